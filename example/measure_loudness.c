@@ -0,0 +1,72 @@
+#include "genesis.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+// measure the loudness of audio files, of every file in the directories
+// given, several at a time
+
+static int usage(char *exe) {
+    fprintf(stderr, "Usage: %s [options] path...\n"
+            "Options:\n"
+            "--threads      how many files to measure at once, one per cpu by default\n", exe);
+    return 1;
+}
+
+static int report_error(enum GenesisError err) {
+    fprintf(stderr, "Error: %s\n", genesis_strerror(err));
+    return 1;
+}
+
+static void on_file(void *userdata, const char *path, int err, const struct GenesisLoudness *loudness) {
+    // called from several threads at once, and each printf is whole
+    if (err) {
+        fprintf(stderr, "%s: %s\n", path, genesis_strerror(err));
+        return;
+    }
+    float true_peak = 0.0f;
+    for (int ch = 0; ch < loudness->channel_count; ch += 1)
+        true_peak = fmaxf(loudness->true_peak[ch], true_peak);
+    printf("%7.1f LUFS %7.1f dBTP  %s\n", loudness->integrated, 20.0 * log10(true_peak), path);
+}
+
+int main(int argc, char **argv) {
+    int thread_count = 0;
+    int first_path = argc;
+
+    for (int i = 1; i < argc; i += 1) {
+        char *arg = argv[i];
+        if (arg[0] == '-' && arg[1] == '-') {
+            arg += 2;
+            if (i + 1 >= argc) {
+                return usage(argv[0]);
+            } else if (strcmp(arg, "threads") == 0) {
+                thread_count = atoi(argv[++i]);
+            } else {
+                return usage(argv[0]);
+            }
+        } else {
+            first_path = i;
+            break;
+        }
+    }
+
+    if (first_path >= argc)
+        return usage(argv[0]);
+
+    struct GenesisContext *context;
+    int err = genesis_context_create(&context);
+    if (err)
+        return report_error(err);
+
+    for (int i = first_path; i < argc; i += 1) {
+        err = genesis_measure_loudness_batch(context, argv[i], thread_count, on_file, NULL);
+        if (err)
+            fprintf(stderr, "%s: %s\n", argv[i], genesis_strerror(err));
+    }
+
+    genesis_context_destroy(context);
+    return 0;
+}
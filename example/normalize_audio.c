@@ -12,7 +12,9 @@ static int usage(char *exe) {
             "Options:\n"
             "--bitrate      bit rate in kbps\n"
             "--format       format of outputfile\n"
-            "--codec        codec of outputfile\n", exe);
+            "--codec        codec of outputfile\n"
+            "--lufs         integrated loudness to normalize to, instead of the peak\n"
+            "--ceiling      highest true peak in dBTP with --lufs, -1 by default\n", exe);
     return 1;
 }
 
@@ -31,6 +33,9 @@ int main(int argc, char **argv) {
     char *format = NULL;
     char *codec_name = NULL;
     int bit_rate_k = 320;
+    bool by_loudness = false;
+    double target_lufs = -23.0;
+    double ceiling_db = -1.0;
 
     for (int i = 1; i < argc; i += 1) {
         char *arg = argv[i];
@@ -44,6 +49,11 @@ int main(int argc, char **argv) {
                 format = argv[++i];
             } else if (strcmp(arg, "codec") == 0) {
                 codec_name = argv[++i];
+            } else if (strcmp(arg, "lufs") == 0) {
+                by_loudness = true;
+                target_lufs = atof(argv[++i]);
+            } else if (strcmp(arg, "ceiling") == 0) {
+                ceiling_db = atof(argv[++i]);
             } else {
                 return usage(argv[0]);
             }
@@ -79,23 +89,39 @@ int main(int argc, char **argv) {
     double seconds = frame_count / (double)sample_rate;
     fprintf(stderr, "%ld frames (%.2f seconds)\n", frame_count, seconds);
 
-    // calculate the maximum sample value
+    // calculate the maximum sample value, or the gain which reaches the
+    // target loudness
     float abs_max = 0.0f;
-    for (int ch = 0; ch < channel_layout->channel_count; ch += 1) {
-        struct GenesisAudioFileIterator it = genesis_audio_file_iterator(audio_file, ch, 0);
-        while (it.start < frame_count) {
-            for (long frame = it.start, offset = 0; frame < it.end; frame += 1, offset += 1) {
-                float sample = it.ptr[offset];
-                abs_max = fmaxf(fabsf(sample), abs_max);
+    float multiplier = 1.0f;
+    if (by_loudness) {
+        struct GenesisLoudness loudness;
+        err = genesis_audio_file_measure_loudness(audio_file, &loudness);
+        if (err)
+            return report_error(err);
+        for (int ch = 0; ch < loudness.channel_count; ch += 1)
+            abs_max = fmaxf(loudness.true_peak[ch], abs_max);
+        fprintf(stderr, "Integrated loudness: %.1f LUFS, true peak: %.1f dBTP\n",
+                loudness.integrated, 20.0 * log10(abs_max));
+        if (isfinite(loudness.integrated))
+            multiplier = genesis_loudness_normalization_gain(&loudness, target_lufs, ceiling_db);
+    } else {
+        for (int ch = 0; ch < channel_layout->channel_count; ch += 1) {
+            struct GenesisAudioFileIterator it = genesis_audio_file_iterator(audio_file, ch, 0);
+            while (it.start < frame_count) {
+                for (long frame = it.start, offset = 0; frame < it.end; frame += 1, offset += 1) {
+                    float sample = it.ptr[offset];
+                    abs_max = fmaxf(fabsf(sample), abs_max);
+                }
+                genesis_audio_file_iterator_next(&it);
             }
-            genesis_audio_file_iterator_next(&it);
         }
+        if (abs_max > 0.0f && abs_max < 1.0f)
+            multiplier = 1.0f / abs_max;
     }
 
     if (abs_max == 0.0f) {
         fprintf(stderr, "Audio stream is completely silent.\n");
-    } else if (abs_max < 1.0f) {
-        float multiplier = 1.0f / abs_max;
+    } else if (multiplier != 1.0f) {
         fprintf(stderr, "Amplification factor: %.3f\n", multiplier);
         for (int ch = 0; ch < channel_layout->channel_count; ch += 1) {
             struct GenesisAudioFileIterator it = genesis_audio_file_iterator(audio_file, ch, 0);
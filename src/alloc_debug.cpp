@@ -0,0 +1,182 @@
+#include "alloc_debug.hpp"
+
+#ifdef GENESIS_ALLOC_DEBUG
+
+#include "util.hpp"
+#include "atomics.hpp"
+
+#include <stdio.h>
+
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#define usable_size malloc_size
+#elif defined(_WIN32)
+#include <malloc.h>
+#define usable_size _msize
+#else
+#include <malloc.h>
+#define usable_size malloc_usable_size
+#endif
+
+// a fixed open addressing table so that counting never allocates. sites
+// past the capacity are lumped into overflow_site.
+static const int SITE_CAPACITY = 4096;
+
+struct AllocSite {
+    atomic_uintptr_t address;
+    atomic_long count;
+    atomic_long bytes;
+};
+
+static AllocSite sites[SITE_CAPACITY];
+static AllocSite overflow_site;
+
+static atomic_long allocation_count;
+static atomic_long free_count;
+static atomic_long live_bytes;
+static atomic_long peak_bytes;
+static atomic_long realtime_allocation_count;
+static atomic_long realtime_lock_count;
+static atomic_uintptr_t last_realtime_site;
+static atomic_int policy;
+
+static thread_local int realtime_depth = 0;
+
+static AllocSite *get_site(uintptr_t address) {
+    uintptr_t h = address;
+    h ^= h >> 17;
+    h *= 0xed5ad4bb;
+    h ^= h >> 11;
+    for (int i = 0; i < SITE_CAPACITY; i += 1) {
+        AllocSite *site = &sites[(h + i) % SITE_CAPACITY];
+        uintptr_t current = site->address.load(std::memory_order_relaxed);
+        if (current == address)
+            return site;
+        if (current == 0) {
+            uintptr_t expected = 0;
+            if (site->address.compare_exchange_strong(expected, address) || expected == address)
+                return site;
+        }
+    }
+    return &overflow_site;
+}
+
+static void realtime_violation(atomic_long *counter, void *site, const char *what) {
+    *counter += 1;
+    last_realtime_site.store((uintptr_t)site);
+    if (policy.load() == AllocDebugPolicyAbort)
+        panic("realtime thread %s at %p", what, site);
+}
+
+static void add_live_bytes(long bytes) {
+    long live = (live_bytes += bytes);
+    long peak = peak_bytes.load(std::memory_order_relaxed);
+    while (live > peak && !peak_bytes.compare_exchange_weak(peak, live)) {}
+}
+
+static void record_alloc(void *ptr, void *caller, long old_bytes) {
+    if (realtime_depth > 0)
+        realtime_violation(&realtime_allocation_count, caller, "allocated memory");
+    long bytes = usable_size(ptr);
+    AllocSite *site = get_site((uintptr_t)caller);
+    site->count.fetch_add(1, std::memory_order_relaxed);
+    site->bytes.fetch_add(bytes, std::memory_order_relaxed);
+    allocation_count += 1;
+    add_live_bytes(bytes - old_bytes);
+}
+
+void alloc_debug_on_alloc(void *ptr) {
+    if (ptr)
+        record_alloc(ptr, __builtin_return_address(0), 0);
+}
+
+void alloc_debug_on_realloc(size_t old_bytes, void *new_ptr) {
+    record_alloc(new_ptr, __builtin_return_address(0), old_bytes);
+}
+
+void alloc_debug_on_free(void *ptr) {
+    if (!ptr)
+        return;
+    if (realtime_depth > 0)
+        realtime_violation(&realtime_allocation_count, __builtin_return_address(0), "freed memory");
+    free_count += 1;
+    live_bytes -= (long)usable_size(ptr);
+}
+
+size_t alloc_debug_size(void *ptr) {
+    return ptr ? usable_size(ptr) : 0;
+}
+
+void alloc_debug_on_lock(void) {
+    if (realtime_depth > 0)
+        realtime_violation(&realtime_lock_count, __builtin_return_address(0), "blocked on a lock");
+}
+
+void realtime_thread_begin(void) {
+    realtime_depth += 1;
+}
+
+void realtime_thread_end(void) {
+    assert(realtime_depth > 0);
+    realtime_depth -= 1;
+}
+
+bool realtime_thread_active(void) {
+    return realtime_depth > 0;
+}
+
+void alloc_debug_set_policy(AllocDebugPolicy new_policy) {
+    policy.store(new_policy);
+}
+
+void alloc_debug_get_stats(AllocDebugStats *stats) {
+    stats->allocation_count = allocation_count.load();
+    stats->free_count = free_count.load();
+    stats->live_bytes = live_bytes.load();
+    stats->peak_bytes = peak_bytes.load();
+    stats->realtime_allocation_count = realtime_allocation_count.load();
+    stats->realtime_lock_count = realtime_lock_count.load();
+    stats->last_realtime_site = (void *)last_realtime_site.load();
+}
+
+void alloc_debug_print_report(int max_site_count) {
+    static const int MAX_REPORT_SITES = 64;
+    max_site_count = clamp(0, max_site_count, MAX_REPORT_SITES);
+    // a partial insertion sort by bytes, largest first
+    AllocSite *top[MAX_REPORT_SITES];
+    int top_count = 0;
+    for (int i = 0; i < SITE_CAPACITY + 1; i += 1) {
+        AllocSite *site = (i < SITE_CAPACITY) ? &sites[i] : &overflow_site;
+        if (site->count.load() == 0)
+            continue;
+        long bytes = site->bytes.load();
+        if (top_count == max_site_count) {
+            if (top_count == 0 || top[top_count - 1]->bytes.load() >= bytes)
+                continue;
+            top_count -= 1;
+        }
+        int j = top_count;
+        for (; j > 0 && top[j - 1]->bytes.load() < bytes; j -= 1)
+            top[j] = top[j - 1];
+        top[j] = site;
+        top_count += 1;
+    }
+
+    AllocDebugStats stats;
+    alloc_debug_get_stats(&stats);
+    fprintf(stderr, "allocations: %ld frees: %ld live bytes: %ld peak bytes: %ld\n",
+            stats.allocation_count, stats.free_count, stats.live_bytes, stats.peak_bytes);
+    fprintf(stderr, "realtime allocations: %ld realtime locks: %ld last at %p\n",
+            stats.realtime_allocation_count, stats.realtime_lock_count, stats.last_realtime_site);
+    fprintf(stderr, "%18s %12s %14s\n", "site", "count", "bytes");
+    for (int i = 0; i < top_count; i += 1) {
+        AllocSite *site = top[i];
+        if (site == &overflow_site)
+            fprintf(stderr, "%18s", "(other)");
+        else
+            fprintf(stderr, "%18p", (void *)site->address.load());
+        fprintf(stderr, " %12ld %14ld\n", site->count.load(), site->bytes.load());
+    }
+}
+
+#endif
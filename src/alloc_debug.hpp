@@ -0,0 +1,71 @@
+#ifndef GENESIS_ALLOC_DEBUG_HPP
+#define GENESIS_ALLOC_DEBUG_HPP
+
+#include "config.h"
+
+#include <stddef.h>
+
+// allocation diagnostics, compiled in with -DGENESIS_ALLOC_DEBUG=ON. the
+// allocators in util.hpp report every allocation here, counted by the
+// address of the function that asked for it, along with live and peak bytes.
+// a thread inside realtime_thread_begin/realtime_thread_end must not touch
+// the heap or block on a lock; when it does, that is recorded as a realtime
+// violation, or the process aborts if that policy is set.
+// without GENESIS_ALLOC_DEBUG all of this compiles to nothing.
+
+enum AllocDebugPolicy {
+    AllocDebugPolicyRecord,
+    AllocDebugPolicyAbort,
+};
+
+struct AllocDebugStats {
+    long allocation_count;
+    long free_count;
+    long live_bytes;
+    long peak_bytes;
+    long realtime_allocation_count;
+    long realtime_lock_count;
+    // the call site of the most recent realtime violation
+    void *last_realtime_site;
+};
+
+#ifdef GENESIS_ALLOC_DEBUG
+
+void alloc_debug_on_alloc(void *ptr) __attribute__((noinline));
+void alloc_debug_on_free(void *ptr) __attribute__((noinline));
+// realloc moves bytes from one allocation to another, so the caller measures
+// the old one before it is gone
+size_t alloc_debug_size(void *ptr);
+void alloc_debug_on_realloc(size_t old_bytes, void *new_ptr) __attribute__((noinline));
+void alloc_debug_on_lock(void) __attribute__((noinline));
+
+// these nest
+void realtime_thread_begin(void);
+void realtime_thread_end(void);
+bool realtime_thread_active(void);
+
+void alloc_debug_set_policy(AllocDebugPolicy policy);
+void alloc_debug_get_stats(AllocDebugStats *stats);
+// writes the sites with the most bytes to stderr. resolve the addresses
+// with addr2line -f -e <binary>.
+void alloc_debug_print_report(int max_site_count);
+
+#else
+
+static inline void alloc_debug_on_alloc(void *) {}
+static inline void alloc_debug_on_free(void *) {}
+static inline size_t alloc_debug_size(void *) { return 0; }
+static inline void alloc_debug_on_realloc(size_t, void *) {}
+static inline void alloc_debug_on_lock(void) {}
+
+static inline void realtime_thread_begin(void) {}
+static inline void realtime_thread_end(void) {}
+static inline bool realtime_thread_active(void) { return false; }
+
+static inline void alloc_debug_set_policy(AllocDebugPolicy) {}
+static inline void alloc_debug_get_stats(AllocDebugStats *stats) { *stats = AllocDebugStats(); }
+static inline void alloc_debug_print_report(int) {}
+
+#endif
+
+#endif
@@ -1,6 +1,7 @@
 #include "alpha_texture.hpp"
 #include "debug_gl.hpp"
 #include "gui.hpp"
+#include "gui_window.hpp"
 
 AlphaTexture::AlphaTexture(Gui *gui) :
     _gui(gui),
@@ -36,28 +37,6 @@ void AlphaTexture::send_pixels(const ByteBuffer &pixels, int width, int height)
 }
 
 void AlphaTexture::draw(GuiWindow *window, const glm::vec4 &color, const glm::mat4 &mvp) {
-    _gui->_shader_program_manager._text_shader_program.bind();
-
-    _gui->_shader_program_manager._text_shader_program.set_uniform(
-            _gui->_shader_program_manager._text_uniform_color, color);
-
-    _gui->_shader_program_manager._text_shader_program.set_uniform(
-            _gui->_shader_program_manager._text_uniform_tex, 0);
-
-    _gui->_shader_program_manager._text_shader_program.set_uniform(
-            _gui->_shader_program_manager._text_uniform_mvp, mvp);
-
-    glBindBuffer(GL_ARRAY_BUFFER, _gui->_static_geometry._rect_2d_vertex_buffer);
-    glEnableVertexAttribArray(_gui->_shader_program_manager._text_attrib_position);
-    glVertexAttribPointer(_gui->_shader_program_manager._text_attrib_position, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-
-    glBindBuffer(GL_ARRAY_BUFFER, _gui->_static_geometry._rect_2d_tex_coord_buffer);
-    glEnableVertexAttribArray(_gui->_shader_program_manager._text_attrib_tex_coord);
-    glVertexAttribPointer(_gui->_shader_program_manager._text_attrib_tex_coord, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, _texture_id);
-
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    window->draw_quad(GuiQuadModeTextureRed, _texture_id, mvp, 1.0f, 1.0f, nullptr, color, color);
 }
 
@@ -2,6 +2,7 @@
 #define ATOMIC_VALUE_HPP
 
 #include "atomics.hpp"
+#include "list.hpp"
 
 // single reader, single writer atomic value
 
@@ -56,4 +57,79 @@ private:
     AtomicValue &operator=(const AtomicValue &copy) = delete;
 };
 
+// single reader, single writer publication of values too big to copy. the
+// writer hands over a value it allocated, and the reader pins the one it
+// reads. the values the writer replaced wait until the reader has pinned a
+// later one and are then destroyed by the writer, as with EventTimeline, so
+// the reader never copies or frees anything.
+
+template<typename T>
+class AtomicPointer {
+public:
+    AtomicPointer() {
+        _current = nullptr;
+        _pinned = nullptr;
+    }
+    // while nothing reads it
+    ~AtomicPointer() {
+        collect(true);
+        destroy(_current.load(), 1);
+    }
+
+    // writer. takes value, which may be null, unless it runs out of memory.
+    int publish(T *value) {
+        T *old_value = _current.load();
+        if (old_value && _retired.append(old_value))
+            return GenesisErrorNoMem;
+        _current.store(value);
+        collect(false);
+        return 0;
+    }
+
+    // writer. destroys the replaced values the reader is done with, which
+    // is all of them when reader_stopped says the reader will not run until
+    // the next publish.
+    void collect(bool reader_stopped) {
+        T *pinned = nullptr;
+        if (reader_stopped)
+            _pinned.store(nullptr);
+        else
+            pinned = _pinned.load();
+        for (int i = _retired.length() - 1; i >= 0; i -= 1) {
+            T *value = _retired.at(i);
+            if (value == pinned)
+                continue;
+            _retired.swap_remove(i);
+            destroy(value, 1);
+        }
+    }
+
+    // writer
+    T *get_write_ptr() {
+        return _current.load();
+    }
+
+    // reader. the value stays valid until the next call. the writer only
+    // destroys a value it finds unpinned after replacing it, so if the value
+    // is still current once it is pinned, the pin was in time.
+    T *get_read_ptr() {
+        T *value = _current.load();
+        for (;;) {
+            _pinned.store(value);
+            T *latest = _current.load();
+            if (latest == value)
+                return value;
+            value = latest;
+        }
+    }
+
+private:
+    std::atomic<T *> _current;
+    std::atomic<T *> _pinned;
+    List<T *> _retired;
+
+    AtomicPointer(const AtomicPointer &copy) = delete;
+    AtomicPointer &operator=(const AtomicPointer &copy) = delete;
+};
+
 #endif
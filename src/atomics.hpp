@@ -24,4 +24,13 @@ using std::atomic_uintptr_t;
 #error "require atomic pointers to be lock free"
 #endif
 
+// hint to the cpu that we are in a spin-wait loop
+static inline void cpu_relax(void) {
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
 #endif
@@ -1,5 +1,9 @@
 #include "audio_file.hpp"
+#include "genesis.hpp"
 #include "os.hpp"
+#include "dsp_kernels.hpp"
+#include "sample_codec.hpp"
+#include "flac_frame.hpp"
 
 #include <stdint.h>
 
@@ -99,172 +103,142 @@ static const int bit_rate_list[] = {
 static const float int24_min = -8388608.0f;
 static const float int24_max = 8388607.0f;
 
-static int import_frame_uint8(const AVFrame *avframe, GenesisAudioFile *audio_file) {
-    uint8_t *ptr = avframe->extended_data[0];
-    double min = 0.0;
-    double max = (double)UINT8_MAX;
-    double half_range = max / 2.0 - min / 2.0;
-    int err = 0;
-    for (int frame = 0; frame < avframe->nb_samples; frame += 1) {
-        for (int ch = 0; ch < audio_file->channels.length(); ch += 1, ptr += 1) {
-            uint8_t sample = *ptr;
-            double dbl_sample = (((double)sample) - min) / half_range - 1.0;
-            err = err || audio_file->channels.at(ch).samples.append(dbl_sample);
-        }
+// frame_count more samples at the end of each channel, channel ch's at
+// dests[ch]. decode_to_end reserves the room up front, so this seldom
+// moves the samples.
+static int extend_channels(GenesisAudioFile *audio_file, int frame_count, float **dests) {
+    for (int ch = 0; ch < audio_file->channels.length(); ch += 1) {
+        List<float> *samples = &audio_file->channels.at(ch).samples;
+        int old_length = samples->length();
+        if (samples->resize(old_length + frame_count))
+            return GenesisErrorNoMem;
+        dests[ch] = samples->raw() + old_length;
     }
-    return err;
+    return 0;
+}
+
+static int import_frame_uint8(const AVFrame *avframe, GenesisAudioFile *audio_file) {
+    float *dests[GENESIS_MAX_CHANNELS];
+    if (extend_channels(audio_file, avframe->nb_samples, dests))
+        return GenesisErrorNoMem;
+    dsp_import_uint8(dests, avframe->extended_data[0], audio_file->channels.length(), avframe->nb_samples);
+    return 0;
 }
 
 static int import_frame_int16(const AVFrame *avframe, GenesisAudioFile *audio_file) {
-    uint8_t *ptr = avframe->extended_data[0];
-    double min = (double)INT16_MIN;
-    double max = (double)INT16_MAX;
-    double half_range = max / 2.0 - min / 2.0;
-    int err = 0;
-    for (int frame = 0; frame < avframe->nb_samples; frame += 1) {
-        for (int ch = 0; ch < audio_file->channels.length(); ch += 1, ptr += 2) {
-            int16_t *sample = reinterpret_cast<int16_t*>(ptr);
-            double dbl_sample = (((double)*sample) - min) / half_range - 1.0;
-            err = err || audio_file->channels.at(ch).samples.append(dbl_sample);
-        }
-    }
-    return err;
+    float *dests[GENESIS_MAX_CHANNELS];
+    if (extend_channels(audio_file, avframe->nb_samples, dests))
+        return GenesisErrorNoMem;
+    dsp_import_int16(dests, reinterpret_cast<const int16_t *>(avframe->extended_data[0]),
+            audio_file->channels.length(), avframe->nb_samples);
+    return 0;
 }
 
 static int import_frame_int32(const AVFrame *avframe, GenesisAudioFile *audio_file) {
-    uint8_t *ptr = avframe->extended_data[0];
-    double min = (double)INT32_MIN;
-    double max = (double)INT32_MAX;
-    double half_range = max / 2.0 - min / 2.0;
-    int err = 0;
-    for (int frame = 0; frame < avframe->nb_samples; frame += 1) {
-        for (int ch = 0; ch < audio_file->channels.length(); ch += 1, ptr += 4) {
-            int32_t *sample = reinterpret_cast<int32_t*>(ptr);
-            double dbl_sample = (((double)*sample) - min) / half_range - 1.0;
-            err = err || audio_file->channels.at(ch).samples.append(dbl_sample);
-        }
-    }
-    return err;
+    float *dests[GENESIS_MAX_CHANNELS];
+    if (extend_channels(audio_file, avframe->nb_samples, dests))
+        return GenesisErrorNoMem;
+    dsp_import_int32(dests, reinterpret_cast<const int32_t *>(avframe->extended_data[0]),
+            audio_file->channels.length(), avframe->nb_samples);
+    return 0;
 }
 
 static int import_frame_float(const AVFrame *avframe, GenesisAudioFile *audio_file) {
-    uint8_t *ptr = avframe->extended_data[0];
-    int err = 0;
-    for (int frame = 0; frame < avframe->nb_samples; frame += 1) {
-        for (int ch = 0; ch < audio_file->channels.length(); ch += 1, ptr += 4) {
-            float *sample = reinterpret_cast<float*>(ptr);
-            double dbl_sample = *sample;
-            err = err || audio_file->channels.at(ch).samples.append(dbl_sample);
-        }
-    }
-    return err;
+    float *dests[GENESIS_MAX_CHANNELS];
+    if (extend_channels(audio_file, avframe->nb_samples, dests))
+        return GenesisErrorNoMem;
+    dsp_import_float(dests, reinterpret_cast<const float *>(avframe->extended_data[0]),
+            audio_file->channels.length(), avframe->nb_samples);
+    return 0;
 }
 
 static int import_frame_double(const AVFrame *avframe, GenesisAudioFile *audio_file) {
-    uint8_t *ptr = avframe->extended_data[0];
-    int err = 0;
-    for (int frame = 0; frame < avframe->nb_samples; frame += 1) {
-        for (int ch = 0; ch < audio_file->channels.length(); ch += 1, ptr += 8) {
-            double *sample = reinterpret_cast<double*>(ptr);
-            err = err || audio_file->channels.at(ch).samples.append(*sample);
-        }
-    }
-    return err;
+    float *dests[GENESIS_MAX_CHANNELS];
+    if (extend_channels(audio_file, avframe->nb_samples, dests))
+        return GenesisErrorNoMem;
+    dsp_import_double(dests, reinterpret_cast<const double *>(avframe->extended_data[0]),
+            audio_file->channels.length(), avframe->nb_samples);
+    return 0;
 }
 
 static int import_frame_uint8_planar(const AVFrame *avframe, GenesisAudioFile *audio_file) {
-    double min = 0.0;
-    double max = (double)UINT8_MAX;
-    double half_range = max / 2.0 - min / 2.0;
-    int err = 0;
-    for (int ch = 0; ch < audio_file->channels.length(); ch += 1) {
-        uint8_t *ptr = avframe->extended_data[ch];
-        Channel *channel = &audio_file->channels.at(ch);
-        for (int frame = 0; frame < avframe->nb_samples; frame += 1, ptr += 1) {
-            uint8_t sample = *ptr;
-            double dbl_sample = (((double)sample) - min) / half_range - 1.0;
-            err = err || channel->samples.append(dbl_sample);
-        }
-    }
-    return err;
+    float *dests[GENESIS_MAX_CHANNELS];
+    if (extend_channels(audio_file, avframe->nb_samples, dests))
+        return GenesisErrorNoMem;
+    for (int ch = 0; ch < audio_file->channels.length(); ch += 1)
+        dsp_import_uint8(&dests[ch], avframe->extended_data[ch], 1, avframe->nb_samples);
+    return 0;
 }
 
 static int import_frame_int16_planar(const AVFrame *avframe, GenesisAudioFile *audio_file) {
-    double min = (double)INT16_MIN;
-    double max = (double)INT16_MAX;
-    double half_range = max / 2.0 - min / 2.0;
-    int err = 0;
+    float *dests[GENESIS_MAX_CHANNELS];
+    if (extend_channels(audio_file, avframe->nb_samples, dests))
+        return GenesisErrorNoMem;
     for (int ch = 0; ch < audio_file->channels.length(); ch += 1) {
-        uint8_t *ptr = avframe->extended_data[ch];
-        Channel *channel = &audio_file->channels.at(ch);
-        for (int frame = 0; frame < avframe->nb_samples; frame += 1, ptr += 2) {
-            int16_t *sample = reinterpret_cast<int16_t*>(ptr);
-            double dbl_sample = (((double)*sample) - min) / half_range - 1.0;
-            err = err || channel->samples.append(dbl_sample);
-        }
+        dsp_import_int16(&dests[ch], reinterpret_cast<const int16_t *>(avframe->extended_data[ch]),
+                1, avframe->nb_samples);
     }
-    return err;
+    return 0;
 }
 
 static int import_frame_int32_planar(const AVFrame *avframe, GenesisAudioFile *audio_file) {
-    double min = (double)INT32_MIN;
-    double max = (double)INT32_MAX;
-    double half_range = max / 2.0 - min / 2.0;
-    int err = 0;
+    float *dests[GENESIS_MAX_CHANNELS];
+    if (extend_channels(audio_file, avframe->nb_samples, dests))
+        return GenesisErrorNoMem;
     for (int ch = 0; ch < audio_file->channels.length(); ch += 1) {
-        uint8_t *ptr = avframe->extended_data[ch];
-        Channel *channel = &audio_file->channels.at(ch);
-        for (int frame = 0; frame < avframe->nb_samples; frame += 1, ptr += 4) {
-            int32_t *sample = reinterpret_cast<int32_t*>(ptr);
-            double dbl_sample = (((double)*sample) - min) / half_range - 1.0;
-            err = err || channel->samples.append(dbl_sample);
-        }
+        dsp_import_int32(&dests[ch], reinterpret_cast<const int32_t *>(avframe->extended_data[ch]),
+                1, avframe->nb_samples);
     }
-    return err;
+    return 0;
 }
 
 static int import_frame_float_planar(const AVFrame *avframe, GenesisAudioFile *audio_file) {
-    int err = 0;
-    for (int ch = 0; ch < audio_file->channels.length(); ch += 1) {
-        uint8_t *ptr = avframe->extended_data[ch];
-        Channel *channel = &audio_file->channels.at(ch);
-        for (int frame = 0; frame < avframe->nb_samples; frame += 1, ptr += 4) {
-            float *sample = reinterpret_cast<float*>(ptr);
-            double dbl_sample = *sample;
-            err = err || channel->samples.append(dbl_sample);
-        }
-    }
-    return err;
+    float *dests[GENESIS_MAX_CHANNELS];
+    if (extend_channels(audio_file, avframe->nb_samples, dests))
+        return GenesisErrorNoMem;
+    for (int ch = 0; ch < audio_file->channels.length(); ch += 1)
+        memcpy(dests[ch], avframe->extended_data[ch], avframe->nb_samples * sizeof(float));
+    return 0;
 }
 
 static int import_frame_double_planar(const AVFrame *avframe, GenesisAudioFile *audio_file) {
-    int err = 0;
+    float *dests[GENESIS_MAX_CHANNELS];
+    if (extend_channels(audio_file, avframe->nb_samples, dests))
+        return GenesisErrorNoMem;
     for (int ch = 0; ch < audio_file->channels.length(); ch += 1) {
-        uint8_t *ptr = avframe->extended_data[ch];
-        Channel *channel = &audio_file->channels.at(ch);
-        for (int frame = 0; frame < avframe->nb_samples; frame += 1, ptr += 8) {
-            double *sample = reinterpret_cast<double*>(ptr);
-            err = err || channel->samples.append(*sample);
-        }
+        dsp_import_double(&dests[ch], reinterpret_cast<const double *>(avframe->extended_data[ch]),
+                1, avframe->nb_samples);
     }
-    return err;
+    return 0;
 }
 
 static int decode_interrupt_cb(void *ctx) {
     return 0;
 }
 
+// adds the time since *start_time to counter and moves *start_time up to now
+static void add_codec_time(atomic_long *counter, uint64_t *start_time) {
+    uint64_t now = os_timestamp();
+    *counter += (long)(os_timestamp_to_seconds(now - *start_time) * 1000000000.0);
+    *start_time = now;
+}
+
 static int decode_frame(GenesisAudioFile *audio_file, AVPacket *pkt,
         AVCodecContext *codec_ctx, AVFrame *in_frame,
         int (*import_frame)(const AVFrame *, GenesisAudioFile *))
 {
+    GenesisContext *context = audio_file->genesis_context;
+    bool stats_enabled = context && context->codec_stats_enabled.load();
     AVPacket pkt_temp = *pkt;
     bool new_packet = true;
     int decoded_byte_count = 0;
     while (pkt_temp.size > 0 || (!pkt_temp.data && new_packet)) {
         new_packet = false;
         int got_frame;
+        uint64_t start_time = stats_enabled ? os_timestamp() : 0;
         int len1 = avcodec_decode_audio4(codec_ctx, in_frame, &got_frame, &pkt_temp);
+        if (stats_enabled)
+            add_codec_time(&context->codec_decode_ns, &start_time);
         if (len1 < 0) {
             if (len1 == AVERROR(ENOMEM)) {
                 return -GenesisErrorNoMem;
@@ -283,6 +257,8 @@ static int decode_frame(GenesisAudioFile *audio_file, AVPacket *pkt,
         }
 
         int err = import_frame(in_frame, audio_file);
+        if (stats_enabled)
+            add_codec_time(&context->codec_import_ns, &start_time);
         if (err)
             return -GenesisErrorNoMem;
         decoded_byte_count += in_frame->nb_samples *
@@ -320,7 +296,7 @@ static SoundIoChannelId from_ffmpeg_channel_id(uint64_t ffmpeg_channel_id) {
 
 static int channel_layout_init_from_ffmpeg(uint64_t ffmpeg_channel_layout, SoundIoChannelLayout *layout) {
     int channel_count = av_get_channel_layout_nb_channels(ffmpeg_channel_layout);
-    if (layout->channel_count > GENESIS_MAX_CHANNELS)
+    if (channel_count > GENESIS_MAX_CHANNELS)
         return GenesisErrorMaxChannelsExceeded;
 
     layout->channel_count = channel_count;
@@ -343,28 +319,22 @@ static int channel_layout_init_from_ffmpeg(uint64_t ffmpeg_channel_layout, Sound
     return 0;
 }
 
-int genesis_audio_file_load(struct GenesisContext *context,
-        const char *input_filename, struct GenesisAudioFile **out_audio_file)
-{
-    *out_audio_file = nullptr;
-    GenesisAudioFile *audio_file = create_zero<GenesisAudioFile>();
-    if (!audio_file) {
-        genesis_audio_file_destroy(audio_file);
-        return GenesisErrorNoMem;
-    }
+// decoders of 24 bit audio put it in the top of 32 bit samples
+static int int32_source_bits(const AVCodecContext *codec_ctx) {
+    int bits = codec_ctx->bits_per_raw_sample;
+    return (bits > 0 && bits <= 24) ? bits : 32;
+}
 
+int audio_file_decoder_open(GenesisAudioFile *audio_file, const char *path) {
     audio_file->ic = avformat_alloc_context();
-    if (!audio_file->ic) {
-        genesis_audio_file_destroy(audio_file);
+    if (!audio_file->ic)
         return GenesisErrorNoMem;
-    }
 
     audio_file->ic->interrupt_callback.callback = decode_interrupt_cb;
     audio_file->ic->interrupt_callback.opaque = NULL;
 
-    int av_err = avformat_open_input(&audio_file->ic, input_filename, NULL, NULL);
+    int av_err = avformat_open_input(&audio_file->ic, path, NULL, NULL);
     if (av_err < 0) {
-        genesis_audio_file_destroy(audio_file);
         if (av_err == AVERROR(ENOMEM)) {
             return GenesisErrorNoMem;
         } else if (av_err == AVERROR(EIO)) {
@@ -380,10 +350,8 @@ int genesis_audio_file_load(struct GenesisContext *context,
         }
     }
 
-    if ((av_err = avformat_find_stream_info(audio_file->ic, NULL)) < 0) {
-        genesis_audio_file_destroy(audio_file);
+    if ((av_err = avformat_find_stream_info(audio_file->ic, NULL)) < 0)
         return GenesisErrorDecodingAudio;
-    }
 
     // set all streams to discard. in a few lines here we will find the audio
     // stream and cancel discarding it
@@ -392,14 +360,11 @@ int genesis_audio_file_load(struct GenesisContext *context,
 
     AVCodec *decoder = NULL;
     int audio_stream_index = av_find_best_stream(audio_file->ic, AVMEDIA_TYPE_AUDIO, -1, -1, &decoder, 0);
-    if (audio_stream_index < 0) {
-        genesis_audio_file_destroy(audio_file);
+    if (audio_stream_index < 0)
         return GenesisErrorNoAudioFound;
-    }
-    if (!decoder) {
-        genesis_audio_file_destroy(audio_file);
+    if (!decoder)
         return GenesisErrorNoDecoderFound;
-    }
+    audio_file->audio_stream_index = audio_stream_index;
 
     AVStream *audio_st = audio_file->ic->streams[audio_stream_index];
     audio_st->discard = AVDISCARD_DEFAULT;
@@ -407,16 +372,14 @@ int genesis_audio_file_load(struct GenesisContext *context,
     audio_file->codec_ctx = audio_st->codec;
     av_err = avcodec_open2(audio_file->codec_ctx, decoder, NULL);
     if (av_err < 0) {
-        genesis_audio_file_destroy(audio_file);
+        audio_file->codec_ctx = nullptr;
         return GenesisErrorDecodingAudio;
     }
 
     if (!audio_file->codec_ctx->channel_layout)
         audio_file->codec_ctx->channel_layout = av_get_default_channel_layout(audio_file->codec_ctx->channels);
-    if (!audio_file->codec_ctx->channel_layout) {
-        genesis_audio_file_destroy(audio_file);
+    if (!audio_file->codec_ctx->channel_layout)
         return GenesisErrorNoAudioFound;
-    }
 
     // copy the audio stream metadata to the context metadata
     av_dict_copy(&audio_file->ic->metadata, audio_st->metadata, 0);
@@ -429,125 +392,1075 @@ int genesis_audio_file_load(struct GenesisContext *context,
 
     int genesis_err = channel_layout_init_from_ffmpeg(audio_file->codec_ctx->channel_layout,
            &audio_file->channel_layout);
-    if (genesis_err) {
-        genesis_audio_file_destroy(audio_file);
+    if (genesis_err)
         return genesis_err;
-    }
 
     audio_file->sample_rate = audio_file->codec_ctx->sample_rate;
     long channel_count = audio_file->channel_layout.channel_count;
 
-    int (*import_frame)(const AVFrame *, GenesisAudioFile *);
     switch (audio_file->codec_ctx->sample_fmt) {
         default:
             panic("unrecognized sample format");
             break;
         case AV_SAMPLE_FMT_U8:
-            import_frame = import_frame_uint8;
+            audio_file->import_frame = import_frame_uint8;
+            audio_file->source_bits = 8;
             break;
         case AV_SAMPLE_FMT_S16:
-            import_frame = import_frame_int16;
+            audio_file->import_frame = import_frame_int16;
+            audio_file->source_bits = 16;
             break;
         case AV_SAMPLE_FMT_S32:
-            import_frame = import_frame_int32;
+            audio_file->import_frame = import_frame_int32;
+            audio_file->source_bits = int32_source_bits(audio_file->codec_ctx);
             break;
         case AV_SAMPLE_FMT_FLT:
-            import_frame = import_frame_float;
+            audio_file->import_frame = import_frame_float;
             break;
         case AV_SAMPLE_FMT_DBL:
-            import_frame = import_frame_double;
+            audio_file->import_frame = import_frame_double;
             break;
 
         case AV_SAMPLE_FMT_U8P:
-            import_frame = import_frame_uint8_planar;
+            audio_file->import_frame = import_frame_uint8_planar;
+            audio_file->source_bits = 8;
             break;
         case AV_SAMPLE_FMT_S16P:
-            import_frame = import_frame_int16_planar;
+            audio_file->import_frame = import_frame_int16_planar;
+            audio_file->source_bits = 16;
             break;
         case AV_SAMPLE_FMT_S32P:
-            import_frame = import_frame_int32_planar;
+            audio_file->import_frame = import_frame_int32_planar;
+            audio_file->source_bits = int32_source_bits(audio_file->codec_ctx);
             break;
         case AV_SAMPLE_FMT_FLTP:
-            import_frame = import_frame_float_planar;
+            audio_file->import_frame = import_frame_float_planar;
             break;
         case AV_SAMPLE_FMT_DBLP:
-            import_frame = import_frame_double_planar;
+            audio_file->import_frame = import_frame_double_planar;
             break;
     }
 
-    if (audio_file->channels.resize(channel_count)) {
-        genesis_audio_file_destroy(audio_file);
+    if (audio_file->channels.resize(channel_count))
         return GenesisErrorNoMem;
-    }
     for (int i = 0; i < audio_file->channels.length(); i += 1) {
         audio_file->channels.at(i).samples.clear();
     }
 
     audio_file->in_frame = av_frame_alloc();
-    if (!audio_file->in_frame) {
-        genesis_audio_file_destroy(audio_file);
+    if (!audio_file->in_frame)
         return GenesisErrorNoMem;
-    }
+
+    audio_file->decoder_flushing = false;
+    return 0;
+}
+
+int audio_file_decoder_next(GenesisAudioFile *audio_file, long *out_frame_index, bool *out_eof) {
+    *out_frame_index = -1;
+    *out_eof = false;
 
     AVPacket pkt;
     memset(&pkt, 0, sizeof(AVPacket));
 
-    for (;;) {
-        av_err = av_read_frame(audio_file->ic, &pkt);
+    while (!audio_file->decoder_flushing) {
+        int av_err = av_read_frame(audio_file->ic, &pkt);
         if (av_err == AVERROR_EOF) {
+            audio_file->decoder_flushing = true;
             break;
         } else if (av_err < 0) {
-            genesis_audio_file_destroy(audio_file);
             return GenesisErrorDecodingAudio;
         }
-        int negative_err = decode_frame(audio_file, &pkt, audio_file->codec_ctx, audio_file->in_frame, import_frame);
+        if (pkt.pts != AV_NOPTS_VALUE) {
+            AVStream *audio_st = audio_file->ic->streams[audio_file->audio_stream_index];
+            *out_frame_index = av_rescale_q(pkt.pts, audio_st->time_base, {1, audio_file->sample_rate});
+        }
+        int negative_err = decode_frame(audio_file, &pkt, audio_file->codec_ctx, audio_file->in_frame,
+                audio_file->import_frame);
         av_free_packet(&pkt);
         if (negative_err == -GenesisErrorDecodingAudio) {
             // ignore decoding errors and try the next frame
-            continue;
+            return 0;
         } else if (negative_err < 0) {
-            genesis_audio_file_destroy(audio_file);
             return -negative_err;
         }
+        return 0;
+    }
+
+    // flush
+    av_init_packet(&pkt);
+    pkt.data = NULL;
+    pkt.size = 0;
+    pkt.stream_index = audio_file->audio_stream_index;
+    int negative_err = decode_frame(audio_file, &pkt, audio_file->codec_ctx, audio_file->in_frame,
+            audio_file->import_frame);
+    if (negative_err == -GenesisErrorDecodingAudio) {
+        // treat decoding errors as EOFs
+        *out_eof = true;
+    } else if (negative_err < 0) {
+        return -negative_err;
+    } else if (negative_err == 0) {
+        *out_eof = true;
+    }
+    return 0;
+}
+
+int audio_file_decoder_seek(GenesisAudioFile *audio_file, long frame_index) {
+    AVStream *audio_st = audio_file->ic->streams[audio_file->audio_stream_index];
+    int64_t timestamp = av_rescale_q(frame_index, {1, audio_file->sample_rate}, audio_st->time_base);
+    if (av_seek_frame(audio_file->ic, audio_file->audio_stream_index, timestamp, AVSEEK_FLAG_BACKWARD) < 0)
+        return GenesisErrorDecodingAudio;
+    avcodec_flush_buffers(audio_file->codec_ctx);
+    audio_file->decoder_flushing = false;
+    for (int i = 0; i < audio_file->channels.length(); i += 1)
+        audio_file->channels.at(i).samples.clear();
+    return 0;
+}
+
+void audio_file_decoder_close(GenesisAudioFile *audio_file) {
+    av_frame_free(&audio_file->in_frame); audio_file->in_frame = nullptr;
+    if (audio_file->codec_ctx) {
+        avcodec_close(audio_file->codec_ctx);
+        audio_file->codec_ctx = nullptr;
+    }
+    if (audio_file->ic) {
+        avformat_close_input(&audio_file->ic);
+        audio_file->ic = nullptr;
+    }
+}
+
+// a little past the end when the container rounds up; readers pad with
+// silence when the decoder ends early
+static long estimate_frame_count(GenesisAudioFile *audio_file) {
+    AVStream *audio_st = audio_file->ic->streams[audio_file->audio_stream_index];
+    if (audio_st->duration != AV_NOPTS_VALUE)
+        return av_rescale_q(audio_st->duration, audio_st->time_base, {1, audio_file->sample_rate});
+    if (audio_file->ic->duration != AV_NOPTS_VALUE)
+        return av_rescale(audio_file->ic->duration, audio_file->sample_rate, AV_TIME_BASE);
+    return -1;
+}
+
+// frames per channel in each of the blocks that decoding spills into once
+// the channels run out of the room reserved for them
+static const int decode_segment_frames = 262144;
+
+struct DecodeSegment {
+    float *samples[GENESIS_MAX_CHANNELS];
+    int frame_count;
+};
+
+static void destroy_decode_segments(List<DecodeSegment> &segments, int channel_count) {
+    for (int i = 0; i < segments.length(); i += 1) {
+        for (int ch = 0; ch < channel_count; ch += 1)
+            destroy(segments.at(i).samples[ch], 0);
+    }
+    segments.clear();
+}
+
+// moves the frames from spill_from on out of the channels and into the
+// segments, so that the channels never have to grow
+static int spill_decoded(GenesisAudioFile *audio_file, int spill_from, List<DecodeSegment> &segments) {
+    int channel_count = audio_file->channels.length();
+    int end = audio_file->channels.at(0).samples.length();
+    for (int frame = spill_from; frame < end;) {
+        if (segments.length() == 0 || segments.last().frame_count == decode_segment_frames) {
+            if (segments.add_one())
+                return GenesisErrorNoMem;
+            DecodeSegment *segment = &segments.last();
+            memset(segment, 0, sizeof(DecodeSegment));
+            for (int ch = 0; ch < channel_count; ch += 1) {
+                if (!(segment->samples[ch] = allocate_nonzero<float>(decode_segment_frames)))
+                    return GenesisErrorNoMem;
+            }
+        }
+        DecodeSegment *segment = &segments.last();
+        int amt = min(end - frame, decode_segment_frames - segment->frame_count);
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            memcpy(segment->samples[ch] + segment->frame_count,
+                    audio_file->channels.at(ch).samples.raw() + frame, amt * sizeof(float));
+        }
+        segment->frame_count += amt;
+        frame += amt;
+    }
+    for (int ch = 0; ch < channel_count; ch += 1)
+        ok_or_panic(audio_file->channels.at(ch).samples.resize(spill_from));
+    return 0;
+}
+
+// puts the spilled frames back after the ones in the channels, freeing each
+// segment as soon as it is copied
+static int join_decoded(GenesisAudioFile *audio_file, List<DecodeSegment> &segments) {
+    int channel_count = audio_file->channels.length();
+    long frame_count = audio_file->channels.at(0).samples.length();
+    for (int i = 0; i < segments.length(); i += 1)
+        frame_count += segments.at(i).frame_count;
+    if (frame_count > INT_MAX)
+        return GenesisErrorNoMem;
+    int offset = audio_file->channels.at(0).samples.length();
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        List<float> *samples = &audio_file->channels.at(ch).samples;
+        if (samples->reserve(frame_count) || samples->resize(frame_count))
+            return GenesisErrorNoMem;
+    }
+    for (int i = 0; i < segments.length(); i += 1) {
+        DecodeSegment *segment = &segments.at(i);
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            memcpy(audio_file->channels.at(ch).samples.raw() + offset, segment->samples[ch],
+                    segment->frame_count * sizeof(float));
+            destroy(segment->samples[ch], 0);
+            segment->samples[ch] = nullptr;
+        }
+        offset += segment->frame_count;
+    }
+    segments.clear();
+    return 0;
+}
+
+// files longer than this many frames for each thread are decoded a region
+// on each thread, when the codec and container can seek to an exact frame
+static const long parallel_decode_min_frames = 1L << 20;
+static const int max_decode_threads = 16;
+
+struct DecodeRegion {
+    GenesisAudioFile *audio_file;
+    const char *path;
+    long start;
+    // -1 for the last region, which goes to the end of the file
+    long end;
+    // the frames from start up to here are in the channels
+    long decoded_end;
+    // optional. stores decoded_end as it grows, and stops decoding early
+    atomic_long *published_end;
+    const atomic_bool *cancel;
+    // place packets one after another from the start of the file instead
+    // of at their timestamps, for codecs which do not decode in regions
+    bool sequential;
+    int err;
+};
+
+// flac frames and pcm packets decode on their own and have exact
+// timestamps. other codecs need samples from before a seek point or only
+// know roughly where one is.
+static bool decodes_in_regions(GenesisAudioFile *audio_file) {
+    AVCodecID codec_id = audio_file->codec_ctx->codec_id;
+    bool exact = (codec_id == AV_CODEC_ID_FLAC) ||
+        (codec_id >= AV_CODEC_ID_FIRST_AUDIO && codec_id < AV_CODEC_ID_ADPCM_IMA_QT);
+    return exact && audio_file->ic->pb && audio_file->ic->pb->seekable;
+}
+
+// decodes the region with a decoder of its own, copying each packet's
+// frames straight to where they go in the channels of audio_file. frames
+// from before the start, where the seek landed, are left out.
+static int decode_region(DecodeRegion *region) {
+    GenesisAudioFile *audio_file = region->audio_file;
+    GenesisAudioFile *decoder = create_zero<GenesisAudioFile>();
+    if (!decoder)
+        return GenesisErrorNoMem;
+    decoder->genesis_context = audio_file->genesis_context;
+
+    int channel_count = audio_file->channels.length();
+    long frame_capacity = audio_file->channels.at(0).samples.length();
+    long end = (region->end >= 0) ? region->end : frame_capacity;
+    int err;
+    if ((err = audio_file_decoder_open(decoder, region->path)) ||
+        (region->start > 0 && (err = audio_file_decoder_seek(decoder, region->start))))
+    {
+        genesis_audio_file_destroy(decoder);
+        return err;
+    }
+    if (decoder->channels.length() != channel_count || decoder->sample_rate != audio_file->sample_rate) {
+        genesis_audio_file_destroy(decoder);
+        return GenesisErrorDecodingAudio;
+    }
+
+    // the frame index of the next frame the decoder gives
+    long position = -1;
+    while (region->decoded_end < end && !(region->cancel && region->cancel->load())) {
+        long frame_index;
+        bool eof;
+        if ((err = audio_file_decoder_next(decoder, &frame_index, &eof)))
+            break;
+        if (frame_index >= 0 && !region->sequential)
+            position = frame_index;
+        else if (position < 0 && region->start == 0)
+            position = 0;
+        int frame_count = decoder->channels.at(0).samples.length();
+        if (frame_count > 0) {
+            // a packet without a timestamp, or one after a gap, cannot be
+            // placed
+            if (position < 0 || position > region->decoded_end) {
+                err = GenesisErrorDecodingAudio;
+                break;
+            }
+            long copy_end = min(position + frame_count, end);
+            if (copy_end > region->decoded_end) {
+                for (int ch = 0; ch < channel_count; ch += 1) {
+                    memcpy(audio_file->channels.at(ch).samples.raw() + region->decoded_end,
+                            decoder->channels.at(ch).samples.raw() + (region->decoded_end - position),
+                            (copy_end - region->decoded_end) * sizeof(float));
+                }
+                region->decoded_end = copy_end;
+                if (region->published_end)
+                    region->published_end->store(copy_end);
+            }
+            // the last region ran past the room in the channels
+            if (region->end < 0 && position + frame_count > frame_capacity) {
+                err = GenesisErrorDecodingAudio;
+                break;
+            }
+            position += frame_count;
+            for (int ch = 0; ch < channel_count; ch += 1)
+                decoder->channels.at(ch).samples.clear();
+        }
+        if (eof)
+            break;
+    }
+    genesis_audio_file_destroy(decoder);
+    return err;
+}
+
+static void run_decode_region(void *userdata) {
+    DecodeRegion *region = (DecodeRegion *)userdata;
+    region->err = decode_region(region);
+}
+
+// into channels sized to frame_capacity up front. returns
+// GenesisErrorDecodingAudio when a region could not be decoded exactly, or
+// the file turned out shorter than the container said, for the caller to
+// decode the file from the start instead.
+static int decode_in_regions(GenesisAudioFile *audio_file, const char *path, long estimate,
+        long frame_capacity, int region_count)
+{
+    int channel_count = audio_file->channels.length();
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        List<float> *samples = &audio_file->channels.at(ch).samples;
+        if (samples->reserve(frame_capacity) || samples->resize(frame_capacity))
+            return GenesisErrorNoMem;
+    }
+
+    DecodeRegion regions[max_decode_threads];
+    OsThread *threads[max_decode_threads];
+    for (int t = 0; t < region_count; t += 1) {
+        DecodeRegion *region = &regions[t];
+        region->audio_file = audio_file;
+        region->path = path;
+        region->start = estimate * t / region_count;
+        region->end = (t + 1 < region_count) ? estimate * (t + 1) / region_count : -1;
+        region->decoded_end = region->start;
+        region->published_end = nullptr;
+        region->cancel = nullptr;
+        region->sequential = false;
+        region->err = 0;
+        threads[t] = nullptr;
+        if (t > 0 && os_thread_create(run_decode_region, region, false, &threads[t]))
+            threads[t] = nullptr;
+    }
+    for (int t = 0; t < region_count; t += 1) {
+        // the first region, and any without a thread, decode here
+        if (!threads[t])
+            run_decode_region(&regions[t]);
+    }
+    for (int t = 0; t < region_count; t += 1)
+        os_thread_destroy(threads[t]);
+
+    int err = 0;
+    for (int t = 0; t < region_count && !err; t += 1) {
+        DecodeRegion *region = &regions[t];
+        err = region->err;
+        if (!err && region->end >= 0 && region->decoded_end < region->end)
+            err = GenesisErrorDecodingAudio;
+    }
+    if (err)
+        return err;
+    long frame_count = regions[region_count - 1].decoded_end;
+    for (int ch = 0; ch < channel_count; ch += 1)
+        ok_or_panic(audio_file->channels.at(ch).samples.resize(frame_count));
+    return 0;
+}
+
+// the channels get as much room as the container says the file is long, so
+// that decoding never copies them to grow them. when there is no length or
+// it was short, the rest is decoded into segments which are joined onto
+// the channels once at the end. long files which can be decoded a region
+// at a time are decoded on several threads from path.
+static int decode_to_end(GenesisAudioFile *audio_file, const char *path) {
+    int channel_count = audio_file->channels.length();
+    long estimate = estimate_frame_count(audio_file);
+    long reserved = decode_segment_frames;
+    if (estimate > 0)
+        reserved += estimate + estimate / 64;
+
+    int region_count = min((long)min(os_concurrency(), max_decode_threads),
+            estimate / parallel_decode_min_frames);
+    if (region_count >= 2 && reserved <= INT_MAX && decodes_in_regions(audio_file)) {
+        int err = decode_in_regions(audio_file, path, estimate, reserved, region_count);
+        if (err != GenesisErrorDecodingAudio)
+            return err;
+        // a region did not decode exactly, so start over the slow way
+        for (int ch = 0; ch < channel_count; ch += 1)
+            audio_file->channels.at(ch).samples.clear();
+    }
+
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        if (audio_file->channels.at(ch).samples.reserve(min(reserved, (long)INT_MAX)))
+            return GenesisErrorNoMem;
+    }
+
+    List<DecodeSegment> segments;
+    int spill_from = -1;
+    int packet_frames = 4096;
+    int err = 0;
+    for (;;) {
+        long frame_index;
+        bool eof;
+        List<float> *samples = &audio_file->channels.at(0).samples;
+        int before = samples->length();
+        if ((err = audio_file_decoder_next(audio_file, &frame_index, &eof)))
+            break;
+        int after = samples->length();
+        packet_frames = max(packet_frames, after - before);
+        if (spill_from < 0 && samples->capacity() - after < 2 * packet_frames)
+            spill_from = after;
+        if (spill_from >= 0 && after > spill_from && (err = spill_decoded(audio_file, spill_from, segments)))
+            break;
+        if (eof)
+            break;
+    }
+    if (!err && segments.length() > 0)
+        err = join_decoded(audio_file, segments);
+    destroy_decode_segments(segments, channel_count);
+    return err;
+}
+
+int genesis_audio_file_load(struct GenesisContext *context,
+        const char *input_filename, struct GenesisAudioFile **out_audio_file)
+{
+    *out_audio_file = nullptr;
+    GenesisAudioFile *audio_file = create_zero<GenesisAudioFile>();
+    if (!audio_file) {
+        genesis_audio_file_destroy(audio_file);
+        return GenesisErrorNoMem;
+    }
+    audio_file->genesis_context = context;
+
+    int err;
+    if ((err = audio_file_decoder_open(audio_file, input_filename))) {
+        genesis_audio_file_destroy(audio_file);
+        return err;
+    }
+    if ((err = decode_to_end(audio_file, input_filename))) {
+        genesis_audio_file_destroy(audio_file);
+        return err;
+    }
+    audio_file_decoder_close(audio_file);
+
+    *out_audio_file = audio_file;
+    return 0;
+}
+
+static void run_progressive_decode(void *userdata) {
+    GenesisAudioFile *audio_file = (GenesisAudioFile *)userdata;
+    DecodeRegion region;
+    region.audio_file = audio_file;
+    region.path = audio_file->path.raw();
+    region.start = 0;
+    region.end = -1;
+    region.decoded_end = 0;
+    region.published_end = &audio_file->decoded_frame_count;
+    region.cancel = &audio_file->decode_cancel;
+    region.sequential = audio_file->progressive_sequential;
+    int err = decode_region(&region);
+    // only ever shrinks, so the samples stay where readers have them
+    for (int ch = 0; ch < audio_file->channels.length(); ch += 1)
+        ok_or_panic(audio_file->channels.at(ch).samples.resize(region.decoded_end));
+    audio_file->decode_err = err;
+    audio_file->decoded_frame_count.store(region.decoded_end);
+    audio_file->decoding.store(false);
+}
+
+// the channels get all the room up front, as in decode_to_end, and readers
+// can use the frames as soon as they are there
+static int start_progressive_decode(GenesisAudioFile *audio_file, const char *path, long estimate) {
+    long frame_capacity = decode_segment_frames + estimate + estimate / 64;
+    for (int ch = 0; ch < audio_file->channels.length(); ch += 1) {
+        List<float> *samples = &audio_file->channels.at(ch).samples;
+        if (samples->reserve(frame_capacity) || samples->resize(frame_capacity))
+            return GenesisErrorNoMem;
+    }
+    audio_file->path.append(path);
+    audio_file->progressive = true;
+    audio_file->progressive_sequential = !decodes_in_regions(audio_file);
+    audio_file->progressive_frame_count = estimate;
+    audio_file->decoded_frame_count.store(0);
+    audio_file->decode_cancel.store(false);
+    audio_file->decoding.store(true);
+    // the thread decodes with a decoder of its own
+    audio_file_decoder_close(audio_file);
+    int err;
+    if ((err = os_thread_create_with_attributes(run_progressive_decode, audio_file,
+                    &audio_file->genesis_context->background_thread_attributes, &audio_file->decode_thread)))
+    {
+        audio_file->decoding.store(false);
+        return err;
+    }
+    return 0;
+}
+
+enum OpenMode {
+    OpenModeDecode,
+    OpenModeProgressive,
+    // streams every file it knows the length of, however short
+    OpenModeStreamed,
+};
+
+// decodes packets until the channels hold head_seconds or the file ends,
+// and moves the first head_seconds of them into heads. a file which ends
+// sooner gets its length from the decoder instead of the container.
+static int decode_head(GenesisAudioFile *audio_file, double head_seconds, List<float> *heads) {
+    int head_frame_count = (int)ceil(head_seconds * audio_file->sample_rate);
+    List<float> *samples = &audio_file->channels.at(0).samples;
+    int err;
+    while (samples->length() < head_frame_count) {
+        long frame_index;
+        bool eof;
+        if ((err = audio_file_decoder_next(audio_file, &frame_index, &eof)))
+            return err;
+        if (eof) {
+            audio_file->streamed_frame_count = min(audio_file->streamed_frame_count, (long)samples->length());
+            break;
+        }
+    }
+    int frame_count = min(samples->length(), head_frame_count);
+    for (int ch = 0; ch < audio_file->channels.length(); ch += 1) {
+        List<float> *channel_samples = &audio_file->channels.at(ch).samples;
+        if ((err = heads[ch].resize(frame_count)))
+            return err;
+        memcpy(heads[ch].raw(), channel_samples->raw(), frame_count * sizeof(float));
+        channel_samples->clear_and_free();
+    }
+    return 0;
+}
+
+// heads is nullptr, or for OpenModeStreamed one list per channel to decode
+// the first head_seconds into
+static int open_audio_file(struct GenesisContext *context, const char *input_filename,
+        OpenMode mode, double head_seconds, List<float> *heads,
+        struct GenesisAudioFile **out_audio_file)
+{
+    *out_audio_file = nullptr;
+    GenesisAudioFile *audio_file = create_zero<GenesisAudioFile>();
+    if (!audio_file) {
+        genesis_audio_file_destroy(audio_file);
+        return GenesisErrorNoMem;
+    }
+    audio_file->genesis_context = context;
+
+    int err;
+    if ((err = audio_file_decoder_open(audio_file, input_filename))) {
+        genesis_audio_file_destroy(audio_file);
+        return err;
+    }
+
+    // without a duration there is no way to know whether it fits
+    long frame_count = estimate_frame_count(audio_file);
+    long decoded_bytes = frame_count * audio_file->channel_layout.channel_count * (long)sizeof(float);
+    bool too_large = decoded_bytes > context->audio_file_resident_bytes;
+    if (frame_count > 0 && (too_large || mode == OpenModeStreamed)) {
+        audio_file->streamed = true;
+        audio_file->streamed_frame_count = frame_count;
+        audio_file->path.append(input_filename);
+        if (heads && (err = decode_head(audio_file, head_seconds, heads))) {
+            genesis_audio_file_destroy(audio_file);
+            return err;
+        }
+    } else if (mode != OpenModeDecode && frame_count > 0 && frame_count < INT_MAX / 2) {
+        if ((err = start_progressive_decode(audio_file, input_filename, frame_count))) {
+            genesis_audio_file_destroy(audio_file);
+            return err;
+        }
+    } else if ((err = decode_to_end(audio_file, input_filename))) {
+        genesis_audio_file_destroy(audio_file);
+        return err;
+    }
+    audio_file_decoder_close(audio_file);
+
+    *out_audio_file = audio_file;
+    return 0;
+}
+
+int genesis_audio_file_open(struct GenesisContext *context,
+        const char *input_filename, struct GenesisAudioFile **out_audio_file)
+{
+    return open_audio_file(context, input_filename, OpenModeDecode, 0.0, nullptr, out_audio_file);
+}
+
+int genesis_audio_file_open_progressive(struct GenesisContext *context,
+        const char *input_filename, struct GenesisAudioFile **out_audio_file)
+{
+    return open_audio_file(context, input_filename, OpenModeProgressive, 0.0, nullptr, out_audio_file);
+}
+
+int genesis_audio_file_open_streamed(struct GenesisContext *context,
+        const char *input_filename, struct GenesisAudioFile **out_audio_file)
+{
+    return open_audio_file(context, input_filename, OpenModeStreamed, 0.0, nullptr, out_audio_file);
+}
+
+int audio_file_open_streamed_head(GenesisContext *context, const char *path, double head_seconds,
+        List<float> *heads, GenesisAudioFile **out_audio_file)
+{
+    return open_audio_file(context, path, OpenModeStreamed, head_seconds, heads, out_audio_file);
+}
+
+bool genesis_audio_file_is_decoding(const struct GenesisAudioFile *audio_file) {
+    return audio_file->progressive && audio_file->decoding.load();
+}
+
+long genesis_audio_file_decoded_frame_count(const struct GenesisAudioFile *audio_file) {
+    if (audio_file->progressive)
+        return audio_file->decoded_frame_count.load();
+    return genesis_audio_file_frame_count(audio_file);
+}
+
+int genesis_audio_file_wait_decoded(struct GenesisAudioFile *audio_file) {
+    if (audio_file->decode_thread) {
+        os_thread_destroy(audio_file->decode_thread);
+        audio_file->decode_thread = nullptr;
+    }
+    return audio_file->decode_err;
+}
+
+bool genesis_audio_file_is_streamed(const struct GenesisAudioFile *audio_file) {
+    return audio_file->streamed;
+}
+
+void genesis_set_audio_file_resident_bytes(struct GenesisContext *context, long bytes) {
+    context->audio_file_resident_bytes = bytes;
+}
+
+long genesis_audio_file_resident_bytes(struct GenesisContext *context) {
+    return context->audio_file_resident_bytes;
+}
+
+void genesis_set_default_sample_storage(struct GenesisContext *context, enum GenesisSampleStorage storage) {
+    context->default_sample_storage = storage;
+}
+
+enum GenesisSampleStorage genesis_default_sample_storage(struct GenesisContext *context) {
+    return context->default_sample_storage;
+}
+
+void genesis_set_audio_asset_cache_bytes(struct GenesisContext *context, long bytes) {
+    context->audio_asset_cache_bytes = bytes;
+}
+
+long genesis_audio_asset_cache_bytes(struct GenesisContext *context) {
+    return context->audio_asset_cache_bytes;
+}
+
+void genesis_set_asset_store_dir(struct GenesisContext *context, const char *dir) {
+    context->asset_store_dir = dir ? dir : "";
+}
+
+const char *genesis_asset_store_dir(struct GenesisContext *context) {
+    return context->asset_store_dir.raw();
+}
+
+void genesis_set_codec_stats_enabled(struct GenesisContext *context, bool enabled) {
+    context->codec_stats_enabled.store(enabled);
+}
+
+void genesis_get_codec_stats(struct GenesisContext *context, struct GenesisCodecStats *out_stats) {
+    out_stats->decode_seconds = context->codec_decode_ns.load() / 1000000000.0;
+    out_stats->import_seconds = context->codec_import_ns.load() / 1000000000.0;
+    out_stats->encode_seconds = context->codec_encode_ns.load() / 1000000000.0;
+    out_stats->export_seconds = context->codec_export_ns.load() / 1000000000.0;
+}
+
+void genesis_reset_codec_stats(struct GenesisContext *context) {
+    context->codec_decode_ns.store(0);
+    context->codec_import_ns.store(0);
+    context->codec_encode_ns.store(0);
+    context->codec_export_ns.store(0);
+}
+
+// the inverse of the import_frame functions for the source depth, which
+// put integers min..max at -1.0..1.0
+static const double int16_half_range = ((double)INT16_MAX - (double)INT16_MIN) / 2.0;
+static const double int32_half_range = ((double)INT32_MAX - (double)INT32_MIN) / 2.0;
+
+static inline int32_t integer_sample(float sample, int sample_bytes) {
+    if (sample_bytes == 2)
+        return clamp((long)INT16_MIN, lrint(sample * int16_half_range - 0.5), (long)INT16_MAX);
+    long value = lrint((sample * int32_half_range - 0.5) / 256.0);
+    return clamp((long)int24_min, value, (long)int24_max);
+}
+
+// integer_sample(sample) turns back into (sample + offset) * scale
+static void integer_sample_scale(int sample_bytes, float *offset, float *scale) {
+    if (sample_bytes == 2) {
+        *offset = 0.5f;
+        *scale = (float)(1.0 / int16_half_range);
+    } else {
+        *offset = 0.5f / 256.0f;
+        *scale = (float)(256.0 / int32_half_range);
+    }
+}
+
+// 0 when the source has no integer depth that holds its samples
+static int source_sample_bytes(int source_bits) {
+    if (source_bits <= 0 || source_bits > 24)
+        return 0;
+    return (source_bits <= 16) ? 2 : 3;
+}
+
+static void compact_channel(const float *src, long frame_count, int sample_bytes, uint8_t *dest) {
+    if (sample_bytes == 2) {
+        int16_t *dest16 = reinterpret_cast<int16_t *>(dest);
+        for (long i = 0; i < frame_count; i += 1)
+            dest16[i] = integer_sample(src[i], sample_bytes);
+    } else {
+        for (long i = 0; i < frame_count; i += 1, dest += 3) {
+            uint32_t bits = (uint32_t)integer_sample(src[i], sample_bytes);
+            dest[0] = bits & 0xff;
+            dest[1] = (bits >> 8) & 0xff;
+            dest[2] = (bits >> 16) & 0xff;
+        }
+    }
+}
+
+// scratch has room for the worst case, so that the result is allocated
+// at its exact size
+static int compress_channel(const float *src, long frame_count, int sample_bytes, List<uint8_t> &scratch,
+        uint8_t **out_samples, long **out_block_offsets)
+{
+    long block_count = (frame_count + SAMPLE_CODEC_BLOCK_FRAMES - 1) / SAMPLE_CODEC_BLOCK_FRAMES;
+    long *block_offsets = allocate_nonzero<long>(block_count + 1);
+    if (!block_offsets)
+        return GenesisErrorNoMem;
+    scratch.clear();
+    int32_t block[SAMPLE_CODEC_BLOCK_FRAMES];
+    for (long block_i = 0; block_i < block_count; block_i += 1) {
+        long start = block_i * SAMPLE_CODEC_BLOCK_FRAMES;
+        int block_frames = min((long)SAMPLE_CODEC_BLOCK_FRAMES, frame_count - start);
+        for (int i = 0; i < block_frames; i += 1)
+            block[i] = integer_sample(src[start + i], sample_bytes);
+        block_offsets[block_i] = scratch.length();
+        sample_codec_encode(block, block_frames, scratch);
+    }
+    block_offsets[block_count] = scratch.length();
+    uint8_t *samples = allocate_nonzero<uint8_t>(max(1, scratch.length()));
+    if (!samples) {
+        destroy(block_offsets, 0);
+        return GenesisErrorNoMem;
+    }
+    memcpy(samples, scratch.raw(), scratch.length());
+    *out_samples = samples;
+    *out_block_offsets = block_offsets;
+    return 0;
+}
+
+static_assert(AUDIO_FILE_CONVERT_FRAMES == SAMPLE_CODEC_BLOCK_FRAMES, "a block converts in one go");
+
+long audio_file_convert_block(const GenesisAudioFile *audio_file, int channel_index, long frame_index,
+        float *dest, int *out_frame_count)
+{
+    float offset, scale;
+    integer_sample_scale(audio_file->integer_sample_bytes, &offset, &scale);
+    long start = frame_index;
+    if (audio_file->storage == GenesisSampleStorageCompressed)
+        start -= frame_index % SAMPLE_CODEC_BLOCK_FRAMES;
+    int frame_count = min((long)AUDIO_FILE_CONVERT_FRAMES, audio_file->integer_frame_count - start);
+    *out_frame_count = frame_count;
+
+    if (audio_file->storage == GenesisSampleStorageCompressed) {
+        const long *block_offsets = audio_file->compressed_block_offsets[channel_index];
+        long block_i = start / SAMPLE_CODEC_BLOCK_FRAMES;
+        sample_codec_decode(audio_file->compressed_samples[channel_index] + block_offsets[block_i],
+                block_offsets[block_i + 1] - block_offsets[block_i], frame_count, offset, scale, dest);
+        return start;
+    }
+    const uint8_t *src = audio_file->compact_samples[channel_index] + start * audio_file->integer_sample_bytes;
+    if (audio_file->integer_sample_bytes == 2)
+        dsp_int16_to_float(dest, reinterpret_cast<const int16_t *>(src), offset, scale, frame_count);
+    else
+        dsp_int24_to_float(dest, src, offset, scale, frame_count);
+    return start;
+}
+
+static void free_integer_samples(GenesisAudioFile *audio_file) {
+    for (int ch = 0; ch < GENESIS_MAX_CHANNELS; ch += 1) {
+        destroy(audio_file->compact_samples[ch], 0);
+        destroy(audio_file->compressed_samples[ch], 0);
+        destroy(audio_file->compressed_block_offsets[ch], 0);
+        audio_file->compact_samples[ch] = nullptr;
+        audio_file->compressed_samples[ch] = nullptr;
+        audio_file->compressed_block_offsets[ch] = nullptr;
+    }
+}
+
+static int restore_float_samples(GenesisAudioFile *audio_file) {
+    int channel_count = audio_file->channel_layout.channel_count;
+    long frame_count = audio_file->integer_frame_count;
+    if (frame_count > INT_MAX)
+        return GenesisErrorNoMem;
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        if (audio_file->channels.at(ch).samples.reserve(frame_count)) {
+            for (int i = 0; i < ch; i += 1)
+                audio_file->channels.at(i).samples.clear_and_free();
+            return GenesisErrorNoMem;
+        }
+    }
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        List<float> *samples = &audio_file->channels.at(ch).samples;
+        ok_or_panic(samples->resize(frame_count));
+        for (long frame = 0; frame < frame_count;) {
+            int block_frames;
+            audio_file_convert_block(audio_file, ch, frame, samples->raw() + frame, &block_frames);
+            frame += block_frames;
+        }
+    }
+    free_integer_samples(audio_file);
+    audio_file->storage = GenesisSampleStorageFloat;
+    return 0;
+}
+
+static int store_integer_samples(GenesisAudioFile *audio_file, GenesisSampleStorage storage) {
+    int sample_bytes = source_sample_bytes(audio_file->source_bits);
+    if (!sample_bytes)
+        return 0;
+    int channel_count = audio_file->channel_layout.channel_count;
+    long frame_count = genesis_audio_file_frame_count(audio_file);
+
+    uint8_t *samples[GENESIS_MAX_CHANNELS] = {};
+    long *block_offsets[GENESIS_MAX_CHANNELS] = {};
+    List<uint8_t> scratch;
+    long max_bytes = ((frame_count + SAMPLE_CODEC_BLOCK_FRAMES - 1) / SAMPLE_CODEC_BLOCK_FRAMES) *
+        sample_codec_max_block_bytes(SAMPLE_CODEC_BLOCK_FRAMES);
+    int err = 0;
+    if (storage == GenesisSampleStorageCompressed && (max_bytes > INT_MAX || scratch.reserve(max_bytes)))
+        err = GenesisErrorNoMem;
+    for (int ch = 0; ch < channel_count && !err; ch += 1) {
+        const float *src = audio_file_channel_samples(audio_file, ch);
+        if (storage == GenesisSampleStorageCompressed) {
+            err = compress_channel(src, frame_count, sample_bytes, scratch, &samples[ch], &block_offsets[ch]);
+        } else if (!(samples[ch] = allocate_nonzero<uint8_t>(max(1L, frame_count * sample_bytes)))) {
+            err = GenesisErrorNoMem;
+        } else {
+            compact_channel(src, frame_count, sample_bytes, samples[ch]);
+        }
+    }
+    if (err) {
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            destroy(samples[ch], 0);
+            destroy(block_offsets[ch], 0);
+        }
+        return err;
+    }
+
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        if (storage == GenesisSampleStorageCompressed) {
+            audio_file->compressed_samples[ch] = samples[ch];
+            audio_file->compressed_block_offsets[ch] = block_offsets[ch];
+        } else {
+            audio_file->compact_samples[ch] = samples[ch];
+        }
+        audio_file->channels.at(ch).samples.clear_and_free();
+    }
+    os_unmap_file(&audio_file->mapped_file);
+    audio_file->integer_sample_bytes = sample_bytes;
+    audio_file->integer_frame_count = frame_count;
+    audio_file->storage = storage;
+    return 0;
+}
+
+int genesis_audio_file_set_sample_storage(struct GenesisAudioFile *audio_file,
+        enum GenesisSampleStorage storage)
+{
+    if (audio_file->streamed || storage == audio_file->storage)
+        return 0;
+    genesis_audio_file_wait_decoded(audio_file);
+    GenesisSampleStorage old_storage = audio_file->storage;
+    int err;
+    if (old_storage != GenesisSampleStorageFloat && (err = restore_float_samples(audio_file)))
+        return err;
+    if (storage == GenesisSampleStorageFloat)
+        return 0;
+    if ((err = store_integer_samples(audio_file, storage))) {
+        if (old_storage != GenesisSampleStorageFloat)
+            store_integer_samples(audio_file, old_storage);
+        return err;
+    }
+    return 0;
+}
+
+enum GenesisSampleStorage genesis_audio_file_sample_storage(const struct GenesisAudioFile *audio_file) {
+    return audio_file->storage;
+}
+
+long genesis_audio_file_memory_bytes(const struct GenesisAudioFile *audio_file) {
+    if (audio_file->streamed)
+        return 0;
+    int channel_count = audio_file->channel_layout.channel_count;
+    long frame_count = genesis_audio_file_frame_count(audio_file);
+    if (audio_file->storage == GenesisSampleStorageCompact)
+        return frame_count * audio_file->integer_sample_bytes * channel_count;
+    if (audio_file->storage == GenesisSampleStorageCompressed) {
+        long block_count = (frame_count + SAMPLE_CODEC_BLOCK_FRAMES - 1) / SAMPLE_CODEC_BLOCK_FRAMES;
+        long bytes = 0;
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            bytes += audio_file->compressed_block_offsets[ch][block_count];
+            bytes += (block_count + 1) * (long)sizeof(long);
+        }
+        return bytes;
+    }
+    if (audio_file->mapped_file.address)
+        return audio_file->mapped_file.size;
+    long bytes = 0;
+    for (int ch = 0; ch < audio_file->channels.length(); ch += 1)
+        bytes += audio_file->channels.at(ch).samples.capacity() * (long)sizeof(float);
+    return bytes;
+}
+
+void genesis_audio_file_destroy(struct GenesisAudioFile *audio_file) {
+    if (audio_file) {
+        audio_file->decode_cancel.store(true);
+        genesis_audio_file_wait_decoded(audio_file);
+        av_frame_free(&audio_file->in_frame);
+        if (audio_file->codec_ctx)
+            avcodec_close(audio_file->codec_ctx);
+        if (audio_file->ic)
+            avformat_close_input(&audio_file->ic);
+        os_unmap_file(&audio_file->mapped_file);
+        free_integer_samples(audio_file);
+        destroy(audio_file, 1);
+    }
+}
+
+// decoded sample files are a cache which only this machine reads back, so
+// they are in native byte order. the samples of each channel are
+// contiguous so that they can be used straight from the mapping.
+static const char decoded_file_magic[8] = {'G', 'N', 'S', 'D', 'E', 'C', '0', '2'};
+static const long decoded_file_alignment = 4096;
+
+struct DecodedFileHeader {
+    char magic[8];
+    int32_t sample_rate;
+    int32_t channel_count;
+    int32_t channel_ids[GENESIS_MAX_CHANNELS];
+    int64_t frame_count;
+    // frames from the start of one channel to the start of the next
+    int64_t channel_stride;
+    int32_t source_bits;
+};
+static_assert(sizeof(DecodedFileHeader) <= decoded_file_alignment, "header must fit before the samples");
+
+static bool write_zeroes(FILE *f, long byte_count) {
+    static const char zeroes[decoded_file_alignment] = {0};
+    while (byte_count > 0) {
+        long amt = min(byte_count, decoded_file_alignment);
+        if (fwrite(zeroes, 1, amt, f) != (size_t)amt)
+            return false;
+        byte_count -= amt;
+    }
+    return true;
+}
+
+int genesis_audio_file_write_decoded(struct GenesisAudioFile *audio_file, const char *path) {
+    if (audio_file->streamed || audio_file->storage != GenesisSampleStorageFloat)
+        return GenesisErrorInvalidParam;
+    genesis_audio_file_wait_decoded(audio_file);
+
+    long frame_count = genesis_audio_file_frame_count(audio_file);
+    long frames_per_page = decoded_file_alignment / sizeof(float);
+    DecodedFileHeader header;
+    memset(&header, 0, sizeof(DecodedFileHeader));
+    memcpy(header.magic, decoded_file_magic, sizeof(header.magic));
+    header.sample_rate = audio_file->sample_rate;
+    header.channel_count = audio_file->channel_layout.channel_count;
+    for (int ch = 0; ch < header.channel_count; ch += 1)
+        header.channel_ids[ch] = audio_file->channel_layout.channels[ch];
+    header.frame_count = frame_count;
+    header.channel_stride = ((frame_count + frames_per_page - 1) / frames_per_page) * frames_per_page;
+    header.source_bits = audio_file->source_bits;
+
+    // written next to path and renamed over it, so that a reader never sees
+    // half of a file
+    OsTempFile tmp_file;
+    int err;
+    if ((err = os_create_temp_file(os_path_dirname(path).raw(), &tmp_file)))
+        return err;
+
+    bool ok = fwrite(&header, sizeof(DecodedFileHeader), 1, tmp_file.file) == 1 &&
+        write_zeroes(tmp_file.file, decoded_file_alignment - sizeof(DecodedFileHeader));
+    for (int ch = 0; ok && ch < header.channel_count; ch += 1) {
+        const float *samples = audio_file_channel_samples(audio_file, ch);
+        ok = fwrite(samples, sizeof(float), frame_count, tmp_file.file) == (size_t)frame_count &&
+            write_zeroes(tmp_file.file, (header.channel_stride - frame_count) * sizeof(float));
+    }
+    if (fclose(tmp_file.file))
+        ok = false;
+    if (!ok) {
+        os_delete(tmp_file.path.raw());
+        return GenesisErrorFileAccess;
+    }
+    if ((err = os_rename_clobber(tmp_file.path.raw(), path))) {
+        os_delete(tmp_file.path.raw());
+        return err;
+    }
+    return 0;
+}
+
+int genesis_audio_file_map_decoded(struct GenesisContext *context,
+        const char *path, struct GenesisAudioFile **out_audio_file)
+{
+    *out_audio_file = nullptr;
+    GenesisAudioFile *audio_file = create_zero<GenesisAudioFile>();
+    if (!audio_file)
+        return GenesisErrorNoMem;
+    audio_file->genesis_context = context;
+
+    int err;
+    if ((err = os_map_file(path, &audio_file->mapped_file))) {
+        genesis_audio_file_destroy(audio_file);
+        return err;
     }
 
-    // flush
-    for (;;) {
-        av_init_packet(&pkt);
-        pkt.data = NULL;
-        pkt.size = 0;
-        pkt.stream_index = audio_stream_index;
-        int negative_err = decode_frame(audio_file, &pkt, audio_file->codec_ctx, audio_file->in_frame, import_frame);
-        if (negative_err == -GenesisErrorDecodingAudio) {
-            // treat decoding errors as EOFs
-            break;
-        } else if (negative_err < 0) {
-            genesis_audio_file_destroy(audio_file);
-            return -negative_err;
-        } else if (negative_err == 0) {
-            break;
-        }
+    size_t size = audio_file->mapped_file.size;
+    const DecodedFileHeader *header = reinterpret_cast<DecodedFileHeader *>(audio_file->mapped_file.address);
+    if (size < (size_t)decoded_file_alignment ||
+        memcmp(header->magic, decoded_file_magic, sizeof(header->magic)) != 0 ||
+        header->sample_rate <= 0 ||
+        header->channel_count <= 0 || header->channel_count > GENESIS_MAX_CHANNELS ||
+        header->frame_count < 0 || header->channel_stride < header->frame_count ||
+        header->source_bits < 0 || header->source_bits > 32 ||
+        (size - decoded_file_alignment) / sizeof(float) / header->channel_count <
+            (size_t)header->channel_stride)
+    {
+        genesis_audio_file_destroy(audio_file);
+        return GenesisErrorDecodingAudio;
     }
 
-    av_frame_free(&audio_file->in_frame); audio_file->in_frame = nullptr;
-    avcodec_close(audio_file->codec_ctx); audio_file->codec_ctx = nullptr;
-    avformat_close_input(&audio_file->ic); audio_file->ic = nullptr;
+    audio_file->sample_rate = header->sample_rate;
+    audio_file->source_bits = header->source_bits;
+    audio_file->channel_layout.name = nullptr;
+    audio_file->channel_layout.channel_count = header->channel_count;
+    for (int ch = 0; ch < header->channel_count; ch += 1)
+        audio_file->channel_layout.channels[ch] = (SoundIoChannelId)header->channel_ids[ch];
+    soundio_channel_layout_detect_builtin(&audio_file->channel_layout);
+
+    if (audio_file->channels.resize(header->channel_count)) {
+        genesis_audio_file_destroy(audio_file);
+        return GenesisErrorNoMem;
+    }
+    float *samples = reinterpret_cast<float *>(audio_file->mapped_file.address + decoded_file_alignment);
+    for (int ch = 0; ch < header->channel_count; ch += 1)
+        audio_file->mapped_samples[ch] = samples + ch * header->channel_stride;
+    audio_file->mapped_frame_count = header->frame_count;
 
     *out_audio_file = audio_file;
     return 0;
 }
 
-void genesis_audio_file_destroy(struct GenesisAudioFile *audio_file) {
-    if (audio_file) {
-        av_frame_free(&audio_file->in_frame);
-        if (audio_file->codec_ctx)
-            avcodec_close(audio_file->codec_ctx);
-        if (audio_file->ic)
-            avformat_close_input(&audio_file->ic);
-        destroy(audio_file, 1);
-    }
-}
-
 GenesisAudioFileCodec *audio_file_guess_audio_file_codec(
         List<GenesisRenderFormat*> &out_formats, const char *filename_hint,
         const char *format_name, const char *codec_name)
@@ -672,172 +1585,70 @@ static void set_codec_ctx_format(AVCodecContext *codec_ctx, GenesisExportFormat
     }
 }
 
-static void write_frames_uint8_planar(const float *frames, int channel_count,
-        int offset, int end, uint8_t *buffer, AVFrame *frame)
-{
-    for (int ch = 0; ch < channel_count; ch += 1) {
-        uint8_t *ch_buf = frame->extended_data[ch] + offset;
-        for (int i = 0; i < end; i += 1) {
-            float sample = frames[i * channel_count + ch];
-            *ch_buf = (uint8_t)clamp(0.0f, (sample * 127.5f) + 127.5f, (float)UINT8_MAX);
-            ch_buf += 1;
-        }
-    }
-}
-
-static void write_frames_int16_planar(const float *frames, int channel_count,
-        int offset, int end, uint8_t *buffer, AVFrame *frame)
-{
-    for (int ch = 0; ch < channel_count; ch += 1) {
-        int16_t *ch_buf = reinterpret_cast<int16_t*>(frame->extended_data[ch] + offset);
-        for (int i = 0; i < end; i += 1) {
-            float sample = frames[i * channel_count + ch];
-            *ch_buf = (int16_t)clamp((float)INT16_MIN, sample * 32767.0f, (float)INT16_MAX);
-            ch_buf += 1;
-        }
-    }
-}
-
-static void write_frames_int32_planar(const float *frames, int channel_count,
-        int offset, int end, uint8_t *buffer, AVFrame *frame)
-{
-    for (int ch = 0; ch < channel_count; ch += 1) {
-        int32_t *ch_buf = reinterpret_cast<int32_t*>(frame->extended_data[ch] + offset);
-        for (int i = 0; i < end; i += 1) {
-            float sample = frames[i * channel_count + ch];
-            *ch_buf = (int32_t)clamp((double)INT32_MIN, sample * 2147483647.0, (double)INT32_MAX);
-            ch_buf += 1;
-        }
-    }
-}
-
-static void write_frames_int24_planar(const float *frames, int channel_count,
-        int offset, int end, uint8_t *buffer, AVFrame *frame)
-{
-
-    for (int ch = 0; ch < channel_count; ch += 1) {
-        int32_t *ch_buf = reinterpret_cast<int32_t*>(frame->extended_data[ch] + offset);
-        for (int i = 0; i < end; i += 1) {
-            float sample = frames[i * channel_count + ch];
-            // ffmpeg looks at the most significant bytes
-            *ch_buf = ((int32_t)clamp(int24_min, sample * 8388607.0f, int24_max)) << 8;
-            ch_buf += 1;
-        }
-    }
+static void convert_samples_uint8(uint8_t *dest, const float *src, int count, DspDither *dither) {
+    dsp_export_uint8(dest, src, count, dither);
 }
 
-static void write_frames_float_planar(const float *frames, int channel_count,
-        int offset, int end, uint8_t *buffer, AVFrame *frame)
-{
-    for (int ch = 0; ch < channel_count; ch += 1) {
-        float *ch_buf = reinterpret_cast<float*>(frame->extended_data[ch] + offset);
-        for (int i = 0; i < end; i += 1) {
-            float sample = frames[i * channel_count + ch];
-            *ch_buf = (float)sample;
-            ch_buf += 1;
-        }
-    }
+static void convert_samples_int16(uint8_t *dest, const float *src, int count, DspDither *dither) {
+    dsp_export_int16(reinterpret_cast<int16_t *>(dest), src, count, dither);
 }
 
-static void write_frames_double_planar(const float *frames, int channel_count,
-        int offset, int end, uint8_t *buffer, AVFrame *frame)
-{
-    for (int ch = 0; ch < channel_count; ch += 1) {
-        double *ch_buf = reinterpret_cast<double*>(frame->extended_data[ch] + offset);
-        for (int i = 0; i < end; i += 1) {
-            float sample = frames[i * channel_count + ch];
-            *ch_buf = sample;
-            ch_buf += 1;
-        }
-    }
+static void convert_samples_int24(uint8_t *dest, const float *src, int count, DspDither *dither) {
+    dsp_export_int24(reinterpret_cast<int32_t *>(dest), src, count, dither);
 }
 
-static void write_frames_uint8(const float *frames, int channel_count,
-        int offset, int end, uint8_t *buffer, AVFrame *)
-{
-    for (int i = 0; i < end; i += 1) {
-        for (int ch = 0; ch < channel_count; ch += 1) {
-            float sample = frames[i * channel_count + ch];
-
-            *buffer = (uint8_t)clamp(0.0f, (sample * 127.5f) + 127.5f, (float)UINT8_MAX);
-
-            buffer += 1;
-        }
-    }
+static void convert_samples_int32(uint8_t *dest, const float *src, int count, DspDither *) {
+    dsp_export_int32(reinterpret_cast<int32_t *>(dest), src, count);
 }
 
-static void write_frames_int16(const float *frames, int channel_count,
-        int offset, int end, uint8_t *buffer, AVFrame *)
-{
-    for (int i = 0; i < end; i += 1) {
-        for (int ch = 0; ch < channel_count; ch += 1) {
-            float sample = frames[i * channel_count + ch];
-
-            int16_t *int_ptr = reinterpret_cast<int16_t*>(buffer);
-            *int_ptr = (int16_t)clamp((float)INT16_MIN, sample * 32767.0f, (float)INT16_MAX);
-
-            buffer += 2;
-        }
-    }
+static void convert_samples_float(uint8_t *dest, const float *src, int count, DspDither *) {
+    memcpy(dest, src, count * sizeof(float));
 }
 
-static void write_frames_int32(const float *frames, int channel_count,
-        int offset, int end, uint8_t *buffer, AVFrame *)
-{
-    for (int i = 0; i < end; i += 1) {
-        for (int ch = 0; ch < channel_count; ch += 1) {
-            float sample = frames[i * channel_count + ch];
-
-            int32_t *int_ptr = reinterpret_cast<int32_t*>(buffer);
-            *int_ptr = (int32_t)clamp((double)INT32_MIN, sample * 2147483647.0, (double)INT32_MAX);
-
-            buffer += 4;
-        }
-    }
+static void convert_samples_double(uint8_t *dest, const float *src, int count, DspDither *) {
+    dsp_export_double(reinterpret_cast<double *>(dest), src, count);
 }
 
-static void write_frames_int24(const float *frames, int channel_count,
-        int offset, int end, uint8_t *buffer, AVFrame *)
-{
-    for (int i = 0; i < end; i += 1) {
-        for (int ch = 0; ch < channel_count; ch += 1) {
-            float sample = frames[i * channel_count + ch];
+// planar formats take the frames a chunk at a time, deinterleaved onto the
+// stack and converted from there
+static const int write_planar_chunk_frames = 128;
 
-            int32_t *int_ptr = reinterpret_cast<int32_t*>(buffer);
-            // ffmpeg looks at the most significant bytes
-            *int_ptr = ((int32_t)clamp(int24_min, sample * 8388607.0f, int24_max) << 8);
+// how many frames at a time go to encoders which take any number
+static const int variable_frame_size_frames = 8192;
 
-            buffer += 4;
-        }
+// frame_count interleaved frames into the frame being filled, after the
+// ones already in it
+static void convert_frames(GenesisAudioFileStream *afs, const float *frames, int frame_count) {
+    int channel_count = afs->channel_layout.channel_count;
+    DspDither *dither = afs->dithered ? &afs->dither : nullptr;
+    if (!afs->is_planar) {
+        afs->convert_samples(afs->frame_buffer + afs->pkt_offset * afs->bytes_per_frame,
+                frames, frame_count * channel_count, dither);
+        return;
     }
-}
-
-static void write_frames_float(const float *frames, int channel_count,
-        int offset, int end, uint8_t *buffer, AVFrame *)
-{
-    for (int i = 0; i < end; i += 1) {
+    const DspChannelKernels *kernels = dsp_channel_kernels(channel_count);
+    float chunk[GENESIS_MAX_CHANNELS * write_planar_chunk_frames];
+    for (int frame = 0; frame < frame_count; frame += write_planar_chunk_frames) {
+        int amt = min(write_planar_chunk_frames, frame_count - frame);
+        kernels->deinterleave(channel_count, chunk, write_planar_chunk_frames,
+                frames + frame * channel_count, amt);
+        int byte_offset = (afs->pkt_offset + frame) * afs->bytes_per_sample;
         for (int ch = 0; ch < channel_count; ch += 1) {
-            float sample = frames[i * channel_count + ch];
-
-            float *float_ptr = reinterpret_cast<float*>(buffer);
-            *float_ptr = (float)sample;
-
-            buffer += 4;
+            afs->convert_samples(afs->frame->extended_data[ch] + byte_offset,
+                    chunk + ch * write_planar_chunk_frames, amt, dither);
         }
     }
 }
 
-static void write_frames_double(const float *frames, int channel_count,
-        int offset, int end, uint8_t *buffer, AVFrame *)
-{
-    for (int i = 0; i < end; i += 1) {
-        for (int ch = 0; ch < channel_count; ch += 1) {
-            float sample = frames[i * channel_count + ch];
-            double *double_ptr = reinterpret_cast<double*>(buffer);
-            *double_ptr = sample;
-            buffer += 8;
-        }
+static void write_frames(GenesisAudioFileStream *afs, const float *frames, int frame_count) {
+    GenesisContext *context = afs->genesis_context;
+    if (!context || !context->codec_stats_enabled.load()) {
+        convert_frames(afs, frames, frame_count);
+        return;
     }
+    uint64_t start_time = os_timestamp();
+    convert_frames(afs, frames, frame_count);
+    add_codec_time(&context->codec_export_ns, &start_time);
 }
 
 static uint64_t to_ffmpeg_channel_id(enum SoundIoChannelId channel_id) {
@@ -879,6 +1690,10 @@ int genesis_audio_file_export(struct GenesisAudioFile *audio_file,
         const char *output_filename, int output_filename_len,
         struct GenesisExportFormat *export_format)
 {
+    if (audio_file->streamed || audio_file->storage != GenesisSampleStorageFloat)
+        return GenesisErrorInvalidParam;
+    genesis_audio_file_wait_decoded(audio_file);
+
     GenesisAudioFileStream *afs = genesis_audio_file_stream_create(audio_file->genesis_context);
     if (!afs) {
         genesis_audio_file_stream_destroy(afs);
@@ -909,10 +1724,8 @@ int genesis_audio_file_export(struct GenesisAudioFile *audio_file,
     float frame[GENESIS_MAX_CHANNELS];
     long frame_count = genesis_audio_file_frame_count(audio_file);
     for (long frame_i = 0; frame_i < frame_count; frame_i += 1) {
-        for (int ch = 0; ch < audio_file->channels.length(); ch += 1) {
-            Channel *channel = &audio_file->channels.at(ch);
-            frame[ch] = channel->samples.at(frame_i);
-        }
+        for (int ch = 0; ch < audio_file->channels.length(); ch += 1)
+            frame[ch] = audio_file_channel_samples(audio_file, ch)[frame_i];
         genesis_audio_file_stream_write(afs, frame, 1);
     }
 
@@ -1102,6 +1915,14 @@ const struct SoundIoChannelLayout *genesis_audio_file_channel_layout(const struc
 }
 
 long genesis_audio_file_frame_count(const struct GenesisAudioFile *audio_file) {
+    if (audio_file->streamed)
+        return audio_file->streamed_frame_count;
+    if (audio_file->progressive && audio_file->decoding.load())
+        return audio_file->progressive_frame_count;
+    if (audio_file->storage != GenesisSampleStorageFloat)
+        return audio_file->integer_frame_count;
+    if (audio_file->mapped_file.address)
+        return audio_file->mapped_frame_count;
     return audio_file->channels.at(0).samples.length();
 }
 
@@ -1112,17 +1933,27 @@ int genesis_audio_file_sample_rate(const struct GenesisAudioFile *audio_file) {
 struct GenesisAudioFileIterator genesis_audio_file_iterator(
         struct GenesisAudioFile *audio_file, int channel_index, long start_frame_index)
 {
-    long frame_count = genesis_audio_file_frame_count(audio_file);
+    assert(!audio_file->streamed);
+    assert(audio_file->storage == GenesisSampleStorageFloat);
+    long frame_count = genesis_audio_file_decoded_frame_count(audio_file);
     return {
         audio_file,
         start_frame_index,
         frame_count,
-        audio_file->channels.at(channel_index).samples.raw() + start_frame_index,
+        audio_file_channel_samples(audio_file, channel_index) + start_frame_index,
     };
 }
 
 void genesis_audio_file_iterator_next(struct GenesisAudioFileIterator *it) {
-    long frame_count = genesis_audio_file_frame_count(it->audio_file);
+    GenesisAudioFile *audio_file = it->audio_file;
+    long frame_count = genesis_audio_file_decoded_frame_count(audio_file);
+    if (audio_file->progressive && frame_count > it->end) {
+        // the frames decoded since, which stay where they are
+        it->ptr += it->end - it->start;
+        it->start = it->end;
+        it->end = frame_count;
+        return;
+    }
     it->start = frame_count;
     it->end = frame_count;
     it->ptr = nullptr;
@@ -1183,6 +2014,7 @@ struct GenesisAudioFile *genesis_audio_file_create(struct GenesisContext *contex
         return nullptr;
     }
 
+    audio_file->genesis_context = context;
     audio_file->sample_rate = sample_rate;
     audio_file->channel_layout = *soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono);
     if (audio_file->channels.resize(1)) {
@@ -1202,7 +2034,7 @@ void genesis_audio_file_set_sample_rate(struct GenesisAudioFile *audio_file,
 int genesis_audio_file_set_channel_layout(struct GenesisAudioFile *audio_file,
         const SoundIoChannelLayout *channel_layout)
 {
-    int err = audio_file->channels.resize(audio_file->channel_layout.channel_count);
+    int err = audio_file->channels.resize(channel_layout->channel_count);
     if (err)
         return err;
     audio_file->channel_layout = *channel_layout;
@@ -1297,6 +2129,7 @@ struct GenesisAudioFileStream *genesis_audio_file_stream_create(struct GenesisCo
     GenesisAudioFileStream *afs = create_zero<GenesisAudioFileStream>();
     if (!afs)
         return nullptr;
+    afs->genesis_context = context;
 
     return afs;
 }
@@ -1361,6 +2194,335 @@ static int64_t afs_avio_seek(void *opaque, int64_t offset, int whence) {
     return -1;
 }
 
+// the most threads a stream encodes flac frames on
+static const int max_encode_threads = 16;
+
+struct EncodeJob {
+    AVFrame *frame;
+    uint8_t *frame_buffer;
+    AVPacket pkt;
+    bool got_packet;
+    // the packet with its frame number counted from the start of the
+    // stream instead of from the start of its encoder
+    List<uint8_t> renumbered;
+    bool done;
+};
+
+struct EncodeWorker {
+    AudioFileEncodePool *pool;
+    AVCodecContext *codec_ctx;
+    OsThread *thread;
+};
+
+// flac frames do not depend on each other, so each worker has an encoder
+// of its own which frames go to in whatever order the workers take them.
+// the muxer gets them back in order.
+struct AudioFileEncodePool {
+    GenesisContext *genesis_context;
+    OsMutex *mutex;
+    OsCond *cond;
+    EncodeWorker *workers;
+    int worker_count;
+    // frame index i is filled and encoded in jobs[i % job_count]
+    EncodeJob *jobs;
+    int job_count;
+    int frame_size;
+    int frame_buffer_size;
+    // frames before next_write are written, those before next_take are
+    // taken by a worker and those before next_submit are filled
+    long next_write;
+    long next_take;
+    long next_submit;
+    bool quit;
+
+    // for the streaminfo the main encoder writes at the end, which knows
+    // about none of the frames
+    AVMD5 *md5;
+    int md5_sample_bytes;
+    int sample_bytes;
+    List<uint8_t> md5_scratch;
+    int min_packet_size;
+    int max_packet_size;
+};
+
+static void set_codec_ctx(AVCodecContext *codec_ctx, GenesisAudioFileStream *afs,
+        uint64_t channel_layout, bool *is_planar)
+{
+    codec_ctx->bit_rate = afs->export_format.bit_rate;
+    set_codec_ctx_format(codec_ctx, &afs->export_format, is_planar);
+    codec_ctx->sample_rate = afs->export_format.sample_rate;
+    codec_ctx->channel_layout = channel_layout;
+    codec_ctx->channels = afs->channel_layout.channel_count;
+    codec_ctx->strict_std_compliance = FF_COMPLIANCE_EXPERIMENTAL;
+}
+
+static void open_codec_ctx(AVCodecContext *codec_ctx, AVCodec *codec) {
+    int err;
+    if ((err = avcodec_open2(codec_ctx, codec, NULL)) < 0) {
+        char buf[256];
+        av_strerror(err, buf, sizeof(buf));
+        panic("unable to open codec: %s", buf);
+    }
+}
+
+static void init_frame(AVCodecContext *codec_ctx, int frame_count, int buffer_size,
+        AVFrame **out_frame, uint8_t **out_buffer)
+{
+    AVFrame *frame = av_frame_alloc();
+    if (!frame)
+        panic("error allocating frame");
+
+    frame->pts = 0;
+    frame->nb_samples = frame_count;
+    frame->format = codec_ctx->sample_fmt;
+    frame->channel_layout = codec_ctx->channel_layout;
+
+    uint8_t *buffer = ok_mem(allocate_nonzero<uint8_t>(buffer_size));
+
+    int err = avcodec_fill_audio_frame(frame, codec_ctx->channels, codec_ctx->sample_fmt,
+            buffer, buffer_size, 0);
+    if (err < 0) {
+        char buf[256];
+        av_strerror(err, buf, sizeof(buf));
+        panic("error setting up audio frame: %s", buf);
+    }
+    *out_frame = frame;
+    *out_buffer = buffer;
+}
+
+// avcodec_encode_audio2, timed for the codec stats
+static int encode_audio(GenesisContext *context, AVCodecContext *codec_ctx, AVPacket *pkt,
+        const AVFrame *frame, int *got_packet)
+{
+    if (!context || !context->codec_stats_enabled.load())
+        return avcodec_encode_audio2(codec_ctx, pkt, frame, got_packet);
+    uint64_t start_time = os_timestamp();
+    int err = avcodec_encode_audio2(codec_ctx, pkt, frame, got_packet);
+    add_codec_time(&context->codec_encode_ns, &start_time);
+    return err;
+}
+
+static void encode_job(AudioFileEncodePool *pool, AVCodecContext *codec_ctx, EncodeJob *job, long index) {
+    av_init_packet(&job->pkt);
+    job->pkt.data = NULL; // packet data will be allocated by the encoder
+    job->pkt.size = 0;
+    int got_packet = 0;
+    int err = encode_audio(pool->genesis_context, codec_ctx, &job->pkt, job->frame, &got_packet);
+    if (err < 0) {
+        char buf[256];
+        av_strerror(err, buf, sizeof(buf));
+        panic("error encoding audio frame: %s", buf);
+    }
+    job->got_packet = got_packet;
+    if (got_packet && (err = flac_frame_renumber(job->pkt.data, job->pkt.size,
+                    index, index * pool->frame_size, job->renumbered)))
+    {
+        panic("unable to renumber flac frame: %s", genesis_strerror(err));
+    }
+}
+
+static void encode_worker_run(void *arg) {
+    EncodeWorker *worker = (EncodeWorker *)arg;
+    AudioFileEncodePool *pool = worker->pool;
+    os_mutex_lock(pool->mutex);
+    for (;;) {
+        if (pool->next_take < pool->next_submit) {
+            long index = pool->next_take;
+            pool->next_take += 1;
+            EncodeJob *job = &pool->jobs[index % pool->job_count];
+            os_mutex_unlock(pool->mutex);
+            encode_job(pool, worker->codec_ctx, job, index);
+            os_mutex_lock(pool->mutex);
+            job->done = true;
+            os_cond_broadcast(pool->cond, pool->mutex);
+        } else if (pool->quit) {
+            break;
+        } else {
+            os_cond_wait(pool->cond, pool->mutex);
+        }
+    }
+    os_mutex_unlock(pool->mutex);
+}
+
+// the md5 in streaminfo is of the samples as they went in, little endian
+// and in as few bytes as the sample size needs
+static void update_md5(AudioFileEncodePool *pool, const uint8_t *frame_buffer) {
+    if (pool->md5_sample_bytes == pool->sample_bytes) {
+        av_md5_update(pool->md5, frame_buffer, pool->frame_buffer_size);
+        return;
+    }
+    int sample_count = pool->frame_buffer_size / pool->sample_bytes;
+    uint8_t *dest = pool->md5_scratch.raw();
+    const int32_t *src = reinterpret_cast<const int32_t *>(frame_buffer);
+    for (int i = 0; i < sample_count; i += 1) {
+        for (int byte = 0; byte < pool->md5_sample_bytes; byte += 1)
+            *dest++ = src[i] >> (8 * byte);
+    }
+    av_md5_update(pool->md5, pool->md5_scratch.raw(), sample_count * pool->md5_sample_bytes);
+}
+
+static void write_encoded_job(GenesisAudioFileStream *afs, EncodeJob *job) {
+    AudioFileEncodePool *pool = afs->encode_pool;
+    update_md5(pool, job->frame_buffer);
+    if (!job->got_packet)
+        return;
+
+    int size = job->renumbered.length();
+    pool->min_packet_size = pool->max_packet_size ? min(pool->min_packet_size, size) : size;
+    pool->max_packet_size = max(pool->max_packet_size, size);
+
+    AVPacket pkt;
+    av_init_packet(&pkt);
+    pkt.data = job->renumbered.raw();
+    pkt.size = size;
+    pkt.pts = job->pkt.pts;
+    pkt.dts = job->pkt.dts;
+    pkt.duration = job->pkt.duration;
+    pkt.flags = job->pkt.flags;
+    int err = av_write_frame(afs->fmt_ctx, &pkt);
+    if (err < 0)
+        panic("error writing frame");
+    av_free_packet(&job->pkt);
+}
+
+// the pool mutex must be locked. writes the encoded jobs in order, waiting
+// for ones still encoding until no more than keep_count are left.
+static void write_encoded_jobs(GenesisAudioFileStream *afs, long keep_count) {
+    AudioFileEncodePool *pool = afs->encode_pool;
+    while (pool->next_write < pool->next_submit) {
+        EncodeJob *job = &pool->jobs[pool->next_write % pool->job_count];
+        if (!job->done) {
+            if (pool->next_submit - pool->next_write <= keep_count)
+                break;
+            os_cond_wait(pool->cond, pool->mutex);
+            continue;
+        }
+        os_mutex_unlock(pool->mutex);
+        write_encoded_job(afs, job);
+        os_mutex_lock(pool->mutex);
+        pool->next_write += 1;
+    }
+}
+
+// hands the filled frame to the workers and moves on to the next job,
+// once it has been written
+static void submit_encode_job(GenesisAudioFileStream *afs) {
+    AudioFileEncodePool *pool = afs->encode_pool;
+    os_mutex_lock(pool->mutex);
+    EncodeJob *job = &pool->jobs[pool->next_submit % pool->job_count];
+    job->done = false;
+    job->frame->pts = pool->next_submit * pool->frame_size;
+    pool->next_submit += 1;
+    os_cond_broadcast(pool->cond, pool->mutex);
+    write_encoded_jobs(afs, pool->job_count - 1);
+    os_mutex_unlock(pool->mutex);
+
+    EncodeJob *next_job = &pool->jobs[pool->next_submit % pool->job_count];
+    afs->frame = next_job->frame;
+    afs->frame_buffer = next_job->frame_buffer;
+}
+
+static void destroy_encode_pool(GenesisAudioFileStream *afs) {
+    AudioFileEncodePool *pool = afs->encode_pool;
+    if (!pool)
+        return;
+
+    if (pool->mutex && pool->cond) {
+        os_mutex_lock(pool->mutex);
+        pool->quit = true;
+        os_cond_broadcast(pool->cond, pool->mutex);
+        os_mutex_unlock(pool->mutex);
+    }
+    if (pool->workers) {
+        for (int i = 0; i < pool->worker_count; i += 1) {
+            EncodeWorker *worker = &pool->workers[i];
+            os_thread_destroy(worker->thread);
+            if (worker->codec_ctx) {
+                avcodec_close(worker->codec_ctx);
+                av_free(worker->codec_ctx);
+            }
+        }
+        destroy(pool->workers, pool->worker_count);
+    }
+    if (pool->jobs) {
+        for (int i = 0; i < pool->job_count; i += 1) {
+            EncodeJob *job = &pool->jobs[i];
+            av_frame_free(&job->frame);
+            destroy(job->frame_buffer, pool->frame_buffer_size);
+        }
+        destroy(pool->jobs, pool->job_count);
+    }
+    av_free(pool->md5);
+    os_cond_destroy(pool->cond);
+    os_mutex_destroy(pool->mutex);
+    destroy(pool, 1);
+
+    afs->encode_pool = nullptr;
+    afs->frame = nullptr;
+    afs->frame_buffer = nullptr;
+}
+
+static int start_encode_pool(GenesisAudioFileStream *afs, AVCodec *codec, AVCodecContext *codec_ctx,
+        int worker_count)
+{
+    AudioFileEncodePool *pool = create_zero<AudioFileEncodePool>();
+    if (!pool)
+        return GenesisErrorNoMem;
+    afs->encode_pool = pool;
+
+    pool->genesis_context = afs->genesis_context;
+    pool->frame_size = afs->buffer_frame_count;
+    pool->frame_buffer_size = afs->frame_buffer_size;
+    pool->sample_bytes = av_get_bytes_per_sample(codec_ctx->sample_fmt);
+    pool->md5_sample_bytes = (codec_ctx->bits_per_raw_sample + 7) / 8;
+    if (pool->md5_sample_bytes != pool->sample_bytes &&
+        pool->md5_scratch.resize(pool->frame_buffer_size / pool->sample_bytes * pool->md5_sample_bytes))
+    {
+        return GenesisErrorNoMem;
+    }
+    if (!(pool->md5 = av_md5_alloc()))
+        return GenesisErrorNoMem;
+    av_md5_init(pool->md5);
+    if (!(pool->mutex = os_mutex_create()))
+        return GenesisErrorNoMem;
+    if (!(pool->cond = os_cond_create()))
+        return GenesisErrorNoMem;
+
+    // enough for every worker to have a frame while the next ones fill
+    pool->job_count = worker_count * 2 + 1;
+    pool->jobs = allocate_class<EncodeJob>(pool->job_count);
+    for (int i = 0; i < pool->job_count; i += 1) {
+        EncodeJob *job = &pool->jobs[i];
+        init_frame(codec_ctx, pool->frame_size, pool->frame_buffer_size, &job->frame, &job->frame_buffer);
+        job->got_packet = false;
+        job->done = true;
+    }
+
+    pool->workers = allocate_zero<EncodeWorker>(worker_count);
+    if (!pool->workers)
+        return GenesisErrorNoMem;
+    pool->worker_count = worker_count;
+    for (int i = 0; i < worker_count; i += 1) {
+        EncodeWorker *worker = &pool->workers[i];
+        worker->pool = pool;
+        if (!(worker->codec_ctx = avcodec_alloc_context3(codec)))
+            return GenesisErrorNoMem;
+        bool is_planar;
+        set_codec_ctx(worker->codec_ctx, afs, codec_ctx->channel_layout, &is_planar);
+        open_codec_ctx(worker->codec_ctx, codec);
+        if (worker->codec_ctx->frame_size != codec_ctx->frame_size)
+            panic("flac encoders disagree on the frame size");
+    }
+    for (int i = 0; i < worker_count; i += 1) {
+        int err;
+        if ((err = os_thread_create(encode_worker_run, &pool->workers[i], false, &pool->workers[i].thread)))
+            return err;
+    }
+
+    afs->frame = pool->jobs[0].frame;
+    afs->frame_buffer = pool->jobs[0].frame_buffer;
+    return 0;
+}
 
 int genesis_audio_file_stream_open(struct GenesisAudioFileStream *afs,
         const char *file_path, int file_path_len)
@@ -1415,23 +2577,15 @@ int genesis_audio_file_stream_open(struct GenesisAudioFileStream *afs,
     afs->stream->time_base.num = 1;
 
     AVCodecContext *codec_ctx = afs->stream->codec;
-    codec_ctx->bit_rate = afs->export_format.bit_rate;
     bool is_planar;
-    set_codec_ctx_format(codec_ctx, &afs->export_format, &is_planar);
-    codec_ctx->sample_rate = afs->export_format.sample_rate;
-    codec_ctx->channel_layout = out_channel_layout;
-    codec_ctx->channels = afs->channel_layout.channel_count;
-    codec_ctx->strict_std_compliance = FF_COMPLIANCE_EXPERIMENTAL;
+    set_codec_ctx(codec_ctx, afs, out_channel_layout, &is_planar);
 
     if (afs->fmt_ctx->oformat->flags & AVFMT_GLOBALHEADER)
         codec_ctx->flags |= CODEC_FLAG_GLOBAL_HEADER;
 
+    open_codec_ctx(codec_ctx, codec);
+
     int err;
-    if ((err = avcodec_open2(codec_ctx, codec, NULL)) < 0) {
-        char buf[256];
-        av_strerror(err, buf, sizeof(buf));
-        panic("unable to open codec: %s", buf);
-    }
 
     // copy metadata to format context
     av_dict_free(&afs->fmt_ctx->metadata);
@@ -1451,88 +2605,60 @@ int genesis_audio_file_stream_open(struct GenesisAudioFileStream *afs,
         panic("error writing header: %s", buf);
     }
 
-    afs->frame = av_frame_alloc();
-    if (!afs->frame)
-        panic("error allocating frame");
-
-    if (codec_ctx->frame_size) {
-        afs->frame_buffer_size = av_samples_get_buffer_size(NULL, codec_ctx->channels,
-            codec_ctx->frame_size, codec_ctx->sample_fmt, 0);
-        if (afs->frame_buffer_size < 0) {
-            char buf[256];
-            av_strerror(err, buf, sizeof(buf));
-            panic("error determining buffer size: %s", buf);
-        }
-    } else {
-        afs->frame_buffer_size = 16 * 1024;
+    // an encoder without a frame size takes any number of frames, so it gets
+    // a lot of them at once
+    int buffer_frames = codec_ctx->frame_size ? codec_ctx->frame_size : variable_frame_size_frames;
+    afs->frame_buffer_size = av_samples_get_buffer_size(NULL, codec_ctx->channels,
+        buffer_frames, codec_ctx->sample_fmt, 0);
+    if (afs->frame_buffer_size < 0) {
+        char buf[256];
+        av_strerror(afs->frame_buffer_size, buf, sizeof(buf));
+        panic("error determining buffer size: %s", buf);
     }
     int bytes_per_sample = av_get_bytes_per_sample(codec_ctx->sample_fmt);
     afs->buffer_frame_count = afs->frame_buffer_size / bytes_per_sample / codec_ctx->channels;
 
-    afs->frame->pts = 0;
-    afs->frame->nb_samples = afs->buffer_frame_count;
-    afs->frame->format = codec_ctx->sample_fmt;
-    afs->frame->channel_layout = codec_ctx->channel_layout;
-
-    afs->frame_buffer = ok_mem(allocate_nonzero<uint8_t>(afs->frame_buffer_size));
-
-    err = avcodec_fill_audio_frame(afs->frame, codec_ctx->channels, codec_ctx->sample_fmt,
-            afs->frame_buffer, afs->frame_buffer_size, 0);
-    if (err < 0) {
-        char buf[256];
-        av_strerror(err, buf, sizeof(buf));
-        panic("error setting up audio frame: %s", buf);
-    }
-
-    if (is_planar) {
-        switch (afs->export_format.sample_format) {
-            case SoundIoFormatU8:
-                afs->write_frames = write_frames_uint8_planar;
-                break;
-            case SoundIoFormatS16NE:
-                afs->write_frames = write_frames_int16_planar;
-                break;
-            case SoundIoFormatS24NE:
-                afs->write_frames = write_frames_int24_planar;
-                break;
-            case SoundIoFormatS32NE:
-                afs->write_frames = write_frames_int32_planar;
-                break;
-            case SoundIoFormatFloat32NE:
-                afs->write_frames = write_frames_float_planar;
-                break;
-            case SoundIoFormatFloat64NE:
-                afs->write_frames = write_frames_double_planar;
-                break;
-            default:
-                panic("invalid sample format");
+    // leaves a cpu for whatever is producing the frames
+    int encode_threads = min(os_concurrency() - 1, max_encode_threads);
+    if (afs->export_format.codec->render_format->render_format_type == RenderFormatTypeFlac &&
+        codec_ctx->frame_size && encode_threads >= 1)
+    {
+        if ((err = start_encode_pool(afs, codec, codec_ctx, encode_threads))) {
+            destroy_encode_pool(afs);
+            genesis_audio_file_stream_close(afs);
+            return err;
         }
     } else {
-        switch (afs->export_format.sample_format) {
-            case SoundIoFormatU8:
-                afs->write_frames = write_frames_uint8;
-                break;
-            case SoundIoFormatS16NE:
-                afs->write_frames = write_frames_int16;
-                break;
-            case SoundIoFormatS24NE:
-                afs->write_frames = write_frames_int24;
-                break;
-            case SoundIoFormatS32NE:
-                afs->write_frames = write_frames_int32;
-                break;
-            case SoundIoFormatFloat32NE:
-                afs->write_frames = write_frames_float;
-                break;
-            case SoundIoFormatFloat64NE:
-                afs->write_frames = write_frames_double;
-                break;
-            default:
-                panic("invalid sample format");
-        }
+        init_frame(codec_ctx, afs->buffer_frame_count, afs->frame_buffer_size,
+                &afs->frame, &afs->frame_buffer);
+    }
+
+    switch (afs->export_format.sample_format) {
+        case SoundIoFormatU8:
+            afs->convert_samples = convert_samples_uint8;
+            break;
+        case SoundIoFormatS16NE:
+            afs->convert_samples = convert_samples_int16;
+            break;
+        case SoundIoFormatS24NE:
+            afs->convert_samples = convert_samples_int24;
+            break;
+        case SoundIoFormatS32NE:
+            afs->convert_samples = convert_samples_int32;
+            break;
+        case SoundIoFormatFloat32NE:
+            afs->convert_samples = convert_samples_float;
+            break;
+        case SoundIoFormatFloat64NE:
+            afs->convert_samples = convert_samples_double;
+            break;
+        default:
+            panic("invalid sample format");
     }
-    if (!afs->write_frames)
-        panic("invalid sample format");
+    afs->is_planar = is_planar;
+    // a fixed seed, so that the same render gives the same file
+    afs->dithered = (afs->export_format.dither == GenesisDitherTriangular);
+    dsp_dither_init(&afs->dither, 0x9e3779b9);
 
     afs->bytes_per_sample = soundio_get_bytes_per_sample(afs->export_format.sample_format);
     afs->bytes_per_frame = afs->bytes_per_sample * afs->channel_layout.channel_count;
@@ -1548,16 +2674,45 @@ int genesis_audio_file_stream_open(struct GenesisAudioFileStream *afs,
 int genesis_audio_file_stream_close(struct GenesisAudioFileStream *afs) {
     int err;
     if (afs->fmt_ctx) {
+        bool patch_streaminfo = false;
+        uint64_t total_samples = 0;
+        int min_packet_size = 0;
+        int max_packet_size = 0;
+        uint8_t md5[16];
+        if (afs->encode_pool) {
+            AudioFileEncodePool *pool = afs->encode_pool;
+            os_mutex_lock(pool->mutex);
+            write_encoded_jobs(afs, 0);
+            os_mutex_unlock(pool->mutex);
+            patch_streaminfo = true;
+            total_samples = pool->next_submit * pool->frame_size;
+            min_packet_size = pool->min_packet_size;
+            max_packet_size = pool->max_packet_size;
+            av_md5_final(pool->md5, md5);
+            destroy_encode_pool(afs);
+        }
         // flush the encoder
         for (;;) {
             int got_packet = 0;
-            err = avcodec_encode_audio2(afs->stream->codec, &afs->pkt, NULL, &got_packet);
+            err = encode_audio(afs->genesis_context, afs->stream->codec, &afs->pkt, NULL, &got_packet);
             if (err < 0) {
                 char buf[256];
                 av_strerror(err, buf, sizeof(buf));
                 panic("error encoding audio frame: %s", buf);
             }
             if (got_packet) {
+                if (patch_streaminfo) {
+                    // the main encoder saw none of the frames
+                    int streaminfo_size;
+                    uint8_t *streaminfo = av_packet_get_side_data(&afs->pkt,
+                            AV_PKT_DATA_NEW_EXTRADATA, &streaminfo_size);
+                    if (streaminfo && streaminfo_size == FLAC_STREAMINFO_SIZE) {
+                        flac_streaminfo_patch(streaminfo, total_samples,
+                                min_packet_size, max_packet_size, md5);
+                    }
+                    afs->pkt.pts = total_samples;
+                    afs->pkt.dts = total_samples;
+                }
                 err = av_write_frame(afs->fmt_ctx, &afs->pkt);
                 if (err < 0)
                     panic("error writing frame");
@@ -1598,6 +2753,8 @@ int genesis_audio_file_stream_close(struct GenesisAudioFileStream *afs) {
         afs->file = nullptr;
     }
 
+    destroy_encode_pool(afs);
+
     destroy(afs->frame_buffer, afs->frame_buffer_size);
     afs->frame_buffer = nullptr;
 
@@ -1616,11 +2773,8 @@ int genesis_audio_file_stream_write(struct GenesisAudioFileStream *afs,
     int pkt_frames_left = afs->buffer_frame_count - afs->pkt_offset;
 
     while (source_frame_count > 0) {
-        int interleaved_byte_offset = afs->pkt_offset * afs->bytes_per_frame;
-        int planar_byte_offset = afs->pkt_offset * afs->bytes_per_sample;
         int write_count = min(pkt_frames_left, source_frame_count);
-        afs->write_frames(frames, channel_count, planar_byte_offset,
-                write_count, afs->frame_buffer + interleaved_byte_offset, afs->frame);
+        write_frames(afs, frames, write_count);
         afs->pkt_offset += write_count;
         pkt_frames_left = afs->buffer_frame_count - afs->pkt_offset;
 
@@ -1628,9 +2782,13 @@ int genesis_audio_file_stream_write(struct GenesisAudioFileStream *afs,
         source_frame_count -= write_count;
 
 
-        if (pkt_frames_left <= 0) {
+        if (pkt_frames_left <= 0 && afs->encode_pool) {
+            submit_encode_job(afs);
+            afs->pkt_offset = 0;
+            pkt_frames_left = afs->buffer_frame_count;
+        } else if (pkt_frames_left <= 0) {
             int got_packet = 0;
-            err = avcodec_encode_audio2(afs->stream->codec, &afs->pkt, afs->frame, &got_packet);
+            err = encode_audio(afs->genesis_context, afs->stream->codec, &afs->pkt, afs->frame, &got_packet);
             if (err < 0) {
                 char buf[256];
                 av_strerror(err, buf, sizeof(buf));
@@ -3,9 +3,12 @@
 
 #include "genesis.h"
 #include "list.hpp"
-#include "hash_map.hpp"
+#include "flat_hash_map.hpp"
 #include "byte_buffer.hpp"
 #include "ffmpeg.hpp"
+#include "os.hpp"
+#include "dsp_kernels.hpp"
+#include "atomics.hpp"
 
 struct Channel {
     List<float> samples;
@@ -15,20 +18,89 @@ struct GenesisAudioFile {
     List<Channel> channels;
     SoundIoChannelLayout channel_layout;
     int sample_rate;
-    HashMap<ByteBuffer, ByteBuffer, ByteBuffer::hash> tags;
+    FlatHashMap<ByteBuffer, ByteBuffer, ByteBuffer::hash> tags;
     AVFormatContext *ic;
     AVCodecContext *codec_ctx;
     AVFrame *in_frame;
     GenesisContext *genesis_context;
+    int audio_stream_index;
+    int (*import_frame)(const AVFrame *, GenesisAudioFile *);
+    bool decoder_flushing;
+
+    // too large to keep decoded. each reader opens its own decoder on path.
+    bool streamed;
+    long streamed_frame_count;
+    ByteBuffer path;
+
+    // samples mapped from a file written by genesis_audio_file_write_decoded
+    // instead of held in channels
+    OsMappedFile mapped_file;
+    float *mapped_samples[GENESIS_MAX_CHANNELS];
+    long mapped_frame_count;
+
+    // bits per sample of the integer samples the decoder produced, or 0
+    // when it produced floats
+    int source_bits;
+    // with GenesisSampleStorageCompact or GenesisSampleStorageCompressed
+    // the samples are integers at the source depth instead of floats in
+    // channels. compact_samples are int16_t for sources of up to 16 bits,
+    // otherwise three little endian bytes a sample.
+    GenesisSampleStorage storage;
+    int integer_sample_bytes;
+    long integer_frame_count;
+    uint8_t *compact_samples[GENESIS_MAX_CHANNELS];
+    // block i of a channel is bytes compressed_block_offsets[ch][i] up to
+    // compressed_block_offsets[ch][i + 1] of compressed_samples[ch]
+    uint8_t *compressed_samples[GENESIS_MAX_CHANNELS];
+    long *compressed_block_offsets[GENESIS_MAX_CHANNELS];
+
+    // opened with genesis_audio_file_open_progressive. decode_thread
+    // decodes from path into channels which were sized up front, so the
+    // samples never move. frames before decoded_frame_count are ready,
+    // and it only grows. until decoding is done the frame count is
+    // progressive_frame_count, from the container.
+    bool progressive;
+    bool progressive_sequential;
+    long progressive_frame_count;
+    OsThread *decode_thread;
+    atomic_long decoded_frame_count;
+    atomic_bool decoding;
+    atomic_bool decode_cancel;
+    int decode_err;
 };
 
+// the most frames audio_file_convert_block converts at once
+static const int AUDIO_FILE_CONVERT_FRAMES = 4096;
+
+// converts a block of one channel of a compact or compressed file to
+// floats in dest, which has room for AUDIO_FILE_CONVERT_FRAMES. the block
+// holds frame_index and starts there for compact files, or at the start of
+// the compressed block for compressed ones. returns where it starts.
+long audio_file_convert_block(const GenesisAudioFile *audio_file, int channel_index, long frame_index,
+        float *dest, int *out_frame_count);
+
+// the decoded samples of one channel of a file which is neither streamed
+// nor held as integers
+static inline float *audio_file_channel_samples(GenesisAudioFile *audio_file, int channel_index) {
+    assert(audio_file->storage == GenesisSampleStorageFloat);
+    if (audio_file->mapped_file.address)
+        return audio_file->mapped_samples[channel_index];
+    return audio_file->channels.at(channel_index).samples.raw();
+}
+
+struct AudioFileEncodePool;
+
 struct GenesisAudioFileStream {
+    GenesisContext *genesis_context;
     SoundIoChannelLayout channel_layout;
     int sample_rate;
-    HashMap<ByteBuffer, ByteBuffer, ByteBuffer::hash> tags;
+    FlatHashMap<ByteBuffer, ByteBuffer, ByteBuffer::hash> tags;
     GenesisExportFormat export_format;
-    void (*write_frames)(const float *frames, int channel_count,
-            int offset, int end, uint8_t *buffer, AVFrame *frame);
+    // count contiguous samples into a plane, or into the interleaved buffer
+    void (*convert_samples)(uint8_t *dest, const float *src, int count, DspDither *dither);
+    bool is_planar;
+    bool dithered;
+    DspDither dither;
     FILE *file;
     AVIOContext *avio;
     AVFormatContext *fmt_ctx;
@@ -43,6 +115,9 @@ struct GenesisAudioFileStream {
     int avio_buffer_size;
     int bytes_per_frame;
     int bytes_per_sample;
+    // flac frames are encoded on these threads, and then frame and
+    // frame_buffer are those of the job being filled
+    AudioFileEncodePool *encode_pool;
 };
 
 struct GenesisAudioFileCodec {
@@ -92,5 +167,27 @@ GenesisAudioFileCodec *audio_file_guess_audio_file_codec(
 
 uint64_t channel_layout_to_libav(const SoundIoChannelLayout *channel_layout);
 
+// opens path for decoding into the channels of audio_file and fills in the
+// channel layout, sample rate and tags
+int __attribute__((warn_unused_result)) audio_file_decoder_open(
+        GenesisAudioFile *audio_file, const char *path);
+// decodes one more packet, appending its samples to the channels.
+// out_frame_index is the frame index of the first new sample, or -1 if the
+// container does not say.
+int __attribute__((warn_unused_result)) audio_file_decoder_next(
+        GenesisAudioFile *audio_file, long *out_frame_index, bool *out_eof);
+// the next packet decoded starts at or before frame_index
+int __attribute__((warn_unused_result)) audio_file_decoder_seek(
+        GenesisAudioFile *audio_file, long frame_index);
+void audio_file_decoder_close(GenesisAudioFile *audio_file);
+
+// like genesis_audio_file_open_streamed, and while the decoder which found
+// the length is still open decodes the first head_seconds of each channel
+// into heads, which has a list for each of GENESIS_MAX_CHANNELS. the heads
+// are shorter only when the file is, and then its frame count is exact.
+// files without a length are decoded whole and their heads left empty.
+int __attribute__((warn_unused_result)) audio_file_open_streamed_head(GenesisContext *context,
+        const char *path, double head_seconds, List<float> *heads, GenesisAudioFile **out_audio_file);
+
 
 #endif
@@ -0,0 +1,314 @@
+#include "audio_file_reader.hpp"
+#include "audio_file.hpp"
+#include "genesis.hpp"
+
+// how far ahead of a streaming reader's position the reader thread decodes
+static const double reader_buffer_seconds = 2.0;
+// the reader thread waits for this many free frames before it writes, so
+// that it copies in batches instead of a few frames per consumer advance
+static const int reader_min_write_frames = 4096;
+
+static void wake_reader_thread(GenesisContext *context) {
+    context->audio_file_reader_wake_epoch += 1;
+    if (context->audio_file_reader_idle.load())
+        futex_wake(reinterpret_cast<int*>(&context->audio_file_reader_wake_epoch), 1);
+}
+
+static void decode_next_packet(GenesisAudioFileReader *reader) {
+    GenesisAudioFile *decoder = reader->decoder;
+    for (int ch = 0; ch < decoder->channels.length(); ch += 1)
+        decoder->channels.at(ch).samples.clear();
+    reader->decoded_offset = 0;
+
+    long packet_frame_index;
+    bool eof;
+    if (audio_file_decoder_next(decoder, &packet_frame_index, &eof) || eof) {
+        reader->decoder_done = true;
+        return;
+    }
+    if (!reader->decoder_position_known) {
+        // a seek lands on a packet at or before the target. if the
+        // container has no timestamp assume it landed on the target.
+        reader->decoder_frame_index = (packet_frame_index >= 0) ?
+            packet_frame_index : reader->write_frame_index;
+        reader->decoder_position_known = true;
+    }
+    reader->decoded_frame_index = reader->decoder_frame_index;
+    reader->decoder_frame_index += decoder->channels.at(0).samples.length();
+}
+
+// writes to the rings from the last channel to the first, and consumers
+// look at the fill count of the first, so every channel has at least as
+// many frames as the consumer sees
+static void write_frames(GenesisAudioFileReader *reader, int frame_count, bool silence) {
+    for (int ch = reader->channel_count - 1; ch >= 0; ch -= 1) {
+        float *dest = reinterpret_cast<float*>(ring_buffer_write_ptr(&reader->rings[ch]));
+        if (silence) {
+            memset(dest, 0, frame_count * sizeof(float));
+        } else {
+            const float *src = reader->decoder->channels.at(ch).samples.raw() + reader->decoded_offset;
+            memcpy(dest, src, frame_count * sizeof(float));
+        }
+        ring_buffer_advance_write_ptr(&reader->rings[ch], frame_count * sizeof(float));
+    }
+    reader->write_frame_index += frame_count;
+}
+
+// does one unit of work for reader. returns whether there was any.
+static bool service_reader(GenesisAudioFileReader *reader) {
+    int generation = reader->seek_generation.load();
+    if (generation != reader->handled_generation) {
+        reader->handled_generation = generation;
+        long frame_index = reader->seek_frame_index.load();
+        for (int ch = 0; ch < reader->channel_count; ch += 1)
+            ring_buffer_clear(&reader->rings[ch]);
+        reader->write_frame_index = frame_index;
+        reader->decoded_offset = 0;
+        reader->decoder_position_known = false;
+        // if the container can not seek we have nothing better than silence
+        reader->decoder_done = (audio_file_decoder_seek(reader->decoder, frame_index) != 0);
+        reader->buffered_generation.store(generation);
+        return true;
+    }
+
+    long frames_left = reader->frame_count - reader->write_frame_index;
+    if (frames_left <= 0)
+        return false;
+    int free_frames = ring_buffer_free_count(&reader->rings[reader->channel_count - 1]) / sizeof(float);
+    int write_count = min((long)free_frames, frames_left);
+    if (write_count < min((long)reader_min_write_frames, frames_left))
+        return false;
+
+    int decoded_count = reader->decoder->channels.at(0).samples.length() - reader->decoded_offset;
+    if (decoded_count <= 0) {
+        if (reader->decoder_done) {
+            // the duration in the container was longer than the audio
+            write_frames(reader, write_count, true);
+        } else {
+            decode_next_packet(reader);
+        }
+        return true;
+    }
+
+    if (reader->decoded_frame_index < reader->write_frame_index) {
+        // decoded from before the seek target
+        int skip_count = min((long)decoded_count, reader->write_frame_index - reader->decoded_frame_index);
+        reader->decoded_offset += skip_count;
+        reader->decoded_frame_index += skip_count;
+    } else if (reader->decoded_frame_index > reader->write_frame_index) {
+        // the stream starts later than the frame we want
+        write_frames(reader, min((long)write_count, reader->decoded_frame_index - reader->write_frame_index), true);
+    } else {
+        int copy_count = min(write_count, decoded_count);
+        write_frames(reader, copy_count, false);
+        reader->decoded_offset += copy_count;
+        reader->decoded_frame_index += copy_count;
+    }
+    return true;
+}
+
+static void reader_thread_run(void *userdata) {
+    GenesisContext *context = reinterpret_cast<GenesisContext*>(userdata);
+    while (!context->audio_file_reader_exit.load()) {
+        int epoch = context->audio_file_reader_wake_epoch.load();
+        bool worked = false;
+        os_mutex_lock(context->audio_file_readers_mutex);
+        for (int i = 0; i < context->audio_file_readers.length(); i += 1) {
+            if (service_reader(context->audio_file_readers.at(i)))
+                worked = true;
+        }
+        os_mutex_unlock(context->audio_file_readers_mutex);
+        if (worked)
+            continue;
+        // consumers bump the epoch before looking at the idle flag, so
+        // either they see us idle or the wait returns right away
+        context->audio_file_reader_idle = true;
+        if (!context->audio_file_reader_exit.load())
+            futex_wait(reinterpret_cast<int*>(&context->audio_file_reader_wake_epoch), epoch);
+        context->audio_file_reader_idle = false;
+    }
+}
+
+void audio_file_reader_thread_destroy(GenesisContext *context) {
+    if (!context->audio_file_reader_thread)
+        return;
+    assert(context->audio_file_readers.length() == 0);
+    context->audio_file_reader_exit = true;
+    context->audio_file_reader_wake_epoch += 1;
+    futex_wake(reinterpret_cast<int*>(&context->audio_file_reader_wake_epoch), 1);
+    os_thread_destroy(context->audio_file_reader_thread);
+    context->audio_file_reader_thread = nullptr;
+}
+
+static int start_streaming(GenesisAudioFileReader *reader, double buffer_seconds) {
+    GenesisAudioFile *audio_file = reader->audio_file;
+    GenesisContext *context = reader->context;
+
+    if (!(reader->decoder = create_zero<GenesisAudioFile>()))
+        return GenesisErrorNoMem;
+    reader->decoder->genesis_context = context;
+    int err;
+    if ((err = audio_file_decoder_open(reader->decoder, audio_file->path.raw())))
+        return err;
+    // the file changed on disk since it was opened
+    if (reader->decoder->channel_layout.channel_count != reader->channel_count)
+        return GenesisErrorDecodingAudio;
+
+    int ring_frame_count = max(reader_min_write_frames * 2,
+            (int)(buffer_seconds * audio_file->sample_rate));
+    for (; reader->ring_count < reader->channel_count; reader->ring_count += 1) {
+        if ((err = ring_buffer_init(&reader->rings[reader->ring_count], ring_frame_count * sizeof(float))))
+            return err;
+    }
+
+    // starts decoding from the beginning right away
+    reader->seek_frame_index = 0;
+    reader->seek_generation = 1;
+    reader->buffered_generation = 0;
+    reader->handled_generation = 0;
+
+    {
+        OsMutexLocker locker(context->audio_file_readers_mutex);
+        if ((err = context->audio_file_readers.append(reader)))
+            return err;
+        reader->registered = true;
+    }
+
+    if (!context->audio_file_reader_thread) {
+        context->audio_file_reader_exit = false;
+        if ((err = os_thread_create_with_attributes(reader_thread_run, context,
+                        &context->background_thread_attributes, &context->audio_file_reader_thread)))
+        {
+            return err;
+        }
+    }
+    wake_reader_thread(context);
+    return 0;
+}
+
+int audio_file_reader_create(GenesisAudioFile *audio_file, double buffer_seconds,
+        GenesisAudioFileReader **out_reader)
+{
+    *out_reader = nullptr;
+    GenesisAudioFileReader *reader = create_zero<GenesisAudioFileReader>();
+    if (!reader)
+        return GenesisErrorNoMem;
+
+    reader->audio_file = audio_file;
+    reader->context = audio_file->genesis_context;
+    reader->channel_count = audio_file->channel_layout.channel_count;
+    reader->frame_count = genesis_audio_file_frame_count(audio_file);
+
+    if (audio_file->storage != GenesisSampleStorageFloat) {
+        for (int ch = 0; ch < reader->channel_count; ch += 1) {
+            if (!(reader->converted[ch] = allocate_nonzero<float>(AUDIO_FILE_CONVERT_FRAMES))) {
+                genesis_audio_file_reader_destroy(reader);
+                return GenesisErrorNoMem;
+            }
+        }
+    }
+
+    if (audio_file->streamed) {
+        int err;
+        if ((err = start_streaming(reader, buffer_seconds))) {
+            genesis_audio_file_reader_destroy(reader);
+            return err;
+        }
+    }
+
+    *out_reader = reader;
+    return 0;
+}
+
+int genesis_audio_file_reader_create(struct GenesisAudioFile *audio_file,
+        struct GenesisAudioFileReader **out_reader)
+{
+    return audio_file_reader_create(audio_file, reader_buffer_seconds, out_reader);
+}
+
+void genesis_audio_file_reader_destroy(struct GenesisAudioFileReader *reader) {
+    if (!reader)
+        return;
+
+    if (reader->registered) {
+        GenesisContext *context = reader->context;
+        OsMutexLocker locker(context->audio_file_readers_mutex);
+        for (int i = 0; i < context->audio_file_readers.length(); i += 1) {
+            if (context->audio_file_readers.at(i) == reader) {
+                context->audio_file_readers.swap_remove(i);
+                break;
+            }
+        }
+    }
+    for (int ch = 0; ch < reader->ring_count; ch += 1)
+        ring_buffer_deinit(&reader->rings[ch]);
+    for (int ch = 0; ch < reader->channel_count; ch += 1)
+        destroy(reader->converted[ch], 0);
+    genesis_audio_file_destroy(reader->decoder);
+    destroy(reader, 1);
+}
+
+void genesis_audio_file_reader_seek(struct GenesisAudioFileReader *reader, long frame_index) {
+    reader->position = frame_index;
+    if (!reader->audio_file->streamed)
+        return;
+    reader->seek_frame_index.store(frame_index);
+    reader->seek_generation += 1;
+    wake_reader_thread(reader->context);
+}
+
+long genesis_audio_file_reader_position(const struct GenesisAudioFileReader *reader) {
+    return reader->position;
+}
+
+// the block at the read position, unless it is already converted
+static int fill_converted(GenesisAudioFileReader *reader) {
+    long offset = reader->position - reader->converted_frame_index;
+    if (offset >= 0 && offset < reader->converted_frame_count)
+        return reader->converted_frame_count - offset;
+    if (reader->position < 0 || reader->position >= reader->frame_count) {
+        reader->converted_frame_count = 0;
+        return 0;
+    }
+    for (int ch = 0; ch < reader->channel_count; ch += 1) {
+        reader->converted_frame_index = audio_file_convert_block(reader->audio_file, ch, reader->position,
+                reader->converted[ch], &reader->converted_frame_count);
+    }
+    return reader->converted_frame_index + reader->converted_frame_count - reader->position;
+}
+
+int genesis_audio_file_reader_fill_count(struct GenesisAudioFileReader *reader) {
+    if (reader->converted[0])
+        return fill_converted(reader);
+    GenesisAudioFile *audio_file = reader->audio_file;
+    if (!audio_file->streamed) {
+        long end = reader->frame_count;
+        // frames a progressive file has yet to decode read as nothing yet
+        if (audio_file->progressive)
+            end = min(end, audio_file->decoded_frame_count.load());
+        return max(0L, min((long)INT_MAX, end - reader->position));
+    }
+    if (reader->buffered_generation.load() != reader->seek_generation.load())
+        return 0;
+    return ring_buffer_fill_count(&reader->rings[0]) / sizeof(float);
+}
+
+const float *genesis_audio_file_reader_read_ptr(struct GenesisAudioFileReader *reader, int channel_index) {
+    if (reader->converted[0])
+        return reader->converted[channel_index] + (reader->position - reader->converted_frame_index);
+    if (!reader->audio_file->streamed)
+        return audio_file_channel_samples(reader->audio_file, channel_index) + reader->position;
+    return reinterpret_cast<float*>(ring_buffer_read_ptr(&reader->rings[channel_index]));
+}
+
+void genesis_audio_file_reader_advance_read_ptr(struct GenesisAudioFileReader *reader, int frame_count) {
+    reader->position += frame_count;
+    if (!reader->audio_file->streamed)
+        return;
+    // the reader thread looks at the free count of the last channel
+    for (int ch = 0; ch < reader->channel_count; ch += 1)
+        ring_buffer_advance_read_ptr(&reader->rings[ch], frame_count * sizeof(float));
+    int free_frames = ring_buffer_free_count(&reader->rings[reader->channel_count - 1]) / sizeof(float);
+    if (free_frames >= reader_min_write_frames)
+        wake_reader_thread(reader->context);
+}
@@ -0,0 +1,54 @@
+#ifndef GENESIS_AUDIO_FILE_READER_HPP
+#define GENESIS_AUDIO_FILE_READER_HPP
+
+#include "genesis.h"
+#include "ring_buffer.hpp"
+#include "atomics.hpp"
+
+struct GenesisAudioFileReader {
+    GenesisAudioFile *audio_file;
+    GenesisContext *context;
+    int channel_count;
+    long frame_count;
+    // owned by the consumer
+    long position;
+    // compact and compressed files are converted a block at a time, frames
+    // [converted_frame_index, converted_frame_index + converted_frame_count)
+    // into converted
+    float *converted[GENESIS_MAX_CHANNELS];
+    long converted_frame_index;
+    int converted_frame_count;
+
+    // the rest is only used for streamed files. a seek stores
+    // seek_frame_index and then bumps seek_generation. the rings hold frames
+    // starting at the seek of buffered_generation.
+    RingBuffer rings[GENESIS_MAX_CHANNELS];
+    int ring_count;
+    atomic_long seek_frame_index;
+    atomic_int seek_generation;
+    atomic_int buffered_generation;
+    bool registered;
+
+    // owned by the reader thread
+    GenesisAudioFile *decoder;
+    int handled_generation;
+    // frame index of the next frame written to the rings
+    long write_frame_index;
+    // frame index of decoded frame decoded_offset, and of the next packet
+    long decoded_frame_index;
+    long decoder_frame_index;
+    int decoded_offset;
+    bool decoder_position_known;
+    bool decoder_done;
+};
+
+// like genesis_audio_file_reader_create, with the reader thread decoding
+// buffer_seconds ahead of a streaming reader
+int audio_file_reader_create(GenesisAudioFile *audio_file, double buffer_seconds,
+        GenesisAudioFileReader **out_reader);
+
+// joins the thread which decodes ahead of streaming readers. every reader
+// must already be destroyed.
+void audio_file_reader_thread_destroy(GenesisContext *context);
+
+#endif
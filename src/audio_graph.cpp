@@ -1,22 +1,72 @@
 #include "audio_graph.hpp"
+#include "audio_file_reader.hpp"
 #include "mixer_node.hpp"
+#include "resample.hpp"
 #include "settings_file.hpp"
-
-static const int AUDIO_CLIP_POLYPHONY = 32;
+#include "dsp_kernels.hpp"
+#include "thread_safe_queue.hpp"
+#include "sha_256_hasher.hpp"
+#include "os.hpp"
+#include "logger.hpp"
+#include "render_coordinator.hpp"
+#include "voice_pool.hpp"
+#include "time_stretch.hpp"
+
+// each streaming reader keeps a decoder and a buffer of its own, so clips from
+// streamed files get at most this many voices
+static const int AUDIO_CLIP_STREAM_COUNT = 4;
+// each voice of a stretched clip keeps a time stretch of its own, so those
+// clips get at most this many voices, and the voices stretch this many
+// frames at a time
+static const int AUDIO_CLIP_STRETCH_COUNT = 8;
+static const int STRETCH_CHUNK_FRAME_COUNT = 256;
+
+// how much of the master mix the prerender renders at a time, how far
+// before each block its render starts so that the block holds the tails of
+// what came before, and how long before a live block the clip nodes go
+// back to mixing so that their streamed readers have decoded it
+static const double PRERENDER_BLOCK_SECONDS = 4.0;
+static const double PRERENDER_PREROLL_SECONDS = 1.0;
+static const double PRERENDER_WARMUP_SECONDS = 0.5;
+
+// a render skips silence between segments only when there is at least this
+// much of it, and starts the graph again this long before the next segment
+// so that what leads into it is rendered
+static const double RENDER_SKIP_MIN_SECONDS = 1.0;
+static const double RENDER_SKIP_LEAD_SECONDS = 0.25;
+
+// playback starts at the latency of the settings and the pipeline finds
+// the least latency the machine plays without underruns between these
+static const double PLAYBACK_MIN_LATENCY = 0.002;
+static const double PLAYBACK_MAX_LATENCY = 0.5;
+
+// playback graphs give nodes only to the clips with a segment playing or
+// starting within this long of the play head, and take them back from
+// clips with none within twice as long. well past PLAYBACK_MAX_LATENCY, so
+// that a clip's readers have decoded its first segment before it plays.
+static const double CLIP_LOOKAHEAD_SECONDS = 4.0;
+
+// playback graphs checkpoint the state of their effects this often and
+// keep this many, so that a seek back into what just played hears the
+// tails it would have
+static const double CHECKPOINT_INTERVAL_SECONDS = 1.0;
+static const int CHECKPOINT_COUNT = 16;
 
 static_assert(sizeof(long) == 8, "require long to be 8 bytes");
 
-struct AudioClipNodeChannel {
-    struct GenesisAudioFileIterator iter;
-    long offset;
-};
-
 struct AudioClipVoice {
-    bool active;
-    AudioClipNodeChannel channels[GENESIS_MAX_CHANNELS];
+    int reader_index;
     int frames_until_start;
     long frame_index;
     long frame_end;
+    // stretched clips only. the frames the voice has left to play, which run
+    // past frame_end by the stretch.
+    long stretched_frames_left;
+    // orders voices by age, for stealing
+    long serial;
+    // the largest sample magnitude of the last block, for stealing the
+    // quietest
+    float level;
 };
 
 struct AudioClipNodeContext {
@@ -24,8 +74,22 @@ struct AudioClipNodeContext {
     GenesisAudioFile *audio_file;
     int frame_pos;
 
-    AudioClipVoice voices[AUDIO_CLIP_POLYPHONY];
-    int next_note_index;
+    // counted in the graph's active_voice_count
+    VoicePool<AudioClipVoice> voices;
+
+    // one for each voice. active voices each own one of the readers. the
+    // idle ones of a streamed file are parked on upcoming segments so that
+    // they are already decoded when the segment starts.
+    GenesisAudioFileReader **readers;
+    bool *reader_in_use;
+    int reader_count;
+    // the voices kept time without reading while the prerender played
+    bool readers_stale;
+
+    // for a stretched clip, one for each reader, and what they write before
+    // it is mixed into the output
+    TimeStretch **time_stretches;
+    float *stretch_buf;
 
     AtomicDouble seek_pos;
 };
@@ -34,19 +98,276 @@ struct AudioClipEventNodeContext {
     AudioGraphClip *clip;
     double pos;
     AtomicDouble new_pos;
+    // for streamed files, the audio file frames where the next segments to
+    // play start, soonest first. -1 where there are no more.
+    atomic_long upcoming_frames[AUDIO_CLIP_STREAM_COUNT];
+};
+
+static void release_voice_reader(AudioClipNodeContext *context, AudioClipVoice *voice) {
+    if (voice->reader_index >= 0) {
+        context->reader_in_use[voice->reader_index] = false;
+        voice->reader_index = -1;
+    }
+}
+
+static void release_voice(AudioClipNodeContext *context, int voice_index) {
+    release_voice_reader(context, &context->voices.voices[voice_index]);
+    context->voices.release(voice_index);
+}
+
+static void release_all_voices(AudioClipNodeContext *context) {
+    while (context->voices.active_count > 0)
+        release_voice(context, context->voices.active_count - 1);
+}
+
+// a free voice, if the clip has one and the graph's voice limit allows it,
+// or else the active voice which the clip's policy gives up. returns
+// nullptr only when neither is to be had.
+static AudioClipVoice *acquire_voice(AudioClipNodeContext *context) {
+    AudioClipVoice *voice = context->voices.acquire_free(context->clip->audio_graph->voice_limit.load());
+    if (voice) {
+        voice->reader_index = -1;
+        return voice;
+    }
+    voice = context->voices.steal(context->clip->voice_steal == AudioClipVoiceStealQuietest);
+    if (voice)
+        release_voice_reader(context, voice);
+    return voice;
+}
+
+static bool reader_has_frame(GenesisAudioFileReader *reader, long frame_index) {
+    long position = genesis_audio_file_reader_position(reader);
+    return frame_index >= position &&
+        frame_index < position + genesis_audio_file_reader_fill_count(reader);
+}
+
+// prefers a free reader which already has frame_index decoded. returns -1
+// if every reader is in use.
+static int acquire_reader(AudioClipNodeContext *context, long frame_index) {
+    int chosen = -1;
+    for (int i = 0; i < context->reader_count; i += 1) {
+        if (context->reader_in_use[i])
+            continue;
+        if (reader_has_frame(context->readers[i], frame_index)) {
+            chosen = i;
+            break;
+        }
+        if (chosen == -1)
+            chosen = i;
+    }
+    if (chosen == -1)
+        return -1;
+
+    context->reader_in_use[chosen] = true;
+    GenesisAudioFileReader *reader = context->readers[chosen];
+    if (reader_has_frame(reader, frame_index)) {
+        long skip_count = frame_index - genesis_audio_file_reader_position(reader);
+        genesis_audio_file_reader_advance_read_ptr(reader, skip_count);
+    } else {
+        genesis_audio_file_reader_seek(reader, frame_index);
+    }
+    return chosen;
+}
+
+// moves idle readers of a streamed file to segments which are about to
+// start and do not have a reader waiting yet
+static void prefetch_upcoming(AudioClipNodeContext *context) {
+    AudioClipEventNodeContext *event_context =
+        (AudioClipEventNodeContext *)context->clip->event_node->userdata;
+    bool parked[AUDIO_CLIP_STREAM_COUNT] = {};
+    long unparked_frames[AUDIO_CLIP_STREAM_COUNT];
+    int unparked_count = 0;
+    for (int i = 0; i < AUDIO_CLIP_STREAM_COUNT; i += 1) {
+        long frame_index = event_context->upcoming_frames[i].load();
+        if (frame_index < 0)
+            break;
+        bool found = false;
+        for (int reader_i = 0; reader_i < context->reader_count && !found; reader_i += 1) {
+            if (context->reader_in_use[reader_i] || parked[reader_i])
+                continue;
+            if (genesis_audio_file_reader_position(context->readers[reader_i]) == frame_index) {
+                parked[reader_i] = true;
+                found = true;
+            }
+        }
+        if (!found)
+            unparked_frames[unparked_count++] = frame_index;
+    }
+    int reader_i = 0;
+    for (int i = 0; i < unparked_count; i += 1) {
+        while (reader_i < context->reader_count &&
+                (context->reader_in_use[reader_i] || parked[reader_i]))
+        {
+            reader_i += 1;
+        }
+        if (reader_i >= context->reader_count)
+            break;
+        genesis_audio_file_reader_seek(context->readers[reader_i], unparked_frames[i]);
+        parked[reader_i] = true;
+    }
+}
+
+enum PrerenderCover {
+    PrerenderCoverNone,
+    // the cache plays this chunk, but a live block comes soon
+    PrerenderCoverWarm,
+    PrerenderCoverFull,
 };
 
-static AudioClipVoice *find_next_voice(AudioClipNodeContext *context) {
-    for (int i = 0;; i += 1) {
-        AudioClipVoice *voice = &context->voices[context->next_note_index];
-        context->next_note_index = (context->next_note_index + 1) % AUDIO_CLIP_POLYPHONY;
-        if (!voice->active || i == AUDIO_CLIP_POLYPHONY)
-            return voice;
+// whether the block plays from the cache in the current pass
+static bool prerender_decide(AudioGraph *ag, AudioGraphPrerenderBlock *block) {
+    long pass = ag->prerender_pass.load();
+    long decision = block->decision.load();
+    for (;;) {
+        long decided_pass = decision / 2;
+        if (decided_pass == pass)
+            return decision % 2;
+        if (decided_pass > pass)
+            return false;
+        long new_decision = pass * 2 + (block->reader.load() ? 1 : 0);
+        if (block->decision.compare_exchange_weak(decision, new_decision))
+            return new_decision % 2;
+    }
+}
+
+// like prerender_decide, without deciding a block nothing has reached yet
+static bool prerender_expects(AudioGraph *ag, AudioGraphPrerenderBlock *block) {
+    long decision = block->decision.load();
+    if (decision / 2 == ag->prerender_pass.load())
+        return decision % 2;
+    return block->reader.load() != nullptr;
+}
+
+// how the cache covers the chunk of a node at frame_rate which starts at
+// frame_pos. the chunk is cut short at the end of its block, so that the
+// cache plays the whole of it or none of it.
+static PrerenderCover prerender_cover(AudioGraph *ag, long frame_pos, int frame_rate, int *frame_count) {
+    AudioGraphPrerenderGrid *grid = ag->prerender_grid.load();
+    if (!grid || !ag->is_playing.load())
+        return PrerenderCoverNone;
+    long pos = frame_pos * grid->sample_rate / frame_rate;
+    long block_index = pos / grid->block_frames;
+    if (block_index >= grid->block_count)
+        return PrerenderCoverNone;
+
+    long block_end = (block_index + 1) * grid->block_frames;
+    long frames_to_end = (block_end * frame_rate + grid->sample_rate - 1) / grid->sample_rate - frame_pos;
+    *frame_count = min((long)*frame_count, max(1L, frames_to_end));
+    if (!prerender_decide(ag, &grid->blocks[block_index]))
+        return PrerenderCoverNone;
+
+    long chunk_end = pos + (long)*frame_count * grid->sample_rate / frame_rate;
+    long warmup_end = chunk_end + (long)(PRERENDER_WARMUP_SECONDS * grid->sample_rate);
+    if (warmup_end < block_end || block_index + 1 >= grid->block_count ||
+        prerender_expects(ag, &grid->blocks[block_index + 1]))
+    {
+        return PrerenderCoverFull;
+    }
+    return PrerenderCoverWarm;
+}
+
+// what the voices of a chunk the cache plays would have done, but without
+// reading them
+static void skip_voices(AudioClipNodeContext *context, int frame_count) {
+    for (int voice_i = context->voices.active_count - 1; voice_i >= 0; voice_i -= 1) {
+        AudioClipVoice *voice = &context->voices.voices[voice_i];
+        int out_frame_count = frame_count - voice->frames_until_start;
+        if (context->time_stretches) {
+            long frames_to_advance = min((long)out_frame_count, voice->stretched_frames_left);
+            voice->frame_index = min(voice->frame_end,
+                    voice->frame_index + (long)(frames_to_advance / context->clip->stretch));
+            voice->stretched_frames_left -= frames_to_advance;
+            voice->frames_until_start = 0;
+            if (voice->stretched_frames_left == 0)
+                release_voice(context, voice_i);
+            continue;
+        }
+        int audio_file_frames_left = voice->frame_end - voice->frame_index;
+        int frames_to_advance = min(out_frame_count, audio_file_frames_left);
+        voice->frame_index += frames_to_advance;
+        voice->frames_until_start = 0;
+        if (frames_to_advance == audio_file_frames_left)
+            release_voice(context, voice_i);
+    }
+    context->readers_stale = true;
+}
+
+static void seek_voice_readers(AudioClipNodeContext *context) {
+    for (int voice_i = 0; voice_i < context->voices.active_count; voice_i += 1) {
+        AudioClipVoice *voice = &context->voices.voices[voice_i];
+        genesis_audio_file_reader_seek(context->readers[voice->reader_index], voice->frame_index);
+        if (context->time_stretches)
+            time_stretch_reset(context->time_stretches[voice->reader_index]);
+    }
+    context->readers_stale = false;
+}
+
+// plays frame_count frames of a voice of a stretched clip into the
+// interleaved out_buf. past frame_end the time stretch is fed silence, so
+// that it plays out what it holds. returns how many frames it played, which
+// are fewer when the reader fell behind.
+static int mix_stretched_voice(AudioClipNodeContext *context, AudioClipVoice *voice, float *out_buf,
+        int frame_count, int channel_count, bool track_levels)
+{
+    static const float silence[STRETCH_CHUNK_FRAME_COUNT] = {};
+    GenesisAudioFileReader *reader = context->readers[voice->reader_index];
+    TimeStretch *time_stretch = context->time_stretches[voice->reader_index];
+    float *stretch_buf = context->stretch_buf;
+    int frame_offset = 0;
+    while (frame_offset < frame_count) {
+        const float *srcs[GENESIS_MAX_CHANNELS];
+        bool past_end = voice->frame_index >= voice->frame_end;
+        int in_frame_count;
+        if (past_end) {
+            for (int ch = 0; ch < channel_count; ch += 1)
+                srcs[ch] = silence;
+            in_frame_count = STRETCH_CHUNK_FRAME_COUNT;
+        } else {
+            in_frame_count = min((long)genesis_audio_file_reader_fill_count(reader),
+                    voice->frame_end - voice->frame_index);
+            if (in_frame_count <= 0)
+                break;
+            for (int ch = 0; ch < channel_count; ch += 1)
+                srcs[ch] = genesis_audio_file_reader_read_ptr(reader, ch);
+        }
+        int consumed;
+        int written;
+        time_stretch_convert_planar(time_stretch, srcs, in_frame_count, stretch_buf,
+                min(STRETCH_CHUNK_FRAME_COUNT, frame_count - frame_offset), &consumed, &written);
+        dsp_mix_add(out_buf + frame_offset * channel_count, stretch_buf, written * channel_count);
+        if (track_levels) {
+            float peaks[GENESIS_MAX_CHANNELS] = {};
+            float sum_squares[GENESIS_MAX_CHANNELS] = {};
+            dsp_peak_sum_squares(stretch_buf, channel_count, written, peaks, sum_squares);
+            for (int ch = 0; ch < channel_count; ch += 1)
+                voice->level = max(voice->level, peaks[ch]);
+        }
+        if (!past_end) {
+            genesis_audio_file_reader_advance_read_ptr(reader, consumed);
+            voice->frame_index += consumed;
+        }
+        frame_offset += written;
     }
+    return frame_offset;
 }
 
 static void audio_clip_node_destroy(struct GenesisNode *node) {
     AudioClipNodeContext *audio_clip_context = (AudioClipNodeContext*)node->userdata;
+    if (audio_clip_context) {
+        int voice_count = audio_clip_context->voices.voice_count;
+        release_all_voices(audio_clip_context);
+        for (int i = 0; i < audio_clip_context->reader_count; i += 1)
+            genesis_audio_file_reader_destroy(audio_clip_context->readers[i]);
+        destroy(audio_clip_context->readers, voice_count);
+        destroy(audio_clip_context->reader_in_use, voice_count);
+        if (audio_clip_context->time_stretches) {
+            for (int i = 0; i < voice_count; i += 1)
+                time_stretch_destroy(audio_clip_context->time_stretches[i]);
+            destroy(audio_clip_context->time_stretches, voice_count);
+        }
+        int channel_count = genesis_audio_file_channel_layout(audio_clip_context->audio_file)->channel_count;
+        destroy(audio_clip_context->stretch_buf, STRETCH_CHUNK_FRAME_COUNT * channel_count);
+    }
     destroy(audio_clip_context, 1);
 }
 
@@ -58,8 +379,56 @@ static int audio_clip_node_create(struct GenesisNode *node) {
         audio_clip_node_destroy(node);
         return GenesisErrorNoMem;
     }
-    audio_clip_context->clip = (AudioGraphClip*)genesis_node_descriptor_userdata(node_descr);
-    audio_clip_context->audio_file = audio_clip_context->clip->audio_clip->audio_asset->audio_file;
+    AudioGraphClip *clip = (AudioGraphClip*)genesis_node_descriptor_userdata(node_descr);
+    audio_clip_context->clip = clip;
+    audio_clip_context->audio_file = clip->audio_clip->audio_asset->audio_file;
+
+    int voice_count = genesis_audio_file_is_streamed(audio_clip_context->audio_file) ?
+        min(clip->polyphony, AUDIO_CLIP_STREAM_COUNT) : clip->polyphony;
+    bool stretched = clip->stretch != 1.0 || clip->pitch != 1.0;
+    if (stretched)
+        voice_count = min(voice_count, AUDIO_CLIP_STRETCH_COUNT);
+    if (audio_clip_context->voices.init(voice_count, &clip->audio_graph->active_voice_count)) {
+        audio_clip_node_destroy(node);
+        return GenesisErrorNoMem;
+    }
+    audio_clip_context->readers = allocate_zero<GenesisAudioFileReader *>(voice_count);
+    audio_clip_context->reader_in_use = allocate_zero<bool>(voice_count);
+    if (!audio_clip_context->readers || !audio_clip_context->reader_in_use) {
+        audio_clip_node_destroy(node);
+        return GenesisErrorNoMem;
+    }
+    for (int i = 0; i < voice_count; i += 1) {
+        int err;
+        if ((err = genesis_audio_file_reader_create(audio_clip_context->audio_file,
+                        &audio_clip_context->readers[i])))
+        {
+            audio_clip_node_destroy(node);
+            return err;
+        }
+        audio_clip_context->reader_count += 1;
+    }
+    if (stretched) {
+        GenesisAudioFile *audio_file = audio_clip_context->audio_file;
+        int channel_count = genesis_audio_file_channel_layout(audio_file)->channel_count;
+        audio_clip_context->time_stretches = allocate_zero<TimeStretch *>(voice_count);
+        audio_clip_context->stretch_buf = allocate_nonzero<float>(STRETCH_CHUNK_FRAME_COUNT * channel_count);
+        if (!audio_clip_context->time_stretches || !audio_clip_context->stretch_buf) {
+            audio_clip_node_destroy(node);
+            return GenesisErrorNoMem;
+        }
+        for (int i = 0; i < voice_count; i += 1) {
+            int err;
+            if ((err = time_stretch_create(genesis_audio_file_sample_rate(audio_file), channel_count,
+                            (GenesisTimeStretchQuality)clip->time_stretch_quality,
+                            &audio_clip_context->time_stretches[i])))
+            {
+                audio_clip_node_destroy(node);
+                return err;
+            }
+            time_stretch_set_ratios(audio_clip_context->time_stretches[i], clip->stretch, clip->pitch);
+        }
+    }
     return 0;
 }
 
@@ -85,30 +454,16 @@ static void audio_clip_node_run(struct GenesisNode *node) {
     double seek_pos = context->seek_pos.exchange(-1.0);
     if (seek_pos != -1.0) {
         context->frame_pos = genesis_whole_notes_to_frames(pipeline, seek_pos, frame_rate);
-        for (int voice_i = 0; voice_i < AUDIO_CLIP_POLYPHONY; voice_i += 1) {
-            context->voices[voice_i].active = false;
-        }
+        release_all_voices(context);
     }
 
 
     int frame_at_start = context->frame_pos;
-    double whole_note_at_start = genesis_frames_to_whole_notes(pipeline, frame_at_start, frame_rate);
-    int wanted_frame_at_end = frame_at_start + output_frame_count;
-    double wanted_whole_note_at_end = genesis_frames_to_whole_notes(pipeline, wanted_frame_at_end, frame_rate);
-    double event_time_requested = wanted_whole_note_at_end - whole_note_at_start;
-    assert(event_time_requested >= 0.0);
-
+    PrerenderCover cover = prerender_cover(context->clip->audio_graph, frame_at_start, frame_rate,
+            &output_frame_count);
     int event_count;
-    double event_buf_size;
-    genesis_events_in_port_fill_count(events_in_port, event_time_requested, &event_count, &event_buf_size);
-
-    double whole_note_at_end = whole_note_at_start + event_buf_size;
-    int frame_at_event_end = genesis_whole_notes_to_frames(pipeline, whole_note_at_end, frame_rate);
-    int input_frame_count = frame_at_event_end - frame_at_start;
-    int frame_count = min(output_frame_count, input_frame_count);
-    int frame_at_consume_end = frame_at_start + frame_count;
-    double whole_note_at_consume_end = genesis_frames_to_whole_notes(pipeline, frame_at_consume_end, frame_rate);
-    double event_whole_notes_consumed = whole_note_at_consume_end - whole_note_at_start;
+    int frame_count = genesis_events_in_port_fill_frames(events_in_port, frame_at_start,
+            output_frame_count, frame_rate, &event_count);
 
     GenesisMidiEvent *event = genesis_events_in_port_read_ptr(events_in_port);
     int event_index;
@@ -120,61 +475,130 @@ static void audio_clip_node_run(struct GenesisNode *node) {
             frame_index_offset = -frames_until_start;
             frames_until_start = 0;
         }
-        if (frames_until_start >= frame_count ||
-            event->data.segment_data.start + frame_index_offset >= event->data.segment_data.end)
-        {
+        if (frames_until_start >= frame_count)
             break;
-        }
         if (event->event_type == GenesisMidiEventTypeSegment) {
-            AudioClipVoice *voice = find_next_voice(context);
-
-            voice->active = true;
-            voice->frames_until_start = frames_until_start;
-            voice->frame_index = event->data.segment_data.start;
-            voice->frame_end = event->data.segment_data.end;
-            for (int ch = 0; ch < channel_count; ch += 1) {
-                struct AudioClipNodeChannel *channel = &voice->channels[ch];
-                channel->iter = genesis_audio_file_iterator(context->audio_file, ch,
-                        frame_index_offset);
-                channel->offset = 0;
+            long segment_start = event->data.segment_data.start;
+            long frame_index = segment_start + frame_index_offset;
+            long frame_end = min(event->data.segment_data.end,
+                    genesis_audio_file_frame_count(context->audio_file));
+            long stretched_frames_left = 0;
+            if (context->time_stretches) {
+                // the offset is into the stretched segment
+                double stretch = context->clip->stretch;
+                stretched_frames_left = (long)ceil((frame_end - segment_start) * stretch) - frame_index_offset;
+                frame_index = min(frame_end, segment_start + (long)(frame_index_offset / stretch));
+                if (stretched_frames_left <= 0)
+                    continue;
+            } else if (frame_index >= frame_end) {
+                continue;
             }
+            AudioClipVoice *voice = acquire_voice(context);
+            if (!voice)
+                continue;
+            // every voice has a reader of its own, so one is free
+            voice->reader_index = acquire_reader(context, frame_index);
+            assert(voice->reader_index >= 0);
+            voice->frames_until_start = frames_until_start;
+            voice->frame_index = frame_index;
+            voice->frame_end = frame_end;
+            voice->stretched_frames_left = stretched_frames_left;
+            if (context->time_stretches)
+                time_stretch_reset(context->time_stretches[voice->reader_index]);
         }
     }
-    genesis_events_in_port_advance_read_ptr(events_in_port, event_index, event_whole_notes_consumed);
+    genesis_events_in_port_advance_frames(events_in_port, event_index, frame_at_start, frame_count, frame_rate);
+
+    // the cache has the mix, so the voices only keep time
+    if (cover == PrerenderCoverFull) {
+        skip_voices(context, frame_count);
+        if (genesis_audio_file_is_streamed(context->audio_file))
+            prefetch_upcoming(context);
+        context->frame_pos += frame_count;
+        genesis_audio_out_port_write_silence(audio_out_port, frame_count);
+        return;
+    }
+    if (context->readers_stale)
+        seek_voice_readers(context);
+
+    bool silent = context->voices.active_count == 0;
+    bool track_levels = context->clip->voice_steal == AudioClipVoiceStealQuietest;
 
     // set everything to silence and then we'll add samples in
-    memset(out_buf, 0, frame_count * bytes_per_frame);
+    if (!silent)
+        memset(out_buf, 0, frame_count * bytes_per_frame);
 
-    for (int voice_i = 0; voice_i < AUDIO_CLIP_POLYPHONY; voice_i += 1) {
-        AudioClipVoice *voice = &context->voices[voice_i];
-        if (!voice->active)
-            continue;
+    // from the end, so that a released voice is replaced by one that has
+    // already played this block
+    const DspChannelKernels *kernels = dsp_channel_kernels(channel_count);
+    for (int voice_i = context->voices.active_count - 1; voice_i >= 0; voice_i -= 1) {
+        AudioClipVoice *voice = &context->voices.voices[voice_i];
+        if (track_levels)
+            voice->level = 0.0f;
 
         int out_frame_count = min(frame_count, frame_count - voice->frames_until_start);
+        float *voice_out_buf = out_buf + voice->frames_until_start * channel_count;
+        if (context->time_stretches) {
+            int frames_to_play = min((long)out_frame_count, voice->stretched_frames_left);
+            int played = mix_stretched_voice(context, voice, voice_out_buf, frames_to_play,
+                    channel_count, track_levels);
+            voice->stretched_frames_left -= frames_to_play;
+            voice->frames_until_start = 0;
+            if (voice->stretched_frames_left == 0) {
+                release_voice(context, voice_i);
+            } else if (played < frames_to_play) {
+                // like below, and the stretch starts over after the gap
+                voice->frame_index = min(voice->frame_end,
+                        voice->frame_index + (long)((frames_to_play - played) / context->clip->stretch));
+                genesis_audio_file_reader_seek(context->readers[voice->reader_index], voice->frame_index);
+                time_stretch_reset(context->time_stretches[voice->reader_index]);
+            }
+            continue;
+        }
         int audio_file_frames_left = voice->frame_end - voice->frame_index;
         int frames_to_advance = min(out_frame_count, audio_file_frames_left);
-        for (int ch = 0; ch < channel_count; ch += 1) {
-            struct AudioClipNodeChannel *channel = &voice->channels[ch];
-            for (int frame_offset = 0; frame_offset < frames_to_advance; frame_offset += 1) {
-                if (channel->offset >= channel->iter.end) {
-                    genesis_audio_file_iterator_next(&channel->iter);
-                    channel->offset = 0;
-                }
 
-                int out_frame_index = voice->frames_until_start + frame_offset;
-                int out_sample_index = out_frame_index * channel_count + ch;
-                out_buf[out_sample_index] += channel->iter.ptr[channel->offset];
-                channel->offset += 1;
+        GenesisAudioFileReader *reader = context->readers[voice->reader_index];
+        int frame_offset = 0;
+        while (frame_offset < frames_to_advance) {
+            int available = genesis_audio_file_reader_fill_count(reader);
+            if (available <= 0)
+                break;
+            int span_frame_count = min(frames_to_advance - frame_offset, available);
+            const float *srcs[GENESIS_MAX_CHANNELS];
+            for (int ch = 0; ch < channel_count; ch += 1)
+                srcs[ch] = genesis_audio_file_reader_read_ptr(reader, ch);
+            kernels->interleave_add(channel_count, voice_out_buf + frame_offset * channel_count,
+                    srcs, span_frame_count);
+            if (track_levels) {
+                for (int ch = 0; ch < channel_count; ch += 1) {
+                    float sum_squares = 0.0f;
+                    dsp_peak_sum_squares(srcs[ch], 1, span_frame_count, &voice->level, &sum_squares);
+                }
             }
+            genesis_audio_file_reader_advance_read_ptr(reader, span_frame_count);
+            frame_offset += span_frame_count;
         }
         voice->frame_index += frames_to_advance;
         voice->frames_until_start = 0;
-        if (frames_to_advance == audio_file_frames_left)
-            voice->active = false;
+        if (frames_to_advance == audio_file_frames_left) {
+            release_voice(context, voice_i);
+        } else if (frame_offset < frames_to_advance) {
+            // the reader thread fell behind. stay in time and leave a gap
+            // rather than play late.
+            genesis_audio_file_reader_seek(reader, voice->frame_index);
+        }
     }
 
+    if (genesis_audio_file_is_streamed(context->audio_file))
+        prefetch_upcoming(context);
+
+    // a warm chunk is read only to keep the readers going
     context->frame_pos += frame_count;
-    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+    if (silent || cover == PrerenderCoverWarm)
+        genesis_audio_out_port_write_silence(audio_out_port, frame_count);
+    else
+        genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
 }
 
 static void audio_clip_event_node_destroy(struct GenesisNode *node) {
@@ -193,9 +617,32 @@ static int audio_clip_event_node_create(struct GenesisNode *node) {
     audio_clip_event_node_context->clip =
         (AudioGraphClip*) genesis_node_descriptor_userdata(node_descr);
     audio_clip_event_node_context->new_pos.store(0.0);
+    for (int i = 0; i < AUDIO_CLIP_STREAM_COUNT; i += 1)
+        audio_clip_event_node_context->upcoming_frames[i].store(-1);
     return 0;
 }
 
+// the soonest segments starting at or after pos, for prefetching
+static void update_upcoming_frames(AudioClipEventNodeContext *context, const EventTimelineVersion *version,
+        double pos)
+{
+    int upcoming_count = 0;
+    for (int chunk_i = event_timeline_find_chunk(version, pos);
+            chunk_i < version->chunk_count && upcoming_count < AUDIO_CLIP_STREAM_COUNT; chunk_i += 1)
+    {
+        const EventTimelineChunk *chunk = version->chunks[chunk_i];
+        for (int i = 0; i < chunk->event_count && upcoming_count < AUDIO_CLIP_STREAM_COUNT; i += 1) {
+            const GenesisMidiEvent *event = &chunk->events[i].midi;
+            if (event->event_type != GenesisMidiEventTypeSegment || event->start < pos)
+                continue;
+            context->upcoming_frames[upcoming_count].store(event->data.segment_data.start);
+            upcoming_count += 1;
+        }
+    }
+    for (int i = upcoming_count; i < AUDIO_CLIP_STREAM_COUNT; i += 1)
+        context->upcoming_frames[i].store(-1);
+}
+
 static void audio_clip_event_node_seek(struct GenesisNode *node) {
     AudioClipEventNodeContext *audio_clip_event_node_context = (AudioClipEventNodeContext*)node->userdata;
     audio_clip_event_node_context->new_pos.store(node->timestamp);
@@ -221,27 +668,198 @@ static void audio_clip_event_node_run(struct GenesisNode *node) {
 
     double end_pos = context->pos + event_time_requested;
 
+    // pinned even while stopped, so that the writer can free the versions
+    // this node read before
+    const EventTimelineVersion *version = event_timeline_read(&clip->events);
     int event_index = 0;
     if (ag->is_playing) {
-        List<GenesisMidiEvent> *event_list = clip->events.get_read_ptr();
-        for (int i = 0; i < event_list->length(); i += 1) {
-            GenesisMidiEvent *event = &event_list->at(i);
-            if ((event->start >= context->pos || detect_ongoing_notes) && event->start < end_pos) {
+        // after a seek, start from the segments still playing at pos
+        bool done = false;
+        int chunk_i = detect_ongoing_notes ? event_timeline_find_overlap(version, context->pos) :
+            event_timeline_find_chunk(version, context->pos);
+        for (; chunk_i < version->chunk_count && !done; chunk_i += 1) {
+            const EventTimelineChunk *chunk = version->chunks[chunk_i];
+            for (int i = 0; i < chunk->event_count; i += 1) {
+                const EventTimelineEvent *timeline_event = &chunk->events[i];
+                const GenesisMidiEvent *event = &timeline_event->midi;
+                if (event->start >= end_pos) {
+                    done = true;
+                    break;
+                }
+                if (event->start < context->pos &&
+                    (!detect_ongoing_notes || timeline_event->end <= context->pos))
+                {
+                    continue;
+                }
                 *event_buf = *event;
                 event_buf += 1;
                 event_index += 1;
 
                 if (event_index >= event_count) {
                     event_time_requested = event->start - context->pos;
+                    done = true;
                     break;
                 }
             }
         }
+        if (genesis_audio_file_is_streamed(clip->audio_clip->audio_asset->audio_file))
+            update_upcoming_frames(context, version, context->pos + event_time_requested);
     }
     context->pos += event_time_requested;
     genesis_events_out_port_advance_write_ptr(events_out_port, event_index, event_time_requested);
 }
 
+// how far ahead of the preview voice its file is decoded, and how many of
+// its frames it converts at a time
+static const double preview_buffer_seconds = 0.25;
+static const int preview_chunk_frames = 1024;
+
+// the writer only frees a stream it finds unpinned after replacing it, as
+// in event_timeline_read
+static AudioGraphPreviewStream *read_preview_stream(AudioGraph *ag) {
+    AudioGraphPreviewStream *stream = ag->preview_current.load();
+    for (;;) {
+        ag->preview_pinned.store(stream);
+        AudioGraphPreviewStream *latest = ag->preview_current.load();
+        if (latest == stream)
+            return stream;
+        stream = latest;
+    }
+}
+
+// the scrub voice takes this long to catch up with the cursor, and moves
+// no faster than SCRUB_MAX_SPEED times normal speed. below
+// SCRUB_FULL_GAIN_SPEED it fades out, so that it is silent where the
+// cursor rests.
+static const double SCRUB_FOLLOW_SECONDS = 0.02;
+static const double SCRUB_MAX_SPEED = 4.0;
+static const double SCRUB_FULL_GAIN_SPEED = 0.25;
+
+static AudioGraphScrubSet *read_scrub_set(AudioGraph *ag) {
+    AudioGraphScrubSet *set = ag->scrub_current.load();
+    for (;;) {
+        ag->scrub_pinned.store(set);
+        AudioGraphScrubSet *latest = ag->scrub_current.load();
+        if (latest == set)
+            return set;
+        set = latest;
+    }
+}
+
+// one sample of each channel of the file at frame, or false when the
+// reader has nothing there yet
+static bool read_scrub_frame(GenesisAudioFileReader *reader, long frame, int channel_count, float *out) {
+    genesis_audio_file_reader_seek(reader, frame);
+    if (genesis_audio_file_reader_fill_count(reader) <= 0)
+        return false;
+    for (int ch = 0; ch < channel_count; ch += 1)
+        out[ch] = genesis_audio_file_reader_read_ptr(reader, ch)[0];
+    return true;
+}
+
+// adds segment to out_samples for frame_count frames, over which the voice
+// goes from start_frame with a velocity from start_velocity by
+// velocity_step a frame, and a gain from start_gain by gain_step
+static void add_scrub_segment(AudioGraphScrubSegment *segment, float *out_samples, int frame_count,
+        int channel_count, double start_frame, double start_velocity, double velocity_step,
+        float start_gain, float gain_step)
+{
+    float near[GENESIS_MAX_CHANNELS];
+    float far[GENESIS_MAX_CHANNELS];
+    long near_frame = -1;
+    for (int i = 1; i <= frame_count; i += 1) {
+        double timeline_frame = start_frame + i * start_velocity + velocity_step * i * (i + 1) * 0.5;
+        double file_pos = segment->start + (timeline_frame - segment->timeline_frame) * segment->rate_ratio;
+        if (file_pos < segment->start || file_pos >= segment->end - 1)
+            continue;
+        long file_frame = (long)file_pos;
+        // frames next to each other mostly read the same two samples
+        if (file_frame != near_frame) {
+            if (!read_scrub_frame(segment->reader, file_frame, segment->channel_count, near) ||
+                !read_scrub_frame(segment->reader, file_frame + 1, segment->channel_count, far))
+            {
+                near_frame = -1;
+                continue;
+            }
+            near_frame = file_frame;
+        }
+        float fraction = (float)(file_pos - file_frame);
+        float gain = (start_gain + gain_step * i) * segment->gain;
+        float *out = out_samples + (i - 1) * channel_count;
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            int file_ch = ch % segment->channel_count;
+            out[ch] += gain * (near[file_ch] + (far[file_ch] - near[file_ch]) * fraction);
+        }
+    }
+}
+
+// the velocity ramps over the block toward what reaches the cursor in
+// SCRUB_FOLLOW_SECONDS, which is a varispeed playback of the segments that
+// follows the mouse
+static void add_scrub_voice(AudioGraph *ag, AudioGraphScrubSet *set, float *out_samples, int frame_count,
+        int channel_count, int sample_rate)
+{
+    double target = ag->scrub_target.load();
+    if (set != ag->scrub_playing) {
+        ag->scrub_playing = set;
+        ag->scrub_frame = target;
+        ag->scrub_velocity = 0.0;
+        ag->scrub_gain = 0.0f;
+    }
+    if (frame_count <= 0)
+        return;
+    double end_velocity = clamp(-SCRUB_MAX_SPEED,
+            (target - ag->scrub_frame) / (SCRUB_FOLLOW_SECONDS * sample_rate), SCRUB_MAX_SPEED);
+    float end_gain = (float)min(1.0, fabs(end_velocity) / SCRUB_FULL_GAIN_SPEED);
+    double start_velocity = ag->scrub_velocity;
+    double velocity_step = (end_velocity - start_velocity) / frame_count;
+    float gain_step = (end_gain - ag->scrub_gain) / frame_count;
+
+    double reach = frame_count * max(fabs(start_velocity), fabs(end_velocity));
+    for (int i = 0; i < set->segment_count; i += 1) {
+        AudioGraphScrubSegment *segment = &set->segments[i];
+        double segment_end = segment->timeline_frame + (segment->end - segment->start) / segment->rate_ratio;
+        if (segment_end < ag->scrub_frame - reach || segment->timeline_frame > ag->scrub_frame + reach)
+            continue;
+        add_scrub_segment(segment, out_samples, frame_count, channel_count, ag->scrub_frame,
+                start_velocity, velocity_step, ag->scrub_gain, gain_step);
+    }
+
+    ag->scrub_frame += frame_count * start_velocity + velocity_step * frame_count * (frame_count + 1) * 0.5;
+    ag->scrub_velocity = end_velocity;
+    ag->scrub_gain = end_gain;
+}
+
+// returns how many frames of out_samples it wrote
+static int play_preview_stream(AudioGraphPreviewStream *stream, float *out_samples, int frame_count,
+        int channel_count)
+{
+    GenesisAudioFileReader *reader = stream->reader;
+    int file_channel_count = genesis_audio_file_channel_layout(stream->audio_file)->channel_count;
+    const DspChannelKernels *kernels = dsp_channel_kernels(file_channel_count);
+    int frame_offset = 0;
+    while (frame_offset < frame_count) {
+        int in_frame_count = min(preview_chunk_frames, genesis_audio_file_reader_fill_count(reader));
+        if (in_frame_count <= 0)
+            break;
+        const float *srcs[GENESIS_MAX_CHANNELS];
+        for (int ch = 0; ch < file_channel_count; ch += 1)
+            srcs[ch] = genesis_audio_file_reader_read_ptr(reader, ch);
+        memset(stream->interleaved, 0, in_frame_count * file_channel_count * sizeof(float));
+        kernels->interleave_add(file_channel_count, stream->interleaved, srcs, in_frame_count);
+        int consumed;
+        int written;
+        resample_convert(stream->resample_context, stream->interleaved, in_frame_count,
+                out_samples + frame_offset * channel_count, frame_count - frame_offset,
+                &consumed, &written);
+        genesis_audio_file_reader_advance_read_ptr(reader, consumed);
+        frame_offset += written;
+        if (consumed < in_frame_count)
+            break;
+    }
+    return frame_offset;
+}
+
 static void audio_file_node_run(struct GenesisNode *node) {
     const struct GenesisNodeDescriptor *node_descriptor = genesis_node_descriptor(node);
     struct AudioGraph *ag = (struct AudioGraph *)genesis_node_descriptor_userdata(node_descriptor);
@@ -252,251 +870,1207 @@ static void audio_file_node_run(struct GenesisNode *node) {
     int channel_count = channel_layout->channel_count;
     float *out_samples = genesis_audio_out_port_write_ptr(audio_out_port);
 
-    int audio_file_frames_left = ag->audio_file_frame_count - ag->audio_file_frame_index;
-    int frames_to_advance = min(output_frame_count, audio_file_frames_left);
-    assert(frames_to_advance >= 0);
+    AudioGraphPreviewStream *stream = read_preview_stream(ag);
+    AudioGraphScrubSet *scrub_set = read_scrub_set(ag);
+    if (!scrub_set)
+        ag->scrub_playing = nullptr;
+    if (!stream && !scrub_set) {
+        genesis_audio_out_port_write_silence(audio_out_port, output_frame_count);
+        return;
+    }
+    int frame_offset = stream ? play_preview_stream(stream, out_samples, output_frame_count, channel_count) : 0;
+    // the stream has not caught up yet, or it ended
+    memset(out_samples + frame_offset * channel_count, 0,
+            (output_frame_count - frame_offset) * channel_count * sizeof(float));
+    if (scrub_set) {
+        add_scrub_voice(ag, scrub_set, out_samples, output_frame_count, channel_count,
+                genesis_audio_port_sample_rate(audio_out_port));
+    }
 
-    for (int ch = 0; ch < channel_count; ch += 1) {
-        struct PlayChannelContext *channel_context = &ag->audio_file_channel_context[ch];
-        for (int frame_offset = 0; frame_offset < frames_to_advance; frame_offset += 1) {
-            if (channel_context->offset >= channel_context->iter.end) {
-                genesis_audio_file_iterator_next(&channel_context->iter);
-                channel_context->offset = 0;
-            }
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, output_frame_count);
+}
+
+static void frozen_track_node_seek(struct GenesisNode *node) {
+    AudioGraphFrozenTrack *frozen = (AudioGraphFrozenTrack *)genesis_node_descriptor_userdata(
+            genesis_node_descriptor(node));
+    frozen->seek_pos.store(node->timestamp);
+}
 
-            out_samples[channel_count * frame_offset + ch] = channel_context->iter.ptr[channel_context->offset];
+static void frozen_track_node_run(struct GenesisNode *node) {
+    AudioGraphFrozenTrack *frozen = (AudioGraphFrozenTrack *)genesis_node_descriptor_userdata(
+            genesis_node_descriptor(node));
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int output_frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    int channel_count = genesis_audio_port_channel_layout(audio_out_port)->channel_count;
 
-            channel_context->offset += 1;
-        }
+    int frame_rate = genesis_audio_port_sample_rate(audio_out_port);
+
+    double seek_pos = frozen->seek_pos.exchange(-1.0);
+    if (seek_pos != -1.0) {
+        genesis_audio_file_reader_seek(frozen->reader,
+                genesis_whole_notes_to_frames(genesis_node_pipeline(node), seek_pos, frame_rate));
     }
-    int silent_frames = output_frame_count - frames_to_advance;
-    memset(&out_samples[channel_count * frames_to_advance], 0, silent_frames * 4 * channel_count);
 
-    ag->audio_file_frame_index += frames_to_advance;
+    // holds its place while paused, like the clips it stands in for
+    if (!frozen->audio_graph->is_playing || genesis_audio_file_reader_fill_count(frozen->reader) <= 0) {
+        genesis_audio_out_port_write_silence(audio_out_port, output_frame_count);
+        return;
+    }
+    long frame_pos = genesis_audio_file_reader_position(frozen->reader);
+    if (prerender_cover(frozen->audio_graph, frame_pos, frame_rate, &output_frame_count) != PrerenderCoverNone) {
+        genesis_audio_file_reader_seek(frozen->reader, frame_pos + output_frame_count);
+        genesis_audio_out_port_write_silence(audio_out_port, output_frame_count);
+        return;
+    }
+    float *out_samples = genesis_audio_out_port_write_ptr(audio_out_port);
+    memset(out_samples, 0, output_frame_count * channel_count * sizeof(float));
+    const DspChannelKernels *kernels = dsp_channel_kernels(channel_count);
+    int frame_offset = 0;
+    while (frame_offset < output_frame_count) {
+        int span_frame_count = min(output_frame_count - frame_offset,
+                genesis_audio_file_reader_fill_count(frozen->reader));
+        if (span_frame_count <= 0)
+            break;
+        const float *srcs[GENESIS_MAX_CHANNELS];
+        for (int ch = 0; ch < channel_count; ch += 1)
+            srcs[ch] = genesis_audio_file_reader_read_ptr(frozen->reader, ch);
+        kernels->interleave_add(channel_count, out_samples + frame_offset * channel_count,
+                srcs, span_frame_count);
+        genesis_audio_file_reader_advance_read_ptr(frozen->reader, span_frame_count);
+        frame_offset += span_frame_count;
+    }
     genesis_audio_out_port_advance_write_ptr(audio_out_port, output_frame_count);
 }
 
-static void render_node_run(struct GenesisNode *node) {
-    const struct GenesisNodeDescriptor *node_descriptor = genesis_node_descriptor(node);
-    struct AudioGraph *ag = (struct AudioGraph *)genesis_node_descriptor_userdata(node_descriptor);
-    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+// the writer only destroys a reader it finds unpinned after taking it out
+// of its block, as with the preview stream
+static GenesisAudioFileReader *pin_prerender_reader(AudioGraph *ag, AudioGraphPrerenderBlock *block) {
+    GenesisAudioFileReader *reader = block->reader.load();
+    for (;;) {
+        ag->prerender_pinned.store(reader);
+        GenesisAudioFileReader *latest = block->reader.load();
+        if (latest == reader)
+            return reader;
+        reader = latest;
+    }
+}
 
-    int input_frame_count = genesis_audio_in_port_fill_count(audio_in_port);
-    float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
-    GenesisAudioFileStream *afs = ag->render_stream;
+static void prerender_node_seek(struct GenesisNode *node) {
+    AudioGraph *ag = (AudioGraph *)genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    ag->prerender_seek_pos.store(node->timestamp);
+}
 
+// plays the blocks decided for the cache, and silence where the clip nodes
+// play live
+static void prerender_node_run(struct GenesisNode *node) {
+    AudioGraph *ag = (AudioGraph *)genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int output_frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    int channel_count = genesis_audio_port_channel_layout(audio_out_port)->channel_count;
+    int frame_rate = genesis_audio_port_sample_rate(audio_out_port);
 
-    int frames_left = ag->render_frame_count - ag->render_frame_index;
-    int write_count = min(input_frame_count, frames_left);
+    double seek_pos = ag->prerender_seek_pos.exchange(-1.0);
+    if (seek_pos != -1.0)
+        ag->prerender_frame_pos = genesis_whole_notes_to_frames(genesis_node_pipeline(node), seek_pos, frame_rate);
 
-    if (write_count > 0) {
-        int err;
-        if ((err = genesis_audio_file_stream_write(afs, in_buf, write_count))) {
-            panic("TODO handle this error");
-        }
+    if (!ag->is_playing) {
+        ag->prerender_pinned.store(nullptr);
+        genesis_audio_out_port_write_silence(audio_out_port, output_frame_count);
+        return;
+    }
 
-        long new_index = ag->render_frame_index.load() + write_count;
-        assert(new_index <= ag->render_frame_count);
-        bool done = new_index == ag->render_frame_count;
+    long frame_pos = ag->prerender_frame_pos;
+    AudioGraphPrerenderGrid *grid = ag->prerender_grid.load();
+    PrerenderCover cover = prerender_cover(ag, frame_pos, frame_rate, &output_frame_count);
+    ag->prerender_frame_pos += output_frame_count;
+    long block_index = grid ? frame_pos / grid->block_frames : 0;
+    GenesisAudioFileReader *reader = nullptr;
+    if (cover != PrerenderCoverNone && grid && block_index < grid->block_count)
+        reader = pin_prerender_reader(ag, &grid->blocks[block_index]);
+    if (!reader) {
+        genesis_audio_out_port_write_silence(audio_out_port, output_frame_count);
+        return;
+    }
 
-        if (done) {
-            if ((err = genesis_audio_file_stream_close(afs))) {
-                panic("TODO handle this error");
+    long offset = frame_pos - block_index * grid->block_frames;
+    if (genesis_audio_file_reader_position(reader) != offset)
+        genesis_audio_file_reader_seek(reader, offset);
+    float *out_samples = genesis_audio_out_port_write_ptr(audio_out_port);
+    memset(out_samples, 0, output_frame_count * channel_count * sizeof(float));
+    const DspChannelKernels *kernels = dsp_channel_kernels(channel_count);
+    int frame_offset = 0;
+    while (frame_offset < output_frame_count) {
+        int span_frame_count = min(output_frame_count - frame_offset,
+                genesis_audio_file_reader_fill_count(reader));
+        if (span_frame_count <= 0)
+            break;
+        const float *srcs[GENESIS_MAX_CHANNELS];
+        for (int ch = 0; ch < channel_count; ch += 1)
+            srcs[ch] = genesis_audio_file_reader_read_ptr(reader, ch);
+        kernels->interleave_add(channel_count, out_samples + frame_offset * channel_count,
+                srcs, span_frame_count);
+        genesis_audio_file_reader_advance_read_ptr(reader, span_frame_count);
+        frame_offset += span_frame_count;
+    }
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, output_frame_count);
+}
+
+// the frames at sample_rate the segment plays. its asset must be loaded.
+static void get_segment_frames(AudioGraph *ag, AudioClipSegment *segment, int sample_rate,
+        long *out_start, long *out_end)
+{
+    int clip_sample_rate = genesis_audio_file_sample_rate(segment->audio_clip->audio_asset->audio_file);
+    *out_start = genesis_whole_notes_to_frames(ag->pipeline, segment->pos, sample_rate);
+    *out_end = *out_start + audio_clip_segment_duration(segment) * sample_rate / clip_sample_rate;
+}
+
+static int compare_render_intervals(RenderInterval a, RenderInterval b) {
+    return (a.start > b.start) - (a.start < b.start);
+}
+
+static void build_render_intervals(AudioGraph *ag) {
+    Project *project = ag->project;
+    ag->render_intervals.clear();
+    ag->render_interval_index = 0;
+    ag->render_intervals_stale.store(false);
+    for (int track_i = 0; track_i < project->track_list.length(); track_i += 1) {
+        Track *track = project->track_list.at(track_i);
+        for (int i = 0; i < track->audio_clip_segments.length(); i += 1) {
+            AudioClipSegment *segment = track->audio_clip_segments.at(i);
+            if (!project_audio_asset_is_loaded(segment->audio_clip->audio_asset)) {
+                ag->render_intervals_stale.store(true);
+                return;
             }
+            RenderInterval interval;
+            get_segment_frames(ag, segment, ag->render_sample_rate, &interval.start, &interval.end);
+            ok_or_panic(ag->render_intervals.append(interval));
+        }
+    }
+    ag->render_intervals.sort<compare_render_intervals>();
+    int merged_count = 0;
+    for (int i = 0; i < ag->render_intervals.length(); i += 1) {
+        RenderInterval interval = ag->render_intervals.at(i);
+        if (merged_count > 0 && interval.start <= ag->render_intervals.at(merged_count - 1).end) {
+            RenderInterval *last = &ag->render_intervals.at(merged_count - 1);
+            last->end = max(last->end, interval.end);
+        } else {
+            ag->render_intervals.at(merged_count) = interval;
+            merged_count += 1;
         }
+    }
+    ok_or_panic(ag->render_intervals.resize(merged_count));
+}
 
-        ag->render_frame_index.store(new_index);
-        ag->play_head_changed_flag.clear();
+// seek positions are kept to frames that every clip, the mix and the
+// render rate agree on, so a render that skips comes out as one that
+// doesn't
+static long render_skip_alignment(AudioGraph *ag) {
+    int sample_rate = ag->render_sample_rate;
+    long alignment = render_coordinator_alignment(ag->project, sample_rate);
+    long period = sample_rate / greatest_common_denominator(sample_rate, ag->project->sample_rate);
+    return alignment / greatest_common_denominator(alignment, period) * period;
+}
 
-        if (done) {
-            os_cond_signal(ag->render_cond, nullptr);
-        }
+// whole notes don't hold every frame exactly, and the clip nodes round
+// their seek position down, so step up until it comes back as frame
+static double render_seek_pos(AudioGraph *ag, long frame) {
+    int sample_rate = ag->render_sample_rate;
+    double pos = genesis_frames_to_whole_notes(ag->pipeline, frame, sample_rate);
+    while (genesis_whole_notes_to_frames(ag->pipeline, pos, sample_rate) < frame)
+        pos = nextafter(pos, INFINITY);
+    return pos;
+}
+
+static void wake_render_ring(RenderSink *sink) {
+    sink->ring_epoch += 1;
+    futex_wake(reinterpret_cast<int*>(&sink->ring_epoch), 2);
+}
 
-        genesis_audio_in_port_advance_read_ptr(audio_in_port, write_count);
+// copies frame_count frames from the render node inputs into the sink's
+// ring, waiting for its encoder whenever the ring is full
+static void write_render_sink(RenderSink *sink, struct GenesisNode *node, int input_count,
+        int frame_count)
+{
+    int bytes_per_frame = sink->audio_graph->render_bytes_per_frame;
+    int sample_count_per_frame = bytes_per_frame / sizeof(float);
+    int written = 0;
+    while (written < frame_count) {
+        int epoch = sink->ring_epoch.load();
+        int free_frames = ring_buffer_free_count(&sink->ring) / bytes_per_frame;
+        if (free_frames == 0) {
+            // the only place the graph waits for an encoder
+            futex_wait(reinterpret_cast<int*>(&sink->ring_epoch), epoch);
+            continue;
+        }
+        int count = min(free_frames, frame_count - written);
+        int sample_offset = written * sample_count_per_frame;
+        int sample_count = count * sample_count_per_frame;
+        float *dest = reinterpret_cast<float*>(ring_buffer_write_ptr(&sink->ring));
+        int first_input = max(sink->input_index, 0);
+        memcpy(dest, genesis_audio_in_port_read_ptr(genesis_node_port(node, first_input)) + sample_offset,
+                sample_count * sizeof(float));
+        if (sink->input_index == -1) {
+            for (int i = 1; i < input_count; i += 1) {
+                dsp_mix_add(dest, genesis_audio_in_port_read_ptr(genesis_node_port(node, i)) + sample_offset,
+                        sample_count);
+            }
+        }
+        ring_buffer_advance_write_ptr(&sink->ring, count * bytes_per_frame);
+        written += count;
+        wake_render_ring(sink);
     }
 }
 
-static int render_node_activate(struct GenesisNode *node) {
-    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+// writes frame_count frames of silence into the sink's ring, as
+// write_render_sink does
+static void write_render_sink_silence(RenderSink *sink, long frame_count) {
+    int bytes_per_frame = sink->audio_graph->render_bytes_per_frame;
+    long written = 0;
+    while (written < frame_count) {
+        int epoch = sink->ring_epoch.load();
+        int free_frames = ring_buffer_free_count(&sink->ring) / bytes_per_frame;
+        if (free_frames == 0) {
+            futex_wait(reinterpret_cast<int*>(&sink->ring_epoch), epoch);
+            continue;
+        }
+        int count = min((long)free_frames, frame_count - written);
+        memset(ring_buffer_write_ptr(&sink->ring), 0, count * bytes_per_frame);
+        ring_buffer_advance_write_ptr(&sink->ring, count * bytes_per_frame);
+        written += count;
+        wake_render_ring(sink);
+    }
+}
 
-    // ask for audio frames
-    genesis_audio_in_port_advance_read_ptr(audio_in_port, 0);
+// called once the whole mix has gone silent. if no segment plays for a
+// while, the graph is sought to just before the next one and the render
+// node writes silence until then instead of running the graph over it.
+static void request_render_skip(AudioGraph *ag) {
+    if (ag->render_intervals_stale.load())
+        return;
+    long frame = ag->render_start_frame + ag->render_frames_queued;
+    long end_frame = ag->render_start_frame + ag->render_frame_count;
+    while (ag->render_interval_index < ag->render_intervals.length() &&
+            ag->render_intervals.at(ag->render_interval_index).end <= frame)
+    {
+        ag->render_interval_index += 1;
+    }
+    bool last = ag->render_interval_index == ag->render_intervals.length() ||
+        ag->render_intervals.at(ag->render_interval_index).start >= end_frame;
+    long target = end_frame;
+    if (!last) {
+        long alignment = render_skip_alignment(ag);
+        long lead_frames = RENDER_SKIP_LEAD_SECONDS * ag->render_sample_rate;
+        long next_start = ag->render_intervals.at(ag->render_interval_index).start;
+        target = (next_start - lead_frames) / alignment * alignment;
+    }
+    if (target - frame < (long)(RENDER_SKIP_MIN_SECONDS * ag->render_sample_rate))
+        return;
 
-    return 0;
+    ag->render_silence_frames = target - frame;
+    // with nothing left to play there is nothing to seek to; the graph is
+    // left waiting on the full render node inputs
+    if (last)
+        return;
+    ag->render_skip_to.store(target);
+    wake_render_ring(ag->render_sinks.at(0));
 }
 
-static void stop_pipeline(AudioGraph *ag) {
-    genesis_pipeline_stop(ag->pipeline);
-    genesis_node_disconnect_all_ports(ag->master_node);
+static void render_node_seek(struct GenesisNode *node) {
+    const struct GenesisNodeDescriptor *node_descriptor = genesis_node_descriptor(node);
+    struct AudioGraph *ag = (struct AudioGraph *)genesis_node_descriptor_userdata(node_descriptor);
+    ag->render_skip_to.store(-1);
+}
 
-    genesis_node_destroy(ag->resample_node);
-    ag->resample_node = nullptr;
+static void render_node_run(struct GenesisNode *node) {
+    const struct GenesisNodeDescriptor *node_descriptor = genesis_node_descriptor(node);
+    struct AudioGraph *ag = (struct AudioGraph *)genesis_node_descriptor_userdata(node_descriptor);
+    int input_count = 1 + ag->render_stem_buses.length();
 
-    genesis_node_destroy(ag->mixer_node);
-    ag->mixer_node = nullptr;
+    // what the inputs hold from before the seek is thrown away with it
+    if (ag->render_skip_to.load() >= 0)
+        return;
 
-    genesis_node_descriptor_destroy(ag->mixer_descr);
-    ag->mixer_descr = nullptr;
+    if (ag->render_silence_frames > 0) {
+        for (int i = 0; i < ag->render_sinks.length(); i += 1)
+            write_render_sink_silence(ag->render_sinks.at(i), ag->render_silence_frames);
+        ag->render_frames_queued += ag->render_silence_frames;
+        ag->render_silence_frames = 0;
+    }
 
-    for (int i = 0; i < ag->audio_clip_list.length(); i += 1) {
-        AudioGraphClip *clip = ag->audio_clip_list.at(i);
-        genesis_node_disconnect_all_ports(clip->node);
+    int fill_count = genesis_audio_in_port_fill_count(genesis_node_port(node, 0));
+    for (int i = 1; i < input_count; i += 1)
+        fill_count = min(fill_count, genesis_audio_in_port_fill_count(genesis_node_port(node, i)));
 
-        genesis_node_destroy(clip->resample_node);
-        clip->resample_node = nullptr;
+    if (ag->render_frames_to_skip > 0) {
+        int skip_count = min((long)fill_count, ag->render_frames_to_skip);
+        ag->render_frames_to_skip -= skip_count;
+        for (int i = 0; i < input_count; i += 1)
+            genesis_audio_in_port_advance_read_ptr(genesis_node_port(node, i), skip_count);
+        return;
     }
-}
 
-void audio_graph_start_pipeline(AudioGraph *ag) {
-    int err;
-
-    ag->start_play_head_pos = ag->play_head_pos;
+    long frames_left = ag->render_frame_count - ag->render_frames_queued;
+    int write_count = min((long)fill_count, frames_left);
 
-    if (genesis_pipeline_is_running(ag->pipeline))
+    if (write_count <= 0)
         return;
 
-    int target_sample_rate = genesis_pipeline_get_sample_rate(ag->pipeline);
-    SoundIoChannelLayout *target_channel_layout = genesis_pipeline_get_channel_layout(ag->pipeline);
+    for (int i = 0; i < ag->render_sinks.length(); i += 1)
+        write_render_sink(ag->render_sinks.at(i), node, input_count, write_count);
 
-    int audio_file_node_count = ag->audio_file_port_descr ? 1 : 0;
+    bool silent = true;
+    for (int i = 0; i < input_count; i += 1)
+        silent = silent && genesis_audio_in_port_silent_count(genesis_node_port(node, i)) >= write_count;
 
-    if (audio_file_node_count >= 1) {
+    ag->render_frames_queued += write_count;
+    for (int i = 0; i < input_count; i += 1)
+        genesis_audio_in_port_advance_read_ptr(genesis_node_port(node, i), write_count);
 
-        if (ag->audio_file_node) {
-            genesis_node_destroy(ag->audio_file_node);
-            ag->audio_file_node = nullptr;
-        }
+    if (silent && ag->render_frames_queued < ag->render_frame_count)
+        request_render_skip(ag);
+}
 
-        if (ag->preview_audio_file) {
-            // Set channel layout
-            const struct SoundIoChannelLayout *channel_layout =
-                genesis_audio_file_channel_layout(ag->preview_audio_file);
-            genesis_audio_port_descriptor_set_channel_layout(
-                    ag->audio_file_port_descr, channel_layout, true, -1);
+// progress is that of the slowest sink
+static void update_render_frame_index(AudioGraph *ag) {
+    long min_index = ag->render_frame_count;
+    for (int i = 0; i < ag->render_sinks.length(); i += 1)
+        min_index = min(min_index, ag->render_sinks.at(i)->frame_index.load());
+    long old_index = ag->render_frame_index.load();
+    while (old_index < min_index &&
+            !ag->render_frame_index.compare_exchange_weak(old_index, min_index))
+    {
+    }
+}
 
-            // Set sample rate
-            int sample_rate = genesis_audio_file_sample_rate(ag->preview_audio_file);
-            genesis_audio_port_descriptor_set_sample_rate(ag->audio_file_port_descr, sample_rate, true, -1);
+static int write_render_sink_frames(RenderSink *sink, float *frames, int frame_count) {
+    if (sink->stream)
+        return genesis_audio_file_stream_write(sink->stream, frames, frame_count);
 
-        } else {
-            genesis_audio_port_descriptor_set_channel_layout(
-                    ag->audio_file_port_descr, target_channel_layout, true, -1);
-            genesis_audio_port_descriptor_set_sample_rate(
-                    ag->audio_file_port_descr, target_sample_rate, true, -1);
+    GenesisAudioFile *audio_file = sink->decoded_audio_file;
+    int channel_count = audio_file->channel_layout.channel_count;
+    long offset = sink->frame_index.load();
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        float *dest = audio_file->channels.at(ch).samples.raw() + offset;
+        for (int i = 0; i < frame_count; i += 1)
+            dest[i] = frames[i * channel_count + ch];
+    }
+    return 0;
+}
+
+static int close_render_sink(RenderSink *sink) {
+    if (sink->stream)
+        return genesis_audio_file_stream_close(sink->stream);
+    return genesis_audio_file_write_decoded(sink->decoded_audio_file, sink->decoded_path.raw());
+}
+
+static void render_encoder_run(void *userdata) {
+    RenderSink *sink = (RenderSink *)userdata;
+    AudioGraph *ag = sink->audio_graph;
+    int bytes_per_frame = ag->render_bytes_per_frame;
+    while (!ag->render_encoder_exit.load()) {
+        int epoch = sink->ring_epoch.load();
+        // the render node can't seek the pipeline it runs in, so the first
+        // sink's encoder does it
+        long skip_to = ag->render_skip_to.load();
+        if (skip_to >= 0 && sink == ag->render_sinks.at(0)) {
+            OsMutexLocker locker(ag->render_seek_mutex);
+            if (!ag->render_seek_closed) {
+                ok_or_panic(genesis_pipeline_seek(ag->pipeline, render_seek_pos(ag, skip_to)));
+                continue;
+            }
+        }
+        int fill_frames = ring_buffer_fill_count(&sink->ring) / bytes_per_frame;
+        if (fill_frames == 0) {
+            futex_wait(reinterpret_cast<int*>(&sink->ring_epoch), epoch);
+            continue;
+        }
+
+        int err;
+        float *frames = reinterpret_cast<float*>(ring_buffer_read_ptr(&sink->ring));
+        if ((err = write_render_sink_frames(sink, frames, fill_frames))) {
+            panic("TODO handle this error");
+        }
+        ring_buffer_advance_read_ptr(&sink->ring, fill_frames * bytes_per_frame);
+        wake_render_ring(sink);
+
+        long new_index = sink->frame_index.load() + fill_frames;
+        assert(new_index <= ag->render_frame_count);
+        bool done = new_index == ag->render_frame_count;
+
+        if (done) {
+            if ((err = close_render_sink(sink))) {
+                panic("TODO handle this error");
+            }
+        }
+
+        sink->frame_index.store(new_index);
+        update_render_frame_index(ag);
+        ag->play_head_changed_flag.clear();
+
+        if (done) {
+            if (ag->render_frame_index.load() == ag->render_frame_count)
+                os_cond_signal(ag->render_cond, nullptr);
+            break;
         }
-        ag->audio_file_node = ok_mem(genesis_node_descriptor_create_node(ag->audio_file_descr));
     }
+}
+
+static int render_node_activate(struct GenesisNode *node) {
+    const struct GenesisNodeDescriptor *node_descriptor = genesis_node_descriptor(node);
+    struct AudioGraph *ag = (struct AudioGraph *)genesis_node_descriptor_userdata(node_descriptor);
+
+    // ask for audio frames
+    for (int i = 0; i < 1 + ag->render_stem_buses.length(); i += 1)
+        genesis_audio_in_port_advance_read_ptr(genesis_node_port(node, i), 0);
 
+    return 0;
+}
+
+// whether the clip's nodes are in the graph, fed by its events and playing
+// into a mixer
+static bool audio_clip_is_connected(AudioGraphClip *clip) {
+    if (!clip->node)
+        return false;
+    GenesisPort *events_in_port = genesis_node_port(clip->node, 1);
+    return events_in_port->input_from == genesis_node_port(clip->event_node, 0);
+}
+
+// removes the nodes which depend on the set of clips and the mixer lines.
+// destroy_mixer_lines must follow once the edit has been
+// committed.
+static void teardown_graph(AudioGraph *ag, GenesisGraphEdit *edit) {
+    ok_or_panic(genesis_graph_edit_remove_node(edit, ag->audio_file_node));
+    ag->audio_file_node = nullptr;
+
+    for (int i = 0; i < ag->mixer_lines.length(); i += 1) {
+        AudioGraphMixerLine *line = ag->mixer_lines.at(i);
+        ok_or_panic(mixer_tree_remove_nodes(line->mixer_tree, edit));
+        ok_or_panic(genesis_graph_edit_remove_node(edit, line->meter_node));
+        line->meter_node = nullptr;
+    }
+
+    for (int i = 0; i < ag->render_stem_buses.length(); i += 1) {
+        RenderStemBus *bus = ag->render_stem_buses.at(i);
+        ok_or_panic(mixer_tree_remove_nodes(bus->mixer_tree, edit));
+    }
+
+    for (int i = 0; i < ag->audio_clip_list.length(); i += 1) {
+        AudioGraphClip *clip = ag->audio_clip_list.at(i);
+        if (!clip->node)
+            continue;
+
+        if (audio_clip_is_connected(clip)) {
+            ok_or_panic(genesis_graph_edit_disconnect(edit, genesis_node_port(clip->event_node, 0),
+                        genesis_node_port(clip->node, 1)));
+        }
+
+        ok_or_panic(genesis_graph_edit_remove_node(edit, clip->resample_node));
+        clip->resample_node = nullptr;
+    }
+
+    for (int i = 0; i < ag->frozen_tracks.length(); i += 1) {
+        AudioGraphFrozenTrack *frozen = ag->frozen_tracks.at(i);
+        ok_or_panic(genesis_graph_edit_remove_node(edit, frozen->resample_node));
+        frozen->resample_node = nullptr;
+    }
+}
+
+static void destroy_mixer_lines(AudioGraph *ag) {
+    while (ag->mixer_lines.length()) {
+        AudioGraphMixerLine *line = ag->mixer_lines.pop();
+        mixer_tree_destroy(line->mixer_tree);
+        destroy(line, 1);
+    }
+}
+
+// connects out_port to in_port, going through a new resample node if the
+// formats do not match
+static GenesisNode *connect_with_resample(AudioGraph *ag, GenesisGraphEdit *edit,
+        GenesisPort *audio_out_port, GenesisPort *audio_in_port)
+{
+    int err;
+    if (!(err = genesis_graph_edit_connect(edit, audio_out_port, audio_in_port)))
+        return nullptr;
+
+    if (err != GenesisErrorIncompatibleChannelLayouts && err != GenesisErrorIncompatibleSampleRates)
+        ok_or_panic(err);
 
     int resample_audio_out_index = genesis_node_descriptor_find_port_index(ag->resample_descr, "audio_out");
     assert(resample_audio_out_index >= 0);
+    int resample_audio_in_index = genesis_node_descriptor_find_port_index(ag->resample_descr, "audio_in");
+    assert(resample_audio_in_index >= 0);
+
+    GenesisNode *resample_node = ok_mem(genesis_graph_edit_add_node(edit, ag->resample_descr));
+    ok_or_panic(genesis_graph_edit_connect(edit, audio_out_port,
+                genesis_node_port(resample_node, resample_audio_in_index)));
+    ok_or_panic(genesis_graph_edit_connect(edit,
+                genesis_node_port(resample_node, resample_audio_out_index), audio_in_port));
+    return resample_node;
+}
+
+static int count_audio_clips(AudioGraph *ag, int stem_index, MixerLine *mixer_line) {
+    int count = 0;
+    for (int i = 0; i < ag->audio_clip_list.length(); i += 1) {
+        AudioGraphClip *clip = ag->audio_clip_list.at(i);
+        if (clip->node && clip->stem_index == stem_index && clip->mixer_line == mixer_line)
+            count += 1;
+    }
+    return count;
+}
+
+// connects the clip's events and its audio to audio_in_port
+static void connect_audio_clip(AudioGraph *ag, GenesisGraphEdit *edit, AudioGraphClip *clip,
+        GenesisPort *audio_in_port)
+{
+    int audio_out_port_index = genesis_node_descriptor_find_port_index(clip->node_descr, "audio_out");
+    if (audio_out_port_index < 0)
+        panic("port not found");
+
+    GenesisPort *audio_out_port = genesis_node_port(clip->node, audio_out_port_index);
+    clip->resample_node = connect_with_resample(ag, edit, audio_out_port, audio_in_port);
+
+    GenesisPort *events_in_port = genesis_node_port(clip->node, 1);
+    GenesisPort *events_out_port = genesis_node_port(clip->event_node, 0);
+
+    ok_or_panic(genesis_graph_edit_connect(edit, events_out_port, events_in_port));
+}
+
+// connects each loaded clip of stem_index and mixer_line to the inputs of
+// mixer_tree at gain, starting at next_mixer_input
+static void connect_audio_clips(AudioGraph *ag, GenesisGraphEdit *edit, int stem_index,
+        MixerLine *mixer_line, MixerTree *mixer_tree, int next_mixer_input, float gain)
+{
+    for (int i = 0; i < ag->audio_clip_list.length(); i += 1) {
+        AudioGraphClip *clip = ag->audio_clip_list.at(i);
+        if (!clip->node || clip->stem_index != stem_index || clip->mixer_line != mixer_line)
+            continue;
+
+        ok_or_panic(mixer_tree_set_input(mixer_tree, next_mixer_input, gain, 0.0f));
+        connect_audio_clip(ag, edit, clip, mixer_tree_input_port(mixer_tree, next_mixer_input++));
+    }
+
+    assert(next_mixer_input == mixer_tree_input_count(mixer_tree));
+}
+
+static int find_mixer_line(AudioGraph *ag, const uint256 &id) {
+    for (int i = 0; i < ag->mixer_lines.length(); i += 1) {
+        if (ag->mixer_lines.at(i)->mixer_line->id == id)
+            return i;
+    }
+    return -1;
+}
+
+static Track *frozen_track_track(AudioGraph *ag, AudioGraphFrozenTrack *frozen) {
+    auto *entry = ag->project->tracks.maybe_get(frozen->track_id);
+    return entry ? entry->value : nullptr;
+}
+
+// index into mixer_lines of the line the frozen track plays into
+static int frozen_track_mixer_line(AudioGraph *ag, AudioGraphFrozenTrack *frozen) {
+    Track *track = frozen_track_track(ag, frozen);
+    auto *entry = track ? ag->project->mixer_lines.maybe_get(track->mixer_line_id) : nullptr;
+    return entry ? max(0, find_mixer_line(ag, entry->value->id)) : 0;
+}
+
+static int find_frozen_track(AudioGraph *ag, Track *track) {
+    for (int i = 0; i < ag->frozen_tracks.length(); i += 1) {
+        if (ag->frozen_tracks.at(i)->track_id == track->id)
+            return i;
+    }
+    return -1;
+}
+
+// whether line from_index plays into line to_index through the sends so far
+static bool mixer_line_reaches(AudioGraph *ag, int from_index, int to_index) {
+    if (from_index == to_index)
+        return true;
+    AudioGraphMixerLine *line = ag->mixer_lines.at(from_index);
+    for (int i = 0; i < line->sends.length(); i += 1) {
+        if (mixer_line_reaches(ag, line->sends.at(i).target, to_index))
+            return true;
+    }
+    return false;
+}
 
-    // one for each of the audio clips and one for the sample file preview node
-    int mix_port_count = audio_file_node_count + ag->audio_clip_list.length();
+static void create_mixer_lines(AudioGraph *ag, int preview_count) {
+    Project *project = ag->project;
+    assert(ag->mixer_lines.length() == 0);
+    for (int i = 0; i < project->mixer_line_list.length(); i += 1) {
+        AudioGraphMixerLine *line = ok_mem(create_zero<AudioGraphMixerLine>());
+        line->mixer_line = project->mixer_line_list.at(i);
+        ok_or_panic(ag->mixer_lines.append(line));
+    }
 
-    ok_or_panic(create_mixer_descriptor(ag->pipeline, mix_port_count, &ag->mixer_descr));
-    ag->mixer_node = ok_mem(genesis_node_descriptor_create_node(ag->mixer_descr));
+    // every line but the master plays into the master line. sends add more
+    // outputs, except those that would make a cycle.
+    for (int i = 1; i < ag->mixer_lines.length(); i += 1)
+        ok_or_panic(ag->mixer_lines.at(i)->sends.append({0, 1.0f}));
+    for (int i = 0; i < ag->mixer_lines.length(); i += 1) {
+        AudioGraphMixerLine *line = ag->mixer_lines.at(i);
+        for (int effect_i = 0; effect_i < line->mixer_line->effects.length(); effect_i += 1) {
+            Effect *effect = line->mixer_line->effects.at(effect_i);
+            if (effect->effect_type != EffectTypeSend)
+                continue;
+            EffectSend *send = &effect->effect.send;
+            if (send->send_type != EffectSendTypeMixerLine)
+                continue;
+            int target = find_mixer_line(ag, send->send.mixer_line.mixer_line_id);
+            if (target < 0 || mixer_line_reaches(ag, target, i) || line->sends.length() >= GENESIS_PORT_MAX_OUTPUTS)
+                continue;
+            ok_or_panic(line->sends.append({target, send->gain}));
+        }
+    }
 
-    ok_or_panic(genesis_connect_audio_nodes(ag->mixer_node, ag->master_node));
+    for (int i = 0; i < ag->mixer_lines.length(); i += 1) {
+        AudioGraphMixerLine *line = ag->mixer_lines.at(i);
+        line->input_count += count_audio_clips(ag, -1, (i == 0) ? nullptr : line->mixer_line);
+        for (int send_i = 0; send_i < line->sends.length(); send_i += 1)
+            ag->mixer_lines.at(line->sends.at(send_i).target)->input_count += 1;
+    }
+    ag->mixer_lines.at(0)->input_count += preview_count + (ag->prerender_node ? 1 : 0);
+    for (int i = 0; i < ag->frozen_tracks.length(); i += 1)
+        ag->mixer_lines.at(frozen_track_mixer_line(ag, ag->frozen_tracks.at(i)))->input_count += 1;
+    for (int i = 0; i < ag->mixer_lines.length(); i += 1) {
+        AudioGraphMixerLine *line = ag->mixer_lines.at(i);
+        ok_or_panic(mixer_tree_create(ag->pipeline, line->input_count, &line->mixer_tree));
+    }
+}
+
+// the line's volume applies to everything that goes into it
+static GenesisPort *take_mixer_line_input(AudioGraphMixerLine *line, float gain) {
+    int input = line->next_input++;
+    ok_or_panic(mixer_tree_set_input(line->mixer_tree, input, gain * line->mixer_line->volume, 0.0f));
+    return mixer_tree_input_port(line->mixer_tree, input);
+}
+
+// adds the nodes of the line and connects its mix to audio_in_port. in a
+// playback graph the mix goes through the line's meter first. returns the
+// port the mix comes out of.
+static GenesisPort *add_mixer_line_output(AudioGraph *ag, GenesisGraphEdit *edit,
+        AudioGraphMixerLine *line, GenesisPort *audio_in_port)
+{
+    if (ag->render_descr) {
+        ok_or_panic(mixer_tree_add_nodes(line->mixer_tree, edit, audio_in_port));
+        return genesis_node_port(mixer_tree_root(line->mixer_tree), 0);
+    }
+    line->meter_node = ok_mem(genesis_graph_edit_add_node(edit, ag->meter_descr));
+    ok_or_panic(mixer_tree_add_nodes(line->mixer_tree, edit, genesis_node_port(line->meter_node, 0)));
+    GenesisPort *audio_out_port = genesis_node_port(line->meter_node, 1);
+    ok_or_panic(genesis_graph_edit_connect(edit, audio_out_port, audio_in_port));
+    return audio_out_port;
+}
+
+// a line's output is connected to the inputs of the lines it sends into, so
+// those are added first, starting from the master line
+static void add_mixer_line_nodes(AudioGraph *ag, GenesisGraphEdit *edit) {
+    AudioGraphMixerLine *master = ag->mixer_lines.at(0);
+    add_mixer_line_output(ag, edit, master, genesis_node_port(ag->master_node, 0));
+    master->nodes_added = true;
+
+    int added_count = 1;
+    while (added_count < ag->mixer_lines.length()) {
+        for (int i = 1; i < ag->mixer_lines.length(); i += 1) {
+            AudioGraphMixerLine *line = ag->mixer_lines.at(i);
+            if (line->nodes_added)
+                continue;
+            bool targets_added = true;
+            for (int send_i = 0; send_i < line->sends.length(); send_i += 1)
+                targets_added = targets_added && ag->mixer_lines.at(line->sends.at(send_i).target)->nodes_added;
+            if (!targets_added)
+                continue;
+
+            GenesisPort *audio_out_port = nullptr;
+            for (int send_i = 0; send_i < line->sends.length(); send_i += 1) {
+                AudioGraphSend *send = &line->sends.at(send_i);
+                GenesisPort *audio_in_port = take_mixer_line_input(ag->mixer_lines.at(send->target), send->gain);
+                if (send_i == 0)
+                    audio_out_port = add_mixer_line_output(ag, edit, line, audio_in_port);
+                else
+                    ok_or_panic(genesis_graph_edit_connect(edit, audio_out_port, audio_in_port));
+            }
+            line->nodes_added = true;
+            added_count += 1;
+        }
+    }
+}
+
+// while a line other than the master is soloed, the clips on the others
+// are muted
+static float mixer_line_clip_gain(AudioGraph *ag, int line_index) {
+    bool any_solo = false;
+    for (int i = 1; i < ag->mixer_lines.length(); i += 1)
+        any_solo = any_solo || ag->mixer_lines.at(i)->mixer_line->solo;
+    AudioGraphMixerLine *line = ag->mixer_lines.at(line_index);
+    bool muted = any_solo && line_index > 0 && !line->mixer_line->solo;
+    return muted ? 0.0f : line->mixer_line->volume;
+}
+
+static void build_graph(AudioGraph *ag, GenesisGraphEdit *edit) {
+    int audio_file_node_count = ag->audio_file_port_descr ? 1 : 0;
 
-    // We start on mixer port index 1 because index 0 is the audio out. Index 1 is
-    // the first audio in.
-    int next_mixer_port = 1;
+    if (audio_file_node_count >= 1) {
+        assert(!ag->audio_file_node);
+        ag->audio_file_node = ok_mem(genesis_graph_edit_add_node(edit, ag->audio_file_descr));
+    }
+
+    create_mixer_lines(ag, audio_file_node_count);
+    add_mixer_line_nodes(ag, edit);
+
+    // sends come first on every line, then the preview voice and the
+    // prerender on the master line, then frozen tracks, then clips
+    AudioGraphMixerLine *master = ag->mixer_lines.at(0);
     if (audio_file_node_count >= 1) {
         int audio_out_port_index = genesis_node_descriptor_find_port_index(ag->audio_file_descr, "audio_out");
         if (audio_out_port_index < 0)
             panic("port not found");
 
         GenesisPort *audio_out_port = genesis_node_port(ag->audio_file_node, audio_out_port_index);
-        GenesisPort *audio_in_port = genesis_node_port(ag->mixer_node, next_mixer_port++);
+        GenesisPort *audio_in_port = take_mixer_line_input(master, 1.0f);
+        ok_or_panic(genesis_graph_edit_connect(edit, audio_out_port, audio_in_port));
+    }
+    // the blocks were rendered after the master volume
+    if (ag->prerender_node) {
+        int input = master->next_input++;
+        ok_or_panic(mixer_tree_set_input(master->mixer_tree, input, 1.0f, 0.0f));
+        ok_or_panic(genesis_graph_edit_connect(edit, genesis_node_port(ag->prerender_node, 0),
+                    mixer_tree_input_port(master->mixer_tree, input)));
+    }
 
-        if ((err = genesis_connect_ports(audio_out_port, audio_in_port))) {
-            if (err == GenesisErrorIncompatibleChannelLayouts ||
-                err == GenesisErrorIncompatibleSampleRates)
-            {
-                ag->resample_node = ok_mem(genesis_node_descriptor_create_node(ag->resample_descr));
-                ok_or_panic(genesis_connect_audio_nodes(ag->audio_file_node, ag->resample_node));
+    // while a line other than the master is soloed, the clips on the
+    // others are muted
+    bool any_solo = false;
+    for (int i = 1; i < ag->mixer_lines.length(); i += 1)
+        any_solo = any_solo || ag->mixer_lines.at(i)->mixer_line->solo;
+    for (int i = 0; i < ag->frozen_tracks.length(); i += 1) {
+        AudioGraphFrozenTrack *frozen = ag->frozen_tracks.at(i);
+        int line_index = frozen_track_mixer_line(ag, frozen);
+        AudioGraphMixerLine *line = ag->mixer_lines.at(line_index);
+        bool muted = any_solo && line_index > 0 && !line->mixer_line->solo;
+        int input = line->next_input++;
+        ok_or_panic(mixer_tree_set_input(line->mixer_tree, input, muted ? 0.0f : line->mixer_line->volume, 0.0f));
+        frozen->resample_node = connect_with_resample(ag, edit, genesis_node_port(frozen->node, 0),
+                mixer_tree_input_port(line->mixer_tree, input));
+    }
+    for (int i = 0; i < ag->mixer_lines.length(); i += 1) {
+        AudioGraphMixerLine *line = ag->mixer_lines.at(i);
+        connect_audio_clips(ag, edit, -1, (i == 0) ? nullptr : line->mixer_line,
+                line->mixer_tree, line->next_input, mixer_line_clip_gain(ag, i));
+    }
 
-                GenesisPort *audio_out_port = genesis_node_port(ag->resample_node, resample_audio_out_index);
-                ok_or_panic(genesis_connect_ports(audio_out_port, audio_in_port));
-            } else {
-                ok_or_panic(err);
-            }
-        }
+    // render node input 0 is the master line
+    for (int i = 0; i < ag->render_stem_buses.length(); i += 1) {
+        RenderStemBus *bus = ag->render_stem_buses.at(i);
+        ok_or_panic(mixer_tree_add_nodes(bus->mixer_tree, edit, genesis_node_port(ag->master_node, i + 1)));
+        connect_audio_clips(ag, edit, i, nullptr, bus->mixer_tree, 0, 1.0f);
+    }
+}
+
+// rebuilds the parts of the graph which depend on the set of clips. when the pipeline is running this happens without
+// stopping it.
+static void rebuild_graph(AudioGraph *ag) {
+    GenesisGraphEdit *edit;
+    ok_or_panic(genesis_graph_edit_begin(ag->pipeline, &edit));
+    teardown_graph(ag, edit);
+    ok_or_panic(genesis_graph_edit_commit(edit));
+    destroy_mixer_lines(ag);
+
+    ok_or_panic(genesis_graph_edit_begin(ag->pipeline, &edit));
+    build_graph(ag, edit);
+    ok_or_panic(genesis_graph_edit_commit(edit));
+}
+
+// destroys the clip's nodes, which are out of the pipeline, along with
+// their descriptors, and unpins its asset
+static void release_audio_clip_nodes(AudioGraphClip *clip) {
+    if (clip->event_node)
+        genesis_node_destroy(clip->event_node);
+    clip->event_node = nullptr;
+
+    if (clip->event_node_descr)
+        genesis_node_descriptor_destroy(clip->event_node_descr);
+    clip->event_node_descr = nullptr;
+
+    if (clip->node)
+        genesis_node_destroy(clip->node);
+    clip->node = nullptr;
+
+    if (clip->node_descr)
+        genesis_node_descriptor_destroy(clip->node_descr);
+    clip->node_descr = nullptr;
+
+    if (clip->audio_asset)
+        project_unpin_audio_asset(clip->audio_graph->project, clip->audio_asset);
+    clip->audio_asset = nullptr;
+}
+
+static void audio_graph_clip_destroy(AudioGraphClip *clip) {
+    if (!clip)
+        return;
+
+    release_audio_clip_nodes(clip);
+    event_timeline_deinit(&clip->events);
+    destroy(clip, 1);
+}
+
+// gives a line a new mixer tree with an input for each of its clips that
+// has nodes. the inputs before the clips keep their sources, gains and pans,
+// and so do the clips that were connected already. the old tree goes into
+// old_trees, to be destroyed once edit is committed.
+static void patch_mixer_line_clips(AudioGraph *ag, GenesisGraphEdit *edit, int line_index,
+        List<MixerTree *> *old_trees)
+{
+    AudioGraphMixerLine *line = ag->mixer_lines.at(line_index);
+    MixerLine *mixer_line = (line_index == 0) ? nullptr : line->mixer_line;
+    MixerTree *old_tree = line->mixer_tree;
+    int kept_count = line->next_input;
+    List<GenesisPort *> kept_sources;
+    ok_or_panic(kept_sources.resize(kept_count));
+    for (int i = 0; i < kept_count; i += 1)
+        kept_sources.at(i) = mixer_tree_input_port(old_tree, i)->input_from;
+    ok_or_panic(mixer_tree_remove_nodes(old_tree, edit));
+    ok_or_panic(old_trees->append(old_tree));
+
+    line->input_count = kept_count + count_audio_clips(ag, -1, mixer_line);
+    ok_or_panic(mixer_tree_create(ag->pipeline, line->input_count, &line->mixer_tree));
+    for (int i = 0; i < kept_count; i += 1) {
+        float gain;
+        float pan;
+        mixer_tree_get_input(old_tree, i, &gain, &pan);
+        ok_or_panic(mixer_tree_set_input(line->mixer_tree, i, gain, pan));
+    }
+    ok_or_panic(mixer_tree_add_nodes(line->mixer_tree, edit, genesis_node_port(line->meter_node, 0)));
+    for (int i = 0; i < kept_count; i += 1) {
+        ok_or_panic(genesis_graph_edit_connect(edit, kept_sources.at(i),
+                    mixer_tree_input_port(line->mixer_tree, i)));
     }
 
+    int resample_audio_out_index = genesis_node_descriptor_find_port_index(ag->resample_descr, "audio_out");
+    assert(resample_audio_out_index >= 0);
+    float gain = mixer_line_clip_gain(ag, line_index);
+    int next_mixer_input = kept_count;
     for (int i = 0; i < ag->audio_clip_list.length(); i += 1) {
         AudioGraphClip *clip = ag->audio_clip_list.at(i);
+        if (!clip->node || clip->stem_index != -1 || clip->mixer_line != mixer_line)
+            continue;
+        ok_or_panic(mixer_tree_set_input(line->mixer_tree, next_mixer_input, gain, 0.0f));
+        GenesisPort *audio_in_port = mixer_tree_input_port(line->mixer_tree, next_mixer_input++);
+        if (!audio_clip_is_connected(clip)) {
+            connect_audio_clip(ag, edit, clip, audio_in_port);
+            continue;
+        }
+        GenesisPort *audio_out_port = clip->resample_node ?
+            genesis_node_port(clip->resample_node, resample_audio_out_index) : genesis_node_port(clip->node, 0);
+        ok_or_panic(genesis_graph_edit_connect(edit, audio_out_port, audio_in_port));
+    }
+}
 
-        int audio_out_port_index = genesis_node_descriptor_find_port_index(clip->node_descr, "audio_out");
-        if (audio_out_port_index < 0)
-            panic("port not found");
+// the index into mixer_lines of the line the clip plays into, or -1 if
+// there is none in this graph
+static int audio_clip_mixer_line(AudioGraph *ag, AudioGraphClip *clip) {
+    if (clip->stem_index != -1)
+        return -1;
+    return clip->mixer_line ? find_mixer_line(ag, clip->mixer_line->id) : 0;
+}
 
-        GenesisPort *audio_out_port = genesis_node_port(clip->node, audio_out_port_index);
-        GenesisPort *audio_in_port = genesis_node_port(ag->mixer_node, next_mixer_port++);
+// takes the clip's nodes out of the pipeline with edit, marking the line
+// it played into as changed
+static void remove_audio_clip_nodes(AudioGraph *ag, GenesisGraphEdit *edit, AudioGraphClip *clip,
+        List<bool> &line_changed, bool *rebuild)
+{
+    if (audio_clip_is_connected(clip)) {
+        int line_index = audio_clip_mixer_line(ag, clip);
+        if (line_index >= 0)
+            line_changed.at(line_index) = true;
+        else
+            *rebuild = true;
+    }
+    ok_or_panic(genesis_graph_edit_remove_node(edit, clip->resample_node));
+    ok_or_panic(genesis_graph_edit_remove_node(edit, clip->event_node));
+    ok_or_panic(genesis_graph_edit_remove_node(edit, clip->node));
+    clip->resample_node = nullptr;
+    clip->event_node = nullptr;
+    clip->node = nullptr;
+}
 
-        if ((err = genesis_connect_ports(audio_out_port, audio_in_port))) {
-            if (err == GenesisErrorIncompatibleChannelLayouts ||
-                err == GenesisErrorIncompatibleSampleRates)
-            {
-                clip->resample_node = ok_mem(genesis_node_descriptor_create_node(ag->resample_descr));
-                ok_or_panic(genesis_connect_audio_nodes(clip->node, clip->resample_node));
-
-                GenesisPort *audio_out_port = genesis_node_port(clip->resample_node,
-                        resample_audio_out_index);
-                ok_or_panic(genesis_connect_ports(audio_out_port, audio_in_port));
-            } else {
-                ok_or_panic(err);
-            }
+// brings a running graph up to date with the clip list after clips were
+// added to it, given nodes, marked going_dormant or taken out of it into
+// removed_clips, which are destroyed. only the mixer trees of the lines
+// whose clips changed are replaced, in one edit, so the rest of the graph
+// plays on as it was.
+static void patch_audio_clips(AudioGraph *ag, List<AudioGraphClip *> *removed_clips) {
+    if (genesis_pipeline_is_running(ag->pipeline)) {
+        GenesisGraphEdit *edit;
+        ok_or_panic(genesis_graph_edit_begin(ag->pipeline, &edit));
+        List<bool> line_changed;
+        ok_or_panic(line_changed.resize(ag->mixer_lines.length()));
+        line_changed.fill(false);
+        // render graphs and clips of lines that are not in the graph yet
+        // take a full rebuild
+        bool rebuild = ag->render_descr != nullptr;
+        for (int i = 0; i < removed_clips->length(); i += 1)
+            remove_audio_clip_nodes(ag, edit, removed_clips->at(i), line_changed, &rebuild);
+        for (int i = 0; i < ag->audio_clip_list.length(); i += 1) {
+            AudioGraphClip *clip = ag->audio_clip_list.at(i);
+            if (clip->going_dormant && clip->node)
+                remove_audio_clip_nodes(ag, edit, clip, line_changed, &rebuild);
+        }
+        for (int i = 0; i < ag->audio_clip_list.length(); i += 1) {
+            AudioGraphClip *clip = ag->audio_clip_list.at(i);
+            if (!clip->node || audio_clip_is_connected(clip))
+                continue;
+            int line_index = audio_clip_mixer_line(ag, clip);
+            if (line_index >= 0)
+                line_changed.at(line_index) = true;
+            else
+                rebuild = true;
         }
 
-        GenesisPort *events_in_port = genesis_node_port(clip->node, 1);
-        GenesisPort *events_out_port = genesis_node_port(clip->event_node, 0);
+        List<MixerTree *> old_trees;
+        for (int i = 0; i < ag->mixer_lines.length() && !rebuild; i += 1) {
+            if (line_changed.at(i))
+                patch_mixer_line_clips(ag, edit, i, &old_trees);
+        }
+        ok_or_panic(genesis_graph_edit_commit(edit));
+        for (int i = 0; i < old_trees.length(); i += 1)
+            mixer_tree_destroy(old_trees.at(i));
+        if (rebuild)
+            rebuild_graph(ag);
+    }
 
-        ok_or_panic(genesis_connect_ports(events_out_port, events_in_port));
+    // with the pipeline stopped, the nodes of dormant clips were never
+    // taken out of it and are destroyed here
+    for (int i = 0; i < ag->audio_clip_list.length(); i += 1) {
+        AudioGraphClip *clip = ag->audio_clip_list.at(i);
+        if (clip->going_dormant) {
+            release_audio_clip_nodes(clip);
+            clip->going_dormant = false;
+        }
     }
+    for (int i = 0; i < removed_clips->length(); i += 1)
+        audio_graph_clip_destroy(removed_clips->at(i));
+    removed_clips->clear();
+}
+
+static void stop_pipeline(AudioGraph *ag) {
+    genesis_pipeline_stop(ag->pipeline);
+
+    GenesisGraphEdit *edit;
+    ok_or_panic(genesis_graph_edit_begin(ag->pipeline, &edit));
+    teardown_graph(ag, edit);
+    ok_or_panic(genesis_graph_edit_commit(edit));
+    destroy_mixer_lines(ag);
+}
+
+void audio_graph_start_pipeline(AudioGraph *ag) {
+    int err;
+
+    ag->start_play_head_pos = ag->play_head_pos;
+    ag->prerender_pass += 1;
+
+    if (genesis_pipeline_is_running(ag->pipeline))
+        return;
 
+    GenesisGraphEdit *edit;
+    ok_or_panic(genesis_graph_edit_begin(ag->pipeline, &edit));
+    build_graph(ag, edit);
+    ok_or_panic(genesis_graph_edit_commit(edit));
+
+    if (ag->render_descr)
+        build_render_intervals(ag);
 
     fprintf(stderr, "\nStarting pipeline...\n");
     genesis_debug_print_pipeline(ag->pipeline);
 
     double start_time = ag->play_head_pos;
 
-    assert(next_mixer_port == mix_port_count + 1);
     if ((err = genesis_pipeline_start(ag->pipeline, start_time)))
         panic("unable to start pipeline: %s", genesis_strerror(err));
 }
 
-static void play_audio_file(AudioGraph *ag, GenesisAudioFile *audio_file, bool is_asset) {
-    // TODO atomically modify the pipeline instead of stopping and starting
-    stop_pipeline(ag);
+static void preview_stream_destroy(AudioGraph *ag, AudioGraphPreviewStream *stream) {
+    if (!stream)
+        return;
+    genesis_audio_file_reader_destroy(stream->reader);
+    resample_context_destroy(stream->resample_context);
+    destroy(stream->interleaved, 0);
+    if (stream->audio_asset)
+        project_unpin_audio_asset(ag->project, stream->audio_asset);
+    else
+        genesis_audio_file_destroy(stream->audio_file);
+    destroy(stream, 1);
+}
 
-    if (ag->preview_audio_file && !ag->preview_audio_file_is_asset) {
-        genesis_audio_file_destroy(ag->preview_audio_file);
-        ag->preview_audio_file = nullptr;
-    } else if (ag->preview_audio_file && ag->preview_audio_file_is_asset) {
-        ag->preview_audio_file = nullptr;
+// frees the replaced streams the preview node is done with, which is all of
+// them when the pipeline is not running
+static void collect_preview_streams(AudioGraph *ag) {
+    AudioGraphPreviewStream *pinned = nullptr;
+    if (genesis_pipeline_is_running(ag->pipeline))
+        pinned = ag->preview_pinned.load();
+    else
+        ag->preview_pinned.store(nullptr);
+    for (int i = ag->preview_retired.length() - 1; i >= 0; i -= 1) {
+        AudioGraphPreviewStream *stream = ag->preview_retired.at(i);
+        if (stream == pinned)
+            continue;
+        ag->preview_retired.swap_remove(i);
+        preview_stream_destroy(ag, stream);
     }
+}
 
-    assert(!ag->preview_audio_file);
-    ag->preview_audio_file = audio_file;
-    ag->preview_audio_file_is_asset = is_asset;
+static int preview_stream_create(AudioGraph *ag, GenesisAudioFile *audio_file, AudioAsset *audio_asset,
+        AudioGraphPreviewStream **out_stream)
+{
+    *out_stream = nullptr;
+    AudioGraphPreviewStream *stream = create_zero<AudioGraphPreviewStream>();
+    if (!stream)
+        return GenesisErrorNoMem;
+    stream->audio_file = audio_file;
+    if (audio_asset) {
+        stream->audio_asset = audio_asset;
+        project_pin_audio_asset(ag->project, audio_asset);
+    }
 
-    ag->audio_file_frame_count = 0;
-    ag->audio_file_frame_index = 0;
+    const SoundIoChannelLayout *channel_layout = genesis_audio_file_channel_layout(audio_file);
+    int err;
+    if ((err = audio_file_reader_create(audio_file, preview_buffer_seconds, &stream->reader)) ||
+        (err = resample_context_create(genesis_audio_file_sample_rate(audio_file), channel_layout,
+                genesis_pipeline_get_sample_rate(ag->pipeline), genesis_pipeline_get_channel_layout(ag->pipeline),
+                GenesisResampleQualityRealtime, &stream->resample_context)))
+    {
+        preview_stream_destroy(ag, stream);
+        return err;
+    }
+    if (!(stream->interleaved = allocate_nonzero<float>(preview_chunk_frames * channel_layout->channel_count))) {
+        preview_stream_destroy(ag, stream);
+        return GenesisErrorNoMem;
+    }
+    *out_stream = stream;
+    return 0;
+}
 
-    if (ag->preview_audio_file) {
-        ag->audio_file_frame_count = genesis_audio_file_frame_count(audio_file);
-        const struct SoundIoChannelLayout *channel_layout =
-            genesis_audio_file_channel_layout(ag->preview_audio_file);
-        for (int ch = 0; ch < channel_layout->channel_count; ch += 1) {
-            struct PlayChannelContext *channel_context = &ag->audio_file_channel_context[ch];
-            channel_context->offset = 0;
-            channel_context->iter = genesis_audio_file_iterator(ag->preview_audio_file, ch, 0);
+// the preview voice switches to audio_file, which it takes, without the
+// graph changing. nullptr stops it.
+static void play_audio_file(AudioGraph *ag, GenesisAudioFile *audio_file, AudioAsset *audio_asset) {
+    AudioGraphPreviewStream *stream = nullptr;
+    if (audio_file) {
+        int err;
+        if ((err = preview_stream_create(ag, audio_file, audio_asset, &stream))) {
+            log_message(LogLevelError, "unable to preview audio file: %s", genesis_strerror(err));
+            if (!audio_asset)
+                genesis_audio_file_destroy(audio_file);
+            stream = nullptr;
         }
     }
 
-    audio_graph_start_pipeline(ag);
+    AudioGraphPreviewStream *old_stream = ag->preview_current.load();
+    if (old_stream)
+        ok_or_panic(ag->preview_retired.append(old_stream));
+    ag->preview_current.store(stream);
+    collect_preview_streams(ag);
+    genesis_pipeline_wake(ag->pipeline);
+
+    if (!genesis_pipeline_is_running(ag->pipeline))
+        audio_graph_start_pipeline(ag);
+}
+
+static void scrub_set_destroy(AudioGraph *ag, AudioGraphScrubSet *set) {
+    if (!set)
+        return;
+    for (int i = 0; i < set->segment_count; i += 1) {
+        AudioGraphScrubSegment *segment = &set->segments[i];
+        genesis_audio_file_reader_destroy(segment->reader);
+        if (segment->audio_asset)
+            project_unpin_audio_asset(ag->project, segment->audio_asset);
+    }
+    destroy(set->segments, set->segment_count);
+    destroy(set, 1);
+}
+
+// like collect_preview_streams
+static void collect_scrub_sets(AudioGraph *ag) {
+    AudioGraphScrubSet *pinned = nullptr;
+    if (genesis_pipeline_is_running(ag->pipeline))
+        pinned = ag->scrub_pinned.load();
+    else
+        ag->scrub_pinned.store(nullptr);
+    for (int i = ag->scrub_retired.length() - 1; i >= 0; i -= 1) {
+        AudioGraphScrubSet *set = ag->scrub_retired.at(i);
+        if (set == pinned)
+            continue;
+        ag->scrub_retired.swap_remove(i);
+        scrub_set_destroy(ag, set);
+    }
+}
+
+static void publish_scrub_set(AudioGraph *ag, AudioGraphScrubSet *set) {
+    AudioGraphScrubSet *old_set = ag->scrub_current.load();
+    if (old_set)
+        ok_or_panic(ag->scrub_retired.append(old_set));
+    ag->scrub_current.store(set);
+    collect_scrub_sets(ag);
+}
+
+// the frame at the pipeline's rate, counting from time 0, of pos in whole
+// notes
+static double scrub_frame_for_pos(AudioGraph *ag, double pos) {
+    int sample_rate = genesis_pipeline_get_sample_rate(ag->pipeline);
+    return genesis_whole_notes_to_seconds(ag->pipeline, pos, sample_rate) * sample_rate;
+}
+
+static float scrub_segment_gain(AudioGraph *ag, AudioClipSegment *segment) {
+    if (ag->mixer_lines.length() == 0)
+        return 1.0f;
+    auto *entry = ag->project->mixer_lines.maybe_get(segment->track->mixer_line_id);
+    int line_index = entry ? max(0, find_mixer_line(ag, entry->value->id)) : 0;
+    return mixer_line_clip_gain(ag, line_index);
+}
+
+// the segments whose assets are decoded, which are the ones a reader can
+// seek around in from the realtime thread
+static int scrub_set_create(AudioGraph *ag, AudioGraphScrubSet **out_set) {
+    *out_set = nullptr;
+    AudioGraphScrubSet *set = create_zero<AudioGraphScrubSet>();
+    if (!set)
+        return GenesisErrorNoMem;
+    int segment_count = ag->project->audio_clip_segments.size();
+    if (segment_count > 0 && !(set->segments = allocate_zero<AudioGraphScrubSegment>(segment_count))) {
+        destroy(set, 1);
+        return GenesisErrorNoMem;
+    }
+    int sample_rate = genesis_pipeline_get_sample_rate(ag->pipeline);
+    auto it = ag->project->audio_clip_segments.entry_iterator();
+    for (;;) {
+        auto *entry = it.next();
+        if (!entry)
+            break;
+        AudioClipSegment *segment = entry->value;
+        AudioAsset *audio_asset = segment->audio_clip->audio_asset;
+        if (!project_audio_asset_is_loaded(audio_asset) ||
+            genesis_audio_file_is_streamed(audio_asset->audio_file) ||
+            segment->end <= segment->start)
+        {
+            continue;
+        }
+        AudioGraphScrubSegment *scrub_segment = &set->segments[set->segment_count];
+        int err;
+        if ((err = genesis_audio_file_reader_create(audio_asset->audio_file, &scrub_segment->reader))) {
+            scrub_set_destroy(ag, set);
+            return err;
+        }
+        set->segment_count += 1;
+        scrub_segment->audio_asset = audio_asset;
+        project_pin_audio_asset(ag->project, audio_asset);
+        scrub_segment->channel_count = genesis_audio_file_channel_layout(audio_asset->audio_file)->channel_count;
+        scrub_segment->start = segment->start;
+        scrub_segment->end = segment->end;
+        scrub_segment->timeline_frame = scrub_frame_for_pos(ag, segment->pos);
+        // a stretched clip scrubs at the speed of its stretch, pitch and all
+        scrub_segment->rate_ratio = genesis_audio_file_sample_rate(audio_asset->audio_file) /
+            (sample_rate * segment->audio_clip->stretch);
+        scrub_segment->gain = scrub_segment_gain(ag, segment);
+    }
+    *out_set = set;
+    return 0;
 }
 
 static SoundIoDevice *get_device_for_id(AudioGraph *ag, DeviceId device_id) {
@@ -521,7 +2095,8 @@ static SoundIoDevice *get_device_for_id(AudioGraph *ag, DeviceId device_id) {
     return genesis_get_default_output_device(ag->pipeline->context);
 }
 
-static int init_playback_node(AudioGraph *ag) {
+// the device the master mixer line sends to
+static SoundIoDevice *get_master_device(AudioGraph *ag) {
     MixerLine *master_mixer_line = ag->project->mixer_line_list.at(0);
     Effect *first_effect = master_mixer_line->effects.at(0);
 
@@ -531,7 +2106,11 @@ static int init_playback_node(AudioGraph *ag) {
     assert(effect_send->send_type == EffectSendTypeDevice);
     EffectSendDevice *send_device = &effect_send->send.device;
 
-    SoundIoDevice *audio_device = get_device_for_id(ag, (DeviceId)send_device->device_id);
+    return get_device_for_id(ag, (DeviceId)send_device->device_id);
+}
+
+static int init_playback_node(AudioGraph *ag) {
+    SoundIoDevice *audio_device = get_master_device(ag);
     if (!audio_device) {
         return GenesisErrorDeviceNotFound;
     }
@@ -562,7 +2141,9 @@ static void add_audio_node_to_audio_clip(AudioGraph *ag, AudioGraphClip *clip) {
     assert(!clip->node);
 
     ok_or_panic(project_ensure_audio_asset_loaded(ag->project, clip->audio_clip->audio_asset));
-    GenesisAudioFile *audio_file = clip->audio_clip->audio_asset->audio_file;
+    clip->audio_asset = clip->audio_clip->audio_asset;
+    project_pin_audio_asset(ag->project, clip->audio_asset);
+    GenesisAudioFile *audio_file = clip->audio_asset->audio_file;
 
     const struct SoundIoChannelLayout *channel_layout =
         genesis_audio_file_channel_layout(audio_file);
@@ -617,116 +2198,1054 @@ static void add_event_node_to_audio_clip(AudioGraph *ag, AudioGraphClip *clip) {
     if (!events_out_port)
         panic("unable to create ports");
 
-    genesis_node_descriptor_set_run_callback(node_descr, audio_clip_event_node_run);
-    genesis_node_descriptor_set_seek_callback(node_descr, audio_clip_event_node_seek);
-    genesis_node_descriptor_set_create_callback(node_descr, audio_clip_event_node_create);
-    genesis_node_descriptor_set_destroy_callback(node_descr, audio_clip_event_node_destroy);
+    genesis_node_descriptor_set_run_callback(node_descr, audio_clip_event_node_run);
+    genesis_node_descriptor_set_seek_callback(node_descr, audio_clip_event_node_seek);
+    genesis_node_descriptor_set_create_callback(node_descr, audio_clip_event_node_create);
+    genesis_node_descriptor_set_destroy_callback(node_descr, audio_clip_event_node_destroy);
+
+    clip->event_node_descr = node_descr;
+    clip->event_node = ok_mem(genesis_node_descriptor_create_node(node_descr));
+}
+
+static void add_nodes_to_audio_clip(AudioGraph *ag, AudioGraphClip *clip) {
+    add_audio_node_to_audio_clip(ag, clip);
+    add_event_node_to_audio_clip(ag, clip);
+}
+
+static void seek_audio_clip(AudioGraphClip *clip, double pos) {
+    AudioClipEventNodeContext *event_context =
+        (AudioClipEventNodeContext *)clip->event_node->userdata;
+    event_context->new_pos.store(pos);
+
+    AudioClipNodeContext *clip_context = (AudioClipNodeContext *)clip->node->userdata;
+    clip_context->seek_pos.store(pos);
+}
+
+static AudioGraphClip *create_audio_graph_clip(AudioGraph *ag, AudioClip *audio_clip, int stem_index,
+        MixerLine *mixer_line)
+{
+    AudioGraphClip *clip = ok_mem(create_zero<AudioGraphClip>());
+    clip->audio_clip = audio_clip;
+    clip->audio_graph = ag;
+    clip->stem_index = stem_index;
+    clip->mixer_line = mixer_line;
+    clip->polyphony = clamp(1, audio_clip->polyphony, AUDIO_CLIP_MAX_POLYPHONY);
+    clip->voice_steal = audio_clip->voice_steal;
+    clip->stretch = audio_clip->stretch;
+    clip->pitch = audio_clip->pitch;
+    clip->time_stretch_quality = audio_clip->time_stretch_quality;
+    ok_or_panic(event_timeline_init(&clip->events));
+    return clip;
+}
+
+// the position seconds after pos
+static double whole_notes_after(AudioGraph *ag, double pos, double seconds) {
+    int sample_rate = genesis_pipeline_get_sample_rate(ag->pipeline);
+    return genesis_whole_notes_add_frames(ag->pipeline, pos, (int)(seconds * sample_rate), sample_rate);
+}
+
+// whether a segment of the clip plays somewhere from pos to end, going by
+// the events of its last update_audio_clip_segments
+static bool audio_clip_plays_between(AudioGraphClip *clip, double pos, double end) {
+    for (int i = 0; i < clip->pending_events.length(); i += 1) {
+        const EventTimelineEvent *event = &clip->pending_events.at(i);
+        // sorted by start
+        if (event->midi.start >= end)
+            break;
+        if (event->end > pos)
+            return true;
+    }
+    return false;
+}
+
+// clips whose asset is still decoding stay out of the graph until
+// on_project_audio_asset_loaded, and with dormant_clips so do clips with
+// no segment near the play head, until update_dormant_clips
+static bool audio_clip_wants_nodes(AudioGraph *ag, AudioGraphClip *clip) {
+    if (!project_audio_asset_is_loaded(clip->audio_clip->audio_asset))
+        return false;
+    if (!ag->dormant_clips)
+        return true;
+    double pos = audio_graph_play_head_pos(ag);
+    return audio_clip_plays_between(clip, pos, whole_notes_after(ag, pos, CLIP_LOOKAHEAD_SECONDS));
+}
+
+// gives nodes to the dormant clips that came near pos and marks the ones
+// that left it going_dormant. returns whether any clip changed, for
+// patch_audio_clips to follow.
+static bool update_dormant_clips(AudioGraph *ag, double pos) {
+    if (!ag->dormant_clips)
+        return false;
+    double wake_end = whole_notes_after(ag, pos, CLIP_LOOKAHEAD_SECONDS);
+    double sleep_end = whole_notes_after(ag, pos, CLIP_LOOKAHEAD_SECONDS * 2.0);
+    bool clips_changed = false;
+    for (int i = 0; i < ag->audio_clip_list.length(); i += 1) {
+        AudioGraphClip *clip = ag->audio_clip_list.at(i);
+        if (clip->node) {
+            if (!audio_clip_plays_between(clip, pos, sleep_end)) {
+                clip->going_dormant = true;
+                clips_changed = true;
+            }
+        } else if (project_audio_asset_is_loaded(clip->audio_clip->audio_asset) &&
+            audio_clip_plays_between(clip, pos, wake_end))
+        {
+            add_nodes_to_audio_clip(ag, clip);
+            if (ag->is_playing)
+                seek_audio_clip(clip, pos);
+            clips_changed = true;
+        }
+    }
+    return clips_changed;
+}
+
+static void patch_dormant_clips(AudioGraph *ag, double pos) {
+    if (update_dormant_clips(ag, pos)) {
+        List<AudioGraphClip *> removed_clips;
+        patch_audio_clips(ag, &removed_clips);
+    }
+}
+
+static void add_loaded_pending_clips(AudioGraph *ag) {
+    bool clips_added = false;
+    for (int i = 0; i < ag->audio_clip_list.length(); i += 1) {
+        AudioGraphClip *clip = ag->audio_clip_list.at(i);
+        if (clip->node || !audio_clip_wants_nodes(ag, clip))
+            continue;
+        add_nodes_to_audio_clip(ag, clip);
+        // new nodes start at the beginning of the project
+        if (ag->is_playing && !ag->render_descr)
+            seek_audio_clip(clip, audio_graph_play_head_pos(ag));
+        clips_added = true;
+    }
+
+    if (clips_added) {
+        List<AudioGraphClip *> removed_clips;
+        patch_audio_clips(ag, &removed_clips);
+    }
+}
+
+static int stem_index_for_track(AudioGraph *ag, Track *track) {
+    for (int i = 0; i < ag->render_stem_buses.length(); i += 1) {
+        if (ag->render_stem_buses.at(i)->track == track)
+            return i;
+    }
+    return -1;
+}
+
+// null for the master line
+static MixerLine *mixer_line_for_track(AudioGraph *ag, Track *track) {
+    auto *entry = ag->project->mixer_lines.maybe_get(track->mixer_line_id);
+    if (!entry || entry->value == ag->project->mixer_line_list.at(0))
+        return nullptr;
+    return entry->value;
+}
+
+static AudioGraphClip *find_audio_clip(AudioGraph *ag, AudioClip *audio_clip, int stem_index,
+        MixerLine *mixer_line)
+{
+    for (int i = 0; i < ag->audio_clip_list.length(); i += 1) {
+        AudioGraphClip *clip = ag->audio_clip_list.at(i);
+        if (clip->audio_clip == audio_clip && clip->stem_index == stem_index && clip->mixer_line == mixer_line)
+            return clip;
+    }
+    return nullptr;
+}
+
+
+// in a stem render one clip node plays a clip's segments on each stem
+// track, and the first one plays the rest
+static void add_stem_audio_clips(AudioGraph *ag) {
+    auto it = ag->project->audio_clip_segments.entry_iterator();
+    for (;;) {
+        auto *entry = it.next();
+        if (!entry)
+            break;
+
+        AudioClipSegment *segment = entry->value;
+        int stem_index = stem_index_for_track(ag, segment->track);
+        if (stem_index == -1 || find_audio_clip(ag, segment->audio_clip, stem_index, nullptr))
+            continue;
+
+        AudioGraphClip *clip = create_audio_graph_clip(ag, segment->audio_clip, stem_index, nullptr);
+        add_nodes_to_audio_clip(ag, clip);
+        ok_or_panic(ag->audio_clip_list.append(clip));
+    }
+}
+
+static AudioGraphClip *clip_for_segment(AudioGraph *ag, AudioClipSegment *segment) {
+    int stem_index = stem_index_for_track(ag, segment->track);
+    MixerLine *mixer_line = (stem_index == -1) ? mixer_line_for_track(ag, segment->track) : nullptr;
+    if (stem_index == -1 && !mixer_line)
+        return (AudioGraphClip *)segment->audio_clip->userdata;
+    return find_audio_clip(ag, segment->audio_clip, stem_index, mixer_line);
+}
+
+// segments on the tracks of a line other than the master are played by a
+// clip node of their own, which plays into that line. returns whether any
+// were added.
+static bool add_mixer_line_audio_clips(AudioGraph *ag) {
+    bool clips_added = false;
+    auto it = ag->project->audio_clip_segments.entry_iterator();
+    for (;;) {
+        auto *entry = it.next();
+        if (!entry)
+            break;
+
+        AudioClipSegment *segment = entry->value;
+        if (stem_index_for_track(ag, segment->track) != -1)
+            continue;
+        MixerLine *mixer_line = mixer_line_for_track(ag, segment->track);
+        if (!mixer_line || find_audio_clip(ag, segment->audio_clip, -1, mixer_line))
+            continue;
+
+        AudioGraphClip *clip = create_audio_graph_clip(ag, segment->audio_clip, -1, mixer_line);
+        if (audio_clip_wants_nodes(ag, clip)) {
+            add_nodes_to_audio_clip(ag, clip);
+            if (ag->is_playing && !ag->render_descr)
+                seek_audio_clip(clip, audio_graph_play_head_pos(ag));
+            clips_added = true;
+        }
+        ok_or_panic(ag->audio_clip_list.append(clip));
+    }
+    return clips_added;
+}
+
+// by start, and then by the rest so that the order does not depend on
+// the order of the project's segments
+static int compare_timeline_events(EventTimelineEvent a, EventTimelineEvent b) {
+    if (a.midi.start != b.midi.start)
+        return (a.midi.start < b.midi.start) ? -1 : 1;
+    return memcmp(&a, &b, sizeof(EventTimelineEvent));
+}
+
+// the events of every clip node, leaving out the segments of frozen
+// tracks. returns whether clip nodes were added.
+static bool update_audio_clip_segments(AudioGraph *ag) {
+    bool clips_added = add_mixer_line_audio_clips(ag);
+    for (int clip_i = 0; clip_i < ag->audio_clip_list.length(); clip_i += 1) {
+        AudioGraphClip *clip = ag->audio_clip_list.at(clip_i);
+        if (clip->stem_index == -1 && !clip->mixer_line)
+            clip->audio_clip->userdata = clip;
+        clip->pending_events.clear();
+    }
+
+    auto it = ag->project->audio_clip_segments.entry_iterator();
+    for (;;) {
+        auto *entry = it.next();
+        if (!entry)
+            break;
+
+        AudioClipSegment *segment = entry->value;
+        if (find_frozen_track(ag, segment->track) >= 0)
+            continue;
+        AudioGraphClip *clip = clip_for_segment(ag, segment);
+        assert(clip);
+        ok_or_panic(clip->pending_events.add_one());
+        EventTimelineEvent *timeline_event = &clip->pending_events.last();
+        memset(timeline_event, 0, sizeof(EventTimelineEvent));
+        GenesisMidiEvent *event = &timeline_event->midi;
+        event->event_type = GenesisMidiEventTypeSegment;
+        event->start = segment->pos;
+        event->data.segment_data.start = segment->start;
+        event->data.segment_data.end = segment->end;
+        int frame_rate = genesis_audio_file_sample_rate(clip->audio_clip->audio_asset->audio_file);
+        timeline_event->end = genesis_whole_notes_add_frames(ag->pipeline, segment->pos,
+                audio_clip_segment_duration(segment), frame_rate);
+    }
+
+    for (int i = 0; i < ag->audio_clip_list.length(); i += 1) {
+        AudioGraphClip *clip = ag->audio_clip_list.at(i);
+        clip->pending_events.sort<compare_timeline_events>();
+        ok_or_panic(event_timeline_publish(&clip->events, clip->pending_events.raw(),
+                    clip->pending_events.length()));
+        event_timeline_collect(&clip->events, !genesis_pipeline_is_running(ag->pipeline));
+    }
+    return clips_added;
+}
+
+static void refresh_audio_clips(AudioGraph *ag) {
+    Project *project = ag->project;
+    // the clip nodes for the master line follow the order of the project's
+    // clips, and come before the ones for other lines and stems. clips still
+    // in the project keep their nodes, unless their voices changed.
+    List<AudioGraphClip *> master_clips;
+    List<AudioGraphClip *> other_clips;
+    for (int i = 0; i < ag->audio_clip_list.length(); i += 1) {
+        AudioGraphClip *clip = ag->audio_clip_list.at(i);
+        bool is_master = !clip->mixer_line && clip->stem_index == -1;
+        ok_or_panic((is_master ? master_clips : other_clips).append(clip));
+    }
+
+    ag->audio_clip_list.clear();
+    int kept_count = 0;
+    for (int project_i = 0; project_i < project->audio_clip_list.length(); project_i += 1) {
+        AudioClip *project_clip = project->audio_clip_list.at(project_i);
+        AudioGraphClip *ag_clip = nullptr;
+        for (int i = kept_count; i < master_clips.length(); i += 1) {
+            AudioGraphClip *master_clip = master_clips.at(i);
+            if (master_clip->audio_clip == project_clip &&
+                master_clip->polyphony == clamp(1, project_clip->polyphony, AUDIO_CLIP_MAX_POLYPHONY) &&
+                master_clip->voice_steal == project_clip->voice_steal &&
+                master_clip->stretch == project_clip->stretch &&
+                master_clip->pitch == project_clip->pitch &&
+                master_clip->time_stretch_quality == project_clip->time_stretch_quality)
+            {
+                ag_clip = master_clips.at(i);
+                master_clips.at(i) = master_clips.at(kept_count);
+                master_clips.at(kept_count) = ag_clip;
+                kept_count += 1;
+                break;
+            }
+        }
+        if (!ag_clip) {
+            ag_clip = create_audio_graph_clip(ag, project_clip, -1, nullptr);
+            if (audio_clip_wants_nodes(ag, ag_clip)) {
+                add_nodes_to_audio_clip(ag, ag_clip);
+                if (ag->is_playing && !ag->render_descr)
+                    seek_audio_clip(ag_clip, audio_graph_play_head_pos(ag));
+            }
+        }
+        ok_or_panic(ag->audio_clip_list.append(ag_clip));
+    }
+
+    // the clips that left the project take their nodes for other lines
+    // along with them
+    List<AudioGraphClip *> removed_clips;
+    for (int i = kept_count; i < master_clips.length(); i += 1)
+        ok_or_panic(removed_clips.append(master_clips.at(i)));
+    for (int i = 0; i < other_clips.length(); i += 1) {
+        AudioGraphClip *clip = other_clips.at(i);
+        bool removed = false;
+        for (int removed_i = 0; removed_i < master_clips.length() - kept_count && !removed; removed_i += 1)
+            removed = removed_clips.at(removed_i)->audio_clip == clip->audio_clip;
+        ok_or_panic((removed ? removed_clips : ag->audio_clip_list).append(clip));
+    }
+
+    // the clips that took new nodes need their segments again, on every
+    // line, and only then can the dormant ones among them be told apart
+    if (removed_clips.length() > 0) {
+        update_audio_clip_segments(ag);
+        if (ag->dormant_clips)
+            update_dormant_clips(ag, audio_graph_play_head_pos(ag));
+    }
+    patch_audio_clips(ag, &removed_clips);
+}
+
+static void refresh_audio_clip_segments(AudioGraph *ag) {
+    // the line mixers need a port for each new clip. segments that moved
+    // near the play head wake their clips, and ones that moved away let
+    // them sleep.
+    bool clips_changed = update_audio_clip_segments(ag);
+    if (ag->dormant_clips && update_dormant_clips(ag, audio_graph_play_head_pos(ag)))
+        clips_changed = true;
+    if (clips_changed) {
+        List<AudioGraphClip *> removed_clips;
+        patch_audio_clips(ag, &removed_clips);
+    }
+}
+
+static void frozen_track_destroy(AudioGraphFrozenTrack *frozen) {
+    if (frozen->node)
+        genesis_node_destroy(frozen->node);
+    genesis_node_descriptor_destroy(frozen->node_descr);
+    genesis_audio_file_reader_destroy(frozen->reader);
+    genesis_audio_file_destroy(frozen->audio_file);
+    destroy(frozen, 1);
+}
+
+// everything the render of the track's clips depends on
+static void get_frozen_track_digest(Project *project, Track *track, ByteBuffer &out) {
+    Sha256Hasher hasher;
+    int sample_rate = project->sample_rate;
+    hasher.update((char *)&sample_rate, sizeof(sample_rate));
+    const SoundIoChannelLayout *layout = &project->channel_layout;
+    hasher.update((char *)&layout->channel_count, sizeof(layout->channel_count));
+    hasher.update((char *)layout->channels, layout->channel_count * sizeof(layout->channels[0]));
+    for (int i = 0; i < track->audio_clip_segments.length(); i += 1) {
+        AudioClipSegment *segment = track->audio_clip_segments.at(i);
+        ByteBuffer &asset_digest = segment->audio_clip->audio_asset->sha256sum;
+        hasher.update(asset_digest.raw(), asset_digest.length());
+        hasher.update((char *)&segment->start, sizeof(segment->start));
+        hasher.update((char *)&segment->end, sizeof(segment->end));
+        hasher.update((char *)&segment->pos, sizeof(segment->pos));
+        hasher.update((char *)&segment->audio_clip->stretch, sizeof(segment->audio_clip->stretch));
+        hasher.update((char *)&segment->audio_clip->pitch, sizeof(segment->audio_clip->pitch));
+        hasher.update((char *)&segment->audio_clip->time_stretch_quality,
+                sizeof(segment->audio_clip->time_stretch_quality));
+    }
+    hasher.get_digest(out);
+}
+
+// a stem render of the track from the start of the project, moved into
+// place once it is whole so a failed render never leaves a short file in
+// the cache
+static int render_frozen_track(AudioGraph *ag, Track *track, const ByteBuffer &path) {
+    Project *project = ag->project;
+    RenderOutput output = {};
+    output.export_format.sample_rate = project->sample_rate;
+    output.export_format.resample_quality = GenesisResampleQualityMastering;
+    output.out_path = path;
+    output.out_path.append(".tmp");
+    output.track = track;
+    output.decoded = true;
+
+    AudioGraph *render_ag;
+    int err;
+    if ((err = audio_graph_create_multi_render(project, ag->pipeline->context, &output, 1, &render_ag)))
+        return err;
+    audio_graph_start_pipeline(render_ag);
+    while (render_ag->render_frame_index.load() < render_ag->render_frame_count)
+        os_cond_timed_wait(render_ag->render_cond, nullptr, 0.25);
+    audio_graph_destroy(render_ag);
+
+    return os_rename_clobber(output.out_path.raw(), path.raw());
+}
+
+// a seek puts the voices of the clips back in place after the set of
+// clip nodes changed under them
+static void restart_frozen_playback(AudioGraph *ag) {
+    if (ag->is_playing)
+        audio_graph_set_play_head(ag, audio_graph_play_head_pos(ag));
+}
+
+int audio_graph_freeze_track(AudioGraph *ag, Track *track) {
+    assert(!ag->render_descr);
+    if (find_frozen_track(ag, track) >= 0)
+        return 0;
+    if (track->audio_clip_segments.length() == 0)
+        return GenesisErrorInvalidParam;
+
+    Project *project = ag->project;
+    AudioGraphFrozenTrack *frozen = create_zero<AudioGraphFrozenTrack>();
+    if (!frozen)
+        return GenesisErrorNoMem;
+    frozen->audio_graph = ag;
+    frozen->track_id = track->id;
+    frozen->seek_pos.store(-1.0);
+    get_frozen_track_digest(project, track, frozen->digest);
+
+    ByteBuffer cache_dir;
+    ByteBuffer cache_path;
+    project_decoded_cache_path(project, frozen->digest, cache_dir, cache_path);
+    int err;
+    if (genesis_audio_file_map_decoded(ag->pipeline->context, cache_path.raw(), &frozen->audio_file)) {
+        if ((err = os_mkdirp(cache_dir)) ||
+            (err = render_frozen_track(ag, track, cache_path)) ||
+            (err = genesis_audio_file_map_decoded(ag->pipeline->context, cache_path.raw(), &frozen->audio_file)))
+        {
+            frozen_track_destroy(frozen);
+            return err;
+        }
+    }
+    if ((err = genesis_audio_file_reader_create(frozen->audio_file, &frozen->reader))) {
+        frozen_track_destroy(frozen);
+        return err;
+    }
+
+    char *description = create_formatted_str("Frozen Track: %s", track->name.encode().raw());
+    frozen->node_descr = genesis_create_node_descriptor(ag->pipeline, 1, "frozen_track", description);
+    free(description); description = nullptr;
+    if (!frozen->node_descr) {
+        frozen_track_destroy(frozen);
+        return GenesisErrorNoMem;
+    }
+    genesis_node_descriptor_set_userdata(frozen->node_descr, frozen);
+    struct GenesisPortDescriptor *audio_out_port = genesis_node_descriptor_create_port(
+            frozen->node_descr, 0, GenesisPortTypeAudioOut, "audio_out");
+    if (!audio_out_port) {
+        frozen_track_destroy(frozen);
+        return GenesisErrorNoMem;
+    }
+    genesis_audio_port_descriptor_set_channel_layout(audio_out_port,
+            genesis_audio_file_channel_layout(frozen->audio_file), true, -1);
+    genesis_audio_port_descriptor_set_sample_rate(audio_out_port,
+            genesis_audio_file_sample_rate(frozen->audio_file), true, -1);
+    genesis_node_descriptor_set_run_callback(frozen->node_descr, frozen_track_node_run);
+    genesis_node_descriptor_set_seek_callback(frozen->node_descr, frozen_track_node_seek);
+
+    frozen->node = genesis_node_descriptor_create_node(frozen->node_descr);
+    if (!frozen->node || ag->frozen_tracks.append(frozen)) {
+        frozen_track_destroy(frozen);
+        return GenesisErrorNoMem;
+    }
+
+    // the frozen node takes the mixer line inputs of the clips it replaces
+    if (genesis_pipeline_is_running(ag->pipeline)) {
+        GenesisGraphEdit *edit;
+        ok_or_panic(genesis_graph_edit_begin(ag->pipeline, &edit));
+        teardown_graph(ag, edit);
+        ok_or_panic(genesis_graph_edit_commit(edit));
+        destroy_mixer_lines(ag);
+        update_audio_clip_segments(ag);
+        ok_or_panic(genesis_graph_edit_begin(ag->pipeline, &edit));
+        build_graph(ag, edit);
+        ok_or_panic(genesis_graph_edit_commit(edit));
+    } else {
+        update_audio_clip_segments(ag);
+    }
+    restart_frozen_playback(ag);
+    return 0;
+}
+
+static void thaw_frozen_track(AudioGraph *ag, int index) {
+    AudioGraphFrozenTrack *frozen = ag->frozen_tracks.at(index);
+    bool running = genesis_pipeline_is_running(ag->pipeline);
+    if (running) {
+        GenesisGraphEdit *edit;
+        ok_or_panic(genesis_graph_edit_begin(ag->pipeline, &edit));
+        teardown_graph(ag, edit);
+        ok_or_panic(genesis_graph_edit_remove_node(edit, frozen->node));
+        ok_or_panic(genesis_graph_edit_commit(edit));
+        destroy_mixer_lines(ag);
+        frozen->node = nullptr;
+    }
+    ag->frozen_tracks.swap_remove(index);
+    frozen_track_destroy(frozen);
+    update_audio_clip_segments(ag);
+    if (running) {
+        GenesisGraphEdit *edit;
+        ok_or_panic(genesis_graph_edit_begin(ag->pipeline, &edit));
+        build_graph(ag, edit);
+        ok_or_panic(genesis_graph_edit_commit(edit));
+    }
+}
+
+void audio_graph_thaw_track(AudioGraph *ag, Track *track) {
+    int index = find_frozen_track(ag, track);
+    if (index < 0)
+        return;
+    thaw_frozen_track(ag, index);
+    restart_frozen_playback(ag);
+}
+
+bool audio_graph_track_is_frozen(AudioGraph *ag, Track *track) {
+    return find_frozen_track(ag, track) >= 0;
+}
+
+// thaws the tracks that are gone or whose rendered file is out of date
+static void refresh_frozen_tracks(AudioGraph *ag) {
+    bool any_thawed = false;
+    for (int i = ag->frozen_tracks.length() - 1; i >= 0; i -= 1) {
+        AudioGraphFrozenTrack *frozen = ag->frozen_tracks.at(i);
+        Track *track = frozen_track_track(ag, frozen);
+        if (track) {
+            ByteBuffer digest;
+            get_frozen_track_digest(ag->project, track, digest);
+            if (digest == frozen->digest)
+                continue;
+        }
+        thaw_frozen_track(ag, i);
+        any_thawed = true;
+    }
+    if (any_thawed)
+        restart_frozen_playback(ag);
+}
+
+static void prerender_reader_destroy(GenesisAudioFileReader *reader) {
+    GenesisAudioFile *audio_file = reader->audio_file;
+    genesis_audio_file_reader_destroy(reader);
+    genesis_audio_file_destroy(audio_file);
+}
+
+static void prerender_grid_destroy(AudioGraphPrerenderGrid *grid) {
+    destroy(grid->blocks, grid->block_count);
+    destroy(grid, 1);
+}
+
+// takes the block's file away from the prerender node. returns whether the
+// block was playing from it in this pass, which then has to start over.
+static bool retire_prerender_block(AudioGraph *ag, AudioGraphPrerenderBlock *block) {
+    GenesisAudioFileReader *reader = block->reader.exchange(nullptr);
+    if (reader)
+        ok_or_panic(ag->prerender_retired.append(reader));
+    long pass = ag->prerender_pass.load();
+    return block->decision.exchange(pass * 2) == pass * 2 + 1;
+}
+
+// blocks are rendered at the rate and layout of the project, which the
+// prerender node plays as they are
+static bool prerender_format_matches(AudioGraph *ag) {
+    Project *project = ag->project;
+    return project->sample_rate == ag->prerender_sample_rate &&
+        project->sample_rate == genesis_pipeline_get_sample_rate(ag->pipeline) &&
+        soundio_channel_layout_equal(&project->channel_layout, &ag->prerender_channel_layout) &&
+        soundio_channel_layout_equal(&project->channel_layout, genesis_pipeline_get_channel_layout(ag->pipeline));
+}
+
+// what the mix of every block depends on besides its own segments
+static void get_prerender_settings_digest(AudioGraph *ag, ByteBuffer &out) {
+    Project *project = ag->project;
+    Sha256Hasher hasher;
+    int sample_rate = project->sample_rate;
+    hasher.update((char *)&sample_rate, sizeof(sample_rate));
+    const SoundIoChannelLayout *layout = &project->channel_layout;
+    hasher.update((char *)&layout->channel_count, sizeof(layout->channel_count));
+    hasher.update((char *)layout->channels, layout->channel_count * sizeof(layout->channels[0]));
+    for (int i = 0; i < project->mixer_line_list.length(); i += 1) {
+        MixerLine *mixer_line = project->mixer_line_list.at(i);
+        hasher.update((char *)&mixer_line->id, sizeof(mixer_line->id));
+        hasher.update((char *)&mixer_line->solo, sizeof(mixer_line->solo));
+        hasher.update((char *)&mixer_line->volume, sizeof(mixer_line->volume));
+        for (int effect_i = 0; effect_i < mixer_line->effects.length(); effect_i += 1) {
+            Effect *effect = mixer_line->effects.at(effect_i);
+            if (effect->effect_type != EffectTypeSend)
+                continue;
+            EffectSend *send = &effect->effect.send;
+            hasher.update((char *)&send->gain, sizeof(send->gain));
+            hasher.update((char *)&send->send_type, sizeof(send->send_type));
+            if (send->send_type == EffectSendTypeMixerLine) {
+                uint256 *target_id = &send->send.mixer_line.mixer_line_id;
+                hasher.update((char *)target_id, sizeof(*target_id));
+            }
+        }
+    }
+    int voice_limit = ag->voice_limit.load();
+    hasher.update((char *)&voice_limit, sizeof(voice_limit));
+    hasher.get_digest(out);
+}
+
+// first_frame is where the render of the block starts, with its pre-roll
+static void get_prerender_block_digest(AudioGraph *ag, ByteBuffer &settings_digest,
+        long first_frame, long block_start, long block_end, ByteBuffer &out)
+{
+    Project *project = ag->project;
+    Sha256Hasher hasher;
+    hasher.update(settings_digest.raw(), settings_digest.length());
+    hasher.update((char *)&block_start, sizeof(block_start));
+    hasher.update((char *)&block_end, sizeof(block_end));
+    for (int track_i = 0; track_i < project->track_list.length(); track_i += 1) {
+        Track *track = project->track_list.at(track_i);
+        for (int i = 0; i < track->audio_clip_segments.length(); i += 1) {
+            AudioClipSegment *segment = track->audio_clip_segments.at(i);
+            long start;
+            long end;
+            get_segment_frames(ag, segment, project->sample_rate, &start, &end);
+            if (start >= block_end || end <= first_frame)
+                continue;
+            AudioClip *audio_clip = segment->audio_clip;
+            ByteBuffer &asset_digest = audio_clip->audio_asset->sha256sum;
+            hasher.update(asset_digest.raw(), asset_digest.length());
+            hasher.update((char *)&segment->start, sizeof(segment->start));
+            hasher.update((char *)&segment->end, sizeof(segment->end));
+            hasher.update((char *)&segment->pos, sizeof(segment->pos));
+            hasher.update((char *)&track->mixer_line_id, sizeof(track->mixer_line_id));
+            hasher.update((char *)&audio_clip->polyphony, sizeof(audio_clip->polyphony));
+            hasher.update((char *)&audio_clip->voice_steal, sizeof(audio_clip->voice_steal));
+            hasher.update((char *)&audio_clip->stretch, sizeof(audio_clip->stretch));
+            hasher.update((char *)&audio_clip->pitch, sizeof(audio_clip->pitch));
+            hasher.update((char *)&audio_clip->time_stretch_quality, sizeof(audio_clip->time_stretch_quality));
+        }
+    }
+    hasher.get_digest(out);
+}
+
+static AudioGraphPrerenderGrid *create_prerender_grid(AudioGraph *ag, long block_frames,
+        long preroll_frames, long frame_count)
+{
+    AudioGraphPrerenderGrid *grid = ok_mem(create_zero<AudioGraphPrerenderGrid>());
+    grid->sample_rate = ag->project->sample_rate;
+    grid->block_frames = block_frames;
+    grid->preroll_frames = preroll_frames;
+    grid->frame_count = frame_count;
+    grid->block_count = (frame_count + block_frames - 1) / block_frames;
+    if (grid->block_count == 0)
+        return grid;
+    grid->blocks = allocate_class<AudioGraphPrerenderBlock>(grid->block_count);
+    for (int i = 0; i < grid->block_count; i += 1) {
+        grid->blocks[i].reader.store(nullptr);
+        grid->blocks[i].decision.store(0);
+    }
+    return grid;
+}
+
+static void create_prerender_node(AudioGraph *ag) {
+    ag->prerender_sample_rate = genesis_pipeline_get_sample_rate(ag->pipeline);
+    ag->prerender_channel_layout = *genesis_pipeline_get_channel_layout(ag->pipeline);
+    ag->prerender_seek_pos.store(-1.0);
+    ag->prerender_frame_pos = 0;
+    ag->prerender_descr = ok_mem(genesis_create_node_descriptor(ag->pipeline, 1, "prerender",
+                "Pre-rendered master mix."));
+    genesis_node_descriptor_set_userdata(ag->prerender_descr, ag);
+    GenesisPortDescriptor *audio_out_port = ok_mem(genesis_node_descriptor_create_port(
+            ag->prerender_descr, 0, GenesisPortTypeAudioOut, "audio_out"));
+    genesis_audio_port_descriptor_set_channel_layout(audio_out_port, &ag->prerender_channel_layout, true, -1);
+    genesis_audio_port_descriptor_set_sample_rate(audio_out_port, ag->prerender_sample_rate, true, -1);
+    genesis_node_descriptor_set_run_callback(ag->prerender_descr, prerender_node_run);
+    genesis_node_descriptor_set_seek_callback(ag->prerender_descr, prerender_node_seek);
+    ag->prerender_node = ok_mem(genesis_node_descriptor_create_node(ag->prerender_descr));
+}
+
+// takes the prerender node out of the graph. a running pipeline goes
+// through a grace period on the way, after which nothing reads the grids.
+static void remove_prerender_node(AudioGraph *ag) {
+    if (!ag->prerender_node)
+        return;
+    if (genesis_pipeline_is_running(ag->pipeline)) {
+        GenesisGraphEdit *edit;
+        ok_or_panic(genesis_graph_edit_begin(ag->pipeline, &edit));
+        teardown_graph(ag, edit);
+        ok_or_panic(genesis_graph_edit_remove_node(edit, ag->prerender_node));
+        ok_or_panic(genesis_graph_edit_commit(edit));
+        destroy_mixer_lines(ag);
+        ag->prerender_node = nullptr;
+        ok_or_panic(genesis_graph_edit_begin(ag->pipeline, &edit));
+        build_graph(ag, edit);
+        ok_or_panic(genesis_graph_edit_commit(edit));
+    } else {
+        genesis_node_destroy(ag->prerender_node);
+        ag->prerender_node = nullptr;
+    }
+    genesis_node_descriptor_destroy(ag->prerender_descr);
+    ag->prerender_descr = nullptr;
+}
+
+// gives every block the digest of what it holds now. blocks whose digest
+// changed play live until they are rendered again. a grid is only laid out
+// once every asset is loaded, since block sizes depend on their rates.
+static void refresh_prerender(AudioGraph *ag) {
+    // whatever changes what the prerender holds also changes the state the
+    // nodes would have reached
+    genesis_pipeline_clear_checkpoints(ag->pipeline);
+    if (!ag->prerender_enabled)
+        return;
+    // the node takes the format of the pipeline again while it is stopped
+    if (!genesis_pipeline_is_running(ag->pipeline) &&
+        (ag->prerender_sample_rate != genesis_pipeline_get_sample_rate(ag->pipeline) ||
+         !soundio_channel_layout_equal(&ag->prerender_channel_layout,
+             genesis_pipeline_get_channel_layout(ag->pipeline))))
+    {
+        remove_prerender_node(ag);
+        create_prerender_node(ag);
+    }
+    Project *project = ag->project;
+    bool all_loaded = true;
+    for (int i = 0; i < project->audio_clip_list.length(); i += 1)
+        all_loaded = all_loaded && project_audio_asset_is_loaded(project->audio_clip_list.at(i)->audio_asset);
+
+    AudioGraphPrerenderGrid *old_grid = ag->prerender_grid.load();
+    AudioGraphPrerenderGrid *grid = nullptr;
+    bool restart = false;
+    if (all_loaded && prerender_format_matches(ag)) {
+        int sample_rate = project->sample_rate;
+        long alignment = render_coordinator_alignment(project, sample_rate);
+        long block_frames = ((long)(PRERENDER_BLOCK_SECONDS * sample_rate) + alignment - 1) / alignment * alignment;
+        long preroll_frames = ((long)(PRERENDER_PREROLL_SECONDS * sample_rate) + alignment - 1) / alignment * alignment;
+        long frame_count = 0;
+        for (int track_i = 0; track_i < project->track_list.length(); track_i += 1) {
+            Track *track = project->track_list.at(track_i);
+            for (int i = 0; i < track->audio_clip_segments.length(); i += 1) {
+                long start;
+                long end;
+                get_segment_frames(ag, track->audio_clip_segments.at(i), sample_rate, &start, &end);
+                frame_count = max(frame_count, end);
+            }
+        }
+        long block_count = (frame_count + block_frames - 1) / block_frames;
+        if (old_grid && old_grid->block_frames == block_frames &&
+            old_grid->preroll_frames == preroll_frames && old_grid->block_count == block_count)
+        {
+            grid = old_grid;
+            grid->frame_count = frame_count;
+        } else {
+            grid = create_prerender_grid(ag, block_frames, preroll_frames, frame_count);
+        }
+
+        ByteBuffer settings_digest;
+        get_prerender_settings_digest(ag, settings_digest);
+        for (int i = 0; i < grid->block_count; i += 1) {
+            AudioGraphPrerenderBlock *block = &grid->blocks[i];
+            long block_start = i * block_frames;
+            long block_end = min(block_start + block_frames, frame_count);
+            ByteBuffer digest;
+            get_prerender_block_digest(ag, settings_digest, max(0L, block_start - preroll_frames),
+                    block_start, block_end, digest);
+            if (grid == old_grid && digest != block->digest)
+                restart = retire_prerender_block(ag, block) || restart;
+            block->digest = digest;
+        }
+    }
+
+    if (grid != old_grid) {
+        // the files of blocks which are the same move to the new grid. the
+        // old grid lets go of them, so that nothing pins them through it.
+        if (old_grid) {
+            for (int i = 0; i < old_grid->block_count; i += 1) {
+                AudioGraphPrerenderBlock *old_block = &old_grid->blocks[i];
+                AudioGraphPrerenderBlock *block = nullptr;
+                if (grid && i < grid->block_count && grid->block_frames == old_grid->block_frames)
+                    block = &grid->blocks[i];
+                if (block && block->digest == old_block->digest) {
+                    block->reader.store(old_block->reader.exchange(nullptr));
+                    block->decision.store(old_block->decision.load());
+                } else {
+                    restart = retire_prerender_block(ag, old_block) || restart;
+                }
+            }
+            ok_or_panic(ag->prerender_retired_grids.append(old_grid));
+        }
+        ag->prerender_grid.store(grid);
+    }
+
+    if (restart)
+        restart_frozen_playback(ag);
+}
+
+static void get_prerender_cache_paths(AudioGraph *ag, const ByteBuffer &digest,
+        ByteBuffer &out_dir, ByteBuffer &out_path, ByteBuffer &out_tmp_path)
+{
+    project_decoded_cache_path(ag->project, digest, out_dir, out_path);
+    out_tmp_path = out_path;
+    out_tmp_path.append(".tmp");
+}
+
+static bool load_prerender_block(AudioGraph *ag, AudioGraphPrerenderBlock *block, const ByteBuffer &path) {
+    GenesisAudioFile *audio_file;
+    if (genesis_audio_file_map_decoded(ag->pipeline->context, path.raw(), &audio_file))
+        return false;
+    GenesisAudioFileReader *reader;
+    if (genesis_audio_file_reader_create(audio_file, &reader)) {
+        genesis_audio_file_destroy(audio_file);
+        return false;
+    }
+    block->reader.store(reader);
+    return true;
+}
 
-    clip->event_node_descr = node_descr;
-    clip->event_node = ok_mem(genesis_node_descriptor_create_node(node_descr));
+static void cancel_prerender_render(AudioGraph *ag) {
+    if (!ag->prerender_render)
+        return;
+    audio_graph_destroy(ag->prerender_render);
+    ag->prerender_render = nullptr;
+    ByteBuffer cache_dir;
+    ByteBuffer cache_path;
+    ByteBuffer tmp_path;
+    get_prerender_cache_paths(ag, ag->prerender_render_digest, cache_dir, cache_path, tmp_path);
+    os_delete(tmp_path.raw());
 }
 
-static void add_nodes_to_audio_clip(AudioGraph *ag, AudioGraphClip *clip) {
-    add_audio_node_to_audio_clip(ag, clip);
-    add_event_node_to_audio_clip(ag, clip);
+// the render is kept in the cache even when an edit has changed its block
+// meanwhile, for an undo to find
+static void finish_prerender_render(AudioGraph *ag) {
+    audio_graph_destroy(ag->prerender_render);
+    ag->prerender_render = nullptr;
+    ByteBuffer cache_dir;
+    ByteBuffer cache_path;
+    ByteBuffer tmp_path;
+    get_prerender_cache_paths(ag, ag->prerender_render_digest, cache_dir, cache_path, tmp_path);
+    if (os_rename_clobber(tmp_path.raw(), cache_path.raw())) {
+        os_delete(tmp_path.raw());
+        return;
+    }
+    AudioGraphPrerenderGrid *grid = ag->prerender_grid.load();
+    if (!grid || ag->prerender_render_block >= grid->block_count)
+        return;
+    AudioGraphPrerenderBlock *block = &grid->blocks[ag->prerender_render_block];
+    if (!block->reader.load() && block->digest == ag->prerender_render_digest)
+        load_prerender_block(ag, block, cache_path);
 }
 
-static void refresh_audio_clips(AudioGraph *ag) {
+// the first block without a file, from the play head on, comes from the
+// cache if it was rendered before or else is rendered. a render waits for
+// every asset, so that it never blocks the main thread on one.
+static void start_prerender_render(AudioGraph *ag) {
     Project *project = ag->project;
-    int ag_i = 0;
-    int project_i = 0;
-    for (;;) {
-        AudioGraphClip *ag_clip = nullptr;
-        AudioClip *project_clip = nullptr;
-        if (ag_i < ag->audio_clip_list.length())
-            ag_clip = ag->audio_clip_list.at(ag_i);
-        if (project_i < project->audio_clip_list.length())
-            project_clip = project->audio_clip_list.at(project_i);
-        if (ag_clip && project_clip && ag_clip->audio_clip == project_clip) {
-            ag_i += 1;
-            project_i += 1;
-        } else if (project_clip && !ag_clip) {
-            ag_clip = ok_mem(create_zero<AudioGraphClip>());
-            ag_clip->audio_clip = project_clip;
-            ag_clip->audio_graph = ag;
-            add_nodes_to_audio_clip(ag, ag_clip);
-            ok_or_panic(ag->audio_clip_list.append(ag_clip));
-            ag_i += 1;
-            project_i += 1;
-        } else if (!project_clip && ag_clip) {
-            panic("TODO destroy audio graph clip");
-            ag->audio_clip_list.swap_remove(ag_i);
-        } else if (!project_clip && !ag_clip) {
-            break;
-        } else {
-            panic("TODO replace nodes");
-        }
+    AudioGraphPrerenderGrid *grid = ag->prerender_grid.load();
+    if (!grid || grid->block_count == 0)
+        return;
+
+    long play_head_frame = genesis_whole_notes_to_frames(ag->pipeline,
+            audio_graph_play_head_pos(ag), grid->sample_rate);
+    int first_block = min((long)grid->block_count - 1, play_head_frame / grid->block_frames);
+    for (int block_i = 0; block_i < grid->block_count; block_i += 1) {
+        int index = (first_block + block_i) % grid->block_count;
+        AudioGraphPrerenderBlock *block = &grid->blocks[index];
+        if (block->reader.load())
+            continue;
+        ByteBuffer cache_dir;
+        ByteBuffer cache_path;
+        ByteBuffer tmp_path;
+        get_prerender_cache_paths(ag, block->digest, cache_dir, cache_path, tmp_path);
+        if (load_prerender_block(ag, block, cache_path))
+            continue;
+        if (os_mkdirp(cache_dir))
+            return;
+
+        RenderOutput output = {};
+        output.export_format.sample_rate = grid->sample_rate;
+        output.export_format.resample_quality = GenesisResampleQualityRealtime;
+        output.out_path = tmp_path;
+        output.track = nullptr;
+        output.decoded = true;
+        AudioGraph *render_ag;
+        if (audio_graph_create_multi_render(project, ag->pipeline->context, &output, 1, &render_ag))
+            return;
+        long block_start = index * grid->block_frames;
+        long frame_count = min(grid->block_frames, grid->frame_count - block_start);
+        audio_graph_set_render_range(render_ag, block_start, frame_count, grid->preroll_frames);
+        audio_graph_start_pipeline(render_ag);
+        ag->prerender_render = render_ag;
+        ag->prerender_render_digest = block->digest;
+        ag->prerender_render_block = index;
+        return;
     }
 }
 
-static void refresh_audio_clip_segments(AudioGraph *ag) {
-    for (int clip_i = 0; clip_i < ag->audio_clip_list.length(); clip_i += 1) {
-        AudioGraphClip *clip = ag->audio_clip_list.at(clip_i);
-        clip->audio_clip->userdata = clip;
-        clip->events_write_ptr = clip->events.write_begin();
-        clip->events_write_ptr->clear();
+static void prerender_flush(AudioGraph *ag) {
+    GenesisAudioFileReader *pinned = nullptr;
+    if (genesis_pipeline_is_running(ag->pipeline))
+        pinned = ag->prerender_pinned.load();
+    else
+        ag->prerender_pinned.store(nullptr);
+    for (int i = ag->prerender_retired.length() - 1; i >= 0; i -= 1) {
+        GenesisAudioFileReader *reader = ag->prerender_retired.at(i);
+        if (reader == pinned)
+            continue;
+        ag->prerender_retired.swap_remove(i);
+        prerender_reader_destroy(reader);
+    }
+    if (!genesis_pipeline_is_running(ag->pipeline)) {
+        while (ag->prerender_retired_grids.length())
+            prerender_grid_destroy(ag->prerender_retired_grids.pop());
     }
 
-    auto it = ag->project->audio_clip_segments.entry_iterator();
-    for (;;) {
-        auto *entry = it.next();
-        if (!entry)
-            break;
+    if (ag->prerender_render) {
+        if (ag->prerender_render->render_frame_index.load() < ag->prerender_render->render_frame_count)
+            return;
+        finish_prerender_render(ag);
+    }
 
-        AudioClipSegment *segment = entry->value;
-        AudioClip *audio_clip = segment->audio_clip;
-        AudioGraphClip *clip = (AudioGraphClip *)audio_clip->userdata;
-        assert(clip);
-        ok_or_panic(clip->events_write_ptr->add_one());
-        GenesisMidiEvent *event = &clip->events_write_ptr->last();
-        event->event_type = GenesisMidiEventTypeSegment;
-        event->start = segment->pos;
-        event->data.segment_data.start = segment->start;
-        event->data.segment_data.end = segment->end;
+    bool all_loaded = true;
+    for (int i = 0; i < ag->project->audio_clip_list.length(); i += 1)
+        all_loaded = all_loaded && project_audio_asset_is_loaded(ag->project->audio_clip_list.at(i)->audio_asset);
+    if (all_loaded)
+        start_prerender_render(ag);
+}
+
+// for when no pipeline thread reads the grids any more
+static void destroy_prerender_cache(AudioGraph *ag) {
+    cancel_prerender_render(ag);
+    AudioGraphPrerenderGrid *grid = ag->prerender_grid.exchange(nullptr);
+    if (grid) {
+        for (int i = 0; i < grid->block_count; i += 1) {
+            GenesisAudioFileReader *reader = grid->blocks[i].reader.exchange(nullptr);
+            if (reader)
+                prerender_reader_destroy(reader);
+        }
+        prerender_grid_destroy(grid);
     }
+    while (ag->prerender_retired_grids.length())
+        prerender_grid_destroy(ag->prerender_retired_grids.pop());
+    while (ag->prerender_retired.length())
+        prerender_reader_destroy(ag->prerender_retired.pop());
+    ag->prerender_pinned.store(nullptr);
+}
 
-    for (int i = 0; i < ag->audio_clip_list.length(); i += 1) {
-        AudioGraphClip *clip = ag->audio_clip_list.at(i);
-        clip->events.write_end();
-        clip->events_write_ptr = nullptr;
+void audio_graph_set_prerender(AudioGraph *ag, bool enabled) {
+    assert(!ag->render_descr);
+    if (ag->prerender_enabled == enabled)
+        return;
+    ag->prerender_enabled = enabled;
+    if (!enabled) {
+        ag->prerender_grid.store(nullptr);
+        remove_prerender_node(ag);
+        destroy_prerender_cache(ag);
+        return;
     }
+
+    create_prerender_node(ag);
+    if (genesis_pipeline_is_running(ag->pipeline))
+        rebuild_graph(ag);
+    refresh_prerender(ag);
+    restart_frozen_playback(ag);
+}
+
+bool audio_graph_prerender_enabled(AudioGraph *ag) {
+    return ag->prerender_enabled;
 }
 
+// a stem render keeps the clips and segments it started with, since its
+// clip nodes are split by track
 static void on_project_audio_clips_changed(Event, void *userdata) {
     AudioGraph *ag = (AudioGraph *) userdata;
-    refresh_audio_clips(ag);
+    if (ag->render_stem_buses.length() == 0)
+        refresh_audio_clips(ag);
+    ag->render_intervals_stale.store(true);
+    refresh_prerender(ag);
 }
 
 static void on_project_audio_clip_segments_changed(Event, void *userdata) {
     AudioGraph *ag = (AudioGraph *) userdata;
-    refresh_audio_clip_segments(ag);
+    if (ag->render_stem_buses.length() == 0) {
+        refresh_frozen_tracks(ag);
+        refresh_audio_clip_segments(ag);
+    }
+    ag->render_intervals_stale.store(true);
+    refresh_prerender(ag);
+}
+
+// a rendered file holds the project rate and layout, and its track
+static void on_project_frozen_tracks_changed(Event, void *userdata) {
+    AudioGraph *ag = (AudioGraph *) userdata;
+    refresh_frozen_tracks(ag);
+    refresh_prerender(ag);
+}
+
+// volume, solo and sends are read when the graph is built
+static void on_project_mixer_lines_changed(Event, void *userdata) {
+    AudioGraph *ag = (AudioGraph *) userdata;
+    if (!ag->render_descr && genesis_pipeline_is_running(ag->pipeline))
+        rebuild_graph(ag);
+    refresh_prerender(ag);
+}
+
+static void on_project_audio_asset_loaded(Event, void *userdata) {
+    AudioGraph *ag = (AudioGraph *) userdata;
+    add_loaded_pending_clips(ag);
+    refresh_prerender(ag);
+}
+
+static void set_pipeline_tempo_map(GenesisPipeline *pipeline, Project *project) {
+    List<GenesisTempoChange> changes;
+    ok_or_panic(changes.resize(project->tempo_map.change_count()));
+    for (int i = 0; i < changes.length(); i += 1)
+        changes.at(i) = project->tempo_map.change_at(i);
+    ok_or_panic(genesis_pipeline_set_tempo_map(pipeline, changes.raw(), changes.length()));
 }
 
 static AudioGraph *audio_graph_create_common(Project *project, GenesisContext *genesis_context,
-        double latency)
+        double latency, GenesisResampleQuality resample_quality, bool dormant_clips)
 {
     GenesisPipeline *pipeline;
     ok_or_panic(genesis_pipeline_create(genesis_context, &pipeline));
 
     genesis_pipeline_set_latency(pipeline, latency);
     genesis_pipeline_set_sample_rate(pipeline, project->sample_rate);
+    set_pipeline_tempo_map(pipeline, project);
     genesis_pipeline_set_channel_layout(pipeline, &project->channel_layout);
+    if (dormant_clips)
+        ok_or_panic(genesis_pipeline_set_checkpoints(pipeline, CHECKPOINT_INTERVAL_SECONDS, CHECKPOINT_COUNT));
 
     AudioGraph *ag = ok_mem(create_zero<AudioGraph>());
     ag->project = project;
     ag->pipeline = pipeline;
+    ag->dormant_clips = dormant_clips;
     ag->play_head_pos = 0.0;
     ag->is_playing = false;
+    ag->voice_limit.store(AUDIO_GRAPH_DEFAULT_VOICE_LIMIT);
+    ag->active_voice_count.store(0);
     ag->play_head_changed_flag.clear();
+    ag->prerender_grid.store(nullptr);
+    ag->prerender_pass.store(1);
+    ag->prerender_pinned.store(nullptr);
+    ag->prerender_seek_pos.store(-1.0);
 
     ag->resample_descr = genesis_node_descriptor_find(ag->pipeline, "resample");
     if (!ag->resample_descr)
         panic("unable to find resampler");
+    ag->meter_descr = genesis_node_descriptor_find(ag->pipeline, "meter");
+    if (!ag->meter_descr)
+        panic("unable to find meter");
+    ok_or_panic(genesis_resample_descriptor_set_quality(ag->resample_descr, resample_quality));
 
     genesis_pipeline_set_underrun_callback(pipeline, underrun_callback, ag);
 
@@ -734,6 +3253,18 @@ static AudioGraph *audio_graph_create_common(Project *project, GenesisContext *g
             on_project_audio_clips_changed, ag);
     project->events.attach_handler(EventProjectAudioClipSegmentsChanged,
             on_project_audio_clip_segments_changed, ag);
+    project->events.attach_handler(EventProjectMixerLinesChanged,
+            on_project_mixer_lines_changed, ag);
+    project->events.attach_handler(EventProjectEffectsChanged,
+            on_project_mixer_lines_changed, ag);
+    project->events.attach_handler(EventProjectAudioAssetLoaded,
+            on_project_audio_asset_loaded, ag);
+    project->events.attach_handler(EventProjectTracksChanged,
+            on_project_frozen_tracks_changed, ag);
+    project->events.attach_handler(EventProjectSampleRateChanged,
+            on_project_frozen_tracks_changed, ag);
+    project->events.attach_handler(EventProjectChannelLayoutChanged,
+            on_project_frozen_tracks_changed, ag);
 
 
     refresh_audio_clips(ag);
@@ -746,9 +3277,13 @@ static AudioGraph *audio_graph_create_common(Project *project, GenesisContext *g
 int audio_graph_create_playback(Project *project, GenesisContext *genesis_context,
         SettingsFile *settings_file, AudioGraph **out_audio_graph)
 {
-    AudioGraph *ag = audio_graph_create_common(project, genesis_context, settings_file->latency);
+    AudioGraph *ag = audio_graph_create_common(project, genesis_context, settings_file->latency,
+            GenesisResampleQualityRealtime, true);
 
     ag->settings_file = settings_file;
+    ok_or_panic(genesis_pipeline_set_adaptive_latency(ag->pipeline, true,
+                min(PLAYBACK_MIN_LATENCY, settings_file->latency), max(PLAYBACK_MAX_LATENCY, settings_file->latency)));
+    ok_or_panic(genesis_pipeline_set_idle_enabled(ag->pipeline, true));
 
     ag->audio_file_descr = genesis_create_node_descriptor(ag->pipeline,
             1, "audio_file", "Audio file playback.");
@@ -761,12 +3296,18 @@ int audio_graph_create_playback(Project *project, GenesisContext *genesis_contex
             ag->audio_file_descr, 0, GenesisPortTypeAudioOut, "audio_out");
     if (!ag->audio_file_port_descr)
         panic("unable to create audio out port descriptor");
+    // the preview voice converts to the pipeline's format itself, so that
+    // it never has to be reconnected
+    genesis_audio_port_descriptor_set_channel_layout(ag->audio_file_port_descr,
+            genesis_pipeline_get_channel_layout(ag->pipeline), true, -1);
+    genesis_audio_port_descriptor_set_sample_rate(ag->audio_file_port_descr,
+            genesis_pipeline_get_sample_rate(ag->pipeline), true, -1);
     ag->audio_file_node = nullptr;
 
 
     init_playback_node(ag);
 
-    play_audio_file(ag, nullptr, true);
+    play_audio_file(ag, nullptr, nullptr);
 
 
     *out_audio_graph = ag;
@@ -777,138 +3318,333 @@ int audio_graph_create_render(Project *project, GenesisContext *genesis_context,
         const GenesisExportFormat *export_format, const ByteBuffer &out_path,
         AudioGraph **out_audio_graph)
 {
-    AudioGraph *ag = audio_graph_create_common(project, genesis_context, 0.10);
-
-    ag->render_export_format = *export_format;
-    ag->render_out_path = out_path;
-
-    ag->render_frame_index = 0;
-    ag->render_frame_count = project_get_duration_frames(project);
-    ag->render_cond = ok_mem(os_cond_create());
-    ag->is_playing = true;
-
-    ag->render_descr = genesis_create_node_descriptor(ag->pipeline,
-            1, "render", "Master render node.");
-    if (!ag->render_descr)
-        panic("unable to create render node descriptor");
-
-    genesis_node_descriptor_set_userdata(ag->render_descr, ag);
-    genesis_node_descriptor_set_run_callback(ag->render_descr, render_node_run);
-    genesis_node_descriptor_set_activate_callback(ag->render_descr, render_node_activate);
-    ag->render_port_descr = genesis_node_descriptor_create_port(
-            ag->render_descr, 0, GenesisPortTypeAudioIn, "audio_in");
-    if (!ag->render_port_descr)
-        panic("unable to create render port descriptor");
-    genesis_audio_port_descriptor_set_channel_layout(ag->render_port_descr,
-            &project->channel_layout, true, -1);
-    genesis_audio_port_descriptor_set_sample_rate(ag->render_port_descr,
-            export_format->sample_rate, true, -1);
-
-    ag->master_node = ok_mem(genesis_node_descriptor_create_node(ag->render_descr));
+    RenderOutput output;
+    output.export_format = *export_format;
+    output.out_path = out_path;
+    output.track = nullptr;
+    output.decoded = false;
+    return audio_graph_create_multi_render(project, genesis_context, &output, 1, out_audio_graph);
+}
 
-    ag->render_stream = ok_mem(genesis_audio_file_stream_create(ag->pipeline->context));
+int audio_graph_open_render_stream(Project *project, GenesisContext *genesis_context,
+        const GenesisExportFormat *export_format, const ByteBuffer &out_path,
+        GenesisAudioFileStream **out_stream)
+{
+    *out_stream = nullptr;
+    GenesisAudioFileStream *stream = genesis_audio_file_stream_create(genesis_context);
+    if (!stream)
+        return GenesisErrorNoMem;
 
-    int render_sample_rate = genesis_audio_file_codec_best_sample_rate(export_format->codec,
-            export_format->sample_rate);
+    int render_sample_rate = genesis_audio_file_codec_sample_rate_index(export_format->codec,
+            genesis_audio_file_codec_best_sample_rate(export_format->codec, export_format->sample_rate));
 
-    genesis_audio_file_stream_set_sample_rate(ag->render_stream, render_sample_rate);
-    genesis_audio_file_stream_set_channel_layout(ag->render_stream, &project->channel_layout);
+    genesis_audio_file_stream_set_sample_rate(stream, render_sample_rate);
+    genesis_audio_file_stream_set_channel_layout(stream, &project->channel_layout);
 
     ByteBuffer encoded;
     encoded = project->tag_title.encode();
-    genesis_audio_file_stream_set_tag(ag->render_stream, "title", -1, encoded.raw(), encoded.length());
+    genesis_audio_file_stream_set_tag(stream, "title", -1, encoded.raw(), encoded.length());
 
     encoded = project->tag_artist.encode();
-    genesis_audio_file_stream_set_tag(ag->render_stream, "artist", -1, encoded.raw(), encoded.length());
+    genesis_audio_file_stream_set_tag(stream, "artist", -1, encoded.raw(), encoded.length());
 
     encoded = project->tag_album_artist.encode();
-    genesis_audio_file_stream_set_tag(ag->render_stream, "album_artist", -1, encoded.raw(), encoded.length());
+    genesis_audio_file_stream_set_tag(stream, "album_artist", -1, encoded.raw(), encoded.length());
 
     encoded = project->tag_album.encode();
-    genesis_audio_file_stream_set_tag(ag->render_stream, "album", -1, encoded.raw(), encoded.length());
+    genesis_audio_file_stream_set_tag(stream, "album", -1, encoded.raw(), encoded.length());
 
     // TODO looks like I messed up the year tag; it should actually be ISO 8601 "date"
     // TODO so we need to write the date tag here, not year.
 
-    genesis_audio_file_stream_set_export_format(ag->render_stream, export_format);
+    genesis_audio_file_stream_set_export_format(stream, export_format);
+
+    int err;
+    if ((err = genesis_audio_file_stream_open(stream, out_path.raw(), out_path.length()))) {
+        genesis_audio_file_stream_destroy(stream);
+        return err;
+    }
+
+    *out_stream = stream;
+    return 0;
+}
+
+static int add_render_sink(AudioGraph *ag, const RenderOutput *output) {
+    Project *project = ag->project;
+    const GenesisExportFormat *export_format = &output->export_format;
+
+    RenderSink *sink = create_zero<RenderSink>();
+    if (!sink)
+        return GenesisErrorNoMem;
+    if (ag->render_sinks.append(sink)) {
+        destroy(sink, 1);
+        return GenesisErrorNoMem;
+    }
+    sink->audio_graph = ag;
+    sink->input_index = output->track ? 1 + stem_index_for_track(ag, output->track) : -1;
 
     int err;
-    if ((err = genesis_audio_file_stream_open(ag->render_stream, out_path.raw(),
-                    out_path.length())))
+    if (output->decoded) {
+        sink->decoded_audio_file = genesis_audio_file_create(ag->pipeline->context,
+                export_format->sample_rate);
+        if (!sink->decoded_audio_file)
+            return GenesisErrorNoMem;
+        if ((err = genesis_audio_file_set_channel_layout(sink->decoded_audio_file, &project->channel_layout)))
+            return err;
+        // allocated up front; the range is in memory until the render is done
+        for (int ch = 0; ch < project->channel_layout.channel_count; ch += 1) {
+            if ((err = sink->decoded_audio_file->channels.at(ch).samples.resize(ag->render_frame_count)))
+                return err;
+        }
+        sink->decoded_path = output->out_path;
+    } else if ((err = audio_graph_open_render_stream(project, ag->pipeline->context,
+                    export_format, output->out_path, &sink->stream)))
     {
-        audio_graph_destroy(ag);
         return err;
     }
 
-    *out_audio_graph = ag;
+    // a second of output between the graph and the encoder
+    if ((err = ring_buffer_init(&sink->ring, export_format->sample_rate * ag->render_bytes_per_frame)))
+        return err;
+    sink->ring_inited = true;
+
+    return os_thread_create(render_encoder_run, sink, false, &sink->encoder_thread);
+}
+
+static int add_render_stem_bus(AudioGraph *ag, Track *track) {
+    if (stem_index_for_track(ag, track) >= 0)
+        return 0;
+
+    RenderStemBus *bus = create_zero<RenderStemBus>();
+    if (!bus)
+        return GenesisErrorNoMem;
+    if (ag->render_stem_buses.append(bus)) {
+        destroy(bus, 1);
+        return GenesisErrorNoMem;
+    }
+    bus->track = track;
     return 0;
 }
 
-static void audio_graph_clip_destroy(AudioGraphClip *clip) {
-    if (!clip)
-        return;
+int audio_graph_create_multi_render(Project *project, GenesisContext *genesis_context,
+        const RenderOutput *outputs, int output_count, AudioGraph **out_audio_graph)
+{
+    *out_audio_graph = nullptr;
+    if (output_count < 1)
+        return GenesisErrorInvalidParam;
+    // the graph runs at one rate; the encoders pick their own codec rate
+    // from it
+    int sample_rate = outputs[0].export_format.sample_rate;
+    for (int i = 1; i < output_count; i += 1) {
+        if (outputs[i].export_format.sample_rate != sample_rate)
+            return GenesisErrorInvalidParam;
+    }
 
-    if (clip->event_node)
-        genesis_node_destroy(clip->event_node);
+    // a render can't leave clips out, so it waits for every asset
+    for (int i = 0; i < project->audio_clip_list.length(); i += 1)
+        ok_or_panic(project_ensure_audio_asset_loaded(project, project->audio_clip_list.at(i)->audio_asset));
 
-    if (clip->event_node_descr)
-        genesis_node_descriptor_destroy(clip->event_node_descr);
+    AudioGraph *ag = audio_graph_create_common(project, genesis_context, 0.10,
+            outputs[0].export_format.resample_quality, false);
+    ok_or_panic(genesis_pipeline_set_offline(ag->pipeline, true));
 
-    if (clip->node)
-        genesis_node_destroy(clip->node);
+    ag->render_frame_index = 0;
+    ag->render_frame_count = project_get_duration_frames(project);
+    ag->render_sample_rate = sample_rate;
+    ag->render_cond = ok_mem(os_cond_create());
+    ag->render_seek_mutex = ok_mem(os_mutex_create());
+    ag->render_skip_to.store(-1);
+    ag->is_playing = true;
 
-    if (clip->node_descr)
-        genesis_node_descriptor_destroy(clip->node_descr);
+    int err;
+    for (int i = 0; i < output_count; i += 1) {
+        if (outputs[i].track && (err = add_render_stem_bus(ag, outputs[i].track))) {
+            audio_graph_destroy(ag);
+            return err;
+        }
+    }
+    if (ag->render_stem_buses.length() > 0) {
+        add_stem_audio_clips(ag);
+        refresh_audio_clip_segments(ag);
+        // the set of clips is fixed from here on, so each bus mixer has
+        // one descriptor for the whole render
+        for (int bus_i = 0; bus_i < ag->render_stem_buses.length(); bus_i += 1) {
+            int clip_count = 0;
+            for (int i = 0; i < ag->audio_clip_list.length(); i += 1) {
+                if (ag->audio_clip_list.at(i)->stem_index == bus_i)
+                    clip_count += 1;
+            }
+            RenderStemBus *bus = ag->render_stem_buses.at(bus_i);
+            ok_or_panic(mixer_tree_create(ag->pipeline, clip_count, &bus->mixer_tree));
+        }
+    }
 
-    destroy(clip, 1);
+    int input_count = 1 + ag->render_stem_buses.length();
+    ag->render_descr = genesis_create_node_descriptor(ag->pipeline,
+            input_count, "render", "Master render node.");
+    if (!ag->render_descr)
+        panic("unable to create render node descriptor");
+
+    genesis_node_descriptor_set_userdata(ag->render_descr, ag);
+    genesis_node_descriptor_set_run_callback(ag->render_descr, render_node_run);
+    genesis_node_descriptor_set_seek_callback(ag->render_descr, render_node_seek);
+    genesis_node_descriptor_set_activate_callback(ag->render_descr, render_node_activate);
+    for (int i = 0; i < input_count; i += 1) {
+        char name[256];
+        if (i == 0)
+            sprintf(name, "audio_in");
+        else
+            sprintf(name, "stem_in_%d", i - 1);
+        GenesisPortDescriptor *port_descr = genesis_node_descriptor_create_port(
+                ag->render_descr, i, GenesisPortTypeAudioIn, name);
+        if (!port_descr)
+            panic("unable to create render port descriptor");
+        genesis_audio_port_descriptor_set_channel_layout(port_descr,
+                &project->channel_layout, true, -1);
+        genesis_audio_port_descriptor_set_sample_rate(port_descr, sample_rate, true, -1);
+    }
+
+    ag->master_node = ok_mem(genesis_node_descriptor_create_node(ag->render_descr));
+
+    ag->render_bytes_per_frame = project->channel_layout.channel_count * sizeof(float);
+    for (int i = 0; i < output_count; i += 1) {
+        if ((err = add_render_sink(ag, &outputs[i]))) {
+            audio_graph_destroy(ag);
+            return err;
+        }
+    }
+
+    *out_audio_graph = ag;
+    return 0;
+}
+
+void audio_graph_set_render_range(AudioGraph *ag, long start_frame, long frame_count,
+        long preroll_frames)
+{
+    assert(ag->render_descr);
+    assert(!genesis_pipeline_is_running(ag->pipeline));
+    preroll_frames = min(preroll_frames, start_frame);
+    long first_frame = start_frame - preroll_frames;
+
+    // ranges rendered apart then join without a gap
+    double pos = render_seek_pos(ag, first_frame);
+
+    ag->play_head_pos = pos;
+    ag->start_play_head_pos = pos;
+    ag->render_frames_to_skip = preroll_frames;
+    ag->render_start_frame = start_frame;
+    ag->render_frame_count = frame_count;
+    for (int i = 0; i < ag->render_sinks.length(); i += 1) {
+        RenderSink *sink = ag->render_sinks.at(i);
+        if (!sink->decoded_audio_file)
+            continue;
+        for (int ch = 0; ch < sink->decoded_audio_file->channels.length(); ch += 1)
+            ok_or_panic(sink->decoded_audio_file->channels.at(ch).samples.resize(frame_count));
+    }
 }
 
 void audio_graph_destroy(AudioGraph *ag) {
     if (!ag)
         return;
 
+    // a seek from an encoder thread would start the pipeline again
+    if (ag->render_seek_mutex) {
+        OsMutexLocker locker(ag->render_seek_mutex);
+        ag->render_seek_closed = true;
+    }
     if (ag->pipeline) {
         genesis_pipeline_stop(ag->pipeline);
         genesis_node_destroy(ag->master_node);
         ag->master_node = nullptr;
+        destroy_mixer_lines(ag);
     }
+    while (ag->frozen_tracks.length())
+        frozen_track_destroy(ag->frozen_tracks.pop());
+    remove_prerender_node(ag);
+    destroy_prerender_cache(ag);
+    // after the pipeline, so the render node is not left waiting on a full
+    // ring
+    ag->render_encoder_exit = true;
+    for (int i = 0; i < ag->render_sinks.length(); i += 1) {
+        RenderSink *sink = ag->render_sinks.at(i);
+        if (sink->encoder_thread) {
+            wake_render_ring(sink);
+            os_thread_destroy(sink->encoder_thread);
+        }
+    }
+    while (ag->render_sinks.length()) {
+        RenderSink *sink = ag->render_sinks.pop();
+        if (sink->ring_inited)
+            ring_buffer_deinit(&sink->ring);
+        genesis_audio_file_stream_destroy(sink->stream);
+        genesis_audio_file_destroy(sink->decoded_audio_file);
+        destroy(sink, 1);
+    }
+    preview_stream_destroy(ag, ag->preview_current.load());
+    ag->preview_current.store(nullptr);
+    while (ag->preview_retired.length())
+        preview_stream_destroy(ag, ag->preview_retired.pop());
+    scrub_set_destroy(ag, ag->scrub_current.load());
+    ag->scrub_current.store(nullptr);
+    while (ag->scrub_retired.length())
+        scrub_set_destroy(ag, ag->scrub_retired.pop());
 
     ag->project->events.detach_handler(EventProjectAudioClipsChanged,
-            on_project_audio_clips_changed);
+            on_project_audio_clips_changed, ag);
     ag->project->events.detach_handler(EventProjectAudioClipSegmentsChanged,
-            on_project_audio_clip_segments_changed);
+            on_project_audio_clip_segments_changed, ag);
+    ag->project->events.detach_handler(EventProjectAudioAssetLoaded,
+            on_project_audio_asset_loaded, ag);
+    ag->project->events.detach_handler(EventProjectMixerLinesChanged,
+            on_project_mixer_lines_changed, ag);
+    ag->project->events.detach_handler(EventProjectEffectsChanged,
+            on_project_mixer_lines_changed, ag);
+    ag->project->events.detach_handler(EventProjectTracksChanged,
+            on_project_frozen_tracks_changed, ag);
+    ag->project->events.detach_handler(EventProjectSampleRateChanged,
+            on_project_frozen_tracks_changed, ag);
+    ag->project->events.detach_handler(EventProjectChannelLayoutChanged,
+            on_project_frozen_tracks_changed, ag);
 
     while (ag->audio_clip_list.length()) {
         AudioGraphClip *clip = ag->audio_clip_list.pop();
         audio_graph_clip_destroy(clip);
     }
 
+    while (ag->render_stem_buses.length()) {
+        RenderStemBus *bus = ag->render_stem_buses.pop();
+        mixer_tree_destroy(bus->mixer_tree);
+        destroy(bus, 1);
+    }
+
     os_cond_destroy(ag->render_cond);
+    if (ag->render_seek_mutex)
+        os_mutex_destroy(ag->render_seek_mutex);
 }
 
 void audio_graph_play_sample_file(AudioGraph *ag, const ByteBuffer &path) {
     GenesisAudioFile *audio_file;
     int err;
-    if ((err = genesis_audio_file_load(ag->pipeline->context, path.raw(), &audio_file))) {
-        fprintf(stderr, "unable to load audio file: %s\n", genesis_strerror(err));
+    if ((err = genesis_audio_file_open_streamed(ag->pipeline->context, path.raw(), &audio_file))) {
+        log_message(LogLevelError, "unable to load audio file: %s", genesis_strerror(err));
         return;
     }
 
-    play_audio_file(ag, audio_file, false);
+    play_audio_file(ag, audio_file, nullptr);
 }
 
 void audio_graph_play_audio_asset(AudioGraph *ag, AudioAsset *audio_asset) {
     int err;
     if ((err = project_ensure_audio_asset_loaded(ag->project, audio_asset))) {
         if (err == GenesisErrorDecodingAudio) {
-            fprintf(stderr, "Error decoding audio\n");
+            log_message(LogLevelError, "unable to decode audio");
             return;
         } else {
             ok_or_panic(err);
         }
     }
 
-    play_audio_file(ag, audio_asset->audio_file, true);
+    play_audio_file(ag, audio_asset->audio_file, audio_asset);
 }
 
 bool audio_graph_is_playing(AudioGraph *ag) {
@@ -918,25 +3654,38 @@ bool audio_graph_is_playing(AudioGraph *ag) {
 static void refresh_event_positions(AudioGraph *ag, double pos) {
     for (int i = 0; i < ag->audio_clip_list.length(); i += 1) {
         AudioGraphClip *clip = ag->audio_clip_list.at(i);
-        AudioClipEventNodeContext *event_context =
-            (AudioClipEventNodeContext *)clip->event_node->userdata;
-        event_context->new_pos.store(pos);
-
-        AudioClipNodeContext *clip_context = (AudioClipNodeContext *)clip->node->userdata;
-        clip_context->seek_pos.store(pos);
+        if (clip->node)
+            seek_audio_clip(clip, pos);
     }
+    for (int i = 0; i < ag->frozen_tracks.length(); i += 1)
+        ag->frozen_tracks.at(i)->seek_pos.store(pos);
+    ag->prerender_seek_pos.store(pos);
+    ag->prerender_pass += 1;
 }
 
 void audio_graph_set_play_head(AudioGraph *ag, double target_pos) {
     double pos = max(0.0, target_pos);
+    // the clips near the new position need their nodes before it plays
+    patch_dormant_clips(ag, pos);
     refresh_event_positions(ag, pos);
+    // drop audio that was already buffered for the old position
+    if (genesis_pipeline_is_running(ag->pipeline))
+        ok_or_panic(genesis_pipeline_seek(ag->pipeline, pos));
     genesis_node_playback_reset_offset(ag->master_node);
     ag->start_play_head_pos = pos;
     ag->play_head_pos = pos;
     ag->events.trigger(EventAudioGraphPlayHeadChanged);
 }
 
+// between device callbacks the play head moves on by the time since the
+// last one, so that it does not step a buffer at a time
 static double get_playing_play_pos(AudioGraph *ag) {
+    GenesisPlaybackClock clock;
+    if (genesis_node_playback_clock(ag->master_node, &clock)) {
+        double pos = genesis_playback_clock_position(ag->pipeline, &clock, os_get_time());
+        return max(ag->start_play_head_pos, pos);
+    }
+
     GenesisPort *audio_in_port = genesis_node_port(ag->master_node, 0);
     int sample_rate = genesis_audio_port_sample_rate(audio_in_port);
     long frame_at_start = genesis_whole_notes_to_frames(ag->pipeline, ag->start_play_head_pos,
@@ -963,7 +3712,9 @@ void audio_graph_play(AudioGraph *ag) {
     if (ag->is_playing.exchange(true))
         return;
     double pos = ag->play_head_pos;
+    patch_dormant_clips(ag, pos);
     audio_graph_start_pipeline(ag);
+    genesis_pipeline_wake(ag->pipeline);
     genesis_node_playback_reset_offset(ag->master_node);
     refresh_event_positions(ag, pos);
     ag->events.trigger(EventAudioGraphPlayingChanged);
@@ -971,61 +3722,99 @@ void audio_graph_play(AudioGraph *ag) {
 
 void audio_graph_restart_playback(AudioGraph *ag) {
     ag->play_head_pos = ag->start_play_head_pos;
+    patch_dormant_clips(ag, ag->play_head_pos);
     ag->is_playing = true;
-    audio_graph_start_pipeline(ag);
+    if (genesis_pipeline_is_running(ag->pipeline)) {
+        refresh_event_positions(ag, ag->play_head_pos);
+        ok_or_panic(genesis_pipeline_seek(ag->pipeline, ag->play_head_pos));
+        genesis_node_playback_reset_offset(ag->master_node);
+    } else {
+        audio_graph_start_pipeline(ag);
+    }
     ag->events.trigger(EventAudioGraphPlayHeadChanged);
     ag->events.trigger(EventAudioGraphPlayingChanged);
 }
 
 void audio_graph_recover_stream(AudioGraph *ag, double new_latency) {
+    if (genesis_pipeline_is_running(ag->pipeline) &&
+        !genesis_pipeline_reopen_devices(ag->pipeline, new_latency))
+    {
+        return;
+    }
     ag->play_head_pos = audio_graph_play_head_pos(ag);
     stop_pipeline(ag);
     genesis_pipeline_set_latency(ag->pipeline, new_latency);
     audio_graph_start_pipeline(ag);
 }
 
-void audio_graph_change_sample_rate(AudioGraph *ag, int new_sample_rate) {
-    ag->play_head_pos = audio_graph_play_head_pos(ag);
-    stop_pipeline(ag);
-
-
+// the master node keeps its descriptor, which takes the device again and
+// with it the format the device has now
+static void reinit_playback_device(AudioGraph *ag) {
     GenesisNodeDescriptor *playback_node_descr = genesis_node_descriptor(ag->master_node);
+    SoundIoDevice *audio_device = get_master_device(ag);
+    if (audio_device && !genesis_audio_device_node_descriptor_set_device(playback_node_descr, audio_device)) {
+        soundio_device_unref(audio_device);
+        return;
+    }
+    soundio_device_unref(audio_device);
 
     genesis_node_destroy(ag->master_node);
     ag->master_node = nullptr;
-
     genesis_node_descriptor_destroy(playback_node_descr);
-    playback_node_descr = nullptr;
-
-    genesis_pipeline_set_sample_rate(ag->pipeline, new_sample_rate);
-
     init_playback_node(ag);
+}
 
+// every port buffer and resampler depends on the sample rate, so the graph
+// behind the master node is built again, but the device node stays
+void audio_graph_change_sample_rate(AudioGraph *ag, int new_sample_rate) {
+    ag->play_head_pos = audio_graph_play_head_pos(ag);
+    stop_pipeline(ag);
+    genesis_pipeline_set_sample_rate(ag->pipeline, new_sample_rate);
+    reinit_playback_device(ag);
+    refresh_prerender(ag);
     audio_graph_start_pipeline(ag);
 }
 
 void audio_graph_recover_sound_backend_disconnect(AudioGraph *ag) {
     if (!ag->master_node)
         return;
-    ag->play_head_pos = audio_graph_play_head_pos(ag);
-
-    GenesisNodeDescriptor *playback_node_descr = genesis_node_descriptor(ag->master_node);
 
+    // the same device on the reconnected backend plays on from what the
+    // pipeline has buffered
+    if (genesis_pipeline_is_running(ag->pipeline)) {
+        GenesisNodeDescriptor *playback_node_descr = genesis_node_descriptor(ag->master_node);
+        SoundIoDevice *audio_device = get_master_device(ag);
+        bool reopened = audio_device &&
+            !genesis_audio_device_node_descriptor_set_device(playback_node_descr, audio_device) &&
+            !genesis_pipeline_reopen_devices(ag->pipeline, 0.0);
+        soundio_device_unref(audio_device);
+        if (reopened)
+            return;
+    }
 
+    ag->play_head_pos = audio_graph_play_head_pos(ag);
     stop_pipeline(ag);
-
-
-    genesis_node_destroy(ag->master_node);
-    ag->master_node = nullptr;
-
-    genesis_node_descriptor_destroy(playback_node_descr);
-    playback_node_descr = nullptr;
-
-    init_playback_node(ag);
-
+    reinit_playback_device(ag);
     audio_graph_start_pipeline(ag);
 }
 
+// devices other than the one the master line sends to come and go without
+// the pipeline noticing
+void audio_graph_refresh_devices(AudioGraph *ag) {
+    if (!ag->master_node)
+        return;
+    SoundIoDevice *current_device = genesis_audio_device_node_descriptor_device(
+            genesis_node_descriptor(ag->master_node));
+    SoundIoDevice *audio_device = get_master_device(ag);
+    bool unchanged = !audio_device || (current_device &&
+            audio_device->soundio == current_device->soundio &&
+            audio_device->is_raw == current_device->is_raw &&
+            strcmp(audio_device->id, current_device->id) == 0);
+    soundio_device_unref(audio_device);
+    if (!unchanged)
+        audio_graph_recover_sound_backend_disconnect(ag);
+}
+
 void audio_graph_stop_playback(AudioGraph *ag) {
     stop_pipeline(ag);
     ag->is_playing = false;
@@ -1035,14 +3824,93 @@ void audio_graph_stop_playback(AudioGraph *ag) {
     ag->events.trigger(EventAudioGraphPlayingChanged);
 }
 
+bool audio_graph_read_mixer_line_levels(AudioGraph *ag, MixerLine *mixer_line,
+        GenesisMeterLevels *out_levels)
+{
+    for (int i = 0; i < ag->mixer_lines.length(); i += 1) {
+        AudioGraphMixerLine *line = ag->mixer_lines.at(i);
+        if (line->mixer_line == mixer_line && line->meter_node)
+            return !genesis_meter_node_read_levels(line->meter_node, out_levels);
+    }
+    return false;
+}
+
+void audio_graph_set_voice_limit(AudioGraph *ag, int voice_limit) {
+    ag->voice_limit.store(max(1, voice_limit));
+    refresh_prerender(ag);
+}
+
 void audio_graph_flush_events(AudioGraph *ag) {
-    if ((!ag->render_stream && ag->is_playing) || !ag->play_head_changed_flag.test_and_set()) {
+    if (ag->scrub_retired.length())
+        collect_scrub_sets(ag);
+    if (ag->prerender_enabled)
+        prerender_flush(ag);
+    if (ag->dormant_clips && ag->is_playing)
+        patch_dormant_clips(ag, audio_graph_play_head_pos(ag));
+    if ((!ag->render_descr && ag->is_playing) || !ag->play_head_changed_flag.test_and_set()) {
         ag->events.trigger(EventAudioGraphPlayHeadChanged);
     }
 }
 
+void audio_graph_scrub_begin(AudioGraph *ag, double target_pos) {
+    if (!ag->audio_file_node) {
+        audio_graph_set_play_head(ag, target_pos);
+        return;
+    }
+    if (audio_graph_is_scrubbing(ag)) {
+        audio_graph_scrub_move(ag, target_pos);
+        return;
+    }
+    ag->scrub_was_playing = ag->is_playing;
+    audio_graph_pause(ag);
+
+    AudioGraphScrubSet *set;
+    int err;
+    if ((err = scrub_set_create(ag, &set))) {
+        log_message(LogLevelError, "unable to scrub: %s", genesis_strerror(err));
+        audio_graph_set_play_head(ag, target_pos);
+        return;
+    }
+    double pos = max(0.0, target_pos);
+    ag->scrub_target.store(scrub_frame_for_pos(ag, pos));
+    publish_scrub_set(ag, set);
+    ag->start_play_head_pos = pos;
+    ag->play_head_pos = pos;
+    ag->events.trigger(EventAudioGraphPlayHeadChanged);
+
+    if (!genesis_pipeline_is_running(ag->pipeline))
+        audio_graph_start_pipeline(ag);
+    genesis_pipeline_wake(ag->pipeline);
+}
+
+void audio_graph_scrub_move(AudioGraph *ag, double target_pos) {
+    if (!audio_graph_is_scrubbing(ag)) {
+        audio_graph_set_play_head(ag, target_pos);
+        return;
+    }
+    double pos = max(0.0, target_pos);
+    ag->scrub_target.store(scrub_frame_for_pos(ag, pos));
+    ag->start_play_head_pos = pos;
+    ag->play_head_pos = pos;
+    ag->events.trigger(EventAudioGraphPlayHeadChanged);
+    genesis_pipeline_wake(ag->pipeline);
+}
+
+void audio_graph_scrub_end(AudioGraph *ag) {
+    if (!audio_graph_is_scrubbing(ag))
+        return;
+    publish_scrub_set(ag, nullptr);
+    audio_graph_set_play_head(ag, ag->play_head_pos);
+    if (ag->scrub_was_playing)
+        audio_graph_play(ag);
+}
+
+bool audio_graph_is_scrubbing(AudioGraph *ag) {
+    return ag->scrub_current.load() != nullptr;
+}
+
 double audio_graph_play_head_pos(AudioGraph *ag) {
-    assert(!ag->render_stream);
+    assert(!ag->render_descr);
 
     bool is_playing = ag->is_playing.load();
 
@@ -2,29 +2,196 @@
 #define AUDIO_GRAPH_HPP
 
 #include "project.hpp"
-#include "atomic_value.hpp"
 #include "atomic_double.hpp"
 #include "atomics.hpp"
 #include "midi_hardware.hpp"
 #include "settings_file.hpp"
 #include "event_dispatcher.hpp"
+#include "event_timeline.hpp"
+#include "ring_buffer.hpp"
 
 struct EventList {
     List<GenesisMidiEvent> events;
 };
 
 struct AudioGraph;
+struct MixerTree;
+
+// one file written by a render. track is null for the master mix, or else
+// the stem of that track alone. a decoded output is written with
+// genesis_audio_file_write_decoded instead of being encoded, so that it
+// can be joined to others without loss; only the sample rate and resample
+// quality of its export format are used.
+struct RenderOutput {
+    GenesisExportFormat export_format;
+    ByteBuffer out_path;
+    Track *track;
+    bool decoded;
+};
+
+struct RenderSink {
+    AudioGraph *audio_graph;
+    // one of these is set
+    GenesisAudioFileStream *stream;
+    GenesisAudioFile *decoded_audio_file;
+    ByteBuffer decoded_path;
+    // the render node input this sink reads, or -1 for the sum of all of
+    // them
+    int input_index;
+    // the render node hands interleaved frames to the encoder thread here,
+    // so that encoding overlaps the rest of the graph. both sides wait on
+    // ring_epoch and bump it after moving the ring.
+    RingBuffer ring;
+    bool ring_inited;
+    atomic_int ring_epoch;
+    OsThread *encoder_thread;
+    // frames the encoder thread has written to stream
+    atomic_long frame_index;
+};
+
+// frames at the render rate in which some segment plays
+struct RenderInterval {
+    long start;
+    long end;
+};
+
+struct RenderStemBus {
+    Track *track;
+    MixerTree *mixer_tree;
+};
 
 struct AudioGraphClip {
     AudioGraph *audio_graph;
     AudioClip *audio_clip;
     GenesisNodeDescriptor *node_descr;
     GenesisNode *node;
+    // the asset node_descr reads, pinned until the clip is destroyed, which
+    // is after its node is out of the pipeline
+    AudioAsset *audio_asset;
     GenesisNodeDescriptor *event_node_descr;
     GenesisNode *event_node;
     GenesisNode *resample_node;
-    AtomicValue<List<GenesisMidiEvent>> events;
-    List<GenesisMidiEvent> *events_write_ptr;
+    // index into render_stem_buses of the mixer this clip plays into, or
+    // -1 for the mixer of its line
+    int stem_index;
+    // the clip node plays the segments on the tracks of this line, or of
+    // the master line when null. there is one clip node for each line that
+    // has segments of the clip, and the one for the master line comes first.
+    MixerLine *mixer_line;
+    // the audio clip's, when the nodes were made. the clip takes new nodes
+    // when they change.
+    int polyphony;
+    int voice_steal;
+    double stretch;
+    double pitch;
+    int time_stretch_quality;
+    EventTimeline events;
+    // writer only. the events being gathered for the next publish.
+    List<EventTimelineEvent> pending_events;
+    // with dormant_clips only. set on a clip whose segments are all far from
+    // the play head; patch_audio_clips takes its nodes back, and it stays
+    // dormant without them until the play head comes near again.
+    bool going_dormant;
+};
+
+// a track whose clips were rendered once into a decoded file, which one
+// node plays into the track's mixer line in place of them
+struct AudioGraphFrozenTrack {
+    AudioGraph *audio_graph;
+    uint256 track_id;
+    // of everything the rendered file depends on. also its name in the
+    // decoded cache.
+    ByteBuffer digest;
+    GenesisAudioFile *audio_file;
+    GenesisAudioFileReader *reader;
+    GenesisNodeDescriptor *node_descr;
+    GenesisNode *node;
+    GenesisNode *resample_node;
+    AtomicDouble seek_pos;
+};
+
+// a stretch of the master mix which playback renders ahead of the play
+// head. reader is null until the block's file is in the decoded cache.
+struct AudioGraphPrerenderBlock {
+    // of everything the block's mix depends on. also its name in the
+    // decoded cache.
+    ByteBuffer digest;
+    std::atomic<GenesisAudioFileReader *> reader;
+    // prerender_pass * 2, plus 1 if the block plays from the cache in that
+    // pass. the first node to reach the block in a pass decides for all of
+    // them.
+    atomic_long decision;
+};
+
+// the blocks for one length of the project. clip nodes on every pipeline
+// thread read the grid without pinning it, so a replaced grid waits in
+// prerender_retired_grids until the pipeline is stopped.
+struct AudioGraphPrerenderGrid {
+    int sample_rate;
+    long block_frames;
+    long preroll_frames;
+    long frame_count;
+    int block_count;
+    AudioGraphPrerenderBlock *blocks;
+};
+
+struct ResampleContext;
+
+// a file the preview voice plays, converted to the format of the pipeline
+struct AudioGraphPreviewStream {
+    GenesisAudioFile *audio_file;
+    // pinned while its audio file is previewed, which the stream owns
+    // otherwise
+    AudioAsset *audio_asset;
+    GenesisAudioFileReader *reader;
+    ResampleContext *resample_context;
+    // frames of reader interleaved for resample_context
+    float *interleaved;
+};
+
+// a segment the scrub voice plays. it has a reader of its own so that it
+// can read anywhere in the file.
+struct AudioGraphScrubSegment {
+    // pinned along with the set
+    AudioAsset *audio_asset;
+    GenesisAudioFileReader *reader;
+    int channel_count;
+    // frames of the file
+    long start;
+    long end;
+    // the frame at the pipeline's rate, counting from time 0, where the
+    // segment starts, and how many frames of the file go by in one of those
+    double timeline_frame;
+    double rate_ratio;
+    float gain;
+};
+
+// the segments of the project when scrubbing started, which the scrub voice
+// plays. they stay as they were until it ends.
+struct AudioGraphScrubSet {
+    AudioGraphScrubSegment *segments;
+    int segment_count;
+};
+
+struct AudioGraphSend {
+    int target; // index into AudioGraph::mixer_lines
+    float gain;
+};
+
+// one mixer line of the project while the graph is built. the mixer tree
+// sums the sends into the line, then the preview voice for the master line,
+// then the clips on its tracks. lines only meet where one sends into
+// another, so the pipeline threads mix independent lines in parallel.
+struct AudioGraphMixerLine {
+    MixerLine *mixer_line;
+    MixerTree *mixer_tree;
+    int input_count;
+    int next_input;
+    // every line but the master sends into the master line first
+    List<AudioGraphSend> sends;
+    bool nodes_added;
+    // playback graphs only. the mix goes through it on the way out.
+    GenesisNode *meter_node;
 };
 
 struct AudioGraph {
@@ -32,33 +199,113 @@ struct AudioGraph {
     EventDispatcher events;
 
     List<AudioGraphClip*> audio_clip_list;
+    // playback graphs only
+    List<AudioGraphFrozenTrack *> frozen_tracks;
 
     GenesisPipeline *pipeline;
     SettingsFile *settings_file;
     GenesisNodeDescriptor *resample_descr;
-    GenesisNodeDescriptor *mixer_descr;
-    GenesisNode *resample_node;
-    GenesisNode *mixer_node;
+    GenesisNodeDescriptor *meter_descr;
+    // replaced whenever the graph is rebuilt. the master line is the first.
+    List<AudioGraphMixerLine *> mixer_lines;
     GenesisNode *master_node;
 
-    long audio_file_frame_count;
-    long audio_file_frame_index;
-    PlayChannelContext audio_file_channel_context[GENESIS_MAX_CHANNELS];
-
     GenesisPortDescriptor *audio_file_port_descr;
     GenesisNodeDescriptor *audio_file_descr;
     GenesisNode *audio_file_node;
-    GenesisAudioFile *preview_audio_file;
-    bool preview_audio_file_is_asset;
+    // the preview voice is always in playback graphs and plays
+    // preview_current, which the main thread replaces to preview another
+    // file. the preview node pins the stream it reads, and replaced streams
+    // wait in preview_retired until it has pinned a later one, as with
+    // EventTimeline.
+    std::atomic<AudioGraphPreviewStream *> preview_current;
+    std::atomic<AudioGraphPreviewStream *> preview_pinned;
+    List<AudioGraphPreviewStream *> preview_retired;
+
+    // playback graphs only. see audio_graph_scrub_begin. the preview node
+    // also plays scrub_current, which is pinned and retired the same way as
+    // the preview streams. scrub_target is the frame at the pipeline's rate,
+    // counting from time 0, that the cursor is on.
+    std::atomic<AudioGraphScrubSet *> scrub_current;
+    std::atomic<AudioGraphScrubSet *> scrub_pinned;
+    List<AudioGraphScrubSet *> scrub_retired;
+    AtomicDouble scrub_target;
+    bool scrub_was_playing;
+    // owned by the preview node. the set it played last, where the voice is
+    // in the same frames as scrub_target, its velocity in frames per frame,
+    // and its gain.
+    AudioGraphScrubSet *scrub_playing;
+    double scrub_frame;
+    double scrub_velocity;
+    float scrub_gain;
+
+    // playback graphs only. see audio_graph_set_prerender. the prerender
+    // node plays the blocks into the master line; it pins the reader it
+    // plays, and readers taken out of their blocks wait in
+    // prerender_retired until it has moved on.
+    bool prerender_enabled;
+    std::atomic<AudioGraphPrerenderGrid *> prerender_grid;
+    List<AudioGraphPrerenderGrid *> prerender_retired_grids;
+    // bumped by every seek, so that each block is decided again
+    atomic_long prerender_pass;
+    std::atomic<GenesisAudioFileReader *> prerender_pinned;
+    List<GenesisAudioFileReader *> prerender_retired;
+    GenesisNodeDescriptor *prerender_descr;
+    GenesisNode *prerender_node;
+    int prerender_sample_rate;
+    SoundIoChannelLayout prerender_channel_layout;
+    // owned by the prerender node
+    long prerender_frame_pos;
+    AtomicDouble prerender_seek_pos;
+    // the one block being rendered at a time, if any
+    AudioGraph *prerender_render;
+    ByteBuffer prerender_render_digest;
+    int prerender_render_block;
 
     GenesisNodeDescriptor *render_descr;
-    GenesisPortDescriptor *render_port_descr;
-    ByteBuffer render_out_path;
-    GenesisExportFormat render_export_format;
-    GenesisAudioFileStream *render_stream;
+    // one per output file of the render
+    List<RenderSink *> render_sinks;
+    // in a stem render, the clips on each stem track go to its own mixer.
+    // the render node has an input for the master line and then one for
+    // each of these.
+    List<RenderStemBus *> render_stem_buses;
+    // the least frames any sink's encoder has written
     atomic_long render_frame_index;
     long render_frame_count;
+    int render_sample_rate;
     OsCond *render_cond;
+    int render_bytes_per_frame;
+    // owned by the render node
+    long render_frames_queued;
+    // pre-roll frames the render node drops before the first it keeps
+    long render_frames_to_skip;
+    atomic_bool render_encoder_exit;
+    // the first frame of the range, which render_frames_queued counts from
+    long render_start_frame;
+    // where the segments play, sorted and merged, so that the render node
+    // can skip the silence between them. built when the pipeline starts,
+    // and no longer used once the segments change.
+    List<RenderInterval> render_intervals;
+    atomic_bool render_intervals_stale;
+    // owned by the render node
+    int render_interval_index;
+    long render_silence_frames;
+    // the frame the first sink's encoder thread is to seek the graph to
+    // while the render node writes silence up to it, or -1
+    atomic_long render_skip_to;
+    // held while seeking; audio_graph_destroy closes it before it stops
+    // the pipeline
+    OsMutex *render_seek_mutex;
+    bool render_seek_closed;
+
+    // every clip node takes its voices out of these, so that the graph as a
+    // whole plays at most voice_limit segments at once
+    atomic_int voice_limit;
+    atomic_int active_voice_count;
+
+    // playback graphs only. clips without a segment near the play head are
+    // dormant, with no nodes; see CLIP_LOOKAHEAD_SECONDS.
+    bool dormant_clips;
 
     double start_play_head_pos;
     double play_head_pos;
@@ -71,6 +318,23 @@ int audio_graph_create_playback(Project *project, GenesisContext *genesis_contex
 int audio_graph_create_render(Project *project, GenesisContext *genesis_context,
         const GenesisExportFormat *export_format, const ByteBuffer &out_path,
         AudioGraph **out_audio_graph);
+// renders every output in one pass over the graph. they must share a
+// sample rate.
+int audio_graph_create_multi_render(Project *project, GenesisContext *genesis_context,
+        const RenderOutput *outputs, int output_count, AudioGraph **out_audio_graph);
+// renders frame_count frames from start_frame instead of the whole
+// project. the graph runs for preroll_frames before start_frame so that
+// the range starts with the tails of what came before it. call before
+// audio_graph_start_pipeline. the pre-roll is played rather than restored
+// from checkpoints: a range worker and each prerender block render in a
+// graph of their own, which has no earlier run to take state from, and the
+// clip nodes whose tails the pre-roll carries have no state to save.
+void audio_graph_set_render_range(AudioGraph *audio_graph, long start_frame, long frame_count,
+        long preroll_frames);
+// opens an encoder for export_format with the tags of the project
+int audio_graph_open_render_stream(Project *project, GenesisContext *genesis_context,
+        const GenesisExportFormat *export_format, const ByteBuffer &out_path,
+        GenesisAudioFileStream **out_stream);
 void audio_graph_destroy(AudioGraph *audio_graph);
 
 void audio_graph_start_pipeline(AudioGraph *audio_graph);
@@ -82,6 +346,18 @@ void audio_graph_play_audio_asset(AudioGraph *audio_graph, AudioAsset *audio_ass
 
 void audio_graph_set_play_head(AudioGraph *audio_graph, double pos);
 
+// while scrubbing, the play head follows pos without seeking the pipeline,
+// and playback pauses. a voice of the preview node reads the segments
+// around pos straight from their files, at a speed which follows how fast
+// pos moves, so it is heard a pipeline latency later. it leaves out the
+// effects and streamed files. the end seeks to where scrubbing stopped,
+// and playback goes on from there if it was playing before.
+// playback graphs only.
+void audio_graph_scrub_begin(AudioGraph *audio_graph, double pos);
+void audio_graph_scrub_move(AudioGraph *audio_graph, double pos);
+void audio_graph_scrub_end(AudioGraph *audio_graph);
+bool audio_graph_is_scrubbing(AudioGraph *audio_graph);
+
 bool audio_graph_is_playing(AudioGraph *audio_graph);
 void audio_graph_pause(AudioGraph *audio_graph);
 void audio_graph_play(AudioGraph *audio_graph);
@@ -90,9 +366,43 @@ void audio_graph_stop_playback(AudioGraph *audio_graph);
 
 void audio_graph_recover_stream(AudioGraph *audio_graph, double new_latency);
 void audio_graph_recover_sound_backend_disconnect(AudioGraph *audio_graph);
+// after the device list or a device designation changes. the master node
+// moves only when the device it should send to is not the one it has.
+void audio_graph_refresh_devices(AudioGraph *audio_graph);
 void audio_graph_change_sample_rate(AudioGraph *audio_graph, int new_sample_rate);
 
+// renders the clips of track on their own into the project's decoded
+// cache, then plays that file in place of them to save the work of the
+// clip nodes. the file is named by a digest of the track's segments and
+// assets, so freezing the same content again skips the render. the track
+// thaws by itself once an edit changes the digest. playback graphs only.
+int audio_graph_freeze_track(AudioGraph *audio_graph, Track *track);
+void audio_graph_thaw_track(AudioGraph *audio_graph, Track *track);
+bool audio_graph_track_is_frozen(AudioGraph *audio_graph, Track *track);
+
+// renders the master mix ahead of the play head into the project's
+// decoded cache, a few seconds at a time, and plays those blocks in place
+// of the clip nodes. each block is named by a digest of what it holds, so
+// an edit only renders again the blocks whose digest it changes, and a
+// block rendered before is found in the cache. blocks that are not
+// rendered yet play live; an edit to a block that is already playing from
+// the cache restarts playback at the play head, as freezing does.
+// playback graphs only.
+void audio_graph_set_prerender(AudioGraph *audio_graph, bool enabled);
+bool audio_graph_prerender_enabled(AudioGraph *audio_graph);
+
+// the levels of the line's mix since the previous call, after its volume.
+// returns false while the line has no meter, as in a render or before the
+// graph is built. call from the thread that edits the project.
+bool audio_graph_read_mixer_line_levels(AudioGraph *audio_graph, MixerLine *mixer_line,
+        GenesisMeterLevels *out_levels);
+
 void audio_graph_flush_events(AudioGraph *audio_graph);
+
+static const int AUDIO_GRAPH_DEFAULT_VOICE_LIMIT = 512;
+// how many segments all the clips together may play at once. clips past it
+// steal from their own voices.
+void audio_graph_set_voice_limit(AudioGraph *audio_graph, int voice_limit);
 double audio_graph_play_head_pos(AudioGraph *audio_graph);
 
 #endif
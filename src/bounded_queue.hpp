@@ -0,0 +1,256 @@
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include "thread_safe_queue.hpp"
+#include "list.hpp"
+
+#include <limits.h>
+#include <time.h>
+
+static const int BOUNDED_QUEUE_CACHE_LINE = 64;
+
+// many writer, many reader, fixed size, first-in-first-out queue. items go
+// into an array of cells, each with a sequence number that says whether it
+// is free for the writer of a position or full for its reader, as in Dmitry
+// Vyukov's bounded MPMC queue. pushing and shifting are lock-free; only the
+// blocking calls wait, on a futex, and only then do the other side's calls
+// make a syscall to wake them.
+// must call init before you can start using it
+template<typename T>
+class BoundedQueue {
+public:
+    BoundedQueue() {
+        _cells = nullptr;
+        _capacity = 0;
+        _mask = 0;
+        _push_pos = 0;
+        _shift_pos = 0;
+        _push_epoch = 0;
+        _shift_epoch = 0;
+        _push_waiter_count = 0;
+        _shift_waiter_count = 0;
+        // with a single cpu the other side can't run while we spin
+        _spin_count = (os_concurrency() > 1) ? thread_safe_queue_default_spin_count : 0;
+        _shutdown = false;
+    }
+    ~BoundedQueue() {
+        destroy(_cells, _capacity);
+    }
+
+    // the capacity is rounded up to a power of two. empties the queue, and
+    // only reallocates when the capacity changes.
+    // this method not thread safe
+    int __attribute__((warn_unused_result)) init(int capacity) {
+        if (capacity < 1 || capacity > (1 << 30))
+            return GenesisErrorInvalidParam;
+        int new_capacity = 1;
+        while (new_capacity < capacity)
+            new_capacity *= 2;
+        if (new_capacity != _capacity) {
+            Cell *new_cells = allocate_zero<Cell>(new_capacity);
+            if (!new_cells)
+                return GenesisErrorNoMem;
+            destroy(_cells, _capacity);
+            _cells = new_cells;
+            _capacity = new_capacity;
+            _mask = new_capacity - 1;
+        }
+        for (int i = 0; i < new_capacity; i += 1)
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        _push_pos = 0;
+        _shift_pos = 0;
+        _shutdown = false;
+        return 0;
+    }
+
+    int capacity() const {
+        return _capacity;
+    }
+
+    // returns false if the queue is full. thread-safe.
+    bool try_push(T item) {
+        long pos = _push_pos.load(std::memory_order_relaxed);
+        Cell *cell;
+        for (;;) {
+            cell = &_cells[pos & _mask];
+            long sequence = cell->sequence.load(std::memory_order_acquire);
+            long diff = sequence - pos;
+            if (diff == 0) {
+                if (_push_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = _push_pos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->item = item;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        wake(&_push_epoch, &_shift_waiter_count);
+        return true;
+    }
+
+    // returns false if the queue is empty. thread-safe.
+    bool try_shift(T *result) {
+        long pos = _shift_pos.load(std::memory_order_relaxed);
+        Cell *cell;
+        for (;;) {
+            cell = &_cells[pos & _mask];
+            long sequence = cell->sequence.load(std::memory_order_acquire);
+            long diff = sequence - (pos + 1);
+            if (diff == 0) {
+                if (_shift_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = _shift_pos.load(std::memory_order_relaxed);
+            }
+        }
+        *result = cell->item;
+        cell->sequence.store(pos + _mask + 1, std::memory_order_release);
+        wake(&_shift_epoch, &_push_waiter_count);
+        return true;
+    }
+
+    // takes up to max_count items without blocking, returning how many.
+    // thread-safe.
+    int try_shift_many(T *items, int max_count) {
+        int count = 0;
+        while (count < max_count && try_shift(&items[count]))
+            count += 1;
+        return count;
+    }
+
+    // blocks while the queue is full. returns 0 on success or
+    // GenesisErrorAborted. thread-safe.
+    int __attribute__((warn_unused_result)) push(T item) {
+        for (;;) {
+            int epoch = _shift_epoch.load();
+            if (_shutdown.load())
+                return GenesisErrorAborted;
+            if (try_push(item))
+                return 0;
+            wait(&_shift_epoch, &_push_waiter_count, epoch, -1.0);
+        }
+    }
+
+    // blocks while the queue is empty. returns 0 on success or
+    // GenesisErrorAborted. thread-safe.
+    int shift(T *result) {
+        for (;;) {
+            int epoch = _push_epoch.load();
+            if (_shutdown.load())
+                return GenesisErrorAborted;
+            if (try_shift(result))
+                return 0;
+            wait(&_push_epoch, &_shift_waiter_count, epoch, -1.0);
+        }
+    }
+
+    // waits for at least one item, or for timeout seconds if timeout is not
+    // negative, and then moves every queued item to the end of out.
+    // returns 0 on success, GenesisErrorAborted, or GenesisErrorNoMem, in
+    // which case the items which did not fit stay queued. thread-safe.
+    int shift_all(List<T> &out, double timeout) {
+        double deadline = os_get_time() + timeout;
+        int old_length = out.length();
+        for (;;) {
+            int epoch = _push_epoch.load();
+            if (_shutdown.load())
+                return GenesisErrorAborted;
+            if (out.add_one())
+                return GenesisErrorNoMem;
+            if (try_shift(&out.last()))
+                break;
+            out.pop();
+            double remaining = deadline - os_get_time();
+            if (timeout >= 0.0 && remaining <= 0.0)
+                return 0;
+            wait(&_push_epoch, &_shift_waiter_count, epoch, (timeout >= 0.0) ? remaining : -1.0);
+        }
+        for (;;) {
+            if (out.add_one())
+                return (out.length() > old_length) ? 0 : GenesisErrorNoMem;
+            if (!try_shift(&out.last())) {
+                out.pop();
+                return 0;
+            }
+        }
+    }
+
+    // wakes up all blocking calls, which return GenesisErrorAborted from
+    // then on. thread-safe.
+    // call init() to use the queue again.
+    void wakeup_all() {
+        _shutdown.store(true);
+        _push_epoch += 1;
+        _shift_epoch += 1;
+        futex_wake(reinterpret_cast<int*>(&_push_epoch), INT_MAX);
+        futex_wake(reinterpret_cast<int*>(&_shift_epoch), INT_MAX);
+    }
+
+    // a snapshot, which other threads may change at once. thread-safe.
+    int length() const {
+        long count = _push_pos.load() - _shift_pos.load();
+        return (int)max(0L, min(count, (long)_capacity));
+    }
+
+private:
+    struct Cell {
+        std::atomic<long> sequence;
+        T item;
+    };
+
+    Cell *_cells;
+    int _capacity;
+    long _mask;
+    int _spin_count;
+    atomic_bool _shutdown;
+    char _pad0[BOUNDED_QUEUE_CACHE_LINE];
+    // each side's position and epoch on a cache line of their own. the
+    // epochs are bumped after every push and every shift, for the other
+    // side to wait on.
+    std::atomic<long> _push_pos;
+    atomic_int _push_epoch;
+    atomic_int _push_waiter_count;
+    char _pad1[BOUNDED_QUEUE_CACHE_LINE];
+    std::atomic<long> _shift_pos;
+    atomic_int _shift_epoch;
+    atomic_int _shift_waiter_count;
+    char _pad2[BOUNDED_QUEUE_CACHE_LINE];
+
+    // a waiter counts itself before it looks at the epoch again in the
+    // kernel, so either it sees the bump or the bump sees it. waking clears
+    // the count, so that until the woken threads have run and counted
+    // themselves again, the calls after it make no syscall.
+    static void wake(atomic_int *epoch, atomic_int *waiter_count) {
+        *epoch += 1;
+        if (waiter_count->load() > 0 && waiter_count->exchange(0) > 0)
+            futex_wake(reinterpret_cast<int*>(epoch), INT_MAX);
+    }
+
+    // items tend to arrive in bursts, so it's cheaper to poll for a short
+    // while than to sleep when there is another cpu to run the other side
+    void wait(atomic_int *epoch, atomic_int *waiter_count, int old_epoch, double timeout) {
+        for (int i = 0; i < _spin_count; i += 1) {
+            cpu_relax();
+            if (epoch->load(std::memory_order_relaxed) != old_epoch)
+                return;
+        }
+        *waiter_count += 1;
+        if (timeout < 0.0) {
+            futex_wait(reinterpret_cast<int*>(epoch), old_epoch);
+        } else {
+            struct timespec ts;
+            ts.tv_sec = (time_t)timeout;
+            ts.tv_nsec = (long)((timeout - ts.tv_sec) * 1000000000.0);
+            futex(reinterpret_cast<int*>(epoch), FUTEX_WAIT, old_epoch, &ts, nullptr, 0);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue &other) = delete;
+    BoundedQueue<T>& operator= (const BoundedQueue<T> &other) = delete;
+};
+
+#endif
@@ -25,7 +25,7 @@ ButtonWidget::ButtonWidget(GuiWindow *gui_window) :
 
 void ButtonWidget::draw(const glm::mat4 &projection) {
     bg.draw(gui_window, projection);
-    label.draw(projection * label_model, text_color);
+    label.draw(gui_window, projection * label_model, text_color);
 }
 
 void ButtonWidget::on_mouse_move(const MouseEvent *event) {
@@ -63,6 +63,7 @@ void ButtonWidget::set_text(const String &text) {
 }
 
 void ButtonWidget::update_model() {
+    queue_redraw();
     bg.set_scheme(mouse_down ? SunkenBoxSchemeSunkenBorders : SunkenBoxSchemeRaisedBorders);
     bg.update(this, 0, 0, width, height);
 
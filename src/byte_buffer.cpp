@@ -63,6 +63,26 @@ void ByteBuffer::format(const char *format, ...) {
     va_end(ap);
 }
 
+void ByteBuffer::append_format(const char *format, ...) {
+    va_list ap, ap2;
+    va_start(ap, format);
+    va_copy(ap2, ap);
+
+    int ret = vsnprintf(NULL, 0, format, ap);
+    if (ret < 0)
+        panic("vsnprintf error");
+
+    int old_length = length();
+    ok_or_panic(_buffer.resize(old_length + ret + 1));
+
+    ret = vsnprintf(_buffer.raw() + old_length, ret + 1, format, ap2);
+    if (ret < 0)
+        panic("vsnprintf error 2");
+
+    va_end(ap2);
+    va_end(ap);
+}
+
 int ByteBuffer::index_of_rev(char c) const {
     return index_of_rev(c, length() - 1);
 }
@@ -122,8 +142,8 @@ void ByteBuffer::split(const char *split_by, List<ByteBuffer> &out) const {
 
 ByteBuffer ByteBuffer::to_string() const {
     ByteBuffer result;
-    result.resize(_buffer.length() * 2);
-    for (int i = 0; i < _buffer.length() - 1; i += 1) {
+    result.resize(length() * 2);
+    for (int i = 0; i < length(); i += 1) {
         sprintf(result.raw() + i * 2, "%02x", *((uint8_t*)(_buffer.raw() + i)));
     }
     return result;
@@ -2,11 +2,16 @@
 #define BYTE_BUFFER_HPP
 
 #include "list.hpp"
+#include "small_list.hpp"
 
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
 
+// keys up to this long, with the null terminator, need no heap allocation.
+// that covers the project file's id keys.
+static const int BYTE_BUFFER_INLINE_SIZE = 48;
+
 class ByteBuffer {
 public:
     ByteBuffer();
@@ -29,6 +34,8 @@ public:
     }
 
     void format(const char *format, ...) __attribute__ ((format (printf, 2, 3)));
+    // like format, but after what is already there
+    void append_format(const char *format, ...) __attribute__ ((format (printf, 2, 3)));
 
     int length() const {
         return _buffer.length() - 1;
@@ -38,6 +45,11 @@ public:
             panic("out of memory");
         _buffer.at(length()) = 0;
     }
+    // makes room for new_length bytes without changing the length
+    void reserve(int new_length) {
+        if (_buffer.ensure_capacity(new_length + 1))
+            panic("out of memory");
+    }
     void append(const ByteBuffer &other);
     void append(const char *str);
     void append(const char *str, int length);
@@ -97,7 +109,7 @@ public:
     uint32_t read_uint32le(int index) const {
         if (index < 0 || index + 4 > length())
             panic("bounds check");
-        char *buf = _buffer.raw() + index;
+        const char *buf = _buffer.raw() + index;
         return  ((uint32_t)buf[0])        |
                (((uint32_t)buf[1]) <<  8) |
                (((uint32_t)buf[2]) << 16) |
@@ -106,7 +118,7 @@ public:
     uint8_t read_uint8(int index) const {
         if (index < 0 || index >= length())
             panic("bounds check");
-        char *buf = _buffer.raw() + index;
+        const char *buf = _buffer.raw() + index;
         return (uint8_t)*buf;
     }
     void append_fill(int count, char value) {
@@ -190,7 +202,7 @@ public:
         return compare(*this, other) != 0;
     }
 private:
-    List<char> _buffer;
+    SmallList<char, BYTE_BUFFER_INLINE_SIZE> _buffer;
 };
 
 #endif
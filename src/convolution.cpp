@@ -0,0 +1,727 @@
+#include "convolution.hpp"
+#include "fft.hpp"
+#include "audio_file.hpp"
+#include "atomic_double.hpp"
+#include "thread_safe_queue.hpp"
+
+// the impulse response is split in two. the head, its first
+// HEAD_FRAME_COUNT frames, is convolved in partitions of HEAD_BLOCK frames
+// on the pipeline thread, which is what sets the latency. the rest is the
+// tail, convolved in partitions of TAIL_BLOCK frames on a worker thread
+// while the head goes on. a tail block is handed over as soon as its input
+// is in, and its first output frames are not due until TAIL_BLOCK frames
+// later, which is the head's length less the head block.
+//
+// an offline pipeline has no deadline between its blocks and gets through
+// long impulses faster in fewer, larger transforms, so there the tail ends
+// at FAR_OFFSET and what is left is the far stage, convolved in partitions
+// of FAR_BLOCK frames on a second worker in the same way. a realtime
+// pipeline keeps to the tail, so that no one block of work takes long.
+static const int HEAD_BLOCK = 256;
+static const int TAIL_BLOCK = 8 * HEAD_BLOCK;
+static const int FAR_BLOCK = 8 * TAIL_BLOCK;
+static const int HEAD_FRAME_COUNT = 2 * TAIL_BLOCK - HEAD_BLOCK;
+static const int FAR_OFFSET = 2 * FAR_BLOCK - HEAD_BLOCK;
+static const long DECAYED = LONG_MAX / 2;
+
+// uniformly partitioned overlap-save convolution of every channel with its
+// own impulse response
+struct ConvolutionStage {
+    Fft *fft; // of 2 * block
+    int block;
+    int channel_count;
+    int partition_count;
+    int bin_count;
+    // partition p of channel ch at (ch * partition_count + p) * bin_count
+    float *ir_re;
+    float *ir_im;
+    // the spectra of the last partition_count input windows of each
+    // channel, laid out the same. fdl_index is the slot of the newest.
+    float *fdl_re;
+    float *fdl_im;
+    int fdl_index;
+    // per channel, 2 * block. the previous input block, then the current
+    float *window;
+    // per channel, block. the output of the last input block
+    float *out;
+    // stage_scratch_size bytes for stage_process, or nullptr when the
+    // caller brings its own
+    char *scratch;
+};
+
+// what stage_process works in, carved from stage_scratch_size bytes
+struct StageScratch {
+    float *acc_re;
+    float *acc_im;
+    float *time;
+    float *work;
+};
+
+static size_t align_scratch(size_t size) {
+    return (size + GENESIS_SCRATCH_ALIGNMENT - 1) & ~(size_t)(GENESIS_SCRATCH_ALIGNMENT - 1);
+}
+
+// a 2 * block FFT has block + 1 bins
+static size_t stage_scratch_size(int block) {
+    return 2 * align_scratch((block + 1) * sizeof(float)) + 2 * align_scratch(2 * block * sizeof(float));
+}
+
+static void stage_scratch_carve(int block, char *scratch, StageScratch *out) {
+    size_t bins_size = align_scratch((block + 1) * sizeof(float));
+    size_t time_size = align_scratch(2 * block * sizeof(float));
+    out->acc_re = (float *)scratch;
+    out->acc_im = (float *)(scratch + bins_size);
+    out->time = (float *)(scratch + 2 * bins_size);
+    out->work = (float *)(scratch + 2 * bins_size + time_size);
+}
+
+// a stage convolved on a worker thread of its own
+struct ConvolutionWorker {
+    ConvolutionStage stage;
+    // per channel, stage.block. in gathers input for the next block while
+    // the worker reads job_in. out is the stage's share of the coming
+    // frames, from out_frame on. nullptr while the stage is not used.
+    float *in;
+    float *job_in;
+    float *out;
+    int in_frame;
+    int out_frame;
+    bool job_pending;
+
+    // the worker takes a job when job_epoch moves and sets done_epoch to it
+    // when the job is done
+    OsThread *thread;
+    atomic_int job_epoch;
+    atomic_int done_epoch;
+    atomic_bool exit;
+};
+
+// the tail, then the far stage
+static const int WORKER_COUNT = 2;
+
+struct ConvolutionContext {
+    // as set. one run of impulse_frame_count frames per channel, at
+    // impulse_sample_rate. only changes while the pipeline is stopped.
+    float *impulse;
+    int impulse_channel_count;
+    long impulse_frame_count;
+    int impulse_sample_rate;
+    bool impulse_changed;
+
+    // parameters, set from any thread
+    AtomicDouble dry;
+    AtomicDouble wet;
+
+    int channel_count;
+    int sample_rate;
+    // whether the stages are split for an offline pipeline
+    bool offline;
+    // impulse frames at sample_rate
+    long frame_count;
+    ConvolutionStage head;
+    ConvolutionWorker workers[WORKER_COUNT];
+    // per channel, HEAD_BLOCK. input frames gathered for the next head block
+    float *in_block;
+    // interleaved, HEAD_BLOCK frames. the output for the last head block,
+    // played while the next one is gathered
+    float *out_block;
+    int block_frame;
+
+    // how many frames in a row the input has been silence
+    long silent_frame_count;
+};
+
+static void stage_free(ConvolutionStage *stage) {
+    int spectra_count = stage->channel_count * stage->partition_count * stage->bin_count;
+    fft_destroy(stage->fft);
+    destroy(stage->ir_re, spectra_count);
+    destroy(stage->ir_im, spectra_count);
+    destroy(stage->fdl_re, spectra_count);
+    destroy(stage->fdl_im, spectra_count);
+    destroy(stage->window, stage->channel_count * 2 * stage->block);
+    destroy(stage->out, stage->channel_count * stage->block);
+    destroy(stage->scratch, stage_scratch_size(stage->block));
+    memset(stage, 0, sizeof(ConvolutionStage));
+}
+
+static void stage_reset(ConvolutionStage *stage) {
+    int spectra_count = stage->channel_count * stage->partition_count * stage->bin_count;
+    if (spectra_count) {
+        memset(stage->fdl_re, 0, spectra_count * sizeof(float));
+        memset(stage->fdl_im, 0, spectra_count * sizeof(float));
+    }
+    memset(stage->window, 0, stage->channel_count * 2 * stage->block * sizeof(float));
+    memset(stage->out, 0, stage->channel_count * stage->block * sizeof(float));
+    stage->fdl_index = 0;
+}
+
+// covers impulse frames [offset, offset + partition_count * block), which
+// may run past the end of impulse. channel ch uses impulse channel
+// ch % impulse_channel_count. the stage keeps scratch of its own when
+// own_scratch is set.
+static int stage_init(ConvolutionStage *stage, int block, int partition_count, int channel_count,
+        const float *impulse, int impulse_channel_count, long impulse_frame_count, long offset,
+        bool own_scratch)
+{
+    int err;
+    if ((err = fft_create(2 * block, &stage->fft)))
+        return err;
+    stage->block = block;
+    stage->channel_count = channel_count;
+    stage->partition_count = partition_count;
+    stage->bin_count = fft_bin_count(stage->fft);
+    int spectra_count = channel_count * partition_count * stage->bin_count;
+    stage->ir_re = allocate_zero<float>(spectra_count);
+    stage->ir_im = allocate_zero<float>(spectra_count);
+    stage->fdl_re = allocate_zero<float>(spectra_count);
+    stage->fdl_im = allocate_zero<float>(spectra_count);
+    stage->window = allocate_zero<float>(channel_count * 2 * block);
+    stage->out = allocate_zero<float>(channel_count * block);
+    stage->scratch = allocate_zero_aligned<char>(stage_scratch_size(block), GENESIS_SCRATCH_ALIGNMENT);
+    if ((spectra_count && (!stage->ir_re || !stage->ir_im || !stage->fdl_re || !stage->fdl_im)) ||
+        !stage->window || !stage->out || !stage->scratch)
+    {
+        return GenesisErrorNoMem;
+    }
+
+    StageScratch scratch;
+    stage_scratch_carve(block, stage->scratch, &scratch);
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        const float *channel_impulse = impulse + (ch % impulse_channel_count) * impulse_frame_count;
+        for (int p = 0; p < partition_count; p += 1) {
+            long start = offset + (long)p * block;
+            int count = (int)clamp(0l, impulse_frame_count - start, (long)block);
+            memset(scratch.time, 0, 2 * block * sizeof(float));
+            if (count > 0)
+                memcpy(scratch.time, channel_impulse + start, count * sizeof(float));
+            int index = (ch * partition_count + p) * stage->bin_count;
+            fft_forward(stage->fft, scratch.time, stage->ir_re + index, stage->ir_im + index, scratch.work);
+        }
+    }
+    if (!own_scratch) {
+        destroy(stage->scratch, stage_scratch_size(block));
+        stage->scratch = nullptr;
+    }
+    return 0;
+}
+
+// in holds block frames per channel, channel ch at in + ch * block. the
+// convolved frames end up in out. scratch is stage_scratch_size bytes,
+// aligned to GENESIS_SCRATCH_ALIGNMENT.
+static void stage_process(ConvolutionStage *stage, const float *in, char *scratch_bytes) {
+    int block = stage->block;
+    int bin_count = stage->bin_count;
+    int partition_count = stage->partition_count;
+    if (partition_count == 0) {
+        memset(stage->out, 0, stage->channel_count * block * sizeof(float));
+        return;
+    }
+    StageScratch scratch;
+    stage_scratch_carve(block, scratch_bytes, &scratch);
+    stage->fdl_index = (stage->fdl_index + 1) % partition_count;
+    for (int ch = 0; ch < stage->channel_count; ch += 1) {
+        float *window = stage->window + ch * 2 * block;
+        memcpy(window, window + block, block * sizeof(float));
+        memcpy(window + block, in + ch * block, block * sizeof(float));
+
+        int channel_index = ch * partition_count * bin_count;
+        float *fdl_re = stage->fdl_re + channel_index;
+        float *fdl_im = stage->fdl_im + channel_index;
+        const float *ir_re = stage->ir_re + channel_index;
+        const float *ir_im = stage->ir_im + channel_index;
+        fft_forward(stage->fft, window, fdl_re + stage->fdl_index * bin_count,
+                fdl_im + stage->fdl_index * bin_count, scratch.work);
+
+        memset(scratch.acc_re, 0, bin_count * sizeof(float));
+        memset(scratch.acc_im, 0, bin_count * sizeof(float));
+        // partition p meets the input from p blocks ago
+        int slot = stage->fdl_index;
+        for (int p = 0; p < partition_count; p += 1) {
+            fft_multiply_add(scratch.acc_re, scratch.acc_im, fdl_re + slot * bin_count, fdl_im + slot * bin_count,
+                    ir_re + p * bin_count, ir_im + p * bin_count, bin_count);
+            slot = (slot == 0) ? (partition_count - 1) : (slot - 1);
+        }
+        fft_inverse(stage->fft, scratch.acc_re, scratch.acc_im, scratch.time, scratch.work);
+        // the first half wrapped around, the second is the linear part
+        memcpy(stage->out + ch * block, scratch.time + block, block * sizeof(float));
+    }
+}
+
+static void worker_thread_run(void *userdata) {
+    ConvolutionWorker *worker = (ConvolutionWorker *)userdata;
+    int done_epoch = worker->done_epoch.load();
+    for (;;) {
+        int epoch = worker->job_epoch.load();
+        if (worker->exit.load())
+            break;
+        if (epoch == done_epoch) {
+            futex_wait(reinterpret_cast<int*>(&worker->job_epoch), epoch);
+            continue;
+        }
+        stage_process(&worker->stage, worker->job_in, worker->stage.scratch);
+        done_epoch = epoch;
+        worker->done_epoch.store(done_epoch);
+        futex_wake(reinterpret_cast<int*>(&worker->done_epoch), 1);
+    }
+}
+
+// the worker has a whole block of time for each job, so this only blocks
+// when it fell behind, or when the pipeline is offline and does not wait
+// for a device between blocks
+static void wait_for_worker(ConvolutionWorker *worker) {
+    int epoch = worker->job_epoch.load();
+    for (;;) {
+        int done_epoch = worker->done_epoch.load();
+        if (done_epoch == epoch)
+            break;
+        futex_wait(reinterpret_cast<int*>(&worker->done_epoch), done_epoch);
+    }
+}
+
+static void submit_job(ConvolutionWorker *worker) {
+    worker->job_epoch += 1;
+    futex_wake(reinterpret_cast<int*>(&worker->job_epoch), 1);
+}
+
+static void stop_worker_thread(ConvolutionWorker *worker) {
+    if (!worker->thread)
+        return;
+    // a job in flight finishes, so that its output is there on resume
+    wait_for_worker(worker);
+    worker->exit.store(true);
+    submit_job(worker);
+    os_thread_destroy(worker->thread);
+    worker->thread = nullptr;
+    worker->exit.store(false);
+    worker->done_epoch.store(worker->job_epoch.load());
+}
+
+static void stop_worker_threads(ConvolutionContext *convolution_context) {
+    for (int i = 0; i < WORKER_COUNT; i += 1)
+        stop_worker_thread(&convolution_context->workers[i]);
+}
+
+static void free_buffers(ConvolutionContext *convolution_context) {
+    int channel_count = convolution_context->channel_count;
+    stage_free(&convolution_context->head);
+    destroy(convolution_context->in_block, channel_count * HEAD_BLOCK);
+    destroy(convolution_context->out_block, channel_count * HEAD_BLOCK);
+    convolution_context->in_block = nullptr;
+    convolution_context->out_block = nullptr;
+    for (int i = 0; i < WORKER_COUNT; i += 1) {
+        ConvolutionWorker *worker = &convolution_context->workers[i];
+        int buffer_size = channel_count * worker->stage.block;
+        destroy(worker->in, buffer_size);
+        destroy(worker->job_in, buffer_size);
+        destroy(worker->out, buffer_size);
+        worker->in = nullptr;
+        worker->job_in = nullptr;
+        worker->out = nullptr;
+        stage_free(&worker->stage);
+    }
+    convolution_context->channel_count = 0;
+}
+
+static void reset_state(ConvolutionContext *convolution_context) {
+    int channel_count = convolution_context->channel_count;
+    stage_reset(&convolution_context->head);
+    memset(convolution_context->in_block, 0, channel_count * HEAD_BLOCK * sizeof(float));
+    memset(convolution_context->out_block, 0, channel_count * HEAD_BLOCK * sizeof(float));
+    convolution_context->block_frame = 0;
+    for (int i = 0; i < WORKER_COUNT; i += 1) {
+        ConvolutionWorker *worker = &convolution_context->workers[i];
+        if (worker->in) {
+            wait_for_worker(worker);
+            stage_reset(&worker->stage);
+            memset(worker->in, 0, channel_count * worker->stage.block * sizeof(float));
+            memset(worker->out, 0, channel_count * worker->stage.block * sizeof(float));
+        }
+        worker->in_frame = 0;
+        worker->out_frame = 0;
+        worker->job_pending = false;
+    }
+    convolution_context->silent_frame_count = DECAYED;
+}
+
+static void convolution_destroy(struct GenesisNode *node) {
+    struct ConvolutionContext *convolution_context = (struct ConvolutionContext *)node->userdata;
+    if (convolution_context) {
+        stop_worker_threads(convolution_context);
+        free_buffers(convolution_context);
+        destroy(convolution_context->impulse,
+                convolution_context->impulse_channel_count * convolution_context->impulse_frame_count);
+        destroy(convolution_context, 1);
+    }
+}
+
+static int convolution_create(struct GenesisNode *node) {
+    struct ConvolutionContext *convolution_context = create_zero<ConvolutionContext>();
+    node->userdata = convolution_context;
+    if (!convolution_context) {
+        convolution_destroy(node);
+        return GenesisErrorNoMem;
+    }
+    convolution_context->dry.store(1.0);
+    convolution_context->wet.store(0.5);
+    return 0;
+}
+
+// the impulse at the node's sample rate, by linear interpolation, scaled so
+// that the convolution keeps its gain
+static float *resample_impulse(ConvolutionContext *convolution_context, long *out_frame_count) {
+    int channel_count = convolution_context->impulse_channel_count;
+    long in_frame_count = convolution_context->impulse_frame_count;
+    double ratio = convolution_context->impulse_sample_rate / (double)convolution_context->sample_rate;
+    long frame_count = (long)ceil(in_frame_count / ratio);
+    float *samples = allocate_zero<float>(channel_count * frame_count);
+    if (!samples)
+        return nullptr;
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        const float *in = convolution_context->impulse + ch * in_frame_count;
+        float *out = samples + ch * frame_count;
+        for (long i = 0; i < frame_count; i += 1) {
+            double pos = i * ratio;
+            long index = (long)pos;
+            float fraction = pos - index;
+            float a = (index < in_frame_count) ? in[index] : 0.0f;
+            float b = (index + 1 < in_frame_count) ? in[index + 1] : 0.0f;
+            out[i] = (a + (b - a) * fraction) * ratio;
+        }
+    }
+    *out_frame_count = frame_count;
+    return samples;
+}
+
+// the worker's stage covers the impulse from 2 * block - HEAD_BLOCK on,
+// since its output for a block is played from the end of the next one
+static int worker_init(ConvolutionWorker *worker, int block, int partition_count, int channel_count,
+        const float *impulse, int impulse_channel_count, long impulse_frame_count)
+{
+    int err;
+    if ((err = stage_init(&worker->stage, block, partition_count, channel_count, impulse,
+                    impulse_channel_count, impulse_frame_count, 2 * block - HEAD_BLOCK, true)))
+    {
+        return err;
+    }
+    worker->in = allocate_zero<float>(channel_count * block);
+    worker->job_in = allocate_zero<float>(channel_count * block);
+    worker->out = allocate_zero<float>(channel_count * block);
+    if (!worker->in || !worker->job_in || !worker->out)
+        return GenesisErrorNoMem;
+    return 0;
+}
+
+static int prepare(ConvolutionContext *convolution_context, int channel_count, bool offline) {
+    int err;
+    free_buffers(convolution_context);
+    convolution_context->channel_count = channel_count;
+    convolution_context->offline = offline;
+    convolution_context->in_block = allocate_zero<float>(channel_count * HEAD_BLOCK);
+    convolution_context->out_block = allocate_zero<float>(channel_count * HEAD_BLOCK);
+    if (!convolution_context->in_block || !convolution_context->out_block)
+        return GenesisErrorNoMem;
+
+    const float *impulse = convolution_context->impulse;
+    int impulse_channel_count = max(1, convolution_context->impulse_channel_count);
+    long frame_count = convolution_context->impulse_frame_count;
+    float *resampled = nullptr;
+    if (impulse && convolution_context->impulse_sample_rate != convolution_context->sample_rate) {
+        if (!(resampled = resample_impulse(convolution_context, &frame_count)))
+            return GenesisErrorNoMem;
+        impulse = resampled;
+    }
+    convolution_context->frame_count = frame_count;
+
+    long head_frame_count = min(frame_count, (long)HEAD_FRAME_COUNT);
+    int head_partition_count = (head_frame_count + HEAD_BLOCK - 1) / HEAD_BLOCK;
+    long tail_end = offline ? min(frame_count, (long)FAR_OFFSET) : frame_count;
+    long tail_frame_count = max(0l, tail_end - HEAD_FRAME_COUNT);
+    int tail_partition_count = (tail_frame_count + TAIL_BLOCK - 1) / TAIL_BLOCK;
+    long far_frame_count = max(0l, frame_count - tail_end);
+    int far_partition_count = (far_frame_count + FAR_BLOCK - 1) / FAR_BLOCK;
+    err = stage_init(&convolution_context->head, HEAD_BLOCK, head_partition_count, channel_count,
+            impulse, impulse_channel_count, frame_count, 0, false);
+    if (!err && tail_partition_count > 0) {
+        err = worker_init(&convolution_context->workers[0], TAIL_BLOCK, tail_partition_count,
+                channel_count, impulse, impulse_channel_count, frame_count);
+    }
+    if (!err && far_partition_count > 0) {
+        err = worker_init(&convolution_context->workers[1], FAR_BLOCK, far_partition_count,
+                channel_count, impulse, impulse_channel_count, frame_count);
+    }
+    if (resampled)
+        destroy(resampled, impulse_channel_count * frame_count);
+    if (err)
+        return err;
+    reset_state(convolution_context);
+    return 0;
+}
+
+// the head is convolved in the pipeline's scratch, and the other stages in
+// their own on their worker threads
+static int convolution_scratch_size(struct GenesisNode *) {
+    return (int)stage_scratch_size(HEAD_BLOCK);
+}
+
+// the partitions are only built here, while no node runs
+static int convolution_activate(struct GenesisNode *node) {
+    struct ConvolutionContext *convolution_context = (struct ConvolutionContext *)node->userdata;
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    int channel_count = genesis_audio_port_channel_layout(audio_in_port)->channel_count;
+    int sample_rate = genesis_audio_port_sample_rate(audio_in_port);
+    bool offline = node->descriptor->pipeline->offline;
+    int err;
+    if (convolution_context->impulse_changed || channel_count != convolution_context->channel_count ||
+        sample_rate != convolution_context->sample_rate || offline != convolution_context->offline)
+    {
+        convolution_context->sample_rate = sample_rate;
+        if ((err = prepare(convolution_context, channel_count, offline))) {
+            free_buffers(convolution_context);
+            return err;
+        }
+        convolution_context->impulse_changed = false;
+    }
+    GenesisContext *context = node->descriptor->pipeline->context;
+    for (int i = 0; i < WORKER_COUNT; i += 1) {
+        ConvolutionWorker *worker = &convolution_context->workers[i];
+        if (worker->in && !worker->thread) {
+            if ((err = os_thread_create_with_attributes(worker_thread_run, worker,
+                            &context->background_thread_attributes, &worker->thread)))
+            {
+                return err;
+            }
+        }
+    }
+    return 0;
+}
+
+static void convolution_deactivate(struct GenesisNode *node) {
+    struct ConvolutionContext *convolution_context = (struct ConvolutionContext *)node->userdata;
+    stop_worker_threads(convolution_context);
+}
+
+static void convolution_seek(struct GenesisNode *node) {
+    struct ConvolutionContext *convolution_context = (struct ConvolutionContext *)node->userdata;
+    if (convolution_context->in_block)
+        reset_state(convolution_context);
+}
+
+// a whole head block is in. every block of a worker's stage this trades
+// the worker's output for the next block of input.
+static void finish_block(ConvolutionContext *convolution_context, float dry, float wet, char *scratch) {
+    int channel_count = convolution_context->channel_count;
+    const float *worker_outs[WORKER_COUNT];
+    for (int i = 0; i < WORKER_COUNT; i += 1) {
+        ConvolutionWorker *worker = &convolution_context->workers[i];
+        worker_outs[i] = nullptr;
+        if (!worker->in)
+            continue;
+        int block = worker->stage.block;
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            memcpy(worker->in + ch * block + worker->in_frame,
+                    convolution_context->in_block + ch * HEAD_BLOCK, HEAD_BLOCK * sizeof(float));
+        }
+        worker->in_frame += HEAD_BLOCK;
+        if (worker->in_frame == block) {
+            if (worker->job_pending) {
+                wait_for_worker(worker);
+                float *out = worker->out;
+                worker->out = worker->stage.out;
+                worker->stage.out = out;
+            }
+            float *in = worker->in;
+            worker->in = worker->job_in;
+            worker->job_in = in;
+            worker->in_frame = 0;
+            worker->out_frame = 0;
+            worker->job_pending = true;
+            submit_job(worker);
+        }
+        worker_outs[i] = worker->out + worker->out_frame;
+        worker->out_frame += HEAD_BLOCK;
+    }
+
+    stage_process(&convolution_context->head, convolution_context->in_block, scratch);
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        const float *in = convolution_context->in_block + ch * HEAD_BLOCK;
+        float *head_out = convolution_context->head.out + ch * HEAD_BLOCK;
+        float *out = convolution_context->out_block + ch;
+        for (int i = 0; i < WORKER_COUNT; i += 1) {
+            if (!worker_outs[i])
+                continue;
+            const float *channel_worker_out = worker_outs[i] + ch * convolution_context->workers[i].stage.block;
+            for (int frame = 0; frame < HEAD_BLOCK; frame += 1)
+                head_out[frame] += channel_worker_out[frame];
+        }
+        for (int frame = 0; frame < HEAD_BLOCK; frame += 1)
+            out[frame * channel_count] = dry * in[frame] + wet * head_out[frame];
+    }
+}
+
+// what is still in the partitions plays out over the impulse, the latency
+// and a block of the longest stage in flight
+static long decay_frame_count(ConvolutionContext *convolution_context) {
+    int block = HEAD_BLOCK;
+    for (int i = 0; i < WORKER_COUNT; i += 1) {
+        if (convolution_context->workers[i].in)
+            block = convolution_context->workers[i].stage.block;
+    }
+    return convolution_context->frame_count + HEAD_BLOCK + 2 * block;
+}
+
+static void convolution_run(struct GenesisNode *node) {
+    struct ConvolutionContext *convolution_context = (struct ConvolutionContext *)node->userdata;
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 1);
+
+    int input_frame_count = genesis_audio_in_port_fill_count(audio_in_port);
+    int output_frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    int frame_count = min(input_frame_count, output_frame_count);
+
+    long tail_frames = decay_frame_count(convolution_context);
+    bool silent_input = genesis_audio_in_port_silent_count(audio_in_port) >= frame_count;
+    if (silent_input && convolution_context->silent_frame_count >= tail_frames) {
+        genesis_audio_out_port_write_silence(audio_out_port, frame_count);
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+        return;
+    }
+
+    float dry = convolution_context->dry.load();
+    float wet = convolution_context->wet.load();
+    int channel_count = convolution_context->channel_count;
+    float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    int frame = 0;
+    while (frame < frame_count) {
+        int block_frame = convolution_context->block_frame;
+        int span_frame_count = min(frame_count - frame, HEAD_BLOCK - block_frame);
+        const float *in = in_buf + frame * channel_count;
+        float *out = out_buf + frame * channel_count;
+        const float *delayed = convolution_context->out_block + block_frame * channel_count;
+        for (int i = 0; i < span_frame_count; i += 1) {
+            for (int ch = 0; ch < channel_count; ch += 1) {
+                convolution_context->in_block[ch * HEAD_BLOCK + block_frame + i] = in[i * channel_count + ch];
+                out[i * channel_count + ch] = delayed[i * channel_count + ch];
+            }
+        }
+        frame += span_frame_count;
+        convolution_context->block_frame += span_frame_count;
+        if (convolution_context->block_frame == HEAD_BLOCK) {
+            finish_block(convolution_context, dry, wet, (char *)genesis_node_scratch(node));
+            convolution_context->block_frame = 0;
+        }
+    }
+
+    if (!silent_input) {
+        convolution_context->silent_frame_count = 0;
+    } else {
+        convolution_context->silent_frame_count = min(convolution_context->silent_frame_count + frame_count,
+                DECAYED);
+        // what is left of the reverb becomes exact silence
+        if (convolution_context->silent_frame_count >= tail_frames)
+            reset_state(convolution_context);
+    }
+
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+int genesis_convolution_node_set_impulse(struct GenesisNode *node, struct GenesisAudioFile *audio_file) {
+    if (node->descriptor->run != convolution_run || audio_file->streamed)
+        return GenesisErrorInvalidParam;
+    if (genesis_pipeline_is_running(node->descriptor->pipeline))
+        return GenesisErrorInvalidState;
+    struct ConvolutionContext *convolution_context = (struct ConvolutionContext *)node->userdata;
+    int channel_count = audio_file->channel_layout.channel_count;
+    long frame_count = genesis_audio_file_frame_count(audio_file);
+    float *impulse = nullptr;
+    if (channel_count > 0 && frame_count > 0) {
+        if (!(impulse = allocate_zero<float>(channel_count * frame_count)))
+            return GenesisErrorNoMem;
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            memcpy(impulse + ch * frame_count, audio_file_channel_samples(audio_file, ch),
+                    frame_count * sizeof(float));
+        }
+    } else {
+        channel_count = 0;
+        frame_count = 0;
+    }
+    destroy(convolution_context->impulse,
+            convolution_context->impulse_channel_count * convolution_context->impulse_frame_count);
+    convolution_context->impulse = impulse;
+    convolution_context->impulse_channel_count = channel_count;
+    convolution_context->impulse_frame_count = frame_count;
+    convolution_context->impulse_sample_rate = audio_file->sample_rate;
+    convolution_context->impulse_changed = true;
+    return 0;
+}
+
+int genesis_convolution_node_load_impulse(struct GenesisNode *node, const char *path) {
+    if (node->descriptor->run != convolution_run)
+        return GenesisErrorInvalidParam;
+    if (genesis_pipeline_is_running(node->descriptor->pipeline))
+        return GenesisErrorInvalidState;
+    struct GenesisAudioFile *audio_file;
+    int err;
+    if ((err = genesis_audio_file_load(node->descriptor->pipeline->context, path, &audio_file)))
+        return err;
+    err = genesis_convolution_node_set_impulse(node, audio_file);
+    genesis_audio_file_destroy(audio_file);
+    return err;
+}
+
+int genesis_convolution_node_set_params(struct GenesisNode *node, float dry, float wet) {
+    if (node->descriptor->run != convolution_run || !isfinite(dry) || !isfinite(wet))
+        return GenesisErrorInvalidParam;
+    struct ConvolutionContext *convolution_context = (struct ConvolutionContext *)node->userdata;
+    convolution_context->dry.store(dry);
+    convolution_context->wet.store(wet);
+    return 0;
+}
+
+int create_convolution_descriptor(GenesisPipeline *pipeline) {
+    GenesisNodeDescriptor *node_descr = genesis_create_node_descriptor(pipeline, 2, "convolution",
+            "Convolution reverb.");
+    if (!node_descr) {
+        genesis_node_descriptor_destroy(node_descr);
+        return GenesisErrorNoMem;
+    }
+
+    genesis_node_descriptor_set_run_callback(node_descr, convolution_run);
+    genesis_node_descriptor_set_create_callback(node_descr, convolution_create);
+    genesis_node_descriptor_set_destroy_callback(node_descr, convolution_destroy);
+    genesis_node_descriptor_set_seek_callback(node_descr, convolution_seek);
+    genesis_node_descriptor_set_activate_callback(node_descr, convolution_activate);
+    genesis_node_descriptor_set_scratch_callback(node_descr, convolution_scratch_size);
+    node_descr->deactivate = convolution_deactivate;
+    // the dry frames wait for the head block too
+    genesis_node_descriptor_set_latency(node_descr, HEAD_BLOCK);
+
+    struct GenesisPortDescriptor *audio_in_port = genesis_node_descriptor_create_port(
+            node_descr, 0, GenesisPortTypeAudioIn, "audio_in");
+    struct GenesisPortDescriptor *audio_out_port = genesis_node_descriptor_create_port(
+            node_descr, 1, GenesisPortTypeAudioOut, "audio_out");
+
+    if (!audio_in_port || !audio_out_port) {
+        genesis_node_descriptor_destroy(node_descr);
+        return GenesisErrorNoMem;
+    }
+
+    int target_sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+
+    genesis_audio_port_descriptor_set_channel_layout(audio_in_port,
+        soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono), false, -1);
+
+    genesis_audio_port_descriptor_set_sample_rate(audio_in_port, target_sample_rate, false, -1);
+
+    genesis_audio_port_descriptor_set_channel_layout(audio_out_port,
+        soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono), true, 0);
+
+    genesis_audio_port_descriptor_set_sample_rate(audio_out_port, target_sample_rate, true, 0);
+
+    // each input sample is read before the output sample in its place is
+    // written
+    genesis_audio_port_descriptor_set_in_place(audio_out_port, 0);
+
+    return 0;
+}
@@ -0,0 +1,8 @@
+#ifndef CONVOLUTION_HPP
+#define CONVOLUTION_HPP
+
+#include "genesis.hpp"
+
+int create_convolution_descriptor(GenesisPipeline *pipeline);
+
+#endif
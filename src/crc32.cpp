@@ -1,4 +1,15 @@
 #include "crc32.hpp"
+#include "util.hpp"
+
+#include <string.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#define GENESIS_CRC32C_X86
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define GENESIS_CRC32C_ARMV8
+#endif
 
 static const uint32_t crc_table[256] = {
     0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419,
@@ -66,3 +77,156 @@ uint32_t crc32(uint32_t crc, const unsigned char *buf, int len) {
 
     return crc ^ 0xffffffff;
 }
+
+// reflected castagnoli polynomial
+static const uint32_t CRC32C_POLY = 0x82f63b78;
+
+// crc32c_table[k][b] is the crc of byte b followed by k zero bytes
+static uint32_t crc32c_table[8][256];
+
+static bool init_crc32c_table(void) {
+    for (int b = 0; b < 256; b += 1) {
+        uint32_t crc = b;
+        for (int bit = 0; bit < 8; bit += 1)
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : (crc >> 1);
+        crc32c_table[0][b] = crc;
+    }
+    for (int b = 0; b < 256; b += 1) {
+        for (int k = 1; k < 8; k += 1) {
+            uint32_t prev = crc32c_table[k - 1][b];
+            crc32c_table[k][b] = (prev >> 8) ^ crc32c_table[0][prev & 0xff];
+        }
+    }
+    return true;
+}
+
+static inline uint32_t read_uint32le(const unsigned char *buf) {
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+static uint32_t crc32c_slice_by_8(uint32_t crc, const unsigned char *buf, int len) {
+    static const bool table_ready = init_crc32c_table();
+    (void)table_ready;
+
+    crc = crc ^ 0xffffffff;
+    for (; len >= 8; len -= 8, buf += 8) {
+        uint32_t one = read_uint32le(buf) ^ crc;
+        uint32_t two = read_uint32le(buf + 4);
+        crc = crc32c_table[7][one & 0xff] ^
+              crc32c_table[6][(one >> 8) & 0xff] ^
+              crc32c_table[5][(one >> 16) & 0xff] ^
+              crc32c_table[4][one >> 24] ^
+              crc32c_table[3][two & 0xff] ^
+              crc32c_table[2][(two >> 8) & 0xff] ^
+              crc32c_table[1][(two >> 16) & 0xff] ^
+              crc32c_table[0][two >> 24];
+    }
+    while (len--)
+        crc = crc32c_table[0][(crc ^ (*buf++)) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffff;
+}
+
+#if defined(GENESIS_CRC32C_X86)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *buf, int len) {
+    crc = crc ^ 0xffffffff;
+#if defined(__x86_64__)
+    uint64_t crc64 = crc;
+    for (; len >= 8; len -= 8, buf += 8) {
+        uint64_t word;
+        memcpy(&word, buf, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (uint32_t)crc64;
+#endif
+    for (; len >= 4; len -= 4, buf += 4) {
+        uint32_t word;
+        memcpy(&word, buf, 4);
+        crc = _mm_crc32_u32(crc, word);
+    }
+    while (len--)
+        crc = _mm_crc32_u8(crc, *buf++);
+    return crc ^ 0xffffffff;
+}
+#endif
+
+#if defined(GENESIS_CRC32C_ARMV8)
+static uint32_t crc32c_armv8(uint32_t crc, const unsigned char *buf, int len) {
+    crc = crc ^ 0xffffffff;
+    for (; len >= 8; len -= 8, buf += 8) {
+        uint64_t word;
+        memcpy(&word, buf, 8);
+        crc = __crc32cd(crc, word);
+    }
+    while (len--)
+        crc = __crc32cb(crc, *buf++);
+    return crc ^ 0xffffffff;
+}
+#endif
+
+bool crc32c_impl_supported(Crc32cImpl impl) {
+    switch (impl) {
+    case Crc32cImplSliceBy8:
+        return true;
+    case Crc32cImplSse42:
+#if defined(GENESIS_CRC32C_X86)
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse4.2");
+#else
+        return false;
+#endif
+    case Crc32cImplArmv8:
+#if defined(GENESIS_CRC32C_ARMV8)
+        return true;
+#else
+        return false;
+#endif
+    }
+    panic("invalid Crc32cImpl");
+}
+
+static Crc32Function crc32c_impl_function(Crc32cImpl impl) {
+    switch (impl) {
+    case Crc32cImplSliceBy8:
+        return crc32c_slice_by_8;
+    case Crc32cImplSse42:
+#if defined(GENESIS_CRC32C_X86)
+        return crc32c_sse42;
+#else
+        break;
+#endif
+    case Crc32cImplArmv8:
+#if defined(GENESIS_CRC32C_ARMV8)
+        return crc32c_armv8;
+#else
+        break;
+#endif
+    }
+    panic("unsupported Crc32cImpl");
+}
+
+static Crc32Function crc32c_best_function(void) {
+    static const Crc32cImpl prioritized_impls[] = {
+        Crc32cImplSse42,
+        Crc32cImplArmv8,
+    };
+    for (int i = 0; i < array_length(prioritized_impls); i += 1) {
+        if (crc32c_impl_supported(prioritized_impls[i]))
+            return crc32c_impl_function(prioritized_impls[i]);
+    }
+    return crc32c_slice_by_8;
+}
+
+uint32_t crc32c_with_impl(Crc32cImpl impl, uint32_t crc, const unsigned char *buf, int len) {
+    assert(crc32c_impl_supported(impl));
+    if (!buf)
+        return 0;
+    return crc32c_impl_function(impl)(crc, buf, len);
+}
+
+uint32_t crc32c(uint32_t crc, const unsigned char *buf, int len) {
+    static const Crc32Function best = crc32c_best_function();
+    if (!buf)
+        return 0;
+    return best(crc, buf, len);
+}
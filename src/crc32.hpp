@@ -3,6 +3,22 @@
 
 #include <stdint.h>
 
+typedef uint32_t (*Crc32Function)(uint32_t crc, const unsigned char *buf, int len);
+
 uint32_t crc32(uint32_t crc, const unsigned char *buf, int len);
 
+// crc32c (castagnoli), chained the same way as crc32. it uses the sse4.2 or
+// armv8 crc instructions when the cpu has them.
+uint32_t crc32c(uint32_t crc, const unsigned char *buf, int len);
+
+enum Crc32cImpl {
+    Crc32cImplSliceBy8,
+    Crc32cImplSse42,
+    Crc32cImplArmv8,
+};
+
+bool crc32c_impl_supported(Crc32cImpl impl);
+// for testing the implementations against each other
+uint32_t crc32c_with_impl(Crc32cImpl impl, uint32_t crc, const unsigned char *buf, int len);
+
 #endif
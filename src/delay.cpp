@@ -1,128 +1,347 @@
 #include "delay.hpp"
+#include "dsp_kernels.hpp"
+#include "atomic_double.hpp"
+#include "node_template.hpp"
 
-static const int MAX_DELAY_FRAMES = 96000;
+// a tail is over once it is below -120 dB
+static const double TAIL_GAIN = 0.000001;
+static const long DECAYED = LONG_MAX / 2;
+// changes to the delay time glide over this long
+static const double GLIDE_SECONDS = 0.02;
+// so do changes to these. while one ramps it is held for this many frames
+// at a time.
+static const int PARAM_FEEDBACK = 0;
+static const int PARAM_WET = 1;
+static const int RAMP_CHUNK_FRAME_COUNT = 32;
 
-struct DelayContext {
-    float *delayed_frames;
-    int delayed_frames_capacity;
+struct DelayContext : NodeTemplate {
+    typedef AudioInPort<0> AudioIn;
+    typedef AudioOutPort<1> AudioOut;
+    typedef NodePorts<AudioIn, AudioOut> Ports;
+    static const NodePortSpec PORT_SPECS[Ports::COUNT];
+    static const int PARAM_COUNT = 2;
+    static const NodeParamSpec PARAM_SPECS[PARAM_COUNT];
+    static const NodeParamSpec *param_specs() { return PARAM_SPECS; }
+    static const bool HAS_SEEK = true;
+    static const bool HAS_ACTIVATE = true;
+    static const bool HAS_STATE = true;
+
+    ~DelayContext() {
+        destroy(line, line_capacity);
+    }
+    int create(GenesisNode *node);
+    void run(GenesisNode *node);
+    void seek(GenesisNode *node);
+    int activate(GenesisNode *node);
+    int state_size(GenesisNode *node);
+    void save_state(GenesisNode *node, void *state);
+    void restore_state(GenesisNode *node, const void *state);
+
+    // interleaved frames. the write head is at write_frame and the read head
+    // delay frames behind it, with the delay always within
+    // [1, line_frame_count - 2] so that both samples it reads were written
+    // before the one being written.
+    float *line;
+    int line_capacity;
+    int line_frame_count;
+    int write_frame;
     int channel_count;
-    int frame_offset;
-    float delay_length_notes; // in whole notes
-    int delay_length_frames;
+    int sample_rate;
+    // in frames. glides toward the delay parameter
+    double delay;
+
+    // whole notes. only changes while the pipeline is stopped
+    double max_delay;
+    // in whole notes, set from any thread. feedback and wet are node params.
+    AtomicDouble delay_param;
+
+    // how many frames in a row the input has been silence
+    long silent_frame_count;
 };
 
-static void delay_destroy(struct GenesisNode *node) {
-    struct DelayContext *delay_context = (struct DelayContext *)node->userdata;
-    if (delay_context) {
-        destroy(delay_context->delayed_frames, delay_context->delayed_frames_capacity);
-        destroy(delay_context, 1);
-    }
-}
+// in the order of PARAM_FEEDBACK and PARAM_WET
+const NodeParamSpec DelayContext::PARAM_SPECS[] = {
+    {"feedback", -0.999f, 0.999f, 0.5f, GLIDE_SECONDS},
+    {"wet", -4.0f, 4.0f, 0.5f, GLIDE_SECONDS},
+};
 
-static int delay_create(struct GenesisNode *node) {
-    struct DelayContext *delay_context = create_zero<DelayContext>();
-    node->userdata = delay_context;
-    if (!delay_context) {
-        delay_destroy(node);
-        return GenesisErrorNoMem;
-    }
-    delay_context->delay_length_notes = 1.0f;
+// both ways of running read each input sample before writing its output,
+// so the out port works in place
+const NodePortSpec DelayContext::PORT_SPECS[] = {
+    {"audio_in", SoundIoChannelLayoutIdMono, false, -1, false, -1, -1},
+    {"audio_out", SoundIoChannelLayoutIdMono, true, 0, true, 0, 0},
+};
+
+int DelayContext::create(struct GenesisNode *) {
+    max_delay = 1.0;
+    delay_param.store(1.0);
     return 0;
 }
 
-static int delay_port_connect(struct GenesisPort *audio_in_port, struct GenesisPort *other_port) {
-    struct GenesisNode *node = audio_in_port->node;
+static double delay_frames(struct GenesisNode *node, double whole_notes) {
     struct DelayContext *delay_context = (struct DelayContext *)node->userdata;
-    struct GenesisPipeline *pipeline = node->descriptor->pipeline;
-
-    delay_context->channel_count = genesis_audio_port_channel_layout(audio_in_port)->channel_count;
-    int new_capacity = delay_context->channel_count * MAX_DELAY_FRAMES;
-    if (new_capacity != delay_context->delayed_frames_capacity) {
-        float *new_frames = reallocate_safe<float>(
-                delay_context->delayed_frames, delay_context->delayed_frames_capacity, new_capacity);
-        if (!new_frames)
-            return GenesisErrorNoMem;
-
-        delay_context->delayed_frames = new_frames;
-        delay_context->delayed_frames_capacity = new_capacity;
-    }
+    double frames = delay_context->sample_rate * genesis_whole_notes_to_seconds(
+            node->descriptor->pipeline, whole_notes, delay_context->sample_rate);
+    return clamp(1.0, frames, delay_context->line_frame_count - 2.0);
+}
 
-    delay_context->delay_length_frames = genesis_whole_notes_to_frames(
-            pipeline, delay_context->delay_length_notes, genesis_audio_port_sample_rate(audio_in_port));
+// the delay line only grows here, while no node runs
+int DelayContext::activate(struct GenesisNode *node) {
+    DelayContext *delay_context = this;
+    AudioIn audio_in(node);
+    delay_context->channel_count = audio_in.channel_count();
+    delay_context->sample_rate = audio_in.sample_rate();
 
+    double max_delay_frames = delay_context->sample_rate * genesis_whole_notes_to_seconds(
+            node->descriptor->pipeline, delay_context->max_delay, delay_context->sample_rate);
+    int line_frame_count = (int)ceil(max_delay_frames) + 2;
+    int new_capacity = line_frame_count * delay_context->channel_count;
+    if (line_frame_count != delay_context->line_frame_count || new_capacity != delay_context->line_capacity) {
+        if (new_capacity != delay_context->line_capacity) {
+            float *new_line = reallocate_safe<float>(delay_context->line, delay_context->line_capacity,
+                    new_capacity);
+            if (!new_line)
+                return GenesisErrorNoMem;
+            delay_context->line = new_line;
+            delay_context->line_capacity = new_capacity;
+        }
+        delay_context->line_frame_count = line_frame_count;
+        memset(delay_context->line, 0, new_capacity * sizeof(float));
+        delay_context->write_frame = 0;
+        delay_context->silent_frame_count = DECAYED;
+    }
+    delay_context->delay = delay_frames(node, delay_context->delay_param.load());
     return 0;
 }
 
-static void delay_seek(struct GenesisNode *node) {
-    struct DelayContext *delay_context = (struct DelayContext *)node->userdata;
-    delay_context->frame_offset = 0;
-    memset(delay_context->delayed_frames, 0, delay_context->delayed_frames_capacity);
+void DelayContext::seek(struct GenesisNode *node) {
+    DelayContext *delay_context = this;
+    delay_context->write_frame = 0;
+    if (delay_context->line)
+        memset(delay_context->line, 0, delay_context->line_capacity * sizeof(float));
+    // an empty delay line has no tail
+    delay_context->silent_frame_count = DECAYED;
+    if (delay_context->line_frame_count)
+        delay_context->delay = delay_frames(node, delay_context->delay_param.load());
 }
 
-static void delay_run(struct GenesisNode *node) {
-    struct DelayContext *delay_context = (struct DelayContext *)node->userdata;
-    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
-    struct GenesisPort *audio_out_port = genesis_node_port(node, 1);
+// what a checkpoint holds, followed by the delay line
+struct DelayState {
+    int write_frame;
+    double delay;
+    long silent_frame_count;
+};
 
-    int input_frame_count = genesis_audio_in_port_fill_count(audio_in_port);
-    int output_frame_count = genesis_audio_out_port_free_count(audio_out_port);
-    int frame_count = min(input_frame_count, output_frame_count);
+int DelayContext::state_size(struct GenesisNode *) {
+    return sizeof(DelayState) + line_capacity * sizeof(float);
+}
 
-    float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
-    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
-    for (int frame = 0; frame < frame_count; frame += 1) {
-        for (int channel = 0; channel < delay_context->channel_count; channel += 1) {
-            int sample_index = frame * delay_context->channel_count + channel;
-            float in_sample = in_buf[sample_index];
-            int delay_sample_index = delay_context->frame_offset * delay_context->channel_count + channel;
-            out_buf[sample_index] = in_sample + 0.50f * delay_context->delayed_frames[delay_sample_index];
-
-            delay_context->delayed_frames[delay_sample_index] =
-                delay_context->delayed_frames[delay_sample_index] * 0.50f + in_sample;
-        }
-        delay_context->frame_offset = (delay_context->frame_offset + 1) % delay_context->delay_length_frames;
-    }
+void DelayContext::save_state(struct GenesisNode *, void *state) {
+    DelayContext *delay_context = this;
+    DelayState *delay_state = (DelayState *)state;
+    delay_state->write_frame = delay_context->write_frame;
+    delay_state->delay = delay_context->delay;
+    delay_state->silent_frame_count = delay_context->silent_frame_count;
+    memcpy(delay_state + 1, delay_context->line, delay_context->line_capacity * sizeof(float));
+}
 
-    genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
-    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+void DelayContext::restore_state(struct GenesisNode *, const void *state) {
+    DelayContext *delay_context = this;
+    const DelayState *delay_state = (const DelayState *)state;
+    delay_context->write_frame = delay_state->write_frame;
+    delay_context->delay = delay_state->delay;
+    delay_context->silent_frame_count = delay_state->silent_frame_count;
+    memcpy(delay_context->line, delay_state + 1, delay_context->line_capacity * sizeof(float));
 }
 
-int create_delay_descriptor(GenesisPipeline *pipeline) {
-    GenesisNodeDescriptor *node_descr = genesis_create_node_descriptor(pipeline, 2, "delay", "Simple delay filter.");
-    if (!node_descr) {
-        genesis_node_descriptor_destroy(node_descr);
-        return GenesisErrorNoMem;
+// how long the tail rings after the input goes silent
+static long tail_frame_count(DelayContext *delay_context, float feedback) {
+    double gain = fabs(feedback);
+    if (gain < TAIL_GAIN)
+        return (long)ceil(delay_context->delay);
+    double pass_count = ceil(log(TAIL_GAIN) / log(gain)) + 1.0;
+    return (long)min(pass_count * ceil(delay_context->delay), (double)DECAYED);
+}
+
+// the delay stays put, so every stretch up to where one of the heads wraps,
+// and no longer than the delay so it never reads what it writes, is one
+// contiguous span
+static void run_steady(DelayContext *delay_context, float *out_buf, const float *in_buf,
+        int frame_count, float wet, float feedback)
+{
+    int channel_count = delay_context->channel_count;
+    int line_frame_count = delay_context->line_frame_count;
+    int whole_delay = (int)delay_context->delay;
+    float fraction = delay_context->delay - whole_delay;
+    int frame = 0;
+    while (frame < frame_count) {
+        int near_frame = delay_context->write_frame - whole_delay;
+        if (near_frame < 0)
+            near_frame += line_frame_count;
+        int far_frame = (near_frame == 0) ? (line_frame_count - 1) : (near_frame - 1);
+        int span_frame_count = min(frame_count - frame, whole_delay);
+        span_frame_count = min(span_frame_count, line_frame_count - delay_context->write_frame);
+        span_frame_count = min(span_frame_count, line_frame_count - near_frame);
+        span_frame_count = min(span_frame_count, line_frame_count - far_frame);
+        dsp_fractional_delay(out_buf + frame * channel_count, in_buf + frame * channel_count,
+                delay_context->line + delay_context->write_frame * channel_count,
+                delay_context->line + near_frame * channel_count,
+                delay_context->line + far_frame * channel_count,
+                fraction, span_frame_count * channel_count, wet, feedback);
+        frame += span_frame_count;
+        delay_context->write_frame += span_frame_count;
+        if (delay_context->write_frame == line_frame_count)
+            delay_context->write_frame = 0;
     }
+}
 
-    genesis_node_descriptor_set_run_callback(node_descr, delay_run);
-    genesis_node_descriptor_set_create_callback(node_descr, delay_create);
-    genesis_node_descriptor_set_destroy_callback(node_descr, delay_destroy);
-    genesis_node_descriptor_set_seek_callback(node_descr, delay_seek);
+// the delay moves from where it is to end_delay over the block, so each
+// frame reads between two other samples
+struct RunGliding {
+    template<int ChannelCount>
+    static void run(DelayContext *delay_context, float *out_buf, const float *in_buf,
+            int frame_count, float wet, float feedback, double end_delay);
+};
 
-    struct GenesisPortDescriptor *audio_in_port = genesis_node_descriptor_create_port(
-            node_descr, 0, GenesisPortTypeAudioIn, "audio_in");
-    struct GenesisPortDescriptor *audio_out_port = genesis_node_descriptor_create_port(
-            node_descr, 1, GenesisPortTypeAudioOut, "audio_out");
+template<int ChannelCount>
+void RunGliding::run(DelayContext *delay_context, float *out_buf, const float *in_buf,
+        int frame_count, float wet, float feedback, double end_delay)
+{
+    int channel_count = node_template_channel_count<ChannelCount>(delay_context->channel_count);
+    int line_frame_count = delay_context->line_frame_count;
+    double delay_step = (end_delay - delay_context->delay) / frame_count;
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        delay_context->delay += delay_step;
+        double read_pos = delay_context->write_frame - delay_context->delay;
+        if (read_pos < 0.0)
+            read_pos += line_frame_count;
+        int far_frame = (int)read_pos;
+        float fraction = 1.0f - (float)(read_pos - far_frame);
+        int near_frame = (far_frame + 1 == line_frame_count) ? 0 : (far_frame + 1);
+        const float *near = delay_context->line + near_frame * channel_count;
+        const float *far = delay_context->line + far_frame * channel_count;
+        float *write = delay_context->line + delay_context->write_frame * channel_count;
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            float in_sample = in_buf[ch];
+            float delayed = near[ch] + (far[ch] - near[ch]) * fraction;
+            out_buf[ch] = in_sample + wet * delayed;
+            write[ch] = in_sample + feedback * delayed;
+        }
+        in_buf += channel_count;
+        out_buf += channel_count;
+        delay_context->write_frame += 1;
+        if (delay_context->write_frame == line_frame_count)
+            delay_context->write_frame = 0;
+    }
+    delay_context->delay = end_delay;
+}
 
-    if (!audio_in_port || !audio_out_port) {
-        genesis_node_descriptor_destroy(node_descr);
-        return GenesisErrorNoMem;
+static void run_span(DelayContext *delay_context, float *out_buf, const float *in_buf,
+        int frame_count, float wet, float feedback, double target_delay)
+{
+    if (target_delay == delay_context->delay) {
+        run_steady(delay_context, out_buf, in_buf, frame_count, wet, feedback);
+    } else {
+        double glide_frames = GLIDE_SECONDS * delay_context->sample_rate;
+        double end_delay = delay_context->delay + (target_delay - delay_context->delay) *
+            min(1.0, frame_count / glide_frames);
+        // close enough that the rest of the glide would not be heard
+        if (fabs(end_delay - target_delay) < 0.001)
+            end_delay = target_delay;
+        node_template_for_channels<RunGliding>(delay_context->channel_count, delay_context,
+                out_buf, in_buf, frame_count, wet, feedback, end_delay);
     }
+}
 
-    int target_sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+void DelayContext::run(struct GenesisNode *node) {
+    DelayContext *delay_context = this;
+    AudioIn audio_in(node);
+    AudioOut audio_out(node);
 
-    genesis_port_descriptor_set_connect_callback(audio_in_port, delay_port_connect);
+    int input_frame_count = audio_in.fill_count();
+    int output_frame_count = audio_out.free_count();
+    int frame_count = min(input_frame_count, output_frame_count);
+    int sample_rate = delay_context->sample_rate;
 
-    genesis_audio_port_descriptor_set_channel_layout(audio_in_port,
-        soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono), false, -1);
+    double target_delay = delay_frames(node, delay_context->delay_param.load());
+    genesis_node_params_next_segment(node, sample_rate, frame_count);
+    long tail_frames = tail_frame_count(delay_context, genesis_node_param_value(node, PARAM_FEEDBACK));
+    bool silent_input = audio_in.silent_count() >= frame_count;
+    if (silent_input && delay_context->silent_frame_count >= tail_frames) {
+        delay_context->delay = target_delay;
+        genesis_node_params_advance(node, frame_count);
+        audio_out.write_silence(frame_count);
+        audio_in.advance(frame_count);
+        return;
+    }
 
-    genesis_audio_port_descriptor_set_sample_rate(audio_in_port, target_sample_rate, false, -1);
+    float *in_buf = audio_in.read_ptr();
+    float *out_buf = audio_out.write_ptr();
+    int channel_count = delay_context->channel_count;
+    int frame = 0;
+    while (frame < frame_count) {
+        int span_frame_count = genesis_node_params_next_segment(node, sample_rate, frame_count - frame);
+        float feedback = genesis_node_param_value(node, PARAM_FEEDBACK);
+        float wet = genesis_node_param_value(node, PARAM_WET);
+        float feedback_step = genesis_node_param_step(node, PARAM_FEEDBACK);
+        float wet_step = genesis_node_param_step(node, PARAM_WET);
+        if (feedback_step != 0.0f || wet_step != 0.0f) {
+            // the values halfway through the chunk
+            span_frame_count = min(span_frame_count, RAMP_CHUNK_FRAME_COUNT);
+            feedback += feedback_step * span_frame_count * 0.5f;
+            wet += wet_step * span_frame_count * 0.5f;
+        }
+        run_span(delay_context, out_buf + frame * channel_count, in_buf + frame * channel_count,
+                span_frame_count, wet, feedback, target_delay);
+        genesis_node_params_advance(node, span_frame_count);
+        frame += span_frame_count;
+    }
 
+    if (!silent_input) {
+        delay_context->silent_frame_count = 0;
+    } else {
+        delay_context->silent_frame_count = min(delay_context->silent_frame_count + frame_count, DECAYED);
+        // the tail has died away. what is left of it becomes exact silence.
+        if (delay_context->silent_frame_count >= tail_frames) {
+            memset(delay_context->line, 0, delay_context->line_capacity * sizeof(float));
+            delay_context->silent_frame_count = DECAYED;
+        }
+    }
 
-    genesis_audio_port_descriptor_set_channel_layout(audio_out_port,
-        soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono), true, 0);
+    audio_in.advance(frame_count);
+    audio_out.advance(frame_count);
+}
 
-    genesis_audio_port_descriptor_set_sample_rate(audio_out_port, target_sample_rate, true, 0);
+int genesis_delay_node_set_params(struct GenesisNode *node, double delay, float feedback, float wet) {
+    if (!node_template_is<DelayContext>(node))
+        return GenesisErrorInvalidParam;
+    if (!(delay > 0.0) || !(feedback > -1.0f && feedback < 1.0f) || !isfinite(wet))
+        return GenesisErrorInvalidParam;
+    struct DelayContext *delay_context = (struct DelayContext *)node->userdata;
+    if (delay > delay_context->max_delay) {
+        if (genesis_pipeline_is_running(node->descriptor->pipeline))
+            return GenesisErrorInvalidParam;
+        delay_context->max_delay = delay;
+    }
+    delay_context->delay_param.store(delay);
+    int err;
+    if ((err = genesis_node_set_param(node, PARAM_FEEDBACK, feedback, -1.0)))
+        return err;
+    return genesis_node_set_param(node, PARAM_WET, wet, -1.0);
+}
 
+int genesis_delay_node_set_max_delay(struct GenesisNode *node, double max_delay) {
+    if (!node_template_is<DelayContext>(node) || !(max_delay > 0.0))
+        return GenesisErrorInvalidParam;
+    if (genesis_pipeline_is_running(node->descriptor->pipeline))
+        return GenesisErrorInvalidState;
+    struct DelayContext *delay_context = (struct DelayContext *)node->userdata;
+    delay_context->max_delay = max_delay;
+    if (delay_context->delay_param.load() > max_delay)
+        delay_context->delay_param.store(max_delay);
     return 0;
 }
+
+int create_delay_descriptor(GenesisPipeline *pipeline) {
+    return node_template_create_descriptor<DelayContext>(pipeline, "delay", "Simple delay filter.", nullptr);
+}
@@ -0,0 +1,81 @@
+#ifndef GENESIS_DENORMALS_HPP
+#define GENESIS_DENORMALS_HPP
+
+#if defined(__SSE__) || defined(__x86_64__)
+#include <xmmintrin.h>
+#define GENESIS_DENORMALS_SSE
+#elif defined(__aarch64__)
+#define GENESIS_DENORMALS_AARCH64
+#endif
+
+// the floating point mode of the calling thread. a decaying feedback loop
+// ends up in numbers too small to be normal, which are many times slower
+// to compute with on x86. flushing them means treating them as zero, both
+// as operands (DAZ) and as results (FTZ). on other architectures these do
+// nothing and no denormals are ever reported.
+
+#if defined(GENESIS_DENORMALS_SSE)
+static const unsigned int DENORMALS_MXCSR_FTZ = 0x8000;
+static const unsigned int DENORMALS_MXCSR_DAZ = 0x0040;
+// the denormal operand and underflow flags. underflow is also flagged when
+// a result is flushed.
+static const unsigned int DENORMALS_MXCSR_FLAGS = 0x0002 | 0x0010;
+#elif defined(GENESIS_DENORMALS_AARCH64)
+static const unsigned long DENORMALS_FPCR_FZ = 1ul << 24;
+// input denormal and underflow
+static const unsigned long DENORMALS_FPSR_FLAGS = (1ul << 7) | (1ul << 3);
+#endif
+
+static inline void denormals_set_flush(bool flush) {
+#if defined(GENESIS_DENORMALS_SSE)
+    unsigned int mode = DENORMALS_MXCSR_FTZ | DENORMALS_MXCSR_DAZ;
+    unsigned int csr = _mm_getcsr();
+    _mm_setcsr(flush ? (csr | mode) : (csr & ~mode));
+#elif defined(GENESIS_DENORMALS_AARCH64)
+    unsigned long fpcr;
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+    fpcr = flush ? (fpcr | DENORMALS_FPCR_FZ) : (fpcr & ~DENORMALS_FPCR_FZ);
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+#else
+    (void)flush;
+#endif
+}
+
+static inline bool denormals_get_flush(void) {
+#if defined(GENESIS_DENORMALS_SSE)
+    return (_mm_getcsr() & DENORMALS_MXCSR_FTZ) != 0;
+#elif defined(GENESIS_DENORMALS_AARCH64)
+    unsigned long fpcr;
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+    return (fpcr & DENORMALS_FPCR_FZ) != 0;
+#else
+    return false;
+#endif
+}
+
+// the flags are sticky: they stay set from the first denormal operand or
+// tiny result until they are cleared
+static inline void denormals_clear_flags(void) {
+#if defined(GENESIS_DENORMALS_SSE)
+    _mm_setcsr(_mm_getcsr() & ~DENORMALS_MXCSR_FLAGS);
+#elif defined(GENESIS_DENORMALS_AARCH64)
+    unsigned long fpsr;
+    __asm__ __volatile__("mrs %0, fpsr" : "=r"(fpsr));
+    fpsr &= ~DENORMALS_FPSR_FLAGS;
+    __asm__ __volatile__("msr fpsr, %0" : : "r"(fpsr));
+#endif
+}
+
+static inline bool denormals_flagged(void) {
+#if defined(GENESIS_DENORMALS_SSE)
+    return (_mm_getcsr() & DENORMALS_MXCSR_FLAGS) != 0;
+#elif defined(GENESIS_DENORMALS_AARCH64)
+    unsigned long fpsr;
+    __asm__ __volatile__("mrs %0, fpsr" : "=r"(fpsr));
+    return (fpsr & DENORMALS_FPSR_FLAGS) != 0;
+#else
+    return false;
+#endif
+}
+
+#endif
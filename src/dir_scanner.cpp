@@ -0,0 +1,270 @@
+#include "dir_scanner.hpp"
+#include "flat_hash_map.hpp"
+#include "util.hpp"
+
+#include <time.h>
+
+// entries a batch holds at most
+static const int scan_batch_size = 256;
+// how often the scan thread asks the watcher what changed
+static const double watch_poll_seconds = 0.25;
+
+struct DirListing {
+    ByteBuffer dir;
+    long mtime;
+    // the second the directory was read in. an mtime from that same second
+    // could have changed again without the mtime moving.
+    long listed_at;
+    bool complete;
+    // -1 when not watched
+    int watch_id;
+    List<OsDirEntry *> entries;
+};
+
+struct DirScanner {
+    OsThread *thread;
+    OsMutex *mutex;
+    OsCond *cond;
+
+    // guarded by mutex
+    bool exit;
+    List<ByteBuffer> requests;
+    List<DirScanBatch *> done;
+
+    // scan thread only. watcher is nullptr where the os cannot watch.
+    OsDirWatcher *watcher;
+    FlatHashMap<ByteBuffer, DirListing *, ByteBuffer::hash> listings;
+};
+
+struct ScanContext {
+    DirScanner *scanner;
+    DirListing *listing;
+    bool first;
+};
+
+void dir_scan_batch_destroy(DirScanBatch *batch) {
+    if (batch) {
+        for (int i = 0; i < batch->entries.length(); i += 1)
+            os_dir_entry_unref(batch->entries.at(i));
+        destroy(batch, 1);
+    }
+}
+
+static void clear_listing(DirListing *listing) {
+    for (int i = 0; i < listing->entries.length(); i += 1)
+        os_dir_entry_unref(listing->entries.at(i));
+    listing->entries.clear();
+    listing->complete = false;
+}
+
+static DirScanBatch *create_batch(const ByteBuffer &dir, bool first, bool last, bool cached, int err) {
+    DirScanBatch *batch = ok_mem(create_zero<DirScanBatch>());
+    batch->dir = dir;
+    batch->first = first;
+    batch->last = last;
+    batch->cached = cached;
+    batch->err = err;
+    return batch;
+}
+
+static void publish_batch(DirScanner *scanner, DirScanBatch *batch) {
+    OsMutexLocker locker(scanner->mutex);
+    ok_or_panic(scanner->done.append(batch));
+}
+
+static void on_scan_batch(void *userdata, List<OsDirEntry *> &entries) {
+    ScanContext *context = (ScanContext *)userdata;
+    DirScanBatch *batch = create_batch(context->listing->dir, context->first, false, false, 0);
+    context->first = false;
+    for (int i = 0; i < entries.length(); i += 1) {
+        OsDirEntry *entry = entries.at(i);
+        os_dir_entry_ref(entry);
+        ok_or_panic(batch->entries.append(entry));
+        os_dir_entry_ref(entry);
+        ok_or_panic(context->listing->entries.append(entry));
+    }
+    publish_batch(context->scanner, batch);
+}
+
+static void scan_dir(DirScanner *scanner, const ByteBuffer &dir, bool changed) {
+    auto *map_entry = scanner->listings.maybe_get(dir);
+    DirListing *listing = map_entry ? map_entry->value : nullptr;
+
+    long mtime;
+    int err = os_dir_mtime(dir.raw(), &mtime);
+    if (err) {
+        if (listing)
+            clear_listing(listing);
+        publish_batch(scanner, create_batch(dir, true, true, false, err));
+        return;
+    }
+
+    if (listing && listing->complete && !changed &&
+        listing->mtime == mtime && listing->mtime < listing->listed_at)
+    {
+        DirScanBatch *batch = create_batch(dir, true, true, true, 0);
+        for (int i = 0; i < listing->entries.length(); i += 1) {
+            OsDirEntry *entry = listing->entries.at(i);
+            os_dir_entry_ref(entry);
+            ok_or_panic(batch->entries.append(entry));
+        }
+        publish_batch(scanner, batch);
+        return;
+    }
+
+    if (!listing) {
+        listing = ok_mem(create_zero<DirListing>());
+        listing->dir = dir;
+        listing->watch_id = -1;
+        scanner->listings.put(dir, listing);
+    }
+    clear_listing(listing);
+    // watched before it is read, so that nothing added meanwhile is missed
+    if (scanner->watcher && listing->watch_id < 0) {
+        if ((err = os_dir_watcher_add(scanner->watcher, dir.raw(), &listing->watch_id))) {
+            fprintf(stderr, "unable to watch %s: %s\n", dir.raw(), genesis_strerror(err));
+            listing->watch_id = -1;
+        }
+    }
+    listing->mtime = mtime;
+    listing->listed_at = time(nullptr);
+
+    ScanContext context;
+    context.scanner = scanner;
+    context.listing = listing;
+    context.first = true;
+    err = os_readdir_batched(dir.raw(), scan_batch_size, on_scan_batch, &context);
+    listing->complete = !err;
+    publish_batch(scanner, create_batch(dir, context.first, true, false, err));
+}
+
+// the directories which changed, for scan_dir to read again
+static void collect_changes(DirScanner *scanner, List<ByteBuffer> &out_dirs) {
+    List<int> watch_ids;
+    if (os_dir_watcher_changes(scanner->watcher, watch_ids))
+        return;
+    for (int i = 0; i < watch_ids.length(); i += 1) {
+        int watch_id = watch_ids.at(i);
+        auto it = scanner->listings.entry_iterator();
+        for (;;) {
+            auto *map_entry = it.next();
+            if (!map_entry)
+                break;
+            DirListing *listing = map_entry->value;
+            if (listing->watch_id >= 0 && (watch_id == -1 || listing->watch_id == watch_id))
+                ok_or_panic(out_dirs.append(listing->dir));
+        }
+    }
+}
+
+static void scan_thread_run(void *arg) {
+    DirScanner *scanner = (DirScanner *)arg;
+    List<ByteBuffer> requests;
+    List<ByteBuffer> changed_dirs;
+    for (;;) {
+        {
+            OsMutexLocker locker(scanner->mutex);
+            if (!scanner->exit && scanner->requests.length() == 0) {
+                if (scanner->watcher)
+                    os_cond_timed_wait(scanner->cond, scanner->mutex, watch_poll_seconds);
+                else
+                    os_cond_wait(scanner->cond, scanner->mutex);
+            }
+            if (scanner->exit)
+                return;
+            for (int i = 0; i < scanner->requests.length(); i += 1)
+                ok_or_panic(requests.append(scanner->requests.at(i)));
+            scanner->requests.clear();
+        }
+
+        changed_dirs.clear();
+        if (scanner->watcher)
+            collect_changes(scanner, changed_dirs);
+        for (int i = 0; i < changed_dirs.length(); i += 1)
+            scan_dir(scanner, changed_dirs.at(i), true);
+        for (int i = 0; i < requests.length(); i += 1)
+            scan_dir(scanner, requests.at(i), false);
+        requests.clear();
+    }
+}
+
+int dir_scanner_create(DirScanner **out_scanner) {
+    *out_scanner = nullptr;
+    DirScanner *scanner = create_zero<DirScanner>();
+    if (!scanner)
+        return GenesisErrorNoMem;
+
+    if (!(scanner->mutex = os_mutex_create()) || !(scanner->cond = os_cond_create())) {
+        dir_scanner_destroy(scanner);
+        return GenesisErrorNoMem;
+    }
+
+    int err = os_dir_watcher_create(&scanner->watcher);
+    if (err && err != GenesisErrorUnimplemented) {
+        dir_scanner_destroy(scanner);
+        return err;
+    }
+
+    if ((err = os_thread_create(scan_thread_run, scanner, false, &scanner->thread))) {
+        dir_scanner_destroy(scanner);
+        return err;
+    }
+
+    *out_scanner = scanner;
+    return 0;
+}
+
+void dir_scanner_destroy(DirScanner *scanner) {
+    if (!scanner)
+        return;
+
+    if (scanner->thread) {
+        {
+            OsMutexLocker locker(scanner->mutex);
+            scanner->exit = true;
+            os_cond_signal(scanner->cond, scanner->mutex);
+        }
+        os_thread_destroy(scanner->thread);
+    }
+
+    auto it = scanner->listings.entry_iterator();
+    for (;;) {
+        auto *map_entry = it.next();
+        if (!map_entry)
+            break;
+        DirListing *listing = map_entry->value;
+        clear_listing(listing);
+        destroy(listing, 1);
+    }
+    for (int i = 0; i < scanner->done.length(); i += 1)
+        dir_scan_batch_destroy(scanner->done.at(i));
+
+    os_dir_watcher_destroy(scanner->watcher);
+    if (scanner->cond)
+        os_cond_destroy(scanner->cond);
+    if (scanner->mutex)
+        os_mutex_destroy(scanner->mutex);
+    destroy(scanner, 1);
+}
+
+int dir_scanner_request(DirScanner *scanner, const ByteBuffer &dir) {
+    OsMutexLocker locker(scanner->mutex);
+    int err;
+    if ((err = scanner->requests.append(dir)))
+        return err;
+    os_cond_signal(scanner->cond, scanner->mutex);
+    return 0;
+}
+
+int dir_scanner_poll(DirScanner *scanner, List<DirScanBatch *> &out_batches) {
+    OsMutexLocker locker(scanner->mutex);
+    for (int i = 0; i < scanner->done.length(); i += 1) {
+        int err;
+        if ((err = out_batches.append(scanner->done.at(i)))) {
+            scanner->done.remove_range(0, i);
+            return err;
+        }
+    }
+    scanner->done.clear();
+    return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef GENESIS_DIR_SCANNER_HPP
+#define GENESIS_DIR_SCANNER_HPP
+
+#include "os.hpp"
+#include "list.hpp"
+
+// lists directories on a thread of its own, for the gui, which picks up
+// what was found with dir_scanner_poll. entries come in batches as they
+// are read, so that the first ones show while a slow share is still being
+// listed. listings are cached along with the mtime of their directory, and
+// directories that were listed are watched, so that one which changes is
+// listed again on its own.
+
+struct DirScanBatch {
+    ByteBuffer dir;
+    // holds a ref to each
+    List<OsDirEntry *> entries;
+    // the first batch of a listing of dir. entries from an earlier listing
+    // that are not in this one are gone.
+    bool first;
+    // the listing is complete
+    bool last;
+    // the listing came from the cache without the directory being read
+    bool cached;
+    int err;
+};
+
+void dir_scan_batch_destroy(DirScanBatch *batch);
+
+struct DirScanner;
+
+int dir_scanner_create(DirScanner **out_scanner);
+void dir_scanner_destroy(DirScanner *scanner);
+
+// returns at once. dir is listed from the cache if it has not changed since
+// it was last read.
+int dir_scanner_request(DirScanner *scanner, const ByteBuffer &dir);
+// the batches found since the last call are appended to out_batches, oldest
+// first, and the caller destroys them
+int dir_scanner_poll(DirScanner *scanner, List<DirScanBatch *> &out_batches);
+
+#endif
@@ -0,0 +1,527 @@
+#include "genesis.hpp"
+#include "byte_buffer.hpp"
+
+// the writer thread writes a track this many bytes at a time. the samples
+// start one aligned block into the file, so every write is whole aligned
+// blocks at an aligned offset, from an aligned place in the ring.
+static const int WRITE_CHUNK_SIZE = 256 * 1024;
+// the wav header, padded out to that first block
+static const int HEADER_SIZE = OS_DIRECT_IO_ALIGNMENT;
+static const double DEFAULT_BUFFER_SECONDS = 10.0;
+// how far ahead of the samples written the files have their space reserved
+static const double PREALLOCATE_SECONDS = 60.0;
+
+static_assert(WRITE_CHUNK_SIZE % OS_DIRECT_IO_ALIGNMENT == 0, "");
+
+struct DiskRecorderTrack {
+    // empty when the track is not recorded
+    ByteBuffer path;
+    // from activate to deactivate. the header is written through file, and
+    // the samples through direct_file when writes skip the os cache.
+    FILE *file;
+    FILE *direct_file;
+    int channel_count;
+    int sample_rate;
+    int bytes_per_frame;
+    // the audio thread writes frames here and the writer thread reads them.
+    // a multiple of WRITE_CHUNK_SIZE.
+    SpscRingBuffer ring;
+    bool ring_inited;
+
+    // audio thread only. frames dropped for lack of room that still have
+    // to be made up with silence, and bytes put in the ring since the
+    // writer thread was last woken for this track.
+    long gap_frame_count;
+    int unannounced_bytes;
+
+    // writer thread only, and deactivate once the thread is gone. sample
+    // bytes written past the header, and how long the file's reserved
+    // space is.
+    long written_bytes;
+    long allocated_size;
+    bool failed;
+
+    // from activate, whether the track has a file
+    bool recorded;
+    atomic_long recorded_frame_count;
+    atomic_long written_frame_count;
+    atomic_long dropped_frame_count;
+    atomic<float> peak_fill;
+};
+
+struct DiskRecorderContext {
+    int track_count;
+    DiskRecorderTrack **tracks;
+    double buffer_seconds;
+    bool direct_io;
+    bool offline;
+
+    OsThread *writer_thread;
+    atomic_bool writer_exit;
+    // the audio thread bumps wake_epoch before it looks at writer_idle, so
+    // either it sees the writer idle and wakes it or the writer's wait
+    // returns right away
+    atomic_int wake_epoch;
+    atomic_bool writer_idle;
+    // bumped by the writer thread after each write. an offline pipeline
+    // waits on it for room in a ring.
+    atomic_int written_epoch;
+    atomic_int write_error;
+};
+
+static void wake_writer(DiskRecorderContext *recorder_context) {
+    recorder_context->wake_epoch += 1;
+    if (recorder_context->writer_idle.load())
+        futex_wake(reinterpret_cast<int*>(&recorder_context->wake_epoch), 1);
+}
+
+static void set_write_error(DiskRecorderContext *recorder_context, int err) {
+    int expected = 0;
+    recorder_context->write_error.compare_exchange_strong(expected, err);
+}
+
+// a wav header of float samples padded with a JUNK chunk to HEADER_SIZE.
+// files over 4 GiB get an RF64 header instead, whose ds64 chunk takes the
+// place of the first JUNK chunk, as EBU Tech 3306 has it.
+static int write_header(DiskRecorderTrack *track, long data_size) {
+    long riff_size = HEADER_SIZE - 8 + data_size;
+    bool rf64 = riff_size > (long)UINT32_MAX;
+    ByteBuffer header;
+    header.reserve(HEADER_SIZE);
+    header.append(rf64 ? "RF64" : "RIFF");
+    header.append_uint32le(rf64 ? UINT32_MAX : riff_size);
+    header.append("WAVE");
+
+    header.append(rf64 ? "ds64" : "JUNK");
+    header.append_uint32le(28);
+    long frame_count = data_size / track->bytes_per_frame;
+    long ds64_values[] = {riff_size, data_size, frame_count};
+    for (int i = 0; i < array_length(ds64_values); i += 1) {
+        long value = rf64 ? ds64_values[i] : 0;
+        header.append_uint32le(value & 0xffffffff);
+        header.append_uint32le((uint64_t)value >> 32);
+    }
+    // no table of other chunk sizes
+    header.append_uint32le(0);
+
+    header.append("fmt ");
+    header.append_uint32le(16);
+    // WAVE_FORMAT_IEEE_FLOAT
+    header.append_uint16le(3);
+    header.append_uint16le(track->channel_count);
+    header.append_uint32le(track->sample_rate);
+    header.append_uint32le(track->sample_rate * track->bytes_per_frame);
+    header.append_uint16le(track->bytes_per_frame);
+    header.append_uint16le(32);
+
+    header.append("JUNK");
+    header.append_uint32le(HEADER_SIZE - header.length() - 4 - 8);
+    while (header.length() < HEADER_SIZE - 8)
+        header.append_uint8(0);
+
+    header.append("data");
+    header.append_uint32le(rf64 ? UINT32_MAX : data_size);
+    assert(header.length() == HEADER_SIZE);
+
+    OsFileSlice slice = {header.raw(), header.length()};
+    return os_file_write_at(track->file, 0, &slice, 1);
+}
+
+// reserves PREALLOCATE_SECONDS of samples past those written
+static int reserve_space(DiskRecorderTrack *track) {
+    long bytes_per_second = (long)track->sample_rate * track->bytes_per_frame;
+    long ahead = ((long)(PREALLOCATE_SECONDS * bytes_per_second) / WRITE_CHUNK_SIZE + 1) * WRITE_CHUNK_SIZE;
+    long size = HEADER_SIZE + track->written_bytes + ahead;
+    int err;
+    if ((err = os_file_preallocate(track->file, size)))
+        return err;
+    track->allocated_size = size;
+    return 0;
+}
+
+// writes a chunk of track if its ring has one. returns whether it did.
+static bool write_chunk(DiskRecorderContext *recorder_context, DiskRecorderTrack *track) {
+    if (!track->file || track->failed)
+        return false;
+    int fill_count = spsc_ring_buffer_fill_count(&track->ring, track->ring.capacity);
+    float fill = fill_count / (float)track->ring.capacity;
+    if (fill > track->peak_fill.load(std::memory_order_relaxed))
+        track->peak_fill.store(fill, std::memory_order_relaxed);
+    if (fill_count < WRITE_CHUNK_SIZE)
+        return false;
+
+    int err = 0;
+    long offset = HEADER_SIZE + track->written_bytes;
+    if (offset + WRITE_CHUNK_SIZE > track->allocated_size)
+        err = reserve_space(track);
+    if (!err) {
+        OsFileSlice slice = {spsc_ring_buffer_read_ptr(&track->ring), WRITE_CHUNK_SIZE};
+        err = os_file_write_at(track->direct_file ? track->direct_file : track->file, offset, &slice, 1);
+    }
+    if (err) {
+        // the ring fills up, and the audio thread drops what it cannot fit
+        track->failed = true;
+        set_write_error(recorder_context, err);
+    } else {
+        spsc_ring_buffer_advance_read_ptr(&track->ring, WRITE_CHUNK_SIZE);
+        track->written_bytes += WRITE_CHUNK_SIZE;
+        track->written_frame_count.store(track->written_bytes / track->bytes_per_frame);
+    }
+    recorder_context->written_epoch += 1;
+    futex_wake(reinterpret_cast<int*>(&recorder_context->written_epoch), 1);
+    return true;
+}
+
+static void writer_thread_run(void *userdata) {
+    DiskRecorderContext *recorder_context = (DiskRecorderContext *)userdata;
+    while (!recorder_context->writer_exit.load()) {
+        int epoch = recorder_context->wake_epoch.load();
+        // a chunk of each track in turn, so that no track waits on the others
+        bool worked = false;
+        for (int i = 0; i < recorder_context->track_count; i += 1) {
+            if (write_chunk(recorder_context, recorder_context->tracks[i]))
+                worked = true;
+        }
+        if (worked)
+            continue;
+        recorder_context->writer_idle = true;
+        if (!recorder_context->writer_exit.load())
+            futex_wait(reinterpret_cast<int*>(&recorder_context->wake_epoch), epoch);
+        recorder_context->writer_idle = false;
+    }
+}
+
+static void stop_writer_thread(DiskRecorderContext *recorder_context) {
+    if (!recorder_context->writer_thread)
+        return;
+    recorder_context->writer_exit = true;
+    recorder_context->wake_epoch += 1;
+    futex_wake(reinterpret_cast<int*>(&recorder_context->wake_epoch), 1);
+    os_thread_destroy(recorder_context->writer_thread);
+    recorder_context->writer_thread = nullptr;
+}
+
+// writes what is left in the ring, which ends in less than a chunk, and
+// the header with the final length, and gives back the reserved space past it
+static void finish_track(DiskRecorderContext *recorder_context, DiskRecorderTrack *track) {
+    if (!track->file)
+        return;
+    while (write_chunk(recorder_context, track)) {}
+    if (track->direct_file) {
+        fclose(track->direct_file);
+        track->direct_file = nullptr;
+    }
+    int err;
+    if (!track->failed) {
+        int fill_count = spsc_ring_buffer_fill_count(&track->ring, track->ring.capacity);
+        OsFileSlice slice = {spsc_ring_buffer_read_ptr(&track->ring), fill_count};
+        if ((err = os_file_write_at(track->file, HEADER_SIZE + track->written_bytes, &slice, 1))) {
+            set_write_error(recorder_context, err);
+        } else {
+            spsc_ring_buffer_advance_read_ptr(&track->ring, fill_count);
+            track->written_bytes += fill_count;
+            track->written_frame_count.store(track->written_bytes / track->bytes_per_frame);
+        }
+    }
+    if ((err = write_header(track, track->written_bytes)))
+        set_write_error(recorder_context, err);
+    if ((err = os_file_truncate(track->file, HEADER_SIZE + track->written_bytes)))
+        set_write_error(recorder_context, err);
+    if ((err = os_file_data_sync(track->file)))
+        set_write_error(recorder_context, err);
+    fclose(track->file);
+    track->file = nullptr;
+    spsc_ring_buffer_deinit(&track->ring);
+    track->ring_inited = false;
+}
+
+static int open_track(DiskRecorderContext *recorder_context, DiskRecorderTrack *track,
+        struct GenesisPort *audio_in_port)
+{
+    track->channel_count = genesis_audio_port_channel_layout(audio_in_port)->channel_count;
+    track->sample_rate = genesis_audio_port_sample_rate(audio_in_port);
+    track->bytes_per_frame = track->channel_count * sizeof(float);
+    track->written_bytes = 0;
+    track->allocated_size = 0;
+    track->failed = false;
+
+    long ring_size = (long)(recorder_context->buffer_seconds * track->sample_rate) * track->bytes_per_frame;
+    int chunk_count = max(2L, (ring_size + WRITE_CHUNK_SIZE - 1) / WRITE_CHUNK_SIZE);
+    int err;
+    if ((err = spsc_ring_buffer_init(&track->ring, chunk_count * WRITE_CHUNK_SIZE)))
+        return err;
+    track->ring_inited = true;
+    assert(track->ring.capacity % WRITE_CHUNK_SIZE == 0);
+
+    if (!(track->file = fopen(track->path.raw(), "wb+")))
+        return GenesisErrorFileAccess;
+    if ((err = write_header(track, 0)))
+        return err;
+    if ((err = reserve_space(track)))
+        return err;
+    if (recorder_context->direct_io) {
+        // where the cache cannot be skipped the samples go through it
+        err = os_file_open_direct(track->path.raw(), &track->direct_file);
+        if (err && err != GenesisErrorUnimplemented)
+            return err;
+    }
+    return 0;
+}
+
+static void disk_recorder_deactivate(struct GenesisNode *node) {
+    DiskRecorderContext *recorder_context = (DiskRecorderContext *)node->userdata;
+    stop_writer_thread(recorder_context);
+    for (int i = 0; i < recorder_context->track_count; i += 1) {
+        DiskRecorderTrack *track = recorder_context->tracks[i];
+        finish_track(recorder_context, track);
+        // from a failed activate
+        if (track->ring_inited) {
+            spsc_ring_buffer_deinit(&track->ring);
+            track->ring_inited = false;
+        }
+    }
+}
+
+static int disk_recorder_activate(struct GenesisNode *node) {
+    DiskRecorderContext *recorder_context = (DiskRecorderContext *)node->userdata;
+    recorder_context->offline = node->descriptor->pipeline->offline;
+    recorder_context->write_error = 0;
+    bool any_file = false;
+    int err;
+    for (int i = 0; i < recorder_context->track_count; i += 1) {
+        DiskRecorderTrack *track = recorder_context->tracks[i];
+        struct GenesisPort *audio_in_port = genesis_node_port(node, i);
+        track->gap_frame_count = 0;
+        track->unannounced_bytes = 0;
+        track->recorded_frame_count = 0;
+        track->written_frame_count = 0;
+        track->dropped_frame_count = 0;
+        track->peak_fill = 0.0f;
+        track->recorded = false;
+        if (!audio_in_port->input_from)
+            continue;
+        if (track->path.length() > 0) {
+            track->recorded = true;
+            if ((err = open_track(recorder_context, track, audio_in_port)))
+                return err;
+            any_file = true;
+        }
+        // ask for audio frames
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, 0);
+    }
+
+    if (any_file) {
+        GenesisContext *context = node->descriptor->pipeline->context;
+        recorder_context->writer_exit = false;
+        recorder_context->writer_idle = false;
+        if ((err = os_thread_create_with_attributes(writer_thread_run, recorder_context,
+                        &context->background_thread_attributes, &recorder_context->writer_thread)))
+        {
+            return err;
+        }
+    }
+    return 0;
+}
+
+// copies frames into the ring of track. frames without room are dropped,
+// and once there is room again silence takes their place.
+static void record_frames(DiskRecorderContext *recorder_context, DiskRecorderTrack *track,
+        const char *frames, int frame_count)
+{
+    int bytes_per_frame = track->bytes_per_frame;
+    int written = 0;
+    while (written < frame_count) {
+        int wanted = min((long)track->ring.capacity,
+                (track->gap_frame_count + frame_count - written) * bytes_per_frame);
+        int epoch = recorder_context->written_epoch.load();
+        int free_frames = spsc_ring_buffer_free_count(&track->ring, wanted) / bytes_per_frame;
+        if (free_frames == 0) {
+            if (!recorder_context->offline || recorder_context->write_error.load())
+                break;
+            // nothing is lost by waiting for the disk
+            wake_writer(recorder_context);
+            futex_wait(reinterpret_cast<int*>(&recorder_context->written_epoch), epoch);
+            continue;
+        }
+        char *dest = spsc_ring_buffer_write_ptr(&track->ring);
+        int gap_count = min((long)free_frames, track->gap_frame_count);
+        memset(dest, 0, gap_count * bytes_per_frame);
+        track->gap_frame_count -= gap_count;
+        int count = min(free_frames - gap_count, frame_count - written);
+        memcpy(dest + gap_count * bytes_per_frame, frames + written * bytes_per_frame,
+                count * bytes_per_frame);
+        int byte_count = (gap_count + count) * bytes_per_frame;
+        spsc_ring_buffer_advance_write_ptr(&track->ring, byte_count);
+        track->unannounced_bytes += byte_count;
+        written += count;
+        if (!recorder_context->offline)
+            break;
+    }
+    track->recorded_frame_count.store(track->recorded_frame_count.load(std::memory_order_relaxed) + frame_count);
+    int dropped_count = frame_count - written;
+    if (dropped_count > 0) {
+        track->gap_frame_count += dropped_count;
+        track->dropped_frame_count += dropped_count;
+    }
+    if (track->unannounced_bytes >= WRITE_CHUNK_SIZE) {
+        track->unannounced_bytes = 0;
+        wake_writer(recorder_context);
+    }
+}
+
+static void disk_recorder_run(struct GenesisNode *node) {
+    DiskRecorderContext *recorder_context = (DiskRecorderContext *)node->userdata;
+    for (int i = 0; i < recorder_context->track_count; i += 1) {
+        DiskRecorderTrack *track = recorder_context->tracks[i];
+        struct GenesisPort *audio_in_port = genesis_node_port(node, i);
+        if (!audio_in_port->input_from)
+            continue;
+        int frame_count = genesis_audio_in_port_fill_count(audio_in_port);
+        if (track->file && frame_count > 0) {
+            const char *frames = (const char *)genesis_audio_in_port_read_ptr(audio_in_port);
+            record_frames(recorder_context, track, frames, frame_count);
+        }
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+    }
+}
+
+static void disk_recorder_destroy(struct GenesisNode *node) {
+    DiskRecorderContext *recorder_context = (DiskRecorderContext *)node->userdata;
+    if (recorder_context) {
+        if (recorder_context->tracks) {
+            disk_recorder_deactivate(node);
+            for (int i = 0; i < recorder_context->track_count; i += 1)
+                destroy(recorder_context->tracks[i], 1);
+            destroy(recorder_context->tracks, recorder_context->track_count);
+        }
+        destroy(recorder_context, 1);
+    }
+}
+
+static int disk_recorder_create(struct GenesisNode *node) {
+    DiskRecorderContext *recorder_context = create_zero<DiskRecorderContext>();
+    node->userdata = recorder_context;
+    if (!recorder_context) {
+        disk_recorder_destroy(node);
+        return GenesisErrorNoMem;
+    }
+    recorder_context->buffer_seconds = DEFAULT_BUFFER_SECONDS;
+    recorder_context->track_count = node->port_count;
+    if (!(recorder_context->tracks = allocate_zero<DiskRecorderTrack *>(recorder_context->track_count))) {
+        disk_recorder_destroy(node);
+        return GenesisErrorNoMem;
+    }
+    for (int i = 0; i < recorder_context->track_count; i += 1) {
+        if (!(recorder_context->tracks[i] = create_zero<DiskRecorderTrack>())) {
+            disk_recorder_destroy(node);
+            return GenesisErrorNoMem;
+        }
+    }
+    return 0;
+}
+
+int genesis_disk_recorder_create_node_descriptor(struct GenesisPipeline *pipeline,
+        int track_count, struct GenesisNodeDescriptor **out)
+{
+    *out = nullptr;
+    if (track_count < 1)
+        return GenesisErrorInvalidParam;
+
+    GenesisNodeDescriptor *node_descr = genesis_create_node_descriptor(pipeline, track_count,
+            "disk-recorder", "Records each input to a file.");
+    if (!node_descr)
+        return GenesisErrorNoMem;
+
+    genesis_node_descriptor_set_run_callback(node_descr, disk_recorder_run);
+    genesis_node_descriptor_set_create_callback(node_descr, disk_recorder_create);
+    genesis_node_descriptor_set_destroy_callback(node_descr, disk_recorder_destroy);
+    genesis_node_descriptor_set_activate_callback(node_descr, disk_recorder_activate);
+    node_descr->deactivate = disk_recorder_deactivate;
+
+    int target_sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+    for (int i = 0; i < track_count; i += 1) {
+        char name[32];
+        snprintf(name, sizeof(name), "track_%d", i);
+        struct GenesisPortDescriptor *audio_in_port = genesis_node_descriptor_create_port(
+                node_descr, i, GenesisPortTypeAudioIn, name);
+        if (!audio_in_port) {
+            genesis_node_descriptor_destroy(node_descr);
+            return GenesisErrorNoMem;
+        }
+        genesis_audio_port_descriptor_set_channel_layout(audio_in_port,
+            soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono), false, -1);
+        genesis_audio_port_descriptor_set_sample_rate(audio_in_port, target_sample_rate, false, -1);
+    }
+
+    *out = node_descr;
+    return 0;
+}
+
+static int check_stopped_recorder(struct GenesisNode *node) {
+    if (node->descriptor->run != disk_recorder_run)
+        return GenesisErrorInvalidParam;
+    if (genesis_pipeline_is_running(node->descriptor->pipeline))
+        return GenesisErrorInvalidState;
+    return 0;
+}
+
+int genesis_disk_recorder_node_set_track_path(struct GenesisNode *node, int track_index, const char *path) {
+    int err;
+    if ((err = check_stopped_recorder(node)))
+        return err;
+    DiskRecorderContext *recorder_context = (DiskRecorderContext *)node->userdata;
+    if (track_index < 0 || track_index >= recorder_context->track_count)
+        return GenesisErrorInvalidParam;
+    recorder_context->tracks[track_index]->path = path ? path : "";
+    return 0;
+}
+
+int genesis_disk_recorder_node_set_buffer_seconds(struct GenesisNode *node, double seconds) {
+    int err;
+    if ((err = check_stopped_recorder(node)))
+        return err;
+    if (!(seconds > 0.0))
+        return GenesisErrorInvalidParam;
+    DiskRecorderContext *recorder_context = (DiskRecorderContext *)node->userdata;
+    recorder_context->buffer_seconds = seconds;
+    return 0;
+}
+
+int genesis_disk_recorder_node_set_direct_io(struct GenesisNode *node, bool direct_io) {
+    int err;
+    if ((err = check_stopped_recorder(node)))
+        return err;
+    DiskRecorderContext *recorder_context = (DiskRecorderContext *)node->userdata;
+    recorder_context->direct_io = direct_io;
+    return 0;
+}
+
+int genesis_disk_recorder_node_get_stats(struct GenesisNode *node, struct GenesisDiskRecorderStats *out_stats) {
+    if (node->descriptor->run != disk_recorder_run)
+        return GenesisErrorInvalidParam;
+    DiskRecorderContext *recorder_context = (DiskRecorderContext *)node->userdata;
+    out_stats->recorded_frame_count = -1;
+    out_stats->written_frame_count = -1;
+    out_stats->dropped_frame_count = 0;
+    out_stats->peak_buffer_fill = 0.0;
+    for (int i = 0; i < recorder_context->track_count; i += 1) {
+        DiskRecorderTrack *track = recorder_context->tracks[i];
+        if (!track->recorded)
+            continue;
+        long recorded_frame_count = track->recorded_frame_count.load();
+        long written_frame_count = track->written_frame_count.load();
+        if (out_stats->recorded_frame_count == -1) {
+            out_stats->recorded_frame_count = recorded_frame_count;
+            out_stats->written_frame_count = written_frame_count;
+        }
+        out_stats->recorded_frame_count = min(out_stats->recorded_frame_count, recorded_frame_count);
+        out_stats->written_frame_count = min(out_stats->written_frame_count, written_frame_count);
+        out_stats->dropped_frame_count += track->dropped_frame_count.load();
+        out_stats->peak_buffer_fill = max(out_stats->peak_buffer_fill,
+                (double)track->peak_fill.load(std::memory_order_relaxed));
+    }
+    out_stats->recorded_frame_count = max(0L, out_stats->recorded_frame_count);
+    out_stats->written_frame_count = max(0L, out_stats->written_frame_count);
+    out_stats->write_error = recorder_context->write_error.load();
+    return 0;
+}
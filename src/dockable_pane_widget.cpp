@@ -60,7 +60,7 @@ void DockAreaWidget::draw(const glm::mat4 &projection) {
                         gui_window->fill_rect(insert_tab_arrow_color, projection * drop_lines[i]);
                     }
                     for (int i = 0; i < array_length(drop_area_labels); i += 1) {
-                        drop_area_labels[i]->draw(projection * drop_area_label_models[i], insert_tab_arrow_color);
+                        drop_area_labels[i]->draw(gui_window, projection * drop_area_label_models[i], insert_tab_arrow_color);
                     }
                     if (drop_area_icon) {
                         gui->draw_image_color(gui_window, drop_area_icon,
@@ -475,6 +475,7 @@ void DockAreaWidget::on_mouse_move(const MouseEvent *event) {
 }
 
 void DockAreaWidget::update_model() {
+    queue_redraw();
     switch (layout) {
         case DockAreaLayoutTabs:
             if (tab_widget) {
@@ -648,7 +649,7 @@ DockablePaneWidget::DockablePaneWidget(Widget *child, const String &title) :
 }
 
 void DockablePaneWidget::draw(const glm::mat4 &projection) {
-    child->draw(projection);
+    gui_window->draw_widget(child, projection);
 }
 
 void DockablePaneWidget::on_drag(const DragEvent *event) {
@@ -0,0 +1,1215 @@
+#include "dsp_kernels.hpp"
+#include "genesis.h"
+#include "util.hpp"
+
+#include <string.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#define GENESIS_DSP_X86
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define GENESIS_DSP_NEON
+#endif
+
+// C is the channel count, or 0 for the generic versions which take it at
+// runtime. lerp selects fir_frame_lerp.
+
+template<int C>
+static void deinterleave(int runtime_channel_count, float *dest, int dest_stride,
+        const float *src, int frame_count)
+{
+    const int channel_count = C ? C : runtime_channel_count;
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        for (int ch = 0; ch < channel_count; ch += 1)
+            dest[ch * dest_stride + frame] = src[frame * channel_count + ch];
+    }
+}
+
+template<int C>
+static void interleave(int runtime_channel_count, float *dest, const float *src, int src_stride,
+        int frame_count)
+{
+    const int channel_count = C ? C : runtime_channel_count;
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        for (int ch = 0; ch < channel_count; ch += 1)
+            dest[frame * channel_count + ch] = src[ch * src_stride + frame];
+    }
+}
+
+template<int C>
+static void interleave_add(int runtime_channel_count, float *dest, const float *const *srcs, int frame_count) {
+    const int channel_count = C ? C : runtime_channel_count;
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        for (int ch = 0; ch < channel_count; ch += 1)
+            dest[frame * channel_count + ch] += srcs[ch][frame];
+    }
+}
+
+// adds taps k through tap_count - 1 into sums
+template<int C, bool lerp>
+static inline void accumulate_taps(int channel_count, float *sums, const float *filter, float fraction,
+        const float *window, int window_stride, int k, int tap_count)
+{
+    for (; k < tap_count; k += 1) {
+        float coefficient = filter[k];
+        if (lerp)
+            coefficient += (filter[tap_count + k] - coefficient) * fraction;
+        for (int ch = 0; ch < channel_count; ch += 1)
+            sums[ch] += coefficient * window[ch * window_stride + k];
+    }
+}
+
+template<int C, bool lerp>
+static void fir_frame_scalar(int runtime_channel_count, float *out_frame, const float *filter, float fraction,
+        const float *window, int window_stride, int tap_count)
+{
+    const int channel_count = C ? C : runtime_channel_count;
+    for (int ch = 0; ch < channel_count; ch += 1)
+        out_frame[ch] = 0.0f;
+    accumulate_taps<C, lerp>(channel_count, out_frame, filter, fraction, window, window_stride, 0, tap_count);
+}
+
+#if defined(GENESIS_DSP_X86) && defined(__SSE2__)
+
+static inline float horizontal_sum_sse2(__m128 v) {
+    __m128 high = _mm_movehl_ps(v, v);
+    __m128 sum = _mm_add_ps(v, high);
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+template<int C, bool lerp>
+static void fir_frame_sse2(int runtime_channel_count, float *out_frame, const float *filter, float fraction,
+        const float *window, int window_stride, int tap_count)
+{
+    const int channel_count = C ? C : runtime_channel_count;
+    __m128 sums[C ? C : GENESIS_MAX_CHANNELS];
+    for (int ch = 0; ch < channel_count; ch += 1)
+        sums[ch] = _mm_setzero_ps();
+    const __m128 fraction_v = _mm_set1_ps(fraction);
+    int k = 0;
+    for (; k + 4 <= tap_count; k += 4) {
+        __m128 coefficients = _mm_loadu_ps(filter + k);
+        if (lerp) {
+            __m128 next = _mm_loadu_ps(filter + tap_count + k);
+            coefficients = _mm_add_ps(coefficients, _mm_mul_ps(_mm_sub_ps(next, coefficients), fraction_v));
+        }
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            __m128 samples = _mm_loadu_ps(window + ch * window_stride + k);
+            sums[ch] = _mm_add_ps(sums[ch], _mm_mul_ps(coefficients, samples));
+        }
+    }
+    for (int ch = 0; ch < channel_count; ch += 1)
+        out_frame[ch] = horizontal_sum_sse2(sums[ch]);
+    accumulate_taps<C, lerp>(channel_count, out_frame, filter, fraction, window, window_stride, k, tap_count);
+}
+
+static void deinterleave_stereo_sse2(int channel_count, float *dest, int dest_stride,
+        const float *src, int frame_count)
+{
+    float *left = dest;
+    float *right = dest + dest_stride;
+    int frame = 0;
+    for (; frame + 4 <= frame_count; frame += 4) {
+        __m128 a = _mm_loadu_ps(src + frame * 2);
+        __m128 b = _mm_loadu_ps(src + frame * 2 + 4);
+        _mm_storeu_ps(left + frame, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(right + frame, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+    for (; frame < frame_count; frame += 1) {
+        left[frame] = src[frame * 2];
+        right[frame] = src[frame * 2 + 1];
+    }
+}
+
+static void interleave_stereo_sse2(int channel_count, float *dest, const float *src, int src_stride,
+        int frame_count)
+{
+    const float *left = src;
+    const float *right = src + src_stride;
+    int frame = 0;
+    for (; frame + 4 <= frame_count; frame += 4) {
+        __m128 l = _mm_loadu_ps(left + frame);
+        __m128 r = _mm_loadu_ps(right + frame);
+        _mm_storeu_ps(dest + frame * 2, _mm_unpacklo_ps(l, r));
+        _mm_storeu_ps(dest + frame * 2 + 4, _mm_unpackhi_ps(l, r));
+    }
+    for (; frame < frame_count; frame += 1) {
+        dest[frame * 2] = left[frame];
+        dest[frame * 2 + 1] = right[frame];
+    }
+}
+
+static void interleave_add_stereo_sse2(int channel_count, float *dest, const float *const *srcs,
+        int frame_count)
+{
+    const float *left = srcs[0];
+    const float *right = srcs[1];
+    int frame = 0;
+    for (; frame + 4 <= frame_count; frame += 4) {
+        __m128 l = _mm_loadu_ps(left + frame);
+        __m128 r = _mm_loadu_ps(right + frame);
+        float *d = dest + frame * 2;
+        _mm_storeu_ps(d, _mm_add_ps(_mm_loadu_ps(d), _mm_unpacklo_ps(l, r)));
+        _mm_storeu_ps(d + 4, _mm_add_ps(_mm_loadu_ps(d + 4), _mm_unpackhi_ps(l, r)));
+    }
+    for (; frame < frame_count; frame += 1) {
+        dest[frame * 2] += left[frame];
+        dest[frame * 2 + 1] += right[frame];
+    }
+}
+
+#endif
+
+#if defined(GENESIS_DSP_X86)
+
+__attribute__((target("avx2")))
+static inline float horizontal_sum_avx2(__m256 v) {
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    __m128 high = _mm_movehl_ps(sum, sum);
+    sum = _mm_add_ps(sum, high);
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+template<int C, bool lerp>
+__attribute__((target("avx2")))
+static void fir_frame_avx2(int runtime_channel_count, float *out_frame, const float *filter, float fraction,
+        const float *window, int window_stride, int tap_count)
+{
+    const int channel_count = C ? C : runtime_channel_count;
+    __m256 sums[C ? C : GENESIS_MAX_CHANNELS];
+    for (int ch = 0; ch < channel_count; ch += 1)
+        sums[ch] = _mm256_setzero_ps();
+    const __m256 fraction_v = _mm256_set1_ps(fraction);
+    int k = 0;
+    for (; k + 8 <= tap_count; k += 8) {
+        __m256 coefficients = _mm256_loadu_ps(filter + k);
+        if (lerp) {
+            __m256 next = _mm256_loadu_ps(filter + tap_count + k);
+            coefficients = _mm256_add_ps(coefficients,
+                    _mm256_mul_ps(_mm256_sub_ps(next, coefficients), fraction_v));
+        }
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            __m256 samples = _mm256_loadu_ps(window + ch * window_stride + k);
+            sums[ch] = _mm256_add_ps(sums[ch], _mm256_mul_ps(coefficients, samples));
+        }
+    }
+    for (int ch = 0; ch < channel_count; ch += 1)
+        out_frame[ch] = horizontal_sum_avx2(sums[ch]);
+    accumulate_taps<C, lerp>(channel_count, out_frame, filter, fraction, window, window_stride, k, tap_count);
+}
+
+#endif
+
+#if defined(GENESIS_DSP_NEON)
+
+template<int C, bool lerp>
+static void fir_frame_neon(int runtime_channel_count, float *out_frame, const float *filter, float fraction,
+        const float *window, int window_stride, int tap_count)
+{
+    const int channel_count = C ? C : runtime_channel_count;
+    float32x4_t sums[C ? C : GENESIS_MAX_CHANNELS];
+    for (int ch = 0; ch < channel_count; ch += 1)
+        sums[ch] = vdupq_n_f32(0.0f);
+    int k = 0;
+    for (; k + 4 <= tap_count; k += 4) {
+        float32x4_t coefficients = vld1q_f32(filter + k);
+        if (lerp) {
+            float32x4_t next = vld1q_f32(filter + tap_count + k);
+            coefficients = vmlaq_n_f32(coefficients, vsubq_f32(next, coefficients), fraction);
+        }
+        for (int ch = 0; ch < channel_count; ch += 1)
+            sums[ch] = vmlaq_f32(sums[ch], coefficients, vld1q_f32(window + ch * window_stride + k));
+    }
+    for (int ch = 0; ch < channel_count; ch += 1)
+        out_frame[ch] = vaddvq_f32(sums[ch]);
+    accumulate_taps<C, lerp>(channel_count, out_frame, filter, fraction, window, window_stride, k, tap_count);
+}
+
+static void deinterleave_stereo_neon(int channel_count, float *dest, int dest_stride,
+        const float *src, int frame_count)
+{
+    float *left = dest;
+    float *right = dest + dest_stride;
+    int frame = 0;
+    for (; frame + 4 <= frame_count; frame += 4) {
+        float32x4x2_t s = vld2q_f32(src + frame * 2);
+        vst1q_f32(left + frame, s.val[0]);
+        vst1q_f32(right + frame, s.val[1]);
+    }
+    for (; frame < frame_count; frame += 1) {
+        left[frame] = src[frame * 2];
+        right[frame] = src[frame * 2 + 1];
+    }
+}
+
+static void interleave_stereo_neon(int channel_count, float *dest, const float *src, int src_stride,
+        int frame_count)
+{
+    const float *left = src;
+    const float *right = src + src_stride;
+    int frame = 0;
+    for (; frame + 4 <= frame_count; frame += 4) {
+        float32x4x2_t d;
+        d.val[0] = vld1q_f32(left + frame);
+        d.val[1] = vld1q_f32(right + frame);
+        vst2q_f32(dest + frame * 2, d);
+    }
+    for (; frame < frame_count; frame += 1) {
+        dest[frame * 2] = left[frame];
+        dest[frame * 2 + 1] = right[frame];
+    }
+}
+
+static void interleave_add_stereo_neon(int channel_count, float *dest, const float *const *srcs,
+        int frame_count)
+{
+    const float *left = srcs[0];
+    const float *right = srcs[1];
+    int frame = 0;
+    for (; frame + 4 <= frame_count; frame += 4) {
+        float32x4x2_t d = vld2q_f32(dest + frame * 2);
+        d.val[0] = vaddq_f32(d.val[0], vld1q_f32(left + frame));
+        d.val[1] = vaddq_f32(d.val[1], vld1q_f32(right + frame));
+        vst2q_f32(dest + frame * 2, d);
+    }
+    for (; frame < frame_count; frame += 1) {
+        dest[frame * 2] += left[frame];
+        dest[frame * 2 + 1] += right[frame];
+    }
+}
+
+#endif
+
+typedef void (*FirFrameLerpFn)(int channel_count, float *out_frame, const float *filter, float fraction,
+        const float *window, int window_stride, int tap_count);
+
+// fir_frame is fir_frame_lerp with the interpolation compiled out. the
+// fraction argument is ignored.
+template<FirFrameLerpFn fn>
+static void fir_frame_adapter(int channel_count, float *out_frame, const float *filter,
+        const float *window, int window_stride, int tap_count)
+{
+    fn(channel_count, out_frame, filter, 0.0f, window, window_stride, tap_count);
+}
+
+enum DspSimd {
+    DspSimdNone,
+    DspSimdSse2,
+    DspSimdAvx2,
+    DspSimdNeon,
+};
+
+// channel counts with specializations, then the generic version
+static const int specialized_channel_counts[] = {1, 2, 6, 8, 0};
+static DspChannelKernels channel_kernels[array_length(specialized_channel_counts)];
+
+static float (*dot_product_fn)(const float *a, const float *b, int count);
+
+template<int C>
+static void set_channel_kernels(DspChannelKernels *kernels, DspSimd simd) {
+    kernels->channel_count = C;
+    kernels->deinterleave = deinterleave<C>;
+    kernels->interleave = interleave<C>;
+    kernels->interleave_add = interleave_add<C>;
+#if defined(GENESIS_DSP_X86) && defined(__SSE2__)
+    if (C == 2 && simd != DspSimdNone) {
+        kernels->deinterleave = deinterleave_stereo_sse2;
+        kernels->interleave = interleave_stereo_sse2;
+        kernels->interleave_add = interleave_add_stereo_sse2;
+    }
+#elif defined(GENESIS_DSP_NEON)
+    if (C == 2 && simd == DspSimdNeon) {
+        kernels->deinterleave = deinterleave_stereo_neon;
+        kernels->interleave = interleave_stereo_neon;
+        kernels->interleave_add = interleave_add_stereo_neon;
+    }
+#endif
+    switch (simd) {
+#if defined(GENESIS_DSP_X86) && defined(__SSE2__)
+    case DspSimdSse2:
+        kernels->fir_frame = fir_frame_adapter<fir_frame_sse2<C, false>>;
+        kernels->fir_frame_lerp = fir_frame_sse2<C, true>;
+        return;
+#endif
+#if defined(GENESIS_DSP_X86)
+    case DspSimdAvx2:
+        kernels->fir_frame = fir_frame_adapter<fir_frame_avx2<C, false>>;
+        kernels->fir_frame_lerp = fir_frame_avx2<C, true>;
+        return;
+#endif
+#if defined(GENESIS_DSP_NEON)
+    case DspSimdNeon:
+        kernels->fir_frame = fir_frame_adapter<fir_frame_neon<C, false>>;
+        kernels->fir_frame_lerp = fir_frame_neon<C, true>;
+        return;
+#endif
+    default:
+        kernels->fir_frame = fir_frame_adapter<fir_frame_scalar<C, false>>;
+        kernels->fir_frame_lerp = fir_frame_scalar<C, true>;
+        return;
+    }
+}
+
+template<FirFrameLerpFn fn>
+static float dot_product_adapter(const float *a, const float *b, int count) {
+    float sum;
+    fn(1, &sum, a, 0.0f, b, 0, count);
+    return sum;
+}
+
+static DspSimd best_simd(void) {
+#if defined(GENESIS_DSP_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return DspSimdAvx2;
+#if defined(__SSE2__)
+    return DspSimdSse2;
+#endif
+#elif defined(GENESIS_DSP_NEON)
+    return DspSimdNeon;
+#endif
+    return DspSimdNone;
+}
+
+void dsp_kernels_init(void) {
+    DspSimd simd = best_simd();
+    set_channel_kernels<1>(&channel_kernels[0], simd);
+    set_channel_kernels<2>(&channel_kernels[1], simd);
+    set_channel_kernels<6>(&channel_kernels[2], simd);
+    set_channel_kernels<8>(&channel_kernels[3], simd);
+    set_channel_kernels<0>(&channel_kernels[4], simd);
+    static_assert(array_length(specialized_channel_counts) == 5, "");
+
+    switch (simd) {
+#if defined(GENESIS_DSP_X86) && defined(__SSE2__)
+    case DspSimdSse2:
+        dot_product_fn = dot_product_adapter<fir_frame_sse2<1, false>>;
+        break;
+#endif
+#if defined(GENESIS_DSP_X86)
+    case DspSimdAvx2:
+        dot_product_fn = dot_product_adapter<fir_frame_avx2<1, false>>;
+        break;
+#endif
+#if defined(GENESIS_DSP_NEON)
+    case DspSimdNeon:
+        dot_product_fn = dot_product_adapter<fir_frame_neon<1, false>>;
+        break;
+#endif
+    default:
+        dot_product_fn = dot_product_adapter<fir_frame_scalar<1, false>>;
+        break;
+    }
+}
+
+const DspChannelKernels *dsp_channel_kernels(int channel_count) {
+    assert(channel_count > 0);
+    assert(channel_count <= GENESIS_MAX_CHANNELS);
+    assert(dot_product_fn);
+    for (int i = 0; i < array_length(specialized_channel_counts) - 1; i += 1) {
+        if (specialized_channel_counts[i] == channel_count)
+            return &channel_kernels[i];
+    }
+    return &channel_kernels[array_length(specialized_channel_counts) - 1];
+}
+
+float dsp_dot_product(const float *a, const float *b, int count) {
+    return dot_product_fn(a, b, count);
+}
+
+void dsp_mix_add(float *dest, const float *src, int sample_count) {
+    for (int i = 0; i < sample_count; i += 1)
+        dest[i] += src[i];
+}
+
+void dsp_mix_add_gain(float *dest, const float *src, int channel_count, float *gains,
+        const float *gain_steps, int frame_count)
+{
+    int frame = 0;
+#if (defined(GENESIS_DSP_X86) && defined(__SSE2__)) || defined(GENESIS_DSP_NEON)
+    // a vector of four samples holds whole frames when the channel count
+    // divides four, so the gains form a repeating pattern
+    if (4 % channel_count == 0) {
+        int frames_per_vector = 4 / channel_count;
+        float gain_pattern[4];
+        float step_pattern[4];
+        for (int i = 0; i < 4; i += 1) {
+            int ch = i % channel_count;
+            gain_pattern[i] = gains[ch] + gain_steps[ch] * (i / channel_count);
+            step_pattern[i] = gain_steps[ch] * frames_per_vector;
+        }
+        int sample_count = (frame_count / frames_per_vector) * 4;
+        int i = 0;
+#if defined(GENESIS_DSP_X86)
+        __m128 gain_v = _mm_loadu_ps(gain_pattern);
+        const __m128 step_v = _mm_loadu_ps(step_pattern);
+        for (; i < sample_count; i += 4) {
+            _mm_storeu_ps(dest + i, _mm_add_ps(_mm_loadu_ps(dest + i), _mm_mul_ps(_mm_loadu_ps(src + i), gain_v)));
+            gain_v = _mm_add_ps(gain_v, step_v);
+        }
+#else
+        float32x4_t gain_v = vld1q_f32(gain_pattern);
+        const float32x4_t step_v = vld1q_f32(step_pattern);
+        for (; i < sample_count; i += 4) {
+            vst1q_f32(dest + i, vmlaq_f32(vld1q_f32(dest + i), vld1q_f32(src + i), gain_v));
+            gain_v = vaddq_f32(gain_v, step_v);
+        }
+#endif
+        frame = sample_count / channel_count;
+        for (int ch = 0; ch < channel_count; ch += 1)
+            gains[ch] += gain_steps[ch] * frame;
+    }
+#endif
+    for (; frame < frame_count; frame += 1) {
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            int i = frame * channel_count + ch;
+            dest[i] += src[i] * gains[ch];
+            gains[ch] += gain_steps[ch];
+        }
+    }
+}
+
+void dsp_fractional_delay(float *out, const float *in, float *line, const float *near, const float *far,
+        float fraction, int sample_count, float wet, float feedback)
+{
+    int i = 0;
+#if defined(GENESIS_DSP_X86) && defined(__SSE2__)
+    const __m128 fraction_v = _mm_set1_ps(fraction);
+    const __m128 wet_v = _mm_set1_ps(wet);
+    const __m128 feedback_v = _mm_set1_ps(feedback);
+    for (; i + 4 <= sample_count; i += 4) {
+        __m128 in_samples = _mm_loadu_ps(in + i);
+        __m128 near_samples = _mm_loadu_ps(near + i);
+        __m128 delayed = _mm_add_ps(near_samples,
+                _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(far + i), near_samples), fraction_v));
+        _mm_storeu_ps(out + i, _mm_add_ps(in_samples, _mm_mul_ps(wet_v, delayed)));
+        _mm_storeu_ps(line + i, _mm_add_ps(in_samples, _mm_mul_ps(feedback_v, delayed)));
+    }
+#elif defined(GENESIS_DSP_NEON)
+    const float32x4_t fraction_v = vdupq_n_f32(fraction);
+    const float32x4_t wet_v = vdupq_n_f32(wet);
+    const float32x4_t feedback_v = vdupq_n_f32(feedback);
+    for (; i + 4 <= sample_count; i += 4) {
+        float32x4_t in_samples = vld1q_f32(in + i);
+        float32x4_t near_samples = vld1q_f32(near + i);
+        float32x4_t delayed = vmlaq_f32(near_samples, vsubq_f32(vld1q_f32(far + i), near_samples), fraction_v);
+        vst1q_f32(out + i, vmlaq_f32(in_samples, wet_v, delayed));
+        vst1q_f32(line + i, vmlaq_f32(in_samples, feedback_v, delayed));
+    }
+#endif
+    for (; i < sample_count; i += 1) {
+        float in_sample = in[i];
+        float delayed = near[i] + (far[i] - near[i]) * fraction;
+        out[i] = in_sample + wet * delayed;
+        line[i] = in_sample + feedback * delayed;
+    }
+}
+
+void dsp_multiply(float *dest, const float *a, const float *b, int count) {
+    int i = 0;
+#if defined(GENESIS_DSP_X86) && defined(__SSE2__)
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_ps(dest + i, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+#elif defined(GENESIS_DSP_NEON)
+    for (; i + 4 <= count; i += 4)
+        vst1q_f32(dest + i, vmulq_f32(vld1q_f32(a + i), vld1q_f32(b + i)));
+#endif
+    for (; i < count; i += 1)
+        dest[i] = a[i] * b[i];
+}
+
+void dsp_multiply_add(float *dest, const float *a, const float *b, int count) {
+    int i = 0;
+#if defined(GENESIS_DSP_X86) && defined(__SSE2__)
+    for (; i + 4 <= count; i += 4) {
+        __m128 product = _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+        _mm_storeu_ps(dest + i, _mm_add_ps(_mm_loadu_ps(dest + i), product));
+    }
+#elif defined(GENESIS_DSP_NEON)
+    for (; i + 4 <= count; i += 4)
+        vst1q_f32(dest + i, vmlaq_f32(vld1q_f32(dest + i), vld1q_f32(a + i), vld1q_f32(b + i)));
+#endif
+    for (; i < count; i += 1)
+        dest[i] += a[i] * b[i];
+}
+
+void dsp_power_spectrum(float *power, const float *re, const float *im, int count) {
+    int i = 0;
+#if defined(GENESIS_DSP_X86) && defined(__SSE2__)
+    for (; i + 4 <= count; i += 4) {
+        __m128 re_v = _mm_loadu_ps(re + i);
+        __m128 im_v = _mm_loadu_ps(im + i);
+        _mm_storeu_ps(power + i, _mm_add_ps(_mm_mul_ps(re_v, re_v), _mm_mul_ps(im_v, im_v)));
+    }
+#elif defined(GENESIS_DSP_NEON)
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t re_v = vld1q_f32(re + i);
+        float32x4_t im_v = vld1q_f32(im + i);
+        vst1q_f32(power + i, vmlaq_f32(vmulq_f32(re_v, re_v), im_v, im_v));
+    }
+#endif
+    for (; i < count; i += 1)
+        power[i] = re[i] * re[i] + im[i] * im[i];
+}
+
+void dsp_complex_rotate(float *re, float *im, float rotation_re, float rotation_im, int count) {
+    int i = 0;
+#if defined(GENESIS_DSP_X86) && defined(__SSE2__)
+    const __m128 rotation_re_v = _mm_set1_ps(rotation_re);
+    const __m128 rotation_im_v = _mm_set1_ps(rotation_im);
+    for (; i + 4 <= count; i += 4) {
+        __m128 re_v = _mm_loadu_ps(re + i);
+        __m128 im_v = _mm_loadu_ps(im + i);
+        _mm_storeu_ps(re + i, _mm_sub_ps(_mm_mul_ps(re_v, rotation_re_v), _mm_mul_ps(im_v, rotation_im_v)));
+        _mm_storeu_ps(im + i, _mm_add_ps(_mm_mul_ps(re_v, rotation_im_v), _mm_mul_ps(im_v, rotation_re_v)));
+    }
+#elif defined(GENESIS_DSP_NEON)
+    const float32x4_t rotation_re_v = vdupq_n_f32(rotation_re);
+    const float32x4_t rotation_im_v = vdupq_n_f32(rotation_im);
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t re_v = vld1q_f32(re + i);
+        float32x4_t im_v = vld1q_f32(im + i);
+        vst1q_f32(re + i, vmlsq_f32(vmulq_f32(re_v, rotation_re_v), im_v, rotation_im_v));
+        vst1q_f32(im + i, vmlaq_f32(vmulq_f32(re_v, rotation_im_v), im_v, rotation_re_v));
+    }
+#endif
+    for (; i < count; i += 1) {
+        float re_i = re[i];
+        re[i] = re_i * rotation_re - im[i] * rotation_im;
+        im[i] = re_i * rotation_im + im[i] * rotation_re;
+    }
+}
+
+static inline float wavetable_sample(const float *table, int table_bits, uint32_t phase) {
+    uint32_t index = phase >> (32 - table_bits);
+    float fraction = ((phase << table_bits) >> 8) * (1.0f / 16777216.0f);
+    float a = table[index];
+    return a + (table[index + 1] - a) * fraction;
+}
+
+void dsp_wavetable_add(float *dest, const float *table, int table_bits, uint32_t *phase,
+        uint32_t increment, float gain, float gain_step, int count)
+{
+    uint32_t p = *phase;
+    int i = 0;
+#if defined(GENESIS_DSP_X86) && defined(__SSE2__)
+    // four phases at once; the table reads stay scalar since SSE2 has no
+    // gather
+    if (count >= 4) {
+        __m128i phases = _mm_set_epi32(p + 3 * increment, p + 2 * increment, p + increment, p);
+        const __m128i phase_step = _mm_set1_epi32(4 * increment);
+        __m128 gains = _mm_set_ps(gain + 3.0f * gain_step, gain + 2.0f * gain_step, gain + gain_step, gain);
+        const __m128 gain_step4 = _mm_set1_ps(4.0f * gain_step);
+        const __m128 fraction_scale = _mm_set1_ps(1.0f / 16777216.0f);
+        const __m128i index_shift = _mm_cvtsi32_si128(32 - table_bits);
+        const __m128i fraction_shift = _mm_cvtsi32_si128(table_bits);
+        for (; i + 4 <= count; i += 4) {
+            alignas(16) uint32_t indexes[4];
+            _mm_store_si128((__m128i *)indexes, _mm_srl_epi32(phases, index_shift));
+            __m128i fraction_bits = _mm_srli_epi32(_mm_sll_epi32(phases, fraction_shift), 8);
+            __m128 fractions = _mm_mul_ps(_mm_cvtepi32_ps(fraction_bits), fraction_scale);
+            __m128 a = _mm_set_ps(table[indexes[3]], table[indexes[2]], table[indexes[1]], table[indexes[0]]);
+            __m128 b = _mm_set_ps(table[indexes[3] + 1], table[indexes[2] + 1],
+                    table[indexes[1] + 1], table[indexes[0] + 1]);
+            __m128 samples = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), fractions));
+            _mm_storeu_ps(dest + i, _mm_add_ps(_mm_loadu_ps(dest + i), _mm_mul_ps(samples, gains)));
+            phases = _mm_add_epi32(phases, phase_step);
+            gains = _mm_add_ps(gains, gain_step4);
+        }
+        p += (uint32_t)i * increment;
+        gain += i * gain_step;
+    }
+#endif
+    for (; i < count; i += 1) {
+        dest[i] += wavetable_sample(table, table_bits, p) * gain;
+        gain += gain_step;
+        p += increment;
+    }
+    *phase = p;
+}
+
+void dsp_peak_sum_squares(const float *src, int channel_count, int frame_count, float *peaks,
+        float *sum_squares)
+{
+    int frame = 0;
+#if (defined(GENESIS_DSP_X86) && defined(__SSE2__)) || defined(GENESIS_DSP_NEON)
+    // as in dsp_mix_add_gain, lane i of every vector holds channel
+    // i % channel_count
+    if (4 % channel_count == 0) {
+        int sample_count = (frame_count * channel_count / 4) * 4;
+        float lane_peaks[4];
+        float lane_sums[4];
+        int i = 0;
+#if defined(GENESIS_DSP_X86)
+        const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        __m128 peak_v = _mm_setzero_ps();
+        __m128 sum_v = _mm_setzero_ps();
+        for (; i < sample_count; i += 4) {
+            __m128 samples = _mm_loadu_ps(src + i);
+            peak_v = _mm_max_ps(peak_v, _mm_and_ps(samples, abs_mask));
+            sum_v = _mm_add_ps(sum_v, _mm_mul_ps(samples, samples));
+        }
+        _mm_storeu_ps(lane_peaks, peak_v);
+        _mm_storeu_ps(lane_sums, sum_v);
+#else
+        float32x4_t peak_v = vdupq_n_f32(0.0f);
+        float32x4_t sum_v = vdupq_n_f32(0.0f);
+        for (; i < sample_count; i += 4) {
+            float32x4_t samples = vld1q_f32(src + i);
+            peak_v = vmaxq_f32(peak_v, vabsq_f32(samples));
+            sum_v = vmlaq_f32(sum_v, samples, samples);
+        }
+        vst1q_f32(lane_peaks, peak_v);
+        vst1q_f32(lane_sums, sum_v);
+#endif
+        for (int lane = 0; lane < 4; lane += 1) {
+            int ch = lane % channel_count;
+            peaks[ch] = max(peaks[ch], lane_peaks[lane]);
+            sum_squares[ch] += lane_sums[lane];
+        }
+        frame = sample_count / channel_count;
+    }
+#endif
+    for (; frame < frame_count; frame += 1) {
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            float sample = src[frame * channel_count + ch];
+            peaks[ch] = max(peaks[ch], fabsf(sample));
+            sum_squares[ch] += sample * sample;
+        }
+    }
+}
+
+void dsp_int16_to_float(float *dest, const int16_t *src, float offset, float scale, int count) {
+    int i = 0;
+#if defined(GENESIS_DSP_X86) && defined(__SSE2__)
+    const __m128 offset_v = _mm_set1_ps(offset);
+    const __m128 scale_v = _mm_set1_ps(scale);
+    for (; i + 8 <= count; i += 8) {
+        __m128i samples = _mm_loadu_si128((const __m128i *)(src + i));
+        // each 16 bit sample into the top of a 32 bit lane, then shifted
+        // back down to sign extend it
+        __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16);
+        __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16);
+        _mm_storeu_ps(dest + i, _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(low), offset_v), scale_v));
+        _mm_storeu_ps(dest + i + 4, _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(high), offset_v), scale_v));
+    }
+#elif defined(GENESIS_DSP_NEON)
+    const float32x4_t offset_v = vdupq_n_f32(offset);
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t samples = vld1q_s16(src + i);
+        float32x4_t low = vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples)));
+        float32x4_t high = vcvtq_f32_s32(vmovl_s16(vget_high_s16(samples)));
+        vst1q_f32(dest + i, vmulq_n_f32(vaddq_f32(low, offset_v), scale));
+        vst1q_f32(dest + i + 4, vmulq_n_f32(vaddq_f32(high, offset_v), scale));
+    }
+#endif
+    for (; i < count; i += 1)
+        dest[i] = (src[i] + offset) * scale;
+}
+
+static inline int32_t load_int24(const uint8_t *src) {
+    return (int32_t)((uint32_t)src[0] << 8 | (uint32_t)src[1] << 16 | (uint32_t)src[2] << 24) >> 8;
+}
+
+void dsp_int24_to_float(float *dest, const uint8_t *src, float offset, float scale, int count) {
+    int i = 0;
+#if defined(GENESIS_DSP_X86) && defined(__SSE2__)
+    // four bytes at each sample, the top one belonging to the next sample,
+    // so the last sample is left to the scalar loop
+    const __m128 offset_v = _mm_set1_ps(offset);
+    const __m128 scale_v = _mm_set1_ps(scale);
+    for (; i + 4 < count; i += 4) {
+        int32_t words[4];
+        memcpy(&words[0], src + i * 3, 4);
+        memcpy(&words[1], src + i * 3 + 3, 4);
+        memcpy(&words[2], src + i * 3 + 6, 4);
+        memcpy(&words[3], src + i * 3 + 9, 4);
+        __m128i samples = _mm_loadu_si128((const __m128i *)words);
+        samples = _mm_srai_epi32(_mm_slli_epi32(samples, 8), 8);
+        _mm_storeu_ps(dest + i, _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(samples), offset_v), scale_v));
+    }
+#endif
+    for (; i < count; i += 1)
+        dest[i] = (load_int24(src + i * 3) + offset) * scale;
+}
+
+// integers min..max to -1.0..1.0 the way (x - min) / half_range - 1.0 does,
+// which is (x + offset) * scale. int32 goes through double, since a float
+// has too few bits to keep 24 bit samples in the top of 32 bit ones exact.
+static const float import_uint8_offset = -127.5f;
+static const float import_uint8_scale = (float)(1.0 / 127.5);
+static const float import_int16_offset = 0.5f;
+static const float import_int16_scale = (float)(1.0 / 32767.5);
+static const double import_int32_scale = 1.0 / 2147483647.5;
+
+#if (defined(GENESIS_DSP_X86) && defined(__SSE2__)) || defined(GENESIS_DSP_NEON)
+#define GENESIS_DSP_PCM_SIMD
+#if defined(GENESIS_DSP_X86)
+typedef __m128 ImportVector;
+
+static inline __m128 import_offset_scale(__m128i samples, float offset, float scale) {
+    return _mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(samples), _mm_set1_ps(offset)), _mm_set1_ps(scale));
+}
+
+static inline __m128 import_int32_vector(__m128i samples) {
+    const __m128d half = _mm_set1_pd(0.5);
+    const __m128d scale = _mm_set1_pd(import_int32_scale);
+    __m128d low = _mm_mul_pd(_mm_add_pd(_mm_cvtepi32_pd(samples), half), scale);
+    __m128d high = _mm_mul_pd(_mm_add_pd(_mm_cvtepi32_pd(_mm_srli_si128(samples, 8)), half), scale);
+    return _mm_movelh_ps(_mm_cvtpd_ps(low), _mm_cvtpd_ps(high));
+}
+
+static inline void import_store(float *dest, __m128 v) {
+    _mm_storeu_ps(dest, v);
+}
+#else
+typedef float32x4_t ImportVector;
+
+static inline float32x4_t import_offset_scale(float32x4_t samples, float offset, float scale) {
+    return vmulq_n_f32(vaddq_f32(samples, vdupq_n_f32(offset)), scale);
+}
+
+static inline float64x2_t import_int32_half(int32x2_t samples) {
+    float64x2_t v = vcvtq_f64_s64(vmovl_s32(samples));
+    return vmulq_n_f64(vaddq_f64(v, vdupq_n_f64(0.5)), import_int32_scale);
+}
+
+static inline float32x4_t import_int32_vector(int32x4_t samples) {
+    return vcombine_f32(vcvt_f32_f64(import_int32_half(vget_low_s32(samples))),
+            vcvt_f32_f64(import_int32_half(vget_high_s32(samples))));
+}
+
+static inline void import_store(float *dest, float32x4_t v) {
+    vst1q_f32(dest, v);
+}
+#endif
+#endif
+
+// convert gives one sample and convert8 the eight starting at src, as two
+// vectors of four. both round the same way, so the vector loops and their
+// scalar tails agree bit for bit.
+struct ImportUint8 {
+    typedef uint8_t Sample;
+    static inline float convert(uint8_t x) {
+        return (x + import_uint8_offset) * import_uint8_scale;
+    }
+#if defined(GENESIS_DSP_PCM_SIMD)
+    static inline void convert8(const uint8_t *src, ImportVector *low, ImportVector *high) {
+#if defined(GENESIS_DSP_X86)
+        const __m128i zero = _mm_setzero_si128();
+        __m128i words = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)src), zero);
+        *low = import_offset_scale(_mm_unpacklo_epi16(words, zero), import_uint8_offset, import_uint8_scale);
+        *high = import_offset_scale(_mm_unpackhi_epi16(words, zero), import_uint8_offset, import_uint8_scale);
+#else
+        uint16x8_t words = vmovl_u8(vld1_u8(src));
+        *low = import_offset_scale(vcvtq_f32_u32(vmovl_u16(vget_low_u16(words))),
+                import_uint8_offset, import_uint8_scale);
+        *high = import_offset_scale(vcvtq_f32_u32(vmovl_u16(vget_high_u16(words))),
+                import_uint8_offset, import_uint8_scale);
+#endif
+    }
+#endif
+};
+
+struct ImportInt16 {
+    typedef int16_t Sample;
+    static inline float convert(int16_t x) {
+        return (x + import_int16_offset) * import_int16_scale;
+    }
+#if defined(GENESIS_DSP_PCM_SIMD)
+    static inline void convert8(const int16_t *src, ImportVector *low, ImportVector *high) {
+#if defined(GENESIS_DSP_X86)
+        __m128i samples = _mm_loadu_si128((const __m128i *)src);
+        __m128i low_words = _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16);
+        __m128i high_words = _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16);
+        *low = import_offset_scale(low_words, import_int16_offset, import_int16_scale);
+        *high = import_offset_scale(high_words, import_int16_offset, import_int16_scale);
+#else
+        int16x8_t samples = vld1q_s16(src);
+        *low = import_offset_scale(vcvtq_f32_s32(vmovl_s16(vget_low_s16(samples))),
+                import_int16_offset, import_int16_scale);
+        *high = import_offset_scale(vcvtq_f32_s32(vmovl_s16(vget_high_s16(samples))),
+                import_int16_offset, import_int16_scale);
+#endif
+    }
+#endif
+};
+
+struct ImportInt32 {
+    typedef int32_t Sample;
+    static inline float convert(int32_t x) {
+        return (float)((x + 0.5) * import_int32_scale);
+    }
+#if defined(GENESIS_DSP_PCM_SIMD)
+    static inline void convert8(const int32_t *src, ImportVector *low, ImportVector *high) {
+#if defined(GENESIS_DSP_X86)
+        *low = import_int32_vector(_mm_loadu_si128((const __m128i *)src));
+        *high = import_int32_vector(_mm_loadu_si128((const __m128i *)(src + 4)));
+#else
+        *low = import_int32_vector(vld1q_s32(src));
+        *high = import_int32_vector(vld1q_s32(src + 4));
+#endif
+    }
+#endif
+};
+
+struct ImportFloat {
+    typedef float Sample;
+    static inline float convert(float x) {
+        return x;
+    }
+#if defined(GENESIS_DSP_PCM_SIMD)
+    static inline void convert8(const float *src, ImportVector *low, ImportVector *high) {
+#if defined(GENESIS_DSP_X86)
+        *low = _mm_loadu_ps(src);
+        *high = _mm_loadu_ps(src + 4);
+#else
+        *low = vld1q_f32(src);
+        *high = vld1q_f32(src + 4);
+#endif
+    }
+#endif
+};
+
+struct ImportDouble {
+    typedef double Sample;
+    static inline float convert(double x) {
+        return (float)x;
+    }
+#if defined(GENESIS_DSP_PCM_SIMD)
+    static inline void convert8(const double *src, ImportVector *low, ImportVector *high) {
+#if defined(GENESIS_DSP_X86)
+        *low = _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(src)), _mm_cvtpd_ps(_mm_loadu_pd(src + 2)));
+        *high = _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(src + 4)), _mm_cvtpd_ps(_mm_loadu_pd(src + 6)));
+#else
+        *low = vcombine_f32(vcvt_f32_f64(vld1q_f64(src)), vcvt_f32_f64(vld1q_f64(src + 2)));
+        *high = vcombine_f32(vcvt_f32_f64(vld1q_f64(src + 4)), vcvt_f32_f64(vld1q_f64(src + 6)));
+#endif
+    }
+#endif
+};
+
+template<typename Import>
+static void import_span(float *dest, const typename Import::Sample *src, int count) {
+    int i = 0;
+#if defined(GENESIS_DSP_PCM_SIMD)
+    for (; i + 8 <= count; i += 8) {
+        ImportVector low, high;
+        Import::convert8(src + i, &low, &high);
+        import_store(dest + i, low);
+        import_store(dest + i + 4, high);
+    }
+#endif
+    for (; i < count; i += 1)
+        dest[i] = Import::convert(src[i]);
+}
+
+template<typename Import>
+static void import_stereo(float *left, float *right, const typename Import::Sample *src, int frame_count) {
+    int frame = 0;
+#if defined(GENESIS_DSP_PCM_SIMD)
+    for (; frame + 4 <= frame_count; frame += 4) {
+        ImportVector low, high;
+        Import::convert8(src + frame * 2, &low, &high);
+#if defined(GENESIS_DSP_X86)
+        import_store(left + frame, _mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0)));
+        import_store(right + frame, _mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1)));
+#else
+        float32x4x2_t channels = vuzpq_f32(low, high);
+        import_store(left + frame, channels.val[0]);
+        import_store(right + frame, channels.val[1]);
+#endif
+    }
+#endif
+    for (; frame < frame_count; frame += 1) {
+        left[frame] = Import::convert(src[frame * 2]);
+        right[frame] = Import::convert(src[frame * 2 + 1]);
+    }
+}
+
+// other channel counts are converted a chunk at a time onto the stack and
+// scattered from there
+static const int import_chunk_samples = 1024;
+
+template<typename Import>
+static void import_frames(float *const *dests, const typename Import::Sample *src, int channel_count,
+        int frame_count)
+{
+    if (channel_count == 1) {
+        import_span<Import>(dests[0], src, frame_count);
+        return;
+    }
+    if (channel_count == 2) {
+        import_stereo<Import>(dests[0], dests[1], src, frame_count);
+        return;
+    }
+    float chunk[import_chunk_samples];
+    int chunk_frames = import_chunk_samples / channel_count;
+    for (int frame = 0; frame < frame_count; frame += chunk_frames) {
+        int amt = min(chunk_frames, frame_count - frame);
+        import_span<Import>(chunk, src + (long)frame * channel_count, amt * channel_count);
+        for (int i = 0; i < amt; i += 1) {
+            for (int ch = 0; ch < channel_count; ch += 1)
+                dests[ch][frame + i] = chunk[i * channel_count + ch];
+        }
+    }
+}
+
+void dsp_import_uint8(float *const *dests, const uint8_t *src, int channel_count, int frame_count) {
+    import_frames<ImportUint8>(dests, src, channel_count, frame_count);
+}
+
+void dsp_import_int16(float *const *dests, const int16_t *src, int channel_count, int frame_count) {
+    import_frames<ImportInt16>(dests, src, channel_count, frame_count);
+}
+
+void dsp_import_int32(float *const *dests, const int32_t *src, int channel_count, int frame_count) {
+    import_frames<ImportInt32>(dests, src, channel_count, frame_count);
+}
+
+void dsp_import_float(float *const *dests, const float *src, int channel_count, int frame_count) {
+    import_frames<ImportFloat>(dests, src, channel_count, frame_count);
+}
+
+void dsp_import_double(float *const *dests, const double *src, int channel_count, int frame_count) {
+    import_frames<ImportDouble>(dests, src, channel_count, frame_count);
+}
+
+void dsp_dither_init(DspDither *dither, uint32_t seed) {
+    // xorshift gets stuck at zero
+    for (int i = 0; i < 4; i += 1) {
+        seed = seed * 1664525 + 1013904223;
+        dither->state[i] = seed ? seed : 1;
+    }
+}
+
+static inline uint32_t xorshift32(uint32_t x) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+// the difference of the two halves of a random word, so that the noise is
+// triangular between -1 and 1
+static inline float dither_noise(uint32_t *state) {
+    uint32_t x = xorshift32(*state);
+    *state = x;
+    return ((int32_t)(x & 0xffff) - (int32_t)(x >> 16)) * (1.0f / 65536.0f);
+}
+
+// integers min..max from -1.0..1.0 as sample * scale + offset
+struct ExportInteger {
+    float scale;
+    float offset;
+    float min;
+    float max;
+};
+
+static const ExportInteger export_uint8_format = {127.5f, 127.5f, 0.0f, (float)UINT8_MAX};
+static const ExportInteger export_int16_format = {32767.0f, 0.0f, (float)INT16_MIN, (float)INT16_MAX};
+static const ExportInteger export_int24_format = {8388607.0f, 0.0f, -8388608.0f, 8388607.0f};
+
+static inline int32_t export_quantize(const ExportInteger &format, float sample, DspDither *dither) {
+    float value = sample * format.scale + format.offset;
+    if (!dither)
+        return (int32_t)clamp(format.min, value, format.max);
+    value = clamp(format.min, value + dither_noise(&dither->state[0]), format.max);
+    return (int32_t)lrintf(value);
+}
+
+#if defined(GENESIS_DSP_PCM_SIMD)
+#if defined(GENESIS_DSP_X86)
+typedef __m128i ExportWords;
+
+static inline __m128 dither_noise_vector(__m128i *state) {
+    __m128i x = *state;
+    x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+    x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+    *state = x;
+    __m128i diff = _mm_sub_epi32(_mm_and_si128(x, _mm_set1_epi32(0xffff)), _mm_srli_epi32(x, 16));
+    return _mm_mul_ps(_mm_cvtepi32_ps(diff), _mm_set1_ps(1.0f / 65536.0f));
+}
+
+// four samples from src, quantized; state is null without dither
+static inline __m128i export_quantize_vector(const ExportInteger &format, const float *src, __m128i *state) {
+    __m128 value = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(src), _mm_set1_ps(format.scale)),
+            _mm_set1_ps(format.offset));
+    if (!state)
+        return _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(value, _mm_set1_ps(format.min)), _mm_set1_ps(format.max)));
+    value = _mm_add_ps(value, dither_noise_vector(state));
+    return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(value, _mm_set1_ps(format.min)), _mm_set1_ps(format.max)));
+}
+#else
+typedef int32x4_t ExportWords;
+
+static inline float32x4_t dither_noise_vector(uint32x4_t *state) {
+    uint32x4_t x = *state;
+    x = veorq_u32(x, vshlq_n_u32(x, 13));
+    x = veorq_u32(x, vshrq_n_u32(x, 17));
+    x = veorq_u32(x, vshlq_n_u32(x, 5));
+    *state = x;
+    int32x4_t diff = vsubq_s32(vreinterpretq_s32_u32(vandq_u32(x, vdupq_n_u32(0xffff))),
+            vreinterpretq_s32_u32(vshrq_n_u32(x, 16)));
+    return vmulq_n_f32(vcvtq_f32_s32(diff), 1.0f / 65536.0f);
+}
+
+static inline int32x4_t export_quantize_vector(const ExportInteger &format, const float *src, uint32x4_t *state) {
+    float32x4_t value = vaddq_f32(vmulq_n_f32(vld1q_f32(src), format.scale), vdupq_n_f32(format.offset));
+    if (!state)
+        return vcvtq_s32_f32(vminq_f32(vmaxq_f32(value, vdupq_n_f32(format.min)), vdupq_n_f32(format.max)));
+    value = vaddq_f32(value, dither_noise_vector(state));
+    return vcvtnq_s32_f32(vminq_f32(vmaxq_f32(value, vdupq_n_f32(format.min)), vdupq_n_f32(format.max)));
+}
+#endif
+
+#endif
+
+// store8 puts eight quantized samples, in two vectors of four, at dest
+struct ExportUint8 {
+    typedef uint8_t Sample;
+#if defined(GENESIS_DSP_PCM_SIMD)
+    static inline void store8(uint8_t *dest, ExportWords low, ExportWords high) {
+#if defined(GENESIS_DSP_X86)
+        __m128i words = _mm_packs_epi32(low, high);
+        _mm_storel_epi64((__m128i *)dest, _mm_packus_epi16(words, words));
+#else
+        vst1_u8(dest, vqmovun_s16(vcombine_s16(vmovn_s32(low), vmovn_s32(high))));
+#endif
+    }
+#endif
+};
+
+struct ExportInt16 {
+    typedef int16_t Sample;
+#if defined(GENESIS_DSP_PCM_SIMD)
+    static inline void store8(int16_t *dest, ExportWords low, ExportWords high) {
+#if defined(GENESIS_DSP_X86)
+        _mm_storeu_si128((__m128i *)dest, _mm_packs_epi32(low, high));
+#else
+        vst1q_s16(dest, vcombine_s16(vmovn_s32(low), vmovn_s32(high)));
+#endif
+    }
+#endif
+};
+
+struct ExportInt24 {
+    typedef int32_t Sample;
+#if defined(GENESIS_DSP_PCM_SIMD)
+    static inline void store8(int32_t *dest, ExportWords low, ExportWords high) {
+#if defined(GENESIS_DSP_X86)
+        _mm_storeu_si128((__m128i *)dest, _mm_slli_epi32(low, 8));
+        _mm_storeu_si128((__m128i *)(dest + 4), _mm_slli_epi32(high, 8));
+#else
+        vst1q_s32(dest, vshlq_n_s32(low, 8));
+        vst1q_s32(dest + 4, vshlq_n_s32(high, 8));
+#endif
+    }
+#endif
+};
+
+// the scalar tail takes the noise of the first lane, which is left where
+// the vector loop stopped
+template<typename Export, int shift>
+static void export_integer(const ExportInteger &format, typename Export::Sample *dest, const float *src,
+        int count, DspDither *dither)
+{
+    int i = 0;
+#if defined(GENESIS_DSP_PCM_SIMD)
+#if defined(GENESIS_DSP_X86)
+    __m128i state_v;
+    __m128i *state = nullptr;
+    if (dither) {
+        state_v = _mm_loadu_si128((const __m128i *)dither->state);
+        state = &state_v;
+    }
+#else
+    uint32x4_t state_v;
+    uint32x4_t *state = nullptr;
+    if (dither) {
+        state_v = vld1q_u32(dither->state);
+        state = &state_v;
+    }
+#endif
+    for (; i + 8 <= count; i += 8) {
+        ExportWords low = export_quantize_vector(format, src + i, state);
+        ExportWords high = export_quantize_vector(format, src + i + 4, state);
+        Export::store8(dest + i, low, high);
+    }
+    if (dither) {
+#if defined(GENESIS_DSP_X86)
+        _mm_storeu_si128((__m128i *)dither->state, state_v);
+#else
+        vst1q_u32(dither->state, state_v);
+#endif
+    }
+#endif
+    for (; i < count; i += 1)
+        dest[i] = (typename Export::Sample)((uint32_t)export_quantize(format, src[i], dither) << shift);
+}
+
+void dsp_export_uint8(uint8_t *dest, const float *src, int count, DspDither *dither) {
+    export_integer<ExportUint8, 0>(export_uint8_format, dest, src, count, dither);
+}
+
+void dsp_export_int16(int16_t *dest, const float *src, int count, DspDither *dither) {
+    export_integer<ExportInt16, 0>(export_int16_format, dest, src, count, dither);
+}
+
+void dsp_export_int24(int32_t *dest, const float *src, int count, DspDither *dither) {
+    export_integer<ExportInt24, 8>(export_int24_format, dest, src, count, dither);
+}
+
+void dsp_export_int32(int32_t *dest, const float *src, int count) {
+    int i = 0;
+#if defined(GENESIS_DSP_X86) && defined(__SSE2__)
+    const __m128d scale = _mm_set1_pd(2147483647.0);
+    const __m128d min = _mm_set1_pd((double)INT32_MIN);
+    const __m128d max = _mm_set1_pd((double)INT32_MAX);
+    for (; i + 4 <= count; i += 4) {
+        __m128 samples = _mm_loadu_ps(src + i);
+        __m128d low = _mm_mul_pd(_mm_cvtps_pd(samples), scale);
+        __m128d high = _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(samples, samples)), scale);
+        low = _mm_min_pd(_mm_max_pd(low, min), max);
+        high = _mm_min_pd(_mm_max_pd(high, min), max);
+        _mm_storeu_si128((__m128i *)(dest + i),
+                _mm_unpacklo_epi64(_mm_cvttpd_epi32(low), _mm_cvttpd_epi32(high)));
+    }
+#elif defined(GENESIS_DSP_NEON)
+    const float64x2_t min = vdupq_n_f64((double)INT32_MIN);
+    const float64x2_t max = vdupq_n_f64((double)INT32_MAX);
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t samples = vld1q_f32(src + i);
+        float64x2_t low = vmulq_n_f64(vcvt_f64_f32(vget_low_f32(samples)), 2147483647.0);
+        float64x2_t high = vmulq_n_f64(vcvt_high_f64_f32(samples), 2147483647.0);
+        low = vminq_f64(vmaxq_f64(low, min), max);
+        high = vminq_f64(vmaxq_f64(high, min), max);
+        vst1q_s32(dest + i, vcombine_s32(vmovn_s64(vcvtq_s64_f64(low)), vmovn_s64(vcvtq_s64_f64(high))));
+    }
+#endif
+    for (; i < count; i += 1)
+        dest[i] = (int32_t)clamp((double)INT32_MIN, src[i] * 2147483647.0, (double)INT32_MAX);
+}
+
+void dsp_export_double(double *dest, const float *src, int count) {
+    int i = 0;
+#if defined(GENESIS_DSP_X86) && defined(__SSE2__)
+    for (; i + 4 <= count; i += 4) {
+        __m128 samples = _mm_loadu_ps(src + i);
+        _mm_storeu_pd(dest + i, _mm_cvtps_pd(samples));
+        _mm_storeu_pd(dest + i + 2, _mm_cvtps_pd(_mm_movehl_ps(samples, samples)));
+    }
+#elif defined(GENESIS_DSP_NEON)
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t samples = vld1q_f32(src + i);
+        vst1q_f64(dest + i, vcvt_f64_f32(vget_low_f32(samples)));
+        vst1q_f64(dest + i + 2, vcvt_high_f64_f32(samples));
+    }
+#endif
+    for (; i < count; i += 1)
+        dest[i] = src[i];
+}
@@ -0,0 +1,108 @@
+#ifndef GENESIS_DSP_KERNELS_HPP
+#define GENESIS_DSP_KERNELS_HPP
+
+#include <stdint.h>
+
+// inner loops for the built in nodes. kernels which stride across channels
+// are specialized for mono, stereo, 5.1 and 7.1 so that the channel loops
+// have constant trip counts; other channel counts use a generic version.
+// nodes look up their kernels when a port connects and the layout is known.
+
+struct DspChannelKernels {
+    int channel_count;
+    // interleaved src into one buffer per channel, channel ch at
+    // dest + ch * dest_stride
+    void (*deinterleave)(int channel_count, float *dest, int dest_stride,
+            const float *src, int frame_count);
+    // the other way: one buffer per channel, channel ch at
+    // src + ch * src_stride, into interleaved dest
+    void (*interleave)(int channel_count, float *dest, const float *src, int src_stride,
+            int frame_count);
+    // adds one buffer per channel, srcs[ch] for channel ch, into interleaved
+    // dest in a single pass
+    void (*interleave_add)(int channel_count, float *dest, const float *const *srcs, int frame_count);
+    // one interleaved output frame from one FIR window per channel, channel ch
+    // at window + ch * window_stride
+    void (*fir_frame)(int channel_count, float *out_frame, const float *filter,
+            const float *window, int window_stride, int tap_count);
+    // same, linearly interpolating between filter and the tap_count
+    // coefficients after it
+    void (*fir_frame_lerp)(int channel_count, float *out_frame, const float *filter, float fraction,
+            const float *window, int window_stride, int tap_count);
+};
+
+// chooses the fastest kernels the cpu supports. not thread safe; called
+// once from genesis_context_create.
+void dsp_kernels_init(void);
+
+const DspChannelKernels *dsp_channel_kernels(int channel_count);
+
+// these work on contiguous spans of samples, so they don't care about the
+// channel count
+float dsp_dot_product(const float *a, const float *b, int count);
+// dest[i] += src[i]
+void dsp_mix_add(float *dest, const float *src, int sample_count);
+// interleaved: dest[frame * channel_count + ch] += src[...] * gain, where
+// gain starts at gains[ch] and steps by gain_steps[ch] each frame. gains is
+// left where the next frame would be.
+void dsp_mix_add_gain(float *dest, const float *src, int channel_count, float *gains,
+        const float *gain_steps, int frame_count);
+// a feedback delay read between two samples of the delay line:
+// delayed = near[i] + (far[i] - near[i]) * fraction;
+// out[i] = in[i] + wet * delayed; line[i] = in[i] + feedback * delayed.
+// out may be in. line must not overlap near or far.
+void dsp_fractional_delay(float *out, const float *in, float *line, const float *near, const float *far,
+        float fraction, int sample_count, float wet, float feedback);
+// dest[i] = a[i] * b[i]. dest may be a or b.
+void dsp_multiply(float *dest, const float *a, const float *b, int count);
+// dest[i] += a[i] * b[i], which is the overlap-add of a windowed frame
+void dsp_multiply_add(float *dest, const float *a, const float *b, int count);
+// power[i] = re[i] * re[i] + im[i] * im[i]
+void dsp_power_spectrum(float *power, const float *re, const float *im, int count);
+// multiplies count complex bins by rotation_re + i rotation_im in place
+void dsp_complex_rotate(float *re, float *im, float rotation_re, float rotation_im, int count);
+// adds count samples of a wavetable oscillator to dest. table holds one
+// period in 1 << table_bits samples plus a copy of the first, and is read
+// with linear interpolation at the top bits of phase, which wraps at 2^32.
+// phase steps by increment and gain by gain_step each sample. *phase is
+// left where the next sample would be.
+void dsp_wavetable_add(float *dest, const float *table, int table_bits, uint32_t *phase,
+        uint32_t increment, float gain, float gain_step, int count);
+// for the interleaved frames of src: peaks[ch] becomes the larger of itself
+// and the largest magnitude on channel ch, and the squares of the samples on
+// channel ch are added to sum_squares[ch]
+void dsp_peak_sum_squares(const float *src, int channel_count, int frame_count, float *peaks,
+        float *sum_squares);
+// dest[i] = (src[i] + offset) * scale, for the samples of a compact audio
+// file. int24 is packed little endian, three bytes a sample.
+void dsp_int16_to_float(float *dest, const int16_t *src, float offset, float scale, int count);
+void dsp_int24_to_float(float *dest, const uint8_t *src, float offset, float scale, int count);
+
+// decoded pcm from an interleaved buffer of channel_count channels into one
+// span per channel, dests[ch] for channel ch, in a single pass. planar pcm
+// goes one plane at a time with a channel_count of 1. integers min..max
+// become -1.0..1.0.
+void dsp_import_uint8(float *const *dests, const uint8_t *src, int channel_count, int frame_count);
+void dsp_import_int16(float *const *dests, const int16_t *src, int channel_count, int frame_count);
+void dsp_import_int32(float *const *dests, const int32_t *src, int channel_count, int frame_count);
+void dsp_import_float(float *const *dests, const float *src, int channel_count, int frame_count);
+void dsp_import_double(float *const *dests, const double *src, int channel_count, int frame_count);
+
+// the noise of dithered export, one generator per vector lane
+struct DspDither {
+    uint32_t state[4];
+};
+
+void dsp_dither_init(DspDither *dither, uint32_t seed);
+
+// contiguous float samples out to the pcm an encoder takes. integers are
+// clipped to min..max and truncated toward zero, or with dither, get
+// triangular noise one step wide and are rounded to the nearest.
+void dsp_export_uint8(uint8_t *dest, const float *src, int count, DspDither *dither);
+void dsp_export_int16(int16_t *dest, const float *src, int count, DspDither *dither);
+// 24 bit samples in the top of 32 bit ones, which is how ffmpeg takes them
+void dsp_export_int24(int32_t *dest, const float *src, int count, DspDither *dither);
+void dsp_export_int32(int32_t *dest, const float *src, int count);
+void dsp_export_double(double *dest, const float *src, int count);
+
+#endif
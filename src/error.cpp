@@ -34,6 +34,9 @@ const char *genesis_strerror(int error) {
         case GenesisErrorIncompatibleDevice: return "incompatible device";
         case GenesisErrorDeviceNotFound: return "device not found";
         case GenesisErrorDecodingString: return "decoding string";
+        case GenesisErrorMaxConnectionsExceeded: return "too many connections";
+        case GenesisErrorQueueFull: return "queue full";
+        case GenesisErrorConflict: return "conflicting edit";
     }
     panic("invalid error enum value");
 }
@@ -19,6 +19,8 @@ enum Event {
     EventProjectAudioAssetsChanged,
     EventProjectAudioClipsChanged,
     EventProjectAudioClipSegmentsChanged,
+    EventProjectAudioAssetLoaded,
+    EventProjectAudioAssetLoadProgress,
     EventProjectMixerLinesChanged,
     EventProjectEffectsChanged,
     EventBufferUnderrun,
@@ -34,22 +36,32 @@ enum Event {
     EventRenderJobsUpdated,
     EventAudioGraphPlayHeadChanged,
     EventAudioGraphPlayingChanged,
+    EventInputHandled,
 };
 
 struct EventHandler {
     Event event;
     void (*fn)(Event, void *);
     void *userdata;
+    // deferred handlers are called from flush_deferred rather than trigger
+    bool deferred;
+    bool pending;
 };
 
 class EventDispatcher {
 public:
+    EventDispatcher() : any_pending(false) {}
+
     void attach_handler(Event event, void (*fn)(Event, void *), void *userdata) {
-        ok_or_panic(event_handlers.add_one());
-        EventHandler *event_handler = &event_handlers.last();
-        event_handler->event = event;
-        event_handler->fn = fn;
-        event_handler->userdata = userdata;
+        add_handler(event, fn, userdata, false);
+    }
+
+    // for handlers that rebuild a whole model. however many times the event
+    // triggers between two calls to flush_deferred, the handler is called
+    // once, and once in total for all the events it is attached to with the
+    // same fn and userdata.
+    void attach_deferred_handler(Event event, void (*fn)(Event, void *), void *userdata) {
+        add_handler(event, fn, userdata, true);
     }
 
     void detach_handler(Event event, void (*fn)(Event, void *)) {
@@ -63,6 +75,20 @@ public:
         panic("event handler not attached");
     }
 
+    // for a handler that is attached more than once with different userdata
+    void detach_handler(Event event, void (*fn)(Event, void *), void *userdata) {
+        for (int i = 0; i < event_handlers.length(); i += 1) {
+            EventHandler *event_handler = &event_handlers.at(i);
+            if (event_handler->event == event && event_handler->fn == fn &&
+                event_handler->userdata == userdata)
+            {
+                event_handlers.swap_remove(i);
+                return;
+            }
+        }
+        panic("event handler not attached");
+    }
+
     void trigger(Event event) {
         // we use the stack here because we want to call this function in the main loop
         // need the memory on the stack because calling a handler might destroy this class
@@ -72,10 +98,15 @@ public:
 
         for (int i = 0; i < event_handlers.length(); i += 1) {
             EventHandler *handler = &event_handlers.at(i);
-            if (handler->event == event) {
-                handlers[handler_index++] = handler;
-                assert(handler_index <= MAX_HANDLERS);
+            if (handler->event != event)
+                continue;
+            if (handler->deferred) {
+                handler->pending = true;
+                any_pending = true;
+                continue;
             }
+            handlers[handler_index++] = handler;
+            assert(handler_index <= MAX_HANDLERS);
         }
         // we use a deferred list like this in case any event handlers
         // destroy this EventDispatcher
@@ -85,7 +116,53 @@ public:
         }
     }
 
+    // call once per EventFlushEvents tick
+    void flush_deferred() {
+        if (!any_pending)
+            return;
+        any_pending = false;
+
+        // copies, since a handler may detach handlers or destroy this class
+        static const int MAX_HANDLERS = 256;
+        EventHandler handlers[MAX_HANDLERS];
+        int handler_index = 0;
+
+        for (int i = 0; i < event_handlers.length(); i += 1) {
+            EventHandler *handler = &event_handlers.at(i);
+            if (!handler->pending)
+                continue;
+            handler->pending = false;
+            bool duplicate = false;
+            for (int j = 0; j < handler_index; j += 1) {
+                if (handlers[j].fn == handler->fn && handlers[j].userdata == handler->userdata) {
+                    duplicate = true;
+                    break;
+                }
+            }
+            if (duplicate)
+                continue;
+            assert(handler_index < MAX_HANDLERS);
+            handlers[handler_index++] = *handler;
+        }
+        for (int i = 0; i < handler_index; i += 1) {
+            EventHandler *handler = &handlers[i];
+            handler->fn(handler->event, handler->userdata);
+        }
+    }
+
     List<EventHandler> event_handlers;
+    bool any_pending;
+
+private:
+    void add_handler(Event event, void (*fn)(Event, void *), void *userdata, bool deferred) {
+        ok_or_panic(event_handlers.add_one());
+        EventHandler *event_handler = &event_handlers.last();
+        event_handler->event = event;
+        event_handler->fn = fn;
+        event_handler->userdata = userdata;
+        event_handler->deferred = deferred;
+        event_handler->pending = false;
+    }
 
 };
 
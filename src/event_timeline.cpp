@@ -0,0 +1,197 @@
+#include "event_timeline.hpp"
+#include "genesis.h"
+
+#include <math.h>
+
+static EventTimelineVersion *create_version(int chunk_count) {
+    EventTimelineVersion *version = create_zero<EventTimelineVersion>();
+    if (!version)
+        return nullptr;
+    version->chunks = allocate_zero<EventTimelineChunk *>(max(1, chunk_count));
+    version->reach = allocate_zero<double>(max(1, chunk_count));
+    if (!version->chunks || !version->reach) {
+        destroy(version->chunks, max(1, chunk_count));
+        destroy(version->reach, max(1, chunk_count));
+        destroy(version, 1);
+        return nullptr;
+    }
+    version->chunk_count = chunk_count;
+    return version;
+}
+
+static void release_chunk(EventTimelineChunk *chunk) {
+    chunk->ref_count -= 1;
+    if (chunk->ref_count <= 0)
+        destroy(chunk, 1);
+}
+
+static void release_version(EventTimelineVersion *version) {
+    for (int i = 0; i < version->chunk_count; i += 1)
+        release_chunk(version->chunks[i]);
+    destroy(version->chunks, max(1, version->chunk_count));
+    destroy(version->reach, max(1, version->chunk_count));
+    destroy(version, 1);
+}
+
+int event_timeline_init(EventTimeline *timeline) {
+    EventTimelineVersion *version = create_version(0);
+    if (!version)
+        return GenesisErrorNoMem;
+    timeline->current.store(version);
+    timeline->pinned.store(nullptr);
+    return 0;
+}
+
+void event_timeline_deinit(EventTimeline *timeline) {
+    event_timeline_collect(timeline, true);
+    EventTimelineVersion *version = timeline->current.exchange(nullptr);
+    if (version)
+        release_version(version);
+}
+
+// new chunks for a run of events that matched no published chunk, split
+// evenly so that none of them starts out nearly empty
+static int append_fresh_chunks(List<EventTimelineChunk *> &chunks, const EventTimelineEvent *events,
+        int event_count)
+{
+    int chunk_count = (event_count + EVENT_TIMELINE_CHUNK_CAPACITY - 1) / EVENT_TIMELINE_CHUNK_CAPACITY;
+    for (int i = 0; i < chunk_count; i += 1) {
+        int start = (int)((long)event_count * i / chunk_count);
+        int end = (int)((long)event_count * (i + 1) / chunk_count);
+        EventTimelineChunk *chunk = create_zero<EventTimelineChunk>();
+        if (!chunk)
+            return GenesisErrorNoMem;
+        if (chunks.append(chunk)) {
+            destroy(chunk, 1);
+            return GenesisErrorNoMem;
+        }
+        chunk->event_count = end - start;
+        memcpy(chunk->events, events + start, chunk->event_count * sizeof(EventTimelineEvent));
+    }
+    return 0;
+}
+
+int event_timeline_publish(EventTimeline *timeline, const EventTimelineEvent *events, int event_count) {
+    EventTimelineVersion *old_version = timeline->current.load();
+    List<EventTimelineChunk *> chunks;
+    int kept_count = 0;
+    bool any_fresh = false;
+    // each published chunk stands for the events from its first start up
+    // to the first start of the next one. where those are all the same, the
+    // chunk is kept; the events of the regions in between get new chunks.
+    int run_start = 0;
+    int event_index = 0;
+    int err = 0;
+    for (int chunk_i = 0; chunk_i < old_version->chunk_count && !err; chunk_i += 1) {
+        EventTimelineChunk *chunk = old_version->chunks[chunk_i];
+        double region_end = (chunk_i + 1 < old_version->chunk_count) ?
+            old_version->chunks[chunk_i + 1]->events[0].midi.start : INFINITY;
+        int region_start = event_index;
+        while (event_index < event_count && events[event_index].midi.start < region_end)
+            event_index += 1;
+        int region_count = event_index - region_start;
+        if (region_count != chunk->event_count ||
+            memcmp(events + region_start, chunk->events, region_count * sizeof(EventTimelineEvent)))
+        {
+            continue;
+        }
+        if (region_start > run_start) {
+            any_fresh = true;
+            err = append_fresh_chunks(chunks, events + run_start, region_start - run_start);
+        }
+        if (!err && !(err = chunks.append(chunk)))
+            kept_count += 1;
+        run_start = event_index;
+    }
+    if (!err && run_start < event_count) {
+        any_fresh = true;
+        err = append_fresh_chunks(chunks, events + run_start, event_count - run_start);
+    }
+
+    EventTimelineVersion *version = nullptr;
+    if (!err && (any_fresh || kept_count != old_version->chunk_count)) {
+        if (!(version = create_version(chunks.length())) || timeline->retired.add_one()) {
+            err = GenesisErrorNoMem;
+            if (version)
+                release_version(version);
+            version = nullptr;
+        }
+    }
+    if (!version) {
+        // the fresh chunks are the ones no version holds yet
+        for (int i = 0; i < chunks.length(); i += 1) {
+            if (chunks.at(i)->ref_count == 0)
+                destroy(chunks.at(i), 1);
+        }
+        return err;
+    }
+
+    for (int i = 0; i < chunks.length(); i += 1) {
+        EventTimelineChunk *chunk = chunks.at(i);
+        chunk->ref_count += 1;
+        version->chunks[i] = chunk;
+        double reach = (i > 0) ? version->reach[i - 1] : -INFINITY;
+        for (int event_i = 0; event_i < chunk->event_count; event_i += 1)
+            reach = max(reach, chunk->events[event_i].end);
+        version->reach[i] = reach;
+    }
+    timeline->current.store(version);
+    timeline->retired.last() = old_version;
+    event_timeline_collect(timeline, false);
+    return 0;
+}
+
+void event_timeline_collect(EventTimeline *timeline, bool reader_stopped) {
+    EventTimelineVersion *pinned = nullptr;
+    if (reader_stopped)
+        timeline->pinned.store(nullptr);
+    else
+        pinned = timeline->pinned.load();
+    for (int i = timeline->retired.length() - 1; i >= 0; i -= 1) {
+        EventTimelineVersion *version = timeline->retired.at(i);
+        if (version == pinned)
+            continue;
+        timeline->retired.swap_remove(i);
+        release_version(version);
+    }
+}
+
+// the writer only frees a version it finds unpinned after replacing it, so
+// if the version is still current once it is pinned, the pin was in time
+EventTimelineVersion *event_timeline_read(EventTimeline *timeline) {
+    EventTimelineVersion *version = timeline->current.load();
+    for (;;) {
+        timeline->pinned.store(version);
+        EventTimelineVersion *latest = timeline->current.load();
+        if (latest == version)
+            return version;
+        version = latest;
+    }
+}
+
+int event_timeline_find_chunk(const EventTimelineVersion *version, double pos) {
+    int low = 0;
+    int high = version->chunk_count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        const EventTimelineChunk *chunk = version->chunks[mid];
+        if (chunk->events[chunk->event_count - 1].midi.start < pos)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+int event_timeline_find_overlap(const EventTimelineVersion *version, double pos) {
+    int low = 0;
+    int high = version->chunk_count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (version->reach[mid] <= pos)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
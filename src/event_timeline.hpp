@@ -0,0 +1,70 @@
+#ifndef EVENT_TIMELINE_HPP
+#define EVENT_TIMELINE_HPP
+
+#include "midi_hardware.hpp"
+#include "atomics.hpp"
+#include "list.hpp"
+
+// events sorted by start, which one thread publishes and one other thread
+// reads without either waiting on the other. each published version is an
+// array of pointers to chunks of events that never change once published.
+// a new version shares every chunk of the one before whose events are
+// still the same, so an edit only allocates the chunks it touches. the
+// reader pins the version it reads, and the writer frees the versions
+// it replaced once the reader has pinned a later one. each event also has
+// an end, and each version keeps how far the events up to each chunk reach,
+// so that the events still going on at a position are found without a scan.
+
+static const int EVENT_TIMELINE_CHUNK_CAPACITY = 64;
+
+struct EventTimelineEvent {
+    GenesisMidiEvent midi;
+    // in whole notes. the same as midi.start for events without a length.
+    double end;
+};
+
+struct EventTimelineChunk {
+    int event_count;
+    // writer only. how many versions hold the chunk.
+    int ref_count;
+    EventTimelineEvent events[EVENT_TIMELINE_CHUNK_CAPACITY];
+};
+
+struct EventTimelineVersion {
+    int chunk_count;
+    EventTimelineChunk **chunks;
+    // the latest end of the events in this chunk and all the ones before
+    double *reach;
+};
+
+struct EventTimeline {
+    std::atomic<EventTimelineVersion *> current;
+    // the version the reader took last
+    std::atomic<EventTimelineVersion *> pinned;
+    // writer only. replaced versions that the reader may still hold.
+    List<EventTimelineVersion *> retired;
+};
+
+// starts out with no events
+int event_timeline_init(EventTimeline *timeline);
+// while nothing reads it
+void event_timeline_deinit(EventTimeline *timeline);
+
+// writer. events must be sorted by start, and compare equal byte for byte
+// to the ones already published where they did not change, so zero the
+// padding. leaves the timeline as it was if it runs out of memory.
+int event_timeline_publish(EventTimeline *timeline, const EventTimelineEvent *events, int event_count);
+// writer. frees the replaced versions the reader is done with, which is
+// all of them when reader_stopped says the reader will not run until the
+// next publish.
+void event_timeline_collect(EventTimeline *timeline, bool reader_stopped);
+
+// reader. the version stays valid until the next call.
+EventTimelineVersion *event_timeline_read(EventTimeline *timeline);
+// the first chunk with an event starting at or after pos, or chunk_count
+int event_timeline_find_chunk(const EventTimelineVersion *version, double pos);
+// the first chunk with an event ending after pos, or chunk_count. no chunk
+// before it has an event that is still going on at pos.
+int event_timeline_find_overlap(const EventTimelineVersion *version, double pos);
+
+#endif
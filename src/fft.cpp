@@ -0,0 +1,152 @@
+#include "fft.hpp"
+#include "util.hpp"
+#include "genesis.h"
+
+#include <math.h>
+
+int fft_create(int size, Fft **out_fft) {
+    *out_fft = nullptr;
+    if (size < 4 || (size & (size - 1)))
+        return GenesisErrorInvalidParam;
+    Fft *fft = create_zero<Fft>();
+    if (!fft)
+        return GenesisErrorNoMem;
+    fft->size = size;
+    fft->half_size = size / 2;
+    fft->twiddle_re = allocate_zero<float>(fft->half_size);
+    fft->twiddle_im = allocate_zero<float>(fft->half_size);
+    fft->bit_reverse = allocate_zero<int>(fft->half_size);
+    if (!fft->twiddle_re || !fft->twiddle_im || !fft->bit_reverse) {
+        fft_destroy(fft);
+        return GenesisErrorNoMem;
+    }
+    for (int k = 0; k < fft->half_size; k += 1) {
+        double angle = -2.0 * M_PI * k / size;
+        fft->twiddle_re[k] = cos(angle);
+        fft->twiddle_im[k] = sin(angle);
+    }
+    int bits = 0;
+    while ((1 << bits) < fft->half_size)
+        bits += 1;
+    for (int i = 0; i < fft->half_size; i += 1) {
+        int reversed = 0;
+        for (int bit = 0; bit < bits; bit += 1) {
+            if (i & (1 << bit))
+                reversed |= 1 << (bits - 1 - bit);
+        }
+        fft->bit_reverse[i] = reversed;
+    }
+    *out_fft = fft;
+    return 0;
+}
+
+void fft_destroy(Fft *fft) {
+    if (fft) {
+        destroy(fft->twiddle_re, fft->half_size);
+        destroy(fft->twiddle_im, fft->half_size);
+        destroy(fft->bit_reverse, fft->half_size);
+        destroy(fft, 1);
+    }
+}
+
+// the forward complex transform of half_size points, in place on points
+// that are already in bit reversed order
+static void complex_butterflies(const Fft *fft, float *re, float *im) {
+    int n = fft->half_size;
+    for (int len = 2; len <= n; len <<= 1) {
+        int half = len / 2;
+        int twiddle_stride = fft->size / len;
+        for (int start = 0; start < n; start += len) {
+            for (int j = 0; j < half; j += 1) {
+                float wr = fft->twiddle_re[j * twiddle_stride];
+                float wi = fft->twiddle_im[j * twiddle_stride];
+                int a = start + j;
+                int b = a + half;
+                float br = re[b] * wr - im[b] * wi;
+                float bi = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - br;
+                im[b] = im[a] - bi;
+                re[a] += br;
+                im[a] += bi;
+            }
+        }
+    }
+}
+
+// the even samples go in the real parts and the odd ones in the imaginary
+// parts of a transform half the size, which is then split back into the
+// spectra of the even and odd samples and combined
+void fft_forward(const Fft *fft, const float *in, float *re, float *im, float *work) {
+    int n = fft->half_size;
+    float *zr = work;
+    float *zi = work + n;
+    for (int i = 0; i < n; i += 1) {
+        int r = fft->bit_reverse[i];
+        zr[r] = in[2 * i];
+        zi[r] = in[2 * i + 1];
+    }
+    complex_butterflies(fft, zr, zi);
+
+    re[0] = zr[0] + zi[0];
+    im[0] = 0.0f;
+    re[n] = zr[0] - zi[0];
+    im[n] = 0.0f;
+    for (int k = 1; k < n; k += 1) {
+        float ar = zr[k];
+        float ai = zi[k];
+        float br = zr[n - k];
+        float bi = -zi[n - k];
+        float even_re = 0.5f * (ar + br);
+        float even_im = 0.5f * (ai + bi);
+        float odd_re = 0.5f * (ai - bi);
+        float odd_im = -0.5f * (ar - br);
+        float wr = fft->twiddle_re[k];
+        float wi = fft->twiddle_im[k];
+        re[k] = even_re + odd_re * wr - odd_im * wi;
+        im[k] = even_im + odd_re * wi + odd_im * wr;
+    }
+}
+
+// undoes the split into even and odd spectra, then runs the inverse of the
+// half size transform by conjugating on the way in and out
+void fft_inverse(const Fft *fft, const float *re, const float *im, float *out, float *work) {
+    int n = fft->half_size;
+    float *zr = work;
+    float *zi = work + n;
+    zr[0] = re[0] + re[n];
+    zi[0] = -(re[0] - re[n]);
+    for (int k = 1; k < n; k += 1) {
+        float ar = re[k];
+        float ai = im[k];
+        float br = re[n - k];
+        float bi = -im[n - k];
+        float even_re = ar + br;
+        float even_im = ai + bi;
+        float dr = ar - br;
+        float di = ai - bi;
+        // times the conjugate twiddle
+        float wr = fft->twiddle_re[k];
+        float wi = -fft->twiddle_im[k];
+        float odd_re = dr * wr - di * wi;
+        float odd_im = dr * wi + di * wr;
+        int r = fft->bit_reverse[k];
+        zr[r] = even_re - odd_im;
+        zi[r] = -(even_im + odd_re);
+    }
+    complex_butterflies(fft, zr, zi);
+
+    float scale = 1.0f / fft->size;
+    for (int i = 0; i < n; i += 1) {
+        out[2 * i] = zr[i] * scale;
+        out[2 * i + 1] = -zi[i] * scale;
+    }
+}
+
+void fft_multiply_add(float *acc_re, float *acc_im, const float *a_re, const float *a_im,
+        const float *b_re, const float *b_im, int bin_count)
+{
+    for (int k = 0; k < bin_count; k += 1) {
+        acc_re[k] += a_re[k] * b_re[k] - a_im[k] * b_im[k];
+        acc_im[k] += a_re[k] * b_im[k] + a_im[k] * b_re[k];
+    }
+}
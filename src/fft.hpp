@@ -0,0 +1,42 @@
+#ifndef GENESIS_FFT_HPP
+#define GENESIS_FFT_HPP
+
+// a real to complex FFT of one power of two size, for nodes that work in
+// the frequency domain. a spectrum is bin_count = size / 2 + 1 bins, kept
+// as separate real and imaginary arrays so that the per bin loops
+// vectorize. the bins of a real signal above size / 2 are the conjugates of
+// the ones below, so they are not stored.
+// an Fft is immutable once created and can be shared between threads.
+
+struct Fft {
+    int size;
+    // the complex transform of size / 2 that does the work
+    int half_size;
+    // exp(-2 pi i k / size) for k in [0, size / 2)
+    float *twiddle_re;
+    float *twiddle_im;
+    // half_size entries
+    int *bit_reverse;
+};
+
+// size is a power of two, at least 4
+int fft_create(int size, Fft **out_fft);
+void fft_destroy(Fft *fft);
+
+static inline int fft_bin_count(const Fft *fft) {
+    return fft->half_size + 1;
+}
+
+// in is size samples. re and im get the bins. work is size floats of
+// scratch and may not overlap the others.
+void fft_forward(const Fft *fft, const float *in, float *re, float *im, float *work);
+// the other way, scaled so that fft_inverse of fft_forward gives back the
+// signal. the imaginary parts of the first and last bins are ignored.
+void fft_inverse(const Fft *fft, const float *re, const float *im, float *out, float *work);
+
+// acc += a * b for bin_count complex bins, which is a circular convolution
+// of the two signals once transformed back
+void fft_multiply_add(float *acc_re, float *acc_im, const float *a_re, const float *a_im,
+        const float *b_re, const float *b_im, int bin_count);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef FLAC_FRAME_HPP
+#define FLAC_FRAME_HPP
+
+#include "list.hpp"
+
+#include <stdint.h>
+
+// size of the streaminfo block after its metadata header, as encoders put
+// it in extradata
+static const int FLAC_STREAMINFO_SIZE = 34;
+
+// the checksums of a frame header and of a whole frame
+uint8_t flac_crc8(const uint8_t *buf, int len);
+uint16_t flac_crc16(const uint8_t *buf, int len);
+
+// a copy of an encoded frame in out, with the number in its header replaced
+// by frame_number, or by sample_number when the frame has a variable block
+// size, and both checksums fixed up. so that frames from several encoders
+// each counting from 0 make one stream. returns GenesisErrorInvalidFormat
+// if frame is not a flac frame.
+int flac_frame_renumber(const uint8_t *frame, int size, uint64_t frame_number, uint64_t sample_number,
+        List<uint8_t> &out);
+
+// overwrites the fields of streaminfo which are only known once the whole
+// stream is encoded. a frame size of 0 or an md5 of all zeroes means
+// unknown.
+void flac_streaminfo_patch(uint8_t *streaminfo, uint64_t total_samples,
+        int min_frame_size, int max_frame_size, const uint8_t *md5);
+
+#endif
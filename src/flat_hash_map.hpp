@@ -0,0 +1,279 @@
+#ifndef FLAT_HASH_MAP_HPP
+#define FLAT_HASH_MAP_HPP
+
+#include "util.hpp"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define GENESIS_FLAT_HASH_MAP_SSE2
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define GENESIS_FLAT_HASH_MAP_NEON
+#endif
+
+// an open addressing table with the same interface as HashMap. each slot has
+// a control byte, kept apart from the entries, which says whether the slot
+// is empty, deleted or full, and for a full slot holds 7 bits of the hash.
+// a probe compares a group of 16 control bytes at once and only looks at
+// the entries whose bits match, so a miss usually touches no entry at all.
+
+static const int FLAT_HASH_MAP_GROUP_SIZE = 16;
+static const int8_t FLAT_HASH_MAP_EMPTY = -128;
+static const int8_t FLAT_HASH_MAP_DELETED = -2;
+
+// these return one bit for each slot of the group, lowest slot first
+
+static inline uint32_t flat_hash_map_match(const int8_t *ctrl, int8_t h2) {
+#if defined(GENESIS_FLAT_HASH_MAP_SSE2)
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(h2)));
+#elif defined(GENESIS_FLAT_HASH_MAP_NEON)
+    static const uint8_t bits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t eq = vceqq_s8(vld1q_s8(ctrl), vdupq_n_s8(h2));
+    uint8x16_t masked = vandq_u8(eq, vld1q_u8(bits));
+    return vaddv_u8(vget_low_u8(masked)) | (vaddv_u8(vget_high_u8(masked)) << 8);
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < FLAT_HASH_MAP_GROUP_SIZE; i += 1)
+        mask |= (uint32_t)(ctrl[i] == h2) << i;
+    return mask;
+#endif
+}
+
+static inline uint32_t flat_hash_map_match_empty(const int8_t *ctrl) {
+    return flat_hash_map_match(ctrl, FLAT_HASH_MAP_EMPTY);
+}
+
+// full slots are the ones with the high bit clear
+static inline uint32_t flat_hash_map_match_empty_or_deleted(const int8_t *ctrl) {
+#if defined(GENESIS_FLAT_HASH_MAP_SSE2)
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < FLAT_HASH_MAP_GROUP_SIZE; i += 1)
+        mask |= (uint32_t)(ctrl[i] < 0) << i;
+    return mask;
+#endif
+}
+
+// the hash functions in use are not all good in their low bits
+static inline uint32_t flat_hash_map_mix(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+template<typename K, typename V, uint32_t (*HashFunction)(const K &key)>
+class FlatHashMap {
+public:
+    FlatHashMap() {
+        init_capacity(32);
+    }
+    FlatHashMap(int capacity) {
+        init_capacity(capacity);
+    }
+    ~FlatHashMap() {
+        destroy(_entries, _capacity);
+        destroy(_ctrl, 0);
+    }
+    FlatHashMap(const FlatHashMap &copy) = delete;
+    FlatHashMap &operator=(const FlatHashMap &copy) = delete;
+
+    struct Entry {
+        K key;
+        V value;
+    };
+
+    void clear() {
+        for (int i = 0; i < _capacity; i += 1) {
+            if (_ctrl[i] >= 0)
+                _entries[i] = Entry();
+        }
+        memset(_ctrl, FLAT_HASH_MAP_EMPTY, _capacity);
+        _size = 0;
+        _deleted_count = 0;
+        _modification_count += 1;
+    }
+
+    int size() const {
+        return _size;
+    }
+
+    void put(const K &key, const V &value) {
+        _modification_count += 1;
+        uint32_t hash = flat_hash_map_mix(HashFunction(key));
+        Entry *entry = internal_get(key, hash);
+        if (entry) {
+            entry->value = value;
+            return;
+        }
+
+        // at 7/8 full, counting deleted slots, double the capacity. if it
+        // is mostly deleted slots, clean them out at the same capacity.
+        if ((_size + _deleted_count + 1) * 8 > _capacity * 7) {
+            int new_capacity = ((_size + 1) * 16 > _capacity * 7) ? (_capacity * 2) : _capacity;
+            rehash(new_capacity);
+        }
+        internal_put(key, value, hash);
+    }
+
+    const V &get(const K &key) const {
+        Entry *entry = maybe_get(key);
+        if (!entry)
+            panic("key not found");
+        return entry->value;
+    }
+
+    Entry *maybe_get(const K &key) const {
+        return internal_get(key, flat_hash_map_mix(HashFunction(key)));
+    }
+
+    void remove(const K &key) {
+        _modification_count += 1;
+        Entry *entry = maybe_get(key);
+        if (!entry)
+            panic("key not found");
+        int index = entry - _entries;
+        int8_t *group_ctrl = &_ctrl[index - index % FLAT_HASH_MAP_GROUP_SIZE];
+        // a group with an empty slot was never full, so no probe goes on
+        // past it and the slot can be empty again
+        if (flat_hash_map_match_empty(group_ctrl)) {
+            _ctrl[index] = FLAT_HASH_MAP_EMPTY;
+        } else {
+            _ctrl[index] = FLAT_HASH_MAP_DELETED;
+            _deleted_count += 1;
+        }
+        *entry = Entry();
+        _size -= 1;
+    }
+
+    class Iterator {
+    public:
+        Entry *next() {
+            if (_inital_modification_count != _table->_modification_count)
+                panic("concurrent modification");
+            if (_count >= _table->size())
+                return NULL;
+            for (; _index < _table->_capacity; _index += 1) {
+                if (_table->_ctrl[_index] >= 0) {
+                    Entry *entry = &_table->_entries[_index];
+                    _index += 1;
+                    _count += 1;
+                    return entry;
+                }
+            }
+            panic("no next item");
+        }
+    private:
+        const FlatHashMap * _table;
+        // how many items have we returned
+        int _count = 0;
+        // iterator through the entry array
+        int _index = 0;
+        // used to detect concurrent modification
+        uint32_t _inital_modification_count;
+        Iterator(const FlatHashMap * table) :
+                _table(table), _inital_modification_count(table->_modification_count) {
+        }
+        friend FlatHashMap;
+    };
+
+    // you must not modify the underlying FlatHashMap while this iterator is still in use
+    Iterator entry_iterator() const {
+        return Iterator(this);
+    }
+
+private:
+
+    int8_t *_ctrl;
+    Entry *_entries;
+    // always a power of two and at least one group
+    int _capacity;
+    int _size;
+    int _deleted_count;
+    // this is used to detect bugs where a hashtable is edited while an iterator is running.
+    uint32_t _modification_count = 0;
+
+    void init_capacity(int capacity) {
+        _capacity = FLAT_HASH_MAP_GROUP_SIZE;
+        while (_capacity < capacity)
+            _capacity *= 2;
+        _ctrl = allocate_nonzero<int8_t>(_capacity);
+        if (!_ctrl)
+            panic("allocate: out of memory");
+        memset(_ctrl, FLAT_HASH_MAP_EMPTY, _capacity);
+        _entries = allocate_class<Entry>(_capacity);
+        _size = 0;
+        _deleted_count = 0;
+    }
+
+    void rehash(int new_capacity) {
+        int8_t *old_ctrl = _ctrl;
+        Entry *old_entries = _entries;
+        int old_capacity = _capacity;
+        init_capacity(new_capacity);
+        for (int i = 0; i < old_capacity; i += 1) {
+            if (old_ctrl[i] >= 0) {
+                Entry *old_entry = &old_entries[i];
+                internal_put(old_entry->key, old_entry->value,
+                        flat_hash_map_mix(HashFunction(old_entry->key)));
+            }
+        }
+        destroy(old_entries, old_capacity);
+        destroy(old_ctrl, 0);
+    }
+
+    // the groups are visited in triangular steps, which covers every group
+    // when the group count is a power of two
+    int first_group(uint32_t hash) const {
+        return (hash >> 7) & group_mask();
+    }
+
+    int group_mask() const {
+        return _capacity / FLAT_HASH_MAP_GROUP_SIZE - 1;
+    }
+
+    // key must not be in the table yet
+    void internal_put(const K &key, const V &value, uint32_t hash) {
+        int group = first_group(hash);
+        for (int step = 1; ; step += 1) {
+            uint32_t bits = flat_hash_map_match_empty_or_deleted(&_ctrl[group * FLAT_HASH_MAP_GROUP_SIZE]);
+            if (bits) {
+                int index = group * FLAT_HASH_MAP_GROUP_SIZE + __builtin_ctz(bits);
+                if (_ctrl[index] == FLAT_HASH_MAP_DELETED)
+                    _deleted_count -= 1;
+                _ctrl[index] = hash & 0x7f;
+                _entries[index].key = key;
+                _entries[index].value = value;
+                _size += 1;
+                return;
+            }
+            group = (group + step) & group_mask();
+        }
+    }
+
+    Entry *internal_get(const K &key, uint32_t hash) const {
+        int8_t h2 = hash & 0x7f;
+        int group = first_group(hash);
+        for (int step = 1; step <= group_mask() + 1; step += 1) {
+            const int8_t *group_ctrl = &_ctrl[group * FLAT_HASH_MAP_GROUP_SIZE];
+            for (uint32_t bits = flat_hash_map_match(group_ctrl, h2); bits; bits &= bits - 1) {
+                Entry *entry = &_entries[group * FLAT_HASH_MAP_GROUP_SIZE + __builtin_ctz(bits)];
+                if (entry->key == key)
+                    return entry;
+            }
+            if (flat_hash_map_match_empty(group_ctrl))
+                return NULL;
+            group = (group + step) & group_mask();
+        }
+        return NULL;
+    }
+};
+
+#endif
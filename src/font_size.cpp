@@ -1,16 +1,74 @@
 #include "font_size.hpp"
+#include "glyph_rasterizer.hpp"
+#include "os.hpp"
+#include "gui_stats.hpp"
+
+static const int atlas_start_width = 512;
+static const int atlas_start_height = 256;
+static const int atlas_max_height = 8192;
+// between glyphs, so that filtering never reaches a neighbor
+static const int atlas_padding = 1;
 
 static void ft_ok(FT_Error err) {
     if (err)
         panic("freetype error");
 }
 
-FontSize::FontSize(FT_Face font_face, int font_size) :
+// the cache file is a header and then a record and the bitmap for each glyph
+static const char glyph_cache_magic[4] = {'G', 'G', 'L', 'Y'};
+static const uint32_t glyph_cache_version = 1;
+
+struct GlyphCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t glyph_count;
+};
+
+struct GlyphCacheRecord {
+    uint32_t codepoint;
+    uint32_t glyph_index;
+    float advance;
+    int32_t bitmap_left;
+    int32_t bitmap_top;
+    int32_t bitmap_width;
+    int32_t bitmap_height;
+};
+
+FontSize::FontSize(FT_Face font_face, int font_size, GlyphRasterizer *rasterizer,
+        const ByteBuffer &cache_path, GuiFrameStats *stats) :
     _max_above_size(0),
     _max_below_size(0),
     _font_face(font_face),
-    _font_size(font_size)
+    _font_size(font_size),
+    _rasterizer(rasterizer),
+    _stats(stats),
+    _cache_path(cache_path),
+    _cache_dirty(false),
+    _atlas_width(atlas_start_width),
+    _atlas_height(atlas_start_height),
+    _row_x(atlas_padding),
+    _row_top(atlas_padding),
+    _row_height(0),
+    _upload_deferred(true)
 {
+    _atlas_pixels.resize(_atlas_width * _atlas_height);
+    _atlas_pixels.fill(0);
+    read_cache_file();
+
+    // all of the cached glyphs go up at once
+    glGenTextures(1, &_atlas_texture_id);
+    glBindTexture(GL_TEXTURE_2D, _atlas_texture_id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, _atlas_width, _atlas_height,
+            0, GL_RED, GL_UNSIGNED_BYTE, _atlas_pixels.raw());
+    _stats->texture_uploads += 1;
+    _stats->texture_upload_bytes += _atlas_pixels.length();
+    _upload_deferred = false;
+
     // pre-fill some characters in the cache so that we have a good measurement of
     // _max_above_size and _max_below_size
     static const char * some_characters =
@@ -20,14 +78,77 @@ FontSize::FontSize(FT_Face font_face, int font_size) :
 }
 
 FontSize::~FontSize() {
-    auto it = _font_cache.entry_iterator();
-    for (;;) {
-        auto *entry = it.next();
-        if (!entry)
-            break;
-        FontCacheValue *font_cache_value = &entry->value;
-        FT_Done_Glyph(font_cache_value->glyph);
+    if (_cache_dirty)
+        write_cache_file();
+    glDeleteTextures(1, &_atlas_texture_id);
+}
+
+void FontSize::grow_atlas() {
+    int new_height = _atlas_height * 2;
+    if (new_height > atlas_max_height)
+        panic("glyph atlas full");
+    _atlas_pixels.resize(_atlas_width * new_height);
+    memset(_atlas_pixels.raw() + _atlas_width * _atlas_height, 0, _atlas_width * (new_height - _atlas_height));
+    _atlas_height = new_height;
+    if (_upload_deferred)
+        return;
+    glBindTexture(GL_TEXTURE_2D, _atlas_texture_id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, _atlas_width, _atlas_height,
+            0, GL_RED, GL_UNSIGNED_BYTE, _atlas_pixels.raw());
+    _stats->texture_uploads += 1;
+    _stats->texture_upload_bytes += _atlas_pixels.length();
+}
+
+// finds room in the atlas for a bitmap, growing it if need be
+void FontSize::reserve_rect(int width, int height, int *out_x, int *out_y) {
+    if (width == 0 || height == 0) {
+        *out_x = 0;
+        *out_y = 0;
+        return;
     }
+    if (width + 2 * atlas_padding > _atlas_width)
+        panic("glyph wider than the atlas");
+
+    if (_row_x + width + atlas_padding > _atlas_width) {
+        _row_top += _row_height + atlas_padding;
+        _row_x = atlas_padding;
+        _row_height = 0;
+    }
+    while (_row_top + height + atlas_padding > _atlas_height)
+        grow_atlas();
+
+    *out_x = _row_x;
+    *out_y = _row_top;
+    _row_x += width + atlas_padding;
+    _row_height = max(_row_height, height);
+}
+
+// copies a bitmap into its place in the atlas and uploads only those pixels
+void FontSize::write_pixels(int x, int y, int width, int height,
+        const unsigned char *pixels, int pitch)
+{
+    if (width == 0 || height == 0)
+        return;
+    for (int row = 0; row < height; row += 1)
+        memcpy(_atlas_pixels.raw() + (y + row) * _atlas_width + x, pixels + row * pitch, width);
+    if (_upload_deferred)
+        return;
+    glBindTexture(GL_TEXTURE_2D, _atlas_texture_id);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, _atlas_width);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RED, GL_UNSIGNED_BYTE,
+            _atlas_pixels.raw() + y * _atlas_width + x);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    _stats->texture_uploads += 1;
+    _stats->texture_upload_bytes += width * height;
+}
+
+void FontSize::add_metrics(const FontCacheValue &value) {
+    if (value.above_size > _max_above_size)
+        _max_above_size = value.above_size;
+    if (value.below_size > _max_below_size)
+        _max_below_size = value.below_size;
 }
 
 uint32_t hash_uint32_t(const uint32_t &x) {
@@ -39,26 +160,152 @@ FontCacheValue FontSize::font_cache_entry(uint32_t codepoint) {
     if (entry)
         return entry->value;
 
+    // loading without rendering still sets the size and place the bitmap
+    // will have, which is all that layout needs
     ft_ok(FT_Set_Char_Size(_font_face, 0, _font_size * 64, 0, 0));
     FT_UInt glyph_index = FT_Get_Char_Index(_font_face, codepoint);
-    ft_ok(FT_Load_Glyph(_font_face, glyph_index, FT_LOAD_RENDER));
+    ft_ok(FT_Load_Glyph(_font_face, glyph_index, FT_LOAD_DEFAULT));
     FT_GlyphSlot glyph_slot = _font_face->glyph;
-    FT_Glyph glyph;
-    ft_ok(FT_Get_Glyph(glyph_slot, &glyph));
-    ft_ok(FT_Glyph_To_Bitmap(&glyph, FT_RENDER_MODE_NORMAL, NULL, 0));
-    FT_BitmapGlyph bitmap_glyph = (FT_BitmapGlyph) glyph;
-
-    int bmp_start_top = bitmap_glyph->top;
-    int bmp_height = bitmap_glyph->bitmap.rows;
-    int this_above_size = bmp_start_top;
-    int this_below_size = bmp_height - this_above_size;
-
-    if (this_above_size > _max_above_size)
-        _max_above_size = this_above_size;
-    if (this_below_size > _max_below_size)
-        _max_below_size = this_below_size;
-
-    FontCacheValue value = FontCacheValue{glyph, bitmap_glyph, glyph_index, this_above_size, this_below_size};
+
+    FontCacheValue value;
+    value.glyph_index = glyph_index;
+    value.advance = glyph_slot->advance.x / 64.0f;
+    value.bitmap_left = glyph_slot->bitmap_left;
+    value.bitmap_top = glyph_slot->bitmap_top;
+    value.bitmap_width = glyph_slot->bitmap.width;
+    value.bitmap_height = glyph_slot->bitmap.rows;
+    value.above_size = value.bitmap_top;
+    value.below_size = value.bitmap_height - value.above_size;
+    reserve_rect(value.bitmap_width, value.bitmap_height, &value.atlas_x, &value.atlas_y);
+    value.ready = (value.bitmap_width == 0 || value.bitmap_height == 0);
+    add_metrics(value);
     _font_cache.put(codepoint, value);
+
+    if (!value.ready) {
+        GlyphJob job;
+        job.font_size = this;
+        job.pixel_size = _font_size;
+        job.codepoint = codepoint;
+        job.glyph_index = glyph_index;
+        job.atlas_x = value.atlas_x;
+        job.atlas_y = value.atlas_y;
+        job.width = value.bitmap_width;
+        job.height = value.bitmap_height;
+        job.pixels = nullptr;
+        _rasterizer->queue(job);
+    }
     return value;
 }
+
+void FontSize::fill_glyph(const GlyphJob *job) {
+    write_pixels(job->atlas_x, job->atlas_y, job->width, job->height, job->pixels, job->width);
+    _font_cache.maybe_get(job->codepoint)->value.ready = true;
+    _cache_dirty = true;
+}
+
+// a missing or unreadable file leaves the cache as far as it got
+void FontSize::read_cache_file() {
+    FILE *f = fopen(_cache_path.raw(), "rb");
+    if (!f)
+        return;
+    long size;
+    ByteBuffer contents;
+    bool ok = false;
+    if (!os_file_size(f, &size) && size >= (long)sizeof(GlyphCacheHeader)) {
+        contents.resize(size);
+        ok = (fread(contents.raw(), 1, size, f) == (size_t)size);
+    }
+    fclose(f);
+    if (!ok)
+        return;
+
+    GlyphCacheHeader header;
+    memcpy(&header, contents.raw(), sizeof(header));
+    if (memcmp(header.magic, glyph_cache_magic, sizeof(header.magic)) != 0 ||
+        header.version != glyph_cache_version)
+    {
+        return;
+    }
+
+    long offset = sizeof(header);
+    for (uint32_t i = 0; i < header.glyph_count; i += 1) {
+        GlyphCacheRecord record;
+        if (offset + (long)sizeof(record) > size)
+            return;
+        memcpy(&record, contents.raw() + offset, sizeof(record));
+        offset += sizeof(record);
+        if (record.bitmap_width < 0 || record.bitmap_height < 0 ||
+            record.bitmap_width + 2 * atlas_padding > _atlas_width)
+        {
+            return;
+        }
+        long pixel_count = (long)record.bitmap_width * (long)record.bitmap_height;
+        if (offset + pixel_count > size)
+            return;
+
+        FontCacheValue value;
+        value.glyph_index = record.glyph_index;
+        value.advance = record.advance;
+        value.bitmap_left = record.bitmap_left;
+        value.bitmap_top = record.bitmap_top;
+        value.bitmap_width = record.bitmap_width;
+        value.bitmap_height = record.bitmap_height;
+        value.above_size = value.bitmap_top;
+        value.below_size = value.bitmap_height - value.above_size;
+        reserve_rect(value.bitmap_width, value.bitmap_height, &value.atlas_x, &value.atlas_y);
+        write_pixels(value.atlas_x, value.atlas_y, value.bitmap_width, value.bitmap_height,
+                (const unsigned char *)contents.raw() + offset, value.bitmap_width);
+        value.ready = true;
+        add_metrics(value);
+        _font_cache.put(record.codepoint, value);
+        offset += pixel_count;
+    }
+}
+
+// the glyphs whose bitmaps are done, read back out of the atlas
+void FontSize::write_cache_file() {
+    ByteBuffer contents;
+    GlyphCacheHeader header;
+    memcpy(header.magic, glyph_cache_magic, sizeof(header.magic));
+    header.version = glyph_cache_version;
+    header.glyph_count = 0;
+    contents.append((const char *)&header, sizeof(header));
+
+    auto it = _font_cache.entry_iterator();
+    for (;;) {
+        auto *entry = it.next();
+        if (!entry)
+            break;
+        const FontCacheValue *value = &entry->value;
+        if (!value->ready)
+            continue;
+        GlyphCacheRecord record = {
+            entry->key,
+            value->glyph_index,
+            value->advance,
+            value->bitmap_left,
+            value->bitmap_top,
+            value->bitmap_width,
+            value->bitmap_height,
+        };
+        contents.append((const char *)&record, sizeof(record));
+        for (int row = 0; row < value->bitmap_height; row += 1) {
+            contents.append(_atlas_pixels.raw() + (value->atlas_y + row) * _atlas_width + value->atlas_x,
+                    value->bitmap_width);
+        }
+        header.glyph_count += 1;
+    }
+    memcpy(contents.raw(), &header, sizeof(header));
+
+    ByteBuffer dir = os_path_dirname(_cache_path);
+    if (os_mkdirp(dir))
+        return;
+    OsTempFile tmp_file;
+    if (os_create_temp_file(dir.raw(), &tmp_file))
+        return;
+    bool ok = (fwrite(contents.raw(), 1, contents.length(), tmp_file.file) == (size_t)contents.length());
+    if (fclose(tmp_file.file))
+        ok = false;
+    if (!ok || os_rename_clobber(tmp_file.path.raw(), _cache_path.raw()))
+        os_delete(tmp_file.path.raw());
+}
@@ -3,34 +3,92 @@
 
 #include "hash_map.hpp"
 #include "freetype.hpp"
+#include "byte_buffer.hpp"
+#include "glfw.hpp"
 
 #include <stdint.h>
 
 uint32_t hash_uint32_t(const uint32_t &);
 
 struct FontCacheValue {
-    FT_Glyph glyph;
-    FT_BitmapGlyph bitmap_glyph;
     FT_UInt glyph_index;
+    // pen movement after the glyph, in pixels
+    float advance;
+    // of the bitmap, from the pen position on the baseline
+    int bitmap_left;
+    int bitmap_top;
+    int bitmap_width;
+    int bitmap_height;
     int above_size;
     int below_size;
+    // where the bitmap is in the atlas
+    int atlas_x;
+    int atlas_y;
+    // the bitmap is in the atlas. until then its place there is blank.
+    bool ready;
 };
 
+struct GlyphJob;
+struct GuiFrameStats;
+class GlyphRasterizer;
+
 class FontSize {
 public:
-    FontSize(FT_Face font_face, int font_size);
+    // glyphs rasterized in earlier runs are read from cache_path, and the
+    // rest are rendered by rasterizer
+    FontSize(FT_Face font_face, int font_size, GlyphRasterizer *rasterizer,
+            const ByteBuffer &cache_path, GuiFrameStats *stats);
     ~FontSize();
 
+    // the metrics are right at once. the bitmap may take a few frames.
     FontCacheValue font_cache_entry(uint32_t codepoint);
+    // from GlyphRasterizer::flush
+    void fill_glyph(const GlyphJob *job);
 
     int _max_above_size;
     int _max_below_size;
 
+    // the bitmaps of every glyph cached so far, one byte of coverage a
+    // pixel, shared by all the labels of this size. it grows taller as it
+    // fills, so atlas positions stay where they are.
+    GLuint atlas_texture_id() const {
+        return _atlas_texture_id;
+    }
+    int atlas_width() const {
+        return _atlas_width;
+    }
+    int atlas_height() const {
+        return _atlas_height;
+    }
+
 private:
     HashMap<uint32_t, FontCacheValue, hash_uint32_t> _font_cache;
 
     FT_Face _font_face;
     int _font_size;
+    GlyphRasterizer *_rasterizer;
+    GuiFrameStats *_stats;
+    ByteBuffer _cache_path;
+    // glyphs were rendered since the cache file was read
+    bool _cache_dirty;
+
+    GLuint _atlas_texture_id;
+    int _atlas_width;
+    int _atlas_height;
+    ByteBuffer _atlas_pixels;
+    // glyphs are packed left to right in rows as tall as their tallest
+    int _row_x;
+    int _row_top;
+    int _row_height;
+    // while reading the cache file the texture does not exist yet
+    bool _upload_deferred;
+
+    void grow_atlas();
+    void reserve_rect(int width, int height, int *out_x, int *out_y);
+    void write_pixels(int x, int y, int width, int height, const unsigned char *pixels, int pitch);
+    void add_metrics(const FontCacheValue &value);
+    void read_cache_file();
+    void write_cache_file();
 
     FontSize &operator=(const FontSize&) = delete;
     FontSize(const FontSize&) = delete;
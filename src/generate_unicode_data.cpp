@@ -7,14 +7,21 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <assert.h>
+#include <string.h>
 
 static const uint32_t whitespace[] = {9, 10, 11, 12, 13, 32, 133, 160, 5760,
     8192, 8193, 8194, 8195, 8196, 8197, 8198, 8199, 8200, 8201, 8202, 8232,
     8233, 8239, 8287, 12288};
 
-struct UnicodeCharacter {
-    uint32_t lower;
-    uint32_t upper;
+// codepoints are looked up in blocks of 1 << block_shift. blocks with the
+// same mappings share one run of indexes, which point into a table of the
+// distinct differences from a codepoint to its lower and upper case.
+static const int block_shift = 7;
+static const int block_size = 1 << block_shift;
+
+struct UnicodeCaseDelta {
+    int32_t lower;
+    int32_t upper;
 };
 
 int main(int argc, char *argv[]) {
@@ -54,7 +61,9 @@ int main(int argc, char *argv[]) {
     buffer.split("\n", lines);
 
     uint32_t max = 0;
-    List<UnicodeCharacter> case_info_list;
+    // unlisted codepoints, such as the inside of the CJK ranges, map to
+    // themselves
+    List<UnicodeCaseDelta> case_info_list;
 
     for (uint32_t i = 0; i < (uint32_t)lines.length(); i += 1) {
         List<ByteBuffer> line_fields;
@@ -78,7 +87,48 @@ int main(int argc, char *argv[]) {
             sscanf(lower_str.raw(), "%X", &lower);
             sscanf(upper_str.raw(), "%X", &upper);
         }
-        ok_or_panic(case_info_list.append({ lower, upper }));
+        ok_or_panic(case_info_list.append({ (int32_t)(lower - codepoint), (int32_t)(upper - codepoint) }));
+    }
+
+    // the first delta is the identity, which is what the blocks past the
+    // end of the table map to
+    List<UnicodeCaseDelta> deltas;
+    ok_or_panic(deltas.append({ 0, 0 }));
+    List<uint8_t> indexes;
+    List<uint16_t> blocks;
+    uint8_t block_indexes[block_size];
+    uint32_t block_count = (max >> block_shift) + 1;
+    for (uint32_t block = 0; block < block_count; block += 1) {
+        for (int i = 0; i < block_size; i += 1) {
+            uint32_t codepoint = (block << block_shift) + i;
+            UnicodeCaseDelta delta = { 0, 0 };
+            if (codepoint < (uint32_t)case_info_list.length())
+                delta = case_info_list.at(codepoint);
+            int delta_index = 0;
+            while (delta_index < deltas.length() && (deltas.at(delta_index).lower != delta.lower ||
+                        deltas.at(delta_index).upper != delta.upper))
+            {
+                delta_index += 1;
+            }
+            if (delta_index == deltas.length()) {
+                if (delta_index > UINT8_MAX)
+                    panic("too many distinct case mappings");
+                ok_or_panic(deltas.append(delta));
+            }
+            block_indexes[i] = delta_index;
+        }
+        int unique_count = indexes.length() / block_size;
+        int unique = 0;
+        while (unique < unique_count &&
+                memcmp(&indexes.at(unique * block_size), block_indexes, block_size) != 0)
+        {
+            unique += 1;
+        }
+        if (unique == unique_count) {
+            for (int i = 0; i < block_size; i += 1)
+                ok_or_panic(indexes.append(block_indexes[i]));
+        }
+        ok_or_panic(blocks.append(unique));
     }
 
     fprintf(out, "// This file is auto-generated.\n");
@@ -92,18 +142,27 @@ int main(int argc, char *argv[]) {
     }
     fprintf(out, "};\n");
 
-    fprintf(out, "struct UnicodeCharacter {\n");
-    fprintf(out, "    uint32_t lower;\n");
-    fprintf(out, "    uint32_t upper;\n");
+    fprintf(out, "static const int UNICODE_CASE_BLOCK_SHIFT = %d;\n", block_shift);
+    fprintf(out, "struct UnicodeCaseDelta {\n");
+    fprintf(out, "    int32_t lower;\n");
+    fprintf(out, "    int32_t upper;\n");
     fprintf(out, "};\n");
-    fprintf(out, "static const UnicodeCharacter unicode_characters[] = {\n");
 
-    for (uint32_t i = 0; i < max; i += 1) {
-        UnicodeCharacter *unicode_char = &case_info_list.at(i);
-        fprintf(out, "  {0x%x, 0x%x},\n", unicode_char->lower, unicode_char->upper);
-    }
+    fprintf(out, "static const UnicodeCaseDelta unicode_case_deltas[] = {\n");
+    for (int i = 0; i < deltas.length(); i += 1)
+        fprintf(out, "  {%d, %d},\n", deltas.at(i).lower, deltas.at(i).upper);
+    fprintf(out, "};\n");
 
+    fprintf(out, "static const uint16_t unicode_case_blocks[] = {\n");
+    for (int i = 0; i < blocks.length(); i += 1)
+        fprintf(out, "  %d,\n", blocks.at(i));
     fprintf(out, "};\n");
+
+    fprintf(out, "static const uint8_t unicode_case_indexes[] = {\n");
+    for (int i = 0; i < indexes.length(); i += 1)
+        fprintf(out, "  %d,\n", indexes.at(i));
+    fprintf(out, "};\n");
+
     fprintf(out, "#endif\n");
 
     if (fclose(out))
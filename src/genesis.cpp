@@ -1,339 +1,115 @@
 #include "genesis.hpp"
 #include "audio_file.hpp"
+#include "audio_file_reader.hpp"
+#include "node_params.hpp"
 #include "midi_note_pitch.hpp"
 #include "synth.hpp"
 #include "delay.hpp"
+#include "meter.hpp"
+#include "convolution.hpp"
+#include "plugin_host_node.hpp"
+#include "sampler.hpp"
+#include "network_sink.hpp"
+#include "time_stretch.hpp"
+#include "job_system.hpp"
+#include "dsp_kernels.hpp"
+#include "denormals.hpp"
 #include "resample.hpp"
+#include "sample_format.hpp"
 #include "config.h"
 
-static const int BYTES_PER_SAMPLE = 4; // assuming float samples
-static const int EVENTS_PER_SECOND_CAPACITY = 16000;
-
-// When you finally get around to genericizing this code, take a peek at
-// project_whole_notes_to_frames and project_frames_to_whole_notes
-static const double whole_notes_per_second = 140.0 / 60.0;
+#include <sched.h>
+
+// event buffers start with room for this many events per second, then
+// have room for twice the busiest rate their writer reached
+static const int DEFAULT_EVENTS_PER_SECOND_CAPACITY = 500;
+static const int MIN_EVENTS_PER_SECOND_CAPACITY = 32;
+static const int MAX_EVENTS_PER_SECOND_CAPACITY = 64000;
+static const double EVENT_RATE_WINDOW_SECONDS = 0.1;
+// silence is tracked per block, or per this many frames without a block size
+static const int SILENCE_GRANULE_FRAME_COUNT = 64;
+// samples of two precisions other than float32 go through this many floats
+// at a time
+static const int CONVERT_CHUNK_SAMPLE_COUNT = 256;
+// a recording device on another clock than the pipeline's is converted
+// this many frames at a time, and its rate trimmed by at most this much,
+// far more than two crystals differ by
+static const int DRIFT_CHUNK_FRAME_COUNT = 1024;
+static const double MAX_DRIFT_CORRECTION = 0.005;
 
 static int (*plugin_create_list[])(GenesisPipeline *pipeline) = {
     create_synth_descriptor,
     create_delay_descriptor,
     create_resample_descriptor,
+    create_convolution_descriptor,
+    create_meter_descriptor,
+    create_plugin_host_descriptor,
+    create_sampler_descriptor,
+    create_network_sink_descriptor,
+    create_time_stretch_descriptor,
 };
 
 static_assert(GENESIS_NOTES_COUNT == array_length(midi_note_to_pitch), "");
 
 struct PlaybackNodeContext {
     SoundIoOutStream *outstream;
-    void (*write_sample)(char *ptr, float sample);
+    const SampleFormatInfo *sample_format_info;
     atomic_bool ongoing_recovery;
     bool stream_started;
     AtomicDouble latency;
     atomic_long offset;
     atomic_flag reset_offset_flag;
+    // whole notes. where the next frame handed to the device is
+    double clock_position;
+    // what the last device callback handed over, for
+    // genesis_node_playback_clock, or a negative clock_time when it does not
+    // know. clock_sequence is odd while they change.
+    atomic_int clock_sequence;
+    AtomicDouble clock_time;
+    atomic_long clock_frame;
+    atomic_int clock_frame_count;
+    AtomicDouble clock_whole_note;
+    atomic_int clock_frame_rate;
+    AtomicDouble clock_latency;
+    // set by a seek while the stream is open; the stream is unpaused once
+    // the input buffer is full again
+    atomic_bool seek_pending;
+    // set by a seek which restored checkpoints: the frames from the
+    // checkpoint to where the seek went, which are dropped before the input
+    // buffer fills. only touched by seek and by runs during recovery.
+    long preroll_frame_count;
+    // with direct playback, the node which feeds this one from the device
+    // callback. only changes while no device callback runs.
+    GenesisNode *direct_node;
+    // only touched by the device callback, and by seek and activate while it
+    // does not run. see genesis_pipeline_set_idle_enabled; silent_frame_count
+    // counts the frames of silence handed to the device in a row.
+    bool idle;
+    long silent_frame_count;
+    int idle_wake_epoch;
+    // only touched by the device callback. os_timestamp() when the last
+    // callback started, or 0 before the first one
+    uint64_t last_callback_time;
+    // seconds; a running average of the time between callbacks
+    double mean_callback_interval;
+    // the scratch for direct_node when the device callback runs it. only
+    // grows, and only while no device callback runs.
+    char *direct_scratch_arena;
+    int direct_scratch_arena_size;
 };
 
 struct RecordingNodeContext {
     SoundIoInStream *instream;
-    void (*read_sample)(char *ptr, float *sample);
-};
-
-struct SampleFormatInfo {
-    SoundIoFormat format;
-    void (*write_sample)(char *ptr, float sample);
-    void (*read_sample)(char *ptr, float *sample);
-};
-
-template<int byte_count>
-static void swap_endian(char *ptr) {
-    for (int i = 0; i < byte_count / 2; i += 1) {
-        char value = ptr[i];
-        ptr[i] = ptr[byte_count - i - 1];
-        ptr[byte_count - i - 1] = value;
-    }
-}
-
-static void write_sample_s16ne(char *ptr, float sample) {
-    int16_t *buf = (int16_t *)ptr;
-    *buf = (int16_t)clamp((float)INT16_MIN, sample * 32767.0f, (float)INT16_MAX);
-}
-
-static void read_sample_s16ne(char *ptr, float *sample) {
-    int16_t *buf = (int16_t *)ptr;
-    float range = (float)INT16_MAX - (float)INT16_MIN;
-    *sample = (float)(*buf) / range * 2.0f;
-}
-
-static void write_sample_s16fe(char *ptr, float sample) {
-    write_sample_s16ne(ptr, sample);
-    swap_endian<2>(ptr);
-}
-
-static void read_sample_s16fe(char *ptr, float *sample) {
-    read_sample_s16ne(ptr, sample);
-    swap_endian<2>(ptr);
-}
-
-static void write_sample_u16ne(char *ptr, float sample) {
-    uint32_t *buf = (uint32_t *)ptr;
-    float val = sample * (1.0f + (float)UINT16_MAX);
-    *buf = val;
-}
-
-static void read_sample_u16ne(char *ptr, float *sample) {
-    uint16_t *buf = (uint16_t *)ptr;
-    *sample = (float)(*buf) / (1.0f + (float)UINT16_MAX);
-}
-
-static void write_sample_u16fe(char *ptr, float sample) {
-    write_sample_u16ne(ptr, sample);
-    swap_endian<2>(ptr);
-}
-
-static void read_sample_u16fe(char *ptr, float *sample) {
-    read_sample_u16ne(ptr, sample);
-    swap_endian<2>(ptr);
-}
-
-static void write_sample_s32ne(char *ptr, float sample) {
-    int32_t *buf = (int32_t *)ptr;
-    *buf = (int32_t)clamp((double)INT32_MIN, sample * 2147483647.0, (double)INT32_MAX);
-}
-
-static void read_sample_s32ne(char *ptr, float *sample) {
-    int32_t *buf = (int32_t *)ptr;
-    float range = (float)INT32_MAX - (float)INT32_MIN;
-    *sample = (float)(*buf) / range * 2.0f;
-}
-
-static void write_sample_s32fe(char *ptr, float sample) {
-    write_sample_s32ne(ptr, sample);
-    swap_endian<4>(ptr);
-}
-
-static void read_sample_s32fe(char *ptr, float *sample) {
-    read_sample_s32ne(ptr, sample);
-    swap_endian<4>(ptr);
-}
-
-static void write_sample_float32ne(char *ptr, float sample) {
-    float *buf = (float *)ptr;
-    *buf = sample;
-}
-
-static void read_sample_float32ne(char *ptr, float *sample) {
-    float *buf = (float *)ptr;
-    *sample = *buf;
-}
-
-static void write_sample_float32fe(char *ptr, float sample) {
-    write_sample_float32ne(ptr, sample);
-    swap_endian<4>(ptr);
-}
-
-static void read_sample_float32fe(char *ptr, float *sample) {
-    read_sample_float32ne(ptr, sample);
-    swap_endian<4>((char*)sample);
-}
-
-static void write_sample_float64ne(char *ptr, float sample) {
-    float *buf = (float *)ptr;
-    *buf = sample;
-}
-
-static void read_sample_float64ne(char *ptr, float *sample) {
-    double *buf = (double *)ptr;
-    *sample = *buf;
-}
-
-static void write_sample_float64fe(char *ptr, float sample) {
-    write_sample_float64ne(ptr, sample);
-    swap_endian<8>(ptr);
-}
-
-static void read_sample_float64fe(char *ptr, float *sample) {
-    read_sample_float64ne(ptr, sample);
-    swap_endian<8>((char*)sample);
-}
-
-static void write_sample_u32ne(char *ptr, float sample) {
-    uint32_t *buf = (uint32_t *)ptr;
-    float val = sample * (1.0f + (float)UINT32_MAX);
-    *buf = val;
-}
-
-static void read_sample_u32ne(char *ptr, float *sample) {
-    uint32_t *buf = (uint32_t *)ptr;
-    *sample = (float)(*buf) / (1.0f + (float)UINT32_MAX);
-}
-
-static void write_sample_u32fe(char *ptr, float sample) {
-    write_sample_u32ne(ptr, sample);
-    swap_endian<4>(ptr);
-}
-
-static void read_sample_u32fe(char *ptr, float *sample) {
-    read_sample_u32ne(ptr, sample);
-    swap_endian<4>(ptr);
-}
-
-static void write_sample_s24ne(char *ptr, float sample) {
-    int32_t *buf = (int32_t *)ptr;
-    float range = 16777216.0f;
-    float val = sample * range / 2.0;
-    *buf = val;
-}
-
-static void read_sample_s24ne(char *ptr, float *sample) {
-    int32_t *buf = (int32_t *)ptr;
-    float range = 16777216.0f;
-    *sample = (float)(*buf) / range * 2.0f;
-}
-
-static void write_sample_s24fe(char *ptr, float sample) {
-    write_sample_s24ne(ptr, sample);
-    swap_endian<4>(ptr);
-}
-
-static void read_sample_s24fe(char *ptr, float *sample) {
-    read_sample_s24ne(ptr, sample);
-    swap_endian<4>(ptr);
-}
-
-static void write_sample_u24ne(char *ptr, float sample) {
-    uint32_t *buf = (uint32_t *)ptr;
-    float val = sample * 16777217.0f;
-    *buf = val;
-}
-
-static void read_sample_u24ne(char *ptr, float *sample) {
-    uint32_t *buf = (uint32_t *)ptr;
-    *sample = (float)(*buf) / 16777217.0f;
-}
-
-static void write_sample_u24fe(char *ptr, float sample) {
-    write_sample_u24ne(ptr, sample);
-    swap_endian<4>(ptr);
-}
-
-static void read_sample_u24fe(char *ptr, float *sample) {
-    read_sample_u24ne(ptr, sample);
-    swap_endian<4>(ptr);
-}
-
-static void write_sample_s8(char *ptr, float sample) {
-    int8_t *buf = (int8_t *)ptr;
-    float range = (float)INT8_MAX - (float)INT8_MIN;
-    float val = sample * range / 2.0;
-    *buf = val;
-}
-
-static void read_sample_s8(char *ptr, float *sample) {
-    int8_t *buf = (int8_t *)ptr;
-    float range = (float)INT8_MAX - (float)INT8_MIN;
-    *sample = (float)(*buf) / range * 2.0f;
-}
-
-static void write_sample_u8(char *ptr, float sample) {
-    uint8_t *buf = (uint8_t *)ptr;
-    float val = sample * (1.0f + (float)UINT8_MAX);
-    *buf = val;
-}
-
-static void read_sample_u8(char *ptr, float *sample) {
-    uint8_t *buf = (uint8_t *)ptr;
-    *sample = (float)(*buf) / (1.0f + (float)UINT8_MAX);
-}
-
-static SampleFormatInfo prioritized_sample_format_infos[] = {
-    {
-        SoundIoFormatFloat32NE,
-        write_sample_float32ne,
-        read_sample_float32ne
-    },
-    {
-        SoundIoFormatFloat32FE,
-        write_sample_float32fe,
-        read_sample_float32fe
-    },
-    {
-        SoundIoFormatFloat64NE,
-        write_sample_float64ne,
-        read_sample_float64ne,
-    },
-    {
-        SoundIoFormatFloat64FE,
-        write_sample_float64fe,
-        read_sample_float64fe,
-    },
-    {
-        SoundIoFormatS32NE,
-        write_sample_s32ne,
-        read_sample_s32ne,
-    },
-    {
-        SoundIoFormatS32FE,
-        write_sample_s32fe,
-        read_sample_s32fe,
-    },
-    {
-        SoundIoFormatU32NE,
-        write_sample_u32ne,
-        read_sample_u32ne,
-    },
-    {
-        SoundIoFormatU32FE,
-        write_sample_u32fe,
-        read_sample_u32fe,
-    },
-    {
-        SoundIoFormatS24NE,
-        write_sample_s24ne,
-        read_sample_s24ne,
-    },
-    {
-        SoundIoFormatS24FE,
-        write_sample_s24fe,
-        read_sample_s24fe,
-    },
-    {
-        SoundIoFormatU24NE,
-        write_sample_u24ne,
-        read_sample_u24ne,
-    },
-    {
-        SoundIoFormatU24FE,
-        write_sample_u24fe,
-        read_sample_u24fe,
-    },
-    {
-        SoundIoFormatS16NE,
-        write_sample_s16ne,
-        read_sample_s16ne,
-    },
-    {
-        SoundIoFormatS16FE,
-        write_sample_s16fe,
-        read_sample_s16fe,
-    },
-    {
-        SoundIoFormatU16NE,
-        write_sample_u16ne,
-        read_sample_u16ne,
-    },
-    {
-        SoundIoFormatU16FE,
-        write_sample_u16fe,
-        read_sample_u16fe,
-    },
-    {
-        SoundIoFormatS8,
-        write_sample_s8,
-        read_sample_s8,
-    },
-    {
-        SoundIoFormatU8,
-        write_sample_u8,
-        read_sample_u8,
-    },
+    const SampleFormatInfo *sample_format_info;
+    // when another device drives the pipeline the two clocks drift apart,
+    // so what this one records goes through a conversion which keeps the
+    // output port half full. nullptr otherwise. only touched by the
+    // device callback, and by seek and activate while it does not run.
+    ResampleContext *drift_resample_context;
+    ResampleDriftControl drift_control;
+    // interleaved frames from the device, before the conversion
+    float *drift_buf;
+    int drift_buf_size;
 };
 
 static enum SoundIoChannelLayoutId prioritized_layouts[] = {
@@ -379,24 +155,84 @@ static void midi_events_signal(MidiHardware *midi_hardware) {
     emit_event_ready(context);
 }
 
+static void on_soundio_events_signal(SoundIo *soundio) {
+    GenesisSoundBackend *sound_backend = (GenesisSoundBackend *)soundio->userdata;
+    emit_event_ready(sound_backend->context);
+}
+
+// what a device is to the users of the device list. backends rescan for
+// things like volume changes, which leave this as it was.
+static void append_device_key(ByteBuffer &key, SoundIoDevice *device, bool is_default) {
+    key.append_format("%d %d %d %d %d %d ", device->aim, device->is_raw, is_default,
+            device->probe_error, device->layout_count, device->sample_rate_current);
+    key.append(device->id);
+    key.append("\n");
+    key.append(device->name);
+    key.append("\n");
+}
+
 static void on_devices_change(SoundIo *soundio) {
     GenesisSoundBackend *sound_backend = (GenesisSoundBackend *)soundio->userdata;
     GenesisContext *context = sound_backend->context;
+    ByteBuffer key;
+    int default_input_index = soundio_default_input_device_index(soundio);
+    for (int i = 0; i < soundio_input_device_count(soundio); i += 1) {
+        SoundIoDevice *device = soundio_get_input_device(soundio, i);
+        append_device_key(key, device, i == default_input_index);
+        soundio_device_unref(device);
+    }
+    int default_output_index = soundio_default_output_device_index(soundio);
+    for (int i = 0; i < soundio_output_device_count(soundio); i += 1) {
+        SoundIoDevice *device = soundio_get_output_device(soundio, i);
+        append_device_key(key, device, i == default_output_index);
+        soundio_device_unref(device);
+    }
+    ByteBuffer *last_key = &context->sound_backend_device_keys.at(sound_backend - context->sound_backend_list);
+    if (ByteBuffer::equal(key, *last_key))
+        return;
+    *last_key = key;
+
     if (context->devices_change_callback)
         context->devices_change_callback(context->devices_change_callback_userdata);
 }
 
 double genesis_frames_to_whole_notes(GenesisPipeline *pipeline, int frames, int frame_rate) {
-    double seconds = frames / (double)frame_rate;
-    return whole_notes_per_second * seconds;
+    return pipeline->tempo_map.seconds_to_whole_notes(frames / (double)frame_rate);
 }
 
 int genesis_whole_notes_to_frames(GenesisPipeline *pipeline, double whole_notes, int frame_rate) {
-    return frame_rate * genesis_whole_notes_to_seconds(pipeline, whole_notes, frame_rate);
+    return frame_rate * pipeline->tempo_map.whole_notes_to_seconds(whole_notes);
 }
 
 double genesis_whole_notes_to_seconds(GenesisPipeline *pipeline, double whole_notes, int frame_rate) {
-    return whole_notes / whole_notes_per_second;
+    return pipeline->tempo_map.whole_notes_to_seconds(whole_notes);
+}
+
+double genesis_whole_notes_add_frames(struct GenesisPipeline *pipeline, double whole_notes,
+        int frame_count, int frame_rate)
+{
+    double seconds = pipeline->tempo_map.whole_notes_to_seconds(whole_notes) + frame_count / (double)frame_rate;
+    return pipeline->tempo_map.seconds_to_whole_notes(seconds);
+}
+
+int genesis_pipeline_set_tempo_map(struct GenesisPipeline *pipeline,
+        const struct GenesisTempoChange *changes, int change_count)
+{
+    if (pipeline->running)
+        return GenesisErrorInvalidState;
+    return pipeline->tempo_map.set(changes, change_count);
+}
+
+int genesis_pipeline_get_tempo_change_count(struct GenesisPipeline *pipeline) {
+    return pipeline->tempo_map.change_count();
+}
+
+struct GenesisTempoChange genesis_pipeline_get_tempo_change(struct GenesisPipeline *pipeline, int index) {
+    return pipeline->tempo_map.change_at(index);
+}
+
+double genesis_pipeline_get_tempo(struct GenesisPipeline *pipeline, double whole_note) {
+    return pipeline->tempo_map.whole_notes_per_minute_at(whole_note);
 }
 
 static void on_backend_disconnect(struct SoundIo *soundio, int err) {
@@ -407,11 +243,24 @@ static void on_backend_disconnect(struct SoundIo *soundio, int err) {
         context->sound_backend_disconnect_callback(context->sound_backend_disconnect_userdata);
 }
 
+static void destroy_thread_pool(GenesisPipeline *pipeline) {
+    if (!pipeline->thread_pool)
+        return;
+    for (int i = 0; i < pipeline->thread_pool_size; i += 1) {
+        GenesisPipelineWorker *worker = &pipeline->thread_pool[i];
+        destroy(worker->scratch_arena, worker->scratch_arena_size);
+    }
+    destroy(pipeline->thread_pool, pipeline->thread_pool_size);
+    pipeline->thread_pool = nullptr;
+    pipeline->thread_pool_size = 0;
+}
+
 void genesis_pipeline_destroy(struct GenesisPipeline *pipeline) {
     if (!pipeline)
         return;
 
     genesis_pipeline_stop(pipeline);
+    genesis_pipeline_trace_stop(pipeline);
 
     GenesisContext *context = pipeline->context;
     for (int i = 0; i < context->pipelines.length(); i += 1) {
@@ -430,13 +279,43 @@ void genesis_pipeline_destroy(struct GenesisPipeline *pipeline) {
         int last_index = pipeline->node_descriptors.length() - 1;
         genesis_node_descriptor_destroy(pipeline->node_descriptors.at(last_index));
     }
-    destroy(pipeline->thread_pool, pipeline->thread_pool_size);
+    destroy_thread_pool(pipeline);
 
     destroy(pipeline, 1);
 }
 
+// must be called with the pipeline stopped
+static int create_thread_pool(GenesisPipeline *pipeline) {
+    destroy_thread_pool(pipeline);
+
+    int concurrency = pipeline->context->executor_thread_count;
+    // realtime pipelines subtract one to make room for GUI thread, OS, and
+    // other miscellaneous interruptions. offline rendering has nothing to
+    // keep responsive.
+    int thread_pool_size = pipeline->offline ? concurrency : max(1, concurrency - 1);
+    if (pipeline->thread_count_limit > 0)
+        thread_pool_size = min(thread_pool_size, pipeline->thread_count_limit);
+    pipeline->thread_pool = allocate_zero<GenesisPipelineWorker>(thread_pool_size);
+    if (!pipeline->thread_pool)
+        return GenesisErrorNoMem;
+    pipeline->thread_pool_size = thread_pool_size;
+    pipeline->thread_scaling.active_thread_count.store(thread_pool_size);
+    for (int i = 0; i < pipeline->thread_pool_size; i += 1) {
+        GenesisPipelineWorker *worker = &pipeline->thread_pool[i];
+        worker->pipeline = pipeline;
+        worker->index = i;
+    }
+    return 0;
+}
+
 int genesis_pipeline_create(struct GenesisContext *context,
         struct GenesisPipeline **out_pipeline)
+{
+    return genesis_pipeline_create_with_scheduler(context, GenesisSchedulerWorkStealing, out_pipeline);
+}
+
+int genesis_pipeline_create_with_scheduler(struct GenesisContext *context,
+        enum GenesisScheduler scheduler, struct GenesisPipeline **out_pipeline)
 {
     GenesisPipeline *pipeline = create_zero<GenesisPipeline>();
 
@@ -446,21 +325,19 @@ int genesis_pipeline_create(struct GenesisContext *context,
     }
 
     pipeline->context = context;
+    pipeline->scheduler = scheduler;
     pipeline->latency = 0.020; // 20ms
     pipeline->target_sample_rate = 44100;
+    pipeline->fuse_chains = true;
+    pipeline->flush_denormals = true;
     pipeline->channel_layout = *soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdStereo);
 
     pipeline->stream_fail_flag.test_and_set();
 
-    int concurrency = os_concurrency();
-    // subtract one to make room for GUI thread, OS, and other miscellaneous
-    // interruptions.
-    pipeline->thread_pool_size = max(1, concurrency - 1);
-    pipeline->thread_pool_size = 1; // TODO remove this debug
-    pipeline->thread_pool = allocate_zero<OsThread *>(pipeline->thread_pool_size);
-    if (!pipeline->thread_pool) {
+    int err;
+    if ((err = create_thread_pool(pipeline))) {
         genesis_pipeline_destroy(pipeline);
-        return GenesisErrorNoMem;
+        return err;
     }
 
     for (int i = 0; i < array_length(plugin_create_list); i += 1) {
@@ -472,7 +349,6 @@ int genesis_pipeline_create(struct GenesisContext *context,
         }
     }
 
-    int err;
     if ((err = context->pipelines.append(pipeline))) {
         genesis_pipeline_destroy(pipeline);
         return err;
@@ -483,10 +359,54 @@ int genesis_pipeline_create(struct GenesisContext *context,
     return 0;
 }
 
+static int init_once(void) {
+    sample_format_init();
+    dsp_kernels_init();
+    return audio_file_init();
+}
+
+static void set_executor_cpu_mask(GenesisContext *context, uint64_t cpu_mask) {
+    context->executor_thread_attributes.cpu_mask = cpu_mask;
+    int cpu_count = min(os_concurrency(), 64);
+    uint64_t all_cpus = (cpu_count == 64) ? ~(uint64_t)0 : (((uint64_t)1 << cpu_count) - 1);
+    uint64_t other_cpus = all_cpus & ~cpu_mask;
+    context->background_thread_attributes.cpu_mask = (cpu_mask && other_cpus) ? other_cpus : 0;
+}
+
+// the pipeline threads are spread over the NUMA nodes in proportion to how
+// many of their CPUs each node has, and kept there, so that the buffers of
+// the subgraphs they run can be local to them
+static void assign_executor_numa_nodes(GenesisContext *context) {
+    uint64_t cpus = context->executor_thread_attributes.cpu_mask;
+    if (!cpus) {
+        for (int i = 0; i < context->numa_cpu_masks.length(); i += 1)
+            cpus |= context->numa_cpu_masks.at(i);
+    }
+    int cpu = -1;
+    for (int i = 0; i < context->executor_thread_count; i += 1) {
+        GenesisExecutorThread *thread = &context->executor_threads[i];
+        thread->numa_node = -1;
+        thread->numa_cpu_mask = 0;
+        if (!cpus)
+            continue;
+        do {
+            cpu = (cpu + 1) % 64;
+        } while (!(cpus & ((uint64_t)1 << cpu)));
+        for (int numa_node = 0; numa_node < context->numa_cpu_masks.length(); numa_node += 1) {
+            uint64_t numa_cpus = context->numa_cpu_masks.at(numa_node);
+            if (numa_cpus & ((uint64_t)1 << cpu)) {
+                thread->numa_node = numa_node;
+                thread->numa_cpu_mask = numa_cpus & cpus;
+                break;
+            }
+        }
+    }
+}
+
 int genesis_context_create(struct GenesisContext **out_context) {
     *out_context = nullptr;
 
-    os_init(audio_file_init);
+    os_init(init_once);
 
     GenesisContext *context = create_zero<GenesisContext>();
     if (!context) {
@@ -504,8 +424,72 @@ int genesis_context_create(struct GenesisContext **out_context) {
         return GenesisErrorNoMem;
     }
 
+    if (!(context->events_poll_event = os_poll_event_create())) {
+        genesis_context_destroy(context);
+        return GenesisErrorSystemResources;
+    }
+
+    if (!(context->audio_file_readers_mutex = os_mutex_create())) {
+        genesis_context_destroy(context);
+        return GenesisErrorNoMem;
+    }
+
+    int err;
+    if ((err = mirrored_memory_pool_init(&context->ring_buffer_pool))) {
+        genesis_context_destroy(context);
+        return err;
+    }
+    context->audio_file_resident_bytes = GENESIS_DEFAULT_AUDIO_FILE_RESIDENT_BYTES;
+    context->audio_asset_cache_bytes = GENESIS_DEFAULT_AUDIO_ASSET_CACHE_BYTES;
+
+    context->executor_thread_count = max(1, os_concurrency());
+    int job_thread_count = context->executor_thread_count;
+    context->executor_thread_attributes.policy = OsThreadPolicyRealtimeFifo;
+    context->background_thread_attributes.policy = OsThreadPolicyNormal;
+    // on a hybrid CPU the pipeline threads stay on the performance cores;
+    // a block is only done when its slowest node is
+    OsCpuTopology topology;
+    if (!os_get_cpu_topology(&topology)) {
+        uint64_t fast_cpus = os_cpu_topology_mask(&topology, 0);
+        if (topology.performance_class_count > 1 && fast_cpus) {
+            context->executor_thread_count = __builtin_popcountll(fast_cpus);
+            set_executor_cpu_mask(context, fast_cpus);
+        }
+        job_thread_count = max(1, topology.online_count);
+        if (topology.numa_node_count > 1 &&
+                (err = context->numa_cpu_masks.resize(topology.numa_node_count)))
+        {
+            os_cpu_topology_deinit(&topology);
+            genesis_context_destroy(context);
+            return err;
+        }
+        for (int i = 0; i < context->numa_cpu_masks.length(); i += 1)
+            context->numa_cpu_masks.at(i) = os_cpu_topology_numa_mask(&topology, i);
+        os_cpu_topology_deinit(&topology);
+    }
+    context->executor_threads = allocate_zero<GenesisExecutorThread>(context->executor_thread_count);
+    if (!context->executor_threads) {
+        genesis_context_destroy(context);
+        return GenesisErrorNoMem;
+    }
+    for (int i = 0; i < context->executor_thread_count; i += 1) {
+        GenesisExecutorThread *thread = &context->executor_threads[i];
+        thread->context = context;
+        thread->index = i;
+    }
+    assign_executor_numa_nodes(context);
+
+    // the job threads keep to the CPUs that the background attributes leave
+    // them when there are any, and start with the first job, once
+    // genesis_context_set_pipeline_threads has had its say
+    if ((err = job_system_create(&context->background_thread_attributes, job_thread_count,
+                    &context->job_system)))
+    {
+        genesis_context_destroy(context);
+        return err;
+    }
 
-    int err = create_midi_hardware(context, "genesis", midi_events_signal, on_midi_devices_change,
+    err = create_midi_hardware(context, "genesis", midi_events_signal, on_midi_devices_change,
             context, &context->midi_hardware);
     if (err) {
         genesis_context_destroy(context);
@@ -519,7 +503,9 @@ int genesis_context_create(struct GenesisContext **out_context) {
     }
     context->sound_backend_count = soundio_backend_count(token_soundio);
     context->sound_backend_list = allocate_zero<GenesisSoundBackend>(context->sound_backend_count);
-    if (!context->sound_backend_list) {
+    if (!context->sound_backend_list ||
+        context->sound_backend_device_keys.resize(context->sound_backend_count))
+    {
         soundio_destroy(token_soundio);
         genesis_context_destroy(context);
         return GenesisErrorNoMem;
@@ -537,6 +523,7 @@ int genesis_context_create(struct GenesisContext **out_context) {
         sound_backend->soundio->app_name = "Genesis";
         sound_backend->soundio->on_backend_disconnect = on_backend_disconnect;
         sound_backend->soundio->on_devices_change = on_devices_change;
+        sound_backend->soundio->on_events_signal = on_soundio_events_signal;
         sound_backend->connect_err = soundio_connect_backend(sound_backend->soundio, sound_backend->backend);
     }
 
@@ -556,6 +543,12 @@ int genesis_context_create(struct GenesisContext **out_context) {
     return 0;
 }
 
+static void executor_destroy_threads(GenesisContext *context);
+
+JobSystem *genesis_context_job_system(GenesisContext *context) {
+    return context->job_system;
+}
+
 void genesis_context_destroy(struct GenesisContext *context) {
     if (!context)
         return;
@@ -565,6 +558,14 @@ void genesis_context_destroy(struct GenesisContext *context) {
         genesis_pipeline_destroy(pipeline);
     }
 
+    if (context->executor_threads) {
+        executor_destroy_threads(context);
+        destroy(context->executor_threads, context->executor_thread_count);
+    }
+
+    audio_file_reader_thread_destroy(context);
+    job_system_destroy(context->job_system);
+
     for (int i = 0; i < context->out_formats.length(); i += 1) {
         destroy(context->out_formats.at(i), 1);
     }
@@ -585,12 +586,81 @@ void genesis_context_destroy(struct GenesisContext *context) {
 
     os_mutex_destroy(context->events_mutex);
     os_cond_destroy(context->events_cond);
-
+    os_poll_event_destroy(context->events_poll_event);
+    os_mutex_destroy(context->audio_file_readers_mutex);
+    mirrored_memory_pool_deinit(&context->ring_buffer_pool);
 
     destroy(context, 1);
 }
 
+int genesis_context_set_pipeline_threads(struct GenesisContext *context,
+        enum GenesisThreadPolicy policy, int priority, uint64_t cpu_mask)
+{
+    if (context->executor_threads_created)
+        return GenesisErrorInvalidState;
+    if (policy < GenesisThreadPolicyNormal || policy > GenesisThreadPolicyRealtimeRoundRobin || priority < 0)
+        return GenesisErrorInvalidParam;
+
+    switch (policy) {
+        case GenesisThreadPolicyNormal:
+            context->executor_thread_attributes.policy = OsThreadPolicyNormal;
+            break;
+        case GenesisThreadPolicyRealtimeFifo:
+            context->executor_thread_attributes.policy = OsThreadPolicyRealtimeFifo;
+            break;
+        case GenesisThreadPolicyRealtimeRoundRobin:
+            context->executor_thread_attributes.policy = OsThreadPolicyRealtimeRoundRobin;
+            break;
+    }
+    context->executor_thread_attributes.priority = priority;
+    set_executor_cpu_mask(context, cpu_mask);
+    assign_executor_numa_nodes(context);
+    return 0;
+}
+
+static void reset_adaptive_latency_window(GenesisPipeline *pipeline) {
+    GenesisAdaptiveLatency *adaptive = &pipeline->adaptive_latency;
+    adaptive->window_start = os_get_time();
+    adaptive->min_headroom_ns.store(LONG_MAX);
+    adaptive->max_callback_ns.store(0);
+}
+
+// the stream has already stopped, so reopening it costs nothing more.
+// returns whether the pipeline is playing again.
+static bool grow_adaptive_latency(GenesisPipeline *pipeline) {
+    GenesisAdaptiveLatency *adaptive = &pipeline->adaptive_latency;
+    if (!adaptive->enabled || pipeline->offline || !pipeline->running.load())
+        return false;
+    double latency = max(adaptive->min_latency, min(adaptive->max_latency, pipeline->latency * 1.5));
+    return !genesis_pipeline_reopen_devices(pipeline, latency);
+}
+
+// lowering the latency only takes effect at the next resume, so that it
+// never interrupts playback. latency is cut only when the spare audio of
+// the last window would have covered the cut twice over, with callbacks
+// short enough for the smaller device buffer.
+static void shrink_adaptive_latency(GenesisPipeline *pipeline) {
+    GenesisAdaptiveLatency *adaptive = &pipeline->adaptive_latency;
+    if (!adaptive->enabled || pipeline->offline || !pipeline->running.load())
+        return;
+    if (os_get_time() - adaptive->window_start < GENESIS_ADAPTIVE_LATENCY_SHRINK_SECONDS)
+        return;
+    long min_headroom_ns = adaptive->min_headroom_ns.load();
+    double max_callback_duration = adaptive->max_callback_ns.load() / 1000000000.0;
+    reset_adaptive_latency_window(pipeline);
+    if (min_headroom_ns == LONG_MAX)
+        return;
+    double headroom = min_headroom_ns / 1000000000.0;
+    double latency = max(adaptive->min_latency, pipeline->latency * 0.9);
+    double current_latency = pipeline->actual_latency * 0.75 + pipeline->device_latency;
+    if (headroom >= 2.0 * (current_latency - latency) && max_callback_duration < latency * 0.25 * 0.5)
+        pipeline->latency = latency;
+}
+
+// the poll event is reset first, so that an event that comes in while
+// flushing signals it again
 void genesis_flush_events(struct GenesisContext *context) {
+    os_poll_event_reset(context->events_poll_event);
     for (int i = 0; i < context->sound_backend_count; i += 1) {
         GenesisSoundBackend *sound_backend = &context->sound_backend_list[i];
         if (!sound_backend->connect_err)
@@ -601,8 +671,10 @@ void genesis_flush_events(struct GenesisContext *context) {
     for (int i = 0; i < context->pipelines.length(); i += 1) {
         GenesisPipeline *pipeline = context->pipelines.at(i);
         if (!pipeline->stream_fail_flag.test_and_set()) {
-            if (pipeline->underrun_callback)
+            if (!grow_adaptive_latency(pipeline) && pipeline->underrun_callback)
                 pipeline->underrun_callback(pipeline->underrun_callback_userdata);
+        } else {
+            shrink_adaptive_latency(pipeline);
         }
     }
 }
@@ -618,6 +690,11 @@ void genesis_wakeup(struct GenesisContext *context) {
     os_mutex_lock(context->events_mutex);
     os_cond_signal(context->events_cond, context->events_mutex);
     os_mutex_unlock(context->events_mutex);
+    os_poll_event_signal(context->events_poll_event);
+}
+
+intptr_t genesis_get_event_fd(struct GenesisContext *context) {
+    return os_poll_event_handle(context->events_poll_event);
 }
 
 void genesis_set_event_callback(struct GenesisContext *context,
@@ -646,15 +723,35 @@ const char *genesis_node_descriptor_description(const struct GenesisNodeDescript
     return node_descriptor->description;
 }
 
-static GenesisPort *create_port_from_descriptor(GenesisPortDescriptor *port_descriptor) {
+// a node, its array of ports and the ports themselves are one allocation,
+// so that walking the ports of a node to see whether it is ready stays in
+// memory that is close together. every part starts on a cache line of its
+// own, since different threads write to neighbouring ports.
+static const size_t node_block_alignment = 64;
+
+static size_t align_node_block(size_t offset) {
+    return (offset + node_block_alignment - 1) & ~(node_block_alignment - 1);
+}
+
+static size_t port_size(GenesisPortDescriptor *port_descriptor) {
+    switch (port_descriptor->port_type) {
+        case GenesisPortTypeAudioIn:
+        case GenesisPortTypeAudioOut:
+            return sizeof(GenesisAudioPort);
+        case GenesisPortTypeEventsIn:
+        case GenesisPortTypeEventsOut:
+            return sizeof(GenesisEventsPort);
+    }
+    panic("invalid port type");
+}
+
+static GenesisPort *create_port_from_descriptor(GenesisPortDescriptor *port_descriptor, char *memory) {
     GenesisPort *port = nullptr;
     switch (port_descriptor->port_type) {
         case GenesisPortTypeAudioIn:
         case GenesisPortTypeAudioOut:
             {
-                GenesisAudioPort *audio_port = create_zero<GenesisAudioPort>();
-                if (!audio_port)
-                    return nullptr;
+                GenesisAudioPort *audio_port = new (memory) GenesisAudioPort();
                 audio_port->sample_buffer_err = GenesisErrorInvalidState;
                 port = (GenesisPort*)audio_port;
                 break;
@@ -662,9 +759,7 @@ static GenesisPort *create_port_from_descriptor(GenesisPortDescriptor *port_desc
         case GenesisPortTypeEventsIn:
         case GenesisPortTypeEventsOut:
             {
-                GenesisEventsPort *events_port = create_zero<GenesisEventsPort>();
-                if (!events_port)
-                    return nullptr;
+                GenesisEventsPort *events_port = new (memory) GenesisEventsPort();
                 events_port->event_buffer_err = GenesisErrorInvalidState;
                 port = (GenesisPort*)events_port;
                 break;
@@ -676,28 +771,34 @@ static GenesisPort *create_port_from_descriptor(GenesisPortDescriptor *port_desc
 }
 
 struct GenesisNode *genesis_node_descriptor_create_node(struct GenesisNodeDescriptor *node_descriptor) {
-    GenesisNode *node = create_zero<GenesisNode>();
-    if (!node) {
-        genesis_node_destroy(node);
+    int port_count = node_descriptor->port_descriptors.length();
+    size_t ports_offset = align_node_block(sizeof(GenesisNode));
+    size_t block_size = align_node_block(ports_offset + port_count * sizeof(GenesisPort *));
+    for (int i = 0; i < port_count; i += 1)
+        block_size += align_node_block(port_size(node_descriptor->port_descriptors.at(i)));
+    char *block = allocate_zero_aligned<char>(block_size, node_block_alignment);
+    if (!block)
         return nullptr;
-    }
+
+    GenesisNode *node = new (block) GenesisNode();
     node->set_index = -1;
+    node->latency_frames = -1;
+    node->numa_node = -1;
     node->descriptor = node_descriptor;
-    node->port_count = node_descriptor->port_descriptors.length();
-    node->ports = allocate_zero<GenesisPort*>(node->port_count);
-    if (!node->ports) {
-        genesis_node_destroy(node);
-        return nullptr;
-    }
-    for (int i = 0; i < node->port_count; i += 1) {
-        GenesisPort *port = create_port_from_descriptor(node_descriptor->port_descriptors.at(i));
-        if (!port) {
-            genesis_node_destroy(node);
-            return nullptr;
-        }
+    node->port_count = port_count;
+    node->ports = reinterpret_cast<GenesisPort **>(block + ports_offset);
+    size_t port_offset = align_node_block(ports_offset + port_count * sizeof(GenesisPort *));
+    for (int i = 0; i < port_count; i += 1) {
+        GenesisPortDescriptor *port_descriptor = node_descriptor->port_descriptors.at(i);
+        GenesisPort *port = create_port_from_descriptor(port_descriptor, block + port_offset);
+        port_offset += align_node_block(port_size(port_descriptor));
         port->node = node;
         node->ports[i] = port;
     }
+    if (node_params_create(node)) {
+        genesis_node_destroy(node);
+        return nullptr;
+    }
     if (node_descriptor->create) {
         if (node_descriptor->create(node)) {
             genesis_node_destroy(node);
@@ -716,21 +817,26 @@ struct GenesisNode *genesis_node_descriptor_create_node(struct GenesisNodeDescri
     return node;
 }
 
+static MirroredMemoryPool *port_ring_buffer_pool(GenesisPort *port) {
+    return &port->node->descriptor->pipeline->context->ring_buffer_pool;
+}
+
 static void destroy_audio_port(GenesisAudioPort *audio_port) {
     if (!audio_port->sample_buffer_err)
-        ring_buffer_deinit(&audio_port->sample_buffer);
-    destroy(audio_port, 1);
+        ring_buffer_deinit_pooled(&audio_port->sample_buffer, port_ring_buffer_pool(&audio_port->port));
+    destroy(audio_port->silent_granules, audio_port->silent_granule_count);
+    destroy(audio_port->convert_buffer, audio_port->convert_buffer_size);
+    audio_port->~GenesisAudioPort();
 }
 
 static void destroy_events_port(GenesisEventsPort *events_port) {
     if (!events_port->event_buffer_err)
-        ring_buffer_deinit(&events_port->event_buffer);
-    destroy(events_port, 1);
+        ring_buffer_deinit_pooled(&events_port->event_buffer, port_ring_buffer_pool(&events_port->port));
+    events_port->~GenesisEventsPort();
 }
 
+// the memory goes with the node
 static void destroy_port(struct GenesisPort *port) {
-    if (!port)
-        return;
     switch (port->descriptor->port_type) {
         case GenesisPortTypeAudioIn:
         case GenesisPortTypeAudioOut:
@@ -749,14 +855,25 @@ void genesis_node_disconnect_all_ports(struct GenesisNode *node) {
     for (int i = 0; i < node->port_count; i += 1) {
         GenesisPort *port = node->ports[i];
         if (port) {
-            if (port->output_to)
-                genesis_disconnect_ports(port, port->output_to);
+            while (port->output_count > 0)
+                genesis_disconnect_ports(port, port->output_to[port->output_count - 1]);
             if (port->input_from)
                 genesis_disconnect_ports(port->input_from, port);
         }
     }
 }
 
+static void destroy_node_checkpoints(GenesisNode *node) {
+    GenesisNodeCheckpoints *checkpoints = node->checkpoints;
+    if (!checkpoints)
+        return;
+    for (int i = 0; i < checkpoints->slot_count; i += 1)
+        destroy(checkpoints->slots[i].state, checkpoints->state_size);
+    destroy(checkpoints->slots, checkpoints->slot_count);
+    destroy(checkpoints, 1);
+    node->checkpoints = nullptr;
+}
+
 void genesis_node_destroy(struct GenesisNode *node) {
     if (!node)
         return;
@@ -764,9 +881,7 @@ void genesis_node_destroy(struct GenesisNode *node) {
     GenesisPipeline *pipeline = node->descriptor->pipeline;
 
     // first all disconnect methods on all ports
-    if (node->ports) {
-        genesis_node_disconnect_all_ports(node);
-    }
+    genesis_node_disconnect_all_ports(node);
 
     // call destructor on node
     if (node->constructed && node->descriptor->destroy)
@@ -779,14 +894,12 @@ void genesis_node_destroy(struct GenesisNode *node) {
         node->set_index = -1;
     }
 
-    if (node->ports) {
-        for (int i = 0; i < node->port_count; i += 1) {
-            GenesisPort *port = node->ports[i];
-            destroy_port(port);
-        }
-        destroy(node->ports, node->port_count);
-    }
+    for (int i = 0; i < node->port_count; i += 1)
+        destroy_port(node->ports[i]);
+    node_params_destroy(node);
+    destroy_node_checkpoints(node);
 
+    // frees the ports too
     destroy(node, 1);
 }
 
@@ -837,46 +950,232 @@ int genesis_audio_file_codec_sample_rate_index(
     return codec->sample_rate_list.at(index);
 }
 
-static void get_audio_port_status(GenesisAudioPort *audio_out_port, bool *empty, bool *full) {
-    int fill_count = ring_buffer_fill_count(&audio_out_port->sample_buffer);
-    *empty = (fill_count == 0);
-    *full = (fill_count == audio_out_port->sample_buffer_size);
+// an unconnected out port still has one reader, which nobody advances
+static int port_reader_count(GenesisPort *out_port) {
+    return max(1, out_port->output_count);
 }
 
-static void get_events_port_status(GenesisEventsPort *events_out_port, bool *empty, bool *full) {
-    *full = (events_out_port->time_requested.load() == 0.0);
-    *empty = (*full) ? false : (events_out_port->time_available.load() == 0.0);
+// the writer is held back by the reader that requested the most
+static double events_port_time_requested(GenesisEventsPort *events_out_port) {
+    double time_requested = events_out_port->time_requested[0].load();
+    for (int i = 1; i < port_reader_count(&events_out_port->port); i += 1)
+        time_requested = max(time_requested, events_out_port->time_requested[i].load());
+    return time_requested;
 }
 
-static void get_port_status(GenesisPort *port, bool *empty, bool *full) {
-    switch (port->descriptor->port_type) {
-        case GenesisPortTypeAudioOut:
-            get_audio_port_status((GenesisAudioPort *)port, empty, full);
-            return;
-        case GenesisPortTypeEventsOut:
-            get_events_port_status((GenesisEventsPort *)port, empty, full);
-            return;
-        case GenesisPortTypeAudioIn:
-        case GenesisPortTypeEventsIn:
-            panic("expected out port");
-    }
+// the port whose ring buffer holds the frames of audio_out_port
+static GenesisAudioPort *audio_buffer_port(GenesisAudioPort *audio_out_port) {
+    GenesisAudioPort *buffer_port = audio_out_port->in_place_buffer_port;
+    return buffer_port ? buffer_port : audio_out_port;
+}
+
+// which reader of its source's frames audio_in_port is
+static int audio_in_port_reader(GenesisAudioPort *audio_in_port) {
+    GenesisAudioPort *source = (GenesisAudioPort *)audio_in_port->port.input_from;
+    return source->in_place_buffer_port ? audio_in_port->in_place_source_reader : audio_in_port->port.reader_index;
+}
+
+// how many bytes the writer of audio_out_port has room for. an in place
+// port has room for what its node has not read yet.
+static int audio_out_port_free_bytes(GenesisAudioPort *audio_out_port) {
+    GenesisAudioPort *buffer_port = audio_out_port->in_place_buffer_port;
+    if (buffer_port)
+        return ring_buffer_reader_fill_count(&buffer_port->sample_buffer, audio_out_port->in_place_reader);
+    return audio_out_port->sample_buffer_size - ring_buffer_fill_count(&audio_out_port->sample_buffer);
+}
+
+// forgets which frames of audio_out_port are silence, for when the offsets
+// of its frames change
+static void reset_silent_granules(GenesisAudioPort *audio_out_port) {
+    for (int i = 0; i < audio_out_port->silent_granule_count; i += 1)
+        audio_out_port->silent_granules[i].store(-1);
+    audio_out_port->silence_granule = -1;
+    audio_out_port->silence_granule_silent = false;
+}
+
+// records that the writer of audio_out_port wrote byte_count bytes at offset
+// into the buffer that holds its frames. a granule is only silent when
+// every write to it was.
+static void mark_written(GenesisAudioPort *audio_out_port, long offset, int byte_count, bool silent) {
+    if (byte_count <= 0 || audio_out_port->silent_granule_count == 0)
+        return;
+    long granule_size = audio_out_port->silence_granule_size;
+    long first = offset / granule_size;
+    long last = (offset + byte_count - 1) / granule_size;
+    bool granule_silent = silent && (offset % granule_size == 0 ||
+            (audio_out_port->silence_granule == first && audio_out_port->silence_granule_silent));
+    for (long granule = first; ; granule += 1) {
+        audio_out_port->silent_granules[granule % audio_out_port->silent_granule_count].store(
+                granule_silent ? granule : -1, std::memory_order_release);
+        if (granule == last)
+            break;
+        granule_silent = silent;
+    }
+    audio_out_port->silence_granule = last;
+    audio_out_port->silence_granule_silent = granule_silent;
+}
+
+// how many of the bytes that reader has ready from audio_out_port are known
+// to be silence, from where it reads on
+static int audio_port_silent_bytes(GenesisAudioPort *audio_out_port, int reader) {
+    if (audio_out_port->silent_granule_count == 0)
+        return 0;
+    RingBuffer *rb = &audio_buffer_port(audio_out_port)->sample_buffer;
+    // the fill count first, so that the granules are at least as new
+    int fill_count = ring_buffer_reader_fill_count(rb, reader);
+    long start = rb->read_offsets[reader].load();
+    long end = start + fill_count;
+    long granule_size = audio_out_port->silence_granule_size;
+    long offset = start;
+    while (offset < end) {
+        long granule = offset / granule_size;
+        long slot = audio_out_port->silent_granules[granule % audio_out_port->silent_granule_count].load(
+                std::memory_order_acquire);
+        if (slot != granule)
+            break;
+        offset = (granule + 1) * granule_size;
+    }
+    return min(offset, end) - start;
+}
+
+// with a block size, a port is empty until a whole block is ready and full
+// once there is no room for another whole block. full is as the writer sees
+// it and empty is as the given reader sees it.
+static void get_audio_port_status(GenesisAudioPort *audio_out_port, int reader, bool *empty, bool *full) {
+    int block_size = audio_out_port->port.node->descriptor->pipeline->block_size;
+    int block_byte_count = max(1, block_size) * audio_out_port->bytes_per_frame;
+    if (audio_out_port->in_place_buffer_port)
+        reader = audio_in_port_reader((GenesisAudioPort *)audio_out_port->port.output_to[reader]);
+    RingBuffer *rb = &audio_buffer_port(audio_out_port)->sample_buffer;
+    int reader_fill_count = ring_buffer_reader_fill_count(rb, reader);
+    *empty = (reader_fill_count < block_byte_count);
+    *full = (audio_out_port_free_bytes(audio_out_port) < block_byte_count);
+}
+
+static void get_events_port_status(GenesisEventsPort *events_out_port, int reader, bool *empty, bool *full) {
+    *full = (events_port_time_requested(events_out_port) == 0.0);
+    *empty = (*full) ? false : (events_out_port->time_available[reader].load() == 0.0);
+}
+
+static void get_out_port_status(GenesisPort *port, int reader, bool *empty, bool *full) {
+    switch (port->descriptor->port_type) {
+        case GenesisPortTypeAudioOut:
+            get_audio_port_status((GenesisAudioPort *)port, reader, empty, full);
+            return;
+        case GenesisPortTypeEventsOut:
+            get_events_port_status((GenesisEventsPort *)port, reader, empty, full);
+            return;
+        case GenesisPortTypeAudioIn:
+        case GenesisPortTypeEventsIn:
+            panic("expected out port");
+    }
     panic("invalid port type");
 }
 
-static void run_node(GenesisNode *node) {
-    const GenesisNodeDescriptor *node_descriptor = node->descriptor;
-    node_descriptor->run(node);
-    node->being_processed = false;
+static void get_port_status(GenesisPort *out_port, bool *empty, bool *full) {
+    get_out_port_status(out_port, 0, empty, full);
 }
 
-static void queue_node_if_ready(GenesisPipeline *pipeline, GenesisNode *node, bool recursive) {
+// the status of the out port that in_port reads from, as in_port sees it
+static void get_input_status(GenesisPort *in_port, bool *empty, bool *full) {
+    get_out_port_status(in_port->input_from, in_port->reader_index, empty, full);
+}
+
+// the worker running on this thread, or nullptr if this is not a worker thread
+static thread_local GenesisPipelineWorker *current_worker = nullptr;
+// what genesis_node_scratch gives the node running on this thread
+static thread_local char *current_scratch_arena = nullptr;
+// the floating point mode last set on this thread: -1 for not yet, or
+// whether denormals are flushed. threads are shared between pipelines.
+static thread_local int thread_flush_denormals = -1;
+
+static void use_denormals_mode(GenesisPipeline *pipeline) {
+    if (thread_flush_denormals == (int)pipeline->flush_denormals)
+        return;
+    denormals_set_flush(pipeline->flush_denormals);
+    thread_flush_denormals = pipeline->flush_denormals;
+}
+
+static void wake_executor_thread(GenesisExecutorThread *thread) {
+    thread->wake_epoch += 1;
+    futex_wake(reinterpret_cast<int*>(&thread->wake_epoch), 1);
+}
+
+// thread 0 may keep to realtime pipelines (see executor_scan), so an
+// offline pipeline's workers run on the threads from 1 on, and only its
+// last worker runs on thread 0, when it has one for every thread. that way
+// an offline pipeline with fewer threads still has all of them.
+static int worker_thread_index(GenesisPipeline *pipeline, int worker_index) {
+    int thread_count = pipeline->context->executor_thread_count;
+    return pipeline->offline ? (worker_index + 1) % thread_count : worker_index;
+}
+
+static int thread_worker_index(GenesisPipeline *pipeline, int thread_index) {
+    int thread_count = pipeline->context->executor_thread_count;
+    return pipeline->offline ? (thread_index + thread_count - 1) % thread_count : thread_index;
+}
+
+// wakes idle threads among those the pipeline's active workers run on.
+// thread 0 may keep to realtime pipelines, so it does not count for an
+// offline one. a woken thread may take another pipeline's node first, so
+// two are woken. busy threads find the node when they finish theirs.
+static void wake_idle_worker(GenesisPipeline *pipeline) {
+    GenesisContext *context = pipeline->context;
+    if (context->executor_idle_count.load() == 0)
+        return;
+    int worker_count = min(pipeline->thread_pool_size,
+            pipeline->thread_scaling.active_thread_count.load(std::memory_order_relaxed));
+    int woken_count = 0;
+    for (int i = 0; i < worker_count && woken_count < 2; i += 1) {
+        int thread_index = worker_thread_index(pipeline, i);
+        GenesisExecutorThread *thread = &context->executor_threads[thread_index];
+        if (!thread->idle.load())
+            continue;
+        wake_executor_thread(thread);
+        if (thread_index != 0 || !pipeline->offline)
+            woken_count += 1;
+    }
+}
+
+static void count_ready_node(GenesisThreadScaling *scaling) {
+    int ready_count = scaling->ready_count.fetch_add(1, std::memory_order_relaxed) + 1;
+    int peak_ready_count = scaling->peak_ready_count.load(std::memory_order_relaxed);
+    while (ready_count > peak_ready_count && !scaling->peak_ready_count.compare_exchange_weak(
+                peak_ready_count, ready_count, std::memory_order_relaxed)) {}
+}
+
+static void enqueue_node(GenesisPipeline *pipeline, GenesisNode *node) {
+    // keep producer/consumer chains on the same thread so that the buffers
+    // between them are still in cache
+    GenesisPipelineWorker *worker = current_worker;
+    // counted before it can be taken, so that the count stays positive
+    if (pipeline->thread_scaling.min_thread_count)
+        count_ready_node(&pipeline->thread_scaling);
+    if (pipeline->scheduler == GenesisSchedulerCriticalPath) {
+        // a node is queued at most once at a time, so every level has room
+        if (!pipeline->priority_queues[node->priority_level].try_push(node))
+            panic("priority queue full");
+    } else if (pipeline->scheduler == GenesisSchedulerWorkStealing && worker && worker->pipeline == pipeline) {
+        worker->deque.push(node);
+    } else {
+        pipeline->task_queue.enqueue(node);
+    }
+    wake_idle_worker(pipeline);
+}
+
+static void queue_node_if_ready(GenesisPipeline *pipeline, GenesisNode *node, bool recursive);
+
+// returns whether node was ready and is now claimed by the caller, who then
+// either queues it or runs it
+static bool claim_node_if_ready(GenesisPipeline *pipeline, GenesisNode *node, bool recursive) {
     if (node->being_processed) {
         // this node is already being processed; no point in queueing it again
-        return;
+        return false;
     }
-    if (!node->descriptor->run) {
-        // this node has no run function; no point in queuing it
-        return;
+    if (!node->descriptor->run || node->device_driven.load()) {
+        // this node has no run function, or a device callback runs it; no
+        // point in queuing it
+        return false;
     }
     // make sure all the children of this node are ready
     bool waiting_for_any_children = false;
@@ -885,7 +1184,7 @@ static void queue_node_if_ready(GenesisPipeline *pipeline, GenesisNode *node, bo
     for (int parent_port_i = 0; parent_port_i < node->port_count; parent_port_i += 1) {
         GenesisPort *port = node->ports[parent_port_i];
 
-        if (port->output_to) {
+        if (port->output_count > 0) {
             has_any_output = true;
             bool empty, full;
             get_port_status(port, &empty, &full);
@@ -895,9 +1194,13 @@ static void queue_node_if_ready(GenesisPipeline *pipeline, GenesisNode *node, bo
             GenesisPort *child_port = port->input_from;
             if (child_port && child_port != port) {
                 bool empty, full;
-                get_port_status(child_port, &empty, &full);
+                get_input_status(port, &empty, &full);
                 waiting_for_any_children = waiting_for_any_children || empty;
-                if (!full) {
+                // an in place port is full when its own node has nothing to
+                // work on, so ask that node
+                bool in_place = child_port->descriptor->port_type == GenesisPortTypeAudioOut &&
+                    ((GenesisAudioPort *)child_port)->in_place_buffer_port;
+                if (!full || in_place) {
                     GenesisNode *child_node = child_port->node;
                     if (recursive)
                         queue_node_if_ready(pipeline, child_node, true);
@@ -905,16 +1208,550 @@ static void queue_node_if_ready(GenesisPipeline *pipeline, GenesisNode *node, bo
             }
         }
     }
-    if (!waiting_for_any_children && (!has_any_output || any_output_has_room)) {
-        // we know that we want it enqueued. now make sure it only happens once.
-        if (!node->being_processed.exchange(true))
-            pipeline->task_queue.enqueue(node);
+    // we know that we want it enqueued. now make sure it only happens once.
+    return !waiting_for_any_children && (!has_any_output || any_output_has_room) &&
+        !node->being_processed.exchange(true);
+}
+
+static void queue_node_if_ready(GenesisPipeline *pipeline, GenesisNode *node, bool recursive) {
+    if (claim_node_if_ready(pipeline, node, recursive))
+        enqueue_node(pipeline, node);
+}
+
+static bool node_output_has_room(GenesisNode *node) {
+    bool has_any_output = false;
+    for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+        GenesisPort *port = node->ports[port_i];
+        if (port->output_count > 0) {
+            has_any_output = true;
+            bool empty, full;
+            get_port_status(port, &empty, &full);
+            if (!full)
+                return true;
+        }
+    }
+    return !has_any_output;
+}
+
+static void plan_queue_node(GenesisPipeline *pipeline, GenesisNode *node);
+
+// with a block size, a node waits for a whole block on every audio input.
+// running it anyway would read nothing, so pass the demand on to the
+// producers that are short instead.
+static bool plan_inputs_have_block(GenesisPipeline *pipeline, GenesisNode *node) {
+    bool ready = true;
+    for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+        GenesisPort *port = node->ports[port_i];
+        GenesisPort *child_port = port->input_from;
+        if (child_port && child_port != port && child_port->descriptor->port_type == GenesisPortTypeAudioOut) {
+            bool empty, full;
+            get_input_status(port, &empty, &full);
+            if (empty) {
+                ready = false;
+                plan_queue_node(pipeline, child_port->node);
+            }
+        }
+    }
+    return ready;
+}
+
+// like claim_node_if_ready, for the compiled graph
+static bool plan_claim_node(GenesisPipeline *pipeline, GenesisNode *node) {
+    if (!node->descriptor->run || node->device_driven.load())
+        return false;
+    if (!node_output_has_room(node))
+        return false;
+    if (pipeline->block_size > 0 && !plan_inputs_have_block(pipeline, node))
+        return false;
+    // if the node is being processed, run_node will queue it again when it
+    // finishes.
+    node->plan_rerun = true;
+    if (!node->being_processed.exchange(true)) {
+        node->plan_rerun = false;
+        return true;
+    }
+    return false;
+}
+
+static void plan_queue_node(GenesisPipeline *pipeline, GenesisNode *node) {
+    if (plan_claim_node(pipeline, node))
+        enqueue_node(pipeline, node);
+}
+
+// with claim, a consumer that becomes ready is claimed rather than queued,
+// and this returns whether it was
+static bool plan_edge_done(GenesisPipeline *pipeline, GenesisNode *consumer, bool claim) {
+    if (consumer->plan_pending.fetch_sub(1) == 1) {
+        consumer->plan_pending += consumer->plan_dependency_count;
+        if (claim)
+            return plan_claim_node(pipeline, consumer);
+        plan_queue_node(pipeline, consumer);
+    }
+    return false;
+}
+
+// only the worker running the node writes cost_ns, so the update needs no
+// loop. a new sample counts for an eighth.
+static void record_cost(GenesisNode *node, double seconds) {
+    long ns = (long)(seconds * 1000000000.0);
+    long cost_ns = node->cost_ns.load(std::memory_order_relaxed);
+    cost_ns = (cost_ns == 0) ? ns : cost_ns + (ns - cost_ns) / 8;
+    node->cost_ns.store(max(cost_ns, 1L), std::memory_order_relaxed);
+}
+
+// see GenesisNodeStats::run_time_histogram
+static int histogram_bucket(long ns) {
+    unsigned long us = ns / 1000;
+    int bucket = (us == 0) ? 0 : (int)(sizeof(unsigned long) * 8) - __builtin_clzl(us);
+    return min(bucket, GENESIS_NODE_STATS_HISTOGRAM_SIZE - 1);
+}
+
+static void record_run_time(GenesisNodeStatsCounters *stats, double seconds) {
+    long ns = (long)(seconds * 1000000000.0);
+    stats->run_count += 1;
+    stats->total_run_time_ns += ns;
+    long max_ns = stats->max_run_time_ns.load();
+    while (ns > max_ns && !stats->max_run_time_ns.compare_exchange_weak(max_ns, ns)) {}
+
+    stats->run_time_histogram[histogram_bucket(ns)] += 1;
+}
+
+static void trace_port_fill_counts(PipelineTrace *trace, int lane_index, GenesisNode *node, uint64_t time) {
+    PipelineTraceEvent event;
+    event.time = time;
+    event.duration = 0.0;
+    event.type = PipelineTraceEventTypeFill;
+    event.node_index = node->set_index;
+    for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+        GenesisPort *port = node->ports[port_i];
+        if (port->descriptor->port_type != GenesisPortTypeAudioIn || !port->input_from)
+            continue;
+        event.value = genesis_audio_in_port_fill_count(port);
+        snprintf(event.name, sizeof(event.name), "%s.%s", node->descriptor->name, port->descriptor->name);
+        pipeline_trace_record(trace, lane_index, &event);
+    }
+}
+
+static void trace_node_run(PipelineTrace *trace, int lane_index, GenesisNode *node,
+        uint64_t start_time, double seconds)
+{
+    PipelineTraceEvent event;
+    event.time = start_time;
+    event.duration = seconds;
+    event.type = PipelineTraceEventTypeRun;
+    event.node_index = node->set_index;
+    event.value = 0;
+    snprintf(event.name, sizeof(event.name), "%s", node->descriptor->name);
+    pipeline_trace_record(trace, lane_index, &event);
+}
+
+static bool node_has_block(GenesisNode *node) {
+    for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+        GenesisPort *port = node->ports[port_i];
+        GenesisPort *child_port = port->input_from;
+        if (child_port && child_port != port && child_port->descriptor->port_type == GenesisPortTypeAudioOut) {
+            bool empty, full;
+            get_input_status(port, &empty, &full);
+            if (empty)
+                return false;
+        }
+    }
+    return node_output_has_room(node);
+}
+
+// the frames between checkpoints at the pipeline's sample rate. whole
+// blocks, so that runs which stop at them keep to blocks.
+static int checkpoint_interval_frames(GenesisPipeline *pipeline) {
+    int frame_count = max(1, (int)lround(pipeline->checkpoint_interval * pipeline->target_sample_rate));
+    int block_size = pipeline->block_size;
+    if (block_size > 0)
+        frame_count = (frame_count + block_size - 1) / block_size * block_size;
+    return frame_count;
+}
+
+static GenesisPort *checkpoint_port(GenesisNode *node) {
+    GenesisPort *out_port = nullptr;
+    for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+        GenesisPort *port = node->ports[port_i];
+        GenesisPortType port_type = port->descriptor->port_type;
+        if (port_type == GenesisPortTypeAudioIn && port->input_from)
+            return port;
+        if (port_type == GenesisPortTypeAudioOut && !out_port)
+            out_port = port;
+    }
+    return out_port;
+}
+
+// exact is whether the state of the node is what playing from time 0 up to
+// frame would have left
+static void set_checkpoint_position(GenesisNode *node, long frame, bool exact) {
+    GenesisNodeCheckpoints *checkpoints = node->checkpoints;
+    checkpoints->frame = frame;
+    checkpoints->next_frame = (frame / checkpoints->interval_frames + 1) * checkpoints->interval_frames;
+    checkpoints->run_epoch = exact ? node->descriptor->pipeline->checkpoint_epoch.load() : -1;
+}
+
+static long checkpoint_frame_at(GenesisNode *node, double whole_notes) {
+    int sample_rate = ((GenesisAudioPort *)node->checkpoints->port)->sample_rate;
+    return lround(genesis_whole_notes_to_seconds(node->descriptor->pipeline, whole_notes, sample_rate) *
+            sample_rate);
+}
+
+// after activate. from_seek is whether the node was seeked to its timestamp
+// since it last ran.
+static int init_node_checkpoints(GenesisNode *node, bool from_seek) {
+    destroy_node_checkpoints(node);
+    GenesisNodeDescriptor *node_descriptor = node->descriptor;
+    GenesisPipeline *pipeline = node_descriptor->pipeline;
+    GenesisPort *port = checkpoint_port(node);
+    if (pipeline->checkpoint_interval <= 0.0 || !node_descriptor->save_state || !port)
+        return 0;
+    // a node cannot stop at boundaries which fall between its frames or its
+    // blocks, so it keeps no checkpoints and seeks cannot restore any
+    long rate_frame_count = (long)checkpoint_interval_frames(pipeline) * ((GenesisAudioPort *)port)->sample_rate;
+    if (rate_frame_count % pipeline->target_sample_rate != 0)
+        return 0;
+    int interval_frames = rate_frame_count / pipeline->target_sample_rate;
+    if (pipeline->block_size > 0 && interval_frames % pipeline->block_size != 0)
+        return 0;
+
+    GenesisNodeCheckpoints *checkpoints = create_zero<GenesisNodeCheckpoints>();
+    if (!checkpoints)
+        return GenesisErrorNoMem;
+    node->checkpoints = checkpoints;
+    checkpoints->port = port;
+    checkpoints->interval_frames = interval_frames;
+    checkpoints->state_size = max(1, node_descriptor->state_size(node));
+    checkpoints->slots = allocate_zero<GenesisCheckpointSlot>(pipeline->checkpoint_count);
+    if (!checkpoints->slots) {
+        destroy_node_checkpoints(node);
+        return GenesisErrorNoMem;
+    }
+    checkpoints->slot_count = pipeline->checkpoint_count;
+    for (int i = 0; i < checkpoints->slot_count; i += 1) {
+        checkpoints->slots[i].state = allocate_zero<char>(checkpoints->state_size);
+        if (!checkpoints->slots[i].state) {
+            destroy_node_checkpoints(node);
+            return GenesisErrorNoMem;
+        }
+    }
+    long frame = checkpoint_frame_at(node, node->timestamp);
+    set_checkpoint_position(node, frame, from_seek && frame == 0);
+    return 0;
+}
+
+// a node with checkpoints reads or writes its counted port no further than
+// the next boundary, so that the state after the run is the state there
+static int clamp_to_checkpoint(GenesisPort *port, int frame_count) {
+    GenesisNodeCheckpoints *checkpoints = port->node->checkpoints;
+    if (!checkpoints || checkpoints->port != port || checkpoints->run_epoch < 0)
+        return frame_count;
+    return min(frame_count, (int)(checkpoints->next_frame - checkpoints->frame));
+}
+
+static void count_checkpoint_frames(GenesisPort *port, int frame_count) {
+    GenesisNodeCheckpoints *checkpoints = port->node->checkpoints;
+    if (checkpoints && checkpoints->port == port)
+        checkpoints->frame += frame_count;
+}
+
+// after a run of a node with checkpoints. returns whether the run stopped
+// at a boundary, in which case there may be more for it to do.
+static bool take_checkpoint(GenesisNode *node) {
+    GenesisNodeCheckpoints *checkpoints = node->checkpoints;
+    if (checkpoints->frame < checkpoints->next_frame)
+        return false;
+    bool at_boundary = checkpoints->run_epoch >= 0 && checkpoints->frame == checkpoints->next_frame;
+    long index = checkpoints->frame / checkpoints->interval_frames;
+    if (at_boundary) {
+        GenesisCheckpointSlot *slot = &checkpoints->slots[index % checkpoints->slot_count];
+        node->descriptor->save_state(node, slot->state);
+        slot->index = index;
+        slot->epoch = checkpoints->run_epoch;
+    }
+    checkpoints->next_frame = (index + 1) * checkpoints->interval_frames;
+    return at_boundary;
+}
+
+// room for the load to grow by half before the next window sees it
+static const double thread_scaling_headroom = 1.5;
+
+static int min_active_thread_count(GenesisPipeline *pipeline) {
+    return min(pipeline->thread_scaling.min_thread_count, pipeline->thread_pool_size);
+}
+
+// the average number of busy workers over the window, with headroom, is
+// how many are needed. if the active workers were mostly busy and still
+// had nodes waiting on them, one more is. growing is at once, while
+// shrinking lets go of one worker a window.
+int thread_scaling_target(int active_count, int min_count, int pool_size,
+        double busy_threads, int peak_ready_count)
+{
+    int needed = (int)ceil(busy_threads * thread_scaling_headroom);
+    if (busy_threads > active_count * 0.5 && peak_ready_count > active_count)
+        needed = max(needed, active_count + 1);
+    int target = clamp(min_count, needed, pool_size);
+    if (target < active_count)
+        target = active_count - 1;
+    return target;
+}
+
+// called by a pipeline worker after each node run, with os_timestamp().
+// the first to see the window end decides; everyone else goes on at once.
+static void scale_threads(GenesisPipeline *pipeline, uint64_t now) {
+    GenesisThreadScaling *scaling = &pipeline->thread_scaling;
+    uint64_t window_start = scaling->window_start.load(std::memory_order_relaxed);
+    double window_seconds = os_timestamp_to_seconds(now - window_start);
+    if (window_seconds < GENESIS_THREAD_SCALING_WINDOW_SECONDS ||
+        !scaling->window_start.compare_exchange_strong(window_start, now))
+    {
+        return;
+    }
+    long busy_ns = 0;
+    for (int i = 0; i < pipeline->thread_pool_size; i += 1)
+        busy_ns += pipeline->thread_pool[i].busy_ns.load(std::memory_order_relaxed);
+    double busy_threads = (busy_ns - scaling->window_busy_ns.exchange(busy_ns)) / (window_seconds * 1000000000.0);
+    int peak_ready_count = scaling->peak_ready_count.exchange(scaling->ready_count.load());
+
+    int active_count = scaling->active_thread_count.load();
+    int target = thread_scaling_target(active_count, min_active_thread_count(pipeline),
+            pipeline->thread_pool_size, busy_threads, peak_ready_count);
+    if (target == active_count)
+        return;
+    scaling->active_thread_count.store(target);
+    if (target > active_count)
+        wake_idle_worker(pipeline);
+}
+
+// returns the next node of a fused chain if it is ready to run, claimed
+static GenesisNode *run_one_node(GenesisNode *node) {
+    const GenesisNodeDescriptor *node_descriptor = node->descriptor;
+    GenesisPipeline *pipeline = node_descriptor->pipeline;
+    if (pipeline->block_size > 0 && !node_has_block(node)) {
+        // whoever queued the node saw it ready before its previous run used
+        // that up. look again now that it is no longer claimed, in case it
+        // became ready in the meantime.
+        node->being_processed = false;
+        if (pipeline->compiled_graph) {
+            node->plan_rerun = false;
+            plan_queue_node(pipeline, node);
+        } else {
+            queue_node_if_ready(pipeline, node, false);
+        }
+        return nullptr;
+    }
+    use_denormals_mode(pipeline);
+    bool stats_enabled = pipeline->node_stats_enabled.load();
+    // a device callback running the node has no lane of its own
+    PipelineTrace *trace = current_worker ? pipeline->trace : nullptr;
+    bool critical_path = pipeline->scheduler == GenesisSchedulerCriticalPath;
+    // only the pipeline's own threads scale
+    GenesisPipelineWorker *scaling_worker = pipeline->thread_scaling.min_thread_count ? current_worker : nullptr;
+    if (stats_enabled || trace || critical_path || scaling_worker) {
+        uint64_t start_time = os_timestamp();
+        int lane_index = trace ? current_worker->index : -1;
+        if (trace)
+            trace_port_fill_counts(trace, lane_index, node, start_time);
+        if (stats_enabled)
+            denormals_clear_flags();
+        node_descriptor->run(node);
+        uint64_t end_time = os_timestamp();
+        double seconds = os_timestamp_to_seconds(end_time - start_time);
+        if (stats_enabled) {
+            record_run_time(&node->stats, seconds);
+            if (denormals_flagged())
+                node->stats.denormal_run_count += 1;
+        }
+        if (critical_path)
+            record_cost(node, seconds);
+        if (trace)
+            trace_node_run(trace, lane_index, node, start_time, seconds);
+        if (scaling_worker) {
+            scaling_worker->busy_ns.store(scaling_worker->busy_ns.load(std::memory_order_relaxed) +
+                    (long)(seconds * 1000000000.0), std::memory_order_relaxed);
+            scale_threads(pipeline, end_time);
+        }
+    } else {
+        node_descriptor->run(node);
+    }
+    bool at_checkpoint = node->checkpoints && take_checkpoint(node);
+    GenesisNode *fused_next = nullptr;
+    if (!pipeline->compiled_graph) {
+        node->being_processed = false;
+        if (at_checkpoint)
+            queue_node_if_ready(pipeline, node, false);
+        if (node->fused_pending) {
+            node->fused_pending = false;
+            if (claim_node_if_ready(pipeline, node->fused_next, false))
+                fused_next = node->fused_next;
+        }
+        return fused_next;
+    }
+    for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+        GenesisPort *port = node->ports[port_i];
+        if (port->plan_produced) {
+            port->plan_produced = false;
+            for (int i = 0; i < port->output_count; i += 1) {
+                GenesisNode *consumer = port->output_to[i]->node;
+                if (plan_edge_done(pipeline, consumer, consumer == node->fused_next))
+                    fused_next = consumer;
+            }
+        }
+    }
+    node->being_processed = false;
+    // this run may have used up what made the node ready, so check again
+    if (node->plan_rerun.exchange(false) || at_checkpoint)
+        plan_queue_node(pipeline, node);
+    return fused_next;
+}
+
+static void run_node(GenesisNode *node) {
+    while (node)
+        node = run_one_node(node);
+}
+
+// from a device callback, with direct playback. the pipeline threads leave
+// the node alone while it is device driven, but one of them may still be
+// finishing a run from before.
+static void run_direct_node(PlaybackNodeContext *playback_node_context) {
+    GenesisNode *node = playback_node_context->direct_node;
+    if (!node->being_processed.exchange(true)) {
+        current_scratch_arena = playback_node_context->direct_scratch_arena;
+        run_node(node);
+        current_scratch_arena = nullptr;
+    }
+}
+
+// topologically sort the nodes and reset the dependency counters
+static int build_execution_plan(GenesisPipeline *pipeline) {
+    pipeline->execution_plan.clear();
+    int err;
+    if ((err = pipeline->execution_plan.ensure_capacity(pipeline->nodes.length())))
+        return err;
+
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        int dependency_count = 0;
+        for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+            GenesisPort *port = node->ports[port_i];
+            if (port->input_from && port->input_from != port)
+                dependency_count += 1;
+            port->plan_produced = false;
+        }
+        node->plan_dependency_count = dependency_count;
+        node->plan_pending = dependency_count;
+        node->plan_rerun = false;
+        if (dependency_count == 0)
+            ok_or_panic(pipeline->execution_plan.append(node));
+    }
+
+    for (int plan_index = 0; plan_index < pipeline->execution_plan.length(); plan_index += 1) {
+        GenesisNode *node = pipeline->execution_plan.at(plan_index);
+        for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+            GenesisPort *port = node->ports[port_i];
+            for (int i = 0; i < port->output_count; i += 1) {
+                GenesisNode *consumer = port->output_to[i]->node;
+                if (consumer->plan_pending.fetch_sub(1) == 1)
+                    ok_or_panic(pipeline->execution_plan.append(consumer));
+            }
+        }
+    }
+
+    if (pipeline->execution_plan.length() != pipeline->nodes.length())
+        return GenesisErrorInvalidState; // the graph has a cycle
+
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        node->plan_pending = node->plan_dependency_count;
+    }
+    return 0;
+}
+
+// the upward rank of a node is its cost plus the highest rank among its
+// consumers, so it is found in reverse topological order. nodes that have
+// not run yet, and so have no cost, still count for a little, so that
+// depth alone orders them. nodes on a cycle only count for themselves.
+static int compute_upward_ranks(GenesisPipeline *pipeline) {
+    static const long min_cost_ns = 1000;
+    int node_count = pipeline->nodes.length();
+    List<int> pending;
+    List<GenesisNode *> order;
+    int err;
+    if ((err = pending.resize(node_count)) || (err = order.ensure_capacity(node_count)))
+        return err;
+
+    for (int node_index = 0; node_index < node_count; node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        int consumer_count = 0;
+        for (int port_i = 0; port_i < node->port_count; port_i += 1)
+            consumer_count += node->ports[port_i]->output_count;
+        pending.at(node_index) = consumer_count;
+        node->upward_rank_ns = max(node->cost_ns.load(), min_cost_ns);
+        if (consumer_count == 0)
+            ok_or_panic(order.append(node));
+    }
+    for (int order_index = 0; order_index < order.length(); order_index += 1) {
+        GenesisNode *node = order.at(order_index);
+        for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+            GenesisPort *port = node->ports[port_i];
+            if (!port->input_from || port->input_from == port)
+                continue;
+            GenesisNode *producer = port->input_from->node;
+            long rank = max(producer->cost_ns.load(), min_cost_ns) + node->upward_rank_ns;
+            producer->upward_rank_ns = max(producer->upward_rank_ns, rank);
+            if ((pending.at(producer->set_index) -= 1) == 0)
+                ok_or_panic(order.append(producer));
+        }
+    }
+
+    long max_rank_ns = 1;
+    for (int node_index = 0; node_index < node_count; node_index += 1)
+        max_rank_ns = max(max_rank_ns, pipeline->nodes.at(node_index)->upward_rank_ns);
+    for (int node_index = 0; node_index < node_count; node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        long level = node->upward_rank_ns * GENESIS_PRIORITY_LEVEL_COUNT / (max_rank_ns + 1);
+        node->priority_level = (int)min(level, (long)GENESIS_PRIORITY_LEVEL_COUNT - 1);
+    }
+    return 0;
+}
+
+// called after a consumer reads from one of producer's out ports
+static void port_consumed(GenesisNode *producer) {
+    GenesisPipeline *pipeline = producer->descriptor->pipeline;
+    if (pipeline->compiled_graph)
+        plan_queue_node(pipeline, producer);
+    else
+        queue_node_if_ready(pipeline, producer, true);
+}
+
+// called after a producer writes to out_port. every reader is a consumer.
+static void port_produced(GenesisPort *out_port, bool any_written) {
+    GenesisPipeline *pipeline = out_port->node->descriptor->pipeline;
+    GenesisNode *node = out_port->node;
+    if (!pipeline->compiled_graph) {
+        for (int i = 0; i < out_port->output_count; i += 1) {
+            GenesisNode *consumer = out_port->output_to[i]->node;
+            // the end of the run takes care of it
+            if (consumer == node->fused_next)
+                node->fused_pending = true;
+            else
+                queue_node_if_ready(pipeline, consumer, false);
+        }
+    } else if (any_written) {
+        // nodes without a run callback are written to from device callbacks,
+        // so there is no end of run to wait for.
+        if (node->descriptor->run) {
+            out_port->plan_produced = true;
+        } else {
+            for (int i = 0; i < out_port->output_count; i += 1)
+                plan_edge_done(pipeline, out_port->output_to[i]->node, false);
+        }
     }
 }
 
 double genesis_node_playback_latency(struct GenesisNode *node) {
     PlaybackNodeContext *playback_node_context = (PlaybackNodeContext*)node->userdata;
-    return playback_node_context->latency.load();
+    return playback_node_context->latency.load() + node->path_latency.load();
 }
 
 void genesis_node_playback_reset_offset(struct GenesisNode *node) {
@@ -931,21 +1768,121 @@ static void playback_node_destroy(struct GenesisNode *node) {
     PlaybackNodeContext *playback_node_context = (PlaybackNodeContext*)node->userdata;
     if (playback_node_context) {
         soundio_outstream_destroy(playback_node_context->outstream);
+        destroy(playback_node_context->direct_scratch_arena, playback_node_context->direct_scratch_arena_size);
         destroy(playback_node_context, 1);
     }
 }
 
+// while a playback device starts or recovers, the pipeline threads fill its
+// input as usual, so that there is something to start with
+static void set_direct_node_device_driven(PlaybackNodeContext *playback_node_context, bool device_driven) {
+    if (playback_node_context->direct_node)
+        playback_node_context->direct_node->device_driven.store(device_driven);
+}
+
 static void playback_node_error_callback(SoundIoOutStream *outstream, int err) {
     GenesisNode *node = (GenesisNode *)outstream->userdata;
     GenesisPipeline *pipeline = node->descriptor->pipeline;
     PlaybackNodeContext *playback_node_context = (PlaybackNodeContext*)node->userdata;
 
+    if (err == SoundIoErrorUnderflow)
+        pipeline->telemetry.underrun_count.fetch_add(1, std::memory_order_relaxed);
+
+    if (pipeline->trace) {
+        PipelineTraceEvent event;
+        event.time = os_timestamp();
+        event.duration = 0.0;
+        event.type = PipelineTraceEventTypeUnderrun;
+        event.node_index = node->set_index;
+        event.value = 0;
+        snprintf(event.name, sizeof(event.name), "%s",
+                (err == SoundIoErrorUnderflow) ? "underrun" : soundio_strerror(err));
+        pipeline_trace_record_device(pipeline->trace, &event);
+    }
+
     if (pipeline->running.load() && !playback_node_context->ongoing_recovery.exchange(true)) {
+        set_direct_node_device_driven(playback_node_context, false);
         pipeline->stream_fail_flag.clear();
         emit_event_ready(pipeline->context);
     }
 }
 
+void device_callback_end(GenesisPipeline *pipeline) {
+    if (pipeline->device_callback_count.fetch_sub(1) == 1 && !pipeline->running.load())
+        futex_wake(reinterpret_cast<int*>(&pipeline->device_callback_count), 1);
+}
+
+bool device_callback_begin(GenesisPipeline *pipeline) {
+    pipeline->device_callback_count += 1;
+    if (pipeline->running.load())
+        return true;
+    device_callback_end(pipeline);
+    return false;
+}
+
+static void wait_for_device_callbacks(GenesisPipeline *pipeline) {
+    for (;;) {
+        int count = pipeline->device_callback_count.load();
+        if (count == 0)
+            break;
+        futex_wait(reinterpret_cast<int*>(&pipeline->device_callback_count), count);
+    }
+}
+
+// only the device callback publishes, or whatever runs while it cannot
+static void publish_clock(PlaybackNodeContext *playback_node_context, const GenesisPlaybackClock *clock) {
+    playback_node_context->clock_sequence += 1;
+    playback_node_context->clock_time.store(clock->time);
+    playback_node_context->clock_frame.store(clock->frame);
+    playback_node_context->clock_frame_count.store(clock->frame_count);
+    playback_node_context->clock_whole_note.store(clock->whole_note);
+    playback_node_context->clock_frame_rate.store(clock->frame_rate);
+    playback_node_context->clock_latency.store(clock->latency);
+    playback_node_context->clock_sequence += 1;
+}
+
+static void unpublish_clock(PlaybackNodeContext *playback_node_context) {
+    GenesisPlaybackClock clock = {};
+    clock.time = -1.0;
+    publish_clock(playback_node_context, &clock);
+}
+
+static bool read_playback_clock(PlaybackNodeContext *playback_node_context, GenesisPlaybackClock *clock) {
+    for (;;) {
+        int sequence = playback_node_context->clock_sequence.load();
+        if (sequence & 1)
+            continue;
+        clock->time = playback_node_context->clock_time.load();
+        clock->frame = playback_node_context->clock_frame.load();
+        clock->frame_count = playback_node_context->clock_frame_count.load();
+        clock->whole_note = playback_node_context->clock_whole_note.load();
+        clock->frame_rate = playback_node_context->clock_frame_rate.load();
+        clock->latency = playback_node_context->clock_latency.load();
+        if (playback_node_context->clock_sequence.load() == sequence)
+            return clock->time >= 0.0;
+    }
+}
+
+// returns false when no playback node knows where it is
+static bool read_clock(GenesisPipeline *pipeline, GenesisPlaybackClock *clock) {
+    if (!pipeline->clock_node)
+        return false;
+    return read_playback_clock((PlaybackNodeContext *)pipeline->clock_node->userdata, clock);
+}
+
+bool genesis_node_playback_clock(struct GenesisNode *node, struct GenesisPlaybackClock *clock) {
+    return read_playback_clock((PlaybackNodeContext*)node->userdata, clock);
+}
+
+double genesis_playback_clock_position(struct GenesisPipeline *pipeline,
+        const struct GenesisPlaybackClock *clock, double time)
+{
+    double elapsed = (time - clock->time) - clock->latency;
+    elapsed = min(elapsed, clock->frame_count / (double)clock->frame_rate);
+    double seconds = pipeline->tempo_map.whole_notes_to_seconds(clock->whole_note) + elapsed;
+    return pipeline->tempo_map.seconds_to_whole_notes(seconds);
+}
+
 static void playback_node_fill_silence(SoundIoOutStream *outstream, int frame_count_min) {
     struct SoundIoChannelArea *areas;
     int channel_count = outstream->layout.channel_count;
@@ -977,72 +1914,236 @@ static void playback_node_fill_silence(SoundIoOutStream *outstream, int frame_co
     }
 }
 
-static void playback_node_callback(SoundIoOutStream *outstream,
-        int frame_count_min, int frame_count_max)
-{
+// returns false after reporting an error
+static bool playback_node_write_frames(SoundIoOutStream *outstream, const float *in_buf, int frame_count_total) {
     GenesisNode *node = (GenesisNode *)outstream->userdata;
-    GenesisPipeline *pipeline = node->descriptor->pipeline;
     PlaybackNodeContext *playback_node_context = (PlaybackNodeContext*)node->userdata;
+    const struct SoundIoChannelLayout *layout = &outstream->layout;
     struct SoundIoChannelArea *areas;
     int err;
-
-    if (!pipeline->running.load() || playback_node_context->ongoing_recovery.load()) {
-        playback_node_fill_silence(outstream, frame_count_min);
-        return;
-    }
-
-    GenesisPort *audio_in_port = genesis_node_port(node, 0);
-    int input_frame_count = genesis_audio_in_port_fill_count(audio_in_port);
-    float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
-    const struct SoundIoChannelLayout *layout = &outstream->layout;
-
-    if (frame_count_max > input_frame_count) {
-        playback_node_fill_silence(outstream, frame_count_min);
-        soundio_outstream_pause(playback_node_context->outstream, 1);
-        playback_node_error_callback(outstream, SoundIoErrorUnderflow);
-        return;
-    }
-
-    int frames_left = frame_count_max;
+    int frames_left = frame_count_total;
     while (frames_left > 0) {
         int frame_count = frames_left;
         if ((err = soundio_outstream_begin_write(outstream, &areas, &frame_count))) {
             playback_node_error_callback(outstream, err);
-            return;
+            return false;
         }
 
         if (!frame_count)
             break;
 
-        for (int frame = 0; frame < frame_count; frame += 1) {
-            for (int channel = 0; channel < layout->channel_count; channel += 1) {
-                playback_node_context->write_sample(areas[channel].ptr, *in_buf);
-                areas[channel].ptr += areas[channel].step;
-                in_buf += 1;
-            }
-        }
+        sample_format_write_areas(playback_node_context->sample_format_info, areas,
+                layout->channel_count, in_buf, frame_count);
+        in_buf += frame_count * layout->channel_count;
 
         if ((err = soundio_outstream_end_write(outstream))) {
             playback_node_error_callback(outstream, err);
-            return;
+            return false;
         }
 
         frames_left -= frame_count;
     }
+    return true;
+}
 
-    double latency;
-    if ((err = soundio_outstream_get_latency(outstream, &latency))) {
-        playback_node_error_callback(outstream, err);
+// with direct playback the input holds at most a device buffer, so the
+// frames may go out in pieces, running the node that feeds it in between
+// while idle the input stays where it is and the clock holds still at the
+// first frame of it. the whole device buffer is filled so that callbacks
+// come as seldom as they can.
+static void playback_node_write_idle(SoundIoOutStream *outstream, int frame_count_max, double callback_time) {
+    GenesisNode *node = (GenesisNode *)outstream->userdata;
+    PlaybackNodeContext *playback_node_context = (PlaybackNodeContext*)node->userdata;
+    int err;
+
+    playback_node_fill_silence(outstream, frame_count_max);
+
+    double latency;
+    if ((err = soundio_outstream_get_latency(outstream, &latency))) {
+        playback_node_error_callback(outstream, err);
+        return;
+    }
+    playback_node_context->latency.store(latency);
+
+    GenesisPlaybackClock clock;
+    clock.time = callback_time;
+    clock.frame = playback_node_context->offset.load();
+    clock.frame_count = 0;
+    clock.whole_note = playback_node_context->clock_position;
+    clock.frame_rate = outstream->sample_rate;
+    clock.latency = os_get_time() - callback_time + latency;
+    publish_clock(playback_node_context, &clock);
+}
+
+// idle once the silence handed over has flushed a whole input buffer and
+// whatever the nodes before it held back, and the input is all silence
+static bool playback_node_should_idle(GenesisNode *node, PlaybackNodeContext *playback_node_context,
+        int frame_rate)
+{
+    if (!node->descriptor->pipeline->idle_enabled)
+        return false;
+    GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    int input_capacity = genesis_audio_in_port_capacity(audio_in_port);
+    long min_silent_frame_count = input_capacity +
+        (long)((node->path_latency.load() + GENESIS_IDLE_SILENT_SECONDS) * frame_rate);
+    if (playback_node_context->silent_frame_count < min_silent_frame_count)
+        return false;
+    int input_frame_count = genesis_audio_in_port_fill_count(audio_in_port);
+    return input_frame_count == input_capacity &&
+        genesis_audio_in_port_silent_count(audio_in_port) >= input_frame_count;
+}
+
+static void playback_node_write(SoundIoOutStream *outstream, int frame_count_min, int frame_count_max) {
+    GenesisNode *node = (GenesisNode *)outstream->userdata;
+    PlaybackNodeContext *playback_node_context = (PlaybackNodeContext*)node->userdata;
+    int err;
+
+    if (playback_node_context->ongoing_recovery.load()) {
+        playback_node_fill_silence(outstream, frame_count_min);
+        return;
+    }
+
+    double callback_time = os_get_time();
+    int idle_wake_epoch = node->descriptor->pipeline->idle_wake_epoch.load();
+    if (idle_wake_epoch != playback_node_context->idle_wake_epoch) {
+        playback_node_context->idle_wake_epoch = idle_wake_epoch;
+        playback_node_context->idle = false;
+        playback_node_context->silent_frame_count = 0;
+    }
+    if (playback_node_context->idle) {
+        playback_node_write_idle(outstream, frame_count_max, callback_time);
+        return;
+    }
+
+    GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    GenesisNode *direct_node = playback_node_context->direct_node;
+    bool direct = direct_node && direct_node->device_driven.load();
+    int input_frame_count = genesis_audio_in_port_fill_count(audio_in_port);
+    if (direct && input_frame_count < frame_count_max) {
+        run_direct_node(playback_node_context);
+        input_frame_count = genesis_audio_in_port_fill_count(audio_in_port);
+    }
+
+    if (!direct && frame_count_max > input_frame_count) {
+        playback_node_fill_silence(outstream, frame_count_min);
+        soundio_outstream_pause(playback_node_context->outstream, 1);
+        playback_node_error_callback(outstream, SoundIoErrorUnderflow);
+        return;
+    }
+
+    GenesisAdaptiveLatency *adaptive = &node->descriptor->pipeline->adaptive_latency;
+    long headroom_ns = (long)((input_frame_count - frame_count_max) * 1000000000.0 / outstream->sample_rate);
+    long min_headroom_ns = adaptive->min_headroom_ns.load(std::memory_order_relaxed);
+    while (headroom_ns < min_headroom_ns && !adaptive->min_headroom_ns.compare_exchange_weak(min_headroom_ns,
+                headroom_ns, std::memory_order_relaxed)) {}
+
+    int frames_written = 0;
+    for (;;) {
+        int frame_count = min(input_frame_count, frame_count_max - frames_written);
+        if (genesis_audio_in_port_silent_count(audio_in_port) >= frame_count)
+            playback_node_context->silent_frame_count += frame_count;
+        else
+            playback_node_context->silent_frame_count = 0;
+        if (!playback_node_write_frames(outstream, genesis_audio_in_port_read_ptr(audio_in_port), frame_count))
+            return;
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+        frames_written += frame_count;
+        if (!direct || frames_written == frame_count_max)
+            break;
+        run_direct_node(playback_node_context);
+        input_frame_count = genesis_audio_in_port_fill_count(audio_in_port);
+        if (input_frame_count == 0)
+            break;
+    }
+
+    if (frames_written < frame_count_max) {
+        playback_node_fill_silence(outstream, max(0, frame_count_min - frames_written));
+        soundio_outstream_pause(playback_node_context->outstream, 1);
+        playback_node_error_callback(outstream, SoundIoErrorUnderflow);
+        return;
+    }
+
+    double latency;
+    if ((err = soundio_outstream_get_latency(outstream, &latency))) {
+        playback_node_error_callback(outstream, err);
         return;
     }
     playback_node_context->latency.store(latency);
 
+    long frame;
     if (!playback_node_context->reset_offset_flag.test_and_set()) {
+        frame = 0;
         playback_node_context->offset.store(frame_count_max);
     } else {
-        playback_node_context->offset += frame_count_max;
+        frame = playback_node_context->offset.fetch_add(frame_count_max);
+    }
+    // the latency is until the frame after the ones just written is heard
+    GenesisPipeline *pipeline = node->descriptor->pipeline;
+    GenesisPlaybackClock clock;
+    clock.time = callback_time;
+    clock.frame = frame;
+    clock.frame_count = frame_count_max;
+    clock.whole_note = playback_node_context->clock_position;
+    clock.frame_rate = outstream->sample_rate;
+    clock.latency = max(0.0, os_get_time() - callback_time + latency - frame_count_max / (double)clock.frame_rate);
+    publish_clock(playback_node_context, &clock);
+    playback_node_context->clock_position = genesis_whole_notes_add_frames(pipeline,
+            playback_node_context->clock_position, frame_count_max, outstream->sample_rate);
+
+    if (playback_node_should_idle(node, playback_node_context, outstream->sample_rate))
+        playback_node_context->idle = true;
+}
+
+// the period is the device buffer, which is how long a callback may take
+// before the device runs dry. jitter is how far the time since the last
+// callback is from the average.
+static void record_playback_callback(GenesisPipeline *pipeline, PlaybackNodeContext *playback_node_context,
+        uint64_t start_time, uint64_t end_time)
+{
+    GenesisPipelineTelemetryCounters *telemetry = &pipeline->telemetry;
+    long ns = (long)(os_timestamp_to_seconds(end_time - start_time) * 1000000000.0);
+    telemetry->callback_count.fetch_add(1, std::memory_order_relaxed);
+    telemetry->last_callback_ns.store(ns, std::memory_order_relaxed);
+    long max_ns = telemetry->max_callback_ns.load(std::memory_order_relaxed);
+    while (ns > max_ns && !telemetry->max_callback_ns.compare_exchange_weak(max_ns, ns,
+                std::memory_order_relaxed)) {}
+    GenesisAdaptiveLatency *adaptive = &pipeline->adaptive_latency;
+    max_ns = adaptive->max_callback_ns.load(std::memory_order_relaxed);
+    while (ns > max_ns && !adaptive->max_callback_ns.compare_exchange_weak(max_ns, ns,
+                std::memory_order_relaxed)) {}
+    telemetry->callback_period_ns.store((long)(playback_node_context->outstream->software_latency * 1000000000.0),
+            std::memory_order_relaxed);
+
+    if (playback_node_context->last_callback_time > 0) {
+        double interval = os_timestamp_to_seconds(start_time - playback_node_context->last_callback_time);
+        if (playback_node_context->mean_callback_interval <= 0.0)
+            playback_node_context->mean_callback_interval = interval;
+        double jitter = fabs(interval - playback_node_context->mean_callback_interval);
+        playback_node_context->mean_callback_interval +=
+            (interval - playback_node_context->mean_callback_interval) / 16.0;
+        telemetry->callback_jitter_histogram[histogram_bucket((long)(jitter * 1000000000.0))].fetch_add(1,
+                std::memory_order_relaxed);
+    }
+    playback_node_context->last_callback_time = start_time;
+}
+
+static void playback_node_callback(SoundIoOutStream *outstream,
+        int frame_count_min, int frame_count_max)
+{
+    GenesisNode *node = (GenesisNode *)outstream->userdata;
+    GenesisPipeline *pipeline = node->descriptor->pipeline;
+    PlaybackNodeContext *playback_node_context = (PlaybackNodeContext*)node->userdata;
+    uint64_t start_time = os_timestamp();
+    realtime_thread_begin();
+    use_denormals_mode(pipeline);
+    if (device_callback_begin(pipeline)) {
+        playback_node_write(outstream, frame_count_min, frame_count_max);
+        device_callback_end(pipeline);
+    } else {
+        playback_node_fill_silence(outstream, frame_count_min);
     }
-    genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count_max);
+    realtime_thread_end();
+    record_playback_callback(pipeline, playback_node_context, start_time, os_timestamp());
 }
 
 static void playback_node_underrun_callback(SoundIoOutStream *outstream) {
@@ -1051,16 +2152,21 @@ static void playback_node_underrun_callback(SoundIoOutStream *outstream) {
 
 static void playback_node_deactivate(struct GenesisNode *node) {
     PlaybackNodeContext *playback_node_context = (PlaybackNodeContext*)node->userdata;
+    GenesisPipeline *pipeline = node->descriptor->pipeline;
     soundio_outstream_destroy(playback_node_context->outstream);
+    if (pipeline->clock_node == node)
+        pipeline->clock_node = nullptr;
+    unpublish_clock(playback_node_context);
     playback_node_context->outstream = nullptr;
     playback_node_context->stream_started = false;
+    playback_node_context->seek_pending.store(false);
 }
 
 static int playback_choose_best_format(PlaybackNodeContext *playback_node_context, SoundIoDevice *device) {
-    for (int i = 0; i < array_length(prioritized_sample_format_infos); i += 1) {
-        struct SampleFormatInfo *sample_format_info = &prioritized_sample_format_infos[i];
+    for (int i = 0; i < sample_format_info_count(); i += 1) {
+        const SampleFormatInfo *sample_format_info = sample_format_info_at(i);
         if (soundio_device_supports_format(device, sample_format_info->format)) {
-            playback_node_context->write_sample = sample_format_info->write_sample;
+            playback_node_context->sample_format_info = sample_format_info;
             playback_node_context->outstream->format = sample_format_info->format;
             return 0;
         }
@@ -1074,6 +2180,11 @@ static int playback_node_activate(struct GenesisNode *node) {
     SoundIoDevice *device = (SoundIoDevice*)node->descriptor->userdata;
 
     playback_node_context->ongoing_recovery.store(true);
+    set_direct_node_device_driven(playback_node_context, false);
+    playback_node_context->last_callback_time = 0;
+    playback_node_context->mean_callback_interval = 0.0;
+    playback_node_context->idle = false;
+    playback_node_context->silent_frame_count = 0;
 
     assert(!playback_node_context->outstream);
     if (!(playback_node_context->outstream = soundio_outstream_create(device))) {
@@ -1101,13 +2212,16 @@ static int playback_node_activate(struct GenesisNode *node) {
 
     // Spend 1/4 of the latency on the device buffer and 3/4 of the latency in ring buffers for
     // nodes in the audio pipeline.
-    outstream->software_latency = pipeline->actual_latency * 0.25;
+    outstream->software_latency = pipeline->device_latency;
 
     if ((err = soundio_outstream_open(outstream))) {
         playback_node_deactivate(node);
         return GenesisErrorOpeningAudioHardware;
     }
 
+    if (!pipeline->clock_node)
+        pipeline->clock_node = node;
+
     // ask for audio frames
     genesis_audio_in_port_advance_read_ptr(&audio_port->port, 0);
 
@@ -1121,12 +2235,23 @@ static void playback_node_run(struct GenesisNode *node) {
         struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
         int input_frame_count = genesis_audio_in_port_fill_count(audio_in_port);
         int input_capacity = genesis_audio_in_port_capacity(audio_in_port);
+        if (playback_node_context->preroll_frame_count > 0) {
+            int drop_count = min((long)input_frame_count, playback_node_context->preroll_frame_count);
+            genesis_audio_in_port_advance_read_ptr(audio_in_port, drop_count);
+            playback_node_context->preroll_frame_count -= drop_count;
+            input_frame_count -= drop_count;
+        }
 
         if (input_frame_count == input_capacity) {
             if (!playback_node_context->stream_started) {
+                set_direct_node_device_driven(playback_node_context, true);
                 playback_node_context->ongoing_recovery.store(false);
                 soundio_outstream_start(playback_node_context->outstream);
                 playback_node_context->stream_started = true;
+            } else if (playback_node_context->seek_pending.exchange(false)) {
+                set_direct_node_device_driven(playback_node_context, true);
+                playback_node_context->ongoing_recovery.store(false);
+                soundio_outstream_pause(playback_node_context->outstream, 0);
             }
         }
     }
@@ -1141,6 +2266,7 @@ static int playback_node_create(struct GenesisNode *node) {
     node->userdata = playback_node_context;
     playback_node_context->offset.store(0);
     playback_node_context->reset_offset_flag.test_and_set();
+    unpublish_clock(playback_node_context);
 
     return 0;
 }
@@ -1148,10 +2274,24 @@ static int playback_node_create(struct GenesisNode *node) {
 static void playback_node_seek(struct GenesisNode *node) {
     PlaybackNodeContext *playback_node_context = (PlaybackNodeContext*)node->userdata;
     playback_node_context->ongoing_recovery.store(true);
+    set_direct_node_device_driven(playback_node_context, false);
     playback_node_context->reset_offset_flag.test_and_set();
+    // the device starts where the seek went, past what the nodes play from
+    // a checkpoint before it
+    GenesisPipeline *pipeline = node->descriptor->pipeline;
+    int sample_rate = genesis_audio_port_sample_rate(genesis_node_port(node, 0));
+    playback_node_context->clock_position = pipeline->seek_time;
+    playback_node_context->preroll_frame_count = max(0L, lround(sample_rate *
+        (genesis_whole_notes_to_seconds(pipeline, pipeline->seek_time, sample_rate) -
+         genesis_whole_notes_to_seconds(pipeline, node->timestamp, sample_rate))));
+    playback_node_context->idle = false;
+    playback_node_context->silent_frame_count = 0;
+    unpublish_clock(playback_node_context);
     if (playback_node_context->outstream) {
         soundio_outstream_pause(playback_node_context->outstream, 1);
         soundio_outstream_clear_buffer(playback_node_context->outstream);
+        if (playback_node_context->stream_started)
+            playback_node_context->seek_pending.store(true);
     }
 }
 
@@ -1160,38 +2300,41 @@ static void destroy_audio_device_node_descriptor(struct GenesisNodeDescriptor *n
     soundio_device_unref(audio_device);
 }
 
+static bool is_audio_device_node_descriptor(GenesisNodeDescriptor *node_descr) {
+    return node_descr->destroy_descriptor == destroy_audio_device_node_descriptor;
+}
+
 static void recording_node_error_callback(SoundIoInStream *instream, int err) {
     panic("TODO recording_node_error_callback");
 }
 
 static void recording_node_overflow_callback(SoundIoInStream *instream) {
+    GenesisNode *node = (GenesisNode *)instream->userdata;
+    node->descriptor->pipeline->telemetry.overflow_count.fetch_add(1, std::memory_order_relaxed);
     recording_node_error_callback(instream, SoundIoErrorUnderflow);
 }
 
-static void recording_node_callback(SoundIoInStream *instream, int frame_count_min, int frame_count_max) {
+// frames which do not fit in the output port are dropped. the drift
+// control keeps it from filling up, unless the pipeline stalls.
+static void recording_node_read(SoundIoInStream *instream, int frame_count_min, int frame_count_max) {
     GenesisNode *node = (GenesisNode *)instream->userdata;
-    GenesisPipeline *pipeline = node->descriptor->pipeline;
     RecordingNodeContext *recording_node_context = (RecordingNodeContext *)node->userdata;
+    ResampleContext *drift_resample_context = recording_node_context->drift_resample_context;
+    int channel_count = instream->layout.channel_count;
     struct SoundIoChannelArea *areas;
     int err;
 
-    assert(pipeline->running);
-
     GenesisPort *audio_out_port = genesis_node_port(node, 0);
     int output_frame_count = genesis_audio_out_port_free_count(audio_out_port);
     float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
 
-    int write_frames = min(output_frame_count, frame_count_max);
-    int read_frames = clamp(frame_count_min, output_frame_count, frame_count_max);
-    int read_frames_left = read_frames;
-    int write_frames_left = write_frames;
-
-    if (read_frames > write_frames) {
-        panic("TODO handle data dropped; read_frames > write_frames");
-    }
+    int read_frames_left = clamp(frame_count_min, output_frame_count, frame_count_max);
+    int written = 0;
+    bool dropped = false;
 
     while (read_frames_left > 0) {
-        int read_frame_count = read_frames_left;
+        int read_frame_count = drift_resample_context ?
+            min(read_frames_left, DRIFT_CHUNK_FRAME_COUNT) : read_frames_left;
         if ((err = soundio_instream_begin_read(instream, &areas, &read_frame_count))) {
             recording_node_error_callback(instream, err);
             return;
@@ -1200,17 +2343,21 @@ static void recording_node_callback(SoundIoInStream *instream, int frame_count_m
         if (!read_frame_count)
             break;
 
-        int write_frame_count = min(read_frame_count, write_frames_left);
+        int write_frame_count = min(read_frame_count, output_frame_count - written);
+        // converted frames go through drift_buf, the others straight into
+        // the port
+        float *dest = recording_node_context->drift_buf;
+        int dest_frame_count = read_frame_count;
+        if (!drift_resample_context) {
+            dest = out_buf + written * channel_count;
+            dest_frame_count = write_frame_count;
+        }
         if (!areas) {
-            panic("TODO handle data dropped; hole");
+            // the device dropped frames itself
+            memset(dest, 0, dest_frame_count * channel_count * sizeof(float));
         } else {
-            for (int frame = 0; frame < write_frame_count; frame += 1) {
-                for (int ch = 0; ch < instream->layout.channel_count; ch += 1) {
-                    recording_node_context->read_sample(areas[ch].ptr, out_buf);
-                    areas[ch].ptr += areas[ch].step;
-                    out_buf += 1;
-                }
-            }
+            sample_format_read_areas(recording_node_context->sample_format_info, areas,
+                    channel_count, dest, dest_frame_count);
         }
 
         if ((err = soundio_instream_end_read(instream))) {
@@ -1218,23 +2365,61 @@ static void recording_node_callback(SoundIoInStream *instream, int frame_count_m
             return;
         }
 
+        if (drift_resample_context) {
+            int consumed;
+            resample_convert(drift_resample_context, dest, read_frame_count,
+                    out_buf + written * channel_count, output_frame_count - written,
+                    &consumed, &write_frame_count);
+            if (consumed < read_frame_count)
+                dropped = true;
+        } else if (write_frame_count < read_frame_count) {
+            dropped = true;
+        }
+        written += write_frame_count;
         read_frames_left -= read_frame_count;
-        write_frames_left -= write_frame_count;
     }
 
-    genesis_audio_out_port_advance_write_ptr(audio_out_port, write_frames);
+    if (dropped)
+        node->descriptor->pipeline->telemetry.overflow_count.fetch_add(1, std::memory_order_relaxed);
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, written);
+
+    if (drift_resample_context && written > 0) {
+        GenesisAudioPort *buffer_port = audio_buffer_port((GenesisAudioPort *)audio_out_port);
+        int capacity = buffer_port->sample_buffer_size / buffer_port->bytes_per_frame;
+        int fill = capacity - genesis_audio_out_port_free_count(audio_out_port);
+        // the pipeline reads as the playback device plays, so its clock
+        // tells how far the reads have got, at this device's rate
+        GenesisPlaybackClock clock;
+        double read_position = -1.0;
+        if (read_clock(node->descriptor->pipeline, &clock)) {
+            read_position = (clock.frame + (os_get_time() - clock.time) * clock.frame_rate) *
+                instream->sample_rate / clock.frame_rate;
+        }
+        resample_context_set_correction(drift_resample_context,
+                resample_drift_control_update(&recording_node_context->drift_control, fill, written,
+                    read_position));
+    }
 }
 
-static void recording_node_seek(struct GenesisNode *node) {
-    //RecordingNodeContext *recording_node_context = (RecordingNodeContext*)node->userdata;
-    panic("TODO recording_node_seek");
+static void recording_node_callback(SoundIoInStream *instream, int frame_count_min, int frame_count_max) {
+    GenesisNode *node = (GenesisNode *)instream->userdata;
+    GenesisPipeline *pipeline = node->descriptor->pipeline;
+    realtime_thread_begin();
+    use_denormals_mode(pipeline);
+    if (device_callback_begin(pipeline)) {
+        recording_node_read(instream, frame_count_min, frame_count_max);
+        device_callback_end(pipeline);
+    }
+    realtime_thread_end();
 }
 
-static void recording_node_destroy(struct GenesisNode *node) {
+// the output port was emptied, so the conversion starts over, but the
+// correction the drift control settled on still holds
+static void recording_node_seek(struct GenesisNode *node) {
     RecordingNodeContext *recording_node_context = (RecordingNodeContext*)node->userdata;
-    if (recording_node_context) {
-        soundio_instream_destroy(recording_node_context->instream);
-        destroy(recording_node_context, 1);
+    if (recording_node_context->drift_resample_context) {
+        resample_context_reset(recording_node_context->drift_resample_context);
+        resample_drift_control_reset(&recording_node_context->drift_control);
     }
 }
 
@@ -1242,18 +2427,46 @@ static void recording_node_deactivate(struct GenesisNode *node) {
     RecordingNodeContext *recording_node_context = (RecordingNodeContext*)node->userdata;
     soundio_instream_destroy(recording_node_context->instream);
     recording_node_context->instream = nullptr;
+    resample_context_destroy(recording_node_context->drift_resample_context);
+    recording_node_context->drift_resample_context = nullptr;
+    destroy(recording_node_context->drift_buf, recording_node_context->drift_buf_size);
+    recording_node_context->drift_buf = nullptr;
 }
 
-static int recording_node_activate(struct GenesisNode *node) {
-    //RecordingNodeContext *recording_node_context = (RecordingNodeContext*)node->userdata;
-    panic("TODO recording_node_activate");
+static void recording_node_destroy(struct GenesisNode *node) {
+    RecordingNodeContext *recording_node_context = (RecordingNodeContext*)node->userdata;
+    if (recording_node_context) {
+        recording_node_deactivate(node);
+        destroy(recording_node_context, 1);
+    }
+}
+
+// whether a playback device other than this one drives the pipeline. the
+// input and output of one card share an id, and a clock.
+static bool recording_node_clocked_elsewhere(struct GenesisNode *node) {
+    SoundIoDevice *device = (SoundIoDevice*)node->descriptor->userdata;
+    GenesisPipeline *pipeline = node->descriptor->pipeline;
+    for (int i = 0; i < pipeline->nodes.length(); i += 1) {
+        GenesisNodeDescriptor *other_descr = pipeline->nodes.at(i)->descriptor;
+        if (!is_audio_device_node_descriptor(other_descr))
+            continue;
+        SoundIoDevice *other_device = (SoundIoDevice*)other_descr->userdata;
+        if (other_device->aim != SoundIoDeviceAimOutput)
+            continue;
+        if (other_device->soundio != device->soundio || other_device->is_raw != device->is_raw ||
+            strcmp(other_device->id, device->id) != 0)
+        {
+            return true;
+        }
+    }
+    return false;
 }
 
 static int recording_choose_best_format(RecordingNodeContext *recording_node_context, SoundIoDevice *device) {
-    for (int i = 0; i < array_length(prioritized_sample_format_infos); i += 1) {
-        struct SampleFormatInfo *sample_format_info = &prioritized_sample_format_infos[i];
+    for (int i = 0; i < sample_format_info_count(); i += 1) {
+        const SampleFormatInfo *sample_format_info = sample_format_info_at(i);
         if (soundio_device_supports_format(device, sample_format_info->format)) {
-            recording_node_context->read_sample = sample_format_info->read_sample;
+            recording_node_context->sample_format_info = sample_format_info;
             recording_node_context->instream->format = sample_format_info->format;
             return 0;
         }
@@ -1261,46 +2474,77 @@ static int recording_choose_best_format(RecordingNodeContext *recording_node_con
     return GenesisErrorIncompatibleDevice;
 }
 
-static int recording_node_create(struct GenesisNode *node) {
-    struct GenesisPipeline *pipeline = node->descriptor->pipeline;
-    RecordingNodeContext *recording_node_context = create_zero<RecordingNodeContext>();
-    if (!recording_node_context) {
-        recording_node_destroy(node);
-        return GenesisErrorNoMem;
-    }
-    node->userdata = recording_node_context;
-
+static int recording_node_activate(struct GenesisNode *node) {
+    RecordingNodeContext *recording_node_context = (RecordingNodeContext*)node->userdata;
+    GenesisPipeline *pipeline = node->descriptor->pipeline;
     SoundIoDevice *device = (SoundIoDevice*)node->descriptor->userdata;
 
+    assert(!recording_node_context->instream);
     if (!(recording_node_context->instream = soundio_instream_create(device))) {
-        recording_node_destroy(node);
+        recording_node_deactivate(node);
         return GenesisErrorNoMem;
     }
+    SoundIoInStream *instream = recording_node_context->instream;
 
     int err;
     if ((err = recording_choose_best_format(recording_node_context, device))) {
-        recording_node_destroy(node);
+        recording_node_deactivate(node);
         return err;
     }
 
     GenesisAudioPort *audio_port = (GenesisAudioPort *)node->ports[0];
 
-    recording_node_context->instream->name = "Genesis";
-    recording_node_context->instream->userdata = node;
-    recording_node_context->instream->read_callback = recording_node_callback;
-    recording_node_context->instream->error_callback = recording_node_error_callback;
-    recording_node_context->instream->overflow_callback = recording_node_overflow_callback;
-    recording_node_context->instream->sample_rate = audio_port->sample_rate;
-    recording_node_context->instream->layout = audio_port->channel_layout;
+    instream->name = "Genesis";
+    instream->userdata = node;
+    instream->read_callback = recording_node_callback;
+    instream->error_callback = recording_node_error_callback;
+    instream->overflow_callback = recording_node_overflow_callback;
+    instream->sample_rate = audio_port->sample_rate;
+    instream->layout = audio_port->channel_layout;
     // Spend 1/4 of the latency on the device buffer and 3/4 of the latency in ring buffers for
     // nodes in the audio pipeline.
-    recording_node_context->instream->software_latency = pipeline->latency * 0.25;
+    instream->software_latency = pipeline->device_latency;
 
-    if ((err = soundio_instream_open(recording_node_context->instream))) {
-        recording_node_destroy(node);
-        return err;
+    if ((err = soundio_instream_open(instream))) {
+        recording_node_deactivate(node);
+        return GenesisErrorOpeningAudioHardware;
+    }
+
+    if (recording_node_clocked_elsewhere(node)) {
+        int channel_count = audio_port->channel_layout.channel_count;
+        if ((err = resample_context_create_adaptive(audio_port->sample_rate, audio_port->sample_rate,
+                        &audio_port->channel_layout, GenesisResampleQualityRealtime,
+                        &recording_node_context->drift_resample_context)))
+        {
+            recording_node_deactivate(node);
+            return err;
+        }
+        recording_node_context->drift_buf_size = DRIFT_CHUNK_FRAME_COUNT * channel_count;
+        if (!(recording_node_context->drift_buf = allocate_nonzero<float>(recording_node_context->drift_buf_size))) {
+            recording_node_deactivate(node);
+            return GenesisErrorNoMem;
+        }
+        GenesisAudioPort *buffer_port = audio_buffer_port(audio_port);
+        int capacity = buffer_port->sample_buffer_size / buffer_port->bytes_per_frame;
+        resample_drift_control_init(&recording_node_context->drift_control, audio_port->sample_rate,
+                capacity / 2.0, MAX_DRIFT_CORRECTION);
     }
 
+    if ((err = soundio_instream_start(instream))) {
+        recording_node_deactivate(node);
+        return GenesisErrorOpeningAudioHardware;
+    }
+
+    return 0;
+}
+
+static int recording_node_create(struct GenesisNode *node) {
+    RecordingNodeContext *recording_node_context = create_zero<RecordingNodeContext>();
+    if (!recording_node_context) {
+        recording_node_destroy(node);
+        return GenesisErrorNoMem;
+    }
+    node->userdata = recording_node_context;
     return 0;
 }
 
@@ -1317,6 +2561,28 @@ static void get_best_supported_layout(SoundIoDevice *device, SoundIoChannelLayou
     *out_layout = device->layouts[0];
 }
 
+// the rate and layout the device is set to, or else the ones closest to
+// what the pipeline wants
+static void choose_device_port_format(GenesisPipeline *pipeline, SoundIoDevice *audio_device,
+        GenesisPortDescriptor *audio_port)
+{
+    int chosen_sample_rate;
+    if (audio_device->sample_rate_current) {
+        chosen_sample_rate = audio_device->sample_rate_current;
+    } else {
+        chosen_sample_rate = soundio_device_nearest_sample_rate(audio_device, pipeline->target_sample_rate);
+    }
+    genesis_audio_port_descriptor_set_sample_rate(audio_port, chosen_sample_rate, true, -1);
+
+    SoundIoChannelLayout layout;
+    if (audio_device->current_layout.channel_count) {
+        layout = audio_device->current_layout;
+    } else {
+        get_best_supported_layout(audio_device, &layout);
+    }
+    genesis_audio_port_descriptor_set_channel_layout(audio_port, &layout, true, -1);
+}
+
 int genesis_audio_device_create_node_descriptor(struct GenesisPipeline *pipeline,
         struct SoundIoDevice *audio_device,
         struct GenesisNodeDescriptor **out)
@@ -1381,66 +2647,171 @@ int genesis_audio_device_create_node_descriptor(struct GenesisPipeline *pipeline
         node_descr->seek = recording_node_seek;
     }
 
-    int chosen_sample_rate;
-    if (audio_device->sample_rate_current) {
-        chosen_sample_rate = audio_device->sample_rate_current;
-    } else {
-        chosen_sample_rate = soundio_device_nearest_sample_rate(audio_device, pipeline->target_sample_rate);
-    }
-    genesis_audio_port_descriptor_set_sample_rate(audio_port, chosen_sample_rate, true, -1);
+    choose_device_port_format(pipeline, audio_device, audio_port);
 
-    SoundIoChannelLayout layout;
-    if (audio_device->current_layout.channel_count) {
-        layout = audio_device->current_layout;
+    *out = node_descr;
+    return 0;
+}
+
+int genesis_audio_device_node_descriptor_set_device(struct GenesisNodeDescriptor *node_descr,
+        struct SoundIoDevice *audio_device)
+{
+    if (!is_audio_device_node_descriptor(node_descr))
+        return GenesisErrorInvalidParam;
+    SoundIoDevice *old_device = (SoundIoDevice *)node_descr->userdata;
+    if (audio_device->aim != old_device->aim)
+        return GenesisErrorInvalidParam;
+    if (audio_device->probe_error)
+        return GenesisErrorOpeningAudioHardware;
+
+    GenesisPipeline *pipeline = node_descr->pipeline;
+    GenesisPortDescriptor *port_descr = node_descr->port_descriptors.at(0);
+    GenesisAudioPortDescriptor *audio_port_descr = (GenesisAudioPortDescriptor *)port_descr;
+    if (pipeline->running) {
+        // the ports keep the format they were connected with
+        if (soundio_device_nearest_sample_rate(audio_device, audio_port_descr->sample_rate) !=
+                audio_port_descr->sample_rate ||
+            !soundio_device_supports_layout(audio_device, &audio_port_descr->channel_layout))
+        {
+            return GenesisErrorIncompatibleDevice;
+        }
     } else {
-        get_best_supported_layout(audio_device, &layout);
+        choose_device_port_format(pipeline, audio_device, port_descr);
     }
-    genesis_audio_port_descriptor_set_channel_layout(audio_port, &layout, true, -1);
 
-    *out = node_descr;
+    soundio_device_ref(audio_device);
+    soundio_device_unref(old_device);
+    node_descr->userdata = audio_device;
+    node_descr->min_software_latency = audio_device->software_latency_min;
     return 0;
 }
 
-static void midi_node_on_event(struct GenesisMidiDevice *device, const struct GenesisMidiEvent *event) {
-    GenesisNode *node = (GenesisNode *)device->userdata;
-    GenesisPort *events_out_port = genesis_node_port(node, 0);
+struct SoundIoDevice *genesis_audio_device_node_descriptor_device(struct GenesisNodeDescriptor *node_descr) {
+    if (!is_audio_device_node_descriptor(node_descr))
+        return nullptr;
+    return (SoundIoDevice *)node_descr->userdata;
+}
 
-    int event_count;
-    double time_requested;
-    genesis_events_out_port_free_count(events_out_port, &event_count, &time_requested);
+// what the MIDI thread hands to the midi node
+struct MidiNodeInputEvent {
+    GenesisMidiEvent event;
+    double time;
+};
 
-    assert(event_count >= 1); // TODO handle this error condition
+static const int MIDI_NODE_QUEUE_EVENT_COUNT = 1024;
 
-    GenesisMidiEvent *out_ptr = genesis_events_out_port_write_ptr(events_out_port);
-    memcpy(out_ptr, event, sizeof(GenesisMidiEvent));
+struct MidiNodeContext {
+    // written only by the MIDI thread, read only by the node
+    SpscRingBuffer queue;
+    // whole notes. where the next event block starts
+    double pos;
+};
 
-    genesis_events_out_port_advance_write_ptr(events_out_port, 1, time_requested);
+// events that come faster than the pipeline takes them are dropped
+static void midi_node_on_event(struct GenesisMidiDevice *device, const struct GenesisMidiEvent *event,
+        double time)
+{
+    GenesisNode *node = (GenesisNode *)device->userdata;
+    MidiNodeContext *midi_node_context = (MidiNodeContext *)node->userdata;
+    SpscRingBuffer *queue = &midi_node_context->queue;
+    if (spsc_ring_buffer_free_count(queue, sizeof(MidiNodeInputEvent)) < (int)sizeof(MidiNodeInputEvent))
+        return;
+    MidiNodeInputEvent *input_event = (MidiNodeInputEvent *)spsc_ring_buffer_write_ptr(queue);
+    input_event->event = *event;
+    input_event->time = time;
+    spsc_ring_buffer_advance_write_ptr(queue, sizeof(MidiNodeInputEvent));
+    genesis_pipeline_wake(node->descriptor->pipeline);
+}
+
+// an event is played one pipeline latency after it arrived, by the playback
+// frame clock, so that where it lands in a block does not depend on when the
+// block happened to run. without a clock, or when that is already past, it
+// starts the block.
+static double midi_node_event_start(GenesisNode *node, double time) {
+    GenesisPipeline *pipeline = node->descriptor->pipeline;
+    MidiNodeContext *midi_node_context = (MidiNodeContext *)node->userdata;
+    GenesisPlaybackClock clock;
+    if (!read_clock(pipeline, &clock))
+        return midi_node_context->pos;
+    int frame_rate = genesis_pipeline_get_sample_rate(pipeline);
+    double seconds = time - clock.time + pipeline->actual_latency;
+    double start = clock.whole_note + genesis_frames_to_whole_notes(pipeline, (int)(seconds * frame_rate), frame_rate);
+    return max(start, midi_node_context->pos);
 }
 
 static void midi_node_run(struct GenesisNode *node) {
+    MidiNodeContext *midi_node_context = (MidiNodeContext *)node->userdata;
+    SpscRingBuffer *queue = &midi_node_context->queue;
     GenesisPort *events_out_port = genesis_node_port(node, 0);
     int event_count;
     double time_requested;
     genesis_events_out_port_free_count(events_out_port, &event_count, &time_requested);
-    genesis_events_out_port_advance_write_ptr(events_out_port, 0, time_requested);
-}
-
-static int midi_node_create(struct GenesisNode *node) {
-    GenesisMidiDevice *device = (GenesisMidiDevice*)node->descriptor->userdata;
-    device->userdata = node;
-    device->on_event = midi_node_on_event;
-    return open_midi_device(device);
+    GenesisMidiEvent *event_buf = genesis_events_out_port_write_ptr(events_out_port);
+
+    double end_pos = midi_node_context->pos + time_requested;
+    int event_index = 0;
+    while (spsc_ring_buffer_fill_count(queue, sizeof(MidiNodeInputEvent)) >= (int)sizeof(MidiNodeInputEvent)) {
+        MidiNodeInputEvent *input_event = (MidiNodeInputEvent *)spsc_ring_buffer_read_ptr(queue);
+        double start = midi_node_event_start(node, input_event->time);
+        if (start >= end_pos)
+            break;
+        if (event_index >= event_count) {
+            end_pos = start;
+            break;
+        }
+        *event_buf = input_event->event;
+        event_buf->start = start;
+        event_buf += 1;
+        event_index += 1;
+        spsc_ring_buffer_advance_read_ptr(queue, sizeof(MidiNodeInputEvent));
+    }
+    genesis_events_out_port_advance_write_ptr(events_out_port, event_index,
+            end_pos - midi_node_context->pos);
+    midi_node_context->pos = end_pos;
 }
 
 static void midi_node_destroy(struct GenesisNode *node) {
     GenesisMidiDevice *device = (GenesisMidiDevice*)node->descriptor->userdata;
+    MidiNodeContext *midi_node_context = (MidiNodeContext *)node->userdata;
     close_midi_device(device);
     device->userdata = nullptr;
     device->on_event = nullptr;
+    spsc_ring_buffer_deinit(&midi_node_context->queue);
+    destroy(midi_node_context, 1);
+}
+
+static int midi_node_create(struct GenesisNode *node) {
+    GenesisMidiDevice *device = (GenesisMidiDevice*)node->descriptor->userdata;
+    MidiNodeContext *midi_node_context = create_zero<MidiNodeContext>();
+    if (!midi_node_context)
+        return GenesisErrorNoMem;
+    node->userdata = midi_node_context;
+    int err;
+    if ((err = spsc_ring_buffer_init(&midi_node_context->queue,
+                    MIDI_NODE_QUEUE_EVENT_COUNT * sizeof(MidiNodeInputEvent))))
+    {
+        destroy(midi_node_context, 1);
+        node->userdata = nullptr;
+        return err;
+    }
+    device->userdata = node;
+    device->on_event = midi_node_on_event;
+    if ((err = open_midi_device(device))) {
+        device->userdata = nullptr;
+        device->on_event = nullptr;
+        spsc_ring_buffer_deinit(&midi_node_context->queue);
+        destroy(midi_node_context, 1);
+        node->userdata = nullptr;
+        return err;
+    }
+    return 0;
 }
 
+// events still queued keep their arrival times, so they come out after the
+// seek
 static void midi_node_seek(struct GenesisNode *node) {
-    // do nothing
+    MidiNodeContext *midi_node_context = (MidiNodeContext *)node->userdata;
+    midi_node_context->pos = node->timestamp;
 }
 
 static void destroy_midi_device_node_descriptor(struct GenesisNodeDescriptor *node_descriptor) {
@@ -1546,111 +2917,205 @@ void genesis_node_descriptor_destroy(struct GenesisNodeDescriptor *node_descript
         genesis_port_descriptor_destroy(port_descriptor);
     }
 
+    for (int i = 0; i < node_descriptor->param_descriptors.length(); i += 1)
+        free(node_descriptor->param_descriptors.at(i).name);
     free(node_descriptor->name);
     free(node_descriptor->description);
 
     destroy(node_descriptor, 1);
 }
 
-static void resolve_channel_layout(GenesisAudioPort *audio_port) {
+static void resolve_channel_layout(const GenesisAudioPort *audio_port, SoundIoChannelLayout *channel_layout) {
     GenesisAudioPortDescriptor *port_descr = (GenesisAudioPortDescriptor*)audio_port->port.descriptor;
     if (port_descr->channel_layout_fixed) {
         if (port_descr->same_channel_layout_index >= 0) {
             GenesisAudioPort *other_port = (GenesisAudioPort *)
                 audio_port->port.node->ports[port_descr->same_channel_layout_index];
-            audio_port->channel_layout = other_port->channel_layout;
+            *channel_layout = other_port->channel_layout;
         } else {
-            audio_port->channel_layout = port_descr->channel_layout;
+            *channel_layout = port_descr->channel_layout;
         }
     }
 }
 
-static void resolve_sample_rate(GenesisAudioPort *audio_port) {
+static void resolve_sample_rate(const GenesisAudioPort *audio_port, int *sample_rate) {
     GenesisAudioPortDescriptor *port_descr = (GenesisAudioPortDescriptor *)audio_port->port.descriptor;
     if (port_descr->sample_rate_fixed) {
         if (port_descr->same_sample_rate_index >= 0) {
             GenesisAudioPort *other_port = (GenesisAudioPort *)
                 audio_port->port.node->ports[port_descr->same_sample_rate_index];
-            audio_port->sample_rate = other_port->sample_rate;
+            *sample_rate = other_port->sample_rate;
         } else {
-            audio_port->sample_rate = port_descr->sample_rate;
+            *sample_rate = port_descr->sample_rate;
         }
     }
 }
 
-static int connect_audio_ports(GenesisAudioPort *source, GenesisAudioPort *dest) {
+struct AudioPortFormat {
+    SoundIoChannelLayout channel_layout;
+    int sample_rate;
+};
+
+// figures out what the formats of source and dest would be if they were
+// connected, without modifying either port
+static int negotiate_audio_ports(const GenesisAudioPort *source, const GenesisAudioPort *dest,
+        AudioPortFormat *source_format, AudioPortFormat *dest_format)
+{
     GenesisAudioPortDescriptor *source_audio_descr = (GenesisAudioPortDescriptor *) source->port.descriptor;
     GenesisAudioPortDescriptor *dest_audio_descr = (GenesisAudioPortDescriptor *) dest->port.descriptor;
     GenesisPipeline *pipeline = source->port.node->descriptor->pipeline;
 
-    resolve_channel_layout(source);
-    resolve_channel_layout(dest);
+    source_format->channel_layout = source->channel_layout;
+    dest_format->channel_layout = dest->channel_layout;
+    resolve_channel_layout(source, &source_format->channel_layout);
+    resolve_channel_layout(dest, &dest_format->channel_layout);
     if (source_audio_descr->channel_layout_fixed &&
         dest_audio_descr->channel_layout_fixed)
     {
         // both fixed. they better match up
-        if (!soundio_channel_layout_equal(&source->channel_layout, &dest->channel_layout)) {
+        if (!soundio_channel_layout_equal(&source_format->channel_layout, &dest_format->channel_layout)) {
             return GenesisErrorIncompatibleChannelLayouts;
         }
     } else if (!source_audio_descr->channel_layout_fixed &&
                !dest_audio_descr->channel_layout_fixed)
     {
         // anything goes. default to mono
-        source->channel_layout = *soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono);
-        dest->channel_layout = source->channel_layout;
+        source_format->channel_layout = *soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono);
+        dest_format->channel_layout = source_format->channel_layout;
     } else if (source_audio_descr->channel_layout_fixed) {
         // source is fixed, use that one
-        dest->channel_layout = source->channel_layout;
+        dest_format->channel_layout = source_format->channel_layout;
     } else {
         // dest is fixed, use that one
-        source->channel_layout = dest->channel_layout;
+        source_format->channel_layout = dest_format->channel_layout;
     }
 
-    resolve_sample_rate(source);
-    resolve_sample_rate(dest);
+    source_format->sample_rate = source->sample_rate;
+    dest_format->sample_rate = dest->sample_rate;
+    resolve_sample_rate(source, &source_format->sample_rate);
+    resolve_sample_rate(dest, &dest_format->sample_rate);
     if (source_audio_descr->sample_rate_fixed && dest_audio_descr->sample_rate_fixed) {
         // both fixed. they better match up
-        if (source->sample_rate != dest->sample_rate)
+        if (source_format->sample_rate != dest_format->sample_rate)
             return GenesisErrorIncompatibleSampleRates;
     } else if (!source_audio_descr->sample_rate_fixed &&
                !dest_audio_descr->sample_rate_fixed)
     {
         // anything goes. default to 48,000 Hz
-        source->sample_rate = pipeline->target_sample_rate;
-        dest->sample_rate = source->sample_rate;
+        source_format->sample_rate = pipeline->target_sample_rate;
+        dest_format->sample_rate = source_format->sample_rate;
     } else if (source_audio_descr->sample_rate_fixed) {
         // source is fixed, use that one
-        dest->sample_rate = source->sample_rate;
+        dest_format->sample_rate = source_format->sample_rate;
     } else {
         // dest is fixed, use that one
-        source->sample_rate = dest->sample_rate;
+        source_format->sample_rate = dest_format->sample_rate;
     }
 
     return 0;
 }
 
-static int connect_events_ports(GenesisEventsPort *source, GenesisEventsPort *dest) {
+static int connect_audio_ports(GenesisAudioPort *source, GenesisAudioPort *dest) {
+    AudioPortFormat source_format;
+    AudioPortFormat dest_format;
+    int err;
+    if ((err = negotiate_audio_ports(source, dest, &source_format, &dest_format)))
+        return err;
+
+    source->channel_layout = source_format.channel_layout;
+    source->sample_rate = source_format.sample_rate;
+    dest->channel_layout = dest_format.channel_layout;
+    dest->sample_rate = dest_format.sample_rate;
     return 0;
 }
 
-void genesis_disconnect_ports(struct GenesisPort *source, struct GenesisPort *dest) {
-    source->output_to = nullptr;
-    dest->input_from = nullptr;
-    if (source->descriptor->disconnect)
-        source->descriptor->disconnect(source, dest);
-    if (dest->descriptor->disconnect)
-        dest->descriptor->disconnect(dest, source);
+static int connect_events_ports(GenesisEventsPort *source, GenesisEventsPort *dest) {
+    return 0;
 }
 
-int genesis_connect_ports(struct GenesisPort *source, struct GenesisPort *dest) {
-    int err = GenesisErrorInvalidPortType;
-    switch (source->descriptor->port_type) {
+// the ring buffer of out_port, or nullptr if it has none yet. readers of a
+// buffer that does not exist yet are set up when it is created.
+static RingBuffer *out_port_ring_buffer(GenesisPort *out_port) {
+    switch (out_port->descriptor->port_type) {
         case GenesisPortTypeAudioOut:
-            if (dest->descriptor->port_type != GenesisPortTypeAudioIn)
-                return GenesisErrorInvalidPortDirection;
-
-            err = connect_audio_ports((GenesisAudioPort *)source, (GenesisAudioPort *)dest);
-            break;
+            {
+                GenesisAudioPort *audio_port = (GenesisAudioPort *)out_port;
+                return audio_port->sample_buffer_err ? nullptr : &audio_port->sample_buffer;
+            }
+        case GenesisPortTypeEventsOut:
+            {
+                GenesisEventsPort *events_port = (GenesisEventsPort *)out_port;
+                return events_port->event_buffer_err ? nullptr : &events_port->event_buffer;
+            }
+        case GenesisPortTypeAudioIn:
+        case GenesisPortTypeEventsIn:
+            panic("expected out port");
+    }
+    panic("invalid port type");
+}
+
+static int add_output(GenesisPort *source, GenesisPort *dest) {
+    if (source->output_count >= GENESIS_PORT_MAX_OUTPUTS)
+        return GenesisErrorMaxConnectionsExceeded;
+    int reader = source->output_count;
+    RingBuffer *rb = out_port_ring_buffer(source);
+    // the first output takes over the reader that an unconnected port has
+    if (rb && reader > 0) {
+        int new_reader = ring_buffer_add_reader(rb);
+        assert(new_reader == reader);
+        if (source->descriptor->port_type == GenesisPortTypeEventsOut) {
+            // the new reader starts where the slowest one is, so it has
+            // the same time ahead of it
+            GenesisEventsPort *events_port = (GenesisEventsPort *)source;
+            int slowest = 0;
+            while (rb->read_offsets[slowest].load() != rb->read_offsets[reader].load())
+                slowest += 1;
+            events_port->time_available[reader].store(events_port->time_available[slowest].load());
+            events_port->time_requested[reader].store(events_port->time_requested[slowest].load());
+        }
+    }
+    source->output_to[reader] = dest;
+    source->output_count += 1;
+    dest->reader_index = reader;
+    return 0;
+}
+
+static void remove_output(GenesisPort *source, GenesisPort *dest) {
+    int reader = dest->reader_index;
+    assert(reader < source->output_count && source->output_to[reader] == dest);
+    int last = source->output_count - 1;
+    RingBuffer *rb = out_port_ring_buffer(source);
+    if (rb)
+        ring_buffer_remove_reader(rb, reader);
+    if (source->descriptor->port_type == GenesisPortTypeEventsOut) {
+        GenesisEventsPort *events_port = (GenesisEventsPort *)source;
+        events_port->time_available[reader].store(events_port->time_available[last].load());
+        events_port->time_requested[reader].store(events_port->time_requested[last].load());
+    }
+    source->output_to[reader] = source->output_to[last];
+    source->output_to[reader]->reader_index = reader;
+    source->output_count -= 1;
+    dest->reader_index = 0;
+}
+
+void genesis_disconnect_ports(struct GenesisPort *source, struct GenesisPort *dest) {
+    remove_output(source, dest);
+    dest->input_from = nullptr;
+    if (source->descriptor->disconnect)
+        source->descriptor->disconnect(source, dest);
+    if (dest->descriptor->disconnect)
+        dest->descriptor->disconnect(dest, source);
+}
+
+int genesis_connect_ports(struct GenesisPort *source, struct GenesisPort *dest) {
+    int err = GenesisErrorInvalidPortType;
+    switch (source->descriptor->port_type) {
+        case GenesisPortTypeAudioOut:
+            if (dest->descriptor->port_type != GenesisPortTypeAudioIn)
+                return GenesisErrorInvalidPortDirection;
+
+            err = connect_audio_ports((GenesisAudioPort *)source, (GenesisAudioPort *)dest);
+            break;
         case GenesisPortTypeEventsOut:
             if (dest->descriptor->port_type != GenesisPortTypeEventsIn)
                 return GenesisErrorInvalidPortDirection;
@@ -1664,13 +3129,18 @@ int genesis_connect_ports(struct GenesisPort *source, struct GenesisPort *dest)
     if (err)
         return err;
 
-    source->output_to = dest;
+    // an in port reads from one out port only
+    if (dest->input_from)
+        genesis_disconnect_ports(dest->input_from, dest);
+
+    if ((err = add_output(source, dest)))
+        return err;
     dest->input_from = source;
 
     if (source->descriptor->connect) {
         err = source->descriptor->connect(source, dest);
         if (err) {
-            source->output_to = nullptr;
+            remove_output(source, dest);
             dest->input_from = nullptr;
             return err;
         }
@@ -1680,7 +3150,7 @@ int genesis_connect_ports(struct GenesisPort *source, struct GenesisPort *dest)
         if (err) {
             if (source->descriptor->disconnect)
                 source->descriptor->disconnect(source, dest);
-            source->output_to = nullptr;
+            remove_output(source, dest);
             dest->input_from = nullptr;
             return err;
         }
@@ -1788,18 +3258,18 @@ void genesis_debug_print_pipeline(GenesisPipeline *pipeline) {
             GenesisPort *port = node->ports[i];
             const char *in_port_name = "-";
             const char *in_node_name = "-";
-            const char *out_port_name = "-";
-            const char *out_node_name = "-";
             if (port->input_from) {
                 in_port_name = port->input_from->descriptor->name;
                 in_node_name = port->input_from->node->descriptor->name;
             }
-            if (port->output_to) {
-                out_port_name = port->output_to->descriptor->name;
-                out_node_name = port->output_to->node->descriptor->name;
+            fprintf(stderr, "  port: %s  in: %s.%s  out:", port->descriptor->name,
+                    in_node_name, in_port_name);
+            if (port->output_count == 0)
+                fprintf(stderr, " -.-");
+            for (int out_i = 0; out_i < port->output_count; out_i += 1) {
+                GenesisPort *output = port->output_to[out_i];
+                fprintf(stderr, " %s.%s", output->node->descriptor->name, output->descriptor->name);
             }
-            fprintf(stderr, "  port: %s  in: %s.%s  out: %s.%s", port->descriptor->name,
-                    in_node_name, in_port_name, out_node_name, out_port_name);
             if (port->descriptor->port_type == GenesisPortTypeAudioIn ||
                 port->descriptor->port_type == GenesisPortTypeAudioOut)
             {
@@ -1829,193 +3299,1817 @@ static void genesis_debug_print_channel_layout(const struct SoundIoChannelLayout
     }
 }
 
-static void debug_print_audio_port_config(GenesisAudioPort *port) {
-    resolve_channel_layout(port);
-    resolve_sample_rate(port);
+static void debug_print_audio_port_config(GenesisAudioPort *port) {
+    resolve_channel_layout(port, &port->channel_layout);
+    resolve_sample_rate(port, &port->sample_rate);
+
+    GenesisAudioPortDescriptor *audio_descr = (GenesisAudioPortDescriptor *)port->port.descriptor;
+    const char *chan_layout_fixed = audio_descr->channel_layout_fixed ? "(fixed)" : "(any)";
+    const char *sample_rate_fixed = audio_descr->sample_rate_fixed ? "(fixed)" : "(any)";
+
+    fprintf(stderr, "audio port: %s\n", port->port.descriptor->name);
+    fprintf(stderr, "sample rate: %s %d\n", sample_rate_fixed, port->sample_rate);
+    fprintf(stderr, "channel_layout: %s ", chan_layout_fixed);
+    genesis_debug_print_channel_layout(&port->channel_layout);
+}
+
+static void debug_print_events_port_config(GenesisEventsPort *port) {
+    fprintf(stderr, "events port: %s\n", port->port.descriptor->name);
+}
+
+void genesis_debug_print_port_config(struct GenesisPort *port) {
+    switch (port->descriptor->port_type) {
+        case GenesisPortTypeAudioIn:
+        case GenesisPortTypeAudioOut:
+            debug_print_audio_port_config((GenesisAudioPort *)port);
+            return;
+        case GenesisPortTypeEventsIn:
+        case GenesisPortTypeEventsOut:
+            debug_print_events_port_config((GenesisEventsPort *)port);
+            return;
+    }
+    panic("invalid port type");
+}
+
+static GenesisNode *find_work(GenesisPipelineWorker *worker) {
+    GenesisPipeline *pipeline = worker->pipeline;
+    GenesisNode *node;
+    if (pipeline->scheduler == GenesisSchedulerCriticalPath) {
+        for (int level = GENESIS_PRIORITY_LEVEL_COUNT - 1; level >= 0; level -= 1) {
+            if (pipeline->priority_queues[level].try_shift(&node))
+                return node;
+        }
+        return nullptr;
+    }
+    node = worker->deque.pop();
+    if (node)
+        return node;
+    pipeline->task_queue.try_dequeue(&node);
+    if (node)
+        return node;
+    // the subgraphs queued by threads on the same NUMA node are likely to
+    // have their buffers there too, so those are stolen from first
+    for (int pass = 0; pass < 2; pass += 1) {
+        for (int i = 1; i < pipeline->thread_pool_size; i += 1) {
+            int victim_index = (worker->index + i) % pipeline->thread_pool_size;
+            GenesisPipelineWorker *victim = &pipeline->thread_pool[victim_index];
+            if ((victim->numa_node == worker->numa_node) != (pass == 0))
+                continue;
+            if ((node = victim->deque.steal()))
+                return node;
+        }
+    }
+    return nullptr;
+}
+
+// runs at most one node of pipeline, along with the rest of its fused chain.
+// returns whether it did.
+static bool executor_run_one(GenesisExecutorThread *thread, GenesisPipeline *pipeline) {
+    bool ran = false;
+    pipeline->active_worker_count += 1;
+    int worker_index = thread_worker_index(pipeline, thread->index);
+    if (pipeline->running && worker_index < pipeline->thread_pool_size &&
+        worker_index < pipeline->thread_scaling.active_thread_count.load(std::memory_order_relaxed))
+    {
+        // with the shared queue the deques stay empty, so this only looks
+        // at task_queue
+        GenesisPipelineWorker *worker = &pipeline->thread_pool[worker_index];
+        GenesisNode *node = find_work(worker);
+        if (node && pipeline->thread_scaling.min_thread_count)
+            pipeline->thread_scaling.ready_count.fetch_sub(1, std::memory_order_relaxed);
+        if (node) {
+            current_worker = worker;
+            current_scratch_arena = worker->scratch_arena;
+            run_node(node);
+            current_scratch_arena = nullptr;
+            current_worker = nullptr;
+            ran = true;
+        }
+    }
+    if (pipeline->active_worker_count.fetch_sub(1) == 1 && !pipeline->running)
+        futex_wake(reinterpret_cast<int*>(&pipeline->active_worker_count), 1);
+    return ran;
+}
+
+static bool executor_scan(GenesisExecutorThread *thread) {
+    GenesisContext *context = thread->context;
+    thread->scanning = true;
+    bool ran = false;
+    GenesisExecutorPipelineList *list = context->executor_pipelines.load();
+    if (list) {
+        // keep one thread free for realtime work, so that offline nodes,
+        // which run for a long time, cannot delay playback by more than
+        // one node run
+        bool realtime_only = thread->index == 0 && context->executor_thread_count > 1 &&
+            list->realtime_count > 0;
+        int count = realtime_only ? list->realtime_count : list->count;
+        for (int i = 0; i < count && !ran; i += 1)
+            ran = executor_run_one(thread, list->pipelines[i]);
+    }
+    thread->scanning = false;
+    thread->scan_count += 1;
+    return ran;
+}
+
+static void executor_thread_run(void *userdata) {
+    GenesisExecutorThread *thread = reinterpret_cast<GenesisExecutorThread*>(userdata);
+    GenesisContext *context = thread->context;
+    realtime_thread_begin();
+    while (!context->executor_exit.load()) {
+        if (executor_scan(thread))
+            continue;
+        // announce that we are idle before checking one last time, so
+        // that a producer either sees us idle or we see its node.
+        int epoch = thread->wake_epoch.load();
+        thread->idle.store(true);
+        context->executor_idle_count += 1;
+        if (!executor_scan(thread) && !context->executor_exit.load())
+            futex_wait(reinterpret_cast<int*>(&thread->wake_epoch), epoch);
+        context->executor_idle_count -= 1;
+        thread->idle.store(false);
+    }
+    realtime_thread_end();
+}
+
+static void executor_wake_all(GenesisContext *context) {
+    for (int i = 0; i < context->executor_thread_count; i += 1)
+        wake_executor_thread(&context->executor_threads[i]);
+}
+
+static int executor_create_threads(GenesisContext *context) {
+    if (context->executor_threads_created)
+        return 0;
+    context->executor_threads_created = true;
+    int err;
+    for (int i = 0; i < context->executor_thread_count; i += 1) {
+        GenesisExecutorThread *thread = &context->executor_threads[i];
+        OsThreadAttributes attributes = context->executor_thread_attributes;
+        if (thread->numa_cpu_mask)
+            attributes.cpu_mask = thread->numa_cpu_mask;
+        if ((err = os_thread_create_with_attributes(executor_thread_run, thread,
+                        &attributes, &thread->thread)))
+        {
+            return err;
+        }
+    }
+    return 0;
+}
+
+static void executor_destroy_threads(GenesisContext *context) {
+    context->executor_exit = true;
+    executor_wake_all(context);
+    for (int i = 0; i < context->executor_thread_count; i += 1) {
+        GenesisExecutorThread *thread = &context->executor_threads[i];
+        os_thread_destroy(thread->thread);
+        thread->thread = nullptr;
+    }
+}
+
+static void executor_pipeline_list_destroy(GenesisExecutorPipelineList *list) {
+    if (!list)
+        return;
+    destroy(list->pipelines, list->count);
+    destroy(list, 1);
+}
+
+// swaps in a new list of running pipelines and waits until no executor
+// thread can still be looking at the old one
+static int executor_update_pipelines(GenesisContext *context, GenesisPipeline *added,
+        GenesisPipeline *removed)
+{
+    GenesisExecutorPipelineList *old_list = context->executor_pipelines.load();
+    int old_count = old_list ? old_list->count : 0;
+    int new_count = old_count + (added ? 1 : 0) - (removed ? 1 : 0);
+
+    GenesisExecutorPipelineList *new_list = nullptr;
+    if (new_count > 0) {
+        new_list = create_zero<GenesisExecutorPipelineList>();
+        if (!new_list)
+            return GenesisErrorNoMem;
+        new_list->pipelines = allocate_zero<GenesisPipeline *>(new_count);
+        if (!new_list->pipelines) {
+            destroy(new_list, 1);
+            return GenesisErrorNoMem;
+        }
+        for (int offline = 0; offline <= 1; offline += 1) {
+            for (int i = 0; i <= old_count; i += 1) {
+                GenesisPipeline *pipeline = (i < old_count) ? old_list->pipelines[i] : added;
+                if (!pipeline || pipeline == removed || pipeline->offline != (bool)offline)
+                    continue;
+                new_list->pipelines[new_list->count++] = pipeline;
+                if (!offline)
+                    new_list->realtime_count += 1;
+            }
+        }
+        assert(new_list->count == new_count);
+    }
+
+    context->executor_pipelines.store(new_list);
+
+    for (int i = 0; i < context->executor_thread_count; i += 1) {
+        GenesisExecutorThread *thread = &context->executor_threads[i];
+        long scan_count = thread->scan_count.load();
+        while (thread->scanning.load() && thread->scan_count.load() == scan_count)
+            sched_yield();
+    }
+    executor_pipeline_list_destroy(old_list);
+    return 0;
+}
+
+// tell executor threads to leave the pipeline alone and wait until none is
+// running one of its nodes
+static void park_workers(GenesisPipeline *pipeline) {
+    pipeline->running = false;
+    for (;;) {
+        int active_count = pipeline->active_worker_count.load();
+        if (active_count == 0)
+            break;
+        futex_wait(reinterpret_cast<int*>(&pipeline->active_worker_count), active_count);
+    }
+}
+
+// must be called with running set
+static int unpark_workers(GenesisPipeline *pipeline) {
+    GenesisContext *context = pipeline->context;
+    int err;
+    if ((err = executor_create_threads(context)))
+        return err;
+    if (!pipeline->executor_listed) {
+        if ((err = executor_update_pipelines(context, pipeline, nullptr)))
+            return err;
+        pipeline->executor_listed = true;
+    }
+    // nodes queued before the pipeline was listed did not wake anyone
+    executor_wake_all(context);
+    return 0;
+}
+
+static void unlist_pipeline(GenesisPipeline *pipeline) {
+    if (!pipeline->executor_listed)
+        return;
+    // genesis_pipeline_stop has no way to report running out of memory
+    ok_or_panic(executor_update_pipelines(pipeline->context, nullptr, pipeline));
+    pipeline->executor_listed = false;
+}
+
+// the pipeline keeps the workers it had, within the range it may have now
+static void reset_thread_scaling(GenesisPipeline *pipeline) {
+    GenesisThreadScaling *scaling = &pipeline->thread_scaling;
+    int active_count = pipeline->thread_pool_size;
+    if (scaling->min_thread_count) {
+        active_count = clamp(min_active_thread_count(pipeline), scaling->active_thread_count.load(),
+                pipeline->thread_pool_size);
+    }
+    scaling->active_thread_count.store(active_count);
+    long busy_ns = 0;
+    for (int i = 0; i < pipeline->thread_pool_size; i += 1)
+        busy_ns += pipeline->thread_pool[i].busy_ns.load();
+    scaling->window_busy_ns.store(busy_ns);
+    scaling->window_start.store(os_timestamp());
+    scaling->ready_count.store(0);
+    scaling->peak_ready_count.store(0);
+}
+
+// a node is queued at most once at a time, so no deque can hold more than
+// every node. only reallocates when the node count grew. the critical path
+// scheduler uses no deques, and ranks the nodes again here instead, since
+// the graph or the run times may have changed.
+static int reset_queues(GenesisPipeline *pipeline) {
+    reset_thread_scaling(pipeline);
+    int err;
+    if ((err = pipeline->task_queue.resize(pipeline->nodes.length() + pipeline->thread_pool_size)))
+        return err;
+    if (pipeline->scheduler == GenesisSchedulerCriticalPath) {
+        for (int level = 0; level < GENESIS_PRIORITY_LEVEL_COUNT; level += 1) {
+            if ((err = pipeline->priority_queues[level].init(pipeline->nodes.length() + pipeline->thread_pool_size)))
+                return err;
+        }
+        return compute_upward_ranks(pipeline);
+    }
+    for (int i = 0; i < pipeline->thread_pool_size; i += 1) {
+        if ((err = pipeline->thread_pool[i].deque.resize(max(1, pipeline->nodes.length()))))
+            return err;
+    }
+    return 0;
+}
+
+// whether every node with state callbacks saved its state at boundary index
+static bool have_checkpoints(GenesisPipeline *pipeline, long index, int epoch) {
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        if (!node->descriptor->save_state)
+            continue;
+        GenesisNodeCheckpoints *checkpoints = node->checkpoints;
+        if (!checkpoints)
+            return false;
+        GenesisCheckpointSlot *slot = &checkpoints->slots[index % checkpoints->slot_count];
+        if (slot->index != index || slot->epoch != epoch)
+            return false;
+    }
+    return true;
+}
+
+// the latest boundary at or before time which every node can start from,
+// or -1. at boundary 0, time 0, every node starts from silence.
+static long find_checkpoint(GenesisPipeline *pipeline, double time) {
+    if (pipeline->checkpoint_interval <= 0.0)
+        return -1;
+    int sample_rate = pipeline->target_sample_rate;
+    long frame = lround(genesis_whole_notes_to_seconds(pipeline, time, sample_rate) * sample_rate);
+    long index = frame / checkpoint_interval_frames(pipeline);
+    int epoch = pipeline->checkpoint_epoch.load();
+    for (long oldest = max(0L, index - pipeline->checkpoint_count); index >= oldest; index -= 1) {
+        if (index == 0 || have_checkpoints(pipeline, index, epoch))
+            return index;
+    }
+    return -1;
+}
+
+// index is the boundary the node starts from, after its seek callback, or
+// -1 to start from its timestamp
+static void seek_checkpoints(GenesisNode *node, long index) {
+    GenesisNodeCheckpoints *checkpoints = node->checkpoints;
+    if (index < 0) {
+        long frame = checkpoint_frame_at(node, node->timestamp);
+        set_checkpoint_position(node, frame, frame == 0);
+        return;
+    }
+    if (index > 0)
+        node->descriptor->restore_state(node, checkpoints->slots[index % checkpoints->slot_count].state);
+    set_checkpoint_position(node, index * checkpoints->interval_frames, true);
+}
+
+// must be called with no node running and no device callback using ports.
+// with restore, the nodes start from a checkpoint before time if they can.
+static void seek_nodes(GenesisPipeline *pipeline, double time, bool restore) {
+    long checkpoint_index = restore ? find_checkpoint(pipeline, time) : -1;
+    pipeline->seek_time = time;
+    pipeline->seek_start_time = time;
+    if (checkpoint_index >= 0) {
+        pipeline->seek_start_time = genesis_frames_to_whole_notes(pipeline,
+                checkpoint_index * checkpoint_interval_frames(pipeline), pipeline->target_sample_rate);
+    }
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+            GenesisPort *port = node->ports[port_i];
+            if (port->descriptor->port_type == GenesisPortTypeAudioOut) {
+                GenesisAudioPort *audio_port = reinterpret_cast<GenesisAudioPort*>(port);
+                if (!audio_port->sample_buffer_err)
+                    ring_buffer_clear(&audio_port->sample_buffer);
+                audio_port->compensation_due = true;
+            } else if (port->descriptor->port_type == GenesisPortTypeEventsOut) {
+                GenesisEventsPort *events_port = reinterpret_cast<GenesisEventsPort*>(port);
+                if (!events_port->event_buffer_err)
+                    ring_buffer_clear(&events_port->event_buffer);
+            }
+        }
+        node->timestamp = pipeline->seek_start_time;
+        node_params_seek(node);
+        if (node->descriptor->seek)
+            node->descriptor->seek(node);
+        if (node->checkpoints)
+            seek_checkpoints(node, checkpoint_index);
+    }
+}
+
+// only reallocates buffers whose size changed
+static int greatest_common_divisor(int a, int b) {
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static int round_up(int value, int multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+// the consumer to fuse after node, if any
+static GenesisNode *find_fused_next(GenesisNode *node) {
+    if (!node->descriptor->run || node->direct_playback)
+        return nullptr;
+    GenesisPort *out_port = nullptr;
+    for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+        GenesisPort *port = node->ports[port_i];
+        if (port->output_count > 0) {
+            if (out_port)
+                return nullptr;
+            out_port = port;
+        }
+    }
+    if (!out_port || out_port->output_count != 1 || out_port->descriptor->port_type != GenesisPortTypeAudioOut)
+        return nullptr;
+    GenesisPort *in_port = out_port->output_to[0];
+    GenesisNode *consumer = in_port->node;
+    if (consumer == node || !consumer->descriptor->run || consumer->direct_playback)
+        return nullptr;
+    for (int port_i = 0; port_i < consumer->port_count; port_i += 1) {
+        GenesisPort *port = consumer->ports[port_i];
+        if (port != in_port && port->input_from && port->input_from != port)
+            return nullptr;
+    }
+    return consumer;
+}
+
+// must be called while no node runs and no device callback uses a port,
+// before chains are fused
+static void find_direct_playback_nodes(GenesisPipeline *pipeline) {
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        node->direct_playback = false;
+        node->device_driven.store(false);
+    }
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        if (node->descriptor->activate != playback_node_activate || !node->userdata)
+            continue;
+        PlaybackNodeContext *playback_node_context = (PlaybackNodeContext*)node->userdata;
+        playback_node_context->direct_node = nullptr;
+        GenesisPort *in_port = node->ports[0];
+        GenesisPort *out_port = in_port->input_from;
+        if (!pipeline->direct_playback || pipeline->offline || !out_port || out_port == in_port ||
+            out_port->output_count != 1)
+        {
+            continue;
+        }
+        // everything the node writes has to be taken by the device
+        GenesisNode *producer = out_port->node;
+        bool only_output = true;
+        for (int port_i = 0; port_i < producer->port_count; port_i += 1) {
+            GenesisPort *port = producer->ports[port_i];
+            if (port != out_port && port->output_count > 0)
+                only_output = false;
+        }
+        if (!producer->descriptor->run || is_audio_device_node_descriptor(producer->descriptor) || !only_output)
+            continue;
+        producer->direct_playback = true;
+        // a graph edit may change the node while the stream plays
+        producer->device_driven.store(playback_node_context->outstream &&
+                !playback_node_context->ongoing_recovery.load());
+        playback_node_context->direct_node = producer;
+    }
+}
+
+static int reserve_scratch_arena(char **arena, int *arena_size, int size) {
+    if (size <= *arena_size)
+        return 0;
+    char *new_arena = allocate_zero_aligned<char>(size, GENESIS_SCRATCH_ALIGNMENT);
+    if (!new_arena)
+        return GenesisErrorNoMem;
+    destroy(*arena, *arena_size);
+    *arena = new_arena;
+    *arena_size = size;
+    return 0;
+}
+
+// must be called while no node runs and no device callback runs one, after
+// the port buffers and direct playback are set up. a thread runs one node
+// at a time, so each worker has room for the largest scratch of any node,
+// and so does the device callback of a playback node with direct playback,
+// which runs a chain of them.
+static int init_scratch_arenas(GenesisPipeline *pipeline) {
+    int arena_size = 0;
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        int scratch_size = node->descriptor->scratch_size ? max(0, node->descriptor->scratch_size(node)) : 0;
+        node->scratch_size = (scratch_size + GENESIS_SCRATCH_ALIGNMENT - 1) & ~(GENESIS_SCRATCH_ALIGNMENT - 1);
+        arena_size = max(arena_size, node->scratch_size);
+    }
+    int err;
+    for (int i = 0; i < pipeline->thread_pool_size; i += 1) {
+        GenesisPipelineWorker *worker = &pipeline->thread_pool[i];
+        if ((err = reserve_scratch_arena(&worker->scratch_arena, &worker->scratch_arena_size, arena_size)))
+            return err;
+    }
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        if (node->descriptor->activate != playback_node_activate || !node->userdata)
+            continue;
+        PlaybackNodeContext *playback_node_context = (PlaybackNodeContext*)node->userdata;
+        if (!playback_node_context->direct_node)
+            continue;
+        if ((err = reserve_scratch_arena(&playback_node_context->direct_scratch_arena,
+                        &playback_node_context->direct_scratch_arena_size, arena_size)))
+        {
+            return err;
+        }
+    }
+    return 0;
+}
+
+// must be called while no node runs, before the port buffers are set up
+static void fuse_chains(GenesisPipeline *pipeline) {
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        node->fused_next = pipeline->fuse_chains ? find_fused_next(node) : nullptr;
+        node->fused_pending = false;
+    }
+}
+
+void genesis_node_descriptor_set_latency(struct GenesisNodeDescriptor *node_descriptor, int frames) {
+    node_descriptor->latency_frames = max(0, frames);
+}
+
+void genesis_node_set_latency(struct GenesisNode *node, int frames) {
+    node->latency_frames = max(-1, frames);
+}
+
+int genesis_node_latency(struct GenesisNode *node) {
+    return (node->latency_frames >= 0) ? node->latency_frames : node->descriptor->latency_frames;
+}
+
+double genesis_node_path_latency(struct GenesisNode *node) {
+    return node->path_latency.load();
+}
+
+static double node_latency_seconds(GenesisNode *node) {
+    int frames = genesis_node_latency(node);
+    if (frames == 0)
+        return 0.0;
+    for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+        GenesisPort *port = node->ports[port_i];
+        if (port->descriptor->port_type != GenesisPortTypeAudioOut)
+            continue;
+        int sample_rate = ((GenesisAudioPort *)port)->sample_rate;
+        return (sample_rate > 0) ? frames / (double)sample_rate : 0.0;
+    }
+    return 0.0;
+}
+
+// seconds from the sources of the graph to the out ports of node
+static double node_output_latency(GenesisNode *node) {
+    return node->path_latency.load() + node_latency_seconds(node);
+}
+
+// false when node is on a cycle of audio connections
+static bool visit_path_latency(GenesisNode *node) {
+    if (node->latency_visit == 2)
+        return true;
+    if (node->latency_visit == 1)
+        return false;
+    node->latency_visit = 1;
+    double path_latency = 0.0;
+    for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+        GenesisPort *port = node->ports[port_i];
+        if (port->descriptor->port_type != GenesisPortTypeAudioIn || !port->input_from || port->input_from == port)
+            continue;
+        GenesisNode *source = port->input_from->node;
+        if (!visit_path_latency(source))
+            return false;
+        path_latency = max(path_latency, node_output_latency(source));
+    }
+    node->path_latency.store(path_latency);
+    node->latency_visit = 2;
+    return true;
+}
+
+// must be called while no node runs, before the port buffers are set up.
+// every audio in port is delayed by how much sooner its frames arrive than
+// those of the node's slowest input.
+static void compute_latency_compensation(GenesisPipeline *pipeline) {
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1)
+        pipeline->nodes.at(node_index)->latency_visit = 0;
+    bool acyclic = true;
+    for (int node_index = 0; node_index < pipeline->nodes.length() && acyclic; node_index += 1)
+        acyclic = visit_path_latency(pipeline->nodes.at(node_index));
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        if (!acyclic)
+            node->path_latency.store(0.0);
+        for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+            GenesisPort *port = node->ports[port_i];
+            if (port->descriptor->port_type != GenesisPortTypeAudioIn)
+                continue;
+            GenesisAudioPort *audio_port = (GenesisAudioPort *)port;
+            audio_port->compensation_frames = 0;
+            if (!acyclic || !port->input_from || port->input_from == port)
+                continue;
+            double early = node->path_latency.load() - node_output_latency(port->input_from->node);
+            audio_port->compensation_frames = max(0, (int)lround(early * audio_port->sample_rate));
+        }
+    }
+}
+
+static int max_compensation_frames(GenesisPort *out_port) {
+    int frames = 0;
+    for (int i = 0; i < out_port->output_count; i += 1)
+        frames = max(frames, ((GenesisAudioPort *)out_port->output_to[i])->compensation_frames);
+    return frames;
+}
+
+// must be called while no node runs and no device callback uses a port,
+// after the port buffers are set up and before they are aliased. the
+// silence only goes into empty buffers, so that no frames are shifted
+// while the pipeline plays.
+static void apply_latency_compensation(GenesisPipeline *pipeline) {
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+            GenesisPort *port = node->ports[port_i];
+            if (port->descriptor->port_type != GenesisPortTypeAudioOut)
+                continue;
+            GenesisAudioPort *audio_port = (GenesisAudioPort *)port;
+            if (!audio_port->compensation_due)
+                continue;
+            audio_port->compensation_due = false;
+            RingBuffer *rb = &audio_port->sample_buffer;
+            int frame_count = max_compensation_frames(port);
+            if (frame_count == 0 || audio_port->sample_buffer_err || audio_port->in_place_buffer_port ||
+                ring_buffer_fill_count(rb) > 0)
+            {
+                continue;
+            }
+            // every reader starts at the silence, and the ones that need
+            // less of it skip ahead
+            int byte_count = frame_count * audio_port->bytes_per_frame;
+            long offset = rb->write_offset.load();
+            memset(ring_buffer_write_ptr(rb), 0, byte_count);
+            mark_written(audio_port, offset, byte_count, true);
+            ring_buffer_advance_write_ptr(rb, byte_count);
+            for (int i = 0; i < port->output_count; i += 1) {
+                GenesisAudioPort *audio_in_port = (GenesisAudioPort *)port->output_to[i];
+                int skip_count = (frame_count - audio_in_port->compensation_frames) * audio_port->bytes_per_frame;
+                if (skip_count > 0)
+                    ring_buffer_reader_advance_read_ptr(rb, port->output_to[i]->reader_index, skip_count);
+            }
+        }
+    }
+}
+
+// the converters between floats and samples of this precision
+static const SampleFormatInfo *sample_precision_info(GenesisSamplePrecision sample_precision) {
+    switch (sample_precision) {
+        case GenesisSamplePrecisionFloat32:
+            return sample_format_info_find(SoundIoFormatFloat32NE);
+        case GenesisSamplePrecisionFloat64:
+            return sample_format_info_find(SoundIoFormatFloat64NE);
+        case GenesisSamplePrecisionInt16:
+            return sample_format_info_find(SoundIoFormatS16NE);
+    }
+    panic("invalid sample precision");
+}
+
+// the rate the writer of events_out_port reached since its buffer was sized,
+// or twice the old capacity if it ran out of room. what it has done is
+// forgotten, so that a rate that drops off shrinks the buffer again.
+static int adapt_events_per_second_capacity(GenesisEventsPort *events_out_port) {
+    int capacity = events_out_port->events_per_second_capacity;
+    if (capacity == 0) {
+        capacity = DEFAULT_EVENTS_PER_SECOND_CAPACITY;
+    } else if (events_out_port->peak_event_rate > 0.0 || events_out_port->event_buffer_filled) {
+        double rate = 2.0 * events_out_port->peak_event_rate;
+        if (events_out_port->event_buffer_filled)
+            rate = max(rate, 2.0 * capacity);
+        capacity = clamp(MIN_EVENTS_PER_SECOND_CAPACITY, (int)ceil(rate), MAX_EVENTS_PER_SECOND_CAPACITY);
+    }
+    events_out_port->window_event_count = 0;
+    events_out_port->window_time = 0.0;
+    events_out_port->peak_event_rate = 0.0;
+    events_out_port->event_buffer_filled = false;
+    return capacity;
+}
+
+// each source of the graph is given, in turn, one of the NUMA nodes that
+// the pipeline threads are on, and every other node takes the home of the
+// producer of its first input, so that a chain of effects stays with the
+// source that feeds it. nodes on a cycle go with the first home.
+static int assign_numa_homes(GenesisPipeline *pipeline) {
+    GenesisContext *context = pipeline->context;
+    int numa_node_count = context->numa_cpu_masks.length();
+    List<int> homes;
+    int err;
+    for (int i = 0; i < pipeline->thread_pool_size; i += 1) {
+        GenesisPipelineWorker *worker = &pipeline->thread_pool[i];
+        worker->numa_node = (i < context->executor_thread_count) ?
+            context->executor_threads[worker_thread_index(pipeline, i)].numa_node : -1;
+        bool listed = worker->numa_node < 0;
+        for (int home_i = 0; home_i < homes.length() && !listed; home_i += 1)
+            listed = homes.at(home_i) == worker->numa_node;
+        if (!listed && (err = homes.append(worker->numa_node)))
+            return err;
+    }
+
+    int node_count = pipeline->nodes.length();
+    if (numa_node_count <= 1 || homes.length() == 0) {
+        for (int node_index = 0; node_index < node_count; node_index += 1)
+            pipeline->nodes.at(node_index)->numa_node = -1;
+        return 0;
+    }
+
+    List<int> pending;
+    List<GenesisNode *> order;
+    if ((err = pending.resize(node_count)) || (err = order.ensure_capacity(node_count)))
+        return err;
+    int next_home = 0;
+    for (int node_index = 0; node_index < node_count; node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        int input_count = 0;
+        for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+            GenesisPort *port = node->ports[port_i];
+            if (port->input_from && port->input_from != port)
+                input_count += 1;
+        }
+        pending.at(node_index) = input_count;
+        node->numa_node = -1;
+        if (input_count == 0) {
+            node->numa_node = homes.at(next_home);
+            next_home = (next_home + 1) % homes.length();
+            ok_or_panic(order.append(node));
+        }
+    }
+    for (int order_index = 0; order_index < order.length(); order_index += 1) {
+        GenesisNode *node = order.at(order_index);
+        for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+            GenesisPort *port = node->ports[port_i];
+            for (int i = 0; i < port->output_count; i += 1) {
+                GenesisNode *consumer = port->output_to[i]->node;
+                if (consumer->numa_node < 0)
+                    consumer->numa_node = node->numa_node;
+                if ((pending.at(consumer->set_index) -= 1) == 0)
+                    ok_or_panic(order.append(consumer));
+            }
+        }
+    }
+    for (int node_index = 0; node_index < node_count; node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        if (node->numa_node < 0)
+            node->numa_node = homes.at(0);
+    }
+    return 0;
+}
+
+static int init_port_buffers(GenesisNode *node, double desired_buffer_duration) {
+    bool offline = node->descriptor->pipeline->offline;
+    int block_size = node->descriptor->pipeline->block_size;
+    MirroredMemoryPool *pool = &node->descriptor->pipeline->context->ring_buffer_pool;
+    for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+        GenesisPort *port = node->ports[port_i];
+        if (port->descriptor->port_type == GenesisPortTypeAudioIn) {
+            GenesisAudioPort *audio_port = reinterpret_cast<GenesisAudioPort*>(port);
+            GenesisAudioPortDescriptor *audio_descr = (GenesisAudioPortDescriptor *)port->descriptor;
+            audio_port->sample_precision = audio_descr->sample_precision;
+            audio_port->bytes_per_frame = sample_precision_info(audio_port->sample_precision)->bytes_per_sample *
+                audio_port->channel_layout.channel_count;
+            audio_port->sample_layout = (block_size > 0) ? audio_descr->sample_layout :
+                GenesisSampleLayoutInterleaved;
+        } else if (port->descriptor->port_type == GenesisPortTypeAudioOut) {
+            GenesisAudioPort *audio_port = reinterpret_cast<GenesisAudioPort*>(port);
+            int sample_buffer_frame_count = offline ? GENESIS_OFFLINE_BLOCK_FRAME_COUNT :
+                ceil(desired_buffer_duration * audio_port->sample_rate);
+            // a buffer that has frames in it keeps its size when the chain
+            // changes, so that none are lost
+            bool fused = node->fused_next != nullptr;
+            if (!audio_port->sample_buffer_err && ring_buffer_fill_count(&audio_port->sample_buffer) > 0)
+                fused = audio_port->fused_buffer;
+            audio_port->fused_buffer = fused;
+            if (fused)
+                sample_buffer_frame_count = min(sample_buffer_frame_count, GENESIS_FUSED_BUFFER_FRAME_COUNT);
+            // what a direct playback node has written waits for the device,
+            // so it holds no more than one device buffer
+            if (node->direct_playback) {
+                sample_buffer_frame_count = min(sample_buffer_frame_count,
+                        (int)ceil(node->descriptor->pipeline->device_latency * audio_port->sample_rate));
+            }
+            // room for the silence that delays its in ports, on top of
+            // the room to work in
+            sample_buffer_frame_count += max_compensation_frames(port);
+            // frames already in the buffer keep their precision
+            GenesisAudioPortDescriptor *audio_descr = (GenesisAudioPortDescriptor *)port->descriptor;
+            if (audio_port->sample_buffer_err || ring_buffer_fill_count(&audio_port->sample_buffer) == 0)
+                audio_port->sample_precision = audio_descr->sample_precision;
+            audio_port->bytes_per_frame = sample_precision_info(audio_port->sample_precision)->bytes_per_sample *
+                audio_port->channel_layout.channel_count;
+            // the ring buffer capacity is a whole number of pages. with a
+            // block size it also has to be a whole number of blocks, so that
+            // block offsets stay aligned when they wrap around.
+            int ring_buffer_capacity_multiple = 1;
+            if (block_size > 0) {
+                // room for two blocks, so that the producer can write one
+                // while the consumer reads the other
+                sample_buffer_frame_count = max(2 * block_size, round_up(sample_buffer_frame_count, block_size));
+                int block_byte_count = block_size * audio_port->bytes_per_frame;
+                int page_size = os_page_size();
+                ring_buffer_capacity_multiple = block_byte_count / greatest_common_divisor(block_byte_count,
+                        page_size) * page_size;
+            }
+            int new_sample_buffer_size = sample_buffer_frame_count * audio_port->bytes_per_frame;
+            bool different = new_sample_buffer_size != audio_port->sample_buffer_size ||
+                (!audio_port->sample_buffer_err &&
+                 audio_port->sample_buffer.capacity % ring_buffer_capacity_multiple != 0);
+            audio_port->sample_buffer_size = new_sample_buffer_size;
+
+            // planar frames need the silence in front of every reader to be
+            // whole blocks. frames already in the buffer keep their layout.
+            if (audio_port->sample_buffer_err || ring_buffer_fill_count(&audio_port->sample_buffer) == 0) {
+                bool planar = block_size > 0 && audio_descr->sample_layout == GenesisSampleLayoutPlanar;
+                for (int i = 0; planar && i < port->output_count; i += 1)
+                    planar = ((GenesisAudioPort *)port->output_to[i])->compensation_frames % block_size == 0;
+                audio_port->sample_layout = planar ? GenesisSampleLayoutPlanar : GenesisSampleLayoutInterleaved;
+            }
+
+            if (audio_port->sample_buffer_err || different) {
+                if (!audio_port->sample_buffer_err)
+                    ring_buffer_deinit_pooled(&audio_port->sample_buffer, pool);
+                int ring_buffer_capacity = round_up(audio_port->sample_buffer_size, ring_buffer_capacity_multiple);
+                if ((audio_port->sample_buffer_err =
+                        ring_buffer_init_pooled(&audio_port->sample_buffer, pool, ring_buffer_capacity)))
+                {
+                    return audio_port->sample_buffer_err;
+                }
+                ring_buffer_set_reader_count(&audio_port->sample_buffer, port_reader_count(port));
+                audio_port->compensation_due = true;
+            }
+            // the home may have changed along with the graph
+            if (node->numa_node >= 0)
+                ring_buffer_bind_numa_node(&audio_port->sample_buffer, node->numa_node);
+
+            // the buffer may have moved or started over, so nothing is
+            // known to be silence any more
+            int granule_frame_count = (block_size > 0) ? block_size : SILENCE_GRANULE_FRAME_COUNT;
+            audio_port->silence_granule_size = granule_frame_count * audio_port->bytes_per_frame;
+            int silent_granule_count = audio_port->sample_buffer.capacity / audio_port->silence_granule_size + 2;
+            if (silent_granule_count != audio_port->silent_granule_count) {
+                destroy(audio_port->silent_granules, audio_port->silent_granule_count);
+                audio_port->silent_granule_count = 0;
+                audio_port->silent_granules = allocate_nonzero<atomic_long>(silent_granule_count);
+                if (!audio_port->silent_granules)
+                    return GenesisErrorNoMem;
+                audio_port->silent_granule_count = silent_granule_count;
+            }
+            reset_silent_granules(audio_port);
+        } else if (port->descriptor->port_type == GenesisPortTypeEventsOut) {
+            GenesisEventsPort *events_port = reinterpret_cast<GenesisEventsPort*>(port);
+            // a buffer that has events in it keeps its size, so that none
+            // are lost
+            if (!events_port->event_buffer_err && ring_buffer_fill_count(&events_port->event_buffer) > 0)
+                continue;
+            events_port->events_per_second_capacity = adapt_events_per_second_capacity(events_port);
+            int min_event_buffer_size = ceil(events_port->events_per_second_capacity * desired_buffer_duration) *
+                sizeof(GenesisMidiEvent);
+            bool different = min_event_buffer_size != events_port->event_buffer_size;
+            events_port->event_buffer_size = min_event_buffer_size;
+            if (events_port->event_buffer_err || different) {
+                if (!events_port->event_buffer_err)
+                    ring_buffer_deinit_pooled(&events_port->event_buffer, pool);
+                if ((events_port->event_buffer_err = ring_buffer_init_pooled(&events_port->event_buffer,
+                                pool, min_event_buffer_size)))
+                {
+                    return events_port->event_buffer_err;
+                }
+                ring_buffer_set_reader_count(&events_port->event_buffer, port_reader_count(port));
+            }
+            if (node->numa_node >= 0)
+                ring_buffer_bind_numa_node(&events_port->event_buffer, node->numa_node);
+        }
+    }
+    return 0;
+}
+
+static void alias_in_place_port(GenesisAudioPort *audio_out_port) {
+    if (audio_out_port->in_place_checked)
+        return;
+    audio_out_port->in_place_checked = true;
+
+    GenesisAudioPortDescriptor *descr = (GenesisAudioPortDescriptor *)audio_out_port->port.descriptor;
+    GenesisNode *node = audio_out_port->port.node;
+    if (!descr->in_place || audio_out_port->port.output_count != 1 || node->direct_playback ||
+        descr->in_place_index < 0 || descr->in_place_index >= node->port_count)
+    {
+        return;
+    }
+    GenesisPort *in_port = node->ports[descr->in_place_index];
+    GenesisPort *source = in_port->input_from;
+    if (in_port->descriptor->port_type != GenesisPortTypeAudioIn || !source || source == in_port ||
+        source->output_count != 1)
+    {
+        return;
+    }
+    // ports that are delayed read the silence from their own buffers
+    GenesisAudioPort *audio_in_port = (GenesisAudioPort *)in_port;
+    if (audio_in_port->compensation_frames > 0 ||
+        ((GenesisAudioPort *)audio_out_port->port.output_to[0])->compensation_frames > 0)
+    {
+        return;
+    }
+
+    // a chain of in place nodes all share the buffer at its start
+    GenesisAudioPort *audio_source = (GenesisAudioPort *)source;
+    alias_in_place_port(audio_source);
+    GenesisAudioPort *buffer_port = audio_buffer_port(audio_source);
+    // the frames have to fit back into this port's own buffer when the
+    // chain is taken apart
+    if (buffer_port->sample_buffer_err || audio_out_port->sample_buffer_err ||
+        buffer_port->bytes_per_frame != audio_out_port->bytes_per_frame ||
+        buffer_port->sample_buffer_size > audio_out_port->sample_buffer_size)
+    {
+        return;
+    }
+    // the node works on the frames where they are, so it has to see them
+    // in the layout and precision they are in. so does the consumer, whose
+    // reader would otherwise not have to be at the start of a block when the
+    // chain is taken apart.
+    GenesisAudioPort *consumer = (GenesisAudioPort *)audio_out_port->port.output_to[0];
+    if (audio_in_port->sample_layout != buffer_port->sample_layout ||
+        audio_out_port->sample_layout != buffer_port->sample_layout ||
+        consumer->sample_layout != buffer_port->sample_layout ||
+        audio_in_port->sample_precision != buffer_port->sample_precision ||
+        audio_out_port->sample_precision != buffer_port->sample_precision ||
+        consumer->sample_precision != buffer_port->sample_precision)
+    {
+        return;
+    }
+
+    // frames that the consumer has not read yet from this port's own
+    // buffer go in front of the ones the node has yet to process, in room
+    // that the node has already read past
+    RingBuffer *rb = &buffer_port->sample_buffer;
+    RingBuffer *own_rb = &audio_out_port->sample_buffer;
+    int node_reader = audio_in_port_reader(audio_in_port);
+    int pending_count = ring_buffer_fill_count(own_rb);
+    if (pending_count > ring_buffer_free_count(rb) || rb->read_offsets[node_reader].load() < pending_count)
+        return;
+    int consumer_reader = ring_buffer_add_reader(rb);
+    if (consumer_reader < 0)
+        return;
+    ring_buffer_set_reader_source(rb, consumer_reader, node_reader);
+    if (pending_count > 0) {
+        memcpy(ring_buffer_reader_rewind(rb, consumer_reader, pending_count),
+                ring_buffer_read_ptr(own_rb), pending_count);
+        ring_buffer_clear(own_rb);
+    }
+
+    audio_out_port->in_place_buffer_port = buffer_port;
+    audio_out_port->in_place_reader = node_reader;
+    reset_silent_granules(audio_out_port);
+    audio_in_port->in_place_out_port = audio_out_port;
+    consumer->in_place_source_reader = consumer_reader;
+}
+
+// must be called while no node runs and no device callback uses a port,
+// after the port buffers are set up
+static void alias_in_place_ports(GenesisPipeline *pipeline) {
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+            GenesisPort *port = node->ports[port_i];
+            if (port->descriptor->port_type == GenesisPortTypeAudioOut)
+                alias_in_place_port((GenesisAudioPort *)port);
+        }
+    }
+}
+
+// must be called after alias_in_place_ports. gives each in port whose
+// source holds its frames in another layout or precision room to convert
+// them in.
+static int init_convert_buffers(GenesisPipeline *pipeline) {
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+            GenesisPort *port = node->ports[port_i];
+            if (port->descriptor->port_type != GenesisPortTypeAudioIn)
+                continue;
+            GenesisAudioPort *audio_in_port = (GenesisAudioPort *)port;
+            int size = 0;
+            if (port->input_from && port->input_from != port) {
+                GenesisAudioPort *buffer_port = audio_buffer_port((GenesisAudioPort *)port->input_from);
+                // a reader that is partway into a planar block converts all
+                // of it
+                if ((buffer_port->sample_layout != audio_in_port->sample_layout ||
+                     buffer_port->sample_precision != audio_in_port->sample_precision) &&
+                    !buffer_port->sample_buffer_err)
+                {
+                    int frame_count = buffer_port->sample_buffer.capacity / buffer_port->bytes_per_frame;
+                    size = (frame_count + pipeline->block_size) * audio_in_port->bytes_per_frame;
+                }
+            }
+            if (size == audio_in_port->convert_buffer_size)
+                continue;
+            destroy(audio_in_port->convert_buffer, audio_in_port->convert_buffer_size);
+            audio_in_port->convert_buffer = nullptr;
+            audio_in_port->convert_buffer_size = 0;
+            if (size > 0) {
+                if (!(audio_in_port->convert_buffer = allocate_nonzero<char>(size)))
+                    return GenesisErrorNoMem;
+                audio_in_port->convert_buffer_size = size;
+            }
+        }
+    }
+    return 0;
+}
+
+// undoes alias_in_place_ports, before ports are connected or disconnected
+// or their buffers change. frames that a consumer of an in place port has
+// not read yet move to the port's own buffer, so none are lost.
+static void unalias_in_place_ports(GenesisPipeline *pipeline) {
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+            GenesisPort *port = node->ports[port_i];
+            if (port->descriptor->port_type != GenesisPortTypeAudioOut)
+                continue;
+            GenesisAudioPort *audio_port = (GenesisAudioPort *)port;
+            GenesisAudioPort *buffer_port = audio_port->in_place_buffer_port;
+            if (!buffer_port)
+                continue;
+            RingBuffer *rb = &buffer_port->sample_buffer;
+            int reader = ((GenesisAudioPort *)port->output_to[0])->in_place_source_reader;
+            int byte_count = ring_buffer_reader_fill_count(rb, reader);
+            ring_buffer_set_reader_count(&audio_port->sample_buffer, 1);
+            memcpy(ring_buffer_write_ptr(&audio_port->sample_buffer),
+                    ring_buffer_reader_read_ptr(rb, reader), byte_count);
+            ring_buffer_advance_write_ptr(&audio_port->sample_buffer, byte_count);
+        }
+    }
+    // the readers that were added are the last ones of each buffer, so
+    // dropping them leaves the others where they are
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+            GenesisPort *port = node->ports[port_i];
+            if (port->descriptor->port_type == GenesisPortTypeAudioIn) {
+                ((GenesisAudioPort *)port)->in_place_out_port = nullptr;
+                continue;
+            }
+            if (port->descriptor->port_type != GenesisPortTypeAudioOut)
+                continue;
+            GenesisAudioPort *audio_port = (GenesisAudioPort *)port;
+            audio_port->in_place_checked = false;
+            GenesisAudioPort *buffer_port = audio_port->in_place_buffer_port;
+            if (!buffer_port)
+                continue;
+            RingBuffer *rb = &buffer_port->sample_buffer;
+            while (rb->reader_count > port_reader_count(&buffer_port->port))
+                ring_buffer_remove_reader(rb, rb->reader_count - 1);
+            audio_port->in_place_buffer_port = nullptr;
+            reset_silent_granules(audio_port);
+        }
+    }
+}
+
+// nothing is queued after seeking or editing the graph, so ask every
+// producer for frames
+static void kick_producers(GenesisPipeline *pipeline) {
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+            GenesisPort *port = node->ports[port_i];
+            if (port->input_from && port->input_from != port)
+                port_consumed(port->input_from->node);
+        }
+    }
+}
+
+static int resume_pipeline(GenesisPipeline *pipeline, bool from_seek);
+
+int genesis_pipeline_start(struct GenesisPipeline *pipeline, double time) {
+    seek_nodes(pipeline, time, false);
+    return resume_pipeline(pipeline, true);
+}
+
+int genesis_pipeline_seek(struct GenesisPipeline *pipeline, double time) {
+    if (!pipeline->running)
+        return genesis_pipeline_start(pipeline, time);
+
+    park_workers(pipeline);
+    wait_for_device_callbacks(pipeline);
+
+    int err;
+    if ((err = reset_queues(pipeline))) {
+        genesis_pipeline_stop(pipeline);
+        return err;
+    }
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1)
+        pipeline->nodes.at(node_index)->being_processed = false;
+    if (pipeline->compiled_graph)
+        ok_or_panic(build_execution_plan(pipeline));
+
+    seek_nodes(pipeline, time, true);
+    apply_latency_compensation(pipeline);
+    reset_adaptive_latency_window(pipeline);
+
+    pipeline->running = true;
+    if ((err = unpark_workers(pipeline))) {
+        genesis_pipeline_stop(pipeline);
+        return err;
+    }
+
+    kick_producers(pipeline);
+    return 0;
+}
+
+int genesis_pipeline_reopen_devices(struct GenesisPipeline *pipeline, double latency) {
+    if (!pipeline->running)
+        return GenesisErrorInvalidState;
+    if (latency > 60.0)
+        return GenesisErrorInvalidParam;
+
+    park_workers(pipeline);
+    wait_for_device_callbacks(pipeline);
+
+    for (int i = 0; i < pipeline->nodes.length(); i += 1) {
+        GenesisNode *node = pipeline->nodes.at(i);
+        if (is_audio_device_node_descriptor(node->descriptor))
+            node->descriptor->deactivate(node);
+    }
+
+    if (latency > 0.0) {
+        // the port buffers keep their size and what is in them until the
+        // next resume, so the device buffer makes up the difference
+        pipeline->latency = latency;
+        pipeline->device_latency = max(pipeline->actual_latency * 0.25, latency - pipeline->actual_latency * 0.75);
+    }
+
+    pipeline->stream_fail_flag.test_and_set();
+    reset_adaptive_latency_window(pipeline);
+    pipeline->running = true;
+
+    int err;
+    for (int i = 0; i < pipeline->nodes.length(); i += 1) {
+        GenesisNode *node = pipeline->nodes.at(i);
+        if (is_audio_device_node_descriptor(node->descriptor) && (err = node->descriptor->activate(node))) {
+            genesis_pipeline_stop(pipeline);
+            return err;
+        }
+    }
+
+    if ((err = unpark_workers(pipeline))) {
+        genesis_pipeline_stop(pipeline);
+        return err;
+    }
+
+    // a playback device starts once its input is full, which it may
+    // already be, so nothing else would run it
+    for (int i = 0; i < pipeline->nodes.length(); i += 1) {
+        GenesisNode *node = pipeline->nodes.at(i);
+        if (is_audio_device_node_descriptor(node->descriptor))
+            port_consumed(node);
+    }
+    return 0;
+}
+
+void genesis_pipeline_stop(struct GenesisPipeline *pipeline) {
+    park_workers(pipeline);
+    unlist_pipeline(pipeline);
+    for (int i = 0; i < pipeline->nodes.length(); i += 1) {
+        GenesisNode *node = pipeline->nodes.at(i);
+        assert(node->descriptor->pipeline);
+        if (node->descriptor->deactivate)
+            node->descriptor->deactivate(node);
+        destroy_node_checkpoints(node);
+    }
+    unalias_in_place_ports(pipeline);
+}
+
+// from_seek is whether every node was seeked since the pipeline stopped
+static int resume_pipeline(GenesisPipeline *pipeline, bool from_seek) {
+    int err;
+    if ((err = reset_queues(pipeline))) {
+        genesis_pipeline_stop(pipeline);
+        return err;
+    }
+
+    if (pipeline->compiled_graph && (err = build_execution_plan(pipeline))) {
+        genesis_pipeline_stop(pipeline);
+        return err;
+    }
+
+    pipeline->stream_fail_flag.test_and_set();
+
+    double desired_buffer_duration;
+    if (pipeline->offline) {
+        // there is no device to keep fed, so buffers are sized for
+        // throughput. audio ports ignore this and use GENESIS_OFFLINE_BLOCK_FRAME_COUNT.
+        desired_buffer_duration = GENESIS_OFFLINE_BLOCK_FRAME_COUNT / (double)pipeline->target_sample_rate;
+    } else {
+        // the 0.75 is because the outstream software_latency is pipeline->latency * 0.25
+        desired_buffer_duration = pipeline->latency * 0.75;
+        for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
+            GenesisNode *node = pipeline->nodes.at(node_index);
+            desired_buffer_duration = max(node->descriptor->min_software_latency, desired_buffer_duration);
+        }
+    }
+    pipeline->actual_latency = desired_buffer_duration / 0.75;
+    pipeline->device_latency = pipeline->actual_latency * 0.25;
+    reset_adaptive_latency_window(pipeline);
+
+    unalias_in_place_ports(pipeline);
+    find_direct_playback_nodes(pipeline);
+    fuse_chains(pipeline);
+    compute_latency_compensation(pipeline);
+    if ((err = assign_numa_homes(pipeline))) {
+        genesis_pipeline_stop(pipeline);
+        return err;
+    }
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        node->being_processed = false;
+        if ((err = init_port_buffers(node, desired_buffer_duration))) {
+            genesis_pipeline_stop(pipeline);
+            return err;
+        }
+    }
+    apply_latency_compensation(pipeline);
+    alias_in_place_ports(pipeline);
+    if ((err = init_convert_buffers(pipeline)) || (err = init_scratch_arenas(pipeline))) {
+        genesis_pipeline_stop(pipeline);
+        return err;
+    }
+
+    pipeline->running = true;
+
+    for (int i = 0; i < pipeline->nodes.length(); i += 1) {
+        GenesisNode *node = pipeline->nodes.at(i);
+        if (node->descriptor->activate) {
+            if ((err = node->descriptor->activate(node))) {
+                genesis_pipeline_stop(pipeline);
+                return err;
+            }
+        }
+    }
+    for (int i = 0; i < pipeline->nodes.length(); i += 1) {
+        if ((err = init_node_checkpoints(pipeline->nodes.at(i), from_seek))) {
+            genesis_pipeline_stop(pipeline);
+            return err;
+        }
+    }
+
+    if ((err = unpark_workers(pipeline))) {
+        genesis_pipeline_stop(pipeline);
+        return err;
+    }
+
+    return 0;
+}
+
+int genesis_pipeline_resume(struct GenesisPipeline *pipeline) {
+    return resume_pipeline(pipeline, false);
+}
+
+int genesis_graph_edit_begin(struct GenesisPipeline *pipeline, struct GenesisGraphEdit **out_edit) {
+    *out_edit = nullptr;
+    if (pipeline->graph_edit)
+        return GenesisErrorInvalidState;
+
+    GenesisGraphEdit *edit = create_zero<GenesisGraphEdit>();
+    if (!edit)
+        return GenesisErrorNoMem;
+
+    edit->pipeline = pipeline;
+    pipeline->graph_edit = edit;
+    *out_edit = edit;
+    return 0;
+}
+
+static void graph_edit_destroy(GenesisGraphEdit *edit) {
+    edit->pipeline->graph_edit = nullptr;
+    destroy(edit, 1);
+}
+
+static bool graph_edit_owns_node(GenesisGraphEdit *edit, GenesisNode *node) {
+    for (int i = 0; i < edit->added_nodes.length(); i += 1) {
+        if (edit->added_nodes.at(i) == node)
+            return true;
+    }
+    return false;
+}
+
+// changes that only involve nodes added by this edit, or which are made
+// while the pipeline is stopped, do not have to wait for commit
+static bool graph_edit_is_immediate(GenesisGraphEdit *edit, GenesisNode *a, GenesisNode *b) {
+    if (!edit->pipeline->running)
+        return true;
+    return graph_edit_owns_node(edit, a) && (!b || graph_edit_owns_node(edit, b));
+}
+
+static int graph_edit_append_op(GenesisGraphEdit *edit, GenesisGraphEditOpType type,
+        GenesisPort *source, GenesisPort *dest, GenesisNode *node)
+{
+    GenesisGraphEditOp op;
+    op.type = type;
+    op.source = source;
+    op.dest = dest;
+    op.node = node;
+    return edit->ops.append(op);
+}
+
+struct GenesisNode *genesis_graph_edit_add_node(struct GenesisGraphEdit *edit,
+        struct GenesisNodeDescriptor *node_descriptor)
+{
+    if (edit->added_nodes.ensure_capacity(edit->added_nodes.length() + 1))
+        return nullptr;
+    GenesisNode *node = genesis_node_descriptor_create_node(node_descriptor);
+    if (!node)
+        return nullptr;
+    ok_or_panic(edit->added_nodes.append(node));
+    return node;
+}
+
+int genesis_graph_edit_remove_node(struct GenesisGraphEdit *edit, struct GenesisNode *node) {
+    if (!node)
+        return 0;
+    for (int i = 0; i < edit->added_nodes.length(); i += 1) {
+        if (edit->added_nodes.at(i) == node) {
+            // forget pending changes which mention it
+            int op_count = 0;
+            for (int op_i = 0; op_i < edit->ops.length(); op_i += 1) {
+                GenesisGraphEditOp *op = &edit->ops.at(op_i);
+                bool mentions_node = op->node == node ||
+                    (op->source && op->source->node == node) || (op->dest && op->dest->node == node);
+                if (!mentions_node)
+                    edit->ops.at(op_count++) = *op;
+            }
+            edit->ops.remove_range(op_count, edit->ops.length());
+            edit->added_nodes.swap_remove(i);
+            genesis_node_destroy(node);
+            return 0;
+        }
+    }
+    if (graph_edit_is_immediate(edit, node, nullptr)) {
+        genesis_node_destroy(node);
+        return 0;
+    }
+    return graph_edit_append_op(edit, GenesisGraphEditOpTypeRemoveNode, nullptr, nullptr, node);
+}
+
+static int check_connect_ports(GenesisPort *source, GenesisPort *dest) {
+    switch (source->descriptor->port_type) {
+        case GenesisPortTypeAudioOut:
+            {
+                if (dest->descriptor->port_type != GenesisPortTypeAudioIn)
+                    return GenesisErrorInvalidPortDirection;
+                AudioPortFormat source_format;
+                AudioPortFormat dest_format;
+                return negotiate_audio_ports((GenesisAudioPort *)source, (GenesisAudioPort *)dest,
+                        &source_format, &dest_format);
+            }
+        case GenesisPortTypeEventsOut:
+            if (dest->descriptor->port_type != GenesisPortTypeEventsIn)
+                return GenesisErrorInvalidPortDirection;
+            return 0;
+        case GenesisPortTypeAudioIn:
+        case GenesisPortTypeEventsIn:
+            return GenesisErrorInvalidPortDirection;
+    }
+    return GenesisErrorInvalidPortType;
+}
+
+int genesis_graph_edit_connect(struct GenesisGraphEdit *edit,
+        struct GenesisPort *source, struct GenesisPort *dest)
+{
+    if (graph_edit_is_immediate(edit, source->node, dest->node))
+        return genesis_connect_ports(source, dest);
+
+    int err;
+    if ((err = check_connect_ports(source, dest)))
+        return err;
+    return graph_edit_append_op(edit, GenesisGraphEditOpTypeConnect, source, dest, nullptr);
+}
+
+int genesis_graph_edit_connect_audio_nodes(struct GenesisGraphEdit *edit,
+        struct GenesisNode *source, struct GenesisNode *dest)
+{
+    int audio_out_port_index = genesis_node_descriptor_find_port_index(source->descriptor, "audio_out");
+    if (audio_out_port_index < 0)
+        return GenesisErrorPortNotFound;
+
+    int audio_in_port_index = genesis_node_descriptor_find_port_index(dest->descriptor, "audio_in");
+    if (audio_in_port_index < 0)
+        return GenesisErrorPortNotFound;
+
+    return genesis_graph_edit_connect(edit, genesis_node_port(source, audio_out_port_index),
+            genesis_node_port(dest, audio_in_port_index));
+}
+
+int genesis_graph_edit_disconnect(struct GenesisGraphEdit *edit,
+        struct GenesisPort *source, struct GenesisPort *dest)
+{
+    if (dest->input_from != source)
+        return GenesisErrorInvalidParam;
+
+    if (graph_edit_is_immediate(edit, source->node, dest->node)) {
+        genesis_disconnect_ports(source, dest);
+        return 0;
+    }
+    return graph_edit_append_op(edit, GenesisGraphEditOpTypeDisconnect, source, dest, nullptr);
+}
+
+static int graph_edit_apply_ops(GenesisGraphEdit *edit, bool was_running) {
+    int err;
+    for (int op_i = 0; op_i < edit->ops.length(); op_i += 1) {
+        GenesisGraphEditOp *op = &edit->ops.at(op_i);
+        switch (op->type) {
+            case GenesisGraphEditOpTypeConnect:
+                if ((err = genesis_connect_ports(op->source, op->dest)))
+                    return err;
+                break;
+            case GenesisGraphEditOpTypeDisconnect:
+                genesis_disconnect_ports(op->source, op->dest);
+                break;
+            case GenesisGraphEditOpTypeRemoveNode:
+                if (was_running && op->node->descriptor->deactivate)
+                    op->node->descriptor->deactivate(op->node);
+                genesis_node_destroy(op->node);
+                break;
+        }
+    }
+    return 0;
+}
+
+int genesis_graph_edit_commit(struct GenesisGraphEdit *edit) {
+    GenesisPipeline *pipeline = edit->pipeline;
+    int err;
+
+    if (!pipeline->running) {
+        err = graph_edit_apply_ops(edit, false);
+        graph_edit_destroy(edit);
+        return err;
+    }
+
+    // wait for a grace period in which no pipeline thread is running a node
+    // and no device callback is using a port. the device keeps playing from
+    // what it already has buffered.
+    park_workers(pipeline);
+    wait_for_device_callbacks(pipeline);
+    unalias_in_place_ports(pipeline);
+
+    if ((err = graph_edit_apply_ops(edit, true))) {
+        graph_edit_destroy(edit);
+        genesis_pipeline_stop(pipeline);
+        return err;
+    }
+
+    find_direct_playback_nodes(pipeline);
+    fuse_chains(pipeline);
+    compute_latency_compensation(pipeline);
+    if ((err = assign_numa_homes(pipeline))) {
+        graph_edit_destroy(edit);
+        genesis_pipeline_stop(pipeline);
+        return err;
+    }
+    double desired_buffer_duration = pipeline->actual_latency * 0.75;
+    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_index);
+        node->being_processed = false;
+        if ((err = init_port_buffers(node, desired_buffer_duration))) {
+            graph_edit_destroy(edit);
+            genesis_pipeline_stop(pipeline);
+            return err;
+        }
+    }
+    apply_latency_compensation(pipeline);
+    alias_in_place_ports(pipeline);
+
+    if ((err = init_convert_buffers(pipeline)) ||
+        (err = init_scratch_arenas(pipeline)) ||
+        (err = reset_queues(pipeline)) ||
+        (pipeline->compiled_graph && (err = build_execution_plan(pipeline))))
+    {
+        graph_edit_destroy(edit);
+        genesis_pipeline_stop(pipeline);
+        return err;
+    }
+
+    pipeline->running = true;
+
+    for (int i = 0; i < edit->added_nodes.length(); i += 1) {
+        GenesisNode *node = edit->added_nodes.at(i);
+        if (node->descriptor->activate && (err = node->descriptor->activate(node))) {
+            graph_edit_destroy(edit);
+            genesis_pipeline_stop(pipeline);
+            return err;
+        }
+    }
+    // nodes which are new or count another port have no state worth keeping
+    // until the next seek
+    for (int i = 0; i < pipeline->nodes.length(); i += 1) {
+        GenesisNode *node = pipeline->nodes.at(i);
+        if (node->checkpoints ? node->checkpoints->port == checkpoint_port(node) : !node->descriptor->save_state)
+            continue;
+        if ((err = init_node_checkpoints(node, false))) {
+            graph_edit_destroy(edit);
+            genesis_pipeline_stop(pipeline);
+            return err;
+        }
+    }
+    graph_edit_destroy(edit);
+    genesis_pipeline_wake(pipeline);
+
+    if ((err = unpark_workers(pipeline))) {
+        genesis_pipeline_stop(pipeline);
+        return err;
+    }
+
+    kick_producers(pipeline);
+    return 0;
+}
+
+void genesis_graph_edit_abort(struct GenesisGraphEdit *edit) {
+    while (edit->added_nodes.length())
+        genesis_node_destroy(edit->added_nodes.pop());
+    graph_edit_destroy(edit);
+}
+
+bool genesis_pipeline_is_running(struct GenesisPipeline *pipeline) {
+    assert(pipeline);
+    return pipeline->running;
+}
+
+int genesis_pipeline_set_latency(struct GenesisPipeline *pipeline, double latency) {
+    if (latency <= 0.0)
+        return GenesisErrorInvalidParam;
+    if (latency > 60.0)
+        return GenesisErrorInvalidParam;
+    if (pipeline->running)
+        return GenesisErrorInvalidState;
+
+    pipeline->latency = latency;
+    return 0;
+}
+
+double genesis_pipeline_get_latency(struct GenesisPipeline *pipeline) {
+    return pipeline->latency;
+}
+
+int genesis_pipeline_set_adaptive_latency(struct GenesisPipeline *pipeline, bool enabled,
+        double min_latency, double max_latency)
+{
+    if (min_latency <= 0.0 || max_latency < min_latency || max_latency > 60.0)
+        return GenesisErrorInvalidParam;
+
+    GenesisAdaptiveLatency *adaptive = &pipeline->adaptive_latency;
+    adaptive->enabled = enabled;
+    adaptive->min_latency = min_latency;
+    adaptive->max_latency = max_latency;
+    reset_adaptive_latency_window(pipeline);
+    return 0;
+}
+
+void genesis_pipeline_set_node_stats_enabled(struct GenesisPipeline *pipeline, bool enabled) {
+    pipeline->node_stats_enabled.store(enabled);
+}
+
+bool genesis_pipeline_get_node_stats_enabled(struct GenesisPipeline *pipeline) {
+    return pipeline->node_stats_enabled.load();
+}
+
+void genesis_pipeline_reset_stats(struct GenesisPipeline *pipeline) {
+    for (int i = 0; i < pipeline->nodes.length(); i += 1) {
+        GenesisNodeStatsCounters *stats = &pipeline->nodes.at(i)->stats;
+        stats->run_count = 0;
+        stats->total_run_time_ns = 0;
+        stats->max_run_time_ns = 0;
+        stats->frames_written = 0;
+        stats->frames_read = 0;
+        stats->denormal_run_count = 0;
+        for (int bucket = 0; bucket < GENESIS_NODE_STATS_HISTOGRAM_SIZE; bucket += 1)
+            stats->run_time_histogram[bucket] = 0;
+    }
+}
+
+void genesis_node_get_stats(struct GenesisNode *node, struct GenesisNodeStats *out_stats) {
+    GenesisNodeStatsCounters *stats = &node->stats;
+    out_stats->run_count = stats->run_count.load();
+    out_stats->total_run_time = stats->total_run_time_ns.load() / 1000000000.0;
+    out_stats->max_run_time = stats->max_run_time_ns.load() / 1000000000.0;
+
+    bool has_audio_out = false;
+    for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+        if (node->ports[port_i]->descriptor->port_type == GenesisPortTypeAudioOut)
+            has_audio_out = true;
+    }
+    out_stats->frames_processed = has_audio_out ? stats->frames_written.load() : stats->frames_read.load();
+    out_stats->denormal_run_count = stats->denormal_run_count.load();
+
+    for (int bucket = 0; bucket < GENESIS_NODE_STATS_HISTOGRAM_SIZE; bucket += 1)
+        out_stats->run_time_histogram[bucket] = stats->run_time_histogram[bucket].load();
+}
+
+void genesis_pipeline_get_telemetry(struct GenesisPipeline *pipeline,
+        struct GenesisPipelineTelemetry *out_telemetry)
+{
+    GenesisPipelineTelemetryCounters *telemetry = &pipeline->telemetry;
+    out_telemetry->underrun_count = telemetry->underrun_count.load(std::memory_order_relaxed);
+    out_telemetry->overflow_count = telemetry->overflow_count.load(std::memory_order_relaxed);
+    out_telemetry->callback_count = telemetry->callback_count.load(std::memory_order_relaxed);
+    out_telemetry->last_callback_duration =
+        telemetry->last_callback_ns.load(std::memory_order_relaxed) / 1000000000.0;
+    out_telemetry->max_callback_duration =
+        telemetry->max_callback_ns.load(std::memory_order_relaxed) / 1000000000.0;
+    out_telemetry->callback_period =
+        telemetry->callback_period_ns.load(std::memory_order_relaxed) / 1000000000.0;
+    out_telemetry->actual_latency = pipeline->actual_latency;
+    for (int bucket = 0; bucket < GENESIS_NODE_STATS_HISTOGRAM_SIZE; bucket += 1) {
+        out_telemetry->callback_jitter_histogram[bucket] =
+            telemetry->callback_jitter_histogram[bucket].load(std::memory_order_relaxed);
+    }
+}
+
+void genesis_pipeline_reset_telemetry(struct GenesisPipeline *pipeline) {
+    GenesisPipelineTelemetryCounters *telemetry = &pipeline->telemetry;
+    telemetry->underrun_count = 0;
+    telemetry->overflow_count = 0;
+    telemetry->callback_count = 0;
+    telemetry->last_callback_ns = 0;
+    telemetry->max_callback_ns = 0;
+    for (int bucket = 0; bucket < GENESIS_NODE_STATS_HISTOGRAM_SIZE; bucket += 1)
+        telemetry->callback_jitter_histogram[bucket] = 0;
+}
+
+int genesis_pipeline_get_port_fills(struct GenesisPipeline *pipeline,
+        struct GenesisPortFill *out_fills, int max_count)
+{
+    int count = 0;
+    for (int node_i = 0; node_i < pipeline->nodes.length(); node_i += 1) {
+        GenesisNode *node = pipeline->nodes.at(node_i);
+        for (int port_i = 0; port_i < node->port_count; port_i += 1) {
+            GenesisPort *port = node->ports[port_i];
+            if (port->descriptor->port_type != GenesisPortTypeAudioIn || !port->input_from)
+                continue;
+            if (count < max_count) {
+                GenesisPortFill *fill = &out_fills[count];
+                fill->port = port;
+                fill->fill_count = genesis_audio_in_port_fill_count(port);
+                fill->capacity = genesis_audio_in_port_capacity(port);
+            }
+            count += 1;
+        }
+    }
+    return count;
+}
+
+int genesis_pipeline_set_compiled_graph(struct GenesisPipeline *pipeline, bool compiled) {
+    if (pipeline->running)
+        return GenesisErrorInvalidState;
+
+    pipeline->compiled_graph = compiled;
+    return 0;
+}
+
+bool genesis_pipeline_get_compiled_graph(struct GenesisPipeline *pipeline) {
+    return pipeline->compiled_graph;
+}
+
+int genesis_pipeline_set_offline(struct GenesisPipeline *pipeline, bool offline) {
+    // trace lanes are per worker thread
+    if (pipeline->running || pipeline->trace)
+        return GenesisErrorInvalidState;
+
+    if (pipeline->offline == offline)
+        return 0;
+
+    pipeline->offline = offline;
+    return create_thread_pool(pipeline);
+}
+
+bool genesis_pipeline_get_offline(struct GenesisPipeline *pipeline) {
+    return pipeline->offline;
+}
+
+int genesis_pipeline_set_thread_count(struct GenesisPipeline *pipeline, int thread_count) {
+    if (thread_count < 0)
+        return GenesisErrorInvalidParam;
+    // trace lanes are per worker thread
+    if (pipeline->running || pipeline->trace)
+        return GenesisErrorInvalidState;
+
+    if (pipeline->thread_count_limit == thread_count)
+        return 0;
+
+    pipeline->thread_count_limit = thread_count;
+    return create_thread_pool(pipeline);
+}
+
+int genesis_pipeline_get_thread_count(struct GenesisPipeline *pipeline) {
+    return pipeline->thread_pool_size;
+}
+
+int genesis_pipeline_set_thread_count_range(struct GenesisPipeline *pipeline,
+        int min_thread_count, int max_thread_count)
+{
+    if (min_thread_count < 0 || max_thread_count < 0 ||
+        (max_thread_count > 0 && min_thread_count > max_thread_count))
+    {
+        return GenesisErrorInvalidParam;
+    }
+    if (pipeline->running || pipeline->trace)
+        return GenesisErrorInvalidState;
+
+    int err;
+    if ((err = genesis_pipeline_set_thread_count(pipeline, max_thread_count)))
+        return err;
+    pipeline->thread_scaling.min_thread_count = min_thread_count;
+    reset_thread_scaling(pipeline);
+    return 0;
+}
+
+int genesis_pipeline_get_active_thread_count(struct GenesisPipeline *pipeline) {
+    return pipeline->thread_scaling.active_thread_count.load();
+}
+
+int genesis_pipeline_set_block_size(struct GenesisPipeline *pipeline, int frame_count) {
+    if (frame_count < 0 || frame_count > GENESIS_OFFLINE_BLOCK_FRAME_COUNT)
+        return GenesisErrorInvalidParam;
+    if (pipeline->running)
+        return GenesisErrorInvalidState;
 
-    GenesisAudioPortDescriptor *audio_descr = (GenesisAudioPortDescriptor *)port->port.descriptor;
-    const char *chan_layout_fixed = audio_descr->channel_layout_fixed ? "(fixed)" : "(any)";
-    const char *sample_rate_fixed = audio_descr->sample_rate_fixed ? "(fixed)" : "(any)";
+    pipeline->block_size = frame_count;
+    return 0;
+}
 
-    fprintf(stderr, "audio port: %s\n", port->port.descriptor->name);
-    fprintf(stderr, "sample rate: %s %d\n", sample_rate_fixed, port->sample_rate);
-    fprintf(stderr, "channel_layout: %s ", chan_layout_fixed);
-    genesis_debug_print_channel_layout(&port->channel_layout);
+int genesis_pipeline_get_block_size(struct GenesisPipeline *pipeline) {
+    return pipeline->block_size;
 }
 
-static void debug_print_events_port_config(GenesisEventsPort *port) {
-    fprintf(stderr, "events port: %s\n", port->port.descriptor->name);
+int genesis_pipeline_set_fuse_chains(struct GenesisPipeline *pipeline, bool fuse) {
+    if (pipeline->running)
+        return GenesisErrorInvalidState;
+
+    pipeline->fuse_chains = fuse;
+    return 0;
 }
 
-void genesis_debug_print_port_config(struct GenesisPort *port) {
-    switch (port->descriptor->port_type) {
-        case GenesisPortTypeAudioIn:
-        case GenesisPortTypeAudioOut:
-            debug_print_audio_port_config((GenesisAudioPort *)port);
-            return;
-        case GenesisPortTypeEventsIn:
-        case GenesisPortTypeEventsOut:
-            debug_print_events_port_config((GenesisEventsPort *)port);
-            return;
-    }
-    panic("invalid port type");
+bool genesis_pipeline_get_fuse_chains(struct GenesisPipeline *pipeline) {
+    return pipeline->fuse_chains;
 }
 
-static void pipeline_thread_run(void *userdata) {
-    GenesisPipeline *pipeline = reinterpret_cast<GenesisPipeline*>(userdata);
-    for (;;) {
-        GenesisNode *node = pipeline->task_queue.dequeue();
-        if (!pipeline->running)
-            break;
+int genesis_pipeline_set_direct_playback(struct GenesisPipeline *pipeline, bool direct) {
+    if (pipeline->running)
+        return GenesisErrorInvalidState;
 
-        run_node(node);
-    }
+    pipeline->direct_playback = direct;
+    return 0;
 }
 
-int genesis_pipeline_start(struct GenesisPipeline *pipeline, double time) {
-    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
-        GenesisNode *node = pipeline->nodes.at(node_index);
-        for (int port_i = 0; port_i < node->port_count; port_i += 1) {
-            GenesisPort *port = node->ports[port_i];
-            if (port->descriptor->port_type == GenesisPortTypeAudioOut) {
-                GenesisAudioPort *audio_port = reinterpret_cast<GenesisAudioPort*>(port);
-                if (!audio_port->sample_buffer_err)
-                    ring_buffer_clear(&audio_port->sample_buffer);
-            } else if (port->descriptor->port_type == GenesisPortTypeEventsOut) {
-                GenesisEventsPort *events_port = reinterpret_cast<GenesisEventsPort*>(port);
-                if (!events_port->event_buffer_err)
-                    ring_buffer_clear(&events_port->event_buffer);
-            }
-        }
-        node->timestamp = time;
-        if (node->descriptor->seek)
-            node->descriptor->seek(node);
-    }
+bool genesis_pipeline_get_direct_playback(struct GenesisPipeline *pipeline) {
+    return pipeline->direct_playback;
+}
+
+int genesis_pipeline_set_idle_enabled(struct GenesisPipeline *pipeline, bool enabled) {
+    if (pipeline->running)
+        return GenesisErrorInvalidState;
 
-    return genesis_pipeline_resume(pipeline);
+    pipeline->idle_enabled = enabled;
+    return 0;
 }
 
-void genesis_pipeline_stop(struct GenesisPipeline *pipeline) {
-    pipeline->running = false;
-    pipeline->task_queue.wakeup_all();
-    for (int i = 0; i < pipeline->thread_pool_size; i += 1) {
-        OsThread *thread = pipeline->thread_pool[i];
-        os_thread_destroy(thread);
-        pipeline->thread_pool[i] = nullptr;
-    }
-    for (int i = 0; i < pipeline->nodes.length(); i += 1) {
-        GenesisNode *node = pipeline->nodes.at(i);
-        assert(node->descriptor->pipeline);
-        if (node->descriptor->deactivate)
-            node->descriptor->deactivate(node);
-    }
+bool genesis_pipeline_get_idle_enabled(struct GenesisPipeline *pipeline) {
+    return pipeline->idle_enabled;
 }
 
-int genesis_pipeline_resume(struct GenesisPipeline *pipeline) {
-    int err = pipeline->task_queue.resize(pipeline->nodes.length() + pipeline->thread_pool_size);
-    if (err) {
-        genesis_pipeline_stop(pipeline);
-        return err;
-    }
+void genesis_pipeline_wake(struct GenesisPipeline *pipeline) {
+    pipeline->idle_wake_epoch += 1;
+}
 
-    pipeline->stream_fail_flag.test_and_set();
+int genesis_pipeline_set_flush_denormals(struct GenesisPipeline *pipeline, bool flush) {
+    if (pipeline->running)
+        return GenesisErrorInvalidState;
 
-    // the 0.75 is because the outstream software_latency is pipeline->latency * 0.25
-    double desired_buffer_duration = pipeline->latency * 0.75;
-    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
-        GenesisNode *node = pipeline->nodes.at(node_index);
-        desired_buffer_duration = max(node->descriptor->min_software_latency, desired_buffer_duration);
-    }
-    pipeline->actual_latency = desired_buffer_duration / 0.75;
+    pipeline->flush_denormals = flush;
+    return 0;
+}
 
-    for (int node_index = 0; node_index < pipeline->nodes.length(); node_index += 1) {
-        GenesisNode *node = pipeline->nodes.at(node_index);
-        node->being_processed = false;
-        for (int port_i = 0; port_i < node->port_count; port_i += 1) {
-            GenesisPort *port = node->ports[port_i];
-            if (port->descriptor->port_type == GenesisPortTypeAudioIn) {
-                GenesisAudioPort *audio_port = reinterpret_cast<GenesisAudioPort*>(port);
-                audio_port->bytes_per_frame = BYTES_PER_SAMPLE * audio_port->channel_layout.channel_count;
-            } else if (port->descriptor->port_type == GenesisPortTypeAudioOut) {
-                GenesisAudioPort *audio_port = reinterpret_cast<GenesisAudioPort*>(port);
-                int sample_buffer_frame_count = ceil(desired_buffer_duration * audio_port->sample_rate);
-                audio_port->bytes_per_frame = BYTES_PER_SAMPLE * audio_port->channel_layout.channel_count;
-                int new_sample_buffer_size = sample_buffer_frame_count * audio_port->bytes_per_frame;
-                bool different = new_sample_buffer_size != audio_port->sample_buffer_size;
-                audio_port->sample_buffer_size = new_sample_buffer_size;
-
-                if (audio_port->sample_buffer_err || different) {
-                    if (!audio_port->sample_buffer_err)
-                        ring_buffer_deinit(&audio_port->sample_buffer);
-                    if ((audio_port->sample_buffer_err =
-                            ring_buffer_init(&audio_port->sample_buffer, audio_port->sample_buffer_size)))
-                    {
-                        genesis_pipeline_stop(pipeline);
-                        return audio_port->sample_buffer_err;
-                    }
-                }
-            } else if (port->descriptor->port_type == GenesisPortTypeEventsOut) {
-                GenesisEventsPort *events_port = reinterpret_cast<GenesisEventsPort*>(port);
-                int min_event_buffer_size = EVENTS_PER_SECOND_CAPACITY * desired_buffer_duration;
-                if (events_port->event_buffer_err ||
-                    events_port->event_buffer.capacity != min_event_buffer_size)
-                {
-                    if (!events_port->event_buffer_err)
-                        ring_buffer_deinit(&events_port->event_buffer);
-                    if ((events_port->event_buffer_err = ring_buffer_init(&events_port->event_buffer,
-                                    min_event_buffer_size)))
-                    {
-                        genesis_pipeline_stop(pipeline);
-                        return events_port->event_buffer_err;
-                    }
-                }
-            }
-        }
-    }
+bool genesis_pipeline_get_flush_denormals(struct GenesisPipeline *pipeline) {
+    return pipeline->flush_denormals;
+}
 
-    pipeline->running = true;
+int genesis_pipeline_set_checkpoints(struct GenesisPipeline *pipeline, double interval, int checkpoint_count) {
+    if (pipeline->running)
+        return GenesisErrorInvalidState;
+    if (!(interval >= 0.0 && interval <= 3600.0) || (interval > 0.0 && checkpoint_count < 1))
+        return GenesisErrorInvalidParam;
 
-    for (int i = 0; i < pipeline->nodes.length(); i += 1) {
-        GenesisNode *node = pipeline->nodes.at(i);
-        if (node->descriptor->activate) {
-            if ((err = node->descriptor->activate(node))) {
-                genesis_pipeline_stop(pipeline);
-                return err;
-            }
-        }
-    }
+    pipeline->checkpoint_interval = interval;
+    pipeline->checkpoint_count = checkpoint_count;
+    return 0;
+}
 
-    for (int i = 0; i < pipeline->thread_pool_size; i += 1) {
-        if ((err = os_thread_create(pipeline_thread_run, pipeline, true, &pipeline->thread_pool[i]))) {
-            genesis_pipeline_stop(pipeline);
-            return err;
-        }
-    }
+void genesis_pipeline_clear_checkpoints(struct GenesisPipeline *pipeline) {
+    pipeline->checkpoint_epoch.fetch_add(1);
+}
 
-    return 0;
+double genesis_pipeline_get_seek_start_time(struct GenesisPipeline *pipeline) {
+    return pipeline->seek_start_time;
 }
 
-bool genesis_pipeline_is_running(struct GenesisPipeline *pipeline) {
-    assert(pipeline);
-    return pipeline->running;
+int genesis_pipeline_trace_start(struct GenesisPipeline *pipeline, const char *path) {
+    if (pipeline->running || pipeline->trace)
+        return GenesisErrorInvalidState;
+
+    return pipeline_trace_create(path, pipeline->thread_pool_size, &pipeline->trace);
 }
 
-int genesis_pipeline_set_latency(struct GenesisPipeline *pipeline, double latency) {
-    if (latency <= 0.0)
-        return GenesisErrorInvalidParam;
-    if (latency > 60.0)
-        return GenesisErrorInvalidParam;
+int genesis_pipeline_trace_stop(struct GenesisPipeline *pipeline) {
     if (pipeline->running)
         return GenesisErrorInvalidState;
 
-    pipeline->latency = latency;
+    pipeline_trace_destroy(pipeline->trace);
+    pipeline->trace = nullptr;
     return 0;
 }
 
-double genesis_pipeline_get_latency(struct GenesisPipeline *pipeline) {
-    return pipeline->latency;
-}
-
 int genesis_pipeline_set_sample_rate(struct GenesisPipeline *pipeline, int sample_rate) {
     if (sample_rate <= 0)
         return GenesisErrorInvalidParam;
@@ -2051,56 +5145,256 @@ float genesis_midi_note_to_pitch(int note) {
 int genesis_audio_in_port_capacity(struct GenesisPort *port) {
     struct GenesisAudioPort *audio_in_port = (struct GenesisAudioPort *) port;
     struct GenesisAudioPort *audio_out_port = (struct GenesisAudioPort *) audio_in_port->port.input_from;
-    return audio_out_port->sample_buffer_size / audio_out_port->bytes_per_frame;
+    struct GenesisAudioPort *buffer_port = audio_buffer_port(audio_out_port);
+    return buffer_port->sample_buffer_size / buffer_port->bytes_per_frame;
+}
+
+// device callbacks see every frame; only nodes run by pipeline threads work
+// in whole blocks
+static int round_down_to_block(GenesisPipeline *pipeline, int frame_count) {
+    int block_size = pipeline->block_size;
+    if (block_size == 0 || !current_worker)
+        return frame_count;
+    return frame_count - frame_count % block_size;
 }
 
 int genesis_audio_in_port_fill_count(GenesisPort *port) {
     struct GenesisAudioPort *audio_in_port = (struct GenesisAudioPort *) port;
     struct GenesisAudioPort *audio_out_port = (struct GenesisAudioPort *) audio_in_port->port.input_from;
-    return ring_buffer_fill_count(&audio_out_port->sample_buffer) / audio_out_port->bytes_per_frame;
+    int frame_count = ring_buffer_reader_fill_count(&audio_buffer_port(audio_out_port)->sample_buffer,
+            audio_in_port_reader(audio_in_port)) / audio_out_port->bytes_per_frame;
+    frame_count = clamp_to_checkpoint(port, frame_count);
+    return round_down_to_block(port->node->descriptor->pipeline, frame_count);
 }
 
-float *genesis_audio_in_port_read_ptr(GenesisPort *port) {
+int genesis_audio_in_port_silent_count(GenesisPort *port) {
     struct GenesisAudioPort *audio_in_port = (struct GenesisAudioPort *) port;
     struct GenesisAudioPort *audio_out_port = (struct GenesisAudioPort *) audio_in_port->port.input_from;
-    return (float*)ring_buffer_read_ptr(&audio_out_port->sample_buffer);
+    int frame_count = audio_port_silent_bytes(audio_out_port,
+            audio_in_port_reader(audio_in_port)) / audio_out_port->bytes_per_frame;
+    return round_down_to_block(port->node->descriptor->pipeline, frame_count);
+}
+
+// count samples, src_step and dest_step bytes apart, from the precision of
+// src_info to that of dest_info. float32 is what the converters take, so
+// samples of two other precisions go through floats. samples that keep
+// their precision are copied as they are.
+static void convert_samples(const SampleFormatInfo *dest_info, char *dest, int dest_step,
+        const SampleFormatInfo *src_info, const char *src, int src_step, int count)
+{
+    bool dest_packed = dest_step == dest_info->bytes_per_sample;
+    bool src_packed = src_step == src_info->bytes_per_sample;
+    if (dest_info == src_info) {
+        for (int i = 0; i < count; i += 1)
+            memcpy(dest + i * dest_step, src + i * src_step, src_info->bytes_per_sample);
+        return;
+    }
+    if (src_info->format == SoundIoFormatFloat32NE) {
+        if (dest_packed && src_packed)
+            dest_info->write_samples(dest, (const float *)src, count);
+        else
+            dest_info->write_samples_strided(dest, dest_step, (const float *)src, src_step / sizeof(float), count);
+        return;
+    }
+    if (dest_info->format == SoundIoFormatFloat32NE) {
+        if (dest_packed && src_packed)
+            src_info->read_samples((float *)dest, src, count);
+        else
+            src_info->read_samples_strided((float *)dest, dest_step / sizeof(float), src, src_step, count);
+        return;
+    }
+    float samples[CONVERT_CHUNK_SAMPLE_COUNT];
+    for (int i = 0; i < count; i += CONVERT_CHUNK_SAMPLE_COUNT) {
+        int chunk_count = min(CONVERT_CHUNK_SAMPLE_COUNT, count - i);
+        src_info->read_samples_strided(samples, 1, src + i * src_step, src_step, chunk_count);
+        dest_info->write_samples_strided(dest + i * dest_step, dest_step, samples, 1, chunk_count);
+    }
+}
+
+// every frame the reader has yet to read, into the layout and precision
+// audio_in_port wants. planar blocks are where the writer put them, which
+// may start before the reader.
+static char *convert_in_port_frames(GenesisAudioPort *audio_in_port, GenesisAudioPort *buffer_port,
+        int reader)
+{
+    RingBuffer *rb = &buffer_port->sample_buffer;
+    int block_size = audio_in_port->port.node->descriptor->pipeline->block_size;
+    int channel_count = buffer_port->channel_layout.channel_count;
+    const SampleFormatInfo *src_info = sample_precision_info(buffer_port->sample_precision);
+    const SampleFormatInfo *dest_info = sample_precision_info(audio_in_port->sample_precision);
+    int src_sample_bytes = src_info->bytes_per_sample;
+    int dest_sample_bytes = dest_info->bytes_per_sample;
+    const char *src = ring_buffer_reader_read_ptr(rb, reader);
+    int frame_count = ring_buffer_reader_fill_count(rb, reader) / buffer_port->bytes_per_frame;
+    int lead_frame_count = 0;
+    if (buffer_port->sample_layout == GenesisSampleLayoutPlanar) {
+        lead_frame_count = rb->read_offsets[reader].load() / buffer_port->bytes_per_frame % block_size;
+        src -= lead_frame_count * buffer_port->bytes_per_frame;
+        frame_count = round_up(lead_frame_count + frame_count, block_size);
+    } else if (audio_in_port->sample_layout == GenesisSampleLayoutPlanar) {
+        frame_count -= frame_count % block_size;
+    }
+    char *dest = audio_in_port->convert_buffer;
+
+    if (buffer_port->sample_layout == audio_in_port->sample_layout) {
+        // planar blocks come out where they went in
+        convert_samples(dest_info, dest, dest_sample_bytes, src_info, src, src_sample_bytes,
+                frame_count * channel_count);
+    } else if (src_info->format == SoundIoFormatFloat32NE && dest_info->format == SoundIoFormatFloat32NE) {
+        const DspChannelKernels *kernels = dsp_channel_kernels(channel_count);
+        int block_sample_count = block_size * channel_count;
+        int block_count = frame_count / block_size;
+        float *dest_samples = (float *)dest;
+        const float *src_samples = (const float *)src;
+        for (int block = 0; block < block_count; block += 1) {
+            if (buffer_port->sample_layout == GenesisSampleLayoutPlanar) {
+                kernels->interleave(channel_count, dest_samples + block * block_sample_count,
+                        src_samples + block * block_sample_count, block_size, block_size);
+            } else {
+                kernels->deinterleave(channel_count, dest_samples + block * block_sample_count,
+                        block_size, src_samples + block * block_sample_count, block_size);
+            }
+        }
+    } else {
+        // one channel of one block at a time. its samples are next to each
+        // other on the planar side and a frame apart on the interleaved one.
+        bool src_planar = buffer_port->sample_layout == GenesisSampleLayoutPlanar;
+        int src_step = src_planar ? src_sample_bytes : buffer_port->bytes_per_frame;
+        int dest_step = src_planar ? audio_in_port->bytes_per_frame : dest_sample_bytes;
+        int src_channel_step = src_planar ? block_size * src_sample_bytes : src_sample_bytes;
+        int dest_channel_step = src_planar ? dest_sample_bytes : block_size * dest_sample_bytes;
+        for (int frame = 0; frame < frame_count; frame += block_size) {
+            for (int ch = 0; ch < channel_count; ch += 1) {
+                convert_samples(dest_info,
+                        dest + frame * audio_in_port->bytes_per_frame + ch * dest_channel_step, dest_step,
+                        src_info, src + frame * buffer_port->bytes_per_frame + ch * src_channel_step, src_step,
+                        block_size);
+            }
+        }
+    }
+    return dest + lead_frame_count * audio_in_port->bytes_per_frame;
+}
+
+static char *audio_in_port_read_ptr(GenesisAudioPort *audio_in_port) {
+    struct GenesisAudioPort *audio_out_port = (struct GenesisAudioPort *) audio_in_port->port.input_from;
+    GenesisAudioPort *buffer_port = audio_buffer_port(audio_out_port);
+    if (audio_in_port->convert_buffer)
+        return convert_in_port_frames(audio_in_port, buffer_port, audio_in_port_reader(audio_in_port));
+    return ring_buffer_reader_read_ptr(&buffer_port->sample_buffer, audio_in_port_reader(audio_in_port));
+}
+
+float *genesis_audio_in_port_read_ptr(GenesisPort *port) {
+    struct GenesisAudioPort *audio_in_port = (struct GenesisAudioPort *) port;
+    assert(audio_in_port->sample_precision == GenesisSamplePrecisionFloat32);
+    return (float *)audio_in_port_read_ptr(audio_in_port);
+}
+
+double *genesis_audio_in_port_read_ptr_double(GenesisPort *port) {
+    struct GenesisAudioPort *audio_in_port = (struct GenesisAudioPort *) port;
+    assert(audio_in_port->sample_precision == GenesisSamplePrecisionFloat64);
+    return (double *)audio_in_port_read_ptr(audio_in_port);
+}
+
+int16_t *genesis_audio_in_port_read_ptr_int16(GenesisPort *port) {
+    struct GenesisAudioPort *audio_in_port = (struct GenesisAudioPort *) port;
+    assert(audio_in_port->sample_precision == GenesisSamplePrecisionInt16);
+    return (int16_t *)audio_in_port_read_ptr(audio_in_port);
 }
 
+// when an out port of the same node is in place on this port, its write
+// moves the reader instead
 void genesis_audio_in_port_advance_read_ptr(GenesisPort *port, int frame_count) {
     struct GenesisAudioPort *audio_in_port = (struct GenesisAudioPort *) port;
     struct GenesisAudioPort *audio_out_port = (struct GenesisAudioPort *) audio_in_port->port.input_from;
+    struct GenesisAudioPort *buffer_port = audio_buffer_port(audio_out_port);
     int byte_count = frame_count * audio_out_port->bytes_per_frame;
     assert(byte_count >= 0);
-    assert(byte_count <= audio_out_port->sample_buffer_size);
-    ring_buffer_advance_read_ptr(&audio_out_port->sample_buffer, byte_count);
-    struct GenesisNode *child_node = audio_out_port->port.node;
-    queue_node_if_ready(child_node->descriptor->pipeline, child_node, true);
+    assert(byte_count <= buffer_port->sample_buffer_size);
+    if (!audio_in_port->in_place_out_port) {
+        ring_buffer_reader_advance_read_ptr(&buffer_port->sample_buffer,
+                audio_in_port_reader(audio_in_port), byte_count);
+    }
+    if (port->node->descriptor->pipeline->node_stats_enabled.load())
+        port->node->stats.frames_read += frame_count;
+    count_checkpoint_frames(port, frame_count);
+    port_consumed(audio_out_port->port.node);
+    // only reading frames out of the buffer makes room for its writer
+    if (buffer_port != audio_out_port)
+        port_consumed(buffer_port->port.node);
 }
 
 int genesis_audio_out_port_free_count(GenesisPort *port) {
     struct GenesisAudioPort *audio_out_port = (struct GenesisAudioPort *) port;
-    int fill_count = ring_buffer_fill_count(&audio_out_port->sample_buffer);
-    int bytes_free_count = audio_out_port->sample_buffer_size - fill_count;
-    int result = bytes_free_count / audio_out_port->bytes_per_frame;
+    int result = audio_out_port_free_bytes(audio_out_port) / audio_out_port->bytes_per_frame;
     assert(result >= 0);
-    return result;
+    result = clamp_to_checkpoint(port, result);
+    return round_down_to_block(port->node->descriptor->pipeline, result);
+}
+
+static char *audio_out_port_write_ptr(GenesisAudioPort *audio_out_port) {
+    GenesisAudioPort *buffer_port = audio_out_port->in_place_buffer_port;
+    if (buffer_port)
+        return ring_buffer_reader_read_ptr(&buffer_port->sample_buffer, audio_out_port->in_place_reader);
+    return ring_buffer_write_ptr(&audio_out_port->sample_buffer);
 }
 
 float *genesis_audio_out_port_write_ptr(GenesisPort *port) {
     struct GenesisAudioPort *audio_out_port = (struct GenesisAudioPort *) port;
-    return (float*)ring_buffer_write_ptr(&audio_out_port->sample_buffer);
+    assert(audio_out_port->sample_precision == GenesisSamplePrecisionFloat32);
+    return (float *)audio_out_port_write_ptr(audio_out_port);
 }
 
-void genesis_audio_out_port_advance_write_ptr(GenesisPort *port, int frame_count) {
+double *genesis_audio_out_port_write_ptr_double(GenesisPort *port) {
+    struct GenesisAudioPort *audio_out_port = (struct GenesisAudioPort *) port;
+    assert(audio_out_port->sample_precision == GenesisSamplePrecisionFloat64);
+    return (double *)audio_out_port_write_ptr(audio_out_port);
+}
+
+int16_t *genesis_audio_out_port_write_ptr_int16(GenesisPort *port) {
     struct GenesisAudioPort *audio_out_port = (struct GenesisAudioPort *) port;
+    assert(audio_out_port->sample_precision == GenesisSamplePrecisionInt16);
+    return (int16_t *)audio_out_port_write_ptr(audio_out_port);
+}
+
+static void advance_audio_out_port(GenesisAudioPort *audio_out_port, int frame_count, bool silent) {
+    GenesisPort *port = &audio_out_port->port;
     int byte_count = frame_count * audio_out_port->bytes_per_frame;
     assert(byte_count >= 0);
-    assert(byte_count <= (audio_out_port->sample_buffer_size - ring_buffer_fill_count(&audio_out_port->sample_buffer)));
-    ring_buffer_advance_write_ptr(&audio_out_port->sample_buffer, byte_count);
-    GenesisAudioPort *audio_in_port = (GenesisAudioPort *)audio_out_port->port.output_to;
-    GenesisNode *other_node = audio_in_port->port.node;
-    GenesisPipeline *pipeline = port->node->descriptor->pipeline;
-    queue_node_if_ready(pipeline, other_node, false);
+    assert(byte_count <= audio_out_port_free_bytes(audio_out_port));
+    GenesisAudioPort *buffer_port = audio_out_port->in_place_buffer_port;
+    if (buffer_port) {
+        RingBuffer *rb = &buffer_port->sample_buffer;
+        mark_written(audio_out_port, rb->read_offsets[audio_out_port->in_place_reader].load(),
+                byte_count, silent);
+        ring_buffer_reader_advance_read_ptr(rb, audio_out_port->in_place_reader, byte_count);
+    } else {
+        mark_written(audio_out_port, audio_out_port->sample_buffer.write_offset.load(), byte_count, silent);
+        ring_buffer_advance_write_ptr(&audio_out_port->sample_buffer, byte_count);
+    }
+    if (port->node->descriptor->pipeline->node_stats_enabled.load())
+        port->node->stats.frames_written += frame_count;
+    count_checkpoint_frames(port, frame_count);
+    port_produced(port, byte_count > 0);
+}
+
+void genesis_audio_out_port_advance_write_ptr(GenesisPort *port, int frame_count) {
+    advance_audio_out_port((struct GenesisAudioPort *) port, frame_count, false);
+}
+
+// an in place port already holds zeros where its node's input is silence
+void genesis_audio_out_port_write_silence(GenesisPort *port, int frame_count) {
+    struct GenesisAudioPort *audio_out_port = (struct GenesisAudioPort *) port;
+    int byte_count = frame_count * audio_out_port->bytes_per_frame;
+    bool zeroed = false;
+    if (audio_out_port->in_place_buffer_port) {
+        GenesisAudioPortDescriptor *descr = (GenesisAudioPortDescriptor *)port->descriptor;
+        GenesisPort *audio_in_port = port->node->ports[descr->in_place_index];
+        zeroed = audio_port_silent_bytes((GenesisAudioPort *)audio_in_port->input_from,
+                audio_out_port->in_place_reader) >= byte_count;
+    }
+    if (!zeroed)
+        memset(audio_out_port_write_ptr(audio_out_port), 0, byte_count);
+    advance_audio_out_port(audio_out_port, frame_count, true);
 }
 
 int genesis_audio_port_bytes_per_frame(struct GenesisPort *port) {
@@ -2108,6 +5402,16 @@ int genesis_audio_port_bytes_per_frame(struct GenesisPort *port) {
     return audio_port->bytes_per_frame;
 }
 
+enum GenesisSampleLayout genesis_audio_port_sample_layout(struct GenesisPort *port) {
+    struct GenesisAudioPort *audio_port = (struct GenesisAudioPort *)port;
+    return audio_port->sample_layout;
+}
+
+enum GenesisSamplePrecision genesis_audio_port_sample_precision(struct GenesisPort *port) {
+    struct GenesisAudioPort *audio_port = (struct GenesisAudioPort *)port;
+    return audio_port->sample_precision;
+}
+
 int genesis_audio_port_sample_rate(struct GenesisPort *port) {
     struct GenesisAudioPort *audio_port = (struct GenesisAudioPort *)port;
     return audio_port->sample_rate;
@@ -2124,27 +5428,79 @@ void genesis_events_in_port_fill_count(struct GenesisPort *port,
     struct GenesisEventsPort *events_in_port = (struct GenesisEventsPort *) port;
     struct GenesisEventsPort *events_out_port = (struct GenesisEventsPort *) events_in_port->port.input_from;
     assert(events_out_port); // assume it is connected
-    *event_count = ring_buffer_fill_count(&events_out_port->event_buffer) / sizeof(GenesisMidiEvent);
-    *time_available = events_out_port->time_available.load();
-    events_out_port->time_requested.add(time_requested);
+    int reader = port->reader_index;
+    *event_count = ring_buffer_reader_fill_count(&events_out_port->event_buffer, reader) /
+        sizeof(GenesisMidiEvent);
+    *time_available = events_out_port->time_available[reader].load();
+    events_out_port->time_requested[reader].add(time_requested);
 }
 
 void genesis_events_in_port_advance_read_ptr(struct GenesisPort *port, int event_count, double buf_size) {
     struct GenesisEventsPort *events_in_port = (struct GenesisEventsPort *) port;
     struct GenesisEventsPort *events_out_port = (struct GenesisEventsPort *) events_in_port->port.input_from;
     assert(events_out_port); // assume it is connected
-    ring_buffer_advance_read_ptr(&events_out_port->event_buffer, event_count * sizeof(GenesisMidiEvent));
-    events_out_port->time_available.add(-buf_size);
+    int reader = port->reader_index;
+    ring_buffer_reader_advance_read_ptr(&events_out_port->event_buffer, reader,
+            event_count * sizeof(GenesisMidiEvent));
+    events_out_port->time_available[reader].add(-buf_size);
 
-    struct GenesisNode *child_node = events_out_port->port.node;
-    queue_node_if_ready(child_node->descriptor->pipeline, child_node, true);
+    port_consumed(events_out_port->port.node);
 }
 
 GenesisMidiEvent *genesis_events_in_port_read_ptr(GenesisPort *port) {
     struct GenesisEventsPort *events_in_port = (struct GenesisEventsPort *) port;
     struct GenesisEventsPort *events_out_port = (struct GenesisEventsPort *) events_in_port->port.input_from;
     assert(events_out_port); // assume it is connected
-    return (GenesisMidiEvent*)ring_buffer_read_ptr(&events_out_port->event_buffer);
+    return (GenesisMidiEvent*)ring_buffer_reader_read_ptr(&events_out_port->event_buffer, port->reader_index);
+}
+
+// the events to read are one contiguous array in start order, so this is a
+// binary search over them
+int genesis_events_in_port_find(struct GenesisPort *port, int event_count, double start) {
+    const GenesisMidiEvent *events = genesis_events_in_port_read_ptr(port);
+    int low = 0;
+    int high = event_count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (events[mid].start < start)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+int genesis_events_in_port_fill_frames(struct GenesisPort *port,
+        int frame_start, int frame_count, int frame_rate, int *event_count)
+{
+    struct GenesisEventsPort *events_out_port = (struct GenesisEventsPort *) port->input_from;
+    assert(events_out_port); // assume it is connected
+    GenesisPipeline *pipeline = port->node->descriptor->pipeline;
+    int reader = port->reader_index;
+    double whole_note_at_start = genesis_frames_to_whole_notes(pipeline, frame_start, frame_rate);
+    double time_wanted = genesis_frames_to_whole_notes(pipeline, frame_start + frame_count, frame_rate) -
+        whole_note_at_start;
+    // the writer moves time from requested to available in that order, so
+    // reading them in that order may see too much but never too little
+    double time_requested = events_out_port->time_requested[reader].load();
+    double time_available = events_out_port->time_available[reader].load();
+    if (time_wanted > time_requested + time_available)
+        events_out_port->time_requested[reader].add(time_wanted - time_requested - time_available);
+    // after the time, so that every event the time accounts for is counted
+    *event_count = ring_buffer_reader_fill_count(&events_out_port->event_buffer, reader) /
+        sizeof(GenesisMidiEvent);
+    int frame_at_event_end = genesis_whole_notes_to_frames(pipeline,
+            whole_note_at_start + time_available, frame_rate);
+    return clamp(0, frame_at_event_end - frame_start, frame_count);
+}
+
+void genesis_events_in_port_advance_frames(struct GenesisPort *port,
+        int event_count, int frame_start, int frame_count, int frame_rate)
+{
+    GenesisPipeline *pipeline = port->node->descriptor->pipeline;
+    double time_consumed = genesis_frames_to_whole_notes(pipeline, frame_start + frame_count, frame_rate) -
+        genesis_frames_to_whole_notes(pipeline, frame_start, frame_rate);
+    genesis_events_in_port_advance_read_ptr(port, event_count, time_consumed);
 }
 
 void genesis_events_out_port_free_count(struct GenesisPort *port,
@@ -2154,20 +5510,35 @@ void genesis_events_out_port_free_count(struct GenesisPort *port,
     int bytes_free_count = events_out_port->event_buffer.capacity -
         ring_buffer_fill_count(&events_out_port->event_buffer);
     *event_count = bytes_free_count / sizeof(GenesisMidiEvent);
-    *time_requested = events_out_port->time_requested.load();
+    *time_requested = events_port_time_requested(events_out_port);
 }
 
 void genesis_events_out_port_advance_write_ptr(struct GenesisPort *port, int event_count, double buf_size) {
     struct GenesisEventsPort *events_out_port = (struct GenesisEventsPort *) port;
     ring_buffer_advance_write_ptr(&events_out_port->event_buffer, event_count * sizeof(GenesisMidiEvent));
-    events_out_port->time_requested.add(-buf_size);
-    events_out_port->time_available.add(buf_size);
+    if (events_out_port->event_buffer.capacity - ring_buffer_fill_count(&events_out_port->event_buffer) <
+            (int)sizeof(GenesisMidiEvent))
+    {
+        events_out_port->event_buffer_filled = true;
+    }
+    events_out_port->window_event_count += event_count;
+    events_out_port->window_time += buf_size;
+    // at the opening tempo, which is close enough for a rate
+    double window_seconds = events_out_port->port.node->descriptor->pipeline->tempo_map.whole_notes_to_seconds(
+            events_out_port->window_time);
+    if (window_seconds >= EVENT_RATE_WINDOW_SECONDS) {
+        events_out_port->peak_event_rate = max(events_out_port->peak_event_rate,
+                events_out_port->window_event_count / window_seconds);
+        events_out_port->window_event_count = 0;
+        events_out_port->window_time = 0.0;
+    }
+    for (int i = 0; i < port_reader_count(port); i += 1) {
+        events_out_port->time_requested[i].add(-buf_size);
+        events_out_port->time_available[i].add(buf_size);
+    }
 
-    GenesisEventsPort *events_in_port = (GenesisEventsPort *)events_out_port->port.output_to;
-    assert(events_in_port);
-    GenesisNode *other_node = events_in_port->port.node;
-    GenesisPipeline *pipeline = port->node->descriptor->pipeline;
-    queue_node_if_ready(pipeline, other_node, false);
+    assert(events_out_port->port.output_count > 0);
+    port_produced(port, event_count > 0 || buf_size > 0.0);
 }
 
 struct GenesisMidiEvent *genesis_events_out_port_write_ptr(struct GenesisPort *port) {
@@ -2193,6 +5564,26 @@ void genesis_node_descriptor_set_seek_callback(struct GenesisNodeDescriptor *nod
     node_descriptor->seek = seek;
 }
 
+void genesis_node_descriptor_set_state_callbacks(struct GenesisNodeDescriptor *node_descriptor,
+        int (*state_size)(struct GenesisNode *node),
+        void (*save_state)(struct GenesisNode *node, void *state),
+        void (*restore_state)(struct GenesisNode *node, const void *state))
+{
+    node_descriptor->state_size = state_size;
+    node_descriptor->save_state = save_state;
+    node_descriptor->restore_state = restore_state;
+}
+
+void genesis_node_descriptor_set_scratch_callback(struct GenesisNodeDescriptor *node_descriptor,
+        int (*scratch_size)(struct GenesisNode *node))
+{
+    node_descriptor->scratch_size = scratch_size;
+}
+
+void *genesis_node_scratch(struct GenesisNode *node) {
+    return node->scratch_size ? current_scratch_arena : nullptr;
+}
+
 void genesis_node_descriptor_set_create_callback(struct GenesisNodeDescriptor *node_descriptor,
         int (*create)(struct GenesisNode *node))
 {
@@ -2251,6 +5642,46 @@ int genesis_audio_port_descriptor_set_sample_rate(
     return 0;
 }
 
+int genesis_audio_port_descriptor_set_sample_layout(struct GenesisPortDescriptor *port_descr,
+        enum GenesisSampleLayout sample_layout)
+{
+    assert(port_descr);
+
+    if (port_descr->port_type != GenesisPortTypeAudioIn && port_descr->port_type != GenesisPortTypeAudioOut)
+        return GenesisErrorInvalidPortType;
+
+    GenesisAudioPortDescriptor *audio_port_descr = (GenesisAudioPortDescriptor *)port_descr;
+    audio_port_descr->sample_layout = sample_layout;
+    return 0;
+}
+
+int genesis_audio_port_descriptor_set_sample_precision(struct GenesisPortDescriptor *port_descr,
+        enum GenesisSamplePrecision sample_precision)
+{
+    assert(port_descr);
+
+    if (port_descr->port_type != GenesisPortTypeAudioIn && port_descr->port_type != GenesisPortTypeAudioOut)
+        return GenesisErrorInvalidPortType;
+
+    GenesisAudioPortDescriptor *audio_port_descr = (GenesisAudioPortDescriptor *)port_descr;
+    audio_port_descr->sample_precision = sample_precision;
+    return 0;
+}
+
+int genesis_audio_port_descriptor_set_in_place(struct GenesisPortDescriptor *port_descr, int in_port_index) {
+    assert(port_descr);
+
+    if (port_descr->port_type != GenesisPortTypeAudioOut)
+        return GenesisErrorInvalidPortType;
+
+    GenesisAudioPortDescriptor *audio_port_descr = (GenesisAudioPortDescriptor *)port_descr;
+
+    audio_port_descr->in_place = true;
+    audio_port_descr->in_place_index = in_port_index;
+
+    return 0;
+}
+
 int genesis_connect_audio_nodes(struct GenesisNode *source, struct GenesisNode *dest) {
     int audio_out_port_index = genesis_node_descriptor_find_port_index(source->descriptor, "audio_out");
     if (audio_out_port_index < 0)
@@ -2315,6 +5746,14 @@ void genesis_set_audio_device_callback(struct GenesisContext *context,
     context->devices_change_callback = callback;
 }
 
+void genesis_set_ring_buffer_huge_pages(struct GenesisContext *context, bool enabled) {
+    mirrored_memory_pool_set_huge_pages(&context->ring_buffer_pool, enabled);
+}
+
+void genesis_trim_ring_buffer_pool(struct GenesisContext *context) {
+    mirrored_memory_pool_trim(&context->ring_buffer_pool);
+}
+
 void genesis_set_sound_backend_disconnect_callback(struct GenesisContext *context,
         void (*callback)(void *userdata), void *userdata)
 {
@@ -2,6 +2,7 @@
 #define GENESIS_GENESIS_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <soundio/soundio.h>
 
 /// \cond
@@ -28,6 +29,19 @@
 /// How many SoundIoChannelId values there are.
 #define GENESIS_CHANNEL_ID_COUNT 70
 
+#define GENESIS_NODE_STATS_HISTOGRAM_SIZE 16
+
+// what genesis_node_scratch is aligned to
+#define GENESIS_SCRATCH_ALIGNMENT 64
+
+// audio files which decode to more bytes than this are streamed from disk
+// by genesis_audio_file_open. see genesis_set_audio_file_resident_bytes.
+#define GENESIS_DEFAULT_AUDIO_FILE_RESIDENT_BYTES (64L * 1024L * 1024L)
+
+// how many bytes of samples the audio assets projects keep loaded may add up
+// to before unused ones are evicted. see genesis_set_audio_asset_cache_bytes.
+#define GENESIS_DEFAULT_AUDIO_ASSET_CACHE_BYTES (1024L * 1024L * 1024L)
+
 enum GenesisError {
     GenesisErrorNone,
     GenesisErrorNoMem,
@@ -60,6 +74,9 @@ enum GenesisError {
     GenesisErrorIncompatibleDevice,
     GenesisErrorDeviceNotFound,
     GenesisErrorDecodingString,
+    GenesisErrorMaxConnectionsExceeded,
+    GenesisErrorQueueFull,
+    GenesisErrorConflict,
 };
 
 enum GenesisPortType {
@@ -69,6 +86,91 @@ enum GenesisPortType {
     GenesisPortTypeEventsOut,
 };
 
+// how the frames of an audio port are laid out. planar frames come in
+// blocks of genesis_pipeline_get_block_size frames, each block holding all
+// of its samples of channel 0, then all of channel 1 and so on. a pipeline
+// without a block size only has interleaved ports.
+enum GenesisSampleLayout {
+    GenesisSampleLayoutInterleaved,
+    GenesisSampleLayoutPlanar,
+};
+
+// the samples of an audio port. float64 is for summing where the rounding
+// of float32 adds up, int16 halves the bytes that pass between nodes.
+// int16 samples are scaled and clipped as for a sound device.
+enum GenesisSamplePrecision {
+    GenesisSamplePrecisionFloat32,
+    GenesisSamplePrecisionFloat64,
+    GenesisSamplePrecisionInt16,
+};
+
+enum GenesisScheduler {
+    // each worker thread has its own deque of ready nodes and steals from the
+    // others when it runs dry. nodes made ready by a worker run on that worker.
+    GenesisSchedulerWorkStealing,
+    // all worker threads share one queue of ready nodes.
+    GenesisSchedulerSharedQueue,
+    // all worker threads share queues of ready nodes by priority. a node
+    // takes priority by its upward rank: how long it runs, on average, plus
+    // the longest such path from it to the end of the graph. nodes on the
+    // critical path to the outputs run first. ranks are worked out from the
+    // run times so far whenever the pipeline resumes, seeks or commits an
+    // edit.
+    GenesisSchedulerCriticalPath,
+};
+
+// how the pipeline threads are scheduled
+enum GenesisThreadPolicy {
+    GenesisThreadPolicyNormal,
+    // SCHED_FIFO. on macOS the time constraint policy and on Windows time
+    // critical priority in the MMCSS "Pro Audio" task.
+    GenesisThreadPolicyRealtimeFifo,
+    // SCHED_RR. the same as GenesisThreadPolicyRealtimeFifo on macOS and
+    // Windows.
+    GenesisThreadPolicyRealtimeRoundRobin,
+};
+
+// filter length and stop band attenuation of resample nodes
+enum GenesisResampleQuality {
+    // short filters for previews and draft renders
+    GenesisResampleQualityDraft,
+    // the default for playback
+    GenesisResampleQualityRealtime,
+    // long kaiser windowed filters for final renders
+    GenesisResampleQualityMastering,
+};
+
+// how time stretch nodes and stretched clips change duration and pitch.
+// modifying this affects project file backward compatibility.
+enum GenesisTimeStretchQuality {
+    // overlapped segments of the input, cheap enough for many voices
+    GenesisTimeStretchQualityDraft,
+    // a phase vocoder, for sustained and polyphonic material
+    GenesisTimeStretchQualityHigh,
+};
+
+// what goes into samples before they are rounded to an integer sample
+// format on export
+enum GenesisDither {
+    GenesisDitherNone,
+    // triangular noise one step of the sample format wide
+    GenesisDitherTriangular,
+};
+
+// how the decoded samples of a resident audio file are held in memory
+enum GenesisSampleStorage {
+    // 32 bit floats
+    GenesisSampleStorageFloat,
+    // the integer depth of the source, 16 or 24 bits, converted to floats
+    // by readers as they go. sources with more bits or float samples stay
+    // GenesisSampleStorageFloat.
+    GenesisSampleStorageCompact,
+    // the same integers, coded losslessly in blocks of a few thousand frames
+    // that readers decode as they go. about half the size of compact for
+    // most material. only for sources that compact storage can hold.
+    GenesisSampleStorageCompressed,
+};
+
 struct GenesisContext;
 struct GenesisPipeline;
 
@@ -77,6 +179,10 @@ struct GenesisExportFormat {
     enum SoundIoFormat sample_format;
     int bit_rate;
     int sample_rate;
+    // for resample nodes in the render graph
+    enum GenesisResampleQuality resample_quality;
+    // for the integer sample formats
+    enum GenesisDither dither;
 };
 
 struct GenesisAudioFileIterator {
@@ -93,17 +199,73 @@ struct GenesisSoundBackend {
     int connect_err;
 };
 
+// collected only while genesis_pipeline_set_node_stats_enabled is on
+struct GenesisNodeStats {
+    long run_count;
+    double total_run_time; // seconds
+    double max_run_time; // seconds
+    // audio frames written to out ports, or read from in ports if the node
+    // has no audio out ports
+    long frames_processed;
+    // runs during which a number too small to be normal was an operand or
+    // a result, whether or not it was flushed to zero. only counted on x86
+    // and arm64.
+    long denormal_run_count;
+    // run_time_histogram[0] counts runs that took less than 1 microsecond.
+    // run_time_histogram[i] counts runs that took at least 2^(i-1) and less
+    // than 2^i microseconds. the last bucket also counts all longer runs.
+    long run_time_histogram[GENESIS_NODE_STATS_HISTOGRAM_SIZE];
+};
+
+// see genesis_pipeline_set_tempo_map
+struct GenesisTempoChange {
+    // where the tempo starts
+    double whole_note;
+    double whole_notes_per_minute;
+};
+
+// always collected. see genesis_pipeline_get_telemetry
+struct GenesisPipelineTelemetry {
+    // playback devices that ran out of frames, and recording devices that
+    // had frames dropped
+    long underrun_count;
+    long overflow_count;
+    // playback device callbacks. durations are in seconds
+    long callback_count;
+    double last_callback_duration;
+    double max_callback_duration;
+    // seconds of audio in the device buffer. a callback which takes longer
+    // than this causes an underrun.
+    double callback_period;
+    // seconds. the latency the pipeline was resumed with, which is at least
+    // genesis_pipeline_get_latency but may be raised by the nodes' devices
+    double actual_latency;
+    // how far the time between two playback callbacks was from the average,
+    // in the buckets of GenesisNodeStats::run_time_histogram
+    long callback_jitter_histogram[GENESIS_NODE_STATS_HISTOGRAM_SIZE];
+};
+
+// frames waiting in the buffer of an audio in port
+struct GenesisPortFill {
+    struct GenesisPort *port;
+    int fill_count;
+    int capacity;
+};
+
 struct GenesisMidiDevice;
 
 struct GenesisPortDescriptor;
 struct GenesisNodeDescriptor;
 struct GenesisPort;
 struct GenesisNode;
+struct GenesisGraphEdit;
 
 struct GenesisAudioFileFormat;
 struct GenesisRenderFormat;
 struct GenesisAudioFileCodec;
 struct GenesisAudioFile;
+struct GenesisAudioFileReader;
+struct GenesisLoudnessMeter;
 
 ////////// Main Context
 GENESIS_EXPORT const char *genesis_version_string(void);
@@ -111,6 +273,20 @@ GENESIS_EXPORT const char *genesis_version_string(void);
 GENESIS_EXPORT int genesis_context_create(struct GenesisContext **context);
 GENESIS_EXPORT void genesis_context_destroy(struct GenesisContext *context);
 
+// the pipeline threads are shared by every pipeline of the context and are
+// created when the first one starts, so this can only be set before that.
+// the default is GenesisThreadPolicyRealtimeFifo at the highest priority.
+// priority is for SCHED_FIFO and SCHED_RR; 0 means the highest allowed.
+// bit i of cpu_mask lets the pipeline threads run on CPU i, and then the
+// context's disk reading thread keeps off those CPUs if there are any
+// others. 0 means any CPU. the default is the performance cores of a hybrid
+// CPU and any CPU otherwise. the mask is ignored on macOS. when the process
+// may not use a realtime policy, the threads get the normal one.
+// with more than one NUMA node, each thread is kept to the CPUs of the mask
+// on one node, and the threads are shared out by how many each node has.
+GENESIS_EXPORT int genesis_context_set_pipeline_threads(struct GenesisContext *context,
+        enum GenesisThreadPolicy policy, int priority, uint64_t cpu_mask);
+
 GENESIS_EXPORT const char *genesis_strerror(int error);
 
 // when you call genesis_flush_events, device information becomes invalid
@@ -121,9 +297,17 @@ GENESIS_EXPORT void genesis_flush_events(struct GenesisContext *context);
 // be ready for spurious wakeups
 GENESIS_EXPORT void genesis_wait_events(struct GenesisContext *context);
 
-// makes genesis_wait_events stop blocking
+// makes genesis_wait_events stop blocking, and signals the handle from
+// genesis_get_event_fd
 GENESIS_EXPORT void genesis_wakeup(struct GenesisContext *context);
 
+// for hosts that wait in a poll loop of their own instead of in
+// genesis_wait_events. the handle becomes readable whenever events are
+// ready, and stays readable until genesis_flush_events is called. it is an
+// eventfd on Linux and a kqueue on macOS, for epoll or kqueue, and an event
+// HANDLE on Windows, for WaitForMultipleObjects. do not read from or close it.
+GENESIS_EXPORT intptr_t genesis_get_event_fd(struct GenesisContext *context);
+
 // optionally set a callback to be called when an event becomes ready
 // it might be called spuriously, and it will be called from an
 // internal genesis thread. You would typically use this to wake up another
@@ -205,8 +389,19 @@ GENESIS_EXPORT float genesis_midi_note_to_pitch(int note);
 
 ///////////// Pipeline
 GENESIS_EXPORT void genesis_pipeline_destroy(struct GenesisPipeline *pipeline);
+// port buffers are kept mapped and reused when a pipeline resizes them.
+// with huge pages, buffers that are a whole number of huge pages ask the
+// system to back them with huge pages, where it supports that. off by
+// default; affects buffers mapped afterwards.
+GENESIS_EXPORT void genesis_set_ring_buffer_huge_pages(struct GenesisContext *context, bool enabled);
+// unmaps the port buffers which are not in use
+GENESIS_EXPORT void genesis_trim_ring_buffer_pool(struct GenesisContext *context);
+
+// uses GenesisSchedulerWorkStealing
 GENESIS_EXPORT int genesis_pipeline_create(struct GenesisContext *context,
         struct GenesisPipeline **out_pipeline);
+GENESIS_EXPORT int genesis_pipeline_create_with_scheduler(struct GenesisContext *context,
+        enum GenesisScheduler scheduler, struct GenesisPipeline **out_pipeline);
 
 // set callback to be called when a buffer underrun occurs.
 // callback is always called from genesis_flush_events or genesis_wait_events
@@ -214,9 +409,29 @@ GENESIS_EXPORT void genesis_pipeline_set_underrun_callback(struct GenesisPipelin
         void (*callback)(void *userdata), void *userdata);
 
 
+// positions in whole notes from the start of the timeline, and in frames or
+// seconds from frame 0, through the tempo map of the pipeline. a span of
+// frames starting somewhere else converts as the difference of the
+// positions of its ends, which genesis_whole_notes_add_frames works out.
 GENESIS_EXPORT double genesis_frames_to_whole_notes(struct GenesisPipeline *pipeline, int frames, int frame_rate);
 GENESIS_EXPORT int genesis_whole_notes_to_frames(struct GenesisPipeline *pipeline, double whole_notes, int frame_rate);
 GENESIS_EXPORT double genesis_whole_notes_to_seconds(struct GenesisPipeline *pipeline, double whole_notes, int frame_rate);
+// the position frame_count frames after whole_notes
+GENESIS_EXPORT double genesis_whole_notes_add_frames(struct GenesisPipeline *pipeline, double whole_notes,
+        int frame_count, int frame_rate);
+
+// can only set this when the pipeline is stopped. changes must be in order
+// of whole_note, with the first at 0, and each tempo lasts until the next
+// change. conversions are a binary search over the changes, whose start
+// times are worked out here. no changes, the default, is a constant 140
+// whole notes per minute.
+GENESIS_EXPORT int genesis_pipeline_set_tempo_map(struct GenesisPipeline *pipeline,
+        const struct GenesisTempoChange *changes, int change_count);
+GENESIS_EXPORT int genesis_pipeline_get_tempo_change_count(struct GenesisPipeline *pipeline);
+GENESIS_EXPORT struct GenesisTempoChange genesis_pipeline_get_tempo_change(struct GenesisPipeline *pipeline,
+        int index);
+// whole notes per minute at whole_note
+GENESIS_EXPORT double genesis_pipeline_get_tempo(struct GenesisPipeline *pipeline, double whole_note);
 
 
 GENESIS_EXPORT struct GenesisNodeDescriptor *genesis_node_descriptor_find(
@@ -228,6 +443,18 @@ GENESIS_EXPORT int genesis_audio_device_create_node_descriptor(
         struct GenesisPipeline *pipeline,
         struct SoundIoDevice *audio_device,
         struct GenesisNodeDescriptor **out_node_descriptor);
+// gives the descriptor's nodes another device the next time they are
+// activated, e.g. the same device found again after the sound backend
+// reconnected. while the pipeline is running the port keeps its format and
+// the device must support it, or GenesisErrorIncompatibleDevice is returned.
+// when it is stopped the format is chosen again as on creation.
+GENESIS_EXPORT int genesis_audio_device_node_descriptor_set_device(
+        struct GenesisNodeDescriptor *node_descriptor,
+        struct SoundIoDevice *audio_device);
+// the device the node descriptor opens, which it keeps the reference to,
+// or NULL if it is not an audio device node descriptor.
+GENESIS_EXPORT struct SoundIoDevice *genesis_audio_device_node_descriptor_device(
+        struct GenesisNodeDescriptor *node_descriptor);
 GENESIS_EXPORT int genesis_midi_device_create_node_descriptor(
         struct GenesisPipeline *pipeline,
         struct GenesisMidiDevice *midi_device,
@@ -255,6 +482,291 @@ GENESIS_EXPORT void *genesis_node_descriptor_userdata(const struct GenesisNodeDe
 GENESIS_EXPORT void genesis_node_descriptor_set_activate_callback(
         struct GenesisNodeDescriptor *descr, int (*activate)(struct GenesisNode *node));
 
+// see genesis_pipeline_set_checkpoints; all three or none. state_size says
+// how many bytes save_state writes, and is called when the pipeline
+// resumes, after activate. save_state is called from a run of the node, so
+// it must not allocate or wait. restore_state is called after the seek
+// callback, with what save_state wrote.
+GENESIS_EXPORT void genesis_node_descriptor_set_state_callbacks(struct GenesisNodeDescriptor *node_descriptor,
+        int (*state_size)(struct GenesisNode *node),
+        void (*save_state)(struct GenesisNode *node, void *state),
+        void (*restore_state)(struct GenesisNode *node, const void *state));
+
+// for buffers which only live through one run. scratch_size says how many
+// bytes the node needs, from the block size and the layouts of its ports.
+// it is called each time the pipeline resumes or a graph edit is
+// committed, once the port buffers are set up and before activate.
+GENESIS_EXPORT void genesis_node_descriptor_set_scratch_callback(struct GenesisNodeDescriptor *node_descriptor,
+        int (*scratch_size)(struct GenesisNode *node));
+
+// only from the node's run callback: at least as many bytes as its
+// scratch_size asked for, aligned to GENESIS_SCRATCH_ALIGNMENT, or nullptr
+// when it asked for none. the memory belongs to whichever thread runs the
+// node and nodes run next on that thread write over it, so nothing in it
+// lasts from one run to the next. getting it never allocates.
+GENESIS_EXPORT void *genesis_node_scratch(struct GenesisNode *node);
+
+// the frames by which every node of the descriptor delays its audio, at the
+// sample rate of the node's first audio out port. 0 by default. when the
+// pipeline resumes it delays the audio on shorter paths through the graph
+// so that every node with several audio inputs gets them lined up.
+GENESIS_EXPORT void genesis_node_descriptor_set_latency(struct GenesisNodeDescriptor *node_descriptor,
+        int frames);
+
+// declares a param that every node of the descriptor has, numbered in the
+// order they are added. changes glide to their new value over ramp_seconds,
+// or jump when that is 0. returns GenesisErrorInvalidState once the
+// descriptor has nodes, and GenesisErrorInvalidParam for a range without
+// the default or a name already taken.
+GENESIS_EXPORT int genesis_node_descriptor_add_param(struct GenesisNodeDescriptor *node_descriptor,
+        const char *name, float min_value, float max_value, float default_value, double ramp_seconds);
+GENESIS_EXPORT int genesis_node_descriptor_param_count(const struct GenesisNodeDescriptor *node_descriptor);
+// returns -1 if not found
+GENESIS_EXPORT int genesis_node_descriptor_find_param_index(
+        const struct GenesisNodeDescriptor *node_descriptor, const char *name);
+GENESIS_EXPORT const char *genesis_node_descriptor_param_name(
+        const struct GenesisNodeDescriptor *node_descriptor, int param_index);
+GENESIS_EXPORT float genesis_node_descriptor_param_min(
+        const struct GenesisNodeDescriptor *node_descriptor, int param_index);
+GENESIS_EXPORT float genesis_node_descriptor_param_max(
+        const struct GenesisNodeDescriptor *node_descriptor, int param_index);
+GENESIS_EXPORT float genesis_node_descriptor_param_default(
+        const struct GenesisNodeDescriptor *node_descriptor, int param_index);
+
+// queues a change of a param to value, clamped to its range, at time in
+// whole notes, or at the start of the node's next run when time is
+// negative. changes are taken in the order they are queued, so queue them
+// in time order. call from one thread per node; it never waits for the
+// pipeline. returns GenesisErrorQueueFull when the node has not caught up
+// with the changes already queued. while the pipeline is stopped the
+// change is made right away, without a ramp.
+GENESIS_EXPORT int genesis_node_set_param(struct GenesisNode *node, int param_index,
+        float value, double time);
+
+// for run callbacks. a run is split into segments in which every param
+// holds still or ramps by a fixed step per frame. returns how many of the
+// next frame_count frames, at frame_rate, are in the segment; read the
+// values for it, then move past the frames used with
+// genesis_node_params_advance, which may be fewer than the segment.
+GENESIS_EXPORT int genesis_node_params_next_segment(struct GenesisNode *node, int frame_rate,
+        int frame_count);
+// at the first frame of the segment
+GENESIS_EXPORT float genesis_node_param_value(struct GenesisNode *node, int param_index);
+// per frame, within the segment
+GENESIS_EXPORT float genesis_node_param_step(struct GenesisNode *node, int param_index);
+GENESIS_EXPORT void genesis_node_params_advance(struct GenesisNode *node, int frame_count);
+
+// node_descriptor must be the "resample" descriptor of a pipeline, otherwise
+// returns GenesisErrorInvalidParam. applies to resample nodes when they are
+// next connected.
+GENESIS_EXPORT int genesis_resample_descriptor_set_quality(struct GenesisNodeDescriptor *node_descriptor,
+        enum GenesisResampleQuality quality);
+GENESIS_EXPORT enum GenesisResampleQuality genesis_resample_descriptor_quality(
+        const struct GenesisNodeDescriptor *node_descriptor);
+
+// node must be made from the "delay" descriptor, otherwise returns
+// GenesisErrorInvalidParam. delay is in whole notes; feedback is within
+// (-1, 1) and wet is the gain of the delayed signal in the output. may be
+// called while the pipeline runs, and then new values glide in over 20 ms
+// and the delay must be at most the max delay. feedback and wet are the
+// node's "feedback" and "wet" params, and this queues them like
+// genesis_node_set_param does. the defaults are a delay of 1, feedback
+// 0.5 and wet 0.5.
+GENESIS_EXPORT int genesis_delay_node_set_params(struct GenesisNode *node,
+        double delay, float feedback, float wet);
+// the longest delay, in whole notes, that the delay line holds. the line is
+// sized to it when the pipeline starts, so this returns
+// GenesisErrorInvalidState while it runs. the default is 1.
+GENESIS_EXPORT int genesis_delay_node_set_max_delay(struct GenesisNode *node, double max_delay);
+
+// node must be made from the "time_stretch" descriptor, otherwise these
+// return GenesisErrorInvalidParam. stretch is how many times longer the
+// output lasts than the input, within [0.25, 4], and pitch how many times
+// higher it sounds, within [0.5, 2]. they are the node's "stretch" and
+// "pitch" params, and this queues them like genesis_node_set_param does;
+// a run takes the values where it starts. the defaults are 1 and 1.
+GENESIS_EXPORT int genesis_time_stretch_node_set_params(struct GenesisNode *node,
+        float stretch, float pitch);
+// the default is GenesisTimeStretchQualityDraft. changes the node's latency,
+// so this returns GenesisErrorInvalidState while the pipeline runs.
+GENESIS_EXPORT int genesis_time_stretch_node_set_quality(struct GenesisNode *node,
+        enum GenesisTimeStretchQuality quality);
+
+// node must be made from the "convolution" descriptor, otherwise these
+// return GenesisErrorInvalidParam. the node convolves each input channel
+// with a channel of the impulse response, wrapping around when the
+// impulse has fewer channels, and delays its output by 256 frames. the
+// impulse is copied and resampled to the node's rate when the pipeline
+// starts, so it can only be changed while the pipeline is stopped, and
+// otherwise GenesisErrorInvalidState is returned. without one the node
+// only passes the dry signal.
+GENESIS_EXPORT int genesis_convolution_node_set_impulse(struct GenesisNode *node,
+        struct GenesisAudioFile *audio_file);
+// same, with the impulse loaded from path by genesis_audio_file_load
+GENESIS_EXPORT int genesis_convolution_node_load_impulse(struct GenesisNode *node, const char *path);
+// the gains of the input and of the convolved signal in the output. may be
+// called while the pipeline runs. the defaults are dry 1 and wet 0.5.
+GENESIS_EXPORT int genesis_convolution_node_set_params(struct GenesisNode *node, float dry, float wet);
+
+// node must be made from the "plugin_host" descriptor, otherwise returns
+// GenesisErrorInvalidParam. the node runs the effect in the shared library
+// at library_path, which exports a struct GenesisPluginEffect as in
+// genesis_plugin.h, in a process started from host_path, usually the
+// genesis_plugin_host program. blocks go to it and back through shared
+// memory. the process starts with the pipeline, so this returns
+// GenesisErrorInvalidState while it runs. without a plugin the node
+// passes its input through.
+GENESIS_EXPORT int genesis_plugin_host_node_set_plugin(struct GenesisNode *node,
+        const char *host_path, const char *library_path);
+// whether the plugin could not be started, crashed or took longer than
+// 100 ms over a block. the node is silent from then on, until the
+// pipeline starts again.
+GENESIS_EXPORT bool genesis_plugin_host_node_failed(struct GenesisNode *node);
+
+// samples shared by any number of "sampler" nodes. each sample is loaded
+// once, however many zones and nodes play it, and only its first 300 ms
+// stay in memory; the rest is decoded from the file while a voice plays.
+struct GenesisSamplerPool;
+
+// a voice plays path when a note within [low_note, high_note] arrives with
+// a velocity within [low_velocity, high_velocity], both MIDI numbers, and
+// plays it at its recorded pitch for root_note. the first zone which
+// matches is played.
+struct GenesisSamplerZone {
+    const char *path;
+    int root_note;
+    int low_note;
+    int high_note;
+    int low_velocity;
+    int high_velocity;
+};
+
+GENESIS_EXPORT int genesis_sampler_pool_create(struct GenesisContext *context,
+        struct GenesisSamplerPool **out_pool);
+// after every node using the pool was destroyed or given another pool,
+// and before the context
+GENESIS_EXPORT void genesis_sampler_pool_destroy(struct GenesisSamplerPool *pool);
+// loads the files of zones which the pool does not have yet, several at
+// once, and adds zones after the ones there are. returns
+// GenesisErrorInvalidState while a pipeline with a node using the pool
+// runs. when a file cannot be loaded, no zones are added, but the files
+// which could stay loaded.
+GENESIS_EXPORT int genesis_sampler_pool_add_zones(struct GenesisSamplerPool *pool,
+        const struct GenesisSamplerZone *zones, int zone_count);
+// the bytes of samples and filters the pool keeps in memory
+GENESIS_EXPORT long genesis_sampler_pool_resident_bytes(struct GenesisSamplerPool *pool);
+// node must be made from the "sampler" descriptor, otherwise returns
+// GenesisErrorInvalidParam. the node plays the pool's zones for the notes
+// of its events input, with up to 64 voices. returns
+// GenesisErrorInvalidState while the pipeline runs. pool may be NULL, and
+// then the node is silent.
+GENESIS_EXPORT int genesis_sampler_node_set_pool(struct GenesisNode *node,
+        struct GenesisSamplerPool *pool);
+
+// the "network-sink" descriptor makes nodes which send their audio input
+// to the network as an AES67 stream: RTP packets of 24 bit big endian
+// samples, payload type 96, marked AF41, with timestamps on the media
+// clock. the media clock is TAI counted in frames, which is PTP time where
+// a PTP daemon keeps the system clock in step with the network. a thread
+// of the node's own sends each packet when its time comes, taking the
+// frames straight from the input's buffer, as a sound device would. the
+// stream starts when the pipeline does, with silence until the input's
+// buffer has first filled up. when the input falls behind, the node sends
+// silence and then skips as many frames, so that the latency stays the
+// same. an offline pipeline's node sends nothing.
+
+// node must be made from the "network-sink" descriptor, otherwise these
+// return GenesisErrorInvalidParam. they return GenesisErrorInvalidState
+// while the pipeline runs. address is a numeric ipv4 or ipv6 address,
+// unicast or multicast. a node without a destination sends nothing.
+GENESIS_EXPORT int genesis_network_sink_node_set_destination(struct GenesisNode *node,
+        const char *address, int port);
+// frames in each packet, 48 by default, which is 1 ms at 48 kHz. the
+// pipeline fails to start when a packet of this many frames of the input's
+// channels is too large for an ethernet frame.
+GENESIS_EXPORT int genesis_network_sink_node_set_packet_frames(struct GenesisNode *node,
+        int frame_count);
+
+struct GenesisNetworkSinkStats {
+    long sent_packet_count;
+    // of those, how many were silence because the input was behind
+    long silent_packet_count;
+    // packets which were never sent because the node's thread woke up too
+    // late for them
+    long skipped_packet_count;
+    // the first error sending, or 0. the node keeps sending after one.
+    int send_error;
+};
+
+// since the pipeline last started. may be called while it runs.
+GENESIS_EXPORT int genesis_network_sink_node_get_stats(struct GenesisNode *node,
+        struct GenesisNetworkSinkStats *out_stats);
+
+struct GenesisMeterLevels {
+    int channel_count;
+    // linear, the largest magnitudes of the samples and of the signal
+    // between them
+    float peak[GENESIS_MAX_CHANNELS];
+    float true_peak[GENESIS_MAX_CHANNELS];
+    float rms[GENESIS_MAX_CHANNELS];
+    // how many frames the levels cover
+    long frame_count;
+};
+
+// node must be made from the "meter" descriptor, otherwise returns
+// GenesisErrorInvalidParam. the node passes its input through unchanged
+// and measures it per channel. the levels cover every frame since the
+// levels that the previous call returned, so no peak is missed however
+// seldom this is called, and the same levels come back until the node
+// runs again. one thread may call this while the pipeline runs; it does
+// not make the node wait.
+GENESIS_EXPORT int genesis_meter_node_read_levels(struct GenesisNode *node,
+        struct GenesisMeterLevels *out_levels);
+
+// a node which records each of its track_count audio inputs, "track_0" and
+// on, to a wav file of its own as 32 bit float samples. the node only copies
+// frames into a buffer of each track, and a thread of its own writes them
+// to disk in large chunks, reserving the files' space ahead of time. the
+// disk may stall for as long as the buffers last without losing frames;
+// past that the frames are dropped and their place in the file filled with
+// silence, so the tracks stay in step. an offline pipeline waits for the
+// disk instead. the files are created when the pipeline starts, over the
+// ones there, and finished when it stops.
+GENESIS_EXPORT int genesis_disk_recorder_create_node_descriptor(struct GenesisPipeline *pipeline,
+        int track_count, struct GenesisNodeDescriptor **out_node_descriptor);
+
+// node must be made from a disk recorder descriptor, otherwise these return
+// GenesisErrorInvalidParam. they return GenesisErrorInvalidState while the
+// pipeline runs. tracks without a path, and tracks whose input is not
+// connected, are not recorded.
+GENESIS_EXPORT int genesis_disk_recorder_node_set_track_path(struct GenesisNode *node,
+        int track_index, const char *path);
+// how many seconds of audio each track buffers. 10 by default.
+GENESIS_EXPORT int genesis_disk_recorder_node_set_buffer_seconds(struct GenesisNode *node,
+        double seconds);
+// whether writes skip the os cache, where the os and the file system
+// allow it. off by default.
+GENESIS_EXPORT int genesis_disk_recorder_node_set_direct_io(struct GenesisNode *node, bool direct_io);
+
+struct GenesisDiskRecorderStats {
+    // frames taken from the inputs and frames that reached the disk, of
+    // the track with the fewest
+    long recorded_frame_count;
+    long written_frame_count;
+    // frames dropped from all of the tracks because a buffer was full
+    long dropped_frame_count;
+    // from 0 to 1, the fullest that the buffer of any track has been
+    double peak_buffer_fill;
+    // the first error writing the files, or 0. tracks stop being written
+    // once writing them failed.
+    int write_error;
+};
+
+// since the pipeline last started. may be called while it runs; it does
+// not make the node wait.
+GENESIS_EXPORT int genesis_disk_recorder_node_get_stats(struct GenesisNode *node,
+        struct GenesisDiskRecorderStats *out_stats);
+
 // returns -1 if not found
 GENESIS_EXPORT int genesis_node_descriptor_find_port_index(
         const struct GenesisNodeDescriptor *node_descriptor, const char *name);
@@ -268,21 +780,115 @@ GENESIS_EXPORT struct GenesisNodeDescriptor *genesis_node_descriptor(struct Gene
 GENESIS_EXPORT struct GenesisPipeline *genesis_node_pipeline(struct GenesisNode *node);
 GENESIS_EXPORT void genesis_node_disconnect_all_ports(struct GenesisNode *node);
 
+// an out port can be connected to several in ports, up to 8. they all read
+// the same buffer, and the source only gets as far ahead as the slowest of
+// them. connecting an in port that is already connected replaces the old
+// connection. returns GenesisErrorMaxConnectionsExceeded if source has no
+// room for another.
 GENESIS_EXPORT int genesis_connect_ports(struct GenesisPort *source, struct GenesisPort *dest);
 GENESIS_EXPORT void genesis_disconnect_ports(struct GenesisPort *source, struct GenesisPort *dest);
 // shortcut for connecting audio nodes. calls genesis_connect_ports internally
 GENESIS_EXPORT int genesis_connect_audio_nodes(struct GenesisNode *source, struct GenesisNode *dest);
 
+// changes the graph of a running pipeline without stopping it. changes are
+// collected in an edit and swapped in by genesis_graph_edit_commit, which
+// waits until no pipeline thread is running a node and no device callback
+// is using a port; buffered audio is kept. changes which only involve nodes
+// added by the edit, or which are made while the pipeline is stopped, take
+// effect right away. one edit at a time per pipeline.
+GENESIS_EXPORT int genesis_graph_edit_begin(struct GenesisPipeline *pipeline,
+        struct GenesisGraphEdit **out_edit);
+// returns NULL if out of memory. the node is activated on commit.
+GENESIS_EXPORT struct GenesisNode *genesis_graph_edit_add_node(struct GenesisGraphEdit *edit,
+        struct GenesisNodeDescriptor *node_descriptor);
+// the node is disconnected and destroyed on commit
+GENESIS_EXPORT int genesis_graph_edit_remove_node(struct GenesisGraphEdit *edit, struct GenesisNode *node);
+// port formats are checked right away, so connect errors are reported here
+// rather than by commit
+GENESIS_EXPORT int genesis_graph_edit_connect(struct GenesisGraphEdit *edit,
+        struct GenesisPort *source, struct GenesisPort *dest);
+GENESIS_EXPORT int genesis_graph_edit_connect_audio_nodes(struct GenesisGraphEdit *edit,
+        struct GenesisNode *source, struct GenesisNode *dest);
+GENESIS_EXPORT int genesis_graph_edit_disconnect(struct GenesisGraphEdit *edit,
+        struct GenesisPort *source, struct GenesisPort *dest);
+// applies and destroys the edit. if an error is returned the pipeline has
+// been stopped and only some of the changes may have been applied.
+GENESIS_EXPORT int genesis_graph_edit_commit(struct GenesisGraphEdit *edit);
+// destroys the nodes added by the edit and drops its pending changes.
+// changes which took effect right away are not undone.
+GENESIS_EXPORT void genesis_graph_edit_abort(struct GenesisGraphEdit *edit);
+
 /// `playback_node` must be a node created with ::genesis_audio_device_create_node_descriptor
-/// Returns the latency in seconds.
+/// Returns the latency in seconds: that of the device plus ::genesis_node_path_latency.
 GENESIS_EXPORT double genesis_node_playback_latency(struct GenesisNode *playback_node);
+
+// for a node whose latency depends on its settings, e.g. from its create
+// callback. -1 goes back to the latency of the descriptor. takes effect
+// when the pipeline next resumes; the silence that lines up other paths
+// with it changes on the next seek or start.
+GENESIS_EXPORT void genesis_node_set_latency(struct GenesisNode *node, int frames);
+GENESIS_EXPORT int genesis_node_latency(struct GenesisNode *node);
+// seconds by which the audio that reaches node lags behind the sources of
+// the graph, with the delays that line up its inputs, as of the last
+// resume. 0 when the audio connections form a cycle.
+GENESIS_EXPORT double genesis_node_path_latency(struct GenesisNode *node);
+
 GENESIS_EXPORT void genesis_node_playback_reset_offset(struct GenesisNode *playback_node);
 GENESIS_EXPORT long genesis_node_playback_offset(struct GenesisNode *playback_node);
 
+// what a playback device callback last handed over. see
+// genesis_node_playback_clock
+struct GenesisPlaybackClock {
+    // os_get_time() seconds when the callback handed frame_count frames to
+    // the device. the first of them is frame, counted like
+    // genesis_node_playback_offset, and whole_note on the timeline.
+    double time;
+    long frame;
+    int frame_count;
+    double whole_note;
+    int frame_rate;
+    // seconds after time until the first of the frames is heard
+    double latency;
+};
+
+// the device callback publishes this every time it writes, without a lock,
+// so any thread may call this as often as it likes; interpolate between
+// callbacks with genesis_playback_clock_position. returns false before the
+// first callback after the node activates or seeks.
+GENESIS_EXPORT bool genesis_node_playback_clock(struct GenesisNode *playback_node,
+        struct GenesisPlaybackClock *clock);
+// the position in whole notes that is heard at os_get_time() == time by
+// clock. it moves smoothly in between callbacks, through the tempo map, and
+// stops at the end of the frames the callback handed over.
+GENESIS_EXPORT double genesis_playback_clock_position(struct GenesisPipeline *pipeline,
+        const struct GenesisPlaybackClock *clock, double time);
+
 
 
 GENESIS_EXPORT struct GenesisNode *genesis_port_node(struct GenesisPort *port);
 
+// node stats are off by default. when off, the only cost is checking the flag.
+// thread-safe; may be toggled while the pipeline is running.
+GENESIS_EXPORT void genesis_pipeline_set_node_stats_enabled(struct GenesisPipeline *pipeline, bool enabled);
+GENESIS_EXPORT bool genesis_pipeline_get_node_stats_enabled(struct GenesisPipeline *pipeline);
+// zero the stats of every node in the pipeline. thread-safe.
+GENESIS_EXPORT void genesis_pipeline_reset_stats(struct GenesisPipeline *pipeline);
+// thread-safe. each counter is read atomically but the set of counters is
+// not a consistent snapshot while the node is running.
+GENESIS_EXPORT void genesis_node_get_stats(struct GenesisNode *node, struct GenesisNodeStats *out_stats);
+
+// thread-safe, and cheap enough to poll while the pipeline is running. like
+// genesis_node_get_stats, the counters are not a consistent snapshot.
+GENESIS_EXPORT void genesis_pipeline_get_telemetry(struct GenesisPipeline *pipeline,
+        struct GenesisPipelineTelemetry *out_telemetry);
+// zero the counters and the histogram. thread-safe.
+GENESIS_EXPORT void genesis_pipeline_reset_telemetry(struct GenesisPipeline *pipeline);
+// fills out_fills with up to max_count connected audio in ports of the
+// pipeline and returns how many there are. may be called while the pipeline
+// is running, but not while nodes are being created or destroyed.
+GENESIS_EXPORT int genesis_pipeline_get_port_fills(struct GenesisPipeline *pipeline,
+        struct GenesisPortFill *out_fills, int max_count);
+
 // name is duplicated internally
 GENESIS_EXPORT struct GenesisPortDescriptor *genesis_node_descriptor_create_port(
         struct GenesisNodeDescriptor *node_descriptor, int port_index,
@@ -311,14 +917,57 @@ GENESIS_EXPORT int genesis_audio_port_descriptor_set_sample_rate(
         struct GenesisPortDescriptor *audio_port_descr,
         int sample_rate, bool fixed, int other_port_index);
 
+// declares that the run callback writes to this audio out port exactly the
+// frames that it reads from the audio in port at in_port_index, and that it
+// can do that in place: reading a frame before it writes it, with read and
+// write pointers that may be the same. when that in port is the only reader
+// of its source and this port has one reader, the pipeline then keeps the
+// frames in the source's buffer instead of copying them to this port's.
+// advance both the read and the write pointer as usual.
+GENESIS_EXPORT int genesis_audio_port_descriptor_set_in_place(
+        struct GenesisPortDescriptor *audio_out_port_descr, int in_port_index);
+
+// the layout the run callback wants the frames of this audio port in. the
+// default is GenesisSampleLayoutInterleaved. when the two ends of a
+// connection want different layouts, the in port converts the frames as they
+// are read. an out port stays interleaved while the latency compensation in
+// front of one of its readers is not a whole number of blocks. only nodes run
+// by pipeline threads, which see whole blocks, should ask for planar frames.
+GENESIS_EXPORT int genesis_audio_port_descriptor_set_sample_layout(
+        struct GenesisPortDescriptor *audio_port_descr, enum GenesisSampleLayout sample_layout);
+
+// the samples the run callback reads from or writes to this audio port. the
+// default is GenesisSamplePrecisionFloat32. an out port's buffer holds its
+// own precision, and an in port whose source has another one converts the
+// frames as they are read, so that either end can pick its own. use the read
+// and write pointer functions of the port's precision.
+GENESIS_EXPORT int genesis_audio_port_descriptor_set_sample_precision(
+        struct GenesisPortDescriptor *audio_port_descr, enum GenesisSamplePrecision sample_precision);
+
 GENESIS_EXPORT void genesis_port_descriptor_destroy(struct GenesisPortDescriptor *port_descriptor);
 
 GENESIS_EXPORT void genesis_debug_print_port_config(struct GenesisPort *port);
 GENESIS_EXPORT void genesis_debug_print_pipeline(struct GenesisPipeline *pipeline);
 
+// all pipelines of a context share one pipeline thread per CPU core,
+// created the first time any pipeline starts. realtime pipelines get those
+// threads before offline ones. port buffers are only reallocated when their
+// size changes.
 GENESIS_EXPORT int genesis_pipeline_start(struct GenesisPipeline *pipeline, double time);
 GENESIS_EXPORT void genesis_pipeline_stop(struct GenesisPipeline *pipeline);
 GENESIS_EXPORT int genesis_pipeline_resume(struct GenesisPipeline *pipeline);
+// like stop then start, but leaves devices open: pauses the pipeline threads,
+// clears the port buffers and calls every node's seek callback. if the
+// pipeline is not running this is the same as genesis_pipeline_start.
+GENESIS_EXPORT int genesis_pipeline_seek(struct GenesisPipeline *pipeline, double time);
+
+// closes and opens again the streams of the audio device nodes of a running
+// pipeline, to get over a stream error or a device that went away. the
+// other nodes, the connections and the port buffers are left as they are,
+// so nothing already produced is lost. a latency greater than 0 goes to the
+// device buffer until the next resume, which sizes everything for it.
+// if an error is returned the pipeline has been stopped.
+GENESIS_EXPORT int genesis_pipeline_reopen_devices(struct GenesisPipeline *pipeline, double latency);
 
 GENESIS_EXPORT bool genesis_pipeline_is_running(struct GenesisPipeline *pipeline);
 
@@ -327,6 +976,140 @@ GENESIS_EXPORT bool genesis_pipeline_is_running(struct GenesisPipeline *pipeline
 // descriptors based on audio devices
 GENESIS_EXPORT int genesis_pipeline_set_latency(struct GenesisPipeline *pipeline, double latency);
 GENESIS_EXPORT double genesis_pipeline_get_latency(struct GenesisPipeline *pipeline);
+// off by default. when enabled, genesis_flush_events gets a running
+// pipeline over an underrun itself, with genesis_pipeline_reopen_devices and
+// half as much latency again, up to max_latency, and only calls the
+// underrun callback if that fails. after GENESIS_ADAPTIVE_LATENCY_SHRINK_SECONDS
+// without an underrun, where the playback devices always had audio to spare
+// beyond what they asked for, it lowers the latency by a tenth, down to
+// min_latency and to what the spare audio allows, for the next resume.
+// genesis_pipeline_get_latency returns the latency the controller settled on.
+#define GENESIS_ADAPTIVE_LATENCY_SHRINK_SECONDS 10.0
+GENESIS_EXPORT int genesis_pipeline_set_adaptive_latency(struct GenesisPipeline *pipeline, bool enabled,
+        double min_latency, double max_latency);
+// can only set this when the pipeline is stopped.
+// when enabled, genesis_pipeline_resume compiles the node graph into a
+// topologically sorted execution plan and nodes are scheduled with
+// precomputed dependency counters. genesis_pipeline_resume returns
+// GenesisErrorInvalidState if the graph has a cycle.
+GENESIS_EXPORT int genesis_pipeline_set_compiled_graph(struct GenesisPipeline *pipeline, bool compiled);
+GENESIS_EXPORT bool genesis_pipeline_get_compiled_graph(struct GenesisPipeline *pipeline);
+// can only set this when the pipeline is stopped and not tracing.
+// for rendering to a file rather than to a device. audio buffers are a
+// fixed GENESIS_OFFLINE_BLOCK_FRAME_COUNT frames instead of being derived
+// from the latency, and every pipeline thread may work on it, not leaving
+// one core free. nodes run as fast as the sink consumes. do not use with nodes based on
+// audio devices.
+#define GENESIS_OFFLINE_BLOCK_FRAME_COUNT 65536
+GENESIS_EXPORT int genesis_pipeline_set_offline(struct GenesisPipeline *pipeline, bool offline);
+GENESIS_EXPORT bool genesis_pipeline_get_offline(struct GenesisPipeline *pipeline);
+// can only set this when the pipeline is stopped and not tracing.
+// at most thread_count of the context's executor threads work on the
+// pipeline. 0, the default, is one per cpu offline and one fewer otherwise.
+GENESIS_EXPORT int genesis_pipeline_set_thread_count(struct GenesisPipeline *pipeline, int thread_count);
+// how many threads work on the pipeline
+GENESIS_EXPORT int genesis_pipeline_get_thread_count(struct GenesisPipeline *pipeline);
+// can only set this when the pipeline is stopped and not tracing.
+// max_thread_count is the thread count, as with
+// genesis_pipeline_set_thread_count. with a min_thread_count of 1 or more,
+// only some of those threads take work at a time, at least
+// min_thread_count of them: every GENESIS_THREAD_SCALING_WINDOW_SECONDS
+// the pipeline looks at how long its nodes ran and how many waited in its
+// queues for a thread, then takes on threads at once when they were
+// needed, or lets one go when fewer would have done. the threads it lets
+// go are not stopped, only left idle, so taking them back costs nothing.
+// 0, the default, keeps every thread working on the pipeline.
+#define GENESIS_THREAD_SCALING_WINDOW_SECONDS 0.05
+GENESIS_EXPORT int genesis_pipeline_set_thread_count_range(struct GenesisPipeline *pipeline,
+        int min_thread_count, int max_thread_count);
+// how many threads take work now. the thread count unless the pipeline
+// scales.
+GENESIS_EXPORT int genesis_pipeline_get_active_thread_count(struct GenesisPipeline *pipeline);
+// can only set this when the pipeline is stopped. 0, the default, lets nodes
+// process whatever is available. otherwise a node is only run once every
+// connected audio input has at least frame_count frames ready and an audio
+// output has room for frame_count frames, and within run callbacks
+// genesis_audio_in_port_fill_count and genesis_audio_out_port_free_count
+// return multiples of frame_count. read and write pointers are contiguous
+// and stay block aligned as long as the node advances by what those return.
+// device callbacks are not affected.
+GENESIS_EXPORT int genesis_pipeline_set_block_size(struct GenesisPipeline *pipeline, int frame_count);
+GENESIS_EXPORT int genesis_pipeline_get_block_size(struct GenesisPipeline *pipeline);
+// can only set this when the pipeline is stopped. when enabled, the default,
+// genesis_pipeline_resume looks for chains of nodes in which a node's only
+// audio output goes only to a node with no other input. each node of such a
+// chain runs right after the one before it on the same thread instead of
+// being queued, and the buffers within the chain hold only
+// GENESIS_FUSED_BUFFER_FRAME_COUNT frames, or two blocks, so that they stay
+// in cache.
+#define GENESIS_FUSED_BUFFER_FRAME_COUNT 1024
+GENESIS_EXPORT int genesis_pipeline_set_fuse_chains(struct GenesisPipeline *pipeline, bool fuse);
+GENESIS_EXPORT bool genesis_pipeline_get_fuse_chains(struct GenesisPipeline *pipeline);
+// can only set this when the pipeline is stopped. off by default. for live
+// monitoring: the node that feeds a playback node runs inside the device
+// callback, for what the device asks for, rather than keeping a whole
+// buffer ready ahead of the device. the nodes before it still run ahead on
+// the pipeline threads. this only applies to a node with a run callback
+// whose one connected port feeds nothing but the playback node; it does not
+// work in place or fuse with its neighbours. while a device starts, and
+// after a seek or an underrun, the pipeline threads fill its buffer, which
+// holds one device buffer, before the device takes over.
+GENESIS_EXPORT int genesis_pipeline_set_direct_playback(struct GenesisPipeline *pipeline, bool direct);
+GENESIS_EXPORT bool genesis_pipeline_get_direct_playback(struct GenesisPipeline *pipeline);
+// can only set this when the pipeline is stopped. off by default. when a
+// playback node has handed GENESIS_IDLE_SILENT_SECONDS of silence to its
+// device after a whole input buffer of it, and what it has buffered is
+// silence too, as the sources and the tails of the nodes after them say
+// with genesis_audio_out_port_write_silence, it goes idle: the device
+// callback writes silence without taking any input, so that the nodes
+// before it have nowhere to write and the pipeline threads sleep.
+// genesis_pipeline_wake ends it, as do a seek, a param change, MIDI input
+// and a graph edit.
+#define GENESIS_IDLE_SILENT_SECONDS 1.0
+GENESIS_EXPORT int genesis_pipeline_set_idle_enabled(struct GenesisPipeline *pipeline, bool enabled);
+GENESIS_EXPORT bool genesis_pipeline_get_idle_enabled(struct GenesisPipeline *pipeline);
+// the playback nodes take their input again from their next device
+// callback. call when something which was silent may not be any more, such
+// as when the transport starts. thread-safe and never waits.
+GENESIS_EXPORT void genesis_pipeline_wake(struct GenesisPipeline *pipeline);
+// can only set this when the pipeline is stopped. when enabled, the default,
+// the threads that run the pipeline's nodes and device callbacks flush
+// denormal numbers to zero, both operands and results, since computing with
+// them is many times slower on some CPUs and a decaying tail is full of them.
+GENESIS_EXPORT int genesis_pipeline_set_flush_denormals(struct GenesisPipeline *pipeline, bool flush);
+GENESIS_EXPORT bool genesis_pipeline_get_flush_denormals(struct GenesisPipeline *pipeline);
+// can only set this when the pipeline is stopped. off by default, with an
+// interval of 0. while the pipeline runs, every node with state callbacks
+// saves its state each interval seconds of audio, keeping the last
+// checkpoint_count, for as long as its state is what playing from time 0
+// would have left. such a node stops its runs at each interval of its first
+// connected audio in port, or of its first audio out port if it has none,
+// so it must take whatever fill count it is given.
+// genesis_pipeline_seek on a running pipeline then starts the nodes from
+// the latest checkpoint at or before the time which all of them have, or
+// from time 0 within the first checkpoint_count intervals, instead of from
+// silence. the playback nodes drop the audio up to the time of the seek,
+// faster than realtime, and their clocks start there; other nodes get all
+// of it. checkpoints are dropped when the pipeline stops, and go stale when
+// a param changes. call genesis_pipeline_clear_checkpoints after any other
+// change to what the nodes play, such as a graph edit that changes what a
+// node hears. it is thread-safe and never waits.
+GENESIS_EXPORT int genesis_pipeline_set_checkpoints(struct GenesisPipeline *pipeline, double interval,
+        int checkpoint_count);
+GENESIS_EXPORT void genesis_pipeline_clear_checkpoints(struct GenesisPipeline *pipeline);
+// whole notes. where the nodes started from at the last seek or start:
+// the time of the checkpoint it restored, or the time it was given
+GENESIS_EXPORT double genesis_pipeline_get_seek_start_time(struct GenesisPipeline *pipeline);
+
+// can only start or stop tracing when the pipeline is stopped; the trace
+// stays active across genesis_pipeline_stop and genesis_pipeline_start.
+// while tracing, every node run, the fill level of its audio input ports,
+// and playback underruns are recorded to `path` in Chrome trace event JSON
+// format, viewable with chrome://tracing or ui.perfetto.dev. writing to the
+// file happens on a separate thread, never on pipeline threads.
+GENESIS_EXPORT int genesis_pipeline_trace_start(struct GenesisPipeline *pipeline, const char *path);
+// finishes writing the file. the pipeline being destroyed also does this.
+GENESIS_EXPORT int genesis_pipeline_trace_stop(struct GenesisPipeline *pipeline);
 
 // can only set this when the pipeline is stopped.
 // also if you change this, you must destroy and re-create all nodes and node
@@ -346,15 +1129,33 @@ GENESIS_EXPORT struct SoundIoChannelLayout *genesis_pipeline_get_channel_layout(
 // returns the number of frames available to read
 GENESIS_EXPORT int genesis_audio_in_port_fill_count(struct GenesisPort *port);
 GENESIS_EXPORT float *genesis_audio_in_port_read_ptr(struct GenesisPort *port);
+GENESIS_EXPORT double *genesis_audio_in_port_read_ptr_double(struct GenesisPort *port);
+GENESIS_EXPORT int16_t *genesis_audio_in_port_read_ptr_int16(struct GenesisPort *port);
 GENESIS_EXPORT void genesis_audio_in_port_advance_read_ptr(struct GenesisPort *port, int frame_count);
 GENESIS_EXPORT int genesis_audio_in_port_capacity(struct GenesisPort *port);
+// returns how many of the frames available to read, from the read pointer
+// on, are known to be silence because they were written with
+// genesis_audio_out_port_write_silence. they are zeros either way; this is
+// so that a node which would only turn them into silence can write silence
+// instead of doing its processing. tracked per block, so it can be less
+// than the silence that was written.
+GENESIS_EXPORT int genesis_audio_in_port_silent_count(struct GenesisPort *port);
 
 // returns the number of frames that can be written
 GENESIS_EXPORT int genesis_audio_out_port_free_count(struct GenesisPort *port);
 GENESIS_EXPORT float *genesis_audio_out_port_write_ptr(struct GenesisPort *port);
+GENESIS_EXPORT double *genesis_audio_out_port_write_ptr_double(struct GenesisPort *port);
+GENESIS_EXPORT int16_t *genesis_audio_out_port_write_ptr_int16(struct GenesisPort *port);
 GENESIS_EXPORT void genesis_audio_out_port_advance_write_ptr(struct GenesisPort *port, int frame_count);
+// writes frame_count frames of zeros and advances the write pointer past
+// them, marking them as silence for the readers of this port
+GENESIS_EXPORT void genesis_audio_out_port_write_silence(struct GenesisPort *port, int frame_count);
 
 GENESIS_EXPORT int genesis_audio_port_bytes_per_frame(struct GenesisPort *port);
+// the layout of the frames the node reads from or writes to this port. set
+// when the pipeline starts or the graph changes.
+GENESIS_EXPORT enum GenesisSampleLayout genesis_audio_port_sample_layout(struct GenesisPort *port);
+GENESIS_EXPORT enum GenesisSamplePrecision genesis_audio_port_sample_precision(struct GenesisPort *port);
 GENESIS_EXPORT int genesis_audio_port_sample_rate(struct GenesisPort *port);
 GENESIS_EXPORT const struct SoundIoChannelLayout *genesis_audio_port_channel_layout(struct GenesisPort *port);
 
@@ -366,6 +1167,21 @@ GENESIS_EXPORT void genesis_events_in_port_fill_count(struct GenesisPort *port,
 // event_count is how many events you consumed. buf_size is the amount of whole notes you consumed.
 GENESIS_EXPORT void genesis_events_in_port_advance_read_ptr(struct GenesisPort *port, int event_count, double buf_size);
 GENESIS_EXPORT struct GenesisMidiEvent *genesis_events_in_port_read_ptr(struct GenesisPort *port);
+// returns the index of the first of the event_count events at the read
+// pointer whose start is at or after start, or event_count if none is, in
+// O(log event_count).
+GENESIS_EXPORT int genesis_events_in_port_find(struct GenesisPort *port, int event_count, double start);
+// for nodes that turn events into frames at frame_rate. asks for the time
+// of frames [frame_start, frame_start + frame_count), less what is already
+// available or asked for, so that running again before the events come
+// does not ask twice. returns how many of those frames the available
+// events account for; event_count is as for genesis_events_in_port_fill_count.
+GENESIS_EXPORT int genesis_events_in_port_fill_frames(struct GenesisPort *port,
+        int frame_start, int frame_count, int frame_rate, int *event_count);
+// consumes event_count events and the time of frames
+// [frame_start, frame_start + frame_count)
+GENESIS_EXPORT void genesis_events_in_port_advance_frames(struct GenesisPort *port,
+        int event_count, int frame_start, int frame_count, int frame_rate);
 
 // event_count is the number of events that can be written.
 // time_requested is how much time in whole notes you should account for if you can.
@@ -374,6 +1190,9 @@ GENESIS_EXPORT void genesis_events_out_port_free_count(struct GenesisPort *port,
 // event_count is how many events you wrote to the buffer. buf_size is the amount of whole notes
 // you accounted for.
 GENESIS_EXPORT void genesis_events_out_port_advance_write_ptr(struct GenesisPort *port, int event_count, double buf_size);
+// events are written in order of their start. the buffer has room for about
+// twice as many events as the writer has written in any stretch of time,
+// worked out when the pipeline starts or the graph changes.
 GENESIS_EXPORT struct GenesisMidiEvent *genesis_events_out_port_write_ptr(struct GenesisPort *port);
 
 
@@ -460,6 +1279,101 @@ GENESIS_EXPORT int genesis_audio_file_sample_rate_index(int index);
 GENESIS_EXPORT int genesis_audio_file_load(struct GenesisContext *context,
         const char *input_filename, struct GenesisAudioFile **audio_file);
 
+/// Like genesis_audio_file_load, except that files which would decode to
+/// more than the context's resident byte limit are not decoded up front.
+/// Their samples are only available through a GenesisAudioFileReader.
+GENESIS_EXPORT int genesis_audio_file_open(struct GenesisContext *context,
+        const char *input_filename, struct GenesisAudioFile **audio_file);
+/// Like genesis_audio_file_open, except that files which are decoded up
+/// front are decoded on a thread of their own, and it returns once the file
+/// is open. Readers get silence past genesis_audio_file_decoded_frame_count.
+/// Until decoding is done the frame count is the one the container gives.
+GENESIS_EXPORT int genesis_audio_file_open_progressive(struct GenesisContext *context,
+        const char *input_filename, struct GenesisAudioFile **audio_file);
+/// Like genesis_audio_file_open, except that every file the container gives
+/// a length for is streamed, however short. The rest are opened as with
+/// genesis_audio_file_open_progressive.
+GENESIS_EXPORT int genesis_audio_file_open_streamed(struct GenesisContext *context,
+        const char *input_filename, struct GenesisAudioFile **audio_file);
+/// True while a file opened with genesis_audio_file_open_progressive is
+/// still being decoded.
+GENESIS_EXPORT bool genesis_audio_file_is_decoding(const struct GenesisAudioFile *audio_file);
+/// How many frames from the start are decoded so far. Only grows.
+GENESIS_EXPORT long genesis_audio_file_decoded_frame_count(const struct GenesisAudioFile *audio_file);
+/// Waits for a progressive file to finish decoding and returns the error
+/// it ended with, if any. The decoded frames are kept either way.
+GENESIS_EXPORT int genesis_audio_file_wait_decoded(struct GenesisAudioFile *audio_file);
+/// True if audio_file was opened for streaming. Streamed files have no
+/// iterator and cannot be exported.
+GENESIS_EXPORT bool genesis_audio_file_is_streamed(const struct GenesisAudioFile *audio_file);
+
+/// Writes the decoded samples of audio_file to path, replacing it, in a
+/// form that genesis_audio_file_map_decoded can use without decoding.
+/// Not for streamed files. The file is only meant to be read back on the
+/// same machine.
+GENESIS_EXPORT int genesis_audio_file_write_decoded(struct GenesisAudioFile *audio_file,
+        const char *path);
+/// Maps a file written by genesis_audio_file_write_decoded. Samples are
+/// read from disk as they are first touched. The result has no tags.
+GENESIS_EXPORT int genesis_audio_file_map_decoded(struct GenesisContext *context,
+        const char *path, struct GenesisAudioFile **audio_file);
+
+/// Defaults to GENESIS_DEFAULT_AUDIO_FILE_RESIDENT_BYTES. Affects files
+/// opened afterwards.
+GENESIS_EXPORT void genesis_set_audio_file_resident_bytes(struct GenesisContext *context, long bytes);
+GENESIS_EXPORT long genesis_audio_file_resident_bytes(struct GenesisContext *context);
+
+/// Converts the samples of a resident audio file to storage. Files that
+/// cannot be held that way, and streamed files, are left as they are. A
+/// file that is not GenesisSampleStorageFloat has no iterator and cannot be
+/// exported or written decoded; its samples are only available through a
+/// GenesisAudioFileReader. Not while audio_file has readers. Between
+/// compact and compressed it goes through floats. Leaves audio_file as it
+/// was if it runs out of memory, except that it may be left as floats.
+GENESIS_EXPORT int genesis_audio_file_set_sample_storage(struct GenesisAudioFile *audio_file,
+        enum GenesisSampleStorage storage);
+GENESIS_EXPORT enum GenesisSampleStorage genesis_audio_file_sample_storage(
+        const struct GenesisAudioFile *audio_file);
+/// The storage projects convert the audio assets they load to. Defaults to
+/// GenesisSampleStorageFloat. Affects assets loaded afterwards.
+GENESIS_EXPORT void genesis_set_default_sample_storage(struct GenesisContext *context,
+        enum GenesisSampleStorage storage);
+GENESIS_EXPORT enum GenesisSampleStorage genesis_default_sample_storage(struct GenesisContext *context);
+/// Projects evict the loaded audio assets that nothing plays and no clip
+/// refers to, least recently used first, while the samples of the loaded
+/// ones take up more than bytes. Defaults to
+/// GENESIS_DEFAULT_AUDIO_ASSET_CACHE_BYTES.
+GENESIS_EXPORT void genesis_set_audio_asset_cache_bytes(struct GenesisContext *context, long bytes);
+GENESIS_EXPORT long genesis_audio_asset_cache_bytes(struct GenesisContext *context);
+
+/// Projects keep the audio files they import in dir, named by their SHA-256
+/// digest, and hard link them into the project directory. The decoded
+/// samples and waveform peaks of the files are cached in dir as well, so
+/// that projects which share a file compute them once. NULL or "" turns it
+/// off, which is the default. Affects imports and loads afterwards.
+GENESIS_EXPORT void genesis_set_asset_store_dir(struct GenesisContext *context, const char *dir);
+/// "" when there is no asset store
+GENESIS_EXPORT const char *genesis_asset_store_dir(struct GenesisContext *context);
+
+/// Time spent decoding and encoding audio files, summed over every thread,
+/// split between FFmpeg's codecs and the conversions between their sample
+/// formats and floats.
+struct GenesisCodecStats {
+    double decode_seconds;
+    double import_seconds;
+    double encode_seconds;
+    double export_seconds;
+};
+/// Codec stats are off by default. When off, the only cost is checking the
+/// flag. Thread-safe.
+GENESIS_EXPORT void genesis_set_codec_stats_enabled(struct GenesisContext *context, bool enabled);
+GENESIS_EXPORT void genesis_get_codec_stats(struct GenesisContext *context, struct GenesisCodecStats *out_stats);
+GENESIS_EXPORT void genesis_reset_codec_stats(struct GenesisContext *context);
+
+/// How many bytes the samples of audio_file take up, counting the mapped
+/// ones of a file from genesis_audio_file_map_decoded. 0 for streamed files.
+GENESIS_EXPORT long genesis_audio_file_memory_bytes(const struct GenesisAudioFile *audio_file);
+
 GENESIS_EXPORT struct GenesisAudioFile *genesis_audio_file_create(
         struct GenesisContext *context, int sample_rate);
 GENESIS_EXPORT void genesis_audio_file_set_sample_rate(struct GenesisAudioFile *audio_file,
@@ -482,6 +1396,30 @@ GENESIS_EXPORT struct GenesisAudioFileIterator genesis_audio_file_iterator(
         struct GenesisAudioFile *audio_file, int channel_index, long start_frame_index);
 GENESIS_EXPORT void genesis_audio_file_iterator_next(struct GenesisAudioFileIterator *it);
 
+/// A play position in an audio file. For streamed files a background thread
+/// decodes ahead of the position into a buffer per reader; for resident files
+/// the read pointers point into the decoded samples, or for compact and
+/// compressed files into a block of them that the fill count converts. Create and destroy
+/// readers from a normal priority thread. The rest of the reader functions
+/// are wait-free and meant to be called from one realtime thread.
+/// The audio file must outlive its readers.
+GENESIS_EXPORT int genesis_audio_file_reader_create(struct GenesisAudioFile *audio_file,
+        struct GenesisAudioFileReader **out_reader);
+GENESIS_EXPORT void genesis_audio_file_reader_destroy(struct GenesisAudioFileReader *reader);
+/// Moves the read position to frame_index. For streamed files the fill count
+/// is 0 until the background thread has decoded from the new position.
+GENESIS_EXPORT void genesis_audio_file_reader_seek(struct GenesisAudioFileReader *reader, long frame_index);
+GENESIS_EXPORT long genesis_audio_file_reader_position(const struct GenesisAudioFileReader *reader);
+/// How many frames from the read position are ready. Frames past the end of
+/// the file are never ready.
+GENESIS_EXPORT int genesis_audio_file_reader_fill_count(struct GenesisAudioFileReader *reader);
+/// Samples of one channel starting at the read position. Valid for as many
+/// frames as the last genesis_audio_file_reader_fill_count returned.
+GENESIS_EXPORT const float *genesis_audio_file_reader_read_ptr(struct GenesisAudioFileReader *reader,
+        int channel_index);
+GENESIS_EXPORT void genesis_audio_file_reader_advance_read_ptr(struct GenesisAudioFileReader *reader,
+        int frame_count);
+
 
 GENESIS_EXPORT struct GenesisAudioFileStream *genesis_audio_file_stream_create(struct GenesisContext *context);
 GENESIS_EXPORT void genesis_audio_file_stream_destroy(struct GenesisAudioFileStream *stream);
@@ -503,4 +1441,59 @@ GENESIS_EXPORT int genesis_audio_file_stream_write(struct GenesisAudioFileStream
         const float *frames, int frame_count);
 
 
+////////////////// Loudness
+
+/// Loudness as EBU R128 measures it, following ITU-R BS.1770.
+struct GenesisLoudness {
+    /// Integrated loudness in LUFS, or -INFINITY when every 400 ms block
+    /// is below the absolute gate, such as for silence or files shorter
+    /// than one block.
+    double integrated;
+    int channel_count;
+    /// Linear, the largest magnitude of the samples of each channel.
+    float sample_peak[GENESIS_MAX_CHANNELS];
+    /// Linear, the largest magnitude of each channel upsampled 4 times.
+    /// Never below sample_peak.
+    float true_peak[GENESIS_MAX_CHANNELS];
+    long frame_count;
+};
+
+/// Measures audio a block at a time, as it is decoded, without keeping it.
+/// Channels are weighted by their ids in channel_layout: the LFE is left
+/// out and surrounds count 1.41 times.
+GENESIS_EXPORT int genesis_loudness_meter_create(int sample_rate,
+        const struct SoundIoChannelLayout *channel_layout, struct GenesisLoudnessMeter **out_meter);
+GENESIS_EXPORT void genesis_loudness_meter_destroy(struct GenesisLoudnessMeter *meter);
+/// channels holds one buffer of frame_count samples per channel. Adding
+/// frames any number at a time gives the same result.
+GENESIS_EXPORT void genesis_loudness_meter_add(struct GenesisLoudnessMeter *meter,
+        const float *const *channels, int frame_count);
+/// The loudness of every frame added so far.
+GENESIS_EXPORT void genesis_loudness_meter_get(struct GenesisLoudnessMeter *meter,
+        struct GenesisLoudness *out_loudness);
+
+/// Measures every frame of audio_file. A progressive file is waited for,
+/// and a streamed one is decoded again from its path on the calling thread.
+GENESIS_EXPORT int genesis_audio_file_measure_loudness(struct GenesisAudioFile *audio_file,
+        struct GenesisLoudness *out_loudness);
+/// Decodes path on the calling thread and measures it a packet at a time,
+/// so that files of any length take the same memory.
+GENESIS_EXPORT int genesis_measure_loudness(struct GenesisContext *context, const char *path,
+        struct GenesisLoudness *out_loudness);
+/// Measures the file at path, or every file under it when it is a
+/// directory, on thread_count threads at once, or one per cpu when it is 0.
+/// on_file is called from those threads, once per file, as each is done.
+/// err is nonzero and loudness NULL for files which could not be decoded.
+/// Returns once every file is done.
+GENESIS_EXPORT int genesis_measure_loudness_batch(struct GenesisContext *context, const char *path,
+        int thread_count, void (*on_file)(void *userdata, const char *path, int err,
+            const struct GenesisLoudness *loudness), void *userdata);
+
+/// The gain which brings loudness to target_lufs, lowered as far as it
+/// takes to keep the true peak of every channel at or below
+/// true_peak_ceiling_db dBTP. 1 when there is no integrated loudness.
+GENESIS_EXPORT float genesis_loudness_normalization_gain(const struct GenesisLoudness *loudness,
+        double target_lufs, double true_peak_ceiling_db);
+
+
 #endif
@@ -6,15 +6,52 @@
 #include "midi_hardware.hpp"
 #include "os.hpp"
 #include "thread_safe_queue.hpp"
+#include "bounded_queue.hpp"
+#include "work_stealing_deque.hpp"
+#include "pipeline_trace.hpp"
 #include "ring_buffer.hpp"
 #include "atomic_double.hpp"
 #include "atomics.hpp"
+#include "tempo_map.hpp"
 
 struct GenesisPipeline;
+struct GenesisContext;
+struct JobSystem;
+
+// how many priorities GenesisSchedulerCriticalPath sorts ranks into
+static const int GENESIS_PRIORITY_LEVEL_COUNT = 8;
+
+struct GenesisExecutorThread {
+    GenesisContext *context;
+    OsThread *thread;
+    int index;
+    // with more than one NUMA node, the node this thread is kept on and
+    // its CPUs there. -1 and 0 otherwise.
+    int numa_node;
+    uint64_t numa_cpu_mask;
+    // set while the thread may be looking at the published pipeline list.
+    // scan_count goes up each time it lets go of it.
+    atomic_bool scanning;
+    atomic_long scan_count;
+    // while idle is set the thread sleeps on wake_epoch, so that
+    // producers wake only threads which may take their nodes
+    atomic_bool idle;
+    atomic_int wake_epoch;
+};
+
+// immutable once published. realtime pipelines come first.
+struct GenesisExecutorPipelineList {
+    GenesisPipeline **pipelines;
+    int count;
+    int realtime_count;
+};
 
 struct GenesisContext {
     GenesisSoundBackend *sound_backend_list;
     int sound_backend_count;
+    // what each backend's devices were when devices_change_callback was
+    // last called for it. see append_device_key.
+    List<ByteBuffer> sound_backend_device_keys;
     void (*devices_change_callback)(void *userdata);
     void *devices_change_callback_userdata;
     void (*sound_backend_disconnect_callback)(void *userdata);
@@ -26,6 +63,8 @@ struct GenesisContext {
 
     OsCond *events_cond;
     OsMutex *events_mutex;
+    // signaled along with events_cond, for hosts with a poll loop
+    OsPollEvent *events_poll_event;
     void (*event_callback)(void *userdata);
     void *event_callback_userdata;
 
@@ -33,24 +72,215 @@ struct GenesisContext {
     List<GenesisAudioFileFormat*> in_formats;
 
     List<GenesisPipeline*> pipelines;
+
+    // one set of pipeline threads is shared by every pipeline in the
+    // context, so that running several at once does not oversubscribe the
+    // CPU. between node runs each thread looks at realtime pipelines before
+    // offline ones, and while a realtime pipeline is running thread 0 only
+    // does realtime work. threads are created when the first pipeline starts.
+    GenesisExecutorThread *executor_threads;
+    int executor_thread_count;
+    bool executor_threads_created;
+    // see genesis_context_set_pipeline_threads. the background attributes
+    // are for threads that should stay off the pipeline threads' CPUs.
+    OsThreadAttributes executor_thread_attributes;
+    OsThreadAttributes background_thread_attributes;
+    // shared by the work of the context and its users that is not realtime
+    JobSystem *job_system;
+    // the online CPUs of each NUMA node. empty on a machine with one node.
+    List<uint64_t> numa_cpu_masks;
+    // the running pipelines. replaced, never modified, by the thread that
+    // starts and stops pipelines.
+    std::atomic<GenesisExecutorPipelineList *> executor_pipelines;
+    // port ring buffers come from here, so that resizing them on resume
+    // does not map new memory every time
+    MirroredMemoryPool ring_buffer_pool;
+    // how many executor threads are idle; lets producers skip looking for
+    // one to wake
+    atomic_int executor_idle_count;
+    atomic_bool executor_exit;
+
+    long audio_file_resident_bytes;
+    GenesisSampleStorage default_sample_storage;
+    long audio_asset_cache_bytes;
+    ByteBuffer asset_store_dir;
+    // one thread decodes ahead of every streaming audio file reader. it is
+    // created with the first one. consumers never take readers_mutex.
+    OsThread *audio_file_reader_thread;
+    OsMutex *audio_file_readers_mutex;
+    List<GenesisAudioFileReader *> audio_file_readers;
+    atomic_int audio_file_reader_wake_epoch;
+    atomic_bool audio_file_reader_idle;
+    atomic_bool audio_file_reader_exit;
+    // see genesis_set_codec_stats_enabled. nanoseconds.
+    atomic_bool codec_stats_enabled;
+    atomic_long codec_decode_ns;
+    atomic_long codec_import_ns;
+    atomic_long codec_encode_ns;
+    atomic_long codec_export_ns;
+};
+
+// the part of executor thread `index` that belongs to one pipeline
+struct GenesisPipelineWorker {
+    GenesisPipeline *pipeline;
+    int index;
+    // that of the executor thread
+    int numa_node;
+    // with thread scaling, nanoseconds spent running nodes. only the
+    // worker writes it.
+    atomic_long busy_ns;
+    // only used with GenesisSchedulerWorkStealing
+    WorkStealingDeque<GenesisNode *> deque;
+    // what genesis_node_scratch gives the nodes this worker runs. it only
+    // grows, and only while no node runs.
+    char *scratch_arena;
+    int scratch_arena_size;
+};
+
+enum GenesisGraphEditOpType {
+    GenesisGraphEditOpTypeConnect,
+    GenesisGraphEditOpTypeDisconnect,
+    GenesisGraphEditOpTypeRemoveNode,
+};
+
+struct GenesisGraphEditOp {
+    GenesisGraphEditOpType type;
+    GenesisPort *source;
+    GenesisPort *dest;
+    GenesisNode *node;
+};
+
+struct GenesisGraphEdit {
+    GenesisPipeline *pipeline;
+    // not visible to pipeline threads until commit, so they can be changed
+    // right away
+    List<GenesisNode *> added_nodes;
+    // changes to nodes the pipeline threads may be running, in order
+    List<GenesisGraphEditOp> ops;
+};
+
+// written by device callbacks, read by genesis_pipeline_get_telemetry
+struct GenesisPipelineTelemetryCounters {
+    atomic_long underrun_count;
+    atomic_long overflow_count;
+    atomic_long callback_count;
+    atomic_long last_callback_ns;
+    atomic_long max_callback_ns;
+    atomic_long callback_period_ns;
+    atomic_long callback_jitter_histogram[GENESIS_NODE_STATS_HISTOGRAM_SIZE];
+};
+
+// see genesis_pipeline_set_adaptive_latency. only used from the thread
+// calling genesis_flush_events, apart from what device callbacks record.
+struct GenesisAdaptiveLatency {
+    bool enabled;
+    double min_latency;
+    double max_latency;
+    // when the pipeline last started playing with the latency it has now
+    double window_start;
+    // since window_start, the least audio left in a playback node's input
+    // after a callback took what its device asked for, and the longest
+    // playback callback
+    atomic_long min_headroom_ns;
+    atomic_long max_callback_ns;
+};
+
+// see genesis_pipeline_set_thread_count_range
+struct GenesisThreadScaling {
+    // 0 when the pipeline does not scale
+    int min_thread_count;
+    // workers from this index on are parked: their executor threads leave
+    // the pipeline alone until it takes them back
+    atomic_int active_thread_count;
+    // os_timestamp() when the window started, and the sum of every
+    // worker's busy_ns then
+    std::atomic<uint64_t> window_start;
+    atomic_long window_busy_ns;
+    // nodes queued and not yet taken, and the most there were in the window
+    atomic_int ready_count;
+    atomic_int peak_ready_count;
 };
 
 struct GenesisPipeline {
     GenesisContext *context;
 
-    OsThread **thread_pool;
+    GenesisScheduler scheduler;
+    // how many of the context's executor threads may work on this pipeline
+    GenesisPipelineWorker *thread_pool;
     int thread_pool_size;
+    // whether the pipeline is in context->executor_pipelines
+    bool executor_listed;
+    // executor threads currently working on this pipeline. they check
+    // running after counting themselves, so once running is false and this
+    // reaches zero no node of this pipeline is running.
+    atomic_int active_worker_count;
+    // device callbacks currently using ports. genesis_pipeline_seek waits for
+    // this to reach zero before it touches buffers.
+    atomic_int device_callback_count;
 
     void (*underrun_callback)(void *userdata);
     void *underrun_callback_userdata;
     atomic_flag stream_fail_flag;
+    GenesisPipelineTelemetryCounters telemetry;
+    GenesisAdaptiveLatency adaptive_latency;
 
     List<GenesisNodeDescriptor*> node_descriptors;
     List<GenesisNode*> nodes;
     atomic_bool running;
+    // when true, genesis_pipeline_resume builds execution_plan and readiness
+    // is tracked with per-node dependency counters instead of walking ports.
+    bool compiled_graph;
+    List<GenesisNode *> execution_plan; // topologically sorted
+    // see genesis_pipeline_set_offline
+    bool offline;
+    // see genesis_pipeline_set_thread_count; 0 for the default
+    int thread_count_limit;
+    GenesisThreadScaling thread_scaling;
+    // frames; 0 when nodes process whatever is available
+    int block_size;
+    // see genesis_pipeline_set_fuse_chains
+    bool fuse_chains;
+    // see genesis_pipeline_set_direct_playback
+    bool direct_playback;
+    // see genesis_pipeline_set_idle_enabled. genesis_pipeline_wake bumps
+    // idle_wake_epoch, which every playback node compares with the one it
+    // last saw.
+    bool idle_enabled;
+    atomic_int idle_wake_epoch;
+    // see genesis_pipeline_set_flush_denormals
+    bool flush_denormals;
+    // see genesis_pipeline_set_checkpoints. checkpoint_interval is 0 when
+    // they are off. a checkpoint saved in an older epoch than
+    // checkpoint_epoch is stale.
+    double checkpoint_interval;
+    int checkpoint_count;
+    atomic_int checkpoint_epoch;
+    // whole notes. where the last seek went, and where the nodes started
+    // from, which is earlier when it restored checkpoints
+    double seek_time;
+    double seek_start_time;
+    atomic_bool node_stats_enabled;
+    // the playback node whose clock events are timed by. the first playback
+    // node activated; only changes while no device callback or node runs.
+    GenesisNode *clock_node;
+    GenesisGraphEdit *graph_edit; // the edit in progress, if any
+    // only changes while the pipeline is stopped. workers record to the lane
+    // matching their thread pool index.
+    PipelineTrace *trace;
+    // with GenesisSchedulerSharedQueue, every ready node goes here. with
+    // GenesisSchedulerWorkStealing, only nodes made ready by non-worker
+    // threads, such as device callbacks, go here.
     ThreadSafeQueue<GenesisNode *> task_queue;
+    // with GenesisSchedulerCriticalPath, every ready node goes here instead,
+    // by its priority_level. workers take from the highest level first.
+    BoundedQueue<GenesisNode *> priority_queues[GENESIS_PRIORITY_LEVEL_COUNT];
+    // see genesis_pipeline_set_tempo_map
+    TempoMap tempo_map;
     double latency;
     double actual_latency;
+    // the device buffer, a quarter of actual_latency unless
+    // genesis_pipeline_reopen_devices gave the devices more
+    double device_latency;
 
     // The sample rate that we use if a range of sample rates are available. For example
     // if a device supports 44100 - 96000, and target_sample_rate is 48000, then 48000
@@ -82,12 +312,28 @@ struct GenesisAudioPortDescriptor {
     int same_channel_layout_index;
     struct SoundIoChannelLayout channel_layout;
 
+    enum GenesisSampleLayout sample_layout;
+    enum GenesisSamplePrecision sample_precision;
+
     bool sample_rate_fixed;
     // if sample_rate_fixed is true then this is the index
     // of the other port that it is the same as, or -1 if it is fixed
     // to the value of sample_rate
     int same_sample_rate_index;
     int sample_rate;
+
+    // out ports only. the node writes exactly the frames it reads from the
+    // in port at in_place_index, so the two can share a buffer.
+    bool in_place;
+    int in_place_index;
+};
+
+struct GenesisParamDescriptor {
+    char *name;
+    float min_value;
+    float max_value;
+    float default_value;
+    double ramp_seconds;
 };
 
 struct GenesisNodeDescriptor {
@@ -95,24 +341,46 @@ struct GenesisNodeDescriptor {
     char *name;
     char *description;
     List<GenesisPortDescriptor*> port_descriptors;
+    // only changes while no node of this descriptor exists
+    List<GenesisParamDescriptor> param_descriptors;
     int (*create)(struct GenesisNode *node);
     void (*destroy)(struct GenesisNode *node);
     void (*run)(struct GenesisNode *node);
     void (*seek)(struct GenesisNode *node);
     int (*activate)(struct GenesisNode *node);
     void (*deactivate)(struct GenesisNode *node);
+    // see genesis_node_descriptor_set_state_callbacks
+    int (*state_size)(struct GenesisNode *node);
+    void (*save_state)(struct GenesisNode *node, void *state);
+    void (*restore_state)(struct GenesisNode *node, const void *state);
+    // see genesis_node_descriptor_set_scratch_callback
+    int (*scratch_size)(struct GenesisNode *node);
     int set_index;
     double min_software_latency;
+    // the frames by which its nodes delay their audio, at the sample rate
+    // of their first audio out port
+    int latency_frames;
 
     void *userdata;
     void (*destroy_descriptor)(struct GenesisNodeDescriptor *);
 };
 
+// an out port can feed this many in ports. they all read its ring buffer in
+// place, each with its own read offset.
+static const int GENESIS_PORT_MAX_OUTPUTS = RING_BUFFER_MAX_READERS;
+
 struct GenesisPort {
     struct GenesisPortDescriptor *descriptor;
     struct GenesisNode *node;
     struct GenesisPort *input_from;
-    struct GenesisPort *output_to;
+    // in ports only. which reader of input_from's ring buffer this is; the
+    // same as the index into input_from->output_to.
+    int reader_index;
+    struct GenesisPort *output_to[GENESIS_PORT_MAX_OUTPUTS];
+    int output_count;
+    // compiled graph only. set when the owning node writes to this out port
+    // during a run; the consumer is notified when the run finishes.
+    bool plan_produced;
 };
 
 struct GenesisAudioPort {
@@ -123,25 +391,179 @@ struct GenesisAudioPort {
     int sample_buffer_err;
     int sample_buffer_size; // in bytes
     int bytes_per_frame;
+    // the layout of the frames the node sees. for out ports also the layout
+    // of sample_buffer.
+    enum GenesisSampleLayout sample_layout;
+    // the same for the precision of the samples
+    enum GenesisSamplePrecision sample_precision;
+    // in ports whose source holds its frames in another layout or
+    // precision. where genesis_audio_in_port_read_ptr converts them to.
+    char *convert_buffer;
+    int convert_buffer_size; // in bytes
+    // out ports. whether sample_buffer was sized for a fused chain
+    bool fused_buffer;
+    // out ports. which granules of silence_granule_size bytes, counted by
+    // offset into the ring buffer that holds the frames, are known to be
+    // silence: the slot at granule % silent_granule_count holds granule when
+    // it is. the writer stores a slot before it advances past the granule.
+    atomic_long *silent_granules;
+    int silent_granule_count;
+    int silence_granule_size;
+    // the last granule the writer wrote to and whether it was all silence
+    long silence_granule;
+    bool silence_granule_silent;
+
+    // in place out ports, while the pipeline runs: the frames are not in
+    // sample_buffer but in the ring buffer of in_place_buffer_port, which is
+    // where the node's in port reads them. the node works on them there and
+    // hands them on by moving in_place_reader, the reader of its in port.
+    // nullptr otherwise.
+    struct GenesisAudioPort *in_place_buffer_port;
+    int in_place_reader;
+    bool in_place_checked;
+    // in ports. the out port of the same node that is in place on this one,
+    // or nullptr.
+    struct GenesisAudioPort *in_place_out_port;
+    // in ports whose source is in place. the reader of the ring buffer that
+    // holds the source's frames.
+    int in_place_source_reader;
+
+    // in ports. the frames of silence that go in front of the source's
+    // frames so that they line up with the node's slowest input. found when
+    // the pipeline resumes.
+    int compensation_frames;
+    // out ports. set when sample_buffer is empty after a seek or a new
+    // allocation, until the delays of its in ports are written into it
+    bool compensation_due;
 };
 
 struct GenesisEventsPort {
     struct GenesisPort port;
     RingBuffer event_buffer;
     int event_buffer_err;
-    AtomicDouble time_available; // in whole notes
-    AtomicDouble time_requested; // in whole notes
+    int event_buffer_size; // in bytes, as requested
+    // out ports. the events per second of event time that event_buffer is
+    // sized for, and what the writer has done since: the most events per
+    // second over EVENT_RATE_WINDOW_SECONDS stretches of event time, and
+    // whether it ever filled the buffer. plain fields, since the writer
+    // only runs while the sizes are not being worked out.
+    int events_per_second_capacity;
+    int window_event_count;
+    double window_time; // in whole notes
+    double peak_event_rate;
+    bool event_buffer_filled;
+    // one of each per reader, in whole notes. the writer writes for the
+    // reader that requested the most.
+    AtomicDouble time_available[GENESIS_PORT_MAX_OUTPUTS];
+    AtomicDouble time_requested[GENESIS_PORT_MAX_OUTPUTS];
+};
+
+struct GenesisNodeStatsCounters {
+    atomic_long run_count;
+    atomic_long total_run_time_ns;
+    atomic_long max_run_time_ns;
+    atomic_long frames_written;
+    atomic_long frames_read;
+    atomic_long denormal_run_count;
+    atomic_long run_time_histogram[GENESIS_NODE_STATS_HISTOGRAM_SIZE];
+};
+
+// see genesis_pipeline_set_checkpoints
+struct GenesisCheckpointSlot {
+    // which boundary the state is from, counting from one, or 0 when the
+    // slot is empty
+    long index;
+    int epoch;
+    char *state;
+};
+
+// only touched by the node's runs, and while no node runs
+struct GenesisNodeCheckpoints {
+    // the port whose frames are counted: the first connected audio in port,
+    // or the first audio out port of a node without one
+    struct GenesisPort *port;
+    // how many frames went through port since time 0, and the boundary
+    // which runs stop at so that the state can be saved there
+    long frame;
+    long next_frame;
+    int interval_frames;
+    int state_size;
+    // the epoch the state of the node belongs to, or -1 when it is not what
+    // playing from time 0 would have left, such as after a seek to
+    // somewhere without a checkpoint. then nothing is saved.
+    int run_epoch;
+    GenesisCheckpointSlot *slots;
+    int slot_count;
 };
 
 struct GenesisNode {
     struct GenesisNodeDescriptor *descriptor;
     int port_count;
+    // the array and the ports are part of the node's allocation
     struct GenesisPort **ports;
     int set_index; // index into context->nodes
     atomic_bool being_processed;
+    // compiled graph only. plan_pending counts down once per connected input
+    // edge; when it reaches zero every upstream node has produced and this
+    // node is queued.
+    int plan_dependency_count;
+    atomic_int plan_pending;
+    // set when this node became ready while it was being processed
+    atomic_bool plan_rerun;
+    // set at resume when chains are fused: the consumer of this node's only
+    // audio output, which is also that consumer's only input. it runs after
+    // this node on the same thread instead of being queued.
+    struct GenesisNode *fused_next;
+    // whether this node wrote to fused_next during the current run
+    bool fused_pending;
+    // set at resume with direct playback when this node feeds a playback
+    // node, whose device callback runs it while device_driven is set. the
+    // pipeline threads never claim it then.
+    bool direct_playback;
+    atomic_bool device_driven;
+    // GenesisSchedulerCriticalPath only. a moving average of how long the
+    // node runs, kept by whichever worker runs it, and the queue its upward
+    // rank puts it in, which only changes while no node runs.
+    atomic_long cost_ns;
+    long upward_rank_ns;
+    int priority_level;
+    GenesisNodeStatsCounters stats;
     double timestamp; // in whole notes
+    // nullptr when the descriptor has no params
+    struct GenesisNodeParams *params;
+    // -1 for the latency of the descriptor
+    int latency_frames;
+    // seconds by which the audio that reaches this node lags behind the
+    // sources of the graph, along its slowest path. found when the
+    // pipeline resumes.
+    AtomicDouble path_latency;
+    int latency_visit;
+    // the NUMA node whose pipeline threads this node's subgraph is meant
+    // for, and where its out port buffers live. -1 on a machine with one
+    // node. found when the pipeline resumes.
+    int numa_node;
+    // nullptr unless the pipeline keeps checkpoints and the descriptor has
+    // state callbacks. made when the pipeline resumes.
+    struct GenesisNodeCheckpoints *checkpoints;
+    // bytes of scratch, a multiple of GENESIS_SCRATCH_ALIGNMENT. 0 when the
+    // descriptor has no scratch callback. found when the pipeline resumes.
+    int scratch_size;
     void *userdata;
     bool constructed;
 };
 
+// device callbacks, and any other thread outside the pipeline which uses
+// ports, bracket that with these so that genesis_pipeline_seek can wait for
+// them to leave the pipeline alone. begin returns false, with nothing to
+// end, when the pipeline is not running.
+bool device_callback_begin(GenesisPipeline *pipeline);
+void device_callback_end(GenesisPipeline *pipeline);
+
+// how many workers a scaling pipeline keeps active after a window in which
+// busy_threads of them were busy on average and at most peak_ready_count
+// nodes were queued, with active_count active until then. never below
+// min_count nor above pool_size.
+int thread_scaling_target(int active_count, int min_count, int pool_size,
+        double busy_threads, int peak_ready_count);
+
 #endif
@@ -81,17 +81,25 @@ static void always_show_tabs_handler(void *userdata) {
     genesis_editor->save_window_config();
 }
 
+static void show_stats_handler(void *userdata) {
+    EditorWindow *editor_window = (EditorWindow *)userdata;
+    editor_window->show_stats = !editor_window->show_stats;
+    editor_window->window->set_stats_visible(editor_window->show_stats);
+    editor_window->genesis_editor->refresh_menu_state();
+}
+
 static void on_flush_events(Event, void *userdata) {
     GenesisEditor *genesis_editor = (GenesisEditor *)userdata;
 
     // update FPS labels
-    ByteBuffer fps_text;
-    fps_text.format("%.0f fps", genesis_editor->gui->fps);
     for (int i = 0; i < genesis_editor->windows.length(); i += 1) {
         EditorWindow *editor_window = genesis_editor->windows.at(i);
+        ByteBuffer fps_text;
+        fps_text.format("%.0f fps", editor_window->window->fps);
         editor_window->fps_widget->set_text(fps_text);
     }
 
+    project_flush_events(genesis_editor->project);
     audio_graph_flush_events(genesis_editor->audio_graph);
 
     for (int i = 0; i < genesis_editor->gui->render_jobs.length(); i += 1) {
@@ -100,9 +108,18 @@ static void on_flush_events(Event, void *userdata) {
     }
 }
 
+static void on_input_handled(Event, void *userdata) {
+    GenesisEditor *genesis_editor = (GenesisEditor *)userdata;
+    // input handlers hold pointers into the widget models, so the models
+    // may not be stale from one input to the next
+    genesis_editor->project->events.flush_deferred();
+}
+
 static void on_buffer_underrun(Event, void *userdata) {
     GenesisEditor *genesis_editor = (GenesisEditor *)userdata;
 
+    // the pipeline gets over underruns itself and only gets here when it
+    // could not reopen the device.
     // TODO tell the difference between buffer underruns and other types of errors
     double latency = audio_graph_get_latency(genesis_editor->audio_graph);
     double new_latency = latency + 0.005;
@@ -117,6 +134,12 @@ static void on_sound_backend_disconnected(Event, void *userdata) {
     audio_graph_recover_sound_backend_disconnect(genesis_editor->audio_graph);
 }
 
+static void on_devices_change(Event, void *userdata) {
+    GenesisEditor *genesis_editor = (GenesisEditor *)userdata;
+
+    audio_graph_refresh_devices(genesis_editor->audio_graph);
+}
+
 static void show_dock_handler(void *userdata) {
     EditorPane *editor_pane = (EditorPane *)userdata;
     EditorWindow *editor_window = editor_pane->editor_window;
@@ -160,7 +183,7 @@ GenesisEditor::GenesisEditor() :
     os_get_app_config_path(config_path);
     settings_file = settings_file_open(config_path);
 
-    resource_bundle = create<ResourceBundle>("resources.bundle");
+    resource_bundle = create<ResourceBundle>("resources.bundle", "resources.mapped");
 
     if ((err = genesis_context_create(&genesis_context)))
         panic("unable to create genesis context: %s", genesis_strerror(err));
@@ -168,8 +191,10 @@ GenesisEditor::GenesisEditor() :
     gui = create<Gui>(genesis_context, resource_bundle);
 
     gui->events.attach_handler(EventFlushEvents, on_flush_events, this);
+    gui->events.attach_handler(EventInputHandled, on_input_handled, this);
     gui->events.attach_handler(EventSoundBackendDisconnected, on_sound_backend_disconnected, this);
-    gui->events.attach_handler(EventDeviceDesignationChange, on_sound_backend_disconnected, this);
+    gui->events.attach_handler(EventAudioDeviceChange, on_devices_change, this);
+    gui->events.attach_handler(EventDeviceDesignationChange, on_devices_change, this);
 
     bool settings_dirty = false;
     if (settings_file->user_name.length() == 0) {
@@ -184,6 +209,13 @@ GenesisEditor::GenesisEditor() :
         settings_file->latency = 0.010; // 10 ms
         settings_dirty = true;
     }
+    if (settings_file->audio_file_resident_mb == 0.0) {
+        settings_file->audio_file_resident_mb = GENESIS_DEFAULT_AUDIO_FILE_RESIDENT_BYTES / (1024.0 * 1024.0);
+        settings_dirty = true;
+    }
+    genesis_set_audio_file_resident_bytes(genesis_context,
+            (long)(settings_file->audio_file_resident_mb * 1024.0 * 1024.0));
+    genesis_set_asset_store_dir(genesis_context, settings_file->asset_store_dir.raw());
 
     int out_format_count = genesis_out_format_count(genesis_context);
     for (int i = 0; i < out_format_count; i += 1) {
@@ -285,6 +317,14 @@ GenesisEditor::GenesisEditor() :
 }
 
 GenesisEditor::~GenesisEditor() {
+    // the next session starts from the latency playback settled on
+    double latency = audio_graph_get_latency(audio_graph);
+    if (latency != settings_file->latency) {
+        settings_file->latency = latency;
+        settings_file_commit(settings_file);
+    }
+    // the last commits may still be on their way to disk
+    settings_file_flush(settings_file);
     audio_graph_destroy(audio_graph);
     project_close(project);
     user_destroy(user);
@@ -363,6 +403,7 @@ void GenesisEditor::create_window(SettingsFileOpenWindow *sf_open_window) {
         new_window->maximize();
 
     editor_window->always_show_tabs = sf_open_window->always_show_tabs;
+    editor_window->show_stats = false;
 
 
     editor_window->genesis_editor = this;
@@ -391,6 +432,7 @@ void GenesisEditor::create_window(SettingsFileOpenWindow *sf_open_window) {
     MenuWidgetItem *close_others_menu = window_menu->add_menu("Close &Others", no_shortcut());
     MenuWidgetItem *always_show_tabs_menu = window_menu->add_menu("Always Show &Tabs", no_shortcut());
     MenuWidgetItem *show_view_menu = window_menu->add_menu("Show &View", no_shortcut());
+    MenuWidgetItem *show_stats_menu = window_menu->add_menu("Show &Stats", no_shortcut());
 
     MenuWidgetItem *open_wiki_menu = help_menu->add_menu("Genesis &Wiki", shortcut(VirtKeyF1));
     MenuWidgetItem *report_bug_menu = help_menu->add_menu("&Report a Bug", no_shortcut());
@@ -408,6 +450,7 @@ void GenesisEditor::create_window(SettingsFileOpenWindow *sf_open_window) {
     close_window_menu->set_activate_handler(close_window_handler, editor_window);
     close_others_menu->set_activate_handler(close_others_handler, editor_window);
     always_show_tabs_menu->set_activate_handler(always_show_tabs_handler, editor_window);
+    show_stats_menu->set_activate_handler(show_stats_handler, editor_window);
 
     open_wiki_menu->set_activate_handler(open_wiki_handler, this);
     report_bug_menu->set_activate_handler(report_bug_handler, this);
@@ -415,6 +458,7 @@ void GenesisEditor::create_window(SettingsFileOpenWindow *sf_open_window) {
     editor_window->undo_menu = undo_menu;
     editor_window->redo_menu = redo_menu;
     editor_window->always_show_tabs_menu = always_show_tabs_menu;
+    editor_window->show_stats_menu = show_stats_menu;
     editor_window->show_view_menu = show_view_menu;
     editor_window->toggle_playback_menu = toggle_playback_menu;
     editor_window->restart_playback_menu = restart_playback_menu;
@@ -434,22 +478,23 @@ void GenesisEditor::create_window(SettingsFileOpenWindow *sf_open_window) {
     top_bar_grid_layout->add_widget(fps_widget, 0, 1, HAlignRight, VAlignTop);
 
     ResourcesTreeWidget *resources_tree = create<ResourcesTreeWidget>(new_window, settings_file, audio_graph);
-    add_dock(editor_window, resources_tree, "Resources");
+    add_dock(editor_window, resources_tree, "Resources", false);
 
     TrackEditorWidget *track_editor = create<TrackEditorWidget>(new_window, audio_graph);
-    add_dock(editor_window, track_editor, "Track Editor");
+    add_dock(editor_window, track_editor, "Track Editor", false);
 
-    MixerWidget *mixer = create<MixerWidget>(new_window, project);
-    add_dock(editor_window, mixer, "Mixer");
+    MixerWidget *mixer = create<MixerWidget>(new_window, project, audio_graph);
+    add_dock(editor_window, mixer, "Mixer", false);
 
     PianoRollWidget *piano_roll = create<PianoRollWidget>(new_window, project);
-    add_dock(editor_window, piano_roll, "Piano Roll");
+    add_dock(editor_window, piano_roll, "Piano Roll", false);
 
     ProjectPropsWidget *project_props = create<ProjectPropsWidget>(new_window, project);
-    add_dock(editor_window, project_props, "Project");
+    // these change rarely, so they draw through textures of their own
+    add_dock(editor_window, project_props, "Project", true);
 
     RenderWidget *render_widget = create<RenderWidget>(new_window, project, settings_file);
-    add_dock(editor_window, render_widget, "Render");
+    add_dock(editor_window, render_widget, "Render", true);
 
     DockAreaWidget *dock_area = create<DockAreaWidget>(new_window);
     editor_window->dock_area = dock_area;
@@ -465,7 +510,8 @@ void GenesisEditor::create_window(SettingsFileOpenWindow *sf_open_window) {
     load_perspective(editor_window, perspective);
 }
 
-void GenesisEditor::add_dock(EditorWindow *editor_window, Widget *widget, const char *title) {
+void GenesisEditor::add_dock(EditorWindow *editor_window, Widget *widget, const char *title, bool cached) {
+    widget->set_draw_cached(cached);
     DockablePaneWidget *pane = create<DockablePaneWidget>(widget, title);
     EditorPane *editor_pane = create<EditorPane>();
 
@@ -487,14 +533,14 @@ void GenesisEditor::refresh_menu_state() {
     String undo_caption;
     String redo_caption;
     if (undo_enabled) {
-        Command *cmd = project->undo_stack.at(project->undo_stack_index - 1);
+        Command *cmd = project_get_undo_command(project, project->undo_stack_index - 1);
         undo_caption = "&Undo ";
         undo_caption.append(cmd->description());
     } else {
         undo_caption = "&Undo";
     }
     if (redo_enabled) {
-        Command *cmd = project->undo_stack.at(project->undo_stack_index);
+        Command *cmd = project_get_undo_command(project, project->undo_stack_index);
         redo_caption = "&Redo ";
         redo_caption.append(cmd->description());
     } else {
@@ -513,10 +559,13 @@ void GenesisEditor::refresh_menu_state() {
 
         editor_window->always_show_tabs_menu->set_icon(
                 editor_window->always_show_tabs ? gui->img_check : nullptr);
+        editor_window->show_stats_menu->set_icon(
+                editor_window->show_stats ? gui->img_check : nullptr);
 
         editor_window->toggle_playback_menu->set_caption(is_playing ? "&Pause" : "&Play");
 
         editor_window->window->refresh_context_menu();
+        editor_window->window->queue_redraw();
     }
 }
 
@@ -33,11 +33,13 @@ struct EditorWindow {
     MenuWidgetItem *undo_menu;
     MenuWidgetItem *redo_menu;
     MenuWidgetItem *always_show_tabs_menu;
+    MenuWidgetItem *show_stats_menu;
     MenuWidgetItem *show_view_menu;
     MenuWidgetItem *toggle_playback_menu;
     MenuWidgetItem *restart_playback_menu;
     MenuWidgetItem *stop_playback_menu;
     bool always_show_tabs;
+    bool show_stats;
     DockAreaWidget* dock_area;
     TextWidget *fps_widget;
     List<EditorPane *> all_panes;
@@ -87,7 +89,7 @@ public:
     SettingsFileOpenWindow *create_sf_open_window();
     void save_window_config();
     void save_dock(DockAreaWidget *dock_area, SettingsFileDock *sf_dock);
-    void add_dock(EditorWindow *editor_window, Widget *widget, const char *title);
+    void add_dock(EditorWindow *editor_window, Widget *widget, const char *title, bool cached);
 
     void show_view(EditorPane *editor_pane);
     DockablePaneWidget *find_pane(EditorPane *editor_pane, DockAreaWidget *dock_area);
@@ -0,0 +1,35 @@
+#ifndef GENESIS_PLUGIN_H
+#define GENESIS_PLUGIN_H
+
+// what a shared library exports for genesis to run it as an effect. the
+// library is loaded by genesis_plugin_host, a process of its own, so when
+// the effect crashes or hangs only that process goes and the node which
+// hosts it turns to silence.
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define GENESIS_PLUGIN_VERSION 1
+// the name of the exported struct GenesisPluginEffect
+#define GENESIS_PLUGIN_EFFECT_SYMBOL "genesis_plugin_effect"
+
+struct GenesisPluginEffect {
+    // GENESIS_PLUGIN_VERSION
+    int version;
+    // returns the effect's state, or NULL if it can't run with these
+    void *(*create)(int channel_count, int sample_rate, int max_frame_count);
+    void (*destroy)(void *effect);
+    // in and out are frame_count interleaved frames, at most
+    // max_frame_count. they do not overlap.
+    void (*process)(void *effect, const float *in, float *out, int frame_count);
+    // may be NULL. the timeline jumped, so whatever the effect holds from
+    // the frames before no longer follows on.
+    void (*seek)(void *effect);
+};
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,108 @@
+#include "glyph_rasterizer.hpp"
+#include "font_size.hpp"
+
+static void ft_ok(FT_Error err) {
+    if (err)
+        panic("freetype error");
+}
+
+static void render_glyph(GlyphRasterizer *rasterizer, GlyphJob *job) {
+    FT_Face face = rasterizer->_font_face;
+    job->pixels = ok_mem(allocate_zero<unsigned char>(job->width * job->height));
+    ft_ok(FT_Set_Char_Size(face, 0, job->pixel_size * 64, 0, 0));
+    ft_ok(FT_Load_Glyph(face, job->glyph_index, FT_LOAD_RENDER));
+
+    // the same size as the metrics the font size laid out with. clip in
+    // case a freetype build disagrees with itself.
+    const FT_Bitmap *bitmap = &face->glyph->bitmap;
+    if (bitmap->pitch < 0 || bitmap->pixel_mode != FT_PIXEL_MODE_GRAY)
+        return;
+    int width = min(job->width, (int)bitmap->width);
+    int height = min(job->height, (int)bitmap->rows);
+    for (int row = 0; row < height; row += 1)
+        memcpy(job->pixels + row * job->width, bitmap->buffer + row * bitmap->pitch, width);
+}
+
+static void run(void *arg) {
+    GlyphRasterizer *rasterizer = (GlyphRasterizer *)arg;
+    for (;;) {
+        GlyphJob job;
+        {
+            OsMutexLocker locker(rasterizer->_mutex);
+            while (rasterizer->_running && rasterizer->_queued.length() == 0)
+                os_cond_wait(rasterizer->_cond, rasterizer->_mutex);
+            if (!rasterizer->_running)
+                return;
+            job = rasterizer->_queued.pop();
+        }
+
+        render_glyph(rasterizer, &job);
+
+        bool was_empty;
+        {
+            OsMutexLocker locker(rasterizer->_mutex);
+            was_empty = (rasterizer->_done.length() == 0);
+            ok_or_panic(rasterizer->_done.append(job));
+        }
+        if (was_empty)
+            rasterizer->_on_done(rasterizer->_userdata);
+    }
+}
+
+GlyphRasterizer::GlyphRasterizer(const ResourceView &font, void (*on_done)(void *), void *userdata) :
+    _on_done(on_done),
+    _userdata(userdata),
+    _mutex(ok_mem(os_mutex_create())),
+    _cond(ok_mem(os_cond_create())),
+    _running(true)
+{
+    ft_ok(FT_Init_FreeType(&_ft_library));
+    ft_ok(FT_New_Memory_Face(_ft_library, (const FT_Byte *)font.data,
+                font.size, 0, &_font_face));
+
+    int err;
+    if ((err = os_thread_create(run, this, false, &_thread)))
+        panic("unable to start thread: %s", genesis_strerror(err));
+}
+
+GlyphRasterizer::~GlyphRasterizer() {
+    {
+        OsMutexLocker locker(_mutex);
+        _running = false;
+        os_cond_signal(_cond, _mutex);
+    }
+    os_thread_destroy(_thread);
+
+    for (int i = 0; i < _done.length(); i += 1)
+        destroy(_done.at(i).pixels, _done.at(i).width * _done.at(i).height);
+
+    os_cond_destroy(_cond);
+    os_mutex_destroy(_mutex);
+
+    FT_Done_Face(_font_face);
+    FT_Done_FreeType(_ft_library);
+}
+
+void GlyphRasterizer::queue(const GlyphJob &job) {
+    OsMutexLocker locker(_mutex);
+    ok_or_panic(_queued.append(job));
+    os_cond_signal(_cond, _mutex);
+}
+
+bool GlyphRasterizer::flush() {
+    List<GlyphJob> done;
+    {
+        OsMutexLocker locker(_mutex);
+        if (_done.length() == 0)
+            return false;
+        for (int i = 0; i < _done.length(); i += 1)
+            ok_or_panic(done.append(_done.at(i)));
+        _done.clear();
+    }
+    for (int i = 0; i < done.length(); i += 1) {
+        GlyphJob *job = &done.at(i);
+        job->font_size->fill_glyph(job);
+        destroy(job->pixels, job->width * job->height);
+    }
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef GLYPH_RASTERIZER_HPP
+#define GLYPH_RASTERIZER_HPP
+
+#include "freetype.hpp"
+#include "byte_buffer.hpp"
+#include "resource_bundle.hpp"
+#include "list.hpp"
+#include "os.hpp"
+#include "atomics.hpp"
+
+class FontSize;
+
+struct GlyphJob {
+    FontSize *font_size;
+    int pixel_size;
+    uint32_t codepoint;
+    FT_UInt glyph_index;
+    // where the rendered bitmap goes in the font size's atlas
+    int atlas_x;
+    int atlas_y;
+    int width;
+    int height;
+    // width * height bytes, set by the rasterizer thread
+    unsigned char *pixels;
+};
+
+// renders glyph bitmaps on a thread of its own, with a face of its own
+// made from the same font file, since a face may only be used by one
+// thread at a time. font sizes lay glyphs out from metrics alone and
+// queue the bitmaps here.
+class GlyphRasterizer {
+public:
+    // on_done is called from the rasterizer thread when glyphs are ready
+    GlyphRasterizer(const ResourceView &font, void (*on_done)(void *), void *userdata);
+    ~GlyphRasterizer();
+
+    void queue(const GlyphJob &job);
+    // hands the finished bitmaps to their font sizes. returns whether
+    // there were any.
+    bool flush();
+
+    void (*_on_done)(void *);
+    void *_userdata;
+
+    FT_Library _ft_library;
+    FT_Face _font_face;
+
+    OsThread *_thread;
+    OsMutex *_mutex;
+    OsCond *_cond;
+    atomic_bool _running;
+    // protected by _mutex
+    List<GlyphJob> _queued;
+    List<GlyphJob> _done;
+
+    GlyphRasterizer(const GlyphRasterizer &copy) = delete;
+    GlyphRasterizer &operator=(const GlyphRasterizer &copy) = delete;
+};
+
+#endif
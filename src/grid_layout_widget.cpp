@@ -22,6 +22,7 @@ void GridLayoutWidget::add_widget(Widget *widget, int row, int col, HAlign h_ali
     cell->widget = widget;
     cell->h_align = h_align;
     cell->v_align = v_align;
+    invalidate_size_hints();
     on_size_hints_changed();
 }
 
@@ -39,6 +40,7 @@ void GridLayoutWidget::remove_all_widgets() {
     }
 
     reduce_size();
+    invalidate_size_hints();
     on_size_hints_changed();
 }
 
@@ -52,72 +54,106 @@ void GridLayoutWidget::remove_widget(Widget *widget) {
     widget->layout_row = -1;
     widget->parent_widget = nullptr;
     reduce_size();
+    invalidate_size_hints();
     on_size_hints_changed();
 }
 
 int GridLayoutWidget::min_width() const {
-    int max_min_row_width = 0;
-    for (int row = 0; row < rows(); row += 1) {
-        int row_width = get_row_min_width(row);
-        max_min_row_width = max(max_min_row_width, row_width);
-    }
-    return max_min_row_width;
+    update_size_hints();
+    return total_hints.min_width;
 }
 
 bool GridLayoutWidget::expanding_x() const {
     // if and only if any widget has max_width -1
-    for (int row = 0; row < rows(); row += 1) {
-        if (get_row_max_width(row) == -1)
-            return true;
-    }
-    return false;
+    update_size_hints();
+    return total_hints.max_width == -1;
 }
 
 int GridLayoutWidget::max_width() const {
-    // if any widget has max_width -1, then return -1
-    // otherwise, return the max max row width
-    int max_max_row_width = 0;
-    for (int row = 0; row < rows(); row += 1) {
-        int row_width = get_row_max_width(row);
-        if (row_width == -1)
-            return -1;
-        max_max_row_width = max(max_max_row_width, row_width);
-    }
-    return max_max_row_width;
+    update_size_hints();
+    return total_hints.max_width;
 }
 
 int GridLayoutWidget::min_height() const {
-    int max_min_col_height = 0;
-    for (int col = 0; col < cols(); col += 1) {
-        int col_height = get_col_min_height(col);
-        max_min_col_height = max(max_min_col_height, col_height);
-    }
-    return max_min_col_height;
+    update_size_hints();
+    return total_hints.min_height;
 }
 
 bool GridLayoutWidget::expanding_y() const {
     // if and only if any widget has max_height -1
-    for (int col = 0; col < cols(); col += 1) {
-        if (get_col_max_height(col) == -1)
-            return true;
-    }
-    return false;
+    update_size_hints();
+    return total_hints.max_height == -1;
 }
 
 int GridLayoutWidget::max_height() const {
-    // if any widget has max_height -1, then return -1.
-    // otherwise, return the max max col height
-    int max_max_col_height = 0;
+    update_size_hints();
+    return total_hints.max_height;
+}
+
+void GridLayoutWidget::invalidate_size_hints() {
+    size_hints_dirty = true;
+    layout_dirty = true;
+}
+
+void GridLayoutWidget::on_child_size_hints_changed() {
+    invalidate_size_hints();
+}
+
+void GridLayoutWidget::update_size_hints() const {
+    if (!size_hints_dirty)
+        return;
+
+    ok_or_panic(row_hints.resize(rows()));
+    ok_or_panic(col_hints.resize(cols()));
+
+    // the min width is the max min row width. if any row has max width -1,
+    // then the max width is -1, otherwise it is the max max row width.
+    total_hints.min_width = 0;
+    total_hints.max_width = 0;
+    total_hints.min_height = 0;
+    total_hints.max_height = 0;
+    for (int row = 0; row < rows(); row += 1) {
+        SizeHints *hints = &row_hints.at(row);
+        hints->min_width = get_row_min_width(row);
+        hints->max_width = get_row_max_width(row);
+        hints->min_height = get_row_min_height(row);
+        hints->max_height = get_row_max_height(row);
+        total_hints.min_width = max(total_hints.min_width, hints->min_width);
+        if (hints->max_width == -1 || total_hints.max_width == -1)
+            total_hints.max_width = -1;
+        else
+            total_hints.max_width = max(total_hints.max_width, hints->max_width);
+    }
+    // same for heights, by column
     for (int col = 0; col < cols(); col += 1) {
-        int col_height = get_col_max_height(col);
-        if (col_height == -1)
-            return -1;
-        max_max_col_height = max(max_max_col_height, col_height);
+        SizeHints *hints = &col_hints.at(col);
+        hints->min_width = get_col_min_width(col);
+        hints->max_width = get_col_max_width(col);
+        hints->min_height = get_col_min_height(col);
+        hints->max_height = get_col_max_height(col);
+        total_hints.min_height = max(total_hints.min_height, hints->min_height);
+        if (hints->max_height == -1 || total_hints.max_height == -1)
+            total_hints.max_height = -1;
+        else
+            total_hints.max_height = max(total_hints.max_height, hints->max_height);
     }
-    return max_max_col_height;
+
+    size_hints_dirty = false;
 }
 
 void GridLayoutWidget::on_resize() {
+    // nothing in this subtree changed since the last layout
+    if (!layout_dirty && left == laid_out_left && top == laid_out_top &&
+        width == laid_out_width && height == laid_out_height)
+    {
+        return;
+    }
+    layout_dirty = false;
+    laid_out_left = left;
+    laid_out_top = top;
+    laid_out_width = width;
+    laid_out_height = height;
+
     layout_x();
     layout_y();
     for (int row = 0; row < rows(); row += 1) {
@@ -318,8 +354,8 @@ void GridLayoutWidget::layout_x() {
     for (int col = 0; col < cols(); col += 1) {
         ColRowInfo *col_info = &col_props.at(col);
         col_info->done = false;
-        col_info->min_size = get_col_min_width(col);
-        col_info->max_size = get_col_max_width(col);
+        col_info->min_size = col_hints.at(col).min_width;
+        col_info->max_size = col_hints.at(col).max_width;
     }
     int not_done_count = cols();
 
@@ -399,8 +435,8 @@ void GridLayoutWidget::layout_y() {
     for (int row = 0; row < rows(); row += 1) {
         ColRowInfo *row_info = &row_props.at(row);
         row_info->done = false;
-        row_info->min_size = get_row_min_height(row);
-        row_info->max_size = get_row_max_height(row);
+        row_info->min_size = row_hints.at(row).min_height;
+        row_info->max_size = row_hints.at(row).max_height;
     }
     int not_done_count = rows();
 
@@ -21,7 +21,9 @@ public:
     GridLayoutWidget(GuiWindow *gui_window) :
         Widget(gui_window),
         spacing(4),
-        padding(4)
+        padding(4),
+        size_hints_dirty(true),
+        layout_dirty(true)
     {
     }
     ~GridLayoutWidget() override { }
@@ -45,6 +47,7 @@ public:
     int max_height() const override;
 
     void on_resize() override;
+    void on_child_size_hints_changed() override;
 
     void on_mouse_move(const MouseEvent *) override;
     void on_drag(const DragEvent *) override;
@@ -69,6 +72,30 @@ public:
     List<ColRowInfo> col_props;
     List<ColRowInfo> row_props;
 
+    // constraints gathered from the cells, recomputed only after a cell
+    // changes. spacing and padding are expected to be set before any
+    // widget is added.
+    struct SizeHints {
+        int min_width;
+        int max_width;
+        int min_height;
+        int max_height;
+    };
+    mutable bool size_hints_dirty;
+    mutable List<SizeHints> row_hints;
+    mutable List<SizeHints> col_hints;
+    mutable SizeHints total_hints;
+
+    // the rect of the last layout, so that an unchanged grid skips it
+    bool layout_dirty;
+    int laid_out_left;
+    int laid_out_top;
+    int laid_out_width;
+    int laid_out_height;
+
+    void invalidate_size_hints();
+    void update_size_hints() const;
+
     void ensure_size(int row_count, int col_count);
     void reduce_size();
 
@@ -3,6 +3,13 @@
 #include "audio_graph.hpp"
 #include "render_job.hpp"
 
+// while animating, exec wakes up this often even without input
+static const double frame_seconds = 1.0 / 60.0;
+// asset loading, directory scanning and render jobs report back through
+// EventFlushEvents rather than waking the gui, so while idle exec still
+// looks this often
+static const double idle_poll_seconds = 0.25;
+
 uint32_t hash_int(const int &x) {
     return (uint32_t) x;
 }
@@ -23,7 +30,7 @@ GlobalGlfwContext::GlobalGlfwContext() {
         panic("GLFW initialize");
 
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GENESIS_DEBUG_MODE);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
@@ -46,6 +53,12 @@ static void audio_device_callback(void *userdata) {
     gui->events.trigger(EventAudioDeviceChange);
 }
 
+// called from any thread when genesis_flush_events has something to flush,
+// and from the glyph rasterizer when glyphs are ready
+static void genesis_event_callback(void *) {
+    glfwPostEmptyEvent();
+}
+
 static void midi_device_callback(void *userdata) {
     Gui *gui = (Gui *)userdata;
     gui->events.trigger(EventMidiDeviceChange);
@@ -53,6 +66,12 @@ static void midi_device_callback(void *userdata) {
 
 Gui::Gui(GenesisContext *context, ResourceBundle *resource_bundle) :
     _running(true),
+    _waiting_for_events(false),
+    _frame_requested(true),
+    _frame_stats(),
+    _label_layout_cache(LABEL_LAYOUT_CACHE_COUNT),
+    last_frame_stats(),
+    _stats_dump_file(nullptr),
     _focus_window(nullptr),
     _utility_window(create_utility_window()),
     _resource_bundle(resource_bundle),
@@ -83,9 +102,29 @@ Gui::Gui(GenesisContext *context, ResourceBundle *resource_bundle) :
 {
 
     ft_ok(FT_Init_FreeType(&_ft_library));
-    _resource_bundle->get_file_buffer("font.ttf", _default_font_buffer);
-    ft_ok(FT_New_Memory_Face(_ft_library, (FT_Byte*)_default_font_buffer.raw(),
-                _default_font_buffer.length(), 0, &_default_font_face));
+    _default_font = _resource_bundle->get_file_view("font.ttf");
+    ft_ok(FT_New_Memory_Face(_ft_library, (const FT_Byte*)_default_font.data,
+                _default_font.size, 0, &_default_font_face));
+    _glyph_rasterizer = create<GlyphRasterizer>(_default_font, genesis_event_callback, this);
+
+    Sha256Hasher hasher;
+    hasher.update((char *)_default_font.data, _default_font.size);
+    ByteBuffer font_digest;
+    hasher.get_digest(font_digest);
+    ByteBuffer glyph_cache_name;
+    for (int i = 0; i < 8; i += 1) {
+        char hex[3];
+        snprintf(hex, sizeof(hex), "%02x", (unsigned char)font_digest.at(i));
+        glyph_cache_name.append(hex);
+    }
+    char version[32];
+    snprintf(version, sizeof(version), "-ft%d.%d.%d-", FREETYPE_MAJOR, FREETYPE_MINOR, FREETYPE_PATCH);
+    glyph_cache_name.append(version);
+    ByteBuffer config_dir;
+    os_get_app_config_dir(config_dir);
+    ByteBuffer glyph_cache_dir;
+    os_path_join(glyph_cache_dir, config_dir, "glyph_cache");
+    os_path_join(_glyph_cache_prefix, glyph_cache_dir, glyph_cache_name);
 
     cursor_default = glfwCreateStandardCursor(GLFW_ARROW_CURSOR);
     cursor_ibeam = glfwCreateStandardCursor(GLFW_IBEAM_CURSOR);
@@ -96,6 +135,7 @@ Gui::Gui(GenesisContext *context, ResourceBundle *resource_bundle) :
     genesis_set_midi_device_callback(_genesis_context, midi_device_callback, this);
 
     genesis_set_sound_backend_disconnect_callback(_genesis_context, sound_backend_disconnect_callback, this);
+    genesis_set_event_callback(_genesis_context, genesis_event_callback, this);
 
     genesis_flush_events(_genesis_context);
     genesis_refresh_midi_devices(_genesis_context);
@@ -106,6 +146,8 @@ Gui::Gui(GenesisContext *context, ResourceBundle *resource_bundle) :
 }
 
 Gui::~Gui() {
+    genesis_set_event_callback(_genesis_context, nullptr, nullptr);
+
     while (render_jobs.length()) {
         RenderJob *rj = render_jobs.pop();
         destroy_render_job(rj);
@@ -117,6 +159,12 @@ Gui::~Gui() {
     glfwDestroyCursor(cursor_default);
     glfwDestroyCursor(cursor_ibeam);
 
+    // it may still hold glyphs for the font sizes
+    destroy(_glyph_rasterizer, 1);
+
+    if (_stats_dump_file)
+        fclose(_stats_dump_file);
+
     auto it = _font_size_cache.entry_iterator();
     for (;;) {
         auto *entry = it.next();
@@ -130,33 +178,108 @@ Gui::~Gui() {
     FT_Done_FreeType(_ft_library);
 }
 
+static void dump_stats(Gui *gui, double time) {
+    const GuiFrameStats *stats = &gui->last_frame_stats;
+    FILE *f = gui->_stats_dump_file;
+    fprintf(f, "{\"time\":%.6f,\"events_ms\":%.3f,\"input_ms\":%.3f,\"draw_ms\":%.3f,"
+            "\"text_ms\":%.3f,\"label_updates\":%d,\"label_cache_hits\":%d,\"texture_uploads\":%d,"
+            "\"texture_upload_bytes\":%ld,\"frames\":%d,\"draw_calls\":%d,\"quads\":%d,\"cached_draws\":%d,"
+            "\"draw_cache_hits\":%d,\"render_ms\":[",
+            time, stats->events_seconds * 1000.0, stats->input_seconds * 1000.0,
+            stats->draw_seconds * 1000.0, stats->text_seconds * 1000.0, stats->label_updates,
+            stats->label_cache_hits,
+            stats->texture_uploads, stats->texture_upload_bytes, stats->frames_recorded,
+            stats->draw_calls, stats->quads, stats->cached_draws, stats->draw_cache_hits);
+    bool first = true;
+    for (int i = 0; i < gui->_window_list.length(); i += 1) {
+        GuiWindow *window = gui->_window_list.at(i);
+        if (window == gui->_utility_window)
+            continue;
+        fprintf(f, "%s%.3f", first ? "" : ",", window->render_microseconds.load() / 1000.0);
+        first = false;
+    }
+    fprintf(f, "]}\n");
+}
+
 void Gui::exec() {
-    os_mutex_unlock(gui_mutex);
-    fps = 60.0;
-    double last_time = os_get_time();
     while (_running) {
-        os_mutex_lock(gui_mutex);
+        double pass_start = os_get_time();
+
         genesis_flush_events(_genesis_context);
-        glfwPollEvents();
         events.trigger(EventFlushEvents);
-        os_mutex_unlock(gui_mutex);
 
-        _utility_window->draw();
+        // glyphs which came back from the rasterizer fill in where labels
+        // already left room for them
+        if (_glyph_rasterizer->flush()) {
+            for (int i = 0; i < _window_list.length(); i += 1) {
+                _window_list.at(i)->invalidate_draw_caches();
+                _window_list.at(i)->queue_redraw();
+            }
+        }
+
+        double draw_start = os_get_time();
+        _frame_stats.events_seconds = draw_start - pass_start;
+
+        // the widgets draw here, with gui_mutex held, into lists which the
+        // window threads draw without it
+        for (int i = 0; i < _window_list.length(); i += 1) {
+            GuiWindow *window = _window_list.at(i);
+            if (window != _utility_window)
+                window->record_frame();
+        }
+        // so that the window contexts see the textures uploaded meanwhile
+        glFlush();
+
+        double draw_end = os_get_time();
+        _frame_stats.draw_seconds = draw_end - draw_start;
+        if (_frame_stats.frames_recorded > 0) {
+            last_frame_stats = _frame_stats;
+            if (_stats_dump_file)
+                dump_stats(this, draw_end);
+        }
+        // input comes in while waiting, and counts toward the next pass
+        _frame_stats = GuiFrameStats();
+
+        // widgets which animate queue another redraw while drawing
+        bool redraw_queued = false;
+        for (int i = 0; i < _window_list.length(); i += 1)
+            redraw_queued = redraw_queued || _window_list.at(i)->redraw_queued;
+
+        double timeout = (_frame_requested || redraw_queued) ? frame_seconds : idle_poll_seconds;
+        _frame_requested = false;
 
-        double this_time = os_get_time();
-        double delta = this_time - last_time;
-        last_time = this_time;
-        double this_fps = 1.0 / delta;
-        fps = fps * 0.90 + this_fps * 0.10;
+        os_mutex_unlock(gui_mutex);
+        _waiting_for_events = true;
+        glfwWaitEventsTimeout(timeout);
+        _waiting_for_events = false;
+        os_mutex_lock(gui_mutex);
     }
-    os_mutex_lock(gui_mutex);
+}
+
+void Gui::request_frame() {
+    _frame_requested = true;
+}
+
+int Gui::open_stats_dump(const char *path) {
+    FILE *f = fopen(path, "a");
+    if (!f)
+        return GenesisErrorFileAccess;
+    // a line at a time, so that it can be followed while running
+    setvbuf(f, nullptr, _IOLBF, 0);
+    if (_stats_dump_file)
+        fclose(_stats_dump_file);
+    _stats_dump_file = f;
+    return 0;
 }
 
 FontSize *Gui::get_font_size(int font_size) {
     auto *entry = _font_size_cache.maybe_get(font_size);
     if (entry)
         return entry->value;
-    FontSize *font_size_object = create<FontSize>(_default_font_face, font_size);
+    ByteBuffer cache_path;
+    cache_path.format("%s%d", _glyph_cache_prefix.raw(), font_size);
+    FontSize *font_size_object = create<FontSize>(_default_font_face, font_size,
+            _glyph_rasterizer, cache_path, &_frame_stats);
     _font_size_cache.put(font_size, font_size_object);
     return font_size_object;
 }
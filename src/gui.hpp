@@ -7,6 +7,9 @@
 #include "glm.hpp"
 #include "hash_map.hpp"
 #include "font_size.hpp"
+#include "label.hpp"
+#include "glyph_rasterizer.hpp"
+#include "gui_stats.hpp"
 #include "resource_bundle.hpp"
 #include "spritesheet.hpp"
 #include "gui_window.hpp"
@@ -19,6 +22,8 @@ struct RenderJob;
 
 uint32_t hash_int(const int &x);
 
+static const int LABEL_LAYOUT_CACHE_COUNT = 2048;
+
 class GlobalGlfwContext {
 public:
     GlobalGlfwContext();
@@ -35,6 +40,12 @@ public:
 
     void exec();
 
+    // keeps exec from sleeping until the next frame. animations call this
+    // every frame for as long as they run.
+    void request_frame();
+    // appends the stats of each pass which draws to path
+    int open_stats_dump(const char *path);
+
     GuiWindow *create_window(int left, int top, int width, int height);
     void destroy_window(GuiWindow *window);
 
@@ -54,13 +65,21 @@ public:
 
 
     bool _running;
+    // true while exec waits for input with gui_mutex unlocked
+    bool _waiting_for_events;
+    bool _frame_requested;
+    // being gathered for this pass of exec
+    GuiFrameStats _frame_stats;
+    LabelLayoutCache _label_layout_cache;
+    // of the last pass which recorded a frame
+    GuiFrameStats last_frame_stats;
+    // one line of json for each of those passes, if open
+    FILE *_stats_dump_file;
     List<GuiWindow*> _window_list;
     GuiWindow *_focus_window;
 
     GlobalGlfwContext _global_glfw_context;
-    // utility window has 2 purposes. 1. to give us an OpenGL context before a
-    // real window is created, and 2. block on draw() gives our main loop
-    // something to block on
+    // utility window gives us an OpenGL context before a real window is created
     GuiWindow *_utility_window;
     ShaderProgramManager _shader_program_manager;
     StaticGeometry _static_geometry;
@@ -75,9 +94,13 @@ public:
 
     // key is font size
     HashMap<int, FontSize *, hash_int> _font_size_cache;
+    GlyphRasterizer *_glyph_rasterizer;
+    // the glyph cache file of each size is this and the size. it names the
+    // font and the freetype version, which both change the bitmaps.
+    ByteBuffer _glyph_cache_prefix;
 
     ResourceBundle *_resource_bundle;
-    ByteBuffer _default_font_buffer;
+    ResourceView _default_font;
 
     List<RenderJob *> render_jobs;
 
@@ -108,8 +131,6 @@ public:
 
     EventDispatcher events;
 
-    double fps;
-
     bool dragging;
     DragData *drag_data;
     GuiWindow *drag_window;
@@ -0,0 +1,30 @@
+#ifndef GUI_STATS_HPP
+#define GUI_STATS_HPP
+
+// what one pass of Gui::exec spent its time on, for the stats overlay and
+// the stats dump. times are in seconds. main thread only.
+struct GuiFrameStats {
+    // genesis and gui events, and what their handlers did
+    double events_seconds;
+    // the glfw input callbacks, and the layout they caused
+    double input_seconds;
+    // the widgets drawing into their windows' draw lists
+    double draw_seconds;
+    // laying out label text, wherever it happened
+    double text_seconds;
+    int label_updates;
+    // of those, the ones copied from the label layout cache
+    int label_cache_hits;
+    int texture_uploads;
+    long texture_upload_bytes;
+    // of the windows recorded this pass
+    int frames_recorded;
+    int draw_calls;
+    int quads;
+    // widgets drawn through their draw caches, and of those, the ones
+    // which did not draw into them again
+    int cached_draws;
+    int draw_cache_hits;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#include "gui_stats_widget.hpp"
+#include "gui_window.hpp"
+#include "gui.hpp"
+
+static void on_flush_events(Event, void *userdata) {
+    GuiStatsWidget *stats_widget = (GuiStatsWidget *)userdata;
+    stats_widget->refresh();
+}
+
+GuiStatsWidget::GuiStatsWidget(GuiWindow *gui_window) :
+    Widget(gui_window),
+    bg_color(0.0f, 0.0f, 0.0f, 0.7f),
+    text_color(0.9f, 0.9f, 0.9f, 1.0f),
+    padding(4)
+{
+    for (int i = 0; i < line_count; i += 1)
+        lines[i] = create<Label>(gui);
+    refresh();
+    gui->events.attach_handler(EventFlushEvents, on_flush_events, this);
+}
+
+GuiStatsWidget::~GuiStatsWidget() {
+    gui->events.detach_handler(EventFlushEvents, on_flush_events, this);
+    for (int i = 0; i < line_count; i += 1)
+        destroy(lines[i], 1);
+}
+
+void GuiStatsWidget::draw(const glm::mat4 &projection) {
+    gui_window->fill_rect(bg_color, projection * bg_model);
+    for (int i = 0; i < line_count; i += 1)
+        lines[i]->draw(gui_window, projection * line_models[i], text_color);
+}
+
+int GuiStatsWidget::min_width() const {
+    int w = 0;
+    for (int i = 0; i < line_count; i += 1)
+        w = max(w, lines[i]->width());
+    return w + padding * 2;
+}
+
+int GuiStatsWidget::min_height() const {
+    int h = 0;
+    for (int i = 0; i < line_count; i += 1)
+        h += lines[i]->height();
+    return h + padding * 2;
+}
+
+// while shown, each change redraws the window, which then shows up in the
+// next numbers, so the window redraws at the rate events are flushed
+void GuiStatsWidget::refresh() {
+    const GuiFrameStats *stats = &gui->last_frame_stats;
+    ByteBuffer text[line_count];
+    text[0].format("events %.2f ms  input %.2f ms",
+            stats->events_seconds * 1000.0, stats->input_seconds * 1000.0);
+    text[1].format("draw %.2f ms  render %.2f ms",
+            stats->draw_seconds * 1000.0, gui_window->render_microseconds.load() / 1000.0);
+    text[2].format("text %.2f ms  %d labels  %d cached", stats->text_seconds * 1000.0,
+            stats->label_updates, stats->label_cache_hits);
+    text[3].format("%d draw calls  %d quads  %d frames  %d/%d cached",
+            stats->draw_calls, stats->quads, stats->frames_recorded,
+            stats->draw_cache_hits, stats->cached_draws);
+    text[4].format("%d uploads  %ld KB", stats->texture_uploads, stats->texture_upload_bytes / 1024);
+
+    bool changed = false;
+    for (int i = 0; i < line_count; i += 1) {
+        String str = text[i];
+        if (String::equal(lines[i]->text(), str))
+            continue;
+        lines[i]->set_text(str);
+        lines[i]->update();
+        changed = true;
+    }
+    if (!changed)
+        return;
+    width = min_width();
+    height = min_height();
+    left = gui_window->_width - width;
+    update_model();
+}
+
+void GuiStatsWidget::update_model() {
+    queue_redraw();
+    bg_model = transform2d(0, 0, width, height);
+    int next_top = padding;
+    for (int i = 0; i < line_count; i += 1) {
+        line_models[i] = transform2d(padding, next_top);
+        next_top += lines[i]->height();
+    }
+}
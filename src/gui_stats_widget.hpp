@@ -0,0 +1,32 @@
+#ifndef GUI_STATS_WIDGET_HPP
+#define GUI_STATS_WIDGET_HPP
+
+#include "widget.hpp"
+#include "label.hpp"
+
+// Gui::last_frame_stats, drawn over the top right of a window. it is not
+// part of the widget tree and takes no input.
+class GuiStatsWidget : public Widget {
+public:
+    GuiStatsWidget(GuiWindow *gui_window);
+    ~GuiStatsWidget() override;
+
+    void draw(const glm::mat4 &projection) override;
+    void on_resize() override { update_model(); }
+
+    int min_width() const override;
+    int min_height() const override;
+
+    void refresh();
+    void update_model();
+
+    static const int line_count = 5;
+    Label *lines[line_count];
+    glm::mat4 line_models[line_count];
+    glm::mat4 bg_model;
+    glm::vec4 bg_color;
+    glm::vec4 text_color;
+    int padding;
+};
+
+#endif
@@ -4,22 +4,77 @@
 #include "widget.hpp"
 #include "debug_gl.hpp"
 #include "menu_widget.hpp"
+#include "gui_stats_widget.hpp"
 #include "os.hpp"
 
 // how many pixels user must drag for drag to start
 static const int DRAG_DIST = 4;
+// frames further apart than this do not count toward fps
+static const double max_frame_seconds = 0.1;
+// set in _ready_draw_list while the list there has not been drawn
+static const uintptr_t DRAW_LIST_FRESH = 1;
+// of the texture quads which draw a draw cache. gl counts its rows from the
+// bottom.
+static const float cache_texture_coords[4][2] = {
+    {0, 1},
+    {0, 0},
+    {1, 1},
+    {1, 0},
+};
 
 static void run(void *arg) {
     GuiWindow *gui_window = (GuiWindow *)arg;
     gui_window->setup_context();
 
-    while (gui_window->running) {
-        gui_window->draw();
+    for (;;) {
+        {
+            OsMutexLocker locker(gui_window->_frame_mutex);
+            while (gui_window->running && !(gui_window->_ready_draw_list.load() & DRAW_LIST_FRESH))
+                os_cond_wait(gui_window->_frame_cond, gui_window->_frame_mutex);
+        }
+        if (!gui_window->running)
+            break;
+        gui_window->render_frame();
     }
 
     gui_window->teardown_context();
 }
 
+// glfw calls the callbacks below from Gui::exec, which waits for events with
+// gui_mutex unlocked, and from inside other glfw calls, which the gui makes
+// with gui_mutex locked
+class CallbackLocker {
+public:
+    CallbackLocker(GLFWwindow *window) :
+        gui_window(static_cast<GuiWindow*>(glfwGetWindowUserPointer(window))),
+        gui(gui_window->gui),
+        locked(gui->_waiting_for_events)
+    {
+        if (locked) {
+            os_mutex_lock(gui->gui_mutex);
+            gui->_waiting_for_events = false;
+        }
+        start_time = os_get_time();
+    }
+    ~CallbackLocker() {
+        gui->_frame_stats.input_seconds += os_get_time() - start_time;
+        if (locked) {
+            // so that deferred handlers catch up before the next input
+            gui->events.trigger(EventInputHandled);
+            gui->_waiting_for_events = true;
+            os_mutex_unlock(gui->gui_mutex);
+        }
+    }
+
+    GuiWindow *gui_window;
+    Gui *gui;
+    bool locked;
+    double start_time;
+
+    CallbackLocker(const CallbackLocker &copy) = delete;
+    CallbackLocker &operator=(const CallbackLocker &copy) = delete;
+};
+
 static void handle_new_size(GuiWindow *gui_window, int width, int height) {
     gui_window->_width = width;
     gui_window->_height = height;
@@ -27,41 +82,71 @@ static void handle_new_size(GuiWindow *gui_window, int width, int height) {
 }
 
 static void static_window_pos_callback(GLFWwindow* window, int left, int top) {
-    return static_cast<GuiWindow*>(glfwGetWindowUserPointer(window))->window_pos_callback(left, top);
+    CallbackLocker locker(window);
+    return locker.gui_window->window_pos_callback(left, top);
 }
 
 static void static_window_close_callback(GLFWwindow* window) {
-    return static_cast<GuiWindow*>(glfwGetWindowUserPointer(window))->window_close_callback();
+    CallbackLocker locker(window);
+    return locker.gui_window->window_close_callback();
 }
 
 static void static_window_iconify_callback(GLFWwindow* window, int iconified) {
-    return static_cast<GuiWindow*>(glfwGetWindowUserPointer(window))->window_iconify_callback(iconified);
+    CallbackLocker locker(window);
+    locker.gui_window->queue_redraw();
+    return locker.gui_window->window_iconify_callback(iconified);
 }
 static void static_framebuffer_size_callback(GLFWwindow* window, int width, int height) {
-    return static_cast<GuiWindow*>(glfwGetWindowUserPointer(window))->framebuffer_size_callback(width, height);
+    CallbackLocker locker(window);
+    locker.gui_window->queue_redraw();
+    return locker.gui_window->framebuffer_size_callback(width, height);
 }
 static void static_key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
-    return static_cast<GuiWindow*>(glfwGetWindowUserPointer(window))->key_callback(key, scancode, action, mods);
+    CallbackLocker locker(window);
+    locker.gui_window->queue_input_redraw();
+    return locker.gui_window->key_callback(key, scancode, action, mods);
 }
 static void static_charmods_callback(GLFWwindow* window, unsigned int codepoint, int mods) {
-    return static_cast<GuiWindow*>(glfwGetWindowUserPointer(window))->charmods_callback(codepoint, mods);
+    CallbackLocker locker(window);
+    locker.gui_window->queue_input_redraw();
+    return locker.gui_window->charmods_callback(codepoint, mods);
 }
 static void static_cursor_pos_callback(GLFWwindow* window, double xpos, double ypos) {
-    return static_cast<GuiWindow*>(glfwGetWindowUserPointer(window))->cursor_pos_callback(xpos, ypos);
+    CallbackLocker locker(window);
+    locker.gui_window->queue_input_redraw();
+    return locker.gui_window->cursor_pos_callback(xpos, ypos);
 }
 static void static_window_size_callback(GLFWwindow* window, int width, int height) {
-    return static_cast<GuiWindow*>(glfwGetWindowUserPointer(window))->window_size_callback(width, height);
+    CallbackLocker locker(window);
+    return locker.gui_window->window_size_callback(width, height);
 }
 static void static_mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
-    return static_cast<GuiWindow*>(glfwGetWindowUserPointer(window))->mouse_button_callback(button, action, mods);
+    CallbackLocker locker(window);
+    locker.gui_window->queue_input_redraw();
+    return locker.gui_window->mouse_button_callback(button, action, mods);
 }
 static void static_scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
-    return static_cast<GuiWindow*>(glfwGetWindowUserPointer(window))->scroll_callback(xoffset, yoffset);
+    CallbackLocker locker(window);
+    locker.gui_window->queue_input_redraw();
+    return locker.gui_window->scroll_callback(xoffset, yoffset);
 }
 
 GuiWindow::GuiWindow(Gui *gui, bool is_normal_window, int left, int top, int width, int height) :
     _userdata(nullptr),
     gui(gui),
+    _back_draw_list(&_draw_lists[0]),
+    _front_draw_list(&_draw_lists[1]),
+    _ready_draw_list((uintptr_t)&_draw_lists[2]),
+    _quads_command(-1),
+    _quads_texture_id(0),
+    _frame_mutex(ok_mem(os_mutex_create())),
+    _frame_cond(ok_mem(os_cond_create())),
+    _viewport_width(-1),
+    _viewport_height(-1),
+    _frame_index(0),
+    _cache_slot_count(0),
+    _draw_cache_epoch(0),
+    _recording_cache(nullptr),
     _mouse_over_widget(nullptr),
     _focus_widget(nullptr),
     menu_widget(nullptr),
@@ -72,7 +157,13 @@ GuiWindow::GuiWindow(Gui *gui, bool is_normal_window, int left, int top, int wid
     _double_click_timeout(0.3),
     dbl_click_count(0),
     running(true),
+    render_microseconds(0),
+    redraw_queued(true),
+    _input_redraw_queued(false),
+    fps(60.0),
+    _last_draw_time(os_get_time()),
     main_widget(nullptr),
+    stats_widget(nullptr),
     context_menu(nullptr),
     is_maximized(false),
     drag_widget(nullptr)
@@ -93,6 +184,8 @@ GuiWindow::GuiWindow(Gui *gui, bool is_normal_window, int left, int top, int wid
     }
     if (!window)
         panic("unable to create window");
+    for (int i = 0; i < array_length(_draw_lists); i += 1)
+        _draw_lists[i].renders_caches = false;
     glfwSetWindowUserPointer(window, this);
 
     glfwSetWindowPos(window, left, top);
@@ -134,21 +227,25 @@ GuiWindow::GuiWindow(Gui *gui, bool is_normal_window, int left, int top, int wid
 
 GuiWindow::~GuiWindow() {
     destroy_context_menu();
+    set_stats_visible(false);
 
     if (gui->_utility_window == this) {
         teardown_context();
     } else {
         running = false;
-
-        os_mutex_unlock(gui->gui_mutex);
+        {
+            OsMutexLocker locker(_frame_mutex);
+            os_cond_signal(_frame_cond, _frame_mutex);
+        }
         os_thread_destroy(thread);
-        os_mutex_lock(gui->gui_mutex);
     }
 
     if (main_widget)
         destroy(main_widget, 1);
 
     glfwDestroyWindow(window);
+    os_cond_destroy(_frame_cond);
+    os_mutex_destroy(_frame_mutex);
 }
 
 void GuiWindow::setup_context() {
@@ -161,6 +258,8 @@ void GuiWindow::setup_context() {
     glGenVertexArrays(1, &vertex_array_object);
     glBindVertexArray(vertex_array_object);
 
+    glGenBuffers(1, &quad_instance_buffer);
+
     glClearColor(0.3, 0.3, 0.3, 1.0);
 
     glEnable(GL_BLEND);
@@ -169,11 +268,22 @@ void GuiWindow::setup_context() {
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
     assert_no_gl_error();
+}
 
-    viewport_update_queued = true;
+static void release_cache_target(GuiCacheTarget *target) {
+    glDeleteFramebuffers(1, &target->framebuffer);
+    glDeleteTextures(1, &target->texture_id);
+    target->framebuffer = 0;
+    target->texture_id = 0;
 }
 
 void GuiWindow::teardown_context() {
+    for (int i = 0; i < _cache_targets.length(); i += 1) {
+        GuiCacheTarget *target = &_cache_targets.at(i);
+        if (target->framebuffer)
+            release_cache_target(target);
+    }
+    glDeleteBuffers(1, &quad_instance_buffer);
     glDeleteVertexArrays(1, &vertex_array_object);
     assert_no_gl_error();
 }
@@ -182,24 +292,302 @@ void GuiWindow::window_iconify_callback(int iconified) {
     _is_iconified = iconified;
 }
 
-void GuiWindow::draw() {
-    if (viewport_update_queued.exchange(false))
-        glViewport(0, 0, _width, _height);
-
-    glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT|GL_STENCIL_BUFFER_BIT);
+void GuiWindow::record_frame() {
+    if (!redraw_queued)
+        return;
+    // a list which draws into caches must be rendered, or the frames after
+    // it would draw caches which were never drawn into. so rather than
+    // replace it, wait for the window thread to take it.
+    uintptr_t ready = _ready_draw_list.load();
+    if ((ready & DRAW_LIST_FRESH) && ((GuiDrawList *)(ready & ~DRAW_LIST_FRESH))->renders_caches)
+        return;
+    redraw_queued = false;
+    if (_input_redraw_queued) {
+        _input_redraw_queued = false;
+        dirty_input_draw_caches();
+    }
+    _frame_index += 1;
+
+    GuiDrawList *list = _back_draw_list;
+    list->clear();
+    list->width = _width;
+    list->height = _height;
+    if (main_widget && main_widget->is_visible)
+        main_widget->draw(_projection);
+    if (stats_widget)
+        stats_widget->draw(_projection);
+    if (context_menu && context_menu->is_visible)
+        context_menu->draw(_projection);
+    flush_quads();
+
+    GuiFrameStats *stats = &gui->_frame_stats;
+    stats->frames_recorded += 1;
+    stats->quads += list->quads.length();
+    for (int i = 0; i < list->commands.length(); i += 1) {
+        GuiDrawCommandType type = list->commands.at(i).type;
+        if (type == GuiDrawCommandQuads || type == GuiDrawCommandWaveform || type == GuiDrawCommandCache)
+            stats->draw_calls += 1;
+    }
 
+    // if the window thread has not drawn the last list yet, this one
+    // replaces it, and it gets recorded into next
+    uintptr_t old = _ready_draw_list.exchange((uintptr_t)list | DRAW_LIST_FRESH);
+    _back_draw_list = (GuiDrawList *)(old & ~DRAW_LIST_FRESH);
     {
-        OsMutexLocker locker(gui->gui_mutex);
+        OsMutexLocker locker(_frame_mutex);
+        os_cond_signal(_frame_cond, _frame_mutex);
+    }
+
+    // a frame after the window sat idle says nothing about frame rate
+    double this_time = os_get_time();
+    double delta = this_time - _last_draw_time;
+    _last_draw_time = this_time;
+    if (delta < max_frame_seconds)
+        fps = fps * 0.90 + (1.0 / delta) * 0.10;
+}
+
+static void quad_attrib_pointer(GLint attrib, int component_count, size_t offset) {
+    glEnableVertexAttribArray(attrib);
+    glVertexAttribPointer(attrib, component_count, GL_FLOAT, GL_FALSE, sizeof(GuiQuad), (void *)offset);
+    glVertexAttribDivisor(attrib, 1);
+}
+
+static void render_quads(GuiWindow *gui_window, const GuiDrawCommand *command) {
+    ShaderProgramManager *manager = &gui_window->gui->_shader_program_manager;
+    manager->quad_program.bind();
+    manager->quad_program.set_uniform(manager->quad_uniform_tex, 0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, gui_window->gui->_static_geometry._rect_2d_vertex_buffer);
+    glEnableVertexAttribArray(manager->quad_attrib_position);
+    glVertexAttribPointer(manager->quad_attrib_position, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    glVertexAttribDivisor(manager->quad_attrib_position, 0);
+
+    // instances start at the command's first quad
+    glBindBuffer(GL_ARRAY_BUFFER, gui_window->quad_instance_buffer);
+    size_t base = command->first * sizeof(GuiQuad);
+    // a mat4 takes one attribute location per column
+    for (int column = 0; column < 4; column += 1) {
+        quad_attrib_pointer(manager->quad_attrib_mvp + column, 4,
+                base + offsetof(GuiQuad, mvp) + column * 4 * sizeof(float));
+    }
+    quad_attrib_pointer(manager->quad_attrib_color_top, 4, base + offsetof(GuiQuad, color_top));
+    quad_attrib_pointer(manager->quad_attrib_color_bottom, 4, base + offsetof(GuiQuad, color_bottom));
+    quad_attrib_pointer(manager->quad_attrib_size, 2, base + offsetof(GuiQuad, size));
+    quad_attrib_pointer(manager->quad_attrib_tex_coords_01, 4, base + offsetof(GuiQuad, tex_coords));
+    quad_attrib_pointer(manager->quad_attrib_tex_coords_23, 4, base + offsetof(GuiQuad, tex_coords[2]));
+    quad_attrib_pointer(manager->quad_attrib_mode, 1, base + offsetof(GuiQuad, mode));
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, command->texture_id);
+
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, command->count);
+}
+
+static void render_waveform(GuiWindow *gui_window, const GuiWaveformDraw *waveform) {
+    ShaderProgramManager *manager = &gui_window->gui->_shader_program_manager;
+    ShaderProgram *program = &manager->waveform_program;
+    program->bind();
+    program->set_uniform(manager->waveform_uniform_mvp, waveform->mvp);
+    program->set_uniform(manager->waveform_uniform_size, waveform->size);
+    program->set_uniform(manager->waveform_uniform_peaks, 0);
+    program->set_uniform(manager->waveform_uniform_peaks_width, waveform->peaks_width);
+    program->set_uniform(manager->waveform_uniform_channel_count, waveform->channel_count);
+    program->set_uniform(manager->waveform_uniform_first_level, waveform->first_level);
+    program->set_uniform(manager->waveform_uniform_level_count, waveform->level_count);
+    program->set_uniform(manager->waveform_uniform_level_offset,
+            waveform->level_offsets, WAVEFORM_PEAKS_MAX_LEVELS);
+    program->set_uniform(manager->waveform_uniform_level_peak_count,
+            waveform->level_peak_counts, WAVEFORM_PEAKS_MAX_LEVELS);
+    program->set_uniform(manager->waveform_uniform_start_frame, waveform->start_frame);
+    program->set_uniform(manager->waveform_uniform_frames_per_pixel, waveform->frames_per_pixel);
+    program->set_uniform(manager->waveform_uniform_color, waveform->color);
+    program->set_uniform(manager->waveform_uniform_rms_color, waveform->rms_color);
+
+    glBindBuffer(GL_ARRAY_BUFFER, gui_window->gui->_static_geometry._rect_2d_vertex_buffer);
+    glEnableVertexAttribArray(manager->waveform_attrib_position);
+    glVertexAttribPointer(manager->waveform_attrib_position, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    // the quad program left these per instance
+    glVertexAttribDivisor(manager->waveform_attrib_position, 0);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, waveform->texture_id);
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
+
+// reallocates the texture when the size changes
+static GuiCacheTarget *get_cache_target(GuiWindow *gui_window, int slot, int width, int height) {
+    List<GuiCacheTarget> *targets = &gui_window->_cache_targets;
+    while (targets->length() <= slot) {
+        ok_or_panic(targets->add_one());
+        GuiCacheTarget *target = &targets->last();
+        target->framebuffer = 0;
+        target->texture_id = 0;
+        target->width = 0;
+        target->height = 0;
+        target->used = false;
+    }
+    GuiCacheTarget *target = &targets->at(slot);
+    target->used = true;
+    if (target->framebuffer && target->width == width && target->height == height)
+        return target;
+    if (!target->framebuffer) {
+        glGenFramebuffers(1, &target->framebuffer);
+        glGenTextures(1, &target->texture_id);
+        glBindTexture(GL_TEXTURE_2D, target->texture_id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    target->width = width;
+    target->height = height;
+    glBindTexture(GL_TEXTURE_2D, target->texture_id);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target->texture_id, 0);
+    return target;
+}
+
+// scissor is in window pixels, and so is cache, the rect of the draw cache
+// being drawn into, if any
+static void apply_scissor(const GuiDrawList *list, const GuiDrawCommand *scissor,
+        const GuiDrawCommand *cache)
+{
+    if (!scissor) {
+        glDisable(GL_SCISSOR_TEST);
+        return;
+    }
+    glEnable(GL_SCISSOR_TEST);
+    // gl counts rows from the bottom
+    int bottom = cache ? (cache->y + cache->h) : list->height;
+    int left = cache ? cache->x : 0;
+    glScissor(scissor->x - left, bottom - (scissor->y + scissor->h), scissor->w, scissor->h);
+}
+
+void GuiWindow::render_frame() {
+    double start_time = os_get_time();
+    uintptr_t ready = _ready_draw_list.exchange((uintptr_t)_front_draw_list);
+    assert(ready & DRAW_LIST_FRESH);
+    GuiDrawList *list = (GuiDrawList *)(ready & ~DRAW_LIST_FRESH);
+    _front_draw_list = list;
+
+    if (list->width != _viewport_width || list->height != _viewport_height) {
+        _viewport_width = list->width;
+        _viewport_height = list->height;
+        glViewport(0, 0, _viewport_width, _viewport_height);
+    }
+
+    glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT|GL_STENCIL_BUFFER_BIT);
 
-        if (main_widget && main_widget->is_visible)
-            main_widget->draw(_projection);
-        if (context_menu && context_menu->is_visible)
-            context_menu->draw(_projection);
+    // every quad of the frame goes up at once. orphaned each time, so that
+    // the driver need not wait for the draws which still read the last ones.
+    if (list->quads.length() > 0) {
+        glBindBuffer(GL_ARRAY_BUFFER, quad_instance_buffer);
+        glBufferData(GL_ARRAY_BUFFER, list->quads.length() * sizeof(GuiQuad),
+                list->quads.raw(), GL_STREAM_DRAW);
+    }
 
+    const GuiDrawCommand *scissor = nullptr;
+    const GuiDrawCommand *cache = nullptr;
+    for (int i = 0; i < list->commands.length(); i += 1) {
+        const GuiDrawCommand *command = &list->commands.at(i);
+        switch (command->type) {
+            case GuiDrawCommandQuads:
+                render_quads(this, command);
+                break;
+            case GuiDrawCommandScissor:
+                scissor = command;
+                apply_scissor(list, scissor, cache);
+                break;
+            case GuiDrawCommandNoScissor:
+                scissor = nullptr;
+                apply_scissor(list, scissor, cache);
+                break;
+            case GuiDrawCommandWaveform:
+                render_waveform(this, &list->waveforms.at(command->first));
+                break;
+            case GuiDrawCommandCacheBegin:
+                {
+                    GuiCacheTarget *target = get_cache_target(this, command->slot, command->w, command->h);
+                    cache = command;
+                    glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+                    // the window's coordinates, moved so that the rect of
+                    // the cache lands on the texture
+                    glViewport(-command->x, command->y + command->h - list->height,
+                            list->width, list->height);
+                    glDisable(GL_SCISSOR_TEST);
+                    glClearColor(0.0, 0.0, 0.0, 0.0);
+                    glClear(GL_COLOR_BUFFER_BIT);
+                    glClearColor(0.3, 0.3, 0.3, 1.0);
+                    // alpha adds up as it would over the window, and the
+                    // colors come out premultiplied by it
+                    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+                    break;
+                }
+            case GuiDrawCommandCacheEnd:
+                cache = nullptr;
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                glViewport(0, 0, _viewport_width, _viewport_height);
+                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                apply_scissor(list, scissor, cache);
+                break;
+            case GuiDrawCommandCache:
+                {
+                    if (command->slot >= _cache_targets.length())
+                        break;
+                    GuiCacheTarget *target = &_cache_targets.at(command->slot);
+                    if (!target->framebuffer)
+                        break;
+                    target->used = true;
+                    GuiDrawCommand quads = *command;
+                    quads.texture_id = target->texture_id;
+                    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+                    render_quads(this, &quads);
+                    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                    break;
+                }
+        }
+    }
+    glDisable(GL_SCISSOR_TEST);
+
+    // the textures of caches which were not drawn, such as those of hidden
+    // tabs. a cache which is not drawn in a frame draws into its texture
+    // again the next time it is.
+    for (int i = 0; i < _cache_targets.length(); i += 1) {
+        GuiCacheTarget *target = &_cache_targets.at(i);
+        if (!target->used && target->framebuffer)
+            release_cache_target(target);
+        target->used = false;
     }
+
+    // not counting the wait for the swap
+    render_microseconds = (long)((os_get_time() - start_time) * 1000000.0);
     glfwSwapBuffers(window);
 }
 
+void GuiWindow::queue_redraw() {
+    redraw_queued = true;
+}
+
+// before the input, for the widgets it leaves, and when the frame is
+// recorded, for those it reached. by then the input may have destroyed the
+// window.
+void GuiWindow::queue_input_redraw() {
+    dirty_input_draw_caches();
+    _input_redraw_queued = true;
+    queue_redraw();
+}
+
+void GuiWindow::dirty_input_draw_caches() {
+    if (_mouse_over_widget)
+        _mouse_over_widget->dirty_draw_caches();
+    if (_focus_widget)
+        _focus_widget->dirty_draw_caches();
+    if (drag_widget)
+        drag_widget->dirty_draw_caches();
+}
+
 void GuiWindow::layout_main_widget() {
     if (main_widget) {
         main_widget->left = 0;
@@ -208,14 +596,29 @@ void GuiWindow::layout_main_widget() {
         main_widget->height = _height;
         main_widget->on_resize();
     }
+    if (stats_widget) {
+        stats_widget->left = _width - stats_widget->width;
+        stats_widget->on_resize();
+    }
+}
+
+void GuiWindow::set_stats_visible(bool visible) {
+    if (!visible) {
+        if (stats_widget) {
+            destroy(stats_widget, 1);
+            stats_widget = nullptr;
+            queue_redraw();
+        }
+        return;
+    }
+    if (!stats_widget)
+        stats_widget = create<GuiStatsWidget>(this);
 }
 
 void GuiWindow::framebuffer_size_callback(int width, int height) {
     handle_new_size(this, width, height);
 
     layout_main_widget();
-
-    viewport_update_queued = true;
 }
 
 void GuiWindow::set_main_widget(Widget *widget) {
@@ -573,39 +976,164 @@ void GuiWindow::set_focus_widget(Widget *widget) {
     _focus_widget->on_gain_focus();
 }
 
-void GuiWindow::fill_rect_gradient(const glm::vec4 &top_color, const glm::vec4 &bottom_color,
-        const glm::mat4 &mvp)
+// the corners of a quad which samples all of its texture
+static const float whole_texture_coords[4][2] = {
+    {0, 0},
+    {0, 1},
+    {1, 0},
+    {1, 1},
+};
+
+void GuiWindow::draw_quad(GuiQuadMode mode, GLuint texture_id, const glm::mat4 &mvp,
+        float width, float height, const float tex_coords[4][2],
+        const glm::vec4 &color_top, const glm::vec4 &color_bottom)
 {
-    gui->_shader_program_manager.gradient_program.bind();
+    GuiDrawList *list = _back_draw_list;
+    if (mode != GuiQuadModeColor) {
+        if (_quads_texture_id && _quads_texture_id != texture_id)
+            flush_quads();
+        _quads_texture_id = texture_id;
+    }
+    if (_quads_command == -1) {
+        _quads_command = list->commands.length();
+        ok_or_panic(list->commands.add_one());
+        GuiDrawCommand *command = &list->commands.last();
+        command->type = GuiDrawCommandQuads;
+        command->first = list->quads.length();
+        command->count = 0;
+    }
+    list->commands.at(_quads_command).count += 1;
+    ok_or_panic(list->quads.add_one());
+    GuiQuad *quad = &list->quads.last();
+    memcpy(quad->mvp, &mvp[0][0], sizeof(quad->mvp));
+    memcpy(quad->color_top, &color_top[0], sizeof(quad->color_top));
+    memcpy(quad->color_bottom, &color_bottom[0], sizeof(quad->color_bottom));
+    quad->size[0] = width;
+    quad->size[1] = height;
+    memcpy(quad->tex_coords, tex_coords ? tex_coords : whole_texture_coords, sizeof(quad->tex_coords));
+    quad->mode = mode;
+}
 
-    gui->_shader_program_manager.gradient_program.set_uniform(
-            gui->_shader_program_manager.gradient_uniform_mvp, mvp);
-    gui->_shader_program_manager.gradient_program.set_uniform(
-            gui->_shader_program_manager.gradient_uniform_color_top, top_color);
-    gui->_shader_program_manager.gradient_program.set_uniform(
-            gui->_shader_program_manager.gradient_uniform_color_bottom, bottom_color);
+void GuiWindow::flush_quads() {
+    if (_quads_command == -1)
+        return;
+    _back_draw_list->commands.at(_quads_command).texture_id = _quads_texture_id;
+    _quads_command = -1;
+    _quads_texture_id = 0;
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, gui->_static_geometry._rect_2d_vertex_buffer);
-    glEnableVertexAttribArray(gui->_shader_program_manager.gradient_attrib_position);
-    glVertexAttribPointer(gui->_shader_program_manager.gradient_attrib_position, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+static GuiDrawCommand *add_command(GuiWindow *gui_window, GuiDrawCommandType type) {
+    gui_window->flush_quads();
+    List<GuiDrawCommand> *commands = &gui_window->_back_draw_list->commands;
+    ok_or_panic(commands->add_one());
+    GuiDrawCommand *command = &commands->last();
+    command->type = type;
+    return command;
+}
 
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+void GuiWindow::set_scissor(int x, int y, int w, int h) {
+    GuiDrawCommand *command = add_command(this, GuiDrawCommandScissor);
+    command->x = x;
+    command->y = y;
+    command->w = max(0, w);
+    command->h = max(0, h);
 }
 
-void GuiWindow::fill_rect(const glm::vec4 &color, const glm::mat4 &mvp) {
-    gui->_shader_program_manager._primitive_shader_program.bind();
+void GuiWindow::clear_scissor() {
+    add_command(this, GuiDrawCommandNoScissor);
+}
 
-    gui->_shader_program_manager._primitive_shader_program.set_uniform(
-            gui->_shader_program_manager._primitive_uniform_color, color);
+void GuiWindow::draw_waveform(const GuiWaveformDraw &waveform) {
+    GuiDrawCommand *command = add_command(this, GuiDrawCommandWaveform);
+    command->first = _back_draw_list->waveforms.length();
+    ok_or_panic(_back_draw_list->waveforms.append(waveform));
+}
 
-    gui->_shader_program_manager._primitive_shader_program.set_uniform(
-            gui->_shader_program_manager._primitive_uniform_mvp, mvp);
+void GuiWindow::draw_widget(Widget *widget, const glm::mat4 &projection) {
+    GuiDrawCache *cache = widget->draw_cache;
+    // caches do not nest; the inner one draws into the outer one
+    if (!cache || _recording_cache || widget->width <= 0 || widget->height <= 0) {
+        widget->draw(projection);
+        return;
+    }
 
-    glBindBuffer(GL_ARRAY_BUFFER, gui->_static_geometry._rect_2d_vertex_buffer);
-    glEnableVertexAttribArray(gui->_shader_program_manager._primitive_attrib_position);
-    glVertexAttribPointer(gui->_shader_program_manager._primitive_attrib_position, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    GuiFrameStats *stats = &gui->_frame_stats;
+    stats->cached_draws += 1;
+    bool stale = cache->dirty || cache->epoch != _draw_cache_epoch || cache->frame != _frame_index - 1 ||
+        cache->left != widget->left || cache->top != widget->top ||
+        cache->width != widget->width || cache->height != widget->height ||
+        cache->window_width != _width || cache->window_height != _height;
+    if (stale) {
+        cache->dirty = false;
+        cache->epoch = _draw_cache_epoch;
+        cache->left = widget->left;
+        cache->top = widget->top;
+        cache->width = widget->width;
+        cache->height = widget->height;
+        cache->window_width = _width;
+        cache->window_height = _height;
+
+        GuiDrawCommand *begin = add_command(this, GuiDrawCommandCacheBegin);
+        begin->slot = cache->slot;
+        begin->x = widget->left;
+        begin->y = widget->top;
+        begin->w = widget->width;
+        begin->h = widget->height;
+        _back_draw_list->renders_caches = true;
+        _recording_cache = cache;
+        widget->draw(projection);
+        _recording_cache = nullptr;
+        add_command(this, GuiDrawCommandCacheEnd);
+    } else {
+        stats->draw_cache_hits += 1;
+    }
+    cache->frame = _frame_index;
+
+    GuiDrawList *list = _back_draw_list;
+    GuiDrawCommand *command = add_command(this, GuiDrawCommandCache);
+    command->slot = cache->slot;
+    command->first = list->quads.length();
+    command->count = 1;
+    ok_or_panic(list->quads.add_one());
+    GuiQuad *quad = &list->quads.last();
+    glm::mat4 mvp = projection * widget->transform2d(0, 0, widget->width, widget->height);
+    glm::vec4 white(1.0f, 1.0f, 1.0f, 1.0f);
+    memcpy(quad->mvp, &mvp[0][0], sizeof(quad->mvp));
+    memcpy(quad->color_top, &white[0], sizeof(quad->color_top));
+    memcpy(quad->color_bottom, &white[0], sizeof(quad->color_bottom));
+    quad->size[0] = 1.0f;
+    quad->size[1] = 1.0f;
+    memcpy(quad->tex_coords, cache_texture_coords, sizeof(quad->tex_coords));
+    quad->mode = GuiQuadModeTexture;
+}
 
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+GuiDrawCache *GuiWindow::create_draw_cache() {
+    GuiDrawCache *cache = ok_mem(create_zero<GuiDrawCache>());
+    if (_free_cache_slots.length() > 0)
+        cache->slot = _free_cache_slots.pop();
+    else
+        cache->slot = _cache_slot_count++;
+    cache->dirty = true;
+    return cache;
+}
+
+void GuiWindow::destroy_draw_cache(GuiDrawCache *cache) {
+    ok_or_panic(_free_cache_slots.append(cache->slot));
+    destroy(cache, 1);
+}
+
+void GuiWindow::invalidate_draw_caches() {
+    _draw_cache_epoch += 1;
+}
+
+void GuiWindow::fill_rect_gradient(const glm::vec4 &top_color, const glm::vec4 &bottom_color,
+        const glm::mat4 &mvp)
+{
+    draw_quad(GuiQuadModeColor, 0, mvp, 1.0f, 1.0f, nullptr, top_color, bottom_color);
+}
+
+void GuiWindow::fill_rect(const glm::vec4 &color, const glm::mat4 &mvp) {
+    draw_quad(GuiQuadModeColor, 0, mvp, 1.0f, 1.0f, nullptr, color, color);
 }
 
 
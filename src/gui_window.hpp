@@ -11,6 +11,7 @@
 #include "event_dispatcher.hpp"
 #include "atomics.hpp"
 #include "os.hpp"
+#include "waveform_peaks.hpp"
 
 class Gui;
 class Widget;
@@ -18,13 +19,131 @@ struct SpritesheetImage;
 class MenuWidgetItem;
 class MenuWidget;
 class ContextMenuWidget;
+class GuiStatsWidget;
+
+enum GuiQuadMode {
+    GuiQuadModeColor,
+    // the texture times the color
+    GuiQuadModeTexture,
+    // the color, its alpha times that of the texture
+    GuiQuadModeTextureAlpha,
+    // the color, its alpha times the red of the texture, for glyphs
+    GuiQuadModeTextureRed,
+};
+
+// one instance of the quad program, laid out as it reads it
+struct GuiQuad {
+    float mvp[16];
+    float color_top[4];
+    float color_bottom[4];
+    float size[2];
+    // of the corners, in the order of the rect vertexes of StaticGeometry
+    float tex_coords[4][2];
+    float mode;
+};
+
+// the uniforms of one waveform program draw. see WaveformTexture.
+struct GuiWaveformDraw {
+    GLuint texture_id;
+    glm::mat4 mvp;
+    glm::vec2 size;
+    int peaks_width;
+    int channel_count;
+    int first_level;
+    int level_count;
+    int level_offsets[WAVEFORM_PEAKS_MAX_LEVELS];
+    int level_peak_counts[WAVEFORM_PEAKS_MAX_LEVELS];
+    float start_frame;
+    float frames_per_pixel;
+    glm::vec4 color;
+    glm::vec4 rms_color;
+};
+
+enum GuiDrawCommandType {
+    // count quads from first, sampling texture_id
+    GuiDrawCommandQuads,
+    // clip to x, y, w, h in window pixels from the top left
+    GuiDrawCommandScissor,
+    GuiDrawCommandNoScissor,
+    // the waveform at first
+    GuiDrawCommandWaveform,
+    // draw into the texture of the draw cache at slot, which covers x, y,
+    // w, h of the window, until GuiDrawCommandCacheEnd
+    GuiDrawCommandCacheBegin,
+    GuiDrawCommandCacheEnd,
+    // the quad at first, sampling the texture of the draw cache at slot
+    GuiDrawCommandCache,
+};
+
+struct GuiDrawCommand {
+    GuiDrawCommandType type;
+    GLuint texture_id;
+    int first;
+    int count;
+    int x;
+    int y;
+    int w;
+    int h;
+    int slot;
+};
+
+// one frame of a window. the main thread records it from the widgets and
+// the window thread draws it, reading nothing else of the gui.
+struct GuiDrawList {
+    int width;
+    int height;
+    List<GuiQuad> quads;
+    List<GuiWaveformDraw> waveforms;
+    List<GuiDrawCommand> commands;
+    // whether it draws into any draw cache
+    bool renders_caches;
+
+    void clear() {
+        quads.clear();
+        waveforms.clear();
+        commands.clear();
+        renders_caches = false;
+    }
+};
+
+// main thread. see Widget::set_draw_cached.
+struct GuiDrawCache {
+    // of the texture, in the window thread's GuiWindow::_cache_targets
+    int slot;
+    bool dirty;
+    // the frame it was last drawn in, and what its texture was drawn for
+    long frame;
+    int epoch;
+    int left;
+    int top;
+    int width;
+    int height;
+    int window_width;
+    int window_height;
+};
+
+// window thread. the texture of a draw cache, and its framebuffer.
+struct GuiCacheTarget {
+    GLuint framebuffer;
+    GLuint texture_id;
+    int width;
+    int height;
+    // by the frame being rendered. the others are deleted after it.
+    bool used;
+};
 
 class GuiWindow {
 public:
     GuiWindow(Gui *gui, bool is_normal_window, int left, int top, int width, int height);
     ~GuiWindow();
 
-    void draw();
+    // main thread. records a frame from the widgets if one is queued and
+    // the window thread has taken the last one.
+    void record_frame();
+    // window thread. draws the frame last recorded, if there is a new one.
+    void render_frame();
+    // main thread. call when anything in the window looks different.
+    void queue_redraw();
 
     void remove_widget(Widget *widget);
     void set_focus_widget(Widget *widget);
@@ -43,11 +162,34 @@ public:
     void draw_image(const SpritesheetImage *img, int x, int y, int w, int h);
     void fill_rect_gradient(const glm::vec4 &top_color, const glm::vec4 &bottom_color, const glm::mat4 &mvp);
 
+    // widgets draw by recording into the window's draw list. quads are
+    // drawn in order, one instanced draw for each run of quads that sample
+    // the same texture. the quad is width by height before mvp.
+    void draw_quad(GuiQuadMode mode, GLuint texture_id, const glm::mat4 &mvp,
+            float width, float height, const float tex_coords[4][2],
+            const glm::vec4 &color_top, const glm::vec4 &color_bottom);
+    // ends the run of quads
+    void flush_quads();
+    // clips what is drawn after to the rect, in window pixels, until the
+    // next call
+    void set_scissor(int x, int y, int w, int h);
+    void clear_scissor();
+    void draw_waveform(const GuiWaveformDraw &waveform);
+    // draws the widget, through its draw cache if it has one
+    void draw_widget(Widget *widget, const glm::mat4 &projection);
+
+    GuiDrawCache *create_draw_cache();
+    void destroy_draw_cache(GuiDrawCache *cache);
+    // every cached widget draws again, such as after glyphs came in
+    void invalidate_draw_caches();
+
     void set_clipboard_string(const String &str);
     String get_clipboard_string() const;
     bool clipboard_has_string() const;
 
     void set_main_widget(Widget *widget);
+    // the frame stats overlay
+    void set_stats_visible(bool visible);
     // coords are the rectangle that originated the menu. you might only need left and top.
     ContextMenuWidget * pop_context_menu(MenuWidgetItem *menu_widget_item, int left, int top, int width, int height);
     void refresh_context_menu();
@@ -61,6 +203,33 @@ public:
     Gui *gui;
     GLFWwindow *window;
     GLuint vertex_array_object;
+    GLuint quad_instance_buffer;
+
+    // three lists, so that neither thread waits on the other. the main
+    // thread records into _back_draw_list and swaps it into
+    // _ready_draw_list, setting DRAW_LIST_FRESH. the window thread swaps a
+    // fresh one out for _front_draw_list.
+    GuiDrawList _draw_lists[3];
+    GuiDrawList *_back_draw_list;
+    GuiDrawList *_front_draw_list;
+    atomic_uintptr_t _ready_draw_list;
+    // the run of quads being recorded, or -1, and the texture it samples.
+    // 0 while none of them sample one.
+    int _quads_command;
+    GLuint _quads_texture_id;
+    // of the window thread. only sleeping on these takes a lock.
+    OsMutex *_frame_mutex;
+    OsCond *_frame_cond;
+    int _viewport_width;
+    int _viewport_height;
+    List<GuiCacheTarget> _cache_targets;
+    // main thread. the frames recorded, the slots of destroyed caches, and
+    // the cache being drawn into, if any.
+    long _frame_index;
+    int _cache_slot_count;
+    List<int> _free_cache_slots;
+    int _draw_cache_epoch;
+    GuiDrawCache *_recording_cache;
 
     // pixels
     int _width;
@@ -89,12 +258,24 @@ public:
 
     OsThread *thread;
     atomic_bool running;
-    atomic_bool viewport_update_queued;
+    // how long the window thread took to issue its last frame
+    atomic_long render_microseconds;
+    // main thread
+    bool redraw_queued;
+    // the widgets input reaches may look different after it
+    bool _input_redraw_queued;
+
+    // of the frames this window has recorded
+    double fps;
+    double _last_draw_time;
 
     Widget *main_widget;
+    GuiStatsWidget *stats_widget;
     ContextMenuWidget *context_menu;
 
     void layout_main_widget();
+    void queue_input_redraw();
+    void dirty_input_draw_caches();
     int get_modifiers();
     void on_mouse_move(const MouseEvent *event);
 
@@ -0,0 +1,417 @@
+#include "job_system.hpp"
+#include "atomics.hpp"
+
+static const int JOB_PRIORITY_COUNT = JobPriorityLow + 1;
+
+enum JobState {
+    // for its dependencies
+    JobStateWaiting,
+    JobStateQueued,
+    JobStateRunning,
+    JobStateDone,
+    JobStateCancelled,
+};
+
+struct JobQueue {
+    Job *first;
+    Job *last;
+};
+
+// everything but the atomics is guarded by the job system's mutex
+struct Job {
+    JobSystem *job_system;
+    // until the job is finished
+    JobGroup *group;
+    JobPriority priority;
+    void (*run)(Job *job, void *userdata);
+    void *userdata;
+    JobState state;
+    int pending_dependency_count;
+    // each holds a reference to the job it depends on this one for
+    List<Job *> dependents;
+    // in the group's unfinished_jobs
+    int group_index;
+    // in its queue while queued
+    Job *prev;
+    Job *next;
+    // the job system has one until the job is finished
+    int ref_count;
+    atomic_bool cancel_requested;
+    std::atomic<float> progress;
+};
+
+struct JobGroup {
+    JobSystem *job_system;
+    EventDispatcher *events;
+    Event progress_event;
+    List<Job *> unfinished_jobs;
+    int finished_count;
+    int total_count;
+    atomic_bool progress_changed;
+};
+
+struct JobSystem {
+    const OsThreadAttributes *attributes;
+    int max_thread_count;
+    OsMutex *mutex;
+    // the threads wait for work on work_cond, and job_group_wait for jobs
+    // to finish on done_cond
+    OsCond *work_cond;
+    OsCond *done_cond;
+    JobQueue queues[JOB_PRIORITY_COUNT];
+    OsThread **threads;
+    int thread_count;
+    bool exit;
+    int group_count;
+};
+
+// the mutex must be locked for all of these
+
+static void enqueue_job(JobSystem *job_system, Job *job) {
+    JobQueue *queue = &job_system->queues[job->priority];
+    job->state = JobStateQueued;
+    job->prev = queue->last;
+    job->next = nullptr;
+    if (queue->last)
+        queue->last->next = job;
+    else
+        queue->first = job;
+    queue->last = job;
+    os_cond_signal(job_system->work_cond, job_system->mutex);
+}
+
+static void unqueue_job(JobSystem *job_system, Job *job) {
+    JobQueue *queue = &job_system->queues[job->priority];
+    if (job->prev)
+        job->prev->next = job->next;
+    else
+        queue->first = job->next;
+    if (job->next)
+        job->next->prev = job->prev;
+    else
+        queue->last = job->prev;
+    job->prev = nullptr;
+    job->next = nullptr;
+}
+
+static Job *dequeue_job(JobSystem *job_system) {
+    for (int i = 0; i < JOB_PRIORITY_COUNT; i += 1) {
+        Job *job = job_system->queues[i].first;
+        if (job) {
+            unqueue_job(job_system, job);
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+static void release_job(Job *job) {
+    assert(job->ref_count > 0);
+    job->ref_count -= 1;
+    if (job->ref_count == 0)
+        destroy(job, 1);
+}
+
+// state is JobStateDone or JobStateCancelled. the jobs depending on a
+// cancelled one are cancelled with it.
+static void finish_job(JobSystem *job_system, Job *job, JobState state) {
+    job->state = state;
+    if (state == JobStateCancelled)
+        job->cancel_requested = true;
+
+    JobGroup *group = job->group;
+    group->unfinished_jobs.swap_remove(job->group_index);
+    if (job->group_index < group->unfinished_jobs.length())
+        group->unfinished_jobs.at(job->group_index)->group_index = job->group_index;
+    group->finished_count += 1;
+    group->progress_changed = true;
+    job->group = nullptr;
+
+    for (int i = 0; i < job->dependents.length(); i += 1) {
+        Job *dependent = job->dependents.at(i);
+        if (dependent->state == JobStateWaiting) {
+            if (state == JobStateCancelled)
+                finish_job(job_system, dependent, JobStateCancelled);
+            else if (--dependent->pending_dependency_count == 0)
+                enqueue_job(job_system, dependent);
+        }
+        release_job(dependent);
+    }
+    job->dependents.clear();
+
+    os_cond_broadcast(job_system->done_cond, job_system->mutex);
+    release_job(job);
+}
+
+static void cancel_job(JobSystem *job_system, Job *job) {
+    switch (job->state) {
+        case JobStateWaiting:
+            finish_job(job_system, job, JobStateCancelled);
+            break;
+        case JobStateQueued:
+            unqueue_job(job_system, job);
+            finish_job(job_system, job, JobStateCancelled);
+            break;
+        case JobStateRunning:
+            job->cancel_requested = true;
+            break;
+        case JobStateDone:
+        case JobStateCancelled:
+            break;
+    }
+}
+
+static void job_thread_run(void *userdata) {
+    JobSystem *job_system = (JobSystem *)userdata;
+    os_mutex_lock(job_system->mutex);
+    while (!job_system->exit) {
+        Job *job = dequeue_job(job_system);
+        if (!job) {
+            os_cond_wait(job_system->work_cond, job_system->mutex);
+            continue;
+        }
+        job->state = JobStateRunning;
+        os_mutex_unlock(job_system->mutex);
+
+        job->run(job, job->userdata);
+
+        os_mutex_lock(job_system->mutex);
+        // a job which was cancelled while it ran may have stopped short, so
+        // nothing that depends on it runs
+        finish_job(job_system, job, job->cancel_requested.load() ? JobStateCancelled : JobStateDone);
+    }
+    os_mutex_unlock(job_system->mutex);
+}
+
+// the mutex must be locked. keeps whatever threads could be started.
+static int start_threads(JobSystem *job_system) {
+    if (job_system->threads)
+        return 0;
+    int thread_count = job_system->max_thread_count;
+    uint64_t cpu_mask = job_system->attributes->cpu_mask;
+    if (cpu_mask)
+        thread_count = min(thread_count, __builtin_popcountll(cpu_mask));
+    thread_count = max(1, thread_count);
+    if (!(job_system->threads = allocate_zero<OsThread *>(thread_count)))
+        return GenesisErrorNoMem;
+    int err = 0;
+    for (; job_system->thread_count < thread_count; job_system->thread_count += 1) {
+        OsThread **thread = &job_system->threads[job_system->thread_count];
+        if ((err = os_thread_create_with_attributes(job_thread_run, job_system,
+                        job_system->attributes, thread)))
+        {
+            break;
+        }
+    }
+    if (job_system->thread_count > 0)
+        return 0;
+    destroy(job_system->threads, thread_count);
+    job_system->threads = nullptr;
+    return err;
+}
+
+int job_system_create(const OsThreadAttributes *attributes, int max_thread_count,
+        JobSystem **out_job_system)
+{
+    *out_job_system = nullptr;
+    if (max_thread_count < 1)
+        return GenesisErrorInvalidParam;
+    JobSystem *job_system = create_zero<JobSystem>();
+    if (!job_system)
+        return GenesisErrorNoMem;
+    job_system->attributes = attributes;
+    job_system->max_thread_count = max_thread_count;
+    if (!(job_system->mutex = os_mutex_create()) ||
+        !(job_system->work_cond = os_cond_create()) ||
+        !(job_system->done_cond = os_cond_create()))
+    {
+        job_system_destroy(job_system);
+        return GenesisErrorNoMem;
+    }
+    *out_job_system = job_system;
+    return 0;
+}
+
+void job_system_destroy(JobSystem *job_system) {
+    if (!job_system)
+        return;
+    assert(job_system->group_count == 0);
+    if (job_system->threads) {
+        {
+            OsMutexLocker locker(job_system->mutex);
+            job_system->exit = true;
+            os_cond_broadcast(job_system->work_cond, job_system->mutex);
+        }
+        for (int i = 0; i < job_system->thread_count; i += 1)
+            os_thread_destroy(job_system->threads[i]);
+        destroy(job_system->threads, job_system->thread_count);
+    }
+    if (job_system->done_cond)
+        os_cond_destroy(job_system->done_cond);
+    if (job_system->work_cond)
+        os_cond_destroy(job_system->work_cond);
+    if (job_system->mutex)
+        os_mutex_destroy(job_system->mutex);
+    destroy(job_system, 1);
+}
+
+int job_system_thread_count(JobSystem *job_system) {
+    return job_system->max_thread_count;
+}
+
+int job_group_create(JobSystem *job_system, EventDispatcher *events, Event progress_event,
+        JobGroup **out_group)
+{
+    *out_group = nullptr;
+    JobGroup *group = create_zero<JobGroup>();
+    if (!group)
+        return GenesisErrorNoMem;
+    group->job_system = job_system;
+    group->events = events;
+    group->progress_event = progress_event;
+    OsMutexLocker locker(job_system->mutex);
+    job_system->group_count += 1;
+    *out_group = group;
+    return 0;
+}
+
+void job_group_destroy(JobGroup *group) {
+    if (!group)
+        return;
+    JobSystem *job_system = group->job_system;
+    job_group_cancel(group);
+    job_group_wait(group);
+    {
+        OsMutexLocker locker(job_system->mutex);
+        job_system->group_count -= 1;
+    }
+    destroy(group, 1);
+}
+
+void job_group_cancel(JobGroup *group) {
+    JobSystem *job_system = group->job_system;
+    OsMutexLocker locker(job_system->mutex);
+    // cancelling a job takes it, and maybe others, out of the list. only
+    // running jobs stay, and those come before i.
+    int i = 0;
+    while (i < group->unfinished_jobs.length()) {
+        Job *job = group->unfinished_jobs.at(i);
+        if (job->state == JobStateRunning) {
+            job->cancel_requested = true;
+            i += 1;
+        } else {
+            cancel_job(job_system, job);
+        }
+    }
+}
+
+void job_group_wait(JobGroup *group) {
+    JobSystem *job_system = group->job_system;
+    OsMutexLocker locker(job_system->mutex);
+    while (group->unfinished_jobs.length() > 0)
+        os_cond_wait(job_system->done_cond, job_system->mutex);
+}
+
+void job_group_flush_events(JobGroup *group) {
+    if (group->events && group->progress_changed.exchange(false))
+        group->events->trigger(group->progress_event);
+}
+
+double job_group_progress(JobGroup *group, int *out_finished_count, int *out_total_count) {
+    OsMutexLocker locker(group->job_system->mutex);
+    double progress = group->finished_count;
+    for (int i = 0; i < group->unfinished_jobs.length(); i += 1) {
+        Job *job = group->unfinished_jobs.at(i);
+        if (job->state == JobStateRunning)
+            progress += clamp(0.0f, job->progress.load(), 1.0f);
+    }
+    *out_finished_count = group->finished_count;
+    *out_total_count = group->total_count;
+    return (group->total_count > 0) ? progress / group->total_count : 1.0;
+}
+
+int job_submit(JobGroup *group, JobPriority priority, void (*run)(Job *job, void *userdata),
+        void *userdata, Job *const *dependencies, int dependency_count, Job **out_job)
+{
+    if (out_job)
+        *out_job = nullptr;
+    JobSystem *job_system = group->job_system;
+    Job *job = create_zero<Job>();
+    if (!job)
+        return GenesisErrorNoMem;
+    job->job_system = job_system;
+    job->group = group;
+    job->priority = priority;
+    job->run = run;
+    job->userdata = userdata;
+    job->state = JobStateWaiting;
+    job->ref_count = 1;
+
+    OsMutexLocker locker(job_system->mutex);
+    int err;
+    if ((err = start_threads(job_system))) {
+        destroy(job, 1);
+        return err;
+    }
+    if (group->unfinished_jobs.length() == 0) {
+        group->finished_count = 0;
+        group->total_count = 0;
+    }
+    if ((err = group->unfinished_jobs.append(job))) {
+        destroy(job, 1);
+        return err;
+    }
+    job->group_index = group->unfinished_jobs.length() - 1;
+    group->total_count += 1;
+
+    bool cancelled = false;
+    for (int i = 0; i < dependency_count; i += 1) {
+        Job *dependency = dependencies[i];
+        if (dependency->state == JobStateDone)
+            continue;
+        if (dependency->state == JobStateCancelled) {
+            cancelled = true;
+            continue;
+        }
+        if ((err = dependency->dependents.append(job))) {
+            finish_job(job_system, job, JobStateCancelled);
+            return err;
+        }
+        job->ref_count += 1;
+        job->pending_dependency_count += 1;
+    }
+
+    if (out_job) {
+        job->ref_count += 1;
+        *out_job = job;
+    }
+    if (cancelled)
+        finish_job(job_system, job, JobStateCancelled);
+    else if (job->pending_dependency_count == 0)
+        enqueue_job(job_system, job);
+    return 0;
+}
+
+void job_release(Job *job) {
+    OsMutexLocker locker(job->job_system->mutex);
+    release_job(job);
+}
+
+void job_cancel(Job *job) {
+    OsMutexLocker locker(job->job_system->mutex);
+    cancel_job(job->job_system, job);
+}
+
+bool job_finished(Job *job) {
+    OsMutexLocker locker(job->job_system->mutex);
+    return job->state == JobStateDone || job->state == JobStateCancelled;
+}
+
+bool job_cancelled(Job *job) {
+    return job->cancel_requested.load();
+}
+
+void job_set_progress(Job *job, float fraction) {
+    job->progress.store(fraction);
+    job->group->progress_changed = true;
+}
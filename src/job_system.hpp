@@ -0,0 +1,75 @@
+#ifndef JOB_SYSTEM_HPP
+#define JOB_SYSTEM_HPP
+
+#include "os.hpp"
+#include "event_dispatcher.hpp"
+
+// a pool of threads shared by all the work that is not realtime, such as
+// decoding, hashing and building peaks, so that each of those does not
+// need threads of its own. a job runs once every job it depends on is done,
+// higher priorities first and in the order submitted within a priority.
+// jobs belong to a group, which is what is cancelled or waited for as a
+// whole, for instance when a project closes. the threads are started with
+// the first job.
+
+enum JobPriority {
+    // work someone is waiting for
+    JobPriorityHigh,
+    JobPriorityNormal,
+    // work nobody waits for, such as filling in caches
+    JobPriorityLow,
+};
+
+struct JobSystem;
+struct JobGroup;
+struct Job;
+
+// the job system of the context, which its users share
+JobSystem *genesis_context_job_system(struct GenesisContext *context);
+
+// attributes is read when the threads start, which are at most
+// max_thread_count, and no more than attributes has CPUs for
+int job_system_create(const OsThreadAttributes *attributes, int max_thread_count,
+        JobSystem **out_job_system);
+// after every group was destroyed
+void job_system_destroy(JobSystem *job_system);
+// the most threads it runs jobs on
+int job_system_thread_count(JobSystem *job_system);
+
+// events may be nullptr. otherwise job_group_flush_events triggers
+// progress_event on it when a job of the group finished or reported
+// progress since the last flush.
+int job_group_create(JobSystem *job_system, EventDispatcher *events, Event progress_event,
+        JobGroup **out_group);
+// cancels the group's jobs and waits for the running ones to return
+void job_group_destroy(JobGroup *group);
+// jobs which have not started never will, and neither will the jobs that
+// depend on them. running jobs see job_cancelled return true.
+void job_group_cancel(JobGroup *group);
+// until every job of the group is done or cancelled. not from one of its
+// jobs.
+void job_group_wait(JobGroup *group);
+// on the thread which owns the group's events
+void job_group_flush_events(JobGroup *group);
+// from 0 to 1, how far the group's jobs have come, counting each job the
+// same. the counts start over when a job is submitted to a group with none
+// left to finish.
+double job_group_progress(JobGroup *group, int *out_finished_count, int *out_total_count);
+
+// run is called on a pool thread once each of dependencies is done. when
+// one was cancelled, so is this job. out_job may be nullptr; otherwise it
+// gets a reference to the job, which is given back with job_release.
+int job_submit(JobGroup *group, JobPriority priority, void (*run)(Job *job, void *userdata),
+        void *userdata, Job *const *dependencies, int dependency_count, Job **out_job);
+void job_release(Job *job);
+// like job_group_cancel for one job. does nothing once it is done.
+void job_cancel(Job *job);
+// whether the job is done, or was cancelled
+bool job_finished(Job *job);
+
+// from a running job. a job which is cancelled should return soon.
+bool job_cancelled(Job *job);
+// fraction is from 0 to 1
+void job_set_progress(Job *job, float fraction);
+
+#endif
@@ -1,115 +1,228 @@
 #include "label.hpp"
 #include "gui.hpp"
+#include "gui_window.hpp"
 #include "debug_gl.hpp"
 
+#include <limits.h>
+
 static void ft_ok(FT_Error err) {
     if (err)
         panic("freetype error");
 }
 
-Label::Label(Gui *gui) :
-    _gui(gui),
-    _width(0),
-    _height(0),
-    _text("")
+static uint32_t hash_layout_key(const String &text, FontSize *font_size) {
+    // FNV 32-bit hash
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < text.length(); i += 1) {
+        h ^= text.at(i);
+        h *= 16777619u;
+    }
+    h ^= (uint32_t)(uintptr_t)font_size;
+    h *= 16777619u;
+    return h;
+}
+
+static int compare_long(long a, long b) {
+    return (a < b) ? -1 : ((a > b) ? 1 : 0);
+}
+
+LabelLayoutCache::LabelLayoutCache(int max_count) :
+    _max_count(max_count),
+    _use_serial(0)
 {
-    set_font_size(12);
+}
 
-    glGenTextures(1, &_texture_id);
-    glBindTexture(GL_TEXTURE_2D, _texture_id);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+LabelLayoutCache::~LabelLayoutCache() {
+    auto it = _layouts.entry_iterator();
+    for (;;) {
+        auto *entry = it.next();
+        if (!entry)
+            break;
+        destroy(entry->value, 1);
+    }
+}
 
-    glGenBuffers(1, &_vertex_buffer);
+bool LabelLayoutCache::get(const String &text, FontSize *font_size, List<LabelLetter> &out_letters,
+        int *out_width, int *out_height)
+{
+    auto *entry = _layouts.maybe_get(hash_layout_key(text, font_size));
+    if (!entry || entry->value->font_size != font_size || !String::equal(entry->value->text, text))
+        return false;
+    Layout *layout = entry->value;
+    layout->last_use = ++_use_serial;
+    ok_or_panic(out_letters.resize(layout->letters.length()));
+    if (layout->letters.length() > 0)
+        memcpy(out_letters.raw(), layout->letters.raw(), layout->letters.length() * sizeof(LabelLetter));
+    *out_width = layout->width;
+    *out_height = layout->height;
+    return true;
+}
 
+void LabelLayoutCache::put(const String &text, FontSize *font_size, const List<LabelLetter> &letters,
+        int width, int height)
+{
+    uint32_t key = hash_layout_key(text, font_size);
+    auto *entry = _layouts.maybe_get(key);
+    Layout *layout;
+    if (entry) {
+        layout = entry->value;
+    } else {
+        if (_layouts.size() >= _max_count)
+            evict();
+        layout = create<Layout>();
+        _layouts.put(key, layout);
+    }
+    layout->text = text;
+    layout->font_size = font_size;
+    ok_or_panic(layout->letters.resize(letters.length()));
+    if (letters.length() > 0)
+        memcpy(layout->letters.raw(), letters.raw(), letters.length() * sizeof(LabelLetter));
+    layout->width = width;
+    layout->height = height;
+    layout->last_use = ++_use_serial;
+}
 
-    // send dummy vertex data - real data happens at update()
-    GLfloat vertexes[4][3] = {
-        {0, 0, 0},
-        {0, 0, 0},
-        {0, 0, 0},
-        {0, 0, 0},
-    };
-    glBindBuffer(GL_ARRAY_BUFFER, _vertex_buffer);
-    glBufferData(GL_ARRAY_BUFFER, 4 * 3 * sizeof(GLfloat), vertexes, GL_DYNAMIC_DRAW);
+// dropping half at once keeps this to once every max_count / 2 misses
+void LabelLayoutCache::evict() {
+    List<long> last_uses;
+    auto it = _layouts.entry_iterator();
+    for (;;) {
+        auto *entry = it.next();
+        if (!entry)
+            break;
+        ok_or_panic(last_uses.append(entry->value->last_use));
+    }
+    last_uses.sort<compare_long>();
+    long oldest_kept = last_uses.at(last_uses.length() / 2);
+
+    List<uint32_t> evicted_keys;
+    it = _layouts.entry_iterator();
+    for (;;) {
+        auto *entry = it.next();
+        if (!entry)
+            break;
+        if (entry->value->last_use < oldest_kept)
+            ok_or_panic(evicted_keys.append(entry->key));
+    }
+    for (int i = 0; i < evicted_keys.length(); i += 1) {
+        destroy(_layouts.get(evicted_keys.at(i)), 1);
+        _layouts.remove(evicted_keys.at(i));
+    }
+}
 
+Label::Label(Gui *gui) :
+    _gui(gui),
+    _width(0),
+    _height(0),
+    _text(""),
+    _font_size(nullptr),
+    _valid_letter_count(-1),
+    _moved_letter_start(0)
+{
+    set_font_size(12);
     update();
 }
 
 Label::~Label() {
-    glDeleteBuffers(1, &_vertex_buffer);
-    glDeleteTextures(1, &_texture_id);
 }
 
-void Label::draw(const glm::mat4 &mvp, const glm::vec4 &color) {
-    if (_text.length() == 0)
-        return;
-
-    _gui->_shader_program_manager._text_shader_program.bind();
-
-    _gui->_shader_program_manager._text_shader_program.set_uniform(
-            _gui->_shader_program_manager._text_uniform_color, color);
-
-    _gui->_shader_program_manager._text_shader_program.set_uniform(
-            _gui->_shader_program_manager._text_uniform_tex, 0);
-
-    _gui->_shader_program_manager._text_shader_program.set_uniform(
-            _gui->_shader_program_manager._text_uniform_mvp, mvp);
-
-    glBindBuffer(GL_ARRAY_BUFFER, _vertex_buffer);
-    glEnableVertexAttribArray(_gui->_shader_program_manager._text_attrib_position);
-    glVertexAttribPointer(_gui->_shader_program_manager._text_attrib_position, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-
-    glBindBuffer(GL_ARRAY_BUFFER, _gui->_static_geometry._rect_2d_tex_coord_buffer);
-    glEnableVertexAttribArray(_gui->_shader_program_manager._text_attrib_tex_coord);
-    glVertexAttribPointer(_gui->_shader_program_manager._text_attrib_tex_coord, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, _texture_id);
-
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+void Label::draw(GuiWindow *window, const glm::mat4 &mvp, const glm::vec4 &color) {
+    draw(window, mvp, color, INT_MIN, INT_MAX);
 }
 
-static void copy_freetype_bitmap(FT_Bitmap source, ByteBuffer &dest,
-        int left, int top, int dest_width)
-{
-    int pitch = source.pitch;
-    if (pitch < 0)
-        panic("flow up unsupported");
-
-    if (source.pixel_mode != FT_PIXEL_MODE_GRAY)
-        panic("only 8-bit grayscale fonts supported");
-
-    for (unsigned int y = 0; y < source.rows; y += 1) {
-        for (unsigned int x = 0; x < source.width; x += 1) {
-            unsigned char alpha = source.buffer[y * pitch + x];
-            int dest_index = (top + y) * dest_width + x + left;
-            if (dest_index >= 0 && dest_index < dest.length())
-                dest.at(dest_index) = alpha;
-        }
+// one quad a glyph, all out of the font size's atlas, so that the text of
+// every label of a size batches with the rest of the window. a glyph can
+// reach past the halfway points around its letter, so a few letters either
+// side of the range are drawn too.
+void Label::draw(GuiWindow *window, const glm::mat4 &mvp, const glm::vec4 &color, int min_x, int max_x) {
+    float atlas_width = _font_size->atlas_width();
+    float atlas_height = _font_size->atlas_height();
+    int slack = _height;
+    min_x = (min_x < INT_MIN + slack) ? INT_MIN : (min_x - slack);
+    max_x = (max_x > INT_MAX - slack) ? INT_MAX : (max_x + slack);
+    // the first letter which ends after min_x
+    int first = 0;
+    int last = _letters.length();
+    while (first < last) {
+        int middle = first + (last - first) / 2;
+        const LabelLetter *letter = &_letters.at(middle);
+        if (letter->left + letter->full_width > min_x)
+            last = middle;
+        else
+            first = middle + 1;
+    }
+    for (int i = first; i < _letters.length(); i += 1) {
+        const LabelLetter *letter = &_letters.at(i);
+        if (letter->left >= max_x)
+            break;
+        if (letter->bitmap_width == 0 || letter->bitmap_height == 0)
+            continue;
+        float u0 = letter->atlas_x / atlas_width;
+        float v0 = letter->atlas_y / atlas_height;
+        float u1 = (letter->atlas_x + letter->bitmap_width) / atlas_width;
+        float v1 = (letter->atlas_y + letter->bitmap_height) / atlas_height;
+        const float tex_coords[4][2] = {
+            {u0, v0},
+            {u0, v1},
+            {u1, v0},
+            {u1, v1},
+        };
+        glm::mat4 letter_mvp = glm::translate(mvp, glm::vec3(
+                    letter->left + letter->bitmap_left, above_size() - letter->bitmap_top, 0.0f));
+        window->draw_quad(GuiQuadModeTextureRed, _font_size->atlas_texture_id(), letter_mvp,
+                letter->bitmap_width, letter->bitmap_height, tex_coords, color, color);
     }
 }
 
+// a whole new text comes from the gui's layout cache when it can. an edit
+// lays out again only what it changed, and is not cached, since the texts
+// in between are seldom seen again.
 void Label::update() {
-    _letters.clear();
+    if (_valid_letter_count == _text.length())
+        return;
+    double start_time = os_get_time();
+    LabelLayoutCache *cache = &_gui->_label_layout_cache;
+    if (_valid_letter_count > 0 || _moved_letter_start < _text.length()) {
+        layout_letters(_valid_letter_count, _moved_letter_start);
+    } else if (cache->get(_text, _font_size, _letters, &_width, &_height)) {
+        _gui->_frame_stats.label_cache_hits += 1;
+    } else {
+        layout_letters(0, _text.length());
+        cache->put(_text, _font_size, _letters, _width, _height);
+    }
+    _valid_letter_count = _text.length();
+    _moved_letter_start = _text.length();
+    _gui->_frame_stats.label_updates += 1;
+    _gui->_frame_stats.text_seconds += os_get_time() - start_time;
+}
+
+// lays out the letters from start to end, and the one after them, whose
+// kerning depends on the letter before it. the letters after that were laid
+// out before, and only move by as much as it did.
+void Label::layout_letters(int start, int end) {
+    ok_or_panic(_letters.resize(_text.length()));
     if (_text.length() == 0) {
         _width = 0;
         _height = above_size() + below_size();
         return;
     }
 
-    // one pass to determine width and height
     // pen position represents the baseline. the char can go lower than it
     float pen_x = 0.0f;
     int previous_glyph_index = 0;
-    float bounding_width = 0.0f;
     float prev_right = 0.0f;
-    for (int i = 0; i < _text.length(); i += 1) {
+    if (start > 0) {
+        LabelLetter *prev_letter = &_letters.at(start - 1);
+        pen_x = prev_letter->pen_x;
+        previous_glyph_index = prev_letter->glyph_index;
+        prev_right = prev_letter->right;
+    }
+    int layout_end = min(end + 1, _text.length());
+    float old_pen_x = (layout_end > end) ? _letters.at(end).pen_x : 0.0f;
+    for (int i = start; i < layout_end; i += 1) {
         uint32_t ch = _text.at(i);
         FontCacheValue entry = _font_size->font_cache_entry(ch);
-        if (_letters.length() > 0) {
+        if (i > 0) {
             FT_Face face = _gui->_default_font_face;
             FT_Vector kerning;
             ft_ok(FT_Get_Kerning(face, previous_glyph_index, entry.glyph_index,
@@ -118,84 +231,82 @@ void Label::update() {
             pen_x += kerning_x;
         }
 
-        float bmp_start_left = (float)entry.bitmap_glyph->left;
-
-        FT_Bitmap bitmap = entry.bitmap_glyph->bitmap;
-        float bmp_width = bitmap.width;
+        float bmp_start_left = (float)entry.bitmap_left;
+        float bmp_width = entry.bitmap_width;
         float left = pen_x + bmp_start_left;
         float right = left + bmp_width;
-        bounding_width = ceilf(right);
 
         int halfway_left = floorf((prev_right + left) / 2.0f);
-        if (_letters.length() > 0) {
-            Letter *prev_letter = &_letters.at(_letters.length() - 1);
+        if (i > 0) {
+            LabelLetter *prev_letter = &_letters.at(i - 1);
             prev_letter->full_width = halfway_left - prev_letter->left;
         }
 
-        ok_or_panic(_letters.append(Letter {
+        previous_glyph_index = entry.glyph_index;
+        prev_right = right;
+        pen_x += entry.advance;
+
+        _letters.at(i) = LabelLetter {
             ch,
 
             halfway_left,
             (int)(left - halfway_left),
             (int)bmp_width,
+            entry.bitmap_height,
             (int)(right - halfway_left),
 
             entry.above_size,
             entry.below_size,
-            entry.bitmap_glyph->top,
-        }));
+            entry.bitmap_top,
 
-        previous_glyph_index = entry.glyph_index;
-        prev_right = right;
-        pen_x += ((float)entry.glyph->advance.x) / 65536.0f;
-    }
+            entry.atlas_x,
+            entry.atlas_y,
 
-    float bounding_height = above_size() + below_size();
-    _width = bounding_width;
-    _height = bounding_height;
-
-    glBindBuffer(GL_ARRAY_BUFFER, _vertex_buffer);
-    GLfloat vertexes[4][3] = {
-        {0.0f, 0.0f, 0.0f},
-        {0.0f, (float)_height, 0.0f},
-        {(float)_width, 0.0f, 0.0f},
-        {(float)_width, (float)_height, 0.0f},
-    };
-    glBufferSubData(GL_ARRAY_BUFFER, 0, 3 * 4 * sizeof(GLfloat), vertexes);
-
-    int img_buf_size =  _width * _height;
-    _img_buffer.resize(img_buf_size);
-    _img_buffer.fill(0);
+            entry.glyph_index,
+            right,
+            pen_x,
+        };
+    }
 
-    // second pass to render bitmap
-    for (int i = 0; i < _letters.length(); i += 1) {
-        Letter *letter = &_letters.at(i);
-        FontCacheValue entry = _font_size->font_cache_entry(letter->codepoint);
-        FT_Bitmap bitmap = entry.bitmap_glyph->bitmap;
-        copy_freetype_bitmap(bitmap, _img_buffer,
-                letter->left + letter->bitmap_left, above_size() - letter->bitmap_top, _width);
+    if (layout_end < _text.length()) {
+        float moved_by = _letters.at(end).pen_x - old_pen_x;
+        for (int i = layout_end; i < _text.length(); i += 1) {
+            LabelLetter *prev_letter = &_letters.at(i - 1);
+            LabelLetter *letter = &_letters.at(i);
+            letter->right += moved_by;
+            letter->pen_x += moved_by;
+            float left = letter->right - letter->bitmap_width;
+            int halfway_left = floorf((prev_letter->right + left) / 2.0f);
+            prev_letter->full_width = halfway_left - prev_letter->left;
+            letter->left = halfway_left;
+            letter->bitmap_left = (int)(left - halfway_left);
+        }
     }
 
-    // send bitmap to GPU
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, _texture_id);
-    glPixelStorei(GL_PACK_ALIGNMENT, 1);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, bounding_width, bounding_height,
-            0, GL_RED, GL_UNSIGNED_BYTE, _img_buffer.raw());
+    // the last letter reaches as far as its bitmap
+    LabelLetter *last_letter = &_letters.last();
+    last_letter->full_width = (int)(last_letter->right - last_letter->left);
 
-    assert_no_gl_error();
+    float bounding_height = above_size() + below_size();
+    _width = ceilf(last_letter->right);
+    _height = bounding_height;
 }
 
 int Label::cursor_at_pos(int x, int y) const {
     if (x < 0)
         return 0;
-    for (int i = 0; i < _letters.length(); i += 1) {
-        const Letter *letter = &_letters.at(i);
-
+    // the first letter whose middle is past x
+    int first = 0;
+    int last = _letters.length();
+    while (first < last) {
+        int middle = first + (last - first) / 2;
+        const LabelLetter *letter = &_letters.at(middle);
         if (x < letter->left + letter->full_width / 2)
-            return i;
+            last = middle;
+        else
+            first = middle + 1;
     }
-    return _letters.length();
+    return first;
 }
 
 void Label::pos_at_cursor(int index, int &x, int &y) const {
@@ -211,30 +322,54 @@ void Label::pos_at_cursor(int index, int &x, int &y) const {
         return;
     }
     if (index >= _letters.length()) {
-        const Letter *letter = &_letters.at(_letters.length() - 1);
+        const LabelLetter *letter = &_letters.at(_letters.length() - 1);
         x = letter->left + letter->full_width;
         return;
     }
-    const Letter *letter = &_letters.at(index);
+    const LabelLetter *letter = &_letters.at(index);
     x = letter->left;
 }
 
 void Label::get_slice_dimensions(int start, int end, int &start_x, int &end_x) const {
     if (end >= _letters.length()) {
-        const Letter *end_letter = &_letters.at(_letters.length() - 1);
+        const LabelLetter *end_letter = &_letters.at(_letters.length() - 1);
         end_x = end_letter->left + end_letter->full_width;
     } else {
-        const Letter *end_letter = &_letters.at(end);
+        const LabelLetter *end_letter = &_letters.at(end);
         end_x = end_letter->left;
     }
-    const Letter *start_letter = &_letters.at(start);
+    const LabelLetter *start_letter = &_letters.at(start);
     start_x = start_letter->left;
 }
 
+// the letters are spliced along with the text, so that those after the
+// edit keep their layout
 void Label::replace_text(int start, int end, String text) {
+    bool laid_out = (_valid_letter_count > 0 || _moved_letter_start < _text.length());
     _text.replace(start, end, text);
+    if (!laid_out) {
+        _valid_letter_count = 0;
+        _moved_letter_start = _text.length();
+        return;
+    }
+    _letters.remove_range(start, end);
+    ok_or_panic(_letters.insert_space(start, text.length()));
+    // what an earlier edit left to lay out again past this one still is
+    int inserted_end = start + text.length();
+    bool earlier_edit = (_valid_letter_count < _moved_letter_start && _moved_letter_start > end);
+    _moved_letter_start = earlier_edit ? (_moved_letter_start + inserted_end - end) : inserted_end;
+    _valid_letter_count = min(_valid_letter_count, start);
+    // after a deletion at the end, the letter left last reaches only as far
+    // as its bitmap
+    if (_valid_letter_count >= _text.length())
+        _valid_letter_count = _text.length() - 1;
 }
 
 void Label::set_font_size(int size) {
-    _font_size = _gui->get_font_size(size);
+    FontSize *font_size = _gui->get_font_size(size);
+    if (font_size != _font_size) {
+        _valid_letter_count = 0;
+        _moved_letter_start = _text.length();
+    }
+    _font_size = font_size;
 }
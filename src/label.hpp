@@ -5,11 +5,72 @@
 #include "string.hpp"
 #include "glm.hpp"
 #include "font_size.hpp"
-#include "glfw.hpp"
+#include "hash_map.hpp"
+#include "list.hpp"
 
 class Gui;
 class GuiWindow;
 
+struct LabelLetter {
+    uint32_t codepoint;
+
+    int left; // half-way between prev letter and this one. 0 for first letter
+    int bitmap_left; // left + bitmap_left is the first pixel of the letter
+    int bitmap_width; // left + bitmap_left + bitmap_width is the last pixel of the letter
+    int bitmap_height;
+    int full_width; // left + full_width is half-way between this letter and next
+
+    int above_size;
+    int below_size;
+    int bitmap_top;
+
+    // where the bitmap is in the font size's atlas
+    int atlas_x;
+    int atlas_y;
+
+    // where the layout was after this letter, to carry on from there
+    uint32_t glyph_index;
+    float right;
+    float pen_x;
+};
+
+// the letters of texts laid out lately, so that labels which show the same
+// text in the same size, such as the same name in several places or a
+// number that comes back, copy them instead of laying them out again. keyed
+// by a hash of the text and the font size; a text whose hash collides with
+// another just takes its place. past max_count layouts the least recently
+// used half is dropped.
+class LabelLayoutCache {
+public:
+    LabelLayoutCache(int max_count);
+    ~LabelLayoutCache();
+
+    // returns false if it is not cached
+    bool get(const String &text, FontSize *font_size, List<LabelLetter> &out_letters,
+            int *out_width, int *out_height);
+    void put(const String &text, FontSize *font_size, const List<LabelLetter> &letters,
+            int width, int height);
+
+private:
+    struct Layout {
+        String text;
+        FontSize *font_size;
+        List<LabelLetter> letters;
+        int width;
+        int height;
+        long last_use;
+    };
+
+    HashMap<uint32_t, Layout *, hash_uint32_t> _layouts;
+    int _max_count;
+    long _use_serial;
+
+    void evict();
+
+    LabelLayoutCache(const LabelLayoutCache &copy) = delete;
+    LabelLayoutCache &operator=(const LabelLayoutCache &copy) = delete;
+};
+
 class Label {
 public:
     Label(Gui *gui);
@@ -18,13 +79,12 @@ public:
     // need to call update() to make it take effect
     void set_text(const String &text) {
         _text = text;
+        _valid_letter_count = 0;
+        _moved_letter_start = _text.length();
     }
     const String &text() const {
         return _text;
     }
-    String &text() {
-        return _text;
-    }
     // need to call update() to make it take effect
     void set_font_size(int size);
 
@@ -38,8 +98,11 @@ public:
         return _height;
     }
 
-    void draw(const glm::mat4 &mvp, const glm::vec4 &color);
+    void draw(GuiWindow *window, const glm::mat4 &mvp, const glm::vec4 &color);
+    // only the letters between min_x and max_x, for text which is clipped
+    void draw(GuiWindow *window, const glm::mat4 &mvp, const glm::vec4 &color, int min_x, int max_x);
 
+    // a binary search over the letters
     int cursor_at_pos(int x, int y) const;
     void pos_at_cursor(int index, int &x, int &y) const;
     void get_slice_dimensions(int start, int end, int &start_x, int &end_x) const;
@@ -52,35 +115,27 @@ public:
         return _font_size->_max_below_size;
     }
 
+    // need to call update() to make it take effect. only the new letters
+    // and the one after them are laid out again; the rest only move.
     void replace_text(int start, int end, String text);
 
 private:
-    struct Letter {
-        uint32_t codepoint;
-
-        int left; // half-way between prev letter and this one. 0 for first letter
-        int bitmap_left; // left + bitmap_left is the first pixel of the letter
-        int bitmap_width; // left + bitmap_left + bitmap_width is the last pixel of the letter
-        int full_width; // left + full_width is half-way between this letter and next
-
-        int above_size;
-        int below_size;
-        int bitmap_top;
-    };
-
     Gui *_gui;
     int _width;
     int _height;
-    GLuint _texture_id;
-    GLuint _vertex_buffer;
 
     String _text;
     FontSize *_font_size;
 
-    ByteBuffer _img_buffer;
+    // cached from _text on update(). the first _valid_letter_count are
+    // still right for _text, and those from _moved_letter_start on only
+    // moved with the edits in front of them; the ones between are laid out
+    // again. -1 before the first update.
+    List<LabelLetter> _letters;
+    int _valid_letter_count;
+    int _moved_letter_start;
 
-    // cached from _text on update()
-    List<Letter> _letters;
+    void layout_letters(int start, int end);
 };
 
 #endif
@@ -129,6 +129,14 @@ public:
         _length = 0;
     }
 
+    // also gives the memory back
+    void clear_and_free() {
+        destroy(_items, _capacity);
+        _items = NULL;
+        _length = 0;
+        _capacity = 0;
+    }
+
     template<int(*Comparator)(T, T)>
     void sort() {
         quick_sort<T, Comparator>(_items, _length);
@@ -176,6 +184,18 @@ public:
         return 0;
     }
 
+    // exactly new_capacity, for when the final length is known up front
+    int __attribute__((warn_unused_result)) reserve(int new_capacity) {
+        if (new_capacity <= _capacity)
+            return 0;
+        T *new_items = reallocate_safe(_items, _capacity, new_capacity);
+        if (!new_items)
+            return GenesisErrorNoMem;
+        _items = new_items;
+        _capacity = new_capacity;
+        return 0;
+    }
+
     int allocated_size() const {
         return _capacity * sizeof(T);
     }
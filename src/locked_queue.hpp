@@ -3,6 +3,7 @@
 
 #include "os.hpp"
 #include "util.hpp"
+#include "list.hpp"
 
 template<typename T>
 class LockedQueue {
@@ -67,6 +68,35 @@ public:
         }
     }
 
+    // waits for at least one item, or for timeout seconds if timeout is not
+    // negative, and then moves every queued item to the end of out.
+    // returns 0 on success, GenesisErrorAborted, or GenesisErrorNoMem, in
+    // which case the items which did not fit stay queued.
+    int shift_all(List<T> &out, double timeout) {
+        OsMutexLocker locker(_mutex);
+
+        double deadline = os_get_time() + timeout;
+        while (!_shutdown && _length <= 0) {
+            if (timeout < 0.0) {
+                os_cond_wait(_cond, _mutex);
+            } else {
+                double remaining = deadline - os_get_time();
+                if (remaining <= 0.0)
+                    return 0;
+                os_cond_timed_wait(_cond, _mutex, remaining);
+            }
+        }
+        if (_shutdown)
+            return GenesisErrorAborted;
+        while (_length > 0) {
+            if (out.append(_items[_start]))
+                return GenesisErrorNoMem;
+            _length -= 1;
+            _start = (_start + 1) % _capacity;
+        }
+        return 0;
+    }
+
     void wakeup_all() {
         OsMutexLocker locker(_mutex);
         _shutdown = true;
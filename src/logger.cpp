@@ -0,0 +1,553 @@
+#include "logger.hpp"
+#include "ring_buffer.hpp"
+#include "atomics.hpp"
+#include "os.hpp"
+#include "util.hpp"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+// threads claim a lane each, and the ones past that share the last lane,
+// taking turns with a spin lock
+static const int LANE_COUNT = 32;
+static const int LANE_BYTES = 64 * 1024;
+static const double DRAIN_INTERVAL = 0.05;
+static const int LINE_SIZE = 1024;
+// flags, width and precision longer than this are written as they are
+static const int MAX_SPEC_SIZE = 24;
+
+enum LogArgType {
+    LogArgTypeInt,
+    LogArgTypeUInt,
+    LogArgTypeDouble,
+    LogArgTypeChar,
+    LogArgTypeText,
+    LogArgTypePointer,
+};
+
+union LogArg {
+    long long i;
+    unsigned long long u;
+    double d;
+    const void *p;
+    // into the record's text, or -1 for an empty string
+    int text_offset;
+};
+
+struct LogRecord {
+    const char *format;
+    uint64_t time; // os_timestamp
+    uint8_t level;
+    uint8_t arg_count;
+    uint8_t arg_types[LOG_MAX_ARG_COUNT];
+    LogArg args[LOG_MAX_ARG_COUNT];
+    char text[LOG_TEXT_SIZE];
+};
+
+struct LogLane {
+    SpscRingBuffer records;
+    atomic_long dropped_count;
+    atomic_bool claimed;
+};
+
+struct Logger {
+    LogLane lanes[LANE_COUNT + 1];
+    atomic_flag shared_lane_lock;
+
+    OsThread *thread;
+    OsMutex *mutex;
+    OsCond *cond;
+    atomic_bool running;
+
+    // with mutex
+    char line[LINE_SIZE];
+};
+
+enum LogLength {
+    LogLengthNone,
+    LogLengthChar,
+    LogLengthShort,
+    LogLengthLong,
+    LogLengthLongLong,
+    LogLengthSize,
+    LogLengthMax,
+    LogLengthPtrdiff,
+    LogLengthLongDouble,
+};
+
+// one conversion of a format, from its '%'
+struct LogSpec {
+    const char *start;
+    // where the length modifier, if any, starts
+    const char *length_start;
+    bool width_star;
+    bool precision_star;
+    LogLength length;
+    // 0 when the format ends first
+    char conversion;
+    const char *end;
+};
+
+static std::atomic<Logger *> the_logger;
+static thread_local LogLane *thread_lane = nullptr;
+static thread_local bool on_drain_thread = false;
+
+static void write_to_stderr(void *, LogLevel, const char *line) {
+    fputs(line, stderr);
+}
+
+// with the logger's mutex once there is a logger
+static LogSink sink = write_to_stderr;
+static void *sink_userdata = nullptr;
+
+static bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static const char *parse_spec(const char *p, LogSpec *spec) {
+    spec->start = p;
+    p += 1;
+    while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0')
+        p += 1;
+    spec->width_star = (*p == '*');
+    if (spec->width_star) {
+        p += 1;
+    } else {
+        while (is_digit(*p))
+            p += 1;
+    }
+    spec->precision_star = false;
+    if (*p == '.') {
+        p += 1;
+        spec->precision_star = (*p == '*');
+        if (spec->precision_star) {
+            p += 1;
+        } else {
+            while (is_digit(*p))
+                p += 1;
+        }
+    }
+    spec->length_start = p;
+    spec->length = LogLengthNone;
+    if (p[0] == 'h' && p[1] == 'h') {
+        spec->length = LogLengthChar;
+        p += 2;
+    } else if (p[0] == 'l' && p[1] == 'l') {
+        spec->length = LogLengthLongLong;
+        p += 2;
+    } else if (*p == 'h') {
+        spec->length = LogLengthShort;
+        p += 1;
+    } else if (*p == 'l') {
+        spec->length = LogLengthLong;
+        p += 1;
+    } else if (*p == 'z') {
+        spec->length = LogLengthSize;
+        p += 1;
+    } else if (*p == 'j') {
+        spec->length = LogLengthMax;
+        p += 1;
+    } else if (*p == 't') {
+        spec->length = LogLengthPtrdiff;
+        p += 1;
+    } else if (*p == 'L') {
+        spec->length = LogLengthLongDouble;
+        p += 1;
+    }
+    spec->conversion = *p;
+    if (*p)
+        p += 1;
+    spec->end = p;
+    return p;
+}
+
+// the type a conversion is kept as, or -1 for the ones which are not
+static int arg_type_for(char conversion) {
+    switch (conversion) {
+        case 'd': case 'i':
+            return LogArgTypeInt;
+        case 'u': case 'o': case 'x': case 'X':
+            return LogArgTypeUInt;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            return LogArgTypeDouble;
+        case 'c':
+            return LogArgTypeChar;
+        case 's':
+            return LogArgTypeText;
+        case 'p':
+            return LogArgTypePointer;
+    }
+    return -1;
+}
+
+static int args_needed(const LogSpec *spec) {
+    return (spec->width_star ? 1 : 0) + (spec->precision_star ? 1 : 0) + 1;
+}
+
+static long long signed_arg(LogLength length, va_list *ap) {
+    switch (length) {
+        case LogLengthChar: return (signed char)va_arg(*ap, int);
+        case LogLengthShort: return (short)va_arg(*ap, int);
+        case LogLengthLong: return va_arg(*ap, long);
+        case LogLengthLongLong: return va_arg(*ap, long long);
+        case LogLengthSize: return va_arg(*ap, ptrdiff_t);
+        case LogLengthMax: return va_arg(*ap, intmax_t);
+        case LogLengthPtrdiff: return va_arg(*ap, ptrdiff_t);
+        default: return va_arg(*ap, int);
+    }
+}
+
+static unsigned long long unsigned_arg(LogLength length, va_list *ap) {
+    switch (length) {
+        case LogLengthChar: return (unsigned char)va_arg(*ap, unsigned int);
+        case LogLengthShort: return (unsigned short)va_arg(*ap, unsigned int);
+        case LogLengthLong: return va_arg(*ap, unsigned long);
+        case LogLengthLongLong: return va_arg(*ap, unsigned long long);
+        case LogLengthSize: return va_arg(*ap, size_t);
+        case LogLengthMax: return va_arg(*ap, uintmax_t);
+        case LogLengthPtrdiff: return va_arg(*ap, ptrdiff_t);
+        default: return va_arg(*ap, unsigned int);
+    }
+}
+
+static void add_int_arg(LogRecord *record, int value) {
+    record->arg_types[record->arg_count] = LogArgTypeInt;
+    record->args[record->arg_count].i = value;
+    record->arg_count += 1;
+}
+
+// takes the arguments out of ap, up to the first conversion which does not
+// fit or is not supported
+static void capture_args(LogRecord *record, va_list *ap) {
+    record->arg_count = 0;
+    int text_used = 0;
+    for (const char *p = record->format; *p;) {
+        if (*p != '%') {
+            p += 1;
+            continue;
+        }
+        if (p[1] == '%') {
+            p += 2;
+            continue;
+        }
+        LogSpec spec;
+        p = parse_spec(p, &spec);
+        int type = arg_type_for(spec.conversion);
+        if (type < 0 || record->arg_count + args_needed(&spec) > LOG_MAX_ARG_COUNT)
+            return;
+        if (spec.width_star)
+            add_int_arg(record, va_arg(*ap, int));
+        if (spec.precision_star)
+            add_int_arg(record, va_arg(*ap, int));
+        LogArg *arg = &record->args[record->arg_count];
+        switch ((LogArgType)type) {
+            case LogArgTypeInt:
+                arg->i = signed_arg(spec.length, ap);
+                break;
+            case LogArgTypeUInt:
+                arg->u = unsigned_arg(spec.length, ap);
+                break;
+            case LogArgTypeDouble:
+                arg->d = (spec.length == LogLengthLongDouble) ? (double)va_arg(*ap, long double) :
+                    va_arg(*ap, double);
+                break;
+            case LogArgTypeChar:
+                arg->i = va_arg(*ap, int);
+                break;
+            case LogArgTypePointer:
+                arg->p = va_arg(*ap, void *);
+                break;
+            case LogArgTypeText:
+                {
+                    const char *str = va_arg(*ap, const char *);
+                    if (!str)
+                        str = "(null)";
+                    if (text_used >= LOG_TEXT_SIZE) {
+                        arg->text_offset = -1;
+                        break;
+                    }
+                    arg->text_offset = text_used;
+                    while (*str && text_used < LOG_TEXT_SIZE - 1) {
+                        record->text[text_used] = *str;
+                        text_used += 1;
+                        str += 1;
+                    }
+                    record->text[text_used] = 0;
+                    text_used += 1;
+                    break;
+                }
+        }
+        record->arg_types[record->arg_count] = type;
+        record->arg_count += 1;
+    }
+}
+
+static void append(char *out, int out_size, int *used, const char *str, int len) {
+    int count = min(len, out_size - 1 - *used);
+    if (count <= 0)
+        return;
+    memcpy(out + *used, str, count);
+    *used += count;
+}
+
+// the conversion as snprintf takes it, with the values of its star
+// arguments in their places, and with the length the argument is kept at
+static void rebuild_spec(const LogSpec *spec, const LogRecord *record, int *arg_index, char *out) {
+    int used = 0;
+    for (const char *p = spec->start; p < spec->length_start; p += 1) {
+        if (*p == '*') {
+            used += snprintf(out + used, MAX_SPEC_SIZE, "%d", (int)record->args[*arg_index].i);
+            *arg_index += 1;
+        } else {
+            out[used++] = *p;
+        }
+    }
+    switch (record->arg_types[*arg_index]) {
+        case LogArgTypeInt:
+        case LogArgTypeUInt:
+            out[used++] = 'l';
+            out[used++] = 'l';
+            break;
+    }
+    out[used++] = spec->conversion;
+    out[used] = 0;
+}
+
+static void format_record(const LogRecord *record, char *out, int out_size) {
+    int used = 0;
+    if (record->level == LogLevelWarning)
+        append(out, out_size, &used, "warning: ", 9);
+    else if (record->level == LogLevelError)
+        append(out, out_size, &used, "error: ", 7);
+
+    int arg_index = 0;
+    const char *p = record->format;
+    while (*p) {
+        const char *next = strchr(p, '%');
+        if (!next) {
+            append(out, out_size, &used, p, strlen(p));
+            break;
+        }
+        append(out, out_size, &used, p, next - p);
+        if (next[1] == '%') {
+            append(out, out_size, &used, "%", 1);
+            p = next + 2;
+            continue;
+        }
+        LogSpec spec;
+        p = parse_spec(next, &spec);
+        if (arg_type_for(spec.conversion) < 0 || arg_index + args_needed(&spec) > record->arg_count ||
+            spec.length_start - spec.start > MAX_SPEC_SIZE)
+        {
+            append(out, out_size, &used, next, strlen(next));
+            break;
+        }
+        char spec_buf[3 * MAX_SPEC_SIZE];
+        rebuild_spec(&spec, record, &arg_index, spec_buf);
+        const LogArg *arg = &record->args[arg_index];
+        char *dest = out + used;
+        int room = out_size - 1 - used;
+        int len = 0;
+        switch (record->arg_types[arg_index]) {
+            case LogArgTypeInt:
+                len = snprintf(dest, room + 1, spec_buf, arg->i);
+                break;
+            case LogArgTypeUInt:
+                len = snprintf(dest, room + 1, spec_buf, arg->u);
+                break;
+            case LogArgTypeDouble:
+                len = snprintf(dest, room + 1, spec_buf, arg->d);
+                break;
+            case LogArgTypeChar:
+                len = snprintf(dest, room + 1, spec_buf, (int)arg->i);
+                break;
+            case LogArgTypeText:
+                len = snprintf(dest, room + 1, spec_buf,
+                        (arg->text_offset >= 0) ? record->text + arg->text_offset : "");
+                break;
+            case LogArgTypePointer:
+                len = snprintf(dest, room + 1, spec_buf, arg->p);
+                break;
+        }
+        used += clamp(0, len, room);
+        arg_index += 1;
+    }
+    append(out, out_size, &used, "\n", 1);
+    out[used] = 0;
+}
+
+// with the logger's mutex
+static void write_dropped(Logger *logger, long dropped_count) {
+    snprintf(logger->line, LINE_SIZE, "warning: %ld log messages dropped\n", dropped_count);
+    sink(sink_userdata, LogLevelWarning, logger->line);
+}
+
+// with the logger's mutex. the lanes are each in order, so they are merged
+// by time.
+static void drain(Logger *logger) {
+    int record_size = sizeof(LogRecord);
+    int counts[LANE_COUNT + 1];
+    int indexes[LANE_COUNT + 1];
+    const LogRecord *records[LANE_COUNT + 1];
+    for (int i = 0; i <= LANE_COUNT; i += 1) {
+        SpscRingBuffer *ring = &logger->lanes[i].records;
+        long dropped_count = logger->lanes[i].dropped_count.exchange(0);
+        if (dropped_count > 0)
+            write_dropped(logger, dropped_count);
+        // asking for all of it makes it look at the writer's offset
+        counts[i] = spsc_ring_buffer_fill_count(ring, ring->capacity) / record_size;
+        indexes[i] = 0;
+        records[i] = (const LogRecord *)spsc_ring_buffer_read_ptr(ring);
+    }
+    for (;;) {
+        int earliest = -1;
+        for (int i = 0; i <= LANE_COUNT; i += 1) {
+            if (indexes[i] < counts[i] &&
+                (earliest < 0 || records[i][indexes[i]].time < records[earliest][indexes[earliest]].time))
+            {
+                earliest = i;
+            }
+        }
+        if (earliest < 0)
+            break;
+        const LogRecord *record = &records[earliest][indexes[earliest]];
+        format_record(record, logger->line, LINE_SIZE);
+        sink(sink_userdata, (LogLevel)record->level, logger->line);
+        indexes[earliest] += 1;
+    }
+    for (int i = 0; i <= LANE_COUNT; i += 1)
+        spsc_ring_buffer_advance_read_ptr(&logger->lanes[i].records, indexes[i] * record_size);
+}
+
+static void drain_thread_run(void *userdata) {
+    Logger *logger = (Logger *)userdata;
+    on_drain_thread = true;
+    os_mutex_lock(logger->mutex);
+    while (logger->running.load()) {
+        os_cond_timed_wait(logger->cond, logger->mutex, DRAIN_INTERVAL);
+        drain(logger);
+    }
+    os_mutex_unlock(logger->mutex);
+}
+
+static void flush_at_exit(void) {
+    log_flush();
+}
+
+// only when log_init fails, before the drain thread runs
+static void logger_destroy(Logger *logger) {
+    os_cond_destroy(logger->cond);
+    os_mutex_destroy(logger->mutex);
+    for (int i = 0; i <= LANE_COUNT; i += 1) {
+        if (logger->lanes[i].records.mem.address)
+            spsc_ring_buffer_deinit(&logger->lanes[i].records);
+    }
+    destroy(logger, 1);
+}
+
+int log_init(void) {
+    if (the_logger.load())
+        return 0;
+    Logger *logger = create_zero<Logger>();
+    if (!logger)
+        return GenesisErrorNoMem;
+    logger->shared_lane_lock.clear();
+    int err;
+    for (int i = 0; i <= LANE_COUNT; i += 1) {
+        if ((err = spsc_ring_buffer_init(&logger->lanes[i].records, LANE_BYTES))) {
+            logger_destroy(logger);
+            return err;
+        }
+    }
+    logger->mutex = os_mutex_create();
+    logger->cond = os_cond_create();
+    if (!logger->mutex || !logger->cond) {
+        logger_destroy(logger);
+        return GenesisErrorNoMem;
+    }
+    logger->running = true;
+    if ((err = os_thread_create(drain_thread_run, logger, false, &logger->thread))) {
+        logger_destroy(logger);
+        return err;
+    }
+    // the logger lives as long as the process
+    the_logger.store(logger);
+    atexit(flush_at_exit);
+    return 0;
+}
+
+static LogLane *claim_lane(Logger *logger) {
+    for (int i = 0; i < LANE_COUNT; i += 1) {
+        bool claimed = false;
+        if (logger->lanes[i].claimed.compare_exchange_strong(claimed, true))
+            return &logger->lanes[i];
+    }
+    return &logger->lanes[LANE_COUNT];
+}
+
+void log_message(LogLevel level, const char *format, ...) {
+    Logger *logger = the_logger.load();
+    va_list ap;
+    if (!logger) {
+        LogRecord record;
+        record.format = format;
+        record.level = level;
+        va_start(ap, format);
+        capture_args(&record, &ap);
+        va_end(ap);
+        char line[LINE_SIZE];
+        format_record(&record, line, LINE_SIZE);
+        sink(sink_userdata, level, line);
+        return;
+    }
+
+    if (!thread_lane)
+        thread_lane = claim_lane(logger);
+    LogLane *lane = thread_lane;
+    bool shared = (lane == &logger->lanes[LANE_COUNT]);
+    if (shared) {
+        while (logger->shared_lane_lock.test_and_set()) {}
+    }
+    int record_size = sizeof(LogRecord);
+    if (spsc_ring_buffer_free_count(&lane->records, record_size) < record_size) {
+        lane->dropped_count += 1;
+    } else {
+        LogRecord *record = (LogRecord *)spsc_ring_buffer_write_ptr(&lane->records);
+        record->format = format;
+        record->time = os_timestamp();
+        record->level = level;
+        va_start(ap, format);
+        capture_args(record, &ap);
+        va_end(ap);
+        spsc_ring_buffer_advance_write_ptr(&lane->records, record_size);
+    }
+    if (shared)
+        logger->shared_lane_lock.clear();
+}
+
+void log_flush(void) {
+    Logger *logger = the_logger.load();
+    if (!logger || on_drain_thread)
+        return;
+    os_mutex_lock(logger->mutex);
+    drain(logger);
+    os_mutex_unlock(logger->mutex);
+}
+
+void log_set_sink(LogSink new_sink, void *userdata) {
+    Logger *logger = the_logger.load();
+    if (logger)
+        os_mutex_lock(logger->mutex);
+    sink = new_sink ? new_sink : write_to_stderr;
+    sink_userdata = userdata;
+    if (logger)
+        os_mutex_unlock(logger->mutex);
+}
+
+void log_release_thread(void) {
+    Logger *logger = the_logger.load();
+    if (logger && thread_lane && thread_lane != &logger->lanes[LANE_COUNT])
+        thread_lane->claimed.store(false);
+    thread_lane = nullptr;
+}
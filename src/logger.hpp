@@ -0,0 +1,47 @@
+#ifndef GENESIS_LOGGER_HPP
+#define GENESIS_LOGGER_HPP
+
+// messages from any thread, the audio and pipeline threads included. a
+// message is not formatted where it is logged: its format string and
+// arguments go into a fixed size record in a single-writer ring buffer of
+// the thread's own, and a drain thread formats and writes the records, in
+// the order they were logged. logging never takes a lock, allocates or
+// waits on I/O, so it is safe where an underrun is not.
+//
+// the format must stay valid for the life of the process, as a string
+// literal does. %s arguments are copied, although only the first
+// LOG_TEXT_SIZE bytes of them all, and at most LOG_MAX_ARG_COUNT
+// arguments are kept; the rest of the format is written as it is. %n is
+// not supported. when a thread's buffer is full its messages are dropped
+// and counted, and the count is written in their place.
+
+enum LogLevel {
+    LogLevelInfo,
+    LogLevelWarning,
+    LogLevelError,
+};
+
+static const int LOG_MAX_ARG_COUNT = 8;
+static const int LOG_TEXT_SIZE = 64;
+
+// os_init starts the drain thread. until then messages are written on the
+// spot.
+int log_init(void);
+
+void log_message(LogLevel level, const char *format, ...)
+    __attribute__ ((format (printf, 2, 3)));
+
+// writes out everything logged before the call. not from a realtime
+// thread. panic calls this, so that what led up to it is seen.
+void log_flush(void);
+
+// where formatted lines go, with their trailing newlines. the default writes
+// them to stderr. called on the drain thread, or in log_flush.
+typedef void (*LogSink)(void *userdata, LogLevel level, const char *line);
+void log_set_sink(LogSink sink, void *userdata);
+
+// gives the calling thread's buffer to the next thread that logs. threads
+// made with os_thread_create do this when they return.
+void log_release_thread(void);
+
+#endif
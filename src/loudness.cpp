@@ -0,0 +1,418 @@
+#include "audio_file.hpp"
+#include "meter.hpp"
+#include "dsp_kernels.hpp"
+#include "atomics.hpp"
+#include "util.hpp"
+
+// loudness as ITU-R BS.1770-4 measures it: each channel goes through the
+// k-weighting filter, a high shelf and then a high pass, and the mean
+// squares of 400 ms blocks which overlap by 75% are gated twice, first at
+// -70 LUFS and then 10 LU below the loudness of the blocks left.
+
+// a block is made of this many segments, each a quarter of a block long
+static const int SEGMENTS_PER_BLOCK = 4;
+static const double segment_seconds = 0.1;
+static const double absolute_gate_lufs = -70.0;
+static const double relative_gate_lu = -10.0;
+// frames measured at a time
+static const int CHUNK_FRAME_COUNT = 256;
+static const int HISTORY_STRIDE = TRUE_PEAK_TAP_COUNT - 1 + CHUNK_FRAME_COUNT;
+
+struct Biquad {
+    double b0, b1, b2;
+    double a1, a2;
+};
+
+struct GenesisLoudnessMeter {
+    int channel_count;
+    double weights[GENESIS_MAX_CHANNELS];
+    Biquad shelf;
+    Biquad high_pass;
+    // transposed direct form II, two for each of the two filters
+    double filter_state[GENESIS_MAX_CHANNELS][4];
+
+    long segment_frame_count;
+    long segment_fill;
+    // weighted sum of the squares of the filtered samples of the segment
+    double segment_sum;
+    // the last SEGMENTS_PER_BLOCK segments, oldest at segment_count
+    double segment_sums[SEGMENTS_PER_BLOCK];
+    long segment_count;
+    // weighted mean square of each block
+    List<double> block_powers;
+
+    float sample_peak[GENESIS_MAX_CHANNELS];
+    float true_peak[GENESIS_MAX_CHANNELS];
+    float filters[TRUE_PEAK_PHASE_COUNT - 1][TRUE_PEAK_TAP_COUNT];
+    // per channel, the last TRUE_PEAK_TAP_COUNT - 1 samples of the chunk
+    // before and then the chunk, HISTORY_STRIDE apart
+    float history[GENESIS_MAX_CHANNELS * HISTORY_STRIDE];
+    long frame_count;
+};
+
+static double channel_weight(SoundIoChannelId id) {
+    switch (id) {
+        case SoundIoChannelIdLfe:
+            return 0.0;
+        case SoundIoChannelIdSideLeft:
+        case SoundIoChannelIdSideRight:
+        case SoundIoChannelIdBackLeft:
+        case SoundIoChannelIdBackRight:
+            return 1.41;
+        default:
+            return 1.0;
+    }
+}
+
+// the coefficients of BS.1770, which are given for 48000 Hz, found again for
+// sample_rate from the analog filters they come from
+static void init_k_weighting(GenesisLoudnessMeter *meter, int sample_rate) {
+    double f0 = 1681.974450955533;
+    double gain_db = 3.999843853973347;
+    double q = 0.7071752369554196;
+
+    double k = tan(M_PI * f0 / sample_rate);
+    double vh = pow(10.0, gain_db / 20.0);
+    double vb = pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    meter->shelf.b0 = (vh + vb * k / q + k * k) / a0;
+    meter->shelf.b1 = 2.0 * (k * k - vh) / a0;
+    meter->shelf.b2 = (vh - vb * k / q + k * k) / a0;
+    meter->shelf.a1 = 2.0 * (k * k - 1.0) / a0;
+    meter->shelf.a2 = (1.0 - k / q + k * k) / a0;
+
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+    k = tan(M_PI * f0 / sample_rate);
+    a0 = 1.0 + k / q + k * k;
+    meter->high_pass.b0 = 1.0;
+    meter->high_pass.b1 = -2.0;
+    meter->high_pass.b2 = 1.0;
+    meter->high_pass.a1 = 2.0 * (k * k - 1.0) / a0;
+    meter->high_pass.a2 = (1.0 - k / q + k * k) / a0;
+}
+
+int genesis_loudness_meter_create(int sample_rate, const SoundIoChannelLayout *channel_layout,
+        GenesisLoudnessMeter **out_meter)
+{
+    *out_meter = nullptr;
+    if (sample_rate <= 0 || channel_layout->channel_count <= 0 ||
+        channel_layout->channel_count > GENESIS_MAX_CHANNELS)
+    {
+        return GenesisErrorInvalidParam;
+    }
+    GenesisLoudnessMeter *meter = create_zero<GenesisLoudnessMeter>();
+    if (!meter)
+        return GenesisErrorNoMem;
+    meter->channel_count = channel_layout->channel_count;
+    for (int ch = 0; ch < meter->channel_count; ch += 1)
+        meter->weights[ch] = channel_weight(channel_layout->channels[ch]);
+    init_k_weighting(meter, sample_rate);
+    true_peak_filters_init(meter->filters);
+    meter->segment_frame_count = max(1L, lround(sample_rate * segment_seconds));
+    *out_meter = meter;
+    return 0;
+}
+
+void genesis_loudness_meter_destroy(GenesisLoudnessMeter *meter) {
+    destroy(meter, 1);
+}
+
+// the sum of the squares of the k-weighted samples
+static double k_weighted_sum_squares(GenesisLoudnessMeter *meter, int channel_index,
+        const float *src, int frame_count)
+{
+    const Biquad &shelf = meter->shelf;
+    const Biquad &high_pass = meter->high_pass;
+    double *state = meter->filter_state[channel_index];
+    double s0 = state[0], s1 = state[1], s2 = state[2], s3 = state[3];
+    double sum = 0.0;
+    for (int i = 0; i < frame_count; i += 1) {
+        double x = src[i];
+        double y = shelf.b0 * x + s0;
+        s0 = shelf.b1 * x - shelf.a1 * y + s1;
+        s1 = shelf.b2 * x - shelf.a2 * y;
+        double z = high_pass.b0 * y + s2;
+        s2 = high_pass.b1 * y - high_pass.a1 * z + s3;
+        s3 = high_pass.b2 * y - high_pass.a2 * z;
+        sum += z * z;
+    }
+    state[0] = s0;
+    state[1] = s1;
+    state[2] = s2;
+    state[3] = s3;
+    return sum;
+}
+
+static void measure_true_peak(GenesisLoudnessMeter *meter, int frame_count) {
+    int channel_count = meter->channel_count;
+    float *history = meter->history;
+    const int keep = TRUE_PEAK_TAP_COUNT - 1;
+    const DspChannelKernels *kernels = dsp_channel_kernels(channel_count);
+    float points[GENESIS_MAX_CHANNELS];
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        for (int phase = 0; phase < TRUE_PEAK_PHASE_COUNT - 1; phase += 1) {
+            kernels->fir_frame(channel_count, points, meter->filters[phase],
+                    history + frame, HISTORY_STRIDE, TRUE_PEAK_TAP_COUNT);
+            for (int ch = 0; ch < channel_count; ch += 1)
+                meter->true_peak[ch] = max(meter->true_peak[ch], fabsf(points[ch]));
+        }
+    }
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        float *channel_history = history + ch * HISTORY_STRIDE;
+        memmove(channel_history, channel_history + frame_count, keep * sizeof(float));
+    }
+}
+
+static void end_segment(GenesisLoudnessMeter *meter) {
+    meter->segment_sums[meter->segment_count % SEGMENTS_PER_BLOCK] = meter->segment_sum;
+    meter->segment_count += 1;
+    meter->segment_sum = 0.0;
+    meter->segment_fill = 0;
+    if (meter->segment_count < SEGMENTS_PER_BLOCK)
+        return;
+    double block_sum = 0.0;
+    for (int i = 0; i < SEGMENTS_PER_BLOCK; i += 1)
+        block_sum += meter->segment_sums[i];
+    double power = block_sum / (SEGMENTS_PER_BLOCK * meter->segment_frame_count);
+    ok_or_panic(meter->block_powers.append(power));
+}
+
+void genesis_loudness_meter_add(GenesisLoudnessMeter *meter, const float *const *channels,
+        int frame_count)
+{
+    const int keep = TRUE_PEAK_TAP_COUNT - 1;
+    int offset = 0;
+    while (offset < frame_count) {
+        int chunk_frame_count = min((long)min(frame_count - offset, CHUNK_FRAME_COUNT),
+                meter->segment_frame_count - meter->segment_fill);
+        float unused_sum_squares = 0.0f;
+        for (int ch = 0; ch < meter->channel_count; ch += 1) {
+            const float *src = channels[ch] + offset;
+            dsp_peak_sum_squares(src, 1, chunk_frame_count, &meter->sample_peak[ch], &unused_sum_squares);
+            if (meter->weights[ch] != 0.0) {
+                meter->segment_sum += meter->weights[ch] *
+                    k_weighted_sum_squares(meter, ch, src, chunk_frame_count);
+            }
+            memcpy(meter->history + ch * HISTORY_STRIDE + keep, src, chunk_frame_count * sizeof(float));
+        }
+        measure_true_peak(meter, chunk_frame_count);
+
+        offset += chunk_frame_count;
+        meter->frame_count += chunk_frame_count;
+        meter->segment_fill += chunk_frame_count;
+        if (meter->segment_fill == meter->segment_frame_count)
+            end_segment(meter);
+    }
+}
+
+static double power_to_lufs(double power) {
+    return -0.691 + 10.0 * log10(power);
+}
+
+static double lufs_to_power(double lufs) {
+    return pow(10.0, (lufs + 0.691) / 10.0);
+}
+
+void genesis_loudness_meter_get(GenesisLoudnessMeter *meter, GenesisLoudness *out_loudness) {
+    out_loudness->channel_count = meter->channel_count;
+    out_loudness->frame_count = meter->frame_count;
+    for (int ch = 0; ch < meter->channel_count; ch += 1) {
+        out_loudness->sample_peak[ch] = meter->sample_peak[ch];
+        // the upsampled points lag by half the taps, so the peaks of the
+        // last few samples only show as samples
+        out_loudness->true_peak[ch] = max(meter->sample_peak[ch], meter->true_peak[ch]);
+    }
+
+    double gate = lufs_to_power(absolute_gate_lufs);
+    for (int pass = 0; pass < 2; pass += 1) {
+        double sum = 0.0;
+        long count = 0;
+        for (int i = 0; i < meter->block_powers.length(); i += 1) {
+            double power = meter->block_powers.at(i);
+            if (power > gate) {
+                sum += power;
+                count += 1;
+            }
+        }
+        if (count == 0) {
+            out_loudness->integrated = -INFINITY;
+            return;
+        }
+        if (pass == 0) {
+            gate = max(gate, sum / count * pow(10.0, relative_gate_lu / 10.0));
+        } else {
+            out_loudness->integrated = power_to_lufs(sum / count);
+        }
+    }
+}
+
+static int measure_decoder(GenesisAudioFile *decoder, GenesisLoudness *out_loudness) {
+    GenesisLoudnessMeter *meter;
+    int err;
+    if ((err = genesis_loudness_meter_create(decoder->sample_rate, &decoder->channel_layout, &meter)))
+        return err;
+    int channel_count = decoder->channel_layout.channel_count;
+    const float *channels[GENESIS_MAX_CHANNELS];
+    for (;;) {
+        long frame_index;
+        bool eof;
+        if ((err = audio_file_decoder_next(decoder, &frame_index, &eof)))
+            break;
+        int frame_count = decoder->channels.at(0).samples.length();
+        for (int ch = 0; ch < channel_count; ch += 1)
+            channels[ch] = decoder->channels.at(ch).samples.raw();
+        genesis_loudness_meter_add(meter, channels, frame_count);
+        for (int ch = 0; ch < channel_count; ch += 1)
+            decoder->channels.at(ch).samples.clear();
+        if (eof)
+            break;
+    }
+    if (!err)
+        genesis_loudness_meter_get(meter, out_loudness);
+    genesis_loudness_meter_destroy(meter);
+    return err;
+}
+
+int genesis_measure_loudness(GenesisContext *context, const char *path, GenesisLoudness *out_loudness) {
+    GenesisAudioFile *decoder = create_zero<GenesisAudioFile>();
+    if (!decoder)
+        return GenesisErrorNoMem;
+    decoder->genesis_context = context;
+    int err = audio_file_decoder_open(decoder, path);
+    if (!err)
+        err = measure_decoder(decoder, out_loudness);
+    genesis_audio_file_destroy(decoder);
+    return err;
+}
+
+int genesis_audio_file_measure_loudness(GenesisAudioFile *audio_file, GenesisLoudness *out_loudness) {
+    if (audio_file->streamed)
+        return genesis_measure_loudness(audio_file->genesis_context, audio_file->path.raw(), out_loudness);
+
+    int err;
+    if (audio_file->progressive && (err = genesis_audio_file_wait_decoded(audio_file)))
+        return err;
+
+    GenesisLoudnessMeter *meter;
+    if ((err = genesis_loudness_meter_create(audio_file->sample_rate, &audio_file->channel_layout, &meter)))
+        return err;
+    GenesisAudioFileReader *reader;
+    if ((err = genesis_audio_file_reader_create(audio_file, &reader))) {
+        genesis_loudness_meter_destroy(meter);
+        return err;
+    }
+    int channel_count = audio_file->channel_layout.channel_count;
+    const float *channels[GENESIS_MAX_CHANNELS];
+    for (;;) {
+        // compact and compressed files come a converted block at a time
+        int frame_count = genesis_audio_file_reader_fill_count(reader);
+        if (frame_count == 0)
+            break;
+        for (int ch = 0; ch < channel_count; ch += 1)
+            channels[ch] = genesis_audio_file_reader_read_ptr(reader, ch);
+        genesis_loudness_meter_add(meter, channels, frame_count);
+        genesis_audio_file_reader_advance_read_ptr(reader, frame_count);
+    }
+    genesis_loudness_meter_get(meter, out_loudness);
+    genesis_audio_file_reader_destroy(reader);
+    genesis_loudness_meter_destroy(meter);
+    return 0;
+}
+
+struct LoudnessBatch {
+    GenesisContext *context;
+    List<ByteBuffer> paths;
+    atomic_int next_index;
+    void (*on_file)(void *userdata, const char *path, int err, const GenesisLoudness *loudness);
+    void *userdata;
+};
+
+// the files under dir, depth first. links to directories are not followed,
+// so that a loop of them cannot go on forever.
+static int collect_files(const ByteBuffer &dir, List<ByteBuffer> &out_paths) {
+    List<OsDirEntry *> entries;
+    int err = os_readdir(dir.raw(), entries);
+    if (err == GenesisErrorNotDir)
+        return out_paths.append(dir);
+    if (err)
+        return err;
+    for (int i = 0; i < entries.length() && !err; i += 1) {
+        OsDirEntry *entry = entries.at(i);
+        ByteBuffer path;
+        os_path_join(path, dir, entry->name);
+        if (entry->is_dir && !entry->is_link)
+            err = collect_files(path, out_paths);
+        else if (entry->is_file)
+            err = out_paths.append(path);
+    }
+    for (int i = 0; i < entries.length(); i += 1)
+        os_dir_entry_unref(entries.at(i));
+    return err;
+}
+
+// files vary too much in length to split them up front, so each thread
+// takes the next one as it finishes the last
+static void run_loudness_batch(void *userdata) {
+    LoudnessBatch *batch = (LoudnessBatch *)userdata;
+    for (;;) {
+        int index = batch->next_index.fetch_add(1);
+        if (index >= batch->paths.length())
+            return;
+        const ByteBuffer &path = batch->paths.at(index);
+        GenesisLoudness loudness;
+        int err = genesis_measure_loudness(batch->context, path.raw(), &loudness);
+        batch->on_file(batch->userdata, path.raw(), err, err ? nullptr : &loudness);
+    }
+}
+
+int genesis_measure_loudness_batch(GenesisContext *context, const char *path, int thread_count,
+        void (*on_file)(void *userdata, const char *path, int err, const GenesisLoudness *loudness),
+        void *userdata)
+{
+    if (thread_count < 0)
+        return GenesisErrorInvalidParam;
+
+    LoudnessBatch batch;
+    batch.context = context;
+    batch.next_index.store(0);
+    batch.on_file = on_file;
+    batch.userdata = userdata;
+    int err;
+    if ((err = collect_files(path, batch.paths)))
+        return err;
+    if (batch.paths.length() == 0)
+        return 0;
+
+    if (thread_count == 0)
+        thread_count = os_concurrency();
+    thread_count = max(1, min(thread_count, batch.paths.length()));
+    OsThread **threads = allocate_zero<OsThread *>(thread_count);
+    if (!threads)
+        return GenesisErrorNoMem;
+    // this thread works too, and does all of it if no others can be made
+    for (int t = 1; t < thread_count; t += 1) {
+        if (os_thread_create(run_loudness_batch, &batch, false, &threads[t]))
+            threads[t] = nullptr;
+    }
+    run_loudness_batch(&batch);
+    for (int t = 1; t < thread_count; t += 1)
+        os_thread_destroy(threads[t]);
+    destroy(threads, thread_count);
+    return 0;
+}
+
+float genesis_loudness_normalization_gain(const GenesisLoudness *loudness, double target_lufs,
+        double true_peak_ceiling_db)
+{
+    if (!isfinite(loudness->integrated))
+        return 1.0f;
+    double gain = pow(10.0, (target_lufs - loudness->integrated) / 20.0);
+    float true_peak = 0.0f;
+    for (int ch = 0; ch < loudness->channel_count; ch += 1)
+        true_peak = max(true_peak, loudness->true_peak[ch]);
+    double ceiling = pow(10.0, true_peak_ceiling_db / 20.0);
+    if (true_peak > 0.0f && gain * true_peak > ceiling)
+        gain = ceiling / true_peak;
+    return gain;
+}
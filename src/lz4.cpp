@@ -0,0 +1,162 @@
+#include "lz4.hpp"
+#include "genesis.h"
+#include "util.hpp"
+
+#include <string.h>
+
+static const int MIN_MATCH = 4;
+static const int MAX_OFFSET = 65535;
+// the format ends every block with at least this many literals, and starts
+// no match in the last MATCH_FIND_LIMIT bytes
+static const int LAST_LITERALS = 5;
+static const int MATCH_FIND_LIMIT = 12;
+static const int HASH_BITS = 12;
+// after this many bytes without a match, the search steps further each time
+static const int SKIP_TRIGGER = 6;
+
+static inline uint32_t read32(const uint8_t *ptr) {
+    uint32_t value;
+    memcpy(&value, ptr, 4);
+    return value;
+}
+
+static inline uint32_t hash4(uint32_t value) {
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+int lz4_compress_bound(int src_size) {
+    return src_size + src_size / 255 + 16;
+}
+
+// the extra bytes of a length of 15 or more
+static uint8_t *write_length(uint8_t *op, int length) {
+    for (; length >= 255; length -= 255)
+        *op++ = 255;
+    *op++ = length;
+    return op;
+}
+
+// writes literal_count literals from anchor and then a match, unless match_length
+// is 0, which ends the block. returns nullptr if it does not fit.
+static uint8_t *write_sequence(uint8_t *op, uint8_t *op_end, const uint8_t *anchor, int literal_count,
+        int offset, int match_length)
+{
+    int worst = 1 + literal_count / 255 + 1 + literal_count + 2 + match_length / 255 + 1;
+    if (worst > op_end - op)
+        return nullptr;
+    uint8_t *token = op++;
+    int match_code = match_length ? match_length - MIN_MATCH : 0;
+    *token = (min(literal_count, 15) << 4) | min(match_code, 15);
+    if (literal_count >= 15)
+        op = write_length(op, literal_count - 15);
+    memcpy(op, anchor, literal_count);
+    op += literal_count;
+    if (!match_length)
+        return op;
+    *op++ = offset & 0xff;
+    *op++ = offset >> 8;
+    if (match_code >= 15)
+        op = write_length(op, match_code - 15);
+    return op;
+}
+
+int lz4_compress(const uint8_t *src, int src_size, uint8_t *dest, int dest_capacity) {
+    // where a 4 byte sequence was last seen. 0 to begin with, which is a
+    // place as good as any, since candidates are checked
+    uint32_t table[1 << HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    uint8_t *op = dest;
+    uint8_t *op_end = dest + dest_capacity;
+    int anchor = 0;
+    int ip = 1;
+    int find_limit = src_size - MATCH_FIND_LIMIT;
+    int match_limit = src_size - LAST_LITERALS;
+    while (ip < find_limit) {
+        uint32_t sequence = read32(src + ip);
+        uint32_t hash = hash4(sequence);
+        int candidate = table[hash];
+        table[hash] = ip;
+        if (ip - candidate > MAX_OFFSET || read32(src + candidate) != sequence) {
+            ip += 1 + ((ip - anchor) >> SKIP_TRIGGER);
+            continue;
+        }
+        // take in whatever the literals end with too
+        while (ip > anchor && candidate > 0 && src[ip - 1] == src[candidate - 1]) {
+            ip -= 1;
+            candidate -= 1;
+        }
+        int match_length = MIN_MATCH;
+        while (ip + match_length < match_limit && src[ip + match_length] == src[candidate + match_length])
+            match_length += 1;
+        if (!(op = write_sequence(op, op_end, src + anchor, ip - anchor, ip - candidate, match_length)))
+            return 0;
+        ip += match_length;
+        anchor = ip;
+        if (ip < find_limit)
+            table[hash4(read32(src + ip - 2))] = ip - 2;
+    }
+    if (!(op = write_sequence(op, op_end, src + anchor, src_size - anchor, 0, 0)))
+        return 0;
+    return op - dest;
+}
+
+// adds the extra bytes of a length to *length. false if src runs out or the
+// length could not fit in limit.
+static bool read_length(const uint8_t **ip, const uint8_t *ip_end, int limit, int *length) {
+    for (;;) {
+        if (*ip >= ip_end)
+            return false;
+        uint8_t byte = *(*ip)++;
+        *length += byte;
+        if (*length > limit)
+            return false;
+        if (byte != 255)
+            return true;
+    }
+}
+
+int lz4_decompress(const uint8_t *src, int src_size, uint8_t *dest, int dest_size) {
+    const uint8_t *ip = src;
+    const uint8_t *ip_end = src + src_size;
+    uint8_t *op = dest;
+    uint8_t *op_end = dest + dest_size;
+    for (;;) {
+        if (ip >= ip_end)
+            return GenesisErrorInvalidFormat;
+        uint8_t token = *ip++;
+        int literal_count = token >> 4;
+        if (literal_count == 15 && !read_length(&ip, ip_end, dest_size, &literal_count))
+            return GenesisErrorInvalidFormat;
+        if (literal_count > ip_end - ip || literal_count > op_end - op)
+            return GenesisErrorInvalidFormat;
+        memcpy(op, ip, literal_count);
+        ip += literal_count;
+        op += literal_count;
+        // the last sequence has no match
+        if (ip == ip_end)
+            return (op == op_end) ? 0 : GenesisErrorInvalidFormat;
+
+        if (ip_end - ip < 2)
+            return GenesisErrorInvalidFormat;
+        int offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op - dest)
+            return GenesisErrorInvalidFormat;
+        int match_length = token & 15;
+        if (match_length == 15 && !read_length(&ip, ip_end, dest_size, &match_length))
+            return GenesisErrorInvalidFormat;
+        match_length += MIN_MATCH;
+        if (match_length > op_end - op)
+            return GenesisErrorInvalidFormat;
+        const uint8_t *match = op - offset;
+        if (offset >= match_length) {
+            memcpy(op, match, match_length);
+            op += match_length;
+        } else {
+            // the match overlaps what it writes, which repeats it
+            for (int i = 0; i < match_length; i += 1)
+                *op++ = *match++;
+        }
+    }
+}
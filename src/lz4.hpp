@@ -0,0 +1,19 @@
+#ifndef GENESIS_LZ4_HPP
+#define GENESIS_LZ4_HPP
+
+#include <stdint.h>
+
+// blocks in the lz4 block format, without the frame around them. the
+// compressor is a plain greedy one, which is fast rather than thorough.
+
+// the most bytes lz4_compress writes for src_size bytes of input
+int lz4_compress_bound(int src_size);
+
+// returns the compressed size, or 0 if it would not fit in dest_capacity
+int lz4_compress(const uint8_t *src, int src_size, uint8_t *dest, int dest_capacity);
+
+// dest_size must be the exact size of the data before compression. returns
+// GenesisErrorInvalidFormat for anything that is not a block of that size.
+int lz4_decompress(const uint8_t *src, int src_size, uint8_t *dest, int dest_size);
+
+#endif
@@ -1,14 +1,40 @@
 #include "os.hpp"
 #include "genesis_editor.hpp"
 #include "error.h"
+#include "dsp_kernels.hpp"
+#include "render_coordinator.hpp"
+
+#include <string.h>
+#include <stdio.h>
 
 int main(int argc, char *argv[]) {
     // If genesis depends on libgenesis then we need this code.
     int err;
     if ((err = os_init(nullptr)))
         panic("unable to initialize: %s", genesis_strerror(err));
+    dsp_kernels_init();
+
+    // a render coordinator started this process to render part of a project
+    if (argc >= 2 && strcmp(argv[1], RENDER_WORKER_ARG) == 0)
+        return render_worker_main(argc - 2, argv + 2);
+
+    const char *stats_path = nullptr;
+    for (int i = 1; i < argc; i += 1) {
+        if (strcmp(argv[i], "--gui-stats") == 0 && i + 1 < argc) {
+            stats_path = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--gui-stats file]\n"
+                    "--gui-stats    append the gui's frame stats to file, as a line of json a frame\n",
+                    argv[0]);
+            return 1;
+        }
+    }
 
     GenesisEditor genesis_editor;
+    if (stats_path) {
+        if ((err = genesis_editor.gui->open_stats_dump(stats_path)))
+            panic("unable to open %s: %s", stats_path, genesis_strerror(err));
+    }
     genesis_editor.exec();
 
     return 0;
@@ -0,0 +1,27 @@
+#ifndef MAPPED_RESOURCES_HPP
+#define MAPPED_RESOURCES_HPP
+
+#include <stdint.h>
+
+// resources written out flat by genesis_pack_textures next to the bundle,
+// which the editor maps rather than reads, so that fonts and textures are
+// used where they lie in the page cache. a header, then entry_count
+// entries, then the data of each starting on a multiple of
+// MAPPED_RESOURCES_ALIGNMENT bytes.
+static const char MAPPED_RESOURCES_MAGIC[4] = {'G', 'R', 'M', 'R'};
+static const int MAPPED_RESOURCES_ALIGNMENT = 64;
+static const int MAPPED_RESOURCE_MAX_KEY_SIZE = 48;
+
+struct MappedResourcesHeader {
+    char magic[4];
+    uint32_t entry_count;
+};
+
+// key is null terminated. offset is from the start of the file.
+struct MappedResourceEntry {
+    char key[MAPPED_RESOURCE_MAX_KEY_SIZE];
+    uint64_t offset;
+    uint64_t size;
+};
+
+#endif
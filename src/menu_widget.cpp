@@ -156,6 +156,7 @@ ContextMenuWidget::~ContextMenuWidget() {
 }
 
 void ContextMenuWidget::update_model() {
+    queue_redraw();
     calculated_width = 0;
     int next_top = padding_top;
     for (int i = 0; i < menu_widget_item->children.length(); i += 1) {
@@ -235,13 +236,13 @@ void ContextMenuWidget::draw(const glm::mat4 &projection) {
         if (child->icon)
             gui->draw_image_color(gui_window, child->icon, projection * child->icon_model, text_color);
 
-        child->label.draw(projection * child->label_model, this_text_color);
+        child->label.draw(gui_window, projection * child->label_model, this_text_color);
         if (child->children.length() > 0) {
             gui->draw_image_color(gui_window, gui->img_caret_right,
                     projection * child->expand_arrow_model, this_text_color);
         } else if (!null_key_sequence(child->shortcut)) {
             glm::mat4 shortcut_label_mvp = projection * child->shortcut_label_model;
-            child->shortcut_label.draw(shortcut_label_mvp, this_text_color);
+            child->shortcut_label.draw(gui_window, shortcut_label_mvp, this_text_color);
         }
 
         if (child->mnemonic_index >= 0) {
@@ -485,7 +486,7 @@ void MenuWidget::draw(const glm::mat4 &projection) {
                     left + child->left, top,
                     child->right - child->left, calculated_height);
         }
-        child->item->label.draw(label_mvp, this_text_color);
+        child->item->label.draw(gui_window, label_mvp, this_text_color);
         if (child->item->mnemonic_index >= 0) {
             glm::mat4 mnemonic_mvp = projection * child->item->mnemonic_model;
             gui_window->fill_rect(this_text_color, mnemonic_mvp);
@@ -494,6 +495,7 @@ void MenuWidget::draw(const glm::mat4 &projection) {
 }
 
 void MenuWidget::update_model() {
+    queue_redraw();
     int next_left = 0;
     int max_label_height = 0;
     for (int i = 0; i < children.length(); i += 1) {
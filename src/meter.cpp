@@ -0,0 +1,282 @@
+#include "meter.hpp"
+#include "dsp_kernels.hpp"
+#include "atomic_double.hpp"
+
+// frames measured at a time
+static const int CHUNK_FRAME_COUNT = 256;
+static const int HISTORY_STRIDE = TRUE_PEAK_TAP_COUNT - 1 + CHUNK_FRAME_COUNT;
+
+struct MeterContext {
+    int channel_count;
+    // per channel, the last TRUE_PEAK_TAP_COUNT - 1 samples of the chunk
+    // before and then the chunk, HISTORY_STRIDE apart
+    float *history;
+    int history_capacity;
+    // the history holds nothing but zeros
+    bool history_silent;
+    float filters[TRUE_PEAK_PHASE_COUNT - 1][TRUE_PEAK_TAP_COUNT];
+
+    // audio thread only. since the levels the reader last took.
+    float peak[GENESIS_MAX_CHANNELS];
+    float true_peak[GENESIS_MAX_CHANNELS];
+    double sum_squares[GENESIS_MAX_CHANNELS];
+    long frame_count;
+
+    // the levels above as of the end of the last run, behind a sequence
+    // lock: the audio thread makes sequence odd, writes them and makes it
+    // even again, and the reader tries again if it changed under it. the
+    // audio thread never waits.
+    atomic<unsigned> sequence;
+    atomic_int published_channel_count;
+    atomic<float> published_peak[GENESIS_MAX_CHANNELS];
+    atomic<float> published_true_peak[GENESIS_MAX_CHANNELS];
+    atomic<float> published_rms[GENESIS_MAX_CHANNELS];
+    atomic_long published_frame_count;
+    // the sequence of the last levels the reader took. the audio thread
+    // starts over once nothing it published since is left unread.
+    atomic<unsigned> read_sequence;
+};
+
+static void meter_destroy(struct GenesisNode *node) {
+    struct MeterContext *meter_context = (struct MeterContext *)node->userdata;
+    if (meter_context) {
+        destroy(meter_context->history, meter_context->history_capacity);
+        destroy(meter_context, 1);
+    }
+}
+
+// phase p lands p quarters of a sample after the middle of the window
+void true_peak_filters_init(float filters[TRUE_PEAK_PHASE_COUNT - 1][TRUE_PEAK_TAP_COUNT]) {
+    double half_width = TRUE_PEAK_TAP_COUNT / 2;
+    for (int phase = 1; phase < TRUE_PEAK_PHASE_COUNT; phase += 1) {
+        float *filter = filters[phase - 1];
+        double center = half_width - 1.0 + phase / (double)TRUE_PEAK_PHASE_COUNT;
+        double sum = 0.0;
+        for (int k = 0; k < TRUE_PEAK_TAP_COUNT; k += 1) {
+            double x = k - center;
+            double sinc = sin(M_PI * x) / (M_PI * x);
+            double window = 0.5 * (1.0 + cos(M_PI * x / half_width));
+            filter[k] = sinc * window;
+            sum += filter[k];
+        }
+        for (int k = 0; k < TRUE_PEAK_TAP_COUNT; k += 1)
+            filter[k] /= sum;
+    }
+}
+
+static int meter_create(struct GenesisNode *node) {
+    struct MeterContext *meter_context = create_zero<MeterContext>();
+    node->userdata = meter_context;
+    if (!meter_context) {
+        meter_destroy(node);
+        return GenesisErrorNoMem;
+    }
+    true_peak_filters_init(meter_context->filters);
+    meter_context->history_silent = true;
+    return 0;
+}
+
+static int meter_activate(struct GenesisNode *node) {
+    struct MeterContext *meter_context = (struct MeterContext *)node->userdata;
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    int channel_count = genesis_audio_port_channel_layout(audio_in_port)->channel_count;
+    int new_capacity = channel_count * HISTORY_STRIDE;
+    if (new_capacity != meter_context->history_capacity) {
+        float *new_history = reallocate_safe<float>(meter_context->history,
+                meter_context->history_capacity, new_capacity);
+        if (!new_history)
+            return GenesisErrorNoMem;
+        meter_context->history = new_history;
+        meter_context->history_capacity = new_capacity;
+        memset(meter_context->history, 0, new_capacity * sizeof(float));
+        meter_context->history_silent = true;
+    }
+    if (channel_count != meter_context->channel_count) {
+        meter_context->channel_count = channel_count;
+        for (int ch = 0; ch < GENESIS_MAX_CHANNELS; ch += 1) {
+            meter_context->peak[ch] = 0.0f;
+            meter_context->true_peak[ch] = 0.0f;
+            meter_context->sum_squares[ch] = 0.0;
+        }
+        meter_context->frame_count = 0;
+    }
+    return 0;
+}
+
+static void meter_seek(struct GenesisNode *node) {
+    struct MeterContext *meter_context = (struct MeterContext *)node->userdata;
+    if (meter_context->history)
+        memset(meter_context->history, 0, meter_context->history_capacity * sizeof(float));
+    meter_context->history_silent = true;
+}
+
+// the upsampled points of the chunk, which lag it by half the taps. a null
+// chunk is silence.
+static void measure_true_peak(MeterContext *meter_context, const float *chunk, int frame_count) {
+    int channel_count = meter_context->channel_count;
+    float *history = meter_context->history;
+    const int keep = TRUE_PEAK_TAP_COUNT - 1;
+    const DspChannelKernels *kernels = dsp_channel_kernels(channel_count);
+    if (chunk) {
+        kernels->deinterleave(channel_count, history + keep, HISTORY_STRIDE, chunk, frame_count);
+    } else {
+        for (int ch = 0; ch < channel_count; ch += 1)
+            memset(history + ch * HISTORY_STRIDE + keep, 0, frame_count * sizeof(float));
+    }
+
+    float points[GENESIS_MAX_CHANNELS];
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        for (int phase = 0; phase < TRUE_PEAK_PHASE_COUNT - 1; phase += 1) {
+            kernels->fir_frame(channel_count, points, meter_context->filters[phase],
+                    history + frame, HISTORY_STRIDE, TRUE_PEAK_TAP_COUNT);
+            for (int ch = 0; ch < channel_count; ch += 1)
+                meter_context->true_peak[ch] = max(meter_context->true_peak[ch], fabsf(points[ch]));
+        }
+    }
+
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        float *channel_history = history + ch * HISTORY_STRIDE;
+        memmove(channel_history, channel_history + frame_count, keep * sizeof(float));
+    }
+}
+
+static void publish_levels(MeterContext *meter_context) {
+    int channel_count = meter_context->channel_count;
+    unsigned sequence = meter_context->sequence.load(std::memory_order_relaxed);
+    meter_context->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    long frame_count = meter_context->frame_count;
+    meter_context->published_channel_count.store(channel_count, std::memory_order_relaxed);
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        float rms = frame_count ? sqrt(meter_context->sum_squares[ch] / frame_count) : 0.0f;
+        meter_context->published_peak[ch].store(meter_context->peak[ch], std::memory_order_relaxed);
+        meter_context->published_true_peak[ch].store(max(meter_context->peak[ch],
+                    meter_context->true_peak[ch]), std::memory_order_relaxed);
+        meter_context->published_rms[ch].store(rms, std::memory_order_relaxed);
+    }
+    meter_context->published_frame_count.store(frame_count, std::memory_order_relaxed);
+    meter_context->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+static void meter_run(struct GenesisNode *node) {
+    struct MeterContext *meter_context = (struct MeterContext *)node->userdata;
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 1);
+
+    int input_frame_count = genesis_audio_in_port_fill_count(audio_in_port);
+    int output_frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    int frame_count = min(input_frame_count, output_frame_count);
+    int channel_count = meter_context->channel_count;
+
+    // the reader has everything published so far
+    if (meter_context->read_sequence.load(std::memory_order_relaxed) ==
+            meter_context->sequence.load(std::memory_order_relaxed))
+    {
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            meter_context->peak[ch] = 0.0f;
+            meter_context->true_peak[ch] = 0.0f;
+            meter_context->sum_squares[ch] = 0.0;
+        }
+        meter_context->frame_count = 0;
+    }
+
+    bool silent_input = genesis_audio_in_port_silent_count(audio_in_port) >= frame_count;
+    if (silent_input) {
+        // only the end of what came before can still show up between samples
+        if (!meter_context->history_silent) {
+            int flush_frame_count = min(frame_count, CHUNK_FRAME_COUNT);
+            measure_true_peak(meter_context, nullptr, flush_frame_count);
+            meter_context->history_silent = flush_frame_count >= TRUE_PEAK_TAP_COUNT - 1;
+        }
+        genesis_audio_out_port_write_silence(audio_out_port, frame_count);
+    } else {
+        float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+        float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+        float sum_squares[GENESIS_MAX_CHANNELS];
+        for (int frame = 0; frame < frame_count; frame += CHUNK_FRAME_COUNT) {
+            int chunk_frame_count = min(frame_count - frame, CHUNK_FRAME_COUNT);
+            const float *chunk = in_buf + frame * channel_count;
+            for (int ch = 0; ch < channel_count; ch += 1)
+                sum_squares[ch] = 0.0f;
+            dsp_peak_sum_squares(chunk, channel_count, chunk_frame_count, meter_context->peak, sum_squares);
+            for (int ch = 0; ch < channel_count; ch += 1)
+                meter_context->sum_squares[ch] += sum_squares[ch];
+            measure_true_peak(meter_context, chunk, chunk_frame_count);
+        }
+        meter_context->history_silent = false;
+        if (out_buf != in_buf)
+            memcpy(out_buf, in_buf, frame_count * channel_count * sizeof(float));
+        genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+    }
+    meter_context->frame_count += frame_count;
+    publish_levels(meter_context);
+
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+}
+
+int genesis_meter_node_read_levels(struct GenesisNode *node, struct GenesisMeterLevels *out_levels) {
+    if (node->descriptor->run != meter_run)
+        return GenesisErrorInvalidParam;
+    struct MeterContext *meter_context = (struct MeterContext *)node->userdata;
+    unsigned sequence;
+    for (;;) {
+        sequence = meter_context->sequence.load(std::memory_order_acquire);
+        if (sequence & 1) {
+            cpu_relax();
+            continue;
+        }
+        int channel_count = meter_context->published_channel_count.load(std::memory_order_relaxed);
+        out_levels->channel_count = channel_count;
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            out_levels->peak[ch] = meter_context->published_peak[ch].load(std::memory_order_relaxed);
+            out_levels->true_peak[ch] = meter_context->published_true_peak[ch].load(std::memory_order_relaxed);
+            out_levels->rms[ch] = meter_context->published_rms[ch].load(std::memory_order_relaxed);
+        }
+        out_levels->frame_count = meter_context->published_frame_count.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (meter_context->sequence.load(std::memory_order_relaxed) == sequence)
+            break;
+    }
+    meter_context->read_sequence.store(sequence, std::memory_order_relaxed);
+    return 0;
+}
+
+int create_meter_descriptor(GenesisPipeline *pipeline) {
+    GenesisNodeDescriptor *node_descr = genesis_create_node_descriptor(pipeline, 2, "meter",
+            "Peak, true peak and RMS meter.");
+    if (!node_descr)
+        return GenesisErrorNoMem;
+
+    genesis_node_descriptor_set_run_callback(node_descr, meter_run);
+    genesis_node_descriptor_set_create_callback(node_descr, meter_create);
+    genesis_node_descriptor_set_destroy_callback(node_descr, meter_destroy);
+    genesis_node_descriptor_set_seek_callback(node_descr, meter_seek);
+    genesis_node_descriptor_set_activate_callback(node_descr, meter_activate);
+
+    struct GenesisPortDescriptor *audio_in_port = genesis_node_descriptor_create_port(
+            node_descr, 0, GenesisPortTypeAudioIn, "audio_in");
+    struct GenesisPortDescriptor *audio_out_port = genesis_node_descriptor_create_port(
+            node_descr, 1, GenesisPortTypeAudioOut, "audio_out");
+
+    if (!audio_in_port || !audio_out_port) {
+        genesis_node_descriptor_destroy(node_descr);
+        return GenesisErrorNoMem;
+    }
+
+    int target_sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+
+    genesis_audio_port_descriptor_set_channel_layout(audio_in_port,
+        soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono), false, -1);
+
+    genesis_audio_port_descriptor_set_sample_rate(audio_in_port, target_sample_rate, false, -1);
+
+    genesis_audio_port_descriptor_set_channel_layout(audio_out_port,
+        soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono), true, 0);
+
+    genesis_audio_port_descriptor_set_sample_rate(audio_out_port, target_sample_rate, true, 0);
+
+    // the output is the input, so in place it is left where it is
+    genesis_audio_port_descriptor_set_in_place(audio_out_port, 0);
+
+    return 0;
+}
@@ -0,0 +1,18 @@
+#ifndef METER_HPP
+#define METER_HPP
+
+#include "genesis.hpp"
+
+// the true peak is the largest magnitude of the signal upsampled 4 times,
+// as ITU-R BS.1770 measures it. the three points between two samples each
+// come from a windowed sinc of this many taps.
+static const int TRUE_PEAK_PHASE_COUNT = 4;
+static const int TRUE_PEAK_TAP_COUNT = 16;
+
+// filters[p - 1] gives the point p quarters of a sample after the middle
+// of TRUE_PEAK_TAP_COUNT samples
+void true_peak_filters_init(float filters[TRUE_PEAK_PHASE_COUNT - 1][TRUE_PEAK_TAP_COUNT]);
+
+int create_meter_descriptor(GenesisPipeline *pipeline);
+
+#endif
@@ -1,11 +1,12 @@
 #include "midi_hardware.hpp"
 #include "util.hpp"
+#include "logger.hpp"
 #include "error.h"
 #include "genesis.hpp"
 #include "limits.h"
 
 static void default_on_buffer_overrun(struct MidiHardware *midi_hardware) {
-    fprintf(stderr, "MIDI buffer overrun\n");
+    log_message(LogLevelWarning, "MIDI buffer overrun");
 }
 
 void genesis_midi_device_unref(struct GenesisMidiDevice *device) {
@@ -142,6 +143,19 @@ static int midi_hardware_refresh(MidiHardware *midi_hardware) {
         }
     }
 
+    ByteBuffer key;
+    key.append_format("%d\n", info->default_device_index);
+    for (int i = 0; i < info->devices.length(); i += 1) {
+        GenesisMidiDevice *device = info->devices.at(i);
+        key.append_format("%d %d %s\n%s\n", device->client_id, device->port_id,
+                device->client_name, device->port_name);
+    }
+    if (ByteBuffer::equal(key, midi_hardware->queued_devices_key)) {
+        destroy_devices_info(info);
+        return 0;
+    }
+    midi_hardware->queued_devices_key = key;
+
     os_mutex_lock(midi_hardware->mutex);
 
     MidiDevicesInfo *old_devices_info = midi_hardware->ready_devices_info;
@@ -156,7 +170,7 @@ static int midi_hardware_refresh(MidiHardware *midi_hardware) {
     return 0;
 }
 
-static void dispatch_event(GenesisMidiDevice *device, snd_seq_event_t *event) {
+static void dispatch_event(GenesisMidiDevice *device, snd_seq_event_t *event, double time) {
     GenesisMidiEvent midi_event;
     switch (event->type) {
         case SND_SEQ_EVENT_NOTEON:
@@ -181,7 +195,7 @@ static void dispatch_event(GenesisMidiDevice *device, snd_seq_event_t *event) {
         default:
             return;
     }
-    device->on_event(device, &midi_event);
+    device->on_event(device, &midi_event, time);
 }
 
 static void midi_thread(void *userdata) {
@@ -189,6 +203,7 @@ static void midi_thread(void *userdata) {
     for (;;) {
         snd_seq_event_t *event;
         int err = snd_seq_event_input(midi_hardware->seq, &event);
+        double time = os_get_time();
         if (midi_hardware->quit_flag)
             return;
         if (err < 0) {
@@ -215,7 +230,7 @@ static void midi_thread(void *userdata) {
                 if (device->client_id == event->source.client &&
                     device->port_id == event->source.port)
                 {
-                    dispatch_event(device, event);
+                    dispatch_event(device, event, time);
                     break;
                 }
             }
@@ -2,6 +2,7 @@
 #define MIDI_CONTROLLER_HPP
 
 #include "list.hpp"
+#include "byte_buffer.hpp"
 #include "os.hpp"
 #include "genesis.h"
 #include "atomics.hpp"
@@ -51,7 +52,9 @@ struct GenesisMidiDevice {
     int ref_count;
     bool open;
     int set_index;
-    void (*on_event)(struct GenesisMidiDevice *, const struct GenesisMidiEvent *);
+    // called on the MIDI thread. time is os_get_time() when the event
+    // arrived; the event's start is not set.
+    void (*on_event)(struct GenesisMidiDevice *, const struct GenesisMidiEvent *, double time);
     void *userdata;
 };
 
@@ -69,6 +72,9 @@ struct MidiHardware {
     MidiDevicesInfo *current_devices_info;
     // created when changes are detected, queued up
     MidiDevicesInfo *ready_devices_info;
+    // only on the MIDI thread. the devices of the last queued up list, so
+    // that an announcement which leaves them as they were is let go.
+    ByteBuffer queued_devices_key;
     GenesisMidiDevice *system_announce_device;
     GenesisMidiDevice *system_timer_device;
 
@@ -0,0 +1,81 @@
+#include "mirrored_memory_pool.hpp"
+
+int mirrored_memory_pool_init(MirroredMemoryPool *pool) {
+    if (!(pool->mutex = os_mutex_create()))
+        return GenesisErrorNoMem;
+    pool->free_bytes = 0;
+    pool->max_free_bytes = MIRRORED_MEMORY_POOL_DEFAULT_MAX_FREE_BYTES;
+    pool->huge_pages = false;
+    pool->hit_count = 0;
+    pool->miss_count = 0;
+    return 0;
+}
+
+void mirrored_memory_pool_deinit(MirroredMemoryPool *pool) {
+    if (!pool->mutex)
+        return;
+    mirrored_memory_pool_trim(pool);
+    os_mutex_destroy(pool->mutex);
+    pool->mutex = nullptr;
+}
+
+static size_t round_to_pages(size_t capacity) {
+    size_t page_size = os_page_size();
+    return (capacity + page_size - 1) / page_size * page_size;
+}
+
+int mirrored_memory_pool_acquire(MirroredMemoryPool *pool, OsMirroredMemory *mem, size_t capacity) {
+    size_t actual_capacity = round_to_pages(capacity);
+    bool huge_pages;
+    {
+        OsMutexLocker locker(pool->mutex);
+        // newest first, since it is the most likely to still be in cache
+        for (int i = pool->free_regions.length() - 1; i >= 0; i -= 1) {
+            if (pool->free_regions.at(i).capacity == actual_capacity) {
+                *mem = pool->free_regions.at(i);
+                pool->free_regions.remove_range(i, i + 1);
+                pool->free_bytes -= actual_capacity;
+                pool->hit_count += 1;
+                return 0;
+            }
+        }
+        pool->miss_count += 1;
+        huge_pages = pool->huge_pages;
+    }
+
+    int err;
+    if ((err = os_init_mirrored_memory(mem, actual_capacity)))
+        return err;
+    if (huge_pages)
+        os_mirrored_memory_advise_huge_pages(mem);
+    return 0;
+}
+
+void mirrored_memory_pool_release(MirroredMemoryPool *pool, OsMirroredMemory *mem) {
+    OsMutexLocker locker(pool->mutex);
+    if (mem->capacity > pool->max_free_bytes || pool->free_regions.append(*mem)) {
+        os_deinit_mirrored_memory(mem);
+        return;
+    }
+    pool->free_bytes += mem->capacity;
+    int evict_count = 0;
+    while (pool->free_bytes > pool->max_free_bytes) {
+        pool->free_bytes -= pool->free_regions.at(evict_count).capacity;
+        os_deinit_mirrored_memory(&pool->free_regions.at(evict_count));
+        evict_count += 1;
+    }
+    pool->free_regions.remove_range(0, evict_count);
+}
+
+void mirrored_memory_pool_trim(MirroredMemoryPool *pool) {
+    OsMutexLocker locker(pool->mutex);
+    for (int i = 0; i < pool->free_regions.length(); i += 1)
+        os_deinit_mirrored_memory(&pool->free_regions.at(i));
+    pool->free_regions.clear();
+    pool->free_bytes = 0;
+}
+
+void mirrored_memory_pool_set_huge_pages(MirroredMemoryPool *pool, bool huge_pages) {
+    OsMutexLocker locker(pool->mutex);
+    pool->huge_pages = huge_pages;
+}
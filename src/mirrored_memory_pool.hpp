@@ -0,0 +1,37 @@
+#ifndef GENESIS_MIRRORED_MEMORY_POOL_HPP
+#define GENESIS_MIRRORED_MEMORY_POOL_HPP
+
+#include "os.hpp"
+#include "list.hpp"
+
+// keeps released mirrored memory mapped so that the next buffer of the same
+// number of pages is taken from here instead of being mapped again. every
+// page count is its own size class; a ring buffer with a block size has to
+// be a whole number of blocks, so a region of another size can not stand in.
+// at most max_free_bytes stay mapped, and the oldest regions go first.
+struct MirroredMemoryPool {
+    OsMutex *mutex;
+    List<OsMirroredMemory> free_regions; // oldest first
+    size_t free_bytes;
+    size_t max_free_bytes;
+    bool huge_pages;
+    long hit_count;
+    long miss_count;
+};
+
+static const size_t MIRRORED_MEMORY_POOL_DEFAULT_MAX_FREE_BYTES = 32 * 1024 * 1024;
+
+int mirrored_memory_pool_init(MirroredMemoryPool *pool);
+// unmaps the free regions. everything taken from the pool must have been
+// released first.
+void mirrored_memory_pool_deinit(MirroredMemoryPool *pool);
+
+int mirrored_memory_pool_acquire(MirroredMemoryPool *pool, OsMirroredMemory *mem, size_t capacity);
+void mirrored_memory_pool_release(MirroredMemoryPool *pool, OsMirroredMemory *mem);
+
+// unmaps every free region
+void mirrored_memory_pool_trim(MirroredMemoryPool *pool);
+// applies to regions mapped from now on
+void mirrored_memory_pool_set_huge_pages(MirroredMemoryPool *pool, bool huge_pages);
+
+#endif
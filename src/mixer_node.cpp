@@ -1,11 +1,38 @@
 #include "mixer_node.hpp"
+#include "dsp_kernels.hpp"
+#include "atomic_double.hpp"
+
+#include <math.h>
 
 struct DescriptorContext {
     int input_port_count;
 };
 
+// the gain of each channel follows changes to gain and pan in a straight
+// line over this long, so that they do not click
+static const double RAMP_SECONDS = 0.01;
+
+// above this many inputs a mixer tree has more than one level
+static const int MIXER_TREE_FAN_IN = 16;
+
+static const float zero_gain_steps[GENESIS_MAX_CHANNELS] = {};
+
+struct MixerInput {
+    AtomicDouble gain_param;
+    AtomicDouble pan_param;
+    // the parameters the ramp below goes toward
+    double gain;
+    double pan;
+    float gains[GENESIS_MAX_CHANNELS];
+    float gain_steps[GENESIS_MAX_CHANNELS];
+    float target_gains[GENESIS_MAX_CHANNELS];
+    int ramp_frames_left;
+    bool unity; // every channel gain is exactly 1 and not ramping
+};
+
 struct MixerContext {
     int input_port_count;
+    MixerInput *inputs;
     float **read_ptrs;
 };
 
@@ -14,6 +41,8 @@ static void mixer_destroy(struct GenesisNode *node) {
     if (mixer_context) {
         if (mixer_context->read_ptrs)
             destroy(mixer_context->read_ptrs, mixer_context->input_port_count);
+        if (mixer_context->inputs)
+            destroy(mixer_context->inputs, mixer_context->input_port_count);
         destroy(mixer_context, 1);
     }
 }
@@ -41,10 +70,98 @@ static int mixer_create(struct GenesisNode *node) {
         mixer_destroy(node);
         return GenesisErrorNoMem;
     }
+    mixer_context->inputs = allocate_zero<MixerInput>(mixer_context->input_port_count);
+    if (!mixer_context->inputs) {
+        mixer_destroy(node);
+        return GenesisErrorNoMem;
+    }
+    for (int i = 0; i < mixer_context->input_port_count; i += 1) {
+        MixerInput *input = &mixer_context->inputs[i];
+        input->gain_param.store(1.0);
+        input->pan_param.store(0.0);
+        input->gain = 1.0;
+        input->pan = 0.0;
+        for (int ch = 0; ch < GENESIS_MAX_CHANNELS; ch += 1) {
+            input->gains[ch] = 1.0f;
+            input->target_gains[ch] = 1.0f;
+        }
+        input->unity = true;
+    }
 
     return 0;
 }
 
+// pan is a balance: at the center both sides are at gain, and moving
+// toward one side turns the other down
+static float channel_gain(SoundIoChannelId id, double gain, double pan) {
+    switch (id) {
+    case SoundIoChannelIdFrontLeft:
+    case SoundIoChannelIdFrontLeftCenter:
+    case SoundIoChannelIdSideLeft:
+    case SoundIoChannelIdBackLeft:
+        return gain * min(1.0, 1.0 - pan);
+    case SoundIoChannelIdFrontRight:
+    case SoundIoChannelIdFrontRightCenter:
+    case SoundIoChannelIdSideRight:
+    case SoundIoChannelIdBackRight:
+        return gain * min(1.0, 1.0 + pan);
+    default:
+        return gain;
+    }
+}
+
+static void update_input_ramp(MixerInput *input, const SoundIoChannelLayout *layout, int ramp_frame_count) {
+    double gain = input->gain_param.load();
+    double pan = input->pan_param.load();
+    if (gain == input->gain && pan == input->pan)
+        return;
+    input->gain = gain;
+    input->pan = pan;
+    input->ramp_frames_left = ramp_frame_count;
+    input->unity = false;
+    for (int ch = 0; ch < layout->channel_count; ch += 1) {
+        input->target_gains[ch] = channel_gain(layout->channels[ch], gain, pan);
+        input->gain_steps[ch] = (input->target_gains[ch] - input->gains[ch]) / ramp_frame_count;
+    }
+}
+
+static void finish_input_ramp(MixerInput *input, int channel_count) {
+    input->ramp_frames_left = 0;
+    input->unity = true;
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        input->gains[ch] = input->target_gains[ch];
+        input->unity = input->unity && (input->gains[ch] == 1.0f);
+    }
+}
+
+static bool input_is_muted(const MixerInput *input, int channel_count) {
+    if (input->ramp_frames_left > 0)
+        return false;
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        if (input->gains[ch] != 0.0f)
+            return false;
+    }
+    return true;
+}
+
+// adds frame_count frames of in to out at the input's gains, in one or two
+// contiguous passes: the rest of the ramp and then at the steady gains
+static void mix_input(float *out, const float *in, MixerInput *input, int channel_count, int frame_count) {
+    int ramp_frame_count = min(input->ramp_frames_left, frame_count);
+    if (ramp_frame_count > 0) {
+        dsp_mix_add_gain(out, in, channel_count, input->gains, input->gain_steps, ramp_frame_count);
+        input->ramp_frames_left -= ramp_frame_count;
+        if (input->ramp_frames_left == 0)
+            finish_input_ramp(input, channel_count);
+    }
+    int offset = ramp_frame_count * channel_count;
+    int steady_frame_count = frame_count - ramp_frame_count;
+    if (input->unity)
+        dsp_mix_add(out + offset, in + offset, steady_frame_count * channel_count);
+    else
+        dsp_mix_add_gain(out + offset, in + offset, channel_count, input->gains, zero_gain_steps, steady_frame_count);
+}
+
 static void mixer_run(struct GenesisNode *node) {
     struct MixerContext *mixer_context = (struct MixerContext *)node->userdata;
     struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
@@ -52,6 +169,7 @@ static void mixer_run(struct GenesisNode *node) {
     int output_frame_count = genesis_audio_out_port_free_count(audio_out_port);
     const struct SoundIoChannelLayout * out_channel_layout = genesis_audio_port_channel_layout(audio_out_port);
     int channel_count = out_channel_layout->channel_count;
+    int ramp_frame_count = max(1, (int)(RAMP_SECONDS * genesis_audio_port_sample_rate(audio_out_port)));
 
     int min_frame_count = output_frame_count;
     for (int i = 0; i < mixer_context->input_port_count; i += 1) {
@@ -61,29 +179,67 @@ static void mixer_run(struct GenesisNode *node) {
         min_frame_count = min(min_frame_count, input_frame_count);
     }
 
-    float *out_ptr = genesis_audio_out_port_write_ptr(audio_out_port);
-    for (int frame = 0; frame < min_frame_count; frame += 1) {
-        float total[GENESIS_MAX_CHANNELS] = {0.0f};
-        for (int port_i = 0; port_i < mixer_context->input_port_count; port_i += 1) {
-            for (int ch = 0; ch < channel_count; ch += 1) {
-                total[ch] += mixer_context->read_ptrs[port_i][0];
-                mixer_context->read_ptrs[port_i] += 1;
-            }
+    // silent and muted inputs add nothing, so they are left out. a ramp on
+    // an input that is left out just ends.
+    int first_input = -1;
+    for (int i = 0; i < mixer_context->input_port_count; i += 1) {
+        GenesisPort *audio_in_port = genesis_node_port(node, i + 1);
+        MixerInput *input = &mixer_context->inputs[i];
+        update_input_ramp(input, out_channel_layout, ramp_frame_count);
+        if (genesis_audio_in_port_silent_count(audio_in_port) >= min_frame_count) {
+            if (input->ramp_frames_left > 0)
+                finish_input_ramp(input, channel_count);
+            mixer_context->read_ptrs[i] = nullptr;
+        } else if (input_is_muted(input, channel_count)) {
+            mixer_context->read_ptrs[i] = nullptr;
+        } else if (first_input == -1) {
+            first_input = i;
         }
+    }
 
-        for (int ch = 0; ch < channel_count; ch += 1) {
-            out_ptr[0] = total[ch];
-            out_ptr += 1;
+    // every port has the same layout, so the inputs are summed as flat spans,
+    // one whole input at a time
+    float *out_ptr = genesis_audio_out_port_write_ptr(audio_out_port);
+    int sample_count = min_frame_count * channel_count;
+    if (first_input == -1) {
+        genesis_audio_out_port_write_silence(audio_out_port, min_frame_count);
+    } else {
+        MixerInput *first = &mixer_context->inputs[first_input];
+        if (first->unity) {
+            memcpy(out_ptr, mixer_context->read_ptrs[first_input], sample_count * sizeof(float));
+        } else {
+            memset(out_ptr, 0, sample_count * sizeof(float));
+            mix_input(out_ptr, mixer_context->read_ptrs[first_input], first, channel_count, min_frame_count);
+        }
+        for (int port_i = first_input + 1; port_i < mixer_context->input_port_count; port_i += 1) {
+            if (mixer_context->read_ptrs[port_i]) {
+                mix_input(out_ptr, mixer_context->read_ptrs[port_i], &mixer_context->inputs[port_i],
+                        channel_count, min_frame_count);
+            }
         }
+        genesis_audio_out_port_advance_write_ptr(audio_out_port, min_frame_count);
     }
 
-    genesis_audio_out_port_advance_write_ptr(audio_out_port, min_frame_count);
     for (int i = 0; i < mixer_context->input_port_count; i += 1) {
         GenesisPort *audio_in_port = genesis_node_port(node, i + 1);
         genesis_audio_in_port_advance_read_ptr(audio_in_port, min_frame_count);
     }
 }
 
+int mixer_node_set_input(GenesisNode *node, int input_index, float gain, float pan) {
+    if (node->descriptor->run != mixer_run)
+        return GenesisErrorInvalidParam;
+    struct MixerContext *mixer_context = (struct MixerContext *)node->userdata;
+    if (input_index < 0 || input_index >= mixer_context->input_port_count)
+        return GenesisErrorInvalidParam;
+    if (!isfinite(gain) || !(pan >= -1.0f && pan <= 1.0f))
+        return GenesisErrorInvalidParam;
+    MixerInput *input = &mixer_context->inputs[input_index];
+    input->gain_param.store(gain);
+    input->pan_param.store(pan);
+    return 0;
+}
+
 int create_mixer_descriptor(GenesisPipeline *pipeline, int input_port_count, GenesisNodeDescriptor **out) {
     *out = nullptr;
 
@@ -142,3 +298,182 @@ int create_mixer_descriptor(GenesisPipeline *pipeline, int input_port_count, Gen
 
     return 0;
 }
+
+struct MixerTree {
+    GenesisPipeline *pipeline;
+    int input_count;
+    float *gains;
+    float *pans;
+    // one for each input count needed
+    List<GenesisNodeDescriptor *> descriptors;
+    // the nodes of each level, from the one with the tree inputs up
+    List<int> level_sizes;
+    // while the tree is in the graph, level by level, so the root is last
+    List<GenesisNode *> nodes;
+};
+
+// the number of inputs of node node_index of a level whose nodes split
+// child_count children between them
+static int branch_input_count(int child_count, int node_index) {
+    return min(MIXER_TREE_FAN_IN, child_count - node_index * MIXER_TREE_FAN_IN);
+}
+
+static GenesisNodeDescriptor *find_tree_descriptor(MixerTree *tree, int input_count) {
+    for (int i = 0; i < tree->descriptors.length(); i += 1) {
+        GenesisNodeDescriptor *node_descr = tree->descriptors.at(i);
+        DescriptorContext *descr_context = (DescriptorContext *)genesis_node_descriptor_userdata(node_descr);
+        if (descr_context->input_port_count == input_count)
+            return node_descr;
+    }
+    return nullptr;
+}
+
+void mixer_tree_destroy(MixerTree *tree) {
+    if (tree) {
+        for (int i = 0; i < tree->nodes.length(); i += 1)
+            genesis_node_destroy(tree->nodes.at(i));
+        for (int i = 0; i < tree->descriptors.length(); i += 1)
+            genesis_node_descriptor_destroy(tree->descriptors.at(i));
+        destroy(tree->gains, tree->input_count);
+        destroy(tree->pans, tree->input_count);
+        destroy(tree, 1);
+    }
+}
+
+int mixer_tree_create(GenesisPipeline *pipeline, int input_count, MixerTree **out) {
+    *out = nullptr;
+    MixerTree *tree = create_zero<MixerTree>();
+    if (!tree)
+        return GenesisErrorNoMem;
+    tree->pipeline = pipeline;
+    tree->input_count = input_count;
+    if (input_count > 0) {
+        tree->gains = allocate_zero<float>(input_count);
+        tree->pans = allocate_zero<float>(input_count);
+        if (!tree->gains || !tree->pans) {
+            mixer_tree_destroy(tree);
+            return GenesisErrorNoMem;
+        }
+        for (int i = 0; i < input_count; i += 1)
+            tree->gains[i] = 1.0f;
+    }
+
+    int err;
+    int child_count = input_count;
+    for (;;) {
+        int node_count = (child_count <= MIXER_TREE_FAN_IN) ? 1 :
+            (child_count + MIXER_TREE_FAN_IN - 1) / MIXER_TREE_FAN_IN;
+        if ((err = tree->level_sizes.append(node_count))) {
+            mixer_tree_destroy(tree);
+            return err;
+        }
+        for (int i = 0; i < node_count; i += 1) {
+            int branch_count = (node_count == 1) ? child_count : branch_input_count(child_count, i);
+            if (find_tree_descriptor(tree, branch_count))
+                continue;
+            GenesisNodeDescriptor *node_descr;
+            if ((err = create_mixer_descriptor(pipeline, branch_count, &node_descr))) {
+                mixer_tree_destroy(tree);
+                return err;
+            }
+            if ((err = tree->descriptors.append(node_descr))) {
+                genesis_node_descriptor_destroy(node_descr);
+                mixer_tree_destroy(tree);
+                return err;
+            }
+        }
+        if (node_count == 1)
+            break;
+        child_count = node_count;
+    }
+
+    *out = tree;
+    return 0;
+}
+
+int mixer_tree_add_nodes(MixerTree *tree, GenesisGraphEdit *edit, GenesisPort *audio_in_port) {
+    assert(tree->nodes.length() == 0);
+    int err;
+    int child_count = tree->input_count;
+    for (int level = 0; level < tree->level_sizes.length(); level += 1) {
+        int node_count = tree->level_sizes.at(level);
+        for (int i = 0; i < node_count; i += 1) {
+            int branch_count = (node_count == 1) ? child_count : branch_input_count(child_count, i);
+            GenesisNode *node = genesis_graph_edit_add_node(edit, find_tree_descriptor(tree, branch_count));
+            if (!node)
+                return GenesisErrorNoMem;
+            if ((err = tree->nodes.append(node)))
+                return err;
+        }
+        child_count = node_count;
+    }
+
+    // from the root down, so that each output takes on the format of the
+    // input it feeds
+    if ((err = genesis_graph_edit_connect(edit, genesis_node_port(tree->nodes.last(), 0), audio_in_port)))
+        return err;
+    int level_end = tree->nodes.length();
+    for (int level = tree->level_sizes.length() - 1; level > 0; level -= 1) {
+        int level_start = level_end - tree->level_sizes.at(level);
+        int child_count = tree->level_sizes.at(level - 1);
+        int child_start = level_start - child_count;
+        for (int child = 0; child < child_count; child += 1) {
+            GenesisNode *parent = tree->nodes.at(level_start + child / MIXER_TREE_FAN_IN);
+            if ((err = genesis_graph_edit_connect(edit, genesis_node_port(tree->nodes.at(child_start + child), 0),
+                    genesis_node_port(parent, 1 + child % MIXER_TREE_FAN_IN))))
+            {
+                return err;
+            }
+        }
+        level_end = level_start;
+    }
+
+    for (int i = 0; i < tree->input_count; i += 1) {
+        if ((err = mixer_tree_set_input(tree, i, tree->gains[i], tree->pans[i])))
+            return err;
+    }
+    return 0;
+}
+
+int mixer_tree_remove_nodes(MixerTree *tree, GenesisGraphEdit *edit) {
+    int err;
+    for (int i = 0; i < tree->nodes.length(); i += 1) {
+        if ((err = genesis_graph_edit_remove_node(edit, tree->nodes.at(i))))
+            return err;
+    }
+    tree->nodes.clear();
+    return 0;
+}
+
+GenesisNode *mixer_tree_root(MixerTree *tree) {
+    return tree->nodes.length() ? tree->nodes.last() : nullptr;
+}
+
+int mixer_tree_input_count(MixerTree *tree) {
+    return tree->input_count;
+}
+
+GenesisPort *mixer_tree_input_port(MixerTree *tree, int input_index) {
+    assert(input_index >= 0 && input_index < tree->input_count);
+    assert(tree->nodes.length() > 0);
+    return genesis_node_port(tree->nodes.at(input_index / MIXER_TREE_FAN_IN), 1 + input_index % MIXER_TREE_FAN_IN);
+}
+
+int mixer_tree_set_input(MixerTree *tree, int input_index, float gain, float pan) {
+    if (input_index < 0 || input_index >= tree->input_count)
+        return GenesisErrorInvalidParam;
+    if (!isfinite(gain) || !(pan >= -1.0f && pan <= 1.0f))
+        return GenesisErrorInvalidParam;
+    tree->gains[input_index] = gain;
+    tree->pans[input_index] = pan;
+    if (tree->nodes.length() == 0)
+        return 0;
+    return mixer_node_set_input(tree->nodes.at(input_index / MIXER_TREE_FAN_IN),
+            input_index % MIXER_TREE_FAN_IN, gain, pan);
+}
+
+void mixer_tree_get_input(MixerTree *tree, int input_index, float *gain, float *pan) {
+    assert(input_index >= 0 && input_index < tree->input_count);
+    *gain = tree->gains[input_index];
+    *pan = tree->pans[input_index];
+}
@@ -6,5 +6,32 @@
 int create_mixer_descriptor(GenesisPipeline *pipeline, int input_port_count,
         GenesisNodeDescriptor **out);
 
-#endif
+// node must be made from a mixer descriptor. the gain and pan of input
+// input_index, which is 0 for the first audio in port. pan goes from -1,
+// left, to 1, right. changes ramp in over 10 ms. the defaults are a gain of
+// 1 and a pan of 0.
+int mixer_node_set_input(GenesisNode *node, int input_index, float gain, float pan);
+
+// a mixer of any width made of mixer nodes with at most 16 inputs each,
+// feeding each other level by level up to a single root. the pipeline
+// threads sum the nodes of a level in parallel.
+struct MixerTree;
 
+// creates the descriptors. the nodes come and go with the two functions
+// below. mixer_tree_destroy destroys nodes that are still in the graph, so
+// the pipeline must be stopped unless they were removed.
+int mixer_tree_create(GenesisPipeline *pipeline, int input_count, MixerTree **out);
+void mixer_tree_destroy(MixerTree *tree);
+// adds the nodes, connects them to each other and the mix to audio_in_port.
+// the inputs keep the gain and pan they were set to.
+int mixer_tree_add_nodes(MixerTree *tree, GenesisGraphEdit *edit, GenesisPort *audio_in_port);
+int mixer_tree_remove_nodes(MixerTree *tree, GenesisGraphEdit *edit);
+// while the nodes are in the graph
+GenesisNode *mixer_tree_root(MixerTree *tree);
+GenesisPort *mixer_tree_input_port(MixerTree *tree, int input_index);
+int mixer_tree_input_count(MixerTree *tree);
+int mixer_tree_set_input(MixerTree *tree, int input_index, float gain, float pan);
+// what mixer_tree_set_input last set
+void mixer_tree_get_input(MixerTree *tree, int input_index, float *gain, float *pan);
+
+#endif
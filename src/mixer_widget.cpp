@@ -1,6 +1,14 @@
 #include "mixer_widget.hpp"
 #include "label.hpp"
 #include "color.hpp"
+#include "audio_graph.hpp"
+#include "gui_window.hpp"
+
+// the bottom of the meters
+static const float METER_FLOOR_DB = -60.0f;
+static const float METER_FALL_DB_PER_SECOND = 24.0f;
+// how long the clip light stays on
+static const double METER_CLIP_HOLD_SECONDS = 2.0;
 
 static void on_mixer_lines_changed(Event, void *userdata) {
     MixerWidget *mixer_widget = (MixerWidget *)userdata;
@@ -8,16 +16,21 @@ static void on_mixer_lines_changed(Event, void *userdata) {
     mixer_widget->update_model();
 }
 
-MixerWidget::MixerWidget(GuiWindow *window, Project *project) :
+MixerWidget::MixerWidget(GuiWindow *window, Project *project, AudioGraph *audio_graph) :
     Widget(window),
-    line_name_color(color_fg_text())
+    line_name_color(color_fg_text()),
+    meter_rms_color(parse_color("#4CAF50")),
+    meter_peak_color(parse_color("#C5E1A5")),
+    meter_clip_color(parse_color("#E53935")),
+    last_meter_time(os_get_time())
 {
     this->project = project;
+    this->audio_graph = audio_graph;
 
     refresh_lines();
     update_model();
-    project->events.attach_handler(EventProjectMixerLinesChanged, on_mixer_lines_changed, this);
-    project->events.attach_handler(EventProjectEffectsChanged, on_mixer_lines_changed, this);
+    project->events.attach_deferred_handler(EventProjectMixerLinesChanged, on_mixer_lines_changed, this);
+    project->events.attach_deferred_handler(EventProjectEffectsChanged, on_mixer_lines_changed, this);
 }
 
 MixerWidget::~MixerWidget() {
@@ -25,12 +38,82 @@ MixerWidget::~MixerWidget() {
     project->events.detach_handler(EventProjectMixerLinesChanged, on_mixer_lines_changed);
 }
 
+static float level_to_db(float level) {
+    return (level > 0.0f) ? max(METER_FLOOR_DB, 20.0f * log10f(level)) : METER_FLOOR_DB;
+}
+
+// the meters only read a few numbers per line; the samples stay with the
+// pipeline. returns whether any meter is still moving.
+bool MixerWidget::update_meters() {
+    bool moving = false;
+    double now = os_get_time();
+    float fall_db = METER_FALL_DB_PER_SECOND * (now - last_meter_time);
+    last_meter_time = now;
+    for (int i = 0; i < gui_lines.length(); i += 1) {
+        GuiMixerLine *line = gui_lines.at(i);
+        GenesisMeterLevels levels;
+        if (!audio_graph_read_mixer_line_levels(audio_graph, line->mixer_line, &levels) ||
+            levels.frame_count == 0)
+        {
+            levels.channel_count = line->meter_channel_count;
+            for (int ch = 0; ch < levels.channel_count; ch += 1) {
+                levels.rms[ch] = 0.0f;
+                levels.peak[ch] = 0.0f;
+                levels.true_peak[ch] = 0.0f;
+            }
+        }
+        for (int ch = line->meter_channel_count; ch < levels.channel_count; ch += 1) {
+            line->meter_rms_db[ch] = METER_FLOOR_DB;
+            line->meter_peak_db[ch] = METER_FLOOR_DB;
+        }
+        line->meter_channel_count = levels.channel_count;
+        for (int ch = 0; ch < levels.channel_count; ch += 1) {
+            line->meter_rms_db[ch] = max(level_to_db(levels.rms[ch]), line->meter_rms_db[ch] - fall_db);
+            line->meter_peak_db[ch] = max(level_to_db(levels.true_peak[ch]), line->meter_peak_db[ch] - fall_db);
+            if (levels.true_peak[ch] > 1.0f)
+                line->meter_clip_time = now;
+            if (line->meter_peak_db[ch] > METER_FLOOR_DB)
+                moving = true;
+        }
+        if (line->meter_clip_time > 0.0 && now - line->meter_clip_time < METER_CLIP_HOLD_SECONDS)
+            moving = true;
+    }
+    return moving;
+}
+
+void MixerWidget::draw_meter(GuiMixerLine *line, const glm::mat4 &projection) {
+    if (line->meter_channel_count == 0)
+        return;
+    int bar_width = max(1, line->meter_width / line->meter_channel_count);
+    int bottom = line->meter_top + line->meter_height;
+    for (int ch = 0; ch < line->meter_channel_count; ch += 1) {
+        int left = line->meter_left + ch * bar_width;
+        int rms_height = line->meter_height * (1.0f - line->meter_rms_db[ch] / METER_FLOOR_DB);
+        int peak_y = bottom - (int)(line->meter_height * (1.0f - line->meter_peak_db[ch] / METER_FLOOR_DB));
+        if (rms_height > 0) {
+            gui_window->fill_rect(meter_rms_color,
+                    projection * transform2d(left, bottom - rms_height, bar_width - 1, rms_height));
+        }
+        if (peak_y < bottom)
+            gui_window->fill_rect(meter_peak_color, projection * transform2d(left, peak_y, bar_width - 1, 2));
+    }
+    if (line->meter_clip_time > 0.0 && last_meter_time - line->meter_clip_time < METER_CLIP_HOLD_SECONDS) {
+        gui_window->fill_rect(meter_clip_color,
+                projection * transform2d(line->meter_left, line->meter_top - 4, line->meter_width, 3));
+    }
+}
+
 void MixerWidget::draw(const glm::mat4 &projection) {
+    // the meters are drawn again as soon as the window can for as long as
+    // they move, without waiting on the main loop
+    if (update_meters() || audio_graph_is_playing(audio_graph))
+        queue_redraw();
     for (int i = 0; i < gui_lines.length(); i += 1) {
         GuiMixerLine *line = gui_lines.at(i);
         line->bg.draw(gui_window, projection);
 
-        line->name_label->draw(projection * line->name_label_model, line_name_color);
+        line->name_label->draw(gui_window, projection * line->name_label_model, line_name_color);
+        draw_meter(line, projection);
     }
 
     fx_area_bg.draw(gui_window, projection);
@@ -38,11 +121,12 @@ void MixerWidget::draw(const glm::mat4 &projection) {
         GuiEffect *effect = gui_effects.at(i);
 
         effect->bg.draw(gui_window, projection);
-        effect->name_label->draw(projection * effect->name_label_model, line_name_color);
+        effect->name_label->draw(gui_window, projection * effect->name_label_model, line_name_color);
     }
 }
 
 void MixerWidget::update_model() {
+    queue_redraw();
     static const int line_width = 60;
     static const int line_spacing = 4;
     static const int padding_left = 4;
@@ -52,6 +136,8 @@ void MixerWidget::update_model() {
     static const int name_padding = 2;
     static const int effect_spacing = 4;
     static const int effect_height = 32;
+    static const int meter_width = 12;
+    static const int meter_padding = 6;
 
     int next_x = line_spacing;
     for (int i = 0; i < gui_lines.length(); i += 1) {
@@ -62,6 +148,12 @@ void MixerWidget::update_model() {
 
         line->name_label_model = transform2d(next_x + name_padding, padding_top + name_padding);
 
+        int meter_top = padding_top + name_padding + line->name_label->height() + meter_padding;
+        line->meter_left = right_x - meter_padding - meter_width;
+        line->meter_top = meter_top;
+        line->meter_width = meter_width;
+        line->meter_height = max(0, height - padding_bottom - meter_padding - meter_top);
+
         next_x = right_x + line_spacing;
     }
 
@@ -8,12 +8,24 @@
 class GuiWindow;
 class Label;
 struct Project;
+struct AudioGraph;
 
 struct GuiMixerLine {
     MixerLine *mixer_line;
     SunkenBox bg;
     Label *name_label;
     glm::mat4 name_label_model;
+    // one bar per channel, in dB relative to full scale. the levels fall
+    // back slowly so that short peaks stay in view.
+    int meter_left;
+    int meter_top;
+    int meter_width;
+    int meter_height;
+    int meter_channel_count;
+    float meter_rms_db[GENESIS_MAX_CHANNELS];
+    float meter_peak_db[GENESIS_MAX_CHANNELS];
+    // when the line last went over full scale
+    double meter_clip_time;
 };
 
 struct GuiEffect {
@@ -25,18 +37,23 @@ struct GuiEffect {
 
 class MixerWidget : public Widget {
 public:
-    MixerWidget(GuiWindow *window, Project *project);
+    MixerWidget(GuiWindow *window, Project *project, AudioGraph *audio_graph);
     ~MixerWidget() override;
     void draw(const glm::mat4 &projection) override;
     void on_resize() override { update_model(); }
 
     Project *project;
+    AudioGraph *audio_graph;
 
     void update_model();
     void refresh_lines();
 
 private:
     glm::vec4 line_name_color;
+    glm::vec4 meter_rms_color;
+    glm::vec4 meter_peak_color;
+    glm::vec4 meter_clip_color;
+    double last_meter_time;
 
     List<GuiMixerLine *> gui_lines;
     List<GuiEffect *> gui_effects;
@@ -50,6 +67,8 @@ private:
     void destroy_gui_effect(GuiEffect *gui_effect);
 
     void refresh_fx_list();
+    bool update_meters();
+    void draw_meter(GuiMixerLine *line, const glm::mat4 &projection);
 };
 
 #endif
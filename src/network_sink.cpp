@@ -0,0 +1,373 @@
+#include "network_sink.hpp"
+#include "os.hpp"
+
+static const int NETWORK_SINK_DEFAULT_PACKET_FRAMES = 48;
+static const int RTP_HEADER_SIZE = 12;
+// the largest payload AES67 has receivers take, which fits an ethernet frame
+static const int NETWORK_SINK_MAX_PAYLOAD_SIZE = 1440;
+static const int L24_SAMPLE_SIZE = 3;
+// the first dynamic payload type, which AES67 streams announce as L24
+static const int NETWORK_SINK_PAYLOAD_TYPE = 96;
+// AF41, for media, as AES67 has it
+static const int NETWORK_SINK_DSCP = 34;
+static const int NETWORK_SINK_MULTICAST_TTL = 16;
+// packets shorter than this are sent several at a time
+static const int64_t NETWORK_SINK_MIN_WAKE_NS = 1000000;
+// the most packets sent at one wake. a thread which wakes up later than
+// this many packets skips the ones it missed.
+static const int NETWORK_SINK_MAX_BATCH = 64;
+
+struct NetworkSinkContext {
+    GenesisNode *node;
+    // empty when the node sends nothing
+    ByteBuffer address;
+    int port;
+    int packet_frames;
+
+    // from activate
+    bool sending;
+    int channel_count;
+    int frame_rate;
+    int packet_size;
+    OsUdpSocket socket;
+    bool socket_open;
+    // NETWORK_SINK_MAX_BATCH packets, each with its header
+    char *packets;
+    OsUdpDatagram datagrams[NETWORK_SINK_MAX_BATCH];
+    uint32_t ssrc;
+
+    OsThread *sender_thread;
+    atomic_bool sender_exit;
+    // set by the node once the pipeline has filled its input, and cleared
+    // by a seek. the sender thread takes frames from the input only while
+    // it is set.
+    atomic_bool feeding;
+
+    // sender thread only. the media clock frame of the next packet, and
+    // frames of the input still to skip for the silence sent in their place.
+    int64_t next_frame;
+    uint16_t sequence;
+    long owed_frame_count;
+
+    atomic_long sent_packet_count;
+    atomic_long silent_packet_count;
+    atomic_long skipped_packet_count;
+    atomic_int send_error;
+};
+
+// the media clock is TAI counted in frames since the epoch, whose low 32
+// bits are the RTP timestamp. frames start at the nanosecond they round up
+// to.
+static int64_t media_frame_at(int64_t time_ns, int frame_rate) {
+    return (time_ns / 1000000000) * frame_rate + (time_ns % 1000000000) * frame_rate / 1000000000;
+}
+
+static int64_t media_frame_time_ns(int64_t frame, int frame_rate) {
+    return (frame / frame_rate) * 1000000000 +
+        ((frame % frame_rate) * 1000000000 + frame_rate - 1) / frame_rate;
+}
+
+static void write_rtp_header(unsigned char *packet, uint16_t sequence, uint32_t timestamp, uint32_t ssrc) {
+    // version 2, without padding, extension, contributing sources or marker
+    packet[0] = 0x80;
+    packet[1] = NETWORK_SINK_PAYLOAD_TYPE;
+    packet[2] = sequence >> 8;
+    packet[3] = sequence;
+    packet[4] = timestamp >> 24;
+    packet[5] = timestamp >> 16;
+    packet[6] = timestamp >> 8;
+    packet[7] = timestamp;
+    packet[8] = ssrc >> 24;
+    packet[9] = ssrc >> 16;
+    packet[10] = ssrc >> 8;
+    packet[11] = ssrc;
+}
+
+// big endian, scaled as for a sound device
+static void write_l24(unsigned char *dest, const float *samples, int sample_count) {
+    for (int i = 0; i < sample_count; i += 1) {
+        int32_t value = (int32_t)clamp(-8388608.0f, samples[i] * 8388607.0f, 8388607.0f);
+        dest[0] = value >> 16;
+        dest[1] = value >> 8;
+        dest[2] = value;
+        dest += L24_SAMPLE_SIZE;
+    }
+}
+
+static void set_send_error(NetworkSinkContext *sink_context, int err) {
+    int expected = 0;
+    sink_context->send_error.compare_exchange_strong(expected, err);
+}
+
+// fills packet_count packets from next_frame on, from the input or with
+// silence, and sends them together
+static void send_packets(NetworkSinkContext *sink_context, int packet_count) {
+    GenesisPipeline *pipeline = sink_context->node->descriptor->pipeline;
+    GenesisPort *audio_in_port = genesis_node_port(sink_context->node, 0);
+    bool feeding = false;
+    if (device_callback_begin(pipeline)) {
+        feeding = sink_context->feeding.load();
+        if (!feeding)
+            device_callback_end(pipeline);
+    }
+    if (!feeding)
+        sink_context->owed_frame_count = 0;
+
+    int packet_frames = sink_context->packet_frames;
+    int sample_count = packet_frames * sink_context->channel_count;
+    long silent_count = 0;
+    for (int i = 0; i < packet_count; i += 1) {
+        unsigned char *packet = (unsigned char *)sink_context->packets + i * sink_context->packet_size;
+        write_rtp_header(packet, sink_context->sequence, (uint32_t)sink_context->next_frame,
+                sink_context->ssrc);
+        sink_context->sequence += 1;
+        sink_context->next_frame += packet_frames;
+        unsigned char *payload = packet + RTP_HEADER_SIZE;
+        if (feeding) {
+            int fill_count = genesis_audio_in_port_fill_count(audio_in_port);
+            int drop_count = (int)min((long)fill_count, sink_context->owed_frame_count);
+            if (drop_count > 0) {
+                genesis_audio_in_port_advance_read_ptr(audio_in_port, drop_count);
+                sink_context->owed_frame_count -= drop_count;
+                fill_count -= drop_count;
+            }
+            if (fill_count >= packet_frames) {
+                write_l24(payload, genesis_audio_in_port_read_ptr(audio_in_port), sample_count);
+                genesis_audio_in_port_advance_read_ptr(audio_in_port, packet_frames);
+                continue;
+            }
+            sink_context->owed_frame_count += packet_frames;
+            silent_count += 1;
+        }
+        memset(payload, 0, sample_count * L24_SAMPLE_SIZE);
+    }
+    if (feeding)
+        device_callback_end(pipeline);
+
+    int sent_count;
+    int err = os_udp_socket_send(&sink_context->socket, sink_context->datagrams, packet_count, &sent_count);
+    if (err)
+        set_send_error(sink_context, err);
+    sink_context->sent_packet_count += sent_count;
+    sink_context->silent_packet_count += silent_count;
+}
+
+// the next packet is a packet's time from now
+static void restart_media_clock(NetworkSinkContext *sink_context) {
+    int64_t now_frame = media_frame_at(os_get_media_time_ns(), sink_context->frame_rate);
+    sink_context->next_frame = now_frame + sink_context->packet_frames;
+}
+
+static void sender_thread_run(void *userdata) {
+    NetworkSinkContext *sink_context = (NetworkSinkContext *)userdata;
+    int frame_rate = sink_context->frame_rate;
+    int packet_frames = sink_context->packet_frames;
+    restart_media_clock(sink_context);
+    int64_t last_wake_ns = 0;
+    while (!sink_context->sender_exit.load()) {
+        os_sleep_until_media_time_ns(max(media_frame_time_ns(sink_context->next_frame, frame_rate),
+                    last_wake_ns + NETWORK_SINK_MIN_WAKE_NS));
+        int64_t now_ns = os_get_media_time_ns();
+        last_wake_ns = now_ns;
+        int64_t due_frame = media_frame_at(now_ns, frame_rate);
+        if (due_frame < sink_context->next_frame - frame_rate ||
+            due_frame > sink_context->next_frame + frame_rate)
+        {
+            // the clock was stepped, so the stream starts over from now
+            restart_media_clock(sink_context);
+            continue;
+        }
+        if (due_frame < sink_context->next_frame)
+            continue;
+        long due_count = (due_frame - sink_context->next_frame) / packet_frames + 1;
+        if (due_count > NETWORK_SINK_MAX_BATCH) {
+            long skip_count = due_count - NETWORK_SINK_MAX_BATCH;
+            sink_context->next_frame += skip_count * packet_frames;
+            if (sink_context->feeding.load())
+                sink_context->owed_frame_count += skip_count * packet_frames;
+            sink_context->skipped_packet_count += skip_count;
+            due_count = NETWORK_SINK_MAX_BATCH;
+        }
+        send_packets(sink_context, (int)due_count);
+    }
+}
+
+static void network_sink_deactivate(struct GenesisNode *node) {
+    NetworkSinkContext *sink_context = (NetworkSinkContext *)node->userdata;
+    if (sink_context->sender_thread) {
+        sink_context->sender_exit = true;
+        os_thread_destroy(sink_context->sender_thread);
+        sink_context->sender_thread = nullptr;
+    }
+    if (sink_context->socket_open) {
+        os_udp_socket_close(&sink_context->socket);
+        sink_context->socket_open = false;
+    }
+    destroy(sink_context->packets, NETWORK_SINK_MAX_BATCH * sink_context->packet_size);
+    sink_context->packets = nullptr;
+    sink_context->sending = false;
+}
+
+static int network_sink_activate(struct GenesisNode *node) {
+    NetworkSinkContext *sink_context = (NetworkSinkContext *)node->userdata;
+    GenesisPipeline *pipeline = node->descriptor->pipeline;
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    sink_context->feeding = false;
+    sink_context->owed_frame_count = 0;
+    sink_context->sent_packet_count = 0;
+    sink_context->silent_packet_count = 0;
+    sink_context->skipped_packet_count = 0;
+    sink_context->send_error = 0;
+    sink_context->sending = !pipeline->offline && sink_context->address.length() > 0 &&
+        audio_in_port->input_from;
+    // ask for audio frames
+    if (audio_in_port->input_from)
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, 0);
+    if (!sink_context->sending)
+        return 0;
+
+    sink_context->channel_count = genesis_audio_port_channel_layout(audio_in_port)->channel_count;
+    sink_context->frame_rate = genesis_audio_port_sample_rate(audio_in_port);
+    int payload_size = sink_context->packet_frames * sink_context->channel_count * L24_SAMPLE_SIZE;
+    if (payload_size > NETWORK_SINK_MAX_PAYLOAD_SIZE) {
+        sink_context->sending = false;
+        return GenesisErrorInvalidParam;
+    }
+    sink_context->packet_size = RTP_HEADER_SIZE + payload_size;
+    if (!(sink_context->packets = allocate_zero<char>(NETWORK_SINK_MAX_BATCH * sink_context->packet_size))) {
+        network_sink_deactivate(node);
+        return GenesisErrorNoMem;
+    }
+    for (int i = 0; i < NETWORK_SINK_MAX_BATCH; i += 1) {
+        sink_context->datagrams[i].data = sink_context->packets + i * sink_context->packet_size;
+        sink_context->datagrams[i].size = sink_context->packet_size;
+    }
+
+    int err;
+    if ((err = os_udp_socket_open(&sink_context->socket, sink_context->address.raw(), sink_context->port,
+                    NETWORK_SINK_DSCP, NETWORK_SINK_MULTICAST_TTL)))
+    {
+        network_sink_deactivate(node);
+        return err;
+    }
+    sink_context->socket_open = true;
+    sink_context->ssrc = os_random_uint32();
+    sink_context->sequence = (uint16_t)os_random_uint32();
+
+    sink_context->sender_exit = false;
+    if ((err = os_thread_create(sender_thread_run, sink_context, true, &sink_context->sender_thread))) {
+        network_sink_deactivate(node);
+        return err;
+    }
+    return 0;
+}
+
+// like a playback node, waits for the pipeline to fill the input, and
+// leaves the rest to the sender thread
+static void network_sink_run(struct GenesisNode *node) {
+    NetworkSinkContext *sink_context = (NetworkSinkContext *)node->userdata;
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    int fill_count = genesis_audio_in_port_fill_count(audio_in_port);
+    if (!sink_context->sending) {
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, fill_count);
+        return;
+    }
+    if (!sink_context->feeding.load() && fill_count == genesis_audio_in_port_capacity(audio_in_port))
+        sink_context->feeding = true;
+}
+
+static void network_sink_seek(struct GenesisNode *node) {
+    NetworkSinkContext *sink_context = (NetworkSinkContext *)node->userdata;
+    sink_context->feeding = false;
+}
+
+static void network_sink_destroy(struct GenesisNode *node) {
+    NetworkSinkContext *sink_context = (NetworkSinkContext *)node->userdata;
+    if (sink_context) {
+        network_sink_deactivate(node);
+        destroy(sink_context, 1);
+    }
+}
+
+static int network_sink_create(struct GenesisNode *node) {
+    NetworkSinkContext *sink_context = create_zero<NetworkSinkContext>();
+    node->userdata = sink_context;
+    if (!sink_context) {
+        network_sink_destroy(node);
+        return GenesisErrorNoMem;
+    }
+    sink_context->node = node;
+    sink_context->packet_frames = NETWORK_SINK_DEFAULT_PACKET_FRAMES;
+    return 0;
+}
+
+static int check_stopped_sink(struct GenesisNode *node) {
+    if (node->descriptor->run != network_sink_run)
+        return GenesisErrorInvalidParam;
+    if (genesis_pipeline_is_running(node->descriptor->pipeline))
+        return GenesisErrorInvalidState;
+    return 0;
+}
+
+int genesis_network_sink_node_set_destination(struct GenesisNode *node, const char *address, int port) {
+    int err;
+    if ((err = check_stopped_sink(node)))
+        return err;
+    if (address && (port <= 0 || port > 65535))
+        return GenesisErrorInvalidParam;
+    NetworkSinkContext *sink_context = (NetworkSinkContext *)node->userdata;
+    sink_context->address = address ? address : "";
+    sink_context->port = port;
+    return 0;
+}
+
+int genesis_network_sink_node_set_packet_frames(struct GenesisNode *node, int frame_count) {
+    int err;
+    if ((err = check_stopped_sink(node)))
+        return err;
+    if (frame_count < 1 || frame_count * L24_SAMPLE_SIZE > NETWORK_SINK_MAX_PAYLOAD_SIZE)
+        return GenesisErrorInvalidParam;
+    NetworkSinkContext *sink_context = (NetworkSinkContext *)node->userdata;
+    sink_context->packet_frames = frame_count;
+    return 0;
+}
+
+int genesis_network_sink_node_get_stats(struct GenesisNode *node, struct GenesisNetworkSinkStats *out_stats) {
+    if (node->descriptor->run != network_sink_run)
+        return GenesisErrorInvalidParam;
+    NetworkSinkContext *sink_context = (NetworkSinkContext *)node->userdata;
+    out_stats->sent_packet_count = sink_context->sent_packet_count.load();
+    out_stats->silent_packet_count = sink_context->silent_packet_count.load();
+    out_stats->skipped_packet_count = sink_context->skipped_packet_count.load();
+    out_stats->send_error = sink_context->send_error.load();
+    return 0;
+}
+
+int create_network_sink_descriptor(GenesisPipeline *pipeline) {
+    GenesisNodeDescriptor *node_descr = genesis_create_node_descriptor(pipeline, 1, "network-sink",
+            "Sends audio to the network as an AES67 stream.");
+    if (!node_descr)
+        return GenesisErrorNoMem;
+
+    genesis_node_descriptor_set_run_callback(node_descr, network_sink_run);
+    genesis_node_descriptor_set_create_callback(node_descr, network_sink_create);
+    genesis_node_descriptor_set_destroy_callback(node_descr, network_sink_destroy);
+    genesis_node_descriptor_set_seek_callback(node_descr, network_sink_seek);
+    genesis_node_descriptor_set_activate_callback(node_descr, network_sink_activate);
+    node_descr->deactivate = network_sink_deactivate;
+
+    struct GenesisPortDescriptor *audio_port = genesis_node_descriptor_create_port(
+            node_descr, 0, GenesisPortTypeAudioIn, "audio_in");
+    if (!audio_port) {
+        genesis_node_descriptor_destroy(node_descr);
+        return GenesisErrorNoMem;
+    }
+
+    genesis_audio_port_descriptor_set_channel_layout(audio_port,
+        soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdStereo), false, -1);
+
+    genesis_audio_port_descriptor_set_sample_rate(audio_port,
+            genesis_pipeline_get_sample_rate(pipeline), false, -1);
+
+    return 0;
+}
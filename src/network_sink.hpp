@@ -0,0 +1,8 @@
+#ifndef NETWORK_SINK_HPP
+#define NETWORK_SINK_HPP
+
+#include "genesis.hpp"
+
+int create_network_sink_descriptor(GenesisPipeline *pipeline);
+
+#endif
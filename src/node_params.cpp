@@ -0,0 +1,256 @@
+#include "node_params.hpp"
+
+#include <math.h>
+
+// room for this many changes between two runs of the node
+static const int PARAM_QUEUE_CHANGE_COUNT = 4096;
+
+int genesis_node_descriptor_add_param(struct GenesisNodeDescriptor *node_descriptor, const char *name,
+        float min_value, float max_value, float default_value, double ramp_seconds)
+{
+    if (!(min_value <= max_value) || !(default_value >= min_value && default_value <= max_value) ||
+        !(ramp_seconds >= 0.0) || genesis_node_descriptor_find_param_index(node_descriptor, name) >= 0)
+    {
+        return GenesisErrorInvalidParam;
+    }
+    GenesisPipeline *pipeline = node_descriptor->pipeline;
+    for (int i = 0; i < pipeline->nodes.length(); i += 1) {
+        if (pipeline->nodes.at(i)->descriptor == node_descriptor)
+            return GenesisErrorInvalidState;
+    }
+    if (node_descriptor->param_descriptors.add_one())
+        return GenesisErrorNoMem;
+    GenesisParamDescriptor *param = &node_descriptor->param_descriptors.last();
+    if (!(param->name = strdup(name))) {
+        node_descriptor->param_descriptors.pop();
+        return GenesisErrorNoMem;
+    }
+    param->min_value = min_value;
+    param->max_value = max_value;
+    param->default_value = default_value;
+    param->ramp_seconds = ramp_seconds;
+    return 0;
+}
+
+int genesis_node_descriptor_param_count(const struct GenesisNodeDescriptor *node_descriptor) {
+    return node_descriptor->param_descriptors.length();
+}
+
+int genesis_node_descriptor_find_param_index(const struct GenesisNodeDescriptor *node_descriptor,
+        const char *name)
+{
+    for (int i = 0; i < node_descriptor->param_descriptors.length(); i += 1) {
+        if (strcmp(node_descriptor->param_descriptors.at(i).name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+const char *genesis_node_descriptor_param_name(const struct GenesisNodeDescriptor *node_descriptor,
+        int param_index)
+{
+    return node_descriptor->param_descriptors.at(param_index).name;
+}
+
+float genesis_node_descriptor_param_min(const struct GenesisNodeDescriptor *node_descriptor, int param_index) {
+    return node_descriptor->param_descriptors.at(param_index).min_value;
+}
+
+float genesis_node_descriptor_param_max(const struct GenesisNodeDescriptor *node_descriptor, int param_index) {
+    return node_descriptor->param_descriptors.at(param_index).max_value;
+}
+
+float genesis_node_descriptor_param_default(const struct GenesisNodeDescriptor *node_descriptor,
+        int param_index)
+{
+    return node_descriptor->param_descriptors.at(param_index).default_value;
+}
+
+int node_params_create(GenesisNode *node) {
+    int param_count = node->descriptor->param_descriptors.length();
+    if (param_count == 0)
+        return 0;
+    GenesisNodeParams *params = create_zero<GenesisNodeParams>();
+    if (!params)
+        return GenesisErrorNoMem;
+    node->params = params;
+    params->param_count = param_count;
+    if (!(params->states = allocate_zero<GenesisParamState>(param_count))) {
+        node_params_destroy(node);
+        return GenesisErrorNoMem;
+    }
+    int err;
+    if ((err = spsc_ring_buffer_init(&params->queue, PARAM_QUEUE_CHANGE_COUNT * sizeof(GenesisParamChange)))) {
+        destroy(params->states, param_count);
+        params->states = nullptr;
+        node_params_destroy(node);
+        return err;
+    }
+    for (int i = 0; i < param_count; i += 1) {
+        GenesisParamState *state = &params->states[i];
+        state->value = node->descriptor->param_descriptors.at(i).default_value;
+        state->target = state->value;
+    }
+    return 0;
+}
+
+void node_params_destroy(GenesisNode *node) {
+    GenesisNodeParams *params = node->params;
+    if (!params)
+        return;
+    if (params->states) {
+        spsc_ring_buffer_deinit(&params->queue);
+        destroy(params->states, params->param_count);
+    }
+    destroy(params, 1);
+    node->params = nullptr;
+}
+
+static bool take_change(GenesisNodeParams *params) {
+    if (params->has_pending)
+        return true;
+    if (spsc_ring_buffer_fill_count(&params->queue, sizeof(GenesisParamChange)) <
+            (int)sizeof(GenesisParamChange))
+    {
+        return false;
+    }
+    memcpy(&params->pending, spsc_ring_buffer_read_ptr(&params->queue), sizeof(GenesisParamChange));
+    spsc_ring_buffer_advance_read_ptr(&params->queue, sizeof(GenesisParamChange));
+    params->has_pending = true;
+    return true;
+}
+
+static void apply_change(GenesisNode *node, const GenesisParamChange *change, bool ramp) {
+    GenesisNodeParams *params = node->params;
+    GenesisParamState *state = &params->states[change->param_index];
+    double ramp_seconds = node->descriptor->param_descriptors.at(change->param_index).ramp_seconds;
+    int ramp_frames = ramp ? (int)lround(ramp_seconds * params->frame_rate) : 0;
+    state->target = change->value;
+    if (ramp_frames <= 0 || state->value == state->target) {
+        state->value = state->target;
+        state->step = 0.0f;
+        state->ramp_frames_left = 0;
+    } else {
+        state->step = (state->target - state->value) / ramp_frames;
+        state->ramp_frames_left = ramp_frames;
+    }
+}
+
+// the first frame at or after time
+static long change_frame(GenesisNode *node, double time) {
+    GenesisNodeParams *params = node->params;
+    double seconds = genesis_whole_notes_to_seconds(node->descriptor->pipeline, time, params->frame_rate);
+    return (long)ceil(seconds * params->frame_rate - 0.000001);
+}
+
+// only while no node runs
+static void drain_queue(GenesisNode *node) {
+    GenesisNodeParams *params = node->params;
+    while (take_change(params)) {
+        apply_change(node, &params->pending, false);
+        params->has_pending = false;
+    }
+}
+
+void node_params_seek(GenesisNode *node) {
+    GenesisNodeParams *params = node->params;
+    if (!params)
+        return;
+    drain_queue(node);
+    for (int i = 0; i < params->param_count; i += 1) {
+        GenesisParamState *state = &params->states[i];
+        state->value = state->target;
+        state->step = 0.0f;
+        state->ramp_frames_left = 0;
+    }
+    params->position_known = false;
+}
+
+int genesis_node_set_param(struct GenesisNode *node, int param_index, float value, double time) {
+    GenesisNodeParams *params = node->params;
+    if (!params || param_index < 0 || param_index >= params->param_count || !isfinite(value))
+        return GenesisErrorInvalidParam;
+    const GenesisParamDescriptor *param = &node->descriptor->param_descriptors.at(param_index);
+    GenesisParamChange change;
+    change.param_index = param_index;
+    change.value = clamp(param->min_value, value, param->max_value);
+    change.time = time;
+    // the state the nodes saved came from the old value
+    genesis_pipeline_clear_checkpoints(node->descriptor->pipeline);
+    // nothing reads the queue, so the change is made here and now
+    if (!genesis_pipeline_is_running(node->descriptor->pipeline)) {
+        drain_queue(node);
+        apply_change(node, &change, false);
+        return 0;
+    }
+    if (spsc_ring_buffer_free_count(&params->queue, sizeof(GenesisParamChange)) <
+            (int)sizeof(GenesisParamChange))
+    {
+        return GenesisErrorQueueFull;
+    }
+    memcpy(spsc_ring_buffer_write_ptr(&params->queue), &change, sizeof(GenesisParamChange));
+    spsc_ring_buffer_advance_write_ptr(&params->queue, sizeof(GenesisParamChange));
+    genesis_pipeline_wake(node->descriptor->pipeline);
+    return 0;
+}
+
+int genesis_node_params_next_segment(struct GenesisNode *node, int frame_rate, int frame_count) {
+    GenesisNodeParams *params = node->params;
+    if (!params)
+        return frame_count;
+    if (!params->position_known || params->frame_rate != frame_rate) {
+        params->frame_rate = frame_rate;
+        params->frame_pos = genesis_whole_notes_to_frames(node->descriptor->pipeline,
+                node->timestamp, frame_rate);
+        params->position_known = true;
+    }
+    int segment_frame_count = frame_count;
+    while (take_change(params)) {
+        if (params->pending.time >= 0.0) {
+            long frames_until = change_frame(node, params->pending.time) - params->frame_pos;
+            if (frames_until > 0) {
+                segment_frame_count = (int)min((long)segment_frame_count, frames_until);
+                break;
+            }
+        }
+        apply_change(node, &params->pending, true);
+        params->has_pending = false;
+    }
+    for (int i = 0; i < params->param_count; i += 1) {
+        GenesisParamState *state = &params->states[i];
+        if (state->ramp_frames_left > 0)
+            segment_frame_count = min(segment_frame_count, state->ramp_frames_left);
+    }
+    return segment_frame_count;
+}
+
+float genesis_node_param_value(struct GenesisNode *node, int param_index) {
+    return node->params->states[param_index].value;
+}
+
+float genesis_node_param_step(struct GenesisNode *node, int param_index) {
+    return node->params->states[param_index].step;
+}
+
+void genesis_node_params_advance(struct GenesisNode *node, int frame_count) {
+    GenesisNodeParams *params = node->params;
+    if (!params)
+        return;
+    while (frame_count > 0) {
+        int segment_frame_count = genesis_node_params_next_segment(node, params->frame_rate, frame_count);
+        for (int i = 0; i < params->param_count; i += 1) {
+            GenesisParamState *state = &params->states[i];
+            if (state->ramp_frames_left == 0)
+                continue;
+            state->ramp_frames_left -= segment_frame_count;
+            if (state->ramp_frames_left == 0) {
+                state->value = state->target;
+                state->step = 0.0f;
+            } else {
+                state->value += state->step * segment_frame_count;
+            }
+        }
+        params->frame_pos += segment_frame_count;
+        frame_count -= segment_frame_count;
+    }
+}
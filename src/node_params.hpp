@@ -0,0 +1,44 @@
+#ifndef GENESIS_NODE_PARAMS_HPP
+#define GENESIS_NODE_PARAMS_HPP
+
+#include "genesis.hpp"
+
+// the params of one node. one control thread queues timestamped changes
+// and the node takes them off the queue as it runs, so neither side waits
+// for the other. values ramp to each new target over the param's ramp
+// time instead of jumping.
+
+struct GenesisParamChange {
+    int param_index;
+    float value;
+    // whole notes, or negative for the start of the next run
+    double time;
+};
+
+struct GenesisParamState {
+    float value;
+    float target;
+    float step; // per frame while ramping
+    int ramp_frames_left;
+};
+
+struct GenesisNodeParams {
+    int param_count;
+    GenesisParamState *states;
+    SpscRingBuffer queue;
+    // the change at the head of the queue, when it is not due yet
+    GenesisParamChange pending;
+    bool has_pending;
+    // the frame the next segment starts at, at frame_rate. found from the
+    // node's timestamp on the first segment after a seek.
+    long frame_pos;
+    int frame_rate;
+    bool position_known;
+};
+
+int node_params_create(GenesisNode *node);
+void node_params_destroy(GenesisNode *node);
+// while no node runs. changes still in the queue take effect right away.
+void node_params_seek(GenesisNode *node);
+
+#endif
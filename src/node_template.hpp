@@ -0,0 +1,289 @@
+#ifndef NODE_TEMPLATE_HPP
+#define NODE_TEMPLATE_HPP
+
+#include "genesis.hpp"
+
+// built-in nodes declared by a class. the class lists its ports as types,
+// which carry their index and have the calls of their port type, and
+// node_template_create_descriptor makes its descriptor with callbacks made
+// for the class, which call its members directly. the class derives from
+// NodeTemplate and has:
+//
+//     typedef NodePorts<AudioInPort<0>, AudioOutPort<1>> Ports;
+//     static const NodePortSpec PORT_SPECS[Ports::COUNT];
+//     int create(GenesisNode *node);
+//     void run(GenesisNode *node);
+//
+// and where it needs them, PARAM_COUNT and param_specs(), and seek,
+// activate or state_size, save_state and restore_state with HAS_SEEK,
+// HAS_ACTIVATE or HAS_STATE true. node->userdata is the object, made with
+// create_zero and its constructor and gone with its destructor.
+
+template<int Index>
+struct AudioInPort {
+    static const GenesisPortType TYPE = GenesisPortTypeAudioIn;
+    static const int INDEX = Index;
+    GenesisPort *port;
+
+    explicit AudioInPort(GenesisNode *node) : port(genesis_node_port(node, Index)) {}
+    int fill_count() const { return genesis_audio_in_port_fill_count(port); }
+    int silent_count() const { return genesis_audio_in_port_silent_count(port); }
+    float *read_ptr() const { return genesis_audio_in_port_read_ptr(port); }
+    void advance(int frame_count) const { genesis_audio_in_port_advance_read_ptr(port, frame_count); }
+    int channel_count() const { return genesis_audio_port_channel_layout(port)->channel_count; }
+    int sample_rate() const { return genesis_audio_port_sample_rate(port); }
+};
+
+template<int Index>
+struct AudioOutPort {
+    static const GenesisPortType TYPE = GenesisPortTypeAudioOut;
+    static const int INDEX = Index;
+    GenesisPort *port;
+
+    explicit AudioOutPort(GenesisNode *node) : port(genesis_node_port(node, Index)) {}
+    int free_count() const { return genesis_audio_out_port_free_count(port); }
+    float *write_ptr() const { return genesis_audio_out_port_write_ptr(port); }
+    void advance(int frame_count) const { genesis_audio_out_port_advance_write_ptr(port, frame_count); }
+    void write_silence(int frame_count) const { genesis_audio_out_port_write_silence(port, frame_count); }
+    int channel_count() const { return genesis_audio_port_channel_layout(port)->channel_count; }
+    int sample_rate() const { return genesis_audio_port_sample_rate(port); }
+};
+
+template<int Index>
+struct EventsInPort {
+    static const GenesisPortType TYPE = GenesisPortTypeEventsIn;
+    static const int INDEX = Index;
+    GenesisPort *port;
+
+    explicit EventsInPort(GenesisNode *node) : port(genesis_node_port(node, Index)) {}
+    GenesisMidiEvent *read_ptr() const { return genesis_events_in_port_read_ptr(port); }
+    int fill_frames(int frame_start, int frame_count, int frame_rate, int *event_count) const {
+        return genesis_events_in_port_fill_frames(port, frame_start, frame_count, frame_rate, event_count);
+    }
+    void advance_frames(int event_count, int frame_start, int frame_count, int frame_rate) const {
+        genesis_events_in_port_advance_frames(port, event_count, frame_start, frame_count, frame_rate);
+    }
+};
+
+template<int Index>
+struct EventsOutPort {
+    static const GenesisPortType TYPE = GenesisPortTypeEventsOut;
+    static const int INDEX = Index;
+    GenesisPort *port;
+
+    explicit EventsOutPort(GenesisNode *node) : port(genesis_node_port(node, Index)) {}
+    GenesisMidiEvent *write_ptr() const { return genesis_events_out_port_write_ptr(port); }
+    void free_count(int *event_count, double *time_requested) const {
+        genesis_events_out_port_free_count(port, event_count, time_requested);
+    }
+    void advance(int event_count, double buf_size) const {
+        genesis_events_out_port_advance_write_ptr(port, event_count, buf_size);
+    }
+};
+
+template<int Index, typename... Ports>
+struct NodePortsInOrder {
+    static const bool VALUE = true;
+};
+
+template<int Index, typename First, typename... Rest>
+struct NodePortsInOrder<Index, First, Rest...> {
+    static const bool VALUE = First::INDEX == Index && NodePortsInOrder<Index + 1, Rest...>::VALUE;
+};
+
+template<typename... Ports>
+struct NodePorts {
+    static_assert(sizeof...(Ports) > 0, "a node needs a port");
+    static_assert(NodePortsInOrder<0, Ports...>::VALUE, "ports are listed by index from 0");
+    static const int COUNT = sizeof...(Ports);
+
+    static GenesisPortType type(int index) {
+        static const GenesisPortType types[] = {Ports::TYPE...};
+        return types[index];
+    }
+};
+
+struct NodePortSpec {
+    const char *name;
+    // audio ports only. the channel layout starts as channel_layout_id. when
+    // it is fixed it stays that, or is that of channel_layout_port unless
+    // that is -1. the sample rate is the pipeline's, fixed to that or to
+    // that of sample_rate_port in the same way.
+    SoundIoChannelLayoutId channel_layout_id;
+    bool channel_layout_fixed;
+    int channel_layout_port;
+    bool sample_rate_fixed;
+    int sample_rate_port;
+    // audio out ports only. the audio in port it works in place with, or -1
+    int in_place_port;
+};
+
+struct NodeParamSpec {
+    const char *name;
+    float min_value;
+    float max_value;
+    float default_value;
+    double ramp_seconds;
+};
+
+// what a node class does not declare
+struct NodeTemplate {
+    static const int PARAM_COUNT = 0;
+    static const bool HAS_SEEK = false;
+    static const bool HAS_ACTIVATE = false;
+    static const bool HAS_STATE = false;
+
+    static const NodeParamSpec *param_specs() { return nullptr; }
+    int create(GenesisNode *) { return 0; }
+    void seek(GenesisNode *) {}
+    int activate(GenesisNode *) { return 0; }
+    int state_size(GenesisNode *) { return 0; }
+    void save_state(GenesisNode *, void *) {}
+    void restore_state(GenesisNode *, const void *) {}
+};
+
+// calls Fn::template run<1> or run<2> for those channel counts, so that
+// their inner loops are made for them, and run<0>, which uses
+// channel_count, for any other
+template<typename Fn, typename... Args>
+static inline void node_template_for_channels(int channel_count, Args... args) {
+    switch (channel_count) {
+        case 1: Fn::template run<1>(args...); return;
+        case 2: Fn::template run<2>(args...); return;
+    }
+    Fn::template run<0>(args...);
+}
+
+// for a loop made for ChannelCount: that, or channel_count for 0
+template<int ChannelCount>
+static inline int node_template_channel_count(int channel_count) {
+    return ChannelCount ? ChannelCount : channel_count;
+}
+
+template<typename Node>
+static inline Node *node_template_get(GenesisNode *node) {
+    return (Node *)node->userdata;
+}
+
+template<typename Node>
+static void node_template_destroy(GenesisNode *node) {
+    destroy(node_template_get<Node>(node), 1);
+    node->userdata = nullptr;
+}
+
+template<typename Node>
+static int node_template_create(GenesisNode *node) {
+    Node *self = create_zero<Node>();
+    node->userdata = self;
+    if (!self)
+        return GenesisErrorNoMem;
+    int err;
+    if ((err = self->create(node))) {
+        node_template_destroy<Node>(node);
+        return err;
+    }
+    return 0;
+}
+
+template<typename Node>
+static void node_template_run(GenesisNode *node) {
+    node_template_get<Node>(node)->run(node);
+}
+
+template<typename Node>
+static void node_template_seek(GenesisNode *node) {
+    node_template_get<Node>(node)->seek(node);
+}
+
+template<typename Node>
+static int node_template_activate(GenesisNode *node) {
+    return node_template_get<Node>(node)->activate(node);
+}
+
+template<typename Node>
+static int node_template_state_size(GenesisNode *node) {
+    return node_template_get<Node>(node)->state_size(node);
+}
+
+template<typename Node>
+static void node_template_save_state(GenesisNode *node, void *state) {
+    node_template_get<Node>(node)->save_state(node, state);
+}
+
+template<typename Node>
+static void node_template_restore_state(GenesisNode *node, const void *state) {
+    node_template_get<Node>(node)->restore_state(node, state);
+}
+
+// whether node is one of Node's
+template<typename Node>
+static inline bool node_template_is(GenesisNode *node) {
+    return node->descriptor->run == node_template_run<Node>;
+}
+
+// out_descriptor may be null
+template<typename Node>
+int node_template_create_descriptor(GenesisPipeline *pipeline, const char *name,
+        const char *description, GenesisNodeDescriptor **out_descriptor)
+{
+    typedef typename Node::Ports Ports;
+    GenesisNodeDescriptor *node_descr = genesis_create_node_descriptor(pipeline, Ports::COUNT,
+            name, description);
+    if (!node_descr)
+        return GenesisErrorNoMem;
+
+    genesis_node_descriptor_set_run_callback(node_descr, node_template_run<Node>);
+    genesis_node_descriptor_set_create_callback(node_descr, node_template_create<Node>);
+    genesis_node_descriptor_set_destroy_callback(node_descr, node_template_destroy<Node>);
+    if (Node::HAS_SEEK)
+        genesis_node_descriptor_set_seek_callback(node_descr, node_template_seek<Node>);
+    if (Node::HAS_ACTIVATE)
+        genesis_node_descriptor_set_activate_callback(node_descr, node_template_activate<Node>);
+    if (Node::HAS_STATE) {
+        genesis_node_descriptor_set_state_callbacks(node_descr, node_template_state_size<Node>,
+                node_template_save_state<Node>, node_template_restore_state<Node>);
+    }
+
+    int err;
+    const NodeParamSpec *param_specs = Node::param_specs();
+    for (int i = 0; i < Node::PARAM_COUNT; i += 1) {
+        const NodeParamSpec *spec = &param_specs[i];
+        if ((err = genesis_node_descriptor_add_param(node_descr, spec->name, spec->min_value,
+                        spec->max_value, spec->default_value, spec->ramp_seconds)))
+        {
+            genesis_node_descriptor_destroy(node_descr);
+            return err;
+        }
+    }
+
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+    for (int i = 0; i < Ports::COUNT; i += 1) {
+        const NodePortSpec *spec = &Node::PORT_SPECS[i];
+        GenesisPortType port_type = Ports::type(i);
+        GenesisPortDescriptor *port_descr = genesis_node_descriptor_create_port(node_descr, i,
+                port_type, spec->name);
+        if (!port_descr) {
+            genesis_node_descriptor_destroy(node_descr);
+            return GenesisErrorNoMem;
+        }
+        if (port_type != GenesisPortTypeAudioIn && port_type != GenesisPortTypeAudioOut)
+            continue;
+        if ((err = genesis_audio_port_descriptor_set_channel_layout(port_descr,
+                        soundio_channel_layout_get_builtin(spec->channel_layout_id),
+                        spec->channel_layout_fixed, spec->channel_layout_port)) ||
+            (err = genesis_audio_port_descriptor_set_sample_rate(port_descr, sample_rate,
+                        spec->sample_rate_fixed, spec->sample_rate_port)) ||
+            (spec->in_place_port != -1 &&
+             (err = genesis_audio_port_descriptor_set_in_place(port_descr, spec->in_place_port))))
+        {
+            genesis_node_descriptor_destroy(node_descr);
+            return err;
+        }
+    }
+
+    if (out_descriptor)
+        *out_descriptor = node_descr;
+    return 0;
+}
+
+#endif
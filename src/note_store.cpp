@@ -0,0 +1,115 @@
+#include "note_store.hpp"
+
+// the first entry starting after pos
+static int find_start_after(const List<NoteStoreEntry> &lane, double pos) {
+    int start = 0;
+    int end = lane.length();
+    while (start < end) {
+        int middle = (start + end) / 2;
+        if (lane.at(middle).note.start > pos)
+            end = middle;
+        else
+            start = middle + 1;
+    }
+    return start;
+}
+
+// the first entry which it or one before it reaches past pos. no entry
+// before it is still sounding at pos.
+static int find_reach_after(const List<NoteStoreEntry> &lane, double pos) {
+    int start = 0;
+    int end = lane.length();
+    while (start < end) {
+        int middle = (start + end) / 2;
+        if (lane.at(middle).reach > pos)
+            end = middle;
+        else
+            start = middle + 1;
+    }
+    return start;
+}
+
+static void update_reach(List<NoteStoreEntry> &lane, int index) {
+    double reach = (index > 0) ? lane.at(index - 1).reach : -1.0;
+    for (int i = index; i < lane.length(); i += 1) {
+        NoteStoreEntry *entry = &lane.at(i);
+        reach = max(reach, entry->note.end);
+        entry->reach = reach;
+    }
+}
+
+void note_store_init(NoteStore *store) {
+    store->note_count = 0;
+}
+
+int note_store_add(NoteStore *store, const NoteStoreNote &note) {
+    assert(note.pitch >= 0 && note.pitch < NOTE_STORE_PITCH_COUNT);
+    assert(note.end >= note.start);
+    List<NoteStoreEntry> &lane = store->lanes[note.pitch];
+    int index = find_start_after(lane, note.start);
+    int err;
+    if ((err = lane.insert_space(index, 1)))
+        return err;
+    lane.at(index).note = note;
+    update_reach(lane, index);
+    store->note_count += 1;
+    return 0;
+}
+
+bool note_store_remove(NoteStore *store, const NoteStoreNote &note) {
+    assert(note.pitch >= 0 && note.pitch < NOTE_STORE_PITCH_COUNT);
+    List<NoteStoreEntry> &lane = store->lanes[note.pitch];
+    // the notes starting at the same time are just before this
+    for (int i = find_start_after(lane, note.start) - 1; i >= 0; i -= 1) {
+        const NoteStoreNote *other = &lane.at(i).note;
+        if (other->start != note.start)
+            break;
+        if (other->end == note.end) {
+            lane.remove_range(i, i + 1);
+            update_reach(lane, i);
+            store->note_count -= 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+void note_store_clear(NoteStore *store) {
+    for (int pitch = 0; pitch < NOTE_STORE_PITCH_COUNT; pitch += 1)
+        store->lanes[pitch].clear();
+    store->note_count = 0;
+}
+
+int note_store_query(const NoteStore *store, double start, double end,
+        int low_pitch, int high_pitch, List<NoteStoreNote> &out_notes)
+{
+    low_pitch = max(low_pitch, 0);
+    high_pitch = min(high_pitch, NOTE_STORE_PITCH_COUNT - 1);
+    int err;
+    for (int pitch = low_pitch; pitch <= high_pitch; pitch += 1) {
+        const List<NoteStoreEntry> &lane = store->lanes[pitch];
+        for (int i = find_reach_after(lane, start); i < lane.length(); i += 1) {
+            const NoteStoreNote *note = &lane.at(i).note;
+            if (note->start >= end)
+                break;
+            if (note->end <= start)
+                continue;
+            if ((err = out_notes.append(*note)))
+                return err;
+        }
+    }
+    return 0;
+}
+
+const NoteStoreNote *note_store_find(const NoteStore *store, int pitch, double pos) {
+    if (pitch < 0 || pitch >= NOTE_STORE_PITCH_COUNT)
+        return nullptr;
+    const List<NoteStoreEntry> &lane = store->lanes[pitch];
+    int first = find_reach_after(lane, pos);
+    for (int i = find_start_after(lane, pos) - 1; i >= first; i -= 1) {
+        const NoteStoreNote *note = &lane.at(i).note;
+        if (note->end > pos)
+            return note;
+    }
+    return nullptr;
+}
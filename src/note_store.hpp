@@ -0,0 +1,49 @@
+#ifndef NOTE_STORE_HPP
+#define NOTE_STORE_HPP
+
+#include "list.hpp"
+
+// the notes of a clip, for editing. each pitch has its own lane of notes
+// sorted by start, and each lane keeps how far the notes up to each one
+// reach, so that the notes in a window of time and pitch are found with a
+// binary search per lane instead of a scan of the clip.
+
+static const int NOTE_STORE_PITCH_COUNT = 128;
+
+struct NoteStoreNote {
+    // in whole notes
+    double start;
+    double end;
+    int pitch;
+    int velocity;
+};
+
+struct NoteStoreEntry {
+    NoteStoreNote note;
+    // the latest end of this note and all the ones before it in the lane
+    double reach;
+};
+
+struct NoteStore {
+    List<NoteStoreEntry> lanes[NOTE_STORE_PITCH_COUNT];
+    int note_count;
+};
+
+void note_store_init(NoteStore *store);
+
+// leaves the store as it was if it runs out of memory
+int note_store_add(NoteStore *store, const NoteStoreNote &note);
+// removes the note with the same start, end and pitch. returns whether
+// there was one.
+bool note_store_remove(NoteStore *store, const NoteStoreNote &note);
+void note_store_clear(NoteStore *store);
+
+// appends the notes which sound in [start, end) and have a pitch from
+// low_pitch to high_pitch, lowest pitch first, then by start
+int note_store_query(const NoteStore *store, double start, double end,
+        int low_pitch, int high_pitch, List<NoteStoreNote> &out_notes);
+// the latest starting note of pitch which sounds at pos, or nullptr. the
+// pointer is good until the next change.
+const NoteStoreNote *note_store_find(const NoteStore *store, int pitch, double pos);
+
+#endif
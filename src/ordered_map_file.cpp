@@ -1,72 +1,647 @@
 #include "ordered_map_file.hpp"
 #include "crc32.hpp"
+#include "lz4.hpp"
 
 static const int UUID_SIZE = 16;
-static const char *UUID = "\xca\x2f\x5e\xf5\x00\xd8\xef\x0b\x80\x74\x18\xd0\xe4\x0b\x7a\x4f";
+// the uuid at the start of a file says which checksum its transactions use.
+// files from before crc32c are still read and appended to, and compaction
+// rewrites them with UUID.
+static const char *UUID = "\x2d\x3a\x16\x62\x0f\xa3\x32\x6c\xcf\x7b\x9a\xe7\xf6\xff\xa7\x34";
+static const char *CRC32_UUID = "\xca\x2f\x5e\xf5\x00\xd8\xef\x0b\x80\x74\x18\xd0\xe4\x0b\x7a\x4f";
 
 static const int TRANSACTION_METADATA_SIZE = 16;
 static const int MAX_TRANSACTION_SIZE = 2147483640;
+// compaction splits the snapshot into transactions of about this size
+static const int SNAPSHOT_TRANSACTION_SIZE = 16 * 1024 * 1024;
+
+// a transaction whose put count has this bit set is compressed. after its
+// metadata come the size of the transaction without compression and then
+// an lz4 block of everything which would follow the metadata. the crc
+// covers the compressed bytes, as it covers any others.
+static const uint32_t TRANSACTION_COMPRESSED = 0x80000000;
+static const int COMPRESSED_METADATA_SIZE = TRANSACTION_METADATA_SIZE + 4;
+// smaller transactions are written as they are
+static const int MIN_COMPRESS_SIZE = 256;
+// with compression, compaction splits the snapshot into blocks of about this
+// size. they are bigger than most batches, which compresses them better,
+// and small enough that reading one value does not decompress much.
+static const int COMPRESSED_SNAPSHOT_BLOCK_SIZE = 256 * 1024;
+
+static const double DEFAULT_COMPACTION_RATIO = 1.0;
+static const long DEFAULT_COMPACTION_MIN_DEAD_BYTES = 1024 * 1024;
+// batches waiting for the write thread. ordered_map_file_batch_exec waits
+// for room once this many are queued, such as during a long compaction.
+static const int WRITE_QUEUE_CAPACITY = 4096;
+
+// compaction writes a sorted index of the snapshot as the first
+// transaction. it has no puts or dels, so a replay skips it. after the
+// metadata come INDEX_MAGIC, the entry count and the offset where the
+// snapshot ends, then for each key in order the offset of its value, the key
+// size and the value size. in the snapshot a key is right before its value.
+static const char *INDEX_MAGIC = "gdaw-idx";
+static const int INDEX_MAGIC_SIZE = 8;
+static const int INDEX_HEADER_SIZE = TRANSACTION_METADATA_SIZE + INDEX_MAGIC_SIZE + 8;
+static const int INDEX_ENTRY_SIZE = 12;
+// with a compressed snapshot the keys can not be read from the file, so the
+// index has them. each entry has the block of the value as well, which is 0
+// for a transaction compression did not make smaller, and the keys follow
+// the entries.
+static const char *COMPRESSED_INDEX_MAGIC = "gdaw-idz";
+static const int COMPRESSED_INDEX_ENTRY_SIZE = 16;
 
-static int get_transaction_size(OrderedMapFileBatch *batch) {
-    int total = TRANSACTION_METADATA_SIZE;
-    for (int i = 0; i < batch->puts.length(); i += 1) {
-        OrderedMapFilePut *put = &batch->puts.at(i);
-        total += 8 + put->key->size + put->value->size;
+static int compare_entries(OrderedMapFileEntry * a, OrderedMapFileEntry * b) {
+    return ByteBuffer::compare(a->key, b->key);
+}
+
+static int put_record_size(OrderedMapFileEntry *entry) {
+    return 8 + entry->key.length() + entry->size;
+}
+
+static void finish_transaction(uint8_t *transaction_ptr, int transaction_size, int put_count, int del_count) {
+    write_uint32be(&transaction_ptr[4], transaction_size);
+    write_uint32be(&transaction_ptr[8], put_count);
+    write_uint32be(&transaction_ptr[12], del_count);
+    write_uint32be(&transaction_ptr[0], crc32c(0, &transaction_ptr[4], transaction_size - 4));
+}
+
+// the index of the first entry in list whose key is not less than key
+static int lower_bound(List<OrderedMapFileEntry *> *list, const ByteBuffer &key) {
+    int start = 0;
+    int end = list->length();
+    while (start < end) {
+        int middle = (start + end) / 2;
+        if (ByteBuffer::compare(list->at(middle)->key, key) < 0)
+            start = middle + 1;
+        else
+            end = middle;
+    }
+    return start;
+}
+
+// the index of key in list, or -1
+static int find_exact(List<OrderedMapFileEntry *> *list, const ByteBuffer &key) {
+    int index = lower_bound(list, key);
+    if (index < list->length() && ByteBuffer::compare(list->at(index)->key, key) == 0)
+        return index;
+    return -1;
+}
+
+static void index_put(OrderedMapFile *omf, const char *key_ptr, int key_size, int value_size,
+        long value_offset, int block)
+{
+    OrderedMapFileStats *stats = &omf->write_stats;
+    ByteBuffer key(key_ptr, key_size);
+    OrderedMapFileEntry *entry;
+    int index = lower_bound(omf->list, key);
+    if (index < omf->list->length() && ByteBuffer::compare(omf->list->at(index)->key, key) == 0) {
+        entry = omf->list->at(index);
+        stats->live_bytes -= put_record_size(entry);
+        stats->dead_bytes += put_record_size(entry);
+    } else {
+        entry = ok_mem(create_zero<OrderedMapFileEntry>());
+        entry->key = key;
+        ok_or_panic(omf->list->insert_space(index, 1));
+        omf->list->at(index) = entry;
+        omf->index_generation += 1;
+        stats->live_key_count += 1;
+    }
+    entry->offset = value_offset;
+    entry->size = value_size;
+    entry->block = block;
+    stats->live_bytes += put_record_size(entry);
+}
+
+static void index_del(OrderedMapFile *omf, const char *key_ptr, int key_size) {
+    OrderedMapFileStats *stats = &omf->write_stats;
+    ByteBuffer key(key_ptr, key_size);
+    stats->dead_bytes += 4 + key_size;
+    int index = find_exact(omf->list, key);
+    if (index < 0)
+        return;
+    OrderedMapFileEntry *entry = omf->list->at(index);
+    stats->live_bytes -= put_record_size(entry);
+    stats->dead_bytes += put_record_size(entry);
+    stats->live_key_count -= 1;
+    omf->list->remove_range(index, index + 1);
+    omf->index_generation += 1;
+    destroy(entry, 1);
+}
+
+// compresses the payload_size bytes which follow the metadata of a
+// transaction into out, after room for the compressed metadata. leaves out
+// empty if that does not make the transaction small enough.
+static void compress_transaction(const uint8_t *payload, int payload_size, ByteBuffer &out) {
+    int transaction_size = TRANSACTION_METADATA_SIZE + payload_size;
+    int bound = lz4_compress_bound(payload_size);
+    out.resize(COMPRESSED_METADATA_SIZE + bound);
+    uint8_t *transaction_ptr = (uint8_t*)out.raw();
+    int compressed_size = lz4_compress(payload, payload_size, &transaction_ptr[COMPRESSED_METADATA_SIZE], bound);
+    // not worth a decompression on every read for less than an eighth
+    int stored_size = COMPRESSED_METADATA_SIZE + compressed_size;
+    if (!compressed_size || stored_size > transaction_size - transaction_size / 8) {
+        out.resize(0);
+        return;
+    }
+    out.resize(stored_size);
+    write_uint32be(&transaction_ptr[16], transaction_size);
+}
+
+static void finish_compressed_transaction(ByteBuffer &transaction, int put_count, int del_count,
+        Crc32Function checksum)
+{
+    uint8_t *transaction_ptr = (uint8_t*)transaction.raw();
+    write_uint32be(&transaction_ptr[4], transaction.length());
+    write_uint32be(&transaction_ptr[8], put_count | TRANSACTION_COMPRESSED);
+    write_uint32be(&transaction_ptr[12], del_count);
+    write_uint32be(&transaction_ptr[0], checksum(0, &transaction_ptr[4], transaction.length() - 4));
+}
+
+// the size of the transaction without compression
+static int batch_transaction_size(OrderedMapFileBatch *batch) {
+    return batch->puts.length() + batch->dels.length();
+}
+
+// the size of the transaction as it is written
+static int batch_stored_size(OrderedMapFileBatch *batch) {
+    if (batch->compressed.length() > 0)
+        return batch->compressed.length();
+    return batch_transaction_size(batch);
+}
+
+static void compress_batch(OrderedMapFileBatch *batch) {
+    int payload_size = batch_transaction_size(batch) - TRANSACTION_METADATA_SIZE;
+    if (payload_size + TRANSACTION_METADATA_SIZE < MIN_COMPRESS_SIZE)
+        return;
+    const uint8_t *payload = (const uint8_t*)batch->puts.raw() + TRANSACTION_METADATA_SIZE;
+    // the block is compressed from one buffer
+    ByteBuffer joined;
+    if (batch->dels.length() > 0) {
+        joined.append((const char*)payload, batch->puts.length() - TRANSACTION_METADATA_SIZE);
+        joined.append(batch->dels);
+        payload = (const uint8_t*)joined.raw();
+    }
+    compress_transaction(payload, payload_size, batch->compressed);
+}
+
+static void finish_batch(OrderedMapFileBatch *batch, Crc32Function checksum) {
+    if (batch->compressed.length() > 0) {
+        finish_compressed_transaction(batch->compressed, batch->put_count, batch->del_count, checksum);
+        batch->checksum = checksum;
+        return;
+    }
+    uint8_t *transaction_ptr = (uint8_t*)batch->puts.raw();
+    write_uint32be(&transaction_ptr[4], batch_transaction_size(batch));
+    write_uint32be(&transaction_ptr[8], batch->put_count);
+    write_uint32be(&transaction_ptr[12], batch->del_count);
+    uint32_t crc = checksum(0, &transaction_ptr[4], batch->puts.length() - 4);
+    crc = checksum(crc, (const uint8_t*)batch->dels.raw(), batch->dels.length());
+    write_uint32be(&transaction_ptr[0], crc);
+    batch->checksum = checksum;
+}
+
+// updates the index for a batch whose transaction is written at file_offset
+static void index_batch(OrderedMapFile *omf, OrderedMapFileBatch *batch, long file_offset) {
+    // the values of a compressed transaction are found through its block
+    bool compressed = (batch->compressed.length() > 0);
+    int block = compressed ? file_offset : 0;
+    long value_base = compressed ? 0 : file_offset;
+    if (compressed)
+        omf->compression_saved_bytes += batch_transaction_size(batch) - batch_stored_size(batch);
+
+    const char *puts_ptr = batch->puts.raw();
+    int offset = TRANSACTION_METADATA_SIZE;
+    for (int i = 0; i < batch->put_count; i += 1) {
+        int key_size = read_uint32be(&puts_ptr[offset]);
+        int value_size = read_uint32be(&puts_ptr[offset + 4]);
+        offset += 8;
+        index_put(omf, &puts_ptr[offset], key_size, value_size, value_base + offset + key_size, block);
+        offset += key_size + value_size;
+    }
+    assert(offset == batch->puts.length());
+
+    const char *dels_ptr = batch->dels.raw();
+    offset = 0;
+    for (int i = 0; i < batch->del_count; i += 1) {
+        int key_size = read_uint32be(&dels_ptr[offset]);
+        offset += 4;
+        index_del(omf, &dels_ptr[offset], key_size);
+        offset += key_size;
+    }
+    assert(offset == batch->dels.length());
+    omf->write_stats.dead_bytes += TRANSACTION_METADATA_SIZE;
+}
+
+// the compressed transaction at transaction_ptr as it is without compression
+static int decompress_transaction(const uint8_t *transaction_ptr, ByteBuffer &out) {
+    int stored_size = read_uint32be(&transaction_ptr[4]);
+    int transaction_size = read_uint32be(&transaction_ptr[16]);
+    if (stored_size < COMPRESSED_METADATA_SIZE || transaction_size < TRANSACTION_METADATA_SIZE ||
+        transaction_size > MAX_TRANSACTION_SIZE)
+    {
+        return GenesisErrorInvalidFormat;
+    }
+    out.resize(transaction_size);
+    return lz4_decompress(&transaction_ptr[COMPRESSED_METADATA_SIZE], stored_size - COMPRESSED_METADATA_SIZE,
+        (uint8_t*)out.raw() + TRANSACTION_METADATA_SIZE, transaction_size - TRANSACTION_METADATA_SIZE);
+}
+
+// makes block the compressed transaction at block_offset, without its
+// compression. it is read from mapped when that is not null, else from file.
+static int load_block(const char *mapped, FILE *file, long block_offset, OrderedMapFileBlock *block) {
+    if (block->offset == block_offset)
+        return 0;
+    block->offset = 0;
+    int err;
+    const uint8_t *transaction_ptr;
+    if (mapped) {
+        transaction_ptr = (const uint8_t*)mapped + block_offset;
+    } else {
+        block->stored.resize(COMPRESSED_METADATA_SIZE);
+        if ((err = os_file_read_at(file, block_offset, block->stored.raw(), COMPRESSED_METADATA_SIZE)))
+            return err;
+        int stored_size = read_uint32be(&block->stored.raw()[4]);
+        if (stored_size < COMPRESSED_METADATA_SIZE)
+            return GenesisErrorInvalidFormat;
+        block->stored.resize(stored_size);
+        if ((err = os_file_read_at(file, block_offset + COMPRESSED_METADATA_SIZE,
+            block->stored.raw() + COMPRESSED_METADATA_SIZE, stored_size - COMPRESSED_METADATA_SIZE)))
+        {
+            return err;
+        }
+        transaction_ptr = (const uint8_t*)block->stored.raw();
+    }
+    if ((err = decompress_transaction(transaction_ptr, block->data)))
+        return err;
+    block->offset = block_offset;
+    return 0;
+}
+
+// copies the value of entry to dest, out of mapped when that is not null,
+// else out of file
+static int copy_value(const char *mapped, FILE *file, OrderedMapFileBlock *block,
+        OrderedMapFileEntry *entry, char *dest)
+{
+    if (entry->block) {
+        int err;
+        if ((err = load_block(mapped, file, entry->block, block)))
+            return err;
+        memcpy(dest, block->data.raw() + entry->offset, entry->size);
+        return 0;
+    }
+    if (mapped) {
+        memcpy(dest, mapped + entry->offset, entry->size);
+        return 0;
+    }
+    return os_file_read_at(file, entry->offset, dest, entry->size);
+}
+
+// writes the snapshot transaction in write_buffer to file, compressed into
+// compressed if that is not null and compression makes it smaller
+static int write_snapshot_transaction(OrderedMapFile *omf, FILE *file, int put_count,
+        ByteBuffer *compressed, long *file_offset, long *saved_bytes, bool *out_compressed)
+{
+    int transaction_size = omf->write_buffer.length();
+    const char *transaction_ptr = omf->write_buffer.raw();
+    int stored_size = transaction_size;
+    *out_compressed = false;
+    if (compressed) {
+        compress_transaction((const uint8_t*)transaction_ptr + TRANSACTION_METADATA_SIZE,
+                transaction_size - TRANSACTION_METADATA_SIZE, *compressed);
+        if (compressed->length() > 0) {
+            finish_compressed_transaction(*compressed, put_count, 0, crc32c);
+            transaction_ptr = compressed->raw();
+            stored_size = compressed->length();
+            *saved_bytes += transaction_size - stored_size;
+            *out_compressed = true;
+        }
+    }
+    if (!*out_compressed)
+        finish_transaction((uint8_t*)omf->write_buffer.raw(), transaction_size, put_count, 0);
+    if (fwrite(transaction_ptr, 1, stored_size, file) != (size_t)stored_size)
+        return GenesisErrorFileAccess;
+    *file_offset += stored_size;
+    omf->write_buffer.resize(TRANSACTION_METADATA_SIZE);
+    return 0;
+}
+
+// the size of the index compaction writes, which with compression has the
+// keys too
+static long compaction_index_size(List<OrderedMapFileEntry *> &entries, bool compress) {
+    if (!compress)
+        return INDEX_HEADER_SIZE + (long)entries.length() * INDEX_ENTRY_SIZE;
+    long index_size = INDEX_HEADER_SIZE + (long)entries.length() * COMPRESSED_INDEX_ENTRY_SIZE;
+    for (int i = 0; i < entries.length(); i += 1)
+        index_size += entries.at(i)->key.length();
+    return index_size;
+}
+
+static int write_index(OrderedMapFile *omf, FILE *file, List<OrderedMapFileEntry *> &entries,
+        const List<long> &offsets, const List<int> &blocks, long index_size, long snapshot_end,
+        bool compress)
+{
+    omf->write_buffer.resize(index_size);
+    uint8_t *index_ptr = (uint8_t*)omf->write_buffer.raw();
+    memcpy(&index_ptr[TRANSACTION_METADATA_SIZE], compress ? COMPRESSED_INDEX_MAGIC : INDEX_MAGIC,
+            INDEX_MAGIC_SIZE);
+    write_uint32be(&index_ptr[TRANSACTION_METADATA_SIZE + INDEX_MAGIC_SIZE], entries.length());
+    write_uint32be(&index_ptr[TRANSACTION_METADATA_SIZE + INDEX_MAGIC_SIZE + 4], snapshot_end);
+    long key_offset = INDEX_HEADER_SIZE + (long)entries.length() * COMPRESSED_INDEX_ENTRY_SIZE;
+    for (int i = 0; i < entries.length(); i += 1) {
+        OrderedMapFileEntry *entry = entries.at(i);
+        if (!compress) {
+            uint8_t *index_entry_ptr = &index_ptr[INDEX_HEADER_SIZE + i * INDEX_ENTRY_SIZE];
+            write_uint32be(&index_entry_ptr[0], offsets.at(i));
+            write_uint32be(&index_entry_ptr[4], entry->key.length());
+            write_uint32be(&index_entry_ptr[8], entry->size);
+            continue;
+        }
+        uint8_t *index_entry_ptr = &index_ptr[INDEX_HEADER_SIZE + i * COMPRESSED_INDEX_ENTRY_SIZE];
+        write_uint32be(&index_entry_ptr[0], blocks.at(i));
+        write_uint32be(&index_entry_ptr[4], offsets.at(i));
+        write_uint32be(&index_entry_ptr[8], entry->key.length());
+        write_uint32be(&index_entry_ptr[12], entry->size);
+        memcpy(&index_ptr[key_offset], entry->key.raw(), entry->key.length());
+        key_offset += entry->key.length();
+    }
+    finish_transaction(index_ptr, index_size, 0, 0);
+    if (fwrite(index_ptr, 1, index_size, file) != (size_t)index_size)
+        return GenesisErrorFileAccess;
+    return 0;
+}
+
+// with compression, the offsets of the values from start to end are from
+// the start of their transaction until it is written at transaction_offset
+static void place_snapshot_values(List<long> &offsets, List<int> &blocks, int start, int end,
+        long transaction_offset, bool compressed)
+{
+    for (int i = start; i < end; i += 1) {
+        if (compressed) {
+            blocks.at(i) = transaction_offset;
+        } else {
+            blocks.at(i) = 0;
+            offsets.at(i) += transaction_offset;
+        }
+    }
+}
+
+// writes every live key to "<path>.compact", with the values read from the
+// old file, and renames it over path. on failure the old file stays. the
+// new file always uses crc32c.
+static int compact(OrderedMapFile *omf) {
+    // only this thread changes the list, so it can be read without the lock
+    List<OrderedMapFileEntry *> &entries = *omf->list;
+    // with compression, where each value goes is only known once its
+    // transaction is compressed, so the index is written last
+    bool compress = omf->compression.load();
+    int snapshot_transaction_size = compress ? COMPRESSED_SNAPSHOT_BLOCK_SIZE : SNAPSHOT_TRANSACTION_SIZE;
+    List<long> offsets;
+    List<int> blocks;
+    if (offsets.resize(entries.length()) || blocks.resize(entries.length()))
+        return GenesisErrorNoMem;
+
+    long index_size = compaction_index_size(entries, compress);
+    bool with_index = (index_size <= MAX_TRANSACTION_SIZE);
+    long snapshot_end = UUID_SIZE + (with_index ? index_size : 0);
+    if (!compress) {
+        // lay out the snapshot first, so that the index can go before it
+        long chunk_size = TRANSACTION_METADATA_SIZE;
+        for (int i = 0; i < entries.length(); i += 1) {
+            OrderedMapFileEntry *entry = entries.at(i);
+            int record_size = put_record_size(entry);
+            if (chunk_size > TRANSACTION_METADATA_SIZE && chunk_size + record_size > snapshot_transaction_size) {
+                snapshot_end += chunk_size;
+                chunk_size = TRANSACTION_METADATA_SIZE;
+            }
+            offsets.at(i) = snapshot_end + chunk_size + 8 + entry->key.length();
+            blocks.at(i) = 0;
+            chunk_size += record_size;
+        }
+        if (chunk_size > TRANSACTION_METADATA_SIZE)
+            snapshot_end += chunk_size;
+    }
+
+    ByteBuffer tmp_path;
+    tmp_path.format("%s.compact", omf->path.raw());
+    FILE *file = fopen(tmp_path.raw(), "wb+");
+    if (!file)
+        return GenesisErrorFileAccess;
+
+    int err = 0;
+    long file_offset = UUID_SIZE;
+    if (fwrite(UUID, 1, UUID_SIZE, file) != UUID_SIZE)
+        err = GenesisErrorFileAccess;
+
+    if (!err && with_index) {
+        if (compress) {
+            // zeros until the snapshot is written
+            omf->write_buffer.resize(index_size);
+            memset(omf->write_buffer.raw(), 0, index_size);
+            if (fwrite(omf->write_buffer.raw(), 1, index_size, file) != (size_t)index_size)
+                err = GenesisErrorFileAccess;
+        } else {
+            err = write_index(omf, file, entries, offsets, blocks, index_size, snapshot_end, false);
+        }
+        file_offset += index_size;
+    }
+
+    ByteBuffer compressed;
+    OrderedMapFileBlock block;
+    block.offset = 0;
+    long saved_bytes = 0;
+    int put_count = 0;
+    int first_put = 0;
+    omf->write_buffer.resize(TRANSACTION_METADATA_SIZE);
+    for (int i = 0; i < entries.length() && !err; i += 1) {
+        OrderedMapFileEntry *entry = entries.at(i);
+        int record_size = put_record_size(entry);
+        if (put_count > 0 && omf->write_buffer.length() + record_size > snapshot_transaction_size) {
+            long transaction_offset = file_offset;
+            bool written_compressed;
+            if ((err = write_snapshot_transaction(omf, file, put_count, compress ? &compressed : nullptr,
+                &file_offset, &saved_bytes, &written_compressed)))
+            {
+                break;
+            }
+            if (compress)
+                place_snapshot_values(offsets, blocks, first_put, i, transaction_offset, written_compressed);
+            put_count = 0;
+            first_put = i;
+        }
+
+        int offset = omf->write_buffer.length();
+        omf->write_buffer.resize(offset + record_size);
+        uint8_t *record_ptr = (uint8_t*)omf->write_buffer.raw() + offset;
+        int key_size = entry->key.length();
+        write_uint32be(&record_ptr[0], key_size);
+        write_uint32be(&record_ptr[4], entry->size);
+        memcpy(&record_ptr[8], entry->key.raw(), key_size);
+        if ((err = copy_value(nullptr, omf->file, &block, entry, (char*)&record_ptr[8 + key_size])))
+            break;
+        if (compress)
+            offsets.at(i) = offset + 8 + key_size;
+        else
+            assert(offsets.at(i) == file_offset + offset + 8 + key_size);
+        put_count += 1;
+    }
+    if (!err && put_count > 0) {
+        long transaction_offset = file_offset;
+        bool written_compressed;
+        err = write_snapshot_transaction(omf, file, put_count, compress ? &compressed : nullptr,
+                &file_offset, &saved_bytes, &written_compressed);
+        if (!err && compress)
+            place_snapshot_values(offsets, blocks, first_put, entries.length(), transaction_offset, written_compressed);
+    }
+    if (!err && compress) {
+        snapshot_end = file_offset;
+        if (with_index) {
+            if (fseek(file, UUID_SIZE, SEEK_SET))
+                err = GenesisErrorFileAccess;
+            if (!err)
+                err = write_index(omf, file, entries, offsets, blocks, index_size, snapshot_end, true);
+        }
+    }
+    assert(err || file_offset == snapshot_end);
+    if (!err)
+        err = os_file_data_sync(file);
+    if (!err)
+        err = os_rename_clobber(tmp_path.raw(), omf->path.raw());
+
+    if (err) {
+        fclose(file);
+        os_delete(tmp_path.raw());
+        return err;
     }
-    for (int i = 0; i < batch->dels.length(); i += 1) {
-        OrderedMapFileDel *del = &batch->dels.at(i);
-        total += 4 + del->key->size;
 
+    os_mutex_lock(omf->index_mutex);
+    os_mutex_lock(omf->mutex);
+    FILE *old_file = omf->file;
+    omf->file = file;
+    omf->checksum.store(crc32c);
+    os_mutex_unlock(omf->mutex);
+    for (int i = 0; i < entries.length(); i += 1) {
+        entries.at(i)->offset = offsets.at(i);
+        entries.at(i)->block = blocks.at(i);
     }
-    return total;
+    // the old offsets are gone with the old file
+    omf->read_block.offset = 0;
+    os_mutex_unlock(omf->index_mutex);
+    fclose(old_file);
+
+    omf->transaction_offset = file_offset;
+    omf->compression_saved_bytes = saved_bytes;
+
+    OrderedMapFileStats *stats = &omf->write_stats;
+    stats->dead_bytes = file_offset + saved_bytes - UUID_SIZE - stats->live_bytes;
+    stats->compaction_count += 1;
+    stats->last_compaction_time = os_get_time();
+    return 0;
+}
+
+static bool should_compact(OrderedMapFile *omf, double ratio, long min_dead_bytes) {
+    OrderedMapFileStats *stats = &omf->write_stats;
+    if (ratio < 0.0)
+        return false;
+    if (stats->dead_bytes < min_dead_bytes || stats->dead_bytes < omf->compaction_retry_dead_bytes)
+        return false;
+    return stats->dead_bytes >= ratio * stats->live_bytes;
 }
 
 static void run_write(void *userdata) {
     OrderedMapFile *omf = (OrderedMapFile *)userdata;
 
+    List<OrderedMapFileBatch *> batches;
+    List<OsFileSlice> slices;
+    bool unsynced = false;
+    double last_sync_time = os_get_time();
     for (;;) {
-        OrderedMapFileBatch *batch = nullptr;
-        omf->queue.shift(&batch);
-        if (!batch || !omf->running)
+        int durability = omf->durability.load();
+        double sync_interval = omf->sync_interval_ms.load() / 1000.0;
+
+        // with an interval policy, wake up in time to sync what is already written
+        double timeout = -1.0;
+        if (unsynced && durability == OrderedMapFileDurabilityInterval)
+            timeout = max(0.0, last_sync_time + sync_interval - os_get_time());
+
+        batches.clear();
+        int err = omf->queue.shift_all(batches, timeout);
+        if (err == GenesisErrorAborted || !omf->running) {
+            for (int i = 0; i < batches.length(); i += 1)
+                ordered_map_file_batch_destroy(batches.at(i));
             break;
+        }
 
-        // compute transaction size
-        int transaction_size = get_transaction_size(batch);
-        omf->write_buffer.resize(transaction_size);
+        if (batches.length() > 0) {
+            // readers must not see the index change before the values are
+            // in the file
+            os_mutex_lock(omf->index_mutex);
+
+            // every transaction in the group goes out in one write, straight
+            // from the batches
+            slices.clear();
+            long file_offset = omf->transaction_offset;
+            Crc32Function checksum = omf->checksum.load();
+            for (int i = 0; i < batches.length(); i += 1) {
+                OrderedMapFileBatch *batch = batches.at(i);
+                // queued before a compaction changed the checksum
+                if (batch->checksum != checksum)
+                    finish_batch(batch, checksum);
+                index_batch(omf, batch, file_offset);
+                file_offset += batch_stored_size(batch);
+                if (batch->compressed.length() > 0) {
+                    ok_or_panic(slices.append({batch->compressed.raw(), batch->compressed.length()}));
+                    continue;
+                }
+                ok_or_panic(slices.append({batch->puts.raw(), batch->puts.length()}));
+                if (batch->dels.length() > 0)
+                    ok_or_panic(slices.append({batch->dels.raw(), batch->dels.length()}));
+            }
 
-        uint8_t *transaction_ptr = (uint8_t*)omf->write_buffer.raw();
-        write_uint32be(&transaction_ptr[4], transaction_size);
-        write_uint32be(&transaction_ptr[8], batch->puts.length());
-        write_uint32be(&transaction_ptr[12], batch->dels.length());
+            if ((err = os_file_write_at(omf->file, omf->transaction_offset, &slices.at(0), slices.length())))
+                panic("write to disk failed: %s", genesis_strerror(err));
+            omf->transaction_offset = file_offset;
+            for (int i = 0; i < batches.length(); i += 1)
+                ordered_map_file_batch_destroy(batches.at(i));
+            os_mutex_unlock(omf->index_mutex);
+            unsynced = true;
+        }
 
-        int offset = TRANSACTION_METADATA_SIZE;
-        for (int i = 0; i < batch->puts.length(); i += 1) {
-            OrderedMapFilePut *put = &batch->puts.at(i);
-            write_uint32be(&transaction_ptr[offset], put->key->size); offset += 4;
-            write_uint32be(&transaction_ptr[offset], put->value->size); offset += 4;
-            memcpy(&transaction_ptr[offset], put->key->data, put->key->size); offset += put->key->size;
-            memcpy(&transaction_ptr[offset], put->value->data, put->value->size); offset += put->value->size;
+        bool sync = false;
+        if (unsynced) {
+            if (durability == OrderedMapFileDurabilityGroup)
+                sync = true;
+            else if (durability == OrderedMapFileDurabilityInterval)
+                sync = (os_get_time() - last_sync_time >= sync_interval);
         }
-        for (int i = 0; i < batch->dels.length(); i += 1) {
-            OrderedMapFileDel *del = &batch->dels.at(i);
-            write_uint32be(&transaction_ptr[offset], del->key->size); offset += 4;
-            memcpy(&transaction_ptr[offset], del->key->data, del->key->size); offset += del->key->size;
+        if (sync) {
+            if ((err = os_file_data_sync(omf->file)))
+                panic("sync file fail: %s", genesis_strerror(err));
+            unsynced = false;
+            last_sync_time = os_get_time();
         }
-        assert(offset == transaction_size);
 
-        ordered_map_file_batch_destroy(batch);
-
-        // compute crc32
-        write_uint32be(&transaction_ptr[0], crc32(0, &transaction_ptr[4], transaction_size - 4));
-
-        // append to file
-        size_t amt_written = fwrite(transaction_ptr, 1, transaction_size, omf->file);
-        if (amt_written != (size_t)transaction_size)
-            panic("write to disk failed");
+        if (batches.length() > 0) {
+            os_mutex_lock(omf->mutex);
+            double compaction_ratio = omf->compaction_ratio;
+            long compaction_min_dead_bytes = omf->compaction_min_dead_bytes;
+            os_mutex_unlock(omf->mutex);
+
+            if (should_compact(omf, compaction_ratio, compaction_min_dead_bytes)) {
+                if ((err = compact(omf))) {
+                    fprintf(stderr, "Warning: unable to compact project file: %s\n", genesis_strerror(err));
+                    omf->compaction_retry_dead_bytes = omf->write_stats.dead_bytes * 2;
+                } else {
+                    omf->compaction_retry_dead_bytes = 0;
+                    last_sync_time = os_get_time();
+                    unsynced = false;
+                }
+            }
 
-        os_mutex_lock(omf->mutex);
-        os_cond_signal(omf->cond, omf->mutex);
-        os_mutex_unlock(omf->mutex);
+            os_mutex_lock(omf->mutex);
+            omf->stats = omf->write_stats;
+            omf->written_count += batches.length();
+            os_cond_broadcast(omf->cond, omf->mutex);
+            os_mutex_unlock(omf->mutex);
+        }
     }
 }
 
@@ -74,6 +649,7 @@ static int write_header(OrderedMapFile *omf) {
     size_t amt_written = fwrite(UUID, 1, UUID_SIZE, omf->file);
     if (amt_written != UUID_SIZE)
         return GenesisErrorFileAccess;
+    omf->checksum.store(crc32c);
     return 0;
 }
 
@@ -87,16 +663,16 @@ static int read_header(OrderedMapFile *omf) {
     if (amt_read != UUID_SIZE)
         return GenesisErrorInvalidFormat;
 
-    if (memcmp(UUID, uuid_buf, UUID_SIZE) != 0)
+    if (memcmp(UUID, uuid_buf, UUID_SIZE) == 0)
+        omf->checksum.store(crc32c);
+    else if (memcmp(CRC32_UUID, uuid_buf, UUID_SIZE) == 0)
+        omf->checksum.store(crc32);
+    else
         return GenesisErrorInvalidFormat;
 
     return 0;
 }
 
-static int compare_entries(OrderedMapFileEntry * a, OrderedMapFileEntry * b) {
-    return ByteBuffer::compare(a->key, b->key);
-}
-
 static void destroy_map(OrderedMapFile *omf) {
     if (omf->map) {
         auto it = omf->map->entry_iterator();
@@ -113,6 +689,359 @@ static void destroy_map(OrderedMapFile *omf) {
     }
 }
 
+// transactions at least this many bytes in total have their crcs checked
+// on more than one thread
+static const long PARALLEL_CRC_MIN_BYTES = 4 * 1024 * 1024;
+static const int MAX_CRC_THREADS = 64;
+
+struct CrcCheck {
+    Crc32Function checksum;
+    const uint8_t *data;
+    const long *offsets;
+    int start;
+    int end;
+    // index of the first transaction with a bad crc, or end
+    int first_bad;
+};
+
+static void run_crc_check(void *userdata) {
+    CrcCheck *check = (CrcCheck *)userdata;
+    check->first_bad = check->end;
+    for (int i = check->start; i < check->end; i += 1) {
+        const uint8_t *transaction_ptr = check->data + check->offsets[i];
+        int transaction_size = read_uint32be(&transaction_ptr[4]);
+        uint32_t computed_crc = check->checksum(0, &transaction_ptr[4], transaction_size - 4);
+        if (computed_crc != read_uint32be(&transaction_ptr[0])) {
+            check->first_bad = i;
+            return;
+        }
+    }
+}
+
+// returns how many transactions from the start have good crcs. the
+// transactions are split into runs of about the same number of bytes, one
+// per thread.
+static int check_crcs(Crc32Function checksum, const uint8_t *data, const List<long> &offsets,
+        long end_offset)
+{
+    int transaction_count = offsets.length();
+    if (transaction_count == 0)
+        return 0;
+    long total_bytes = end_offset - offsets.at(0);
+    int thread_count = (total_bytes < PARALLEL_CRC_MIN_BYTES) ? 1 :
+        min(min(os_concurrency(), transaction_count), MAX_CRC_THREADS);
+
+    CrcCheck checks[MAX_CRC_THREADS];
+    OsThread *threads[MAX_CRC_THREADS];
+    int start = 0;
+    for (int t = 0; t < thread_count; t += 1) {
+        long end_target = offsets.at(0) + total_bytes * (t + 1) / thread_count;
+        int end = start;
+        while (end < transaction_count && (t + 1 == thread_count || offsets.at(end) < end_target))
+            end += 1;
+        CrcCheck *check = &checks[t];
+        check->checksum = checksum;
+        check->data = data;
+        check->offsets = &offsets.at(0);
+        check->start = start;
+        check->end = end;
+        threads[t] = nullptr;
+        if (t > 0 && os_thread_create(run_crc_check, check, false, &threads[t]))
+            threads[t] = nullptr;
+        start = end;
+    }
+    for (int t = 0; t < thread_count; t += 1) {
+        // the first run, and any without a thread, are checked here
+        if (!threads[t])
+            run_crc_check(&checks[t]);
+    }
+    for (int t = 0; t < thread_count; t += 1)
+        os_thread_destroy(threads[t]);
+    for (int t = 0; t < thread_count; t += 1) {
+        if (checks[t].first_bad < checks[t].end)
+            return checks[t].first_bad;
+    }
+    return transaction_count;
+}
+
+static void destroy_entries(List<OrderedMapFileEntry *> &entries) {
+    for (int i = 0; i < entries.length(); i += 1)
+        destroy(entries.at(i), 1);
+    entries.clear();
+}
+
+// reads the index which compaction writes at the start of the file into
+// base, which is then sorted. out_snapshot_end is where the transactions to
+// replay start, which without a good index is right after the header.
+static int load_index(Crc32Function checksum, const uint8_t *data, long file_size,
+        List<OrderedMapFileEntry *> &base, long *out_snapshot_end)
+{
+    *out_snapshot_end = UUID_SIZE;
+    if (file_size - UUID_SIZE < INDEX_HEADER_SIZE)
+        return 0;
+    const uint8_t *index_ptr = data + UUID_SIZE;
+    long index_size = read_uint32be(&index_ptr[4]);
+    if (index_size < INDEX_HEADER_SIZE || index_size > file_size - UUID_SIZE ||
+        read_uint32be(&index_ptr[8]) != 0 || read_uint32be(&index_ptr[12]) != 0)
+    {
+        return 0;
+    }
+    bool compressed;
+    if (memcmp(&index_ptr[TRANSACTION_METADATA_SIZE], INDEX_MAGIC, INDEX_MAGIC_SIZE) == 0)
+        compressed = false;
+    else if (memcmp(&index_ptr[TRANSACTION_METADATA_SIZE], COMPRESSED_INDEX_MAGIC, INDEX_MAGIC_SIZE) == 0)
+        compressed = true;
+    else
+        return 0;
+    if (checksum(0, &index_ptr[4], index_size - 4) != read_uint32be(&index_ptr[0]))
+        return 0;
+
+    long entry_count = read_uint32be(&index_ptr[TRANSACTION_METADATA_SIZE + INDEX_MAGIC_SIZE]);
+    long snapshot_start = UUID_SIZE + index_size;
+    long snapshot_end = read_uint32be(&index_ptr[TRANSACTION_METADATA_SIZE + INDEX_MAGIC_SIZE + 4]);
+    int entry_size = compressed ? COMPRESSED_INDEX_ENTRY_SIZE : INDEX_ENTRY_SIZE;
+    long keys_offset = INDEX_HEADER_SIZE + entry_count * entry_size;
+    if ((compressed ? index_size < keys_offset : index_size != keys_offset) ||
+        snapshot_end < snapshot_start || snapshot_end > file_size)
+    {
+        return 0;
+    }
+
+    if (base.ensure_capacity(entry_count))
+        return GenesisErrorNoMem;
+    long key_offset = keys_offset;
+    for (long i = 0; i < entry_count; i += 1) {
+        const uint8_t *index_entry_ptr = &index_ptr[INDEX_HEADER_SIZE + i * entry_size];
+        long block = compressed ? read_uint32be(&index_entry_ptr[0]) : 0;
+        const uint8_t *fields_ptr = compressed ? &index_entry_ptr[4] : index_entry_ptr;
+        long value_offset = read_uint32be(&fields_ptr[0]);
+        int key_size = read_uint32be(&fields_ptr[4]);
+        int value_size = read_uint32be(&fields_ptr[8]);
+        bool usable;
+        if (!block) {
+            usable = (value_offset - key_size >= snapshot_start && value_offset + value_size <= snapshot_end);
+        } else {
+            // the value is checked against the size of its block without
+            // compression
+            const uint8_t *block_ptr = &data[block];
+            usable = (block >= snapshot_start && block <= snapshot_end - COMPRESSED_METADATA_SIZE &&
+                (read_uint32be(&block_ptr[8]) & TRANSACTION_COMPRESSED) &&
+                value_offset - key_size >= TRANSACTION_METADATA_SIZE &&
+                value_offset + value_size <= read_uint32be(&block_ptr[16]));
+        }
+        if (compressed) {
+            usable = usable && key_size >= 0 && key_size <= index_size - key_offset;
+            key_offset += key_size;
+        }
+        if (!usable) {
+            // not an index this can use. replay everything instead.
+            destroy_entries(base);
+            return 0;
+        }
+        OrderedMapFileEntry *entry = create_zero<OrderedMapFileEntry>();
+        if (!entry) {
+            destroy_entries(base);
+            return GenesisErrorNoMem;
+        }
+        const uint8_t *key_ptr = compressed ? &index_ptr[key_offset - key_size] : &data[value_offset - key_size];
+        entry->key = ByteBuffer((const char*)key_ptr, key_size);
+        entry->offset = value_offset;
+        entry->size = value_size;
+        entry->block = block;
+        ok_or_panic(base.append(entry));
+    }
+    if (key_offset != index_size) {
+        destroy_entries(base);
+        return 0;
+    }
+
+    *out_snapshot_end = snapshot_end;
+    return 0;
+}
+
+// merges the sorted base with the entries replayed into omf->map, which
+// win, into omf->list. a replayed entry with a negative size is a delete.
+static int merge_replayed(OrderedMapFile *omf, List<OrderedMapFileEntry *> &base) {
+    List<OrderedMapFileEntry *> replayed;
+    if (replayed.ensure_capacity(omf->map->size()) ||
+        omf->list->ensure_capacity(base.length() + omf->map->size()))
+    {
+        return GenesisErrorNoMem;
+    }
+    auto it = omf->map->entry_iterator();
+    for (;;) {
+        auto *map_entry = it.next();
+        if (!map_entry)
+            break;
+        ok_or_panic(replayed.append(map_entry->value));
+    }
+    omf->map->clear();
+    replayed.sort<compare_entries>();
+
+    int base_i = 0;
+    int replayed_i = 0;
+    while (base_i < base.length() || replayed_i < replayed.length()) {
+        int cmp;
+        if (base_i == base.length())
+            cmp = 1;
+        else if (replayed_i == replayed.length())
+            cmp = -1;
+        else
+            cmp = compare_entries(base.at(base_i), replayed.at(replayed_i));
+
+        if (cmp < 0) {
+            ok_or_panic(omf->list->append(base.at(base_i)));
+            base_i += 1;
+            continue;
+        }
+        if (cmp == 0) {
+            destroy(base.at(base_i), 1);
+            base_i += 1;
+        }
+        OrderedMapFileEntry *entry = replayed.at(replayed_i);
+        replayed_i += 1;
+        if (entry->size < 0)
+            destroy(entry, 1);
+        else
+            ok_or_panic(omf->list->append(entry));
+    }
+    base.clear();
+    return 0;
+}
+
+// indexes the file through a mapping of it. entries point at their values
+// in the file, which ordered_map_file_get copies out of the mapping. with
+// an index from compaction, only what was written after it is replayed.
+static int load_mapped(OrderedMapFile *omf, bool *out_partial_transaction) {
+    int err;
+    if ((err = os_map_file(omf->path.raw(), &omf->mapped_file)))
+        return err;
+    const uint8_t *data = (const uint8_t *)omf->mapped_file.address;
+    long file_size = omf->mapped_file.size;
+
+    List<OrderedMapFileEntry *> base;
+    long offset;
+    Crc32Function checksum = omf->checksum.load();
+    if ((err = load_index(checksum, data, file_size, base, &offset)))
+        return err;
+    omf->transaction_offset = offset;
+
+    // find where each transaction starts, from the sizes alone
+    List<long> offsets;
+    while (offset < file_size) {
+        if (file_size - offset < TRANSACTION_METADATA_SIZE) {
+            *out_partial_transaction = true;
+            break;
+        }
+        long transaction_size = read_uint32be(&data[offset + 4]);
+        if (transaction_size < TRANSACTION_METADATA_SIZE ||
+            transaction_size > MAX_TRANSACTION_SIZE ||
+            transaction_size > file_size - offset)
+        {
+            *out_partial_transaction = true;
+            break;
+        }
+        if (offsets.append(offset)) {
+            destroy_entries(base);
+            return GenesisErrorNoMem;
+        }
+        offset += transaction_size;
+    }
+
+    // ignore the first transaction whose crc check fails and everything after it
+    int good_count = check_crcs(checksum, data, offsets, offset);
+    if (good_count < offsets.length())
+        *out_partial_transaction = true;
+
+    for (int transaction_i = 0; transaction_i < good_count; transaction_i += 1) {
+        long transaction_offset = offsets.at(transaction_i);
+        const uint8_t *transaction_ptr = data + transaction_offset;
+        int stored_size = read_uint32be(&transaction_ptr[4]);
+        uint32_t put_word = read_uint32be(&transaction_ptr[8]);
+        int put_count = put_word & ~TRANSACTION_COMPRESSED;
+        int del_count = read_uint32be(&transaction_ptr[12]);
+
+        // a compressed transaction is read as it is without compression,
+        // and its values are found through its block
+        int transaction_size = stored_size;
+        int block = 0;
+        long value_base = transaction_offset;
+        if (put_word & TRANSACTION_COMPRESSED) {
+            if ((err = load_block((const char*)data, nullptr, transaction_offset, &omf->read_block))) {
+                destroy_entries(base);
+                return err;
+            }
+            transaction_ptr = (const uint8_t*)omf->read_block.data.raw();
+            transaction_size = omf->read_block.data.length();
+            block = transaction_offset;
+            value_base = 0;
+            omf->compression_saved_bytes += transaction_size - stored_size;
+        }
+
+        int offset = TRANSACTION_METADATA_SIZE;
+        for (int i = 0; i < put_count; i += 1) {
+            int key_size = read_uint32be(&transaction_ptr[offset]); offset += 4;
+            int val_size = read_uint32be(&transaction_ptr[offset]); offset += 4;
+            ByteBuffer key((const char*)&transaction_ptr[offset], key_size); offset += key_size;
+
+            // a key put again moves its entry to the new value
+            OrderedMapFileEntry *entry;
+            auto hash_entry = omf->map->maybe_get(key);
+            if (hash_entry) {
+                entry = hash_entry->value;
+            } else {
+                if (!(entry = create_zero<OrderedMapFileEntry>())) {
+                    destroy_entries(base);
+                    return GenesisErrorNoMem;
+                }
+                entry->key = key;
+                omf->map->put(entry->key, entry);
+            }
+            entry->offset = value_base + offset;
+            entry->size = val_size;
+            entry->block = block;
+            offset += val_size;
+        }
+        for (int i = 0; i < del_count; i += 1) {
+            int key_size = read_uint32be(&transaction_ptr[offset]); offset += 4;
+            ByteBuffer key((const char*)&transaction_ptr[offset], key_size); offset += key_size;
+
+            auto hash_entry = omf->map->maybe_get(key);
+            if (base.length() > 0) {
+                // the key may be in base, so remember the delete for the merge
+                OrderedMapFileEntry *entry;
+                if (hash_entry) {
+                    entry = hash_entry->value;
+                } else {
+                    if (!(entry = create_zero<OrderedMapFileEntry>())) {
+                        destroy_entries(base);
+                        return GenesisErrorNoMem;
+                    }
+                    entry->key = key;
+                    omf->map->put(entry->key, entry);
+                }
+                entry->offset = 0;
+                entry->size = -1;
+                entry->block = 0;
+            } else if (hash_entry) {
+                OrderedMapFileEntry *entry = hash_entry->value;
+                omf->map->remove(key);
+                destroy(entry, 1);
+            }
+        }
+        // an index which was not used is replayed as an empty transaction
+        assert(offset == transaction_size || (put_count == 0 && del_count == 0));
+
+        omf->transaction_offset = transaction_offset + stored_size;
+    }
+
+    if ((err = merge_replayed(omf, base))) {
+        destroy_entries(base);
+        return err;
+    }
+    return 0;
+}
+
 int ordered_map_file_open(const char *path, OrderedMapFile **out_omf) {
     *out_omf = nullptr;
     OrderedMapFile *omf = create_zero<OrderedMapFile>();
@@ -128,9 +1057,14 @@ int ordered_map_file_open(const char *path, OrderedMapFile **out_omf) {
         ordered_map_file_close(omf);
         return GenesisErrorNoMem;
     }
-    if (omf->queue.error()) {
+    if (!(omf->index_mutex = os_mutex_create())) {
+        ordered_map_file_close(omf);
+        return GenesisErrorNoMem;
+    }
+    int err;
+    if ((err = omf->queue.init(WRITE_QUEUE_CAPACITY))) {
         ordered_map_file_close(omf);
-        return omf->queue.error();
+        return err;
     }
     omf->list = create_zero<List<OrderedMapFileEntry *>>();
     if (!omf->list) {
@@ -138,14 +1072,17 @@ int ordered_map_file_open(const char *path, OrderedMapFile **out_omf) {
         return GenesisErrorNoMem;
     }
 
-    omf->map = create_zero<HashMap<ByteBuffer, OrderedMapFileEntry *, ByteBuffer::hash>>();
+    omf->map = create_zero<FlatHashMap<ByteBuffer, OrderedMapFileEntry *, ByteBuffer::hash>>();
     if (!omf->map) {
         ordered_map_file_close(omf);
         return GenesisErrorNoMem;
     }
 
+    omf->path = path;
+    omf->compaction_ratio = DEFAULT_COMPACTION_RATIO;
+    omf->compaction_min_dead_bytes = DEFAULT_COMPACTION_MIN_DEAD_BYTES;
+
     omf->running = true;
-    int err;
     if ((err = os_thread_create(run_write, omf, false, &omf->write_thread))) {
         ordered_map_file_close(omf);
         return err;
@@ -178,109 +1115,20 @@ int ordered_map_file_open(const char *path, OrderedMapFile **out_omf) {
     }
 
     // read everything into list
-    bool partial_transaction = false;
-    omf->write_buffer.resize(TRANSACTION_METADATA_SIZE);
     omf->transaction_offset = UUID_SIZE;
-    for (;;) {
-        size_t amt_read = fread(omf->write_buffer.raw(), 1, TRANSACTION_METADATA_SIZE, omf->file);
-        if (amt_read != TRANSACTION_METADATA_SIZE) {
-            // partial transaction. ignore it and we're done.
-            if (amt_read > 0)
-                partial_transaction = true;
-            break;
-        }
-        uint8_t *transaction_ptr = (uint8_t*)omf->write_buffer.raw();
-        int transaction_size = read_uint32be(&transaction_ptr[4]);
-        if (transaction_size < TRANSACTION_METADATA_SIZE ||
-            transaction_size > MAX_TRANSACTION_SIZE)
-        {
-            // invalid value
-            partial_transaction = true;
-            break;
-        }
-
-        omf->write_buffer.resize(transaction_size);
-        transaction_ptr = (uint8_t*)omf->write_buffer.raw();
-
-        size_t amt_to_read = transaction_size - TRANSACTION_METADATA_SIZE;
-        amt_read = fread(&transaction_ptr[TRANSACTION_METADATA_SIZE], 1, amt_to_read, omf->file);
-        if (amt_read != amt_to_read) {
-            // partial transaction. ignore it and we're done.
-            partial_transaction = true;
-            break;
-        }
-        uint32_t computed_crc = crc32(0, &transaction_ptr[4], transaction_size - 4);
-        uint32_t crc_from_file = read_uint32be(&transaction_ptr[0]);
-        if (computed_crc != crc_from_file) {
-            // crc check failed. ignore this transaction and we're done.
-            partial_transaction = true;
-            break;
-        }
-
-        int put_count = read_uint32be(&transaction_ptr[8]);
-        int del_count = read_uint32be(&transaction_ptr[12]);
-
-        int offset = TRANSACTION_METADATA_SIZE;
-        for (int i = 0; i < put_count; i += 1) {
-            int key_size = read_uint32be(&transaction_ptr[offset]); offset += 4;
-            int val_size = read_uint32be(&transaction_ptr[offset]); offset += 4;
-
-            OrderedMapFileEntry *entry = create_zero<OrderedMapFileEntry>();
-            if (!entry) {
-                ordered_map_file_close(omf);
-                return GenesisErrorNoMem;
-            }
-
-            entry->key = ByteBuffer((char*)&transaction_ptr[offset], key_size); offset += key_size;
-            entry->offset = omf->transaction_offset + offset;
-            entry->size = val_size;
-            offset += val_size;
-
-            auto old_hash_entry = omf->map->maybe_get(entry->key);
-            if (old_hash_entry) {
-                OrderedMapFileEntry *old_entry = old_hash_entry->value;
-                destroy(old_entry, 1);
-            }
-
-            omf->map->put(entry->key, entry);
-        }
-        for (int i = 0; i < del_count; i += 1) {
-            int key_size = read_uint32be(&transaction_ptr[offset]); offset += 4;
-            ByteBuffer key((char*)&transaction_ptr[offset], key_size); offset += key_size;
-
-            auto hash_entry = omf->map->maybe_get(key);
-            if (hash_entry) {
-                OrderedMapFileEntry *entry = hash_entry->value;
-                omf->map->remove(key);
-                destroy(entry, 1);
-            }
+    bool partial_transaction = false;
+    if (!open_for_writing) {
+        if ((err = load_mapped(omf, &partial_transaction))) {
+            ordered_map_file_close(omf);
+            return err;
         }
-
-        omf->transaction_offset += transaction_size;
-
     }
 
     if (partial_transaction)
         fprintf(stderr, "Warning: Partial transaction found in project file.\n");
 
-    // transfer map to list and sort
-    auto it = omf->map->entry_iterator();
-    if (omf->list->ensure_capacity(omf->map->size())) {
-        ordered_map_file_close(omf);
-        return GenesisErrorNoMem;
-    }
-    for (;;) {
-        auto *map_entry = it.next();
-        if (!map_entry)
-            break;
-
-        ok_or_panic(omf->list->append(map_entry->value));
-    }
-    omf->map->clear();
     destroy_map(omf);
 
-    omf->list->sort<compare_entries>();
-
     *out_omf = omf;
     return 0;
 }
@@ -300,17 +1148,19 @@ void ordered_map_file_close(OrderedMapFile *omf) {
     if (!omf)
         return;
 
-    if (omf->mutex && omf->cond && !omf->queue.error()) {
+    if (omf->mutex && omf->cond && omf->queue.capacity() > 0) {
         ordered_map_file_flush(omf);
         omf->running = false;
         omf->queue.wakeup_all();
     }
     os_thread_destroy(omf->write_thread);
+    os_unmap_file(&omf->mapped_file);
     if (omf->file)
         fclose(omf->file);
     destroy_list(omf);
     destroy_map(omf);
 
+    os_mutex_destroy(omf->index_mutex);
     os_mutex_destroy(omf->mutex);
     os_cond_destroy(omf->cond);
 
@@ -324,26 +1174,110 @@ OrderedMapFileBatch *ordered_map_file_batch_create(OrderedMapFile *omf) {
         return nullptr;
     }
     batch->omf = omf;
+    batch->puts.resize(TRANSACTION_METADATA_SIZE);
+    batch->open_put_offset = -1;
     return batch;
 }
 
 void ordered_map_file_batch_destroy(OrderedMapFileBatch *batch) {
-    if (batch) {
-        for (int i = 0; i < batch->puts.length(); i += 1) {
-            OrderedMapFilePut *put = &batch->puts.at(i);
-            ordered_map_file_buffer_destroy(put->key);
-            ordered_map_file_buffer_destroy(put->value);
-        }
-        for (int i = 0; i < batch->dels.length(); i += 1) {
-            OrderedMapFileDel *del = &batch->dels.at(i);
-            ordered_map_file_buffer_destroy(del->key);
-        }
+    if (batch)
         destroy(batch, 1);
-    }
 }
 
 int ordered_map_file_batch_exec(OrderedMapFileBatch *batch) {
-    return batch->omf->queue.push(batch);
+    assert(batch->open_put_offset == -1);
+    OrderedMapFile *omf = batch->omf;
+
+    // compression and the crc are done here rather than on the write thread
+    if (omf->compression.load())
+        compress_batch(batch);
+    finish_batch(batch, omf->checksum.load());
+
+    int err;
+    if ((err = omf->queue.push(batch)))
+        return err;
+    omf->queued_count += 1;
+    return 0;
+}
+
+void ordered_map_file_batch_encode(OrderedMapFileBatch *batch, bool compress, ByteBuffer &out) {
+    assert(batch->open_put_offset == -1);
+    if (compress)
+        compress_batch(batch);
+    finish_batch(batch, crc32c);
+    if (batch->compressed.length() > 0) {
+        out = batch->compressed;
+        return;
+    }
+    out = batch->puts;
+    out.append(batch->dels);
+}
+
+// the offset just past the records of an uncompressed transaction, walking
+// them with bounds checks, or -1 if they do not fit in size
+static long records_end(const uint8_t *transaction_ptr, long size, int put_count, int del_count) {
+    long offset = TRANSACTION_METADATA_SIZE;
+    long record_count = (long)put_count + del_count;
+    for (long i = 0; i < record_count; i += 1) {
+        int header_size = (i < put_count) ? 8 : 4;
+        if (size - offset < header_size)
+            return -1;
+        long key_size = read_uint32be(&transaction_ptr[offset]);
+        long value_size = (i < put_count) ? read_uint32be(&transaction_ptr[offset + 4]) : 0;
+        offset += header_size;
+        if (key_size > MAX_TRANSACTION_SIZE || value_size > MAX_TRANSACTION_SIZE ||
+            key_size + value_size > size - offset)
+        {
+            return -1;
+        }
+        offset += key_size + value_size;
+    }
+    return offset;
+}
+
+int ordered_map_file_transaction_decode(const char *data, int size, void *userdata,
+        OrderedMapFilePutCallback put, OrderedMapFileDelCallback del)
+{
+    const uint8_t *transaction_ptr = (const uint8_t*)data;
+    if (size < TRANSACTION_METADATA_SIZE || (int)read_uint32be(&transaction_ptr[4]) != size ||
+        crc32c(0, &transaction_ptr[4], size - 4) != read_uint32be(&transaction_ptr[0]))
+    {
+        return GenesisErrorInvalidFormat;
+    }
+    uint32_t put_word = read_uint32be(&transaction_ptr[8]);
+    int put_count = put_word & ~TRANSACTION_COMPRESSED;
+    int del_count = read_uint32be(&transaction_ptr[12]);
+    if (del_count < 0)
+        return GenesisErrorInvalidFormat;
+
+    ByteBuffer decompressed;
+    long transaction_size = size;
+    if (put_word & TRANSACTION_COMPRESSED) {
+        if (size < COMPRESSED_METADATA_SIZE || decompress_transaction(transaction_ptr, decompressed))
+            return GenesisErrorInvalidFormat;
+        transaction_ptr = (const uint8_t*)decompressed.raw();
+        transaction_size = decompressed.length();
+    }
+    if (records_end(transaction_ptr, transaction_size, put_count, del_count) != transaction_size)
+        return GenesisErrorInvalidFormat;
+
+    int err;
+    long offset = TRANSACTION_METADATA_SIZE;
+    for (int i = 0; i < put_count; i += 1) {
+        int key_size = read_uint32be(&transaction_ptr[offset]);
+        int value_size = read_uint32be(&transaction_ptr[offset + 4]);
+        const char *key_ptr = (const char*)&transaction_ptr[offset + 8];
+        if ((err = put(userdata, key_ptr, key_size, key_ptr + key_size, value_size)))
+            return err;
+        offset += 8 + key_size + value_size;
+    }
+    for (int i = 0; i < del_count; i += 1) {
+        int key_size = read_uint32be(&transaction_ptr[offset]);
+        if ((err = del(userdata, (const char*)&transaction_ptr[offset + 4], key_size)))
+            return err;
+        offset += 4 + key_size;
+    }
+    return 0;
 }
 
 OrderedMapFileBuffer *ordered_map_file_buffer_create(int size) {
@@ -370,31 +1304,75 @@ void ordered_map_file_buffer_destroy(OrderedMapFileBuffer *buffer) {
     }
 }
 
+ByteBuffer *ordered_map_file_batch_begin_put(OrderedMapFileBatch *batch, const char *key, int key_size) {
+    assert(batch->open_put_offset == -1);
+    batch->open_put_offset = batch->puts.length();
+    batch->puts.append_uint32be(key_size);
+    // the value size is filled in by ordered_map_file_batch_end_put
+    batch->puts.append_uint32be(0);
+    batch->puts.append(key, key_size);
+    return &batch->puts;
+}
+
+void ordered_map_file_batch_end_put(OrderedMapFileBatch *batch) {
+    int offset = batch->open_put_offset;
+    assert(offset >= 0);
+    char *record_ptr = batch->puts.raw() + offset;
+    int key_size = read_uint32be(&record_ptr[0]);
+    int value_size = batch->puts.length() - offset - 8 - key_size;
+    write_uint32be(&record_ptr[4], value_size);
+    batch->put_count += 1;
+    batch->open_put_offset = -1;
+}
+
+void ordered_map_file_batch_put_bytes(OrderedMapFileBatch *batch,
+        const char *key, int key_size, const char *value, int value_size)
+{
+    ByteBuffer *buf = ordered_map_file_batch_begin_put(batch, key, key_size);
+    buf->append(value, value_size);
+    ordered_map_file_batch_end_put(batch);
+}
+
+void ordered_map_file_batch_del_bytes(OrderedMapFileBatch *batch, const char *key, int key_size) {
+    assert(batch->open_put_offset == -1);
+    batch->dels.append_uint32be(key_size);
+    batch->dels.append(key, key_size);
+    batch->del_count += 1;
+}
+
 int ordered_map_file_batch_put(OrderedMapFileBatch *batch,
         OrderedMapFileBuffer *key, OrderedMapFileBuffer *value)
 {
-    if (batch->puts.resize(batch->puts.length() + 1))
-        return GenesisErrorNoMem;
-
-    OrderedMapFilePut *put = &batch->puts.at(batch->puts.length() - 1);
-    put->key = key;
-    put->value = value;
+    ordered_map_file_batch_put_bytes(batch, key->data, key->size, value->data, value->size);
+    ordered_map_file_buffer_destroy(key);
+    ordered_map_file_buffer_destroy(value);
     return 0;
 }
 
 int ordered_map_file_batch_del(OrderedMapFileBatch *batch,
         OrderedMapFileBuffer *key)
 {
-    if (batch->dels.resize(batch->dels.length() + 1))
-        return GenesisErrorNoMem;
-
-    OrderedMapFileDel *del = &batch->dels.at(batch->dels.length() - 1);
-    del->key = key;
+    ordered_map_file_batch_del_bytes(batch, key->data, key->size);
+    ordered_map_file_buffer_destroy(key);
     return 0;
 }
 
 void ordered_map_file_done_reading(OrderedMapFile *omf) {
-    destroy_list(omf);
+    // the list stays as the index of the write thread and of reads
+    OrderedMapFileStats *stats = &omf->write_stats;
+    for (int i = 0; i < omf->list->length(); i += 1) {
+        stats->live_key_count += 1;
+        stats->live_bytes += put_record_size(omf->list->at(i));
+    }
+    stats->dead_bytes = omf->transaction_offset + omf->compression_saved_bytes - UUID_SIZE - stats->live_bytes;
+    {
+        OsMutexLocker locker(omf->mutex);
+        omf->stats = *stats;
+    }
+    {
+        OsMutexLocker locker(omf->index_mutex);
+        os_unmap_file(&omf->mapped_file);
+    }
     if (fseek(omf->file, omf->transaction_offset, SEEK_SET))
         panic("unable to seek in file");
 }
@@ -436,30 +1414,117 @@ int ordered_map_file_find_key(OrderedMapFile *omf, const ByteBuffer &key) {
     return ordered_map_file_find_key_tpl<false>(omf, key);
 }
 
+int ordered_map_file_lower_bound(OrderedMapFile *omf, const ByteBuffer &key) {
+    return lower_bound(omf->list, key);
+}
+
 int ordered_map_file_get(OrderedMapFile *omf, int index, ByteBuffer **out_key, ByteBuffer &out_value) {
     OrderedMapFileEntry *entry = omf->list->at(index);
     if (out_key)
         *out_key = &entry->key;
+    // a new file has no entries and so no mapping
+    assert(omf->mapped_file.address);
     out_value.resize(entry->size);
-    if (fseek(omf->file, entry->offset, SEEK_SET))
-        return GenesisErrorFileAccess;
-    size_t amt_read = fread(out_value.raw(), 1, out_value.length(), omf->file);
-    if (amt_read != (size_t)out_value.length())
-        return GenesisErrorFileAccess;
-    return 0;
+    return copy_value(omf->mapped_file.address, omf->file, &omf->read_block, entry, out_value.raw());
 }
 
 int ordered_map_file_count(OrderedMapFile *omf) {
     return omf->list->length();
 }
 
-void ordered_map_file_flush(OrderedMapFile *omf) {
-    {
-        OsMutexLocker locker(omf->mutex);
-        while (omf->queue.length())
-            os_cond_wait(omf->cond, omf->mutex);
+// with index_mutex held
+static int read_value(OrderedMapFile *omf, OrderedMapFileEntry *entry, ByteBuffer &out_value) {
+    out_value.resize(entry->size);
+    return copy_value(omf->mapped_file.address, omf->file, &omf->read_block, entry, out_value.raw());
+}
+
+int ordered_map_file_read(OrderedMapFile *omf, const ByteBuffer &key, ByteBuffer &out_value) {
+    OsMutexLocker locker(omf->index_mutex);
+    int index = find_exact(omf->list, key);
+    if (index < 0)
+        return GenesisErrorKeyNotFound;
+    return read_value(omf, omf->list->at(index), out_value);
+}
+
+void ordered_map_file_cursor_init(OrderedMapFile *omf, OrderedMapFileCursor *cursor,
+        const ByteBuffer &prefix)
+{
+    cursor->omf = omf;
+    cursor->prefix = prefix;
+    cursor->key.resize(0);
+    cursor->index = -1;
+    cursor->generation = 0;
+    cursor->started = false;
+}
+
+bool ordered_map_file_cursor_next(OrderedMapFileCursor *cursor) {
+    OrderedMapFile *omf = cursor->omf;
+    OsMutexLocker locker(omf->index_mutex);
+    int index;
+    if (!cursor->started) {
+        index = lower_bound(omf->list, cursor->prefix);
+    } else if (cursor->generation == omf->index_generation) {
+        index = cursor->index + 1;
+    } else {
+        // keys came or went since, so find the first one after the current
+        index = lower_bound(omf->list, cursor->key);
+        if (index < omf->list->length() && ByteBuffer::compare(omf->list->at(index)->key, cursor->key) == 0)
+            index += 1;
     }
+    cursor->started = true;
+    if (index >= omf->list->length() || omf->list->at(index)->key.cmp_prefix(cursor->prefix) != 0) {
+        cursor->index = omf->list->length();
+        cursor->generation = omf->index_generation;
+        return false;
+    }
+    cursor->key = omf->list->at(index)->key;
+    cursor->index = index;
+    cursor->generation = omf->index_generation;
+    return true;
+}
 
+int ordered_map_file_cursor_value(OrderedMapFileCursor *cursor, ByteBuffer &out_value) {
+    OrderedMapFile *omf = cursor->omf;
+    OsMutexLocker locker(omf->index_mutex);
+    int index = cursor->index;
+    if (cursor->generation != omf->index_generation)
+        index = find_exact(omf->list, cursor->key);
+    if (index < 0 || index >= omf->list->length())
+        return GenesisErrorKeyNotFound;
+    return read_value(omf, omf->list->at(index), out_value);
+}
+
+void ordered_map_file_set_durability(OrderedMapFile *omf,
+        OrderedMapFileDurability durability, int sync_interval_ms)
+{
+    omf->sync_interval_ms.store(sync_interval_ms);
+    omf->durability.store(durability);
+}
+
+void ordered_map_file_set_compaction(OrderedMapFile *omf, double dead_ratio, long min_dead_bytes) {
+    OsMutexLocker locker(omf->mutex);
+    omf->compaction_ratio = dead_ratio;
+    omf->compaction_min_dead_bytes = min_dead_bytes;
+}
+
+void ordered_map_file_set_compression(OrderedMapFile *omf, bool enabled) {
+    omf->compression.store(enabled);
+}
+
+void ordered_map_file_get_stats(OrderedMapFile *omf, OrderedMapFileStats *out_stats) {
+    OsMutexLocker locker(omf->mutex);
+    *out_stats = omf->stats;
+}
+
+void ordered_map_file_flush(OrderedMapFile *omf) {
+    // the queue empties before the write thread is done with a group,
+    // so wait on the count of batches written instead
+    long queued_count = omf->queued_count.load();
+    OsMutexLocker locker(omf->mutex);
+    while (omf->written_count < queued_count)
+        os_cond_wait(omf->cond, omf->mutex);
+
+    // with the mutex held so that a compaction can not swap the file
     int err;
     if (omf->file) {
         if ((err = os_file_flush(omf->file))) {
@@ -5,9 +5,10 @@
 #include "os.hpp"
 #include "list.hpp"
 #include "byte_buffer.hpp"
-#include "locked_queue.hpp"
-#include "hash_map.hpp"
+#include "bounded_queue.hpp"
+#include "flat_hash_map.hpp"
 #include "atomics.hpp"
+#include "crc32.hpp"
 
 struct OrderedMapFile;
 
@@ -15,6 +16,19 @@ struct OrderedMapFileEntry {
     ByteBuffer key;
     int offset;
     int size;
+    // for a value in a compressed transaction, where the transaction is in
+    // the file, and offset is from the start of the transaction as it is
+    // without compression. 0 otherwise.
+    int block;
+};
+
+// a compressed transaction as it is without compression
+struct OrderedMapFileBlock {
+    // where the transaction is in the file, or 0 for none
+    long offset;
+    ByteBuffer data;
+    // the compressed transaction, when it is read from the file
+    ByteBuffer stored;
 };
 
 struct OrderedMapFileBuffer {
@@ -22,19 +36,43 @@ struct OrderedMapFileBuffer {
     int size;
 };
 
-struct OrderedMapFilePut {
-    OrderedMapFileBuffer *key;
-    OrderedMapFileBuffer *value;
+// a batch is written as one transaction, and is laid out as one already:
+// puts holds room for the transaction metadata and then each put, and dels
+// holds the dels, which the format puts after every put. keys and values
+// are written into these directly and go from there to the file.
+struct OrderedMapFileBatch {
+    OrderedMapFile *omf;
+    ByteBuffer puts;
+    ByteBuffer dels;
+    int put_count;
+    int del_count;
+    // where the put begun by ordered_map_file_batch_begin_put starts, or -1
+    int open_put_offset;
+    // what the crc was computed with by ordered_map_file_batch_exec
+    Crc32Function checksum;
+    // the transaction as it is written when compression made it smaller,
+    // else empty
+    ByteBuffer compressed;
 };
 
-struct OrderedMapFileDel {
-    OrderedMapFileBuffer *key;
+enum OrderedMapFileDurability {
+    // writes reach the os but are not synced until flush or close
+    OrderedMapFileDurabilityNone,
+    // data is synced after every group of batches is written
+    OrderedMapFileDurabilityGroup,
+    // data is synced at most once every sync_interval_ms
+    OrderedMapFileDurabilityInterval,
 };
 
-struct OrderedMapFileBatch {
-    OrderedMapFile *omf;
-    List<OrderedMapFilePut> puts;
-    List<OrderedMapFileDel> dels;
+struct OrderedMapFileStats {
+    long live_key_count;
+    // bytes of the puts which hold the live keys
+    long live_bytes;
+    // every other byte of transactions in the file
+    long dead_bytes;
+    int compaction_count;
+    // os_get_time() when the last compaction finished, or 0.0
+    double last_compaction_time;
 };
 
 struct OrderedMapFile {
@@ -43,22 +81,93 @@ struct OrderedMapFile {
     OsCond *cond;
     ByteBuffer write_buffer;
     atomic_bool running;
-    LockedQueue<OrderedMapFileBatch *> queue;
+    BoundedQueue<OrderedMapFileBatch *> queue;
+    // written_count is protected by mutex
+    atomic_long queued_count;
+    long written_count;
+    atomic_int durability;
+    atomic_int sync_interval_ms;
+    // swapped by the write thread while holding mutex when it compacts
     FILE *file;
+    // the checksum the file's transactions use. compaction changes it when
+    // it rewrites a file from before crc32c.
+    std::atomic<Crc32Function> checksum;
+    atomic_bool compression;
+    ByteBuffer path;
     long transaction_offset;
     List<OrderedMapFileEntry *> *list;
-    HashMap<ByteBuffer, OrderedMapFileEntry *, ByteBuffer::hash> *map;
+    FlatHashMap<ByteBuffer, OrderedMapFileEntry *, ByteBuffer::hash> *map;
+    // the file as it was opened, until ordered_map_file_done_reading
+    OsMappedFile mapped_file;
+
+    // after ordered_map_file_done_reading, list stays sorted as the index of
+    // the live keys. only the write thread changes it, with index_mutex held,
+    // which is also held by reads from other threads.
+    OsMutex *index_mutex;
+    // counts keys added to and removed from list
+    long index_generation;
+    OrderedMapFileStats write_stats;
+    // dead_bytes at which to try again after a compaction failed
+    long compaction_retry_dead_bytes;
+    // how much smaller compression made the transactions in the file. the
+    // stats count bytes as they are without compression.
+    long compression_saved_bytes;
+    // the block reads decompressed last. protected by index_mutex after
+    // ordered_map_file_done_reading.
+    OrderedMapFileBlock read_block;
+
+    // protected by mutex
+    OrderedMapFileStats stats;
+    double compaction_ratio;
+    long compaction_min_dead_bytes;
+};
+
+// iterates over the keys with a prefix, in order, with
+// ordered_map_file_cursor_next. it holds no lock in between calls.
+struct OrderedMapFileCursor {
+    OrderedMapFile *omf;
+    ByteBuffer prefix;
+    // the current key
+    ByteBuffer key;
+    int index;
+    long generation;
+    bool started;
 };
 
 int ordered_map_file_open(const char *path, OrderedMapFile **omf);
 void ordered_map_file_done_reading(OrderedMapFile *omf);
 void ordered_map_file_close(OrderedMapFile *omf);
 
+// omf may be null for a batch which is only encoded
 OrderedMapFileBatch *ordered_map_file_batch_create(OrderedMapFile *omf);
 void ordered_map_file_batch_destroy(OrderedMapFileBatch *batch);
 // transfers ownership of the batch
 int ordered_map_file_batch_exec(OrderedMapFileBatch *batch);
 
+// the transaction of a batch as the file would have it, with a crc32c, for
+// sending somewhere else. the batch can not be executed afterwards.
+void ordered_map_file_batch_encode(OrderedMapFileBatch *batch, bool compress, ByteBuffer &out);
+typedef int (*OrderedMapFilePutCallback)(void *userdata, const char *key, int key_size,
+        const char *value, int value_size);
+typedef int (*OrderedMapFileDelCallback)(void *userdata, const char *key, int key_size);
+// calls put for each put of an encoded transaction, in order, then del for
+// each del. the data is checked first, so nothing is called for a
+// transaction which is not valid, and GenesisErrorInvalidFormat is
+// returned. a callback returning an error stops the decode with it.
+int ordered_map_file_transaction_decode(const char *data, int size, void *userdata,
+        OrderedMapFilePutCallback put, OrderedMapFileDelCallback del);
+
+// copy the key and value into the batch
+void ordered_map_file_batch_put_bytes(OrderedMapFileBatch *batch,
+        const char *key, int key_size, const char *value, int value_size);
+void ordered_map_file_batch_del_bytes(OrderedMapFileBatch *batch, const char *key, int key_size);
+// starts a put of key whose value is whatever is appended to the returned
+// buffer until ordered_map_file_batch_end_put. nothing else may be added to
+// the batch in between.
+ByteBuffer *ordered_map_file_batch_begin_put(OrderedMapFileBatch *batch, const char *key, int key_size);
+void ordered_map_file_batch_end_put(OrderedMapFileBatch *batch);
+
+// separately allocated buffers, for callers which make them before the batch
 OrderedMapFileBuffer *ordered_map_file_buffer_create(int size);
 void ordered_map_file_buffer_destroy(OrderedMapFileBuffer *buffer);
 // put and del transfer ownership of the buffers
@@ -70,9 +179,45 @@ int ordered_map_file_batch_del(OrderedMapFileBatch *batch, OrderedMapFileBuffer
 int ordered_map_file_count(OrderedMapFile *omf);
 int ordered_map_file_find_key(OrderedMapFile *omf, const ByteBuffer &key);
 int ordered_map_file_find_prefix(OrderedMapFile *omf, const ByteBuffer &prefix);
+// the index of the first key which is not less than key
+int ordered_map_file_lower_bound(OrderedMapFile *omf, const ByteBuffer &key);
 int ordered_map_file_get(OrderedMapFile *omf, int index, ByteBuffer **out_key, ByteBuffer &out_value);
 
 
+// the write thread takes every batch queued at once and writes them with a
+// single write call. the default is OrderedMapFileDurabilityNone.
+// sync_interval_ms is only used by OrderedMapFileDurabilityInterval.
+void ordered_map_file_set_durability(OrderedMapFile *omf,
+        OrderedMapFileDurability durability, int sync_interval_ms);
+
+// after writing, the write thread compacts the file once dead_bytes is at
+// least dead_ratio times live_bytes and at least min_dead_bytes. it writes
+// the live keys to a new file and renames it over the old one. a negative
+// dead_ratio turns compaction off.
+void ordered_map_file_set_compaction(OrderedMapFile *omf, double dead_ratio, long min_dead_bytes);
+
+// compresses the transactions of the batches executed from then on, each
+// one that compression makes smaller, and has compaction write the snapshot
+// compressed, in blocks. values in compressed blocks are decompressed when
+// read. off by default. a file is read the same either way, so this can
+// change at any time.
+void ordered_map_file_set_compression(OrderedMapFile *omf, bool enabled);
+
+// the stats as of the last group of batches written. only valid after
+// ordered_map_file_done_reading.
+void ordered_map_file_get_stats(OrderedMapFile *omf, OrderedMapFileStats *out_stats);
+// these reads keep working after ordered_map_file_done_reading, from any
+// thread. they see every batch once the write thread has written it.
+// returns GenesisErrorKeyNotFound if key is not there.
+int ordered_map_file_read(OrderedMapFile *omf, const ByteBuffer &key, ByteBuffer &out_value);
+void ordered_map_file_cursor_init(OrderedMapFile *omf, OrderedMapFileCursor *cursor, const ByteBuffer &prefix);
+// moves to the next key with the prefix and returns false after the last.
+// writes in between are fine; a key added behind the cursor is skipped.
+bool ordered_map_file_cursor_next(OrderedMapFileCursor *cursor);
+// the value of the current key as it is now. returns GenesisErrorKeyNotFound
+// if the key was deleted since ordered_map_file_cursor_next.
+int ordered_map_file_cursor_value(OrderedMapFileCursor *cursor, ByteBuffer &out_value);
+
 // blocks until all queued writes finish
 // automatically called by ordered_map_file_close
 void ordered_map_file_flush(OrderedMapFile *omf);
@@ -3,10 +3,15 @@
 #include "random.hpp"
 #include "error.h"
 #include "warning.hpp"
+#include "logger.hpp"
 
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <sys/uio.h>
+#include <sys/resource.h>
 #include <sys/fcntl.h>
 #include <dirent.h>
 #include <pwd.h>
@@ -47,6 +52,7 @@
 #endif
 
 #include <windows.h>
+#include <io.h>
 #include <mmsystem.h>
 #include <objbase.h>
 
@@ -55,6 +61,9 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
 #ifndef MAP_ANONYMOUS
 #define MAP_ANONYMOUS MAP_ANON
 #endif
@@ -68,9 +77,32 @@
 #include <sys/time.h>
 #endif
 
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#include <linux/mempolicy.h>
+#endif
+
 #if defined(__MACH__)
+#include <sys/clonefile.h>
 #include <mach/clock.h>
 #include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <mach/thread_policy.h>
+#include <sys/sysctl.h>
+#endif
+
+// only windows tells binary files from text ones
+#if !defined(O_BINARY)
+#define O_BINARY 0
 #endif
 
 struct OsThread {
@@ -86,6 +118,7 @@ struct OsThread {
 #endif
     void *arg;
     void (*run)(void *arg);
+    OsThreadAttributes attributes;
 };
 
 struct OsMutex {
@@ -120,6 +153,17 @@ struct OsCond {
 };
 #endif
 
+struct OsPollEvent {
+#if defined(GENESIS_OS_WINDOWS)
+    HANDLE handle;
+#elif defined(GENESIS_OS_KQUEUE) || defined(__linux__)
+    int fd;
+#else
+    // the read end is what gets polled
+    int fds[2];
+#endif
+};
+
 #if defined(GENESIS_OS_WINDOWS)
 static INIT_ONCE win32_init_once = INIT_ONCE_STATIC_INIT;
 static double win32_time_resolution;
@@ -133,6 +177,13 @@ static clock_serv_t cclock;
 #endif
 
 static int page_size;
+// see os_timestamp
+static double timestamp_seconds_per_tick;
+#if defined(__i386__) || defined(__x86_64__)
+static bool timestamp_from_tsc = false;
+// how long os_init watches the TSC for to learn its rate
+static const double TSC_CALIBRATION_SECONDS = 0.005;
+#endif
 static RandomState random_state;
 static const mode_t default_dir_mode = 0777;
 
@@ -178,6 +229,13 @@ void os_get_app_config_path(ByteBuffer &out) {
     os_path_join(out, app_config_dir, "config");
 }
 
+void os_get_sample_index_path(ByteBuffer &out) {
+    ByteBuffer app_dir;
+    os_get_app_dir(app_dir);
+
+    os_path_join(out, app_dir, "sample_index");
+}
+
 static int get_random_seed(uint32_t *seed) {
     int fd = open("/dev/urandom", O_RDONLY|O_NONBLOCK);
     if (fd == -1)
@@ -231,6 +289,84 @@ void os_spawn_process(const char *exe, const List<ByteBuffer> &args, bool detach
     panic("execvp failed: %s", strerror(errno));
 }
 
+struct OsProcess {
+    pid_t pid;
+    // waitpid already reaped it while checking whether it exited
+    bool reaped;
+    int status;
+};
+
+int os_process_create(const char *exe, const List<ByteBuffer> &args, OsProcess **out_process) {
+    return os_process_create_inheriting(exe, args, -1, out_process);
+}
+
+int os_process_create_inheriting(const char *exe, const List<ByteBuffer> &args, int inherit_fd,
+        OsProcess **out_process)
+{
+    *out_process = nullptr;
+    OsProcess *process = create_zero<OsProcess>();
+    if (!process)
+        return GenesisErrorNoMem;
+    const char **argv = allocate_zero<const char *>(args.length() + 2);
+    if (!argv) {
+        destroy(process, 1);
+        return GenesisErrorNoMem;
+    }
+    argv[0] = exe;
+    argv[args.length() + 1] = nullptr;
+    for (int i = 0; i < args.length(); i += 1)
+        argv[i + 1] = args.at(i).raw();
+
+    process->pid = fork();
+    if (process->pid == -1) {
+        destroy(argv, args.length() + 2);
+        destroy(process, 1);
+        return GenesisErrorSystemResources;
+    }
+    if (process->pid == 0) {
+        if (inherit_fd >= 0) {
+            int flags = fcntl(inherit_fd, F_GETFD);
+            if (flags == -1 || fcntl(inherit_fd, F_SETFD, flags & ~FD_CLOEXEC) == -1)
+                _exit(127);
+        }
+        execvp(exe, const_cast<char * const *>(argv));
+        fprintf(stderr, "execvp failed: %s\n", strerror(errno));
+        _exit(127);
+    }
+    destroy(argv, args.length() + 2);
+    *out_process = process;
+    return 0;
+}
+
+bool os_process_exited(OsProcess *process) {
+    if (process->reaped)
+        return true;
+    pid_t pid;
+    while ((pid = waitpid(process->pid, &process->status, WNOHANG)) == -1 && errno == EINTR) {}
+    if (pid == process->pid) {
+        process->reaped = true;
+        return true;
+    }
+    return pid == -1;
+}
+
+void os_process_kill(OsProcess *process) {
+    if (!process->reaped)
+        kill(process->pid, SIGKILL);
+}
+
+int os_process_wait(OsProcess *process, int *out_exit_code) {
+    int status = process->status;
+    pid_t pid = process->pid;
+    if (!process->reaped)
+        while ((pid = waitpid(process->pid, &status, 0)) == -1 && errno == EINTR) {}
+    destroy(process, 1);
+    if (pid == -1)
+        return GenesisErrorSystemResources;
+    *out_exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    return 0;
+}
+
 void os_open_in_browser(const String &url) {
     List<ByteBuffer> args;
     ok_or_panic(args.append(url.encode()));
@@ -343,11 +479,32 @@ void os_path_remove_extension(ByteBuffer &path) {
     path.resize(dot_index);
 }
 
-int os_readdir(const char *dir, List<OsDirEntry*> &entries) {
+static void unref_entries(List<OsDirEntry *> &entries) {
     for (int i = 0; i < entries.length(); i += 1)
         os_dir_entry_unref(entries.at(i));
     entries.clear();
+}
+
+// worked out once per entry on the thread that reads the directory, so
+// that sorting a listing is byte comparisons. names which are not UTF-8
+// are left as they are.
+static void make_sort_key(ByteBuffer &out, const ByteBuffer &name) {
+    bool ok;
+    String folded = String::decode(name, &ok);
+    if (ok) {
+        folded.make_lower_case();
+        out = folded.encode();
+    } else {
+        out = name;
+    }
+    out.append("", 1);
+    out.append(name);
+}
 
+// entries on its own when on_batch is nullptr
+static int read_dir_entries(const char *dir, List<OsDirEntry*> &entries, int batch_size,
+        void (*on_batch)(void *userdata, List<OsDirEntry*> &entries), void *userdata)
+{
     DIR *dp = opendir(dir);
     if (!dp) {
         switch (errno) {
@@ -401,6 +558,7 @@ int os_readdir(const char *dir, List<OsDirEntry*> &entries) {
             return GenesisErrorNoMem;
         }
         entry->name = ByteBuffer(ep->d_name);
+        make_sort_key(entry->sort_key, entry->name);
         entry->is_dir = S_ISDIR(st.st_mode);
         entry->is_file = S_ISREG(st.st_mode);
         entry->is_link = S_ISLNK(st.st_mode);
@@ -414,11 +572,160 @@ int os_readdir(const char *dir, List<OsDirEntry*> &entries) {
             os_dir_entry_unref(entry);
             return GenesisErrorNoMem;
         }
+        if (on_batch && entries.length() >= batch_size) {
+            on_batch(userdata, entries);
+            unref_entries(entries);
+        }
     }
     closedir(dp);
     return 0;
 }
 
+int os_readdir(const char *dir, List<OsDirEntry*> &entries) {
+    unref_entries(entries);
+    return read_dir_entries(dir, entries, 0, nullptr, nullptr);
+}
+
+int os_readdir_batched(const char *dir, int batch_size,
+        void (*on_batch)(void *userdata, List<OsDirEntry*> &entries), void *userdata)
+{
+    List<OsDirEntry *> entries;
+    int err = read_dir_entries(dir, entries, batch_size, on_batch, userdata);
+    if (!err && entries.length() > 0)
+        on_batch(userdata, entries);
+    unref_entries(entries);
+    return err;
+}
+
+int os_dir_mtime(const char *dir, long *out_mtime) {
+    struct stat st;
+    if (stat(dir, &st)) {
+        switch (errno) {
+            case EACCES:
+                return GenesisErrorPermissionDenied;
+            case ENOENT:
+                return GenesisErrorFileNotFound;
+            case ENOTDIR:
+                return GenesisErrorNotDir;
+            case ENOMEM:
+                return GenesisErrorNoMem;
+            default:
+                return GenesisErrorFileAccess;
+        }
+    }
+    if (!S_ISDIR(st.st_mode))
+        return GenesisErrorNotDir;
+    *out_mtime = st.st_mtime;
+    return 0;
+}
+
+#if defined(__linux__)
+struct OsDirWatcher {
+    int fd;
+};
+
+int os_dir_watcher_create(OsDirWatcher **out_watcher) {
+    *out_watcher = nullptr;
+    OsDirWatcher *watcher = create_zero<OsDirWatcher>();
+    if (!watcher)
+        return GenesisErrorNoMem;
+    watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher->fd == -1) {
+        destroy(watcher, 1);
+        return (errno == ENOMEM) ? GenesisErrorNoMem : GenesisErrorSystemResources;
+    }
+    *out_watcher = watcher;
+    return 0;
+}
+
+void os_dir_watcher_destroy(OsDirWatcher *watcher) {
+    if (watcher) {
+        close(watcher->fd);
+        destroy(watcher, 1);
+    }
+}
+
+int os_dir_watcher_add(OsDirWatcher *watcher, const char *dir, int *out_watch_id) {
+    static const uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+        IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+    int wd = inotify_add_watch(watcher->fd, dir, mask);
+    if (wd == -1) {
+        switch (errno) {
+            case EACCES:
+                return GenesisErrorPermissionDenied;
+            case ENOENT:
+                return GenesisErrorFileNotFound;
+            case ENOTDIR:
+                return GenesisErrorNotDir;
+            case ENOMEM:
+                return GenesisErrorNoMem;
+            default:
+                // out of inotify watches
+                return GenesisErrorSystemResources;
+        }
+    }
+    *out_watch_id = wd;
+    return 0;
+}
+
+void os_dir_watcher_remove(OsDirWatcher *watcher, int watch_id) {
+    inotify_rm_watch(watcher->fd, watch_id);
+}
+
+int os_dir_watcher_changes(OsDirWatcher *watcher, List<int> &out_watch_ids) {
+    out_watch_ids.clear();
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        ssize_t amt = read(watcher->fd, buf, sizeof(buf));
+        if (amt == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+                return 0;
+            return GenesisErrorFileAccess;
+        }
+        for (char *ptr = buf; ptr < buf + amt;) {
+            struct inotify_event *event = (struct inotify_event *)ptr;
+            ptr += sizeof(struct inotify_event) + event->len;
+            // the kernel dropped events, so every directory may have changed
+            if (event->mask & IN_Q_OVERFLOW) {
+                out_watch_ids.clear();
+                if (out_watch_ids.append(-1))
+                    return GenesisErrorNoMem;
+                continue;
+            }
+            if (event->wd < 0 || (event->mask & IN_IGNORED))
+                continue;
+            bool seen = false;
+            for (int i = 0; i < out_watch_ids.length() && !seen; i += 1)
+                seen = (out_watch_ids.at(i) == event->wd);
+            if (!seen && out_watch_ids.append(event->wd))
+                return GenesisErrorNoMem;
+        }
+    }
+}
+#else
+int os_dir_watcher_create(OsDirWatcher **out_watcher) {
+    *out_watcher = nullptr;
+    return GenesisErrorUnimplemented;
+}
+
+void os_dir_watcher_destroy(OsDirWatcher *watcher) {
+}
+
+int os_dir_watcher_add(OsDirWatcher *watcher, const char *dir, int *out_watch_id) {
+    return GenesisErrorUnimplemented;
+}
+
+void os_dir_watcher_remove(OsDirWatcher *watcher, int watch_id) {
+}
+
+int os_dir_watcher_changes(OsDirWatcher *watcher, List<int> &out_watch_ids) {
+    out_watch_ids.clear();
+    return 0;
+}
+#endif
+
 void os_dir_entry_ref(OsDirEntry *dir_entry) {
     dir_entry->ref_count += 1;
 }
@@ -432,34 +739,100 @@ void os_dir_entry_unref(OsDirEntry *dir_entry) {
     }
 }
 
-static int copy_open_files(FILE *in_f, FILE *out_f, Sha256Hasher *hasher) {
-    char *buf = allocate_nonzero<char>(BUFSIZ);
+// the kernel copies the rest of in_fd to out_fd without the data passing
+// through user space: as a reflink sharing the blocks where the file system
+// can, otherwise with copy_file_range or sendfile. each way picks up at the
+// file offsets where the one before gave up.
+static int copy_fd_contents(int in_fd, int out_fd) {
+#if defined(__linux__)
+    if (ioctl(out_fd, FICLONE, in_fd) == 0)
+        return 0;
+    static const size_t chunk_size = 1024 * 1024 * 1024;
+    for (;;) {
+        ssize_t amt = copy_file_range(in_fd, nullptr, out_fd, nullptr, chunk_size, 0);
+        if (amt > 0 || (amt == -1 && errno == EINTR))
+            continue;
+        if (amt == 0)
+            return 0;
+        if (errno != EXDEV && errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP)
+            return GenesisErrorFileAccess;
+        break;
+    }
+    for (;;) {
+        ssize_t amt = sendfile(out_fd, in_fd, nullptr, chunk_size);
+        if (amt > 0 || (amt == -1 && errno == EINTR))
+            continue;
+        if (amt == 0)
+            return 0;
+        if (errno != EINVAL && errno != ENOSYS)
+            return GenesisErrorFileAccess;
+        break;
+    }
+#endif
+    static const int buf_size = 1024 * 1024;
+    char *buf = allocate_nonzero<char>(buf_size);
     if (!buf)
         return GenesisErrorNoMem;
-
     for (;;) {
-        size_t amt_read = fread(buf, 1, BUFSIZ, in_f);
-        size_t amt_written = fwrite(buf, 1, amt_read, out_f);
-        if (hasher)
-            hasher->update(buf, amt_read);
-        if (amt_read != BUFSIZ) {
-            if (feof(in_f)) {
-                destroy(buf, 1);
-                if (amt_written != amt_read)
-                    return GenesisErrorFileAccess;
-                else
-                    return 0;
-            } else {
-                destroy(buf, 1);
+        ssize_t amt_read = read(in_fd, buf, buf_size);
+        if (amt_read == -1 && errno == EINTR)
+            continue;
+        if (amt_read <= 0) {
+            destroy(buf, buf_size);
+            return amt_read ? GenesisErrorFileAccess : 0;
+        }
+        for (ssize_t offset = 0; offset < amt_read;) {
+            ssize_t amt_written = write(out_fd, buf + offset, amt_read - offset);
+            if (amt_written == -1 && errno == EINTR)
+                continue;
+            if (amt_written <= 0) {
+                destroy(buf, buf_size);
                 return GenesisErrorFileAccess;
             }
-        } else if (amt_written != amt_read) {
-            destroy(buf, 1);
-            return GenesisErrorFileAccess;
+            offset += amt_written;
         }
     }
 }
 
+struct HashMappedFileJob {
+    OsMappedFile mapped_file;
+    Sha256Hasher *hasher;
+};
+
+static void hash_mapped_file(void *arg) {
+    HashMappedFileJob *job = (HashMappedFileJob *)arg;
+#if !defined(GENESIS_OS_WINDOWS)
+    posix_madvise(job->mapped_file.address, job->mapped_file.size, POSIX_MADV_SEQUENTIAL);
+#endif
+    job->hasher->update(job->mapped_file.address, job->mapped_file.size);
+}
+
+// the hash is of the mapped source, on a thread of its own, so that it
+// runs while the kernel copies instead of after each block
+static int copy_and_hash(const char *source_path, int in_fd, int out_fd, Sha256Hasher *hasher) {
+    if (!hasher)
+        return copy_fd_contents(in_fd, out_fd);
+
+    HashMappedFileJob job;
+    job.hasher = hasher;
+    OsThread *thread = nullptr;
+    bool mapped = !os_map_file(source_path, &job.mapped_file);
+    if (mapped && os_thread_create(hash_mapped_file, &job, false, &thread))
+        thread = nullptr;
+
+    int err = copy_fd_contents(in_fd, out_fd);
+
+    if (thread)
+        os_thread_destroy(thread);
+    else if (mapped)
+        hash_mapped_file(&job);
+    if (mapped)
+        os_unmap_file(&job.mapped_file);
+    else if (!err)
+        err = os_hash_file(source_path, hasher);
+    return err;
+}
+
 int os_copy_no_clobber(const char *source_path, const char *dest_dir,
         const char *prefix, const char *dest_extension,
         ByteBuffer &out_path, Sha256Hasher *hasher)
@@ -477,7 +850,21 @@ int os_copy_no_clobber(const char *source_path, const char *dest_dir,
             full_path.append(counter_buf);
         }
         full_path.append(dest_extension);
-        out_fd = open(full_path.raw(), O_CREAT|O_WRONLY|O_EXCL, 0660);
+#if defined(__MACH__)
+        // a clone shares the blocks of the source until either changes
+        if (!clonefile(source_path, full_path.raw(), 0)) {
+            int err;
+            if (hasher && (err = os_hash_file(source_path, hasher))) {
+                os_delete(full_path.raw());
+                return err;
+            }
+            out_path = full_path;
+            return 0;
+        }
+        if (errno == EEXIST)
+            continue;
+#endif
+        out_fd = open(full_path.raw(), O_CREAT|O_WRONLY|O_EXCL|O_BINARY, 0660);
         if (out_fd == -1) {
             if (errno == EEXIST) {
                 continue;
@@ -490,24 +877,18 @@ int os_copy_no_clobber(const char *source_path, const char *dest_dir,
         break;
     }
 
-    FILE *out_f = fdopen(out_fd, "wb");
-    if (!out_f) {
+    int in_fd = open(source_path, O_RDONLY|O_BINARY);
+    if (in_fd == -1) {
         close(out_fd);
         os_delete(full_path.raw());
-        return GenesisErrorNoMem;
-    }
-
-    FILE *in_f = fopen(source_path, "rb");
-    if (!in_f) {
-        fclose(out_f);
-        os_delete(full_path.raw());
         return GenesisErrorFileAccess;
     }
 
-    int err;
-    if ((err = copy_open_files(in_f, out_f, hasher))) {
-        fclose(in_f);
-        fclose(out_f);
+    int err = copy_and_hash(source_path, in_fd, out_fd, hasher);
+    close(in_fd);
+    if (close(out_fd) && !err)
+        err = GenesisErrorFileAccess;
+    if (err) {
         os_delete(full_path.raw());
         return err;
     }
@@ -516,21 +897,95 @@ int os_copy_no_clobber(const char *source_path, const char *dest_dir,
     return 0;
 }
 
+int os_hash_file(const char *path, Sha256Hasher *hasher) {
+    HashMappedFileJob job;
+    job.hasher = hasher;
+    if (!os_map_file(path, &job.mapped_file)) {
+        hash_mapped_file(&job);
+        os_unmap_file(&job.mapped_file);
+        return 0;
+    }
+
+    // empty files cannot be mapped
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return (errno == ENOENT) ? GenesisErrorFileNotFound : GenesisErrorFileAccess;
+    char *buf = allocate_nonzero<char>(BUFSIZ);
+    if (!buf) {
+        fclose(f);
+        return GenesisErrorNoMem;
+    }
+    size_t amt_read;
+    while ((amt_read = fread(buf, 1, BUFSIZ, f)) > 0)
+        hasher->update(buf, amt_read);
+    bool ok = !ferror(f);
+    destroy(buf, 1);
+    fclose(f);
+    return ok ? 0 : GenesisErrorFileAccess;
+}
+
+int os_hard_link(const char *source_path, const char *dest_path) {
+    if (!link(source_path, dest_path))
+        return 0;
+    switch (errno) {
+        case EEXIST:
+            return GenesisErrorAlreadyExists;
+        case ENOENT:
+            return GenesisErrorFileNotFound;
+        case ENOMEM:
+            return GenesisErrorNoMem;
+        case EXDEV:
+        case EPERM:
+        case EMLINK:
+        case EOPNOTSUPP:
+            return GenesisErrorUnimplemented;
+        default:
+            return GenesisErrorFileAccess;
+    }
+}
+
+int os_link_no_clobber(const char *source_path, const char *dest_dir,
+        const char *prefix, const char *dest_extension, ByteBuffer &out_path)
+{
+    ByteBuffer dir_plus_prefix;
+    os_path_join(dir_plus_prefix, dest_dir, prefix);
+
+    for (int counter = 0;; counter += 1) {
+        ByteBuffer full_path = dir_plus_prefix;
+        if (counter != 0) {
+            ByteBuffer counter_buf;
+            counter_buf.format("%d", counter);
+            full_path.append(counter_buf);
+        }
+        full_path.append(dest_extension);
+        int err = os_hard_link(source_path, full_path.raw());
+        if (err == GenesisErrorAlreadyExists)
+            continue;
+        if (err == GenesisErrorUnimplemented)
+            return os_copy_no_clobber(source_path, dest_dir, prefix, dest_extension, out_path, nullptr);
+        if (err)
+            return err;
+        out_path = full_path;
+        return 0;
+    }
+}
+
 int os_copy(const char *source_path, const char *dest_path, Sha256Hasher *hasher) {
-    FILE *in_f = fopen(source_path, "rb");
-    if (!in_f)
+    int in_fd = open(source_path, O_RDONLY|O_BINARY);
+    if (in_fd == -1)
         return GenesisErrorFileAccess;
 
-    FILE *out_f = fopen(dest_path, "wb");
-    if (!out_f) {
-        fclose(in_f);
+    int out_fd = open(dest_path, O_CREAT|O_WRONLY|O_TRUNC|O_BINARY, 0666);
+    if (out_fd == -1) {
+        close(in_fd);
         return GenesisErrorFileAccess;
     }
 
-    int err;
-    if ((err = copy_open_files(in_f, out_f, hasher))) {
-        fclose(in_f);
-        fclose(out_f);
+    int err = copy_and_hash(source_path, in_fd, out_fd, hasher);
+    close(in_fd);
+    if (close(out_fd) && !err)
+        err = GenesisErrorFileAccess;
+    if (err) {
         os_delete(dest_path);
         return err;
     }
@@ -564,12 +1019,120 @@ double os_get_time(void) {
 #endif
 }
 
+// nanoseconds, or performance counter ticks on windows
+static uint64_t clock_timestamp(void) {
+#if defined(GENESIS_OS_WINDOWS)
+    unsigned __int64 time;
+    QueryPerformanceCounter((LARGE_INTEGER*) &time);
+    return time;
+#elif defined(__MACH__)
+    return (uint64_t)(os_get_time() * 1000000000.0);
+#else
+    struct timespec tms;
+#if defined(CLOCK_MONOTONIC_RAW)
+    clock_gettime(CLOCK_MONOTONIC_RAW, &tms);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &tms);
+#endif
+    return tms.tv_sec * (uint64_t)1000000000 + tms.tv_nsec;
+#endif
+}
+
+static double clock_seconds_per_tick(void) {
+#if defined(GENESIS_OS_WINDOWS)
+    return win32_time_resolution;
+#else
+    return 1.0 / 1000000000.0;
+#endif
+}
+
+#if defined(__i386__) || defined(__x86_64__)
+// the TSC can stand in for a clock only when it ticks at the same rate
+// whatever the core's frequency and power state
+static bool has_invariant_tsc(void) {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
+        return false;
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return edx & (1 << 8);
+}
+#endif
+
+static void init_timestamp(void) {
+    timestamp_seconds_per_tick = clock_seconds_per_tick();
+#if defined(__i386__) || defined(__x86_64__)
+    if (!has_invariant_tsc())
+        return;
+    // nothing reports the TSC's rate reliably, so it is measured against
+    // the clock
+    double clock_seconds = clock_seconds_per_tick();
+    uint64_t clock_start = clock_timestamp();
+    uint64_t tsc_start = __builtin_ia32_rdtsc();
+    uint64_t clock_wait = (uint64_t)(TSC_CALIBRATION_SECONDS / clock_seconds);
+    uint64_t clock_end;
+    do {
+        clock_end = clock_timestamp();
+    } while (clock_end - clock_start < clock_wait);
+    uint64_t tsc_end = __builtin_ia32_rdtsc();
+    if (tsc_end <= tsc_start)
+        return;
+    timestamp_seconds_per_tick = (clock_end - clock_start) * clock_seconds / (double)(tsc_end - tsc_start);
+    timestamp_from_tsc = true;
+#elif defined(__aarch64__)
+    uint64_t frequency;
+    __asm__ __volatile__("mrs %0, cntfrq_el0" : "=r" (frequency));
+    timestamp_seconds_per_tick = 1.0 / (double)frequency;
+#endif
+}
+
+uint64_t os_timestamp(void) {
+#if defined(__i386__) || defined(__x86_64__)
+    if (timestamp_from_tsc)
+        return __builtin_ia32_rdtsc();
+    return clock_timestamp();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r" (ticks));
+    return ticks;
+#else
+    return clock_timestamp();
+#endif
+}
+
+double os_timestamp_to_seconds(int64_t ticks) {
+    return ticks * timestamp_seconds_per_tick;
+}
+
 #if defined(GENESIS_OS_WINDOWS)
+typedef HANDLE (WINAPI *AvSetMmThreadCharacteristicsWFn)(LPCWSTR task_name, LPDWORD task_index);
+typedef BOOL (WINAPI *AvRevertMmThreadCharacteristicsFn)(HANDLE avrt_handle);
+
 static DWORD WINAPI run_win32_thread(LPVOID userdata) {
     struct OsThread *thread = (struct OsThread *)userdata;
     HRESULT err = CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
     assert(err == S_OK);
+    // avrt.dll is looked up at run time so that nothing else has to link it
+    HMODULE avrt = nullptr;
+    HANDLE mmcss_handle = nullptr;
+    AvRevertMmThreadCharacteristicsFn revert = nullptr;
+    if (thread->attributes.policy != OsThreadPolicyNormal) {
+        avrt = LoadLibraryW(L"avrt.dll");
+        AvSetMmThreadCharacteristicsWFn set = avrt ? (AvSetMmThreadCharacteristicsWFn)
+            GetProcAddress(avrt, "AvSetMmThreadCharacteristicsW") : nullptr;
+        revert = avrt ? (AvRevertMmThreadCharacteristicsFn)
+            GetProcAddress(avrt, "AvRevertMmThreadCharacteristics") : nullptr;
+        DWORD task_index = 0;
+        if (set)
+            mmcss_handle = set(L"Pro Audio", &task_index);
+        if (!mmcss_handle)
+            emit_warning(WarningHighPriorityThread);
+    }
     thread->run(thread->arg);
+    log_release_thread();
+    if (mmcss_handle && revert)
+        revert(mmcss_handle);
+    if (avrt)
+        FreeLibrary(avrt);
     CoUninitialize();
     return 0;
 }
@@ -578,9 +1141,34 @@ static void assert_no_err(int err) {
     assert(!err);
 }
 
+#if defined(__MACH__)
+// a thread that needs up to 5 ms of CPU time at a stretch, within 10 ms of
+// becoming runnable
+static void set_time_constraint_policy(void) {
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    double ticks_per_ns = (double)timebase.denom / (double)timebase.numer;
+    thread_time_constraint_policy_data_t policy;
+    policy.period = 0;
+    policy.computation = (uint32_t)(5000000 * ticks_per_ns);
+    policy.constraint = (uint32_t)(10000000 * ticks_per_ns);
+    policy.preemptible = true;
+    if (thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_TIME_CONSTRAINT_POLICY,
+                (thread_policy_t)&policy, THREAD_TIME_CONSTRAINT_POLICY_COUNT) != KERN_SUCCESS)
+    {
+        emit_warning(WarningHighPriorityThread);
+    }
+}
+#endif
+
 static void *run_pthread(void *userdata) {
     struct OsThread *thread = (struct OsThread *)userdata;
+#if defined(__MACH__)
+    if (thread->attributes.policy != OsThreadPolicyNormal)
+        set_time_constraint_policy();
+#endif
     thread->run(thread->arg);
+    log_release_thread();
     return NULL;
 }
 #endif
@@ -589,6 +1177,16 @@ int os_thread_create(
         void (*run)(void *arg), void *arg,
         bool high_priority,
         struct OsThread ** out_thread)
+{
+    OsThreadAttributes attributes = {};
+    attributes.policy = high_priority ? OsThreadPolicyRealtimeFifo : OsThreadPolicyNormal;
+    return os_thread_create_with_attributes(run, arg, &attributes, out_thread);
+}
+
+int os_thread_create_with_attributes(
+        void (*run)(void *arg), void *arg,
+        const struct OsThreadAttributes *attributes,
+        struct OsThread ** out_thread)
 {
     *out_thread = NULL;
 
@@ -600,18 +1198,29 @@ int os_thread_create(
 
     thread->run = run;
     thread->arg = arg;
+    thread->attributes = *attributes;
+    bool realtime = attributes->policy != OsThreadPolicyNormal;
 
 #if defined(GENESIS_OS_WINDOWS)
-    thread->handle = CreateThread(NULL, 0, run_win32_thread, thread, 0, &thread->id);
+    // started suspended, so that it only runs where it is allowed to
+    thread->handle = CreateThread(NULL, 0, run_win32_thread, thread, CREATE_SUSPENDED, &thread->id);
     if (!thread->handle) {
         os_thread_destroy(thread);
         return GenesisErrorSystemResources;
     }
-    if (high_priority) {
+    if (attributes->cpu_mask && !SetThreadAffinityMask(thread->handle, (DWORD_PTR)attributes->cpu_mask)) {
+        TerminateThread(thread->handle, 0);
+        CloseHandle(thread->handle);
+        thread->handle = nullptr;
+        os_thread_destroy(thread);
+        return GenesisErrorInvalidParam;
+    }
+    if (realtime) {
         if (!SetThreadPriority(thread->handle, THREAD_PRIORITY_TIME_CRITICAL)) {
             emit_warning(WarningHighPriorityThread);
         }
     }
+    ResumeThread(thread->handle);
 #else
     int err;
     if ((err = pthread_attr_init(&thread->attr))) {
@@ -619,31 +1228,65 @@ int os_thread_create(
         return GenesisErrorNoMem;
     }
     thread->attr_init = true;
-    
-    if (high_priority) {
-        int max_priority = sched_get_priority_max(SCHED_FIFO);
-        if (max_priority == -1) {
+
+#if defined(__linux__)
+    if (attributes->cpu_mask) {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        for (int cpu = 0; cpu < 64; cpu += 1) {
+            if (attributes->cpu_mask & ((uint64_t)1 << cpu))
+                CPU_SET(cpu, &cpu_set);
+        }
+        if ((err = pthread_attr_setaffinity_np(&thread->attr, sizeof(cpu_set_t), &cpu_set))) {
             os_thread_destroy(thread);
-            return GenesisErrorSystemResources;
+            return GenesisErrorInvalidParam;
         }
+    }
+#endif
 
-        if ((err = pthread_attr_setschedpolicy(&thread->attr, SCHED_FIFO))) {
+    // macOS threads get their policy once they run
+#if !defined(__MACH__)
+    if (realtime) {
+        int policy = (attributes->policy == OsThreadPolicyRealtimeRoundRobin) ? SCHED_RR : SCHED_FIFO;
+        int max_priority = sched_get_priority_max(policy);
+        int min_priority = sched_get_priority_min(policy);
+        if (max_priority == -1 || min_priority == -1) {
             os_thread_destroy(thread);
             return GenesisErrorSystemResources;
         }
 
-        struct sched_param param;
-        param.sched_priority = max_priority;
+        if ((err = pthread_attr_setschedpolicy(&thread->attr, policy))) {
+            os_thread_destroy(thread);
+            return GenesisErrorSystemResources;
+        }
+
+        struct sched_param param;
+        param.sched_priority = (attributes->priority == 0) ? max_priority :
+            clamp(min_priority, attributes->priority, max_priority);
         if ((err = pthread_attr_setschedparam(&thread->attr, &param))) {
             os_thread_destroy(thread);
             return GenesisErrorSystemResources;
         }
+
+        // otherwise the new thread takes the policy of this one and the
+        // two above are ignored
+        if ((err = pthread_attr_setinheritsched(&thread->attr, PTHREAD_EXPLICIT_SCHED))) {
+            os_thread_destroy(thread);
+            return GenesisErrorSystemResources;
+        }
     }
+#endif
 
     if ((err = pthread_create(&thread->id, &thread->attr, run_pthread, thread))) {
-        if (err == EPERM && high_priority) {
+        if (err == EPERM && realtime) {
+            // keep the affinity, drop the policy
             emit_warning(WarningHighPriorityThread);
-            err = pthread_create(&thread->id, NULL, run_pthread, thread);
+            assert_no_err(pthread_attr_setinheritsched(&thread->attr, PTHREAD_INHERIT_SCHED));
+            err = pthread_create(&thread->id, &thread->attr, run_pthread, thread);
+        }
+        if (err == EINVAL && attributes->cpu_mask) {
+            os_thread_destroy(thread);
+            return GenesisErrorInvalidParam;
         }
         if (err) {
             os_thread_destroy(thread);
@@ -719,6 +1362,7 @@ void os_mutex_destroy(struct OsMutex *mutex) {
 }
 
 void os_mutex_lock(struct OsMutex *mutex) {
+    alloc_debug_on_lock();
 #if defined(GENESIS_OS_WINDOWS)
     EnterCriticalSection(&mutex->id);
 #else
@@ -839,9 +1483,36 @@ void os_cond_signal(struct OsCond *cond,
 #endif
 }
 
+void os_cond_broadcast(struct OsCond *cond,
+        struct OsMutex *locked_mutex)
+{
+#if defined(GENESIS_OS_WINDOWS)
+    if (locked_mutex) {
+        WakeAllConditionVariable(&cond->id);
+    } else {
+        EnterCriticalSection(&cond->default_cs_id);
+        WakeAllConditionVariable(&cond->id);
+        LeaveCriticalSection(&cond->default_cs_id);
+    }
+#elif defined(GENESIS_OS_KQUEUE)
+    // there is no broadcast for a user event; waiters must tolerate being
+    // woken one at a time
+    os_cond_signal(cond, locked_mutex);
+#else
+    if (locked_mutex) {
+        assert_no_err(pthread_cond_broadcast(&cond->id));
+    } else {
+        assert_no_err(pthread_mutex_lock(&cond->default_mutex_id));
+        assert_no_err(pthread_cond_broadcast(&cond->id));
+        assert_no_err(pthread_mutex_unlock(&cond->default_mutex_id));
+    }
+#endif
+}
+
 void os_cond_timed_wait(struct OsCond *cond,
         struct OsMutex *locked_mutex, double seconds)
 {
+    alloc_debug_on_lock();
 #if defined(GENESIS_OS_WINDOWS)
     CRITICAL_SECTION *target_cs;
     if (locked_mutex) {
@@ -906,6 +1577,7 @@ void os_cond_timed_wait(struct OsCond *cond,
 void os_cond_wait(struct OsCond *cond,
         struct OsMutex *locked_mutex)
 {
+    alloc_debug_on_lock();
 #if defined(GENESIS_OS_WINDOWS)
     CRITICAL_SECTION *target_cs;
     if (locked_mutex) {
@@ -954,6 +1626,109 @@ void os_cond_wait(struct OsCond *cond,
 #endif
 }
 
+struct OsPollEvent *os_poll_event_create(void) {
+    struct OsPollEvent *event = allocate_zero<OsPollEvent>(1);
+    if (!event)
+        return nullptr;
+#if defined(GENESIS_OS_WINDOWS)
+    // manual reset, so that it stays signaled until os_poll_event_reset
+    if (!(event->handle = CreateEvent(nullptr, TRUE, FALSE, nullptr))) {
+        free(event);
+        return nullptr;
+    }
+#elif defined(GENESIS_OS_KQUEUE)
+    if ((event->fd = kqueue()) == -1) {
+        free(event);
+        return nullptr;
+    }
+    struct kevent kev;
+    EV_SET(&kev, notify_ident, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, nullptr);
+    if (kevent(event->fd, &kev, 1, nullptr, 0, nullptr) == -1) {
+        close(event->fd);
+        free(event);
+        return nullptr;
+    }
+#elif defined(__linux__)
+    if ((event->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+        free(event);
+        return nullptr;
+    }
+#else
+    if (pipe(event->fds) == -1) {
+        free(event);
+        return nullptr;
+    }
+    for (int i = 0; i < 2; i += 1) {
+        fcntl(event->fds[i], F_SETFL, fcntl(event->fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(event->fds[i], F_SETFD, FD_CLOEXEC);
+    }
+#endif
+    return event;
+}
+
+void os_poll_event_destroy(struct OsPollEvent *event) {
+    if (!event)
+        return;
+#if defined(GENESIS_OS_WINDOWS)
+    CloseHandle(event->handle);
+#elif defined(GENESIS_OS_KQUEUE) || defined(__linux__)
+    close(event->fd);
+#else
+    close(event->fds[0]);
+    close(event->fds[1]);
+#endif
+    free(event);
+}
+
+// a full pipe or counter is already readable, so a write that would block
+// has nothing left to do
+void os_poll_event_signal(struct OsPollEvent *event) {
+#if defined(GENESIS_OS_WINDOWS)
+    SetEvent(event->handle);
+#elif defined(GENESIS_OS_KQUEUE)
+    struct kevent kev;
+    EV_SET(&kev, notify_ident, EVFILT_USER, 0, NOTE_TRIGGER, 0, nullptr);
+    struct timespec timeout = {0, 0};
+    kevent(event->fd, &kev, 1, nullptr, 0, &timeout);
+#elif defined(__linux__)
+    uint64_t value = 1;
+    ssize_t amt = write(event->fd, &value, sizeof(value));
+    (void)amt;
+#else
+    char value = 0;
+    ssize_t amt = write(event->fds[1], &value, 1);
+    (void)amt;
+#endif
+}
+
+void os_poll_event_reset(struct OsPollEvent *event) {
+#if defined(GENESIS_OS_WINDOWS)
+    ResetEvent(event->handle);
+#elif defined(GENESIS_OS_KQUEUE)
+    // EV_CLEAR resets the event once it is taken off the queue
+    struct kevent kev;
+    struct timespec timeout = {0, 0};
+    while (kevent(event->fd, nullptr, 0, &kev, 1, &timeout) > 0) {}
+#elif defined(__linux__)
+    uint64_t value;
+    ssize_t amt = read(event->fd, &value, sizeof(value));
+    (void)amt;
+#else
+    char buf[64];
+    while (read(event->fds[0], buf, sizeof(buf)) > 0) {}
+#endif
+}
+
+intptr_t os_poll_event_handle(struct OsPollEvent *event) {
+#if defined(GENESIS_OS_WINDOWS)
+    return (intptr_t)event->handle;
+#elif defined(GENESIS_OS_KQUEUE) || defined(__linux__)
+    return event->fd;
+#else
+    return event->fds[0];
+#endif
+}
+
 static int internal_init(int (*init_once)(void)) {
     uint32_t seed;
     int err;
@@ -975,6 +1750,11 @@ static int internal_init(int (*init_once)(void)) {
     host_get_clock_service(mach_host_self(), SYSTEM_CLOCK, &cclock);
 #endif
 #endif
+    init_timestamp();
+
+    // every thread may log from here on
+    if ((err = log_init()))
+        return err;
 
     if (init_once && (err = init_once())) {
         return err;
@@ -1023,6 +1803,63 @@ static inline size_t ceil_dbl_to_size_t(double x) {
     return truncation + (truncation < x);
 }
 
+#if !defined(GENESIS_OS_WINDOWS)
+// in /dev/shm where there is one, so that the pages are never written out
+static int create_unlinked_shm_file(size_t size, int *out_fd) {
+    char shm_path[] = "/dev/shm/genesis-XXXXXX";
+    char tmp_path[] = "/tmp/genesis-XXXXXX";
+    char *chosen_path;
+
+    int fd = mkstemp(shm_path);
+    if (fd < 0) {
+        fd = mkstemp(tmp_path);
+        if (fd < 0) {
+            return GenesisErrorSystemResources;
+        } else {
+            chosen_path = tmp_path;
+        }
+    } else {
+        chosen_path = shm_path;
+    }
+
+    if (unlink(chosen_path)) {
+        close(fd);
+        return GenesisErrorSystemResources;
+    }
+
+    if (ftruncate(fd, size)) {
+        close(fd);
+        return GenesisErrorSystemResources;
+    }
+    *out_fd = fd;
+    return 0;
+}
+
+// the capacity bytes of fd from offset, twice in a row
+static int map_mirrored_fd(int fd, size_t offset, size_t capacity, char **out_address) {
+    char *address = (char*)mmap(NULL, capacity * 2, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (address == MAP_FAILED)
+        return GenesisErrorNoMem;
+
+    char *other_address = (char*)mmap(address, capacity, PROT_READ|PROT_WRITE,
+            MAP_FIXED|MAP_SHARED, fd, offset);
+    if (other_address != address) {
+        munmap(address, 2 * capacity);
+        return GenesisErrorNoMem;
+    }
+
+    other_address = (char*)mmap(address + capacity, capacity,
+            PROT_READ|PROT_WRITE, MAP_FIXED|MAP_SHARED, fd, offset);
+    if (other_address != address + capacity) {
+        munmap(address, 2 * capacity);
+        return GenesisErrorNoMem;
+    }
+
+    *out_address = address;
+    return 0;
+}
+#endif
+
 int os_init_mirrored_memory(struct OsMirroredMemory *mem, size_t requested_capacity) {
     size_t actual_capacity = ceil_dbl_to_size_t(requested_capacity / (double)page_size) * page_size;
 
@@ -1079,60 +1916,93 @@ int os_init_mirrored_memory(struct OsMirroredMemory *mem, size_t requested_capac
         break;
     }
 #else
-    char shm_path[] = "/dev/shm/genesis-XXXXXX";
-    char tmp_path[] = "/tmp/genesis-XXXXXX";
-    char *chosen_path;
-
-    int fd = mkstemp(shm_path);
-    if (fd < 0) {
-        fd = mkstemp(tmp_path);
-        if (fd < 0) {
-            return GenesisErrorSystemResources;
-        } else {
-            chosen_path = tmp_path;
-        }
-    } else {
-        chosen_path = shm_path;
-    }
-
-    if (unlink(chosen_path)) {
+    int fd;
+    int err;
+    if ((err = create_unlinked_shm_file(actual_capacity, &fd)))
+        return err;
+    if ((err = map_mirrored_fd(fd, 0, actual_capacity, &mem->address))) {
         close(fd);
-        return GenesisErrorSystemResources;
+        return err;
     }
-
-    if (ftruncate(fd, actual_capacity)) {
-        close(fd);
+    if (close(fd))
         return GenesisErrorSystemResources;
-    }
+#endif
 
-    char *address = (char*)mmap(NULL, actual_capacity * 2, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-    if (address == MAP_FAILED)
-        return GenesisErrorNoMem;
+    mem->capacity = actual_capacity;
+    return 0;
+}
 
-    char *other_address = (char*)mmap(address, actual_capacity, PROT_READ|PROT_WRITE,
-            MAP_FIXED|MAP_SHARED, fd, 0);
-    if (other_address != address) {
-        munmap(address, 2 * actual_capacity);
-        close(fd);
-        return GenesisErrorNoMem;
-    }
+int os_shared_memory_create(struct OsSharedMemory *shm, size_t size) {
+#if defined(GENESIS_OS_WINDOWS)
+    return GenesisErrorUnimplemented;
+#else
+    shm->size = ceil_dbl_to_size_t(size / (double)page_size) * page_size;
+    int err;
+    if ((err = create_unlinked_shm_file(shm->size, &shm->fd)))
+        return err;
+    fcntl(shm->fd, F_SETFD, FD_CLOEXEC);
+    return 0;
+#endif
+}
 
-    other_address = (char*)mmap(address + actual_capacity, actual_capacity,
-            PROT_READ|PROT_WRITE, MAP_FIXED|MAP_SHARED, fd, 0);
-    if (other_address != address + actual_capacity) {
-        munmap(address, 2 * actual_capacity);
-        close(fd);
-        return GenesisErrorNoMem;
-    }
+int os_shared_memory_open(struct OsSharedMemory *shm, int fd, size_t size) {
+#if defined(GENESIS_OS_WINDOWS)
+    return GenesisErrorUnimplemented;
+#else
+    struct stat st;
+    if (fstat(fd, &st) || (size_t)st.st_size < size)
+        return GenesisErrorInvalidParam;
+    shm->fd = fd;
+    shm->size = size;
+    fcntl(shm->fd, F_SETFD, FD_CLOEXEC);
+    return 0;
+#endif
+}
 
-    mem->address = address;
+void os_shared_memory_close(struct OsSharedMemory *shm) {
+#if !defined(GENESIS_OS_WINDOWS)
+    if (shm->fd >= 0)
+        close(shm->fd);
+#endif
+    shm->fd = -1;
+}
 
-    if (close(fd))
-        return GenesisErrorSystemResources;
+int os_shared_memory_map(const struct OsSharedMemory *shm, size_t offset, size_t size, char **out_address) {
+#if defined(GENESIS_OS_WINDOWS)
+    return GenesisErrorUnimplemented;
+#else
+    if (offset % page_size != 0 || size == 0 || offset + size > shm->size)
+        return GenesisErrorInvalidParam;
+    char *address = (char*)mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, shm->fd, offset);
+    if (address == MAP_FAILED)
+        return GenesisErrorNoMem;
+    *out_address = address;
+    return 0;
 #endif
+}
 
-    mem->capacity = actual_capacity;
+void os_shared_memory_unmap(char *address, size_t size) {
+#if !defined(GENESIS_OS_WINDOWS)
+    int err = munmap(address, size);
+    assert(!err);
+#endif
+}
+
+int os_shared_memory_map_mirrored(const struct OsSharedMemory *shm, size_t offset, size_t capacity,
+        struct OsMirroredMemory *mem)
+{
+#if defined(GENESIS_OS_WINDOWS)
+    return GenesisErrorUnimplemented;
+#else
+    if (offset % page_size != 0 || capacity % page_size != 0 || capacity == 0 || offset + capacity > shm->size)
+        return GenesisErrorInvalidParam;
+    int err;
+    if ((err = map_mirrored_fd(shm->fd, offset, capacity, &mem->address)))
+        return err;
+    mem->capacity = capacity;
+    mem->priv = nullptr;
     return 0;
+#endif
 }
 
 void os_deinit_mirrored_memory(struct OsMirroredMemory *mem) {
@@ -1152,6 +2022,86 @@ void os_deinit_mirrored_memory(struct OsMirroredMemory *mem) {
 #endif
 }
 
+size_t os_huge_page_size(void) {
+    return 2 * 1024 * 1024;
+}
+
+void os_mirrored_memory_advise_huge_pages(struct OsMirroredMemory *mem) {
+#if defined(MADV_HUGEPAGE)
+    if (mem->capacity % os_huge_page_size() == 0)
+        madvise(mem->address, 2 * mem->capacity, MADV_HUGEPAGE);
+#endif
+}
+
+void os_mirrored_memory_bind_numa_node(struct OsMirroredMemory *mem, int numa_node) {
+#if defined(__linux__) && defined(SYS_mbind)
+    // the second mapping shares its pages with the first
+    unsigned long node_mask[4] = {0};
+    static const int max_node = sizeof(node_mask) * 8;
+    if (numa_node < 0 || numa_node >= max_node)
+        return;
+    node_mask[numa_node / (sizeof(unsigned long) * 8)] |= 1UL << (numa_node % (sizeof(unsigned long) * 8));
+    syscall(SYS_mbind, mem->address, mem->capacity, MPOL_PREFERRED, node_mask, max_node, MPOL_MF_MOVE);
+#endif
+}
+
+int os_map_file(const char *path, struct OsMappedFile *out_mapped_file) {
+#if defined(GENESIS_OS_WINDOWS)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return GenesisErrorFileAccess;
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        CloseHandle(file);
+        return GenesisErrorFileAccess;
+    }
+    HANDLE handle = CreateFileMapping(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!handle)
+        return GenesisErrorSystemResources;
+    char *address = (char*)MapViewOfFile(handle, FILE_MAP_COPY, 0, 0, 0);
+    if (!address) {
+        CloseHandle(handle);
+        return GenesisErrorNoMem;
+    }
+    out_mapped_file->priv = handle;
+    size_t size = file_size.QuadPart;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return (errno == ENOENT) ? GenesisErrorFileNotFound : GenesisErrorFileAccess;
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size == 0) {
+        close(fd);
+        return GenesisErrorFileAccess;
+    }
+    char *address = (char*)mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED)
+        return GenesisErrorNoMem;
+    size_t size = st.st_size;
+#endif
+    out_mapped_file->address = address;
+    out_mapped_file->size = size;
+    return 0;
+}
+
+void os_unmap_file(struct OsMappedFile *mapped_file) {
+    if (!mapped_file->address)
+        return;
+#if defined(GENESIS_OS_WINDOWS)
+    BOOL ok = UnmapViewOfFile(mapped_file->address);
+    assert(ok);
+    ok = CloseHandle((HANDLE)mapped_file->priv);
+    assert(ok);
+#else
+    int err = munmap(mapped_file->address, mapped_file->size);
+    assert(!err);
+#endif
+    mapped_file->address = nullptr;
+}
+
 int os_concurrency(void) {
     long cpu_core_count = sysconf(_SC_NPROCESSORS_ONLN);
     if (cpu_core_count <= 0)
@@ -1159,6 +2109,366 @@ int os_concurrency(void) {
     return cpu_core_count;
 }
 
+long os_get_peak_memory_bytes(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage))
+        return 0;
+#if defined(__MACH__)
+    return usage.ru_maxrss;
+#else
+    // kilobytes everywhere else
+    return usage.ru_maxrss * 1024L;
+#endif
+}
+
+static void count_cpu_topology(OsCpuTopology *topology) {
+    topology->online_count = 0;
+    topology->core_count = 0;
+    topology->package_count = 1;
+    topology->numa_node_count = 1;
+    topology->performance_class_count = 1;
+    for (int cpu = 0; cpu < topology->cpu_count; cpu += 1) {
+        OsCpuInfo *info = &topology->cpus[cpu];
+        if (!info->online)
+            continue;
+        topology->online_count += 1;
+        topology->core_count = max(topology->core_count, info->core + 1);
+        topology->package_count = max(topology->package_count, info->package + 1);
+        topology->numa_node_count = max(topology->numa_node_count, info->numa_node + 1);
+        topology->performance_class_count = max(topology->performance_class_count, info->performance_class + 1);
+    }
+}
+
+static int init_cpu_topology(OsCpuTopology *topology, int cpu_count) {
+    topology->cpu_count = max(1, cpu_count);
+    topology->cpus = allocate_zero<OsCpuInfo>(topology->cpu_count);
+    if (!topology->cpus)
+        return GenesisErrorNoMem;
+    for (int cpu = 0; cpu < topology->cpu_count; cpu += 1) {
+        OsCpuInfo *info = &topology->cpus[cpu];
+        info->online = true;
+        info->core = cpu;
+        info->l2_group = -1;
+        info->l3_group = -1;
+    }
+    return 0;
+}
+
+#if defined(__linux__)
+static bool read_sysfs(const char *path, char *buf, int buf_size) {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    size_t amt_read = fread(buf, 1, buf_size - 1, f);
+    fclose(f);
+    buf[amt_read] = 0;
+    return true;
+}
+
+static bool read_sysfs_int(const char *path, int *out_value) {
+    char buf[32];
+    if (!read_sysfs(path, buf, sizeof(buf)))
+        return false;
+    char *end;
+    long value = strtol(buf, &end, 10);
+    if (end == buf)
+        return false;
+    *out_value = value;
+    return true;
+}
+
+// lists look like 0-3,8,10-11
+static bool cpu_list_contains(const char *list, int cpu) {
+    const char *ptr = list;
+    for (;;) {
+        char *end;
+        long first = strtol(ptr, &end, 10);
+        if (end == ptr)
+            return false;
+        long last = first;
+        if (*end == '-') {
+            ptr = end + 1;
+            last = strtol(ptr, &end, 10);
+        }
+        if (cpu >= first && cpu <= last)
+            return true;
+        if (*end != ',')
+            return false;
+        ptr = end + 1;
+    }
+}
+
+static int cpu_list_first(const char *list) {
+    char *end;
+    long first = strtol(list, &end, 10);
+    return (end == list) ? -1 : first;
+}
+
+static int linux_numa_node(int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *dir = opendir(path);
+    if (!dir)
+        return 0;
+    int node = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9') {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+static int get_linux_cpu_topology(OsCpuTopology *topology) {
+    int err;
+    if ((err = init_cpu_topology(topology, sysconf(_SC_NPROCESSORS_CONF))))
+        return err;
+
+    static char list[4096];
+    char path[128];
+    bool have_online = read_sysfs("/sys/devices/system/cpu/online", list, sizeof(list));
+    for (int cpu = 0; cpu < topology->cpu_count; cpu += 1)
+        topology->cpus[cpu].online = !have_online || cpu_list_contains(list, cpu);
+
+    // bigger is faster. arm reports a capacity per CPU; hybrid intel parts
+    // list their efficiency cores.
+    int *capacities = allocate_zero<int>(topology->cpu_count);
+    if (!capacities) {
+        os_cpu_topology_deinit(topology);
+        return GenesisErrorNoMem;
+    }
+    bool have_atom = read_sysfs("/sys/devices/cpu_atom/cpus", list, sizeof(list));
+    for (int cpu = 0; cpu < topology->cpu_count; cpu += 1) {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpu_capacity", cpu);
+        if (!read_sysfs_int(path, &capacities[cpu]))
+            capacities[cpu] = (have_atom && cpu_list_contains(list, cpu)) ? 0 : 1;
+    }
+
+    int *core_ids = allocate_zero<int>(topology->cpu_count);
+    if (!core_ids) {
+        destroy(capacities, topology->cpu_count);
+        os_cpu_topology_deinit(topology);
+        return GenesisErrorNoMem;
+    }
+    int core_count = 0;
+    for (int cpu = 0; cpu < topology->cpu_count; cpu += 1) {
+        OsCpuInfo *info = &topology->cpus[cpu];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+        if (!read_sysfs_int(path, &info->package) || info->package < 0)
+            info->package = 0;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+        if (!read_sysfs_int(path, &core_ids[cpu]))
+            core_ids[cpu] = -1 - cpu;
+        // core ids are only unique within a package
+        info->core = -1;
+        for (int other = 0; other < cpu; other += 1) {
+            if (core_ids[other] == core_ids[cpu] && topology->cpus[other].package == info->package) {
+                info->core = topology->cpus[other].core;
+                break;
+            }
+        }
+        if (info->core == -1)
+            info->core = core_count++;
+
+        for (int index = 0; index < 8; index += 1) {
+            char type[32];
+            int level;
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/type", cpu, index);
+            if (!read_sysfs(path, type, sizeof(type)))
+                break;
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, index);
+            if (strncmp(type, "Instruction", 11) == 0 || !read_sysfs_int(path, &level))
+                continue;
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", cpu, index);
+            if (!read_sysfs(path, list, sizeof(list)))
+                continue;
+            if (level == 2)
+                info->l2_group = cpu_list_first(list);
+            else if (level == 3)
+                info->l3_group = cpu_list_first(list);
+        }
+
+        info->numa_node = linux_numa_node(cpu);
+    }
+
+    // the distinct capacities, fastest first, are the classes
+    for (int cpu = 0; cpu < topology->cpu_count; cpu += 1) {
+        int faster_count = 0;
+        for (int other = 0; other < topology->cpu_count; other += 1) {
+            if (capacities[other] <= capacities[cpu])
+                continue;
+            bool seen = false;
+            for (int before = 0; before < other && !seen; before += 1)
+                seen = capacities[before] == capacities[other];
+            faster_count += seen ? 0 : 1;
+        }
+        topology->cpus[cpu].performance_class = faster_count;
+    }
+
+    destroy(core_ids, topology->cpu_count);
+    destroy(capacities, topology->cpu_count);
+    return 0;
+}
+#elif defined(__MACH__)
+static int sysctl_int(const char *name, int default_value) {
+    int value;
+    size_t size = sizeof(value);
+    if (sysctlbyname(name, &value, &size, nullptr, 0))
+        return default_value;
+    return value;
+}
+
+static int get_mach_cpu_topology(OsCpuTopology *topology) {
+    int err;
+    int cpu_count = sysctl_int("hw.logicalcpu", os_concurrency());
+    if ((err = init_cpu_topology(topology, cpu_count)))
+        return err;
+    int level_count = max(1, sysctl_int("hw.nperflevels", 1));
+    int cpu = 0;
+    int core = 0;
+    char name[64];
+    for (int level = 0; level < level_count && cpu < topology->cpu_count; level += 1) {
+        snprintf(name, sizeof(name), "hw.perflevel%d.logicalcpu", level);
+        int logical_count = sysctl_int(name, (level_count == 1) ? cpu_count : 0);
+        snprintf(name, sizeof(name), "hw.perflevel%d.physicalcpu", level);
+        int physical_count = max(1, sysctl_int(name, (level_count == 1) ?
+                    sysctl_int("hw.physicalcpu", cpu_count) : logical_count));
+        snprintf(name, sizeof(name), "hw.perflevel%d.cpusperl2", level);
+        int cpus_per_l2 = max(1, sysctl_int(name, logical_count));
+        int cpus_per_core = max(1, logical_count / physical_count);
+        int level_start = cpu;
+        for (int i = 0; i < logical_count && cpu < topology->cpu_count; i += 1, cpu += 1) {
+            OsCpuInfo *info = &topology->cpus[cpu];
+            info->core = core + i / cpus_per_core;
+            info->l2_group = level_start + (i / cpus_per_l2) * cpus_per_l2;
+            info->performance_class = level;
+        }
+        core += (logical_count + cpus_per_core - 1) / cpus_per_core;
+    }
+    return 0;
+}
+#elif defined(GENESIS_OS_WINDOWS)
+static int lowest_cpu(KAFFINITY mask) {
+    return mask ? __builtin_ctzll((unsigned long long)mask) : -1;
+}
+
+// only processor group 0, so at most 64 CPUs
+static int get_windows_cpu_topology(OsCpuTopology *topology) {
+    int err;
+    if ((err = init_cpu_topology(topology, GetActiveProcessorCount(0))))
+        return err;
+    DWORD length = 0;
+    GetLogicalProcessorInformationEx(RelationAll, nullptr, &length);
+    char *buf = allocate_nonzero<char>(length);
+    if (!buf) {
+        os_cpu_topology_deinit(topology);
+        return GenesisErrorNoMem;
+    }
+    if (!GetLogicalProcessorInformationEx(RelationAll, (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)buf, &length)) {
+        destroy(buf, length);
+        return 0;
+    }
+    int core = 0;
+    int package = 0;
+    int max_efficiency_class = 0;
+    for (DWORD offset = 0; offset < length;) {
+        PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX item = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)(buf + offset);
+        offset += item->Size;
+        KAFFINITY mask = 0;
+        switch (item->Relationship) {
+            case RelationProcessorCore:
+            case RelationProcessorPackage:
+                if (item->Processor.GroupMask[0].Group == 0)
+                    mask = item->Processor.GroupMask[0].Mask;
+                break;
+            case RelationCache:
+                if (item->Cache.GroupMask.Group == 0 && item->Cache.Type != CacheInstruction)
+                    mask = item->Cache.GroupMask.Mask;
+                break;
+            case RelationNumaNode:
+                if (item->NumaNode.GroupMask.Group == 0)
+                    mask = item->NumaNode.GroupMask.Mask;
+                break;
+            default:
+                break;
+        }
+        for (int cpu = 0; cpu < topology->cpu_count; cpu += 1) {
+            if (!(mask & ((KAFFINITY)1 << cpu)))
+                continue;
+            OsCpuInfo *info = &topology->cpus[cpu];
+            if (item->Relationship == RelationProcessorCore) {
+                info->core = core;
+                // for now the higher class is the faster one
+                info->performance_class = item->Processor.EfficiencyClass;
+                max_efficiency_class = max(max_efficiency_class, (int)item->Processor.EfficiencyClass);
+            } else if (item->Relationship == RelationProcessorPackage) {
+                info->package = package;
+            } else if (item->Relationship == RelationCache && item->Cache.Level == 2) {
+                info->l2_group = lowest_cpu(mask);
+            } else if (item->Relationship == RelationCache && item->Cache.Level == 3) {
+                info->l3_group = lowest_cpu(mask);
+            } else if (item->Relationship == RelationNumaNode) {
+                info->numa_node = item->NumaNode.NodeNumber;
+            }
+        }
+        if (item->Relationship == RelationProcessorCore)
+            core += 1;
+        else if (item->Relationship == RelationProcessorPackage)
+            package += 1;
+    }
+    for (int cpu = 0; cpu < topology->cpu_count; cpu += 1)
+        topology->cpus[cpu].performance_class = max_efficiency_class - topology->cpus[cpu].performance_class;
+    destroy(buf, length);
+    return 0;
+}
+#endif
+
+int os_get_cpu_topology(struct OsCpuTopology *topology) {
+    int err;
+#if defined(__linux__)
+    err = get_linux_cpu_topology(topology);
+#elif defined(__MACH__)
+    err = get_mach_cpu_topology(topology);
+#elif defined(GENESIS_OS_WINDOWS)
+    err = get_windows_cpu_topology(topology);
+#else
+    err = init_cpu_topology(topology, os_concurrency());
+#endif
+    if (err)
+        return err;
+    count_cpu_topology(topology);
+    return 0;
+}
+
+void os_cpu_topology_deinit(struct OsCpuTopology *topology) {
+    destroy(topology->cpus, topology->cpu_count);
+    topology->cpus = nullptr;
+    topology->cpu_count = 0;
+}
+
+uint64_t os_cpu_topology_mask(const struct OsCpuTopology *topology, int performance_class) {
+    uint64_t mask = 0;
+    for (int cpu = 0; cpu < min(topology->cpu_count, 64); cpu += 1) {
+        const OsCpuInfo *info = &topology->cpus[cpu];
+        if (info->online && (performance_class == -1 || info->performance_class == performance_class))
+            mask |= (uint64_t)1 << cpu;
+    }
+    return mask;
+}
+
+uint64_t os_cpu_topology_numa_mask(const struct OsCpuTopology *topology, int numa_node) {
+    uint64_t mask = 0;
+    for (int cpu = 0; cpu < min(topology->cpu_count, 64); cpu += 1) {
+        const OsCpuInfo *info = &topology->cpus[cpu];
+        if (info->online && info->numa_node == numa_node)
+            mask |= (uint64_t)1 << cpu;
+    }
+    return mask;
+}
+
 int os_file_flush(FILE *file) {
     if (fsync(fileno(file))) {
         return GenesisErrorFileAccess;
@@ -1166,6 +2476,97 @@ int os_file_flush(FILE *file) {
     return 0;
 }
 
+int os_file_data_sync(FILE *file) {
+    if (fflush(file))
+        return GenesisErrorFileAccess;
+#if defined(__MACH__)
+    int err = fsync(fileno(file));
+#else
+    int err = fdatasync(fileno(file));
+#endif
+    if (err)
+        return GenesisErrorFileAccess;
+    return 0;
+}
+
+int os_file_read_at(FILE *file, long offset, char *buf, int size) {
+    while (size > 0) {
+#if defined(GENESIS_OS_WINDOWS)
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = (DWORD)offset;
+        overlapped.OffsetHigh = (DWORD)((uint64_t)offset >> 32);
+        DWORD amt_read;
+        HANDLE handle = (HANDLE)_get_osfhandle(fileno(file));
+        if (!ReadFile(handle, buf, size, &amt_read, &overlapped))
+            return GenesisErrorFileAccess;
+#else
+        ssize_t amt_read = pread(fileno(file), buf, size, offset);
+        if (amt_read < 0) {
+            if (errno == EINTR)
+                continue;
+            return GenesisErrorFileAccess;
+        }
+#endif
+        if (amt_read == 0)
+            return GenesisErrorFileAccess;
+        buf += amt_read;
+        offset += amt_read;
+        size -= amt_read;
+    }
+    return 0;
+}
+
+int os_file_write_at(FILE *file, long offset, const OsFileSlice *slices, int count) {
+    int slice_index = 0;
+    int slice_offset = 0;
+    while (slice_index < count) {
+#if defined(GENESIS_OS_WINDOWS)
+        const OsFileSlice *slice = &slices[slice_index];
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = (DWORD)offset;
+        overlapped.OffsetHigh = (DWORD)((uint64_t)offset >> 32);
+        DWORD amt_written;
+        HANDLE handle = (HANDLE)_get_osfhandle(fileno(file));
+        if (!WriteFile(handle, slice->data + slice_offset, slice->size - slice_offset, &amt_written, &overlapped))
+            return GenesisErrorFileAccess;
+        long amt = amt_written;
+#elif defined(__linux__)
+        struct iovec iov[64];
+        int iov_count = 0;
+        for (int i = slice_index; i < count && iov_count < array_length(iov); i += 1) {
+            int skip = (i == slice_index) ? slice_offset : 0;
+            iov[iov_count].iov_base = (void *)(slices[i].data + skip);
+            iov[iov_count].iov_len = slices[i].size - skip;
+            iov_count += 1;
+        }
+        ssize_t amt = pwritev(fileno(file), iov, iov_count, offset);
+        if (amt < 0) {
+            if (errno == EINTR)
+                continue;
+            return GenesisErrorFileAccess;
+        }
+#else
+        const OsFileSlice *slice = &slices[slice_index];
+        ssize_t amt = pwrite(fileno(file), slice->data + slice_offset, slice->size - slice_offset, offset);
+        if (amt < 0) {
+            if (errno == EINTR)
+                continue;
+            return GenesisErrorFileAccess;
+        }
+#endif
+        offset += amt;
+        // move past what was written, which may end inside a slice
+        while (slice_index < count && amt >= slices[slice_index].size - slice_offset) {
+            amt -= slices[slice_index].size - slice_offset;
+            slice_index += 1;
+            slice_offset = 0;
+        }
+        if (slice_index < count)
+            slice_offset += amt;
+    }
+    return 0;
+}
+
 int os_file_size(FILE *file, long *size) {
     int err;
     struct stat st;
@@ -1176,8 +2577,213 @@ int os_file_size(FILE *file, long *size) {
     return 0;
 }
 
+int os_file_open_direct(const char *path, FILE **out_file) {
+#if defined(__linux__) || defined(__MACH__)
+#if defined(__linux__)
+    int fd = open(path, O_WRONLY|O_CLOEXEC|O_DIRECT);
+    if (fd == -1)
+        return (errno == EINVAL) ? GenesisErrorUnimplemented : GenesisErrorFileAccess;
+#else
+    int fd = open(path, O_WRONLY|O_CLOEXEC);
+    if (fd == -1)
+        return GenesisErrorFileAccess;
+    if (fcntl(fd, F_NOCACHE, 1) == -1) {
+        close(fd);
+        return GenesisErrorUnimplemented;
+    }
+#endif
+    FILE *file = fdopen(fd, "wb");
+    if (!file) {
+        close(fd);
+        return GenesisErrorNoMem;
+    }
+    *out_file = file;
+    return 0;
+#else
+    return GenesisErrorUnimplemented;
+#endif
+}
+
+int os_file_preallocate(FILE *file, long size) {
+    long old_size;
+    int err;
+    if ((err = os_file_size(file, &old_size)))
+        return err;
+#if defined(GENESIS_OS_WINDOWS)
+    // ntfs allocates the clusters of a longer file right away
+    if (old_size < size && _chsize_s(fileno(file), size))
+        return GenesisErrorFileAccess;
+    return 0;
+#else
+    int fd = fileno(file);
+#if defined(__linux__)
+    if (fallocate(fd, 0, 0, size) == 0)
+        return 0;
+    if (errno != EOPNOTSUPP)
+        return GenesisErrorFileAccess;
+#elif defined(__MACH__)
+    if (old_size < size) {
+        // contiguous if the file system can, anywhere otherwise
+        fstore_t store = {F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, size - old_size, 0};
+        if (fcntl(fd, F_PREALLOCATE, &store) == -1) {
+            store.fst_flags = F_ALLOCATEALL;
+            fcntl(fd, F_PREALLOCATE, &store);
+        }
+    }
+#endif
+    if (old_size < size && ftruncate(fd, size))
+        return GenesisErrorFileAccess;
+    return 0;
+#endif
+}
+
+int os_file_truncate(FILE *file, long size) {
+#if defined(GENESIS_OS_WINDOWS)
+    if (_chsize_s(fileno(file), size))
+        return GenesisErrorFileAccess;
+#else
+    if (ftruncate(fileno(file), size))
+        return GenesisErrorFileAccess;
+#endif
+    return 0;
+}
+
 int os_get_current_year(void) {
     time_t t = time(nullptr);
     struct tm *gmt = gmtime(&t);
     return gmt->tm_year + 1900;
 }
+
+int os_udp_socket_open(struct OsUdpSocket *sock, const char *address, int port, int dscp,
+        int multicast_ttl)
+{
+#if defined(GENESIS_OS_WINDOWS)
+    return GenesisErrorUnimplemented;
+#else
+    if (port <= 0 || port > 65535)
+        return GenesisErrorInvalidParam;
+    char port_str[16];
+    snprintf(port_str, sizeof(port_str), "%d", port);
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+    struct addrinfo *info;
+    if (getaddrinfo(address, port_str, &hints, &info))
+        return GenesisErrorInvalidParam;
+
+    int fd = socket(info->ai_family, info->ai_socktype | SOCK_CLOEXEC, info->ai_protocol);
+    if (fd == -1) {
+        freeaddrinfo(info);
+        return GenesisErrorSystemResources;
+    }
+    // the dscp is the top six bits of the traffic class byte
+    int traffic_class = dscp << 2;
+    int ttl = multicast_ttl;
+    if (info->ai_family == AF_INET6) {
+        setsockopt(fd, IPPROTO_IPV6, IPV6_TCLASS, &traffic_class, sizeof(traffic_class));
+        setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &ttl, sizeof(ttl));
+    } else {
+        setsockopt(fd, IPPROTO_IP, IP_TOS, &traffic_class, sizeof(traffic_class));
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    }
+    int err = connect(fd, info->ai_addr, info->ai_addrlen);
+    freeaddrinfo(info);
+    if (err) {
+        close(fd);
+        return GenesisErrorConnectionRefused;
+    }
+    sock->fd = fd;
+    return 0;
+#endif
+}
+
+void os_udp_socket_close(struct OsUdpSocket *sock) {
+#if !defined(GENESIS_OS_WINDOWS)
+    close(sock->fd);
+    sock->fd = -1;
+#endif
+}
+
+int os_udp_socket_send(const struct OsUdpSocket *sock, const struct OsUdpDatagram *datagrams,
+        int count, int *out_sent_count)
+{
+    *out_sent_count = 0;
+#if defined(GENESIS_OS_WINDOWS)
+    return GenesisErrorUnimplemented;
+#elif defined(__linux__)
+    static const int max_batch = 64;
+    struct iovec iovecs[max_batch];
+    struct mmsghdr messages[max_batch];
+    while (*out_sent_count < count) {
+        int batch_count = min(count - *out_sent_count, max_batch);
+        for (int i = 0; i < batch_count; i += 1) {
+            const OsUdpDatagram *datagram = &datagrams[*out_sent_count + i];
+            iovecs[i].iov_base = (void *)datagram->data;
+            iovecs[i].iov_len = datagram->size;
+            memset(&messages[i], 0, sizeof(struct mmsghdr));
+            messages[i].msg_hdr.msg_iov = &iovecs[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+        int sent = sendmmsg(sock->fd, messages, batch_count, 0);
+        if (sent == -1) {
+            if (errno == EINTR)
+                continue;
+            return (errno == ENOBUFS || errno == EAGAIN) ? GenesisErrorQueueFull : GenesisErrorSystemResources;
+        }
+        *out_sent_count += sent;
+    }
+    return 0;
+#else
+    while (*out_sent_count < count) {
+        const OsUdpDatagram *datagram = &datagrams[*out_sent_count];
+        if (send(sock->fd, datagram->data, datagram->size, 0) == -1) {
+            if (errno == EINTR)
+                continue;
+            return (errno == ENOBUFS || errno == EAGAIN) ? GenesisErrorQueueFull : GenesisErrorSystemResources;
+        }
+        *out_sent_count += 1;
+    }
+    return 0;
+#endif
+}
+
+#if defined(__linux__) && defined(CLOCK_TAI)
+static const clockid_t media_clock_id = CLOCK_TAI;
+#elif !defined(GENESIS_OS_WINDOWS)
+static const clockid_t media_clock_id = CLOCK_REALTIME;
+#endif
+
+int64_t os_get_media_time_ns(void) {
+#if defined(GENESIS_OS_WINDOWS)
+    return (int64_t)(os_get_time() * 1000000000.0);
+#else
+    struct timespec tms;
+    clock_gettime(media_clock_id, &tms);
+    return tms.tv_sec * (int64_t)1000000000 + tms.tv_nsec;
+#endif
+}
+
+void os_sleep_until_media_time_ns(int64_t time_ns) {
+#if defined(GENESIS_OS_WINDOWS)
+    int64_t wait_ns = time_ns - os_get_media_time_ns();
+    if (wait_ns > 0)
+        Sleep((DWORD)((wait_ns + 999999) / 1000000));
+#elif defined(__linux__)
+    struct timespec tms;
+    tms.tv_sec = time_ns / 1000000000;
+    tms.tv_nsec = time_ns % 1000000000;
+    while (clock_nanosleep(media_clock_id, TIMER_ABSTIME, &tms, nullptr) == EINTR) {}
+#else
+    for (;;) {
+        int64_t wait_ns = time_ns - os_get_media_time_ns();
+        if (wait_ns <= 0)
+            break;
+        struct timespec tms;
+        tms.tv_sec = wait_ns / 1000000000;
+        tms.tv_nsec = wait_ns % 1000000000;
+        nanosleep(&tms, nullptr);
+    }
+#endif
+}
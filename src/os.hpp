@@ -6,9 +6,13 @@
 #include "sha_256_hasher.hpp"
 
 #include <stdio.h>
+#include <stdint.h>
 
 struct OsDirEntry {
     ByteBuffer name;
+    // the lower case of name, then a 0 byte and name itself, so that
+    // ByteBuffer::compare orders entries without case and without ties
+    ByteBuffer sort_key;
     bool is_dir;
     bool is_file;
     bool is_link;
@@ -25,6 +29,7 @@ void os_get_app_dir(ByteBuffer &out);
 void os_get_projects_dir(ByteBuffer &out);
 void os_get_app_config_dir(ByteBuffer &out);
 void os_get_app_config_path(ByteBuffer &out);
+void os_get_sample_index_path(ByteBuffer &out);
 void os_get_samples_dir(ByteBuffer &out);
 
 uint32_t os_random_uint32(void); // 32 bits of entropy
@@ -32,6 +37,12 @@ uint64_t os_random_uint64(void); // 64 bits of entropy
 double os_random_double(void); // 32 bits of entropy in range [0.0, 1.0)
 void os_open_in_browser(const String &url);
 double os_get_time(void);
+// a count of the cheapest steady counter there is, for timing what happens
+// too often for os_get_time: the TSC on x86 when its rate is constant, the
+// virtual counter on arm64, and the raw monotonic clock otherwise. only
+// differences mean anything; os_timestamp_to_seconds converts them.
+uint64_t os_timestamp(void);
+double os_timestamp_to_seconds(int64_t ticks);
 String os_get_user_name(void);
 
 int os_delete(const char *path);
@@ -44,7 +55,34 @@ struct OsTempFile {
 int os_create_temp_file(const char *dir, OsTempFile *out_tmp_file);
 
 int os_file_flush(FILE *file);
+// flushes the stdio buffer and syncs the file's data, but not necessarily
+// metadata such as its modification time
+int os_file_data_sync(FILE *file);
+// reads size bytes at offset without moving the position of file or
+// using its buffer, so other threads may read this way at the same time
+int os_file_read_at(FILE *file, long offset, char *buf, int size);
+struct OsFileSlice {
+    const char *data;
+    int size;
+};
+// writes the slices one after another at offset, past any buffering of
+// file, in as few system calls as the os allows
+int os_file_write_at(FILE *file, long offset, const OsFileSlice *slices, int count);
 int os_file_size(FILE *file, long *out_size);
+// buffers, offsets and sizes of writes to a file opened with
+// os_file_open_direct must be multiples of this
+static const int OS_DIRECT_IO_ALIGNMENT = 4096;
+// opens the existing file at path for os_file_write_at writes that skip the
+// os cache: O_DIRECT on linux and F_NOCACHE on macOS. returns
+// GenesisErrorUnimplemented elsewhere and on file systems which cannot do
+// it, such as tmpfs.
+int os_file_open_direct(const char *path, FILE **out_file);
+// reserves disk space for the first size bytes of file, so that writes
+// within them never wait for the file system to find room. file is at least
+// size bytes long afterwards. where space cannot be reserved the file is
+// only made longer.
+int os_file_preallocate(FILE *file, long size);
+int os_file_truncate(FILE *file, long size);
 
 int os_mkdirp(ByteBuffer path);
 ByteBuffer os_path_dirname(ByteBuffer path);
@@ -58,19 +96,76 @@ int os_copy_no_clobber(const char *source_path, const char *dest_dir,
         const char *prefix, const char *dest_extension,
         ByteBuffer &out_path, Sha256Hasher *hasher);
 int os_copy(const char *source_path, const char *dest_path, Sha256Hasher *hasher);
+// reads the whole file into hasher
+int os_hash_file(const char *path, Sha256Hasher *hasher);
+// makes dest_path another name for the file at source_path. returns
+// GenesisErrorAlreadyExists if dest_path exists, and
+// GenesisErrorUnimplemented where the two cannot share a file, as across
+// file systems.
+int os_hard_link(const char *source_path, const char *dest_path);
+// like os_copy_no_clobber, except that the new file is a hard link to
+// source_path where the file system allows it
+int os_link_no_clobber(const char *source_path, const char *dest_dir,
+        const char *prefix, const char *dest_extension, ByteBuffer &out_path);
 int os_readdir(const char *dir, List<OsDirEntry*> &out_entries);
+// like os_readdir, except that the entries go to on_batch up to batch_size
+// at a time as they are read. on_batch takes refs to the ones it keeps.
+int os_readdir_batched(const char *dir, int batch_size,
+        void (*on_batch)(void *userdata, List<OsDirEntry*> &entries), void *userdata);
 void os_dir_entry_ref(OsDirEntry *dir_entry);
 void os_dir_entry_unref(OsDirEntry *dir_entry);
+// changes whenever an entry is added to dir or removed from it
+int os_dir_mtime(const char *dir, long *out_mtime);
+
+// says which directories had entries added, removed or changed. inotify on
+// linux. elsewhere os_dir_watcher_create returns GenesisErrorUnimplemented.
+struct OsDirWatcher;
+int os_dir_watcher_create(OsDirWatcher **out_watcher);
+void os_dir_watcher_destroy(OsDirWatcher *watcher);
+// only the entries of dir, not those of its subdirectories
+int os_dir_watcher_add(OsDirWatcher *watcher, const char *dir, int *out_watch_id);
+void os_dir_watcher_remove(OsDirWatcher *watcher, int watch_id);
+// does not wait. each watch that changed since the last call is in
+// out_watch_ids once, and -1 means any of them may have.
+int os_dir_watcher_changes(OsDirWatcher *watcher, List<int> &out_watch_ids);
 
 
 
 double os_get_time(void);
 
+enum OsThreadPolicy {
+    OsThreadPolicyNormal,
+    // SCHED_FIFO. on macOS the time constraint policy and on Windows time
+    // critical priority in the MMCSS "Pro Audio" task.
+    OsThreadPolicyRealtimeFifo,
+    // SCHED_RR. the same as OsThreadPolicyRealtimeFifo on macOS and Windows.
+    OsThreadPolicyRealtimeRoundRobin,
+};
+
+struct OsThreadAttributes {
+    OsThreadPolicy policy;
+    // for the realtime policies with pthreads. 0 means the highest that the
+    // policy allows.
+    int priority;
+    // bit i lets the thread run on CPU i. 0 means any CPU. ignored on macOS,
+    // which has no way to pin a thread.
+    uint64_t cpu_mask;
+};
+
 struct OsThread;
+// high_priority is OsThreadPolicyRealtimeFifo at the highest priority
 int os_thread_create(
         void (*run)(void *arg), void *arg,
         bool high_priority,
         struct OsThread ** out_thread);
+// when the process is not allowed a realtime policy, the thread is created
+// anyway with the normal one and WarningHighPriorityThread is emitted.
+// returns GenesisErrorInvalidParam if cpu_mask has no CPU the thread can
+// run on.
+int os_thread_create_with_attributes(
+        void (*run)(void *arg), void *arg,
+        const struct OsThreadAttributes *attributes,
+        struct OsThread ** out_thread);
 
 void os_thread_destroy(struct OsThread *thread);
 
@@ -91,9 +186,24 @@ void os_cond_destroy(struct OsCond *cond);
 // you already have a locked mutex available, pass it; this will be better on
 // systems that use mutexes for conditions.
 void os_cond_signal(struct OsCond *cond, struct OsMutex *locked_mutex);
+// like os_cond_signal but wakes every waiter
+void os_cond_broadcast(struct OsCond *cond, struct OsMutex *locked_mutex);
 void os_cond_timed_wait(struct OsCond *cond, struct OsMutex *locked_mutex, double seconds);
 void os_cond_wait(struct OsCond *cond, struct OsMutex *locked_mutex);
 
+// something that a poll loop outside of genesis can wait on. it is readable
+// from when it is signaled until it is reset: an eventfd on Linux, a kqueue
+// with a user event on macOS and FreeBSD, a manual reset event on Windows and
+// the read end of a pipe elsewhere.
+struct OsPollEvent;
+struct OsPollEvent *os_poll_event_create(void);
+void os_poll_event_destroy(struct OsPollEvent *event);
+// never blocks, so it can be called from any thread
+void os_poll_event_signal(struct OsPollEvent *event);
+void os_poll_event_reset(struct OsPollEvent *event);
+// the file descriptor, or on Windows the HANDLE
+intptr_t os_poll_event_handle(struct OsPollEvent *event);
+
 
 int os_page_size(void);
 
@@ -107,8 +217,89 @@ struct OsMirroredMemory {
 // system page size
 int os_init_mirrored_memory(struct OsMirroredMemory *mem, size_t capacity);
 void os_deinit_mirrored_memory(struct OsMirroredMemory *mem);
+// asks the system to back mem with huge pages. only has an effect where
+// transparent huge pages are available for shared memory, and only on whole
+// huge pages, so small buffers are left alone.
+void os_mirrored_memory_advise_huge_pages(struct OsMirroredMemory *mem);
+// asks the system to keep the pages of mem on numa_node, moving those that
+// are already elsewhere. only has an effect on Linux.
+void os_mirrored_memory_bind_numa_node(struct OsMirroredMemory *mem, int numa_node);
+size_t os_huge_page_size(void);
+
+// memory which another process can map, handed over as a file descriptor.
+// the descriptor is close-on-exec; a child started with
+// os_process_create_inheriting keeps it.
+struct OsSharedMemory {
+    int fd;
+    size_t size;
+};
+// size is rounded up to a multiple of the system page size
+int os_shared_memory_create(struct OsSharedMemory *shm, size_t size);
+// takes over an inherited descriptor of at least size bytes
+int os_shared_memory_open(struct OsSharedMemory *shm, int fd, size_t size);
+// mappings made from shm stay valid after it is closed
+void os_shared_memory_close(struct OsSharedMemory *shm);
+// maps size bytes of shm from offset once. offset must be a multiple of
+// the system page size.
+int os_shared_memory_map(const struct OsSharedMemory *shm, size_t offset, size_t size, char **out_address);
+void os_shared_memory_unmap(char *address, size_t size);
+// maps capacity bytes of shm from offset as mirrored memory. both must be
+// multiples of the system page size. free with os_deinit_mirrored_memory.
+int os_shared_memory_map_mirrored(const struct OsSharedMemory *shm, size_t offset, size_t capacity,
+        struct OsMirroredMemory *mem);
+
+// maps a whole file copy-on-write: writes through the mapping never reach
+// the file. pages are read from disk the first time they are touched.
+struct OsMappedFile {
+    size_t size;
+    char *address;
+    void *priv;
+};
+int os_map_file(const char *path, struct OsMappedFile *out_mapped_file);
+void os_unmap_file(struct OsMappedFile *mapped_file);
 
 int os_concurrency(void);
+// the most memory the process has had resident at once
+long os_get_peak_memory_bytes(void);
+
+// one for each logical CPU, by CPU number
+struct OsCpuInfo {
+    bool online;
+    // the physical core, counting from 0. the logical CPUs of a core with
+    // simultaneous multithreading have the same one.
+    int core;
+    int package;
+    // CPUs with the same group share that cache. the group is the lowest
+    // CPU number sharing it, or -1 when it is not known.
+    int l2_group;
+    int l3_group;
+    int numa_node;
+    // 0 for the fastest cores; efficiency cores have higher classes
+    int performance_class;
+};
+
+struct OsCpuTopology {
+    // every CPU number up to the highest one, online or not
+    int cpu_count;
+    OsCpuInfo *cpus;
+    int online_count;
+    int core_count;
+    int package_count;
+    int numa_node_count;
+    int performance_class_count;
+};
+
+// what cannot be found out is reported as one package, one NUMA node, one
+// performance class and a core for each logical CPU. on macOS, which does
+// not expose which CPU number is which, CPUs are assigned to performance
+// levels in order, fastest first.
+int os_get_cpu_topology(struct OsCpuTopology *topology);
+void os_cpu_topology_deinit(struct OsCpuTopology *topology);
+// the online CPUs below 64 of performance_class, or every class for -1, as
+// an OsThreadAttributes cpu_mask
+uint64_t os_cpu_topology_mask(const struct OsCpuTopology *topology, int performance_class);
+// the online CPUs below 64 of numa_node, as an OsThreadAttributes cpu_mask
+uint64_t os_cpu_topology_numa_mask(const struct OsCpuTopology *topology, int numa_node);
 
 struct OsMutexLocker {
     OsMutexLocker(OsMutex *mutex) {
@@ -127,4 +318,43 @@ int os_get_current_year(void);
 
 void os_spawn_process(const char *exe, const List<ByteBuffer> &args, bool detached);
 
+// a child process which the caller waits for
+struct OsProcess;
+int os_process_create(const char *exe, const List<ByteBuffer> &args, struct OsProcess **out_process);
+// like os_process_create, and the child keeps inherit_fd open across exec
+int os_process_create_inheriting(const char *exe, const List<ByteBuffer> &args, int inherit_fd,
+        struct OsProcess **out_process);
+// whether the process has exited, without waiting for it
+bool os_process_exited(struct OsProcess *process);
+// stops the process at once; still call os_process_wait
+void os_process_kill(struct OsProcess *process);
+// waits for the process to exit and destroys it. exit code is -1 if the
+// process was killed by a signal.
+int os_process_wait(struct OsProcess *process, int *out_exit_code);
+
+// a udp socket connected to one address, for sending datagrams to it
+struct OsUdpSocket {
+    int fd;
+};
+// address is a numeric ipv4 or ipv6 address. the packets are marked with
+// dscp, and cross multicast_ttl routers when the address is multicast.
+int os_udp_socket_open(struct OsUdpSocket *sock, const char *address, int port, int dscp,
+        int multicast_ttl);
+void os_udp_socket_close(struct OsUdpSocket *sock);
+struct OsUdpDatagram {
+    const char *data;
+    int size;
+};
+// sends each datagram in turn, with as few system calls as the os allows.
+// out_sent_count is less than count only when it returns an error;
+// GenesisErrorQueueFull means the os had no room for more.
+int os_udp_socket_send(const struct OsUdpSocket *sock, const struct OsUdpDatagram *datagrams,
+        int count, int *out_sent_count);
+
+// nanoseconds since 1970 on the clock that network audio is timed by: TAI
+// on linux, which a PTP daemon keeps in step with the network's grandmaster,
+// and the realtime clock elsewhere
+int64_t os_get_media_time_ns(void);
+void os_sleep_until_media_time_ns(int64_t time_ns);
+
 #endif
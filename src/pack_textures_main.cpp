@@ -0,0 +1,155 @@
+#include "png_image.hpp"
+#include "packed_texture.hpp"
+#include "mapped_resources.hpp"
+#include "byte_buffer.hpp"
+#include "list.hpp"
+
+#include <rucksack/rucksack.h>
+#include <stdio.h>
+#include <string.h>
+
+// a build step after rucksack: writes the mapped resources file, with each
+// texture given decoded and each file given after --file as it is, so that
+// the editor uses them in place at startup with nothing to decode or copy
+
+static int usage(char *exe) {
+    fprintf(stderr, "Usage: %s bundlefile mappedfile [texturekey | --file filekey]...\n", exe);
+    return 1;
+}
+
+struct MappedResource {
+    ByteBuffer key;
+    ByteBuffer bytes;
+};
+
+static void read_file(RuckSackBundle *bundle, const char *key, MappedResource *resource) {
+    RuckSackFileEntry *entry = rucksack_bundle_find_file(bundle, key, -1);
+    if (!entry)
+        panic("Could not find resource %s in bundle", key);
+
+    resource->key = key;
+    resource->bytes.resize(rucksack_file_size(entry));
+    int err = rucksack_file_read(entry, (unsigned char *)resource->bytes.raw());
+    if (err)
+        panic("Unable to read '%s': %s", key, rucksack_err_str(err));
+}
+
+static void pack_texture(RuckSackBundle *bundle, const char *key, MappedResource *resource) {
+    RuckSackFileEntry *entry = rucksack_bundle_find_file(bundle, key, -1);
+    if (!entry)
+        panic("Could not find resource %s in bundle", key);
+
+    RuckSackTexture *texture;
+    int err = rucksack_file_open_texture(entry, &texture);
+    if (err)
+        panic("Unable to read '%s' as texture: %s", key, rucksack_err_str(err));
+
+    ByteBuffer compressed_bytes;
+    compressed_bytes.resize(rucksack_texture_size(texture));
+    err = rucksack_texture_read(texture, (unsigned char *)compressed_bytes.raw());
+    if (err)
+        panic("Unable to read texture '%s': %s", key, rucksack_err_str(err));
+    rucksack_texture_close(texture);
+
+    PngImage image(compressed_bytes);
+
+    PackedTextureHeader header;
+    memcpy(header.magic, PACKED_TEXTURE_MAGIC, sizeof(header.magic));
+    header.width = image._width;
+    header.height = image._height;
+
+    resource->key = key;
+    resource->key.append(PACKED_TEXTURE_SUFFIX);
+    resource->bytes.resize(0);
+    resource->bytes.append((const char *)&header, sizeof(header));
+    resource->bytes.append((const char *)image.raw(), image._pitch * image._height);
+}
+
+static void write_padding(FILE *f, long *offset) {
+    static const char zeros[MAPPED_RESOURCES_ALIGNMENT] = {};
+    long padding = (MAPPED_RESOURCES_ALIGNMENT - *offset % MAPPED_RESOURCES_ALIGNMENT) % MAPPED_RESOURCES_ALIGNMENT;
+    if (padding > 0 && fwrite(zeros, padding, 1, f) != 1)
+        panic("Unable to write mapped resources");
+    *offset += padding;
+}
+
+static void write_mapped_resources(const char *path, const List<MappedResource *> &resources) {
+    MappedResourcesHeader header;
+    memcpy(header.magic, MAPPED_RESOURCES_MAGIC, sizeof(header.magic));
+    header.entry_count = resources.length();
+
+    List<MappedResourceEntry> entries;
+    ok_or_panic(entries.resize(resources.length()));
+    long offset = sizeof(header) + resources.length() * sizeof(MappedResourceEntry);
+    for (int i = 0; i < resources.length(); i += 1) {
+        MappedResource *resource = resources.at(i);
+        MappedResourceEntry *entry = &entries.at(i);
+        if (resource->key.length() >= MAPPED_RESOURCE_MAX_KEY_SIZE)
+            panic("Resource key %s is too long to map", resource->key.raw());
+        memset(entry->key, 0, sizeof(entry->key));
+        memcpy(entry->key, resource->key.raw(), resource->key.length());
+        offset += (MAPPED_RESOURCES_ALIGNMENT - offset % MAPPED_RESOURCES_ALIGNMENT) % MAPPED_RESOURCES_ALIGNMENT;
+        entry->offset = offset;
+        entry->size = resource->bytes.length();
+        offset += resource->bytes.length();
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        panic("Unable to open %s for writing", path);
+    if (fwrite(&header, sizeof(header), 1, f) != 1 ||
+        (entries.length() > 0 && fwrite(entries.raw(), sizeof(MappedResourceEntry), entries.length(), f) !=
+            (size_t)entries.length()))
+    {
+        panic("Unable to write %s", path);
+    }
+    offset = sizeof(header) + entries.length() * sizeof(MappedResourceEntry);
+    for (int i = 0; i < resources.length(); i += 1) {
+        MappedResource *resource = resources.at(i);
+        write_padding(f, &offset);
+        if (resource->bytes.length() > 0 && fwrite(resource->bytes.raw(), resource->bytes.length(), 1, f) != 1)
+            panic("Unable to write %s", path);
+        offset += resource->bytes.length();
+    }
+    if (fclose(f))
+        panic("Unable to write %s", path);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3)
+        return usage(argv[0]);
+
+    const char *bundle_path = argv[1];
+    const char *mapped_path = argv[2];
+    RuckSackBundle *bundle;
+    int err = rucksack_bundle_open_read(bundle_path, &bundle);
+    if (err)
+        panic("Unable to open %s: %s", bundle_path, rucksack_err_str(err));
+
+    List<MappedResource *> resources;
+    for (int i = 3; i < argc; i += 1) {
+        MappedResource *resource = create<MappedResource>();
+        ok_or_panic(resources.append(resource));
+        if (strcmp(argv[i], "--file") == 0) {
+            if (i + 1 >= argc)
+                return usage(argv[0]);
+            i += 1;
+            read_file(bundle, argv[i], resource);
+        } else {
+            pack_texture(bundle, argv[i], resource);
+        }
+    }
+    rucksack_bundle_close(bundle);
+
+    // written under a name of its own first, so that the editor never maps
+    // half a file
+    ByteBuffer tmp_path(mapped_path);
+    tmp_path.append(".tmp");
+    write_mapped_resources(tmp_path.raw(), resources);
+    if (rename(tmp_path.raw(), mapped_path))
+        panic("Unable to write %s", mapped_path);
+
+    for (int i = 0; i < resources.length(); i += 1)
+        destroy(resources.at(i), 1);
+    return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef PACKED_TEXTURE_HPP
+#define PACKED_TEXTURE_HPP
+
+#include <stdint.h>
+
+// a bundle texture decoded at build time by genesis_pack_textures, stored
+// in the bundle under the texture's key with this suffix. the header is
+// followed by width * height RGBA pixels, bottom row first, as
+// glTexImage2D takes them.
+static const char PACKED_TEXTURE_SUFFIX[] = ".rgba";
+static const char PACKED_TEXTURE_MAGIC[4] = {'G', 'R', 'G', 'A'};
+
+struct PackedTextureHeader {
+    char magic[4];
+    uint32_t width;
+    uint32_t height;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#include "parallel.hpp"
+#include "atomics.hpp"
+
+struct ParallelRun {
+    void (*run_chunk)(void *userdata, int chunk_index);
+    void *userdata;
+    int chunk_count;
+    atomic_int next_chunk;
+};
+
+static void run_chunks(ParallelRun *run) {
+    for (;;) {
+        int chunk_index = run->next_chunk.fetch_add(1);
+        if (chunk_index >= run->chunk_count)
+            return;
+        run->run_chunk(run->userdata, chunk_index);
+    }
+}
+
+static void parallel_job_run(Job *, void *userdata) {
+    run_chunks((ParallelRun *)userdata);
+}
+
+void parallel_run(JobSystem *job_system, int chunk_count,
+        void (*run_chunk)(void *userdata, int chunk_index), void *userdata)
+{
+    ParallelRun run;
+    run.run_chunk = run_chunk;
+    run.userdata = userdata;
+    run.chunk_count = chunk_count;
+    run.next_chunk = 0;
+
+    // the calling thread works too, so a job that cannot be submitted only
+    // means fewer helpers
+    JobGroup *group = nullptr;
+    int helper_count = job_system ? min(chunk_count - 1, job_system_thread_count(job_system)) : 0;
+    if (helper_count > 0 && !job_group_create(job_system, nullptr, EventFlushEvents, &group)) {
+        for (int i = 0; i < helper_count; i += 1) {
+            if (job_submit(group, JobPriorityHigh, parallel_job_run, &run, nullptr, 0, nullptr))
+                break;
+        }
+    }
+    run_chunks(&run);
+    // helpers which have not started by now have nothing left to do and
+    // are cancelled. this waits for the ones still on their last chunk.
+    job_group_destroy(group);
+}
+
+int parallel_chunk_count(JobSystem *job_system, int item_count) {
+    if (!job_system)
+        return 1;
+    // a few chunks a thread even out chunks which take longer than others
+    int thread_count = job_system_thread_count(job_system) + 1;
+    int chunk_count = min(item_count / PARALLEL_MIN_CHUNK_SIZE, thread_count * 4);
+    return clamp(1, chunk_count, PARALLEL_MAX_CHUNK_COUNT);
+}
@@ -0,0 +1,214 @@
+#ifndef GENESIS_PARALLEL_HPP
+#define GENESIS_PARALLEL_HPP
+
+#include "job_system.hpp"
+#include "list.hpp"
+#include "util.hpp"
+
+#include <string.h>
+
+// algorithms over lists which cut the list into chunks and work on them on
+// the calling thread and on whichever threads of the job system are free.
+// the calling thread takes every chunk nobody else has, so these may be
+// called from a job, and they return once every chunk is done. lists of
+// fewer than two chunks' worth of items, or a null job system, are done on
+// the calling thread alone.
+
+// chunks of fewer items cost more to hand out than to work through
+static const int PARALLEL_MIN_CHUNK_SIZE = 2048;
+static const int PARALLEL_MAX_CHUNK_COUNT = 64;
+
+// calls run_chunk once for each chunk_index from 0 to chunk_count - 1, in
+// no particular order
+void parallel_run(JobSystem *job_system, int chunk_count,
+        void (*run_chunk)(void *userdata, int chunk_index), void *userdata);
+
+// how many chunks item_count items are cut into, from 1 to
+// PARALLEL_MAX_CHUNK_COUNT
+int parallel_chunk_count(JobSystem *job_system, int item_count);
+
+static inline void parallel_chunk_bounds(int item_count, int chunk_count, int chunk_index,
+        int *out_start, int *out_end)
+{
+    *out_start = (int)((long)item_count * chunk_index / chunk_count);
+    *out_end = (int)((long)item_count * (chunk_index + 1) / chunk_count);
+}
+
+template<typename T>
+struct ParallelSpan {
+    T *items;
+    int item_count;
+    int chunk_count;
+    void *context;
+};
+
+template<typename T, void (*fn)(void *context, T *item)>
+static void parallel_for_each_chunk(void *userdata, int chunk_index) {
+    ParallelSpan<T> *span = (ParallelSpan<T> *)userdata;
+    int start, end;
+    parallel_chunk_bounds(span->item_count, span->chunk_count, chunk_index, &start, &end);
+    for (int i = start; i < end; i += 1)
+        fn(span->context, &span->items[i]);
+}
+
+// fn is called once for each item, from any thread
+template<typename T, void (*fn)(void *context, T *item)>
+void parallel_for_each(JobSystem *job_system, List<T> &list, void *context) {
+    ParallelSpan<T> span = {list.raw(), list.length(),
+        parallel_chunk_count(job_system, list.length()), context};
+    parallel_run(job_system, span.chunk_count, parallel_for_each_chunk<T, fn>, &span);
+}
+
+template<typename T, typename U>
+struct ParallelTransform {
+    const T *in;
+    U *out;
+    int item_count;
+    int chunk_count;
+    void *context;
+};
+
+template<typename T, typename U, U (*fn)(void *context, const T &item)>
+static void parallel_transform_chunk(void *userdata, int chunk_index) {
+    ParallelTransform<T, U> *transform = (ParallelTransform<T, U> *)userdata;
+    int start, end;
+    parallel_chunk_bounds(transform->item_count, transform->chunk_count, chunk_index, &start, &end);
+    for (int i = start; i < end; i += 1)
+        transform->out[i] = fn(transform->context, transform->in[i]);
+}
+
+// out gets fn of each item of in, in the same order
+template<typename T, typename U, U (*fn)(void *context, const T &item)>
+int __attribute__((warn_unused_result)) parallel_transform(JobSystem *job_system,
+        const List<T> &in, List<U> &out, void *context)
+{
+    int err;
+    if ((err = out.resize(in.length())))
+        return err;
+    ParallelTransform<T, U> transform = {in.raw(), out.raw(), in.length(),
+        parallel_chunk_count(job_system, in.length()), context};
+    parallel_run(job_system, transform.chunk_count, parallel_transform_chunk<T, U, fn>, &transform);
+    return 0;
+}
+
+template<typename T, typename R>
+struct ParallelReduce {
+    const T *items;
+    int item_count;
+    int chunk_count;
+    void *context;
+    R identity;
+    R partials[PARALLEL_MAX_CHUNK_COUNT];
+};
+
+template<typename T, typename R, R (*map)(void *context, const T &item), R (*combine)(R a, R b)>
+static void parallel_reduce_chunk(void *userdata, int chunk_index) {
+    ParallelReduce<T, R> *reduce = (ParallelReduce<T, R> *)userdata;
+    int start, end;
+    parallel_chunk_bounds(reduce->item_count, reduce->chunk_count, chunk_index, &start, &end);
+    R partial = reduce->identity;
+    for (int i = start; i < end; i += 1)
+        partial = combine(partial, map(reduce->context, reduce->items[i]));
+    reduce->partials[chunk_index] = partial;
+}
+
+// combine of map of every item, starting from identity. the chunks are
+// combined in order, so the result depends only on how many items there
+// are and how many threads the job system has, not on timing.
+template<typename T, typename R, R (*map)(void *context, const T &item), R (*combine)(R a, R b)>
+R parallel_reduce(JobSystem *job_system, const List<T> &list, R identity, void *context) {
+    ParallelReduce<T, R> reduce;
+    reduce.items = list.raw();
+    reduce.item_count = list.length();
+    reduce.chunk_count = parallel_chunk_count(job_system, list.length());
+    reduce.context = context;
+    reduce.identity = identity;
+    parallel_run(job_system, reduce.chunk_count, parallel_reduce_chunk<T, R, map, combine>, &reduce);
+    R result = identity;
+    for (int i = 0; i < reduce.chunk_count; i += 1)
+        result = combine(result, reduce.partials[i]);
+    return result;
+}
+
+template<typename T>
+struct ParallelSort {
+    T *src;
+    T *dest;
+    int item_count;
+    int chunk_count;
+    // where each sorted run starts, and the end of the last one
+    int run_starts[PARALLEL_MAX_CHUNK_COUNT + 1];
+    int run_count;
+};
+
+template<typename T, int (*Comparator)(T, T)>
+static void parallel_sort_chunk(void *userdata, int chunk_index) {
+    ParallelSort<T> *sort = (ParallelSort<T> *)userdata;
+    int start = sort->run_starts[chunk_index];
+    quick_sort<T, Comparator>(sort->src + start, sort->run_starts[chunk_index + 1] - start);
+}
+
+// merges runs pair_index * 2 and pair_index * 2 + 1 of src into dest. the
+// last run is copied when it has no pair.
+template<typename T, int (*Comparator)(T, T)>
+static void parallel_sort_merge(void *userdata, int pair_index) {
+    ParallelSort<T> *sort = (ParallelSort<T> *)userdata;
+    int run_index = pair_index * 2;
+    int a = sort->run_starts[run_index];
+    int a_end = sort->run_starts[run_index + 1];
+    int b = a_end;
+    int b_end = (run_index + 1 < sort->run_count) ? sort->run_starts[run_index + 2] : a_end;
+    T *dest = sort->dest + a;
+    while (a < a_end && b < b_end) {
+        int from = (Comparator(sort->src[b], sort->src[a]) < 0) ? b++ : a++;
+        memcpy(dest, &sort->src[from], sizeof(T));
+        dest += 1;
+    }
+    memcpy(dest, sort->src + a, (a_end - a) * sizeof(T));
+    dest += a_end - a;
+    memcpy(dest, sort->src + b, (b_end - b) * sizeof(T));
+}
+
+// like List::sort, and not stable either. the chunks are sorted side by
+// side and then merged a pair at a time into a second array, moving the
+// items bit for bit as List does when it grows. without memory for the
+// second array the list is sorted on the calling thread.
+template<typename T, int (*Comparator)(T, T)>
+void parallel_sort(JobSystem *job_system, List<T> &list) {
+    int item_count = list.length();
+    int chunk_count = parallel_chunk_count(job_system, item_count);
+    T *scratch = (chunk_count > 1) ? allocate_nonzero<T>(item_count) : nullptr;
+    if (!scratch) {
+        quick_sort<T, Comparator>(list.raw(), item_count);
+        return;
+    }
+    ParallelSort<T> sort;
+    sort.src = list.raw();
+    sort.dest = scratch;
+    sort.item_count = item_count;
+    sort.chunk_count = chunk_count;
+    sort.run_count = chunk_count;
+    for (int i = 0; i <= chunk_count; i += 1) {
+        int end;
+        parallel_chunk_bounds(item_count, chunk_count, i, &sort.run_starts[i], &end);
+    }
+    parallel_run(job_system, chunk_count, parallel_sort_chunk<T, Comparator>, &sort);
+
+    while (sort.run_count > 1) {
+        int pair_count = (sort.run_count + 1) / 2;
+        parallel_run(job_system, pair_count, parallel_sort_merge<T, Comparator>, &sort);
+        for (int i = 0; i < pair_count; i += 1)
+            sort.run_starts[i] = sort.run_starts[i * 2];
+        sort.run_starts[pair_count] = item_count;
+        sort.run_count = pair_count;
+        T *src = sort.src;
+        sort.src = sort.dest;
+        sort.dest = src;
+    }
+    if (sort.src != list.raw())
+        memcpy(list.raw(), sort.src, item_count * sizeof(T));
+    // the items live in the list again, so none are destroyed here
+    destroy(scratch, 0);
+}
+
+#endif
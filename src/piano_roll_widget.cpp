@@ -1,10 +1,108 @@
 #include "piano_roll_widget.hpp"
+#include "gui_window.hpp"
+#include "color.hpp"
+
+static bool is_black_key(int pitch) {
+    int key = pitch % 12;
+    return key == 1 || key == 3 || key == 6 || key == 8 || key == 10;
+}
 
 PianoRollWidget::PianoRollWidget(GuiWindow *window, Project *project) :
-    Widget(window)
+    Widget(window),
+    project(project),
+    note_store(nullptr),
+    bg_color(color_dark_bg()),
+    black_key_bg_color(color_dark_bg_alt()),
+    note_color(parse_color("#6A8EAEFF")),
+    selected_note_color(parse_color("#F47A28FF")),
+    view_start(0.0),
+    whole_note_width(256.0),
+    top_pitch(84),
+    key_height(10),
+    have_selected_note(false)
 {
-    this->project = project;
+}
+
+void PianoRollWidget::set_note_store(NoteStore *store) {
+    note_store = store;
+    have_selected_note = false;
+    update_model();
+}
+
+int PianoRollWidget::pitch_at(int y) const {
+    return top_pitch - y / key_height;
+}
+
+double PianoRollWidget::pos_at(int x) const {
+    return view_start + x / whole_note_width;
+}
+
+int PianoRollWidget::note_left(double pos) const {
+    return (int)((pos - view_start) * whole_note_width);
+}
+
+int PianoRollWidget::note_top(int pitch) const {
+    return (top_pitch - pitch) * key_height;
+}
+
+void PianoRollWidget::update_model() {
+    queue_redraw();
+    visible_notes.clear();
+    if (!note_store)
+        return;
+
+    // only the lanes and the stretch of time in view are looked at
+    int bottom_pitch = pitch_at(height - 1);
+    double view_end = pos_at(width);
+    ok_or_panic(note_store_query(note_store, view_start, view_end,
+                bottom_pitch, top_pitch, visible_notes));
 }
 
 void PianoRollWidget::draw(const glm::mat4 &projection) {
+    gui_window->set_scissor(left, top, width, height);
+
+    gui_window->fill_rect(bg_color, projection * transform2d(0, 0, width, height));
+    int bottom_pitch = pitch_at(height - 1);
+    for (int pitch = top_pitch; pitch >= bottom_pitch && pitch >= 0; pitch -= 1) {
+        if (is_black_key(pitch)) {
+            gui_window->fill_rect(black_key_bg_color,
+                    projection * transform2d(0, note_top(pitch), width, key_height));
+        }
+    }
+
+    // one quad a note, so they all go out in the same batch
+    for (int i = 0; i < visible_notes.length(); i += 1) {
+        const NoteStoreNote *note = &visible_notes.at(i);
+        int note_x = note_left(note->start);
+        int note_width = max(1, note_left(note->end) - note_x);
+        bool selected = have_selected_note && note->pitch == selected_note.pitch &&
+            note->start == selected_note.start && note->end == selected_note.end;
+        gui_window->fill_rect(selected ? selected_note_color : note_color,
+                projection * transform2d(note_x, note_top(note->pitch) + 1, note_width, key_height - 1));
+    }
+
+    gui_window->clear_scissor();
+}
+
+void PianoRollWidget::on_mouse_move(const MouseEvent *event) {
+    if (event->action != MouseActionDown || event->button != MouseButtonLeft)
+        return;
+    if (!note_store)
+        return;
+
+    const NoteStoreNote *note = note_store_find(note_store, pitch_at(event->y), pos_at(event->x));
+    have_selected_note = (note != nullptr);
+    if (note)
+        selected_note = *note;
+    queue_redraw();
+}
+
+void PianoRollWidget::on_mouse_wheel(const MouseWheelEvent *event) {
+    if (key_mod_shift(event->modifiers)) {
+        view_start = max(0.0, view_start - event->wheel_y * (64.0 / whole_note_width));
+    } else {
+        int lowest_top_pitch = min(height / key_height - 1, NOTE_STORE_PITCH_COUNT - 1);
+        top_pitch = clamp(lowest_top_pitch, top_pitch + event->wheel_y, NOTE_STORE_PITCH_COUNT - 1);
+    }
+    update_model();
 }
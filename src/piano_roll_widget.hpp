@@ -2,6 +2,7 @@
 #define PIANO_ROLL_WIDGET_HPP
 
 #include "widget.hpp"
+#include "note_store.hpp"
 
 class GuiWindow;
 struct Project;
@@ -12,8 +13,39 @@ public:
     ~PianoRollWidget() override {}
     void draw(const glm::mat4 &projection) override;
 
+    void on_resize() override { update_model(); }
+    void on_mouse_move(const MouseEvent *event) override;
+    void on_mouse_wheel(const MouseWheelEvent *event) override;
+
+    // the notes of the clip being edited, or nullptr for none
+    void set_note_store(NoteStore *store);
+
     Project *project;
+    NoteStore *note_store;
+
+    glm::vec4 bg_color;
+    glm::vec4 black_key_bg_color;
+    glm::vec4 note_color;
+    glm::vec4 selected_note_color;
+
+    // the view. pitches go up from the bottom.
+    double view_start; // in whole notes, at the left edge
+    double whole_note_width; // in pixels
+    int top_pitch;
+    int key_height;
+
+    // only the notes in view, from the last update_model
+    List<NoteStoreNote> visible_notes;
+    bool have_selected_note;
+    NoteStoreNote selected_note;
+
+    // call after the notes or the view change
+    void update_model();
+
+    int pitch_at(int y) const;
+    double pos_at(int x) const;
+    int note_left(double pos) const;
+    int note_top(int pitch) const;
 };
 
 #endif
-
@@ -0,0 +1,194 @@
+#include "pipeline_trace.hpp"
+#include "util.hpp"
+
+static const int lane_size = 1024 * 1024;
+static const double drain_interval = 0.05;
+
+// without the surrounding quotes
+static void write_json_chars(FILE *file, const char *str) {
+    for (const char *c = str; *c; c += 1) {
+        if (*c == '"' || *c == '\\')
+            fputc('\\', file);
+        if ((unsigned char)*c >= 0x20)
+            fputc(*c, file);
+    }
+}
+
+static void begin_event(PipelineTrace *trace) {
+    fputs(trace->first_event ? "\n" : ",\n", trace->file);
+    trace->first_event = false;
+}
+
+static void write_event(PipelineTrace *trace, int lane_index, const PipelineTraceEvent *event) {
+    FILE *file = trace->file;
+    double ts = os_timestamp_to_seconds(event->time - trace->start_time) * 1000000.0;
+    begin_event(trace);
+    switch (event->type) {
+    case PipelineTraceEventTypeRun:
+        fputs("{\"name\":\"", file);
+        write_json_chars(file, event->name);
+        fprintf(file, "\",\"cat\":\"node\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d,"
+                "\"args\":{\"node\":%d}}", ts, event->duration * 1000000.0, lane_index, event->node_index);
+        break;
+    case PipelineTraceEventTypeFill:
+        // counters are keyed by name, so include the node index to tell
+        // apart nodes which share a descriptor
+        fprintf(file, "{\"name\":\"#%d ", event->node_index);
+        write_json_chars(file, event->name);
+        fprintf(file, "\",\"cat\":\"port\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,"
+                "\"args\":{\"frames\":%d}}", ts, lane_index, event->value);
+        break;
+    case PipelineTraceEventTypeUnderrun:
+        fputs("{\"name\":\"", file);
+        write_json_chars(file, event->name);
+        fprintf(file, "\",\"cat\":\"device\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+                ts, lane_index);
+        break;
+    }
+}
+
+static void drain(PipelineTrace *trace) {
+    for (int lane_index = 0; lane_index <= trace->lane_count; lane_index += 1) {
+        SpscRingBuffer *events = &trace->lanes[lane_index].events;
+        // asking for all of it makes it look at the writer's offset
+        int fill_count = spsc_ring_buffer_fill_count(events, events->capacity);
+        const PipelineTraceEvent *event = (const PipelineTraceEvent *)spsc_ring_buffer_read_ptr(events);
+        int event_count = fill_count / sizeof(PipelineTraceEvent);
+        for (int i = 0; i < event_count; i += 1)
+            write_event(trace, lane_index, &event[i]);
+        spsc_ring_buffer_advance_read_ptr(events, event_count * sizeof(PipelineTraceEvent));
+    }
+}
+
+static void drain_thread_run(void *userdata) {
+    PipelineTrace *trace = (PipelineTrace *)userdata;
+    os_mutex_lock(trace->mutex);
+    while (trace->running.load()) {
+        os_cond_timed_wait(trace->cond, trace->mutex, drain_interval);
+        drain(trace);
+    }
+    os_mutex_unlock(trace->mutex);
+}
+
+static void write_thread_name(PipelineTrace *trace, int lane_index, const char *name) {
+    begin_event(trace);
+    fprintf(trace->file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+            "\"args\":{\"name\":\"%s\"}}", lane_index, name);
+}
+
+int pipeline_trace_create(const char *path, int lane_count, PipelineTrace **out_trace) {
+    *out_trace = nullptr;
+
+    PipelineTrace *trace = create_zero<PipelineTrace>();
+    if (!trace)
+        return GenesisErrorNoMem;
+
+    trace->lane_count = lane_count;
+    trace->lanes = allocate_zero<PipelineTraceLane>(lane_count + 1);
+    if (!trace->lanes) {
+        pipeline_trace_destroy(trace);
+        return GenesisErrorNoMem;
+    }
+
+    int err;
+    for (int i = 0; i <= lane_count; i += 1) {
+        if ((err = spsc_ring_buffer_init(&trace->lanes[i].events, lane_size))) {
+            pipeline_trace_destroy(trace);
+            return err;
+        }
+    }
+
+    trace->mutex = os_mutex_create();
+    trace->cond = os_cond_create();
+    if (!trace->mutex || !trace->cond) {
+        pipeline_trace_destroy(trace);
+        return GenesisErrorNoMem;
+    }
+
+    trace->file = fopen(path, "w");
+    if (!trace->file) {
+        pipeline_trace_destroy(trace);
+        return GenesisErrorFileAccess;
+    }
+
+    trace->start_time = os_timestamp();
+    trace->first_event = true;
+    trace->device_lane_lock.clear();
+    fputs("{\"traceEvents\":[", trace->file);
+    char name[32];
+    for (int i = 0; i < lane_count; i += 1) {
+        snprintf(name, sizeof(name), "pipeline worker %d", i);
+        write_thread_name(trace, i, name);
+    }
+    write_thread_name(trace, lane_count, "device");
+
+    trace->running = true;
+    if ((err = os_thread_create(drain_thread_run, trace, false, &trace->thread))) {
+        trace->running = false;
+        pipeline_trace_destroy(trace);
+        return err;
+    }
+
+    *out_trace = trace;
+    return 0;
+}
+
+void pipeline_trace_destroy(PipelineTrace *trace) {
+    if (!trace)
+        return;
+
+    if (trace->thread) {
+        os_mutex_lock(trace->mutex);
+        trace->running = false;
+        os_cond_signal(trace->cond, trace->mutex);
+        os_mutex_unlock(trace->mutex);
+        os_thread_destroy(trace->thread);
+    }
+
+    if (trace->file) {
+        drain(trace);
+        for (int i = 0; i <= trace->lane_count; i += 1) {
+            long dropped_count = trace->lanes[i].dropped_count.load();
+            if (dropped_count > 0) {
+                begin_event(trace);
+                fprintf(trace->file, "{\"name\":\"dropped events\",\"ph\":\"i\",\"s\":\"t\","
+                        "\"ts\":%.3f,\"pid\":1,\"tid\":%d,"
+                        "\"args\":{\"count\":%ld}}",
+                        os_timestamp_to_seconds(os_timestamp() - trace->start_time) * 1000000.0, i, dropped_count);
+            }
+        }
+        fputs("\n]}\n", trace->file);
+        fclose(trace->file);
+    }
+
+    os_cond_destroy(trace->cond);
+    os_mutex_destroy(trace->mutex);
+
+    if (trace->lanes) {
+        for (int i = 0; i <= trace->lane_count; i += 1) {
+            if (trace->lanes[i].events.mem.address)
+                spsc_ring_buffer_deinit(&trace->lanes[i].events);
+        }
+    }
+    destroy(trace->lanes, trace->lane_count + 1);
+
+    destroy(trace, 1);
+}
+
+void pipeline_trace_record(PipelineTrace *trace, int lane_index, const PipelineTraceEvent *event) {
+    PipelineTraceLane *lane = &trace->lanes[lane_index];
+    int event_size = sizeof(PipelineTraceEvent);
+    if (spsc_ring_buffer_free_count(&lane->events, event_size) < event_size) {
+        lane->dropped_count += 1;
+        return;
+    }
+    PipelineTraceEvent *dest = (PipelineTraceEvent *)spsc_ring_buffer_write_ptr(&lane->events);
+    *dest = *event;
+    spsc_ring_buffer_advance_write_ptr(&lane->events, event_size);
+}
+
+void pipeline_trace_record_device(PipelineTrace *trace, const PipelineTraceEvent *event) {
+    while (trace->device_lane_lock.test_and_set()) {}
+    pipeline_trace_record(trace, trace->lane_count, event);
+    trace->device_lane_lock.clear();
+}
@@ -0,0 +1,60 @@
+#ifndef GENESIS_PIPELINE_TRACE_HPP
+#define GENESIS_PIPELINE_TRACE_HPP
+
+#include "ring_buffer.hpp"
+#include "atomics.hpp"
+#include "os.hpp"
+
+#include <stdio.h>
+
+enum PipelineTraceEventType {
+    PipelineTraceEventTypeRun,
+    PipelineTraceEventTypeFill,
+    PipelineTraceEventTypeUnderrun,
+};
+
+struct PipelineTraceEvent {
+    uint64_t time; // os_timestamp
+    double duration; // seconds, only for PipelineTraceEventTypeRun
+    PipelineTraceEventType type;
+    int node_index;
+    int value; // frames, for PipelineTraceEventTypeFill
+    char name[36]; // truncated
+};
+
+// one single-writer ring buffer per recording thread, so that recording
+// never takes a lock. the drain thread is the only reader.
+struct PipelineTraceLane {
+    SpscRingBuffer events;
+    atomic_long dropped_count;
+};
+
+// writes Chrome trace event format JSON, which chrome://tracing and
+// ui.perfetto.dev can open. lanes 0 through lane_count - 1 are owned by
+// pipeline worker threads; the extra lane at lane_count is for device
+// callback threads which serialize with device_lane_lock.
+struct PipelineTrace {
+    FILE *file;
+    uint64_t start_time; // os_timestamp
+    bool first_event;
+
+    PipelineTraceLane *lanes;
+    int lane_count;
+    atomic_flag device_lane_lock;
+
+    OsThread *thread;
+    OsMutex *mutex;
+    OsCond *cond;
+    atomic_bool running;
+};
+
+int pipeline_trace_create(const char *path, int lane_count, PipelineTrace **out_trace);
+// stops the drain thread, writes any remaining events and closes the file
+void pipeline_trace_destroy(PipelineTrace *trace);
+
+// lock-free; if the lane is full the event is dropped and counted.
+void pipeline_trace_record(PipelineTrace *trace, int lane_index, const PipelineTraceEvent *event);
+// for threads that do not own a lane
+void pipeline_trace_record_device(PipelineTrace *trace, const PipelineTraceEvent *event);
+
+#endif
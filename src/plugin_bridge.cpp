@@ -0,0 +1,411 @@
+#include "plugin_bridge.hpp"
+#include "thread_safe_queue.hpp"
+#include "atomics.hpp"
+#include "util.hpp"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__linux__)
+#include <sys/prctl.h>
+#include <signal.h>
+#endif
+
+static const int PLUGIN_BRIDGE_VERSION = 1;
+static const int PLUGIN_BRIDGE_CACHE_LINE = 64;
+// the child sleeps this long at most between checks that it should exit
+static const double CHILD_POLL_SECONDS = 0.5;
+// and the parent between checks that the child is still there
+static const double PARENT_POLL_SECONDS = 0.01;
+
+enum PluginBridgeMessageKind {
+    PluginBridgeMessageKindProcess,
+    PluginBridgeMessageKindSeek,
+};
+
+// ahead of each message in a ring, padded so that the samples after it
+// stay aligned
+struct PluginBridgeMessage {
+    int kind;
+    int frame_count;
+    int pad[2];
+};
+
+// the first page of the memory. each ring's writer owns the line with its
+// write offset, epoch and waiter count; the reader owns its read offset.
+// the epochs are bumped after every write for the other side to wait on.
+struct PluginBridgeShared {
+    int version;
+    int channel_count;
+    int sample_rate;
+    int max_frame_count;
+    long ring_capacity;
+    // set by the parent when the child should exit
+    atomic_int exit_requested;
+    // set by the child once the effect is created, to 1, or could not be, to -1
+    atomic_int state;
+    char pad0[PLUGIN_BRIDGE_CACHE_LINE];
+
+    atomic_long request_write_offset;
+    atomic_int request_epoch;
+    atomic_int request_waiter_count;
+    char pad1[PLUGIN_BRIDGE_CACHE_LINE];
+    atomic_long request_read_offset;
+    char pad2[PLUGIN_BRIDGE_CACHE_LINE];
+
+    atomic_long response_write_offset;
+    atomic_int response_epoch;
+    atomic_int response_waiter_count;
+    char pad3[PLUGIN_BRIDGE_CACHE_LINE];
+    atomic_long response_read_offset;
+    char pad4[PLUGIN_BRIDGE_CACHE_LINE];
+};
+
+static size_t message_size(int channel_count, int frame_count) {
+    return sizeof(PluginBridgeMessage) + channel_count * frame_count * sizeof(float);
+}
+
+static size_t round_to_pages(size_t size) {
+    size_t page_size = os_page_size();
+    return ((size + page_size - 1) / page_size) * page_size;
+}
+
+// same as BoundedQueue: a waiter counts itself before the kernel looks at
+// the epoch again, so either it sees the bump or the bump sees it
+static void wake(atomic_int *epoch, atomic_int *waiter_count) {
+    *epoch += 1;
+    if (waiter_count->load() > 0 && waiter_count->exchange(0) > 0)
+        futex_wake(reinterpret_cast<int*>(epoch), INT_MAX);
+}
+
+static void wait(atomic_int *epoch, atomic_int *waiter_count, int old_epoch, double timeout) {
+    *waiter_count += 1;
+    struct timespec ts;
+    ts.tv_sec = (time_t)timeout;
+    ts.tv_nsec = (long)((timeout - ts.tv_sec) * 1000000000.0);
+    futex(reinterpret_cast<int*>(epoch), FUTEX_WAIT, old_epoch, &ts, nullptr, 0);
+}
+
+// both sides map the header and the two rings, which follow it
+static int map_shared(PluginBridge *bridge, long ring_capacity) {
+    int err;
+    size_t header_size = round_to_pages(sizeof(PluginBridgeShared));
+    char *address;
+    if ((err = os_shared_memory_map(&bridge->shm, 0, header_size, &address)))
+        return err;
+    bridge->shared = reinterpret_cast<PluginBridgeShared *>(address);
+    bridge->shared_size = header_size;
+    if ((err = os_shared_memory_map_mirrored(&bridge->shm, header_size, ring_capacity, &bridge->request_mem)))
+        return err;
+    if ((err = os_shared_memory_map_mirrored(&bridge->shm, header_size + ring_capacity, ring_capacity,
+                    &bridge->response_mem)))
+    {
+        return err;
+    }
+    return 0;
+}
+
+static void unmap_shared(PluginBridge *bridge) {
+    if (bridge->response_mem.address)
+        os_deinit_mirrored_memory(&bridge->response_mem);
+    if (bridge->request_mem.address)
+        os_deinit_mirrored_memory(&bridge->request_mem);
+    if (bridge->shared)
+        os_shared_memory_unmap(reinterpret_cast<char *>(bridge->shared), bridge->shared_size);
+    bridge->response_mem.address = nullptr;
+    bridge->request_mem.address = nullptr;
+    bridge->shared = nullptr;
+}
+
+static void fail(PluginBridge *bridge) {
+    bridge->failed = true;
+    if (bridge->process)
+        os_process_kill(bridge->process);
+}
+
+void plugin_bridge_destroy(PluginBridge *bridge) {
+    if (bridge->process) {
+        if (bridge->shared) {
+            bridge->shared->exit_requested.store(1);
+            bridge->shared->request_epoch += 1;
+            futex_wake(reinterpret_cast<int*>(&bridge->shared->request_epoch), INT_MAX);
+        }
+        // a child which is stuck in the effect does not see the request
+        double deadline = os_get_time() + CHILD_POLL_SECONDS * 2.0;
+        struct timespec ts = {0, 1000000};
+        while (!os_process_exited(bridge->process) && os_get_time() < deadline)
+            nanosleep(&ts, nullptr);
+        os_process_kill(bridge->process);
+        int exit_code;
+        os_process_wait(bridge->process, &exit_code);
+        bridge->process = nullptr;
+    }
+    unmap_shared(bridge);
+    os_shared_memory_close(&bridge->shm);
+}
+
+int plugin_bridge_create(PluginBridge *bridge, const char *host_path, const char *library_path,
+        int channel_count, int sample_rate, int max_frame_count, double timeout)
+{
+    memset(bridge, 0, sizeof(PluginBridge));
+    bridge->shm.fd = -1;
+    if (channel_count < 1 || channel_count > GENESIS_MAX_CHANNELS || sample_rate < 1 || max_frame_count < 1)
+        return GenesisErrorInvalidParam;
+    bridge->channel_count = channel_count;
+    bridge->max_frame_count = max_frame_count;
+    bridge->spin_count = (os_concurrency() > 1) ? thread_safe_queue_default_spin_count : 0;
+
+    // room for a seek and a block queued at once
+    long ring_capacity = round_to_pages(2 * message_size(channel_count, max_frame_count));
+    size_t header_size = round_to_pages(sizeof(PluginBridgeShared));
+    int err;
+    if ((err = os_shared_memory_create(&bridge->shm, header_size + 2 * ring_capacity)) ||
+        (err = map_shared(bridge, ring_capacity)))
+    {
+        plugin_bridge_destroy(bridge);
+        return err;
+    }
+    PluginBridgeShared *shared = bridge->shared;
+    shared->version = PLUGIN_BRIDGE_VERSION;
+    shared->channel_count = channel_count;
+    shared->sample_rate = sample_rate;
+    shared->max_frame_count = max_frame_count;
+    shared->ring_capacity = ring_capacity;
+
+    List<ByteBuffer> args;
+    char fd_buf[32];
+    char size_buf[32];
+    snprintf(fd_buf, sizeof(fd_buf), "%d", bridge->shm.fd);
+    snprintf(size_buf, sizeof(size_buf), "%zu", bridge->shm.size);
+    if (args.append(PLUGIN_BRIDGE_HOST_FLAG) || args.append(fd_buf) || args.append(size_buf) ||
+        (library_path && args.append(library_path)))
+    {
+        plugin_bridge_destroy(bridge);
+        return GenesisErrorNoMem;
+    }
+    if ((err = os_process_create_inheriting(host_path, args, bridge->shm.fd, &bridge->process))) {
+        plugin_bridge_destroy(bridge);
+        return err;
+    }
+
+    double deadline = os_get_time() + timeout;
+    for (;;) {
+        int epoch = shared->response_epoch.load();
+        int state = shared->state.load();
+        if (state > 0)
+            return 0;
+        double remaining = deadline - os_get_time();
+        if (state < 0 || remaining <= 0.0 || os_process_exited(bridge->process)) {
+            plugin_bridge_destroy(bridge);
+            return GenesisErrorAborted;
+        }
+        wait(&shared->response_epoch, &shared->response_waiter_count, epoch,
+                min(remaining, PARENT_POLL_SECONDS));
+    }
+}
+
+static int write_message(PluginBridge *bridge, int kind, const float *samples, int frame_count) {
+    PluginBridgeShared *shared = bridge->shared;
+    size_t size = message_size(bridge->channel_count, frame_count);
+    long write_offset = shared->request_write_offset.load(std::memory_order_relaxed);
+    long read_offset = shared->request_read_offset.load(std::memory_order_acquire);
+    if ((long)size > shared->ring_capacity - (write_offset - read_offset))
+        return GenesisErrorQueueFull;
+    char *ptr = bridge->request_mem.address + (write_offset % shared->ring_capacity);
+    PluginBridgeMessage *message = reinterpret_cast<PluginBridgeMessage *>(ptr);
+    message->kind = kind;
+    message->frame_count = frame_count;
+    if (frame_count > 0)
+        memcpy(message + 1, samples, size - sizeof(PluginBridgeMessage));
+    shared->request_write_offset.store(write_offset + size, std::memory_order_release);
+    wake(&shared->request_epoch, &shared->request_waiter_count);
+    return 0;
+}
+
+int plugin_bridge_seek(PluginBridge *bridge) {
+    if (bridge->failed)
+        return GenesisErrorAborted;
+    return write_message(bridge, PluginBridgeMessageKindSeek, nullptr, 0);
+}
+
+int plugin_bridge_process(PluginBridge *bridge, const float *in, float *out, int frame_count,
+        double timeout)
+{
+    assert(frame_count >= 0 && frame_count <= bridge->max_frame_count);
+    if (bridge->failed)
+        return GenesisErrorAborted;
+    if (frame_count == 0)
+        return 0;
+    PluginBridgeShared *shared = bridge->shared;
+    int err;
+    if ((err = write_message(bridge, PluginBridgeMessageKindProcess, in, frame_count))) {
+        fail(bridge);
+        return GenesisErrorAborted;
+    }
+
+    // the answer usually comes back within the spin, and then no syscall
+    // is made on this side
+    long read_offset = shared->response_read_offset.load(std::memory_order_relaxed);
+    double deadline = -1.0;
+    for (int spin = 0;; spin += 1) {
+        int epoch = shared->response_epoch.load();
+        if (shared->response_write_offset.load(std::memory_order_acquire) != read_offset)
+            break;
+        if (spin < bridge->spin_count) {
+            cpu_relax();
+            continue;
+        }
+        double now = os_get_time();
+        if (deadline < 0.0)
+            deadline = now + timeout;
+        if (now >= deadline || os_process_exited(bridge->process)) {
+            fail(bridge);
+            return GenesisErrorAborted;
+        }
+        wait(&shared->response_epoch, &shared->response_waiter_count, epoch,
+                min(deadline - now, PARENT_POLL_SECONDS));
+    }
+
+    char *ptr = bridge->response_mem.address + (read_offset % shared->ring_capacity);
+    PluginBridgeMessage *message = reinterpret_cast<PluginBridgeMessage *>(ptr);
+    if (message->frame_count != frame_count) {
+        fail(bridge);
+        return GenesisErrorAborted;
+    }
+    size_t size = message_size(bridge->channel_count, frame_count);
+    memcpy(out, message + 1, size - sizeof(PluginBridgeMessage));
+    shared->response_read_offset.store(read_offset + size, std::memory_order_release);
+    return 0;
+}
+
+bool plugin_bridge_is_host_command(int argc, char *argv[]) {
+    return argc >= 4 && strcmp(argv[1], PLUGIN_BRIDGE_HOST_FLAG) == 0;
+}
+
+const char *plugin_bridge_host_library(int argc, char *argv[]) {
+    return (plugin_bridge_is_host_command(argc, argv) && argc >= 5) ? argv[4] : nullptr;
+}
+
+// runs every message queued, answering the blocks. returns false when the
+// parent wrote something which makes no sense.
+static bool serve_messages(PluginBridge *bridge, const GenesisPluginEffect *effect, void *state,
+        float *out_buf)
+{
+    PluginBridgeShared *shared = bridge->shared;
+    long read_offset = shared->request_read_offset.load(std::memory_order_relaxed);
+    long write_offset = shared->request_write_offset.load(std::memory_order_acquire);
+    while (read_offset != write_offset) {
+        char *ptr = bridge->request_mem.address + (read_offset % shared->ring_capacity);
+        PluginBridgeMessage *message = reinterpret_cast<PluginBridgeMessage *>(ptr);
+        int frame_count = message->frame_count;
+        if (frame_count < 0 || frame_count > bridge->max_frame_count)
+            return false;
+        size_t size = message_size(bridge->channel_count, frame_count);
+        if (message->kind == PluginBridgeMessageKindSeek) {
+            if (effect->seek)
+                effect->seek(state);
+        } else if (message->kind == PluginBridgeMessageKindProcess) {
+            // the parent writes no new request until this one is answered,
+            // so the response ring has room
+            long response_offset = shared->response_write_offset.load(std::memory_order_relaxed);
+            char *response_ptr = bridge->response_mem.address + (response_offset % shared->ring_capacity);
+            PluginBridgeMessage *response = reinterpret_cast<PluginBridgeMessage *>(response_ptr);
+            effect->process(state, reinterpret_cast<const float *>(message + 1), out_buf, frame_count);
+            response->kind = PluginBridgeMessageKindProcess;
+            response->frame_count = frame_count;
+            memcpy(response + 1, out_buf, size - sizeof(PluginBridgeMessage));
+            shared->response_write_offset.store(response_offset + size, std::memory_order_release);
+            wake(&shared->response_epoch, &shared->response_waiter_count);
+        } else {
+            return false;
+        }
+        read_offset += size;
+        shared->request_read_offset.store(read_offset, std::memory_order_release);
+        write_offset = shared->request_write_offset.load(std::memory_order_acquire);
+    }
+    return true;
+}
+
+int plugin_bridge_serve(int argc, char *argv[], const GenesisPluginEffect *effect) {
+    if (!plugin_bridge_is_host_command(argc, argv))
+        return 2;
+#if defined(__linux__)
+    // nothing would ever ask an orphan to exit
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+#endif
+    PluginBridge bridge;
+    memset(&bridge, 0, sizeof(PluginBridge));
+    bridge.shm.fd = -1;
+    int fd = atoi(argv[2]);
+    size_t size = strtoull(argv[3], nullptr, 10);
+    size_t header_size = round_to_pages(sizeof(PluginBridgeShared));
+    if (size < header_size || os_shared_memory_open(&bridge.shm, fd, size))
+        return 2;
+    char *address;
+    if (os_shared_memory_map(&bridge.shm, 0, header_size, &address))
+        return 2;
+    PluginBridgeShared *header = reinterpret_cast<PluginBridgeShared *>(address);
+    long ring_capacity = header->ring_capacity;
+    bool ok = header->version == PLUGIN_BRIDGE_VERSION &&
+        (size_t)(header_size + 2 * ring_capacity) == size && ring_capacity > 0;
+    os_shared_memory_unmap(address, header_size);
+    if (!ok || map_shared(&bridge, ring_capacity)) {
+        unmap_shared(&bridge);
+        os_shared_memory_close(&bridge.shm);
+        return 2;
+    }
+    bridge.channel_count = bridge.shared->channel_count;
+    bridge.max_frame_count = bridge.shared->max_frame_count;
+    bridge.spin_count = (os_concurrency() > 1) ? thread_safe_queue_default_spin_count : 0;
+    PluginBridgeShared *shared = bridge.shared;
+
+    int exit_code = 0;
+    float *out_buf = nullptr;
+    void *state = nullptr;
+    if (bridge.channel_count < 1 || bridge.max_frame_count < 1 ||
+        message_size(bridge.channel_count, bridge.max_frame_count) > (size_t)ring_capacity ||
+        effect->version != GENESIS_PLUGIN_VERSION ||
+        !(out_buf = allocate_zero<float>(bridge.channel_count * bridge.max_frame_count)) ||
+        !(state = effect->create(bridge.channel_count, shared->sample_rate, bridge.max_frame_count)))
+    {
+        shared->state.store(-1);
+        wake(&shared->response_epoch, &shared->response_waiter_count);
+        destroy(out_buf, bridge.channel_count * bridge.max_frame_count);
+        unmap_shared(&bridge);
+        os_shared_memory_close(&bridge.shm);
+        return 1;
+    }
+    shared->state.store(1);
+    wake(&shared->response_epoch, &shared->response_waiter_count);
+
+    // the next block follows the last one closely when the pipeline runs,
+    // so poll for a while before sleeping
+    int spin = 0;
+    while (!shared->exit_requested.load()) {
+        int epoch = shared->request_epoch.load();
+        long read_offset = shared->request_read_offset.load(std::memory_order_relaxed);
+        if (shared->request_write_offset.load(std::memory_order_acquire) != read_offset) {
+            if (!serve_messages(&bridge, effect, state, out_buf)) {
+                exit_code = 1;
+                break;
+            }
+            spin = 0;
+            continue;
+        }
+        if (spin < bridge.spin_count) {
+            spin += 1;
+            cpu_relax();
+            continue;
+        }
+        wait(&shared->request_epoch, &shared->request_waiter_count, epoch, CHILD_POLL_SECONDS);
+    }
+
+    effect->destroy(state);
+    destroy(out_buf, bridge.channel_count * bridge.max_frame_count);
+    unmap_shared(&bridge);
+    os_shared_memory_close(&bridge.shm);
+    return exit_code;
+}
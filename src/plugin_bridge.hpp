@@ -0,0 +1,60 @@
+#ifndef PLUGIN_BRIDGE_HPP
+#define PLUGIN_BRIDGE_HPP
+
+#include "os.hpp"
+#include "genesis_plugin.h"
+
+// runs an effect in a child process and trades blocks of audio with it
+// through two ring buffers in memory both processes map, one for requests
+// and one for responses. each ring is mirrored, so a block is always one
+// contiguous span. the sides wake each other with futexes on words in the
+// same memory, after spinning for a while first, so a block costs a few
+// microseconds on top of the effect itself.
+// the child is given the memory as an inherited file descriptor, on the
+// command line after PLUGIN_BRIDGE_HOST_FLAG.
+
+static const char PLUGIN_BRIDGE_HOST_FLAG[] = "--genesis-plugin-host";
+
+struct PluginBridgeShared;
+
+struct PluginBridge {
+    OsSharedMemory shm;
+    // the child, or nullptr on its side of the bridge
+    OsProcess *process;
+    PluginBridgeShared *shared;
+    size_t shared_size;
+    OsMirroredMemory request_mem;
+    OsMirroredMemory response_mem;
+    int channel_count;
+    int max_frame_count;
+    int spin_count;
+    // the child died, hung or could not run the effect. from then on
+    // plugin_bridge_process returns GenesisErrorAborted.
+    bool failed;
+};
+
+// starts host_path with the memory and library_path on its command line,
+// and waits up to timeout seconds for the effect to be created.
+// library_path may be nullptr for a host which needs none.
+int plugin_bridge_create(PluginBridge *bridge, const char *host_path, const char *library_path,
+        int channel_count, int sample_rate, int max_frame_count, double timeout);
+// stops and waits for the child
+void plugin_bridge_destroy(PluginBridge *bridge);
+
+// in and out are frame_count interleaved frames, at most max_frame_count.
+// returns GenesisErrorAborted, and kills the child, when it does not
+// answer within timeout seconds or has exited.
+int plugin_bridge_process(PluginBridge *bridge, const float *in, float *out, int frame_count,
+        double timeout);
+// passes on a seek without waiting for the child
+int plugin_bridge_seek(PluginBridge *bridge);
+
+// for main in the child: whether it was started as the other side of a
+// bridge, and the library it was given, or nullptr
+bool plugin_bridge_is_host_command(int argc, char *argv[]);
+const char *plugin_bridge_host_library(int argc, char *argv[]);
+// runs effect until the bridge is destroyed or the parent exits, and
+// returns the exit code for the process
+int plugin_bridge_serve(int argc, char *argv[], const GenesisPluginEffect *effect);
+
+#endif
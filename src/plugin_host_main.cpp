@@ -0,0 +1,36 @@
+#include "os.hpp"
+#include "plugin_bridge.hpp"
+#include "error.h"
+
+#include <dlfcn.h>
+#include <stdio.h>
+
+// the process a plugin host node starts for its effect. it loads the
+// effect's shared library, so whatever the library does to the process
+// stays out of the one with the pipeline.
+
+int main(int argc, char *argv[]) {
+    int err;
+    if ((err = os_init(nullptr)))
+        panic("unable to initialize: %s", genesis_strerror(err));
+
+    const char *library_path = plugin_bridge_host_library(argc, argv);
+    if (!library_path) {
+        fprintf(stderr, "Usage: %s %s fd size library\n"
+                "Started by genesis to run a plugin; not meant to be run by hand.\n",
+                argv[0], PLUGIN_BRIDGE_HOST_FLAG);
+        return 1;
+    }
+    void *library = dlopen(library_path, RTLD_NOW | RTLD_LOCAL);
+    if (!library) {
+        fprintf(stderr, "unable to load %s: %s\n", library_path, dlerror());
+        return 1;
+    }
+    const GenesisPluginEffect *effect = (const GenesisPluginEffect *)dlsym(library,
+            GENESIS_PLUGIN_EFFECT_SYMBOL);
+    if (!effect) {
+        fprintf(stderr, "%s has no %s\n", library_path, GENESIS_PLUGIN_EFFECT_SYMBOL);
+        return 1;
+    }
+    return plugin_bridge_serve(argc, argv, effect);
+}
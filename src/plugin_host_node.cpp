@@ -0,0 +1,196 @@
+#include "plugin_host_node.hpp"
+#include "plugin_bridge.hpp"
+
+// blocks go to the plugin in pieces of at most this many frames
+static const int PLUGIN_FRAME_COUNT = 1024;
+// a plugin which takes longer than this over a block, or to start, is
+// given up on. the node is silent from then on.
+static const double BLOCK_TIMEOUT_SECONDS = 0.1;
+static const double START_TIMEOUT_SECONDS = 5.0;
+
+struct PluginHostContext {
+    // only change while the pipeline is stopped
+    ByteBuffer host_path;
+    ByteBuffer library_path;
+    bool plugin_changed;
+
+    PluginBridge bridge;
+    bool bridge_open;
+    int channel_count;
+    int sample_rate;
+    // set by the run callback, read from any thread
+    atomic_bool failed;
+};
+
+static void close_bridge(PluginHostContext *plugin_host_context) {
+    if (plugin_host_context->bridge_open) {
+        plugin_bridge_destroy(&plugin_host_context->bridge);
+        plugin_host_context->bridge_open = false;
+    }
+}
+
+static void plugin_host_destroy(struct GenesisNode *node) {
+    struct PluginHostContext *plugin_host_context = (struct PluginHostContext *)node->userdata;
+    if (plugin_host_context) {
+        close_bridge(plugin_host_context);
+        destroy(plugin_host_context, 1);
+    }
+}
+
+static int plugin_host_create(struct GenesisNode *node) {
+    struct PluginHostContext *plugin_host_context = create_zero<PluginHostContext>();
+    node->userdata = plugin_host_context;
+    if (!plugin_host_context) {
+        plugin_host_destroy(node);
+        return GenesisErrorNoMem;
+    }
+    plugin_host_context->failed.store(false);
+    return 0;
+}
+
+// the plugin process is kept from one start of the pipeline to the next,
+// and only started again when it went away or the format changed. one
+// which can't be started does not keep the pipeline from running; the
+// node is silent instead.
+static int plugin_host_activate(struct GenesisNode *node) {
+    struct PluginHostContext *plugin_host_context = (struct PluginHostContext *)node->userdata;
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    int channel_count = genesis_audio_port_channel_layout(audio_in_port)->channel_count;
+    int sample_rate = genesis_audio_port_sample_rate(audio_in_port);
+    if (plugin_host_context->bridge_open && !plugin_host_context->bridge.failed &&
+        !plugin_host_context->plugin_changed && channel_count == plugin_host_context->channel_count &&
+        sample_rate == plugin_host_context->sample_rate)
+    {
+        return 0;
+    }
+    close_bridge(plugin_host_context);
+    plugin_host_context->plugin_changed = false;
+    plugin_host_context->channel_count = channel_count;
+    plugin_host_context->sample_rate = sample_rate;
+    plugin_host_context->failed.store(false);
+    if (plugin_host_context->host_path.length() == 0)
+        return 0;
+
+    const char *library_path = (plugin_host_context->library_path.length() > 0) ?
+        plugin_host_context->library_path.raw() : nullptr;
+    int err = plugin_bridge_create(&plugin_host_context->bridge, plugin_host_context->host_path.raw(),
+            library_path, channel_count, sample_rate, PLUGIN_FRAME_COUNT, START_TIMEOUT_SECONDS);
+    if (err == GenesisErrorNoMem)
+        return err;
+    if (err)
+        plugin_host_context->failed.store(true);
+    else
+        plugin_host_context->bridge_open = true;
+    return 0;
+}
+
+static void plugin_host_seek(struct GenesisNode *node) {
+    struct PluginHostContext *plugin_host_context = (struct PluginHostContext *)node->userdata;
+    if (plugin_host_context->bridge_open)
+        plugin_bridge_seek(&plugin_host_context->bridge);
+}
+
+static void plugin_host_run(struct GenesisNode *node) {
+    struct PluginHostContext *plugin_host_context = (struct PluginHostContext *)node->userdata;
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 1);
+
+    int input_frame_count = genesis_audio_in_port_fill_count(audio_in_port);
+    int output_frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    int frame_count = min(input_frame_count, output_frame_count);
+
+    int channel_count = plugin_host_context->channel_count;
+    float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+
+    // without a plugin the input passes through
+    if (plugin_host_context->host_path.length() == 0) {
+        memmove(out_buf, in_buf, frame_count * channel_count * sizeof(float));
+        genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+        return;
+    }
+
+    int frame = 0;
+    if (plugin_host_context->bridge_open) {
+        while (frame < frame_count) {
+            int chunk_frame_count = min(frame_count - frame, PLUGIN_FRAME_COUNT);
+            if (plugin_bridge_process(&plugin_host_context->bridge, in_buf + frame * channel_count,
+                        out_buf + frame * channel_count, chunk_frame_count, BLOCK_TIMEOUT_SECONDS))
+            {
+                plugin_host_context->failed.store(true);
+                break;
+            }
+            frame += chunk_frame_count;
+        }
+    }
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame);
+    if (frame < frame_count)
+        genesis_audio_out_port_write_silence(audio_out_port, frame_count - frame);
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+}
+
+int genesis_plugin_host_node_set_plugin(struct GenesisNode *node, const char *host_path,
+        const char *library_path)
+{
+    if (node->descriptor->run != plugin_host_run)
+        return GenesisErrorInvalidParam;
+    if (genesis_pipeline_is_running(node->descriptor->pipeline))
+        return GenesisErrorInvalidState;
+    struct PluginHostContext *plugin_host_context = (struct PluginHostContext *)node->userdata;
+    plugin_host_context->host_path = host_path ? host_path : "";
+    plugin_host_context->library_path = library_path ? library_path : "";
+    plugin_host_context->plugin_changed = true;
+    close_bridge(plugin_host_context);
+    plugin_host_context->failed.store(false);
+    return 0;
+}
+
+bool genesis_plugin_host_node_failed(struct GenesisNode *node) {
+    if (node->descriptor->run != plugin_host_run)
+        return false;
+    struct PluginHostContext *plugin_host_context = (struct PluginHostContext *)node->userdata;
+    return plugin_host_context->failed.load();
+}
+
+int create_plugin_host_descriptor(GenesisPipeline *pipeline) {
+    GenesisNodeDescriptor *node_descr = genesis_create_node_descriptor(pipeline, 2, "plugin_host",
+            "Effect plugin in a process of its own.");
+    if (!node_descr) {
+        genesis_node_descriptor_destroy(node_descr);
+        return GenesisErrorNoMem;
+    }
+
+    genesis_node_descriptor_set_run_callback(node_descr, plugin_host_run);
+    genesis_node_descriptor_set_create_callback(node_descr, plugin_host_create);
+    genesis_node_descriptor_set_destroy_callback(node_descr, plugin_host_destroy);
+    genesis_node_descriptor_set_seek_callback(node_descr, plugin_host_seek);
+    genesis_node_descriptor_set_activate_callback(node_descr, plugin_host_activate);
+
+    struct GenesisPortDescriptor *audio_in_port = genesis_node_descriptor_create_port(
+            node_descr, 0, GenesisPortTypeAudioIn, "audio_in");
+    struct GenesisPortDescriptor *audio_out_port = genesis_node_descriptor_create_port(
+            node_descr, 1, GenesisPortTypeAudioOut, "audio_out");
+
+    if (!audio_in_port || !audio_out_port) {
+        genesis_node_descriptor_destroy(node_descr);
+        return GenesisErrorNoMem;
+    }
+
+    int target_sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+
+    genesis_audio_port_descriptor_set_channel_layout(audio_in_port,
+        soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono), false, -1);
+
+    genesis_audio_port_descriptor_set_sample_rate(audio_in_port, target_sample_rate, false, -1);
+
+    genesis_audio_port_descriptor_set_channel_layout(audio_out_port,
+        soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono), true, 0);
+
+    genesis_audio_port_descriptor_set_sample_rate(audio_out_port, target_sample_rate, true, 0);
+
+    // a piece of input is sent off before its output comes back
+    genesis_audio_port_descriptor_set_in_place(audio_out_port, 0);
+
+    return 0;
+}
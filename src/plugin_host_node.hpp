@@ -0,0 +1,8 @@
+#ifndef PLUGIN_HOST_NODE_HPP
+#define PLUGIN_HOST_NODE_HPP
+
+#include "genesis.hpp"
+
+int create_plugin_host_descriptor(GenesisPipeline *pipeline);
+
+#endif
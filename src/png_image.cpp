@@ -1,5 +1,5 @@
 #include "png_image.hpp"
-#include "glfw.hpp"
+#include "util.hpp"
 
 #include <png.h>
 
@@ -73,7 +73,3 @@ PngImage::PngImage(const ByteBuffer &compressed_bytes) {
     png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
     destroy(row_ptrs, _height);
 }
-
-void PngImage::gl_pixel_store_alignment() const {
-    glPixelStorei(GL_PACK_ALIGNMENT, 4);
-}
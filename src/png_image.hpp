@@ -13,8 +13,6 @@ public:
     int _height;
     int _pitch;
 
-    void gl_pixel_store_alignment() const;
-
     const char *raw() const {
         return _image_data.raw();
     }
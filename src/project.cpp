@@ -1,5 +1,9 @@
 #include "project.hpp"
 #include "audio_graph.hpp"
+#include "waveform_peaks.hpp"
+#include "time_stretch.hpp"
+#include "logger.hpp"
+#include "parallel.hpp"
 
 #include <limits.h>
 
@@ -25,11 +29,18 @@ enum PropKey {
     PropKeyTagAlbumArtist,
     PropKeyTagAlbum,
     PropKeyTagYear,
+    PropKeyCommandLog,
 };
 
 static const int PROP_KEY_SIZE = 4;
 static const int UINT256_SIZE = 32;
 
+// every key fits, so keys are built on the stack
+struct ProjectKey {
+    char data[PROP_KEY_SIZE + PROP_KEY_SIZE + UINT256_SIZE];
+    int size;
+};
+
 // modifying this structure affects project file backward compatibility
 enum SerializableFieldKey {
     SerializableFieldKeyInvalid,
@@ -63,6 +74,24 @@ enum SerializableFieldKey {
     SerializableFieldKeyNewSampleRate,
     SerializableFieldKeyOldChannelLayout,
     SerializableFieldKeyNewChannelLayout,
+    SerializableFieldKeyOldPos,
+    SerializableFieldKeyNewPos,
+    SerializableFieldKeyRebalance,
+    SerializableFieldKeyPolyphony,
+    SerializableFieldKeyVoiceSteal,
+    SerializableFieldKeyOldPolyphony,
+    SerializableFieldKeyNewPolyphony,
+    SerializableFieldKeyOldVoiceSteal,
+    SerializableFieldKeyNewVoiceSteal,
+    SerializableFieldKeyStretch,
+    SerializableFieldKeyPitch,
+    SerializableFieldKeyTimeStretchQuality,
+    SerializableFieldKeyOldStretch,
+    SerializableFieldKeyNewStretch,
+    SerializableFieldKeyOldPitch,
+    SerializableFieldKeyNewPitch,
+    SerializableFieldKeyOldTimeStretchQuality,
+    SerializableFieldKeyNewTimeStretchQuality,
 };
 
 // modifying this structure affects project file backward compatibility
@@ -96,6 +125,7 @@ struct SerializableField {
 static int deserialize_from_enum(void *ptr, SerializableFieldType type, const ByteBuffer &buffer, int *offset);
 static void serialize_effect(Effect *effect, ByteBuffer &buffer);
 static void serialize_effect_send(EffectSend *effect_send, ByteBuffer &buffer);
+static void stop_asset_loader(Project *project);
 
 static const SerializableField<Track> *get_serializable_fields(Track *) {
     static const SerializableField<Track> fields[] = {
@@ -115,6 +145,16 @@ static const SerializableField<Track> *get_serializable_fields(Track *) {
             },
             nullptr,
         },
+        {
+            SerializableFieldKeyMixerLineId,
+            SerializableFieldTypeUInt256,
+            [](Track *track) -> void * {
+                return &track->mixer_line_id;
+            },
+            [](Track *track) {
+                track->mixer_line_id = uint256::zero();
+            },
+        },
         {
             SerializableFieldKeyInvalid,
             SerializableFieldTypeInvalid,
@@ -235,6 +275,56 @@ static const SerializableField<AudioClip> *get_serializable_fields(AudioClip *)
             },
             nullptr,
         },
+        {
+            SerializableFieldKeyPolyphony,
+            SerializableFieldTypeUInt32AsInt,
+            [](AudioClip *audio_clip) -> void * {
+                return &audio_clip->polyphony;
+            },
+            [](AudioClip *audio_clip) {
+                audio_clip->polyphony = AUDIO_CLIP_DEFAULT_POLYPHONY;
+            },
+        },
+        {
+            SerializableFieldKeyVoiceSteal,
+            SerializableFieldTypeUInt32AsInt,
+            [](AudioClip *audio_clip) -> void * {
+                return &audio_clip->voice_steal;
+            },
+            [](AudioClip *audio_clip) {
+                audio_clip->voice_steal = AudioClipVoiceStealOldest;
+            },
+        },
+        {
+            SerializableFieldKeyStretch,
+            SerializableFieldTypeDouble,
+            [](AudioClip *audio_clip) -> void * {
+                return &audio_clip->stretch;
+            },
+            [](AudioClip *audio_clip) {
+                audio_clip->stretch = 1.0;
+            },
+        },
+        {
+            SerializableFieldKeyPitch,
+            SerializableFieldTypeDouble,
+            [](AudioClip *audio_clip) -> void * {
+                return &audio_clip->pitch;
+            },
+            [](AudioClip *audio_clip) {
+                audio_clip->pitch = 1.0;
+            },
+        },
+        {
+            SerializableFieldKeyTimeStretchQuality,
+            SerializableFieldTypeUInt32AsInt,
+            [](AudioClip *audio_clip) -> void * {
+                return &audio_clip->time_stretch_quality;
+            },
+            [](AudioClip *audio_clip) {
+                audio_clip->time_stretch_quality = GenesisTimeStretchQualityDraft;
+            },
+        },
         {
             SerializableFieldKeyInvalid,
             SerializableFieldTypeInvalid,
@@ -397,6 +487,26 @@ static const SerializableField<EffectSendDevice> *get_serializable_fields(Effect
     return fields;
 }
 
+static const SerializableField<EffectSendMixerLine> *get_serializable_fields(EffectSendMixerLine *) {
+    static const SerializableField<EffectSendMixerLine> fields[] = {
+        {
+            SerializableFieldKeyMixerLineId,
+            SerializableFieldTypeUInt256,
+            [](EffectSendMixerLine *self) -> void * {
+                return &self->mixer_line_id;
+            },
+            nullptr,
+        },
+        {
+            SerializableFieldKeyInvalid,
+            SerializableFieldTypeInvalid,
+            nullptr,
+            nullptr,
+        },
+    };
+    return fields;
+}
+
 static const SerializableField<Command> *get_serializable_fields(Command *) {
     static const SerializableField<Command> fields[] = {
         {
@@ -467,6 +577,16 @@ static const SerializableField<AddTrackCommand> *get_serializable_fields(AddTrac
             },
             nullptr,
         },
+        {
+            SerializableFieldKeyRebalance,
+            SerializableFieldTypeByteBuffer,
+            [](AddTrackCommand *cmd) -> void * {
+                return &cmd->rebalance;
+            },
+            [](AddTrackCommand *cmd) {
+                cmd->rebalance.clear();
+            },
+        },
         {
             SerializableFieldKeyInvalid,
             SerializableFieldTypeInvalid,
@@ -601,6 +721,162 @@ static const SerializableField<AddAudioClipSegmentCommand> *get_serializable_fie
     return fields;
 }
 
+static const SerializableField<SetAudioClipVoicesCommand> *get_serializable_fields(SetAudioClipVoicesCommand *) {
+    static const SerializableField<SetAudioClipVoicesCommand> fields[] = {
+        {
+            SerializableFieldKeyAudioClipId,
+            SerializableFieldTypeUInt256,
+            [](SetAudioClipVoicesCommand *cmd) -> void * {
+                return &cmd->audio_clip_id;
+            },
+            nullptr,
+        },
+        {
+            SerializableFieldKeyOldPolyphony,
+            SerializableFieldTypeUInt32AsInt,
+            [](SetAudioClipVoicesCommand *cmd) -> void * {
+                return &cmd->old_polyphony;
+            },
+            nullptr,
+        },
+        {
+            SerializableFieldKeyNewPolyphony,
+            SerializableFieldTypeUInt32AsInt,
+            [](SetAudioClipVoicesCommand *cmd) -> void * {
+                return &cmd->new_polyphony;
+            },
+            nullptr,
+        },
+        {
+            SerializableFieldKeyOldVoiceSteal,
+            SerializableFieldTypeUInt32AsInt,
+            [](SetAudioClipVoicesCommand *cmd) -> void * {
+                return &cmd->old_voice_steal;
+            },
+            nullptr,
+        },
+        {
+            SerializableFieldKeyNewVoiceSteal,
+            SerializableFieldTypeUInt32AsInt,
+            [](SetAudioClipVoicesCommand *cmd) -> void * {
+                return &cmd->new_voice_steal;
+            },
+            nullptr,
+        },
+        {
+            SerializableFieldKeyInvalid,
+            SerializableFieldTypeInvalid,
+            nullptr,
+            nullptr,
+        },
+    };
+    return fields;
+}
+
+static const SerializableField<SetAudioClipTimeStretchCommand> *get_serializable_fields(SetAudioClipTimeStretchCommand *) {
+    static const SerializableField<SetAudioClipTimeStretchCommand> fields[] = {
+        {
+            SerializableFieldKeyAudioClipId,
+            SerializableFieldTypeUInt256,
+            [](SetAudioClipTimeStretchCommand *cmd) -> void * {
+                return &cmd->audio_clip_id;
+            },
+            nullptr,
+        },
+        {
+            SerializableFieldKeyOldStretch,
+            SerializableFieldTypeDouble,
+            [](SetAudioClipTimeStretchCommand *cmd) -> void * {
+                return &cmd->old_stretch;
+            },
+            nullptr,
+        },
+        {
+            SerializableFieldKeyNewStretch,
+            SerializableFieldTypeDouble,
+            [](SetAudioClipTimeStretchCommand *cmd) -> void * {
+                return &cmd->new_stretch;
+            },
+            nullptr,
+        },
+        {
+            SerializableFieldKeyOldPitch,
+            SerializableFieldTypeDouble,
+            [](SetAudioClipTimeStretchCommand *cmd) -> void * {
+                return &cmd->old_pitch;
+            },
+            nullptr,
+        },
+        {
+            SerializableFieldKeyNewPitch,
+            SerializableFieldTypeDouble,
+            [](SetAudioClipTimeStretchCommand *cmd) -> void * {
+                return &cmd->new_pitch;
+            },
+            nullptr,
+        },
+        {
+            SerializableFieldKeyOldTimeStretchQuality,
+            SerializableFieldTypeUInt32AsInt,
+            [](SetAudioClipTimeStretchCommand *cmd) -> void * {
+                return &cmd->old_quality;
+            },
+            nullptr,
+        },
+        {
+            SerializableFieldKeyNewTimeStretchQuality,
+            SerializableFieldTypeUInt32AsInt,
+            [](SetAudioClipTimeStretchCommand *cmd) -> void * {
+                return &cmd->new_quality;
+            },
+            nullptr,
+        },
+        {
+            SerializableFieldKeyInvalid,
+            SerializableFieldTypeInvalid,
+            nullptr,
+            nullptr,
+        },
+    };
+    return fields;
+}
+
+static const SerializableField<MoveAudioClipSegmentCommand> *get_serializable_fields(MoveAudioClipSegmentCommand *) {
+    static const SerializableField<MoveAudioClipSegmentCommand> fields[] = {
+        {
+            SerializableFieldKeyAudioClipSegmentId,
+            SerializableFieldTypeUInt256,
+            [](MoveAudioClipSegmentCommand *cmd) -> void * {
+                return &cmd->audio_clip_segment_id;
+            },
+            nullptr,
+        },
+        {
+            SerializableFieldKeyOldPos,
+            SerializableFieldTypeDouble,
+            [](MoveAudioClipSegmentCommand *cmd) -> void * {
+                return &cmd->old_pos;
+            },
+            nullptr,
+        },
+        {
+            SerializableFieldKeyNewPos,
+            SerializableFieldTypeDouble,
+            [](MoveAudioClipSegmentCommand *cmd) -> void * {
+                return &cmd->new_pos;
+            },
+            nullptr,
+        },
+        {
+            SerializableFieldKeyInvalid,
+            SerializableFieldTypeInvalid,
+            nullptr,
+            nullptr,
+        },
+    };
+    return fields;
+}
+
 static const SerializableField<ChangeSampleRateCommand> *get_serializable_fields(ChangeSampleRateCommand *) {
     static const SerializableField<ChangeSampleRateCommand> fields[] = {
         {
@@ -809,34 +1085,76 @@ static void serialize_from_enum(void *ptr, SerializableFieldType type, ByteBuffe
     }
 }
 
+// the size of a field of this type, or 0 if it depends on the value
+static int serializable_type_fixed_size(SerializableFieldType type) {
+    switch (type) {
+    case SerializableFieldTypeUInt8:
+        return 1;
+    case SerializableFieldTypeUInt32:
+    case SerializableFieldTypeUInt32AsInt:
+    case SerializableFieldTypeCmdType:
+    case SerializableFieldTypeFloat:
+        return 4;
+    case SerializableFieldTypeUInt64AsLong:
+    case SerializableFieldTypeDouble:
+        return 8;
+    case SerializableFieldTypeUInt256:
+        return UINT256_SIZE;
+    default:
+        return 0;
+    }
+}
+
+// what serialize_object and deserialize_object need to know about the fields
+// of T, worked out once per type
 template<typename T>
-static void serialize_object(T *obj, ByteBuffer &buffer) {
-    const SerializableField<T> *serializable_fields = get_serializable_fields(obj);
+struct SerializableLayout {
+    const SerializableField<T> *fields;
+    int field_count;
+    // the serialized size not counting the variable size fields' values
+    int min_size;
+};
 
-    // iterate once to count the fields
-    int field_count = 0;
-    const SerializableField<T> *it = serializable_fields;
-    while (it->key != SerializableFieldKeyInvalid) {
+// deserialize_object keeps track of the fields it found in a bit mask
+static const int MAX_SERIALIZABLE_FIELDS = 64;
+
+template<typename T>
+static SerializableLayout<T> create_serializable_layout(void) {
+    SerializableLayout<T> layout;
+    layout.fields = get_serializable_fields((T *)nullptr);
+    layout.field_count = 0;
+    layout.min_size = 4;
+    for (const SerializableField<T> *it = layout.fields; it->key != SerializableFieldKeyInvalid; it += 1) {
         assert(it->get_field_ptr);
-        field_count += 1;
-        it += 1;
+        layout.field_count += 1;
+        layout.min_size += 8 + serializable_type_fixed_size(it->type);
     }
+    assert(layout.field_count <= MAX_SERIALIZABLE_FIELDS);
+    return layout;
+}
+
+template<typename T>
+static const SerializableLayout<T> *get_serializable_layout(void) {
+    static const SerializableLayout<T> layout = create_serializable_layout<T>();
+    return &layout;
+}
 
-    buffer.append_uint32be(field_count);
+template<typename T>
+static void serialize_object(T *obj, ByteBuffer &buffer) {
+    const SerializableLayout<T> *layout = get_serializable_layout<T>();
+    buffer.reserve(buffer.length() + layout->min_size);
+    buffer.append_uint32be(layout->field_count);
 
-    // iterate again and serialize everything
-    it = serializable_fields;
-    while (it->key != SerializableFieldKeyInvalid) {
+    for (int i = 0; i < layout->field_count; i += 1) {
+        const SerializableField<T> *field = &layout->fields[i];
         int field_length_offset = buffer.length();
         buffer.resize(buffer.length() + 4);
 
-        buffer.append_uint32be(it->key);
-        serialize_from_enum(it->get_field_ptr(obj), it->type, buffer);
+        buffer.append_uint32be(field->key);
+        serialize_from_enum(field->get_field_ptr(obj), field->type, buffer);
 
         int field_size = buffer.length() - field_length_offset;
         write_uint32be(buffer.raw() + field_length_offset, field_size);
-
-        it += 1;
     }
 }
 
@@ -854,6 +1172,9 @@ static void serialize_effect_send(EffectSend *effect_send, ByteBuffer &buffer) {
         case EffectSendTypeDevice:
             serialize_object(&effect_send->send.device, buffer);
             return;
+        case EffectSendTypeMixerLine:
+            serialize_object(&effect_send->send.mixer_line, buffer);
+            return;
     }
     panic("invalid effect type");
 }
@@ -930,7 +1251,7 @@ static int deserialize_byte_buffer(ByteBuffer &out, const ByteBuffer &buffer, in
 
     int len = read_uint32be(buffer.raw() + *offset);
     *offset += 4;
-    if (buffer.length() - *offset < len)
+    if (len < 0 || buffer.length() - *offset < len)
         return GenesisErrorInvalidFormat;
 
     out.clear();
@@ -991,21 +1312,10 @@ static int deserialize_channel_layout(SoundIoChannelLayout *layout, const ByteBu
 
 template<typename T>
 static int deserialize_object(T *obj, const ByteBuffer &buffer, int *offset) {
-    const SerializableField<T> *serializable_fields = get_serializable_fields(obj);
+    const SerializableLayout<T> *layout = get_serializable_layout<T>();
+    uint64_t found_mask = 0;
 
     int err;
-    struct Item {
-        bool found;
-        const SerializableField<T> *field;
-    };
-    List<Item> items;
-    const SerializableField<T> *it = serializable_fields;
-    while (it->key != SerializableFieldKeyInvalid) {
-        if (items.append({false, it}))
-            return GenesisErrorNoMem;
-        it += 1;
-    }
-
     int field_count;
     if ((err = deserialize_uint32be_as_int(&field_count, buffer, offset))) return err;
     for (int field_i = 0; field_i < field_count; field_i += 1) {
@@ -1013,22 +1323,31 @@ static int deserialize_object(T *obj, const ByteBuffer &buffer, int *offset) {
 
         int field_size;
         if ((err = deserialize_uint32be_as_int(&field_size, buffer, offset))) return err;
+        if (field_size < 8 || field_size > buffer.length() - field_offset)
+            return GenesisErrorInvalidFormat;
 
         int field_key;
         if ((err = deserialize_uint32be_as_int(&field_key, buffer, offset))) return err;
 
-        bool found_this_field = false;
-        for (int item_i = 0; item_i < items.length(); item_i += 1) {
-            Item *item = &items.at(item_i);
-            if (item->field->key == field_key) {
-                found_this_field = true;
-                item->found = true;
-                if ((err = deserialize_from_enum(item->field->get_field_ptr(obj), item->field->type, buffer, offset)))
-                    return err;
-                break;
+        // fields are written in the order of the table, so look there first
+        int index = -1;
+        if (field_i < layout->field_count && layout->fields[field_i].key == field_key) {
+            index = field_i;
+        } else {
+            for (int i = 0; i < layout->field_count; i += 1) {
+                if (layout->fields[i].key == field_key) {
+                    index = i;
+                    break;
+                }
             }
         }
-        if (!found_this_field) {
+
+        if (index >= 0) {
+            const SerializableField<T> *field = &layout->fields[index];
+            found_mask |= ((uint64_t)1) << index;
+            if ((err = deserialize_from_enum(field->get_field_ptr(obj), field->type, buffer, offset)))
+                return err;
+        } else {
             // skip this field
             *offset = field_offset + field_size;
         }
@@ -1036,12 +1355,12 @@ static int deserialize_object(T *obj, const ByteBuffer &buffer, int *offset) {
     }
 
     // call default callbacks on unfound fields
-    for (int item_i = 0; item_i < items.length(); item_i += 1) {
-        Item *item = &items.at(item_i);
-        if (!item->found) {
-            if (!item->field->set_default_value)
+    for (int i = 0; i < layout->field_count; i += 1) {
+        if (!(found_mask & (((uint64_t)1) << i))) {
+            const SerializableField<T> *field = &layout->fields[i];
+            if (!field->set_default_value)
                 return GenesisErrorInvalidFormat;
-            item->field->set_default_value(obj);
+            field->set_default_value(obj);
         }
     }
 
@@ -1107,6 +1426,8 @@ static int deserialize_from_enum(void *ptr, SerializableFieldType type, const By
             switch ((EffectSendType)effect_send->send_type) {
                 case EffectSendTypeDevice:
                     return deserialize_object(&effect_send->send.device, buffer, offset);
+                case EffectSendTypeMixerLine:
+                    return deserialize_object(&effect_send->send.mixer_line, buffer, offset);
             }
             panic("unreachable");
         }
@@ -1132,6 +1453,12 @@ static int deserialize_from_enum(void *ptr, SerializableFieldType type, const By
                     return deserialize_object(reinterpret_cast<ChangeSampleRateCommand*>(cmd), buffer, offset);
                 case CommandTypeChangeChannelLayout:
                     return deserialize_object(reinterpret_cast<ChangeChannelLayoutCommand*>(cmd), buffer, offset);
+                case CommandTypeMoveAudioClipSegment:
+                    return deserialize_object(reinterpret_cast<MoveAudioClipSegmentCommand*>(cmd), buffer, offset);
+                case CommandTypeSetAudioClipVoices:
+                    return deserialize_object(reinterpret_cast<SetAudioClipVoicesCommand*>(cmd), buffer, offset);
+                case CommandTypeSetAudioClipTimeStretch:
+                    return deserialize_object(reinterpret_cast<SetAudioClipTimeStretchCommand*>(cmd), buffer, offset);
             }
             panic("unreachable");
         }
@@ -1158,44 +1485,49 @@ static int deserialize_from_enum(void *ptr, SerializableFieldType type, const By
     panic("unreachable");
 }
 
-static OrderedMapFileBuffer *omf_buf_uint256(const uint256 &value) {
-    OrderedMapFileBuffer *buf = ok_mem(ordered_map_file_buffer_create(UINT256_SIZE));
-    value.write_be(buf->data);
-    return buf;
+static void omf_put_uint256(OrderedMapFileBatch *batch, const ProjectKey &key, const uint256 &value) {
+    char buf[UINT256_SIZE];
+    value.write_be(buf);
+    ordered_map_file_batch_put_bytes(batch, key.data, key.size, buf, UINT256_SIZE);
 }
 
-static OrderedMapFileBuffer *omf_buf_uint32(uint32_t x) {
-    OrderedMapFileBuffer *buf = ok_mem(ordered_map_file_buffer_create(4));
-    write_uint32be(buf->data, x);
-    return buf;
+static void omf_put_uint32(OrderedMapFileBatch *batch, const ProjectKey &key, uint32_t x) {
+    char buf[4];
+    write_uint32be(buf, x);
+    ordered_map_file_batch_put_bytes(batch, key.data, key.size, buf, 4);
 }
 
-static OrderedMapFileBuffer *omf_buf_byte_buffer(const ByteBuffer &byte_buffer) {
-    OrderedMapFileBuffer *buf = ok_mem(ordered_map_file_buffer_create(byte_buffer.length()));
-    memcpy(buf->data, byte_buffer.raw(), byte_buffer.length());
-    return buf;
+static void omf_put_byte_buffer(OrderedMapFileBatch *batch, const ProjectKey &key, const ByteBuffer &byte_buffer) {
+    ordered_map_file_batch_put_bytes(batch, key.data, key.size, byte_buffer.raw(), byte_buffer.length());
 }
 
-static OrderedMapFileBuffer *omf_buf_channel_layout(const SoundIoChannelLayout *layout) {
+static void omf_put_channel_layout(OrderedMapFileBatch *batch, const ProjectKey &key,
+        const SoundIoChannelLayout *layout)
+{
     assert(layout->channel_count <= GENESIS_MAX_CHANNELS);
-    OrderedMapFileBuffer *buf = ok_mem(ordered_map_file_buffer_create(4 + 4 * layout->channel_count));
-    write_uint32be(buf->data, layout->channel_count);
+    ByteBuffer *buf = ordered_map_file_batch_begin_put(batch, key.data, key.size);
+    buf->append_uint32be(layout->channel_count);
     for (int i = 0; i < layout->channel_count; i += 1) {
-        write_uint32be(&buf->data[4 + i * 4], layout->channels[i]);
+        buf->append_uint32be(layout->channels[i]);
     }
-    return buf;
+    ordered_map_file_batch_end_put(batch);
 }
 
-static OrderedMapFileBuffer *omf_buf_string(const String &string) {
+static void omf_put_string(OrderedMapFileBatch *batch, const ProjectKey &key, const String &string) {
     ByteBuffer encoded = string.encode();
-    return omf_buf_byte_buffer(encoded);
+    omf_put_byte_buffer(batch, key, encoded);
 }
 
+// serializes straight into the batch
 template<typename T>
-static OrderedMapFileBuffer *omf_buf_obj(T *obj) {
-    ByteBuffer buffer;
-    serialize_object(obj, buffer);
-    return omf_buf_byte_buffer(buffer);
+static void omf_put_obj(OrderedMapFileBatch *batch, const ProjectKey &key, T *obj) {
+    ByteBuffer *buf = ordered_map_file_batch_begin_put(batch, key.data, key.size);
+    serialize_object(obj, *buf);
+    ordered_map_file_batch_end_put(batch);
+}
+
+static void omf_del(OrderedMapFileBatch *batch, const ProjectKey &key) {
+    ordered_map_file_batch_del_bytes(batch, key.data, key.size);
 }
 
 static int compare_tracks(Track *a, Track *b) {
@@ -1247,8 +1579,10 @@ static int compare_effects(Effect *a, Effect *b) {
     return (sort_key_cmp == 0) ? uint256::compare(a->id, b->id) : sort_key_cmp;
 }
 
+// large projects have tens of thousands of commands, and those are sorted
+// on every thread the job system has
 template<typename T, int (*compare)(T, T)>
-static void project_sort_item(List<T> &list, IdMap<T> &id_map) {
+static void project_sort_item(Project *project, List<T> &list, IdMap<T> &id_map) {
     list.clear();
     auto it = id_map.entry_iterator();
     for (;;) {
@@ -1258,31 +1592,31 @@ static void project_sort_item(List<T> &list, IdMap<T> &id_map) {
 
         ok_or_panic(list.append(entry->value));
     }
-    quick_sort<T, compare>(list.raw(), list.length());
+    parallel_sort<T, compare>(genesis_context_job_system(project->genesis_context), list);
 }
 
 static void project_sort_tracks(Project *project) {
-    project_sort_item<Track *, compare_tracks>(project->track_list, project->tracks);
+    project_sort_item<Track *, compare_tracks>(project, project->track_list, project->tracks);
 }
 
 static void project_sort_users(Project *project) {
-    project_sort_item<User *, compare_users>(project->user_list, project->users);
+    project_sort_item<User *, compare_users>(project, project->user_list, project->users);
 }
 
 static void project_sort_commands(Project *project) {
-    project_sort_item<Command *, compare_commands>(project->command_list, project->commands);
+    project_sort_item<Command *, compare_commands>(project, project->command_list, project->commands);
 }
 
 static void project_sort_audio_assets(Project *project) {
-    project_sort_item<AudioAsset *, compare_audio_assets>(project->audio_asset_list, project->audio_assets);
+    project_sort_item<AudioAsset *, compare_audio_assets>(project, project->audio_asset_list, project->audio_assets);
 }
 
 static void project_sort_audio_clips(Project *project) {
-    project_sort_item<AudioClip *, compare_audio_clips>(project->audio_clip_list, project->audio_clips);
+    project_sort_item<AudioClip *, compare_audio_clips>(project, project->audio_clip_list, project->audio_clips);
 }
 
 static void project_sort_mixer_lines(Project *project) {
-    project_sort_item<MixerLine *, compare_mixer_lines>(project->mixer_line_list, project->mixer_lines);
+    project_sort_item<MixerLine *, compare_mixer_lines>(project, project->mixer_line_list, project->mixer_lines);
 }
 
 static void project_sort_audio_clip_segments(Project *project) {
@@ -1329,106 +1663,200 @@ static void project_sort_effects(Project *project) {
     }
 }
 
-static void trigger_event(Project *project, Event event) {
-    project->events.trigger(event);
-}
-
-static void project_compute_indexes(Project *project) {
-    if (project->track_list_dirty) project_sort_tracks(project);
-    if (project->user_list_dirty) project_sort_users(project);
-    if (project->command_list_dirty) project_sort_commands(project);
-    if (project->audio_asset_list_dirty) project_sort_audio_assets(project);
-    if (project->audio_clip_list_dirty) project_sort_audio_clips(project);
-    if (project->mixer_line_list_dirty) project_sort_mixer_lines(project);
+// builds every sorted list from the id maps, after the project is read
+static void project_sort_indexes(Project *project) {
+    project_sort_tracks(project);
+    project_sort_users(project);
+    project_sort_commands(project);
+    project_sort_audio_assets(project);
+    project_sort_audio_clips(project);
+    project_sort_mixer_lines(project);
     // depends on tracks being sorted
-    if (project->audio_clip_segments_dirty) project_sort_audio_clip_segments(project);
+    project_sort_audio_clip_segments(project);
     // depends on mixer lines being sorted
-    if (project->effects_dirty) project_sort_effects(project);
+    project_sort_effects(project);
+}
 
-    if (project->track_list_dirty) {
-        project->track_list_dirty = false;
-        trigger_event(project, EventProjectTracksChanged);
-    }
-    if (project->user_list_dirty) {
-        project->user_list_dirty = false;
-        trigger_event(project, EventProjectUsersChanged);
-    }
-    if (project->command_list_dirty) {
-        project->command_list_dirty = false;
-        trigger_event(project, EventProjectCommandsChanged);
-    }
-    if (project->audio_asset_list_dirty) {
-        project->audio_asset_list_dirty = false;
-        trigger_event(project, EventProjectAudioAssetsChanged);
-    }
-    if (project->audio_clip_list_dirty) {
-        project->audio_clip_list_dirty = false;
-        trigger_event(project, EventProjectAudioClipsChanged);
-    }
-    if (project->mixer_line_list_dirty) {
-        project->mixer_line_list_dirty = false;
-        trigger_event(project, EventProjectMixerLinesChanged);
-    }
-    if (project->audio_clip_segments_dirty) {
-        project->audio_clip_segments_dirty = false;
-        trigger_event(project, EventProjectAudioClipSegmentsChanged);
-    }
-    if (project->effects_dirty) {
-        project->effects_dirty = false;
-        trigger_event(project, EventProjectEffectsChanged);
+// after that, edits keep the lists sorted by inserting and removing only the
+// items they touch
+template<typename T, int (*compare)(T, T)>
+static int sorted_lower_bound(List<T> &list, T item) {
+    int start = 0;
+    int end = list.length();
+    while (start < end) {
+        int middle = (start + end) / 2;
+        if (compare(list.at(middle), item) < 0)
+            start = middle + 1;
+        else
+            end = middle;
     }
+    return start;
 }
 
-int project_get_next_revision(Project *project) {
-    project_compute_indexes(project);
+template<typename T, int (*compare)(T, T)>
+static void sorted_insert(List<T> &list, T item) {
+    int index = sorted_lower_bound<T, compare>(list, item);
+    ok_or_panic(list.insert_space(index, 1));
+    list.at(index) = item;
+}
 
-    if (project->command_list.length() == 0)
-        return 0;
+template<typename T, int (*compare)(T, T)>
+static void sorted_remove(List<T> &list, T item) {
+    int index = sorted_lower_bound<T, compare>(list, item);
+    assert(index < list.length() && list.at(index) == item);
+    list.remove_range(index, index + 1);
+}
+
+static void index_add_track(Project *project, Track *track) {
+    sorted_insert<Track *, compare_tracks>(project->track_list, track);
+    project->track_list_dirty = true;
+}
+
+static void index_remove_track(Project *project, Track *track) {
+    sorted_remove<Track *, compare_tracks>(project->track_list, track);
+    project->track_list_dirty = true;
+}
+
+static void index_add_user(Project *project, User *user) {
+    sorted_insert<User *, compare_users>(project->user_list, user);
+    project->user_list_dirty = true;
+}
+
+static void index_add_audio_asset(Project *project, AudioAsset *audio_asset) {
+    sorted_insert<AudioAsset *, compare_audio_assets>(project->audio_asset_list, audio_asset);
+    project->audio_asset_list_dirty = true;
+}
+
+static void index_add_audio_clip(Project *project, AudioClip *audio_clip) {
+    sorted_insert<AudioClip *, compare_audio_clips>(project->audio_clip_list, audio_clip);
+    project->audio_clip_list_dirty = true;
+}
+
+static void index_remove_audio_clip(Project *project, AudioClip *audio_clip) {
+    sorted_remove<AudioClip *, compare_audio_clips>(project->audio_clip_list, audio_clip);
+    project->audio_clip_list_dirty = true;
+}
+
+static void index_add_audio_clip_segment(Project *project, AudioClipSegment *segment) {
+    sorted_insert<AudioClipSegment *, compare_audio_clip_segments>(segment->track->audio_clip_segments, segment);
+    project->audio_clip_segments_dirty = true;
+}
+
+static void index_remove_audio_clip_segment(Project *project, AudioClipSegment *segment) {
+    sorted_remove<AudioClipSegment *, compare_audio_clip_segments>(segment->track->audio_clip_segments, segment);
+    project->audio_clip_segments_dirty = true;
+}
+
+static void index_add_mixer_line(Project *project, MixerLine *mixer_line) {
+    sorted_insert<MixerLine *, compare_mixer_lines>(project->mixer_line_list, mixer_line);
+    project->mixer_line_list_dirty = true;
+}
+
+static void index_add_effect(Project *project, Effect *effect) {
+    sorted_insert<Effect *, compare_effects>(effect->mixer_line->effects, effect);
+    project->effects_dirty = true;
+}
+
+static void trigger_event(Project *project, Event event) {
+    project->events.trigger(event);
+}
+
+// the dirty flags say which lists changed since the last events
+static void project_trigger_list_events(Project *project) {
+    if (project->track_list_dirty) {
+        project->track_list_dirty = false;
+        trigger_event(project, EventProjectTracksChanged);
+    }
+    if (project->user_list_dirty) {
+        project->user_list_dirty = false;
+        trigger_event(project, EventProjectUsersChanged);
+    }
+    if (project->command_list_dirty) {
+        project->command_list_dirty = false;
+        trigger_event(project, EventProjectCommandsChanged);
+    }
+    if (project->audio_asset_list_dirty) {
+        project->audio_asset_list_dirty = false;
+        trigger_event(project, EventProjectAudioAssetsChanged);
+    }
+    if (project->audio_clip_list_dirty) {
+        project->audio_clip_list_dirty = false;
+        trigger_event(project, EventProjectAudioClipsChanged);
+    }
+    if (project->mixer_line_list_dirty) {
+        project->mixer_line_list_dirty = false;
+        trigger_event(project, EventProjectMixerLinesChanged);
+    }
+    if (project->audio_clip_segments_dirty) {
+        project->audio_clip_segments_dirty = false;
+        trigger_event(project, EventProjectAudioClipSegmentsChanged);
+    }
+    if (project->effects_dirty) {
+        project->effects_dirty = false;
+        trigger_event(project, EventProjectEffectsChanged);
+    }
+}
+
+int project_get_next_revision(Project *project) {
+    if (project->command_list.length() == 0)
+        return 0;
 
     Command *last_command = project->command_list.at(project->command_list.length() - 1);
     return last_command->revision + 1;
 }
 
-static OrderedMapFileBuffer *create_undo_stack_key(int index) {
-    OrderedMapFileBuffer *buf = ok_mem(ordered_map_file_buffer_create(PROP_KEY_SIZE + PROP_KEY_SIZE + 4));
-    write_uint32be(&buf->data[0], PropKeyUndoStack);
-    write_uint32be(&buf->data[4], PropKeyDelimiter);
-    write_uint32be(&buf->data[8], index);
-    return buf;
+static ProjectKey create_undo_stack_key(int index) {
+    ProjectKey key;
+    key.size = PROP_KEY_SIZE + PROP_KEY_SIZE + 4;
+    write_uint32be(&key.data[0], PropKeyUndoStack);
+    write_uint32be(&key.data[4], PropKeyDelimiter);
+    write_uint32be(&key.data[8], index);
+    return key;
 }
 
-static OrderedMapFileBuffer *create_id_key(PropKey prop_key, const uint256 &id) {
-    OrderedMapFileBuffer *buf = ok_mem(ordered_map_file_buffer_create(PROP_KEY_SIZE + PROP_KEY_SIZE + UINT256_SIZE));
-    write_uint32be(&buf->data[0], prop_key);
-    write_uint32be(&buf->data[4], PropKeyDelimiter);
-    id.write_be(&buf->data[8]);
-    return buf;
+static ProjectKey create_command_log_key(int revision) {
+    ProjectKey key;
+    key.size = PROP_KEY_SIZE + PROP_KEY_SIZE + 4;
+    write_uint32be(&key.data[0], PropKeyCommandLog);
+    write_uint32be(&key.data[4], PropKeyDelimiter);
+    write_uint32be(&key.data[8], revision);
+    return key;
 }
 
-static OrderedMapFileBuffer *create_effect_key(const uint256 &id) {
+static ProjectKey create_id_key(PropKey prop_key, const uint256 &id) {
+    ProjectKey key;
+    key.size = PROP_KEY_SIZE + PROP_KEY_SIZE + UINT256_SIZE;
+    write_uint32be(&key.data[0], prop_key);
+    write_uint32be(&key.data[4], PropKeyDelimiter);
+    id.write_be(&key.data[8]);
+    return key;
+}
+
+static ProjectKey create_effect_key(const uint256 &id) {
     return create_id_key(PropKeyEffect, id);
 }
 
-static OrderedMapFileBuffer *create_mixer_line_key(const uint256 &id) {
+static ProjectKey create_mixer_line_key(const uint256 &id) {
     return create_id_key(PropKeyMixerLine, id);
 }
 
-static OrderedMapFileBuffer *create_user_key(const uint256 &id) {
+static ProjectKey create_user_key(const uint256 &id) {
     return create_id_key(PropKeyUser, id);
 }
 
-static OrderedMapFileBuffer *create_track_key(const uint256 &id) {
+static ProjectKey create_track_key(const uint256 &id) {
     return create_id_key(PropKeyTrack, id);
 }
 
-static OrderedMapFileBuffer *create_command_key(const uint256 &id) {
+static ProjectKey create_command_key(const uint256 &id) {
     return create_id_key(PropKeyCommand, id);
 }
 
-static OrderedMapFileBuffer *create_basic_key(PropKey prop_key) {
-    OrderedMapFileBuffer *buf = ok_mem(ordered_map_file_buffer_create(4));
-    write_uint32be(buf->data, prop_key);
-    return buf;
+static ProjectKey create_basic_key(PropKey prop_key) {
+    ProjectKey key;
+    key.size = PROP_KEY_SIZE;
+    write_uint32be(key.data, prop_key);
+    return key;
 }
 
 static int object_key_to_id(const ByteBuffer &key, uint256 *out_id) {
@@ -1454,7 +1882,9 @@ static int list_key_to_index(const ByteBuffer &key, int *out_index) {
     return 0;
 }
 
-static int deserialize_track_decoded_key(Project *project, const uint256 &id, const ByteBuffer &value) {
+static int parse_track_decoded_key(Project *project, const uint256 &id, const ByteBuffer &value,
+        Track **out_track)
+{
     Track *track = create_zero<Track>();
     if (!track)
         return GenesisErrorNoMem;
@@ -1468,22 +1898,33 @@ static int deserialize_track_decoded_key(Project *project, const uint256 &id, co
         return err;
     }
 
+    *out_track = track;
+    return 0;
+}
+
+static void add_track(Project *project, Track *track) {
     project->tracks.put(track->id, track);
     project->track_list_dirty = true;
+}
 
+static int deserialize_track_decoded_key(Project *project, const uint256 &id, const ByteBuffer &value) {
+    Track *track;
+    int err;
+    if ((err = parse_track_decoded_key(project, id, value, &track)))
+        return err;
+    add_track(project, track);
     return 0;
-
 }
 
-static int deserialize_track(Project *project, const ByteBuffer &key, const ByteBuffer &value) {
+static int parse_track(Project *project, const ByteBuffer &key, const ByteBuffer &value, Track **out_track) {
     uint256 track_id;
     int err = object_key_to_id(key, &track_id);
     if (err)
         return err;
-    return deserialize_track_decoded_key(project, track_id, value);
+    return parse_track_decoded_key(project, track_id, value, out_track);
 }
 
-static int deserialize_user(Project *project, const ByteBuffer &key, const ByteBuffer &value) {
+static int parse_user(Project *project, const ByteBuffer &key, const ByteBuffer &value, User **out_user) {
     User *user = create_zero<User>();
     if (!user)
         return GenesisErrorNoMem;
@@ -1500,10 +1941,13 @@ static int deserialize_user(Project *project, const ByteBuffer &key, const ByteB
         return err;
     }
 
+    *out_user = user;
+    return 0;
+}
+
+static void add_user(Project *project, User *user) {
     project->users.put(user->id, user);
     project->user_list_dirty = true;
-
-    return 0;
 }
 
 static void project_put_audio_asset(Project *project, AudioAsset *audio_asset) {
@@ -1512,7 +1956,9 @@ static void project_put_audio_asset(Project *project, AudioAsset *audio_asset) {
     project->audio_asset_list_dirty = true;
 }
 
-static int deserialize_audio_asset(Project *project, const ByteBuffer &key, const ByteBuffer &value) {
+static int parse_audio_asset(Project *project, const ByteBuffer &key, const ByteBuffer &value,
+        AudioAsset **out_audio_asset)
+{
     AudioAsset *audio_asset = create_zero<AudioAsset>();
     if (!audio_asset)
         return GenesisErrorNoMem;
@@ -1529,8 +1975,7 @@ static int deserialize_audio_asset(Project *project, const ByteBuffer &key, cons
         return err;
     }
 
-    project_put_audio_asset(project, audio_asset);
-
+    *out_audio_asset = audio_asset;
     return 0;
 }
 
@@ -1538,7 +1983,9 @@ static void destroy_audio_clip(Project *project, AudioClip *audio_clip) {
     destroy(audio_clip, 1);
 }
 
-static int deserialize_audio_clip(Project *project, const ByteBuffer &key, const ByteBuffer &value) {
+static int parse_audio_clip(Project *project, const ByteBuffer &key, const ByteBuffer &value,
+        AudioClip **out_audio_clip)
+{
     AudioClip *audio_clip = create_zero<AudioClip>();
     if (!audio_clip)
         return GenesisErrorNoMem;
@@ -1562,13 +2009,18 @@ static int deserialize_audio_clip(Project *project, const ByteBuffer &key, const
     }
     audio_clip->audio_asset = audio_asset_entry->value;
 
+    *out_audio_clip = audio_clip;
+    return 0;
+}
+
+static void add_audio_clip(Project *project, AudioClip *audio_clip) {
     project->audio_clips.put(audio_clip->id, audio_clip);
     project->audio_clip_list_dirty = true;
-
-    return 0;
 }
 
-static int deserialize_audio_clip_segment(Project *project, const ByteBuffer &key, const ByteBuffer &value) {
+static int parse_audio_clip_segment(Project *project, const ByteBuffer &key, const ByteBuffer &value,
+        AudioClipSegment **out_segment)
+{
     AudioClipSegment *segment = create_zero<AudioClipSegment>();
     if (!segment)
         return GenesisErrorNoMem;
@@ -1599,13 +2051,18 @@ static int deserialize_audio_clip_segment(Project *project, const ByteBuffer &ke
     }
     segment->track = track_entry->value;
 
+    *out_segment = segment;
+    return 0;
+}
+
+static void add_audio_clip_segment(Project *project, AudioClipSegment *segment) {
     project->audio_clip_segments.put(segment->id, segment);
     project->audio_clip_segments_dirty = true;
-
-    return 0;
 }
 
-static int deserialize_mixer_line(Project *project, const ByteBuffer &key, const ByteBuffer &value) {
+static int parse_mixer_line(Project *project, const ByteBuffer &key, const ByteBuffer &value,
+        MixerLine **out_mixer_line)
+{
     MixerLine *mixer_line = create_zero<MixerLine>();
     if (!mixer_line)
         return GenesisErrorNoMem;
@@ -1622,13 +2079,16 @@ static int deserialize_mixer_line(Project *project, const ByteBuffer &key, const
         return err;
     }
 
+    *out_mixer_line = mixer_line;
+    return 0;
+}
+
+static void add_mixer_line(Project *project, MixerLine *mixer_line) {
     project->mixer_lines.put(mixer_line->id, mixer_line);
     project->mixer_line_list_dirty = true;
-
-    return 0;
 }
 
-static int deserialize_effect(Project *project, const ByteBuffer &key, const ByteBuffer &value) {
+static int parse_effect(Project *project, const ByteBuffer &key, const ByteBuffer &value, Effect **out_effect) {
     Effect *effect = create_zero<Effect>();
     if (!effect)
         return GenesisErrorNoMem;
@@ -1652,13 +2112,16 @@ static int deserialize_effect(Project *project, const ByteBuffer &key, const Byt
     }
     effect->mixer_line = mixer_line_entry->value;
 
+    *out_effect = effect;
+    return 0;
+}
+
+static void add_effect(Project *project, Effect *effect) {
     project->effects.put(effect->id, effect);
     project->effects_dirty = true;
-
-    return 0;
 }
 
-static int deserialize_command(Project *project, const ByteBuffer &key, const ByteBuffer &buffer) {
+static int parse_command(Project *project, const ByteBuffer &key, const ByteBuffer &buffer, Command **out_command) {
     int offset_data = 0;
     int *offset = &offset_data;
     int err;
@@ -1713,6 +2176,15 @@ static int deserialize_command(Project *project, const ByteBuffer &key, const By
         case CommandTypeChangeChannelLayout:
             command = create_zero<ChangeChannelLayoutCommand>();
             break;
+        case CommandTypeMoveAudioClipSegment:
+            command = create_zero<MoveAudioClipSegmentCommand>();
+            break;
+        case CommandTypeSetAudioClipVoices:
+            command = create_zero<SetAudioClipVoicesCommand>();
+            break;
+        case CommandTypeSetAudioClipTimeStretch:
+            command = create_zero<SetAudioClipTimeStretchCommand>();
+            break;
         case CommandTypeUndo:
             command = create_zero<UndoCommand>();
             break;
@@ -1724,6 +2196,7 @@ static int deserialize_command(Project *project, const ByteBuffer &key, const By
         return GenesisErrorNoMem;
 
     command->project = project;
+    command->undo_index = -1;
 
     if ((err = object_key_to_id(key, &command->id))) {
         destroy(command, 1);
@@ -1736,14 +2209,19 @@ static int deserialize_command(Project *project, const ByteBuffer &key, const By
     }
 
     auto entry = project->users.maybe_get(command->user_id);
-    if (!entry)
+    if (!entry) {
+        destroy(command, 1);
         return GenesisErrorInvalidFormat;
+    }
     command->user = entry->value;
 
+    *out_command = command;
+    return 0;
+}
+
+static void add_command(Project *project, Command *command) {
     project->commands.put(command->id, command);
     project->command_list_dirty = true;
-
-    return 0;
 }
 
 static int deserialize_undo_stack_item(Project *project, const ByteBuffer &key, const ByteBuffer &buffer) {
@@ -1762,10 +2240,13 @@ static int deserialize_undo_stack_item(Project *project, const ByteBuffer &key,
 
     Command *command = entry->value;
 
-    if (project->undo_stack.resize(project->undo_stack.length() + 1))
+    if (project->undo_stack.add_one())
         return GenesisErrorNoMem;
 
-    project->undo_stack.at(project->undo_stack.length() - 1) = command;
+    UndoStackEntry *undo_entry = &project->undo_stack.last();
+    undo_entry->command_id = command->id;
+    undo_entry->command = command;
+    command->undo_index = project->undo_stack.length() - 1;
 
     return 0;
 }
@@ -1851,6 +2332,92 @@ static int read_scalar_uint32be_as_int(Project *project, PropKey prop_key, int *
     return 0;
 }
 
+// a kind of object is parsed on more than one thread when it has at least
+// this many keys per thread
+static const int PARALLEL_LOAD_MIN_KEYS = 1024;
+static const int MAX_LOAD_THREADS = 64;
+
+template<typename T>
+struct LoadJob {
+    Project *project;
+    int (*parse)(Project *, const ByteBuffer &, const ByteBuffer &, T **);
+    int start;
+    int end;
+    List<T *> objects;
+    int err;
+};
+
+// parsing only reads the project, such as to look up the objects of the
+// kinds loaded before
+template<typename T>
+static void run_load_job(void *userdata) {
+    LoadJob<T> *job = (LoadJob<T> *)userdata;
+    job->err = 0;
+    ByteBuffer *key;
+    ByteBuffer value;
+    for (int index = job->start; index < job->end; index += 1) {
+        if ((job->err = ordered_map_file_get(job->project->omf, index, &key, value)))
+            return;
+        T *obj;
+        if ((job->err = job->parse(job->project, *key, value, &obj)))
+            return;
+        ok_or_panic(job->objects.append(obj));
+    }
+}
+
+// parses every object with prop_key on a pool of threads, then adds them to
+// the project on this thread in key order
+template<typename T>
+static int load_prefix(Project *project, PropKey prop_key,
+        int (*parse)(Project *, const ByteBuffer &, const ByteBuffer &, T **),
+        void (*add)(Project *, T *))
+{
+    ByteBuffer start_key;
+    start_key.append_uint32be(prop_key);
+    start_key.append_uint32be(PropKeyDelimiter);
+    ByteBuffer end_key;
+    end_key.append_uint32be(prop_key);
+    end_key.append_uint32be(PropKeyDelimiter + 1);
+    int start = ordered_map_file_lower_bound(project->omf, start_key);
+    int key_count = ordered_map_file_lower_bound(project->omf, end_key) - start;
+    int thread_count = max(1, min(min(os_concurrency(), key_count / PARALLEL_LOAD_MIN_KEYS), MAX_LOAD_THREADS));
+
+    LoadJob<T> jobs[MAX_LOAD_THREADS];
+    OsThread *threads[MAX_LOAD_THREADS];
+    for (int t = 0; t < thread_count; t += 1) {
+        LoadJob<T> *job = &jobs[t];
+        job->project = project;
+        job->parse = parse;
+        job->start = start + (long)key_count * t / thread_count;
+        job->end = start + (long)key_count * (t + 1) / thread_count;
+        threads[t] = nullptr;
+        if (t > 0 && os_thread_create(run_load_job<T>, job, false, &threads[t]))
+            threads[t] = nullptr;
+    }
+    for (int t = 0; t < thread_count; t += 1) {
+        // the first job, and any without a thread, run here
+        if (!threads[t])
+            run_load_job<T>(&jobs[t]);
+    }
+    for (int t = 0; t < thread_count; t += 1)
+        os_thread_destroy(threads[t]);
+
+    // like a serial load, the objects before the first error are added
+    int err = 0;
+    for (int t = 0; t < thread_count; t += 1) {
+        LoadJob<T> *job = &jobs[t];
+        for (int i = 0; i < job->objects.length(); i += 1) {
+            if (err)
+                destroy(job->objects.at(i), 1);
+            else
+                add(project, job->objects.at(i));
+        }
+        if (!err)
+            err = job->err;
+    }
+    return err;
+}
+
 static int iterate_prefix(Project *project, PropKey prop_key,
         int (*got_one)(Project *, const ByteBuffer &, const ByteBuffer &))
 {
@@ -1885,6 +2452,50 @@ static void project_push_command(Project *project, Command *command) {
     project->commands.put(command->id, command);
 }
 
+// the command an undo or redo refers to and its id, or nullptr for any
+// other command
+static Command **other_command_of(Command *command, uint256 **out_other_id) {
+    if (command->command_type() == CommandTypeUndo) {
+        UndoCommand *undo = (UndoCommand *)command;
+        *out_other_id = &undo->other_command_id;
+        return &undo->other_command;
+    } else if (command->command_type() == CommandTypeRedo) {
+        RedoCommand *redo = (RedoCommand *)command;
+        *out_other_id = &redo->other_command_id;
+        return &redo->other_command;
+    }
+    return nullptr;
+}
+
+// the command log keeps a row for every revision, which is never deleted,
+// so that other copies of the project can be brought up to date. a row is
+// the command id, the user id, the command and, for an undo or redo, the
+// command it refers to, which the other copy may not have in memory.
+static void put_command_log_row(OrderedMapFileBatch *batch, Command *command) {
+    ProjectKey key = create_command_log_key(command->revision);
+    ByteBuffer *buf = ordered_map_file_batch_begin_put(batch, key.data, key.size);
+    serialize_uint256(*buf, command->id);
+    serialize_uint256(*buf, command->user_id);
+    ByteBuffer encoded;
+    serialize_object(command, encoded);
+    buf->append_uint32be(encoded.length());
+    buf->append(encoded);
+    uint256 *other_id;
+    Command **other = other_command_of(command, &other_id);
+    encoded.clear();
+    if (other && *other)
+        serialize_object(*other, encoded);
+    buf->append_uint32be(encoded.length());
+    buf->append(encoded);
+    ordered_map_file_batch_end_put(batch);
+}
+
+// puts a command which was performed or rewritten, and its log row
+static void put_command(OrderedMapFileBatch *batch, Command *command) {
+    omf_put_obj(batch, create_command_key(command->id), command);
+    put_command_log_row(batch, command);
+}
+
 int project_open(GenesisContext *genesis_context, const char *path, User *user,
         Project **out_project)
 {
@@ -1900,11 +2511,15 @@ int project_open(GenesisContext *genesis_context, const char *path, User *user,
     project->path = path;
     project->active_user = user;
 
+    double start_time = os_get_time();
     int err = ordered_map_file_open(path, &project->omf);
     if (err) {
         project_close(project);
         return err;
     }
+    ordered_map_file_set_compression(project->omf, true);
+    double omf_open_time = os_get_time();
+    project->open_stats.omf_open_seconds = omf_open_time - start_time;
 
     err = read_scalar_uint256(project, PropKeyProjectId, &project->id);
     if (err) {
@@ -1948,54 +2563,54 @@ int project_open(GenesisContext *genesis_context, const char *path, User *user,
     }
 
     // read tracks
-    err = iterate_prefix(project, PropKeyTrack, deserialize_track);
+    err = load_prefix(project, PropKeyTrack, parse_track, add_track);
     if (err) {
         project_close(project);
         return err;
     }
 
     // read users
-    err = iterate_prefix(project, PropKeyUser, deserialize_user);
+    err = load_prefix(project, PropKeyUser, parse_user, add_user);
     if (err) {
         project_close(project);
         return err;
     }
 
     // read audio assets
-    err = iterate_prefix(project, PropKeyAudioAsset, deserialize_audio_asset);
+    err = load_prefix(project, PropKeyAudioAsset, parse_audio_asset, project_put_audio_asset);
     if (err) {
         project_close(project);
         return err;
     }
 
     // read audio clips (depends on audio assets)
-    err = iterate_prefix(project, PropKeyAudioClip, deserialize_audio_clip);
+    err = load_prefix(project, PropKeyAudioClip, parse_audio_clip, add_audio_clip);
     if (err) {
         project_close(project);
         return err;
     }
 
     // read audio clip segments (depends on audio clips)
-    err = iterate_prefix(project, PropKeyAudioClipSegment, deserialize_audio_clip_segment);
+    err = load_prefix(project, PropKeyAudioClipSegment, parse_audio_clip_segment, add_audio_clip_segment);
     if (err) {
         project_close(project);
         return err;
     }
 
     // read mixer lines
-    if ((err = iterate_prefix(project, PropKeyMixerLine, deserialize_mixer_line))) {
+    if ((err = load_prefix(project, PropKeyMixerLine, parse_mixer_line, add_mixer_line))) {
         project_close(project);
         return err;
     }
 
     // read effects (depends on mixer lines)
-    if ((err = iterate_prefix(project, PropKeyEffect, deserialize_effect))) {
+    if ((err = load_prefix(project, PropKeyEffect, parse_effect, add_effect))) {
         project_close(project);
         return err;
     }
 
     // read command history (depends on users)
-    err = iterate_prefix(project, PropKeyCommand, deserialize_command);
+    err = load_prefix(project, PropKeyCommand, parse_command, add_command);
     if (err) {
         project_close(project);
         return err;
@@ -2019,9 +2634,31 @@ int project_open(GenesisContext *genesis_context, const char *path, User *user,
         return GenesisErrorInvalidFormat;
     }
 
-    project_compute_indexes(project);
+    double deserialize_time = os_get_time();
+    project->open_stats.deserialize_seconds = deserialize_time - omf_open_time;
+    project_sort_indexes(project);
+    project->open_stats.index_seconds = os_get_time() - deserialize_time;
     ordered_map_file_done_reading(project->omf);
 
+    // the active user may not have edited this copy before, and their
+    // commands can not be read back without them
+    if (!project->users.maybe_get(user->id)) {
+        add_user(project, user);
+        index_add_user(project, user);
+        OrderedMapFileBatch *batch = ok_mem(ordered_map_file_batch_create(project->omf));
+        omf_put_obj(batch, create_user_key(user->id), user);
+        ok_or_panic(ordered_map_file_batch_exec(batch));
+    }
+    // pages out and cuts back what an older session left
+    project_set_undo_limits(project, DEFAULT_UNDO_RESIDENT_COUNT, DEFAULT_UNDO_MAX_COUNT);
+    project_trigger_list_events(project);
+
+    err = project_load_audio_assets_async(project);
+    if (err) {
+        project_close(project);
+        return err;
+    }
+
     *out_project = project;
     return 0;
 }
@@ -2072,63 +2709,58 @@ int project_create(GenesisContext *genesis_context, const char *path, const uint
         project_close(project);
         return err;
     }
+    ordered_map_file_set_compression(project->omf, true);
     ordered_map_file_done_reading(project->omf);
 
     project->id = id;
     project->path = path;
     project->active_user = user;
+    project->undo_resident_count = DEFAULT_UNDO_RESIDENT_COUNT;
+    project->undo_max_count = DEFAULT_UNDO_MAX_COUNT;
 
     OrderedMapFileBatch *batch = ok_mem(ordered_map_file_batch_create(project->omf));
 
     project->users.put(user->id, user);
-    project->user_list_dirty = true;
-    ok_or_panic(ordered_map_file_batch_put(batch, create_user_key(user->id), omf_buf_obj(user)));
+    index_add_user(project, user);
+    omf_put_obj(batch, create_user_key(user->id), user);
 
-    ok_or_panic(ordered_map_file_batch_put(batch, create_basic_key(PropKeyProjectId), omf_buf_uint256(project->id)));
-    ok_or_panic(ordered_map_file_batch_put(batch, create_basic_key(PropKeyUndoStackIndex),
-            omf_buf_uint32(project->undo_stack_index)));
+    omf_put_uint256(batch, create_basic_key(PropKeyProjectId), project->id);
+    omf_put_uint32(batch, create_basic_key(PropKeyUndoStackIndex), project->undo_stack_index);
 
     AddTrackCommand *add_track_cmd = project_insert_track_batch(project, batch, nullptr, nullptr);
     project_push_command(project, add_track_cmd);
+    put_command(batch, add_track_cmd);
 
     // Add master mixer line.
     MixerLine *mixer_line = mixer_line_create("Master");
     project->mixer_lines.put(mixer_line->id, mixer_line);
-    project->mixer_line_list_dirty = true;
-    ok_or_panic(ordered_map_file_batch_put(batch, create_mixer_line_key(mixer_line->id),
-                omf_buf_obj(mixer_line)));
+    index_add_mixer_line(project, mixer_line);
+    omf_put_obj(batch, create_mixer_line_key(mixer_line->id), mixer_line);
     Effect *master_send = create_default_master_send(mixer_line);
     project->effects.put(master_send->id, master_send);
-    project->effects_dirty = true;
-    ok_or_panic(ordered_map_file_batch_put(batch, create_effect_key(master_send->id), omf_buf_obj(master_send)));
+    index_add_effect(project, master_send);
+    omf_put_obj(batch, create_effect_key(master_send->id), master_send);
 
 
     // Add default sample rate
     project->sample_rate = 44100;
-    ok_or_panic(ordered_map_file_batch_put(batch, create_basic_key(PropKeySampleRate),
-                omf_buf_uint32(project->sample_rate)));
+    omf_put_uint32(batch, create_basic_key(PropKeySampleRate), project->sample_rate);
 
     // Add default channel layout
     project->channel_layout = *soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdStereo);
-    ok_or_panic(ordered_map_file_batch_put(batch, create_basic_key(PropKeyChannelLayout),
-                omf_buf_channel_layout(&project->channel_layout)));
+    omf_put_channel_layout(batch, create_basic_key(PropKeyChannelLayout), &project->channel_layout);
 
     // Add default project tags
     project->tag_title = "";
-    ok_or_panic(ordered_map_file_batch_put(batch, create_basic_key(PropKeyTagTitle),
-                omf_buf_string(project->tag_title)));
+    omf_put_string(batch, create_basic_key(PropKeyTagTitle), project->tag_title);
     project->tag_artist = user->name;
-    ok_or_panic(ordered_map_file_batch_put(batch, create_basic_key(PropKeyTagArtist),
-                omf_buf_string(project->tag_artist)));
+    omf_put_string(batch, create_basic_key(PropKeyTagArtist), project->tag_artist);
     project->tag_album_artist = user->name;
-    ok_or_panic(ordered_map_file_batch_put(batch, create_basic_key(PropKeyTagAlbumArtist),
-                omf_buf_string(project->tag_album_artist)));
+    omf_put_string(batch, create_basic_key(PropKeyTagAlbumArtist), project->tag_album_artist);
     project->tag_album = "";
-    ok_or_panic(ordered_map_file_batch_put(batch, create_basic_key(PropKeyTagAlbum),
-                omf_buf_string(project->tag_album)));
+    omf_put_string(batch, create_basic_key(PropKeyTagAlbum), project->tag_album);
     project->tag_year = os_get_current_year();
-    ok_or_panic(ordered_map_file_batch_put(batch, create_basic_key(PropKeyTagYear),
-                omf_buf_uint32(project->tag_year)));
+    omf_put_uint32(batch, create_basic_key(PropKeyTagYear), project->tag_year);
 
 
     err = ordered_map_file_batch_exec(batch);
@@ -2136,7 +2768,7 @@ int project_create(GenesisContext *genesis_context, const char *path, const uint
         project_close(project);
         return err;
     }
-    project_compute_indexes(project);
+    project_trigger_list_events(project);
 
     *out_project = project;
     return 0;
@@ -2146,6 +2778,7 @@ void project_close(Project *project) {
     if (!project)
         return;
 
+    stop_asset_loader(project);
     ordered_map_file_close(project->omf);
     for (int i = 0; i < project->command_list.length(); i += 1) {
         Command *cmd = project->command_list.at(i);
@@ -2171,35 +2804,206 @@ void project_close(Project *project) {
     destroy(project, 1);
 }
 
+// commands this close together can be merged into one
+static const double COMMAND_MERGE_SECONDS = 1.0;
+
 static void trigger_undo_changed(Project *project) {
     return trigger_event(project, EventProjectUndoChanged);
 }
 
+// a command which leaves the undo stack is never needed again. a resident
+// one is deleted from the file when trim_commands evicts it.
+static void drop_undo_entry(OrderedMapFileBatch *batch, UndoStackEntry *entry) {
+    if (entry->command)
+        entry->command->undo_index = -1;
+    else
+        omf_del(batch, create_command_key(entry->command_id));
+}
+
+static bool command_is_resident(Project *project, Command *command) {
+    if (command->undo_index < 0)
+        return false;
+    int distance = (command->undo_index < project->undo_stack_index) ?
+        (project->undo_stack_index - 1 - command->undo_index) :
+        (command->undo_index - project->undo_stack_index);
+    return distance < project->undo_resident_count;
+}
+
+// evicts the commands which are not near undo_stack_index. the last command
+// stays because the next revision comes from it. commands which are not on
+// the undo stack are deleted from the file as well.
+static void trim_commands(Project *project, OrderedMapFileBatch *batch) {
+    int old_length = project->command_list.length();
+    if (old_length == 0)
+        return;
+    Command *last_command = project->command_list.last();
+    int kept = 0;
+    for (int i = 0; i < old_length; i += 1) {
+        Command *cmd = project->command_list.at(i);
+        if (cmd == last_command || command_is_resident(project, cmd)) {
+            project->command_list.at(kept) = cmd;
+            kept += 1;
+            continue;
+        }
+        if (cmd->undo_index < 0)
+            omf_del(batch, create_command_key(cmd->id));
+        else
+            project->undo_stack.at(cmd->undo_index).command = nullptr;
+        project->commands.remove(cmd->id);
+        destroy(cmd, 1);
+    }
+    if (kept == old_length)
+        return;
+    ok_or_panic(project->command_list.resize(kept));
+    project->command_list_dirty = true;
+
+    // an undo or redo which stays must not point at a command which went
+    for (int i = 0; i < kept; i += 1) {
+        Command *cmd = project->command_list.at(i);
+        if (cmd->command_type() == CommandTypeUndo) {
+            UndoCommand *undo = (UndoCommand *)cmd;
+            if (!project->commands.maybe_get(undo->other_command_id))
+                undo->other_command = nullptr;
+        } else if (cmd->command_type() == CommandTypeRedo) {
+            RedoCommand *redo = (RedoCommand *)cmd;
+            if (!project->commands.maybe_get(redo->other_command_id))
+                redo->other_command = nullptr;
+        }
+    }
+}
+
+// drops the oldest undo steps once there are more than undo_max_count. it
+// cuts back a quarter further than that so that the undo stack keys, which
+// all move down, are only rewritten now and then.
+static void gc_undo_stack(Project *project, OrderedMapFileBatch *batch) {
+    int old_length = project->undo_stack.length();
+    if (old_length <= project->undo_max_count)
+        return;
+    int keep_count = project->undo_max_count - project->undo_max_count / 4;
+    int drop_count = min(old_length - keep_count, project->undo_stack_index);
+    if (drop_count <= 0)
+        return;
+
+    for (int i = 0; i < drop_count; i += 1)
+        drop_undo_entry(batch, &project->undo_stack.at(i));
+    project->undo_stack.remove_range(0, drop_count);
+    int new_length = project->undo_stack.length();
+    for (int i = 0; i < new_length; i += 1) {
+        UndoStackEntry *entry = &project->undo_stack.at(i);
+        if (entry->command)
+            entry->command->undo_index = i;
+        omf_put_uint256(batch, create_undo_stack_key(i), entry->command_id);
+    }
+    for (int i = new_length; i < old_length; i += 1)
+        omf_del(batch, create_undo_stack_key(i));
+    project->undo_stack_index -= drop_count;
+    omf_put_uint32(batch, create_basic_key(PropKeyUndoStackIndex), project->undo_stack_index);
+}
+
 static void add_undo_for_command(Project *project, OrderedMapFileBatch *batch, Command *command) {
+    // dels apply after puts in a batch, so the key at undo_stack_index,
+    // which is put again below, must not be deleted
     for (int i = project->undo_stack_index; i < project->undo_stack.length(); i += 1) {
-        ordered_map_file_batch_del(batch, create_undo_stack_key(i));
+        drop_undo_entry(batch, &project->undo_stack.at(i));
+        if (i > project->undo_stack_index)
+            omf_del(batch, create_undo_stack_key(i));
     }
     int this_undo_index = project->undo_stack_index;
     project->undo_stack_index += 1;
     ok_or_panic(project->undo_stack.resize(project->undo_stack_index));
-    project->undo_stack.at(this_undo_index) = command;
-    ok_or_panic(ordered_map_file_batch_put(batch, create_undo_stack_key(this_undo_index), omf_buf_uint256(command->id)));
-    ok_or_panic(ordered_map_file_batch_put(batch, create_basic_key(PropKeyUndoStackIndex),
-            omf_buf_uint32(project->undo_stack_index)));
+    UndoStackEntry *entry = &project->undo_stack.at(this_undo_index);
+    entry->command_id = command->id;
+    entry->command = command;
+    command->undo_index = this_undo_index;
+    omf_put_uint256(batch, create_undo_stack_key(this_undo_index), command->id);
+    omf_put_uint32(batch, create_basic_key(PropKeyUndoStackIndex), project->undo_stack_index);
+    gc_undo_stack(project, batch);
+}
+
+void project_set_undo_limits(Project *project, int resident_count, int max_count) {
+    assert(resident_count >= 1);
+    assert(max_count >= resident_count);
+    project->undo_resident_count = resident_count;
+    project->undo_max_count = max_count;
+
+    OrderedMapFileBatch *batch = ok_mem(ordered_map_file_batch_create(project->omf));
+    gc_undo_stack(project, batch);
+    trim_commands(project, batch);
+    ok_or_panic(ordered_map_file_batch_exec(batch));
+    project_trigger_list_events(project);
+    trigger_undo_changed(project);
+}
+
+Command *project_get_undo_command(Project *project, int index) {
+    UndoStackEntry *entry = &project->undo_stack.at(index);
+    if (entry->command)
+        return entry->command;
+
+    ProjectKey key = create_command_key(entry->command_id);
+    ByteBuffer key_buf(key.data, key.size);
+    ByteBuffer value;
+    int err = ordered_map_file_read(project->omf, key_buf, value);
+    if (err == GenesisErrorKeyNotFound) {
+        // the batch which put it may still be queued
+        ordered_map_file_flush(project->omf);
+        err = ordered_map_file_read(project->omf, key_buf, value);
+    }
+    ok_or_panic(err);
+
+    Command *command;
+    ok_or_panic(parse_command(project, key_buf, value, &command));
+    command->undo_index = index;
+    entry->command = command;
+    project->commands.put(command->id, command);
+    sorted_insert<Command *, compare_commands>(project->command_list, command);
+    project->command_list_dirty = true;
+    return command;
+}
+
+// the command on top of the undo stack, if it was the last one performed
+// and is recent enough that command may be merged into it
+static Command *mergeable_command(Project *project, Command *command) {
+    if (project->undo_stack_index == 0 || project->undo_stack_index != project->undo_stack.length())
+        return nullptr;
+    Command *prev = project->undo_stack.at(project->undo_stack_index - 1).command;
+    if (!prev || project->command_list.length() == 0 || project->command_list.last() != prev)
+        return nullptr;
+    if (prev->user != command->user || prev->perform_time <= 0.0 ||
+        os_get_time() - prev->perform_time > COMMAND_MERGE_SECONDS)
+    {
+        return nullptr;
+    }
+    return prev;
 }
 
 static void project_perform_command(Command *command) {
     Project *project = command->project;
     OrderedMapFileBatch *batch = ok_mem(ordered_map_file_batch_create(project->omf));
 
+    // the previous command is rewritten in place, with no new command or
+    // undo stack entry
+    Command *prev = mergeable_command(project, command);
+    if (prev && prev->merge(command)) {
+        project_perform_command_batch(project, batch, command);
+        prev->perform_time = os_get_time();
+        put_command(batch, prev);
+        project->command_log_rewrite_serial += 1;
+        ok_or_panic(ordered_map_file_batch_exec(batch));
+        destroy(command, 1);
+        project_trigger_list_events(project);
+        return;
+    }
+
     add_undo_for_command(project, batch, command);
 
     project_perform_command_batch(project, batch, command);
+    command->perform_time = os_get_time();
     project_push_command(project, command);
-    ok_or_panic(ordered_map_file_batch_put(batch, create_command_key(command->id), omf_buf_obj(command)));
+    put_command(batch, command);
+    trim_commands(project, batch);
 
     ok_or_panic(ordered_map_file_batch_exec(batch));
-    project_compute_indexes(project);
+    project_trigger_list_events(project);
     trigger_undo_changed(project);
 }
 
@@ -2222,10 +3026,11 @@ void project_insert_track(Project *project, const Track *before, const Track *af
 
     project_push_command(project, add_track_cmd);
 
-    ok_or_panic(ordered_map_file_batch_put(batch, create_command_key(add_track_cmd->id), omf_buf_obj((Command *)add_track_cmd)));
+    put_command(batch, add_track_cmd);
+    trim_commands(project, batch);
 
     ok_or_panic(ordered_map_file_batch_exec(batch));
-    project_compute_indexes(project);
+    project_trigger_list_events(project);
     trigger_undo_changed(project);
 }
 
@@ -2236,7 +3041,28 @@ AddTrackCommand *project_insert_track_batch(Project *project, OrderedMapFileBatc
     const SortKey *high_sort_key = after ? &after->sort_key : nullptr;
     SortKey sort_key = SortKey::single(low_sort_key, high_sort_key);
 
+    // spread all the keys out again rather than let them keep growing
+    ByteBuffer rebalance;
+    if (sort_key.is_long()) {
+        int new_index = 0;
+        while (new_index < project->track_list.length() &&
+                SortKey::compare(project->track_list.at(new_index)->sort_key, sort_key) < 0)
+        {
+            new_index += 1;
+        }
+        List<SortKey> sort_keys;
+        SortKey::rebalance(sort_keys, project->track_list.length() + 1);
+        for (int i = 0; i < project->track_list.length(); i += 1) {
+            Track *track = project->track_list.at(i);
+            serialize_uint256(rebalance, track->id);
+            track->sort_key.serialize(rebalance);
+            sort_keys.at((i < new_index) ? i : (i + 1)).serialize(rebalance);
+        }
+        sort_key = sort_keys.at(new_index);
+    }
+
     AddTrackCommand *add_track = create<AddTrackCommand>(project, "Untitled Track", sort_key);
+    add_track->rebalance = rebalance;
     project_perform_command_batch(project, batch, add_track);
 
     return add_track;
@@ -2247,70 +3073,716 @@ void project_delete_track(Project *project, Track *track) {
     project_perform_command(delete_track);
 }
 
-int project_ensure_audio_asset_loaded(Project *project, AudioAsset *audio_asset) {
-    if (audio_asset->audio_file)
-        return 0;
+static void get_cache_dir(Project *project, ByteBuffer &out_dir) {
+    const char *store_dir = genesis_asset_store_dir(project->genesis_context);
+    if (store_dir[0])
+        os_path_join(out_dir, store_dir, "decoded_cache");
+    else
+        os_path_join(out_dir, os_path_dirname(project->path), "decoded_cache");
+}
 
-    ByteBuffer project_dir = os_path_dirname(project->path);
-    ByteBuffer full_path;
-    os_path_join(full_path, project_dir, audio_asset->path);
-    return genesis_audio_file_load(project->genesis_context, full_path.raw(), &audio_asset->audio_file);
+void project_decoded_cache_path(Project *project, const ByteBuffer &digest,
+        ByteBuffer &out_dir, ByteBuffer &out_path)
+{
+    get_cache_dir(project, out_dir);
+    ByteBuffer file_name = digest.to_string();
+    file_name.append(".pcm");
+    os_path_join(out_path, out_dir, file_name);
 }
 
-int project_add_audio_asset(Project *project, const ByteBuffer &full_path, AudioAsset **out_audio_asset) {
-    *out_audio_asset = nullptr;
+// assets never change once added, so their decoded samples are kept next
+// to the project, or in the asset store, under the asset digest
+static void get_decoded_cache_path(Project *project, AudioAsset *audio_asset,
+        ByteBuffer &out_dir, ByteBuffer &out_path)
+{
+    project_decoded_cache_path(project, audio_asset->sha256sum, out_dir, out_path);
+}
 
-    ByteBuffer ext = os_path_extension(full_path);
-    ByteBuffer project_dir = os_path_dirname(project->path);
-    ByteBuffer prefix = os_path_basename(full_path);
-    os_path_remove_extension(prefix);
+// and their peaks with them
+static void get_peaks_cache_path(Project *project, AudioAsset *audio_asset, ByteBuffer &out_path) {
+    ByteBuffer cache_dir;
+    get_cache_dir(project, cache_dir);
+    ByteBuffer file_name = audio_asset->sha256sum.to_string();
+    file_name.append(".peaks");
+    os_path_join(out_path, cache_dir, file_name);
+}
 
-    int err;
-    ByteBuffer full_dest_asset_path;
-    Sha256Hasher hasher;
-    if ((err = os_copy_no_clobber(full_path.raw(), project_dir.raw(),
-                    prefix.raw(), ext.raw(), full_dest_asset_path, &hasher)))
+// peaks from the cache, if they are there and fit audio_file
+static bool read_cached_peaks(Project *project, AudioAsset *audio_asset,
+        GenesisAudioFile *audio_file, WaveformPeaks **out_peaks)
+{
+    ByteBuffer peaks_path;
+    get_peaks_cache_path(project, audio_asset, peaks_path);
+    if (waveform_peaks_read(peaks_path.raw(), out_peaks))
+        return false;
+    if ((*out_peaks)->channel_count != genesis_audio_file_channel_layout(audio_file)->channel_count ||
+        (*out_peaks)->frame_capacity != genesis_audio_file_frame_count(audio_file))
     {
-        return err;
+        waveform_peaks_destroy(*out_peaks);
+        *out_peaks = nullptr;
+        return false;
     }
-    ByteBuffer digest;
-    hasher.get_digest(digest);
+    return true;
+}
 
-    // see if we have an audio asset that matches this digest already
-    auto entry = project->audio_assets_by_digest.maybe_get(digest);
-    if (entry) {
-        // oops, this file is already in the project.
-        os_delete(full_dest_asset_path.raw());
-        *out_audio_asset = entry->value;
-        return GenesisErrorAlreadyExists;
+static void write_cached_peaks(Project *project, AudioAsset *audio_asset, const WaveformPeaks *peaks) {
+    ByteBuffer peaks_path;
+    get_peaks_cache_path(project, audio_asset, peaks_path);
+    int err;
+    if ((err = os_mkdirp(os_path_dirname(peaks_path))) ||
+        (err = waveform_peaks_write(peaks, peaks_path.raw())))
+    {
+        log_message(LogLevelError, "unable to cache peaks for %s: %s",
+                audio_asset->path.raw(), genesis_strerror(err));
     }
+}
 
-    AudioAsset *audio_asset = create_zero<AudioAsset>();
-    if (!audio_asset) {
-        os_delete(full_dest_asset_path.raw());
-        return GenesisErrorNoMem;
+// the peaks are made from the float samples, so this comes after them.
+// the asset is still usable as floats when there is no memory to convert it.
+static int finish_resident_audio_asset(Project *project, AudioAsset *audio_asset,
+        GenesisAudioFile *audio_file, WaveformPeaks **out_peaks)
+{
+    int err;
+    if (!read_cached_peaks(project, audio_asset, audio_file, out_peaks)) {
+        if ((err = waveform_peaks_create_from_audio_file(audio_file, out_peaks)))
+            return err;
+        write_cached_peaks(project, audio_asset, *out_peaks);
     }
-
-    audio_asset->id = uint256::random();
-    audio_asset->path = os_path_basename(full_dest_asset_path);
-    audio_asset->sha256sum = digest;
-
-    project_put_audio_asset(project, audio_asset);
-
-    // add to project file
-    OrderedMapFileBatch *batch = ok_mem(ordered_map_file_batch_create(project->omf));
-    ok_or_panic(ordered_map_file_batch_put(batch, create_id_key(PropKeyAudioAsset, audio_asset->id), omf_buf_obj(audio_asset)));
-    if ((err = ordered_map_file_batch_exec(batch))) {
-        destroy(audio_asset, 1);
-        os_delete(full_dest_asset_path.raw());
-        return err;
+    GenesisSampleStorage storage = genesis_default_sample_storage(project->genesis_context);
+    if ((err = genesis_audio_file_set_sample_storage(audio_file, storage))) {
+        log_message(LogLevelError, "unable to convert samples of %s: %s",
+                audio_asset->path.raw(), genesis_strerror(err));
     }
-    project_compute_indexes(project);
-
-    *out_audio_asset = audio_asset;
     return 0;
 }
 
+// reads only fields which do not change while the project is open, so the
+// asset loader threads call it too. the peaks of a streamed file come back
+// empty unless they were cached; build_streamed_peaks fills them in.
+static int load_audio_asset(Project *project, AudioAsset *audio_asset,
+        GenesisAudioFile **out_audio_file, WaveformPeaks **out_peaks)
+{
+    *out_peaks = nullptr;
+    ByteBuffer cache_dir;
+    ByteBuffer cache_path;
+    get_decoded_cache_path(project, audio_asset, cache_dir, cache_path);
+    int err;
+    if (!genesis_audio_file_map_decoded(project->genesis_context, cache_path.raw(), out_audio_file))
+        return finish_resident_audio_asset(project, audio_asset, *out_audio_file, out_peaks);
+
+    ByteBuffer project_dir = os_path_dirname(project->path);
+    ByteBuffer full_path;
+    os_path_join(full_path, project_dir, audio_asset->path);
+    if ((err = genesis_audio_file_open(project->genesis_context, full_path.raw(), out_audio_file)))
+        return err;
+
+    // streamed files were never decoded in full, so there is nothing to keep
+    if (genesis_audio_file_is_streamed(*out_audio_file)) {
+        if (read_cached_peaks(project, audio_asset, *out_audio_file, out_peaks))
+            return 0;
+        return waveform_peaks_create(genesis_audio_file_channel_layout(*out_audio_file)->channel_count,
+                genesis_audio_file_frame_count(*out_audio_file), out_peaks);
+    }
+    if ((err = os_mkdirp(cache_dir)) ||
+        (err = genesis_audio_file_write_decoded(*out_audio_file, cache_path.raw())))
+    {
+        log_message(LogLevelError, "unable to cache decoded audio for %s: %s",
+                audio_asset->path.raw(), genesis_strerror(err));
+    }
+    return finish_resident_audio_asset(project, audio_asset, *out_audio_file, out_peaks);
+}
+
+// one pass through a streamed file to fill in its peaks. queries see them
+// grow as it goes.
+static void build_streamed_peaks(Project *project, Job *job, AudioAsset *audio_asset,
+        GenesisAudioFile *audio_file, WaveformPeaks *peaks)
+{
+    GenesisAudioFileReader *reader;
+    int err;
+    if ((err = genesis_audio_file_reader_create(audio_file, &reader))) {
+        log_message(LogLevelError, "unable to read audio for waveform: %s", genesis_strerror(err));
+        return;
+    }
+    long frame_count = genesis_audio_file_frame_count(audio_file);
+    const float *channels[GENESIS_MAX_CHANNELS];
+    bool aborted = false;
+    long frame_index = 0;
+    while (frame_index < frame_count) {
+        int fill_count = genesis_audio_file_reader_fill_count(reader);
+        {
+            OsMutexLocker locker(project->asset_loader_mutex);
+            if (job_cancelled(job)) {
+                aborted = true;
+                break;
+            }
+            if (fill_count == 0) {
+                // the reader thread has nothing to wake us with
+                os_cond_timed_wait(project->asset_loader_cond, project->asset_loader_mutex, 0.005);
+                continue;
+            }
+        }
+        fill_count = min((long)fill_count, frame_count - frame_index);
+        for (int ch = 0; ch < peaks->channel_count; ch += 1)
+            channels[ch] = genesis_audio_file_reader_read_ptr(reader, ch);
+        waveform_peaks_add(peaks, channels, fill_count);
+        genesis_audio_file_reader_advance_read_ptr(reader, fill_count);
+        frame_index += fill_count;
+        job_set_progress(job, frame_index / (float)frame_count);
+    }
+    genesis_audio_file_reader_destroy(reader);
+    if (!aborted) {
+        waveform_peaks_finish(peaks);
+        write_cached_peaks(project, audio_asset, peaks);
+    }
+}
+
+// the mutex must be locked
+static void publish_decoded_asset(AudioAsset *audio_asset) {
+    if (!audio_asset->audio_file) {
+        audio_asset->audio_file = audio_asset->decoded_audio_file;
+        audio_asset->peaks = audio_asset->decoded_peaks;
+    }
+    audio_asset->decoded_audio_file = nullptr;
+    audio_asset->decoded_peaks = nullptr;
+}
+
+static void build_peaks_job_run(Job *job, void *userdata) {
+    Project *project = (Project *)userdata;
+    AssetPeaksJob peaks_job;
+    {
+        OsMutexLocker locker(project->asset_loader_mutex);
+        if (job_cancelled(job) || project->asset_peaks_queue.length() == 0)
+            return;
+        peaks_job = project->asset_peaks_queue.pop();
+    }
+    build_streamed_peaks(project, job, peaks_job.audio_asset, peaks_job.audio_file, peaks_job.peaks);
+}
+
+// the mutex must be locked. peaks only draw waveforms, so they wait behind
+// every asset that is still to decode.
+static int queue_streamed_peaks(Project *project, AudioAsset *audio_asset,
+        GenesisAudioFile *audio_file, WaveformPeaks *peaks)
+{
+    if (!genesis_audio_file_is_streamed(audio_file) || peaks->complete.load())
+        return 0;
+    int err;
+    if ((err = project->asset_peaks_queue.add_one()))
+        return err;
+    AssetPeaksJob *peaks_job = &project->asset_peaks_queue.last();
+    peaks_job->audio_asset = audio_asset;
+    peaks_job->audio_file = audio_file;
+    peaks_job->peaks = peaks;
+    if ((err = job_submit(project->asset_jobs, JobPriorityLow, build_peaks_job_run, project,
+                    nullptr, 0, nullptr)))
+    {
+        project->asset_peaks_queue.pop();
+        return err;
+    }
+    return 0;
+}
+
+// the mutex must be locked. streamed files get their peaks from a second
+// pass, after the asset is published.
+static void finish_decode(Project *project, AudioAsset *audio_asset,
+        GenesisAudioFile *audio_file, WaveformPeaks *peaks, int err)
+{
+    audio_asset->decoded_audio_file = audio_file;
+    audio_asset->decoded_peaks = peaks;
+    audio_asset->load_err = err;
+    audio_asset->load_state = AudioAssetLoadStateDecoded;
+    ok_or_panic(project->asset_load_done.append(audio_asset));
+    if (!err)
+        ok_or_panic(queue_streamed_peaks(project, audio_asset, audio_file, peaks));
+    // wakes project_ensure_audio_asset_loaded
+    os_cond_broadcast(project->asset_loader_cond, project->asset_loader_mutex);
+}
+
+// each job decodes whichever asset is next in the queue, since
+// project_ensure_audio_asset_loaded may have taken the one it was made for
+static void decode_asset_job_run(Job *job, void *userdata) {
+    Project *project = (Project *)userdata;
+    AudioAsset *audio_asset;
+    {
+        OsMutexLocker locker(project->asset_loader_mutex);
+        if (job_cancelled(job) || project->asset_load_queue.length() == 0)
+            return;
+        audio_asset = project->asset_load_queue.pop();
+        audio_asset->load_state = AudioAssetLoadStateDecoding;
+    }
+
+    GenesisAudioFile *audio_file = nullptr;
+    WaveformPeaks *peaks = nullptr;
+    int err = load_audio_asset(project, audio_asset, &audio_file, &peaks);
+
+    OsMutexLocker locker(project->asset_loader_mutex);
+    finish_decode(project, audio_asset, audio_file, peaks, err);
+    genesis_wakeup(project->genesis_context);
+}
+
+static int init_asset_loader(Project *project) {
+    if (project->asset_loader_mutex)
+        return 0;
+    if (!(project->asset_loader_mutex = os_mutex_create()))
+        return GenesisErrorNoMem;
+    if (!(project->asset_loader_cond = os_cond_create()))
+        return GenesisErrorNoMem;
+    return job_group_create(genesis_context_job_system(project->genesis_context), &project->events,
+            EventProjectAudioAssetLoadProgress, &project->asset_jobs);
+}
+
+static void stop_asset_loader(Project *project) {
+    if (!project->asset_loader_mutex)
+        return;
+
+    // the running jobs take the mutex, so this must not hold it
+    job_group_destroy(project->asset_jobs);
+    project->asset_jobs = nullptr;
+
+    for (int i = 0; i < project->asset_load_queue.length(); i += 1)
+        project->asset_load_queue.at(i)->load_state = AudioAssetLoadStateIdle;
+    project->asset_load_queue.clear();
+    for (int i = 0; i < project->asset_load_done.length(); i += 1) {
+        AudioAsset *audio_asset = project->asset_load_done.at(i);
+        publish_decoded_asset(audio_asset);
+        audio_asset->load_state = AudioAssetLoadStateIdle;
+    }
+    project->asset_load_done.clear();
+    // whatever peaks were not built stay incomplete
+    project->asset_peaks_queue.clear();
+
+    os_cond_destroy(project->asset_loader_cond);
+    project->asset_loader_cond = nullptr;
+    os_mutex_destroy(project->asset_loader_mutex);
+    project->asset_loader_mutex = nullptr;
+}
+
+static void touch_audio_asset(Project *project, AudioAsset *audio_asset) {
+    project->asset_use_serial += 1;
+    audio_asset->last_use = project->asset_use_serial;
+}
+
+static int compare_audio_asset_last_use(AudioAsset *a, AudioAsset *b) {
+    if (a->last_use < b->last_use)
+        return -1;
+    if (a->last_use > b->last_use)
+        return 1;
+    return 0;
+}
+
+static void evict_audio_asset(Project *project, AudioAsset *audio_asset) {
+    genesis_audio_file_destroy(audio_asset->audio_file);
+    waveform_peaks_destroy(audio_asset->peaks);
+    audio_asset->audio_file = nullptr;
+    audio_asset->peaks = nullptr;
+    project->asset_cache_stats.eviction_count += 1;
+}
+
+// streamed assets hold next to nothing, and their peaks may still be
+// building on a loader thread, so they stay
+static void trim_audio_asset_cache(Project *project, AudioAsset *keep) {
+    AudioAssetCacheStats *stats = &project->asset_cache_stats;
+    stats->budget_bytes = genesis_audio_asset_cache_bytes(project->genesis_context);
+    stats->resident_bytes = 0;
+    stats->loaded_count = 0;
+    for (int i = 0; i < project->audio_asset_list.length(); i += 1) {
+        AudioAsset *audio_asset = project->audio_asset_list.at(i);
+        audio_asset->evictable = false;
+        if (!audio_asset->audio_file)
+            continue;
+        stats->resident_bytes += genesis_audio_file_memory_bytes(audio_asset->audio_file);
+        stats->loaded_count += 1;
+        audio_asset->evictable = audio_asset != keep && audio_asset->pin_count == 0 &&
+            !genesis_audio_file_is_streamed(audio_asset->audio_file);
+    }
+    if (stats->resident_bytes <= stats->budget_bytes)
+        return;
+
+    for (int i = 0; i < project->audio_clip_list.length(); i += 1)
+        project->audio_clip_list.at(i)->audio_asset->evictable = false;
+
+    // the loader jobs only touch assets which are not idle
+    List<AudioAsset *> candidates;
+    if (project->asset_loader_mutex)
+        os_mutex_lock(project->asset_loader_mutex);
+    for (int i = 0; i < project->audio_asset_list.length(); i += 1) {
+        AudioAsset *audio_asset = project->audio_asset_list.at(i);
+        if (audio_asset->evictable && audio_asset->load_state == AudioAssetLoadStateIdle)
+            ok_or_panic(candidates.append(audio_asset));
+    }
+    if (project->asset_loader_mutex)
+        os_mutex_unlock(project->asset_loader_mutex);
+    candidates.sort<compare_audio_asset_last_use>();
+    for (int i = 0; i < candidates.length() && stats->resident_bytes > stats->budget_bytes; i += 1) {
+        AudioAsset *audio_asset = candidates.at(i);
+        stats->resident_bytes -= genesis_audio_file_memory_bytes(audio_asset->audio_file);
+        stats->loaded_count -= 1;
+        evict_audio_asset(project, audio_asset);
+    }
+}
+
+void project_pin_audio_asset(Project *project, AudioAsset *audio_asset) {
+    audio_asset->pin_count += 1;
+    touch_audio_asset(project, audio_asset);
+}
+
+void project_unpin_audio_asset(Project *project, AudioAsset *audio_asset) {
+    assert(audio_asset->pin_count > 0);
+    audio_asset->pin_count -= 1;
+    touch_audio_asset(project, audio_asset);
+    if (audio_asset->pin_count == 0)
+        trim_audio_asset_cache(project, nullptr);
+}
+
+void project_get_audio_asset_cache_stats(Project *project, AudioAssetCacheStats *out_stats) {
+    trim_audio_asset_cache(project, nullptr);
+    *out_stats = project->asset_cache_stats;
+}
+
+int project_load_audio_assets_async(Project *project) {
+    int err;
+    if ((err = init_asset_loader(project)))
+        return err;
+
+    OsMutexLocker locker(project->asset_loader_mutex);
+    // the jobs pop from the end, so queue in reverse to decode in order
+    for (int i = project->audio_asset_list.length() - 1; i >= 0; i -= 1) {
+        AudioAsset *audio_asset = project->audio_asset_list.at(i);
+        if (audio_asset->audio_file || audio_asset->load_state != AudioAssetLoadStateIdle)
+            continue;
+        if ((err = project->asset_load_queue.append(audio_asset)))
+            return err;
+        if ((err = job_submit(project->asset_jobs, JobPriorityNormal, decode_asset_job_run, project,
+                        nullptr, 0, nullptr)))
+        {
+            project->asset_load_queue.pop();
+            return err;
+        }
+        audio_asset->load_state = AudioAssetLoadStateQueued;
+        project->asset_load_total += 1;
+    }
+    return 0;
+}
+
+static void flush_asset_loads(Project *project) {
+    int done_count;
+    {
+        OsMutexLocker locker(project->asset_loader_mutex);
+        done_count = project->asset_load_done.length();
+        for (int i = 0; i < done_count; i += 1) {
+            AudioAsset *audio_asset = project->asset_load_done.at(i);
+            // project_ensure_audio_asset_loaded may have published it already
+            publish_decoded_asset(audio_asset);
+            audio_asset->load_state = AudioAssetLoadStateIdle;
+            if (audio_asset->load_err) {
+                log_message(LogLevelError, "unable to load audio asset %s: %s",
+                        audio_asset->path.raw(), genesis_strerror(audio_asset->load_err));
+            }
+        }
+        project->asset_load_done.clear();
+    }
+    if (done_count > 0)
+        trim_audio_asset_cache(project, nullptr);
+
+    // handlers may call back into the loader, so trigger without the lock
+    for (int i = 0; i < done_count; i += 1) {
+        project->asset_load_finished += 1;
+        trigger_event(project, EventProjectAudioAssetLoaded);
+    }
+}
+
+void project_flush_events(Project *project) {
+    if (project->asset_loader_mutex) {
+        flush_asset_loads(project);
+        job_group_flush_events(project->asset_jobs);
+    }
+    // deferred handlers see every change made since the last tick at once
+    project->events.flush_deferred();
+}
+
+void project_audio_asset_load_progress(Project *project, int *out_finished, int *out_total) {
+    *out_finished = project->asset_load_finished;
+    *out_total = project->asset_load_total;
+}
+
+static int load_audio_asset_now(Project *project, AudioAsset *audio_asset) {
+    int err;
+    if ((err = init_asset_loader(project)))
+        return err;
+
+    bool was_queued = false;
+    {
+        OsMutexLocker locker(project->asset_loader_mutex);
+        if (audio_asset->load_state == AudioAssetLoadStateQueued) {
+            // faster to decode it here than to wait behind the queue
+            for (int i = 0; i < project->asset_load_queue.length(); i += 1) {
+                if (project->asset_load_queue.at(i) == audio_asset) {
+                    project->asset_load_queue.remove_range(i, i + 1);
+                    break;
+                }
+            }
+            was_queued = true;
+        }
+        while (audio_asset->load_state == AudioAssetLoadStateDecoding)
+            os_cond_wait(project->asset_loader_cond, project->asset_loader_mutex);
+        if (audio_asset->load_state == AudioAssetLoadStateDecoded) {
+            // project_flush_events still counts it and triggers the event
+            publish_decoded_asset(audio_asset);
+            return audio_asset->load_err;
+        }
+        audio_asset->load_state = AudioAssetLoadStateDecoding;
+    }
+
+    GenesisAudioFile *audio_file = nullptr;
+    WaveformPeaks *peaks = nullptr;
+    err = load_audio_asset(project, audio_asset, &audio_file, &peaks);
+
+    OsMutexLocker locker(project->asset_loader_mutex);
+    if (was_queued) {
+        // still goes through the done list so that progress and the loaded
+        // event are reported the same way as from the loader jobs
+        finish_decode(project, audio_asset, audio_file, peaks, err);
+        publish_decoded_asset(audio_asset);
+        return err;
+    }
+    audio_asset->audio_file = audio_file;
+    audio_asset->peaks = peaks;
+    audio_asset->load_state = AudioAssetLoadStateIdle;
+    if (!err)
+        err = queue_streamed_peaks(project, audio_asset, audio_file, peaks);
+    return err;
+}
+
+int project_ensure_audio_asset_loaded(Project *project, AudioAsset *audio_asset) {
+    touch_audio_asset(project, audio_asset);
+    if (audio_asset->audio_file) {
+        project->asset_cache_stats.hit_count += 1;
+        return 0;
+    }
+    project->asset_cache_stats.miss_count += 1;
+    int err = load_audio_asset_now(project, audio_asset);
+    trim_audio_asset_cache(project, audio_asset);
+    return err;
+}
+
+// the store has one file for each digest, named by it, which every
+// project that imports the content links to. a file is copied in the first
+// time any project imports it.
+static int link_from_asset_store(const char *store_dir, const ByteBuffer &full_path,
+        const ByteBuffer &digest, const ByteBuffer &dest_dir, const ByteBuffer &prefix,
+        const ByteBuffer &ext, ByteBuffer &out_path)
+{
+    ByteBuffer files_dir;
+    os_path_join(files_dir, store_dir, "files");
+    ByteBuffer store_path;
+    os_path_join(store_path, files_dir, digest.to_string());
+
+    int err = os_link_no_clobber(store_path.raw(), dest_dir.raw(), prefix.raw(), ext.raw(), out_path);
+    if (err != GenesisErrorFileNotFound)
+        return err;
+
+    // copied under a name of its own first, so that the store never has
+    // part of a file under a digest. another import of the same content may
+    // get there first, which is just as good.
+    if ((err = os_mkdirp(files_dir)))
+        return err;
+    ByteBuffer tmp_path;
+    if ((err = os_copy_no_clobber(full_path.raw(), files_dir.raw(), "import", ".tmp", tmp_path, nullptr)))
+        return err;
+    err = os_hard_link(tmp_path.raw(), store_path.raw());
+    if (err == GenesisErrorUnimplemented) {
+        if ((err = os_rename_clobber(tmp_path.raw(), store_path.raw())))
+            os_delete(tmp_path.raw());
+    } else {
+        os_delete(tmp_path.raw());
+        if (err == GenesisErrorAlreadyExists)
+            err = 0;
+    }
+    if (err)
+        return err;
+    return os_link_no_clobber(store_path.raw(), dest_dir.raw(), prefix.raw(), ext.raw(), out_path);
+}
+
+// copies or links full_path into the project directory, unless the
+// project already has its content, in which case out_existing is set and
+// nothing is copied. only reads the project, so several threads may import
+// at once.
+static int import_audio_file(Project *project, const char *store_dir, const ByteBuffer &full_path,
+        ByteBuffer &out_dest_path, ByteBuffer &out_digest, AudioAsset **out_existing)
+{
+    *out_existing = nullptr;
+
+    ByteBuffer ext = os_path_extension(full_path);
+    ByteBuffer project_dir = os_path_dirname(project->path);
+    ByteBuffer prefix = os_path_basename(full_path);
+    os_path_remove_extension(prefix);
+
+    int err;
+    Sha256Hasher hasher;
+    if (store_dir[0]) {
+        // hashed first, since content already in the store is not copied
+        if ((err = os_hash_file(full_path.raw(), &hasher)))
+            return err;
+        hasher.get_digest(out_digest);
+        auto entry = project->audio_assets_by_digest.maybe_get(out_digest);
+        if (entry) {
+            *out_existing = entry->value;
+            return GenesisErrorAlreadyExists;
+        }
+        return link_from_asset_store(store_dir, full_path, out_digest, project_dir,
+                prefix, ext, out_dest_path);
+    }
+
+    if ((err = os_copy_no_clobber(full_path.raw(), project_dir.raw(),
+                    prefix.raw(), ext.raw(), out_dest_path, &hasher)))
+    {
+        return err;
+    }
+    hasher.get_digest(out_digest);
+
+    // see if we have an audio asset that matches this digest already
+    auto entry = project->audio_assets_by_digest.maybe_get(out_digest);
+    if (entry) {
+        // oops, this file is already in the project.
+        os_delete(out_dest_path.raw());
+        *out_existing = entry->value;
+        return GenesisErrorAlreadyExists;
+    }
+    return 0;
+}
+
+static const int MAX_IMPORT_THREADS = 16;
+
+struct AudioFileImport {
+    const ByteBuffer *full_path;
+    ByteBuffer dest_path;
+    ByteBuffer digest;
+    AudioAsset *audio_asset;
+    int err;
+};
+
+struct AudioFileImportJob {
+    Project *project;
+    const char *store_dir;
+    AudioFileImport *imports;
+    int import_count;
+    atomic_int next_index;
+};
+
+// files differ in size, so each thread takes the next one as it finishes
+static void run_import_job(void *userdata) {
+    AudioFileImportJob *job = (AudioFileImportJob *)userdata;
+    for (;;) {
+        int index = job->next_index.fetch_add(1);
+        if (index >= job->import_count)
+            return;
+        AudioFileImport *import = &job->imports[index];
+        import->err = import_audio_file(job->project, job->store_dir, *import->full_path,
+                import->dest_path, import->digest, &import->audio_asset);
+    }
+}
+
+int project_add_audio_assets(Project *project, const List<ByteBuffer> &full_paths,
+        List<AudioAsset *> &out_audio_assets, List<int> &out_errors)
+{
+    int count = full_paths.length();
+    if (out_audio_assets.resize(count) || out_errors.resize(count))
+        return GenesisErrorNoMem;
+    if (count == 0)
+        return 0;
+
+    AudioFileImport *imports = allocate_class<AudioFileImport>(count);
+    for (int i = 0; i < count; i += 1) {
+        imports[i].full_path = &full_paths.at(i);
+        imports[i].audio_asset = nullptr;
+        imports[i].err = 0;
+    }
+
+    AudioFileImportJob job;
+    job.project = project;
+    job.store_dir = genesis_asset_store_dir(project->genesis_context);
+    job.imports = imports;
+    job.import_count = count;
+    job.next_index.store(0);
+    int thread_count = min(min(os_concurrency(), count), MAX_IMPORT_THREADS);
+    OsThread *threads[MAX_IMPORT_THREADS];
+    for (int t = 1; t < thread_count; t += 1) {
+        if (os_thread_create(run_import_job, &job, false, &threads[t]))
+            threads[t] = nullptr;
+    }
+    run_import_job(&job);
+    for (int t = 1; t < thread_count; t += 1)
+        os_thread_destroy(threads[t]);
+
+    // the same content twice in one import becomes one asset, as if the
+    // files had been added one at a time
+    FlatHashMap<ByteBuffer, AudioAsset *, ByteBuffer::hash> added_by_digest;
+    OrderedMapFileBatch *batch = ok_mem(ordered_map_file_batch_create(project->omf));
+    for (int i = 0; i < count; i += 1) {
+        AudioFileImport *import = &imports[i];
+        if (import->err)
+            continue;
+        auto entry = added_by_digest.maybe_get(import->digest);
+        if (entry) {
+            os_delete(import->dest_path.raw());
+            import->audio_asset = entry->value;
+            import->err = GenesisErrorAlreadyExists;
+            continue;
+        }
+        AudioAsset *audio_asset = create_zero<AudioAsset>();
+        if (!audio_asset) {
+            os_delete(import->dest_path.raw());
+            import->err = GenesisErrorNoMem;
+            continue;
+        }
+        audio_asset->id = uint256::random();
+        audio_asset->path = os_path_basename(import->dest_path);
+        audio_asset->sha256sum = import->digest;
+        import->audio_asset = audio_asset;
+        added_by_digest.put(import->digest, audio_asset);
+        omf_put_obj(batch, create_id_key(PropKeyAudioAsset, audio_asset->id), audio_asset);
+    }
+
+    // written in one batch, and then added to the project all at once
+    int err = ordered_map_file_batch_exec(batch);
+    for (int i = 0; i < count; i += 1) {
+        AudioFileImport *import = &imports[i];
+        if (import->err) {
+            out_audio_assets.at(i) = import->audio_asset;
+            out_errors.at(i) = import->err;
+        } else if (err) {
+            os_delete(import->dest_path.raw());
+            destroy(import->audio_asset, 1);
+            out_audio_assets.at(i) = nullptr;
+            out_errors.at(i) = err;
+        } else {
+            project_put_audio_asset(project, import->audio_asset);
+            index_add_audio_asset(project, import->audio_asset);
+            out_audio_assets.at(i) = import->audio_asset;
+            out_errors.at(i) = 0;
+        }
+    }
+    destroy(imports, count);
+    if (err)
+        return err;
+    project_trigger_list_events(project);
+    return 0;
+}
+
+int project_add_audio_asset(Project *project, const ByteBuffer &full_path, AudioAsset **out_audio_asset) {
+    List<ByteBuffer> full_paths;
+    List<AudioAsset *> audio_assets;
+    List<int> errors;
+    int err;
+    if ((err = full_paths.append(full_path)))
+        return err;
+    if ((err = project_add_audio_assets(project, full_paths, audio_assets, errors))) {
+        *out_audio_asset = nullptr;
+        return err;
+    }
+    *out_audio_asset = audio_assets.at(0);
+    return errors.at(0);
+}
+
 void project_add_audio_clip(Project *project, AudioAsset *audio_asset) {
     ByteBuffer name_from_path = audio_asset->path;
     os_path_remove_extension(name_from_path);
@@ -2323,6 +3795,25 @@ void project_add_audio_clip_segment(Project *project, AudioClip *audio_clip, Tra
     project_perform_command(create<AddAudioClipSegmentCommand>(project, audio_clip, track, start, end, pos));
 }
 
+void project_move_audio_clip_segment(Project *project, AudioClipSegment *segment, double pos) {
+    project_perform_command(create<MoveAudioClipSegmentCommand>(project, segment, pos));
+}
+
+void project_set_audio_clip_voices(Project *project, AudioClip *audio_clip, int polyphony,
+        AudioClipVoiceSteal voice_steal)
+{
+    project_perform_command(create<SetAudioClipVoicesCommand>(project, audio_clip,
+                clamp(1, polyphony, AUDIO_CLIP_MAX_POLYPHONY), voice_steal));
+}
+
+void project_set_audio_clip_time_stretch(Project *project, AudioClip *audio_clip, double stretch,
+        double pitch, GenesisTimeStretchQuality quality)
+{
+    project_perform_command(create<SetAudioClipTimeStretchCommand>(project, audio_clip,
+                clamp(TIME_STRETCH_MIN_STRETCH, stretch, TIME_STRETCH_MAX_STRETCH),
+                clamp(TIME_STRETCH_MIN_PITCH, pitch, TIME_STRETCH_MAX_PITCH), quality));
+}
+
 long project_audio_clip_frame_count(Project *project, AudioClip *audio_clip) {
     ok_or_panic(project_ensure_audio_asset_loaded(project, audio_clip->audio_asset));
     GenesisAudioFile *audio_file = audio_clip->audio_asset->audio_file;
@@ -2354,19 +3845,19 @@ void project_undo(Project *project) {
 
     OrderedMapFileBatch *batch = ok_mem(ordered_map_file_batch_create(project->omf));
 
-    Command *other_command = project->undo_stack.at(this_cmd_index);
+    Command *other_command = project_get_undo_command(project, this_cmd_index);
     UndoCommand *undo = create<UndoCommand>(project, other_command);
     project_perform_command_batch(project, batch, undo);
 
     project_push_command(project, undo);
-    ok_or_panic(ordered_map_file_batch_put(batch, create_command_key(undo->id), omf_buf_obj((Command *)undo)));
+    put_command(batch, undo);
 
     project->undo_stack_index -= 1;
-    ok_or_panic(ordered_map_file_batch_put(batch, create_basic_key(PropKeyUndoStackIndex),
-            omf_buf_uint32(project->undo_stack_index)));
+    omf_put_uint32(batch, create_basic_key(PropKeyUndoStackIndex), project->undo_stack_index);
+    trim_commands(project, batch);
 
     ok_or_panic(ordered_map_file_batch_exec(batch));
-    project_compute_indexes(project);
+    project_trigger_list_events(project);
     trigger_undo_changed(project);
 }
 
@@ -2376,22 +3867,290 @@ void project_redo(Project *project) {
 
     OrderedMapFileBatch *batch = ok_mem(ordered_map_file_batch_create(project->omf));
 
-    Command *other_command = project->undo_stack.at(this_cmd_index);
+    Command *other_command = project_get_undo_command(project, this_cmd_index);
     RedoCommand *redo = create<RedoCommand>(project, other_command);
     project_perform_command_batch(project, batch, redo);
 
     project_push_command(project, redo);
-    ok_or_panic(ordered_map_file_batch_put(batch, create_command_key(redo->id), omf_buf_obj((Command *)redo)));
+    put_command(batch, redo);
 
     project->undo_stack_index += 1;
-    ok_or_panic(ordered_map_file_batch_put(batch, create_basic_key(PropKeyUndoStackIndex),
-            omf_buf_uint32(project->undo_stack_index)));
+    omf_put_uint32(batch, create_basic_key(PropKeyUndoStackIndex), project->undo_stack_index);
+    trim_commands(project, batch);
 
     ok_or_panic(ordered_map_file_batch_exec(batch));
-    project_compute_indexes(project);
+    project_trigger_list_events(project);
     trigger_undo_changed(project);
 }
 
+struct CommandLogRow {
+    uint256 command_id;
+    uint256 user_id;
+    ByteBuffer command;
+    ByteBuffer other_command;
+};
+
+static int parse_command_log_row(const ByteBuffer &value, CommandLogRow *row) {
+    int offset = 0;
+    int err;
+    if ((err = deserialize_uint256(&row->command_id, value, &offset))) return err;
+    if ((err = deserialize_uint256(&row->user_id, value, &offset))) return err;
+    if ((err = deserialize_byte_buffer(row->command, value, &offset))) return err;
+    if ((err = deserialize_byte_buffer(row->other_command, value, &offset))) return err;
+    return (offset == value.length()) ? 0 : GenesisErrorInvalidFormat;
+}
+
+static int read_command_log_row(Project *project, int revision, ByteBuffer &out_value) {
+    ProjectKey key = create_command_log_key(revision);
+    ByteBuffer key_buf(key.data, key.size);
+    int err = ordered_map_file_read(project->omf, key_buf, out_value);
+    if (err == GenesisErrorKeyNotFound) {
+        // it may not be written yet
+        ordered_map_file_flush(project->omf);
+        err = ordered_map_file_read(project->omf, key_buf, out_value);
+    }
+    return err;
+}
+
+int project_encode_delta(Project *project, int first_revision, int max_count,
+        ByteBuffer &out_delta, int *out_end_revision)
+{
+    int end_revision = min(project_get_next_revision(project), first_revision + max_count);
+    List<ByteBuffer> values;
+    List<int> revisions;
+    List<uint256> user_ids;
+    int err;
+    for (int revision = first_revision; revision < end_revision; revision += 1) {
+        ByteBuffer value;
+        err = read_command_log_row(project, revision, value);
+        // revisions from before the file kept a log are left out
+        if (err == GenesisErrorKeyNotFound)
+            continue;
+        if (err)
+            return err;
+        CommandLogRow row;
+        if ((err = parse_command_log_row(value, &row)))
+            return err;
+        bool have_user = false;
+        for (int i = 0; i < user_ids.length() && !have_user; i += 1)
+            have_user = (user_ids.at(i) == row.user_id);
+        if (!have_user && (err = user_ids.append(row.user_id)))
+            return err;
+        if ((err = values.append(value)) || (err = revisions.append(revision)))
+            return err;
+    }
+
+    // users come first, so that the other side knows them by the time it
+    // reads their commands
+    OrderedMapFileBatch *batch = ok_mem(ordered_map_file_batch_create(nullptr));
+    for (int i = 0; i < user_ids.length(); i += 1) {
+        auto entry = project->users.maybe_get(user_ids.at(i));
+        if (!entry) {
+            ordered_map_file_batch_destroy(batch);
+            return GenesisErrorInvalidFormat;
+        }
+        omf_put_obj(batch, create_user_key(entry->value->id), entry->value);
+    }
+    for (int i = 0; i < values.length(); i += 1) {
+        ProjectKey key = create_command_log_key(revisions.at(i));
+        const ByteBuffer &value = values.at(i);
+        ordered_map_file_batch_put_bytes(batch, key.data, key.size, value.raw(), value.length());
+    }
+    ordered_map_file_batch_encode(batch, true, out_delta);
+    ordered_map_file_batch_destroy(batch);
+    *out_end_revision = end_revision;
+    return 0;
+}
+
+struct DeltaApply {
+    Project *project;
+    OrderedMapFileBatch *batch;
+    int missing_revision;
+};
+
+// parses the command of a row. an undo or redo whose command is not in
+// memory gets the one in the row as out_reference, which the caller
+// destroys once the command is performed.
+static int parse_logged_command(Project *project, const CommandLogRow *row,
+        Command **out_command, Command **out_reference)
+{
+    *out_reference = nullptr;
+    ProjectKey key = create_command_key(row->command_id);
+    Command *command;
+    int err;
+    if ((err = parse_command(project, ByteBuffer(key.data, key.size), row->command, &command)))
+        return err;
+    if (command->user_id != row->user_id) {
+        destroy(command, 1);
+        return GenesisErrorInvalidFormat;
+    }
+    uint256 *other_id;
+    Command **other = other_command_of(command, &other_id);
+    if (other && !*other) {
+        key = create_command_key(*other_id);
+        Command *reference = nullptr;
+        if (row->other_command.length() == 0 ||
+            (err = parse_command(project, ByteBuffer(key.data, key.size), row->other_command, &reference)) ||
+            other_command_of(reference, &other_id))
+        {
+            destroy(reference, 1);
+            destroy(command, 1);
+            return err ? err : GenesisErrorInvalidFormat;
+        }
+        *other = reference;
+        *out_reference = reference;
+    }
+    *out_command = command;
+    return 0;
+}
+
+static void put_command_from_row(DeltaApply *apply, Command *command, const ByteBuffer &value) {
+    ProjectKey key = create_command_log_key(command->revision);
+    omf_put_obj(apply->batch, create_command_key(command->id), command);
+    ordered_map_file_batch_put_bytes(apply->batch, key.data, key.size, value.raw(), value.length());
+}
+
+// the other side merged its last command with a later one, which is only
+// done to a command on its own undo stack
+static int replace_last_command(DeltaApply *apply, const CommandLogRow *row, const ByteBuffer &value) {
+    Project *project = apply->project;
+    Command *last = project->command_list.last();
+    uint256 *other_id;
+    if (last->undo_index >= 0 || other_command_of(last, &other_id))
+        return GenesisErrorConflict;
+    Command *command;
+    Command *reference;
+    int err;
+    if ((err = parse_logged_command(project, row, &command, &reference)))
+        return err;
+    if (reference || command->revision != last->revision) {
+        destroy(reference, 1);
+        destroy(command, 1);
+        return GenesisErrorInvalidFormat;
+    }
+    last->undo(apply->batch);
+    command->redo(apply->batch);
+    project->command_list.last() = command;
+    project->commands.put(command->id, command);
+    project->command_list_dirty = true;
+    destroy(last, 1);
+    put_command_from_row(apply, command, value);
+    return 0;
+}
+
+static int apply_command_log_row(DeltaApply *apply, int revision, const ByteBuffer &value) {
+    Project *project = apply->project;
+    CommandLogRow row;
+    int err;
+    if ((err = parse_command_log_row(value, &row)))
+        return err;
+
+    int next_revision = project_get_next_revision(project);
+    if (revision > next_revision) {
+        // the rest waits for the revisions in between
+        if (apply->missing_revision == -1)
+            apply->missing_revision = next_revision;
+        return 0;
+    }
+    if (revision < next_revision - 1) {
+        // already here, as long as it is the same command
+        ByteBuffer local_value;
+        err = read_command_log_row(project, revision, local_value);
+        if (err == GenesisErrorKeyNotFound)
+            return 0;
+        if (err)
+            return err;
+        CommandLogRow local_row;
+        if ((err = parse_command_log_row(local_value, &local_row)))
+            return err;
+        return (local_row.command_id == row.command_id) ? 0 : GenesisErrorConflict;
+    }
+    if (revision == next_revision - 1) {
+        Command *last = project->command_list.last();
+        if (last->id != row.command_id)
+            return GenesisErrorConflict;
+        ByteBuffer local_command;
+        serialize_object(last, local_command);
+        if (local_command == row.command)
+            return 0;
+        return replace_last_command(apply, &row, value);
+    }
+
+    Command *command;
+    Command *reference;
+    if ((err = parse_logged_command(project, &row, &command, &reference)))
+        return err;
+    if (command->revision != revision) {
+        destroy(reference, 1);
+        destroy(command, 1);
+        return GenesisErrorInvalidFormat;
+    }
+    project_perform_command_batch(project, apply->batch, command);
+    if (reference) {
+        uint256 *other_id;
+        *other_command_of(command, &other_id) = nullptr;
+        destroy(reference, 1);
+    }
+    project_push_command(project, command);
+    project->command_list_dirty = true;
+    put_command_from_row(apply, command, value);
+    return 0;
+}
+
+static int apply_delta_put(void *userdata, const char *key, int key_size, const char *value, int value_size) {
+    DeltaApply *apply = (DeltaApply *)userdata;
+    Project *project = apply->project;
+    ByteBuffer key_buf(key, key_size);
+    ByteBuffer value_buf(value, value_size);
+    if (key_size < PROP_KEY_SIZE)
+        return GenesisErrorInvalidFormat;
+    int err;
+    switch (read_uint32be(key)) {
+        case PropKeyUser:
+        {
+            uint256 id;
+            if ((err = object_key_to_id(key_buf, &id)))
+                return err;
+            if (project->users.maybe_get(id))
+                return 0;
+            User *user;
+            if ((err = parse_user(project, key_buf, value_buf, &user)))
+                return err;
+            add_user(project, user);
+            index_add_user(project, user);
+            omf_put_obj(apply->batch, create_user_key(user->id), user);
+            return 0;
+        }
+        case PropKeyCommandLog:
+        {
+            int revision;
+            if ((err = list_key_to_index(key_buf, &revision)))
+                return err;
+            return apply_command_log_row(apply, revision, value_buf);
+        }
+    }
+    return GenesisErrorInvalidFormat;
+}
+
+static int apply_delta_del(void *, const char *, int) {
+    return GenesisErrorInvalidFormat;
+}
+
+int project_apply_delta(Project *project, const ByteBuffer &delta, int *out_missing_revision) {
+    DeltaApply apply;
+    apply.project = project;
+    apply.batch = ok_mem(ordered_map_file_batch_create(project->omf));
+    apply.missing_revision = -1;
+    int err = ordered_map_file_transaction_decode(delta.raw(), delta.length(), &apply,
+            apply_delta_put, apply_delta_del);
+    // the commands before an error stay performed, and are saved with the rest
+    trim_commands(project, apply.batch);
+    ok_or_panic(ordered_map_file_batch_exec(apply.batch));
+    project_trigger_list_events(project);
+    *out_missing_revision = apply.missing_revision;
+    return err;
+}
+
 void project_get_effect_string(Project *project, Effect *effect, String &out) {
     switch ((EffectType)effect->effect_type) {
         case EffectTypeSend:
@@ -2406,6 +4165,13 @@ void project_get_effect_string(Project *project, Effect *effect, String &out) {
                     out = out_buf;
                     return;
                 }
+                case EffectSendTypeMixerLine:
+                {
+                    auto *entry = project->mixer_lines.maybe_get(send->send.mixer_line.mixer_line_id);
+                    out = "To ";
+                    out.append(entry ? entry->value->name : String("Missing Line"));
+                    return;
+                }
             }
             panic("invalid send type");
         }
@@ -2423,21 +4189,15 @@ void project_set_channel_layout(Project *project, const SoundIoChannelLayout *la
     project_perform_command(cmd);
 }
 
-// When you finally get around to genericizing this code, take a peek at
-// whole_notes_per_second at the top of genesis.cpp
-static const double whole_notes_per_second = 140.0 / 60.0;
-
-static double project_whole_notes_to_seconds(Project *project, double whole_notes) {
-    return whole_notes / whole_notes_per_second;
-}
-
 static long project_whole_notes_to_frames(Project *project, double whole_notes) {
-    return project->sample_rate * project_whole_notes_to_seconds(project, whole_notes);
+    return project->sample_rate * project->tempo_map.whole_notes_to_seconds(whole_notes);
 }
 
-static double project_frames_to_whole_notes(Project *project, long frames) {
-    double seconds = frames / (double)project->sample_rate;
-    return whole_notes_per_second * seconds;
+// the position frame_count frames after whole_notes
+static double project_whole_notes_add_frames(Project *project, double whole_notes, long frame_count) {
+    double seconds = project->tempo_map.whole_notes_to_seconds(whole_notes) +
+        frame_count / (double)project->sample_rate;
+    return project->tempo_map.seconds_to_whole_notes(seconds);
 }
 
 double project_get_duration_whole_notes(Project *project) {
@@ -2445,9 +4205,8 @@ double project_get_duration_whole_notes(Project *project) {
     for (int track_i = 0; track_i < project->track_list.length(); track_i += 1) {
         Track *track = project->track_list.at(track_i);
         AudioClipSegment *last_segment = track->audio_clip_segments.last();
-        long duration_frames = last_segment->end - last_segment->start;
-        double duration_whole_notes = project_frames_to_whole_notes(project, duration_frames);
-        double end_pos = last_segment->pos + duration_whole_notes;
+        long duration_frames = audio_clip_segment_duration(last_segment);
+        double end_pos = project_whole_notes_add_frames(project, last_segment->pos, duration_frames);
         last_pos = max(last_pos, end_pos);
     }
     return last_pos;
@@ -2465,28 +4224,54 @@ AddTrackCommand::AddTrackCommand(Project *project, String name, const SortKey &s
     track_id = uint256::random();
 }
 
+// gives each track in a rebalance payload its new sort key, or its old one
+// back. the order of the tracks stays the same either way.
+static void apply_track_rebalance(Project *project, OrderedMapFileBatch *batch,
+        const ByteBuffer &rebalance, bool forward)
+{
+    int offset = 0;
+    while (offset < rebalance.length()) {
+        uint256 track_id;
+        SortKey old_sort_key;
+        SortKey new_sort_key;
+        ok_or_panic(deserialize_uint256(&track_id, rebalance, &offset));
+        ok_or_panic(old_sort_key.deserialize(rebalance, &offset));
+        ok_or_panic(new_sort_key.deserialize(rebalance, &offset));
+        Track *track = project->tracks.get(track_id);
+        track->sort_key = forward ? new_sort_key : old_sort_key;
+        omf_put_obj(batch, create_track_key(track_id), track);
+    }
+    if (rebalance.length() > 0)
+        project->track_list_dirty = true;
+}
+
 void AddTrackCommand::undo(OrderedMapFileBatch *batch) {
     Track *track = project->tracks.get(track_id);
 
     assert(track->audio_clip_segments.length() == 0);
 
     project->tracks.remove(track_id);
-    project->track_list_dirty = true;
+    index_remove_track(project, track);
 
-    ordered_map_file_batch_del(batch, create_track_key(track_id));
+    omf_del(batch, create_track_key(track_id));
 
     destroy(track, 1);
+
+    apply_track_rebalance(project, batch, rebalance, false);
 }
 
 void AddTrackCommand::redo(OrderedMapFileBatch *batch) {
+    apply_track_rebalance(project, batch, rebalance, true);
+
     Track *track = create<Track>();
     track->id = track_id;
     track->name = name;
     track->sort_key = sort_key;
+    track->mixer_line_id = uint256::zero();
     project->tracks.put(track->id, track);
-    project->track_list_dirty = true;
+    index_add_track(project, track);
 
-    ok_or_panic(ordered_map_file_batch_put(batch, create_track_key(track_id), omf_buf_obj(track)));
+    omf_put_obj(batch, create_track_key(track_id), track);
 }
 
 void AddTrackCommand::serialize(ByteBuffer &buf) {
@@ -2506,7 +4291,8 @@ DeleteTrackCommand::DeleteTrackCommand(Project *project, Track *track) :
 
 void DeleteTrackCommand::undo(OrderedMapFileBatch *batch) {
     ok_or_panic(deserialize_track_decoded_key(project, track_id, payload));
-    ok_or_panic(ordered_map_file_batch_put(batch, create_track_key(track_id), omf_buf_byte_buffer(payload)));
+    index_add_track(project, project->tracks.get(track_id));
+    omf_put_byte_buffer(batch, create_track_key(track_id), payload);
 }
 
 void DeleteTrackCommand::redo(OrderedMapFileBatch *batch) {
@@ -2515,9 +4301,9 @@ void DeleteTrackCommand::redo(OrderedMapFileBatch *batch) {
     assert(track->audio_clip_segments.length() == 0);
 
     project->tracks.remove(track_id);
-    project->track_list_dirty = true;
+    index_remove_track(project, track);
 
-    ordered_map_file_batch_del(batch, create_track_key(track_id));
+    omf_del(batch, create_track_key(track_id));
     destroy(track, 1);
 }
 
@@ -2541,9 +4327,9 @@ void AddAudioClipCommand::undo(OrderedMapFileBatch *batch) {
     AudioClip *audio_clip = project->audio_clips.get(audio_clip_id);
 
     project->audio_clips.remove(audio_clip_id);
-    project->audio_clip_list_dirty = true;
+    index_remove_audio_clip(project, audio_clip);
 
-    ordered_map_file_batch_del(batch, create_id_key(PropKeyAudioClip, audio_clip->id));
+    omf_del(batch, create_id_key(PropKeyAudioClip, audio_clip->id));
 
     destroy_audio_clip(project, audio_clip);
 }
@@ -2556,13 +4342,17 @@ void AddAudioClipCommand::redo(OrderedMapFileBatch *batch) {
     audio_clip->id = audio_clip_id;
     audio_clip->audio_asset_id = audio_asset->id;
     audio_clip->name = name;
+    audio_clip->polyphony = AUDIO_CLIP_DEFAULT_POLYPHONY;
+    audio_clip->voice_steal = AudioClipVoiceStealOldest;
+    audio_clip->stretch = 1.0;
+    audio_clip->pitch = 1.0;
+    audio_clip->time_stretch_quality = GenesisTimeStretchQualityDraft;
     audio_clip->audio_asset = audio_asset;
 
     project->audio_clips.put(audio_clip->id, audio_clip);
-    project->audio_clip_list_dirty = true;
+    index_add_audio_clip(project, audio_clip);
 
-    ok_or_panic(ordered_map_file_batch_put(batch,
-                create_id_key(PropKeyAudioClip, audio_clip->id), omf_buf_obj(audio_clip)));
+    omf_put_obj(batch, create_id_key(PropKeyAudioClip, audio_clip->id), audio_clip);
 }
 
 void AddAudioClipCommand::serialize(ByteBuffer &buf) {
@@ -2589,9 +4379,9 @@ void AddAudioClipSegmentCommand::undo(OrderedMapFileBatch *batch) {
     AudioClipSegment *audio_clip_segment = project->audio_clip_segments.get(audio_clip_segment_id);
 
     project->audio_clip_segments.remove(audio_clip_segment_id);
-    project->audio_clip_segments_dirty = true;
+    index_remove_audio_clip_segment(project, audio_clip_segment);
 
-    ordered_map_file_batch_del(batch, create_id_key(PropKeyAudioClipSegment, audio_clip_segment->id));
+    omf_del(batch, create_id_key(PropKeyAudioClipSegment, audio_clip_segment->id));
 
     destroy(audio_clip_segment, 1);
 }
@@ -2608,10 +4398,9 @@ void AddAudioClipSegmentCommand::redo(OrderedMapFileBatch *batch) {
     audio_clip_segment->audio_clip = project->audio_clips.get(audio_clip_id);
 
     project->audio_clip_segments.put(audio_clip_segment->id, audio_clip_segment);
-    project->audio_clip_segments_dirty = true;
+    index_add_audio_clip_segment(project, audio_clip_segment);
 
-    ok_or_panic(ordered_map_file_batch_put(batch,
-                create_id_key(PropKeyAudioClipSegment, audio_clip_segment->id), omf_buf_obj(audio_clip_segment)));
+    omf_put_obj(batch, create_id_key(PropKeyAudioClipSegment, audio_clip_segment->id), audio_clip_segment);
 }
 
 void AddAudioClipSegmentCommand::serialize(ByteBuffer &buf) {
@@ -2622,6 +4411,131 @@ int AddAudioClipSegmentCommand::deserialize(const ByteBuffer &buffer, int *offse
     return deserialize_object(this, buffer, offset);
 }
 
+MoveAudioClipSegmentCommand::MoveAudioClipSegmentCommand(Project *project,
+        AudioClipSegment *segment, double pos) :
+    Command(project)
+{
+    this->audio_clip_segment_id = segment->id;
+    this->old_pos = segment->pos;
+    this->new_pos = pos;
+}
+
+static void set_audio_clip_segment_pos(Project *project, OrderedMapFileBatch *batch,
+        const uint256 &audio_clip_segment_id, double pos)
+{
+    AudioClipSegment *audio_clip_segment = project->audio_clip_segments.get(audio_clip_segment_id);
+    index_remove_audio_clip_segment(project, audio_clip_segment);
+    audio_clip_segment->pos = pos;
+    index_add_audio_clip_segment(project, audio_clip_segment);
+    omf_put_obj(batch, create_id_key(PropKeyAudioClipSegment, audio_clip_segment->id), audio_clip_segment);
+}
+
+void MoveAudioClipSegmentCommand::undo(OrderedMapFileBatch *batch) {
+    set_audio_clip_segment_pos(project, batch, audio_clip_segment_id, old_pos);
+}
+
+void MoveAudioClipSegmentCommand::redo(OrderedMapFileBatch *batch) {
+    set_audio_clip_segment_pos(project, batch, audio_clip_segment_id, new_pos);
+}
+
+bool MoveAudioClipSegmentCommand::merge(const Command *next) {
+    if (next->command_type() != CommandTypeMoveAudioClipSegment)
+        return false;
+    const MoveAudioClipSegmentCommand *next_move = static_cast<const MoveAudioClipSegmentCommand *>(next);
+    if (next_move->audio_clip_segment_id != audio_clip_segment_id)
+        return false;
+    new_pos = next_move->new_pos;
+    return true;
+}
+
+void MoveAudioClipSegmentCommand::serialize(ByteBuffer &buf) {
+    serialize_object(this, buf);
+}
+
+int MoveAudioClipSegmentCommand::deserialize(const ByteBuffer &buffer, int *offset) {
+    return deserialize_object(this, buffer, offset);
+}
+
+SetAudioClipVoicesCommand::SetAudioClipVoicesCommand(Project *project, AudioClip *audio_clip,
+        int polyphony, AudioClipVoiceSteal voice_steal) :
+    Command(project)
+{
+    this->audio_clip_id = audio_clip->id;
+    this->old_polyphony = audio_clip->polyphony;
+    this->new_polyphony = polyphony;
+    this->old_voice_steal = audio_clip->voice_steal;
+    this->new_voice_steal = voice_steal;
+}
+
+// the audio graph gives the clip new nodes when its voices change
+static void set_audio_clip_voices(Project *project, OrderedMapFileBatch *batch,
+        const uint256 &audio_clip_id, int polyphony, int voice_steal)
+{
+    AudioClip *audio_clip = project->audio_clips.get(audio_clip_id);
+    audio_clip->polyphony = polyphony;
+    audio_clip->voice_steal = voice_steal;
+    project->audio_clip_list_dirty = true;
+    omf_put_obj(batch, create_id_key(PropKeyAudioClip, audio_clip->id), audio_clip);
+}
+
+void SetAudioClipVoicesCommand::undo(OrderedMapFileBatch *batch) {
+    set_audio_clip_voices(project, batch, audio_clip_id, old_polyphony, old_voice_steal);
+}
+
+void SetAudioClipVoicesCommand::redo(OrderedMapFileBatch *batch) {
+    set_audio_clip_voices(project, batch, audio_clip_id, new_polyphony, new_voice_steal);
+}
+
+void SetAudioClipVoicesCommand::serialize(ByteBuffer &buf) {
+    serialize_object(this, buf);
+}
+
+int SetAudioClipVoicesCommand::deserialize(const ByteBuffer &buffer, int *offset) {
+    return deserialize_object(this, buffer, offset);
+}
+
+SetAudioClipTimeStretchCommand::SetAudioClipTimeStretchCommand(Project *project, AudioClip *audio_clip,
+        double stretch, double pitch, GenesisTimeStretchQuality quality) :
+    Command(project)
+{
+    this->audio_clip_id = audio_clip->id;
+    this->old_stretch = audio_clip->stretch;
+    this->new_stretch = stretch;
+    this->old_pitch = audio_clip->pitch;
+    this->new_pitch = pitch;
+    this->old_quality = audio_clip->time_stretch_quality;
+    this->new_quality = quality;
+}
+
+// like the voices, and the clip's segments change length on the timeline
+static void set_audio_clip_time_stretch(Project *project, OrderedMapFileBatch *batch,
+        const uint256 &audio_clip_id, double stretch, double pitch, int quality)
+{
+    AudioClip *audio_clip = project->audio_clips.get(audio_clip_id);
+    audio_clip->stretch = stretch;
+    audio_clip->pitch = pitch;
+    audio_clip->time_stretch_quality = quality;
+    project->audio_clip_list_dirty = true;
+    project->audio_clip_segments_dirty = true;
+    omf_put_obj(batch, create_id_key(PropKeyAudioClip, audio_clip->id), audio_clip);
+}
+
+void SetAudioClipTimeStretchCommand::undo(OrderedMapFileBatch *batch) {
+    set_audio_clip_time_stretch(project, batch, audio_clip_id, old_stretch, old_pitch, old_quality);
+}
+
+void SetAudioClipTimeStretchCommand::redo(OrderedMapFileBatch *batch) {
+    set_audio_clip_time_stretch(project, batch, audio_clip_id, new_stretch, new_pitch, new_quality);
+}
+
+void SetAudioClipTimeStretchCommand::serialize(ByteBuffer &buf) {
+    serialize_object(this, buf);
+}
+
+int SetAudioClipTimeStretchCommand::deserialize(const ByteBuffer &buffer, int *offset) {
+    return deserialize_object(this, buffer, offset);
+}
+
 ChangeSampleRateCommand::ChangeSampleRateCommand(Project *project, int sample_rate) :
     Command(project)
 {
@@ -2632,15 +4546,13 @@ ChangeSampleRateCommand::ChangeSampleRateCommand(Project *project, int sample_ra
 void ChangeSampleRateCommand::undo(OrderedMapFileBatch *batch) {
     project->sample_rate = old_sample_rate;
     trigger_event(project, EventProjectSampleRateChanged);
-    ok_or_panic(ordered_map_file_batch_put(batch, create_basic_key(PropKeySampleRate),
-                omf_buf_uint32(project->sample_rate)));
+    omf_put_uint32(batch, create_basic_key(PropKeySampleRate), project->sample_rate);
 }
 
 void ChangeSampleRateCommand::redo(OrderedMapFileBatch *batch) {
     project->sample_rate = new_sample_rate;
     trigger_event(project, EventProjectSampleRateChanged);
-    ok_or_panic(ordered_map_file_batch_put(batch, create_basic_key(PropKeySampleRate),
-                omf_buf_uint32(project->sample_rate)));
+    omf_put_uint32(batch, create_basic_key(PropKeySampleRate), project->sample_rate);
 }
 
 void ChangeSampleRateCommand::serialize(ByteBuffer &buf) {
@@ -2662,15 +4574,13 @@ ChangeChannelLayoutCommand::ChangeChannelLayoutCommand(Project *project,
 void ChangeChannelLayoutCommand::undo(OrderedMapFileBatch *batch) {
     project->channel_layout = old_layout;
     trigger_event(project, EventProjectChannelLayoutChanged);
-    ok_or_panic(ordered_map_file_batch_put(batch, create_basic_key(PropKeyChannelLayout),
-                omf_buf_channel_layout(&project->channel_layout)));
+    omf_put_channel_layout(batch, create_basic_key(PropKeyChannelLayout), &project->channel_layout);
 }
 
 void ChangeChannelLayoutCommand::redo(OrderedMapFileBatch *batch) {
     project->channel_layout = new_layout;
     trigger_event(project, EventProjectChannelLayoutChanged);
-    ok_or_panic(ordered_map_file_batch_put(batch, create_basic_key(PropKeyChannelLayout),
-                omf_buf_channel_layout(&project->channel_layout)));
+    omf_put_channel_layout(batch, create_basic_key(PropKeyChannelLayout), &project->channel_layout);
 }
 
 void ChangeChannelLayoutCommand::serialize(ByteBuffer &buf) {
@@ -2689,10 +4599,12 @@ UndoCommand::UndoCommand(Project *project, Command *other_command) :
 }
 
 void UndoCommand::undo(OrderedMapFileBatch *batch) {
+    assert(other_command);
     other_command->redo(batch);
 }
 
 void UndoCommand::redo(OrderedMapFileBatch *batch) {
+    assert(other_command);
     other_command->undo(batch);
 }
 
@@ -2704,11 +4616,9 @@ int UndoCommand::deserialize(const ByteBuffer &buffer, int *offset) {
     int err;
     if ((err = deserialize_object(this, buffer, offset))) return err;
 
+    // the other command may have fallen off the undo history already
     auto entry = project->commands.maybe_get(other_command_id);
-    if (!entry)
-        return GenesisErrorInvalidFormat;
-
-    other_command = entry->value;
+    other_command = entry ? entry->value : nullptr;
 
     return 0;
 }
@@ -2722,10 +4632,12 @@ RedoCommand::RedoCommand(Project *project, Command *other_command) :
 }
 
 void RedoCommand::undo(OrderedMapFileBatch *batch) {
+    assert(other_command);
     other_command->undo(batch);
 }
 
 void RedoCommand::redo(OrderedMapFileBatch *batch) {
+    assert(other_command);
     other_command->redo(batch);
 }
 
@@ -2737,11 +4649,9 @@ int RedoCommand::deserialize(const ByteBuffer &buffer, int *offset) {
     int err;
     if ((err = deserialize_object(this, buffer, offset))) return err;
 
+    // the other command may have fallen off the undo history already
     auto entry = project->commands.maybe_get(other_command_id);
-    if (!entry)
-        return GenesisErrorInvalidFormat;
-
-    other_command = entry->value;
+    other_command = entry ? entry->value : nullptr;
 
     return 0;
 }
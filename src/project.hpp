@@ -8,10 +8,23 @@
 #include "ordered_map_file.hpp"
 #include "event_dispatcher.hpp"
 #include "device_id.hpp"
+#include "tempo_map.hpp"
+#include "job_system.hpp"
 
 class Command;
 struct AudioClipSegment;
 struct Project;
+struct OsThread;
+struct OsMutex;
+struct OsCond;
+struct WaveformPeaks;
+
+enum AudioAssetLoadState {
+    AudioAssetLoadStateIdle,
+    AudioAssetLoadStateQueued,
+    AudioAssetLoadStateDecoding,
+    AudioAssetLoadStateDecoded,
+};
 
 struct AudioAsset {
     // canonical data
@@ -21,13 +34,74 @@ struct AudioAsset {
 
     // prepared view of data
     GenesisAudioFile *audio_file;
+    // set along with audio_file. for streamed files it fills in afterwards.
+    WaveformPeaks *peaks;
+
+    // transient data. the rest of these are guarded by the project's
+    // asset_loader_mutex while the asset is queued or decoding.
+    AudioAssetLoadState load_state;
+    GenesisAudioFile *decoded_audio_file;
+    WaveformPeaks *decoded_peaks;
+    int load_err;
+    // main thread only. an asset that is pinned or that a clip refers to is
+    // never evicted from the asset cache. evictable is scratch for that.
+    int pin_count;
+    long last_use;
+    bool evictable;
+};
+
+struct AudioAssetCacheStats {
+    long budget_bytes;
+    // the samples of the loaded assets
+    long resident_bytes;
+    int loaded_count;
+    // project_ensure_audio_asset_loaded calls which found the asset loaded,
+    // and the ones which had to load it or wait for it
+    long hit_count;
+    long miss_count;
+    long eviction_count;
+};
+
+// seconds project_open spent on each step. all zero for a project made
+// with project_create.
+struct ProjectOpenStats {
+    // reading the file into the ordered map
+    double omf_open_seconds;
+    // parsing the objects out of the map
+    double deserialize_seconds;
+    // sorting the lists the objects are kept in
+    double index_seconds;
+};
+
+// a pass through a streamed asset to build its peaks
+struct AssetPeaksJob {
+    AudioAsset *audio_asset;
+    GenesisAudioFile *audio_file;
+    WaveformPeaks *peaks;
 };
 
+// which voice a clip cuts off when it starts a segment with all of its
+// voices playing. modifying this affects project file backward compatibility.
+enum AudioClipVoiceSteal {
+    AudioClipVoiceStealOldest,
+    AudioClipVoiceStealQuietest,
+};
+
+static const int AUDIO_CLIP_DEFAULT_POLYPHONY = 32;
+static const int AUDIO_CLIP_MAX_POLYPHONY = 256;
+
 struct AudioClip {
     // canonical data
     uint256 id;
     uint256 audio_asset_id;
     String name;
+    // how many of its segments may play at once
+    int polyphony;
+    int voice_steal; // see enum AudioClipVoiceSteal
+    // how many times longer and higher its segments play than the file
+    double stretch;
+    double pitch;
+    int time_stretch_quality; // see enum GenesisTimeStretchQuality
 
     // prepared view of the data
     AudioAsset *audio_asset;
@@ -41,6 +115,9 @@ struct Track {
     uint256 id;
     String name;
     SortKey sort_key;
+    // the mixer line the track plays into. any id which is not a mixer line,
+    // such as zero, means the master line.
+    uint256 mixer_line_id;
 
     // prepared view of the data
     List<AudioClipSegment *> audio_clip_segments;
@@ -60,6 +137,11 @@ struct AudioClipSegment {
     Track *track;
 };
 
+// how long the segment lasts on the timeline, in frames of its file
+static inline long audio_clip_segment_duration(const AudioClipSegment *segment) {
+    return (long)ceil((segment->end - segment->start) * segment->audio_clip->stretch);
+}
+
 struct User {
     uint256 id;
     String name;
@@ -81,17 +163,25 @@ struct MixerLine {
 // modifying this structure affects project file backward compatibility
 enum EffectSendType {
     EffectSendTypeDevice,
+    EffectSendTypeMixerLine,
 };
 
 struct EffectSendDevice {
     int device_id; // see enum DeviceId
 };
 
+// sums the line into another one. sends which would feed a line back into
+// itself are left out of the graph.
+struct EffectSendMixerLine {
+    uint256 mixer_line_id;
+};
+
 struct EffectSend {
     float gain;
     int send_type; // see enum EffectSendType
     union {
         EffectSendDevice device;
+        EffectSendMixerLine mixer_line;
     } send;
 };
 
@@ -112,11 +202,17 @@ struct Effect {
     MixerLine *mixer_line;
 };
 
-struct PlayChannelContext {
-    struct GenesisAudioFileIterator iter;
-    long offset;
+struct UndoStackEntry {
+    uint256 command_id;
+    // null while the command is paged out to the project file
+    Command *command;
 };
 
+// commands more than this many undo steps away are paged out of memory
+static const int DEFAULT_UNDO_RESIDENT_COUNT = 100;
+// the undo stack is cut back to at most this many steps
+static const int DEFAULT_UNDO_MAX_COUNT = 1000;
+
 struct Project {
     /////////// canonical data, shared among all users
     uint256 id;
@@ -130,23 +226,29 @@ struct Project {
     IdMap<Effect *> effects;
     SoundIoChannelLayout channel_layout;
     int sample_rate;
+    // not saved yet, so always the default tempo
+    TempoMap tempo_map;
     String tag_title;
     String tag_artist;
     String tag_album_artist;
     String tag_album;
     int tag_year;
-    // this represents the true history of the project. you can create the
-    // entire project data structure just from this data
-    // this grows forever and never shrinks
+    // the commands in memory: the ones near undo_stack_index and the last
+    // one performed. the file keeps every command on the undo stack and the
+    // last one; the rest are deleted as they fall off.
     IdMap<Command *> commands;
 
     ///////////// state which is specific to this file, not shared among users
-    // this is a subset of command_stack. it points to commands that are in
-    // active_user's undo stack
-    List<Command *> undo_stack;
+    // active_user's undo stack. entries away from undo_stack_index have
+    // their command paged out; project_get_undo_command reads it back.
+    List<UndoStackEntry> undo_stack;
     int undo_stack_index;
+    int undo_resident_count;
+    int undo_max_count;
 
     /////////////// prepared view of the data
+    // the lists are kept sorted as edits happen. each dirty flag is set
+    // when its list changes and cleared when the change event fires.
     List<Track *> track_list;
     bool track_list_dirty;
 
@@ -157,7 +259,7 @@ struct Project {
     bool command_list_dirty;
 
     List<AudioAsset *> audio_asset_list;
-    HashMap<ByteBuffer, AudioAsset *, ByteBuffer::hash> audio_assets_by_digest;
+    FlatHashMap<ByteBuffer, AudioAsset *, ByteBuffer::hash> audio_assets_by_digest;
     bool audio_asset_list_dirty;
 
     List<AudioClip *> audio_clip_list;
@@ -175,6 +277,28 @@ struct Project {
     OrderedMapFile *omf;
     EventDispatcher events;
     ByteBuffer path; // path to the project file
+    // counts the times the last command was rewritten by a merge, which
+    // changes its command log row without a new revision
+    long command_log_rewrite_serial;
+
+    // decodes audio assets in the background after the project opens, with
+    // a job of asset_jobs for each queued asset or peaks. the queues and the
+    // done list are guarded by asset_loader_mutex.
+    JobGroup *asset_jobs;
+    OsMutex *asset_loader_mutex;
+    OsCond *asset_loader_cond;
+    List<AudioAsset *> asset_load_queue;
+    List<AudioAsset *> asset_load_done;
+    List<AssetPeaksJob> asset_peaks_queue;
+    // main thread only
+    int asset_load_total;
+    int asset_load_finished;
+    // loaded assets that nothing uses are evicted, least recently used
+    // first, when the loaded ones go over the context's audio asset cache
+    // budget. they load again from the decoded cache or stream when needed.
+    long asset_use_serial;
+    AudioAssetCacheStats asset_cache_stats;
+    ProjectOpenStats open_stats;
 };
 
 int project_get_next_revision(Project *project);
@@ -189,6 +313,9 @@ enum CommandType {
     CommandTypeAddAudioClipSegment,
     CommandTypeChangeSampleRate,
     CommandTypeChangeChannelLayout,
+    CommandTypeMoveAudioClipSegment,
+    CommandTypeSetAudioClipVoices,
+    CommandTypeSetAudioClipTimeStretch,
 };
 
 class Command {
@@ -200,6 +327,8 @@ public:
         user_id = user->id;
         revision = project_get_next_revision(project);
         id = uint256::random();
+        perform_time = 0.0;
+        undo_index = -1;
     }
     virtual ~Command() {}
     virtual void undo(OrderedMapFileBatch *batch) = 0;
@@ -209,6 +338,10 @@ public:
     virtual void serialize(ByteBuffer &buf) = 0;
     virtual int deserialize(const ByteBuffer &buf, int *offset) = 0;
     virtual CommandType command_type() const = 0;
+    // takes the change of next, which is performed right after this command
+    // by the same user, so that the two are one command and one undo step.
+    // returns false if they stay apart.
+    virtual bool merge(const Command *next) { return false; }
 
     // serialized
     uint256 id;
@@ -218,6 +351,10 @@ public:
     // transient state
     Project *project;
     User *user;
+    // when this instance last performed or merged a command, or 0
+    double perform_time;
+    // where this command is in the undo stack, or -1
+    int undo_index;
 };
 
 class AddTrackCommand : public Command {
@@ -230,7 +367,8 @@ public:
         return "Insert Track";
     }
     int allocated_size() const override {
-        return sizeof(AddTrackCommand) + name.allocated_size() + sort_key.allocated_size();
+        return sizeof(AddTrackCommand) + name.allocated_size() + sort_key.allocated_size() +
+            rebalance.allocated_size();
     }
 
     void undo(OrderedMapFileBatch *batch) override;
@@ -242,6 +380,9 @@ public:
     uint256 track_id;
     String name;
     SortKey sort_key;
+    // set when this insert spread the other tracks' keys out again: each
+    // track id followed by its old and its new sort key
+    ByteBuffer rebalance;
 };
 
 class DeleteTrackCommand : public Command {
@@ -371,6 +512,87 @@ public:
     SoundIoChannelLayout new_layout;
 };
 
+class MoveAudioClipSegmentCommand : public Command {
+public:
+    MoveAudioClipSegmentCommand(Project *project, AudioClipSegment *segment, double pos);
+    MoveAudioClipSegmentCommand() {}
+    ~MoveAudioClipSegmentCommand() override {}
+
+    String description() const override {
+        return "Move Audio Clip Segment";
+    }
+    int allocated_size() const override {
+        return sizeof(MoveAudioClipSegmentCommand);
+    }
+
+    void undo(OrderedMapFileBatch *batch) override;
+    void redo(OrderedMapFileBatch *batch) override;
+    void serialize(ByteBuffer &buf) override;
+    int deserialize(const ByteBuffer &buf, int *offset) override;
+    CommandType command_type() const override { return CommandTypeMoveAudioClipSegment; }
+    bool merge(const Command *next) override;
+
+    uint256 audio_clip_segment_id;
+    double old_pos;
+    double new_pos;
+};
+
+class SetAudioClipVoicesCommand : public Command {
+public:
+    SetAudioClipVoicesCommand(Project *project, AudioClip *audio_clip, int polyphony,
+            AudioClipVoiceSteal voice_steal);
+    SetAudioClipVoicesCommand() {}
+    ~SetAudioClipVoicesCommand() override {}
+
+    String description() const override {
+        return "Set Audio Clip Voices";
+    }
+    int allocated_size() const override {
+        return sizeof(SetAudioClipVoicesCommand);
+    }
+
+    void undo(OrderedMapFileBatch *batch) override;
+    void redo(OrderedMapFileBatch *batch) override;
+    void serialize(ByteBuffer &buf) override;
+    int deserialize(const ByteBuffer &buf, int *offset) override;
+    CommandType command_type() const override { return CommandTypeSetAudioClipVoices; }
+
+    uint256 audio_clip_id;
+    int old_polyphony;
+    int new_polyphony;
+    int old_voice_steal;
+    int new_voice_steal;
+};
+
+class SetAudioClipTimeStretchCommand : public Command {
+public:
+    SetAudioClipTimeStretchCommand(Project *project, AudioClip *audio_clip, double stretch,
+            double pitch, GenesisTimeStretchQuality quality);
+    SetAudioClipTimeStretchCommand() {}
+    ~SetAudioClipTimeStretchCommand() override {}
+
+    String description() const override {
+        return "Set Audio Clip Time Stretch";
+    }
+    int allocated_size() const override {
+        return sizeof(SetAudioClipTimeStretchCommand);
+    }
+
+    void undo(OrderedMapFileBatch *batch) override;
+    void redo(OrderedMapFileBatch *batch) override;
+    void serialize(ByteBuffer &buf) override;
+    int deserialize(const ByteBuffer &buf, int *offset) override;
+    CommandType command_type() const override { return CommandTypeSetAudioClipTimeStretch; }
+
+    uint256 audio_clip_id;
+    double old_stretch;
+    double new_stretch;
+    double old_pitch;
+    double new_pitch;
+    int old_quality;
+    int new_quality;
+};
+
 class UndoCommand : public Command {
 public:
     UndoCommand(Project *project, Command *other_command);
@@ -434,10 +656,28 @@ void project_close(Project *project);
 
 void project_undo(Project *project);
 void project_redo(Project *project);
+// the command at index in the undo stack, read back from the file if it
+// was paged out
+Command *project_get_undo_command(Project *project, int index);
+// keeps resident_count undo steps each way in memory and at most max_count
+// steps in all, dropping the oldest ones from the file
+void project_set_undo_limits(Project *project, int resident_count, int max_count);
 
 void project_perform_command(Project *project, Command *command);
 void project_perform_command_batch(Project *project, OrderedMapFileBatch *batch, Command *command);
 
+// the command log rows from first_revision, at most max_count of them,
+// with the users they need, as one encoded transaction. out_end_revision
+// is the revision after the last one in the delta.
+int project_encode_delta(Project *project, int first_revision, int max_count,
+        ByteBuffer &out_delta, int *out_end_revision);
+// performs the commands of a delta from another copy of the project which
+// this one does not have yet and saves them. revisions this copy already
+// has are checked to be the same commands, else GenesisErrorConflict is
+// returned. out_missing_revision is -1, or the first revision this copy
+// lacks when the delta skips past it; the commands after it are not applied.
+int project_apply_delta(Project *project, const ByteBuffer &delta, int *out_missing_revision);
+
 void project_insert_track(Project *project, const Track *before, const Track *after);
 AddTrackCommand * project_insert_track_batch(Project *project, OrderedMapFileBatch *batch,
         const Track *before, const Track *after);
@@ -445,11 +685,50 @@ AddTrackCommand * project_insert_track_batch(Project *project, OrderedMapFileBat
 void project_delete_track(Project *project, Track *track);
 
 int project_add_audio_asset(Project *project, const ByteBuffer &full_path, AudioAsset **audio_asset);
+// adds many files at once: they are copied and hashed on several threads,
+// written to the project file in one batch and announced with one event.
+// out_audio_assets and out_errors get one entry for each path, as
+// project_add_audio_asset would return them: 0 and the new asset,
+// GenesisErrorAlreadyExists and the asset the project already had for the
+// content, or another error and no asset. returns an error, having added
+// nothing, when the batch could not be written.
+int project_add_audio_assets(Project *project, const List<ByteBuffer> &full_paths,
+        List<AudioAsset *> &out_audio_assets, List<int> &out_errors);
 void project_add_audio_clip(Project *project, AudioAsset *audio_asset);
 void project_add_audio_clip_segment(Project *project, AudioClip *audio_clip, Track *track,
         long start, long end, double pos);
-
+// moves which follow each other within a second, as while dragging, become
+// one command and one undo step
+void project_move_audio_clip_segment(Project *project, AudioClipSegment *segment, double pos);
+// polyphony is clamped to 1 through AUDIO_CLIP_MAX_POLYPHONY
+void project_set_audio_clip_voices(Project *project, AudioClip *audio_clip, int polyphony,
+        AudioClipVoiceSteal voice_steal);
+// stretch and pitch are clamped to the ranges of the time stretch node.
+// the clip's segments last stretch times as long.
+void project_set_audio_clip_time_stretch(Project *project, AudioClip *audio_clip, double stretch,
+        double pitch, GenesisTimeStretchQuality quality);
+
+// loads audio_asset now, waiting for the background decode if it has one
 int project_ensure_audio_asset_loaded(Project *project, AudioAsset *audio_asset);
+// queues every asset which is not loaded yet for decoding on a thread pool.
+// project_open calls this.
+int project_load_audio_assets_async(Project *project);
+// call from the main thread. publishes finished background decodes,
+// triggering EventProjectAudioAssetLoaded once for each.
+void project_flush_events(Project *project);
+// how many of the assets queued since the project opened are loaded
+void project_audio_asset_load_progress(Project *project, int *out_finished, int *out_total);
+// whatever plays an asset pins it so that it is not evicted meanwhile
+void project_pin_audio_asset(Project *project, AudioAsset *audio_asset);
+void project_unpin_audio_asset(Project *project, AudioAsset *audio_asset);
+void project_get_audio_asset_cache_stats(Project *project, AudioAssetCacheStats *out_stats);
+static inline bool project_audio_asset_is_loaded(AudioAsset *audio_asset) {
+    return audio_asset->audio_file != nullptr;
+}
+// the file in the decoded cache next to the project that holds the decoded
+// samples of content with digest, and its directory
+void project_decoded_cache_path(Project *project, const ByteBuffer &digest,
+        ByteBuffer &out_dir, ByteBuffer &out_path);
 long project_audio_clip_frame_count(Project *project, AudioClip *audio_clip);
 int project_audio_clip_sample_rate(Project *project, AudioClip *audio_clip);
 
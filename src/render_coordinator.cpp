@@ -0,0 +1,251 @@
+#include "render_coordinator.hpp"
+#include "audio_graph.hpp"
+#include "project.hpp"
+#include "dsp_kernels.hpp"
+#include "os.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static const int JOIN_CHUNK_FRAMES = 4096;
+
+int render_coordinator_plan(long frame_count, int range_count, long preroll_frames,
+        long alignment, const ByteBuffer &out_path, List<RenderRange> &out_ranges)
+{
+    if (range_count < 1 || frame_count < 1 || preroll_frames < 0 || alignment < 1)
+        return GenesisErrorInvalidParam;
+    preroll_frames = (preroll_frames + alignment - 1) / alignment * alignment;
+
+    out_ranges.clear();
+    for (int i = 0; i < range_count; i += 1) {
+        long start_frame = frame_count * i / range_count / alignment * alignment;
+        // alignment can leave fewer ranges than asked for
+        if (i > 0 && start_frame == out_ranges.last().start_frame)
+            continue;
+        if (out_ranges.add_one())
+            return GenesisErrorNoMem;
+        RenderRange *range = &out_ranges.last();
+        range->start_frame = start_frame;
+        range->preroll_frames = min(preroll_frames, start_frame);
+        range->out_path.format("%s.part%d", out_path.raw(), out_ranges.length() - 1);
+    }
+    for (int i = 0; i < out_ranges.length(); i += 1) {
+        long end_frame = (i + 1 < out_ranges.length()) ? out_ranges.at(i + 1).start_frame : frame_count;
+        out_ranges.at(i).frame_count = end_frame - out_ranges.at(i).start_frame;
+    }
+    return 0;
+}
+
+long render_coordinator_alignment(Project *project, int sample_rate) {
+    long alignment = 1;
+    for (int i = 0; i < project->audio_clip_list.length(); i += 1) {
+        int clip_sample_rate = project_audio_clip_sample_rate(project, project->audio_clip_list.at(i));
+        long period = sample_rate / greatest_common_denominator(sample_rate, clip_sample_rate);
+        alignment = alignment / greatest_common_denominator(alignment, period) * period;
+    }
+    return alignment;
+}
+
+void render_worker_args(const ByteBuffer &project_path, const RenderRange *range,
+        int sample_rate, GenesisResampleQuality resample_quality, List<ByteBuffer> &out_args)
+{
+    out_args.clear();
+    ByteBuffer arg;
+    ok_or_panic(out_args.append(RENDER_WORKER_ARG));
+    ok_or_panic(out_args.append(project_path));
+    arg.format("%ld", range->start_frame);
+    ok_or_panic(out_args.append(arg));
+    arg.format("%ld", range->frame_count);
+    ok_or_panic(out_args.append(arg));
+    arg.format("%ld", range->preroll_frames);
+    ok_or_panic(out_args.append(arg));
+    arg.format("%d", sample_rate);
+    ok_or_panic(out_args.append(arg));
+    arg.format("%d", (int)resample_quality);
+    ok_or_panic(out_args.append(arg));
+    ok_or_panic(out_args.append(range->out_path));
+}
+
+int render_coordinator_run(Project *project, GenesisContext *genesis_context,
+        const char *worker_exe, const GenesisExportFormat *export_format,
+        const ByteBuffer &out_path, int range_count, long preroll_frames)
+{
+    int err;
+    List<RenderRange> ranges;
+    long alignment = render_coordinator_alignment(project, export_format->sample_rate);
+    if ((err = render_coordinator_plan(project_get_duration_frames(project), range_count,
+                    preroll_frames, alignment, out_path, ranges)))
+    {
+        return err;
+    }
+
+    List<OsProcess *> workers;
+    if (workers.resize(ranges.length()))
+        return GenesisErrorNoMem;
+    List<ByteBuffer> args;
+    for (int i = 0; i < ranges.length(); i += 1) {
+        render_worker_args(project->path, &ranges.at(i), export_format->sample_rate,
+                export_format->resample_quality, args);
+        if ((err = os_process_create(worker_exe, args, &workers.at(i))))
+            workers.at(i) = nullptr;
+    }
+
+    // every worker is waited for, even after one fails
+    int worker_err = err;
+    for (int i = 0; i < workers.length(); i += 1) {
+        if (!workers.at(i))
+            continue;
+        int exit_code;
+        if ((err = os_process_wait(workers.at(i), &exit_code)))
+            worker_err = err;
+        else if (exit_code != 0)
+            worker_err = GenesisErrorSystemResources;
+    }
+
+    if (worker_err) {
+        for (int i = 0; i < ranges.length(); i += 1)
+            os_delete(ranges.at(i).out_path.raw());
+        return worker_err;
+    }
+
+    return render_coordinator_join(project, genesis_context, ranges, export_format, out_path);
+}
+
+static int join_range(GenesisContext *genesis_context, const RenderRange *range,
+        GenesisAudioFileStream *stream, int channel_count, int sample_rate, float *buffer)
+{
+    int err;
+    GenesisAudioFile *audio_file;
+    if ((err = genesis_audio_file_map_decoded(genesis_context, range->out_path.raw(), &audio_file)))
+        return err;
+
+    if (genesis_audio_file_frame_count(audio_file) != range->frame_count ||
+        genesis_audio_file_channel_layout(audio_file)->channel_count != channel_count ||
+        genesis_audio_file_sample_rate(audio_file) != sample_rate)
+    {
+        genesis_audio_file_destroy(audio_file);
+        return GenesisErrorInvalidFormat;
+    }
+
+    const DspChannelKernels *kernels = dsp_channel_kernels(channel_count);
+    const float *srcs[GENESIS_MAX_CHANNELS];
+    for (int ch = 0; ch < channel_count; ch += 1)
+        srcs[ch] = genesis_audio_file_iterator(audio_file, ch, 0).ptr;
+
+    for (long frame = 0; frame < range->frame_count; frame += JOIN_CHUNK_FRAMES) {
+        int frame_count = min((long)JOIN_CHUNK_FRAMES, range->frame_count - frame);
+        memset(buffer, 0, frame_count * channel_count * sizeof(float));
+        kernels->interleave_add(channel_count, buffer, srcs, frame_count);
+        if ((err = genesis_audio_file_stream_write(stream, buffer, frame_count))) {
+            genesis_audio_file_destroy(audio_file);
+            return err;
+        }
+        for (int ch = 0; ch < channel_count; ch += 1)
+            srcs[ch] += frame_count;
+    }
+
+    genesis_audio_file_destroy(audio_file);
+    return 0;
+}
+
+int render_coordinator_join(Project *project, GenesisContext *genesis_context,
+        const List<RenderRange> &ranges, const GenesisExportFormat *export_format,
+        const ByteBuffer &out_path)
+{
+    int channel_count = project->channel_layout.channel_count;
+    float *buffer = allocate_nonzero<float>(JOIN_CHUNK_FRAMES * channel_count);
+    if (!buffer)
+        return GenesisErrorNoMem;
+
+    int err;
+    GenesisAudioFileStream *stream;
+    if ((err = audio_graph_open_render_stream(project, genesis_context, export_format,
+                    out_path, &stream)))
+    {
+        destroy(buffer, JOIN_CHUNK_FRAMES * channel_count);
+        return err;
+    }
+
+    for (int i = 0; i < ranges.length() && !err; i += 1) {
+        const RenderRange *range = &ranges.at(i);
+        if (i > 0) {
+            const RenderRange *prev = &ranges.at(i - 1);
+            if (prev->start_frame + prev->frame_count != range->start_frame) {
+                err = GenesisErrorInvalidParam;
+                break;
+            }
+        }
+        err = join_range(genesis_context, range, stream, channel_count,
+                export_format->sample_rate, buffer);
+    }
+    if (!err)
+        err = genesis_audio_file_stream_close(stream);
+
+    genesis_audio_file_stream_destroy(stream);
+    destroy(buffer, JOIN_CHUNK_FRAMES * channel_count);
+    for (int i = 0; i < ranges.length(); i += 1)
+        os_delete(ranges.at(i).out_path.raw());
+    return err;
+}
+
+static bool parse_long(const char *str, long *out_value) {
+    char *end;
+    *out_value = strtol(str, &end, 10);
+    return *str && !*end;
+}
+
+int render_worker_main(int argc, char *argv[]) {
+    long start_frame, frame_count, preroll_frames, sample_rate, resample_quality;
+    if (argc != 7 ||
+        !parse_long(argv[1], &start_frame) ||
+        !parse_long(argv[2], &frame_count) ||
+        !parse_long(argv[3], &preroll_frames) ||
+        !parse_long(argv[4], &sample_rate) ||
+        !parse_long(argv[5], &resample_quality))
+    {
+        fprintf(stderr, "Usage: %s project start_frame frame_count preroll_frames "
+                "sample_rate resample_quality out_path\n", RENDER_WORKER_ARG);
+        return 1;
+    }
+    const char *project_path = argv[0];
+
+    int err;
+    GenesisContext *genesis_context;
+    if ((err = genesis_context_create(&genesis_context))) {
+        fprintf(stderr, "unable to create context: %s\n", genesis_strerror(err));
+        return 1;
+    }
+
+    User *user = ok_mem(user_create(uint256::random(), os_get_user_name()));
+    Project *project;
+    if ((err = project_open(genesis_context, project_path, user, &project))) {
+        fprintf(stderr, "unable to open %s: %s\n", project_path, genesis_strerror(err));
+        return 1;
+    }
+
+    RenderOutput output = {};
+    output.export_format.sample_rate = (int)sample_rate;
+    output.export_format.resample_quality = (GenesisResampleQuality)resample_quality;
+    output.out_path = argv[6];
+    output.decoded = true;
+
+    AudioGraph *ag;
+    if ((err = audio_graph_create_multi_render(project, genesis_context, &output, 1, &ag))) {
+        fprintf(stderr, "unable to start render: %s\n", genesis_strerror(err));
+        return 1;
+    }
+    audio_graph_set_render_range(ag, start_frame, frame_count, preroll_frames);
+    audio_graph_start_pipeline(ag);
+
+    while (ag->render_frame_index.load() < ag->render_frame_count) {
+        os_cond_timed_wait(ag->render_cond, nullptr, 0.25);
+        fprintf(stdout, "%f\n", ag->render_frame_index.load() / (double)max(1L, ag->render_frame_count));
+        fflush(stdout);
+    }
+
+    audio_graph_destroy(ag);
+    project_close(project);
+    user_destroy(user);
+    genesis_context_destroy(genesis_context);
+    return 0;
+}
@@ -0,0 +1,59 @@
+#ifndef GENESIS_RENDER_COORDINATOR_HPP
+#define GENESIS_RENDER_COORDINATOR_HPP
+
+#include "genesis.h"
+#include "byte_buffer.hpp"
+#include "list.hpp"
+
+struct Project;
+
+// a render can be split into ranges of frames which worker processes
+// render apart, each to a decoded file, and which are then joined into
+// one encoded file. a worker is a genesis process started with
+// RENDER_WORKER_ARG as its first argument.
+
+static const char *const RENDER_WORKER_ARG = "--render-range";
+
+struct RenderRange {
+    long start_frame;
+    long frame_count;
+    // frames before start_frame which the worker runs and then drops, so
+    // that delay and clip tails from before the range are in it
+    long preroll_frames;
+    ByteBuffer out_path;
+};
+
+// splits frame_count frames into up to range_count ranges of about the
+// same size. each range, with its pre-roll, starts on a multiple of
+// alignment. range i is written to "<out_path>.part<i>".
+int render_coordinator_plan(long frame_count, int range_count, long preroll_frames,
+        long alignment, const ByteBuffer &out_path, List<RenderRange> &out_ranges);
+
+// a resampled clip only comes out the same after a seek if the seek lands
+// where the resampler's phase is back at zero. this is the least number of
+// frames at sample_rate after which that is true for every clip.
+long render_coordinator_alignment(Project *project, int sample_rate);
+
+// renders project in range_count worker processes and joins the result
+// into out_path. workers open the project from its file, so it must be
+// saved. worker_exe may be a wrapper which runs the worker on another
+// host, as long as the range files end up readable here.
+int render_coordinator_run(Project *project, GenesisContext *genesis_context,
+        const char *worker_exe, const GenesisExportFormat *export_format,
+        const ByteBuffer &out_path, int range_count, long preroll_frames);
+
+// encodes the ranges one after another into out_path and deletes them.
+// the ranges must be in order and have no gaps.
+int render_coordinator_join(Project *project, GenesisContext *genesis_context,
+        const List<RenderRange> &ranges, const GenesisExportFormat *export_format,
+        const ByteBuffer &out_path);
+
+// the arguments a worker is started with, after RENDER_WORKER_ARG
+void render_worker_args(const ByteBuffer &project_path, const RenderRange *range,
+        int sample_rate, GenesisResampleQuality resample_quality, List<ByteBuffer> &out_args);
+
+// the worker process. argv holds the arguments after RENDER_WORKER_ARG.
+// progress goes to stdout, one fraction per line. returns the exit code.
+int render_worker_main(int argc, char *argv[]);
+
+#endif
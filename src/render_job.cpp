@@ -33,8 +33,17 @@ void render_job_deinit(RenderJob *rj) {
 void render_job_start(RenderJob *rj, const GenesisExportFormat *export_format,
         const ByteBuffer &out_path)
 {
+    RenderOutput output;
+    output.export_format = *export_format;
+    output.out_path = out_path;
+    output.track = nullptr;
+    output.decoded = false;
+    render_job_start_multi(rj, &output, 1);
+}
+
+void render_job_start_multi(RenderJob *rj, const RenderOutput *outputs, int output_count) {
     assert(rj);
-    audio_graph_create_render(rj->project, rj->genesis_context, export_format, out_path,
+    audio_graph_create_multi_render(rj->project, rj->genesis_context, outputs, output_count,
             &rj->audio_graph);
 
     rj->audio_graph->events.attach_handler(EventAudioGraphPlayHeadChanged, on_render_job_updated, rj);
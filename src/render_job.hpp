@@ -4,6 +4,7 @@
 struct Project;
 struct AudioGraph;
 struct GenesisContext;
+struct RenderOutput;
 class Gui;
 
 struct RenderJob {
@@ -18,6 +19,8 @@ void render_job_init(RenderJob *rj, Project *project, GenesisContext *genesis_co
 void render_job_deinit(RenderJob *rj);
 
 void render_job_start(RenderJob *rj, const GenesisExportFormat *export_format, const ByteBuffer &out_path);
+// writes every output from a single pass over the project
+void render_job_start_multi(RenderJob *rj, const RenderOutput *outputs, int output_count);
 float render_job_progress(RenderJob *rj);
 
 void render_job_stop(RenderJob *rj);
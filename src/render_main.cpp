@@ -0,0 +1,139 @@
+#include "os.hpp"
+#include "project.hpp"
+#include "audio_graph.hpp"
+#include "render_coordinator.hpp"
+#include "dsp_kernels.hpp"
+#include "error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// renders a project file without the editor, for machines with no
+// display. progress goes to stdout as one fraction per line.
+
+static int usage(char *exe) {
+    fprintf(stderr, "Usage: %s [options] projectfile outputfile\n"
+            "Options:\n"
+            "--bitrate      bit rate in kbps\n"
+            "--format       format of outputfile\n"
+            "--codec        codec of outputfile\n"
+            "--ranges       render in this many worker processes\n"
+            "--preroll      frames each worker renders before its range\n", exe);
+    return 1;
+}
+
+static int report_error(int err) {
+    fprintf(stderr, "Error: %s\n", genesis_strerror(err));
+    return 1;
+}
+
+static int render(Project *project, GenesisContext *context, const GenesisExportFormat *export_format,
+        const ByteBuffer &out_path)
+{
+    int err;
+    AudioGraph *ag;
+    if ((err = audio_graph_create_render(project, context, export_format, out_path, &ag)))
+        return report_error(err);
+    audio_graph_start_pipeline(ag);
+
+    while (ag->render_frame_index.load() < ag->render_frame_count) {
+        os_cond_timed_wait(ag->render_cond, nullptr, 0.25);
+        fprintf(stdout, "%f\n", ag->render_frame_index.load() / (double)max(1L, ag->render_frame_count));
+        fflush(stdout);
+    }
+
+    audio_graph_destroy(ag);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int err;
+    if ((err = os_init(nullptr)))
+        panic("unable to initialize: %s", genesis_strerror(err));
+    dsp_kernels_init();
+
+    if (argc >= 2 && strcmp(argv[1], RENDER_WORKER_ARG) == 0)
+        return render_worker_main(argc - 2, argv + 2);
+
+    char *project_filename = nullptr;
+    char *output_filename = nullptr;
+    char *format = nullptr;
+    char *codec_name = nullptr;
+    int bit_rate_k = 320;
+    int range_count = 1;
+    long preroll_frames = -1;
+
+    for (int i = 1; i < argc; i += 1) {
+        char *arg = argv[i];
+        if (arg[0] == '-' && arg[1] == '-') {
+            arg += 2;
+            if (i + 1 >= argc) {
+                return usage(argv[0]);
+            } else if (strcmp(arg, "bitrate") == 0) {
+                bit_rate_k = atoi(argv[++i]);
+            } else if (strcmp(arg, "format") == 0) {
+                format = argv[++i];
+            } else if (strcmp(arg, "codec") == 0) {
+                codec_name = argv[++i];
+            } else if (strcmp(arg, "ranges") == 0) {
+                range_count = atoi(argv[++i]);
+            } else if (strcmp(arg, "preroll") == 0) {
+                preroll_frames = atol(argv[++i]);
+            } else {
+                return usage(argv[0]);
+            }
+        } else if (!project_filename) {
+            project_filename = arg;
+        } else if (!output_filename) {
+            output_filename = arg;
+        } else {
+            return usage(argv[0]);
+        }
+    }
+
+    if (!project_filename || !output_filename || range_count < 1)
+        return usage(argv[0]);
+
+    GenesisContext *context;
+    if ((err = genesis_context_create(&context)))
+        return report_error(err);
+
+    User *user = ok_mem(user_create(uint256::random(), os_get_user_name()));
+    Project *project;
+    if ((err = project_open(context, project_filename, user, &project)))
+        return report_error(err);
+
+    GenesisExportFormat export_format;
+    export_format.codec = genesis_guess_audio_file_codec(context, output_filename, format, codec_name);
+    if (!export_format.codec) {
+        fprintf(stderr, "unknown export format\n");
+        return 1;
+    }
+    export_format.sample_format = genesis_audio_file_codec_sample_format_index(export_format.codec,
+            genesis_audio_file_codec_best_sample_format(export_format.codec));
+    export_format.bit_rate = bit_rate_k * 1000;
+    export_format.sample_rate = project->sample_rate;
+    export_format.resample_quality = GenesisResampleQualityMastering;
+    export_format.dither = GenesisDitherTriangular;
+
+    ByteBuffer out_path = output_filename;
+    if (range_count == 1) {
+        if ((err = render(project, context, &export_format, out_path)))
+            return err;
+    } else {
+        if (preroll_frames < 0)
+            preroll_frames = project->sample_rate;
+        // the workers are more of this program
+        if ((err = render_coordinator_run(project, context, argv[0], &export_format, out_path,
+                        range_count, preroll_frames)))
+        {
+            return report_error(err);
+        }
+    }
+
+    project_close(project);
+    user_destroy(user);
+    genesis_context_destroy(context);
+    return 0;
+}
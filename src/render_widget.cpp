@@ -265,12 +265,15 @@ void RenderWidget::my_on_render_activate() {
     export_format.sample_format = sample_format;
     export_format.bit_rate = bit_rate;
     export_format.sample_rate = project->sample_rate;
+    export_format.resample_quality = GenesisResampleQualityMastering;
+    export_format.dither = GenesisDitherTriangular;
 
     ByteBuffer out_path = output_file_text->text().encode();
     render_job_start(rj, &export_format, out_path);
 }
 
 void RenderWidget::refresh_render_jobs() {
+    queue_redraw();
     while (job_list.length() < gui->render_jobs.length()) {
         ok_or_panic(job_list.add_one());
         RenderWidgetJob *rwj = &job_list.last();
@@ -0,0 +1,108 @@
+#include "replication.hpp"
+#include "util.hpp"
+
+// a message is the type, a revision, and for a delta the encoded transaction
+static const int MESSAGE_HEADER_SIZE = 5;
+
+static void write_message(ByteBuffer &out, ReplicationMessageType type, int revision) {
+    out.clear();
+    out.append_uint8(type);
+    out.append_uint32be(revision);
+}
+
+// sends the rows from first_revision to the end of the log
+static int send_deltas(ReplicationPeer *peer, int first_revision, List<ByteBuffer> &out_messages) {
+    Project *project = peer->project;
+    int next_revision = project_get_next_revision(project);
+    int revision = first_revision;
+    int err;
+    while (revision < next_revision) {
+        ByteBuffer delta;
+        int end_revision;
+        if ((err = project_encode_delta(project, revision, REPLICATION_MAX_DELTA_REVISIONS,
+                        delta, &end_revision)))
+        {
+            return err;
+        }
+        if ((err = out_messages.add_one()))
+            return err;
+        ByteBuffer &message = out_messages.last();
+        write_message(message, ReplicationMessageTypeDelta, revision);
+        message.append(delta);
+        revision = end_revision;
+    }
+    peer->sent_revision = next_revision;
+    peer->sent_rewrite_serial = project->command_log_rewrite_serial;
+    return 0;
+}
+
+void replication_peer_init(ReplicationPeer *peer, Project *project) {
+    peer->project = project;
+    peer->connected = false;
+    peer->sent_revision = -1;
+    peer->sent_rewrite_serial = 0;
+}
+
+void replication_peer_connect(ReplicationPeer *peer, ByteBuffer &out_message) {
+    peer->connected = true;
+    peer->sent_revision = -1;
+    write_message(out_message, ReplicationMessageTypeHello, project_get_next_revision(peer->project));
+}
+
+void replication_peer_disconnect(ReplicationPeer *peer) {
+    peer->connected = false;
+    peer->sent_revision = -1;
+}
+
+int replication_peer_receive(ReplicationPeer *peer, const ByteBuffer &message,
+        List<ByteBuffer> &out_messages)
+{
+    if (message.length() < MESSAGE_HEADER_SIZE)
+        return GenesisErrorInvalidFormat;
+    Project *project = peer->project;
+    int revision = read_uint32be(message.raw() + 1);
+    if (revision < 0)
+        return GenesisErrorInvalidFormat;
+
+    switch ((ReplicationMessageType)(uint8_t)message.at(0)) {
+        case ReplicationMessageTypeHello:
+            // the last revision the other side has goes again, so that it
+            // can tell whether the two copies went apart
+            peer->connected = true;
+            return send_deltas(peer, max(revision - 1, 0), out_messages);
+        case ReplicationMessageTypeDelta:
+        {
+            int next_revision = project_get_next_revision(project);
+            ByteBuffer delta(message.raw() + MESSAGE_HEADER_SIZE, message.length() - MESSAGE_HEADER_SIZE);
+            int missing_revision;
+            int err = project_apply_delta(project, delta, &missing_revision);
+            if (err)
+                return err;
+            if (missing_revision != -1) {
+                if ((err = out_messages.add_one()))
+                    return err;
+                write_message(out_messages.last(), ReplicationMessageTypeHello, missing_revision);
+                return 0;
+            }
+            // the other side has what it just sent, so it does not go back
+            if (peer->sent_revision == next_revision)
+                peer->sent_revision = project_get_next_revision(project);
+            return 0;
+        }
+    }
+    return GenesisErrorInvalidFormat;
+}
+
+int replication_peer_poll(ReplicationPeer *peer, List<ByteBuffer> &out_messages) {
+    if (!peer->connected || peer->sent_revision == -1)
+        return 0;
+    Project *project = peer->project;
+    int next_revision = project_get_next_revision(project);
+    int first_revision = peer->sent_revision;
+    // a merge rewrote the last command
+    if (peer->sent_rewrite_serial != project->command_log_rewrite_serial)
+        first_revision = min(first_revision, next_revision - 1);
+    if (first_revision >= next_revision)
+        return 0;
+    return send_deltas(peer, first_revision, out_messages);
+}
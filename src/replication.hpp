@@ -0,0 +1,40 @@
+#ifndef REPLICATION_HPP
+#define REPLICATION_HPP
+
+#include "project.hpp"
+
+// keeps another copy of a project up to date with this one by sending it
+// the command log rows it lacks, a few hundred revisions to a delta. the
+// messages go over whatever connection the caller has, in order. each side
+// of a session has its own peer and calls replication_peer_connect when
+// the connection comes up, again after it drops; the hellos tell each side
+// where the other one is, so only the missing revisions are sent.
+
+enum ReplicationMessageType {
+    ReplicationMessageTypeHello = 1,
+    ReplicationMessageTypeDelta,
+};
+
+static const int REPLICATION_MAX_DELTA_REVISIONS = 256;
+
+struct ReplicationPeer {
+    Project *project;
+    bool connected;
+    // the next revision to send, or -1 until the other side says hello
+    int sent_revision;
+    long sent_rewrite_serial;
+};
+
+void replication_peer_init(ReplicationPeer *peer, Project *project);
+// out_message goes to the other side
+void replication_peer_connect(ReplicationPeer *peer, ByteBuffer &out_message);
+void replication_peer_disconnect(ReplicationPeer *peer);
+// takes a message from the other side and adds the answers to
+// out_messages. returns GenesisErrorConflict when the two copies have
+// different commands at the same revision.
+int replication_peer_receive(ReplicationPeer *peer, const ByteBuffer &message,
+        List<ByteBuffer> &out_messages);
+// adds deltas of the commands performed here since the last call
+int replication_peer_poll(ReplicationPeer *peer, List<ByteBuffer> &out_messages);
+
+#endif
@@ -1,48 +1,139 @@
 #include "resample.hpp"
 #include "audio_file.hpp"
+#include "dsp_kernels.hpp"
 #include "util.hpp"
 
 static const double PI = 3.14159265358979323846;
-static const double transition_band_hz = 800.0;
+// above this many phases the filter bank is sampled at interpolated_phase_count
+// phases and resample_run interpolates between neighboring ones
+static const int max_exact_phase_count = 1024;
+static const int interpolated_phase_count = 512;
+// input frames mixed into the history buffer at a time
+static const int chunk_frame_count = 1024;
+// an adaptive conversion steps through the input in this many phases a
+// frame, fine enough that any ratio is within a part per billion
+static const long adaptive_upsample_factor = 1L << 30;
+// the drift control settles with this angular frequency, in radians a
+// second, and critical damping. slow, so that the jitter of device
+// callbacks does not wobble the pitch, and averaged over about a second.
+static const double drift_control_omega = 0.1;
+static const double drift_fill_time_constant = 1.0;
+
+struct ResampleQualityPreset {
+    double transition_band_hz;
+    // taps for every transition band's worth of input sample rate
+    double taps_per_band;
+    // 0.0 for a blackman window
+    double kaiser_beta;
+};
+
+// indexed by GenesisResampleQuality
+static const ResampleQualityPreset quality_presets[] = {
+    {6000.0, 4.0, 0.0},
+    {800.0, 4.0, 0.0},
+    // about 117 dB of stop band attenuation
+    {400.0, 7.6, 12.0},
+};
+static_assert(array_length(quality_presets) == GenesisResampleQualityMastering + 1, "");
+
+struct ResampleDescriptorContext {
+    GenesisResampleQuality quality;
+};
 
 static const double lfe_mix_level = 1.0;
 static const double surround_mix_level = 1.0;
 
+// polyphase filter bank: upsampling by upsample_factor and downsampling by
+// downsample_factor is computed without ever forming the oversampled signal.
+// the output frame at oversampled time t = base * upsample_factor + phase
+// only depends on the input frames up to base, weighted by sub-filter phase.
 struct ResampleContext {
     bool in_connected;
     bool out_connected;
 
-    long over_offset;
-
     long upsample_factor;
     long downsample_factor;
-
-    float *impulse_response;
-    int impulse_response_size;
-
-    long oversampled_rate;
-
+    // downsample_factor = downsample_whole * upsample_factor + downsample_fraction
+    long downsample_whole;
+    long downsample_fraction;
+
+    // the ratio follows resample_context_set_correction, around
+    // nominal_ratio, instead of staying in_sample_rate / out_sample_rate
+    bool adaptive;
+    double nominal_ratio;
+
+    // fractional-phase accumulator: the next output frame is at phase
+    // phase / upsample_factor past input frame next_base, counted from the
+    // first frame not yet consumed from the input port
+    long phase;
+    long next_base;
+
+    // (phase_count + 1) sub-filters of tap_count coefficients each, reversed
+    // so that each output sample is a dot product with tap_count consecutive
+    // input frames. nullptr when the sample rates match.
+    float *filters;
+    int filters_size;
+    int tap_count;
+    int phase_count;
+    bool interpolate_phases;
+
+    // one buffer per output channel: tap_count - 1 frames of history then
+    // up to chunk_frame_count frames of channel mixed input
+    float *history;
+    int history_size;
+    int history_frame_count;
+    // how many of the last input frames consumed are known to be silence.
+    // once the history is all silence, so is what silent input makes.
+    long silent_frame_count;
+
+    int in_channel_count;
+    int out_channel_count;
     float channel_matrix[GENESIS_CHANNEL_ID_COUNT][GENESIS_CHANNEL_ID_COUNT];
+    // channel_matrix maps every channel to itself, so it can be skipped
+    bool identity_remap;
+    // chosen for the output channel count
+    const DspChannelKernels *kernels;
 };
 
 static double sinc(double x) {
     return (x == 0.0) ? 1.0 : (sin(PI * x) / (PI * x));
 }
 
-static double blackman_window(double n, double size) {
+static double blackman_window(double x, double size) {
     return 0.42 -
-        0.50 * cos(2.0 * PI * n / (size - 1.0)) +
-        0.08 * cos(4.0 * PI * n / (size - 1.0));
+        0.50 * cos(2.0 * PI * x / size) +
+        0.08 * cos(4.0 * PI * x / size);
 }
 
-static void resample_destroy(struct GenesisNode *node) {
-    struct ResampleContext *resample_context = (struct ResampleContext *)node->userdata;
+// zeroth order modified bessel function of the first kind
+static double bessel_i0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; term > sum * 1e-12; k += 1) {
+        double factor = x / (2.0 * k);
+        term *= factor * factor;
+        sum += term;
+    }
+    return sum;
+}
+
+static double kaiser_window(double x, double size, double beta) {
+    double t = 2.0 * x / size - 1.0;
+    return bessel_i0(beta * sqrt(max(0.0, 1.0 - t * t))) / bessel_i0(beta);
+}
+
+void resample_context_destroy(ResampleContext *resample_context) {
     if (resample_context) {
-        destroy(resample_context->impulse_response, resample_context->impulse_response_size);
+        destroy(resample_context->filters, resample_context->filters_size);
+        destroy(resample_context->history, resample_context->history_size);
         destroy(resample_context, 1);
     }
 }
 
+static void resample_destroy(struct GenesisNode *node) {
+    resample_context_destroy((struct ResampleContext *)node->userdata);
+}
+
 static int resample_create(struct GenesisNode *node) {
     ResampleContext *resample_context = create_zero<ResampleContext>();
     node->userdata = resample_context;
@@ -53,169 +144,313 @@ static int resample_create(struct GenesisNode *node) {
     return 0;
 }
 
+void resample_context_reset(ResampleContext *resample_context) {
+    resample_context->phase = 0;
+    resample_context->next_base = 0;
+    resample_context->silent_frame_count = resample_context->tap_count;
+    if (resample_context->history)
+        memset(resample_context->history, 0, resample_context->history_size * sizeof(float));
+}
+
 static void resample_seek(struct GenesisNode *node) {
-    struct ResampleContext *resample_context = (struct ResampleContext *)node->userdata;
-    resample_context->over_offset = 0;
+    resample_context_reset((struct ResampleContext *)node->userdata);
 }
 
-static float get_channel_value(float *samples, ResampleContext *resample_context,
-        const struct SoundIoChannelLayout *in_layout,
-        const struct SoundIoChannelLayout *out_layout,
+static float get_channel_value(const float *samples, ResampleContext *resample_context,
         int in_frame_index, int out_channel_index)
 {
+    int in_channel_count = resample_context->in_channel_count;
     float sum = 0.0f;
-    for (int in_ch = 0; in_ch < in_layout->channel_count; in_ch += 1) {
-        float in_sample = samples[in_frame_index * in_layout->channel_count + in_ch];
+    for (int in_ch = 0; in_ch < in_channel_count; in_ch += 1) {
+        float in_sample = samples[in_frame_index * in_channel_count + in_ch];
         sum += resample_context->channel_matrix[out_channel_index][in_ch] * in_sample;
     }
     return sum;
 }
 
-static void resample_run(struct GenesisNode *node) {
-    struct ResampleContext *resample_context = (struct ResampleContext *)node->userdata;
-    struct GenesisPort *audio_in_port = node->ports[0];
-    struct GenesisPort *audio_out_port = node->ports[1];
-
-    int input_frame_count = genesis_audio_in_port_fill_count(audio_in_port);
-    int output_frame_count = genesis_audio_out_port_free_count(audio_out_port);
-
-    const struct SoundIoChannelLayout * in_channel_layout = genesis_audio_port_channel_layout(audio_in_port);
-    const struct SoundIoChannelLayout * out_channel_layout = genesis_audio_port_channel_layout(audio_out_port);
-
-    int out_channel_count = out_channel_layout->channel_count;
+// stage one: channel remap frame_count interleaved input frames starting at
+// in_frame into each output channel's buffer, starting at dest_frame
+static void remap_into_history(ResampleContext *resample_context, const float *in_buf,
+        int in_channel_count, int out_channel_count, int in_frame, int dest_frame, int frame_count)
+{
+    int history_frame_count = resample_context->history_frame_count;
+    const float *in_frames = in_buf + in_frame * in_channel_count;
+    if (resample_context->identity_remap) {
+        resample_context->kernels->deinterleave(out_channel_count,
+                resample_context->history + dest_frame, history_frame_count, in_frames, frame_count);
+        return;
+    }
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        const float *in_frame_samples = in_frames + frame * in_channel_count;
+        for (int ch = 0; ch < out_channel_count; ch += 1) {
+            const float *row = resample_context->channel_matrix[ch];
+            float sum = 0.0f;
+            for (int in_ch = 0; in_ch < in_channel_count; in_ch += 1)
+                sum += row[in_ch] * in_frame_samples[in_ch];
+            resample_context->history[ch * history_frame_count + dest_frame + frame] = sum;
+        }
+    }
+}
 
-    float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
-    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+void resample_convert(ResampleContext *resample_context, const float *in_buf, int input_frame_count,
+        float *out_buf, int output_frame_count, int *out_consumed, int *out_written)
+{
+    int in_channel_count = resample_context->in_channel_count;
+    int out_channel_count = resample_context->out_channel_count;
 
-    if (!resample_context->impulse_response) {
+    if (!resample_context->filters) {
         // no resampling; only channel remapping
         int frame_count = min(input_frame_count, output_frame_count);
-        for (int frame = 0; frame < frame_count; frame += 1) {
-            for (int ch = 0; ch < out_channel_count; ch += 1) {
-                out_buf[frame * out_channel_count + ch] = get_channel_value(in_buf,
-                        resample_context, in_channel_layout, out_channel_layout, frame, ch);
+        if (resample_context->identity_remap) {
+            memcpy(out_buf, in_buf, frame_count * out_channel_count * sizeof(float));
+        } else {
+            for (int frame = 0; frame < frame_count; frame += 1) {
+                for (int ch = 0; ch < out_channel_count; ch += 1)
+                    out_buf[frame * out_channel_count + ch] = get_channel_value(in_buf, resample_context, frame, ch);
             }
         }
-        genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
-        genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+        *out_consumed = frame_count;
+        *out_written = frame_count;
         return;
     }
 
-    // pretend that we have upsampled the input to the oversample rate by adding zeroes
-    // now low-pass filter using our impulse response window
-
-    int window_size = resample_context->impulse_response_size;
-    int half_window_size = window_size / 2;
-
-    // compute available input start and end in oversample coordinates
-    long over_input_start = resample_context->over_offset;
-    long over_input_end = over_input_start + input_frame_count * resample_context->upsample_factor;
-
-    // compute available output start and end in oversample coordinates
-    long over_output_start = resample_context->over_offset;
-    long over_output_end = over_output_start + output_frame_count * resample_context->downsample_factor;
-
-    long over_actual_input_end = over_input_end - half_window_size;
-
-    if (over_actual_input_end <= over_output_start)
-        return;
-
-    long over_actual_output_end = min(over_output_end, over_actual_input_end);
-    long over_out_count = over_actual_output_end - over_output_start;
-    assert(over_out_count > 0);
-
-    // actual output frame count in output sample rate coordinates
-    int out_frame_count = over_out_count / resample_context->downsample_factor;
-    assert(out_frame_count >= 0);
-    if (out_frame_count == 0)
-        return;
-
-    int in_frame_count = over_out_count / resample_context->upsample_factor;
-
-    for (long frame = 0; frame < out_frame_count; frame += 1) {
-        long over_frame = resample_context->over_offset + (frame * resample_context->downsample_factor);
-        // calculate this oversampled frame
-        float total[GENESIS_MAX_CHANNELS] = {0.0f};
+    int tap_count = resample_context->tap_count;
+    int history_frame_count = resample_context->history_frame_count;
+    int kept_frame_count = tap_count - 1;
+    long upsample_factor = resample_context->upsample_factor;
+    double phase_scale = resample_context->phase_count / (double)upsample_factor;
+    const DspChannelKernels *kernels = resample_context->kernels;
+
+    int in_frames_consumed = 0;
+    int out_frames_written = 0;
+    while (out_frames_written < output_frame_count) {
+        int chunk_frames = min(input_frame_count - in_frames_consumed, chunk_frame_count);
+        if (chunk_frames == 0)
+            break;
+
+        // remap this chunk into the per channel buffers, after the history.
+        // frames before next_base are remapped too because they become history.
+        remap_into_history(resample_context, in_buf, in_channel_count,
+                out_channel_count, in_frames_consumed, kept_frame_count, chunk_frames);
+
+        // stage two: FIR per output channel
+
+        while (resample_context->next_base < chunk_frames && out_frames_written < output_frame_count) {
+            // the window ends at the newest frame, next_base
+            const float *window = resample_context->history + resample_context->next_base;
+            float *out_frame = out_buf + out_frames_written * out_channel_count;
+            if (resample_context->interpolate_phases) {
+                double position = resample_context->phase * phase_scale;
+                int filter_index = (int)position;
+                float fraction = position - filter_index;
+                const float *filter = resample_context->filters + filter_index * tap_count;
+                kernels->fir_frame_lerp(out_channel_count, out_frame, filter, fraction,
+                        window, history_frame_count, tap_count);
+            } else {
+                const float *filter = resample_context->filters + resample_context->phase * tap_count;
+                kernels->fir_frame(out_channel_count, out_frame, filter,
+                        window, history_frame_count, tap_count);
+            }
+            out_frames_written += 1;
 
-        int impulse_start = resample_context->upsample_factor - (((over_frame - half_window_size) +
-                (resample_context->upsample_factor * half_window_size)) % resample_context->upsample_factor);
-        for (int impulse_i = impulse_start; impulse_i < window_size;
-                impulse_i += resample_context->upsample_factor)
-        {
-            long over_in_index = over_frame + (impulse_i - half_window_size);
-            int in_index = (over_in_index - resample_context->over_offset) / resample_context->upsample_factor;
-            if (in_index < 0)
-                continue;
-            for (int ch = 0; ch < out_channel_count; ch += 1) {
-                float over_value = get_channel_value(in_buf, resample_context,
-                        in_channel_layout, out_channel_layout, in_index, ch);
-                int impulse_response_index = window_size - impulse_i - 1;
-                total[ch] += resample_context->impulse_response[impulse_response_index] * over_value;
+            resample_context->phase += resample_context->downsample_fraction;
+            resample_context->next_base += resample_context->downsample_whole;
+            if (resample_context->phase >= upsample_factor) {
+                resample_context->phase -= upsample_factor;
+                resample_context->next_base += 1;
             }
         }
+
+        // input frames before next_base are only needed as history now
+        int consumed = min((long)chunk_frames, resample_context->next_base);
         for (int ch = 0; ch < out_channel_count; ch += 1) {
-            int out_sample_index = frame * out_channel_count + ch;
-            out_buf[out_sample_index] = total[ch];
+            float *channel_history = resample_context->history + ch * history_frame_count;
+            memmove(channel_history, channel_history + consumed, kept_frame_count * sizeof(float));
         }
+        resample_context->next_base -= consumed;
+        in_frames_consumed += consumed;
+        if (consumed < chunk_frames)
+            break;
     }
 
-    genesis_audio_in_port_advance_read_ptr(audio_in_port, in_frame_count);
-    genesis_audio_out_port_advance_write_ptr(audio_out_port, out_frame_count);
+    *out_consumed = in_frames_consumed;
+    *out_written = out_frames_written;
+}
 
-    resample_context->over_offset = (resample_context->over_offset +
-            out_frame_count * resample_context->downsample_factor) % resample_context->oversampled_rate;
+// moves the phase on as resample_convert would for input_frame_count frames
+// of silence after a history of silence, which only make silence
+static void advance_silence(ResampleContext *resample_context, int input_frame_count,
+        int output_frame_count, int *out_consumed, int *out_written)
+{
+    long upsample_factor = resample_context->upsample_factor;
+    int written = 0;
+    while (resample_context->next_base < input_frame_count && written < output_frame_count) {
+        written += 1;
+        resample_context->phase += resample_context->downsample_fraction;
+        resample_context->next_base += resample_context->downsample_whole;
+        if (resample_context->phase >= upsample_factor) {
+            resample_context->phase -= upsample_factor;
+            resample_context->next_base += 1;
+        }
+    }
+    int consumed = min((long)input_frame_count, resample_context->next_base);
+    resample_context->next_base -= consumed;
+    *out_consumed = consumed;
+    *out_written = written;
 }
 
-static int port_connected(struct GenesisNode *node) {
+static void resample_run(struct GenesisNode *node) {
     struct ResampleContext *resample_context = (struct ResampleContext *)node->userdata;
-    if (!resample_context->in_connected || !resample_context->out_connected)
-        return 0;
-
     struct GenesisPort *audio_in_port = node->ports[0];
     struct GenesisPort *audio_out_port = node->ports[1];
 
-    int in_sample_rate = genesis_audio_port_sample_rate(audio_in_port);
-    int out_sample_rate = genesis_audio_port_sample_rate(audio_out_port);
+    int input_frame_count = genesis_audio_in_port_fill_count(audio_in_port);
+    int output_frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    int silent_count = genesis_audio_in_port_silent_count(audio_in_port);
+
+    if (!resample_context->filters) {
+        int frame_count = min(input_frame_count, output_frame_count);
+        if (silent_count >= frame_count) {
+            genesis_audio_out_port_write_silence(audio_out_port, frame_count);
+            genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+            return;
+        }
+    }
 
-    int gcd = greatest_common_denominator(in_sample_rate, out_sample_rate);
-    resample_context->upsample_factor = out_sample_rate / gcd;
-    resample_context->downsample_factor = in_sample_rate / gcd;
+    int consumed;
+    int written;
+    if (resample_context->filters && silent_count > 0 &&
+        resample_context->silent_frame_count >= resample_context->tap_count - 1)
+    {
+        // the filter only sees silence until the end of the silent input
+        advance_silence(resample_context, min(silent_count, input_frame_count), output_frame_count,
+                &consumed, &written);
+        resample_context->silent_frame_count += consumed;
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, consumed);
+        genesis_audio_out_port_write_silence(audio_out_port, written);
+        input_frame_count -= consumed;
+        output_frame_count -= written;
+        silent_count -= consumed;
+        if (input_frame_count == 0 || output_frame_count == 0)
+            return;
+    }
 
-    resample_context->oversampled_rate = in_sample_rate * resample_context->upsample_factor;
+    resample_convert(resample_context, genesis_audio_in_port_read_ptr(audio_in_port), input_frame_count,
+            genesis_audio_out_port_write_ptr(audio_out_port), output_frame_count, &consumed, &written);
+    if (silent_count >= consumed)
+        resample_context->silent_frame_count += consumed;
+    else
+        resample_context->silent_frame_count = 0;
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, consumed);
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, written);
+}
 
-    if (in_sample_rate == out_sample_rate) {
-        destroy(resample_context->impulse_response, resample_context->impulse_response_size);
-        resample_context->impulse_response = nullptr;
-    } else {
-        double cutoff_freq_hz = min(in_sample_rate, out_sample_rate) / 2.0;
-        double cutoff_freq_float = cutoff_freq_hz / (double)resample_context->oversampled_rate;
+void resample_build_filters(float *filters, int tap_count, int phase_count, double cutoff,
+        double kaiser_beta)
+{
+    double center = tap_count / 2.0;
+    for (int p = 0; p <= phase_count; p += 1) {
+        float *filter = filters + p * tap_count;
+        double sum = 0.0;
+        for (int k = 0; k < tap_count; k += 1) {
+            double x = k + p / (double)phase_count;
+            double window = (kaiser_beta > 0.0) ?
+                kaiser_window(x, tap_count, kaiser_beta) : blackman_window(x, tap_count);
+            double sample = cutoff * sinc(cutoff * (x - center)) * window;
+            filter[tap_count - 1 - k] = sample;
+            sum += sample;
+        }
+        // unity gain at DC for every phase
+        for (int k = 0; k < tap_count; k += 1)
+            filter[k] /= sum;
+    }
+}
 
-        double transition_band = transition_band_hz / resample_context->oversampled_rate;
-        int window_size = ceil(4.0 / transition_band);
-        window_size += !(window_size % 2);
+static int init_filters(ResampleContext *resample_context, int in_sample_rate, int out_sample_rate,
+        int channel_count, const ResampleQualityPreset *preset)
+{
+    // a whole number of 8 wide vectors
+    int tap_count = ceil(preset->taps_per_band * in_sample_rate / preset->transition_band_hz);
+    tap_count = (tap_count + 7) & ~7;
+
+    long upsample_factor = resample_context->upsample_factor;
+    bool interpolate_phases = upsample_factor > max_exact_phase_count;
+    int phase_count = interpolate_phases ? interpolated_phase_count : upsample_factor;
+
+    int filters_size = (phase_count + 1) * tap_count;
+    int history_frame_count = tap_count - 1 + chunk_frame_count;
+    int history_size = history_frame_count * channel_count;
+
+    destroy(resample_context->filters, resample_context->filters_size);
+    destroy(resample_context->history, resample_context->history_size);
+    resample_context->filters = allocate_zero<float>(filters_size);
+    resample_context->filters_size = filters_size;
+    resample_context->history = allocate_zero<float>(history_size);
+    resample_context->history_size = history_size;
+    if (!resample_context->filters || !resample_context->history) {
+        destroy(resample_context->filters, resample_context->filters_size);
+        destroy(resample_context->history, resample_context->history_size);
+        resample_context->filters = nullptr;
+        resample_context->history = nullptr;
+        return GenesisErrorNoMem;
+    }
 
-        float *new_impulse_response = reallocate_safe(resample_context->impulse_response,
-                resample_context->impulse_response_size, window_size);
+    resample_context->tap_count = tap_count;
+    resample_context->phase_count = phase_count;
+    resample_context->interpolate_phases = interpolate_phases;
+    resample_context->history_frame_count = history_frame_count;
 
-        if (!new_impulse_response)
-            return GenesisErrorNoMem;
+    // cutoff relative to the input nyquist frequency
+    double cutoff = min(in_sample_rate, out_sample_rate) / (double)in_sample_rate;
+    resample_build_filters(resample_context->filters, tap_count, phase_count, cutoff, preset->kaiser_beta);
+    return 0;
+}
 
-        resample_context->impulse_response = new_impulse_response;
-        resample_context->impulse_response_size = window_size;
+static void set_downsample_factor(ResampleContext *resample_context, long downsample_factor) {
+    resample_context->downsample_factor = downsample_factor;
+    resample_context->downsample_whole = downsample_factor / resample_context->upsample_factor;
+    resample_context->downsample_fraction = downsample_factor % resample_context->upsample_factor;
+}
 
-        // create impulse response by sampling the sinc function and then
-        // multiplying by the blackman window
-        for (int i = 0; i < window_size; i += 1) {
-            // sample the sinc function
-            double sinc_sample = sinc(2.0 * cutoff_freq_float * (i - (window_size - 1) / 2.0));
-            double sample = sinc_sample * blackman_window(i, window_size);
-            resample_context->impulse_response[i] = sample;
+static int init_resample_context(ResampleContext *resample_context,
+        int in_sample_rate, const struct SoundIoChannelLayout *in_channel_layout,
+        int out_sample_rate, const struct SoundIoChannelLayout *out_channel_layout,
+        const ResampleQualityPreset *preset, bool adaptive)
+{
+    resample_context->in_channel_count = in_channel_layout->channel_count;
+    resample_context->out_channel_count = out_channel_layout->channel_count;
+
+    resample_context->adaptive = adaptive;
+    resample_context->nominal_ratio = in_sample_rate / (double)out_sample_rate;
+    if (adaptive) {
+        // the ratio is never exact, so there is no common denominator
+        resample_context->upsample_factor = adaptive_upsample_factor;
+        set_downsample_factor(resample_context,
+                llround(resample_context->nominal_ratio * adaptive_upsample_factor));
+    } else {
+        int gcd = greatest_common_denominator(in_sample_rate, out_sample_rate);
+        resample_context->upsample_factor = out_sample_rate / gcd;
+        set_downsample_factor(resample_context, in_sample_rate / gcd);
+    }
+    resample_context->phase = 0;
+    resample_context->next_base = 0;
+
+    if (in_sample_rate == out_sample_rate && !adaptive) {
+        destroy(resample_context->filters, resample_context->filters_size);
+        destroy(resample_context->history, resample_context->history_size);
+        resample_context->filters = nullptr;
+        resample_context->history = nullptr;
+    } else {
+        int err;
+        if ((err = init_filters(resample_context, in_sample_rate, out_sample_rate,
+                        out_channel_layout->channel_count, preset)))
+        {
+            return err;
         }
+        resample_context->silent_frame_count = resample_context->tap_count;
     }
 
     // set up channel matrix
-    const struct SoundIoChannelLayout * in_channel_layout = genesis_audio_port_channel_layout(audio_in_port);
-    const struct SoundIoChannelLayout * out_channel_layout = genesis_audio_port_channel_layout(audio_out_port);
     memset(resample_context->channel_matrix, 0, sizeof(resample_context->channel_matrix));
 
     int in_contains[GENESIS_CHANNEL_ID_COUNT];
@@ -381,9 +616,138 @@ static int port_connected(struct GenesisNode *node) {
         }
     }
 
+    resample_context->kernels = dsp_channel_kernels(out_channel_layout->channel_count);
+    resample_context->identity_remap = (in_channel_layout->channel_count == out_channel_layout->channel_count);
+    for (int out_ch = 0; out_ch < out_channel_layout->channel_count; out_ch += 1) {
+        for (int in_ch = 0; in_ch < in_channel_layout->channel_count; in_ch += 1) {
+            float expected = (in_ch == out_ch) ? 1.0f : 0.0f;
+            if (resample_context->channel_matrix[out_ch][in_ch] != expected)
+                resample_context->identity_remap = false;
+        }
+    }
+
+    return 0;
+}
+
+static int port_connected(struct GenesisNode *node) {
+    struct ResampleContext *resample_context = (struct ResampleContext *)node->userdata;
+    if (!resample_context->in_connected || !resample_context->out_connected)
+        return 0;
+
+    struct GenesisPort *audio_in_port = node->ports[0];
+    struct GenesisPort *audio_out_port = node->ports[1];
+    ResampleDescriptorContext *descr_context =
+        (ResampleDescriptorContext *)genesis_node_descriptor_userdata(node->descriptor);
+    return init_resample_context(resample_context,
+            genesis_audio_port_sample_rate(audio_in_port), genesis_audio_port_channel_layout(audio_in_port),
+            genesis_audio_port_sample_rate(audio_out_port), genesis_audio_port_channel_layout(audio_out_port),
+            &quality_presets[descr_context->quality], false);
+}
+
+int resample_context_create(int in_sample_rate, const struct SoundIoChannelLayout *in_channel_layout,
+        int out_sample_rate, const struct SoundIoChannelLayout *out_channel_layout,
+        enum GenesisResampleQuality quality, ResampleContext **out_resample_context)
+{
+    *out_resample_context = nullptr;
+    ResampleContext *resample_context = create_zero<ResampleContext>();
+    if (!resample_context)
+        return GenesisErrorNoMem;
+    int err;
+    if ((err = init_resample_context(resample_context, in_sample_rate, in_channel_layout,
+                    out_sample_rate, out_channel_layout, &quality_presets[quality], false)))
+    {
+        resample_context_destroy(resample_context);
+        return err;
+    }
+    *out_resample_context = resample_context;
+    return 0;
+}
+
+int resample_context_create_adaptive(int in_sample_rate, int out_sample_rate,
+        const struct SoundIoChannelLayout *channel_layout, enum GenesisResampleQuality quality,
+        ResampleContext **out_resample_context)
+{
+    *out_resample_context = nullptr;
+    ResampleContext *resample_context = create_zero<ResampleContext>();
+    if (!resample_context)
+        return GenesisErrorNoMem;
+    int err;
+    if ((err = init_resample_context(resample_context, in_sample_rate, channel_layout,
+                    out_sample_rate, channel_layout, &quality_presets[quality], true)))
+    {
+        resample_context_destroy(resample_context);
+        return err;
+    }
+    *out_resample_context = resample_context;
     return 0;
 }
 
+void resample_context_set_correction(ResampleContext *resample_context, double correction) {
+    assert(resample_context->adaptive);
+    // the phase is within the same upsample_factor, so it carries over
+    set_downsample_factor(resample_context,
+            llround(resample_context->nominal_ratio * (1.0 + correction) * resample_context->upsample_factor));
+}
+
+void resample_drift_control_init(ResampleDriftControl *control, int frame_rate, double target_fill,
+        double max_correction)
+{
+    control->frame_rate = frame_rate;
+    control->target_fill = target_fill;
+    control->max_correction = max_correction;
+    // the buffer fills at frame_rate * (drift - correction) frames a
+    // second, so with correction = kp * error + ki * integral of error
+    // the loop is s^2 + frame_rate * (kp * s + ki), with both poles at
+    // -drift_control_omega
+    control->kp = 2.0 * drift_control_omega / frame_rate;
+    control->ki = drift_control_omega * drift_control_omega / frame_rate;
+    control->integral = 0.0;
+    control->correction = 0.0;
+    resample_drift_control_reset(control);
+}
+
+void resample_drift_control_reset(ResampleDriftControl *control) {
+    control->filtered_fill = -1.0;
+    control->written_frame_count = 0;
+    control->clock_known = false;
+}
+
+double resample_drift_control_update(ResampleDriftControl *control, int measured_fill, int frame_count,
+        double read_position)
+{
+    double dt = frame_count / (double)control->frame_rate;
+    // the fill is only ever measured right after a write, and how much the
+    // reader took since its own last read slowly changes as the clocks
+    // drift apart, so it swings by a whole read at the rate they beat. the
+    // reader's clock has no such steps.
+    control->written_frame_count += frame_count;
+    double fill = measured_fill;
+    if (read_position >= 0.0) {
+        double lead = control->written_frame_count - read_position;
+        if (!control->clock_known) {
+            control->clock_offset = lead - measured_fill;
+            control->clock_known = true;
+        }
+        fill = lead - control->clock_offset;
+    } else {
+        control->clock_known = false;
+    }
+    if (control->filtered_fill < 0.0) {
+        control->filtered_fill = fill;
+    } else {
+        double alpha = 1.0 - exp(-dt / drift_fill_time_constant);
+        control->filtered_fill += alpha * (fill - control->filtered_fill);
+    }
+    double error = control->filtered_fill - control->target_fill;
+    // the integral alone makes up for the drift once settled, and is kept
+    // from winding up past what the correction can be
+    double max_integral = control->max_correction / control->ki;
+    control->integral = clamp(-max_integral, control->integral + error * dt, max_integral);
+    control->correction = clamp(-control->max_correction,
+            control->kp * error + control->ki * control->integral, control->max_correction);
+    return control->correction;
+}
+
 static int in_connect(struct GenesisPort *port, struct GenesisPort *other_port) {
     struct GenesisNode *node = genesis_port_node(port);
     struct ResampleContext *resample_context = (struct ResampleContext *)node->userdata;
@@ -410,6 +774,31 @@ static void out_disconnect(struct GenesisPort *port, struct GenesisPort *other_p
     resample_context->out_connected = false;
 }
 
+static void destroy_node_descriptor(struct GenesisNodeDescriptor *node_descr) {
+    ResampleDescriptorContext *descr_context = (ResampleDescriptorContext *)node_descr->userdata;
+    destroy(descr_context, 1);
+}
+
+int genesis_resample_descriptor_set_quality(struct GenesisNodeDescriptor *node_descr,
+        enum GenesisResampleQuality quality)
+{
+    if (node_descr->run != resample_run)
+        return GenesisErrorInvalidParam;
+    if (quality < 0 || quality >= array_length(quality_presets))
+        return GenesisErrorInvalidParam;
+    ResampleDescriptorContext *descr_context = (ResampleDescriptorContext *)node_descr->userdata;
+    descr_context->quality = quality;
+    return 0;
+}
+
+enum GenesisResampleQuality genesis_resample_descriptor_quality(
+        const struct GenesisNodeDescriptor *node_descr)
+{
+    assert(node_descr->run == resample_run);
+    ResampleDescriptorContext *descr_context = (ResampleDescriptorContext *)node_descr->userdata;
+    return descr_context->quality;
+}
+
 int create_resample_descriptor(GenesisPipeline *pipeline) {
     GenesisNodeDescriptor *node_descr = genesis_create_node_descriptor(pipeline, 2,
             "resample", "Resample audio and remap channel layouts.");
@@ -419,6 +808,15 @@ int create_resample_descriptor(GenesisPipeline *pipeline) {
         return GenesisErrorNoMem;
     }
 
+    ResampleDescriptorContext *descr_context = create_zero<ResampleDescriptorContext>();
+    if (!descr_context) {
+        genesis_node_descriptor_destroy(node_descr);
+        return GenesisErrorNoMem;
+    }
+    descr_context->quality = GenesisResampleQualityRealtime;
+    genesis_node_descriptor_set_userdata(node_descr, descr_context);
+    node_descr->destroy_descriptor = destroy_node_descriptor;
+
     genesis_node_descriptor_set_run_callback(node_descr, resample_run);
     genesis_node_descriptor_set_create_callback(node_descr, resample_create);
     genesis_node_descriptor_set_destroy_callback(node_descr, resample_destroy);
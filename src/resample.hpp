@@ -5,4 +5,69 @@
 
 int create_resample_descriptor(GenesisPipeline *pipeline);
 
+// the conversion the resample node does, for audio that is not in a port
+struct ResampleContext;
+int resample_context_create(int in_sample_rate, const struct SoundIoChannelLayout *in_channel_layout,
+        int out_sample_rate, const struct SoundIoChannelLayout *out_channel_layout,
+        enum GenesisResampleQuality quality, ResampleContext **out_resample_context);
+void resample_context_destroy(ResampleContext *resample_context);
+// forgets the input so far, as after a seek
+void resample_context_reset(ResampleContext *resample_context);
+// converts interleaved frames from in_buf into out_buf. the frames it does
+// not consume must be passed again, after any it does.
+void resample_convert(ResampleContext *resample_context, const float *in_buf, int in_frame_count,
+        float *out_buf, int out_frame_count, int *out_consumed, int *out_written);
+
+// a conversion whose ratio can be trimmed while it runs, for audio
+// between two clocks which are nominally at in_sample_rate and
+// out_sample_rate but drift apart. converts with resample_convert, and
+// always filters, even at equal rates.
+int resample_context_create_adaptive(int in_sample_rate, int out_sample_rate,
+        const struct SoundIoChannelLayout *channel_layout, enum GenesisResampleQuality quality,
+        ResampleContext **out_resample_context);
+// consumes in_sample_rate / out_sample_rate * (1 + correction) input
+// frames per output frame from then on. only for adaptive contexts.
+void resample_context_set_correction(ResampleContext *resample_context, double correction);
+
+// a PI control loop which keeps a buffer between two clocks at
+// target_fill frames, by the correction it gives an adaptive conversion
+// that writes frame_rate frames a second into it
+struct ResampleDriftControl {
+    int frame_rate;
+    double target_fill;
+    double max_correction;
+    double kp;
+    double ki;
+    // frame seconds
+    double integral;
+    // the fill level averaged over about a second, negative before the
+    // first measurement
+    double filtered_fill;
+    double correction;
+    // frames written since the reset, and how far that was ahead of the
+    // reader's clock less the fill when the clock was first known
+    long written_frame_count;
+    double clock_offset;
+    bool clock_known;
+};
+void resample_drift_control_init(ResampleDriftControl *control, int frame_rate, double target_fill,
+        double max_correction);
+// forgets the fill level, as after the buffer was emptied, but keeps the
+// integral, which is the drift between the clocks
+void resample_drift_control_reset(ResampleDriftControl *control);
+// fill is the frames in the buffer, measured after frame_count more were
+// converted into it. read_position is how many frames the reader has
+// taken by then, from a clock which moves smoothly rather than by its
+// reads, or negative for none. returns the next correction.
+double resample_drift_control_update(ResampleDriftControl *control, int fill, int frame_count,
+        double read_position);
+
+// fills filters, which has room for (phase_count + 1) * tap_count, with the
+// polyphase bank of a windowed sinc that resample_convert uses: sub-filter
+// p is the prototype at offsets k + p / phase_count input frames, reversed
+// for fir_frame. cutoff is relative to the input nyquist frequency. a
+// kaiser_beta of 0.0 means a blackman window.
+void resample_build_filters(float *filters, int tap_count, int phase_count, double cutoff,
+        double kaiser_beta);
+
 #endif
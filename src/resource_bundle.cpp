@@ -1,15 +1,53 @@
 #include "resource_bundle.hpp"
 
-ResourceBundle::ResourceBundle(const char *filename) {
+ResourceBundle::ResourceBundle(const char *filename, const char *mapped_filename) :
+    _is_mapped(false),
+    _mapped_entries(nullptr),
+    _mapped_entry_count(0)
+{
     int err = rucksack_bundle_open_read(filename, &_bundle);
     if (err)
         panic("Unable to open resource bundle: %s", rucksack_err_str(err));
+    map_resources(mapped_filename);
 }
 
 ResourceBundle::~ResourceBundle() {
+    for (int i = 0; i < _read_files.length(); i += 1)
+        destroy(_read_files.at(i), 1);
+    if (_is_mapped)
+        os_unmap_file(&_mapped_file);
     rucksack_bundle_close(_bundle);
 }
 
+void ResourceBundle::map_resources(const char *mapped_filename) {
+    int err = os_map_file(mapped_filename, &_mapped_file);
+    if (err == GenesisErrorFileNotFound)
+        return;
+    if (err)
+        panic("Unable to map %s: %s", mapped_filename, genesis_strerror(err));
+    _is_mapped = true;
+
+    MappedResourcesHeader header;
+    if (_mapped_file.size < sizeof(header))
+        panic("%s is truncated", mapped_filename);
+    memcpy(&header, _mapped_file.address, sizeof(header));
+    if (memcmp(header.magic, MAPPED_RESOURCES_MAGIC, sizeof(header.magic)) != 0)
+        panic("%s is not a mapped resources file", mapped_filename);
+    size_t entries_end = sizeof(header) + (size_t)header.entry_count * sizeof(MappedResourceEntry);
+    if (entries_end > _mapped_file.size)
+        panic("%s is truncated", mapped_filename);
+    _mapped_entries = (const MappedResourceEntry *)(_mapped_file.address + sizeof(header));
+    _mapped_entry_count = header.entry_count;
+    for (int i = 0; i < _mapped_entry_count; i += 1) {
+        const MappedResourceEntry *entry = &_mapped_entries[i];
+        if (!memchr(entry->key, 0, sizeof(entry->key)) || entry->offset < entries_end ||
+            entry->offset > _mapped_file.size || entry->size > _mapped_file.size - entry->offset)
+        {
+            panic("%s is corrupt", mapped_filename);
+        }
+    }
+}
+
 void ResourceBundle::get_file_buffer(const char *key, ByteBuffer &buffer) {
     RuckSackFileEntry *entry = rucksack_bundle_find_file(_bundle, key, -1);
 
@@ -25,3 +63,31 @@ void ResourceBundle::get_file_buffer(const char *key, ByteBuffer &buffer) {
     if (err)
         panic("error reading '%s' resource: %s", key, rucksack_err_str(err));
 }
+
+bool ResourceBundle::find_file_view(const char *key, ResourceView *out_view) {
+    // only a handful of resources are mapped
+    for (int i = 0; i < _mapped_entry_count; i += 1) {
+        const MappedResourceEntry *entry = &_mapped_entries[i];
+        if (strcmp(entry->key, key) == 0) {
+            out_view->data = _mapped_file.address + entry->offset;
+            out_view->size = entry->size;
+            return true;
+        }
+    }
+
+    if (!rucksack_bundle_find_file(_bundle, key, -1))
+        return false;
+    ByteBuffer *buffer = create<ByteBuffer>();
+    get_file_buffer(key, *buffer);
+    ok_or_panic(_read_files.append(buffer));
+    out_view->data = buffer->raw();
+    out_view->size = buffer->length();
+    return true;
+}
+
+ResourceView ResourceBundle::get_file_view(const char *key) {
+    ResourceView view;
+    if (!find_file_view(key, &view))
+        panic("could not find %s in resource bundle", key);
+    return view;
+}
@@ -2,17 +2,41 @@
 #define RESOURCE_BUNDLE_HPP
 
 #include "byte_buffer.hpp"
+#include "mapped_resources.hpp"
+#include "os.hpp"
 
 #include <rucksack/rucksack.h>
 
+// the bytes of one resource, which stay put as long as the bundle is open
+struct ResourceView {
+    const char *data;
+    long size;
+};
+
 class ResourceBundle {
 public:
-    ResourceBundle(const char *filename);
+    // resources in mapped_filename, when it exists, are used in place. the
+    // rest are read from the bundle.
+    ResourceBundle(const char *filename, const char *mapped_filename);
     ~ResourceBundle();
 
     void get_file_buffer(const char *key, ByteBuffer &buffer);
+    // panics if there is no such resource
+    ResourceView get_file_view(const char *key);
+    // returns false if there is no such resource
+    bool find_file_view(const char *key, ResourceView *out_view);
 
     RuckSackBundle *_bundle;
+
+private:
+    bool _is_mapped;
+    OsMappedFile _mapped_file;
+    const MappedResourceEntry *_mapped_entries;
+    int _mapped_entry_count;
+    // the resources that were not mapped, read in for views of them
+    List<ByteBuffer *> _read_files;
+
+    void map_resources(const char *mapped_filename);
 };
 
 #endif
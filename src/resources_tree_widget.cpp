@@ -8,9 +8,15 @@
 #include "audio_graph.hpp"
 #include "dragged_sample_file.hpp"
 #include "menu_widget.hpp"
+#include "dir_scanner.hpp"
+#include "sample_index.hpp"
+#include "parallel.hpp"
 
 #include <string.h>
 
+// search results shown at most
+static const int max_search_results = 200;
+
 static void device_change_callback(Event, void *userdata) {
     ResourcesTreeWidget *resources_tree = (ResourcesTreeWidget *)userdata;
     resources_tree->refresh_devices();
@@ -19,7 +25,7 @@ static void device_change_callback(Event, void *userdata) {
 
 static void scroll_change_callback(Event, void *userdata) {
     ResourcesTreeWidget *resources_tree = (ResourcesTreeWidget *)userdata;
-    resources_tree->update_model();
+    resources_tree->update_visible_rows();
 }
 
 static void add_to_project_handler(void *userdata) {
@@ -50,6 +56,11 @@ static void audio_clips_change_callback(Event, void *userdata) {
     resources_tree_widget->update_model();
 }
 
+static void flush_events_callback(Event, void *userdata) {
+    ResourcesTreeWidget *resources_tree_widget = (ResourcesTreeWidget *)userdata;
+    resources_tree_widget->poll_dir_scanner();
+}
+
 ResourcesTreeWidget::ResourcesTreeWidget(GuiWindow *gui_window,
         SettingsFile *settings_file, AudioGraph *the_audio_graph) :
     Widget(gui_window),
@@ -68,7 +79,8 @@ ResourcesTreeWidget::ResourcesTreeWidget(GuiWindow *gui_window,
     item_padding_bottom(4),
     settings_file(settings_file)
 {
-    display_node_count = 0;
+    row_height = 0;
+    rows_available_height = 0;
     selected_node = nullptr;
     last_click_node = nullptr;
     audio_graph = the_audio_graph;
@@ -79,16 +91,35 @@ ResourcesTreeWidget::ResourcesTreeWidget(GuiWindow *gui_window,
 
     dummy_label = create<Label>(gui);
 
+    ok_or_panic(dir_scanner_create(&dir_scanner));
+
+    // only a cache, so the tree works without it
+    ByteBuffer app_dir;
+    os_get_app_dir(app_dir);
+    ByteBuffer sample_index_path;
+    os_get_sample_index_path(sample_index_path);
+    int err;
+    if ((err = os_mkdirp(app_dir)) ||
+        (err = sample_index_open(context, sample_index_path.raw(), &sample_index)))
+    {
+        fprintf(stderr, "Unable to open sample index %s: %s\n", sample_index_path.raw(), genesis_strerror(err));
+        sample_index = nullptr;
+    }
+    search_generation = 0;
+
     gui->events.attach_handler(EventAudioDeviceChange, device_change_callback, this);
     gui->events.attach_handler(EventMidiDeviceChange, device_change_callback, this);
     scroll_bar->events.attach_handler(EventScrollValueChange, scroll_change_callback, this);
-    project->events.attach_handler(EventProjectAudioAssetsChanged, audio_assets_change_callback, this);
-    project->events.attach_handler(EventProjectAudioClipsChanged, audio_clips_change_callback, this);
+    project->events.attach_deferred_handler(EventProjectAudioAssetsChanged, audio_assets_change_callback, this);
+    project->events.attach_deferred_handler(EventProjectAudioClipsChanged, audio_clips_change_callback, this);
+    gui->events.attach_handler(EventFlushEvents, flush_events_callback, this);
 
     root_node = create_parent_node(nullptr, "");
     root_node->indent_level = -1;
     root_node->parent_data->expanded = true;
 
+    search_root = create_parent_node(root_node, "");
+    set_search_text("");
     playback_devices_root = create_parent_node(root_node, "Playback Devices");
     recording_devices_root = create_parent_node(root_node, "Recording Devices");
     midi_devices_root = create_parent_node(root_node, "MIDI Devices");
@@ -128,6 +159,12 @@ ResourcesTreeWidget::~ResourcesTreeWidget() {
 
     project->events.detach_handler(EventProjectAudioAssetsChanged, audio_assets_change_callback);
     project->events.detach_handler(EventProjectAudioClipsChanged, audio_clips_change_callback);
+    gui->events.detach_handler(EventFlushEvents, flush_events_callback, this);
+
+    dir_scanner_destroy(dir_scanner);
+    sample_index_close(sample_index);
+    for (int i = 0; i < dir_scan_batches.length(); i += 1)
+        dir_scan_batch_destroy(dir_scan_batches.at(i));
 
     destroy_node(root_node);
 
@@ -141,41 +178,30 @@ void ResourcesTreeWidget::clear_display_nodes() {
         destroy_node_display(node_display);
     }
     display_nodes.clear();
+    for (int i = 0; i < display_pool.length(); i += 1)
+        destroy_node_display(display_pool.at(i));
+    display_pool.clear();
 }
 
 void ResourcesTreeWidget::draw(const glm::mat4 &projection) {
     bg.draw(gui_window, projection);
     scroll_bar->draw(projection);
 
+    gui_window->set_scissor(clip_left, clip_top, clip_width, clip_height);
 
-    glEnable(GL_STENCIL_TEST);
-
-    glStencilFunc(GL_ALWAYS, 1, 0xFF);
-    glStencilOp(GL_KEEP, GL_REPLACE, GL_REPLACE);
-    glStencilMask(0xFF);
-
-    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-    glClear(GL_STENCIL_BUFFER_BIT);
-
-    gui_window->fill_rect(glm::vec4(1.0f, 1.0f, 1.0f, 1.0f), projection * stencil_model);
-
-    glStencilFunc(GL_EQUAL, 1, 0xFF);
-    glStencilMask(0x00);
-    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-
-    for (int i = 0; i < display_node_count; i += 1) {
+    for (int i = 0; i < display_nodes.length(); i += 1) {
         NodeDisplay *node_display = display_nodes.at(i);
         if (node_display->node == selected_node) {
             gui_window->fill_rect(selection_color, projection * node_display->selected_model);
         }
-        node_display->label->draw(projection * node_display->label_model, text_color);
+        node_display->label->draw(gui_window, projection * node_display->label_model, text_color);
         if (should_draw_icon(node_display->node)) {
             gui->draw_image_color(gui_window, node_display->node->icon_img,
                     projection * node_display->icon_model, text_color);
         }
     }
 
-    glDisable(GL_STENCIL_TEST);
+    gui_window->clear_scissor();
 }
 
 void ResourcesTreeWidget::refresh_devices() {
@@ -316,15 +342,36 @@ void ResourcesTreeWidget::refresh_devices() {
     trim_extra_children(midi_devices_root, i);
 }
 
-ResourcesTreeWidget::NodeDisplay * ResourcesTreeWidget::create_node_display(Node *node) {
-    NodeDisplay *result = create<NodeDisplay>();
-    result->label = create<Label>(gui);
+ResourcesTreeWidget::NodeDisplay * ResourcesTreeWidget::acquire_node_display(Node *node) {
+    NodeDisplay *result;
+    if (display_pool.length() > 0) {
+        result = display_pool.pop();
+    } else {
+        result = create<NodeDisplay>();
+        result->label = create<Label>(gui);
+    }
     result->node = node;
     node->display = result;
     ok_or_panic(display_nodes.append(result));
+
+    result->label->set_text(node->text);
+    result->label->update();
     return result;
 }
 
+void ResourcesTreeWidget::release_node_display(NodeDisplay *node_display) {
+    for (int i = 0; i < display_nodes.length(); i += 1) {
+        if (display_nodes.at(i) == node_display) {
+            display_nodes.swap_remove(i);
+            break;
+        }
+    }
+    if (node_display->node)
+        node_display->node->display = nullptr;
+    node_display->node = nullptr;
+    ok_or_panic(display_pool.append(node_display));
+}
+
 void ResourcesTreeWidget::destroy_node_display(NodeDisplay *node_display) {
     if (node_display) {
         if (node_display->node)
@@ -335,15 +382,21 @@ void ResourcesTreeWidget::destroy_node_display(NodeDisplay *node_display) {
 }
 
 void ResourcesTreeWidget::update_model() {
-
+    queue_redraw();
     int available_width = width - scroll_bar->min_width() - padding_left - padding_right;
     int available_height = height - padding_bottom - padding_top;
 
-    stencil_model = transform2d(padding_left, padding_top, available_width, available_height);
+    clip_left = left + padding_left;
+    clip_top = top + padding_top;
+    clip_width = available_width;
+    clip_height = available_height;
 
     bg.update(this, 0, 0, padding_left + available_width, height);
 
-    // compute item positions
+    // compute item positions. every row is the same height.
+    row_height = item_padding_top + dummy_label->height() + item_padding_bottom;
+    rows_available_height = available_height;
+    rows.clear();
     int next_top = padding_top;
     update_model_stack.clear();
     ok_or_panic(update_model_stack.append(root_node));
@@ -352,8 +405,10 @@ void ResourcesTreeWidget::update_model() {
         add_children_to_stack(update_model_stack, child);
         if (child->indent_level == -1)
             continue;
+        child->row_index = rows.length();
+        ok_or_panic(rows.append(child));
         child->top = next_top;
-        next_top += item_padding_top + dummy_label->height() + item_padding_bottom;
+        next_top += row_height;
         child->bottom = next_top;
     }
 
@@ -369,59 +424,73 @@ void ResourcesTreeWidget::update_model() {
     scroll_bar->set_value(scroll_bar->value);
     scroll_bar->on_resize();
 
-    // now consider scroll position and create display nodes for nodes that
-    // are visible
-    display_node_count = 0;
-    update_model_stack.clear();
-    ok_or_panic(update_model_stack.append(root_node));
-    while (update_model_stack.length() > 0) {
-        Node *child = update_model_stack.pop();
-        add_children_to_stack(update_model_stack, child);
-        if (child->indent_level == -1)
-            continue;
-
-        if (child->bottom - scroll_bar->value >= padding_top &&
-            child->top - scroll_bar->value < padding_top + available_height)
-        {
-            NodeDisplay *node_display;
-            if (display_node_count >= display_nodes.length())
-                node_display = create_node_display(child);
-            else
-                node_display = display_nodes.at(display_node_count);
-            display_node_count += 1;
+    update_visible_rows();
+}
 
-            node_display->node = child;
-            child->display = node_display;
+void ResourcesTreeWidget::update_visible_rows() {
+    queue_redraw();
+    int scroll = scroll_bar->value;
+    int first_row = 0;
+    int end_row = 0;
+    if (row_height > 0) {
+        first_row = max(0, scroll / row_height - 1);
+        end_row = min(rows.length(), (scroll + rows_available_height) / row_height + 1);
+    }
 
-            node_display->top = child->top - scroll_bar->value;
-            node_display->bottom = child->bottom - scroll_bar->value;
+    // rows which stay in view keep their labels as they are
+    for (int i = display_nodes.length() - 1; i >= 0; i -= 1) {
+        NodeDisplay *node_display = display_nodes.at(i);
+        Node *node = node_display->node;
+        bool in_view = node && node->row_index >= first_row && node->row_index < end_row &&
+            rows.at(node->row_index) == node;
+        if (!in_view)
+            release_node_display(node_display);
+    }
 
-            node_display->icon_left = padding_left + (icon_width + icon_spacing) * child->indent_level;
-            node_display->right = width - padding_right;
+    for (int row = first_row; row < end_row; row += 1) {
+        Node *child = rows.at(row);
+        if (child->bottom - scroll < padding_top ||
+            child->top - scroll >= padding_top + rows_available_height)
+        {
+            if (child->display)
+                release_node_display(child->display);
+            continue;
+        }
 
-            int extra_indent = (child->icon_img != nullptr);
-            int label_left = padding_left + (icon_width + icon_spacing) *
-                (child->indent_level + extra_indent);
-            int label_top = node_display->top + item_padding_top;
-            node_display->label_model = transform2d(label_left, label_top);
+        NodeDisplay *node_display = child->display;
+        if (!node_display) {
+            node_display = acquire_node_display(child);
+        } else if (!String::equal(node_display->label->text(), child->text)) {
             node_display->label->set_text(child->text);
             node_display->label->update();
+        }
 
-            node_display->selected_model = transform2d(
-                    node_display->icon_left, node_display->top,
-                    node_display->right - node_display->icon_left,
-                    node_display->bottom - node_display->top);
+        node_display->top = child->top - scroll;
+        node_display->bottom = child->bottom - scroll;
 
+        node_display->icon_left = padding_left + (icon_width + icon_spacing) * child->indent_level;
+        node_display->right = width - padding_right;
 
-            if (child->icon_img) {
-                node_display->icon_top = node_display->top +
-                    (node_display->bottom - node_display->top) / 2 - icon_height / 2;
-                float icon_scale_width = icon_width / (float)child->icon_img->width;
-                float icon_scale_height = icon_height / (float)child->icon_img->height;
-                node_display->icon_model = transform2d(
-                        node_display->icon_left, node_display->icon_top,
-                        icon_scale_width, icon_scale_height);
-            }
+        int extra_indent = (child->icon_img != nullptr);
+        int label_left = padding_left + (icon_width + icon_spacing) *
+            (child->indent_level + extra_indent);
+        int label_top = node_display->top + item_padding_top;
+        node_display->label_model = transform2d(label_left, label_top);
+
+        node_display->selected_model = transform2d(
+                node_display->icon_left, node_display->top,
+                node_display->right - node_display->icon_left,
+                node_display->bottom - node_display->top);
+
+
+        if (child->icon_img) {
+            node_display->icon_top = node_display->top +
+                (node_display->bottom - node_display->top) / 2 - icon_height / 2;
+            float icon_scale_width = icon_width / (float)child->icon_img->width;
+            float icon_scale_height = icon_height / (float)child->icon_img->height;
+            node_display->icon_model = transform2d(
+                    node_display->icon_left, node_display->icon_top,
+                    icon_scale_width, icon_scale_height);
         }
     }
 }
@@ -491,6 +560,8 @@ ResourcesTreeWidget::Node *ResourcesTreeWidget::create_parent_node(Node *parent,
     node->node_type = NodeTypeParent;
     node->parent_data = create<ParentNode>();
     node->parent_data->expanded = false;
+    node->parent_data->is_dir = false;
+    node->parent_data->listed = false;
     node->parent_node = parent;
     if (parent)
         ok_or_panic(parent->parent_data->children.append(node));
@@ -511,6 +582,16 @@ ResourcesTreeWidget::Node *ResourcesTreeWidget::create_sample_file_node(Node *pa
     return node;
 }
 
+ResourcesTreeWidget::Node *ResourcesTreeWidget::create_dir_node(Node *parent,
+        const char *text, const ByteBuffer &full_path)
+{
+    Node *node = create_parent_node(parent, text);
+    node->parent_data->is_dir = true;
+    node->full_path = full_path;
+    dir_nodes.put(full_path, node);
+    return node;
+}
+
 void ResourcesTreeWidget::pop_destroy_child(Node *node) {
     Node *child = node->parent_data->children.pop();
     child->parent_node = nullptr;
@@ -523,6 +604,13 @@ void ResourcesTreeWidget::destroy_node(Node *node) {
             select_node(nullptr);
         if (node == last_click_node)
             last_click_node = nullptr;
+        if (node->display)
+            release_node_display(node->display);
+        if (node->parent_data && node->parent_data->is_dir) {
+            auto *entry = dir_nodes.maybe_get(node->full_path);
+            if (entry && entry->value == node)
+                dir_nodes.remove(node->full_path);
+        }
         destroy(node->parent_data, 1);
         soundio_device_unref(node->audio_device);
         genesis_midi_device_unref(node->midi_device);
@@ -534,7 +622,7 @@ void ResourcesTreeWidget::destroy_node(Node *node) {
 void ResourcesTreeWidget::on_mouse_wheel(const MouseWheelEvent *event) {
     float range = scroll_bar->max_value - scroll_bar->min_value;
     scroll_bar->set_value(scroll_bar->value - event->wheel_y * range * 0.18f * scroll_bar->handle_ratio);
-    update_model();
+    update_visible_rows();
 }
 
 void ResourcesTreeWidget::on_mouse_move(const MouseEvent *event) {
@@ -751,6 +839,16 @@ bool ResourcesTreeWidget::on_key_event(const KeyEvent *event) {
 
     switch (event->virt_key) {
         default: break;
+        case VirtKeyBackspace:
+            if (search_text.length() == 0)
+                break;
+            set_search_text(search_text.substring(0, search_text.length() - 1));
+            return true;
+        case VirtKeyEscape:
+            if (search_text.length() == 0)
+                break;
+            set_search_text("");
+            return true;
         case VirtKeyDown:
             nav_sel_y(1);
             return true;
@@ -776,6 +874,52 @@ bool ResourcesTreeWidget::on_key_event(const KeyEvent *event) {
     return false;
 }
 
+void ResourcesTreeWidget::on_text_input(const TextInputEvent *event) {
+    if (!sample_index)
+        return;
+    String text = search_text;
+    text.append(event->codepoint);
+    set_search_text(text);
+}
+
+void ResourcesTreeWidget::set_search_text(const String &text) {
+    search_text = text;
+    refresh_search_results();
+    search_root->parent_data->expanded = (search_text.length() > 0);
+    search_root->icon_img = search_root->parent_data->expanded ? gui->img_minus : gui->img_plus;
+    update_model();
+}
+
+void ResourcesTreeWidget::refresh_search_results() {
+    List<ByteBuffer> paths;
+    if (search_text.length() > 0) {
+        search_generation = sample_index_generation(sample_index);
+        ok_or_panic(sample_index_search(sample_index, search_text.encode(), max_search_results, paths));
+        String text = "Search: ";
+        text.append(search_text);
+        search_root->text = text;
+    } else {
+        search_root->text = sample_index ? "Search (type to find samples)" : "Search (unavailable)";
+    }
+
+    int i;
+    for (i = 0; i < paths.length(); i += 1) {
+        Node *node;
+        if (i < search_root->parent_data->children.length()) {
+            node = search_root->parent_data->children.at(i);
+        } else {
+            node = ok_mem(create_zero<Node>());
+            node->node_type = NodeTypeSampleFile;
+            node->parent_node = search_root;
+            node->icon_img = gui->img_entry_file;
+            ok_or_panic(search_root->parent_data->children.append(node));
+        }
+        node->full_path = paths.at(i);
+        node->text = paths.at(i);
+    }
+    trim_extra_children(search_root, i);
+}
+
 bool ResourcesTreeWidget::is_node_expanded(Node *node) {
     assert(node->node_type == NodeTypeParent);
     return node->parent_data->expanded;
@@ -784,14 +928,20 @@ bool ResourcesTreeWidget::is_node_expanded(Node *node) {
 void ResourcesTreeWidget::toggle_expansion(Node *node) {
     node->parent_data->expanded = !node->parent_data->expanded;
     node->icon_img = node->parent_data->expanded ? gui->img_minus : gui->img_plus;
+    // listed each time it opens. it comes from the cache when unchanged.
+    if (node->parent_data->expanded && node->parent_data->is_dir)
+        ok_or_panic(dir_scanner_request(dir_scanner, node->full_path));
     update_model();
 }
 
 bool ResourcesTreeWidget::should_draw_icon(Node *node) {
     if (!node->icon_img)
         return false;
-    if (node->node_type == NodeTypeParent && node->parent_data->children.length() == 0)
+    if (node->node_type == NodeTypeParent && node->parent_data->children.length() == 0 &&
+        !(node->parent_data->is_dir && !node->parent_data->listed))
+    {
         return false;
+    }
     return true;
 }
 
@@ -809,36 +959,107 @@ void ResourcesTreeWidget::delete_all_children(Node *root) {
         if (node != root)
             destroy_node(node);
     }
+    root->parent_data->children.clear();
+    root->parent_data->child_index.clear();
 }
 
-static int compare_is_dir_then_name(OsDirEntry *a, OsDirEntry *b) {
-    if (a->is_dir && !b->is_dir) {
+static int compare_is_dir_then_name(ResourcesTreeWidget::Node *a, ResourcesTreeWidget::Node *b) {
+    if (a->dir_entry->is_dir && !b->dir_entry->is_dir) {
         return -1;
-    } else if (b->is_dir && !a->is_dir) {
+    } else if (b->dir_entry->is_dir && !a->dir_entry->is_dir) {
         return 1;
     } else {
-        return ByteBuffer::compare(a->name, b->name);
+        return ByteBuffer::compare(a->dir_entry->sort_key, b->dir_entry->sort_key);
     }
 }
 
-void ResourcesTreeWidget::scan_dir_recursive(const ByteBuffer &dir, Node *parent_node) {
-    List<OsDirEntry *> entries;
-    int err = os_readdir(dir.raw(), entries);
-    if (err)
-        fprintf(stderr, "Error reading %s: %s\n", dir.raw(), genesis_strerror(err));
-    entries.sort<compare_is_dir_then_name>();
+// leaves child in the children of parent
+void ResourcesTreeWidget::remove_child(Node *parent, Node *child) {
+    if (child->node_type == NodeTypeParent)
+        delete_all_children(child);
+    parent->parent_data->child_index.remove(child->dir_entry->name);
+    destroy_node(child);
+}
+
+void ResourcesTreeWidget::apply_dir_scan_batch(DirScanBatch *batch) {
+    auto *dir_entry = dir_nodes.maybe_get(batch->dir);
+    if (!dir_entry)
+        return;
+    Node *dir_node = dir_entry->value;
+    ParentNode *parent_data = dir_node->parent_data;
+
+    if (batch->err)
+        fprintf(stderr, "Error reading %s: %s\n", batch->dir.raw(), genesis_strerror(batch->err));
+
+    if (batch->first) {
+        for (int i = 0; i < parent_data->children.length(); i += 1)
+            parent_data->children.at(i)->seen = false;
+    }
+
+    // children which are still there keep their nodes, so that what is
+    // expanded or selected below them stays so
     ByteBuffer full_path;
-    for (int i = 0; i < entries.length(); i += 1) {
-        OsDirEntry *dir_entry = entries.at(i);
-        os_path_join(full_path, dir, dir_entry->name);
-        if (dir_entry->is_dir) {
-            Node *child = create_parent_node(parent_node, dir_entry->name.raw());
-            scan_dir_recursive(full_path, child);
-            os_dir_entry_unref(dir_entry);
+    for (int i = 0; i < batch->entries.length(); i += 1) {
+        OsDirEntry *entry = batch->entries.at(i);
+        auto *child_entry = parent_data->child_index.maybe_get(entry->name);
+        Node *child = child_entry ? child_entry->value : nullptr;
+        if (child && child->dir_entry->is_dir != entry->is_dir) {
+            parent_data->children.swap_remove(get_node_index(child));
+            remove_child(dir_node, child);
+            child = nullptr;
+        }
+        if (child) {
+            os_dir_entry_unref(child->dir_entry);
         } else {
-            create_sample_file_node(parent_node, dir_entry, full_path);
+            os_path_join(full_path, batch->dir, entry->name);
+            if (entry->is_dir)
+                child = create_dir_node(dir_node, entry->name.raw(), full_path);
+            else
+                child = create_sample_file_node(dir_node, entry, full_path);
+            parent_data->child_index.put(entry->name, child);
+        }
+        os_dir_entry_ref(entry);
+        child->dir_entry = entry;
+        child->seen = true;
+    }
+
+    if (batch->last) {
+        int kept_count = 0;
+        for (int i = 0; i < parent_data->children.length(); i += 1) {
+            Node *child = parent_data->children.at(i);
+            if (child->seen) {
+                parent_data->children.at(kept_count) = child;
+                kept_count += 1;
+            } else {
+                remove_child(dir_node, child);
+            }
         }
+        ok_or_panic(parent_data->children.resize(kept_count));
+        parent_data->listed = true;
+    }
+
+    // a sample library can have a good many files in one directory
+    parallel_sort<Node *, compare_is_dir_then_name>(genesis_context_job_system(context), parent_data->children);
+}
+
+void ResourcesTreeWidget::poll_dir_scanner() {
+    if (sample_index && search_text.length() > 0 &&
+        sample_index_generation(sample_index) != search_generation)
+    {
+        refresh_search_results();
+        update_model();
+    }
+
+    ok_or_panic(dir_scanner_poll(dir_scanner, dir_scan_batches));
+    if (dir_scan_batches.length() == 0)
+        return;
+    for (int i = 0; i < dir_scan_batches.length(); i += 1) {
+        DirScanBatch *batch = dir_scan_batches.at(i);
+        apply_dir_scan_batch(batch);
+        dir_scan_batch_destroy(batch);
     }
+    dir_scan_batches.clear();
+    update_model();
 }
 
 void ResourcesTreeWidget::scan_sample_dirs() {
@@ -852,9 +1073,11 @@ void ResourcesTreeWidget::scan_sample_dirs() {
 
     delete_all_children(samples_root);
 
+    // listed when expanded
     for (int i = 0; i < dirs.length(); i += 1) {
-        Node *parent_node = create_parent_node(samples_root, dirs.at(i).raw());
-        scan_dir_recursive(dirs.at(i), parent_node);
+        create_dir_node(samples_root, dirs.at(i).raw(), dirs.at(i));
+        if (sample_index)
+            ok_or_panic(sample_index_add_dir(sample_index, dirs.at(i)));
     }
 }
 
@@ -7,6 +7,7 @@
 #include "os.hpp"
 #include "sunken_box.hpp"
 #include "device_id.hpp"
+#include "flat_hash_map.hpp"
 
 class GuiWindow;
 class Gui;
@@ -18,6 +19,9 @@ struct AudioGraph;
 struct Project;
 struct AudioAsset;
 struct AudioClip;
+struct DirScanner;
+struct DirScanBatch;
+struct SampleIndex;
 
 class ResourcesTreeWidget;
 
@@ -37,6 +41,7 @@ public:
     void on_mouse_move(const MouseEvent *) override;
     void on_mouse_wheel(const MouseWheelEvent *event) override;
     bool on_key_event(const KeyEvent *) override;
+    void on_text_input(const TextInputEvent *event) override;
 
 
     enum NodeType {
@@ -55,6 +60,12 @@ public:
     struct ParentNode {
         List<Node *> children;
         bool expanded;
+        // a directory, whose children come from dir_scanner when it is
+        // expanded. listed once the first listing of it is complete.
+        bool is_dir;
+        bool listed;
+        // children by name, when is_dir
+        FlatHashMap<ByteBuffer, Node *, ByteBuffer::hash> child_index;
     };
 
     struct Node {
@@ -67,6 +78,8 @@ public:
         // not adjusted for scroll position
         int top;
         int bottom;
+        // into rows, when it was last updated. rows might no longer have it.
+        int row_index;
 
         // these depend on node_type
         SoundIoDevice *audio_device;
@@ -76,6 +89,8 @@ public:
         ByteBuffer full_path;
         AudioAsset *audio_asset;
         AudioClip *audio_clip;
+        // in the listing of the parent directory being applied
+        bool seen;
     };
 
     struct NodeDisplay {
@@ -115,11 +130,21 @@ public:
     Node *audio_clips_root;
     List<Node *> update_model_stack;
     SettingsFile *settings_file;
+    // every node that is shown when scrolled to, in order
+    List<Node *> rows;
+    int row_height;
+    int rows_available_height;
+    // only the rows in view have a display. the labels of the rows which
+    // scroll out of view go back to the pool for the rows which come in.
     List<NodeDisplay *> display_nodes;
+    List<NodeDisplay *> display_pool;
     ScrollBarWidget *scroll_bar;
     Label *dummy_label; // so we know the height
-    int display_node_count;
-    glm::mat4 stencil_model;
+    // the nodes are drawn clipped to this, in window pixels
+    int clip_left;
+    int clip_top;
+    int clip_width;
+    int clip_height;
     Node *selected_node;
     AudioGraph *audio_graph;
     Project *project;
@@ -128,8 +153,20 @@ public:
     MenuWidgetItem *playback_device_context_menu;
     MenuWidgetItem *devices_context_menu;
     List<DeviceDesignationHandler> playback_device_designation_handlers;
+    DirScanner *dir_scanner;
+    // directory nodes by full path, for the batches dir_scanner finds
+    FlatHashMap<ByteBuffer, Node *, ByteBuffer::hash> dir_nodes;
+    List<DirScanBatch *> dir_scan_batches;
+    // nullptr if it could not be opened. typing searches it, and what it
+    // finds goes under search_root.
+    SampleIndex *sample_index;
+    Node *search_root;
+    String search_text;
+    long search_generation;
 
     void update_model();
+    // for when only the scroll position changed
+    void update_visible_rows();
 
     Node *create_parent_node(Node *parent, const char *text);
     Node *create_playback_node(Node *parent);
@@ -138,6 +175,7 @@ public:
     Node *create_audio_asset_node();
     Node *create_audio_clip_node();
     Node *create_sample_file_node(Node *parent, OsDirEntry *entry, const ByteBuffer &full_path);
+    Node *create_dir_node(Node *parent, const char *text, const ByteBuffer &full_path);
     void destroy_node(Node *node);
     void pop_destroy_child(Node *node);
     void add_children_to_stack(List<Node *> &stack, Node *node);
@@ -146,13 +184,18 @@ public:
     void destroy_dir_cache();
     void delete_all_children(Node *node);
     void destroy_node_display(NodeDisplay *node_display);
-    NodeDisplay * create_node_display(Node *node);
+    NodeDisplay * acquire_node_display(Node *node);
+    void release_node_display(NodeDisplay *node_display);
     void clear_display_nodes();
-    void scan_dir_recursive(const ByteBuffer &dir, Node *parent_node);
+    void apply_dir_scan_batch(DirScanBatch *batch);
+    void remove_child(Node *parent, Node *child);
 
     // must call update_model after calling these
     void scan_sample_dirs();
     void refresh_devices();
+    void poll_dir_scanner();
+    void refresh_search_results();
+    void set_search_text(const String &text);
 
     void nav_sel_x(int dir);
     void nav_sel_y(int dir);
@@ -1,14 +1,19 @@
 #include "ring_buffer.hpp"
 
 
+static void reset(struct RingBuffer *rb) {
+    rb->write_offset = 0;
+    rb->read_offsets[0] = 0;
+    rb->reader_sources[0] = -1;
+    rb->reader_count = 1;
+    rb->capacity = rb->mem.capacity;
+}
+
 int ring_buffer_init(struct RingBuffer *rb, int requested_capacity) {
     int err;
     if ((err = os_init_mirrored_memory(&rb->mem, requested_capacity)))
         return err;
-    rb->write_offset = 0;
-    rb->read_offset = 0;
-    rb->capacity = rb->mem.capacity;
-
+    reset(rb);
     return 0;
 }
 
@@ -16,6 +21,22 @@ void ring_buffer_deinit(struct RingBuffer *rb) {
     os_deinit_mirrored_memory(&rb->mem);
 }
 
+int ring_buffer_init_pooled(struct RingBuffer *rb, MirroredMemoryPool *pool, int requested_capacity) {
+    int err;
+    if ((err = mirrored_memory_pool_acquire(pool, &rb->mem, requested_capacity)))
+        return err;
+    reset(rb);
+    return 0;
+}
+
+void ring_buffer_deinit_pooled(struct RingBuffer *rb, MirroredMemoryPool *pool) {
+    mirrored_memory_pool_release(pool, &rb->mem);
+}
+
+void ring_buffer_bind_numa_node(struct RingBuffer *rb, int numa_node) {
+    os_mirrored_memory_bind_numa_node(&rb->mem, numa_node);
+}
+
 char *ring_buffer_write_ptr(struct RingBuffer *rb) {
     return rb->mem.address + (rb->write_offset % rb->capacity);
 }
@@ -26,19 +47,29 @@ void ring_buffer_advance_write_ptr(struct RingBuffer *rb, int count) {
 }
 
 char *ring_buffer_read_ptr(struct RingBuffer *rb) {
-    return rb->mem.address + (rb->read_offset % rb->capacity);
+    return ring_buffer_reader_read_ptr(rb, 0);
 }
 
 void ring_buffer_advance_read_ptr(struct RingBuffer *rb, int count) {
-    rb->read_offset += count;
-    assert(ring_buffer_fill_count(rb) >= 0);
+    ring_buffer_reader_advance_read_ptr(rb, 0, count);
+}
+
+static long slowest_read_offset(struct RingBuffer *rb) {
+    long offset = rb->read_offsets[0].load();
+    for (int i = 1; i < rb->reader_count; i += 1)
+        offset = min(offset, rb->read_offsets[i].load());
+    return offset;
 }
 
+// the pipeline also looks at fill counts from threads that are neither the
+// writer nor the reader. read offsets never pass the write offset, so
+// loading them first keeps the count from going negative. readers that move
+// on in between can make it look like more than capacity.
 int ring_buffer_fill_count(struct RingBuffer *rb) {
-    int count = rb->write_offset - rb->read_offset;
+    long read_offset = slowest_read_offset(rb);
+    int count = rb->write_offset.load() - read_offset;
     assert(count >= 0);
-    assert(count <= rb->capacity);
-    return count;
+    return min(count, rb->capacity);
 }
 
 int ring_buffer_free_count(struct RingBuffer *rb) {
@@ -46,5 +77,142 @@ int ring_buffer_free_count(struct RingBuffer *rb) {
 }
 
 void ring_buffer_clear(struct RingBuffer *rb) {
-    return rb->write_offset.store(rb->read_offset.load());
+    if (rb->reader_count == 1) {
+        rb->write_offset.store(rb->read_offsets[0].load());
+        return;
+    }
+    long offset = rb->write_offset.load();
+    for (int i = 0; i < rb->reader_count; i += 1)
+        rb->read_offsets[i].store(offset);
+}
+
+char *ring_buffer_reader_read_ptr(struct RingBuffer *rb, int reader) {
+    assert(reader >= 0 && reader < rb->reader_count);
+    return rb->mem.address + (rb->read_offsets[reader] % rb->capacity);
+}
+
+void ring_buffer_reader_advance_read_ptr(struct RingBuffer *rb, int reader, int count) {
+    assert(reader >= 0 && reader < rb->reader_count);
+    rb->read_offsets[reader] += count;
+    assert(ring_buffer_reader_fill_count(rb, reader) >= 0);
+}
+
+static long source_offset(struct RingBuffer *rb, int reader) {
+    int source = rb->reader_sources[reader];
+    return (source < 0) ? rb->write_offset.load() : rb->read_offsets[source].load();
+}
+
+// a source is never behind the readers that follow it
+int ring_buffer_reader_fill_count(struct RingBuffer *rb, int reader) {
+    assert(reader >= 0 && reader < rb->reader_count);
+    long read_offset = rb->read_offsets[reader].load();
+    int count = source_offset(rb, reader) - read_offset;
+    assert(count >= 0);
+    return min(count, rb->capacity);
+}
+
+int ring_buffer_add_reader(struct RingBuffer *rb) {
+    if (rb->reader_count >= RING_BUFFER_MAX_READERS)
+        return -1;
+    int reader = rb->reader_count;
+    rb->read_offsets[reader].store(slowest_read_offset(rb));
+    rb->reader_sources[reader] = -1;
+    rb->reader_count += 1;
+    return reader;
+}
+
+void ring_buffer_remove_reader(struct RingBuffer *rb, int reader) {
+    assert(reader >= 0 && reader < rb->reader_count);
+    if (rb->reader_count == 1)
+        return;
+    rb->reader_count -= 1;
+    int last = rb->reader_count;
+    rb->read_offsets[reader].store(rb->read_offsets[last].load());
+    rb->reader_sources[reader] = rb->reader_sources[last];
+    for (int i = 0; i < rb->reader_count; i += 1) {
+        assert(rb->reader_sources[i] != reader || reader == last);
+        if (rb->reader_sources[i] == last)
+            rb->reader_sources[i] = reader;
+    }
+}
+
+void ring_buffer_set_reader_count(struct RingBuffer *rb, int count) {
+    assert(count >= 1 && count <= RING_BUFFER_MAX_READERS);
+    long offset = rb->write_offset.load();
+    for (int i = 0; i < count; i += 1) {
+        rb->read_offsets[i].store(offset);
+        rb->reader_sources[i] = -1;
+    }
+    rb->reader_count = count;
+}
+
+void ring_buffer_set_reader_source(struct RingBuffer *rb, int reader, int source) {
+    assert(reader >= 0 && reader < rb->reader_count);
+    assert(source >= -1 && source < rb->reader_count && source != reader);
+    rb->reader_sources[reader] = source;
+    rb->read_offsets[reader].store(source_offset(rb, reader));
+}
+
+int spsc_ring_buffer_init(struct SpscRingBuffer *rb, int requested_capacity) {
+    int err;
+    if ((err = os_init_mirrored_memory(&rb->mem, requested_capacity)))
+        return err;
+    rb->capacity = rb->mem.capacity;
+    rb->write_offset.store(0, std::memory_order_relaxed);
+    rb->cached_read_offset = 0;
+    rb->read_offset.store(0, std::memory_order_relaxed);
+    rb->cached_write_offset = 0;
+    return 0;
+}
+
+void spsc_ring_buffer_deinit(struct SpscRingBuffer *rb) {
+    os_deinit_mirrored_memory(&rb->mem);
+}
+
+// only the writer stores write_offset, so it can load its own with relaxed
+// order; likewise for the reader and read_offset
+int spsc_ring_buffer_free_count(struct SpscRingBuffer *rb, int wanted) {
+    long write_offset = rb->write_offset.load(std::memory_order_relaxed);
+    int free_count = rb->capacity - (int)(write_offset - rb->cached_read_offset);
+    if (free_count >= wanted)
+        return free_count;
+    rb->cached_read_offset = rb->read_offset.load(std::memory_order_acquire);
+    return rb->capacity - (int)(write_offset - rb->cached_read_offset);
+}
+
+char *spsc_ring_buffer_write_ptr(struct SpscRingBuffer *rb) {
+    return rb->mem.address + (rb->write_offset.load(std::memory_order_relaxed) % rb->capacity);
+}
+
+void spsc_ring_buffer_advance_write_ptr(struct SpscRingBuffer *rb, int count) {
+    long write_offset = rb->write_offset.load(std::memory_order_relaxed) + count;
+    assert(write_offset - rb->cached_read_offset <= rb->capacity);
+    rb->write_offset.store(write_offset, std::memory_order_release);
+}
+
+int spsc_ring_buffer_fill_count(struct SpscRingBuffer *rb, int wanted) {
+    long read_offset = rb->read_offset.load(std::memory_order_relaxed);
+    int fill_count = (int)(rb->cached_write_offset - read_offset);
+    if (fill_count >= wanted)
+        return fill_count;
+    rb->cached_write_offset = rb->write_offset.load(std::memory_order_acquire);
+    return (int)(rb->cached_write_offset - read_offset);
+}
+
+char *spsc_ring_buffer_read_ptr(struct SpscRingBuffer *rb) {
+    return rb->mem.address + (rb->read_offset.load(std::memory_order_relaxed) % rb->capacity);
+}
+
+void spsc_ring_buffer_advance_read_ptr(struct SpscRingBuffer *rb, int count) {
+    long read_offset = rb->read_offset.load(std::memory_order_relaxed) + count;
+    assert(read_offset <= rb->cached_write_offset);
+    rb->read_offset.store(read_offset, std::memory_order_release);
+}
+
+char *ring_buffer_reader_rewind(struct RingBuffer *rb, int reader, int count) {
+    assert(reader >= 0 && reader < rb->reader_count);
+    assert(count >= 0 && count <= ring_buffer_free_count(rb));
+    assert(rb->read_offsets[reader].load() >= count);
+    rb->read_offsets[reader] -= count;
+    return ring_buffer_reader_read_ptr(rb, reader);
 }
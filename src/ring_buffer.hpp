@@ -4,34 +4,119 @@
 #include "util.hpp"
 #include "atomics.hpp"
 #include "os.hpp"
+#include "mirrored_memory_pool.hpp"
+
+// one writer and up to RING_BUFFER_MAX_READERS readers. every reader has its
+// own read offset and sees every byte in place. the writer only gets the
+// room that the slowest reader has freed. a reader can also follow another
+// reader instead of the writer, and then only sees what that reader has
+// read past.
+static const int RING_BUFFER_MAX_READERS = 8;
 
 struct RingBuffer {
     OsMirroredMemory mem;
     atomic_long write_offset;
-    atomic_long read_offset;
+    atomic_long read_offsets[RING_BUFFER_MAX_READERS];
+    // the reader that each reader follows, or -1 for the writer
+    int reader_sources[RING_BUFFER_MAX_READERS];
+    int reader_count;
     int capacity;
 };
 
+/// Starts out with one reader.
 int ring_buffer_init(struct RingBuffer *rb, int requested_capacity);
 void ring_buffer_deinit(struct RingBuffer *rb);
+/// Like ring_buffer_init and ring_buffer_deinit, except that the memory is
+/// taken from and given back to pool.
+int ring_buffer_init_pooled(struct RingBuffer *rb, MirroredMemoryPool *pool, int requested_capacity);
+void ring_buffer_deinit_pooled(struct RingBuffer *rb, MirroredMemoryPool *pool);
+// see os_mirrored_memory_bind_numa_node
+void ring_buffer_bind_numa_node(struct RingBuffer *rb, int numa_node);
 
 /// Do not write more than capacity.
 char *ring_buffer_write_ptr(struct RingBuffer *ring_buffer);
 /// `count` in bytes.
 void ring_buffer_advance_write_ptr(struct RingBuffer *ring_buffer, int count);
 
-/// Do not read more than capacity.
+/// Do not read more than capacity. These are for reader 0.
 char *ring_buffer_read_ptr(struct RingBuffer *ring_buffer);
 /// `count` in bytes.
 void ring_buffer_advance_read_ptr(struct RingBuffer *ring_buffer, int count);
 
-/// Returns how many bytes of the buffer is used, ready for reading.
+/// Returns how many bytes of the buffer is used, as far as the writer is
+/// concerned: what the slowest reader has not read yet.
 int ring_buffer_fill_count(struct RingBuffer *ring_buffer);
 
 /// Returns how many bytes of the buffer is free, ready for writing.
 int ring_buffer_free_count(struct RingBuffer *ring_buffer);
 
-/// Must be called by the writer.
+/// Must be called by the writer. With more than one reader, nobody may be
+/// reading at the same time.
 void ring_buffer_clear(struct RingBuffer *ring_buffer);
 
+char *ring_buffer_reader_read_ptr(struct RingBuffer *ring_buffer, int reader);
+void ring_buffer_reader_advance_read_ptr(struct RingBuffer *ring_buffer, int reader, int count);
+/// Returns how many bytes are ready for this reader.
+int ring_buffer_reader_fill_count(struct RingBuffer *ring_buffer, int reader);
+
+/// These must be called while nobody reads or writes. A new reader starts
+/// where the slowest reader is, so it sees what is still buffered and the
+/// writer gets no less room. Removing a reader moves the last reader into
+/// its index. There is always at least one reader. A reader that another
+/// reader follows cannot be removed.
+/// Returns the index of the new reader or -1 if there is no room.
+int ring_buffer_add_reader(struct RingBuffer *ring_buffer);
+void ring_buffer_remove_reader(struct RingBuffer *ring_buffer, int reader);
+/// Every reader starts out with nothing to read.
+void ring_buffer_set_reader_count(struct RingBuffer *ring_buffer, int count);
+/// Also must be called while nobody reads or writes. From now on reader only
+/// gets what source has read past, and it starts out with nothing to read.
+/// A source of -1 means the writer.
+void ring_buffer_set_reader_source(struct RingBuffer *ring_buffer, int reader, int source);
+/// Also must be called while nobody reads or writes. Moves reader back by
+/// `count` bytes, which it reads again, and returns where they start. The
+/// bytes must be free, so the caller can fill them in, and reader must be
+/// at least `count` bytes along.
+char *ring_buffer_reader_rewind(struct RingBuffer *ring_buffer, int reader, int count);
+
+// exactly one writer and one reader. each offset is on a cache line of its
+// own, next to the last value its side saw of the other offset. a call only
+// loads the other offset when that value does not already leave room or
+// data for it, so mostly the two sides touch no line in common. the offsets
+// are published with release stores and read with acquire loads only.
+static const int SPSC_RING_BUFFER_CACHE_LINE = 64;
+
+struct SpscRingBuffer {
+    OsMirroredMemory mem;
+    int capacity;
+    char pad0[SPSC_RING_BUFFER_CACHE_LINE];
+
+    // writer side
+    atomic_long write_offset;
+    long cached_read_offset;
+    char pad1[SPSC_RING_BUFFER_CACHE_LINE];
+
+    // reader side
+    atomic_long read_offset;
+    long cached_write_offset;
+    char pad2[SPSC_RING_BUFFER_CACHE_LINE];
+};
+
+int spsc_ring_buffer_init(struct SpscRingBuffer *rb, int requested_capacity);
+void spsc_ring_buffer_deinit(struct SpscRingBuffer *rb);
+
+/// Writer only. Returns how many bytes are free. This is at least `wanted`
+/// when that much is free, but may be less than the true count otherwise.
+int spsc_ring_buffer_free_count(struct SpscRingBuffer *rb, int wanted);
+char *spsc_ring_buffer_write_ptr(struct SpscRingBuffer *rb);
+/// `count` in bytes, at most what spsc_ring_buffer_free_count returned.
+void spsc_ring_buffer_advance_write_ptr(struct SpscRingBuffer *rb, int count);
+
+/// Reader only. Returns how many bytes are ready. This is at least `wanted`
+/// when that much is ready, but may be less than the true count otherwise.
+int spsc_ring_buffer_fill_count(struct SpscRingBuffer *rb, int wanted);
+char *spsc_ring_buffer_read_ptr(struct SpscRingBuffer *rb);
+/// `count` in bytes, at most what spsc_ring_buffer_fill_count returned.
+void spsc_ring_buffer_advance_read_ptr(struct SpscRingBuffer *rb, int count);
+
 #endif
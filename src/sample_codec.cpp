@@ -0,0 +1,202 @@
+#include "sample_codec.hpp"
+#include "util.hpp"
+
+// a block starts with its mode, which is the predictor order or
+// verbatim_mode. predicted blocks then have the rice parameter, the first
+// order samples as they are, and the coded residuals of the rest.
+static const uint8_t verbatim_mode = 3;
+static const int max_order = 2;
+static const int max_rice_parameter = 31;
+// quotients this large are followed by the whole value instead
+static const int rice_escape = 32;
+
+static inline uint32_t zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static inline int32_t predict(int order, const int32_t *history) {
+    switch (order) {
+    case 0: return 0;
+    case 1: return history[-1];
+    default: return 2 * history[-1] - history[-2];
+    }
+}
+
+static inline int rice_bits(uint32_t value, int k) {
+    uint32_t quotient = value >> k;
+    return (quotient < (uint32_t)rice_escape) ? (int)quotient + 1 + k : rice_escape + 32;
+}
+
+static void put_int24(List<uint8_t> &out, int32_t value) {
+    uint32_t bits = (uint32_t)value;
+    ok_or_panic(out.append(bits & 0xff));
+    ok_or_panic(out.append((bits >> 8) & 0xff));
+    ok_or_panic(out.append((bits >> 16) & 0xff));
+}
+
+static inline int32_t get_int24(const uint8_t *src) {
+    return (int32_t)((uint32_t)src[0] << 8 | (uint32_t)src[1] << 16 | (uint32_t)src[2] << 24) >> 8;
+}
+
+struct BitWriter {
+    List<uint8_t> *out;
+    uint64_t cache;
+    int cache_bits;
+};
+
+static inline void write_bits(BitWriter *writer, uint32_t value, int bit_count) {
+    if (bit_count == 0)
+        return;
+    writer->cache = (writer->cache << bit_count) | value;
+    writer->cache_bits += bit_count;
+    while (writer->cache_bits >= 8) {
+        writer->cache_bits -= 8;
+        ok_or_panic(writer->out->append((writer->cache >> writer->cache_bits) & 0xff));
+    }
+}
+
+static void flush_bits(BitWriter *writer) {
+    if (writer->cache_bits > 0)
+        write_bits(writer, 0, 8 - writer->cache_bits);
+}
+
+// the bits not yet read are at the top of cache
+struct BitReader {
+    const uint8_t *ptr;
+    uint64_t cache;
+    int cache_bits;
+};
+
+// past the end of the block the cache fills with zeroes, which no code
+// that was written reads
+static inline void refill(BitReader *reader, const uint8_t *end) {
+    while (reader->cache_bits <= 56 && reader->ptr < end) {
+        reader->cache |= (uint64_t)*reader->ptr << (56 - reader->cache_bits);
+        reader->ptr += 1;
+        reader->cache_bits += 8;
+    }
+}
+
+static inline uint32_t read_bits(BitReader *reader, int bit_count) {
+    if (bit_count == 0)
+        return 0;
+    uint32_t value = reader->cache >> (64 - bit_count);
+    reader->cache <<= bit_count;
+    reader->cache_bits -= bit_count;
+    return value;
+}
+
+static inline uint32_t read_rice(BitReader *reader, const uint8_t *end, int k) {
+    refill(reader, end);
+    uint64_t inverted = ~reader->cache;
+    int ones = inverted ? __builtin_clzll(inverted) : 64;
+    if (ones >= rice_escape) {
+        read_bits(reader, rice_escape);
+        refill(reader, end);
+        return read_bits(reader, 32);
+    }
+    read_bits(reader, ones + 1);
+    refill(reader, end);
+    return ((uint32_t)ones << k) | read_bits(reader, k);
+}
+
+// the bits it takes to code the residuals of order with rice parameter k
+static long residual_bits(const uint32_t *residuals, int count, int k) {
+    long bits = 0;
+    for (int i = 0; i < count; i += 1)
+        bits += rice_bits(residuals[i], k);
+    return bits;
+}
+
+void sample_codec_encode(const int32_t *samples, int frame_count, List<uint8_t> &out) {
+    long best_bytes = 1 + 3L * frame_count;
+    int best_order = -1;
+    int best_k = 0;
+    uint32_t residuals[max_order + 1][SAMPLE_CODEC_BLOCK_FRAMES];
+    assert(frame_count <= SAMPLE_CODEC_BLOCK_FRAMES);
+    for (int order = 0; order <= max_order && order < frame_count; order += 1) {
+        int count = frame_count - order;
+        uint64_t sum = 0;
+        for (int i = 0; i < count; i += 1) {
+            residuals[order][i] = zigzag(samples[order + i] - predict(order, samples + order + i));
+            sum += residuals[order][i];
+        }
+        // the mean residual suggests the parameter; its neighbors are tried
+        // too since the estimate is rough
+        int estimate = 0;
+        while (estimate < max_rice_parameter && ((uint64_t)count << (estimate + 1)) <= sum)
+            estimate += 1;
+        for (int k = max(0, estimate - 1); k <= min(max_rice_parameter, estimate + 1); k += 1) {
+            long bytes = 2 + 3L * order + (residual_bits(residuals[order], count, k) + 7) / 8;
+            if (bytes < best_bytes) {
+                best_bytes = bytes;
+                best_order = order;
+                best_k = k;
+            }
+        }
+    }
+
+    if (best_order < 0) {
+        ok_or_panic(out.append(verbatim_mode));
+        for (int i = 0; i < frame_count; i += 1)
+            put_int24(out, samples[i]);
+        return;
+    }
+    ok_or_panic(out.append(best_order));
+    ok_or_panic(out.append(best_k));
+    for (int i = 0; i < best_order; i += 1)
+        put_int24(out, samples[i]);
+    BitWriter writer = {&out, 0, 0};
+    const uint32_t *best_residuals = residuals[best_order];
+    for (int i = 0; i < frame_count - best_order; i += 1) {
+        uint32_t value = best_residuals[i];
+        uint32_t quotient = value >> best_k;
+        if (quotient < (uint32_t)rice_escape) {
+            write_bits(&writer, ((1u << quotient) - 1) << 1, quotient + 1);
+            write_bits(&writer, value & ((1u << best_k) - 1), best_k);
+        } else {
+            write_bits(&writer, 0xffffffffu, rice_escape);
+            write_bits(&writer, value, 32);
+        }
+    }
+    flush_bits(&writer);
+}
+
+void sample_codec_decode(const uint8_t *src, long byte_count, int frame_count, float offset, float scale,
+        float *dest)
+{
+    uint8_t mode = src[0];
+    if (mode == verbatim_mode) {
+        for (int i = 0; i < frame_count; i += 1)
+            dest[i] = (get_int24(src + 1 + 3 * i) + offset) * scale;
+        return;
+    }
+    int order = mode;
+    int k = src[1];
+    const uint8_t *ptr = src + 2;
+    int32_t history[max_order];
+    for (int i = 0; i < order; i += 1, ptr += 3) {
+        history[i] = get_int24(ptr);
+        dest[i] = (history[i] + offset) * scale;
+    }
+    const uint8_t *end = src + byte_count;
+    BitReader reader = {ptr, 0, 0};
+    int32_t previous = (order >= 1) ? history[order - 1] : 0;
+    int32_t before_previous = (order >= 2) ? history[0] : 0;
+    for (int i = order; i < frame_count; i += 1) {
+        int32_t residual = unzigzag(read_rice(&reader, end, k));
+        int32_t sample;
+        switch (order) {
+        case 0: sample = residual; break;
+        case 1: sample = previous + residual; break;
+        default: sample = 2 * previous - before_previous + residual; break;
+        }
+        before_previous = previous;
+        previous = sample;
+        dest[i] = (sample + offset) * scale;
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef GENESIS_SAMPLE_CODEC_HPP
+#define GENESIS_SAMPLE_CODEC_HPP
+
+#include "list.hpp"
+
+#include <stdint.h>
+
+// lossless coding of the integer samples of one channel of an audio file,
+// a block at a time. each block is coded on its own, so any one of them
+// decodes without the others. a block is the residuals of a fixed
+// polynomial predictor of order 0 to 2, whichever codes smallest, as rice
+// codes; or the samples as they are when that is smaller still.
+
+static const int SAMPLE_CODEC_BLOCK_FRAMES = 4096;
+
+// the most bytes sample_codec_encode appends for a block
+static inline int sample_codec_max_block_bytes(int frame_count) {
+    return 2 + 3 * frame_count;
+}
+
+// appends the code for frame_count samples of 24 bits or less. out must
+// already have room for sample_codec_max_block_bytes.
+void sample_codec_encode(const int32_t *samples, int frame_count, List<uint8_t> &out);
+// the frame_count samples of the byte_count byte block at src as floats,
+// dest[i] = (sample + offset) * scale
+void sample_codec_decode(const uint8_t *src, long byte_count, int frame_count, float offset, float scale,
+        float *dest);
+
+#endif
@@ -0,0 +1,594 @@
+#include "sample_format.hpp"
+#include "util.hpp"
+
+#include <string.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#define GENESIS_SAMPLE_FORMAT_X86
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define GENESIS_SAMPLE_FORMAT_NEON
+#endif
+
+// integer formats store round(clamp(sample * write_scale)) + offset in the
+// low bits of Int. read_scale is the exact inverse of the full range so that
+// the most negative value reads back as -1.0.
+struct S8 {
+    typedef int8_t Int;
+    static constexpr float write_scale = 127.0f;
+    static constexpr float min_value = -128.0f;
+    static constexpr float max_value = 127.0f;
+    static constexpr float read_scale = 1.0f / 128.0f;
+    static const uint32_t offset = 0;
+    static const int shift = 0;
+};
+
+struct U8 {
+    typedef uint8_t Int;
+    static constexpr float write_scale = 127.0f;
+    static constexpr float min_value = -128.0f;
+    static constexpr float max_value = 127.0f;
+    static constexpr float read_scale = 1.0f / 128.0f;
+    static const uint32_t offset = 0x80;
+    static const int shift = 0;
+};
+
+struct S16 {
+    typedef int16_t Int;
+    static constexpr float write_scale = 32767.0f;
+    static constexpr float min_value = -32768.0f;
+    static constexpr float max_value = 32767.0f;
+    static constexpr float read_scale = 1.0f / 32768.0f;
+    static const uint32_t offset = 0;
+    static const int shift = 0;
+};
+
+struct U16 {
+    typedef uint16_t Int;
+    static constexpr float write_scale = 32767.0f;
+    static constexpr float min_value = -32768.0f;
+    static constexpr float max_value = 32767.0f;
+    static constexpr float read_scale = 1.0f / 32768.0f;
+    static const uint32_t offset = 0x8000;
+    static const int shift = 0;
+};
+
+// 24 bit formats use the low three bytes of a 32 bit word. shift sign
+// extends them when reading, ignoring whatever is in the high byte.
+struct S24 {
+    typedef int32_t Int;
+    static constexpr float write_scale = 8388607.0f;
+    static constexpr float min_value = -8388608.0f;
+    static constexpr float max_value = 8388607.0f;
+    static constexpr float read_scale = 1.0f / 8388608.0f;
+    static const uint32_t offset = 0;
+    static const int shift = 8;
+};
+
+struct U24 {
+    typedef uint32_t Int;
+    static constexpr float write_scale = 8388607.0f;
+    static constexpr float min_value = -8388608.0f;
+    static constexpr float max_value = 8388607.0f;
+    static constexpr float read_scale = 1.0f / 8388608.0f;
+    static const uint32_t offset = 0x800000;
+    static const int shift = 8;
+};
+
+// 2147483647.0f rounds up to 2^31, which does not fit in an int32_t, so
+// max_value is the largest float below it.
+struct S32 {
+    typedef int32_t Int;
+    static constexpr float write_scale = 2147483648.0f;
+    static constexpr float min_value = -2147483648.0f;
+    static constexpr float max_value = 2147483520.0f;
+    static constexpr float read_scale = 1.0f / 2147483648.0f;
+    static const uint32_t offset = 0;
+    static const int shift = 0;
+};
+
+struct U32 {
+    typedef uint32_t Int;
+    static constexpr float write_scale = 2147483648.0f;
+    static constexpr float min_value = -2147483648.0f;
+    static constexpr float max_value = 2147483520.0f;
+    static constexpr float read_scale = 1.0f / 2147483648.0f;
+    static const uint32_t offset = 0x80000000;
+    static const int shift = 0;
+};
+
+template<int byte_count>
+static inline void swap_endian(char *ptr) {
+    for (int i = 0; i < byte_count / 2; i += 1) {
+        char value = ptr[i];
+        ptr[i] = ptr[byte_count - i - 1];
+        ptr[byte_count - i - 1] = value;
+    }
+}
+
+template<typename Traits>
+static inline int32_t quantize(float sample) {
+    return (int32_t)lrintf(clamp(Traits::min_value, sample * Traits::write_scale, Traits::max_value));
+}
+
+template<typename Traits, bool swap>
+struct IntFormat {
+    typedef typename Traits::Int Int;
+    static const int bytes = sizeof(Int);
+
+    static inline void write(char *ptr, float sample) {
+        Int value = (Int)((uint32_t)quantize<Traits>(sample) + Traits::offset);
+        memcpy(ptr, &value, bytes);
+        if (swap)
+            swap_endian<bytes>(ptr);
+    }
+
+    static inline float read(const char *ptr) {
+        Int raw;
+        memcpy(&raw, ptr, bytes);
+        if (swap)
+            swap_endian<bytes>((char *)&raw);
+        uint32_t bits = ((uint32_t)(int32_t)raw - Traits::offset) << Traits::shift;
+        return (float)((int32_t)bits >> Traits::shift) * Traits::read_scale;
+    }
+};
+
+template<typename T, bool swap>
+struct FloatFormat {
+    static const int bytes = sizeof(T);
+
+    static inline void write(char *ptr, float sample) {
+        T value = sample;
+        memcpy(ptr, &value, bytes);
+        if (swap)
+            swap_endian<bytes>(ptr);
+    }
+
+    static inline float read(const char *ptr) {
+        T value;
+        memcpy(&value, ptr, bytes);
+        if (swap)
+            swap_endian<bytes>((char *)&value);
+        return value;
+    }
+};
+
+template<typename Format>
+static void write_samples(char *dest, const float *src, int count) {
+    for (int i = 0; i < count; i += 1)
+        Format::write(dest + i * Format::bytes, src[i]);
+}
+
+template<typename Format>
+static void read_samples(float *dest, const char *src, int count) {
+    for (int i = 0; i < count; i += 1)
+        dest[i] = Format::read(src + i * Format::bytes);
+}
+
+template<typename Format>
+static void write_samples_strided(char *dest, int dest_step, const float *src, int src_stride, int count) {
+    for (int i = 0; i < count; i += 1) {
+        Format::write(dest, *src);
+        dest += dest_step;
+        src += src_stride;
+    }
+}
+
+template<typename Format>
+static void read_samples_strided(float *dest, int dest_stride, const char *src, int src_step, int count) {
+    for (int i = 0; i < count; i += 1) {
+        *dest = Format::read(src);
+        dest += dest_stride;
+        src += src_step;
+    }
+}
+
+// native endian float32 is what the pipeline uses, so it's just a copy
+static void write_samples_float32ne(char *dest, const float *src, int count) {
+    memcpy(dest, src, count * sizeof(float));
+}
+
+static void read_samples_float32ne(float *dest, const char *src, int count) {
+    memcpy(dest, src, count * sizeof(float));
+}
+
+template<typename Format>
+static constexpr SampleFormatInfo make_info(SoundIoFormat format) {
+    return {
+        format,
+        Format::bytes,
+        write_samples<Format>,
+        read_samples<Format>,
+        write_samples_strided<Format>,
+        read_samples_strided<Format>,
+    };
+}
+
+static SampleFormatInfo prioritized_sample_format_infos[] = {
+    {
+        SoundIoFormatFloat32NE,
+        4,
+        write_samples_float32ne,
+        read_samples_float32ne,
+        write_samples_strided<FloatFormat<float, false>>,
+        read_samples_strided<FloatFormat<float, false>>,
+    },
+    make_info<FloatFormat<float, true>>(SoundIoFormatFloat32FE),
+    make_info<FloatFormat<double, false>>(SoundIoFormatFloat64NE),
+    make_info<FloatFormat<double, true>>(SoundIoFormatFloat64FE),
+    make_info<IntFormat<S32, false>>(SoundIoFormatS32NE),
+    make_info<IntFormat<S32, true>>(SoundIoFormatS32FE),
+    make_info<IntFormat<U32, false>>(SoundIoFormatU32NE),
+    make_info<IntFormat<U32, true>>(SoundIoFormatU32FE),
+    make_info<IntFormat<S24, false>>(SoundIoFormatS24NE),
+    make_info<IntFormat<S24, true>>(SoundIoFormatS24FE),
+    make_info<IntFormat<U24, false>>(SoundIoFormatU24NE),
+    make_info<IntFormat<U24, true>>(SoundIoFormatU24FE),
+    make_info<IntFormat<S16, false>>(SoundIoFormatS16NE),
+    make_info<IntFormat<S16, true>>(SoundIoFormatS16FE),
+    make_info<IntFormat<U16, false>>(SoundIoFormatU16NE),
+    make_info<IntFormat<U16, true>>(SoundIoFormatU16FE),
+    make_info<IntFormat<S8, false>>(SoundIoFormatS8),
+    make_info<IntFormat<U8, false>>(SoundIoFormatU8),
+};
+
+// the formats which have simd versions. the loops below convert whole
+// vectors and leave the tail to the scalar versions, which round and clip
+// exactly the same way.
+struct SimdConverters {
+    void (*write_s16)(char *dest, const float *src, int count);
+    void (*read_s16)(float *dest, const char *src, int count);
+    void (*write_s24)(char *dest, const float *src, int count);
+    void (*read_s24)(float *dest, const char *src, int count);
+    void (*write_s32)(char *dest, const float *src, int count);
+    void (*read_s32)(float *dest, const char *src, int count);
+};
+
+static const SimdConverters scalar_converters = {
+    write_samples<IntFormat<S16, false>>,
+    read_samples<IntFormat<S16, false>>,
+    write_samples<IntFormat<S24, false>>,
+    read_samples<IntFormat<S24, false>>,
+    write_samples<IntFormat<S32, false>>,
+    read_samples<IntFormat<S32, false>>,
+};
+
+#if defined(GENESIS_SAMPLE_FORMAT_X86) && defined(__SSE2__)
+
+template<typename Traits>
+static inline __m128i quantize_sse2(__m128 samples) {
+    __m128 scaled = _mm_mul_ps(samples, _mm_set1_ps(Traits::write_scale));
+    scaled = _mm_min_ps(scaled, _mm_set1_ps(Traits::max_value));
+    scaled = _mm_max_ps(scaled, _mm_set1_ps(Traits::min_value));
+    return _mm_cvtps_epi32(scaled);
+}
+
+static void write_s16_sse2(char *dest, const float *src, int count) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i low = quantize_sse2<S16>(_mm_loadu_ps(src + i));
+        __m128i high = quantize_sse2<S16>(_mm_loadu_ps(src + i + 4));
+        _mm_storeu_si128((__m128i *)(dest + i * 2), _mm_packs_epi32(low, high));
+    }
+    write_samples<IntFormat<S16, false>>(dest + i * 2, src + i, count - i);
+}
+
+static void read_s16_sse2(float *dest, const char *src, int count) {
+    const __m128 scale = _mm_set1_ps(S16::read_scale);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i samples = _mm_loadu_si128((const __m128i *)(src + i * 2));
+        // put each sample in the high half of a 32 bit lane, then sign extend
+        __m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16);
+        __m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16);
+        _mm_storeu_ps(dest + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+        _mm_storeu_ps(dest + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+    }
+    read_samples<IntFormat<S16, false>>(dest + i, src + i * 2, count - i);
+}
+
+template<typename Traits>
+static void write_int32_sse2(char *dest, const float *src, int count) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_si128((__m128i *)(dest + i * 4), quantize_sse2<Traits>(_mm_loadu_ps(src + i)));
+    write_samples<IntFormat<Traits, false>>(dest + i * 4, src + i, count - i);
+}
+
+template<typename Traits>
+static void read_int32_sse2(float *dest, const char *src, int count) {
+    const __m128 scale = _mm_set1_ps(Traits::read_scale);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i samples = _mm_loadu_si128((const __m128i *)(src + i * 4));
+        samples = _mm_srai_epi32(_mm_slli_epi32(samples, Traits::shift), Traits::shift);
+        _mm_storeu_ps(dest + i, _mm_mul_ps(_mm_cvtepi32_ps(samples), scale));
+    }
+    read_samples<IntFormat<Traits, false>>(dest + i, src + i * 4, count - i);
+}
+
+static const SimdConverters sse2_converters = {
+    write_s16_sse2,
+    read_s16_sse2,
+    write_int32_sse2<S24>,
+    read_int32_sse2<S24>,
+    write_int32_sse2<S32>,
+    read_int32_sse2<S32>,
+};
+
+#endif
+
+#if defined(GENESIS_SAMPLE_FORMAT_X86)
+
+template<typename Traits>
+__attribute__((target("avx2")))
+static inline __m256i quantize_avx2(__m256 samples) {
+    __m256 scaled = _mm256_mul_ps(samples, _mm256_set1_ps(Traits::write_scale));
+    scaled = _mm256_min_ps(scaled, _mm256_set1_ps(Traits::max_value));
+    scaled = _mm256_max_ps(scaled, _mm256_set1_ps(Traits::min_value));
+    return _mm256_cvtps_epi32(scaled);
+}
+
+__attribute__((target("avx2")))
+static void write_s16_avx2(char *dest, const float *src, int count) {
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i low = quantize_avx2<S16>(_mm256_loadu_ps(src + i));
+        __m256i high = quantize_avx2<S16>(_mm256_loadu_ps(src + i + 8));
+        // packs works within 128 bit lanes, so put the quarters back in order
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(low, high), 0xd8);
+        _mm256_storeu_si256((__m256i *)(dest + i * 2), packed);
+    }
+    write_samples<IntFormat<S16, false>>(dest + i * 2, src + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void read_s16_avx2(float *dest, const char *src, int count) {
+    const __m256 scale = _mm256_set1_ps(S16::read_scale);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i samples = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(src + i * 2)));
+        _mm256_storeu_ps(dest + i, _mm256_mul_ps(_mm256_cvtepi32_ps(samples), scale));
+    }
+    read_samples<IntFormat<S16, false>>(dest + i, src + i * 2, count - i);
+}
+
+template<typename Traits>
+__attribute__((target("avx2")))
+static void write_int32_avx2(char *dest, const float *src, int count) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8)
+        _mm256_storeu_si256((__m256i *)(dest + i * 4), quantize_avx2<Traits>(_mm256_loadu_ps(src + i)));
+    write_samples<IntFormat<Traits, false>>(dest + i * 4, src + i, count - i);
+}
+
+template<typename Traits>
+__attribute__((target("avx2")))
+static void read_int32_avx2(float *dest, const char *src, int count) {
+    const __m256 scale = _mm256_set1_ps(Traits::read_scale);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i samples = _mm256_loadu_si256((const __m256i *)(src + i * 4));
+        samples = _mm256_srai_epi32(_mm256_slli_epi32(samples, Traits::shift), Traits::shift);
+        _mm256_storeu_ps(dest + i, _mm256_mul_ps(_mm256_cvtepi32_ps(samples), scale));
+    }
+    read_samples<IntFormat<Traits, false>>(dest + i, src + i * 4, count - i);
+}
+
+static const SimdConverters avx2_converters = {
+    write_s16_avx2,
+    read_s16_avx2,
+    write_int32_avx2<S24>,
+    read_int32_avx2<S24>,
+    write_int32_avx2<S32>,
+    read_int32_avx2<S32>,
+};
+
+#endif
+
+#if defined(GENESIS_SAMPLE_FORMAT_NEON)
+
+template<typename Traits>
+static inline int32x4_t quantize_neon(float32x4_t samples) {
+    float32x4_t scaled = vmulq_n_f32(samples, Traits::write_scale);
+    scaled = vminq_f32(scaled, vdupq_n_f32(Traits::max_value));
+    scaled = vmaxq_f32(scaled, vdupq_n_f32(Traits::min_value));
+    // round to nearest even, like lrintf in the default rounding mode
+    return vcvtnq_s32_f32(scaled);
+}
+
+static void write_s16_neon(char *dest, const float *src, int count) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        int16x4_t low = vqmovn_s32(quantize_neon<S16>(vld1q_f32(src + i)));
+        int16x4_t high = vqmovn_s32(quantize_neon<S16>(vld1q_f32(src + i + 4)));
+        vst1q_s16((int16_t *)(dest + i * 2), vcombine_s16(low, high));
+    }
+    write_samples<IntFormat<S16, false>>(dest + i * 2, src + i, count - i);
+}
+
+static void read_s16_neon(float *dest, const char *src, int count) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t samples = vld1q_s16((const int16_t *)(src + i * 2));
+        int32x4_t low = vmovl_s16(vget_low_s16(samples));
+        int32x4_t high = vmovl_s16(vget_high_s16(samples));
+        vst1q_f32(dest + i, vmulq_n_f32(vcvtq_f32_s32(low), S16::read_scale));
+        vst1q_f32(dest + i + 4, vmulq_n_f32(vcvtq_f32_s32(high), S16::read_scale));
+    }
+    read_samples<IntFormat<S16, false>>(dest + i, src + i * 2, count - i);
+}
+
+template<typename Traits>
+static void write_int32_neon(char *dest, const float *src, int count) {
+    int i = 0;
+    for (; i + 4 <= count; i += 4)
+        vst1q_s32((int32_t *)(dest + i * 4), quantize_neon<Traits>(vld1q_f32(src + i)));
+    write_samples<IntFormat<Traits, false>>(dest + i * 4, src + i, count - i);
+}
+
+template<typename Traits>
+static void read_int32_neon(float *dest, const char *src, int count) {
+    const int32x4_t left = vdupq_n_s32(Traits::shift);
+    const int32x4_t right = vdupq_n_s32(-Traits::shift);
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        int32x4_t samples = vld1q_s32((const int32_t *)(src + i * 4));
+        samples = vshlq_s32(vshlq_s32(samples, left), right);
+        vst1q_f32(dest + i, vmulq_n_f32(vcvtq_f32_s32(samples), Traits::read_scale));
+    }
+    read_samples<IntFormat<Traits, false>>(dest + i, src + i * 4, count - i);
+}
+
+static const SimdConverters neon_converters = {
+    write_s16_neon,
+    read_s16_neon,
+    write_int32_neon<S24>,
+    read_int32_neon<S24>,
+    write_int32_neon<S32>,
+    read_int32_neon<S32>,
+};
+
+#endif
+
+static SampleFormatInfo *find_info(SoundIoFormat format) {
+    for (int i = 0; i < array_length(prioritized_sample_format_infos); i += 1) {
+        if (prioritized_sample_format_infos[i].format == format)
+            return &prioritized_sample_format_infos[i];
+    }
+    panic("unknown sample format");
+}
+
+static void set_converters(SoundIoFormat format,
+        void (*write)(char *dest, const float *src, int count),
+        void (*read)(float *dest, const char *src, int count))
+{
+    SampleFormatInfo *info = find_info(format);
+    info->write_samples = write;
+    info->read_samples = read;
+}
+
+bool sample_format_simd_supported(SampleFormatSimd simd) {
+    switch (simd) {
+    case SampleFormatSimdNone:
+        return true;
+    case SampleFormatSimdSse2:
+#if defined(GENESIS_SAMPLE_FORMAT_X86) && defined(__SSE2__)
+        return true;
+#else
+        return false;
+#endif
+    case SampleFormatSimdAvx2:
+#if defined(GENESIS_SAMPLE_FORMAT_X86)
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#else
+        return false;
+#endif
+    case SampleFormatSimdNeon:
+#if defined(GENESIS_SAMPLE_FORMAT_NEON)
+        return true;
+#else
+        return false;
+#endif
+    }
+    panic("invalid SampleFormatSimd");
+}
+
+SampleFormatSimd sample_format_best_simd(void) {
+    static const SampleFormatSimd prioritized_simds[] = {
+        SampleFormatSimdAvx2,
+        SampleFormatSimdNeon,
+        SampleFormatSimdSse2,
+    };
+    for (int i = 0; i < array_length(prioritized_simds); i += 1) {
+        if (sample_format_simd_supported(prioritized_simds[i]))
+            return prioritized_simds[i];
+    }
+    return SampleFormatSimdNone;
+}
+
+void sample_format_select_simd(SampleFormatSimd simd) {
+    if (!sample_format_simd_supported(simd))
+        panic("unsupported SampleFormatSimd");
+
+    const SimdConverters *converters = &scalar_converters;
+    switch (simd) {
+    case SampleFormatSimdNone:
+        break;
+#if defined(GENESIS_SAMPLE_FORMAT_X86) && defined(__SSE2__)
+    case SampleFormatSimdSse2:
+        converters = &sse2_converters;
+        break;
+#endif
+#if defined(GENESIS_SAMPLE_FORMAT_X86)
+    case SampleFormatSimdAvx2:
+        converters = &avx2_converters;
+        break;
+#endif
+#if defined(GENESIS_SAMPLE_FORMAT_NEON)
+    case SampleFormatSimdNeon:
+        converters = &neon_converters;
+        break;
+#endif
+    default:
+        break;
+    }
+    set_converters(SoundIoFormatS16NE, converters->write_s16, converters->read_s16);
+    set_converters(SoundIoFormatS24NE, converters->write_s24, converters->read_s24);
+    set_converters(SoundIoFormatS32NE, converters->write_s32, converters->read_s32);
+}
+
+void sample_format_init(void) {
+    sample_format_select_simd(sample_format_best_simd());
+}
+
+int sample_format_info_count(void) {
+    return array_length(prioritized_sample_format_infos);
+}
+
+const SampleFormatInfo *sample_format_info_at(int index) {
+    assert(index >= 0);
+    assert(index < array_length(prioritized_sample_format_infos));
+    return &prioritized_sample_format_infos[index];
+}
+
+const SampleFormatInfo *sample_format_info_find(SoundIoFormat format) {
+    return find_info(format);
+}
+
+// true if the areas are one interleaved buffer, so that a whole span is
+// contiguous on both sides
+static bool areas_are_interleaved(const SampleFormatInfo *info, const SoundIoChannelArea *areas,
+        int channel_count)
+{
+    int frame_bytes = info->bytes_per_sample * channel_count;
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        if (areas[ch].step != frame_bytes || areas[ch].ptr != areas[0].ptr + ch * info->bytes_per_sample)
+            return false;
+    }
+    return true;
+}
+
+void sample_format_write_areas(const SampleFormatInfo *info, const SoundIoChannelArea *areas,
+        int channel_count, const float *src, int frame_count)
+{
+    if (areas_are_interleaved(info, areas, channel_count)) {
+        info->write_samples(areas[0].ptr, src, frame_count * channel_count);
+        return;
+    }
+    for (int ch = 0; ch < channel_count; ch += 1)
+        info->write_samples_strided(areas[ch].ptr, areas[ch].step, src + ch, channel_count, frame_count);
+}
+
+void sample_format_read_areas(const SampleFormatInfo *info, const SoundIoChannelArea *areas,
+        int channel_count, float *dest, int frame_count)
+{
+    if (areas_are_interleaved(info, areas, channel_count)) {
+        info->read_samples(dest, areas[0].ptr, frame_count * channel_count);
+        return;
+    }
+    for (int ch = 0; ch < channel_count; ch += 1)
+        info->read_samples_strided(dest + ch, channel_count, areas[ch].ptr, areas[ch].step, frame_count);
+}
@@ -0,0 +1,50 @@
+#ifndef GENESIS_SAMPLE_FORMAT_HPP
+#define GENESIS_SAMPLE_FORMAT_HPP
+
+#include <soundio/soundio.h>
+
+enum SampleFormatSimd {
+    SampleFormatSimdNone,
+    SampleFormatSimdSse2,
+    SampleFormatSimdAvx2,
+    SampleFormatSimdNeon,
+};
+
+// converts between the float samples that flow through the pipeline and a
+// device sample format, a whole span per call. integer formats clip samples
+// outside of [-1.0, 1.0].
+struct SampleFormatInfo {
+    SoundIoFormat format;
+    int bytes_per_sample;
+    // count samples; dest and src are both contiguous
+    void (*write_samples)(char *dest, const float *src, int count);
+    void (*read_samples)(float *dest, const char *src, int count);
+    // count samples; steps are in bytes and strides are in floats
+    void (*write_samples_strided)(char *dest, int dest_step, const float *src, int src_stride, int count);
+    void (*read_samples_strided)(float *dest, int dest_stride, const char *src, int src_step, int count);
+};
+
+// chooses the fastest converters the cpu supports. not thread safe; called
+// once from genesis_context_create.
+void sample_format_init(void);
+
+// the best instruction set available on this cpu
+SampleFormatSimd sample_format_best_simd(void);
+bool sample_format_simd_supported(SampleFormatSimd simd);
+// for testing. simd must be supported. not thread safe.
+void sample_format_select_simd(SampleFormatSimd simd);
+
+// in order of preference
+int sample_format_info_count(void);
+const SampleFormatInfo *sample_format_info_at(int index);
+// format must be one of the listed ones
+const SampleFormatInfo *sample_format_info_find(SoundIoFormat format);
+
+// frame_count interleaved frames from src into one area per channel
+void sample_format_write_areas(const SampleFormatInfo *info, const SoundIoChannelArea *areas,
+        int channel_count, const float *src, int frame_count);
+// frame_count frames from one area per channel into interleaved dest
+void sample_format_read_areas(const SampleFormatInfo *info, const SoundIoChannelArea *areas,
+        int channel_count, float *dest, int frame_count);
+
+#endif
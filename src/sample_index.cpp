@@ -0,0 +1,611 @@
+#include "sample_index.hpp"
+#include "dir_scanner.hpp"
+#include "ordered_map_file.hpp"
+#include "waveform_peaks.hpp"
+#include "audio_file.hpp"
+#include "string.hpp"
+#include "os.hpp"
+#include "util.hpp"
+
+#include <math.h>
+#include <string.h>
+
+static const uint8_t record_version = 1;
+// how often the index thread picks up what the dir scanner found
+static const double poll_seconds = 0.1;
+// the folded paths are packed again once more than this many are dead and
+// they outnumber the live ones
+static const int min_compact_dead_count = 1024;
+
+// one for each path, in the order they were first indexed
+struct SampleIndexSlot {
+    ByteBuffer path;
+    // where the folded path starts in names_text
+    int text_offset;
+    long mtime;
+    int64_t size;
+    bool live;
+};
+
+struct SampleIndex {
+    GenesisContext *context;
+    OrderedMapFile *omf;
+    DirScanner *dir_scanner;
+    OsThread *thread;
+    OsMutex *mutex;
+    OsCond *cond;
+    atomic_long generation;
+
+    // guarded by mutex. names_text holds the paths of the slots folded to
+    // lower case, each followed by a 0 byte, so that a substring search is
+    // one pass over it. only the index thread changes these.
+    bool exit;
+    List<ByteBuffer> new_dirs;
+    ByteBuffer names_text;
+    List<SampleIndexSlot> slots;
+    FlatHashMap<ByteBuffer, int, ByteBuffer::hash> slot_by_path;
+    int dead_slot_count;
+
+    // index thread only. the batches of each listing until it is complete.
+    FlatHashMap<ByteBuffer, List<OsDirEntry *> *, ByteBuffer::hash> listings;
+    List<DirScanBatch *> batches;
+};
+
+static void fold_case(const ByteBuffer &text, ByteBuffer &out) {
+    bool ok;
+    String decoded = String::decode(text, &ok);
+    if (ok) {
+        decoded.make_lower_case();
+        out = decoded.encode();
+        return;
+    }
+    out = text;
+    for (int i = 0; i < out.length(); i += 1) {
+        char c = out.at(i);
+        if (c >= 'A' && c <= 'Z')
+            out.at(i) = c - 'A' + 'a';
+    }
+}
+
+static int compare_paths(ByteBuffer a, ByteBuffer b) {
+    return ByteBuffer::compare(a, b);
+}
+
+static void serialize_record(const SampleIndexRecord *record, ByteBuffer &out) {
+    out.clear();
+    out.append_uint8(record_version);
+    out.append_uint64be(record->mtime);
+    out.append_uint64be(record->size);
+    out.append_uint32be(record->err);
+    if (record->err)
+        return;
+    out.append_uint64be(record->frame_count);
+    out.append_uint32be(record->sample_rate);
+    out.append_uint32be(record->channel_layout.channel_count);
+    for (int i = 0; i < record->channel_layout.channel_count; i += 1)
+        out.append_uint32be(record->channel_layout.channels[i]);
+    out.append_uint32be(record->tags.length());
+    for (int i = 0; i < record->tags.length(); i += 1) {
+        const SampleIndexTag *tag = &record->tags.at(i);
+        out.append_uint32be(tag->key.length());
+        out.append(tag->key);
+        out.append_uint32be(tag->value.length());
+        out.append(tag->value);
+    }
+    out.append_uint32be(record->thumbnail_width);
+    for (int i = 0; i < record->thumbnail_width; i += 1) {
+        out.append_uint8(record->thumbnail_min[i]);
+        out.append_uint8(record->thumbnail_max[i]);
+    }
+}
+
+static int deserialize_uint32be(uint32_t *x, const ByteBuffer &buffer, int *offset) {
+    if (buffer.length() - *offset < 4)
+        return GenesisErrorInvalidFormat;
+    *x = read_uint32be(buffer.raw() + *offset);
+    *offset += 4;
+    return 0;
+}
+
+static int deserialize_uint64be(uint64_t *x, const ByteBuffer &buffer, int *offset) {
+    if (buffer.length() - *offset < 8)
+        return GenesisErrorInvalidFormat;
+    *x = read_uint64be(buffer.raw() + *offset);
+    *offset += 8;
+    return 0;
+}
+
+static int deserialize_bytes(ByteBuffer &out, const ByteBuffer &buffer, int *offset) {
+    uint32_t length;
+    int err;
+    if ((err = deserialize_uint32be(&length, buffer, offset)))
+        return err;
+    if ((uint32_t)(buffer.length() - *offset) < length)
+        return GenesisErrorInvalidFormat;
+    out = ByteBuffer(buffer.raw() + *offset, length);
+    *offset += length;
+    return 0;
+}
+
+// only_stat stops after the mtime and size
+static int deserialize_record(SampleIndexRecord *record, const ByteBuffer &buffer, bool only_stat) {
+    int offset = 0;
+    if (buffer.length() < 1 || (uint8_t)buffer.at(0) != record_version)
+        return GenesisErrorInvalidFormat;
+    offset += 1;
+
+    uint64_t x64;
+    uint32_t x32;
+    int err;
+    if ((err = deserialize_uint64be(&x64, buffer, &offset))) return err;
+    record->mtime = x64;
+    if ((err = deserialize_uint64be(&x64, buffer, &offset))) return err;
+    record->size = x64;
+    if (only_stat)
+        return 0;
+    if ((err = deserialize_uint32be(&x32, buffer, &offset))) return err;
+    record->err = x32;
+    if (record->err)
+        return 0;
+
+    if ((err = deserialize_uint64be(&x64, buffer, &offset))) return err;
+    record->frame_count = x64;
+    if ((err = deserialize_uint32be(&x32, buffer, &offset))) return err;
+    record->sample_rate = x32;
+    if ((err = deserialize_uint32be(&x32, buffer, &offset))) return err;
+    if (x32 > GENESIS_MAX_CHANNELS)
+        return GenesisErrorInvalidFormat;
+    record->channel_layout.channel_count = x32;
+    for (int i = 0; i < record->channel_layout.channel_count; i += 1) {
+        if ((err = deserialize_uint32be(&x32, buffer, &offset))) return err;
+        if (x32 >= GENESIS_CHANNEL_ID_COUNT)
+            return GenesisErrorInvalidFormat;
+        record->channel_layout.channels[i] = (SoundIoChannelId)x32;
+    }
+    soundio_channel_layout_detect_builtin(&record->channel_layout);
+
+    uint32_t tag_count;
+    if ((err = deserialize_uint32be(&tag_count, buffer, &offset))) return err;
+    record->tags.clear();
+    for (uint32_t i = 0; i < tag_count; i += 1) {
+        SampleIndexTag tag;
+        if ((err = deserialize_bytes(tag.key, buffer, &offset))) return err;
+        if ((err = deserialize_bytes(tag.value, buffer, &offset))) return err;
+        if ((err = record->tags.append(tag))) return err;
+    }
+
+    if ((err = deserialize_uint32be(&x32, buffer, &offset))) return err;
+    if (x32 > SAMPLE_INDEX_THUMBNAIL_WIDTH || (uint32_t)(buffer.length() - offset) < x32 * 2)
+        return GenesisErrorInvalidFormat;
+    record->thumbnail_width = x32;
+    for (int i = 0; i < record->thumbnail_width; i += 1) {
+        record->thumbnail_min[i] = (int8_t)buffer.at(offset);
+        record->thumbnail_max[i] = (int8_t)buffer.at(offset + 1);
+        offset += 2;
+    }
+    return 0;
+}
+
+static int8_t quantize_peak(float value) {
+    return (int8_t)clamp(-127.0f, roundf(value * 127.0f), 127.0f);
+}
+
+static void make_thumbnail(GenesisAudioFile *audio_file, SampleIndexRecord *record) {
+    WaveformPeaks *peaks;
+    if (waveform_peaks_create_from_audio_file(audio_file, &peaks))
+        return;
+    WaveformPeak channel_peaks[SAMPLE_INDEX_THUMBNAIL_WIDTH];
+    WaveformPeak mixed_peaks[SAMPLE_INDEX_THUMBNAIL_WIDTH];
+    int channel_count = record->channel_layout.channel_count;
+    for (int ch = 0; ch < channel_count; ch += 1) {
+        waveform_peaks_query(peaks, ch, 0, record->frame_count, SAMPLE_INDEX_THUMBNAIL_WIDTH,
+                audio_file_channel_samples(audio_file, ch), channel_peaks);
+        for (int i = 0; i < SAMPLE_INDEX_THUMBNAIL_WIDTH; i += 1) {
+            if (ch == 0) {
+                mixed_peaks[i] = channel_peaks[i];
+            } else {
+                mixed_peaks[i].min = min(mixed_peaks[i].min, channel_peaks[i].min);
+                mixed_peaks[i].max = max(mixed_peaks[i].max, channel_peaks[i].max);
+            }
+        }
+    }
+    waveform_peaks_destroy(peaks);
+    record->thumbnail_width = channel_count ? SAMPLE_INDEX_THUMBNAIL_WIDTH : 0;
+    for (int i = 0; i < record->thumbnail_width; i += 1) {
+        record->thumbnail_min[i] = quantize_peak(mixed_peaks[i].min);
+        record->thumbnail_max[i] = quantize_peak(mixed_peaks[i].max);
+    }
+}
+
+static void probe_file(SampleIndex *index, const ByteBuffer &path, const OsDirEntry *dir_entry,
+        SampleIndexRecord *record)
+{
+    record->mtime = dir_entry->mtime;
+    record->size = dir_entry->size;
+    GenesisAudioFile *audio_file;
+    if ((record->err = genesis_audio_file_open(index->context, path.raw(), &audio_file)))
+        return;
+
+    record->frame_count = genesis_audio_file_frame_count(audio_file);
+    record->sample_rate = genesis_audio_file_sample_rate(audio_file);
+    record->channel_layout = *genesis_audio_file_channel_layout(audio_file);
+    auto it = audio_file->tags.entry_iterator();
+    for (;;) {
+        auto *entry = it.next();
+        if (!entry)
+            break;
+        ok_or_panic(record->tags.append({entry->key, entry->value}));
+    }
+    if (!genesis_audio_file_is_streamed(audio_file) && record->frame_count > 0)
+        make_thumbnail(audio_file, record);
+    genesis_audio_file_destroy(audio_file);
+}
+
+// with mutex held
+static void compact_slots(SampleIndex *index) {
+    List<SampleIndexSlot> live_slots;
+    ByteBuffer names_text;
+    index->slot_by_path.clear();
+    for (int i = 0; i < index->slots.length(); i += 1) {
+        SampleIndexSlot *slot = &index->slots.at(i);
+        if (!slot->live)
+            continue;
+        const char *text = index->names_text.raw() + slot->text_offset;
+        SampleIndexSlot live_slot = *slot;
+        live_slot.text_offset = names_text.length();
+        names_text.append(text, strlen(text) + 1);
+        index->slot_by_path.put(live_slot.path, live_slots.length());
+        ok_or_panic(live_slots.append(live_slot));
+    }
+    index->slots.clear();
+    for (int i = 0; i < live_slots.length(); i += 1)
+        ok_or_panic(index->slots.append(live_slots.at(i)));
+    index->names_text = names_text;
+    index->dead_slot_count = 0;
+}
+
+static void set_slot(SampleIndex *index, const ByteBuffer &path, long mtime, int64_t size) {
+    ByteBuffer folded;
+    fold_case(path, folded);
+    OsMutexLocker locker(index->mutex);
+    auto *entry = index->slot_by_path.maybe_get(path);
+    if (entry) {
+        SampleIndexSlot *slot = &index->slots.at(entry->value);
+        slot->mtime = mtime;
+        slot->size = size;
+        return;
+    }
+    SampleIndexSlot slot;
+    slot.path = path;
+    slot.text_offset = index->names_text.length();
+    slot.mtime = mtime;
+    slot.size = size;
+    slot.live = true;
+    index->names_text.append(folded.raw(), folded.length() + 1);
+    index->slot_by_path.put(path, index->slots.length());
+    ok_or_panic(index->slots.append(slot));
+}
+
+static void remove_slot(SampleIndex *index, const ByteBuffer &path) {
+    OsMutexLocker locker(index->mutex);
+    auto *entry = index->slot_by_path.maybe_get(path);
+    if (!entry)
+        return;
+    index->slots.at(entry->value).live = false;
+    index->slot_by_path.remove(path);
+    index->dead_slot_count += 1;
+    if (index->dead_slot_count > min_compact_dead_count &&
+        index->dead_slot_count > index->slots.length() - index->dead_slot_count)
+    {
+        compact_slots(index);
+    }
+}
+
+// a complete listing of dir. files which are new or changed are opened,
+// and paths under dir which are no longer there are removed.
+static void index_listing(SampleIndex *index, const ByteBuffer &dir, List<OsDirEntry *> &entries, int err) {
+    OrderedMapFileBatch *omf_batch = ok_mem(ordered_map_file_batch_create(index->omf));
+    bool changed = false;
+    FlatHashMap<ByteBuffer, OsDirEntry *, ByteBuffer::hash> names;
+    ByteBuffer path;
+    ByteBuffer value;
+    if (!err) {
+        for (int i = 0; i < entries.length(); i += 1) {
+            OsDirEntry *dir_entry = entries.at(i);
+            names.put(dir_entry->name, dir_entry);
+            os_path_join(path, dir, dir_entry->name);
+            if (dir_entry->is_dir) {
+                ok_or_panic(dir_scanner_request(index->dir_scanner, path));
+                continue;
+            }
+            if (!dir_entry->is_file)
+                continue;
+            auto *slot_entry = index->slot_by_path.maybe_get(path);
+            if (slot_entry) {
+                SampleIndexSlot *slot = &index->slots.at(slot_entry->value);
+                if (slot->mtime == dir_entry->mtime && slot->size == dir_entry->size)
+                    continue;
+            }
+            SampleIndexRecord record = {};
+            probe_file(index, path, dir_entry, &record);
+            serialize_record(&record, value);
+            ordered_map_file_batch_put_bytes(omf_batch, path.raw(), path.length(), value.raw(), value.length());
+            set_slot(index, path, record.mtime, record.size);
+            changed = true;
+        }
+    }
+
+    // puts still queued from an earlier listing are not seen here, so a
+    // file removed meanwhile waits for the listing after
+    ByteBuffer prefix;
+    os_path_join(prefix, dir, "");
+    OrderedMapFileCursor cursor;
+    ordered_map_file_cursor_init(index->omf, &cursor, prefix);
+    while (ordered_map_file_cursor_next(&cursor)) {
+        const char *rest = cursor.key.raw() + prefix.length();
+        const char *slash = strchr(rest, '/');
+        ByteBuffer name = slash ? ByteBuffer(rest, slash - rest) : ByteBuffer(rest);
+        auto *name_entry = names.maybe_get(name);
+        if (name_entry && (slash ? name_entry->value->is_dir : name_entry->value->is_file))
+            continue;
+        ordered_map_file_batch_del_bytes(omf_batch, cursor.key.raw(), cursor.key.length());
+        remove_slot(index, cursor.key);
+        changed = true;
+    }
+
+    if (omf_batch->put_count > 0 || omf_batch->del_count > 0)
+        ok_or_panic(ordered_map_file_batch_exec(omf_batch));
+    else
+        ordered_map_file_batch_destroy(omf_batch);
+    if (changed)
+        index->generation += 1;
+}
+
+static void apply_batch(SampleIndex *index, DirScanBatch *batch) {
+    auto *entry = index->listings.maybe_get(batch->dir);
+    List<OsDirEntry *> *listing;
+    if (entry) {
+        listing = entry->value;
+    } else {
+        listing = ok_mem(create_zero<List<OsDirEntry *>>());
+        index->listings.put(batch->dir, listing);
+    }
+    if (batch->first) {
+        for (int i = 0; i < listing->length(); i += 1)
+            os_dir_entry_unref(listing->at(i));
+        listing->clear();
+    }
+    for (int i = 0; i < batch->entries.length(); i += 1) {
+        OsDirEntry *dir_entry = batch->entries.at(i);
+        os_dir_entry_ref(dir_entry);
+        ok_or_panic(listing->append(dir_entry));
+    }
+    if (!batch->last)
+        return;
+
+    index_listing(index, batch->dir, *listing, batch->err);
+    for (int i = 0; i < listing->length(); i += 1)
+        os_dir_entry_unref(listing->at(i));
+    destroy(listing, 1);
+    index->listings.remove(batch->dir);
+}
+
+static void index_thread_run(void *arg) {
+    SampleIndex *index = (SampleIndex *)arg;
+    for (;;) {
+        {
+            OsMutexLocker locker(index->mutex);
+            if (!index->exit && index->new_dirs.length() == 0)
+                os_cond_timed_wait(index->cond, index->mutex, poll_seconds);
+            if (index->exit)
+                return;
+            for (int i = 0; i < index->new_dirs.length(); i += 1)
+                ok_or_panic(dir_scanner_request(index->dir_scanner, index->new_dirs.at(i)));
+            index->new_dirs.clear();
+        }
+
+        ok_or_panic(dir_scanner_poll(index->dir_scanner, index->batches));
+        for (int i = 0; i < index->batches.length(); i += 1) {
+            DirScanBatch *batch = index->batches.at(i);
+            apply_batch(index, batch);
+            dir_scan_batch_destroy(batch);
+        }
+        index->batches.clear();
+    }
+}
+
+// the slots come from the keys, and keys which are not records are deleted
+static int load_slots(SampleIndex *index) {
+    OrderedMapFileBatch *omf_batch = ordered_map_file_batch_create(index->omf);
+    if (!omf_batch)
+        return GenesisErrorNoMem;
+    int count = ordered_map_file_count(index->omf);
+    ByteBuffer value;
+    for (int i = 0; i < count; i += 1) {
+        ByteBuffer *key;
+        int err;
+        if ((err = ordered_map_file_get(index->omf, i, &key, value))) {
+            ordered_map_file_batch_destroy(omf_batch);
+            return err;
+        }
+        SampleIndexRecord record;
+        if (deserialize_record(&record, value, true)) {
+            ordered_map_file_batch_del_bytes(omf_batch, key->raw(), key->length());
+            continue;
+        }
+        set_slot(index, *key, record.mtime, record.size);
+    }
+    ordered_map_file_done_reading(index->omf);
+    if (omf_batch->del_count > 0)
+        return ordered_map_file_batch_exec(omf_batch);
+    ordered_map_file_batch_destroy(omf_batch);
+    return 0;
+}
+
+int sample_index_open(GenesisContext *context, const char *path, SampleIndex **out_index) {
+    *out_index = nullptr;
+    SampleIndex *index = create_zero<SampleIndex>();
+    if (!index)
+        return GenesisErrorNoMem;
+    index->context = context;
+
+    if (!(index->mutex = os_mutex_create()) || !(index->cond = os_cond_create())) {
+        sample_index_close(index);
+        return GenesisErrorNoMem;
+    }
+
+    // it only caches what is on disk, so one that cannot be read starts over
+    int err = ordered_map_file_open(path, &index->omf);
+    if (err && err != GenesisErrorNoMem) {
+        os_delete(path);
+        err = ordered_map_file_open(path, &index->omf);
+    }
+    if (err) {
+        sample_index_close(index);
+        return err;
+    }
+    if ((err = load_slots(index))) {
+        sample_index_close(index);
+        return err;
+    }
+
+    if ((err = dir_scanner_create(&index->dir_scanner))) {
+        sample_index_close(index);
+        return err;
+    }
+    if ((err = os_thread_create(index_thread_run, index, false, &index->thread))) {
+        sample_index_close(index);
+        return err;
+    }
+
+    *out_index = index;
+    return 0;
+}
+
+void sample_index_close(SampleIndex *index) {
+    if (!index)
+        return;
+
+    if (index->thread) {
+        {
+            OsMutexLocker locker(index->mutex);
+            index->exit = true;
+            os_cond_signal(index->cond, index->mutex);
+        }
+        os_thread_destroy(index->thread);
+    }
+    dir_scanner_destroy(index->dir_scanner);
+
+    auto it = index->listings.entry_iterator();
+    for (;;) {
+        auto *entry = it.next();
+        if (!entry)
+            break;
+        List<OsDirEntry *> *listing = entry->value;
+        for (int i = 0; i < listing->length(); i += 1)
+            os_dir_entry_unref(listing->at(i));
+        destroy(listing, 1);
+    }
+    for (int i = 0; i < index->batches.length(); i += 1)
+        dir_scan_batch_destroy(index->batches.at(i));
+
+    ordered_map_file_close(index->omf);
+    if (index->cond)
+        os_cond_destroy(index->cond);
+    if (index->mutex)
+        os_mutex_destroy(index->mutex);
+    destroy(index, 1);
+}
+
+int sample_index_add_dir(SampleIndex *index, const ByteBuffer &dir) {
+    OsMutexLocker locker(index->mutex);
+    int err;
+    if ((err = index->new_dirs.append(dir)))
+        return err;
+    os_cond_signal(index->cond, index->mutex);
+    return 0;
+}
+
+long sample_index_generation(SampleIndex *index) {
+    return index->generation;
+}
+
+int sample_index_search_prefix(SampleIndex *index, const ByteBuffer &prefix, int max_results,
+        List<ByteBuffer> &out_paths)
+{
+    OrderedMapFileCursor cursor;
+    ordered_map_file_cursor_init(index->omf, &cursor, prefix);
+    while (out_paths.length() < max_results && ordered_map_file_cursor_next(&cursor)) {
+        int err;
+        if ((err = out_paths.append(cursor.key)))
+            return err;
+    }
+    return 0;
+}
+
+// the slot whose folded path holds text_offset
+static int slot_at_offset(SampleIndex *index, int text_offset) {
+    int start = 0;
+    int end = index->slots.length();
+    while (end - start > 1) {
+        int middle = start + (end - start) / 2;
+        if (index->slots.at(middle).text_offset <= text_offset)
+            start = middle;
+        else
+            end = middle;
+    }
+    return start;
+}
+
+static const char *find_bytes(const char *haystack, int haystack_size, const char *needle, int needle_size) {
+    if (needle_size == 0)
+        return haystack;
+    const char *end = haystack + haystack_size - needle_size + 1;
+    const char *ptr = haystack;
+    while (ptr < end) {
+        ptr = (const char *)memchr(ptr, needle[0], end - ptr);
+        if (!ptr)
+            return nullptr;
+        if (memcmp(ptr, needle, needle_size) == 0)
+            return ptr;
+        ptr += 1;
+    }
+    return nullptr;
+}
+
+int sample_index_search(SampleIndex *index, const ByteBuffer &text, int max_results,
+        List<ByteBuffer> &out_paths)
+{
+    ByteBuffer needle;
+    fold_case(text, needle);
+    {
+        OsMutexLocker locker(index->mutex);
+        const char *names_text = index->names_text.raw();
+        int names_size = index->names_text.length();
+        int offset = 0;
+        while (offset < names_size && out_paths.length() < max_results) {
+            const char *found = find_bytes(names_text + offset, names_size - offset,
+                    needle.raw(), needle.length());
+            if (!found)
+                break;
+            int slot_index = slot_at_offset(index, found - names_text);
+            SampleIndexSlot *slot = &index->slots.at(slot_index);
+            int err;
+            if (slot->live && (err = out_paths.append(slot->path)))
+                return err;
+            // on to the next path
+            offset = (slot_index + 1 < index->slots.length()) ?
+                index->slots.at(slot_index + 1).text_offset : names_size;
+        }
+    }
+    out_paths.sort<compare_paths>();
+    return 0;
+}
+
+int sample_index_get(SampleIndex *index, const ByteBuffer &path, SampleIndexRecord *out_record) {
+    ByteBuffer value;
+    int err;
+    if ((err = ordered_map_file_read(index->omf, path, value)))
+        return err;
+    return deserialize_record(out_record, value, false);
+}
@@ -0,0 +1,63 @@
+#ifndef SAMPLE_INDEX_HPP
+#define SAMPLE_INDEX_HPP
+
+#include "genesis.h"
+#include "byte_buffer.hpp"
+#include "list.hpp"
+
+// what is known about every file under the sample directories, kept in an
+// OrderedMapFile keyed by full path so that it lasts between runs. a thread
+// of its own lists the directories with a DirScanner, which watches them,
+// and opens the files which are new or whose mtime or size changed. paths
+// can be searched by prefix, in order, or by a case insensitive substring,
+// without touching the disk.
+
+// width of the thumbnail of a sample, in peaks
+static const int SAMPLE_INDEX_THUMBNAIL_WIDTH = 64;
+
+struct SampleIndexTag {
+    ByteBuffer key;
+    ByteBuffer value;
+};
+
+struct SampleIndexRecord {
+    long mtime;
+    int64_t size;
+    // why the file could not be opened as audio, or 0. the rest is left
+    // zero when it could not.
+    int err;
+    long frame_count;
+    int sample_rate;
+    SoundIoChannelLayout channel_layout;
+    List<SampleIndexTag> tags;
+    // min and max over all channels of each of thumbnail_width equal spans
+    // of the file, from -127 to 127. 0 wide for files too large to keep
+    // decoded.
+    int thumbnail_width;
+    int8_t thumbnail_min[SAMPLE_INDEX_THUMBNAIL_WIDTH];
+    int8_t thumbnail_max[SAMPLE_INDEX_THUMBNAIL_WIDTH];
+};
+
+struct SampleIndex;
+
+// a file at path which cannot be read as an index is replaced
+int sample_index_open(GenesisContext *context, const char *path, SampleIndex **out_index);
+void sample_index_close(SampleIndex *index);
+
+// indexes the files under dir and keeps them indexed while it is open
+int sample_index_add_dir(SampleIndex *index, const ByteBuffer &dir);
+
+// bumped whenever a path is added, changed or removed, so that a search can
+// be run again when it changes
+long sample_index_generation(SampleIndex *index);
+
+// the first max_results paths which start with prefix, in order
+int sample_index_search_prefix(SampleIndex *index, const ByteBuffer &prefix, int max_results,
+        List<ByteBuffer> &out_paths);
+// up to max_results paths which contain text, ignoring case, in order
+int sample_index_search(SampleIndex *index, const ByteBuffer &text, int max_results,
+        List<ByteBuffer> &out_paths);
+// returns GenesisErrorKeyNotFound if path has not been indexed
+int sample_index_get(SampleIndex *index, const ByteBuffer &path, SampleIndexRecord *out_record);
+
+#endif
@@ -0,0 +1,959 @@
+#include "sampler.hpp"
+#include "audio_file.hpp"
+#include "audio_file_reader.hpp"
+#include "resample.hpp"
+#include "dsp_kernels.hpp"
+#include "voice_pool.hpp"
+#include "thread_safe_queue.hpp"
+
+// how much of the start of each sample stays in memory. a voice plays it
+// while a reader for the rest is opened and fills up.
+static const double SAMPLER_HEAD_SECONDS = 0.3;
+// how far the reader of a playing voice decodes ahead of it
+static const double SAMPLER_STREAM_BUFFER_SECONDS = 0.5;
+static const int SAMPLER_MAX_VOICES = 64;
+// a voice which takes over from another starts its stream while the old
+// one is still being given back
+static const int SAMPLER_STREAM_COUNT = 2 * SAMPLER_MAX_VOICES;
+// the pitch is changed through a windowed sinc of this many taps, a whole
+// number of 8 wide vectors, sampled at this many fractions of a frame
+static const int SAMPLER_TAP_COUNT = 16;
+static const int SAMPLER_PHASE_COUNT = 256;
+static const int SAMPLER_BANK_SIZE = (SAMPLER_PHASE_COUNT + 1) * SAMPLER_TAP_COUNT;
+// a bank for every half octave a sample is played faster, with the cutoff
+// lowered to the output nyquist frequency, up to four octaves
+static const int SAMPLER_BANK_COUNT = 9;
+static const double SAMPLER_MAX_STEP = 16.0;
+static const double SAMPLER_CUTOFF = 0.9;
+static const double SAMPLER_KAISER_BETA = 8.0;
+// a voice makes this many output frames at a time, fewer when its window
+// would not fit in its stage
+static const int SAMPLER_CHUNK_FRAME_COUNT = 256;
+static const int SAMPLER_STAGE_FRAME_COUNT = 2048;
+// frames before the one a window is centered on
+static const int SAMPLER_WINDOW_LEAD = SAMPLER_TAP_COUNT / 2 - 1;
+static const double SAMPLER_RELEASE_SECONDS = 0.1;
+// an offline pipeline waits for streams instead of leaving gaps, but gives
+// up on one which is stuck for this long
+static const double SAMPLER_OFFLINE_WAIT_SECONDS = 5.0;
+
+struct SamplerSample {
+    // nullptr when the whole sample fits in head
+    GenesisAudioFile *audio_file;
+    int channel_count;
+    int sample_rate;
+    long frame_count;
+    // the first head_frame_count frames, channel ch at ch * head_frame_count
+    float *head;
+    int head_frame_count;
+};
+
+struct SamplerZone {
+    SamplerSample *sample;
+    int root_note;
+    int low_note;
+    int high_note;
+    int low_velocity;
+    int high_velocity;
+};
+
+enum SamplerStreamState {
+    // the node's, to request
+    SamplerStreamStateIdle,
+    // the stream thread's, until it opened the reader
+    SamplerStreamStateRequested,
+    // the node's, to read
+    SamplerStreamStateReady,
+    // the stream thread's, to destroy the reader
+    SamplerStreamStateReleasing,
+};
+
+// the rest of one sample, for one voice
+struct SamplerStream {
+    atomic_int state;
+    SamplerSample *sample;
+    // set by the stream thread before the stream is ready. nullptr when
+    // the file could not be opened again.
+    GenesisAudioFileReader *reader;
+};
+
+struct SamplerVoice {
+    int note;
+    const SamplerZone *zone;
+    // into the node's streams, or -1 when there is nothing past the head
+    // or no stream was free
+    int stream_index;
+    // the sample frame the next output frame is at
+    double position;
+    // sample frames [staged_start, staged_start + staged_count) are in the
+    // stage, plane ch at stage + ch * SAMPLER_STAGE_FRAME_COUNT. each voice
+    // keeps the same stage for good.
+    float *stage;
+    long staged_start;
+    int staged_count;
+    float gain;
+    bool releasing;
+    long serial;
+    float level;
+};
+
+struct SamplerNodeContext {
+    GenesisNode *node;
+    // only changes while the pipeline is stopped
+    GenesisSamplerPool *pool;
+    bool offline;
+
+    VoicePool<SamplerVoice> voices;
+    SamplerStream streams[SAMPLER_STREAM_COUNT];
+    // sized for channel_count, when the pipeline starts
+    float *stages;
+    float *scratch;
+    int channel_count;
+    int frame_rate;
+
+    float pitch;
+    // the frame the next block starts at, on the same timeline as the
+    // events' start times
+    int frame_pos;
+};
+
+struct GenesisSamplerPool {
+    GenesisContext *context;
+    List<SamplerSample *> samples;
+    List<SamplerZone> zones;
+    // of samples, by path
+    FlatHashMap<ByteBuffer, int, ByteBuffer::hash> sample_indexes;
+    long resident_bytes;
+    // SAMPLER_BANK_COUNT banks of SAMPLER_BANK_SIZE
+    float *filters;
+
+    // opens and closes the readers of the streams of nodes. the nodes bump
+    // stream_epoch after they change the state of a stream, and the thread
+    // bumps ready_epoch after it makes one ready.
+    OsThread *stream_thread;
+    OsMutex *nodes_mutex;
+    List<SamplerNodeContext *> nodes;
+    atomic_int stream_epoch;
+    atomic_bool stream_thread_idle;
+    atomic_bool stream_thread_exit;
+    atomic_int ready_epoch;
+};
+
+static void wake_stream_thread(GenesisSamplerPool *pool) {
+    pool->stream_epoch += 1;
+    if (pool->stream_thread_idle.load())
+        futex_wake(reinterpret_cast<int*>(&pool->stream_epoch), 1);
+}
+
+// does whatever stream is waiting for. returns whether there was anything.
+static bool service_stream(GenesisSamplerPool *pool, SamplerStream *stream) {
+    int state = stream->state.load();
+    if (state == SamplerStreamStateRequested) {
+        SamplerSample *sample = stream->sample;
+        GenesisAudioFileReader *reader;
+        if (!audio_file_reader_create(sample->audio_file, SAMPLER_STREAM_BUFFER_SECONDS, &reader))
+            genesis_audio_file_reader_seek(reader, sample->head_frame_count);
+        stream->reader = reader;
+        if (stream->state.compare_exchange_strong(state, SamplerStreamStateReady)) {
+            pool->ready_epoch += 1;
+            futex_wake(reinterpret_cast<int*>(&pool->ready_epoch), INT_MAX);
+            return true;
+        }
+        // the voice ended before the reader was open
+    }
+    if (state == SamplerStreamStateReleasing) {
+        genesis_audio_file_reader_destroy(stream->reader);
+        stream->reader = nullptr;
+        stream->state.store(SamplerStreamStateIdle);
+        return true;
+    }
+    return false;
+}
+
+static void stream_thread_run(void *userdata) {
+    GenesisSamplerPool *pool = reinterpret_cast<GenesisSamplerPool*>(userdata);
+    while (!pool->stream_thread_exit.load()) {
+        int epoch = pool->stream_epoch.load();
+        bool worked = false;
+        os_mutex_lock(pool->nodes_mutex);
+        for (int i = 0; i < pool->nodes.length(); i += 1) {
+            SamplerNodeContext *sampler_context = pool->nodes.at(i);
+            for (int stream_i = 0; stream_i < SAMPLER_STREAM_COUNT; stream_i += 1) {
+                if (service_stream(pool, &sampler_context->streams[stream_i]))
+                    worked = true;
+            }
+        }
+        os_mutex_unlock(pool->nodes_mutex);
+        if (worked)
+            continue;
+        // as with the audio file reader thread
+        pool->stream_thread_idle = true;
+        if (!pool->stream_thread_exit.load())
+            futex_wait(reinterpret_cast<int*>(&pool->stream_epoch), epoch);
+        pool->stream_thread_idle = false;
+    }
+}
+
+static void destroy_sample(SamplerSample *sample) {
+    if (sample) {
+        genesis_audio_file_destroy(sample->audio_file);
+        destroy(sample->head, sample->channel_count * sample->head_frame_count);
+        destroy(sample, 1);
+    }
+}
+
+// copies frames [0, frame_count) of every channel of resident audio_file
+// into head, through a reader, which knows how the samples are stored
+static int read_resident(GenesisAudioFile *audio_file, float *head, int frame_count) {
+    GenesisAudioFileReader *reader;
+    int err;
+    if ((err = genesis_audio_file_reader_create(audio_file, &reader)))
+        return err;
+    int channel_count = audio_file->channel_layout.channel_count;
+    int frame = 0;
+    while (frame < frame_count) {
+        int available = min(genesis_audio_file_reader_fill_count(reader), frame_count - frame);
+        if (available <= 0)
+            break;
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            memcpy(head + ch * frame_count + frame, genesis_audio_file_reader_read_ptr(reader, ch),
+                    available * sizeof(float));
+        }
+        genesis_audio_file_reader_advance_read_ptr(reader, available);
+        frame += available;
+    }
+    genesis_audio_file_reader_destroy(reader);
+    return 0;
+}
+
+// samples which are no longer than the head are kept whole and their file
+// closed, as are those without a length, which were decoded whole anyway
+static int load_sample(GenesisContext *context, const char *path, SamplerSample **out_sample) {
+    *out_sample = nullptr;
+    SamplerSample *sample = create_zero<SamplerSample>();
+    if (!sample)
+        return GenesisErrorNoMem;
+    List<float> heads[GENESIS_MAX_CHANNELS];
+    int err;
+    if ((err = audio_file_open_streamed_head(context, path, SAMPLER_HEAD_SECONDS, heads, &sample->audio_file))) {
+        destroy_sample(sample);
+        return err;
+    }
+    GenesisAudioFile *audio_file = sample->audio_file;
+    sample->channel_count = audio_file->channel_layout.channel_count;
+    sample->sample_rate = audio_file->sample_rate;
+    sample->frame_count = genesis_audio_file_frame_count(audio_file);
+    bool streamed = genesis_audio_file_is_streamed(audio_file);
+    long head_frame_count = streamed ? heads[0].length() : sample->frame_count;
+    if (head_frame_count > INT_MAX / GENESIS_MAX_CHANNELS) {
+        destroy_sample(sample);
+        return GenesisErrorNoMem;
+    }
+    sample->head_frame_count = head_frame_count;
+    if (!(sample->head = allocate_nonzero<float>(sample->channel_count * head_frame_count))) {
+        destroy_sample(sample);
+        return GenesisErrorNoMem;
+    }
+    if (streamed) {
+        for (int ch = 0; ch < sample->channel_count; ch += 1)
+            memcpy(sample->head + ch * head_frame_count, heads[ch].raw(), head_frame_count * sizeof(float));
+    } else if ((err = read_resident(audio_file, sample->head, head_frame_count))) {
+        destroy_sample(sample);
+        return err;
+    }
+    if (head_frame_count >= sample->frame_count) {
+        sample->frame_count = head_frame_count;
+        genesis_audio_file_destroy(sample->audio_file);
+        sample->audio_file = nullptr;
+    }
+    *out_sample = sample;
+    return 0;
+}
+
+struct SamplerLoadJob {
+    GenesisContext *context;
+    const char *const *paths;
+    SamplerSample **samples;
+    int *errs;
+    int count;
+    atomic_int next_index;
+};
+
+static void run_load_job(void *userdata) {
+    SamplerLoadJob *job = (SamplerLoadJob *)userdata;
+    for (;;) {
+        int i = job->next_index.fetch_add(1);
+        if (i >= job->count)
+            break;
+        job->errs[i] = load_sample(job->context, job->paths[i], &job->samples[i]);
+    }
+}
+
+// opening a file takes a few milliseconds and its head a few more, mostly
+// waiting on the disk, so the files are opened on a thread per cpu
+static void load_samples(SamplerLoadJob *job) {
+    static const int max_load_threads = 16;
+    int thread_count = min(min(os_concurrency(), max_load_threads), job->count);
+    OsThread *threads[max_load_threads];
+    for (int t = 1; t < thread_count; t += 1) {
+        if (os_thread_create(run_load_job, job, false, &threads[t]))
+            threads[t] = nullptr;
+    }
+    run_load_job(job);
+    for (int t = 1; t < thread_count; t += 1)
+        os_thread_destroy(threads[t]);
+}
+
+static bool pool_in_use(GenesisSamplerPool *pool) {
+    OsMutexLocker locker(pool->nodes_mutex);
+    for (int i = 0; i < pool->nodes.length(); i += 1) {
+        if (genesis_pipeline_is_running(pool->nodes.at(i)->node->descriptor->pipeline))
+            return true;
+    }
+    return false;
+}
+
+void genesis_sampler_pool_destroy(struct GenesisSamplerPool *pool) {
+    if (!pool)
+        return;
+    if (pool->stream_thread) {
+        assert(pool->nodes.length() == 0);
+        pool->stream_thread_exit = true;
+        wake_stream_thread(pool);
+        futex_wake(reinterpret_cast<int*>(&pool->stream_epoch), 1);
+        os_thread_destroy(pool->stream_thread);
+    }
+    for (int i = 0; i < pool->samples.length(); i += 1)
+        destroy_sample(pool->samples.at(i));
+    os_mutex_destroy(pool->nodes_mutex);
+    destroy(pool->filters, SAMPLER_BANK_COUNT * SAMPLER_BANK_SIZE);
+    destroy(pool, 1);
+}
+
+int genesis_sampler_pool_create(struct GenesisContext *context, struct GenesisSamplerPool **out_pool) {
+    *out_pool = nullptr;
+    GenesisSamplerPool *pool = create_zero<GenesisSamplerPool>();
+    if (!pool)
+        return GenesisErrorNoMem;
+    pool->context = context;
+    pool->filters = allocate_nonzero<float>(SAMPLER_BANK_COUNT * SAMPLER_BANK_SIZE);
+    pool->nodes_mutex = os_mutex_create();
+    if (!pool->filters || !pool->nodes_mutex) {
+        genesis_sampler_pool_destroy(pool);
+        return GenesisErrorNoMem;
+    }
+    for (int bank = 0; bank < SAMPLER_BANK_COUNT; bank += 1) {
+        resample_build_filters(pool->filters + bank * SAMPLER_BANK_SIZE, SAMPLER_TAP_COUNT,
+                SAMPLER_PHASE_COUNT, SAMPLER_CUTOFF / pow(2.0, bank / 2.0), SAMPLER_KAISER_BETA);
+    }
+    pool->resident_bytes = SAMPLER_BANK_COUNT * SAMPLER_BANK_SIZE * sizeof(float);
+
+    pool->stream_thread_exit = false;
+    int err;
+    if ((err = os_thread_create_with_attributes(stream_thread_run, pool,
+                    &context->background_thread_attributes, &pool->stream_thread)))
+    {
+        genesis_sampler_pool_destroy(pool);
+        return err;
+    }
+    *out_pool = pool;
+    return 0;
+}
+
+int genesis_sampler_pool_add_zones(struct GenesisSamplerPool *pool,
+        const struct GenesisSamplerZone *zones, int zone_count)
+{
+    if (zone_count < 0)
+        return GenesisErrorInvalidParam;
+    for (int i = 0; i < zone_count; i += 1) {
+        const GenesisSamplerZone *zone = &zones[i];
+        if (!zone->path || zone->low_note > zone->high_note || zone->low_velocity > zone->high_velocity)
+            return GenesisErrorInvalidParam;
+    }
+    if (pool_in_use(pool))
+        return GenesisErrorInvalidState;
+
+    // each file only once, however many zones play it
+    List<const char *> paths;
+    for (int i = 0; i < zone_count; i += 1) {
+        ByteBuffer path = zones[i].path;
+        if (pool->sample_indexes.maybe_get(path))
+            continue;
+        pool->sample_indexes.put(path, -1);
+        if (paths.append(zones[i].path))
+            return GenesisErrorNoMem;
+    }
+
+    SamplerLoadJob job;
+    job.context = pool->context;
+    job.paths = paths.raw();
+    job.count = paths.length();
+    job.next_index.store(0);
+    job.samples = allocate_zero<SamplerSample *>(job.count);
+    job.errs = allocate_zero<int>(job.count);
+    if (job.count > 0 && (!job.samples || !job.errs)) {
+        destroy(job.samples, 0);
+        destroy(job.errs, 0);
+        for (int i = 0; i < job.count; i += 1)
+            pool->sample_indexes.remove(paths.at(i));
+        return GenesisErrorNoMem;
+    }
+    load_samples(&job);
+
+    // the samples which loaded are kept either way
+    int err = 0;
+    for (int i = 0; i < job.count; i += 1) {
+        SamplerSample *sample = job.samples[i];
+        if (!sample) {
+            err = err ? err : job.errs[i];
+            pool->sample_indexes.remove(paths.at(i));
+            continue;
+        }
+        if (pool->samples.append(sample)) {
+            destroy_sample(sample);
+            pool->sample_indexes.remove(paths.at(i));
+            err = GenesisErrorNoMem;
+            continue;
+        }
+        pool->sample_indexes.put(paths.at(i), pool->samples.length() - 1);
+        pool->resident_bytes += sizeof(SamplerSample) +
+            (long)sample->channel_count * sample->head_frame_count * sizeof(float);
+    }
+    destroy(job.samples, 0);
+    destroy(job.errs, 0);
+    if (err)
+        return err;
+
+    int first_zone = pool->zones.length();
+    if (pool->zones.resize(first_zone + zone_count))
+        return GenesisErrorNoMem;
+    for (int i = 0; i < zone_count; i += 1) {
+        const GenesisSamplerZone *zone = &zones[i];
+        SamplerZone *dest = &pool->zones.at(first_zone + i);
+        dest->sample = pool->samples.at(pool->sample_indexes.get(zone->path));
+        dest->root_note = zone->root_note;
+        dest->low_note = zone->low_note;
+        dest->high_note = zone->high_note;
+        dest->low_velocity = zone->low_velocity;
+        dest->high_velocity = zone->high_velocity;
+    }
+    return 0;
+}
+
+long genesis_sampler_pool_resident_bytes(struct GenesisSamplerPool *pool) {
+    return pool->resident_bytes;
+}
+
+static int acquire_stream(SamplerNodeContext *sampler_context, SamplerSample *sample) {
+    for (int i = 0; i < SAMPLER_STREAM_COUNT; i += 1) {
+        SamplerStream *stream = &sampler_context->streams[i];
+        if (stream->state.load() != SamplerStreamStateIdle)
+            continue;
+        stream->sample = sample;
+        stream->state.store(SamplerStreamStateRequested);
+        wake_stream_thread(sampler_context->pool);
+        return i;
+    }
+    return -1;
+}
+
+static void release_stream(SamplerNodeContext *sampler_context, int stream_index) {
+    SamplerStream *stream = &sampler_context->streams[stream_index];
+    int state = SamplerStreamStateRequested;
+    if (!stream->state.compare_exchange_strong(state, SamplerStreamStateReleasing)) {
+        assert(state == SamplerStreamStateReady);
+        stream->state.store(SamplerStreamStateReleasing);
+    }
+    wake_stream_thread(sampler_context->pool);
+}
+
+static void release_voice_stream(SamplerNodeContext *sampler_context, SamplerVoice *voice) {
+    if (voice->stream_index >= 0) {
+        release_stream(sampler_context, voice->stream_index);
+        voice->stream_index = -1;
+    }
+}
+
+static void release_voice(SamplerNodeContext *sampler_context, int voice_index) {
+    release_voice_stream(sampler_context, &sampler_context->voices.voices[voice_index]);
+    sampler_context->voices.release(voice_index);
+}
+
+static void release_all_voices(SamplerNodeContext *sampler_context) {
+    while (sampler_context->voices.active_count > 0)
+        release_voice(sampler_context, sampler_context->voices.active_count - 1);
+}
+
+// the stream thread lets go of the node's streams before this takes them
+// back, whatever state they were left in
+static void detach_pool(SamplerNodeContext *sampler_context) {
+    GenesisSamplerPool *pool = sampler_context->pool;
+    if (!pool)
+        return;
+    {
+        OsMutexLocker locker(pool->nodes_mutex);
+        for (int i = 0; i < pool->nodes.length(); i += 1) {
+            if (pool->nodes.at(i) == sampler_context) {
+                pool->nodes.swap_remove(i);
+                break;
+            }
+        }
+    }
+    for (int i = 0; i < SAMPLER_STREAM_COUNT; i += 1) {
+        SamplerStream *stream = &sampler_context->streams[i];
+        genesis_audio_file_reader_destroy(stream->reader);
+        stream->reader = nullptr;
+        stream->state.store(SamplerStreamStateIdle);
+    }
+    for (int i = 0; i < sampler_context->voices.active_count; i += 1)
+        sampler_context->voices.voices[i].stream_index = -1;
+    sampler_context->voices.release_all();
+    sampler_context->pool = nullptr;
+}
+
+static void free_stages(SamplerNodeContext *sampler_context) {
+    int channel_count = sampler_context->channel_count;
+    destroy(sampler_context->stages, SAMPLER_MAX_VOICES * channel_count * SAMPLER_STAGE_FRAME_COUNT);
+    destroy(sampler_context->scratch, SAMPLER_CHUNK_FRAME_COUNT * channel_count);
+    sampler_context->stages = nullptr;
+    sampler_context->scratch = nullptr;
+    sampler_context->channel_count = 0;
+}
+
+static void sampler_destroy(struct GenesisNode *node) {
+    SamplerNodeContext *sampler_context = (SamplerNodeContext *)node->userdata;
+    if (sampler_context) {
+        detach_pool(sampler_context);
+        free_stages(sampler_context);
+        destroy(sampler_context, 1);
+    }
+}
+
+static int sampler_create(struct GenesisNode *node) {
+    SamplerNodeContext *sampler_context = create_zero<SamplerNodeContext>();
+    node->userdata = sampler_context;
+    if (!sampler_context) {
+        sampler_destroy(node);
+        return GenesisErrorNoMem;
+    }
+    sampler_context->node = node;
+    if (sampler_context->voices.init(SAMPLER_MAX_VOICES, nullptr)) {
+        sampler_destroy(node);
+        return GenesisErrorNoMem;
+    }
+    for (int i = 0; i < SAMPLER_STREAM_COUNT; i += 1)
+        sampler_context->streams[i].state.store(SamplerStreamStateIdle);
+    return 0;
+}
+
+static int sampler_activate(struct GenesisNode *node) {
+    SamplerNodeContext *sampler_context = (SamplerNodeContext *)node->userdata;
+    GenesisPort *audio_out_port = genesis_node_port(node, 1);
+    int channel_count = genesis_audio_port_channel_layout(audio_out_port)->channel_count;
+    release_all_voices(sampler_context);
+    sampler_context->offline = node->descriptor->pipeline->offline;
+    sampler_context->frame_rate = genesis_audio_port_sample_rate(audio_out_port);
+    if (channel_count == sampler_context->channel_count)
+        return 0;
+
+    free_stages(sampler_context);
+    sampler_context->stages = allocate_zero<float>(SAMPLER_MAX_VOICES * channel_count * SAMPLER_STAGE_FRAME_COUNT);
+    sampler_context->scratch = allocate_zero<float>(SAMPLER_CHUNK_FRAME_COUNT * channel_count);
+    if (!sampler_context->stages || !sampler_context->scratch) {
+        destroy(sampler_context->stages, 0);
+        destroy(sampler_context->scratch, 0);
+        sampler_context->stages = nullptr;
+        sampler_context->scratch = nullptr;
+        return GenesisErrorNoMem;
+    }
+    sampler_context->channel_count = channel_count;
+    for (int i = 0; i < SAMPLER_MAX_VOICES; i += 1) {
+        sampler_context->voices.voices[i].stage = sampler_context->stages +
+            i * channel_count * SAMPLER_STAGE_FRAME_COUNT;
+    }
+    return 0;
+}
+
+static void sampler_seek(struct GenesisNode *node) {
+    SamplerNodeContext *sampler_context = (SamplerNodeContext *)node->userdata;
+    GenesisPort *audio_out_port = genesis_node_port(node, 1);
+    sampler_context->frame_pos = genesis_whole_notes_to_frames(node->descriptor->pipeline,
+            node->timestamp, genesis_audio_port_sample_rate(audio_out_port));
+    release_all_voices(sampler_context);
+}
+
+static const SamplerZone *find_zone(GenesisSamplerPool *pool, int note, float velocity) {
+    int midi_velocity = (int)lroundf(velocity * 127.0f);
+    for (int i = 0; i < pool->zones.length(); i += 1) {
+        const SamplerZone *zone = &pool->zones.at(i);
+        if (note >= zone->low_note && note <= zone->high_note &&
+            midi_velocity >= zone->low_velocity && midi_velocity <= zone->high_velocity)
+        {
+            return zone;
+        }
+    }
+    return nullptr;
+}
+
+static void release_note(SamplerNodeContext *sampler_context, int note) {
+    for (int i = 0; i < sampler_context->voices.active_count; i += 1) {
+        SamplerVoice *voice = &sampler_context->voices.voices[i];
+        if (voice->note == note)
+            voice->releasing = true;
+    }
+}
+
+// a note played again lets the voice it had ring out. when every voice is
+// taken the oldest is cut off.
+static void start_note(SamplerNodeContext *sampler_context, int note, float velocity) {
+    const SamplerZone *zone = find_zone(sampler_context->pool, note, velocity);
+    if (!zone)
+        return;
+    release_note(sampler_context, note);
+    SamplerVoice *voice = sampler_context->voices.acquire_free(SAMPLER_MAX_VOICES);
+    if (!voice) {
+        voice = sampler_context->voices.steal(false);
+        release_voice_stream(sampler_context, voice);
+    }
+    SamplerSample *sample = zone->sample;
+    voice->note = note;
+    voice->zone = zone;
+    voice->position = 0.0;
+    voice->staged_start = 0;
+    voice->staged_count = 0;
+    voice->gain = 1.0f;
+    voice->releasing = false;
+    voice->stream_index = sample->audio_file ? acquire_stream(sampler_context, sample) : -1;
+}
+
+static void sampler_apply_event(SamplerNodeContext *sampler_context, const GenesisMidiEvent *event) {
+    switch (event->event_type) {
+        case GenesisMidiEventTypeNoteOn:
+            start_note(sampler_context, event->data.note_data.note, event->data.note_data.velocity);
+            break;
+        case GenesisMidiEventTypeNoteOff:
+            release_note(sampler_context, event->data.note_data.note);
+            break;
+        case GenesisMidiEventTypePitch:
+            sampler_context->pitch = event->data.pitch_data.pitch;
+            break;
+    }
+}
+
+// timed, because readers do not say when they have decoded more
+static void wait_for_stream(GenesisSamplerPool *pool, int ready_epoch) {
+    struct timespec ts;
+    ts.tv_sec = 0;
+    ts.tv_nsec = 1000000;
+    futex(reinterpret_cast<int*>(&pool->ready_epoch), FUTEX_WAIT, ready_epoch, &ts, nullptr, 0);
+}
+
+// reads sample frames [frame_index, frame_index + frame_count) from the
+// stream of voice into the planes at dest, or as many as it has. when the
+// reader fell behind the voice stays in time and leaves a gap, unless the
+// pipeline is offline and can wait.
+static int read_stream(SamplerNodeContext *sampler_context, SamplerVoice *voice, float *dest,
+        long frame_index, int frame_count)
+{
+    if (voice->stream_index < 0)
+        return 0;
+    GenesisSamplerPool *pool = sampler_context->pool;
+    SamplerStream *stream = &sampler_context->streams[voice->stream_index];
+    double give_up_time = -1.0;
+    for (;;) {
+        int ready_epoch = pool->ready_epoch.load();
+        if (stream->state.load() == SamplerStreamStateReady)
+            break;
+        if (!sampler_context->offline)
+            return 0;
+        if (give_up_time < 0.0)
+            give_up_time = os_get_time() + SAMPLER_OFFLINE_WAIT_SECONDS;
+        else if (os_get_time() > give_up_time)
+            return 0;
+        wait_for_stream(pool, ready_epoch);
+    }
+    GenesisAudioFileReader *reader = stream->reader;
+    if (!reader)
+        return 0;
+    if (genesis_audio_file_reader_position(reader) != frame_index)
+        genesis_audio_file_reader_seek(reader, frame_index);
+
+    int sample_channel_count = stream->sample->channel_count;
+    int frame = 0;
+    while (frame < frame_count) {
+        int available = genesis_audio_file_reader_fill_count(reader);
+        if (available <= 0) {
+            if (!sampler_context->offline)
+                break;
+            if (give_up_time < 0.0)
+                give_up_time = os_get_time() + SAMPLER_OFFLINE_WAIT_SECONDS;
+            else if (os_get_time() > give_up_time)
+                break;
+            wait_for_stream(pool, pool->ready_epoch.load());
+            continue;
+        }
+        int span_frame_count = min(available, frame_count - frame);
+        for (int ch = 0; ch < sampler_context->channel_count; ch += 1) {
+            memcpy(dest + ch * SAMPLER_STAGE_FRAME_COUNT + frame,
+                    genesis_audio_file_reader_read_ptr(reader, ch % sample_channel_count),
+                    span_frame_count * sizeof(float));
+        }
+        genesis_audio_file_reader_advance_read_ptr(reader, span_frame_count);
+        frame += span_frame_count;
+    }
+    if (frame < frame_count)
+        genesis_audio_file_reader_seek(reader, frame_index + frame_count);
+    return frame;
+}
+
+// sample frames [frame_index, frame_index + frame_count) into the planes at
+// dest: the head, then the stream, and silence before and after the
+// sample. output channel ch plays sample channel ch modulo its count.
+static void fill_stage(SamplerNodeContext *sampler_context, SamplerVoice *voice, float *dest,
+        long frame_index, int frame_count)
+{
+    int channel_count = sampler_context->channel_count;
+    SamplerSample *sample = voice->zone->sample;
+    int frame = 0;
+    while (frame < frame_count) {
+        long index = frame_index + frame;
+        int span_frame_count = frame_count - frame;
+        int read_count = 0;
+        if (index < 0) {
+            span_frame_count = min((long)span_frame_count, -index);
+        } else if (index < sample->head_frame_count) {
+            span_frame_count = min((long)span_frame_count, sample->head_frame_count - index);
+            for (int ch = 0; ch < channel_count; ch += 1) {
+                const float *src = sample->head + (ch % sample->channel_count) * sample->head_frame_count;
+                memcpy(dest + ch * SAMPLER_STAGE_FRAME_COUNT + frame, src + index,
+                        span_frame_count * sizeof(float));
+            }
+            read_count = span_frame_count;
+        } else if (index < sample->frame_count) {
+            span_frame_count = min((long)span_frame_count, sample->frame_count - index);
+            read_count = read_stream(sampler_context, voice, dest + frame, index, span_frame_count);
+        }
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            memset(dest + ch * SAMPLER_STAGE_FRAME_COUNT + frame + read_count, 0,
+                    (span_frame_count - read_count) * sizeof(float));
+        }
+        frame += span_frame_count;
+    }
+}
+
+// makes the stage hold sample frames [start, end), keeping what it has
+static void stage_frames(SamplerNodeContext *sampler_context, SamplerVoice *voice, long start, long end) {
+    assert(end - start <= SAMPLER_STAGE_FRAME_COUNT);
+    int channel_count = sampler_context->channel_count;
+    long staged_end = voice->staged_start + voice->staged_count;
+    if (start < voice->staged_start || start > staged_end) {
+        voice->staged_start = start;
+        voice->staged_count = 0;
+        staged_end = start;
+    }
+    int drop_count = start - voice->staged_start;
+    if (drop_count > 0) {
+        int keep_count = voice->staged_count - drop_count;
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            float *plane = voice->stage + ch * SAMPLER_STAGE_FRAME_COUNT;
+            memmove(plane, plane + drop_count, keep_count * sizeof(float));
+        }
+        voice->staged_start = start;
+        voice->staged_count = keep_count;
+    }
+    if (end > staged_end) {
+        fill_stage(sampler_context, voice, voice->stage + voice->staged_count, staged_end, end - staged_end);
+        voice->staged_count += end - staged_end;
+    }
+}
+
+// the sample frames the voice moves each output frame, and the bank which
+// keeps that from aliasing
+static double voice_step(SamplerNodeContext *sampler_context, const SamplerVoice *voice, int *out_bank) {
+    const SamplerZone *zone = voice->zone;
+    double octaves = (voice->note - zone->root_note) / 12.0 + sampler_context->pitch;
+    double step = pow(2.0, octaves) * zone->sample->sample_rate / sampler_context->frame_rate;
+    step = min(step, SAMPLER_MAX_STEP);
+    *out_bank = (step <= 1.0) ? 0 : min(SAMPLER_BANK_COUNT - 1, (int)ceil(2.0 * log2(step)));
+    return step;
+}
+
+// adds frame_count frames of voice to out. returns whether the voice is
+// done, because it was released and has faded, or is past the end of its
+// sample.
+static bool render_voice(SamplerNodeContext *sampler_context, SamplerVoice *voice, float *out,
+        int frame_count)
+{
+    static const int T = SAMPLER_TAP_COUNT;
+    int channel_count = sampler_context->channel_count;
+    const DspChannelKernels *kernels = dsp_channel_kernels(channel_count);
+    float release_step = 1.0 / (SAMPLER_RELEASE_SECONDS * sampler_context->frame_rate);
+    long sample_frame_count = voice->zone->sample->frame_count;
+    int bank;
+    double step = voice_step(sampler_context, voice, &bank);
+    const float *filters = sampler_context->pool->filters + bank * SAMPLER_BANK_SIZE;
+    int max_chunk_frame_count = (int)((SAMPLER_STAGE_FRAME_COUNT - T - 1) / step);
+
+    int frame = 0;
+    while (frame < frame_count) {
+        if ((long)floor(voice->position) - SAMPLER_WINDOW_LEAD >= sample_frame_count)
+            return true;
+        int chunk_frame_count = min(min(frame_count - frame, SAMPLER_CHUNK_FRAME_COUNT), max_chunk_frame_count);
+        long window_start = (long)floor(voice->position) - SAMPLER_WINDOW_LEAD;
+        long last_window_start = (long)floor(voice->position + step * (chunk_frame_count - 1)) -
+            SAMPLER_WINDOW_LEAD;
+        stage_frames(sampler_context, voice, window_start, last_window_start + T);
+
+        float *scratch = sampler_context->scratch;
+        double position = voice->position;
+        for (int i = 0; i < chunk_frame_count; i += 1, position += step) {
+            long whole = (long)floor(position);
+            double phase = (position - whole) * SAMPLER_PHASE_COUNT;
+            int filter_index = (int)phase;
+            const float *window = voice->stage + (whole - SAMPLER_WINDOW_LEAD - voice->staged_start);
+            kernels->fir_frame_lerp(channel_count, scratch + i * channel_count,
+                    filters + filter_index * T, phase - filter_index, window, SAMPLER_STAGE_FRAME_COUNT, T);
+        }
+        voice->position = position;
+
+        float gains[GENESIS_MAX_CHANNELS];
+        float gain_steps[GENESIS_MAX_CHANNELS];
+        int mix_frame_count = chunk_frame_count;
+        float gain_step = 0.0f;
+        if (voice->releasing) {
+            gain_step = -release_step;
+            mix_frame_count = min(mix_frame_count, (int)ceilf(voice->gain / release_step));
+        }
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            gains[ch] = voice->gain;
+            gain_steps[ch] = gain_step;
+        }
+        dsp_mix_add_gain(out + frame * channel_count, scratch, channel_count, gains, gain_steps,
+                mix_frame_count);
+        voice->gain = max(0.0f, voice->gain + gain_step * mix_frame_count);
+        if (voice->releasing && voice->gain <= 0.0f)
+            return true;
+        frame += chunk_frame_count;
+    }
+    return false;
+}
+
+// frames [frame_start, frame_end) of write_ptr get every voice
+static void sampler_render(SamplerNodeContext *sampler_context, float *write_ptr, int frame_start, int frame_end) {
+    float *out = write_ptr + frame_start * sampler_context->channel_count;
+    // from the end, so that a released voice is replaced by one that has
+    // already played
+    for (int voice_i = sampler_context->voices.active_count - 1; voice_i >= 0; voice_i -= 1) {
+        SamplerVoice *voice = &sampler_context->voices.voices[voice_i];
+        if (render_voice(sampler_context, voice, out, frame_end - frame_start))
+            release_voice(sampler_context, voice_i);
+    }
+}
+
+// the frame of the block an event lands on. late events land on the first.
+static int event_frame(SamplerNodeContext *sampler_context, GenesisPipeline *pipeline,
+        const GenesisMidiEvent *event, int frame_rate)
+{
+    int frame = genesis_whole_notes_to_frames(pipeline, event->start, frame_rate);
+    return max(0, frame - sampler_context->frame_pos);
+}
+
+// as the synth does, each event takes effect on the frame its start time
+// falls on
+static void sampler_run(struct GenesisNode *node) {
+    SamplerNodeContext *sampler_context = (SamplerNodeContext *)node->userdata;
+    struct GenesisPipeline *pipeline = node->descriptor->pipeline;
+    struct GenesisPort *events_in_port = genesis_node_port(node, 0);
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 1);
+
+    int output_frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    int frame_rate = sampler_context->frame_rate;
+
+    int frame_at_start = sampler_context->frame_pos;
+    int event_count;
+    int frame_count = genesis_events_in_port_fill_frames(events_in_port, frame_at_start,
+            output_frame_count, frame_rate, &event_count);
+
+    GenesisMidiEvent *event = genesis_events_in_port_read_ptr(events_in_port);
+    bool any_event = event_count > 0 && event_frame(sampler_context, pipeline, event, frame_rate) < frame_count;
+    if (!sampler_context->pool || (sampler_context->voices.active_count == 0 && !any_event)) {
+        genesis_events_in_port_advance_frames(events_in_port, 0, frame_at_start, frame_count, frame_rate);
+        sampler_context->frame_pos += frame_count;
+        genesis_audio_out_port_write_silence(audio_out_port, frame_count);
+        return;
+    }
+
+    float *write_ptr = genesis_audio_out_port_write_ptr(audio_out_port);
+    memset(write_ptr, 0, frame_count * sampler_context->channel_count * sizeof(float));
+
+    int event_index = 0;
+    int frame = 0;
+    while (frame < frame_count) {
+        int segment_end = frame_count;
+        for (; event_index < event_count; event_index += 1) {
+            int frame_of_event = event_frame(sampler_context, pipeline, &event[event_index], frame_rate);
+            if (frame_of_event > frame) {
+                segment_end = min(frame_of_event, frame_count);
+                break;
+            }
+            sampler_apply_event(sampler_context, &event[event_index]);
+        }
+        sampler_render(sampler_context, write_ptr, frame, segment_end);
+        frame = segment_end;
+    }
+    genesis_events_in_port_advance_frames(events_in_port, event_index, frame_at_start, frame_count, frame_rate);
+
+    sampler_context->frame_pos += frame_count;
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+int genesis_sampler_node_set_pool(struct GenesisNode *node, struct GenesisSamplerPool *pool) {
+    if (node->descriptor->run != sampler_run)
+        return GenesisErrorInvalidParam;
+    if (genesis_pipeline_is_running(node->descriptor->pipeline))
+        return GenesisErrorInvalidState;
+    SamplerNodeContext *sampler_context = (SamplerNodeContext *)node->userdata;
+    if (sampler_context->pool == pool)
+        return 0;
+    detach_pool(sampler_context);
+    if (!pool)
+        return 0;
+    OsMutexLocker locker(pool->nodes_mutex);
+    if (pool->nodes.append(sampler_context))
+        return GenesisErrorNoMem;
+    sampler_context->pool = pool;
+    return 0;
+}
+
+int create_sampler_descriptor(GenesisPipeline *pipeline) {
+    GenesisNodeDescriptor *node_descr = genesis_create_node_descriptor(pipeline, 2, "sampler",
+            "Plays samples from a pool, picked by note and velocity.");
+    if (!node_descr) {
+        genesis_node_descriptor_destroy(node_descr);
+        return GenesisErrorNoMem;
+    }
+
+    genesis_node_descriptor_set_run_callback(node_descr, sampler_run);
+    genesis_node_descriptor_set_create_callback(node_descr, sampler_create);
+    genesis_node_descriptor_set_destroy_callback(node_descr, sampler_destroy);
+    genesis_node_descriptor_set_seek_callback(node_descr, sampler_seek);
+    genesis_node_descriptor_set_activate_callback(node_descr, sampler_activate);
+
+    struct GenesisPortDescriptor *events_port = genesis_node_descriptor_create_port(
+            node_descr, 0, GenesisPortTypeEventsIn, "events_in");
+    struct GenesisPortDescriptor *audio_port = genesis_node_descriptor_create_port(
+            node_descr, 1, GenesisPortTypeAudioOut, "audio_out");
+
+    if (!events_port || !audio_port) {
+        genesis_node_descriptor_destroy(node_descr);
+        return GenesisErrorNoMem;
+    }
+
+    genesis_audio_port_descriptor_set_channel_layout(audio_port,
+        soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdStereo), false, -1);
+
+    genesis_audio_port_descriptor_set_sample_rate(audio_port,
+            genesis_pipeline_get_sample_rate(pipeline), false, -1);
+
+    return 0;
+}
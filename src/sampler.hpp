@@ -0,0 +1,8 @@
+#ifndef SAMPLER_HPP
+#define SAMPLER_HPP
+
+#include "genesis.hpp"
+
+int create_sampler_descriptor(GenesisPipeline *pipeline);
+
+#endif
@@ -27,6 +27,7 @@ int ScrollBarWidget::long_dimension() const {
 }
 
 void ScrollBarWidget::update_model() {
+    queue_redraw();
     bg.update(this, 0, 0, width, height);
 
     int range = max_value - min_value;
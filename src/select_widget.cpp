@@ -44,12 +44,13 @@ SelectWidget::SelectWidget(GuiWindow *gui_window) :
 void SelectWidget::draw(const glm::mat4 &projection) {
     bg.draw(gui_window, projection);
     if (selected_index >= 0)
-        label.draw(projection * label_model, text_color);
+        label.draw(gui_window, projection * label_model, text_color);
 
     gui->draw_image_color(gui_window, arrow_icon_img, projection * arrow_icon_model, text_color);
 }
 
 void SelectWidget::update_model() {
+    queue_redraw();
     bg.set_scheme(SunkenBoxSchemeRaisedBorders);
     bg.update(this, 0, 0, width, height);
 
@@ -108,6 +108,10 @@ static int on_string(struct LaxJsonContext *json,
                     sf->state = SettingsFileStateExpectSampleDirs;
                 } else if (ByteBuffer::compare(value, "latency") == 0) {
                     sf->state = SettingsFileStateLatency;
+                } else if (ByteBuffer::compare(value, "audio_file_resident_mb") == 0) {
+                    sf->state = SettingsFileStateAudioFileResidentMb;
+                } else if (ByteBuffer::compare(value, "asset_store_dir") == 0) {
+                    sf->state = SettingsFileStateAssetStoreDir;
                 } else if (ByteBuffer::compare(value, "device_designations") == 0) {
                     sf->state = SettingsFileStateDeviceDesignations;
                 } else if (ByteBuffer::compare(value, "default_render_format") == 0) {
@@ -127,6 +131,10 @@ static int on_string(struct LaxJsonContext *json,
             sf->user_id = uint256::parse(value);
             sf->state = SettingsFileStateReadyForProp;
             break;
+        case SettingsFileStateAssetStoreDir:
+            sf->asset_store_dir = value;
+            sf->state = SettingsFileStateReadyForProp;
+            break;
         case SettingsFileStateUserName:
             {
                 bool ok;
@@ -318,6 +326,10 @@ static int on_number(struct LaxJsonContext *json, double x) {
             sf->latency = x;
             sf->state = SettingsFileStateReadyForProp;
             break;
+        case SettingsFileStateAudioFileResidentMb:
+            sf->audio_file_resident_mb = x;
+            sf->state = SettingsFileStateReadyForProp;
+            break;
         case SettingsFileStateDefaultRenderParamsBitRate:
             sf->default_render_bit_rates[sf->current_default_render_params_format] = (int)x;
             sf->state = SettingsFileStateDefaultRenderParamsProp;
@@ -531,240 +543,240 @@ static const char *dock_type_to_str(SettingsFileDockType dock_type) {
     panic("bad dock type");
 }
 
-static void do_indent(FILE *f, int indent) {
+static void do_indent(ByteBuffer &out, int indent) {
     for (int i = 0; i < indent; i += 1)
-        fprintf(f, " ");
+        out.append_format(" ");
 }
 
-static void json_inline_str(FILE *f, const ByteBuffer &value) {
-    fprintf(f, "\"");
+static void json_inline_str(ByteBuffer &out, const ByteBuffer &value) {
+    out.append_format("\"");
     for (int i = 0; i < value.length(); i += 1) {
         char c = value.at(i);
         switch (c) {
             case '\n':
-                fprintf(f, "\\n");
+                out.append_format("\\n");
                 break;
             case '\r':
-                fprintf(f, "\\r");
+                out.append_format("\\r");
                 break;
             case '\f':
-                fprintf(f, "\\f");
+                out.append_format("\\f");
                 break;
             case '\t':
-                fprintf(f, "\\t");
+                out.append_format("\\t");
                 break;
             case '\b':
-                fprintf(f, "\\b");
+                out.append_format("\\b");
                 break;
             case '"':
-                fprintf(f, "\\\"");
+                out.append_format("\\\"");
                 break;
             case '\\':
-                fprintf(f, "\\\\");
+                out.append_format("\\\\");
                 break;
             default:
-                fprintf(f, "%c", c);
+                out.append_format("%c", c);
                 break;
         }
     }
-    fprintf(f, "\"");
+    out.append_format("\"");
 }
 
-static void json_line_indent(FILE *f, int *indent, const char *brace) {
-    fprintf(f, "%s\n", brace);
+static void json_line_indent(ByteBuffer &out, int *indent, const char *brace) {
+    out.append_format("%s\n", brace);
     *indent += 2;
 }
 
-static void json_line_outdent(FILE *f, int *indent, const char *brace) {
+static void json_line_outdent(ByteBuffer &out, int *indent, const char *brace) {
     *indent -= 2;
-    do_indent(f, *indent);
-    fprintf(f, "%s\n", brace);
+    do_indent(out, *indent);
+    out.append_format("%s\n", brace);
 }
 
-static void json_line_str_list(FILE *f, int indent, const char *key, const List<ByteBuffer> &value) {
-    do_indent(f, indent);
-    fprintf(f, "%s: ", key);
-    json_line_indent(f, &indent, "[");
+static void json_line_str_list(ByteBuffer &out, int indent, const char *key, const List<ByteBuffer> &value) {
+    do_indent(out, indent);
+    out.append_format("%s: ", key);
+    json_line_indent(out, &indent, "[");
     for (int i = 0; i < value.length(); i += 1) {
-        do_indent(f, indent);
-        json_inline_str(f, value.at(i));
-        fprintf(f, ",\n");
+        do_indent(out, indent);
+        json_inline_str(out, value.at(i));
+        out.append_format(",\n");
     }
-    json_line_outdent(f, &indent, "],\n");
+    json_line_outdent(out, &indent, "],\n");
 }
 
-static void json_line_str(FILE *f, int indent, const char *key, const ByteBuffer &value) {
-    do_indent(f, indent);
-    fprintf(f, "%s: ", key);
-    json_inline_str(f, value);
-    fprintf(f, ",\n");
+static void json_line_str(ByteBuffer &out, int indent, const char *key, const ByteBuffer &value) {
+    do_indent(out, indent);
+    out.append_format("%s: ", key);
+    json_inline_str(out, value);
+    out.append_format(",\n");
 }
 
-static void json_line_uint256(FILE *f, int indent, const char *key, const uint256 &value) {
-    do_indent(f, indent);
-    fprintf(f, "%s: \"%s\",\n", key, value.to_string().raw());
+static void json_line_uint256(ByteBuffer &out, int indent, const char *key, const uint256 &value) {
+    do_indent(out, indent);
+    out.append_format("%s: \"%s\",\n", key, value.to_string().raw());
 }
 
-static void json_line_double(FILE *f, int indent, const char *key, double value) {
-    do_indent(f, indent);
-    fprintf(f, "%s: %f,\n", key, value);
+static void json_line_double(ByteBuffer &out, int indent, const char *key, double value) {
+    do_indent(out, indent);
+    out.append_format("%s: %f,\n", key, value);
 }
 
-static void json_line_int(FILE *f, int indent, const char *key, int value) {
-    do_indent(f, indent);
-    fprintf(f, "%s: %d,\n", key, value);
+static void json_line_int(ByteBuffer &out, int indent, const char *key, int value) {
+    do_indent(out, indent);
+    out.append_format("%s: %d,\n", key, value);
 }
 
-static void json_line_float(FILE *f, int indent, const char *key, float value) {
-    do_indent(f, indent);
-    fprintf(f, "%s: %f,\n", key, value);
+static void json_line_float(ByteBuffer &out, int indent, const char *key, float value) {
+    do_indent(out, indent);
+    out.append_format("%s: %f,\n", key, value);
 }
 
-static void json_line_bool(FILE *f, int indent, const char *key, bool value) {
-    do_indent(f, indent);
-    fprintf(f, "%s: %s,\n", key, value ? "true" : "false");
+static void json_line_bool(ByteBuffer &out, int indent, const char *key, bool value) {
+    do_indent(out, indent);
+    out.append_format("%s: %s,\n", key, value ? "true" : "false");
 }
 
-static void json_line_comment(FILE *f, int indent, const char *comment) {
-    do_indent(f, indent);
-    fprintf(f, "// %s\n", comment);
+static void json_line_comment(ByteBuffer &out, int indent, const char *comment) {
+    do_indent(out, indent);
+    out.append_format("// %s\n", comment);
 }
 
-static void json_line_dock(FILE *f, int indent, const char *key, const SettingsFileDock *dock) {
+static void json_line_dock(ByteBuffer &out, int indent, const char *key, const SettingsFileDock *dock) {
     assert(dock);
 
-    do_indent(f, indent);
-    fprintf(f, "%s: ", key);
-    json_line_indent(f, &indent, "{");
+    do_indent(out, indent);
+    out.append_format("%s: ", key);
+    json_line_indent(out, &indent, "{");
 
-    json_line_str(f, indent, "dock_type", dock_type_to_str(dock->dock_type));
+    json_line_str(out, indent, "dock_type", dock_type_to_str(dock->dock_type));
 
     switch (dock->dock_type) {
         case SettingsFileDockTypeTabs:
-            do_indent(f, indent);
-            fprintf(f, "tabs: [");
+            do_indent(out, indent);
+            out.append_format("tabs: [");
             for (int i = 0; i < dock->tabs.length(); i += 1) {
-                json_inline_str(f, dock->tabs.at(i).encode());
+                json_inline_str(out, dock->tabs.at(i).encode());
                 if (i < dock->tabs.length() - 1)
-                    fprintf(f, ", ");
+                    out.append_format(", ");
             }
-            fprintf(f, "],\n");
+            out.append_format("],\n");
             break;
         case SettingsFileDockTypeHoriz:
         case SettingsFileDockTypeVert:
-            json_line_float(f, indent, "split_ratio", dock->split_ratio);
-            json_line_dock(f, indent, "child_a", dock->child_a);
-            json_line_dock(f, indent, "child_b", dock->child_b);
+            json_line_float(out, indent, "split_ratio", dock->split_ratio);
+            json_line_dock(out, indent, "child_a", dock->child_a);
+            json_line_dock(out, indent, "child_b", dock->child_b);
             break;
     }
 
-    json_line_outdent(f, &indent, "},");
+    json_line_outdent(out, &indent, "},");
 }
 
-static void json_line_open_windows(FILE *f, int indent, const char *key,
+static void json_line_open_windows(ByteBuffer &out, int indent, const char *key,
         const List<SettingsFileOpenWindow> &open_windows)
 {
-    do_indent(f, indent);
-    fprintf(f, "%s: ", key);
-    json_line_indent(f, &indent, "[");
+    do_indent(out, indent);
+    out.append_format("%s: ", key);
+    json_line_indent(out, &indent, "[");
 
     for (int i = 0; i < open_windows.length(); i += 1) {
         const SettingsFileOpenWindow *open_window = &open_windows.at(i);
 
-        do_indent(f, indent);
-        json_line_indent(f, &indent, "{");
+        do_indent(out, indent);
+        json_line_indent(out, &indent, "{");
 
-        json_line_comment(f, indent, "which perspective this window uses");
-        json_line_int(f, indent, "perspective", open_window->perspective_index);
-        fprintf(f, "\n");
+        json_line_comment(out, indent, "which perspective this window uses");
+        json_line_int(out, indent, "perspective", open_window->perspective_index);
+        out.append_format("\n");
 
-        json_line_comment(f, indent, "position of the window on the screen");
-        json_line_int(f, indent, "left", open_window->left);
-        json_line_int(f, indent, "top", open_window->top);
-        json_line_int(f, indent, "width", open_window->width);
-        json_line_int(f, indent, "height", open_window->height);
-        json_line_bool(f, indent, "maximized", open_window->maximized);
-        fprintf(f, "\n");
+        json_line_comment(out, indent, "position of the window on the screen");
+        json_line_int(out, indent, "left", open_window->left);
+        json_line_int(out, indent, "top", open_window->top);
+        json_line_int(out, indent, "width", open_window->width);
+        json_line_int(out, indent, "height", open_window->height);
+        json_line_bool(out, indent, "maximized", open_window->maximized);
+        out.append_format("\n");
 
-        json_line_comment(f, indent, "whether to show dockable pane tabs when there is only one");
-        json_line_bool(f, indent, "always_show_tabs", open_window->always_show_tabs);
-        fprintf(f, "\n");
+        json_line_comment(out, indent, "whether to show dockable pane tabs when there is only one");
+        json_line_bool(out, indent, "always_show_tabs", open_window->always_show_tabs);
+        out.append_format("\n");
 
-        json_line_outdent(f, &indent, "},");
+        json_line_outdent(out, &indent, "},");
     }
-    json_line_outdent(f, &indent, "],");
+    json_line_outdent(out, &indent, "],");
 }
 
-static void json_line_perspectives(FILE *f, int indent, const char *key,
+static void json_line_perspectives(ByteBuffer &out, int indent, const char *key,
         const List<SettingsFilePerspective> &perspectives)
 {
-    do_indent(f, indent);
-    fprintf(f, "%s: ", key);
-    json_line_indent(f, &indent, "[");
+    do_indent(out, indent);
+    out.append_format("%s: ", key);
+    json_line_indent(out, &indent, "[");
 
     for (int i = 0; i < perspectives.length(); i += 1) {
         const SettingsFilePerspective *perspective = &perspectives.at(i);
 
-        do_indent(f, indent);
-        json_line_indent(f, &indent, "{");
+        do_indent(out, indent);
+        json_line_indent(out, &indent, "{");
 
-        json_line_str(f, indent, "name", perspective->name.encode());
-        json_line_dock(f, indent, "dock", &perspective->dock);
+        json_line_str(out, indent, "name", perspective->name.encode());
+        json_line_dock(out, indent, "dock", &perspective->dock);
 
-        json_line_outdent(f, &indent, "},");
+        json_line_outdent(out, &indent, "},");
     }
-    json_line_outdent(f, &indent, "],");
+    json_line_outdent(out, &indent, "],");
 }
 
-static void json_line_device_designations(FILE *f, int indent, const char *key,
+static void json_line_device_designations(ByteBuffer &out, int indent, const char *key,
         const List<SettingsFileDeviceId> &device_designations)
 {
-    do_indent(f, indent);
-    fprintf(f, "%s: ", key);
-    json_line_indent(f, &indent, "{");
+    do_indent(out, indent);
+    out.append_format("%s: ", key);
+    json_line_indent(out, &indent, "{");
 
     for (int i = 1; i < device_designations.length(); i += 1) {
         const SettingsFileDeviceId *sf_device_id = &device_designations.at(i);
-        do_indent(f, indent);
-        fprintf(f, "\"%s\": ", device_id_str((DeviceId)i));
+        do_indent(out, indent);
+        out.append_format("\"%s\": ", device_id_str((DeviceId)i));
 
         if (sf_device_id->backend != SoundIoBackendNone) {
-            json_line_indent(f, &indent, "{");
+            json_line_indent(out, &indent, "{");
 
-            json_line_str(f, indent, "backend", soundio_backend_name(sf_device_id->backend));
-            json_line_str(f, indent, "device", sf_device_id->device_id);
-            json_line_bool(f, indent, "raw", sf_device_id->is_raw);
+            json_line_str(out, indent, "backend", soundio_backend_name(sf_device_id->backend));
+            json_line_str(out, indent, "device", sf_device_id->device_id);
+            json_line_bool(out, indent, "raw", sf_device_id->is_raw);
 
-            json_line_outdent(f, &indent, "},");
+            json_line_outdent(out, &indent, "},");
         } else {
-            fprintf(f, "null,\n");
+            out.append_format("null,\n");
         }
     }
 
-    json_line_outdent(f, &indent, "},");
+    json_line_outdent(out, &indent, "},");
 }
 
-static void json_line_render_format_defaults(FILE *f, int indent, const char *key,
+static void json_line_render_format_defaults(ByteBuffer &out, int indent, const char *key,
         const SoundIoFormat *sample_formats, const int *bit_rates)
 {
-    do_indent(f, indent);
-    fprintf(f, "%s: ", key);
-    json_line_indent(f, &indent, "{");
+    do_indent(out, indent);
+    out.append_format("%s: ", key);
+    json_line_indent(out, &indent, "{");
 
     for (int i = 0; i < RenderFormatTypeCount; i += 1) {
         SoundIoFormat format = sample_formats[i];
         int bit_rate = bit_rates[i];
 
-        do_indent(f, indent);
-        fprintf(f, "%s: ", render_format_type_to_str((RenderFormatType)i));
+        do_indent(out, indent);
+        out.append_format("%s: ", render_format_type_to_str((RenderFormatType)i));
 
-        json_line_indent(f, &indent, "{");
-        json_line_str(f, indent, "sample_format", soundio_format_string(format));
-        json_line_int(f, indent, "bit_rate", bit_rate);
-        json_line_outdent(f, &indent, "},");
+        json_line_indent(out, &indent, "{");
+        json_line_str(out, indent, "sample_format", soundio_format_string(format));
+        json_line_int(out, indent, "bit_rate", bit_rate);
+        json_line_outdent(out, &indent, "},");
     }
 
-    json_line_outdent(f, &indent, "},");
+    json_line_outdent(out, &indent, "},");
 }
 
 static void handle_parse_error(SettingsFile *sf, LaxJsonError err) {
@@ -844,6 +856,9 @@ SettingsFile *settings_file_open(const ByteBuffer &path) {
 }
 
 void settings_file_close(SettingsFile *sf) {
+    settings_file_flush(sf);
+    os_cond_destroy(sf->writer_cond);
+    os_mutex_destroy(sf->writer_mutex);
     for (int i = 0; i < sf->perspectives.length(); i += 1) {
         SettingsFilePerspective *perspective = &sf->perspectives.at(i);
         settings_file_clear_dock(&perspective->dock);
@@ -873,78 +888,158 @@ void settings_file_clear_dock(SettingsFileDock *dock) {
     dock->dock_type = SettingsFileDockTypeTabs;
 }
 
-int settings_file_commit(SettingsFile *sf) {
+// writes at most this often, so that a burst of commits costs one write
+static const double write_interval_seconds = 0.5;
+
+static void serialize(SettingsFile *sf, ByteBuffer &out) {
+    out.clear();
+    int indent = 0;
+    json_line_comment(out, indent, "Genesis DAW configuration file");
+    json_line_comment(out, indent, "This config file format is a superset of JSON. See");
+    json_line_comment(out, indent, "https://github.com/andrewrk/liblaxjson for more details.");
+    json_line_comment(out, indent, "WARNING: This file is sporadically overwritten while Genesis is running.");
+    do_indent(out, indent);
+    json_line_indent(out, &indent, "{");
+
+    json_line_comment(out, indent, "your display name");
+    json_line_str(out, indent, "user_name", sf->user_name.encode());
+    out.append_format("\n");
+
+    json_line_comment(out, indent, "your user id");
+    json_line_uint256(out, indent, "user_id", sf->user_id);
+    out.append_format("\n");
+
+    json_line_comment(out, indent, "extra directories to search for samples.");
+    json_line_comment(out, indent, "note: ~/.genesis/samples/ is always searched.");
+    json_line_str_list(out, indent, "sample_dirs", sf->sample_dirs);
+    out.append_format("\n");
+
+    json_line_comment(out, indent, "open this project on startup");
+    json_line_uint256(out, indent, "open_project_id", sf->open_project_id);
+    out.append_format("\n");
+
+    json_line_comment(out, indent, "these perspectives are available for you to choose from");
+    json_line_perspectives(out, indent, "perspectives", sf->perspectives);
+    out.append_format("\n");
+
+    json_line_comment(out, indent, "open these windows on startup");
+    json_line_open_windows(out, indent, "open_windows", sf->open_windows);
+    out.append_format("\n");
+
+    json_line_comment(out, indent, "how many seconds long should audio buffers be");
+    json_line_comment(out, indent, "a shorter value makes genesis respond to events faster");
+    json_line_comment(out, indent, "a larger value guards against buffer underruns");
+    json_line_double(out, indent, "latency", sf->latency);
+    out.append_format("\n");
+
+    json_line_comment(out, indent, "audio files which decode to more megabytes than this");
+    json_line_comment(out, indent, "are streamed from disk instead of kept in memory");
+    json_line_double(out, indent, "audio_file_resident_mb", sf->audio_file_resident_mb);
+    out.append_format("\n");
+
+    json_line_comment(out, indent, "projects share the audio files they import, and their");
+    json_line_comment(out, indent, "decoded samples and waveforms, through this directory");
+    json_line_comment(out, indent, "empty means each project keeps its own");
+    json_line_str(out, indent, "asset_store_dir", sf->asset_store_dir);
+    out.append_format("\n");
+
+    json_line_comment(out, indent, "which actual devices correspond to virtual devices");
+    json_line_comment(out, indent, "null means use the system default device for this virtual device");
+    json_line_device_designations(out, indent, "device_designations", sf->device_designations);
+    out.append_format("\n");
+
+    json_line_comment(out, indent, "in the render dock, which format is selected by default");
+    json_line_str(out, indent, "default_render_format", render_format_type_to_str(sf->default_render_format));
+    out.append_format("\n");
+
+    json_line_comment(out, indent, "for each render format, which sample format and bit rate");
+    json_line_comment(out, indent, "are selected by default");
+    json_line_render_format_defaults(out, indent, "default_render_params",
+            sf->default_render_sample_formats, sf->default_render_bit_rates);
+    out.append_format("\n");
+
+    json_line_outdent(out, &indent, "}");
+}
+
+static int write_contents(const ByteBuffer &path, const ByteBuffer &contents) {
     OsTempFile tmp_file;
-    int err = os_create_temp_file(os_path_dirname(sf->path).raw(), &tmp_file);
+    int err = os_create_temp_file(os_path_dirname(path).raw(), &tmp_file);
     if (err)
         return err;
 
-    FILE *f = tmp_file.file;
+    size_t amt_written = fwrite(contents.raw(), 1, contents.length(), tmp_file.file);
+    if (fclose(tmp_file.file) || amt_written != (size_t)contents.length()) {
+        os_delete(tmp_file.path.raw());
+        return GenesisErrorFileAccess;
+    }
 
-    int indent = 0;
-    json_line_comment(f, indent, "Genesis DAW configuration file");
-    json_line_comment(f, indent, "This config file format is a superset of JSON. See");
-    json_line_comment(f, indent, "https://github.com/andrewrk/liblaxjson for more details.");
-    json_line_comment(f, indent, "WARNING: This file is sporadically overwritten while Genesis is running.");
-    do_indent(f, indent);
-    json_line_indent(f, &indent, "{");
-
-    json_line_comment(f, indent, "your display name");
-    json_line_str(f, indent, "user_name", sf->user_name.encode());
-    fprintf(f, "\n");
-
-    json_line_comment(f, indent, "your user id");
-    json_line_uint256(f, indent, "user_id", sf->user_id);
-    fprintf(f, "\n");
-
-    json_line_comment(f, indent, "extra directories to search for samples.");
-    json_line_comment(f, indent, "note: ~/.genesis/samples/ is always searched.");
-    json_line_str_list(f, indent, "sample_dirs", sf->sample_dirs);
-    fprintf(f, "\n");
-
-    json_line_comment(f, indent, "open this project on startup");
-    json_line_uint256(f, indent, "open_project_id", sf->open_project_id);
-    fprintf(f, "\n");
-
-    json_line_comment(f, indent, "these perspectives are available for you to choose from");
-    json_line_perspectives(f, indent, "perspectives", sf->perspectives);
-    fprintf(f, "\n");
-
-    json_line_comment(f, indent, "open these windows on startup");
-    json_line_open_windows(f, indent, "open_windows", sf->open_windows);
-    fprintf(f, "\n");
-
-    json_line_comment(f, indent, "how many seconds long should audio buffers be");
-    json_line_comment(f, indent, "a shorter value makes genesis respond to events faster");
-    json_line_comment(f, indent, "a larger value guards against buffer underruns");
-    json_line_double(f, indent, "latency", sf->latency);
-    fprintf(f, "\n");
-
-    json_line_comment(f, indent, "which actual devices correspond to virtual devices");
-    json_line_comment(f, indent, "null means use the system default device for this virtual device");
-    json_line_device_designations(f, indent, "device_designations", sf->device_designations);
-    fprintf(f, "\n");
-
-    json_line_comment(f, indent, "in the render dock, which format is selected by default");
-    json_line_str(f, indent, "default_render_format", render_format_type_to_str(sf->default_render_format));
-    fprintf(f, "\n");
-
-    json_line_comment(f, indent, "for each render format, which sample format and bit rate");
-    json_line_comment(f, indent, "are selected by default");
-    json_line_render_format_defaults(f, indent, "default_render_params",
-            sf->default_render_sample_formats, sf->default_render_bit_rates);
-    fprintf(f, "\n");
+    return os_rename_clobber(tmp_file.path.raw(), path.raw());
+}
 
-    json_line_outdent(f, &indent, "}");
+static void writer_thread_run(void *arg) {
+    SettingsFile *sf = (SettingsFile *)arg;
+    ByteBuffer contents;
+    OsMutexLocker locker(sf->writer_mutex);
+    for (;;) {
+        while (!sf->writer_pending && !sf->writer_quit)
+            os_cond_wait(sf->writer_cond, sf->writer_mutex);
+        if (!sf->writer_pending)
+            return;
+
+        // the commits that come in meanwhile replace the contents
+        double wait_until = sf->writer_last_write_time + write_interval_seconds;
+        double now;
+        while (!sf->writer_quit && (now = os_get_time()) < wait_until)
+            os_cond_timed_wait(sf->writer_cond, sf->writer_mutex, wait_until - now);
+
+        contents = sf->writer_contents;
+        sf->writer_pending = false;
+
+        os_mutex_unlock(sf->writer_mutex);
+        int err = write_contents(sf->path, contents);
+        os_mutex_lock(sf->writer_mutex);
+
+        sf->writer_last_write_time = os_get_time();
+        sf->writer_err = err;
+        if (err)
+            fprintf(stderr, "unable to write %s: %s\n", sf->path.raw(), genesis_strerror(err));
+    }
+}
 
-    if (fclose(f))
-        return GenesisErrorFileAccess;
+int settings_file_commit(SettingsFile *sf) {
+    int err;
+    if (!sf->writer_thread) {
+        if (!(sf->writer_mutex = os_mutex_create()))
+            return GenesisErrorNoMem;
+        if (!(sf->writer_cond = os_cond_create()))
+            return GenesisErrorNoMem;
+        if ((err = os_thread_create(writer_thread_run, sf, false, &sf->writer_thread)))
+            return err;
+    }
 
-    err = os_rename_clobber(tmp_file.path.raw(), sf->path.raw());
-    if (err)
-        return err;
+    // serializing is cheap and keeps the writer away from the settings
+    ByteBuffer contents;
+    serialize(sf, contents);
 
-    return 0;
+    OsMutexLocker locker(sf->writer_mutex);
+    sf->writer_contents = contents;
+    sf->writer_pending = true;
+    os_cond_signal(sf->writer_cond, sf->writer_mutex);
+    return sf->writer_err;
+}
+
+int settings_file_flush(SettingsFile *sf) {
+    if (!sf->writer_thread)
+        return 0;
+    {
+        OsMutexLocker locker(sf->writer_mutex);
+        sf->writer_quit = true;
+        os_cond_signal(sf->writer_cond, sf->writer_mutex);
+    }
+    os_thread_destroy(sf->writer_thread);
+    sf->writer_thread = nullptr;
+    sf->writer_quit = false;
+    return sf->writer_err;
 }
 
 void settings_file_set_default_render_format(SettingsFile *sf, RenderFormatType format_type) {
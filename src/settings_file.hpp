@@ -9,6 +9,9 @@
 #include "audio_file.hpp"
 
 struct LaxJsonContext;
+struct OsThread;
+struct OsMutex;
+struct OsCond;
 
 enum SettingsFileState {
     SettingsFileStateStart,
@@ -18,6 +21,8 @@ enum SettingsFileState {
     SettingsFileStateUserName,
     SettingsFileStateUserId,
     SettingsFileStateLatency,
+    SettingsFileStateAudioFileResidentMb,
+    SettingsFileStateAssetStoreDir,
     SettingsFileStateExpectSampleDirs,
     SettingsFileStateSampleDirsItem,
     SettingsFileStatePerspectives,
@@ -107,6 +112,9 @@ struct SettingsFile {
     // index is DeviceId. if backend_name is NULL then that DeviceId is unspecified
     List<SettingsFileDeviceId> device_designations;
     double latency;
+    double audio_file_resident_mb;
+    // empty for none
+    ByteBuffer asset_store_dir;
     RenderFormatType default_render_format;
     SoundIoFormat default_render_sample_formats[RenderFormatTypeCount];
     int default_render_bit_rates[RenderFormatTypeCount];
@@ -122,13 +130,30 @@ struct SettingsFile {
     DeviceId current_device_id;
     SettingsFileDeviceId *current_sf_device_id;
     RenderFormatType current_default_render_params_format;
+
+    // commits are written to disk by writer_thread, and a burst of them at
+    // once. writer_mutex protects the rest.
+    OsThread *writer_thread;
+    OsMutex *writer_mutex;
+    OsCond *writer_cond;
+    ByteBuffer writer_contents;
+    bool writer_pending;
+    bool writer_quit;
+    double writer_last_write_time;
+    // of the last write
+    int writer_err;
 };
 
 SettingsFile *settings_file_open(const ByteBuffer &path);
 void settings_file_close(SettingsFile *sf);
 
-// atomically update settings file on disk
+// atomically update settings file on disk. it happens in the background
+// a moment later, so this takes only a snapshot. returns the error of the
+// last write before it, if any.
 int settings_file_commit(SettingsFile *sf);
+// waits for the commits so far to be on disk. settings_file_close does
+// this too.
+int settings_file_flush(SettingsFile *sf);
 
 void settings_file_clear_dock(SettingsFileDock *dock);
 
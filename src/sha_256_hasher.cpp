@@ -2,32 +2,415 @@
 #include "util.hpp"
 
 #include <rhash.h>
+#include <string.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#define GENESIS_SHA256_X86
+#elif defined(__aarch64__) && (defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO))
+#include <arm_neon.h>
+#define GENESIS_SHA256_ARMV8
+#endif
+
+static const int SHA256_DIGEST_SIZE = 32;
+
+static const uint32_t sha256_initial_state[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static const uint32_t sha256_k[64] __attribute__((aligned(16))) = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t read_uint32be(const unsigned char *buf) {
+    return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | buf[3];
+}
+
+static inline void write_uint32be(unsigned char *buf, uint32_t x) {
+    buf[0] = x >> 24;
+    buf[1] = x >> 16;
+    buf[2] = x >> 8;
+    buf[3] = x;
+}
+
+// the last one or two blocks of a message of total_len bytes, whose first
+// tail_len bytes are in tail. returns how many blocks it wrote to out.
+static int sha256_pad(const unsigned char *tail, int tail_len, uint64_t total_len, unsigned char out[128]) {
+    int block_count = (tail_len + 9 > 64) ? 2 : 1;
+    memcpy(out, tail, tail_len);
+    out[tail_len] = 0x80;
+    memset(out + tail_len + 1, 0, block_count * 64 - tail_len - 1);
+    uint64_t bit_len = total_len * 8;
+    write_uint32be(out + block_count * 64 - 8, (uint32_t)(bit_len >> 32));
+    write_uint32be(out + block_count * 64 - 4, (uint32_t)bit_len);
+    return block_count;
+}
+
+#if defined(GENESIS_SHA256_X86)
+__attribute__((target("sha,sse4.1")))
+static void sha256_blocks_shani(uint32_t *state, const unsigned char *data, size_t block_count) {
+    const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // the instructions want the state as abef and cdgh
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xb1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1b);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+    for (; block_count > 0; block_count -= 1, data += 64) {
+        __m128i abef = state0;
+        __m128i cdgh = state1;
+        __m128i msg[4];
+        for (int group = 0; group < 16; group += 1) {
+            __m128i &w = msg[group % 4];
+            if (group < 4) {
+                w = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + group * 16)), byte_swap);
+            } else {
+                __m128i prev = msg[(group + 3) % 4];
+                w = _mm_sha256msg1_epu32(w, msg[(group + 1) % 4]);
+                w = _mm_add_epi32(w, _mm_alignr_epi8(prev, msg[(group + 2) % 4], 4));
+                w = _mm_sha256msg2_epu32(w, prev);
+            }
+            __m128i wk = _mm_add_epi32(w, _mm_load_si128((const __m128i *)&sha256_k[group * 4]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(wk, 0x0e));
+        }
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1b);
+    state1 = _mm_shuffle_epi32(state1, 0xb1);
+    _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(tmp, state1, 0xf0));
+    _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(state1, tmp, 8));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i rotr_avx2(__m256i x, int n) {
+    return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+// one block of each of eight messages, with word i of lane l at
+// blocks[l] + 4 * i. lanes whose bit in active_mask is clear keep their state.
+__attribute__((target("avx2")))
+static void sha256_block_avx2(__m256i *state, const unsigned char *const *blocks, __m256i active_mask) {
+    __m256i w[16];
+    for (int i = 0; i < 16; i += 1) {
+        w[i] = _mm256_set_epi32(
+                read_uint32be(blocks[7] + 4 * i), read_uint32be(blocks[6] + 4 * i),
+                read_uint32be(blocks[5] + 4 * i), read_uint32be(blocks[4] + 4 * i),
+                read_uint32be(blocks[3] + 4 * i), read_uint32be(blocks[2] + 4 * i),
+                read_uint32be(blocks[1] + 4 * i), read_uint32be(blocks[0] + 4 * i));
+    }
+    __m256i a = state[0], b = state[1], c = state[2], d = state[3];
+    __m256i e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int t = 0; t < 64; t += 1) {
+        __m256i wt;
+        if (t < 16) {
+            wt = w[t];
+        } else {
+            __m256i w15 = w[(t + 1) % 16];
+            __m256i w2 = w[(t + 14) % 16];
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr_avx2(w15, 7), rotr_avx2(w15, 18)),
+                    _mm256_srli_epi32(w15, 3));
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr_avx2(w2, 17), rotr_avx2(w2, 19)),
+                    _mm256_srli_epi32(w2, 10));
+            wt = _mm256_add_epi32(_mm256_add_epi32(w[t % 16], s0),
+                    _mm256_add_epi32(w[(t + 9) % 16], s1));
+            w[t % 16] = wt;
+        }
+        __m256i big_s1 = _mm256_xor_si256(_mm256_xor_si256(rotr_avx2(e, 6), rotr_avx2(e, 11)),
+                rotr_avx2(e, 25));
+        __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        __m256i temp1 = _mm256_add_epi32(_mm256_add_epi32(h, big_s1),
+                _mm256_add_epi32(_mm256_add_epi32(ch, _mm256_set1_epi32(sha256_k[t])), wt));
+        __m256i big_s0 = _mm256_xor_si256(_mm256_xor_si256(rotr_avx2(a, 2), rotr_avx2(a, 13)),
+                rotr_avx2(a, 22));
+        __m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+        __m256i temp2 = _mm256_add_epi32(big_s0, maj);
+        h = g;
+        g = f;
+        f = e;
+        e = _mm256_add_epi32(d, temp1);
+        d = c;
+        c = b;
+        b = a;
+        a = _mm256_add_epi32(temp1, temp2);
+    }
+    __m256i result[8] = {a, b, c, d, e, f, g, h};
+    for (int i = 0; i < 8; i += 1)
+        state[i] = _mm256_blendv_epi8(state[i], _mm256_add_epi32(state[i], result[i]), active_mask);
+}
+
+struct Sha256Lane {
+    const unsigned char *data;
+    size_t full_block_count;
+    size_t block_count;
+    unsigned char tail[128];
+};
+
+// up to eight messages side by side. lanes past count hash nothing.
+__attribute__((target("avx2")))
+static void sha256_digest_group_avx2(const char *const *buffers, const size_t *lens, int count,
+        ByteBuffer *out_digests)
+{
+    static const unsigned char empty_block[64] = {0};
+    Sha256Lane lanes[8];
+    size_t max_block_count = 0;
+    for (int l = 0; l < 8; l += 1) {
+        Sha256Lane *lane = &lanes[l];
+        if (l >= count) {
+            lane->full_block_count = 0;
+            lane->block_count = 0;
+            continue;
+        }
+        lane->data = (const unsigned char *)buffers[l];
+        lane->full_block_count = lens[l] / 64;
+        int tail_len = lens[l] % 64;
+        lane->block_count = lane->full_block_count +
+            sha256_pad(lane->data + lane->full_block_count * 64, tail_len, lens[l], lane->tail);
+        max_block_count = max(max_block_count, lane->block_count);
+    }
+
+    __m256i state[8];
+    for (int i = 0; i < 8; i += 1)
+        state[i] = _mm256_set1_epi32(sha256_initial_state[i]);
+    for (size_t block_index = 0; block_index < max_block_count; block_index += 1) {
+        const unsigned char *blocks[8];
+        uint32_t active[8];
+        for (int l = 0; l < 8; l += 1) {
+            Sha256Lane *lane = &lanes[l];
+            active[l] = (block_index < lane->block_count) ? 0xffffffff : 0;
+            if (block_index < lane->full_block_count)
+                blocks[l] = lane->data + block_index * 64;
+            else if (active[l])
+                blocks[l] = lane->tail + (block_index - lane->full_block_count) * 64;
+            else
+                blocks[l] = empty_block;
+        }
+        sha256_block_avx2(state, blocks, _mm256_loadu_si256((const __m256i *)active));
+    }
+
+    uint32_t words[8][8];
+    for (int i = 0; i < 8; i += 1)
+        _mm256_storeu_si256((__m256i *)words[i], state[i]);
+    for (int l = 0; l < count; l += 1) {
+        ByteBuffer &out = out_digests[l];
+        out.resize(SHA256_DIGEST_SIZE);
+        for (int i = 0; i < 8; i += 1)
+            write_uint32be((unsigned char *)out.raw() + i * 4, words[i][l]);
+    }
+}
+#endif
+
+#if defined(GENESIS_SHA256_ARMV8)
+static void sha256_blocks_armv8(uint32_t *state, const unsigned char *data, size_t block_count) {
+    uint32x4_t state0 = vld1q_u32(&state[0]);
+    uint32x4_t state1 = vld1q_u32(&state[4]);
+    for (; block_count > 0; block_count -= 1, data += 64) {
+        uint32x4_t abcd = state0;
+        uint32x4_t efgh = state1;
+        uint32x4_t msg[4];
+        for (int group = 0; group < 16; group += 1) {
+            uint32x4_t &w = msg[group % 4];
+            if (group < 4) {
+                w = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + group * 16)));
+            } else {
+                w = vsha256su1q_u32(vsha256su0q_u32(w, msg[(group + 1) % 4]),
+                        msg[(group + 2) % 4], msg[(group + 3) % 4]);
+            }
+            uint32x4_t wk = vaddq_u32(w, vld1q_u32(&sha256_k[group * 4]));
+            uint32x4_t prev0 = state0;
+            state0 = vsha256hq_u32(state0, state1, wk);
+            state1 = vsha256h2q_u32(state1, prev0, wk);
+        }
+        state0 = vaddq_u32(state0, abcd);
+        state1 = vaddq_u32(state1, efgh);
+    }
+    vst1q_u32(&state[0], state0);
+    vst1q_u32(&state[4], state1);
+}
+#endif
+
+bool sha256_impl_supported(Sha256Impl impl) {
+    switch (impl) {
+    case Sha256ImplRhash:
+        return true;
+    case Sha256ImplShaNi:
+#if defined(GENESIS_SHA256_X86)
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+#else
+        return false;
+#endif
+    case Sha256ImplArmv8:
+#if defined(GENESIS_SHA256_ARMV8)
+        return true;
+#else
+        return false;
+#endif
+    case Sha256ImplAvx2:
+#if defined(GENESIS_SHA256_X86)
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#else
+        return false;
+#endif
+    }
+    panic("invalid Sha256Impl");
+}
+
+static Sha256BlocksFunction sha256_impl_blocks_function(Sha256Impl impl) {
+    switch (impl) {
+    case Sha256ImplRhash:
+    case Sha256ImplAvx2:
+        break;
+    case Sha256ImplShaNi:
+#if defined(GENESIS_SHA256_X86)
+        return sha256_blocks_shani;
+#else
+        break;
+#endif
+    case Sha256ImplArmv8:
+#if defined(GENESIS_SHA256_ARMV8)
+        return sha256_blocks_armv8;
+#else
+        break;
+#endif
+    }
+    panic("Sha256Impl has no blocks function");
+}
+
+static Sha256Impl sha256_best_impl(void) {
+    static const Sha256Impl prioritized_impls[] = {
+        Sha256ImplShaNi,
+        Sha256ImplArmv8,
+    };
+    for (int i = 0; i < array_length(prioritized_impls); i += 1) {
+        if (sha256_impl_supported(prioritized_impls[i]))
+            return prioritized_impls[i];
+    }
+    return Sha256ImplRhash;
+}
 
 Sha256Hasher::Sha256Hasher() {
-    rhash_library_init();
-    rhc = ok_mem(rhash_init(RHASH_SHA256));
-    needs_reset = false;
+    static const Sha256Impl best = sha256_best_impl();
+    init(best);
+}
+
+Sha256Hasher::Sha256Hasher(Sha256Impl impl) {
+    init(impl);
+}
+
+void Sha256Hasher::init(Sha256Impl impl) {
+    assert(impl != Sha256ImplAvx2);
+    assert(sha256_impl_supported(impl));
+    this->impl = impl;
+    if (impl == Sha256ImplRhash) {
+        rhash_library_init();
+        rhc = ok_mem(rhash_init(RHASH_SHA256));
+        blocks_fn = nullptr;
+    } else {
+        rhc = nullptr;
+        blocks_fn = sha256_impl_blocks_function(impl);
+    }
+    reset();
 }
 
 Sha256Hasher::~Sha256Hasher() {
-    rhash_free(rhc);
+    if (rhc)
+        rhash_free(rhc);
 }
 
 void Sha256Hasher::update(char *buffer, size_t len) {
     assert(!needs_reset);
-    rhash_update(rhc, buffer, len);
+    if (rhc) {
+        rhash_update(rhc, buffer, len);
+        return;
+    }
+    const unsigned char *data = (const unsigned char *)buffer;
+    total_len += len;
+    if (block_len > 0) {
+        size_t amt = min((size_t)(64 - block_len), len);
+        memcpy(block + block_len, data, amt);
+        block_len += amt;
+        data += amt;
+        len -= amt;
+        if (block_len < 64)
+            return;
+        blocks_fn(state, block, 1);
+        block_len = 0;
+    }
+    size_t block_count = len / 64;
+    if (block_count > 0) {
+        blocks_fn(state, data, block_count);
+        data += block_count * 64;
+        len -= block_count * 64;
+    }
+    memcpy(block, data, len);
+    block_len = len;
 }
 
 void Sha256Hasher::get_digest(ByteBuffer &out) {
     assert(!needs_reset);
-    rhash_final(rhc, nullptr);
-    int digest_size = rhash_get_digest_size(RHASH_SHA256);
-    out.resize(digest_size);
-    rhash_print(out.raw(), rhc, RHASH_SHA256, RHPR_RAW);
     needs_reset = true;
+    out.resize(SHA256_DIGEST_SIZE);
+    if (rhc) {
+        rhash_final(rhc, nullptr);
+        rhash_print(out.raw(), rhc, RHASH_SHA256, RHPR_RAW);
+        return;
+    }
+    unsigned char padded[128];
+    blocks_fn(state, padded, sha256_pad(block, block_len, total_len, padded));
+    for (int i = 0; i < 8; i += 1)
+        write_uint32be((unsigned char *)out.raw() + i * 4, state[i]);
 }
 
 void Sha256Hasher::reset() {
-    rhash_reset(rhc);
+    if (rhc)
+        rhash_reset(rhc);
+    memcpy(state, sha256_initial_state, sizeof(state));
+    block_len = 0;
+    total_len = 0;
     needs_reset = false;
 }
+
+void sha256_digest_many_with_impl(Sha256Impl impl, const char *const *buffers, const size_t *lens,
+        int count, ByteBuffer *out_digests)
+{
+    assert(sha256_impl_supported(impl));
+#if defined(GENESIS_SHA256_X86)
+    if (impl == Sha256ImplAvx2) {
+        for (int i = 0; i < count; i += 8) {
+            sha256_digest_group_avx2(buffers + i, lens + i, min(8, count - i), out_digests + i);
+        }
+        return;
+    }
+#endif
+    Sha256Hasher hasher(impl);
+    for (int i = 0; i < count; i += 1) {
+        hasher.update((char *)buffers[i], lens[i]);
+        hasher.get_digest(out_digests[i]);
+        hasher.reset();
+    }
+}
+
+static Sha256Impl sha256_best_many_impl(void) {
+    Sha256Impl impl = sha256_best_impl();
+    if (impl == Sha256ImplRhash && sha256_impl_supported(Sha256ImplAvx2))
+        return Sha256ImplAvx2;
+    return impl;
+}
+
+void sha256_digest_many(const char *const *buffers, const size_t *lens, int count, ByteBuffer *out_digests) {
+    static const Sha256Impl best = sha256_best_many_impl();
+    sha256_digest_many_with_impl(best, buffers, lens, count, out_digests);
+}
@@ -3,19 +3,54 @@
 
 #include "byte_buffer.hpp"
 
+#include <stdint.h>
+
 struct rhash_context;
 
+enum Sha256Impl {
+    Sha256ImplRhash,
+    Sha256ImplShaNi,
+    Sha256ImplArmv8,
+    // eight messages side by side. only for sha256_digest_many.
+    Sha256ImplAvx2,
+};
+
+bool sha256_impl_supported(Sha256Impl impl);
+
+typedef void (*Sha256BlocksFunction)(uint32_t *state, const unsigned char *data, size_t block_count);
+
+// uses the sha instructions of the cpu when it has them, and rhash otherwise
 class Sha256Hasher {
 public:
     Sha256Hasher();
+    // for testing the implementations against each other
+    Sha256Hasher(Sha256Impl impl);
     ~Sha256Hasher();
 
     void update(char *buffer, size_t len);
     void get_digest(ByteBuffer &out);
     void reset();
 
+    Sha256Impl impl;
+    // only with Sha256ImplRhash
     rhash_context *rhc;
+    // the other implementations keep the state here
+    Sha256BlocksFunction blocks_fn;
+    uint32_t state[8];
+    unsigned char block[64];
+    int block_len;
+    uint64_t total_len;
     bool needs_reset;
+
+private:
+    void init(Sha256Impl impl);
 };
 
+// the digests of count whole messages at once, for many small files. with
+// avx2 and no sha instructions it hashes eight messages side by side, which
+// goes fastest when messages next to each other have about the same length.
+void sha256_digest_many(const char *const *buffers, const size_t *lens, int count, ByteBuffer *out_digests);
+void sha256_digest_many_with_impl(Sha256Impl impl, const char *const *buffers, const size_t *lens,
+        int count, ByteBuffer *out_digests);
+
 #endif
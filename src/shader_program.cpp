@@ -1,5 +1,105 @@
 #include "shader_program.hpp"
 #include "byte_buffer.hpp"
+#include "os.hpp"
+#include "sha_256_hasher.hpp"
+
+// linked programs are kept in the config dir, named by a hash of the
+// driver and the sources, so that launches after the first need not
+// compile. any problem with the cache falls back to compiling.
+
+struct ProgramBinaryHeader {
+    uint32_t format;
+};
+
+static bool program_binary_supported() {
+    if (epoxy_gl_version() < 41 && !epoxy_has_gl_extension("GL_ARB_get_program_binary"))
+        return false;
+    GLint format_count = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+    return format_count > 0;
+}
+
+static void hash_string(Sha256Hasher *hasher, const char *str) {
+    // with the terminator, so that no two lists of strings hash alike
+    hasher->update((char *)str, strlen(str) + 1);
+}
+
+static void get_program_binary_path(ByteBuffer &out, const char *vertex_shader_source,
+        const char *fragment_shader_source, const char *geometry_shader_source)
+{
+    Sha256Hasher hasher;
+    hash_string(&hasher, (const char *)glGetString(GL_VENDOR));
+    hash_string(&hasher, (const char *)glGetString(GL_RENDERER));
+    hash_string(&hasher, (const char *)glGetString(GL_VERSION));
+    hash_string(&hasher, vertex_shader_source);
+    hash_string(&hasher, fragment_shader_source);
+    hash_string(&hasher, geometry_shader_source ? geometry_shader_source : "");
+    ByteBuffer digest;
+    hasher.get_digest(digest);
+
+    ByteBuffer name;
+    for (int i = 0; i < digest.length(); i += 1) {
+        char hex[3];
+        snprintf(hex, sizeof(hex), "%02x", (unsigned char)digest.at(i));
+        name.append(hex);
+    }
+
+    ByteBuffer config_dir;
+    os_get_app_config_dir(config_dir);
+    ByteBuffer cache_dir;
+    os_path_join(cache_dir, config_dir, "shader_cache");
+    os_path_join(out, cache_dir, name);
+}
+
+static bool load_program_binary(GLuint program_id, const ByteBuffer &path) {
+    FILE *f = fopen(path.raw(), "rb");
+    if (!f)
+        return false;
+    long size;
+    ByteBuffer contents;
+    bool ok = false;
+    if (!os_file_size(f, &size) && size > (long)sizeof(ProgramBinaryHeader)) {
+        contents.resize(size);
+        ok = (fread(contents.raw(), 1, size, f) == (size_t)size);
+    }
+    fclose(f);
+    if (!ok)
+        return false;
+
+    ProgramBinaryHeader header;
+    memcpy(&header, contents.raw(), sizeof(header));
+    glProgramBinary(program_id, header.format, contents.raw() + sizeof(header), size - sizeof(header));
+
+    // drivers refuse binaries from other builds of themselves this way
+    GLint linked;
+    glGetProgramiv(program_id, GL_LINK_STATUS, &linked);
+    return linked;
+}
+
+static void save_program_binary(GLuint program_id, const ByteBuffer &path) {
+    GLint size;
+    glGetProgramiv(program_id, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0)
+        return;
+    ByteBuffer binary;
+    binary.resize(size);
+    GLenum format;
+    glGetProgramBinary(program_id, size, &size, &format, binary.raw());
+
+    ByteBuffer dir = os_path_dirname(path);
+    if (os_mkdirp(dir))
+        return;
+    OsTempFile tmp_file;
+    if (os_create_temp_file(dir.raw(), &tmp_file))
+        return;
+    ProgramBinaryHeader header = {format};
+    bool ok = (fwrite(&header, sizeof(header), 1, tmp_file.file) == 1 &&
+            fwrite(binary.raw(), 1, size, tmp_file.file) == (size_t)size);
+    if (fclose(tmp_file.file))
+        ok = false;
+    if (!ok || os_rename_clobber(tmp_file.path.raw(), path.raw()))
+        os_delete(tmp_file.path.raw());
+}
 
 static void init_shader(const char *source, const char *name, GLenum type, GLuint &shader_id) {
     shader_id = glCreateShader(type);
@@ -22,15 +122,27 @@ static void init_shader(const char *source, const char *name, GLenum type, GLuin
 
 ShaderProgram::ShaderProgram(const char *vertex_shader_source,
                              const char *fragment_shader_source,
-                             const char *geometry_shader_source)
+                             const char *geometry_shader_source) :
+    have_shaders(false),
+    have_geometry(false)
 {
+    bool use_binary = program_binary_supported();
+    ByteBuffer binary_path;
+    if (use_binary) {
+        get_program_binary_path(binary_path, vertex_shader_source,
+                fragment_shader_source, geometry_shader_source);
+        program_id = glCreateProgram();
+        if (load_program_binary(program_id, binary_path))
+            return;
+        glDeleteProgram(program_id);
+    }
+
+    have_shaders = true;
     init_shader(vertex_shader_source, "vertex", GL_VERTEX_SHADER, vertex_id);
     init_shader(fragment_shader_source, "fragment", GL_FRAGMENT_SHADER, fragment_id);
     if (geometry_shader_source) {
         init_shader(geometry_shader_source, "geometry", GL_GEOMETRY_SHADER, geometry_id);
         have_geometry = true;
-    } else {
-        have_geometry = false;
     }
 
     program_id = glCreateProgram();
@@ -38,13 +150,18 @@ ShaderProgram::ShaderProgram(const char *vertex_shader_source,
     glAttachShader(program_id, fragment_id);
     if (geometry_shader_source)
         glAttachShader(program_id, geometry_id);
+    if (use_binary)
+        glProgramParameteri(program_id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(program_id);
 
     GLint ok;
     glGetProgramiv(program_id, GL_LINK_STATUS, &ok);
 
-    if (ok)
+    if (ok) {
+        if (use_binary)
+            save_program_binary(program_id, binary_path);
         return;
+    }
 
     GLint error_size;
     glGetProgramiv(program_id, GL_INFO_LOG_LENGTH, &error_size);
@@ -56,15 +173,17 @@ ShaderProgram::ShaderProgram(const char *vertex_shader_source,
 }
 
 ShaderProgram::~ShaderProgram() {
-    if (have_geometry)
-        glDetachShader(program_id, geometry_id);
-    glDetachShader(program_id, fragment_id);
-    glDetachShader(program_id, vertex_id);
-
-    if (have_geometry)
-        glDeleteShader(geometry_id);
-    glDeleteShader(fragment_id);
-    glDeleteShader(vertex_id);
+    if (have_shaders) {
+        if (have_geometry)
+            glDetachShader(program_id, geometry_id);
+        glDetachShader(program_id, fragment_id);
+        glDetachShader(program_id, vertex_id);
+
+        if (have_geometry)
+            glDeleteShader(geometry_id);
+        glDeleteShader(fragment_id);
+        glDeleteShader(vertex_id);
+    }
 
     glDeleteProgram(program_id);
 }
@@ -79,6 +198,11 @@ void ShaderProgram::set_uniform(GLint uniform_id, float value) const
     glUniform1f(uniform_id, value);
 }
 
+void ShaderProgram::set_uniform(GLint uniform_id, const glm::vec2 &value) const
+{
+    glUniform2fv(uniform_id, 1, &value[0]);
+}
+
 void ShaderProgram::set_uniform(GLint uniform_id, const glm::vec3 &value) const
 {
     glUniform3fv(uniform_id, 1, &value[0]);
@@ -99,3 +223,8 @@ void ShaderProgram::set_uniform(GLint uniform_id, const glm::mat3 &value) const
     glUniformMatrix3fv(uniform_id, 1, GL_FALSE, &value[0][0]);
 }
 
+void ShaderProgram::set_uniform(GLint uniform_id, const int *values, int count) const
+{
+    glUniform1iv(uniform_id, count, values);
+}
+
@@ -33,14 +33,18 @@ public:
 
     void set_uniform(GLint uniformId, int value) const;
     void set_uniform(GLint uniformId, float value) const;
+    void set_uniform(GLint uniformId, const glm::vec2 &value) const;
     void set_uniform(GLint uniformId, const glm::vec3 &value) const;
     void set_uniform(GLint uniformId, const glm::vec4 &value) const;
     void set_uniform(GLint uniformId, const glm::mat4 &value) const;
     void set_uniform(GLint uniformId, const glm::mat3 &value) const;
+    void set_uniform(GLint uniformId, const int *values, int count) const;
 
 private:
 
     GLuint program_id;
+    // false when the program came linked from the binary cache
+    bool have_shaders;
     GLuint vertex_id;
     GLuint fragment_id;
 
@@ -2,53 +2,35 @@
 #include "debug_gl.hpp"
 
 ShaderProgramManager::ShaderProgramManager() :
-    _texture_shader_program(R"VERTEX(
+    quad_program(R"VERTEX(
 
 #version 150 core
 
 in vec3 VertexPosition;
-in vec2 TexCoord;
 
-out vec2 FragTexCoord;
-
-uniform mat4 MVP;
-
-void main(void)
-{
-    FragTexCoord = TexCoord;
-    gl_Position = MVP * vec4(VertexPosition, 1.0);
-}
-
-)VERTEX", R"FRAGMENT(
-
-#version 150 core
-
-in vec2 FragTexCoord;
-out vec4 FragColor;
-
-uniform sampler2D Tex;
-
-void main(void)
-{
-    FragColor = texture(Tex, FragTexCoord);
-}
-
-)FRAGMENT", NULL),
-    _text_shader_program(R"VERTEX(
-
-#version 150 core
-
-in vec3 VertexPosition;
-in vec2 TexCoord;
+// one of each per quad
+in mat4 MVP;
+in vec4 ColorTop;
+in vec4 ColorBottom;
+in vec2 Size;
+in vec4 TexCoords01;
+in vec4 TexCoords23;
+in float Mode;
 
 out vec2 FragTexCoord;
+out vec4 FragColorTop;
+out vec4 FragColorBottom;
+out float MixAmt;
+flat out int FragMode;
 
-uniform mat4 MVP;
-
-void main(void)
-{
-    FragTexCoord = TexCoord;
-    gl_Position = MVP * vec4(VertexPosition, 1.0);
+void main(void) {
+    vec4 tex_coords = (gl_VertexID < 2) ? TexCoords01 : TexCoords23;
+    FragTexCoord = (gl_VertexID % 2 == 0) ? tex_coords.xy : tex_coords.zw;
+    FragColorTop = ColorTop;
+    FragColorBottom = ColorBottom;
+    MixAmt = clamp(VertexPosition.y, 0, 1);
+    FragMode = int(Mode);
+    gl_Position = MVP * vec4(VertexPosition.xy * Size, 0.0, 1.0);
 }
 
 )VERTEX", R"FRAGMENT(
@@ -56,130 +38,132 @@ void main(void)
 #version 150 core
 
 in vec2 FragTexCoord;
+in vec4 FragColorTop;
+in vec4 FragColorBottom;
+in float MixAmt;
+flat in int FragMode;
 out vec4 FragColor;
 
 uniform sampler2D Tex;
-uniform vec4 Color;
-
-void main(void)
-{
-    FragColor = vec4(1, 1, 1, texture(Tex, FragTexCoord).r) * Color;
-}
-
-)FRAGMENT", NULL),
-    _primitive_shader_program(R"VERTEX(
-
-#version 150 core
-
-in vec3 VertexPosition;
-
-uniform mat4 MVP;
 
 void main(void) {
-    gl_Position = MVP * vec4(VertexPosition, 1.0);
-}
-
-)VERTEX", R"FRAGMENT(
-
-#version 150 core
-
-out vec4 FragColor;
-
-uniform vec4 Color;
-
-void main(void) {
-    FragColor = Color;
+    vec4 color = FragColorBottom * MixAmt + FragColorTop * (1 - MixAmt);
+    if (FragMode == 1) {
+        color *= texture(Tex, FragTexCoord);
+    } else if (FragMode == 2) {
+        color.a *= texture(Tex, FragTexCoord).a;
+    } else if (FragMode == 3) {
+        color.a *= texture(Tex, FragTexCoord).r;
+    }
+    FragColor = color;
 }
 
 )FRAGMENT", NULL),
-    texture_color_program(R"VERTEX(
+    waveform_program(R"VERTEX(
 
 #version 150 core
 
 in vec3 VertexPosition;
-in vec2 TexCoord;
-
-out vec2 FragTexCoord;
 
 uniform mat4 MVP;
+uniform vec2 Size;
 
-void main(void)
-{
-    FragTexCoord = TexCoord;
-    gl_Position = MVP * vec4(VertexPosition, 1.0);
-}
-
-)VERTEX", R"FRAGMENT(
-
-#version 150 core
-
-in vec2 FragTexCoord;
-out vec4 FragColor;
-
-uniform sampler2D Tex;
-uniform vec4 Color;
-
-void main(void)
-{
-    FragColor = vec4(1, 1, 1, texture(Tex, FragTexCoord).a) * Color;
-}
-
-)FRAGMENT", NULL),
-    gradient_program(R"VERTEX(
-
-#version 150 core
-
-in vec3 VertexPosition;
-out float MixAmt;
-
-uniform mat4 MVP;
+out vec2 FragPos;
 
 void main(void) {
-    MixAmt = clamp(0, VertexPosition.y, 1);
-    gl_Position = MVP * vec4(VertexPosition, 1.0);
+    FragPos = VertexPosition.xy * Size;
+    gl_Position = MVP * vec4(FragPos, 0.0, 1.0);
 }
 
 )VERTEX", R"FRAGMENT(
 
 #version 150 core
 
-in float MixAmt;
+// WAVEFORM_PEAKS_MAX_LEVELS
+const int MAX_LEVELS = 40;
+// WAVEFORM_PEAKS_LEVEL0_FRAMES
+const float LEVEL0_FRAMES = 256.0;
+
+in vec2 FragPos;
 out vec4 FragColor;
 
-uniform vec4 ColorTop;
-uniform vec4 ColorBottom;
+// min, max and rms in rgb. each level is laid out as in WaveformPeaks,
+// interleaved by channel, starting at its offset and wrapping rows.
+uniform sampler2D Peaks;
+uniform int PeaksWidth;
+uniform int ChannelCount;
+uniform int FirstLevel;
+uniform int LevelCount;
+uniform int LevelOffset[MAX_LEVELS];
+// how many of the peaks of each level are uploaded
+uniform int LevelPeakCount[MAX_LEVELS];
+
+uniform vec2 Size;
+uniform float StartFrame;
+uniform float FramesPerPixel;
+uniform vec4 Color;
+uniform vec4 RmsColor;
 
 void main(void) {
-    FragColor = ColorBottom * MixAmt + ColorTop * (1 - MixAmt);
+    // the level where one pixel spans one to two peaks
+    float level0_per_pixel = FramesPerPixel / LEVEL0_FRAMES;
+    int level = int(floor(log2(max(level0_per_pixel, 1.0))));
+    level = clamp(level, FirstLevel, LevelCount - 1);
+    float peak_frames = LEVEL0_FRAMES * exp2(float(level));
+
+    float lane_height = Size.y / float(ChannelCount);
+    int channel = min(int(FragPos.y / lane_height), ChannelCount - 1);
+
+    float start = StartFrame + floor(FragPos.x) * FramesPerPixel;
+    int first = int(start / peak_frames);
+    int last = max(first, int(ceil((start + FramesPerPixel) / peak_frames)) - 1);
+    last = min(last, LevelPeakCount[level] - 1);
+    if (first > last)
+        discard;
+
+    vec3 peak = vec3(1.0, -1.0, 0.0);
+    for (int i = first; i <= last && i < first + 4; i += 1) {
+        int index = LevelOffset[level] + i * ChannelCount + channel;
+        vec3 this_peak = texelFetch(Peaks, ivec2(index % PeaksWidth, index / PeaksWidth), 0).rgb;
+        peak = vec3(min(peak.r, this_peak.r), max(peak.g, this_peak.g), max(peak.b, this_peak.b));
+    }
+
+    // +1 at the top of the lane, -1 at the bottom. at least one pixel of
+    // the envelope shows even where it is flat.
+    float lane_y = FragPos.y - float(channel) * lane_height;
+    float value = 1.0 - 2.0 * lane_y / lane_height;
+    float half_pixel = 1.0 / lane_height;
+    if (value < peak.r - half_pixel || value > peak.g + half_pixel)
+        discard;
+    FragColor = (abs(value) <= peak.b) ? RmsColor : Color;
 }
 
 )FRAGMENT", NULL)
 {
-    _texture_attrib_tex_coord = _texture_shader_program.attrib_location("TexCoord");
-    _texture_attrib_position = _texture_shader_program.attrib_location("VertexPosition");
-    _texture_uniform_mvp = _texture_shader_program.uniform_location("MVP");
-    _texture_uniform_tex = _texture_shader_program.uniform_location("Tex");
-
-    _text_attrib_tex_coord = _text_shader_program.attrib_location("TexCoord");
-    _text_attrib_position = _text_shader_program.attrib_location("VertexPosition");
-    _text_uniform_mvp = _text_shader_program.uniform_location("MVP");
-    _text_uniform_tex = _text_shader_program.uniform_location("Tex");
-    _text_uniform_color = _text_shader_program.uniform_location("Color");
-
-    _primitive_attrib_position = _primitive_shader_program.attrib_location("VertexPosition");
-    _primitive_uniform_mvp = _primitive_shader_program.uniform_location("MVP");
-    _primitive_uniform_color = _primitive_shader_program.uniform_location("Color");
-
-    texture_color_attrib_tex_coord = texture_color_program.attrib_location("TexCoord");
-    texture_color_attrib_position = texture_color_program.attrib_location("VertexPosition");
-    texture_color_uniform_mvp = texture_color_program.uniform_location("MVP");
-    texture_color_uniform_tex = texture_color_program.uniform_location("Tex");
-    texture_color_uniform_color = texture_color_program.uniform_location("Color");
-
-    gradient_attrib_position = gradient_program.attrib_location("VertexPosition");
-    gradient_uniform_mvp = gradient_program.uniform_location("MVP");
-    gradient_uniform_color_top = gradient_program.uniform_location("ColorTop");
-    gradient_uniform_color_bottom = gradient_program.uniform_location("ColorBottom");
+    quad_attrib_position = quad_program.attrib_location("VertexPosition");
+    quad_attrib_mvp = quad_program.attrib_location("MVP");
+    quad_attrib_color_top = quad_program.attrib_location("ColorTop");
+    quad_attrib_color_bottom = quad_program.attrib_location("ColorBottom");
+    quad_attrib_size = quad_program.attrib_location("Size");
+    quad_attrib_tex_coords_01 = quad_program.attrib_location("TexCoords01");
+    quad_attrib_tex_coords_23 = quad_program.attrib_location("TexCoords23");
+    quad_attrib_mode = quad_program.attrib_location("Mode");
+    quad_uniform_tex = quad_program.uniform_location("Tex");
+
+    waveform_attrib_position = waveform_program.attrib_location("VertexPosition");
+    waveform_uniform_mvp = waveform_program.uniform_location("MVP");
+    waveform_uniform_size = waveform_program.uniform_location("Size");
+    waveform_uniform_peaks = waveform_program.uniform_location("Peaks");
+    waveform_uniform_peaks_width = waveform_program.uniform_location("PeaksWidth");
+    waveform_uniform_channel_count = waveform_program.uniform_location("ChannelCount");
+    waveform_uniform_first_level = waveform_program.uniform_location("FirstLevel");
+    waveform_uniform_level_count = waveform_program.uniform_location("LevelCount");
+    waveform_uniform_level_offset = waveform_program.uniform_location("LevelOffset");
+    waveform_uniform_level_peak_count = waveform_program.uniform_location("LevelPeakCount");
+    waveform_uniform_start_frame = waveform_program.uniform_location("StartFrame");
+    waveform_uniform_frames_per_pixel = waveform_program.uniform_location("FramesPerPixel");
+    waveform_uniform_color = waveform_program.uniform_location("Color");
+    waveform_uniform_rms_color = waveform_program.uniform_location("RmsColor");
 
     assert_no_gl_error();
 }
@@ -11,36 +11,36 @@ public:
     ShaderProgramManager(const ShaderProgramManager &copy) = delete;
     ShaderProgramManager &operator=(const ShaderProgramManager &copy) = delete;
 
-    ShaderProgram _texture_shader_program;
-    GLint _texture_attrib_tex_coord;
-    GLint _texture_attrib_position;
-    GLint _texture_uniform_mvp;
-    GLint _texture_uniform_tex;
-
-    ShaderProgram _text_shader_program;
-    GLint _text_attrib_tex_coord;
-    GLint _text_attrib_position;
-    GLint _text_uniform_mvp;
-    GLint _text_uniform_tex;
-    GLint _text_uniform_color;
-
-    ShaderProgram _primitive_shader_program;
-    GLint _primitive_attrib_position;
-    GLint _primitive_uniform_mvp;
-    GLint _primitive_uniform_color;
-
-    ShaderProgram texture_color_program;
-    GLint texture_color_attrib_tex_coord;
-    GLint texture_color_attrib_position;
-    GLint texture_color_uniform_mvp;
-    GLint texture_color_uniform_tex;
-    GLint texture_color_uniform_color;
-
-    ShaderProgram gradient_program;
-    GLint gradient_attrib_position;
-    GLint gradient_uniform_mvp;
-    GLint gradient_uniform_color_top;
-    GLint gradient_uniform_color_bottom;
+    // every 2d quad of the gui, drawn instanced by GuiWindow::flush_quads.
+    // the attributes other than the position are per quad.
+    ShaderProgram quad_program;
+    GLint quad_attrib_position;
+    GLint quad_attrib_mvp;
+    GLint quad_attrib_color_top;
+    GLint quad_attrib_color_bottom;
+    GLint quad_attrib_size;
+    GLint quad_attrib_tex_coords_01;
+    GLint quad_attrib_tex_coords_23;
+    GLint quad_attrib_mode;
+    GLint quad_uniform_tex;
+
+    // the min/max envelope of every channel of a WaveformTexture, all of
+    // it worked out per pixel. one draw per waveform.
+    ShaderProgram waveform_program;
+    GLint waveform_attrib_position;
+    GLint waveform_uniform_mvp;
+    GLint waveform_uniform_size;
+    GLint waveform_uniform_peaks;
+    GLint waveform_uniform_peaks_width;
+    GLint waveform_uniform_channel_count;
+    GLint waveform_uniform_first_level;
+    GLint waveform_uniform_level_count;
+    GLint waveform_uniform_level_offset;
+    GLint waveform_uniform_level_peak_count;
+    GLint waveform_uniform_start_frame;
+    GLint waveform_uniform_frames_per_pixel;
+    GLint waveform_uniform_color;
+    GLint waveform_uniform_rms_color;
 };
 
 #endif
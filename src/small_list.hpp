@@ -0,0 +1,117 @@
+#ifndef SMALL_LIST_HPP
+#define SMALL_LIST_HPP
+
+#include "util.hpp"
+#include "genesis.h"
+
+#include <assert.h>
+#include <string.h>
+
+// like List, but the first N items live inside the list itself, so a short
+// list never touches the heap. meant for small plain types: items are moved
+// with memcpy. there is no pointer into the inline items, so a SmallList can
+// itself be moved with memcpy, as List does with its items.
+template<typename T, int N>
+class SmallList {
+public:
+    SmallList() {
+        _length = 0;
+        _capacity = N;
+        _heap_items = NULL;
+    }
+    ~SmallList() {
+        destroy(_heap_items, 0);
+    }
+
+    int __attribute__((warn_unused_result)) append(T item) {
+        int err = ensure_capacity(_length + 1);
+        if (err)
+            return err;
+        raw()[_length++] = item;
+        return 0;
+    }
+    const T & at(int index) const {
+        assert(index >= 0);
+        assert(index < _length);
+        return raw()[index];
+    }
+    T & at(int index) {
+        assert(index >= 0);
+        assert(index < _length);
+        return raw()[index];
+    }
+    int length() const {
+        return _length;
+    }
+
+    const T & last() const {
+        assert(_length >= 1);
+        return raw()[_length - 1];
+    }
+    T & last() {
+        assert(_length >= 1);
+        return raw()[_length - 1];
+    }
+
+    int __attribute__((warn_unused_result)) resize(int length) {
+        assert(length >= 0);
+        int err = ensure_capacity(length);
+        if (err)
+            return err;
+        _length = length;
+        return 0;
+    }
+
+    T *raw() {
+        return _heap_items ? _heap_items : _inline_items;
+    }
+    const T *raw() const {
+        return _heap_items ? _heap_items : _inline_items;
+    }
+
+    void clear() {
+        _length = 0;
+    }
+
+    int capacity() const {
+        return _capacity;
+    }
+
+    int __attribute__((warn_unused_result)) ensure_capacity(int new_capacity) {
+        if (new_capacity <= _capacity)
+            return 0;
+        int better_capacity = max(_capacity, 16);
+        while (better_capacity < new_capacity)
+            better_capacity = better_capacity * 2;
+        if (_heap_items) {
+            T *new_items = reallocate_safe(_heap_items, _capacity, better_capacity);
+            if (!new_items)
+                return GenesisErrorNoMem;
+            _heap_items = new_items;
+        } else {
+            T *new_items = allocate_nonzero<T>(better_capacity);
+            if (!new_items)
+                return GenesisErrorNoMem;
+            memcpy(new_items, _inline_items, _length * sizeof(T));
+            _heap_items = new_items;
+        }
+        _capacity = better_capacity;
+        return 0;
+    }
+
+    // only what is on the heap
+    int allocated_size() const {
+        return _heap_items ? (_capacity * sizeof(T)) : 0;
+    }
+
+private:
+    T _inline_items[N];
+    T *_heap_items;
+    int _length;
+    int _capacity;
+
+    SmallList(const SmallList &other) = delete;
+    SmallList& operator= (const SmallList &other) = delete;
+};
+
+#endif
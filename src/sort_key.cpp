@@ -3,44 +3,88 @@
 
 #include <string.h>
 
-SortKey::SortKey() : magnitude(0) { }
+SortKey::SortKey() :
+    magnitude(0),
+    digit_count(0),
+    heap_digits(nullptr),
+    heap_capacity(0)
+{
+    memset(inline_digits, 0, INLINE_DIGIT_COUNT);
+}
 
-SortKey::SortKey(int value) {
+SortKey::SortKey(int value) : SortKey() {
     assert(value >= 0 && value < 256);
-    if (value == 0) {
-        magnitude = 0;
-    } else {
+    if (value != 0) {
         magnitude = 1;
-        ok_or_panic(digits.append(value));
+        resize_digits(1);
+        set_digit(0, value);
     }
 }
 
-SortKey::SortKey(const SortKey &other) {
+SortKey::SortKey(const SortKey &other) : SortKey() {
     *this = other;
 }
 
 SortKey& SortKey::operator= (const SortKey& other) {
     if (this != &other) {
-        ok_or_panic(digits.resize(other.digits.length()));
-        memcpy(digits.raw(), other.digits.raw(), digits.length());
+        resize_digits(other.digit_count);
+        memcpy(inline_digits, other.inline_digits, INLINE_DIGIT_COUNT);
+        if (other.is_long())
+            memcpy(heap_digits, other.heap_digits, other.digit_count - INLINE_DIGIT_COUNT);
         magnitude = other.magnitude;
     }
     return *this;
 }
 
+void SortKey::resize_digits(int count) {
+    assert(count >= 0);
+    int heap_count = count - INLINE_DIGIT_COUNT;
+    if (heap_count > heap_capacity) {
+        heap_digits = reallocate(heap_digits, heap_capacity, heap_count);
+        heap_capacity = heap_count;
+    }
+    for (int i = digit_count; i < count; i += 1)
+        set_digit(i, 0);
+    for (int i = count; i < digit_count && i < INLINE_DIGIT_COUNT; i += 1)
+        inline_digits[i] = 0;
+    digit_count = count;
+}
+
+void SortKey::remove_leading_digits(int count) {
+    for (int i = 0; i + count < digit_count; i += 1)
+        set_digit(i, digit(i + count));
+    resize_digits(digit_count - count);
+}
+
+void SortKey::insert_leading_zeros(int count) {
+    int old_count = digit_count;
+    resize_digits(old_count + count);
+    for (int i = old_count - 1; i >= 0; i -= 1)
+        set_digit(i + count, digit(i));
+    for (int i = 0; i < count; i += 1)
+        set_digit(i, 0);
+}
+
 int SortKey::compare(const SortKey &a, const SortKey &b) {
     if (a.magnitude > b.magnitude)
         return 1;
     else if (a.magnitude < b.magnitude)
         return -1;
 
-    int cmp = memcmp(a.digits.raw(), b.digits.raw(), min(a.digits.length(), b.digits.length()));
+    int cmp = memcmp(a.inline_digits, b.inline_digits, INLINE_DIGIT_COUNT);
     if (cmp != 0)
         return cmp;
 
-    if (a.digits.length() > b.digits.length())
+    if (a.is_long() && b.is_long()) {
+        cmp = memcmp(a.heap_digits, b.heap_digits,
+                min(a.digit_count, b.digit_count) - INLINE_DIGIT_COUNT);
+        if (cmp != 0)
+            return cmp;
+    }
+
+    if (a.digit_count > b.digit_count)
         return 1;
-    else if (a.digits.length() < b.digits.length())
+    else if (a.digit_count < b.digit_count)
         return -1;
     else
         return 0;
@@ -84,6 +128,10 @@ void SortKey::multi(List<SortKey> &out_sort_key_list,
     }
 }
 
+void SortKey::rebalance(List<SortKey> &out_sort_key_list, int count) {
+    multi(out_sort_key_list, nullptr, nullptr, count);
+}
+
 void SortKey::multi_recurse(List<SortKey> &out_sort_key_list,
         const SortKey *low_value, const SortKey *high_value,
         int low_index, int high_index)
@@ -98,7 +146,8 @@ void SortKey::multi_recurse(List<SortKey> &out_sort_key_list,
 }
 
 void SortKey::truncate_fraction(SortKey &value) {
-    value.digits.remove_range(value.magnitude, value.digits.length());
+    if (value.digit_count > value.magnitude)
+        value.resize_digits(value.magnitude);
 }
 
 SortKey SortKey::increment(const SortKey &value) {
@@ -113,10 +162,10 @@ SortKey SortKey::average(const SortKey &low, const SortKey &high) {
     SortKey b_padded = high;
     pad_to_equal_magnitude(a_padded, b_padded);
     int b_carry = 0;
-    int max_digit_length = max(a_padded.digits.length(), b_padded.digits.length());
+    int max_digit_length = max(a_padded.digit_count, b_padded.digit_count);
     for (int i = 0; i < max_digit_length || b_carry > 0; i += 1) {
-        int a_value =            (i < a_padded.digits.length()) ? a_padded.digits.at(i) : 0;
-        int b_value = b_carry + ((i < b_padded.digits.length()) ? b_padded.digits.at(i) : 0);
+        int a_value =            (i < a_padded.digit_count) ? a_padded.digit(i) : 0;
+        int b_value = b_carry + ((i < b_padded.digit_count) ? b_padded.digit(i) : 0);
         if (a_value == b_value)
             continue;
         if (a_value == b_value - 1) {
@@ -128,13 +177,12 @@ SortKey SortKey::average(const SortKey &low, const SortKey &high) {
         // half the distance floored is sure to be a positive single digit.
         SortKey half_distance;
         half_distance.magnitude = a_padded.magnitude;
-        for (int j = 0; j < i; j += 1)
-            ok_or_panic(half_distance.digits.append(0));
+        half_distance.resize_digits(i + 1);
         int half_distance_value = (b_value - a_value) / 2;
-        ok_or_panic(half_distance.digits.append(half_distance_value));
+        half_distance.set_digit(i, half_distance_value);
         // truncate insignificant digits of a
-        if (i + 1 < a_padded.digits.length())
-            a_padded.digits.remove_range(i + 1, a_padded.digits.length());
+        if (i + 1 < a_padded.digit_count)
+            a_padded.resize_digits(i + 1);
         return add(a_padded, half_distance);
     }
     panic("unreachable");
@@ -147,21 +195,20 @@ SortKey SortKey::add(const SortKey &a, const SortKey &b) {
     SortKey result;
     result.magnitude = a_padded.magnitude;
     int value = 0;
-    List<uint8_t> result_digits;
-    for (int i = max(a_padded.digits.length(), b_padded.digits.length()) - 1; i >= 0; i -= 1) {
-        value += (i < a_padded.digits.length()) ? a_padded.digits.at(i) : 0;
-        value += (i < b_padded.digits.length()) ? b_padded.digits.at(i) : 0;
-        ok_or_panic(result_digits.append(value % 256));
+    result.resize_digits(max(a_padded.digit_count, b_padded.digit_count));
+    for (int i = result.digit_count - 1; i >= 0; i -= 1) {
+        value += (i < a_padded.digit_count) ? a_padded.digit(i) : 0;
+        value += (i < b_padded.digit_count) ? b_padded.digit(i) : 0;
+        result.set_digit(i, value % 256);
         value /= 256;
     }
     // overflow up to more digits
     while (value > 0) {
-        ok_or_panic(result_digits.append(value % 256));
+        result.insert_leading_zeros(1);
+        result.set_digit(0, value % 256);
         value /= 256;
         result.magnitude += 1;
     }
-    for (int i = result_digits.length() - 1; i >= 0; i -= 1)
-        ok_or_panic(result.digits.append(result_digits.at(i)));
     result.normalize();
     return result;
 }
@@ -176,31 +223,29 @@ void SortKey::pad_in_place(SortKey &sort_key, int magnitude) {
     if (amount_to_add <= 0)
         return;
 
-    ok_or_panic(sort_key.digits.insert_space(0, amount_to_add));
-    for (int i = 0; i < amount_to_add; i += 1)
-        sort_key.digits.at(i) = 0;
+    sort_key.insert_leading_zeros(amount_to_add);
     sort_key.magnitude += amount_to_add;
 }
 
 void SortKey::normalize() {
-    for (int i = 0; i < digits.length(); i += 1) {
-        if (digits.at(i) != 0) {
+    for (int i = 0; i < digit_count; i += 1) {
+        if (digit(i) != 0) {
             int amt = min(i, magnitude);
             magnitude -= amt;
-            digits.remove_range(0, amt);
+            remove_leading_digits(amt);
             return;
         }
     }
     magnitude = 0;
-    ok_or_panic(digits.resize(0));
+    resize_digits(0);
 }
 
 void SortKey::serialize(ByteBuffer &buf) const {
     buf.append_uint32be(magnitude);
-    buf.append_uint32be(digits.length());
-    for (int i = 0; i < digits.length(); i += 1) {
-        buf.append_uint8(digits.at(i));
-    }
+    buf.append_uint32be(digit_count);
+    buf.append((const char *)inline_digits, min(digit_count, INLINE_DIGIT_COUNT));
+    if (is_long())
+        buf.append((const char *)heap_digits, digit_count - INLINE_DIGIT_COUNT);
 }
 
 int SortKey::deserialize(const ByteBuffer &buffer, int *offset) {
@@ -212,13 +257,14 @@ int SortKey::deserialize(const ByteBuffer &buffer, int *offset) {
     int len = read_uint32be(buffer.raw() + *offset);
     *offset += 4;
 
-    if (digits.resize(len))
-        return GenesisErrorNoMem;
-
-    if (buffer.length() - *offset < len)
+    if (len < 0 || buffer.length() - *offset < len)
         return GenesisErrorInvalidFormat;
 
-    memcpy(digits.raw(), buffer.raw() + *offset, len);
+    resize_digits(len);
+    const char *src = buffer.raw() + *offset;
+    memcpy(inline_digits, src, min(len, INLINE_DIGIT_COUNT));
+    if (is_long())
+        memcpy(heap_digits, src + INLINE_DIGIT_COUNT, len - INLINE_DIGIT_COUNT);
     *offset += len;
 
     return 0;
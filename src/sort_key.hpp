@@ -6,16 +6,29 @@
 
 class SortKey {
 public:
+    // keys this many digits long or shorter need no heap allocation
+    static const int INLINE_DIGIT_COUNT = 15;
+
     SortKey& operator= (const SortKey& other);
     SortKey(const SortKey &other);
-    ~SortKey() { }
+    ~SortKey() {
+        destroy(heap_digits, 0);
+    }
 
     static SortKey single(const SortKey *low, const SortKey *high);
     static void multi(List<SortKey> &out_sort_key_list, const SortKey *low, const SortKey *high, int count);
     static int compare(const SortKey &a, const SortKey &b);
+    // count short, evenly spread keys in order. use them in place of keys
+    // which grew long from one insert after another between the same two.
+    static void rebalance(List<SortKey> &out_sort_key_list, int count);
+
+    // true when the digits spilled out of the inline storage
+    bool is_long() const {
+        return digit_count > INLINE_DIGIT_COUNT;
+    }
 
     int allocated_size() const {
-        return digits.allocated_size();
+        return heap_capacity;
     }
 
     void serialize(ByteBuffer &buf) const;
@@ -27,7 +40,27 @@ public:
 private:
 
     int magnitude;
-    List<uint8_t> digits;
+    int digit_count;
+    // the first digits. the ones past digit_count are zero so that keys of
+    // the same magnitude are compared with one memcmp.
+    uint8_t inline_digits[INLINE_DIGIT_COUNT];
+    // the digits after the inline ones
+    uint8_t *heap_digits;
+    int heap_capacity;
+
+    uint8_t digit(int index) const {
+        return (index < INLINE_DIGIT_COUNT) ? inline_digits[index] : heap_digits[index - INLINE_DIGIT_COUNT];
+    }
+    void set_digit(int index, uint8_t value) {
+        if (index < INLINE_DIGIT_COUNT)
+            inline_digits[index] = value;
+        else
+            heap_digits[index - INLINE_DIGIT_COUNT] = value;
+    }
+    // new digits are zero
+    void resize_digits(int count);
+    void remove_leading_digits(int count);
+    void insert_leading_zeros(int count);
 
     void normalize();
     static SortKey average(const SortKey &low, const SortKey &high);
@@ -43,4 +76,3 @@ private:
 };
 
 #endif
-
@@ -15,8 +15,9 @@ struct SpritesheetImage {
     float anchor_x;
     float anchor_y;
     bool r90;
-    GLuint vertex_buffer;
-    GLuint tex_coord_buffer;
+    // of the corners of a width by height quad, in the order of the rect
+    // vertexes of StaticGeometry
+    float tex_coords[4][2];
     Spritesheet *spritesheet;
 };
 
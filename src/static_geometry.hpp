@@ -9,7 +9,6 @@ public:
     ~StaticGeometry();
 
     GLuint _rect_2d_vertex_buffer;
-    GLuint _rect_2d_tex_coord_buffer;
 
 
 private:
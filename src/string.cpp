@@ -1,6 +1,11 @@
 #include "string.hpp"
 #include "unicode.hpp"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define GENESIS_STRING_SSE2
+#endif
+
 static void assert_no_err(int err) {
     if (err)
         panic("%s", genesis_strerror(err));
@@ -216,79 +221,164 @@ void String::append(String s) {
     }
 }
 
-int String::compare(const String &a, const String &b) {
-    for (int i = 0;; i += 1) {
-        bool a_end = (i >= a.length());
-        bool b_end = (i >= b.length());
-        if (a_end) {
-            if (b_end)
-                return 0;
-            else
-                return -1;
-        } else if (b_end) {
-            return 1;
-        } else {
-            if (a.at(i) > b.at(i))
-                return 1;
-            else if (a.at(i) < b.at(i))
-                return -1;
-            else
-                continue;
-        }
-    }
+static const uint32_t case_block_mask = (1 << UNICODE_CASE_BLOCK_SHIFT) - 1;
+
+static inline const UnicodeCaseDelta *case_delta(uint32_t c) {
+    uint32_t block = c >> UNICODE_CASE_BLOCK_SHIFT;
+    if (block >= (uint32_t)array_length(unicode_case_blocks))
+        return &unicode_case_deltas[0];
+    uint32_t index = ((uint32_t)unicode_case_blocks[block] << UNICODE_CASE_BLOCK_SHIFT) | (c & case_block_mask);
+    return &unicode_case_deltas[unicode_case_indexes[index]];
 }
 
-int String::compare_insensitive(const String &a, const String &b) {
-    for (int i = 0;; i += 1) {
-        bool a_end = (i >= a.length());
-        bool b_end = (i >= b.length());
-        if (a_end) {
-            if (b_end) {
-                return 0;
-            } else {
-                return -1;
-            }
-        } else if (b_end) {
-            return 1;
-        } else {
-            uint32_t a_lower = char_to_lower(a.at(i));
-            uint32_t b_lower = char_to_lower(b.at(i));
-            if (a_lower > b_lower)
-                return 1;
-            else if (a_lower < b_lower)
-                return -1;
-            else
-                continue;
-        }
+uint32_t String::char_to_lower(uint32_t c) {
+    if (c < 0x80)
+        return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+    return c + case_delta(c)->lower;
+}
+
+uint32_t String::char_to_upper(uint32_t c) {
+    if (c < 0x80)
+        return (c >= 'a' && c <= 'z') ? c - ('a' - 'A') : c;
+    return c + case_delta(c)->upper;
+}
+
+bool String::is_whitespace(uint32_t c) {
+    if (c < 0x80)
+        return c == ' ' || (c >= '\t' && c <= '\r');
+    for (int i = 0; i < array_length(whitespace); i+= 1) {
+        if (c == whitespace[i])
+            return true;
     }
+    return false;
 }
 
-void String::make_lower_case() {
-    for (int i = 0; i < _chars.length(); i += 1) {
-        _chars.at(i) = char_to_lower(_chars.at(i));
+#if defined(GENESIS_STRING_SSE2)
+static inline bool sse2_is_ascii(__m128i chars) {
+    __m128i high = _mm_and_si128(chars, _mm_set1_epi32(~0x7f));
+    return _mm_movemask_epi8(_mm_cmpeq_epi32(high, _mm_setzero_si128())) == 0xffff;
+}
+
+// adds offset to the ascii codepoints from first to last
+static inline __m128i sse2_shift_ascii_range(__m128i chars, int first, int last, int offset) {
+    __m128i in_range = _mm_and_si128(_mm_cmpgt_epi32(chars, _mm_set1_epi32(first - 1)),
+            _mm_cmplt_epi32(chars, _mm_set1_epi32(last + 1)));
+    return _mm_add_epi32(chars, _mm_and_si128(in_range, _mm_set1_epi32(offset)));
+}
+
+static inline __m128i sse2_ascii_to_lower(__m128i chars) {
+    return sse2_shift_ascii_range(chars, 'A', 'Z', 'a' - 'A');
+}
+#endif
+
+// the first index at which a and b differ, or count
+static int first_difference(const uint32_t *a, const uint32_t *b, int count) {
+    int i = 0;
+#if defined(GENESIS_STRING_SSE2)
+    for (; i + 4 <= count; i += 4) {
+        __m128i a_chars = _mm_loadu_si128((const __m128i *)&a[i]);
+        __m128i b_chars = _mm_loadu_si128((const __m128i *)&b[i]);
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi32(a_chars, b_chars));
+        if (mask != 0xffff)
+            return i + __builtin_ctz(~mask) / 4;
     }
+#endif
+    for (; i < count; i += 1) {
+        if (a[i] != b[i])
+            return i;
+    }
+    return count;
 }
 
-void String::make_upper_case() {
-    for (int i = 0; i < _chars.length(); i += 1) {
-        _chars.at(i) = char_to_upper(_chars.at(i));
+// runs of ascii, which is most of what gets sorted and searched, are
+// compared four at a time; the rest goes through the case tables
+static int first_difference_insensitive(const uint32_t *a, const uint32_t *b, int count) {
+    int i = 0;
+#if defined(GENESIS_STRING_SSE2)
+    for (; i + 4 <= count; i += 4) {
+        __m128i a_chars = _mm_loadu_si128((const __m128i *)&a[i]);
+        __m128i b_chars = _mm_loadu_si128((const __m128i *)&b[i]);
+        if (sse2_is_ascii(_mm_or_si128(a_chars, b_chars))) {
+            int mask = _mm_movemask_epi8(_mm_cmpeq_epi32(sse2_ascii_to_lower(a_chars),
+                        sse2_ascii_to_lower(b_chars)));
+            if (mask != 0xffff)
+                return i + __builtin_ctz(~mask) / 4;
+            continue;
+        }
+        for (int j = i; j < i + 4; j += 1) {
+            if (String::char_to_lower(a[j]) != String::char_to_lower(b[j]))
+                return j;
+        }
+    }
+#endif
+    for (; i < count; i += 1) {
+        if (String::char_to_lower(a[i]) != String::char_to_lower(b[i]))
+            return i;
     }
+    return count;
 }
 
-uint32_t String::char_to_lower(uint32_t c) {
-    return (c < array_length(unicode_characters)) ? unicode_characters[c].lower : c;
+static int compare_lengths(int a_length, int b_length) {
+    if (a_length < b_length)
+        return -1;
+    else if (a_length > b_length)
+        return 1;
+    else
+        return 0;
 }
 
-uint32_t String::char_to_upper(uint32_t c) {
-    return (c < array_length(unicode_characters)) ? unicode_characters[c].upper : c;
+int String::compare(const String &a, const String &b) {
+    int length = min(a.length(), b.length());
+    int i = first_difference(a._chars.raw(), b._chars.raw(), length);
+    if (i < length)
+        return (a.at(i) > b.at(i)) ? 1 : -1;
+    return compare_lengths(a.length(), b.length());
 }
 
-bool String::is_whitespace(uint32_t c) {
-    for (int i = 0; i < array_length(whitespace); i+= 1) {
-        if (c == whitespace[i])
-            return true;
+int String::compare_insensitive(const String &a, const String &b) {
+    int length = min(a.length(), b.length());
+    int i = first_difference_insensitive(a._chars.raw(), b._chars.raw(), length);
+    if (i < length)
+        return (char_to_lower(a.at(i)) > char_to_lower(b.at(i))) ? 1 : -1;
+    return compare_lengths(a.length(), b.length());
+}
+
+void String::make_lower_case() {
+    uint32_t *chars = _chars.raw();
+    int i = 0;
+#if defined(GENESIS_STRING_SSE2)
+    for (; i + 4 <= _chars.length(); i += 4) {
+        __m128i block = _mm_loadu_si128((const __m128i *)&chars[i]);
+        if (sse2_is_ascii(block)) {
+            _mm_storeu_si128((__m128i *)&chars[i], sse2_ascii_to_lower(block));
+            continue;
+        }
+        for (int j = i; j < i + 4; j += 1)
+            chars[j] = char_to_lower(chars[j]);
+    }
+#endif
+    for (; i < _chars.length(); i += 1) {
+        chars[i] = char_to_lower(chars[i]);
+    }
+}
+
+void String::make_upper_case() {
+    uint32_t *chars = _chars.raw();
+    int i = 0;
+#if defined(GENESIS_STRING_SSE2)
+    for (; i + 4 <= _chars.length(); i += 4) {
+        __m128i block = _mm_loadu_si128((const __m128i *)&chars[i]);
+        if (sse2_is_ascii(block)) {
+            _mm_storeu_si128((__m128i *)&chars[i], sse2_shift_ascii_range(block, 'a', 'z', 'A' - 'a'));
+            continue;
+        }
+        for (int j = i; j < i + 4; j += 1)
+            chars[j] = char_to_upper(chars[j]);
+    }
+#endif
+    for (; i < _chars.length(); i += 1) {
+        chars[i] = char_to_upper(chars[i]);
     }
-    return false;
 }
 
 void String::split_on_whitespace(List<String> &out) const {
@@ -307,13 +397,17 @@ void String::split_on_whitespace(List<String> &out) const {
 }
 
 off_t String::index_of_insensitive(const String &search) const {
-    off_t upper_bound = _chars.length() - search._chars.length() + 1;
+    // fold the search once instead of at every position
+    String lower_search = search;
+    lower_search.make_lower_case();
+    const uint32_t *chars = _chars.raw();
+    const uint32_t *search_chars = lower_search._chars.raw();
+    int search_length = lower_search.length();
+    off_t upper_bound = _chars.length() - search_length + 1;
     for (off_t i = 0; i < upper_bound; i += 1) {
         bool all_ok = true;
-        for (int inner = 0; inner < search._chars.length(); inner += 1) {
-            uint32_t lower_a = char_to_lower(_chars.at(i + inner));
-            uint32_t lower_b = char_to_lower(search.at(inner));
-            if (lower_a != lower_b) {
+        for (int inner = 0; inner < search_length; inner += 1) {
+            if (char_to_lower(chars[i + inner]) != search_chars[inner]) {
                 all_ok = false;
                 break;
             }
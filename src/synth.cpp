@@ -1,131 +1,271 @@
 #include "synth.hpp"
 
-static const float PI = 3.14159265358979323846;
+#include "dsp_kernels.hpp"
+#include "node_template.hpp"
 
-struct SynthNoteState {
+static const double PI = 3.14159265358979323846;
+
+// a sine has no partials to alias, so one table serves every pitch
+static const int SYNTH_TABLE_BITS = 11;
+static const int SYNTH_TABLE_SIZE = 1 << SYNTH_TABLE_BITS;
+static const int SYNTH_MAX_VOICES = 64;
+// voices are mixed in mono in chunks of this many frames, then copied to
+// every channel
+static const int SYNTH_CHUNK_FRAME_COUNT = 256;
+static const double SYNTH_ATTACK_SECONDS = 0.005;
+static const double SYNTH_RELEASE_SECONDS = 0.05;
+
+enum SynthVoiceStage {
+    SynthVoiceStageAttack,
+    SynthVoiceStageSustain,
+    SynthVoiceStageRelease,
+    SynthVoiceStageDone,
+};
+
+struct SynthVoice {
+    int note;
+    SynthVoiceStage stage;
+    // the envelope ramps level to velocity, holds it, then ramps it to 0
     float velocity;
-    float seconds_offset;
+    float level;
+    uint32_t phase;
+    // orders voices by age, for stealing
+    long serial;
 };
 
-struct SynthContext {
-    float seconds_offset;
-    SynthNoteState notes_on[GENESIS_NOTES_COUNT];
+struct SynthContext : NodeTemplate {
+    typedef EventsInPort<0> EventsIn;
+    typedef AudioOutPort<1> AudioOut;
+    typedef NodePorts<EventsIn, AudioOut> Ports;
+    static const NodePortSpec PORT_SPECS[Ports::COUNT];
+    static const bool HAS_SEEK = true;
+
+    int create(GenesisNode *node);
+    void run(GenesisNode *node);
+    void seek(GenesisNode *node);
+
+    // only the voices that are sounding, in no particular order
+    SynthVoice voices[SYNTH_MAX_VOICES];
+    int voice_count;
+    long next_serial;
     float pitch;
+    // the frame the next block starts at, on the same timeline as the
+    // events' start times
+    int frame_pos;
+    float table[SYNTH_TABLE_SIZE + 1];
+    float mix[SYNTH_CHUNK_FRAME_COUNT];
 };
 
-static void synth_destroy(struct GenesisNode *node) {
-    SynthContext *synth_context = (SynthContext*)node->userdata;
-    destroy(synth_context, 1);
-}
+const NodePortSpec SynthContext::PORT_SPECS[] = {
+    {"events_in", SoundIoChannelLayoutIdMono, false, -1, false, -1, -1},
+    {"audio_out", SoundIoChannelLayoutIdMono, false, -1, false, -1, -1},
+};
 
-static int synth_create(struct GenesisNode *node) {
-    SynthContext *synth_context = create_zero<SynthContext>();
-    node->userdata = synth_context;
-    if (!node->userdata) {
-        synth_destroy(node);
-        return GenesisErrorNoMem;
-    }
+int SynthContext::create(struct GenesisNode *) {
+    for (int i = 0; i < SYNTH_TABLE_SIZE; i += 1)
+        table[i] = sin(2.0 * PI * i / SYNTH_TABLE_SIZE);
+    table[SYNTH_TABLE_SIZE] = table[0];
     return 0;
 }
 
-static void synth_seek(struct GenesisNode *node) {
-    // do nothing
+void SynthContext::seek(struct GenesisNode *node) {
+    frame_pos = genesis_whole_notes_to_frames(node->descriptor->pipeline,
+            node->timestamp, AudioOut(node).sample_rate());
+    voice_count = 0;
 }
 
-static void synth_run(struct GenesisNode *node) {
-    struct SynthContext *synth_context = (struct SynthContext*)node->userdata;
-    struct GenesisPort *events_in_port = genesis_node_port(node, 0);
-    struct GenesisPort *audio_out_port = genesis_node_port(node, 1);
+// the voice already playing note, or a free one, or the one that will be
+// missed least: the quietest releasing voice, else the oldest
+static SynthVoice *get_voice(SynthContext *synth_context, int note) {
+    for (int i = 0; i < synth_context->voice_count; i += 1) {
+        if (synth_context->voices[i].note == note)
+            return &synth_context->voices[i];
+    }
+    SynthVoice *voice;
+    if (synth_context->voice_count < SYNTH_MAX_VOICES) {
+        voice = &synth_context->voices[synth_context->voice_count++];
+        voice->phase = 0;
+        voice->level = 0.0f;
+    } else {
+        voice = &synth_context->voices[0];
+        for (int i = 1; i < SYNTH_MAX_VOICES; i += 1) {
+            SynthVoice *other = &synth_context->voices[i];
+            bool releasing = voice->stage == SynthVoiceStageRelease;
+            bool other_releasing = other->stage == SynthVoiceStageRelease;
+            if (other_releasing != releasing ? other_releasing :
+                    (releasing ? other->level < voice->level : other->serial < voice->serial))
+            {
+                voice = other;
+            }
+        }
+    }
+    voice->note = note;
+    voice->serial = synth_context->next_serial++;
+    return voice;
+}
 
-    int event_count;
-    double time_available;
-    // TODO compute time_requested instead of hardcoding 999.0
-    genesis_events_in_port_fill_count(events_in_port, 999.0, &event_count, &time_available);
-    GenesisMidiEvent *event = genesis_events_in_port_read_ptr(events_in_port);
-    for (int i = 0; i < event_count; i += 1) {
-        switch (event->event_type) {
-            case GenesisMidiEventTypeNoteOn:
-                {
-                    SynthNoteState *note_state = &synth_context->notes_on[event->data.note_data.note];
-                    note_state->velocity = event->data.note_data.velocity;
-                    note_state->seconds_offset = 0.0f;
-                    break;
-                }
-            case GenesisMidiEventTypeNoteOff:
-                synth_context->notes_on[event->data.note_data.note].velocity = 0.0f;
+static void synth_apply_event(SynthContext *synth_context, const GenesisMidiEvent *event) {
+    switch (event->event_type) {
+        case GenesisMidiEventTypeNoteOn:
+            {
+                // retriggering a voice ramps from where it is rather than
+                // jumping
+                SynthVoice *voice = get_voice(synth_context, event->data.note_data.note);
+                voice->velocity = event->data.note_data.velocity;
+                voice->stage = SynthVoiceStageAttack;
                 break;
-            case GenesisMidiEventTypePitch:
-                synth_context->pitch = event->data.pitch_data.pitch;
+            }
+        case GenesisMidiEventTypeNoteOff:
+            for (int i = 0; i < synth_context->voice_count; i += 1) {
+                SynthVoice *voice = &synth_context->voices[i];
+                if (voice->note == event->data.note_data.note && voice->stage != SynthVoiceStageDone)
+                    voice->stage = SynthVoiceStageRelease;
+            }
+            break;
+        case GenesisMidiEventTypePitch:
+            synth_context->pitch = event->data.pitch_data.pitch;
+            break;
+    }
+}
+
+static uint32_t phase_increment(SynthContext *synth_context, int note, int frame_rate) {
+    // 69 is A 440
+    double pitch = (synth_context->pitch != 0.0f) ?
+        (440.0 * pow(2.0, (note - 69.0) / 12.0 + synth_context->pitch)) :
+        genesis_midi_note_to_pitch(note);
+    return (uint32_t)(pitch / frame_rate * 4294967296.0);
+}
+
+// adds count frames of voice to mix, stepping its envelope
+static void render_voice(SynthContext *synth_context, SynthVoice *voice, float *mix, int count,
+        int frame_rate)
+{
+    float attack_step = 1.0 / (SYNTH_ATTACK_SECONDS * frame_rate);
+    float release_step = 1.0 / (SYNTH_RELEASE_SECONDS * frame_rate);
+    uint32_t increment = phase_increment(synth_context, voice->note, frame_rate);
+    int frame = 0;
+    while (frame < count && voice->stage != SynthVoiceStageDone) {
+        int stage_frame_count = count - frame;
+        float step = 0.0f;
+        float target = voice->level;
+        if (voice->stage == SynthVoiceStageAttack) {
+            if (voice->level == voice->velocity) {
+                voice->stage = SynthVoiceStageSustain;
+                continue;
+            }
+            step = (voice->level < voice->velocity) ? attack_step : -release_step;
+            target = voice->velocity;
+        } else if (voice->stage == SynthVoiceStageRelease) {
+            if (voice->level <= 0.0f) {
+                voice->stage = SynthVoiceStageDone;
                 break;
+            }
+            step = -release_step;
+            target = 0.0f;
         }
-        event += 1;
+        if (step != 0.0f)
+            stage_frame_count = min(stage_frame_count, (int)ceilf((target - voice->level) / step));
+        dsp_wavetable_add(mix + frame, synth_context->table, SYNTH_TABLE_BITS, &voice->phase,
+                increment, voice->level, step, stage_frame_count);
+        voice->level += step * stage_frame_count;
+        if ((step > 0.0f && voice->level >= target) || (step < 0.0f && voice->level <= target))
+            voice->level = target;
+        frame += stage_frame_count;
     }
-    genesis_events_in_port_advance_read_ptr(events_in_port, event_count, time_available);
-
-    int output_frame_count = genesis_audio_out_port_free_count(audio_out_port);
-    int bytes_per_frame = genesis_audio_port_bytes_per_frame(audio_out_port);
-
-    float float_sample_rate = genesis_audio_port_sample_rate(audio_out_port);
-    float seconds_per_frame = 1.0f / float_sample_rate;
-
-    float *write_ptr_start = genesis_audio_out_port_write_ptr(audio_out_port);
-    // clear everything to 0
-    memset(write_ptr_start, 0, output_frame_count * bytes_per_frame);
-
-    const SoundIoChannelLayout *channel_layout = genesis_audio_port_channel_layout(audio_out_port);
-    for (int note = 0; note < GENESIS_NOTES_COUNT; note += 1) {
-        SynthNoteState *note_state = &synth_context->notes_on[note];
-        float note_value = note_state->velocity;
-        if (note_value == 0.0f)
-            continue;
-
-        float *ptr = write_ptr_start;
-
-        // 69 is A 440
-        float pitch = (synth_context->pitch != 0.0f) ?
-            (440.0f * powf(2.0f, (note - 69.0f) / 12.0f + synth_context->pitch)) :
-            genesis_midi_note_to_pitch(note);
-        float radians_per_second = pitch * 2.0f * PI;
-        for (int frame = 0; frame < output_frame_count; frame += 1) {
-            float sample = sinf((note_state->seconds_offset + frame * seconds_per_frame) * radians_per_second);
-            for (int channel = 0; channel < channel_layout->channel_count; channel += 1) {
-                *ptr += sample * note_value;
+}
+
+// frames [frame_start, frame_end) of write_ptr get every voice
+struct SynthRender {
+    template<int ChannelCount>
+    static void run(SynthContext *synth_context, float *write_ptr, int channel_count,
+            int frame_rate, int frame_start, int frame_end);
+};
+
+template<int ChannelCount>
+void SynthRender::run(SynthContext *synth_context, float *write_ptr, int channel_count,
+        int frame_rate, int frame_start, int frame_end)
+{
+    channel_count = node_template_channel_count<ChannelCount>(channel_count);
+    for (int chunk_start = frame_start; chunk_start < frame_end; chunk_start += SYNTH_CHUNK_FRAME_COUNT) {
+        int chunk_frame_count = min(SYNTH_CHUNK_FRAME_COUNT, frame_end - chunk_start);
+        float *mix = synth_context->mix;
+        memset(mix, 0, chunk_frame_count * sizeof(float));
+        for (int i = 0; i < synth_context->voice_count;) {
+            SynthVoice *voice = &synth_context->voices[i];
+            render_voice(synth_context, voice, mix, chunk_frame_count, frame_rate);
+            if (voice->stage == SynthVoiceStageDone)
+                *voice = synth_context->voices[--synth_context->voice_count];
+            else
+                i += 1;
+        }
+        float *ptr = write_ptr + chunk_start * channel_count;
+        for (int frame = 0; frame < chunk_frame_count; frame += 1) {
+            for (int channel = 0; channel < channel_count; channel += 1) {
+                *ptr = mix[frame];
                 ptr += 1;
             }
         }
-        note_state->seconds_offset += seconds_per_frame * output_frame_count;
     }
+}
 
-    genesis_audio_out_port_advance_write_ptr(audio_out_port, output_frame_count);
+// the frame of the block an event lands on. late events land on the first.
+static int event_frame(SynthContext *synth_context, GenesisPipeline *pipeline,
+        const GenesisMidiEvent *event, int frame_rate)
+{
+    int frame = genesis_whole_notes_to_frames(pipeline, event->start, frame_rate);
+    return max(0, frame - synth_context->frame_pos);
 }
 
-int create_synth_descriptor(GenesisPipeline *pipeline) {
-    GenesisNodeDescriptor *node_descr = genesis_create_node_descriptor(pipeline, 2, "synth", "A single oscillator");
-    if (!node_descr) {
-        genesis_node_descriptor_destroy(node_descr);
-        return GenesisErrorNoMem;
-    }
+// each event takes effect on the frame its start time falls on. frames are
+// only made as far as the events are accounted for.
+void SynthContext::run(struct GenesisNode *node) {
+    SynthContext *synth_context = this;
+    struct GenesisPipeline *pipeline = node->descriptor->pipeline;
+    EventsIn events_in(node);
+    AudioOut audio_out(node);
 
-    genesis_node_descriptor_set_run_callback(node_descr, synth_run);
-    genesis_node_descriptor_set_create_callback(node_descr, synth_create);
-    genesis_node_descriptor_set_destroy_callback(node_descr, synth_destroy);
-    genesis_node_descriptor_set_seek_callback(node_descr, synth_seek);
+    int output_frame_count = audio_out.free_count();
+    int frame_rate = audio_out.sample_rate();
 
-    struct GenesisPortDescriptor *events_port = genesis_node_descriptor_create_port(
-            node_descr, 0, GenesisPortTypeEventsIn, "events_in");
-    struct GenesisPortDescriptor *audio_port = genesis_node_descriptor_create_port(
-            node_descr, 1, GenesisPortTypeAudioOut, "audio_out");
+    int frame_at_start = synth_context->frame_pos;
+    int event_count;
+    int frame_count = events_in.fill_frames(frame_at_start, output_frame_count, frame_rate, &event_count);
 
-    if (!events_port || !audio_port) {
-        genesis_node_descriptor_destroy(node_descr);
-        return GenesisErrorNoMem;
+    GenesisMidiEvent *event = events_in.read_ptr();
+    // events past the block stay queued
+    bool any_event = event_count > 0 && event_frame(synth_context, pipeline, event, frame_rate) < frame_count;
+    if (synth_context->voice_count == 0 && !any_event) {
+        events_in.advance_frames(0, frame_at_start, frame_count, frame_rate);
+        synth_context->frame_pos += frame_count;
+        audio_out.write_silence(frame_count);
+        return;
     }
 
-    genesis_audio_port_descriptor_set_channel_layout(audio_port,
-        soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono), false, -1);
+    int channel_count = audio_out.channel_count();
+    float *write_ptr = audio_out.write_ptr();
+
+    int event_index = 0;
+    int frame = 0;
+    while (frame < frame_count) {
+        int segment_end = frame_count;
+        for (; event_index < event_count; event_index += 1) {
+            int frame_of_event = event_frame(synth_context, pipeline, &event[event_index], frame_rate);
+            if (frame_of_event > frame) {
+                segment_end = min(frame_of_event, frame_count);
+                break;
+            }
+            synth_apply_event(synth_context, &event[event_index]);
+        }
+        node_template_for_channels<SynthRender>(channel_count, synth_context, write_ptr, channel_count,
+                frame_rate, frame, segment_end);
+        frame = segment_end;
+    }
+    events_in.advance_frames(event_index, frame_at_start, frame_count, frame_rate);
 
-    genesis_audio_port_descriptor_set_sample_rate(audio_port,
-            genesis_pipeline_get_sample_rate(pipeline), false, -1);
+    synth_context->frame_pos += frame_count;
+    audio_out.advance(frame_count);
+}
 
-    return 0;
+int create_synth_descriptor(GenesisPipeline *pipeline) {
+    return node_template_create_descriptor<SynthContext>(pipeline, "synth", "A single oscillator", nullptr);
 }
@@ -55,7 +55,7 @@ void TabWidget::draw(const glm::mat4 &projection) {
             gui_window->fill_rect(tab_border_color, projection * tab->left_line_model);
             gui_window->fill_rect(tab_border_color, projection * tab->right_line_model);
             gui_window->fill_rect(tab_border_color, projection * tab->top_line_model);
-            tab->label->draw(projection * tab->label_model, tab_text_color);
+            tab->label->draw(gui_window, projection * tab->label_model, tab_text_color);
         }
     }
 
@@ -169,6 +169,7 @@ void TabWidget::add_widget(Widget *widget, const String &title) {
 }
 
 void TabWidget::update_model() {
+    queue_redraw();
     show_tab_bar = !auto_hide || tabs.length() >= 2;
     if (show_tab_bar) {
         widget_top = padding_top + tab_height;
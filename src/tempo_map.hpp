@@ -0,0 +1,121 @@
+#ifndef TEMPO_MAP_HPP
+#define TEMPO_MAP_HPP
+
+#include "genesis.h"
+#include "list.hpp"
+
+// the tempo of a map with no changes
+static const double TEMPO_MAP_DEFAULT_WHOLE_NOTES_PER_MINUTE = 140.0;
+
+// converts between positions in whole notes and seconds from the start of
+// the timeline. each tempo change starts a segment in which the tempo is
+// constant, and the seconds at the start of every segment are worked out
+// when the map is set, so a conversion is a binary search over the
+// segments and a multiply. seconds do not depend on the sample rate, so
+// one table does for every frame rate.
+// before the first change the tempo is that of the first change.
+// not thread safe; only change it while nothing converts with it.
+class TempoMap {
+public:
+    TempoMap() {}
+    ~TempoMap() {}
+
+    // changes must be in order of whole_note, with the first at 0.
+    // no changes goes back to TEMPO_MAP_DEFAULT_WHOLE_NOTES_PER_MINUTE.
+    // the map is unchanged if this returns an error.
+    int __attribute__((warn_unused_result)) set(const GenesisTempoChange *changes, int change_count) {
+        if (change_count < 0 || (change_count > 0 && changes[0].whole_note != 0.0))
+            return GenesisErrorInvalidParam;
+        for (int i = 0; i < change_count; i += 1) {
+            if (!(changes[i].whole_notes_per_minute > 0.0))
+                return GenesisErrorInvalidParam;
+            if (i > 0 && !(changes[i].whole_note > changes[i - 1].whole_note))
+                return GenesisErrorInvalidParam;
+        }
+        if (_segments.resize(change_count))
+            return GenesisErrorNoMem;
+        double seconds = 0.0;
+        for (int i = 0; i < change_count; i += 1) {
+            Segment *segment = &_segments.at(i);
+            if (i > 0) {
+                Segment *prev = &_segments.at(i - 1);
+                seconds += (changes[i].whole_note - prev->whole_note) / prev->whole_notes_per_second;
+            }
+            segment->whole_note = changes[i].whole_note;
+            segment->seconds = seconds;
+            segment->whole_notes_per_second = changes[i].whole_notes_per_minute / 60.0;
+        }
+        return 0;
+    }
+
+    int change_count() const {
+        return _segments.length();
+    }
+
+    GenesisTempoChange change_at(int index) const {
+        GenesisTempoChange change;
+        change.whole_note = _segments.at(index).whole_note;
+        change.whole_notes_per_minute = _segments.at(index).whole_notes_per_second * 60.0;
+        return change;
+    }
+
+    double whole_notes_per_minute_at(double whole_note) const {
+        if (_segments.length() == 0)
+            return TEMPO_MAP_DEFAULT_WHOLE_NOTES_PER_MINUTE;
+        return _segments.at(find_whole_note(whole_note)).whole_notes_per_second * 60.0;
+    }
+
+    double whole_notes_to_seconds(double whole_notes) const {
+        if (_segments.length() == 0)
+            return whole_notes / (TEMPO_MAP_DEFAULT_WHOLE_NOTES_PER_MINUTE / 60.0);
+        const Segment *segment = &_segments.at(find_whole_note(whole_notes));
+        return segment->seconds + (whole_notes - segment->whole_note) / segment->whole_notes_per_second;
+    }
+
+    double seconds_to_whole_notes(double seconds) const {
+        if (_segments.length() == 0)
+            return seconds * (TEMPO_MAP_DEFAULT_WHOLE_NOTES_PER_MINUTE / 60.0);
+        const Segment *segment = &_segments.at(find_seconds(seconds));
+        return segment->whole_note + (seconds - segment->seconds) * segment->whole_notes_per_second;
+    }
+
+private:
+    struct Segment {
+        double whole_note;
+        double seconds;
+        double whole_notes_per_second;
+    };
+    List<Segment> _segments;
+
+    // the last segment that starts at or before whole_note, or the first
+    int find_whole_note(double whole_note) const {
+        int start = 0;
+        int end = _segments.length();
+        while (end - start > 1) {
+            int middle = start + (end - start) / 2;
+            if (_segments.at(middle).whole_note <= whole_note)
+                start = middle;
+            else
+                end = middle;
+        }
+        return start;
+    }
+
+    int find_seconds(double seconds) const {
+        int start = 0;
+        int end = _segments.length();
+        while (end - start > 1) {
+            int middle = start + (end - start) / 2;
+            if (_segments.at(middle).seconds <= seconds)
+                start = middle;
+            else
+                end = middle;
+        }
+        return start;
+    }
+
+    TempoMap(const TempoMap &copy) = delete;
+    TempoMap &operator=(const TempoMap &copy) = delete;
+};
+
+#endif
@@ -38,6 +38,10 @@ TextWidget::TextWidget(GuiWindow *gui_window) :
     _cursor_start(0),
     _cursor_end(0),
     _select_down(false),
+    _sel_left(0),
+    _sel_top(0),
+    _sel_width(0),
+    _sel_height(0),
     _have_focus(false),
     _scroll_x(0),
     _placeholder_label(gui),
@@ -71,32 +75,15 @@ void TextWidget::draw(const glm::mat4 &projection) {
     glm::mat4 label_mvp = projection * _label_model;
     if (_text_interaction_on) {
         if (_placeholder_label.text().length() > 0 && _label.text().length() == 0)
-            _placeholder_label.draw(label_mvp, _placeholder_color);
+            _placeholder_label.draw(gui_window, label_mvp, _placeholder_color);
     }
 
-    glEnable(GL_STENCIL_TEST);
-
-    glStencilFunc(GL_ALWAYS, 1, 0xFF);
-    glStencilOp(GL_KEEP, GL_REPLACE, GL_REPLACE);
-    glStencilMask(0xFF);
-
-    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-    glClear(GL_STENCIL_BUFFER_BIT);
-
-    gui_window->fill_rect(glm::vec4(1.0f, 1.0f, 1.0f, 1.0f),
-            left + label_start_x(), top + label_start_y(),
-            label_area_width(), _label.height());
-
-    glStencilFunc(GL_EQUAL, 1, 0xFF);
-    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-
-    _label.draw(label_mvp, _text_color);
-
-    glStencilFunc(GL_ALWAYS, 1, 0xFF);
-    glStencilOp(GL_KEEP, GL_REPLACE, GL_REPLACE);
-    glStencilMask(0xFF);
-
-    glClear(GL_STENCIL_BUFFER_BIT);
+    int label_left = left + label_start_x();
+    int label_top = top + label_start_y();
+    gui_window->set_scissor(label_left, label_top, label_area_width(), _label.height());
+    // long text only draws what shows
+    _label.draw(gui_window, label_mvp, _text_color, _scroll_x, _scroll_x + label_area_width());
+    gui_window->clear_scissor();
 
     if (_text_interaction_on && _have_focus && _cursor_start != -1 && _cursor_end != -1) {
         if (_cursor_start == _cursor_end) {
@@ -109,18 +96,19 @@ void TextWidget::draw(const glm::mat4 &projection) {
             glm::mat4 sel_mvp = projection * _sel_model;
             gui_window->fill_rect(_selection_color, sel_mvp);
 
-            glStencilFunc(GL_EQUAL, 1, 0xFF);
-            glStencilMask(0x00);
-
-            _label.draw(label_mvp, _sel_text_color);
+            // the selected text again over it, in the selected color
+            int clip_top = max(label_top, _sel_top);
+            int clip_bottom = min(label_top + _label.height(), _sel_top + _sel_height);
+            gui_window->set_scissor(_sel_left, clip_top, _sel_width, clip_bottom - clip_top);
+            int sel_x = _sel_left - label_left + _scroll_x;
+            _label.draw(gui_window, label_mvp, _sel_text_color, sel_x, sel_x + _sel_width);
+            gui_window->clear_scissor();
         }
     }
-
-    glDisable(GL_STENCIL_TEST);
-
 }
 
 void TextWidget::update_model() {
+    queue_redraw();
     if (_icon_img) {
         float scale_x = ((float)_icon_size_w) / ((float)_icon_img->width);
         float scale_y = ((float)_icon_size_h) / ((float)_icon_img->height);
@@ -267,10 +255,14 @@ void TextWidget::update_selection_model() {
         start_x = max(0, start_x);
         end_x = min(label_area_width(), end_x);
         int sel_width = end_x - start_x;
+        _sel_left = left + label_start_x() + start_x;
+        _sel_top = top + _padding_top;
+        _sel_width = sel_width;
+        _sel_height = sel_height;
         _sel_model = glm::scale(
                         glm::translate(
                             glm::mat4(1.0f),
-                            glm::vec3(left + label_start_x() + start_x, top + _padding_top, 0.0f)),
+                            glm::vec3(_sel_left, _sel_top, 0.0f)),
                         glm::vec3(sel_width, sel_height, 1.0f));
     }
 }
@@ -572,6 +564,7 @@ void TextWidget::set_text(const String &text) {
         _label.set_text(text);
         _label.update();
         set_selection(_cursor_start, _cursor_end);
+        queue_redraw();
         if (_auto_size)
             on_size_hints_changed();
     }
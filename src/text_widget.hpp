@@ -132,6 +132,11 @@ public:
     bool _select_down;
 
     glm::mat4 _sel_model;
+    // _sel_model in window pixels, to clip the selected text to
+    int _sel_left;
+    int _sel_top;
+    int _sel_width;
+    int _sel_height;
     glm::mat4 _cursor_model;
 
     bool _have_focus;
@@ -37,24 +37,6 @@ void Texture::send_pixels(const ByteBuffer &pixels, int width, int height) {
 }
 
 void Texture::draw(GuiWindow *window, const glm::mat4 &mvp) {
-    _gui->_shader_program_manager._texture_shader_program.bind();
-
-    _gui->_shader_program_manager._texture_shader_program.set_uniform(
-            _gui->_shader_program_manager._texture_uniform_tex, 0);
-
-    _gui->_shader_program_manager._texture_shader_program.set_uniform(
-            _gui->_shader_program_manager._texture_uniform_mvp, mvp);
-
-    glBindBuffer(GL_ARRAY_BUFFER, _gui->_static_geometry._rect_2d_vertex_buffer);
-    glEnableVertexAttribArray(_gui->_shader_program_manager._texture_attrib_position);
-    glVertexAttribPointer(_gui->_shader_program_manager._texture_attrib_position, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-
-    glBindBuffer(GL_ARRAY_BUFFER, _gui->_static_geometry._rect_2d_tex_coord_buffer);
-    glEnableVertexAttribArray(_gui->_shader_program_manager._texture_attrib_tex_coord);
-    glVertexAttribPointer(_gui->_shader_program_manager._texture_attrib_tex_coord, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, _texture_id);
-
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glm::vec4 white(1.0f, 1.0f, 1.0f, 1.0f);
+    window->draw_quad(GuiQuadModeTexture, _texture_id, mvp, 1.0f, 1.0f, nullptr, white, white);
 }
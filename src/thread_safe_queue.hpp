@@ -4,6 +4,7 @@
 #include "error.h"
 #include "util.hpp"
 #include "atomics.hpp"
+#include "os.hpp"
 
 #include <linux/futex.h>
 #include <sys/time.h>
@@ -27,8 +28,11 @@ static inline int futex_wake(int *address, int count) {
     return futex(address, FUTEX_WAKE, count, nullptr, nullptr, 0) ? errno : 0;
 }
 
+static const int thread_safe_queue_default_spin_count = 2000;
+
 // many writer, many reader, fixed size, thread-safe, first-in-first-out queue
-// lock-free except when a reader calls dequeue() and queue is empty, then it blocks
+// lock-free except when a reader calls dequeue() and queue is empty, then it
+// spins for a while and then blocks.
 // must call resize before you can start using it
 // size must be at least equal to the combined number of producers and consumers
 template<typename T>
@@ -38,6 +42,9 @@ public:
         _items = nullptr;
         _size = 0;
         _allocated_size = 0;
+        // with a single cpu the producer can't run while we spin
+        _max_spin_count = (os_concurrency() > 1) ? thread_safe_queue_default_spin_count : 0;
+        _spin_estimate = 0;
     }
     ~ThreadSafeQueue() {
         destroy(_items, _allocated_size);
@@ -63,10 +70,26 @@ public:
         _read_index = 0;
         _write_index = 0;
         _modulus_flag.clear();
+        _spin_estimate = 0;
 
         return 0;
     }
 
+    // the most times dequeue() polls an empty queue before sleeping in the
+    // kernel. dequeue() adapts the actual count to how long items usually
+    // take to arrive, up to this limit. 0 disables spinning, which is the
+    // default on single cpu systems.
+    // this method not thread safe
+    void set_spin_count(int max_spin_count) {
+        assert(max_spin_count >= 0);
+        _max_spin_count = max_spin_count;
+        _spin_estimate = 0;
+    }
+
+    int spin_count() const {
+        return _max_spin_count;
+    }
+
     // put an item on the queue. panics if you attempt to put an item into a
     // full queue. thread-safe.
     void enqueue(T item) {
@@ -84,6 +107,7 @@ public:
     // if the queue has 4 items and 8 threads try to dequeue at the same time,
     // 4 threads will block and 4 threads will return queue items.
     T dequeue() {
+        spin_until_nonempty();
         for (;;) {
             int my_avail_count = _avail_count.fetch_sub(1);
             int my_queue_count = _queue_count.fetch_sub(1);
@@ -114,22 +138,20 @@ public:
     // try to get an item from the queue. item is set to the value, or NULL
     // if no item was returned from the queue.
     void try_dequeue(T *item) {
-        _avail_count -= 1;
-        int my_queue_count = _queue_count.fetch_sub(1);
-        if (my_queue_count > 0) {
-            int my_read_index = _read_index.fetch_add(1);
-            int in_bounds_index = my_read_index % _size;
-            perform_index_modulus();
-            *item = _items[in_bounds_index];
-        } else {
+        if (!try_take(item))
             *item = nullptr;
+    }
 
-            _queue_count += 1;
-            int my_avail_count = _avail_count.fetch_add(1);
-            if (my_avail_count < -1) {
-                futex_wake(reinterpret_cast<int*>(&_avail_count), _size);
-            }
-        }
+    // get up to max_count items from the queue into items, returning how many.
+    // blocks like dequeue() until at least one item is available, then takes
+    // whatever else is queued without blocking. thread-safe.
+    int dequeue_many(T *items, int max_count) {
+        assert(max_count > 0);
+        items[0] = dequeue();
+        int count = 1;
+        while (count < max_count && try_take(&items[count]))
+            count += 1;
+        return count;
     }
 
     // wakes up all blocking dequeue() operations. thread-safe.
@@ -150,6 +172,47 @@ private:
     atomic_int _read_index;
     atomic_int _write_index;
     atomic_flag _modulus_flag;
+    int _max_spin_count;
+    // racy running average of how many spins it took for an item to show up;
+    // a lost update only makes the next spin a little longer or shorter.
+    atomic_int _spin_estimate;
+
+    bool try_take(T *item) {
+        _avail_count -= 1;
+        int my_queue_count = _queue_count.fetch_sub(1);
+        if (my_queue_count > 0) {
+            int my_read_index = _read_index.fetch_add(1);
+            int in_bounds_index = my_read_index % _size;
+            perform_index_modulus();
+            *item = _items[in_bounds_index];
+            return true;
+        }
+
+        _queue_count += 1;
+        int my_avail_count = _avail_count.fetch_add(1);
+        if (my_avail_count < -1) {
+            futex_wake(reinterpret_cast<int*>(&_avail_count), _size);
+        }
+        return false;
+    }
+
+    // items tend to arrive in bursts, so it's cheaper to poll for a short
+    // while than to pay for a futex sleep and wake. same adaptive scheme as
+    // glibc's PTHREAD_MUTEX_ADAPTIVE_NP.
+    void spin_until_nonempty() {
+        if (_max_spin_count <= 0 || _queue_count.load(std::memory_order_relaxed) > 0)
+            return;
+        int estimate = _spin_estimate.load(std::memory_order_relaxed);
+        int limit = min(_max_spin_count, estimate * 2 + 10);
+        int spins = 0;
+        while (spins < limit) {
+            cpu_relax();
+            spins += 1;
+            if (_queue_count.load(std::memory_order_relaxed) > 0)
+                break;
+        }
+        _spin_estimate.store(estimate + (spins - estimate) / 8, std::memory_order_relaxed);
+    }
 
     void perform_index_modulus() {
         // keep the index values in check
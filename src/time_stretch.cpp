@@ -0,0 +1,723 @@
+#include "time_stretch.hpp"
+#include "fft.hpp"
+#include "dsp_kernels.hpp"
+#include "util.hpp"
+
+static const double PI = 3.14159265358979323846;
+// the frames overlapped are the first power of two frames at least this
+// long. draft frames overlap by half, and high quality ones by three
+// quarters, which a phase vocoder needs to keep its phases coherent.
+static const double DRAFT_FRAME_SECONDS = 0.02;
+static const double HIGH_FRAME_SECONDS = 0.04;
+static const int DRAFT_OVERLAP = 2;
+static const int HIGH_OVERLAP = 4;
+// the squares of hann windows a quarter of their length apart sum to this
+static const double HANN_SQUARED_QUARTER_SUM = 1.5;
+// draft segments are found this far, as a fraction of a frame, either side
+// of their place, at first every fourth frame and then every frame around
+// the best of those
+static const int DRAFT_SEARCH_DIVISOR = 8;
+static const int DRAFT_COARSE_STEP = 4;
+
+// the node's params glide to new values over this long
+static const double GLIDE_SECONDS = 0.02;
+static const int PARAM_STRETCH = 0;
+static const int PARAM_PITCH = 1;
+
+struct TimeStretch {
+    GenesisTimeStretchQuality quality;
+    int channel_count;
+    const DspChannelKernels *kernels;
+    double stretch;
+    double pitch;
+
+    // frames of frame_size are overlapped synthesis_hop apart, which is
+    // frame_size / overlap
+    int frame_size;
+    int overlap;
+    int synthesis_hop;
+    // draft only. how far from its place a segment may be taken
+    int search_radius;
+    // hann. for the high quality, synthesis_window is the same scaled so
+    // that the overlapped products of the two sum to 1.
+    float *window;
+    float *synthesis_window;
+
+    // one span of in_capacity frames per channel. in_base is the index of
+    // the first in the input, counting from the first frame after a reset.
+    // the frames before that are silence, of which silence_owed are still
+    // to come. in_skip of the frames to come, first of the silence and then
+    // of the input, are passed over, because no frame needs them.
+    float *in;
+    int in_capacity;
+    int in_count;
+    long in_base;
+    long silence_owed;
+    long in_skip;
+    // the most frames of input a hop looks at, from the first it keeps
+    int in_span;
+    // draft only. the sum of the channels of in, which the search compares
+    float *mix;
+
+    // where the next frame is taken from, in input frames, and where the
+    // last one was
+    double analysis_pos;
+    long last_start;
+    bool have_last;
+
+    // draft only. the running sums of the squares of the frames searched,
+    // 2 * search_radius + synthesis_hop + 1
+    double *energy;
+
+    // high quality only
+    Fft *fft;
+    int bin_count;
+    // frame_size each
+    float *frame;
+    float *work;
+    // bin_count each
+    float *re;
+    float *im;
+    float *power;
+    float *peak_angle;
+    int *peaks;
+    // per channel, bin_count each. the spectrum of the last frame, and the
+    // angle each of its bins was rotated by
+    float *last_re;
+    float *last_im;
+    float *rotation;
+
+    // one span of acc_capacity frames per channel. the frames are overlapped
+    // here; those before acc_done are whole, and the rest partly summed.
+    // read_pos is where the next output frame is read.
+    float *acc;
+    int acc_capacity;
+    int acc_done;
+    double read_pos;
+};
+
+static int frame_size_for(int sample_rate, GenesisTimeStretchQuality quality) {
+    double seconds = (quality == GenesisTimeStretchQualityHigh) ? HIGH_FRAME_SECONDS : DRAFT_FRAME_SECONDS;
+    int frame_size = 64;
+    while (frame_size < sample_rate * seconds)
+        frame_size *= 2;
+    return frame_size;
+}
+
+// an output frame is whole once the last frame over it, which starts at
+// most at it, is in, and the frames after it that reads interpolate
+static int lookahead_for(int frame_size, int search_radius, GenesisTimeStretchQuality quality) {
+    return frame_size + search_radius + (quality == GenesisTimeStretchQualityHigh ? 2 : 1);
+}
+
+static double wrap_phase(double angle) {
+    return angle - 2.0 * PI * floor(angle / (2.0 * PI) + 0.5);
+}
+
+void time_stretch_destroy(TimeStretch *ts) {
+    if (!ts)
+        return;
+    int channel_count = ts->channel_count;
+    destroy(ts->window, ts->frame_size);
+    destroy(ts->synthesis_window, ts->frame_size);
+    destroy(ts->in, channel_count * ts->in_capacity);
+    destroy(ts->mix, ts->in_capacity);
+    destroy(ts->energy, 2 * ts->search_radius + ts->synthesis_hop + 1);
+    fft_destroy(ts->fft);
+    destroy(ts->frame, ts->frame_size);
+    destroy(ts->work, ts->frame_size);
+    destroy(ts->re, ts->bin_count);
+    destroy(ts->im, ts->bin_count);
+    destroy(ts->power, ts->bin_count);
+    destroy(ts->peak_angle, ts->bin_count);
+    destroy(ts->peaks, ts->bin_count);
+    destroy(ts->last_re, channel_count * ts->bin_count);
+    destroy(ts->last_im, channel_count * ts->bin_count);
+    destroy(ts->rotation, channel_count * ts->bin_count);
+    destroy(ts->acc, channel_count * ts->acc_capacity);
+    destroy(ts, 1);
+}
+
+int time_stretch_create(int sample_rate, int channel_count, GenesisTimeStretchQuality quality,
+        TimeStretch **out_time_stretch)
+{
+    *out_time_stretch = nullptr;
+    TimeStretch *ts = create_zero<TimeStretch>();
+    if (!ts)
+        return GenesisErrorNoMem;
+    bool high = (quality == GenesisTimeStretchQualityHigh);
+    ts->quality = quality;
+    ts->channel_count = channel_count;
+    ts->kernels = dsp_channel_kernels(channel_count);
+    ts->stretch = 1.0;
+    ts->pitch = 1.0;
+    ts->frame_size = frame_size_for(sample_rate, quality);
+    ts->overlap = high ? HIGH_OVERLAP : DRAFT_OVERLAP;
+    ts->synthesis_hop = ts->frame_size / ts->overlap;
+    ts->search_radius = high ? 0 : ts->frame_size / DRAFT_SEARCH_DIVISOR;
+    // the search looks back to where the last segment left off, which is up
+    // to an analysis hop behind
+    double max_analysis_hop = ts->synthesis_hop / (TIME_STRETCH_MIN_STRETCH * TIME_STRETCH_MIN_PITCH);
+    ts->in_span = ts->frame_size + 2 * ts->search_radius + (high ? 0 : (int)ceil(max_analysis_hop)) + 2;
+    ts->in_capacity = 2 * ts->in_span;
+    // the frame being added and the few before it that reads interpolate
+    ts->acc_capacity = ts->frame_size + 8;
+
+    int frame_size = ts->frame_size;
+    ts->window = allocate_nonzero<float>(frame_size);
+    ts->in = allocate_zero<float>(channel_count * ts->in_capacity);
+    ts->acc = allocate_zero<float>(channel_count * ts->acc_capacity);
+    if (!ts->window || !ts->in || !ts->acc) {
+        time_stretch_destroy(ts);
+        return GenesisErrorNoMem;
+    }
+    for (int i = 0; i < frame_size; i += 1)
+        ts->window[i] = 0.5 - 0.5 * cos(2.0 * PI * i / frame_size);
+
+    if (high) {
+        int err;
+        if ((err = fft_create(frame_size, &ts->fft))) {
+            time_stretch_destroy(ts);
+            return err;
+        }
+        int bin_count = fft_bin_count(ts->fft);
+        ts->bin_count = bin_count;
+        ts->synthesis_window = allocate_nonzero<float>(frame_size);
+        ts->frame = allocate_nonzero<float>(frame_size);
+        ts->work = allocate_nonzero<float>(frame_size);
+        ts->re = allocate_nonzero<float>(bin_count);
+        ts->im = allocate_nonzero<float>(bin_count);
+        ts->power = allocate_nonzero<float>(bin_count);
+        ts->peak_angle = allocate_nonzero<float>(bin_count);
+        ts->peaks = allocate_nonzero<int>(bin_count);
+        ts->last_re = allocate_zero<float>(channel_count * bin_count);
+        ts->last_im = allocate_zero<float>(channel_count * bin_count);
+        ts->rotation = allocate_zero<float>(channel_count * bin_count);
+        if (!ts->synthesis_window || !ts->frame || !ts->work || !ts->re || !ts->im || !ts->power ||
+            !ts->peak_angle || !ts->peaks || !ts->last_re || !ts->last_im || !ts->rotation)
+        {
+            time_stretch_destroy(ts);
+            return GenesisErrorNoMem;
+        }
+        for (int i = 0; i < frame_size; i += 1)
+            ts->synthesis_window[i] = ts->window[i] / HANN_SQUARED_QUARTER_SUM;
+    } else {
+        ts->mix = allocate_zero<float>(ts->in_capacity);
+        ts->energy = allocate_nonzero<double>(2 * ts->search_radius + ts->synthesis_hop + 1);
+        if (!ts->mix || !ts->energy) {
+            time_stretch_destroy(ts);
+            return GenesisErrorNoMem;
+        }
+    }
+
+    time_stretch_reset(ts);
+    *out_time_stretch = ts;
+    return 0;
+}
+
+void time_stretch_reset(TimeStretch *ts) {
+    // the first frames are taken from before the input, where it is
+    // silent, so that every frame which overlaps output frame 0 is in by
+    // the time it is read, and it lands on input frame 0
+    double analysis_hop = ts->synthesis_hop / (ts->stretch * ts->pitch);
+    ts->analysis_pos = -ts->frame_size / 2 - (ts->overlap - 1) * analysis_hop;
+    ts->have_last = false;
+    ts->in_base = (long)floor(ts->analysis_pos) - ts->search_radius;
+    ts->in_count = 0;
+    ts->silence_owed = -ts->in_base;
+    ts->in_skip = 0;
+
+    memset(ts->acc, 0, ts->channel_count * ts->acc_capacity * sizeof(float));
+    ts->acc_done = 0;
+    ts->read_pos = (ts->overlap - 1) * ts->synthesis_hop + ts->frame_size / 2;
+    if (ts->rotation)
+        memset(ts->rotation, 0, ts->channel_count * ts->bin_count * sizeof(float));
+}
+
+void time_stretch_set_ratios(TimeStretch *ts, double stretch, double pitch) {
+    ts->stretch = clamp(TIME_STRETCH_MIN_STRETCH, stretch, TIME_STRETCH_MAX_STRETCH);
+    ts->pitch = clamp(TIME_STRETCH_MIN_PITCH, pitch, TIME_STRETCH_MAX_PITCH);
+}
+
+int time_stretch_lookahead(const TimeStretch *ts) {
+    return lookahead_for(ts->frame_size, ts->search_radius, ts->quality);
+}
+
+// the first input frame the next hop looks at
+static long input_keep_from(const TimeStretch *ts) {
+    long from = (long)floor(ts->analysis_pos) - ts->search_radius;
+    // the search compares with what followed the last segment
+    if (ts->search_radius > 0 && ts->have_last)
+        from = min(from, ts->last_start + ts->synthesis_hop);
+    return from;
+}
+
+// one past the last input frame the next hop looks at
+static long hop_input_end(const TimeStretch *ts) {
+    return (long)floor(ts->analysis_pos) + ts->search_radius + ts->frame_size;
+}
+
+static void discard_input(TimeStretch *ts) {
+    long drop = input_keep_from(ts) - ts->in_base;
+    if (drop <= 0)
+        return;
+    if (drop >= ts->in_count) {
+        ts->in_skip += drop - ts->in_count;
+        ts->in_base += drop;
+        ts->in_count = 0;
+        return;
+    }
+    int keep_count = ts->in_count - drop;
+    for (int ch = 0; ch < ts->channel_count; ch += 1) {
+        float *in = ts->in + ch * ts->in_capacity;
+        memmove(in, in + drop, keep_count * sizeof(float));
+    }
+    if (ts->mix)
+        memmove(ts->mix, ts->mix + drop, keep_count * sizeof(float));
+    ts->in_base += drop;
+    ts->in_count = keep_count;
+}
+
+// frames of input which fit, once those no hop needs are gone when the
+// buffer is past half full
+static int input_room(TimeStretch *ts) {
+    if (ts->in_capacity - ts->in_count < ts->in_span)
+        discard_input(ts);
+    return ts->in_capacity - ts->in_count;
+}
+
+static void mix_input(TimeStretch *ts, int frame_count) {
+    if (!ts->mix)
+        return;
+    float *mix = ts->mix + ts->in_count;
+    memcpy(mix, ts->in + ts->in_count, frame_count * sizeof(float));
+    for (int ch = 1; ch < ts->channel_count; ch += 1)
+        dsp_mix_add(mix, ts->in + ch * ts->in_capacity + ts->in_count, frame_count);
+}
+
+// the start within the search radius of nominal where the segment's
+// first synthesis_hop frames are most like the ones which followed the
+// last segment, by normalized cross correlation of the channels' sum
+static long best_overlap(TimeStretch *ts, long nominal) {
+    int hop = ts->synthesis_hop;
+    int candidate_count = 2 * ts->search_radius + 1;
+    const float *reference = ts->mix + (ts->last_start + hop - ts->in_base);
+    const float *candidates = ts->mix + (nominal - ts->search_radius - ts->in_base);
+    double *energy = ts->energy;
+    energy[0] = 0.0;
+    for (int i = 0; i < candidate_count + hop - 1; i += 1)
+        energy[i + 1] = energy[i] + (double)candidates[i] * candidates[i];
+
+    auto score = [&](int offset) -> double {
+        double candidate_energy = energy[offset + hop] - energy[offset];
+        return dsp_dot_product(reference, candidates + offset, hop) / sqrt(candidate_energy + 1e-9);
+    };
+    // ties keep the segment where it is
+    int best = ts->search_radius;
+    double best_score = score(best);
+    for (int offset = 0; offset < candidate_count; offset += DRAFT_COARSE_STEP) {
+        double offset_score = score(offset);
+        if (offset_score > best_score) {
+            best = offset;
+            best_score = offset_score;
+        }
+    }
+    int coarse = best;
+    int fine_end = min(candidate_count - 1, coarse + DRAFT_COARSE_STEP - 1);
+    for (int offset = max(0, coarse - DRAFT_COARSE_STEP + 1); offset <= fine_end; offset += 1) {
+        double offset_score = score(offset);
+        if (offset_score > best_score) {
+            best = offset;
+            best_score = offset_score;
+        }
+    }
+    return nominal - ts->search_radius + best;
+}
+
+static long overlap_hop(TimeStretch *ts, long nominal) {
+    long start = ts->have_last ? best_overlap(ts, nominal) : nominal;
+    for (int ch = 0; ch < ts->channel_count; ch += 1) {
+        const float *in = ts->in + ch * ts->in_capacity + (start - ts->in_base);
+        float *acc = ts->acc + ch * ts->acc_capacity + ts->acc_done;
+        dsp_multiply_add(acc, in, ts->window, ts->frame_size);
+    }
+    return start;
+}
+
+// finds the peaks of the spectrum in re and im, and the angle that rotates
+// each so that its phase moves on by its frequency over the synthesis hop
+// rather than the analysis hop. the bins around a peak are rotated with
+// it, up to halfway to the next, so that their phases stay where they
+// were relative to it. rotation gets the angle of every bin, and was the
+// last frame's. returns the peak count.
+static int lock_phases(TimeStretch *ts, const float *last_re, const float *last_im, float *rotation,
+        int analysis_hop)
+{
+    int bin_count = ts->bin_count;
+    const float *re = ts->re;
+    const float *im = ts->im;
+    float *power = ts->power;
+    dsp_power_spectrum(power, re, im, bin_count);
+    int peak_count = 0;
+    for (int k = 0; k < bin_count; k += 1) {
+        float p = power[k];
+        if (!(p > 0.0f) || (k >= 1 && p <= power[k - 1]) || (k >= 2 && p <= power[k - 2]) ||
+            (k + 1 < bin_count && p < power[k + 1]) || (k + 2 < bin_count && p < power[k + 2]))
+        {
+            continue;
+        }
+        ts->peaks[peak_count] = k;
+        peak_count += 1;
+    }
+
+    double hop_ratio = ts->synthesis_hop / (double)analysis_hop;
+    for (int i = 0; i < peak_count; i += 1) {
+        int k = ts->peaks[i];
+        double omega = 2.0 * PI * k / ts->frame_size;
+        double phase = atan2(im[k], re[k]);
+        double last_phase = atan2(last_im[k], last_re[k]);
+        double deviation = wrap_phase(phase - last_phase - omega * analysis_hop);
+        double advance = (omega * analysis_hop + deviation) * hop_ratio;
+        ts->peak_angle[i] = wrap_phase(last_phase + rotation[k] + advance - phase);
+    }
+    for (int i = 0; i < peak_count; i += 1) {
+        int lo = (i == 0) ? 0 : (ts->peaks[i - 1] + ts->peaks[i]) / 2 + 1;
+        int hi = (i == peak_count - 1) ? bin_count - 1 : (ts->peaks[i] + ts->peaks[i + 1]) / 2;
+        for (int k = lo; k <= hi; k += 1)
+            rotation[k] = ts->peak_angle[i];
+    }
+    return peak_count;
+}
+
+static long vocoder_hop(TimeStretch *ts, long start) {
+    int bin_count = ts->bin_count;
+    int analysis_hop = ts->have_last ? (int)(start - ts->last_start) : 0;
+    for (int ch = 0; ch < ts->channel_count; ch += 1) {
+        const float *in = ts->in + ch * ts->in_capacity + (start - ts->in_base);
+        dsp_multiply(ts->frame, in, ts->window, ts->frame_size);
+        fft_forward(ts->fft, ts->frame, ts->re, ts->im, ts->work);
+
+        float *last_re = ts->last_re + ch * bin_count;
+        float *last_im = ts->last_im + ch * bin_count;
+        float *rotation = ts->rotation + ch * bin_count;
+        // the first frame after a reset keeps its phases
+        int peak_count = (analysis_hop > 0) ? lock_phases(ts, last_re, last_im, rotation, analysis_hop) : 0;
+        memcpy(last_re, ts->re, bin_count * sizeof(float));
+        memcpy(last_im, ts->im, bin_count * sizeof(float));
+        for (int i = 0; i < peak_count; i += 1) {
+            int lo = (i == 0) ? 0 : (ts->peaks[i - 1] + ts->peaks[i]) / 2 + 1;
+            int hi = (i == peak_count - 1) ? bin_count - 1 : (ts->peaks[i] + ts->peaks[i + 1]) / 2;
+            float angle = ts->peak_angle[i];
+            dsp_complex_rotate(ts->re + lo, ts->im + lo, cosf(angle), sinf(angle), hi - lo + 1);
+        }
+
+        fft_inverse(ts->fft, ts->re, ts->im, ts->frame, ts->work);
+        float *acc = ts->acc + ch * ts->acc_capacity + ts->acc_done;
+        dsp_multiply_add(acc, ts->frame, ts->synthesis_window, ts->frame_size);
+    }
+    return start;
+}
+
+// drops the whole frames which reads are past, keeping the one before
+// read_pos for interpolation
+static void compact_output(TimeStretch *ts) {
+    long drop = min((long)floor(ts->read_pos) - 1, (long)ts->acc_done);
+    if (drop <= 0)
+        return;
+    int keep_count = ts->acc_capacity - drop;
+    for (int ch = 0; ch < ts->channel_count; ch += 1) {
+        float *acc = ts->acc + ch * ts->acc_capacity;
+        memmove(acc, acc + drop, keep_count * sizeof(float));
+        memset(acc + keep_count, 0, drop * sizeof(float));
+    }
+    ts->acc_done -= drop;
+    ts->read_pos -= drop;
+}
+
+static void run_hop(TimeStretch *ts) {
+    if (ts->acc_done + ts->frame_size > ts->acc_capacity)
+        compact_output(ts);
+    assert(ts->acc_done + ts->frame_size <= ts->acc_capacity);
+    long nominal = (long)floor(ts->analysis_pos);
+    if (ts->quality == GenesisTimeStretchQualityHigh)
+        ts->last_start = vocoder_hop(ts, nominal);
+    else
+        ts->last_start = overlap_hop(ts, nominal);
+    ts->have_last = true;
+    ts->acc_done += ts->synthesis_hop;
+    ts->analysis_pos += ts->synthesis_hop / (ts->stretch * ts->pitch);
+}
+
+static inline float catmull_rom(float p0, float p1, float p2, float p3, float t) {
+    return p1 + 0.5f * t * (p2 - p0 + t * (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3 +
+                t * (3.0f * (p1 - p2) + p3 - p0)));
+}
+
+// reads whole frames pitch frames apart from read_pos, linearly
+// interpolated for the draft quality and cubically for the high one.
+// returns how many it wrote.
+static int read_output(TimeStretch *ts, float *out_buf, int frame_count) {
+    int channel_count = ts->channel_count;
+    int capacity = ts->acc_capacity;
+    bool high = (ts->quality == GenesisTimeStretchQualityHigh);
+    int after = high ? 2 : 1;
+    if (ts->pitch == 1.0 && ts->read_pos == floor(ts->read_pos)) {
+        long index = (long)ts->read_pos;
+        int count = (int)min((long)frame_count, ts->acc_done - after - index);
+        if (count <= 0)
+            return 0;
+        ts->kernels->interleave(channel_count, out_buf, ts->acc + index, capacity, count);
+        ts->read_pos += count;
+        return count;
+    }
+    int written = 0;
+    for (; written < frame_count; written += 1) {
+        long index = (long)ts->read_pos;
+        if (index + after >= ts->acc_done)
+            break;
+        float t = (float)(ts->read_pos - index);
+        float *out = out_buf + written * channel_count;
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            const float *p = ts->acc + ch * capacity + index;
+            out[ch] = high ? catmull_rom(p[-1], p[0], p[1], p[2], t) : p[0] + (p[1] - p[0]) * t;
+        }
+        ts->read_pos += ts->pitch;
+    }
+    return written;
+}
+
+// in_buf is interleaved, or else in_channels has a span per channel
+static void convert(TimeStretch *ts, const float *in_buf, const float *const *in_channels,
+        int in_frame_count, float *out_buf, int out_frame_count, int *out_consumed, int *out_written)
+{
+    int channel_count = ts->channel_count;
+    int consumed = 0;
+    int written = 0;
+    for (;;) {
+        written += read_output(ts, out_buf + written * channel_count, out_frame_count - written);
+        if (written == out_frame_count)
+            break;
+        if (ts->in_base + ts->in_count >= hop_input_end(ts)) {
+            run_hop(ts);
+            continue;
+        }
+        int room = input_room(ts);
+        if (ts->silence_owed > 0) {
+            long skip_count = min(ts->in_skip, ts->silence_owed);
+            ts->in_skip -= skip_count;
+            ts->silence_owed -= skip_count;
+            int count = (int)min((long)room, ts->silence_owed);
+            for (int ch = 0; ch < channel_count; ch += 1)
+                memset(ts->in + ch * ts->in_capacity + ts->in_count, 0, count * sizeof(float));
+            if (ts->mix)
+                memset(ts->mix + ts->in_count, 0, count * sizeof(float));
+            ts->in_count += count;
+            ts->silence_owed -= count;
+            continue;
+        }
+        if (consumed == in_frame_count)
+            break;
+        int skip_count = (int)min(ts->in_skip, (long)(in_frame_count - consumed));
+        ts->in_skip -= skip_count;
+        consumed += skip_count;
+        int count = min(room, in_frame_count - consumed);
+        if (in_buf) {
+            ts->kernels->deinterleave(channel_count, ts->in + ts->in_count, ts->in_capacity,
+                    in_buf + consumed * channel_count, count);
+        } else {
+            for (int ch = 0; ch < channel_count; ch += 1) {
+                memcpy(ts->in + ch * ts->in_capacity + ts->in_count, in_channels[ch] + consumed,
+                        count * sizeof(float));
+            }
+        }
+        mix_input(ts, count);
+        ts->in_count += count;
+        consumed += count;
+    }
+    *out_consumed = consumed;
+    *out_written = written;
+}
+
+void time_stretch_convert(TimeStretch *ts, const float *in_buf, int in_frame_count,
+        float *out_buf, int out_frame_count, int *out_consumed, int *out_written)
+{
+    convert(ts, in_buf, nullptr, in_frame_count, out_buf, out_frame_count, out_consumed, out_written);
+}
+
+void time_stretch_convert_planar(TimeStretch *ts, const float *const *in_channels, int in_frame_count,
+        float *out_buf, int out_frame_count, int *out_consumed, int *out_written)
+{
+    convert(ts, nullptr, in_channels, in_frame_count, out_buf, out_frame_count, out_consumed, out_written);
+}
+
+struct TimeStretchNodeContext {
+    TimeStretch *time_stretch;
+    // only changes while the pipeline is stopped
+    GenesisTimeStretchQuality quality;
+    int sample_rate;
+    // output frames of silence still to come before the input, which is
+    // the latency of the node
+    int silence_frames_left;
+};
+
+static int node_lookahead(TimeStretchNodeContext *context) {
+    int frame_size = frame_size_for(context->sample_rate, context->quality);
+    bool high = (context->quality == GenesisTimeStretchQualityHigh);
+    return lookahead_for(frame_size, high ? 0 : frame_size / DRAFT_SEARCH_DIVISOR, context->quality);
+}
+
+static void time_stretch_node_destroy(struct GenesisNode *node) {
+    TimeStretchNodeContext *context = (TimeStretchNodeContext *)node->userdata;
+    if (context) {
+        time_stretch_destroy(context->time_stretch);
+        destroy(context, 1);
+    }
+}
+
+static int time_stretch_node_create(struct GenesisNode *node) {
+    TimeStretchNodeContext *context = create_zero<TimeStretchNodeContext>();
+    node->userdata = context;
+    if (!context) {
+        time_stretch_node_destroy(node);
+        return GenesisErrorNoMem;
+    }
+    context->quality = GenesisTimeStretchQualityDraft;
+    context->sample_rate = genesis_pipeline_get_sample_rate(node->descriptor->pipeline);
+    genesis_node_set_latency(node, node_lookahead(context));
+    return 0;
+}
+
+// the conversion is made again here, while no node runs, when the channels
+// or the quality changed
+static int time_stretch_node_activate(struct GenesisNode *node) {
+    TimeStretchNodeContext *context = (TimeStretchNodeContext *)node->userdata;
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    int channel_count = genesis_audio_port_channel_layout(audio_in_port)->channel_count;
+    context->sample_rate = genesis_audio_port_sample_rate(audio_in_port);
+    TimeStretch *ts = context->time_stretch;
+    if (!ts || ts->channel_count != channel_count || ts->quality != context->quality ||
+        ts->frame_size != frame_size_for(context->sample_rate, context->quality))
+    {
+        time_stretch_destroy(ts);
+        context->time_stretch = nullptr;
+        int err;
+        if ((err = time_stretch_create(context->sample_rate, channel_count, context->quality,
+                        &context->time_stretch)))
+        {
+            return err;
+        }
+        context->silence_frames_left = time_stretch_lookahead(context->time_stretch);
+    }
+    return 0;
+}
+
+static void time_stretch_node_seek(struct GenesisNode *node) {
+    TimeStretchNodeContext *context = (TimeStretchNodeContext *)node->userdata;
+    if (!context->time_stretch)
+        return;
+    time_stretch_reset(context->time_stretch);
+    context->silence_frames_left = time_stretch_lookahead(context->time_stretch);
+}
+
+static void time_stretch_node_run(struct GenesisNode *node) {
+    TimeStretchNodeContext *context = (TimeStretchNodeContext *)node->userdata;
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 1);
+    TimeStretch *ts = context->time_stretch;
+
+    int input_frame_count = genesis_audio_in_port_fill_count(audio_in_port);
+    int output_frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    // the ratios hold for the run, at their values where it starts
+    genesis_node_params_next_segment(node, context->sample_rate, output_frame_count);
+    time_stretch_set_ratios(ts, genesis_node_param_value(node, PARAM_STRETCH),
+            genesis_node_param_value(node, PARAM_PITCH));
+
+    int silence_count = min(context->silence_frames_left, output_frame_count);
+    if (silence_count > 0) {
+        genesis_audio_out_port_write_silence(audio_out_port, silence_count);
+        context->silence_frames_left -= silence_count;
+        output_frame_count -= silence_count;
+    }
+    int consumed;
+    int written;
+    time_stretch_convert(ts, genesis_audio_in_port_read_ptr(audio_in_port), input_frame_count,
+            genesis_audio_out_port_write_ptr(audio_out_port), output_frame_count, &consumed, &written);
+    genesis_node_params_advance(node, silence_count + written);
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, consumed);
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, written);
+}
+
+int genesis_time_stretch_node_set_params(struct GenesisNode *node, float stretch, float pitch) {
+    if (node->descriptor->run != time_stretch_node_run)
+        return GenesisErrorInvalidParam;
+    if (!(stretch >= TIME_STRETCH_MIN_STRETCH && stretch <= TIME_STRETCH_MAX_STRETCH) ||
+        !(pitch >= TIME_STRETCH_MIN_PITCH && pitch <= TIME_STRETCH_MAX_PITCH))
+    {
+        return GenesisErrorInvalidParam;
+    }
+    int err;
+    if ((err = genesis_node_set_param(node, PARAM_STRETCH, stretch, -1.0)))
+        return err;
+    return genesis_node_set_param(node, PARAM_PITCH, pitch, -1.0);
+}
+
+int genesis_time_stretch_node_set_quality(struct GenesisNode *node, enum GenesisTimeStretchQuality quality) {
+    if (node->descriptor->run != time_stretch_node_run ||
+        (quality != GenesisTimeStretchQualityDraft && quality != GenesisTimeStretchQualityHigh))
+    {
+        return GenesisErrorInvalidParam;
+    }
+    if (genesis_pipeline_is_running(node->descriptor->pipeline))
+        return GenesisErrorInvalidState;
+    TimeStretchNodeContext *context = (TimeStretchNodeContext *)node->userdata;
+    context->quality = quality;
+    genesis_node_set_latency(node, node_lookahead(context));
+    return 0;
+}
+
+int create_time_stretch_descriptor(GenesisPipeline *pipeline) {
+    GenesisNodeDescriptor *node_descr = genesis_create_node_descriptor(pipeline, 2, "time_stretch",
+            "Changes duration and pitch independently.");
+    if (!node_descr) {
+        genesis_node_descriptor_destroy(node_descr);
+        return GenesisErrorNoMem;
+    }
+
+    genesis_node_descriptor_set_run_callback(node_descr, time_stretch_node_run);
+    genesis_node_descriptor_set_create_callback(node_descr, time_stretch_node_create);
+    genesis_node_descriptor_set_destroy_callback(node_descr, time_stretch_node_destroy);
+    genesis_node_descriptor_set_seek_callback(node_descr, time_stretch_node_seek);
+    genesis_node_descriptor_set_activate_callback(node_descr, time_stretch_node_activate);
+
+    int err;
+    if ((err = genesis_node_descriptor_add_param(node_descr, "stretch", TIME_STRETCH_MIN_STRETCH,
+                    TIME_STRETCH_MAX_STRETCH, 1.0f, GLIDE_SECONDS)) ||
+        (err = genesis_node_descriptor_add_param(node_descr, "pitch", TIME_STRETCH_MIN_PITCH,
+                    TIME_STRETCH_MAX_PITCH, 1.0f, GLIDE_SECONDS)))
+    {
+        genesis_node_descriptor_destroy(node_descr);
+        return err;
+    }
+
+    struct GenesisPortDescriptor *audio_in_port = genesis_node_descriptor_create_port(
+            node_descr, 0, GenesisPortTypeAudioIn, "audio_in");
+    struct GenesisPortDescriptor *audio_out_port = genesis_node_descriptor_create_port(
+            node_descr, 1, GenesisPortTypeAudioOut, "audio_out");
+
+    if (!audio_in_port || !audio_out_port) {
+        genesis_node_descriptor_destroy(node_descr);
+        return GenesisErrorNoMem;
+    }
+
+    int target_sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+
+    genesis_audio_port_descriptor_set_channel_layout(audio_in_port,
+        soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono), false, -1);
+    genesis_audio_port_descriptor_set_sample_rate(audio_in_port, target_sample_rate, false, -1);
+
+    genesis_audio_port_descriptor_set_channel_layout(audio_out_port,
+        soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono), true, 0);
+    genesis_audio_port_descriptor_set_sample_rate(audio_out_port, target_sample_rate, true, 0);
+
+    return 0;
+}
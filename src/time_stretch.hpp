@@ -0,0 +1,45 @@
+#ifndef TIME_STRETCH_HPP
+#define TIME_STRETCH_HPP
+
+#include "genesis.hpp"
+
+// changes the duration of audio by stretch and its pitch by pitch, each a
+// ratio and each without the other. the input is first scaled in time by
+// stretch * pitch, from frames overlapped at a fixed hop which are taken
+// from the input at a hop that gives that ratio, and then read back pitch
+// frames at a time. the draft quality overlaps segments of the input
+// itself, each picked within a few milliseconds of where it should be so
+// that its waveform lines up with what came before (WSOLA). the high
+// quality overlaps frames of a phase vocoder whose phases are locked to
+// the peaks of the spectrum, which keeps transients and noise from
+// smearing as much as they would with free phases.
+
+static const double TIME_STRETCH_MIN_STRETCH = 0.25;
+static const double TIME_STRETCH_MAX_STRETCH = 4.0;
+static const double TIME_STRETCH_MIN_PITCH = 0.5;
+static const double TIME_STRETCH_MAX_PITCH = 2.0;
+
+int create_time_stretch_descriptor(GenesisPipeline *pipeline);
+
+struct TimeStretch;
+int time_stretch_create(int sample_rate, int channel_count, enum GenesisTimeStretchQuality quality,
+        TimeStretch **out_time_stretch);
+void time_stretch_destroy(TimeStretch *time_stretch);
+// forgets the input so far, as at the start of a voice or after a seek
+void time_stretch_reset(TimeStretch *time_stretch);
+// clamped to the ranges above. takes effect from the next frame out.
+void time_stretch_set_ratios(TimeStretch *time_stretch, double stretch, double pitch);
+// output frame k is input frame k / stretch, so the first output frame
+// needs about this many frames of input after the first, at ratios of 1
+int time_stretch_lookahead(const TimeStretch *time_stretch);
+// converts interleaved frames from in_buf into out_buf, like
+// resample_convert. the frames it does not consume must be passed again,
+// after any it does.
+void time_stretch_convert(TimeStretch *time_stretch, const float *in_buf, int in_frame_count,
+        float *out_buf, int out_frame_count, int *out_consumed, int *out_written);
+// same, with the input in one span per channel, in_channels[ch] for
+// channel ch
+void time_stretch_convert_planar(TimeStretch *time_stretch, const float *const *in_channels,
+        int in_frame_count, float *out_buf, int out_frame_count, int *out_consumed, int *out_written);
+
+#endif
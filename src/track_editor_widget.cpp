@@ -1,4 +1,5 @@
 #include "track_editor_widget.hpp"
+#include "waveform_texture.hpp"
 #include "project.hpp"
 #include "color.hpp"
 #include "gui_window.hpp"
@@ -37,11 +38,13 @@ static void on_tracks_changed(Event, void *userdata) {
 static void on_play_head_changed(Event, void *userdata) {
     TrackEditorWidget *track_editor_widget = (TrackEditorWidget *)userdata;
     track_editor_widget->update_play_head_model();
+    // this fires every flush while playing, so the play head keeps moving
+    track_editor_widget->gui->request_frame();
 }
 
 static void scroll_callback(Event, void *userdata) {
     TrackEditorWidget *track_editor = (TrackEditorWidget *)userdata;
-    track_editor->update_model();
+    track_editor->update_display();
 }
 
 TrackEditorWidget::TrackEditorWidget(GuiWindow *gui_window, AudioGraph *audio_graph) :
@@ -63,6 +66,8 @@ TrackEditorWidget::TrackEditorWidget(GuiWindow *gui_window, AudioGraph *audio_gr
     scrub_mouse_down = false;
 
     play_head_color = parse_color("#F47A28AA");
+    waveform_color = parse_color("#3E5C76FF");
+    waveform_rms_color = parse_color("#6A8EAEFF");
     play_head_icon = gui->img_play_head;
     timeline_bottom_border_color = color_light_border();
 
@@ -86,8 +91,8 @@ TrackEditorWidget::TrackEditorWidget(GuiWindow *gui_window, AudioGraph *audio_gr
     insert_track_after_menu->set_activate_handler(insert_track_after_handler, this);
     delete_track_menu->set_activate_handler(delete_track_handler, this);
 
-    project->events.attach_handler(EventProjectTracksChanged, on_tracks_changed, this);
-    project->events.attach_handler(EventProjectAudioClipSegmentsChanged, on_tracks_changed, this);
+    project->events.attach_deferred_handler(EventProjectTracksChanged, on_tracks_changed, this);
+    project->events.attach_deferred_handler(EventProjectAudioClipSegmentsChanged, on_tracks_changed, this);
     audio_graph->events.attach_handler(EventAudioGraphPlayHeadChanged, on_play_head_changed, this);
     vert_scroll_bar->events.attach_handler(EventScrollValueChange, scroll_callback, this);
     horiz_scroll_bar->events.attach_handler(EventScrollValueChange, scroll_callback, this);
@@ -95,7 +100,8 @@ TrackEditorWidget::TrackEditorWidget(GuiWindow *gui_window, AudioGraph *audio_gr
 
 TrackEditorWidget::~TrackEditorWidget() {
     project->events.detach_handler(EventProjectTracksChanged, on_tracks_changed);
-    audio_graph->events.detach_handler(EventAudioGraphPlayHeadChanged, on_tracks_changed);
+    project->events.detach_handler(EventProjectAudioClipSegmentsChanged, on_tracks_changed);
+    audio_graph->events.detach_handler(EventAudioGraphPlayHeadChanged, on_play_head_changed);
 
     destroy(vert_scroll_bar, 1);
     destroy(horiz_scroll_bar, 1);
@@ -106,27 +112,18 @@ TrackEditorWidget::~TrackEditorWidget() {
     for (int i = 0; i < display_tracks.length(); i += 1) {
         destroy_display_track(display_tracks.at(i));
     }
+    for (int i = 0; i < gui_waveforms.length(); i += 1) {
+        destroy(gui_waveforms.at(i).texture, 1);
+    }
 }
 
 void TrackEditorWidget::draw(const glm::mat4 &projection) {
-    glm::vec4 white = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
-    glm::mat4 track_area_stencil_mvp = projection * track_area_stencil;
-    glm::mat4 widget_stencil_mvp = projection * widget_stencil;
-
-    glEnable(GL_STENCIL_TEST);
-
-    glStencilFunc(GL_ALWAYS, 1, 0xFF);
-    glStencilOp(GL_KEEP, GL_REPLACE, GL_REPLACE);
-    glStencilMask(0xFF);
-
-    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-    glClear(GL_STENCIL_BUFFER_BIT);
-
-    gui_window->fill_rect(white, track_area_stencil_mvp);
-
-    glStencilFunc(GL_EQUAL, 1, 0xFF);
-    glStencilMask(0x00);
-    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    // everything in the track area goes out in one batch, clipped by the
+    // scissor. only a label wider than its segment needs a clip of its own.
+    int area_top = top + timeline_bottom;
+    int area_bottom = top + track_area_bottom;
+    int area_right = left + track_area_width;
+    gui_window->set_scissor(left, area_top, track_area_width, area_bottom - area_top);
 
     for (int track_i = 0; track_i < display_track_count; track_i += 1) {
         DisplayTrack *display_track = display_tracks.at(track_i);
@@ -137,56 +134,57 @@ void TrackEditorWidget::draw(const glm::mat4 &projection) {
             DisplayAudioClipSegment *segment = display_track->display_audio_clip_segments.at(segment_i);
             segment->body.draw(gui_window, projection);
             segment->title_bar.draw(gui_window, projection);
+
+            if (!segment->label_clipped) {
+                segment->label->draw(gui_window, projection * segment->label_model, track_name_color);
+                continue;
+            }
+
+            int clip_left = max(left + segment->left, left);
+            int clip_top = max(top + segment->top, area_top);
+            int clip_right = min(left + segment->right, area_right);
+            int clip_bottom = min(top + segment->top + segment->title_bar_height, area_bottom);
+            gui_window->set_scissor(clip_left, clip_top, clip_right - clip_left, clip_bottom - clip_top);
+            segment->label->draw(gui_window, projection * segment->label_model, track_name_color);
+            gui_window->set_scissor(left, area_top, track_area_width, area_bottom - area_top);
         }
     }
 
-    glStencilMask(0xFF);
-    glStencilOp(GL_KEEP, GL_INCR, GL_INCR);
-
+    // the waveforms go in the segment bodies below the title bars, one draw
+    // each. the peaks of an asset that is still loading upload as they come.
+    bool waveform_building = false;
     for (int track_i = 0; track_i < display_track_count; track_i += 1) {
         DisplayTrack *display_track = display_tracks.at(track_i);
 
         for (int segment_i = 0; segment_i < display_track->display_audio_clip_segment_count; segment_i += 1) {
             DisplayAudioClipSegment *segment = display_track->display_audio_clip_segments.at(segment_i);
-
-            glClear(GL_STENCIL_BUFFER_BIT);
-            glStencilFunc(GL_ALWAYS, 1, 0xFF);
-            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-
-            gui_window->fill_rect(white, track_area_stencil_mvp);
-
-            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-            glStencilFunc(GL_LEQUAL, 1, 0xFF);
-
-            segment->title_bar.draw(gui_window, projection);
-
-            glStencilFunc(GL_LEQUAL, 2, 0xFF);
-
-            segment->label->draw(projection * segment->label_model, track_name_color);
+            GuiAudioClipSegment *gui_segment = segment->gui_segment;
+            if (!gui_segment || !gui_segment->waveform)
+                continue;
+            int wave_top = segment->top + segment->title_bar_height;
+            int wave_width = segment->right - segment->left;
+            int wave_height = segment->bottom - wave_top - 1;
+            if (wave_width <= 0 || wave_height <= 0)
+                continue;
+            if (gui_segment->waveform->update())
+                waveform_building = true;
+            gui_segment->waveform->draw(gui_window, projection * transform2d(segment->left, wave_top),
+                    wave_width, wave_height, 0.0, gui_segment->frame_count / (double)wave_width,
+                    waveform_color, waveform_rms_color);
         }
     }
+    if (waveform_building)
+        queue_redraw();
 
-    glStencilFunc(GL_ALWAYS, 1, 0xFF);
-    glStencilOp(GL_KEEP, GL_REPLACE, GL_REPLACE);
-
-    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-    glClear(GL_STENCIL_BUFFER_BIT);
-
-    gui_window->fill_rect(white, widget_stencil_mvp);
-
-    glStencilFunc(GL_EQUAL, 1, 0xFF);
-    glStencilMask(0x00);
-    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-
+    gui_window->set_scissor(left, top, width, height);
     gui_window->fill_rect(play_head_color, projection * play_head_model);
-
-    glDisable(GL_STENCIL_TEST);
+    gui_window->clear_scissor();
 
     for (int track_i = 0; track_i < display_track_count; track_i += 1) {
         DisplayTrack *display_track = display_tracks.at(track_i);
 
         display_track->head_bg.draw(gui_window, projection);
-        display_track->track_name_label->draw(
+        display_track->track_name_label->draw(gui_window,
                 projection * display_track->track_name_label_model, track_name_color);
 
         gui_window->fill_rect(light_border_color, projection * display_track->border_top_model);
@@ -201,26 +199,40 @@ void TrackEditorWidget::draw(const glm::mat4 &projection) {
     vert_scroll_bar->draw(projection);
 }
 
-TrackEditorWidget::DisplayTrack * TrackEditorWidget::create_display_track(GuiTrack *gui_track) {
+TrackEditorWidget::DisplayTrack * TrackEditorWidget::create_display_track() {
     DisplayTrack *result = create<DisplayTrack>();
     result->track_name_label = create<Label>(gui);
-    result->gui_track = gui_track;
-    gui_track->display_track = result;
-    ok_or_panic(display_tracks.append(result));
+    result->gui_track = nullptr;
+    result->display_audio_clip_segment_count = 0;
     return result;
 }
 
-TrackEditorWidget::DisplayAudioClipSegment * TrackEditorWidget::create_display_audio_clip_segment(
-        DisplayTrack *display_track, GuiAudioClipSegment *gui_audio_clip_segment)
-{
+TrackEditorWidget::DisplayAudioClipSegment * TrackEditorWidget::create_display_audio_clip_segment() {
     DisplayAudioClipSegment *result = create<DisplayAudioClipSegment>();
     result->label = create<Label>(gui);
-    result->gui_segment = gui_audio_clip_segment;
-    gui_audio_clip_segment->display_segment = result;
-    ok_or_panic(display_track->display_audio_clip_segments.append(result));
+    result->gui_segment = nullptr;
     return result;
 }
 
+// the display objects stay in their lists, free for whatever comes into
+// view next
+void TrackEditorWidget::release_display_audio_clip_segment(
+        DisplayAudioClipSegment *display_audio_clip_segment)
+{
+    if (display_audio_clip_segment->gui_segment)
+        display_audio_clip_segment->gui_segment->display_segment = nullptr;
+    display_audio_clip_segment->gui_segment = nullptr;
+}
+
+void TrackEditorWidget::release_display_track(DisplayTrack *display_track) {
+    if (display_track->gui_track)
+        display_track->gui_track->display_track = nullptr;
+    display_track->gui_track = nullptr;
+    for (int i = 0; i < display_track->display_audio_clip_segments.length(); i += 1)
+        release_display_audio_clip_segment(display_track->display_audio_clip_segments.at(i));
+    display_track->display_audio_clip_segment_count = 0;
+}
+
 void TrackEditorWidget::destroy_display_track(DisplayTrack *display_track) {
     if (display_track) {
         if (display_track->gui_track)
@@ -243,6 +255,37 @@ void TrackEditorWidget::destroy_display_audio_clip_segment(
     }
 }
 
+WaveformTexture *TrackEditorWidget::use_waveform_texture(const WaveformPeaks *peaks) {
+    if (!peaks)
+        return nullptr;
+    for (int i = 0; i < gui_waveforms.length(); i += 1) {
+        GuiWaveform *gui_waveform = &gui_waveforms.at(i);
+        if (gui_waveform->texture->_peaks == peaks) {
+            gui_waveform->used = true;
+            return gui_waveform->texture;
+        }
+    }
+    ok_or_panic(gui_waveforms.add_one());
+    GuiWaveform *gui_waveform = &gui_waveforms.last();
+    gui_waveform->texture = create<WaveformTexture>(gui, peaks);
+    gui_waveform->used = true;
+    return gui_waveform->texture;
+}
+
+// called after every segment has asked for its texture
+void TrackEditorWidget::destroy_unused_waveform_textures() {
+    for (int i = 0; i < gui_waveforms.length();) {
+        GuiWaveform *gui_waveform = &gui_waveforms.at(i);
+        if (gui_waveform->used) {
+            gui_waveform->used = false;
+            i += 1;
+        } else {
+            destroy(gui_waveform->texture, 1);
+            gui_waveforms.swap_remove(i);
+        }
+    }
+}
+
 // these do not take scroll into account
 int TrackEditorWidget::whole_note_to_pixel(double whole_note_pos) {
     return body_left + pixels_per_whole_note * whole_note_pos;
@@ -253,6 +296,7 @@ double TrackEditorWidget::pixel_to_whole_note(int pixel_x) {
 }
 
 void TrackEditorWidget::update_play_head_model() {
+    queue_redraw();
     static const int ICON_WIDTH = 12;
     static const int ICON_HEIGHT = 12;
     float icon_scale_width = ICON_WIDTH / (float)play_head_icon->width;
@@ -266,6 +310,7 @@ void TrackEditorWidget::update_play_head_model() {
 }
 
 void TrackEditorWidget::update_model() {
+    queue_redraw();
     timeline_top = horiz_scroll_bar->min_height();
     timeline_bottom = timeline_top + timeline_height;
     timeline_bg.update(this, 0, timeline_top, width, timeline_height);
@@ -298,9 +343,12 @@ void TrackEditorWidget::update_model() {
 
             int frame_rate = project_audio_clip_sample_rate(project, segment->audio_clip);
             int frame_count = project_audio_clip_frame_count(project, segment->audio_clip);
-            double whole_note_len = genesis_frames_to_whole_notes(
-                    audio_graph->pipeline, frame_count, frame_rate);
-            double whole_note_end = segment->pos + whole_note_len;
+            // the waveform of a stretched clip is drawn stretched with it
+            double whole_note_end = genesis_whole_notes_add_frames(audio_graph->pipeline, segment->pos,
+                    (long)ceil(frame_count * segment->audio_clip->stretch), frame_rate);
+
+            gui_audio_clip_segment->frame_count = frame_count;
+            gui_audio_clip_segment->waveform = use_waveform_texture(segment->audio_clip->audio_asset->peaks);
 
             gui_audio_clip_segment->left = whole_note_to_pixel(segment->pos);
             gui_audio_clip_segment->right = whole_note_to_pixel(whole_note_end);
@@ -310,12 +358,13 @@ void TrackEditorWidget::update_model() {
             max_right = max(max_right, gui_audio_clip_segment->right);
         }
     }
+    destroy_unused_waveform_textures();
+
     int full_width = max_right + EXTRA_SCROLL_WIDTH;
     int full_height = next_top - first_top;
     int available_height = track_area_bottom - track_area_top;
 
-    track_area_stencil = transform2d(0, track_area_top, track_width, available_height);
-    widget_stencil = transform2d(0, 0, width, height);
+    track_area_width = track_width;
 
     vert_scroll_bar->left = left + width - vert_scroll_bar->min_width();
     vert_scroll_bar->top = top + timeline_bottom;
@@ -338,9 +387,32 @@ void TrackEditorWidget::update_model() {
     horiz_scroll_bar->on_resize();
 
 
-    // now consider scroll position and create display tracks for tracks that
-    // are visible
-    display_track_count = 0;
+    update_display();
+}
+
+void TrackEditorWidget::update_display() {
+    queue_redraw();
+    int track_area_top = timeline_bottom;
+    int track_width = track_area_width;
+    int body_width = track_width - body_left;
+
+    // what scrolled out of view gives back its display objects. what stays
+    // in view keeps its own, so its labels stay as they are.
+    for (int track_i = 0; track_i < gui_tracks.length(); track_i += 1) {
+        GuiTrack *gui_track = gui_tracks.at(track_i);
+        bool visible = (gui_track->bottom - vert_scroll_bar->value >= track_area_top &&
+                gui_track->top - vert_scroll_bar->value < track_area_bottom);
+        if (!visible && gui_track->display_track)
+            release_display_track(gui_track->display_track);
+    }
+    free_display_tracks.clear();
+    for (int i = 0; i < display_tracks.length(); i += 1) {
+        DisplayTrack *display_track = display_tracks.at(i);
+        if (!display_track->gui_track)
+            ok_or_panic(free_display_tracks.append(display_track));
+    }
+
+    shown_display_tracks.clear();
     for (int track_i = 0; track_i < gui_tracks.length(); track_i += 1) {
         GuiTrack *gui_track = gui_tracks.at(track_i);
         bool visible = (gui_track->bottom - vert_scroll_bar->value >= track_area_top &&
@@ -348,15 +420,14 @@ void TrackEditorWidget::update_model() {
         if (!visible)
             continue;
 
-        DisplayTrack *display_track;
-        if (display_track_count >= display_tracks.length())
-            display_track = create_display_track(gui_track);
-        else
-            display_track = display_tracks.at(display_track_count);
-        display_track_count += 1;
-
-        display_track->gui_track = gui_track;
-        gui_track->display_track = display_track;
+        DisplayTrack *display_track = gui_track->display_track;
+        if (!display_track) {
+            display_track = (free_display_tracks.length() > 0) ?
+                free_display_tracks.pop() : create_display_track();
+            display_track->gui_track = gui_track;
+            gui_track->display_track = display_track;
+        }
+        ok_or_panic(shown_display_tracks.append(display_track));
 
         display_track->top = gui_track->top - vert_scroll_bar->value;
         display_track->bottom = gui_track->bottom - vert_scroll_bar->value;
@@ -366,8 +437,11 @@ void TrackEditorWidget::update_model() {
         display_track->head_bg.update(this, 0, head_top, track_head_width, track_height);
         display_track->body_bg.update(this, body_left, head_top, body_width, track_height);
 
-        display_track->track_name_label->set_text(gui_track->track->name);
-        display_track->track_name_label->update();
+        Label *track_name_label = display_track->track_name_label;
+        if (String::compare(track_name_label->text(), gui_track->track->name) != 0) {
+            track_name_label->set_text(gui_track->track->name);
+            track_name_label->update();
+        }
 
         int label_left = head_left + track_name_label_padding_left;
         int label_top = head_top + track_name_label_padding_top;
@@ -378,29 +452,37 @@ void TrackEditorWidget::update_model() {
         display_track->border_bottom_model = transform2d(
                 gui_track->left, display_track->bottom, track_width, 1.0f);
 
-        display_track->display_audio_clip_segment_count = 0;
+        List<DisplayAudioClipSegment *> *display_segments = &display_track->display_audio_clip_segments;
         for (int segment_i = 0; segment_i < gui_track->gui_audio_clip_segments.length(); segment_i += 1) {
             GuiAudioClipSegment *gui_audio_clip_segment = gui_track->gui_audio_clip_segments.at(segment_i);
             bool visible = (gui_audio_clip_segment->right - horiz_scroll_bar->value >= body_left &&
                     gui_audio_clip_segment->left - horiz_scroll_bar->value < gui_track->right);
+            if (!visible && gui_audio_clip_segment->display_segment)
+                release_display_audio_clip_segment(gui_audio_clip_segment->display_segment);
+        }
+        free_display_segments.clear();
+        for (int i = 0; i < display_segments->length(); i += 1) {
+            DisplayAudioClipSegment *display_segment = display_segments->at(i);
+            if (!display_segment->gui_segment)
+                ok_or_panic(free_display_segments.append(display_segment));
+        }
 
+        shown_display_segments.clear();
+        for (int segment_i = 0; segment_i < gui_track->gui_audio_clip_segments.length(); segment_i += 1) {
+            GuiAudioClipSegment *gui_audio_clip_segment = gui_track->gui_audio_clip_segments.at(segment_i);
+            bool visible = (gui_audio_clip_segment->right - horiz_scroll_bar->value >= body_left &&
+                    gui_audio_clip_segment->left - horiz_scroll_bar->value < gui_track->right);
             if (!visible)
                 continue;
 
-            DisplayAudioClipSegment *display_audio_clip_segment;
-            if (display_track->display_audio_clip_segment_count >=
-                    display_track->display_audio_clip_segments.length())
-            {
-                display_audio_clip_segment = create_display_audio_clip_segment(
-                        display_track, gui_audio_clip_segment);
-            } else {
-                display_audio_clip_segment =
-                    display_track->display_audio_clip_segments.at(display_track->display_audio_clip_segment_count);
+            DisplayAudioClipSegment *display_audio_clip_segment = gui_audio_clip_segment->display_segment;
+            if (!display_audio_clip_segment) {
+                display_audio_clip_segment = (free_display_segments.length() > 0) ?
+                    free_display_segments.pop() : create_display_audio_clip_segment();
+                display_audio_clip_segment->gui_segment = gui_audio_clip_segment;
+                gui_audio_clip_segment->display_segment = display_audio_clip_segment;
             }
-            display_track->display_audio_clip_segment_count += 1;
-
-            display_audio_clip_segment->gui_segment = gui_audio_clip_segment;
-            gui_audio_clip_segment->display_segment = display_audio_clip_segment;
+            ok_or_panic(shown_display_segments.append(display_audio_clip_segment));
 
             // calculate positions
             display_audio_clip_segment->top = gui_audio_clip_segment->top - vert_scroll_bar->value;
@@ -417,11 +499,15 @@ void TrackEditorWidget::update_model() {
                     segment_width, segment_height);
 
             AudioClip *audio_clip = display_audio_clip_segment->gui_segment->segment->audio_clip;
-            display_audio_clip_segment->label->set_text(audio_clip->name);
-            display_audio_clip_segment->label->update();
+            Label *label = display_audio_clip_segment->label;
+            if (String::compare(label->text(), audio_clip->name) != 0) {
+                label->set_text(audio_clip->name);
+                label->update();
+            }
 
             int label_left;
-            if (display_audio_clip_segment->label->width() >= segment_width) {
+            display_audio_clip_segment->label_clipped = (label->width() >= segment_width);
+            if (display_audio_clip_segment->label_clipped) {
                 label_left = display_audio_clip_segment->left;
             } else {
                 label_left = display_audio_clip_segment->left + segment_width / 2 -
@@ -431,12 +517,25 @@ void TrackEditorWidget::update_model() {
             display_audio_clip_segment->label_model = transform2d(label_left, label_top);
 
             int title_bar_height = display_audio_clip_segment->label->height() + SEGMENT_TITLE_PADDING * 2;
+            display_audio_clip_segment->title_bar_height = title_bar_height;
             display_audio_clip_segment->title_bar.set_scheme(SunkenBoxSchemeRaisedBorders);
             display_audio_clip_segment->title_bar.update(this,
                     display_audio_clip_segment->left, display_audio_clip_segment->top,
                     segment_width, title_bar_height);
         }
+        display_segments->clear();
+        for (int i = 0; i < shown_display_segments.length(); i += 1)
+            ok_or_panic(display_segments->append(shown_display_segments.at(i)));
+        for (int i = 0; i < free_display_segments.length(); i += 1)
+            ok_or_panic(display_segments->append(free_display_segments.at(i)));
+        display_track->display_audio_clip_segment_count = shown_display_segments.length();
     }
+    display_tracks.clear();
+    for (int i = 0; i < shown_display_tracks.length(); i += 1)
+        ok_or_panic(display_tracks.append(shown_display_tracks.at(i)));
+    for (int i = 0; i < free_display_tracks.length(); i += 1)
+        ok_or_panic(display_tracks.append(free_display_tracks.at(i)));
+    display_track_count = shown_display_tracks.length();
 
     update_play_head_model();
 }
@@ -451,7 +550,7 @@ TrackEditorWidget::GuiAudioClipSegment * TrackEditorWidget::create_gui_audio_cli
 
 void TrackEditorWidget::destroy_gui_audio_clip_segment(GuiAudioClipSegment *gui_audio_clip_segment) {
     if (gui_audio_clip_segment->display_segment)
-        gui_audio_clip_segment->display_segment->gui_segment = nullptr;
+        release_display_audio_clip_segment(gui_audio_clip_segment->display_segment);
     destroy(gui_audio_clip_segment, 1);
 }
 
@@ -459,6 +558,8 @@ void TrackEditorWidget::destroy_gui_track(GuiTrack *gui_track) {
     if (gui_track) {
         if (menu_track == gui_track)
             clear_track_context_menu();
+        if (gui_track->display_track)
+            release_display_track(gui_track->display_track);
         for (int i = 0; i < gui_track->gui_audio_clip_segments.length(); i += 1) {
             destroy_gui_audio_clip_segment(gui_track->gui_audio_clip_segments.at(i));
         }
@@ -468,13 +569,14 @@ void TrackEditorWidget::destroy_gui_track(GuiTrack *gui_track) {
 
 void TrackEditorWidget::scrub(const MouseEvent *event) {
     double whole_note = pixel_to_whole_note(event->x + horiz_scroll_bar->value);
-    audio_graph_set_play_head(audio_graph, whole_note);
+    audio_graph_scrub_move(audio_graph, whole_note);
 }
 
 void TrackEditorWidget::on_mouse_move(const MouseEvent *event) {
     if (scrub_mouse_down) {
         if (event->button == MouseButtonLeft && event->action == MouseActionUp) {
             scrub_mouse_down = false;
+            audio_graph_scrub_end(audio_graph);
         } else if (event->action == MouseActionMove) {
             scrub(event);
         }
@@ -493,14 +595,15 @@ void TrackEditorWidget::on_mouse_move(const MouseEvent *event) {
     if (event->button == MouseButtonLeft && event->action == MouseActionDown) {
         if (event->y >= timeline_top && event->y <= timeline_bottom) {
             scrub_mouse_down = true;
-            scrub(event);
+            audio_graph_scrub_begin(audio_graph,
+                    pixel_to_whole_note(event->x + horiz_scroll_bar->value));
         }
         return;
     }
 }
 
 TrackEditorWidget::GuiTrack * TrackEditorWidget::get_track_head_at(int x, int y) {
-    for (int i = 0; i < display_tracks.length(); i += 1) {
+    for (int i = 0; i < display_track_count; i += 1) {
         DisplayTrack *display_track = display_tracks.at(i);
 
         if (y >= display_track->top && y < display_track->bottom && x >= head_left && x < body_left)
@@ -510,7 +613,7 @@ TrackEditorWidget::GuiTrack * TrackEditorWidget::get_track_head_at(int x, int y)
 }
 
 TrackEditorWidget::GuiTrack *TrackEditorWidget::get_track_body_at(int x, int y) {
-    for (int i = 0; i < display_tracks.length(); i += 1) {
+    for (int i = 0; i < display_track_count; i += 1) {
         DisplayTrack *display_track = display_tracks.at(i);
 
         if (y >= display_track->top && y < display_track->bottom && x >= body_left)
@@ -591,40 +694,72 @@ void TrackEditorWidget::on_drag_audio_clip(AudioClip *audio_clip, const DragEven
     }
 }
 
+// matched up with the project by id, so that the tracks and segments which
+// are still there keep their display objects, and their labels
 void TrackEditorWidget::refresh_tracks() {
-    int track_i;
-    for (track_i = 0; track_i < project->track_list.length(); track_i += 1) {
+    old_gui_tracks.clear();
+    old_gui_segments.clear();
+    for (int track_i = 0; track_i < gui_tracks.length(); track_i += 1) {
+        GuiTrack *gui_track = gui_tracks.at(track_i);
+        gui_track->used = false;
+        for (int segment_i = 0; segment_i < gui_track->gui_audio_clip_segments.length(); segment_i += 1) {
+            GuiAudioClipSegment *gui_segment = gui_track->gui_audio_clip_segments.at(segment_i);
+            gui_segment->used = false;
+            ok_or_panic(old_gui_segments.append(gui_segment));
+        }
+        gui_track->gui_audio_clip_segments.clear();
+        ok_or_panic(old_gui_tracks.append(gui_track));
+    }
+
+    gui_tracks.clear();
+    for (int track_i = 0; track_i < project->track_list.length(); track_i += 1) {
         Track *track = project->track_list.at(track_i);
         GuiTrack *gui_track;
-        if (track_i < gui_tracks.length()) {
-            gui_track = gui_tracks.at(track_i);
+        auto *track_entry = gui_track_map.maybe_get(track->id);
+        if (track_entry) {
+            gui_track = track_entry->value;
         } else {
             gui_track = create_gui_track();
-            ok_or_panic(gui_tracks.append(gui_track));
+            gui_track->id = track->id;
+            gui_track_map.put(track->id, gui_track);
         }
-
         gui_track->track = track;
+        gui_track->used = true;
+        ok_or_panic(gui_tracks.append(gui_track));
 
-        int segment_i;
-        for (segment_i = 0; segment_i < track->audio_clip_segments.length(); segment_i += 1) {
+        for (int segment_i = 0; segment_i < track->audio_clip_segments.length(); segment_i += 1) {
             AudioClipSegment *segment = track->audio_clip_segments.at(segment_i);
             GuiAudioClipSegment *gui_segment;
-            if (segment_i < gui_track->gui_audio_clip_segments.length()) {
-                gui_segment = gui_track->gui_audio_clip_segments.at(segment_i);
+            auto *segment_entry = gui_segment_map.maybe_get(segment->id);
+            if (segment_entry) {
+                gui_segment = segment_entry->value;
             } else {
                 gui_segment = create_gui_audio_clip_segment();
-                ok_or_panic(gui_track->gui_audio_clip_segments.append(gui_segment));
+                gui_segment->id = segment->id;
+                gui_segment_map.put(segment->id, gui_segment);
             }
-
+            // a segment moved to another track shows in that track's display
+            if (gui_segment->gui_track != gui_track && gui_segment->display_segment)
+                release_display_audio_clip_segment(gui_segment->display_segment);
+            gui_segment->gui_track = gui_track;
             gui_segment->segment = segment;
-        }
-        while (segment_i < gui_track->gui_audio_clip_segments.length()) {
-            GuiAudioClipSegment *gui_segment = gui_track->gui_audio_clip_segments.pop();
-            destroy_gui_audio_clip_segment(gui_segment);
+            gui_segment->used = true;
+            ok_or_panic(gui_track->gui_audio_clip_segments.append(gui_segment));
         }
     }
-    while (track_i < gui_tracks.length()) {
-        GuiTrack *gui_track = gui_tracks.pop();
+
+    for (int i = 0; i < old_gui_segments.length(); i += 1) {
+        GuiAudioClipSegment *gui_segment = old_gui_segments.at(i);
+        if (gui_segment->used)
+            continue;
+        gui_segment_map.remove(gui_segment->id);
+        destroy_gui_audio_clip_segment(gui_segment);
+    }
+    for (int i = 0; i < old_gui_tracks.length(); i += 1) {
+        GuiTrack *gui_track = old_gui_tracks.at(i);
+        if (gui_track->used)
+            continue;
+        gui_track_map.remove(gui_track->id);
         destroy_gui_track(gui_track);
     }
 }
@@ -638,5 +773,5 @@ void TrackEditorWidget::on_mouse_wheel(const MouseWheelEvent *event) {
         float range = horiz_scroll_bar->max_value - horiz_scroll_bar->min_value;
         horiz_scroll_bar->set_value(horiz_scroll_bar->value - event->wheel_x * range * 0.18f * horiz_scroll_bar->handle_ratio);
     }
-    update_model();
+    update_display();
 }
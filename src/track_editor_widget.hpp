@@ -3,6 +3,7 @@
 
 #include "widget.hpp"
 #include "sunken_box.hpp"
+#include "id_map.hpp"
 
 struct Project;
 struct AudioGraph;
@@ -15,6 +16,8 @@ struct AudioAsset;
 struct AudioClip;
 struct AudioClipSegment;
 struct SpritesheetImage;
+struct WaveformPeaks;
+class WaveformTexture;
 
 class TrackEditorWidget : public Widget {
 public:
@@ -51,8 +54,9 @@ public:
     glm::vec4 light_border_color;
 
     SunkenBox timeline_bg;
-    glm::mat4 track_area_stencil;
-    glm::mat4 widget_stencil;
+    // the track area is clipped to this, from timeline_bottom to
+    // track_area_bottom
+    int track_area_width;
 
     const SpritesheetImage *play_head_icon;
     glm::vec4 play_head_color;
@@ -64,13 +68,21 @@ public:
     double pixels_per_whole_note;
 
     struct DisplayAudioClipSegment;
+    struct GuiTrack;
     struct GuiAudioClipSegment {
+        uint256 id;
         AudioClipSegment *segment;
+        GuiTrack *gui_track;
         DisplayAudioClipSegment *display_segment;
+        // drawn across the whole segment
+        WaveformTexture *waveform;
+        long frame_count;
         int left;
         int right;
         int top;
         int bottom;
+        // scratch for refresh_tracks
+        bool used;
     };
 
     struct DisplayAudioClipSegment {
@@ -79,6 +91,9 @@ public:
         SunkenBox body;
         Label *label;
         glm::mat4 label_model;
+        // wider than the segment, so drawn clipped to the title bar
+        bool label_clipped;
+        int title_bar_height;
 
         // adjusted for scroll position
         int left;
@@ -89,6 +104,7 @@ public:
 
     struct DisplayTrack;
     struct GuiTrack {
+        uint256 id;
         Track *track;
         DisplayTrack *display_track;
         List<GuiAudioClipSegment *> gui_audio_clip_segments;
@@ -96,6 +112,8 @@ public:
         int right;
         int top;
         int bottom;
+        // scratch for refresh_tracks
+        bool used;
     };
 
     struct DisplayTrack {
@@ -107,6 +125,9 @@ public:
         Label *track_name_label;
         glm::mat4 track_name_label_model;
 
+        // the first display_audio_clip_segment_count are shown, in the
+        // order of the segments. the rest are free for segments which
+        // scroll into view.
         List<DisplayAudioClipSegment *> display_audio_clip_segments;
         int display_audio_clip_segment_count;
 
@@ -115,9 +136,30 @@ public:
         int bottom;
     };
 
+    // one for each asset a segment shows, as long as one does
+    struct GuiWaveform {
+        WaveformTexture *texture;
+        // scratch for update_model
+        bool used;
+    };
+    List<GuiWaveform> gui_waveforms;
+    glm::vec4 waveform_color;
+    glm::vec4 waveform_rms_color;
+
+    // in the order of the project's tracks, and by id
     List<GuiTrack *> gui_tracks;
+    IdMap<GuiTrack *> gui_track_map;
+    IdMap<GuiAudioClipSegment *> gui_segment_map;
+    // the first display_track_count are shown, and the rest are free
     List<DisplayTrack *> display_tracks;
     int display_track_count;
+    // scratch for refresh_tracks and update_display
+    List<GuiTrack *> old_gui_tracks;
+    List<GuiAudioClipSegment *> old_gui_segments;
+    List<DisplayTrack *> shown_display_tracks;
+    List<DisplayTrack *> free_display_tracks;
+    List<DisplayAudioClipSegment *> shown_display_segments;
+    List<DisplayAudioClipSegment *> free_display_segments;
 
     MenuWidgetItem *track_context_menu;
     GuiTrack *menu_track;
@@ -126,14 +168,20 @@ public:
 
     bool scrub_mouse_down;
 
+    // lays out the tracks and segments, then update_display
     void update_model();
+    // shows what is scrolled into view, without laying anything out again
+    void update_display();
     void update_play_head_model();
     GuiTrack *create_gui_track();
-    DisplayTrack * create_display_track(GuiTrack *gui_track);
-    DisplayAudioClipSegment * create_display_audio_clip_segment(
-            DisplayTrack *display_track, GuiAudioClipSegment *gui_audio_clip_segment);
+    DisplayTrack * create_display_track();
+    DisplayAudioClipSegment * create_display_audio_clip_segment();
     GuiAudioClipSegment * create_gui_audio_clip_segment();
+    void release_display_track(DisplayTrack *display_track);
+    void release_display_audio_clip_segment(DisplayAudioClipSegment *display_audio_clip_segment);
     void destroy_gui_track(GuiTrack *gui_track);
+    WaveformTexture *use_waveform_texture(const WaveformPeaks *peaks);
+    void destroy_unused_waveform_textures();
     void right_click_track_head(GuiTrack *gui_track, int x, int y);
     void clear_track_context_menu();
     GuiTrack *get_track_body_at(int x, int y);
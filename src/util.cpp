@@ -1,10 +1,13 @@
 #include "util.hpp"
+#include "logger.hpp"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
 
 void panic(const char *format, ...) {
+    // what was logged before comes first
+    log_flush();
     va_list ap;
     va_start(ap, format);
     vfprintf(stderr, format, ap);
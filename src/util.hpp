@@ -2,12 +2,14 @@
 #define UTIL_HPP
 
 #include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
 #include <assert.h>
 #include <math.h>
 #include <new>
 
 #include "genesis.h"
+#include "alloc_debug.hpp"
 
 void panic(const char *format, ...)
     __attribute__((cold))
@@ -16,7 +18,9 @@ void panic(const char *format, ...)
 
 template<typename T>
 __attribute__((malloc)) static inline T *allocate_nonzero(size_t count) {
-    return reinterpret_cast<T*>(malloc(count * sizeof(T)));
+    T *ptr = reinterpret_cast<T*>(malloc(count * sizeof(T)));
+    alloc_debug_on_alloc(ptr);
+    return ptr;
 }
 
 // create<MyClass>(a, b) is equivalent to: new MyClass(a, b)
@@ -25,6 +29,7 @@ __attribute__((malloc)) static inline T * create(Args... args) {
     T * ptr = reinterpret_cast<T*>(malloc(sizeof(T)));
     if (!ptr)
         panic("create: out of memory");
+    alloc_debug_on_alloc(ptr);
     new (ptr) T(args...);
     return ptr;
 }
@@ -34,6 +39,7 @@ __attribute__((malloc)) static inline T * create(Args... args) {
 template<typename T, typename... Args>
 __attribute__((malloc)) static inline T * create_zero(Args... args) {
     T * ptr = reinterpret_cast<T*>(calloc(1, sizeof(T)));
+    alloc_debug_on_alloc(ptr);
     if (ptr)
         new (ptr) T(args...);
     return ptr;
@@ -46,6 +52,7 @@ __attribute__((malloc)) static inline T * allocate_class(size_t count) {
     T * ptr = reinterpret_cast<T*>(malloc(count * sizeof(T)));
     if (!ptr)
         panic("allocate: out of memory");
+    alloc_debug_on_alloc(ptr);
     for (size_t i = 0; i < count; i++)
         new (&ptr[i]) T;
     return ptr;
@@ -54,7 +61,21 @@ __attribute__((malloc)) static inline T * allocate_class(size_t count) {
 // allocate zeroed memory and return NULL instead of panicking.
 template<typename T>
 __attribute__((malloc)) static inline T *allocate_zero(size_t count) {
-    return reinterpret_cast<T*>(calloc(count, sizeof(T)));
+    T *ptr = reinterpret_cast<T*>(calloc(count, sizeof(T)));
+    alloc_debug_on_alloc(ptr);
+    return ptr;
+}
+
+// like allocate_zero, with the memory aligned to alignment, which must be a
+// power of two and a multiple of sizeof(void *). give it back with destroy.
+template<typename T>
+__attribute__((malloc)) static inline T *allocate_zero_aligned(size_t count, size_t alignment) {
+    void *ptr;
+    if (posix_memalign(&ptr, alignment, count * sizeof(T)))
+        return nullptr;
+    memset(ptr, 0, count * sizeof(T));
+    alloc_debug_on_alloc(ptr);
+    return reinterpret_cast<T*>(ptr);
 }
 
 // Pass in a pointer to an array of old_count items.
@@ -72,9 +93,11 @@ __attribute__((malloc)) static inline T *allocate_zero(size_t count) {
 template<typename T>
 static inline T * reallocate(T * old, size_t old_count, size_t new_count) {
     assert(old_count <= new_count);
+    size_t old_bytes = alloc_debug_size(old);
     T * new_ptr = reinterpret_cast<T*>(realloc(old, new_count * sizeof(T)));
     if (!new_ptr)
         panic("reallocate: out of memory");
+    alloc_debug_on_realloc(old_bytes, new_ptr);
     for (size_t i = old_count; i < new_count; i += 1)
         new (&new_ptr[i]) T;
     return new_ptr;
@@ -84,8 +107,10 @@ static inline T * reallocate(T * old, size_t old_count, size_t new_count) {
 template<typename T>
 static inline T * reallocate_safe(T * old, size_t old_count, size_t new_count) {
     assert(old_count <= new_count);
+    size_t old_bytes = alloc_debug_size(old);
     T * new_ptr = reinterpret_cast<T*>(realloc(old, new_count * sizeof(T)));
     if (new_ptr) {
+        alloc_debug_on_realloc(old_bytes, new_ptr);
         for (size_t i = old_count; i < new_count; i += 1)
             new (&new_ptr[i]) T;
     }
@@ -102,6 +127,7 @@ static inline void destroy(T * ptr, size_t count) {
         for (size_t i = 0; i < count; i += 1)
             ptr[i].~T();
     }
+    alloc_debug_on_free(ptr);
     free(ptr);
 }
 
@@ -182,14 +208,97 @@ static inline T sign(T x) {
         return 0;
 }
 
+template<typename T>
+static inline void sort_swap(T *a, T *b) {
+    T tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
 template<typename T, int(*Comparator)(T, T)>
-void quick_sort(T *in_place_list, int size) {
-    auto qsort_comparator = [](const void *void_a, const void *void_b) -> int {
-        T *a = (T *)void_a;
-        T *b = (T *)void_b;
-        return Comparator(*a, *b);
+static void insertion_sort(T *items, int size) {
+    for (int i = 1; i < size; i += 1) {
+        T item = items[i];
+        int j = i;
+        for (; j > 0 && Comparator(items[j - 1], item) > 0; j -= 1)
+            items[j] = items[j - 1];
+        items[j] = item;
+    }
+}
+
+template<typename T, int(*Comparator)(T, T)>
+static void heap_sort(T *items, int size) {
+    auto sift_down = [](T *items, int root, int size) {
+        for (;;) {
+            int child = root * 2 + 1;
+            if (child >= size)
+                return;
+            if (child + 1 < size && Comparator(items[child], items[child + 1]) < 0)
+                child += 1;
+            if (Comparator(items[root], items[child]) >= 0)
+                return;
+            sort_swap(&items[root], &items[child]);
+            root = child;
+        }
     };
-    qsort(in_place_list, size, sizeof(T), qsort_comparator);
+    for (int i = size / 2 - 1; i >= 0; i -= 1)
+        sift_down(items, i, size);
+    for (int end = size - 1; end > 0; end -= 1) {
+        sort_swap(&items[0], &items[end]);
+        sift_down(items, 0, end);
+    }
+}
+
+// quick sort around the median of three, with the smaller side first so
+// the stack stays shallow. when the partitions keep coming out lopsided
+// it gives up and heap sorts what is left, and short runs are insertion
+// sorted.
+template<typename T, int(*Comparator)(T, T)>
+static void intro_sort(T *items, int size, int depth) {
+    while (size > 16) {
+        if (depth == 0) {
+            heap_sort<T, Comparator>(items, size);
+            return;
+        }
+        depth -= 1;
+        int middle = size / 2;
+        if (Comparator(items[middle], items[0]) < 0)
+            sort_swap(&items[middle], &items[0]);
+        if (Comparator(items[size - 1], items[0]) < 0)
+            sort_swap(&items[size - 1], &items[0]);
+        if (Comparator(items[size - 1], items[middle]) < 0)
+            sort_swap(&items[size - 1], &items[middle]);
+        T pivot = items[middle];
+        int i = -1;
+        int j = size;
+        for (;;) {
+            do { i += 1; } while (Comparator(items[i], pivot) < 0);
+            do { j -= 1; } while (Comparator(pivot, items[j]) < 0);
+            if (i >= j)
+                break;
+            sort_swap(&items[i], &items[j]);
+        }
+        int left_size = j + 1;
+        if (left_size < size - left_size) {
+            intro_sort<T, Comparator>(items, left_size, depth);
+            items += left_size;
+            size -= left_size;
+        } else {
+            intro_sort<T, Comparator>(items + left_size, size - left_size, depth);
+            size = left_size;
+        }
+    }
+    insertion_sort<T, Comparator>(items, size);
+}
+
+// not stable. the comparator is called directly rather than through qsort's
+// function pointer, so that cheap comparisons can be inlined.
+template<typename T, int(*Comparator)(T, T)>
+void quick_sort(T *in_place_list, int size) {
+    int depth = 0;
+    for (int n = size; n > 1; n /= 2)
+        depth += 2;
+    intro_sort<T, Comparator>(in_place_list, size, depth);
 }
 
 static inline void write_uint32be(void *buffer, uint32_t x) {
@@ -207,7 +316,7 @@ static inline void write_uint32be(void *buffer, uint32_t x) {
     buf[0] = x & 0xff;
 }
 
-static inline void write_uint64be(void *buffer, uint32_t x) {
+static inline void write_uint64be(void *buffer, uint64_t x) {
     uint8_t *buf = (uint8_t*) buffer;
 
     buf[7] = x & 0xff;
@@ -0,0 +1,109 @@
+#ifndef VOICE_POOL_HPP
+#define VOICE_POOL_HPP
+
+#include "util.hpp"
+#include "atomics.hpp"
+#include "genesis.h"
+
+// the voices of a node that plays overlapping sounds. the first
+// active_count are playing, in no particular order, and the rest are free,
+// so a voice is taken or given back in constant time without allocating.
+// Voice needs a long serial, which orders voices by age, and a float
+// level, the largest sample magnitude of its last block, for stealing.
+// any number of pools may count their active voices in one shared counter,
+// so that a limit holds across all of them.
+template<typename Voice>
+class VoicePool {
+public:
+    VoicePool() {
+        voices = nullptr;
+        voice_count = 0;
+        active_count = 0;
+        next_serial = 0;
+        shared_active_count = nullptr;
+    }
+    ~VoicePool() {
+        deinit();
+    }
+
+    // shared_active_count may be nullptr. not with voices active.
+    int __attribute__((warn_unused_result)) init(int count, atomic_int *shared_count) {
+        deinit();
+        if (!(voices = allocate_zero<Voice>(count)))
+            return GenesisErrorNoMem;
+        voice_count = count;
+        shared_active_count = shared_count;
+        return 0;
+    }
+
+    void deinit() {
+        release_all();
+        destroy(voices, voice_count);
+        voices = nullptr;
+        voice_count = 0;
+    }
+
+    // a free voice, if there is one and the shared count is below limit,
+    // or else nullptr
+    Voice *acquire_free(int limit) {
+        if (active_count >= voice_count)
+            return nullptr;
+        if (shared_active_count && shared_active_count->fetch_add(1) >= limit) {
+            shared_active_count->fetch_sub(1);
+            return nullptr;
+        }
+        Voice *voice = &voices[active_count++];
+        restart(voice);
+        return voice;
+    }
+
+    // the active voice to give up for a new one, the quietest or else the
+    // oldest, restarted as the newest. nullptr when none is active.
+    Voice *steal(bool quietest) {
+        if (active_count == 0)
+            return nullptr;
+        Voice *voice = &voices[0];
+        for (int i = 1; i < active_count; i += 1) {
+            Voice *other = &voices[i];
+            if (quietest ? other->level < voice->level : other->serial < voice->serial)
+                voice = other;
+        }
+        restart(voice);
+        return voice;
+    }
+
+    // gives active voice voice_index back, swapping it with the last active
+    // voice, so that whatever a voice holds for good stays with one voice.
+    // release active voices from the last to the first to visit each once.
+    void release(int voice_index) {
+        assert(voice_index >= 0 && voice_index < active_count);
+        active_count -= 1;
+        Voice released = voices[voice_index];
+        voices[voice_index] = voices[active_count];
+        voices[active_count] = released;
+        if (shared_active_count)
+            shared_active_count->fetch_sub(1);
+    }
+
+    void release_all() {
+        while (active_count > 0)
+            release(active_count - 1);
+    }
+
+    Voice *voices;
+    int voice_count;
+    int active_count;
+    long next_serial;
+    atomic_int *shared_active_count;
+
+private:
+    void restart(Voice *voice) {
+        voice->level = 0.0f;
+        voice->serial = next_serial++;
+    }
+
+    VoicePool(const VoicePool &copy) = delete;
+    VoicePool &operator=(const VoicePool &copy) = delete;
+};
+
+#endif
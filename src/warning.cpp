@@ -1,18 +1,19 @@
 #include "warning.hpp"
 #include "util.hpp"
-#include <stdio.h>
+#include "logger.hpp"
+#include "atomics.hpp"
 
-static bool seen_warnings[WarningCount] = {0};
+// warnings come from any thread, the realtime ones included
+static atomic_bool seen_warnings[WarningCount];
 
 void emit_warning(Warning warning) {
-    if (seen_warnings[warning])
+    if (seen_warnings[warning].exchange(true))
         return;
-    seen_warnings[warning] = true;
 
     switch (warning) {
         case WarningHighPriorityThread:
-            fprintf(stderr, "warning: unable to set high priority thread: Operation not permitted\n");
-            fprintf(stderr, "See https://github.com/andrewrk/genesis/wiki/warning:-unable-to-set-high-priority-thread:-Operation-not-permitted\n");
+            log_message(LogLevelWarning, "unable to set high priority thread: Operation not permitted");
+            log_message(LogLevelInfo, "See https://github.com/andrewrk/genesis/wiki/warning:-unable-to-set-high-priority-thread:-Operation-not-permitted");
             return;
         case WarningCount:
             panic("invalid warning");
@@ -0,0 +1,312 @@
+#include "waveform_peaks.hpp"
+#include "util.hpp"
+#include "os.hpp"
+
+#include <math.h>
+#include <string.h>
+
+// rms is combined as if both halves had the same number of frames, which
+// only the partial peak at the end of a level does not
+static void combine_peak(WaveformPeak *dest, const WaveformPeak *a, const WaveformPeak *b) {
+    dest->min = min(a->min, b->min);
+    dest->max = max(a->max, b->max);
+    dest->rms = sqrtf((a->rms * a->rms + b->rms * b->rms) * 0.5f);
+}
+
+int waveform_peaks_create(int channel_count, long frame_capacity, WaveformPeaks **out_peaks) {
+    *out_peaks = nullptr;
+    WaveformPeaks *peaks = create_zero<WaveformPeaks>();
+    if (!peaks)
+        return GenesisErrorNoMem;
+
+    peaks->channel_count = channel_count;
+    peaks->frame_capacity = frame_capacity;
+
+    long capacity = (frame_capacity + WAVEFORM_PEAKS_LEVEL0_FRAMES - 1) / WAVEFORM_PEAKS_LEVEL0_FRAMES;
+    while (capacity > 0 && peaks->level_count < WAVEFORM_PEAKS_MAX_LEVELS) {
+        WaveformPeaksLevel *level = &peaks->levels[peaks->level_count];
+        level->capacity = capacity;
+        if (!(level->peaks = allocate_zero<WaveformPeak>(capacity * channel_count))) {
+            waveform_peaks_destroy(peaks);
+            return GenesisErrorNoMem;
+        }
+        peaks->level_count += 1;
+        if (capacity == 1)
+            break;
+        capacity = (capacity + 1) / 2;
+    }
+
+    *out_peaks = peaks;
+    return 0;
+}
+
+void waveform_peaks_destroy(WaveformPeaks *peaks) {
+    if (!peaks)
+        return;
+    for (int i = 0; i < peaks->level_count; i += 1) {
+        WaveformPeaksLevel *level = &peaks->levels[i];
+        destroy(level->peaks, level->capacity * peaks->channel_count);
+    }
+    destroy(peaks, 1);
+}
+
+// appends one peak per channel to level_index, and every two peaks there
+// make one on the level above
+static void append_peak(WaveformPeaks *peaks, int level_index, const WaveformPeak *channel_peaks) {
+    WaveformPeaksLevel *level = &peaks->levels[level_index];
+    long index = level->count.load();
+    if (index >= level->capacity)
+        return;
+    WaveformPeak *dest = &level->peaks[index * peaks->channel_count];
+    for (int ch = 0; ch < peaks->channel_count; ch += 1)
+        dest[ch] = channel_peaks[ch];
+    level->count.store(index + 1);
+
+    if ((index & 1) && level_index + 1 < peaks->level_count) {
+        WaveformPeak combined[GENESIS_MAX_CHANNELS];
+        const WaveformPeak *prev = dest - peaks->channel_count;
+        for (int ch = 0; ch < peaks->channel_count; ch += 1)
+            combine_peak(&combined[ch], &prev[ch], &dest[ch]);
+        append_peak(peaks, level_index + 1, combined);
+    }
+}
+
+static void append_pending_peak(WaveformPeaks *peaks) {
+    for (int ch = 0; ch < peaks->channel_count; ch += 1) {
+        peaks->pending[ch].rms = sqrt(peaks->pending_square_sum[ch] / peaks->pending_frame_count);
+        peaks->pending_square_sum[ch] = 0.0;
+    }
+    peaks->pending_frame_count = 0;
+    append_peak(peaks, 0, peaks->pending);
+}
+
+void waveform_peaks_add(WaveformPeaks *peaks, const float *const *channels, int frame_count) {
+    long frame_index = peaks->frame_count.load();
+    frame_count = min((long)frame_count, peaks->frame_capacity - frame_index);
+    int offset = 0;
+    while (offset < frame_count) {
+        int take = min(frame_count - offset, WAVEFORM_PEAKS_LEVEL0_FRAMES - peaks->pending_frame_count);
+        for (int ch = 0; ch < peaks->channel_count; ch += 1) {
+            const float *src = channels[ch] + offset;
+            WaveformPeak *pending = &peaks->pending[ch];
+            float lo = (peaks->pending_frame_count == 0) ? src[0] : pending->min;
+            float hi = (peaks->pending_frame_count == 0) ? src[0] : pending->max;
+            double square_sum = 0.0;
+            for (int i = 0; i < take; i += 1) {
+                float sample = src[i];
+                lo = min(lo, sample);
+                hi = max(hi, sample);
+                square_sum += sample * sample;
+            }
+            pending->min = lo;
+            pending->max = hi;
+            peaks->pending_square_sum[ch] += square_sum;
+        }
+        peaks->pending_frame_count += take;
+        offset += take;
+        if (peaks->pending_frame_count == WAVEFORM_PEAKS_LEVEL0_FRAMES)
+            append_pending_peak(peaks);
+    }
+    peaks->frame_count.store(frame_index + frame_count);
+}
+
+void waveform_peaks_finish(WaveformPeaks *peaks) {
+    if (peaks->pending_frame_count > 0)
+        append_pending_peak(peaks);
+    // an odd peak at the end of a level has nothing to pair with, so it
+    // goes up alone, which may complete a pair on the level above
+    for (int i = 0; i + 1 < peaks->level_count; i += 1) {
+        WaveformPeaksLevel *level = &peaks->levels[i];
+        long count = level->count.load();
+        if (count & 1)
+            append_peak(peaks, i + 1, &level->peaks[(count - 1) * peaks->channel_count]);
+    }
+    peaks->complete.store(true);
+}
+
+int waveform_peaks_create_from_audio_file(GenesisAudioFile *audio_file, WaveformPeaks **out_peaks) {
+    int channel_count = genesis_audio_file_channel_layout(audio_file)->channel_count;
+    long frame_count = genesis_audio_file_frame_count(audio_file);
+    int err;
+    if ((err = waveform_peaks_create(channel_count, frame_count, out_peaks)))
+        return err;
+
+    const float *channels[GENESIS_MAX_CHANNELS];
+    for (int ch = 0; ch < channel_count; ch += 1)
+        channels[ch] = genesis_audio_file_iterator(audio_file, ch, 0).ptr;
+    // in chunks so that a frame count past INT_MAX is fine
+    static const int chunk_frames = 1024 * 1024;
+    for (long frame = 0; frame < frame_count; frame += chunk_frames) {
+        waveform_peaks_add(*out_peaks, channels, min((long)chunk_frames, frame_count - frame));
+        for (int ch = 0; ch < channel_count; ch += 1)
+            channels[ch] += chunk_frames;
+    }
+    waveform_peaks_finish(*out_peaks);
+    return 0;
+}
+
+// the header and then each level's peaks, in native byte order
+static const char peaks_file_magic[8] = {'G', 'N', 'S', 'P', 'K', 'S', '0', '1'};
+
+struct PeaksFileHeader {
+    char magic[8];
+    int32_t channel_count;
+    int32_t level_count;
+    int64_t frame_capacity;
+    int64_t level_counts[WAVEFORM_PEAKS_MAX_LEVELS];
+};
+
+int waveform_peaks_write(const WaveformPeaks *peaks, const char *path) {
+    if (!peaks->complete.load())
+        return GenesisErrorInvalidParam;
+
+    PeaksFileHeader header;
+    memset(&header, 0, sizeof(PeaksFileHeader));
+    memcpy(header.magic, peaks_file_magic, sizeof(header.magic));
+    header.channel_count = peaks->channel_count;
+    header.level_count = peaks->level_count;
+    header.frame_capacity = peaks->frame_capacity;
+    for (int i = 0; i < peaks->level_count; i += 1)
+        header.level_counts[i] = peaks->levels[i].count.load();
+
+    OsTempFile tmp_file;
+    int err;
+    if ((err = os_create_temp_file(os_path_dirname(path).raw(), &tmp_file)))
+        return err;
+    bool ok = fwrite(&header, sizeof(PeaksFileHeader), 1, tmp_file.file) == 1;
+    for (int i = 0; ok && i < peaks->level_count; i += 1) {
+        size_t count = header.level_counts[i] * peaks->channel_count;
+        ok = fwrite(peaks->levels[i].peaks, sizeof(WaveformPeak), count, tmp_file.file) == count;
+    }
+    if (fclose(tmp_file.file))
+        ok = false;
+    if (!ok) {
+        os_delete(tmp_file.path.raw());
+        return GenesisErrorFileAccess;
+    }
+    if ((err = os_rename_clobber(tmp_file.path.raw(), path))) {
+        os_delete(tmp_file.path.raw());
+        return err;
+    }
+    return 0;
+}
+
+int waveform_peaks_read(const char *path, WaveformPeaks **out_peaks) {
+    *out_peaks = nullptr;
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return GenesisErrorFileNotFound;
+
+    PeaksFileHeader header;
+    if (fread(&header, sizeof(PeaksFileHeader), 1, f) != 1 ||
+        memcmp(header.magic, peaks_file_magic, sizeof(header.magic)) != 0 ||
+        header.channel_count <= 0 || header.channel_count > GENESIS_MAX_CHANNELS ||
+        header.frame_capacity < 0)
+    {
+        fclose(f);
+        return GenesisErrorInvalidFormat;
+    }
+
+    WaveformPeaks *peaks;
+    int err;
+    if ((err = waveform_peaks_create(header.channel_count, header.frame_capacity, &peaks))) {
+        fclose(f);
+        return err;
+    }
+    bool ok = header.level_count == peaks->level_count;
+    for (int i = 0; ok && i < peaks->level_count; i += 1) {
+        WaveformPeaksLevel *level = &peaks->levels[i];
+        long count = header.level_counts[i];
+        ok = count >= 0 && count <= level->capacity &&
+            fread(level->peaks, sizeof(WaveformPeak), count * peaks->channel_count, f) ==
+                (size_t)(count * peaks->channel_count);
+        level->count.store(count);
+    }
+    fclose(f);
+    if (!ok) {
+        waveform_peaks_destroy(peaks);
+        return GenesisErrorInvalidFormat;
+    }
+    peaks->frame_count.store(peaks->frame_capacity);
+    peaks->complete.store(true);
+    *out_peaks = peaks;
+    return 0;
+}
+
+static void query_samples(const float *samples, long frame_count, int pixel_count,
+        double start_frame, double frames_per_pixel, WaveformPeak *out_peaks)
+{
+    for (int pixel = 0; pixel < pixel_count; pixel += 1) {
+        long start = max(0L, (long)floor(start_frame + pixel * frames_per_pixel));
+        long end = min(frame_count, max(start + 1, (long)ceil(start_frame + (pixel + 1) * frames_per_pixel)));
+        WaveformPeak *out = &out_peaks[pixel];
+        if (start >= end) {
+            out->min = out->max = out->rms = 0.0f;
+            continue;
+        }
+        float lo = samples[start];
+        float hi = samples[start];
+        double square_sum = 0.0;
+        for (long i = start; i < end; i += 1) {
+            float sample = samples[i];
+            lo = min(lo, sample);
+            hi = max(hi, sample);
+            square_sum += sample * sample;
+        }
+        out->min = lo;
+        out->max = hi;
+        out->rms = sqrt(square_sum / (end - start));
+    }
+}
+
+void waveform_peaks_query(const WaveformPeaks *peaks, int channel_index,
+        double start_frame, double end_frame, int pixel_count,
+        const float *samples, WaveformPeak *out_peaks)
+{
+    if (pixel_count <= 0)
+        return;
+    double frames_per_pixel = (end_frame - start_frame) / pixel_count;
+    if (frames_per_pixel < WAVEFORM_PEAKS_LEVEL0_FRAMES && samples) {
+        query_samples(samples, peaks->frame_count.load(), pixel_count,
+                start_frame, frames_per_pixel, out_peaks);
+        return;
+    }
+
+    if (peaks->level_count == 0) {
+        for (int pixel = 0; pixel < pixel_count; pixel += 1)
+            out_peaks[pixel].min = out_peaks[pixel].max = out_peaks[pixel].rms = 0.0f;
+        return;
+    }
+
+    // the coarsest level with at least one peak per pixel, so each pixel
+    // combines one to three peaks
+    int level_index = 0;
+    while (level_index + 1 < peaks->level_count &&
+        ((long)WAVEFORM_PEAKS_LEVEL0_FRAMES << (level_index + 1)) <= frames_per_pixel)
+    {
+        level_index += 1;
+    }
+
+    const WaveformPeaksLevel *level = &peaks->levels[level_index];
+    long count = level->count.load();
+    double peak_frames = (double)((long)WAVEFORM_PEAKS_LEVEL0_FRAMES << level_index);
+    for (int pixel = 0; pixel < pixel_count; pixel += 1) {
+        double pixel_start = start_frame + pixel * frames_per_pixel;
+        long start = max(0L, (long)floor(pixel_start / peak_frames));
+        long end = min(count, max(start + 1, (long)ceil((pixel_start + frames_per_pixel) / peak_frames)));
+        WaveformPeak *out = &out_peaks[pixel];
+        if (start >= end) {
+            out->min = out->max = out->rms = 0.0f;
+            continue;
+        }
+        *out = level->peaks[start * peaks->channel_count + channel_index];
+        double square_sum = out->rms * out->rms;
+        for (long i = start + 1; i < end; i += 1) {
+            const WaveformPeak *peak = &level->peaks[i * peaks->channel_count + channel_index];
+            out->min = min(out->min, peak->min);
+            out->max = max(out->max, peak->max);
+            square_sum += peak->rms * peak->rms;
+        }
+        out->rms = sqrt(square_sum / (end - start));
+    }
+}
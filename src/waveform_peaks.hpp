@@ -0,0 +1,71 @@
+#ifndef WAVEFORM_PEAKS_HPP
+#define WAVEFORM_PEAKS_HPP
+
+#include "genesis.h"
+#include "atomics.hpp"
+
+// a min/max/rms pyramid over an audio file for drawing waveforms at any
+// zoom. level 0 has one peak per WAVEFORM_PEAKS_LEVEL0_FRAMES frames and
+// each level above has one peak per two of the level below. peaks are
+// interleaved by channel. one thread builds it while others query it; the
+// storage is allocated up front so queries never see it move.
+
+static const int WAVEFORM_PEAKS_LEVEL0_FRAMES = 256;
+static const int WAVEFORM_PEAKS_MAX_LEVELS = 40;
+
+struct WaveformPeak {
+    float min;
+    float max;
+    float rms;
+};
+
+struct WaveformPeaksLevel {
+    WaveformPeak *peaks;
+    long capacity;
+    // the builder stores a peak before it bumps this
+    atomic_long count;
+};
+
+struct WaveformPeaks {
+    int channel_count;
+    long frame_capacity;
+    int level_count;
+    WaveformPeaksLevel levels[WAVEFORM_PEAKS_MAX_LEVELS];
+    // frames added so far
+    atomic_long frame_count;
+    atomic_bool complete;
+
+    // owned by the builder. the level 0 peak being accumulated.
+    WaveformPeak pending[GENESIS_MAX_CHANNELS];
+    double pending_square_sum[GENESIS_MAX_CHANNELS];
+    int pending_frame_count;
+};
+
+int waveform_peaks_create(int channel_count, long frame_capacity, WaveformPeaks **out_peaks);
+void waveform_peaks_destroy(WaveformPeaks *peaks);
+
+// folds frame_count frames into the pyramid, one buffer per channel.
+// frames past frame_capacity are dropped.
+void waveform_peaks_add(WaveformPeaks *peaks, const float *const *channels, int frame_count);
+// adds the partial peaks at the end of each level. call once after the
+// last waveform_peaks_add.
+void waveform_peaks_finish(WaveformPeaks *peaks);
+
+// builds the whole pyramid from a file whose samples are in memory
+int waveform_peaks_create_from_audio_file(GenesisAudioFile *audio_file, WaveformPeaks **out_peaks);
+
+// a finished pyramid, saved for the same machine to read back. writes to a
+// file next to path and renames it over path.
+int waveform_peaks_write(const WaveformPeaks *peaks, const char *path);
+int waveform_peaks_read(const char *path, WaveformPeaks **out_peaks);
+
+// min, max and rms of channel_index over each of the pixel_count equal
+// spans of [start_frame, end_frame). spans past what has been built so far
+// come back as zeros. the cost depends on pixel_count, not on the span,
+// except that when zoomed in past level 0 and samples is not null the
+// samples of the channel are read instead.
+void waveform_peaks_query(const WaveformPeaks *peaks, int channel_index,
+        double start_frame, double end_frame, int pixel_count,
+        const float *samples, WaveformPeak *out_peaks);
+
+#endif
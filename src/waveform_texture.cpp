@@ -0,0 +1,127 @@
+#include "waveform_texture.hpp"
+#include "gui.hpp"
+#include "gui_window.hpp"
+#include "debug_gl.hpp"
+
+// texels a row. a level wraps onto as many rows as it needs.
+static const int TEXTURE_WIDTH = 2048;
+
+static_assert(sizeof(WaveformPeak) == 3 * sizeof(float), "peaks are uploaded as they are");
+
+WaveformTexture::WaveformTexture(Gui *gui, const WaveformPeaks *peaks) :
+    _gui(gui),
+    _peaks(peaks),
+    _height(0),
+    _first_level(0),
+    _allocated(false),
+    _complete(false)
+{
+    GLint max_size;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    long max_texels = (long)TEXTURE_WIDTH * (long)max_size;
+
+    // drop the finest levels until the rest fit. they are the biggest and
+    // only matter zoomed far in.
+    long total = 0;
+    for (int i = 0; i < peaks->level_count; i += 1)
+        total += peaks->levels[i].capacity * peaks->channel_count;
+    while (total > max_texels && _first_level + 1 < peaks->level_count) {
+        total -= peaks->levels[_first_level].capacity * peaks->channel_count;
+        _first_level += 1;
+    }
+
+    long offset = 0;
+    for (int i = 0; i < WAVEFORM_PEAKS_MAX_LEVELS; i += 1) {
+        _uploaded_counts[i] = 0;
+        _level_offsets[i] = offset;
+        if (i >= _first_level && i < peaks->level_count)
+            offset += peaks->levels[i].capacity * peaks->channel_count;
+    }
+    _height = max(1, (int)((total + TEXTURE_WIDTH - 1) / TEXTURE_WIDTH));
+
+    glGenTextures(1, &_texture_id);
+    glBindTexture(GL_TEXTURE_2D, _texture_id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+WaveformTexture::~WaveformTexture() {
+    glDeleteTextures(1, &_texture_id);
+}
+
+// texels [start, end) are contiguous in memory and wrap across rows
+void WaveformTexture::upload_texels(int start, int end, const WaveformPeak *texels) {
+    while (start < end) {
+        int row = start / TEXTURE_WIDTH;
+        int x = start % TEXTURE_WIDTH;
+        int count;
+        int row_count;
+        if (x == 0 && end - start >= TEXTURE_WIDTH) {
+            // whole rows at once
+            row_count = (end - start) / TEXTURE_WIDTH;
+            count = row_count * TEXTURE_WIDTH;
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, row, TEXTURE_WIDTH, row_count,
+                    GL_RGB, GL_FLOAT, texels);
+        } else {
+            count = min(end - start, TEXTURE_WIDTH - x);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, x, row, count, 1, GL_RGB, GL_FLOAT, texels);
+        }
+        _gui->_frame_stats.texture_uploads += 1;
+        _gui->_frame_stats.texture_upload_bytes += count * (long)sizeof(WaveformPeak);
+        start += count;
+        texels += count;
+    }
+}
+
+bool WaveformTexture::update() {
+    if (_complete)
+        return false;
+
+    glBindTexture(GL_TEXTURE_2D, _texture_id);
+    if (!_allocated) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, TEXTURE_WIDTH, _height, 0, GL_RGB, GL_FLOAT, nullptr);
+        _gui->_frame_stats.texture_uploads += 1;
+        _allocated = true;
+    }
+
+    // read complete first, so that the counts after it are the last ones
+    bool complete = _peaks->complete.load();
+    int channel_count = _peaks->channel_count;
+    for (int i = _first_level; i < _peaks->level_count; i += 1) {
+        const WaveformPeaksLevel *level = &_peaks->levels[i];
+        int count = level->count.load();
+        if (count == _uploaded_counts[i])
+            continue;
+        upload_texels(_level_offsets[i] + _uploaded_counts[i] * channel_count,
+                _level_offsets[i] + count * channel_count,
+                level->peaks + _uploaded_counts[i] * channel_count);
+        _uploaded_counts[i] = count;
+    }
+    assert_no_gl_error();
+
+    _complete = complete;
+    return !complete;
+}
+
+void WaveformTexture::draw(GuiWindow *window, const glm::mat4 &mvp, int width, int height,
+        double start_frame, double frames_per_pixel,
+        const glm::vec4 &color, const glm::vec4 &rms_color)
+{
+    GuiWaveformDraw waveform;
+    waveform.texture_id = _texture_id;
+    waveform.mvp = mvp;
+    waveform.size = glm::vec2(width, height);
+    waveform.peaks_width = TEXTURE_WIDTH;
+    waveform.channel_count = _peaks->channel_count;
+    waveform.first_level = _first_level;
+    waveform.level_count = _peaks->level_count;
+    memcpy(waveform.level_offsets, _level_offsets, sizeof(waveform.level_offsets));
+    memcpy(waveform.level_peak_counts, _uploaded_counts, sizeof(waveform.level_peak_counts));
+    waveform.start_frame = start_frame;
+    waveform.frames_per_pixel = frames_per_pixel;
+    waveform.color = color;
+    waveform.rms_color = rms_color;
+    window->draw_waveform(waveform);
+}
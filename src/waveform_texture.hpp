@@ -0,0 +1,48 @@
+#ifndef WAVEFORM_TEXTURE_HPP
+#define WAVEFORM_TEXTURE_HPP
+
+#include "waveform_peaks.hpp"
+#include "glm.hpp"
+#include "glfw.hpp"
+
+class Gui;
+class GuiWindow;
+
+// the peak pyramid of one asset on the gpu, so that a waveform of any zoom
+// is one draw with nothing computed on the cpu. the levels are packed one
+// after another into a float texture, as many as fit.
+class WaveformTexture {
+public:
+    WaveformTexture(Gui *gui, const WaveformPeaks *peaks);
+    ~WaveformTexture();
+
+    // uploads the peaks built since the last call. returns whether more
+    // are still to come.
+    bool update();
+
+    // the frames from start_frame on across width by height pixels, one
+    // lane per channel
+    void draw(GuiWindow *window, const glm::mat4 &mvp, int width, int height,
+            double start_frame, double frames_per_pixel,
+            const glm::vec4 &color, const glm::vec4 &rms_color);
+
+    Gui *_gui;
+    const WaveformPeaks *_peaks;
+
+private:
+    GLuint _texture_id;
+    int _height;
+    // levels below this did not fit in the texture
+    int _first_level;
+    int _level_offsets[WAVEFORM_PEAKS_MAX_LEVELS];
+    int _uploaded_counts[WAVEFORM_PEAKS_MAX_LEVELS];
+    bool _allocated;
+    bool _complete;
+
+    void upload_texels(int start, int end, const WaveformPeak *texels);
+
+    WaveformTexture(const WaveformTexture &copy) = delete;
+    WaveformTexture &operator=(const WaveformTexture &copy) = delete;
+};
+
+#endif
@@ -10,12 +10,14 @@ Widget::Widget(GuiWindow *gui_window) :
     top(0),
     width(100),
     height(100),
-    is_visible(true)
+    is_visible(true),
+    draw_cache(nullptr)
 {
     layout_row = -1;
 }
 
 Widget::~Widget() {
+    set_draw_cached(false);
     gui_window->remove_widget(this);
     if (parent_widget)
         parent_widget->remove_widget(this);
@@ -25,7 +27,31 @@ void Widget::remove_widget(Widget *widget) {
     panic("unimplemented");
 }
 
+void Widget::queue_redraw() {
+    dirty_draw_caches();
+    gui_window->queue_redraw();
+}
+
+void Widget::set_draw_cached(bool cached) {
+    if (cached && !draw_cache) {
+        draw_cache = gui_window->create_draw_cache();
+    } else if (!cached && draw_cache) {
+        gui_window->destroy_draw_cache(draw_cache);
+        draw_cache = nullptr;
+    }
+}
+
+void Widget::dirty_draw_caches() {
+    for (Widget *widget = this; widget; widget = widget->parent_widget) {
+        if (widget->draw_cache)
+            widget->draw_cache->dirty = true;
+    }
+}
+
 void Widget::on_size_hints_changed() {
+    for (Widget *ancestor = parent_widget; ancestor; ancestor = ancestor->parent_widget)
+        ancestor->on_child_size_hints_changed();
+
     if (parent_widget) {
         parent_widget->on_resize();
     } else {
@@ -10,6 +10,7 @@ class GuiWindow;
 class Gui;
 class ContextMenuWidget;
 class MenuWidgetItem;
+struct GuiDrawCache;
 
 class Widget {
 public:
@@ -25,6 +26,18 @@ public:
 
     // call when one of the above 4 functions values will be different
     void on_size_hints_changed();
+    // called on every ancestor when a descendant's size hints change, so
+    // containers can drop the constraints they cached from their children
+    virtual void on_child_size_hints_changed() {}
+    // call when the widget looks different, other than on input to its window
+    void queue_redraw();
+    // draws the widget through a texture of its own, which it only draws
+    // into again once it or a descendant queues a redraw, gets input or
+    // moves. for subtrees which change rarely and paint all of their rect.
+    // the parent must draw it with GuiWindow::draw_widget.
+    void set_draw_cached(bool cached);
+    // makes the caches of the widget and its ancestors draw again
+    void dirty_draw_caches();
 
     // return true if you ate the event
     virtual void on_mouse_move(const MouseEvent *) {}
@@ -53,6 +66,7 @@ public:
     int layout_row;
     int layout_col;
     bool is_visible;
+    GuiDrawCache *draw_cache;
 
     // convenience methods
     glm::mat4 transform2d(int left, int top, float scale_x, float scale_y);
@@ -0,0 +1,103 @@
+#ifndef WORK_STEALING_DEQUE
+#define WORK_STEALING_DEQUE
+
+#include "error.h"
+#include "util.hpp"
+#include "atomics.hpp"
+
+#include <assert.h>
+
+// single owner, many thief, fixed size, lock-free double ended queue.
+// the owning thread pushes and pops from the bottom (last-in-first-out); any
+// other thread may steal from the top (first-in-first-out).
+// T must be a pointer type; nullptr is returned when no item is available.
+// must call resize before you can start using it
+// size must be at least equal to the maximum number of items queued at once
+template<typename T>
+class WorkStealingDeque {
+public:
+    WorkStealingDeque() {
+        _items = nullptr;
+        _size = 0;
+        _top = 0;
+        _bottom = 0;
+    }
+    ~WorkStealingDeque() {
+        destroy(_items, 0);
+    }
+
+    // this method not thread safe
+    int __attribute__((warn_unused_result)) resize(int size) {
+        if (size < 0)
+            return GenesisErrorInvalidParam;
+
+        if (size > _size) {
+            std::atomic<T> *new_items = allocate_zero<std::atomic<T>>(size);
+            if (!new_items)
+                return GenesisErrorNoMem;
+
+            destroy(_items, 0);
+            _items = new_items;
+            _size = size;
+        }
+
+        _top = 0;
+        _bottom = 0;
+
+        return 0;
+    }
+
+    // put an item on the bottom of the deque. only the owning thread may
+    // call this.
+    void push(T item) {
+        long b = _bottom.load();
+        assert(b - _top.load() < _size);
+        _items[b % _size].store(item);
+        _bottom.store(b + 1);
+    }
+
+    // take the most recently pushed item. only the owning thread may call this.
+    T pop() {
+        long b = _bottom.load() - 1;
+        _bottom.store(b);
+        long t = _top.load();
+        if (t > b) {
+            _bottom.store(b + 1);
+            return nullptr;
+        }
+        T item = _items[b % _size].load();
+        if (t == b) {
+            // last item; race against thieves for it
+            if (!_top.compare_exchange_strong(t, t + 1))
+                item = nullptr;
+            _bottom.store(b + 1);
+        }
+        return item;
+    }
+
+    // take the least recently pushed item. thread-safe. returns nullptr if the
+    // deque is empty or another thread won the race for the item.
+    T steal() {
+        long t = _top.load();
+        long b = _bottom.load();
+        if (t >= b)
+            return nullptr;
+        T item = _items[t % _size].load();
+        if (!_top.compare_exchange_strong(t, t + 1))
+            return nullptr;
+        return item;
+    }
+
+    // thread-safe, but only a hint
+    bool is_empty() const {
+        return _top.load() >= _bottom.load();
+    }
+
+private:
+    std::atomic<T> *_items;
+    int _size;
+    atomic_long _top;
+    atomic_long _bottom;
+};
+
+#endif
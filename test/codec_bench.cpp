@@ -0,0 +1,200 @@
+// measures encoding and decoding speed of every render format the context
+// has, for generated signals of several lengths, sample rates and channel
+// counts. each file is written with genesis_audio_file_stream_write and read
+// back with genesis_audio_file_load. the codec stats split the time between
+// FFmpeg and our sample format conversions. the results go to stdout as
+// json, one run per line, and a table to stderr. formats that can only be
+// read have nothing to write their files, so they are not covered. not part
+// of the unit tests; run it by hand:
+//     ./codec_bench [--seconds 10,60]
+
+#include "genesis.h"
+#include "list.hpp"
+#include "os.hpp"
+#include "util.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static const int write_chunk_frames = 4096;
+
+static const int sample_rates[] = {44100, 48000, 96000};
+static const SoundIoChannelLayoutId layout_ids[] = {
+    SoundIoChannelLayoutIdMono,
+    SoundIoChannelLayoutIdStereo,
+    SoundIoChannelLayoutId5Point1,
+};
+
+static bool first_result = true;
+
+// a different tone in each channel, with a little noise so that lossless
+// codecs have some work to do
+static void fill_signal(float *frames, int channel_count, int sample_rate, long frame_index,
+        int frame_count, uint32_t *seed)
+{
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        double t = (frame_index + frame) / (double)sample_rate;
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            *seed = *seed * 1664525u + 1013904223u;
+            float noise = ((*seed >> 8) / 16777216.0f - 0.5f) * 0.01f;
+            frames[frame * channel_count + ch] = 0.5f * sinf(2.0f * M_PI * (220.0f + 110.0f * ch) * t) + noise;
+        }
+    }
+}
+
+static long file_size(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return 0;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+// returns an error if the codec cannot take this format
+static int run(GenesisContext *context, GenesisRenderFormat *render_format, double seconds,
+        int sample_rate, SoundIoChannelLayoutId layout_id)
+{
+    GenesisAudioFileCodec *codec = genesis_render_format_codec(render_format);
+    if (!genesis_audio_file_codec_supports_sample_rate(codec, sample_rate))
+        return GenesisErrorInvalidParam;
+    const SoundIoChannelLayout *layout = soundio_channel_layout_get_builtin(layout_id);
+    int channel_count = layout->channel_count;
+
+    GenesisExportFormat format;
+    format.codec = codec;
+    format.sample_format = genesis_audio_file_codec_sample_format_index(codec,
+            genesis_audio_file_codec_best_sample_format(codec));
+    format.bit_rate = (genesis_audio_file_codec_bit_rate_count(codec) > 0) ?
+        genesis_audio_file_codec_bit_rate_index(codec, genesis_audio_file_codec_best_bit_rate(codec)) : 0;
+    format.sample_rate = sample_rate;
+    format.resample_quality = GenesisResampleQualityRealtime;
+    format.dither = GenesisDitherNone;
+
+    char path[256];
+    snprintf(path, sizeof(path), "/tmp/genesis_codec_bench.%s", genesis_render_format_name(render_format));
+    os_delete(path);
+
+    long frame_count = seconds * sample_rate;
+    float *frames = ok_mem(allocate_nonzero<float>(write_chunk_frames * channel_count));
+    uint32_t seed = 1;
+
+    genesis_reset_codec_stats(context);
+    double start_time = os_get_time();
+    GenesisAudioFileStream *stream = ok_mem(genesis_audio_file_stream_create(context));
+    genesis_audio_file_stream_set_sample_rate(stream, sample_rate);
+    genesis_audio_file_stream_set_channel_layout(stream, layout);
+    genesis_audio_file_stream_set_export_format(stream, &format);
+    int err;
+    if ((err = genesis_audio_file_stream_open(stream, path, -1))) {
+        genesis_audio_file_stream_destroy(stream);
+        destroy(frames, write_chunk_frames * channel_count);
+        return err;
+    }
+    // the signal is made outside the timed part
+    double fill_seconds = 0.0;
+    for (long frame_index = 0; frame_index < frame_count; frame_index += write_chunk_frames) {
+        int amt = min((long)write_chunk_frames, frame_count - frame_index);
+        double fill_start_time = os_get_time();
+        fill_signal(frames, channel_count, sample_rate, frame_index, amt, &seed);
+        fill_seconds += os_get_time() - fill_start_time;
+        ok_or_panic(genesis_audio_file_stream_write(stream, frames, amt));
+    }
+    ok_or_panic(genesis_audio_file_stream_close(stream));
+    genesis_audio_file_stream_destroy(stream);
+    double encode_seconds = os_get_time() - start_time - fill_seconds;
+    destroy(frames, write_chunk_frames * channel_count);
+    GenesisCodecStats encode_stats;
+    genesis_get_codec_stats(context, &encode_stats);
+
+    genesis_reset_codec_stats(context);
+    start_time = os_get_time();
+    GenesisAudioFile *audio_file;
+    ok_or_panic(genesis_audio_file_load(context, path, &audio_file));
+    double decode_seconds = os_get_time() - start_time;
+    GenesisCodecStats decode_stats;
+    genesis_get_codec_stats(context, &decode_stats);
+    long memory_bytes = genesis_audio_file_memory_bytes(audio_file);
+    long decoded_frame_count = genesis_audio_file_frame_count(audio_file);
+    genesis_audio_file_destroy(audio_file);
+    long encoded_bytes = file_size(path);
+    os_delete(path);
+
+    double audio_seconds = frame_count / (double)sample_rate;
+    printf("%s{\"format\":\"%s\",\"seconds\":%.0f,\"sample_rate\":%d,\"channels\":%d,"
+            "\"sample_format\":\"%s\",\"bit_rate\":%d,\"file_bytes\":%ld,"
+            "\"encode_realtime\":%.1f,\"encode_ffmpeg_s\":%.4f,\"encode_convert_s\":%.4f,"
+            "\"decode_realtime\":%.1f,\"decode_ffmpeg_s\":%.4f,\"decode_convert_s\":%.4f,"
+            "\"decoded_frames\":%ld,\"decoded_bytes\":%ld}",
+            first_result ? "[\n" : ",\n", genesis_render_format_name(render_format), seconds, sample_rate,
+            channel_count, soundio_format_string(format.sample_format), format.bit_rate, encoded_bytes,
+            audio_seconds / encode_seconds, encode_stats.encode_seconds, encode_stats.export_seconds,
+            audio_seconds / decode_seconds, decode_stats.decode_seconds, decode_stats.import_seconds,
+            decoded_frame_count, memory_bytes);
+    first_result = false;
+    fflush(stdout);
+    fprintf(stderr, "%-6s %4.0fs %6d Hz %d ch  encode %8.1fx (%5.1f%% converting)  "
+            "decode %8.1fx (%5.1f%% converting)\n",
+            genesis_render_format_name(render_format), seconds, sample_rate, channel_count,
+            audio_seconds / encode_seconds, 100.0 * encode_stats.export_seconds / encode_seconds,
+            audio_seconds / decode_seconds, 100.0 * decode_stats.import_seconds / decode_seconds);
+    return 0;
+}
+
+static int usage(const char *exe) {
+    fprintf(stderr, "Usage: %s [--seconds 10,60]\n", exe);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    List<double> lengths;
+    for (int i = 1; i < argc; i += 1) {
+        if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            char *arg = argv[++i];
+            while (*arg) {
+                char *end;
+                double seconds = strtod(arg, &end);
+                if (end == arg || seconds <= 0.0)
+                    return usage(argv[0]);
+                ok_or_panic(lengths.append(seconds));
+                arg = (*end == ',') ? end + 1 : end;
+            }
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if (lengths.length() == 0) {
+        ok_or_panic(lengths.append(10.0));
+        ok_or_panic(lengths.append(60.0));
+    }
+
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    genesis_set_codec_stats_enabled(context, true);
+
+    for (int format_i = 0; format_i < genesis_out_format_count(context); format_i += 1) {
+        GenesisRenderFormat *render_format = genesis_out_format_index(context, format_i);
+        for (int length_i = 0; length_i < lengths.length(); length_i += 1) {
+            for (int rate_i = 0; rate_i < array_length(sample_rates); rate_i += 1) {
+                for (int layout_i = 0; layout_i < array_length(layout_ids); layout_i += 1) {
+                    int err = run(context, render_format, lengths.at(length_i),
+                            sample_rates[rate_i], layout_ids[layout_i]);
+                    if (err) {
+                        fprintf(stderr, "%-6s %4.0fs %6d Hz %d ch  skipped: %s\n",
+                                genesis_render_format_name(render_format), lengths.at(length_i),
+                                sample_rates[rate_i],
+                                soundio_channel_layout_get_builtin(layout_ids[layout_i])->channel_count,
+                                genesis_strerror(err));
+                    }
+                }
+            }
+        }
+    }
+
+    printf("%s\n]\n", first_result ? "[" : "");
+    genesis_context_destroy(context);
+    return 0;
+}
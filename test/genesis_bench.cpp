@@ -0,0 +1,403 @@
+// microbenchmarks of the node kernels and the sample format converters.
+// each node runs in an offline pipeline between synthetic sources and a
+// sink, and its time comes from the node stats, so the sources and the sink
+// are not counted. the results go to stdout as json, one benchmark per
+// line in a fixed order, so that runs from two releases can be diffed; a
+// table goes to stderr. not part of the unit tests; run it by hand:
+//     ./genesis_bench [--seconds 2]
+
+#include "genesis.hpp"
+#include "mixer_node.hpp"
+#include "sample_format.hpp"
+#include "os.hpp"
+#include "util.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// seconds of output per node benchmark
+static double run_seconds = 2.0;
+// samples per call of the converter benchmarks
+static const int convert_sample_count = 4096;
+static const int convert_repeat_count = 2000;
+
+static bool first_result = true;
+
+static void report(const char *name, const char *params, double ns_per_frame, long frames) {
+    printf("%s{\"name\":\"%s\",%s,\"ns_per_frame\":%.3f,\"frames\":%ld}",
+            first_result ? "[\n" : ",\n", name, params, ns_per_frame, frames);
+    first_result = false;
+    fprintf(stderr, "%-16s %-48s %12.3f ns/frame\n", name, params, ns_per_frame);
+}
+
+struct SineSource {
+    double re;
+    double im;
+    double step_re;
+    double step_im;
+    long frame_index;
+};
+
+static int sine_source_create(struct GenesisNode *node) {
+    SineSource *source = create_zero<SineSource>();
+    if (!source)
+        return GenesisErrorNoMem;
+    // a different pitch for each source, so mixes do not cancel out
+    double step = 2.0 * M_PI * (220.0 + 110.0 * (node->set_index % 8)) / 44100.0;
+    source->re = 1.0;
+    source->step_re = cos(step);
+    source->step_im = sin(step);
+    node->userdata = source;
+    return 0;
+}
+
+static void sine_source_destroy(struct GenesisNode *node) {
+    SineSource *source = (SineSource *)node->userdata;
+    destroy(source, 1);
+}
+
+static void sine_source_run(struct GenesisNode *node) {
+    SineSource *source = (SineSource *)node->userdata;
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int channel_count = genesis_audio_port_channel_layout(audio_out_port)->channel_count;
+    int frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        float sample = 0.25 * source->im;
+        for (int ch = 0; ch < channel_count; ch += 1)
+            out_buf[frame * channel_count + ch] = sample;
+        double re = source->re * source->step_re - source->im * source->step_im;
+        double im = source->re * source->step_im + source->im * source->step_re;
+        source->re = re;
+        source->im = im;
+        source->frame_index += 1;
+        // keep rounding errors from growing the amplitude
+        if ((source->frame_index & 0xffff) == 0) {
+            double length = sqrt(source->re * source->re + source->im * source->im);
+            source->re /= length;
+            source->im /= length;
+        }
+    }
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+struct NoteSource {
+    int note_count;
+    bool sent;
+};
+
+// note_count notes on at the start, held for the whole run
+static void note_source_run(struct GenesisNode *node) {
+    NoteSource *source = (NoteSource *)genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *events_out_port = genesis_node_port(node, 0);
+    int event_count;
+    double time_requested;
+    genesis_events_out_port_free_count(events_out_port, &event_count, &time_requested);
+    GenesisMidiEvent *event = genesis_events_out_port_write_ptr(events_out_port);
+    int written_count = 0;
+    if (!source->sent) {
+        assert(event_count >= source->note_count);
+        for (int i = 0; i < source->note_count; i += 1) {
+            event->event_type = GenesisMidiEventTypeNoteOn;
+            event->start = 0.0;
+            event->data.note_data.note = 36 + i;
+            event->data.note_data.velocity = 0.5f;
+            event += 1;
+            written_count += 1;
+        }
+        source->sent = true;
+    }
+    genesis_events_out_port_advance_write_ptr(events_out_port, written_count, time_requested);
+}
+
+static void set_port_format(struct GenesisPortDescriptor *port_descr, SoundIoChannelLayoutId layout_id,
+        int sample_rate, bool fixed)
+{
+    ok_or_panic(genesis_audio_port_descriptor_set_channel_layout(port_descr,
+        soundio_channel_layout_get_builtin(layout_id), fixed, -1));
+    ok_or_panic(genesis_audio_port_descriptor_set_sample_rate(port_descr, sample_rate, fixed, -1));
+}
+
+static struct GenesisNodeDescriptor *create_sine_descriptor(struct GenesisPipeline *pipeline,
+        SoundIoChannelLayoutId layout_id, int sample_rate)
+{
+    struct GenesisNodeDescriptor *descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "bench_sine", "Benchmark sine source."));
+    genesis_node_descriptor_set_create_callback(descr, sine_source_create);
+    genesis_node_descriptor_set_destroy_callback(descr, sine_source_destroy);
+    genesis_node_descriptor_set_run_callback(descr, sine_source_run);
+    set_port_format(ok_mem(genesis_node_descriptor_create_port(descr, 0, GenesisPortTypeAudioOut,
+                    "audio_out")), layout_id, sample_rate, true);
+    return descr;
+}
+
+static struct GenesisNode *create_sink(struct GenesisPipeline *pipeline,
+        SoundIoChannelLayoutId layout_id, int sample_rate)
+{
+    struct GenesisNodeDescriptor *descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "bench_sink", "Benchmark sink."));
+    set_port_format(ok_mem(genesis_node_descriptor_create_port(descr, 0, GenesisPortTypeAudioIn,
+                    "audio_in")), layout_id, sample_rate, true);
+    return ok_mem(genesis_node_descriptor_create_node(descr));
+}
+
+// runs the pipeline until the sink has read run_seconds of audio. returns
+// the ns per frame that node spent, and the frames it processed.
+static double run_and_measure(struct GenesisPipeline *pipeline, struct GenesisNode *node,
+        struct GenesisNode *sink_node, int sample_rate, long *out_frames)
+{
+    genesis_pipeline_set_node_stats_enabled(pipeline, true);
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+    struct GenesisPort *audio_in_port = genesis_node_port(sink_node, 0);
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, 0);
+    long total_frames = run_seconds * sample_rate;
+    long frames_read = 0;
+    double start_time = os_get_time();
+    while (frames_read < total_frames) {
+        if (os_get_time() - start_time > 60.0 + 60.0 * run_seconds)
+            panic("benchmark stalled after %ld frames", frames_read);
+        int frame_count = min((long)genesis_audio_in_port_fill_count(audio_in_port), total_frames - frames_read);
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+        frames_read += frame_count;
+    }
+    genesis_pipeline_stop(pipeline);
+
+    GenesisNodeStats stats;
+    genesis_node_get_stats(node, &stats);
+    *out_frames = stats.frames_processed;
+    return (stats.frames_processed > 0) ? stats.total_run_time * 1e9 / stats.frames_processed : 0.0;
+}
+
+static void bench_resample(GenesisContext *context, int in_sample_rate, int out_sample_rate,
+        SoundIoChannelLayoutId in_layout, SoundIoChannelLayoutId out_layout)
+{
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_offline(pipeline, true));
+
+    struct GenesisNodeDescriptor *source_descr = create_sine_descriptor(pipeline, in_layout, in_sample_rate);
+    struct GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    struct GenesisNodeDescriptor *resample_descr = ok_mem(genesis_node_descriptor_find(pipeline, "resample"));
+    struct GenesisNode *resample_node = ok_mem(genesis_node_descriptor_create_node(resample_descr));
+    struct GenesisNode *sink_node = create_sink(pipeline, out_layout, out_sample_rate);
+    ok_or_panic(genesis_connect_audio_nodes(source_node, resample_node));
+    ok_or_panic(genesis_connect_audio_nodes(resample_node, sink_node));
+
+    long frames;
+    double ns = run_and_measure(pipeline, resample_node, sink_node, out_sample_rate, &frames);
+    genesis_pipeline_destroy(pipeline);
+
+    char params[256];
+    snprintf(params, sizeof(params), "\"in_rate\":%d,\"out_rate\":%d,\"in_layout\":\"%s\",\"out_layout\":\"%s\"",
+            in_sample_rate, out_sample_rate,
+            soundio_channel_layout_get_builtin(in_layout)->name,
+            soundio_channel_layout_get_builtin(out_layout)->name);
+    report("resample", params, ns, frames);
+}
+
+static void bench_mixer(GenesisContext *context, int input_count) {
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_offline(pipeline, true));
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+
+    struct GenesisNodeDescriptor *mixer_descr;
+    ok_or_panic(create_mixer_descriptor(pipeline, input_count, &mixer_descr));
+    struct GenesisNode *mixer_node = ok_mem(genesis_node_descriptor_create_node(mixer_descr));
+    // the output first, so that the inputs have a layout to match
+    struct GenesisNode *sink_node = create_sink(pipeline, SoundIoChannelLayoutIdStereo, sample_rate);
+    ok_or_panic(genesis_connect_ports(genesis_node_port(mixer_node, 0), genesis_node_port(sink_node, 0)));
+    struct GenesisNodeDescriptor *source_descr = create_sine_descriptor(pipeline,
+            SoundIoChannelLayoutIdStereo, sample_rate);
+    for (int i = 0; i < input_count; i += 1) {
+        struct GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+        ok_or_panic(genesis_connect_ports(genesis_node_port(source_node, 0), genesis_node_port(mixer_node, i + 1)));
+        // so that the gains and pans are not all the fast default
+        ok_or_panic(mixer_node_set_input(mixer_node, i, 0.5f, (i % 3 - 1) * 0.5f));
+    }
+
+    long frames;
+    double ns = run_and_measure(pipeline, mixer_node, sink_node, sample_rate, &frames);
+    genesis_pipeline_destroy(pipeline);
+
+    char params[64];
+    snprintf(params, sizeof(params), "\"inputs\":%d", input_count);
+    report("mixer", params, ns, frames);
+}
+
+static void bench_delay(GenesisContext *context, double feedback) {
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_offline(pipeline, true));
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+
+    struct GenesisNodeDescriptor *source_descr = create_sine_descriptor(pipeline,
+            SoundIoChannelLayoutIdMono, sample_rate);
+    struct GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    struct GenesisNodeDescriptor *delay_descr = ok_mem(genesis_node_descriptor_find(pipeline, "delay"));
+    struct GenesisNode *delay_node = ok_mem(genesis_node_descriptor_create_node(delay_descr));
+    struct GenesisNode *sink_node = create_sink(pipeline, SoundIoChannelLayoutIdMono, sample_rate);
+    ok_or_panic(genesis_connect_audio_nodes(source_node, delay_node));
+    ok_or_panic(genesis_connect_audio_nodes(delay_node, sink_node));
+    ok_or_panic(genesis_delay_node_set_params(delay_node, 0.125, feedback, 0.5f));
+
+    long frames;
+    double ns = run_and_measure(pipeline, delay_node, sink_node, sample_rate, &frames);
+    genesis_pipeline_destroy(pipeline);
+
+    char params[64];
+    snprintf(params, sizeof(params), "\"feedback\":%.2f", feedback);
+    report("delay", params, ns, frames);
+}
+
+static void bench_synth(GenesisContext *context, int note_count) {
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_offline(pipeline, true));
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+
+    NoteSource source = {note_count, false};
+    struct GenesisNodeDescriptor *source_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "bench_notes", "Benchmark note source."));
+    genesis_node_descriptor_set_userdata(source_descr, &source);
+    genesis_node_descriptor_set_run_callback(source_descr, note_source_run);
+    ok_mem(genesis_node_descriptor_create_port(source_descr, 0, GenesisPortTypeEventsOut, "events_out"));
+    struct GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+
+    struct GenesisNodeDescriptor *synth_descr = ok_mem(genesis_node_descriptor_find(pipeline, "synth"));
+    struct GenesisNode *synth_node = ok_mem(genesis_node_descriptor_create_node(synth_descr));
+    struct GenesisNode *sink_node = create_sink(pipeline, SoundIoChannelLayoutIdMono, sample_rate);
+    ok_or_panic(genesis_connect_ports(genesis_node_port(source_node, 0), genesis_node_port(synth_node, 0)));
+    ok_or_panic(genesis_connect_audio_nodes(synth_node, sink_node));
+
+    long frames;
+    double ns = run_and_measure(pipeline, synth_node, sink_node, sample_rate, &frames);
+    genesis_pipeline_destroy(pipeline);
+
+    char params[64];
+    snprintf(params, sizeof(params), "\"notes\":%d", note_count);
+    report("synth", params, ns, frames);
+}
+
+static const char *simd_name(SampleFormatSimd simd) {
+    switch (simd) {
+        case SampleFormatSimdNone: return "none";
+        case SampleFormatSimdSse2: return "sse2";
+        case SampleFormatSimdAvx2: return "avx2";
+        case SampleFormatSimdNeon: return "neon";
+    }
+    panic("invalid simd");
+}
+
+// per stereo frame, both ways, with every instruction set this cpu has
+static void bench_sample_formats(void) {
+    static const SampleFormatSimd simds[] = {
+        SampleFormatSimdNone,
+        SampleFormatSimdSse2,
+        SampleFormatSimdAvx2,
+        SampleFormatSimdNeon,
+    };
+    float *floats = ok_mem(allocate_zero<float>(convert_sample_count));
+    char *bytes = ok_mem(allocate_zero<char>(convert_sample_count * 8));
+    for (int i = 0; i < convert_sample_count; i += 1)
+        floats[i] = sinf(i * 0.01f) * 1.1f;
+    long frames = (long)convert_sample_count / 2 * convert_repeat_count;
+
+    for (int simd_i = 0; simd_i < array_length(simds); simd_i += 1) {
+        if (!sample_format_simd_supported(simds[simd_i]))
+            continue;
+        sample_format_select_simd(simds[simd_i]);
+        for (int i = 0; i < sample_format_info_count(); i += 1) {
+            const SampleFormatInfo *info = sample_format_info_at(i);
+
+            double start_time = os_get_time();
+            for (int rep = 0; rep < convert_repeat_count; rep += 1)
+                info->write_samples(bytes, floats, convert_sample_count);
+            double write_ns = (os_get_time() - start_time) * 1e9 / frames;
+
+            start_time = os_get_time();
+            for (int rep = 0; rep < convert_repeat_count; rep += 1)
+                info->read_samples(floats, bytes, convert_sample_count);
+            double read_ns = (os_get_time() - start_time) * 1e9 / frames;
+
+            char params[128];
+            snprintf(params, sizeof(params), "\"format\":\"%s\",\"simd\":\"%s\",\"direction\":\"write\"",
+                    soundio_format_string(info->format), simd_name(simds[simd_i]));
+            report("sample_format", params, write_ns, frames);
+            snprintf(params, sizeof(params), "\"format\":\"%s\",\"simd\":\"%s\",\"direction\":\"read\"",
+                    soundio_format_string(info->format), simd_name(simds[simd_i]));
+            report("sample_format", params, read_ns, frames);
+        }
+    }
+    sample_format_select_simd(sample_format_best_simd());
+
+    destroy(bytes, convert_sample_count * 8);
+    destroy(floats, convert_sample_count);
+}
+
+static int usage(const char *exe) {
+    fprintf(stderr, "Usage: %s [--seconds 2]\n", exe);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i += 1) {
+        if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            run_seconds = atof(argv[++i]);
+            if (run_seconds <= 0.0)
+                return usage(argv[0]);
+        } else {
+            return usage(argv[0]);
+        }
+    }
+
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+
+    struct RatePair {
+        int in_sample_rate;
+        int out_sample_rate;
+    };
+    static const RatePair rate_pairs[] = {
+        {44100, 44100},
+        {44100, 48000},
+        {48000, 44100},
+        {48000, 96000},
+        {96000, 48000},
+    };
+    struct LayoutPair {
+        SoundIoChannelLayoutId in_layout;
+        SoundIoChannelLayoutId out_layout;
+    };
+    static const LayoutPair layout_pairs[] = {
+        {SoundIoChannelLayoutIdMono, SoundIoChannelLayoutIdMono},
+        {SoundIoChannelLayoutIdStereo, SoundIoChannelLayoutIdStereo},
+        {SoundIoChannelLayoutIdMono, SoundIoChannelLayoutIdStereo},
+        {SoundIoChannelLayoutId5Point1, SoundIoChannelLayoutIdStereo},
+    };
+    for (int rate_i = 0; rate_i < array_length(rate_pairs); rate_i += 1) {
+        for (int layout_i = 0; layout_i < array_length(layout_pairs); layout_i += 1) {
+            bench_resample(context, rate_pairs[rate_i].in_sample_rate, rate_pairs[rate_i].out_sample_rate,
+                    layout_pairs[layout_i].in_layout, layout_pairs[layout_i].out_layout);
+        }
+    }
+
+    static const int mixer_input_counts[] = {1, 2, 8, 16};
+    for (int i = 0; i < array_length(mixer_input_counts); i += 1)
+        bench_mixer(context, mixer_input_counts[i]);
+
+    bench_delay(context, 0.0);
+    bench_delay(context, 0.5);
+
+    static const int synth_note_counts[] = {1, 8, 32, 64};
+    for (int i = 0; i < array_length(synth_note_counts); i += 1)
+        bench_synth(context, synth_note_counts[i]);
+
+    bench_sample_formats();
+
+    printf("\n]\n");
+    genesis_context_destroy(context);
+    return 0;
+}
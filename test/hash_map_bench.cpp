@@ -0,0 +1,102 @@
+// measures insert and lookup in HashMap and FlatHashMap with uint256 keys,
+// as IdMap uses them. lookups go in a different order than the inserts so
+// that they miss the cache the way the project's do. not part of the unit
+// tests; run it by hand:
+//     ./hash_map_bench
+
+#include "hash_map.hpp"
+#include "flat_hash_map.hpp"
+#include "id_map.hpp"
+#include "list.hpp"
+#include "genesis.h"
+#include "os.hpp"
+
+#include <stdio.h>
+
+static const int entry_counts[] = {1000, 100000, 1000000};
+// every measurement does at least this many operations
+static const int min_op_count = 4000000;
+
+struct BenchResult {
+    double insert_ns;
+    double hit_ns;
+    double miss_ns;
+};
+
+template<typename Map>
+static BenchResult run(const List<uint256> &keys, const List<uint256> &lookup_keys,
+        const List<uint256> &missing_keys)
+{
+    int count = keys.length();
+    int rounds = max(1, min_op_count / count);
+    BenchResult result = {};
+    long found = 0;
+    for (int round = 0; round < rounds; round += 1) {
+        Map *map = ok_mem(create_zero<Map>());
+        double start = os_get_time();
+        for (int i = 0; i < count; i += 1)
+            map->put(keys.at(i), i);
+        double inserted = os_get_time();
+        for (int i = 0; i < count; i += 1)
+            found += map->maybe_get(lookup_keys.at(i)) ? 1 : 0;
+        double hit = os_get_time();
+        for (int i = 0; i < count; i += 1)
+            found += map->maybe_get(missing_keys.at(i)) ? 1 : 0;
+        double missed = os_get_time();
+        result.insert_ns += inserted - start;
+        result.hit_ns += hit - inserted;
+        result.miss_ns += missed - hit;
+        destroy(map, 1);
+    }
+    if (found != (long)count * rounds)
+        panic("lookups went wrong");
+    double scale = 1000000000.0 / ((double)count * rounds);
+    result.insert_ns *= scale;
+    result.hit_ns *= scale;
+    result.miss_ns *= scale;
+    return result;
+}
+
+static void print_result(const char *name, int count, const BenchResult &result) {
+    fprintf(stderr, "%12s %10d %10.1f %10.1f %10.1f\n", name, count,
+            result.insert_ns, result.hit_ns, result.miss_ns);
+}
+
+int main(int argc, char *argv[]) {
+    // do all the one-time initialization stuff
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    genesis_context_destroy(context);
+
+    fprintf(stderr, "nanoseconds per operation\n");
+    fprintf(stderr, "%12s %10s %10s %10s %10s\n", "map", "entries", "insert", "hit", "miss");
+    for (int i = 0; i < array_length(entry_counts); i += 1) {
+        int count = entry_counts[i];
+        List<uint256> keys;
+        List<uint256> lookup_keys;
+        List<uint256> missing_keys;
+        for (int j = 0; j < count; j += 1) {
+            ok_or_panic(keys.append(uint256::random()));
+            ok_or_panic(missing_keys.append(uint256::random()));
+        }
+        ok_or_panic(lookup_keys.resize(count));
+        for (int j = 0; j < count; j += 1)
+            lookup_keys.at(j) = keys.at(j);
+        // fisher-yates with a fixed lcg so that runs compare
+        uint32_t state = 1;
+        for (int j = count - 1; j > 0; j -= 1) {
+            state = state * 1664525 + 1013904223;
+            int k = state % (j + 1);
+            uint256 tmp = lookup_keys.at(j);
+            lookup_keys.at(j) = lookup_keys.at(k);
+            lookup_keys.at(k) = tmp;
+        }
+
+        print_result("HashMap", count,
+                run<HashMap<uint256, int, hash_uint256>>(keys, lookup_keys, missing_keys));
+        print_result("FlatHashMap", count,
+                run<FlatHashMap<uint256, int, hash_uint256>>(keys, lookup_keys, missing_keys));
+    }
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+// measures OrderedMapFile transactions per second with each durability
+// policy. producers queue small put batches as fast as they can and the time
+// includes the flush at the end, so every transaction is on disk when the
+// clock stops. not part of the unit tests; run it by hand, optionally with a
+// path on the disk to measure:
+//     ./ordered_map_file_bench [path]
+
+#include "ordered_map_file.hpp"
+#include "os.hpp"
+
+#include <stdio.h>
+
+static const int max_producer_count = 4;
+static const int transaction_count = 20000;
+static const int value_size = 64;
+static const int sync_interval_ms = 10;
+
+struct Bench {
+    OrderedMapFile *omf;
+    int transactions_per_producer;
+    atomic_int next_key;
+};
+
+static void producer_run(void *userdata) {
+    Bench *bench = (Bench *)userdata;
+    for (int i = 0; i < bench->transactions_per_producer; i += 1) {
+        int key_index = bench->next_key.fetch_add(1);
+        OrderedMapFileBatch *batch = ok_mem(ordered_map_file_batch_create(bench->omf));
+        OrderedMapFileBuffer *key = ok_mem(ordered_map_file_buffer_create(4));
+        OrderedMapFileBuffer *value = ok_mem(ordered_map_file_buffer_create(value_size));
+        write_uint32be((uint8_t *)key->data, key_index);
+        memset(value->data, key_index & 0xff, value_size);
+        ok_or_panic(ordered_map_file_batch_put(batch, key, value));
+        ok_or_panic(ordered_map_file_batch_exec(batch));
+    }
+}
+
+static double run(const char *path, OrderedMapFileDurability durability, int producer_count) {
+    os_delete(path);
+    Bench bench;
+    bench.transactions_per_producer = transaction_count / producer_count;
+    bench.next_key.store(0);
+    ok_or_panic(ordered_map_file_open(path, &bench.omf));
+    ordered_map_file_done_reading(bench.omf);
+    ordered_map_file_set_durability(bench.omf, durability, sync_interval_ms);
+
+    OsThread *producers[max_producer_count];
+    double start = os_get_time();
+    for (int i = 0; i < producer_count; i += 1)
+        ok_or_panic(os_thread_create(producer_run, &bench, false, &producers[i]));
+    for (int i = 0; i < producer_count; i += 1)
+        os_thread_destroy(producers[i]);
+    ordered_map_file_flush(bench.omf);
+    double elapsed = os_get_time() - start;
+
+    ordered_map_file_close(bench.omf);
+    os_delete(path);
+    return (bench.transactions_per_producer * producer_count) / elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = (argc >= 2) ? argv[1] : "/tmp/genesis_ordered_map_file_bench.gdaw";
+
+    // do all the one-time initialization stuff
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    genesis_context_destroy(context);
+
+    static const OrderedMapFileDurability durabilities[] = {
+        OrderedMapFileDurabilityNone,
+        OrderedMapFileDurabilityGroup,
+        OrderedMapFileDurabilityInterval,
+    };
+    static const char *durability_names[] = {"none", "group", "interval"};
+    static const int producer_counts[] = {1, max_producer_count};
+
+    fprintf(stderr, "%d transactions of %d bytes, interval %d ms\n",
+            transaction_count, value_size, sync_interval_ms);
+    fprintf(stderr, "%10s %10s %14s\n", "policy", "producers", "transactions/s");
+    for (int i = 0; i < array_length(durabilities); i += 1) {
+        for (int j = 0; j < array_length(producer_counts); j += 1) {
+            double tps = run(path, durabilities[i], producer_counts[j]);
+            fprintf(stderr, "%10s %10d %14.0f\n", durability_names[i], producer_counts[j], tps);
+        }
+    }
+
+    return 0;
+}
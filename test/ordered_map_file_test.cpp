@@ -138,10 +138,506 @@ static void test_many_data(void) {
     delete_tmp_file();
 }
 
+static void test_durability(OrderedMapFileDurability durability) {
+    OrderedMapFile *omf;
+    int err = ordered_map_file_open(tmp_file_path, &omf);
+    assert(err == 0);
+    assert(omf);
+    ordered_map_file_done_reading(omf);
+    ordered_map_file_set_durability(omf, durability, 5);
+
+    for (int i = 0; i < 200; i += 1) {
+        OrderedMapFileBatch *batch = ordered_map_file_batch_create(omf);
+
+        OrderedMapFileBuffer *key = ordered_map_file_buffer_create(4);
+        OrderedMapFileBuffer *value = ordered_map_file_buffer_create(4);
+
+        sprintf(key->data, "%03d", i);
+        sprintf(value->data, "%03d", i);
+
+        ordered_map_file_batch_put(batch, key, value);
+
+        if (i % 2 == 1) {
+            OrderedMapFileBuffer *del_key = ordered_map_file_buffer_create(4);
+            sprintf(del_key->data, "%03d", i - 1);
+            ordered_map_file_batch_del(batch, del_key);
+        }
+
+        int err = ordered_map_file_batch_exec(batch);
+        assert(err == 0);
+
+        if (i == 100)
+            ordered_map_file_flush(omf);
+    }
+
+    ordered_map_file_close(omf);
+
+    omf = nullptr;
+    err = ordered_map_file_open(tmp_file_path, &omf);
+    assert(err == 0);
+    assert(omf);
+
+    assert(ordered_map_file_count(omf) == 100);
+    for (int i = 0; i < 100; i += 1) {
+        ByteBuffer expected_key;
+        expected_key.format("%03d", i * 2 + 1);
+        expected_key.resize(4);
+        assert(ordered_map_file_find_key(omf, expected_key) == i);
+    }
+
+    ordered_map_file_done_reading(omf);
+    ordered_map_file_close(omf);
+    delete_tmp_file();
+}
+
+static void put_value(OrderedMapFile *omf, const char *key_str, int value) {
+    OrderedMapFileBatch *batch = ordered_map_file_batch_create(omf);
+    OrderedMapFileBuffer *key = ordered_map_file_buffer_create(strlen(key_str));
+    OrderedMapFileBuffer *val = ordered_map_file_buffer_create(256);
+    memcpy(key->data, key_str, key->size);
+    memset(val->data, value, val->size);
+    ordered_map_file_batch_put(batch, key, val);
+    int err = ordered_map_file_batch_exec(batch);
+    assert(err == 0);
+}
+
+static void test_compaction(void) {
+    OrderedMapFile *omf;
+    int err = ordered_map_file_open(tmp_file_path, &omf);
+    assert(err == 0);
+    ordered_map_file_done_reading(omf);
+    ordered_map_file_set_compaction(omf, -1.0, 0);
+
+    for (int i = 0; i < 100; i += 1) {
+        put_value(omf, "a", i);
+        put_value(omf, "b", i + 1);
+        put_value(omf, "c", i + 2);
+    }
+    ordered_map_file_flush(omf);
+
+    OrderedMapFileStats stats;
+    ordered_map_file_get_stats(omf, &stats);
+    assert(stats.live_key_count == 3);
+    assert(stats.live_bytes == 3 * (8 + 1 + 256));
+    assert(stats.dead_bytes > 99 * stats.live_bytes);
+    assert(stats.compaction_count == 0);
+
+    OrderedMapFileBatch *batch = ordered_map_file_batch_create(omf);
+    OrderedMapFileBuffer *del_key = ordered_map_file_buffer_create(1);
+    del_key->data[0] = 'b';
+    ordered_map_file_batch_del(batch, del_key);
+    err = ordered_map_file_batch_exec(batch);
+    assert(err == 0);
+
+    ordered_map_file_set_compaction(omf, 1.0, 0);
+    put_value(omf, "c", 42);
+    ordered_map_file_flush(omf);
+
+    ordered_map_file_get_stats(omf, &stats);
+    assert(stats.compaction_count == 1);
+    assert(stats.live_key_count == 2);
+    assert(stats.dead_bytes < stats.live_bytes);
+    assert(stats.last_compaction_time > 0.0);
+
+    // appends after a compaction go to the new file
+    put_value(omf, "d", 7);
+    ordered_map_file_close(omf);
+
+    long file_size;
+    FILE *f = fopen(tmp_file_path, "rb");
+    assert(f);
+    err = os_file_size(f, &file_size);
+    assert(err == 0);
+    fclose(f);
+    assert(file_size < 4 * 1024);
+
+    omf = nullptr;
+    err = ordered_map_file_open(tmp_file_path, &omf);
+    assert(err == 0);
+    assert(ordered_map_file_count(omf) == 3);
+
+    static const char *keys[] = {"a", "c", "d"};
+    static const int values[] = {99, 42, 7};
+    for (int i = 0; i < 3; i += 1) {
+        int index = ordered_map_file_find_key(omf, keys[i]);
+        assert(index == i);
+        ByteBuffer value;
+        err = ordered_map_file_get(omf, index, nullptr, value);
+        assert(err == 0);
+        assert(value.length() == 256);
+        assert((uint8_t)value.at(0) == values[i]);
+        assert((uint8_t)value.at(255) == values[i]);
+    }
+
+    ordered_map_file_done_reading(omf);
+    ordered_map_file_close(omf);
+    delete_tmp_file();
+}
+
+static void expect_value(OrderedMapFile *omf, int index, const char *key_str, int value) {
+    ByteBuffer *key;
+    ByteBuffer buf;
+    int err = ordered_map_file_get(omf, index, &key, buf);
+    assert(err == 0);
+    assert(ByteBuffer::compare(*key, key_str) == 0);
+    assert(buf.length() == 256);
+    assert((uint8_t)buf.at(0) == value);
+}
+
+static void test_index_replay(void) {
+    OrderedMapFile *omf;
+    int err = ordered_map_file_open(tmp_file_path, &omf);
+    assert(err == 0);
+    ordered_map_file_done_reading(omf);
+    ordered_map_file_set_compaction(omf, 1.0, 0);
+    static const char *keys[] = {"e", "b", "d", "a", "c"};
+    for (int i = 0; i < 5; i += 1)
+        put_value(omf, keys[i], i);
+    for (int i = 0; i < 5; i += 1)
+        put_value(omf, keys[i], i + 10);
+    ordered_map_file_flush(omf);
+    OrderedMapFileStats stats;
+    ordered_map_file_get_stats(omf, &stats);
+    assert(stats.compaction_count >= 1);
+
+    // replayed after the index: an overwrite, a delete, and a new key
+    ordered_map_file_set_compaction(omf, -1.0, 0);
+    put_value(omf, "c", 50);
+    OrderedMapFileBatch *batch = ordered_map_file_batch_create(omf);
+    OrderedMapFileBuffer *del_key = ordered_map_file_buffer_create(1);
+    del_key->data[0] = 'd';
+    ordered_map_file_batch_del(batch, del_key);
+    err = ordered_map_file_batch_exec(batch);
+    assert(err == 0);
+    put_value(omf, "bb", 60);
+    ordered_map_file_close(omf);
+
+    omf = nullptr;
+    err = ordered_map_file_open(tmp_file_path, &omf);
+    assert(err == 0);
+    assert(ordered_map_file_count(omf) == 5);
+    expect_value(omf, 0, "a", 13);
+    expect_value(omf, 1, "b", 11);
+    expect_value(omf, 2, "bb", 60);
+    expect_value(omf, 3, "c", 50);
+    expect_value(omf, 4, "e", 10);
+    assert(ordered_map_file_find_key(omf, "d") == -1);
+
+    ordered_map_file_done_reading(omf);
+    ordered_map_file_close(omf);
+    delete_tmp_file();
+}
+
+static void del_value(OrderedMapFile *omf, const char *key_str) {
+    OrderedMapFileBatch *batch = ordered_map_file_batch_create(omf);
+    OrderedMapFileBuffer *key = ordered_map_file_buffer_create(strlen(key_str));
+    memcpy(key->data, key_str, key->size);
+    ordered_map_file_batch_del(batch, key);
+    int err = ordered_map_file_batch_exec(batch);
+    assert(err == 0);
+}
+
+static void test_read_after_done_reading(void) {
+    OrderedMapFile *omf;
+    int err = ordered_map_file_open(tmp_file_path, &omf);
+    assert(err == 0);
+    ordered_map_file_done_reading(omf);
+    put_value(omf, "x", 1);
+    ordered_map_file_close(omf);
+
+    err = ordered_map_file_open(tmp_file_path, &omf);
+    assert(err == 0);
+    ordered_map_file_done_reading(omf);
+    ordered_map_file_set_compaction(omf, -1.0, 0);
+
+    // from before the open
+    ByteBuffer value;
+    err = ordered_map_file_read(omf, "x", value);
+    assert(err == 0);
+    assert(value.length() == 256 && (uint8_t)value.at(0) == 1);
+    assert(ordered_map_file_read(omf, "y", value) == GenesisErrorKeyNotFound);
+
+    put_value(omf, "c1", 1);
+    put_value(omf, "c3", 3);
+    put_value(omf, "c5", 5);
+    put_value(omf, "d", 9);
+    ordered_map_file_flush(omf);
+
+    OrderedMapFileCursor cursor;
+    ordered_map_file_cursor_init(omf, &cursor, "c");
+    assert(ordered_map_file_cursor_next(&cursor));
+    assert(ByteBuffer::compare(cursor.key, "c1") == 0);
+
+    // a key behind the cursor, one ahead of it, and the current one goes
+    put_value(omf, "c0", 0);
+    put_value(omf, "c4", 4);
+    del_value(omf, "c1");
+    ordered_map_file_flush(omf);
+    assert(ordered_map_file_cursor_value(&cursor, value) == GenesisErrorKeyNotFound);
+
+    static const char *expected_keys[] = {"c3", "c4", "c5"};
+    static const int expected_values[] = {3, 4, 5};
+    for (int i = 0; i < 3; i += 1) {
+        assert(ordered_map_file_cursor_next(&cursor));
+        assert(ByteBuffer::compare(cursor.key, expected_keys[i]) == 0);
+        err = ordered_map_file_cursor_value(&cursor, value);
+        assert(err == 0);
+        assert((uint8_t)value.at(0) == expected_values[i]);
+    }
+    assert(!ordered_map_file_cursor_next(&cursor));
+
+    // offsets move with compaction
+    ordered_map_file_set_compaction(omf, 0.0, 0);
+    put_value(omf, "c3", 33);
+    ordered_map_file_flush(omf);
+    OrderedMapFileStats stats;
+    ordered_map_file_get_stats(omf, &stats);
+    assert(stats.compaction_count == 1);
+    err = ordered_map_file_read(omf, "c3", value);
+    assert(err == 0);
+    assert((uint8_t)value.at(0) == 33);
+    err = ordered_map_file_read(omf, "d", value);
+    assert(err == 0);
+    assert((uint8_t)value.at(255) == 9);
+
+    ordered_map_file_close(omf);
+    delete_tmp_file();
+}
+
+static void test_bad_crc(void) {
+    // big enough that the crcs are checked on several threads
+    static const int value_size = 32 * 1024;
+    static const int transaction_size = 16 + 8 + 4 + value_size;
+    static const int bad_transaction = 200;
+
+    OrderedMapFile *omf;
+    int err = ordered_map_file_open(tmp_file_path, &omf);
+    assert(err == 0);
+    ordered_map_file_done_reading(omf);
+    ordered_map_file_set_compaction(omf, -1.0, 0);
+    for (int i = 0; i < 300; i += 1) {
+        OrderedMapFileBatch *batch = ordered_map_file_batch_create(omf);
+        OrderedMapFileBuffer *key = ordered_map_file_buffer_create(4);
+        OrderedMapFileBuffer *value = ordered_map_file_buffer_create(value_size);
+        sprintf(key->data, "%03d", i);
+        memset(value->data, i & 0xff, value_size);
+        ordered_map_file_batch_put(batch, key, value);
+        err = ordered_map_file_batch_exec(batch);
+        assert(err == 0);
+    }
+    ordered_map_file_close(omf);
+
+    FILE *f = fopen(tmp_file_path, "rb+");
+    assert(f);
+    fseek(f, 16 + bad_transaction * transaction_size + 100, SEEK_SET);
+    fputc(0xff, f);
+    fclose(f);
+
+    omf = nullptr;
+    err = ordered_map_file_open(tmp_file_path, &omf);
+    assert(err == 0);
+    assert(ordered_map_file_count(omf) == bad_transaction);
+    ByteBuffer value;
+    err = ordered_map_file_get(omf, bad_transaction - 1, nullptr, value);
+    assert(err == 0);
+    assert(value.length() == value_size);
+    assert((uint8_t)value.at(value_size - 1) == ((bad_transaction - 1) & 0xff));
+
+    ordered_map_file_done_reading(omf);
+    ordered_map_file_close(omf);
+    delete_tmp_file();
+}
+
+static void test_crc32_file(void) {
+    // a file from before crc32c, with one transaction putting "a"
+    static const char *crc32_uuid = "\xca\x2f\x5e\xf5\x00\xd8\xef\x0b\x80\x74\x18\xd0\xe4\x0b\x7a\x4f";
+    static const int transaction_size = 16 + 8 + 1 + 256;
+    uint8_t transaction[transaction_size];
+    write_uint32be(&transaction[4], transaction_size);
+    write_uint32be(&transaction[8], 1);
+    write_uint32be(&transaction[12], 0);
+    write_uint32be(&transaction[16], 1);
+    write_uint32be(&transaction[20], 256);
+    transaction[24] = 'a';
+    memset(&transaction[25], 5, 256);
+    write_uint32be(&transaction[0], crc32(0, &transaction[4], transaction_size - 4));
+    FILE *f = fopen(tmp_file_path, "wb");
+    assert(f);
+    fwrite(crc32_uuid, 1, 16, f);
+    fwrite(transaction, 1, transaction_size, f);
+    fclose(f);
+
+    OrderedMapFile *omf;
+    int err = ordered_map_file_open(tmp_file_path, &omf);
+    assert(err == 0);
+    assert(ordered_map_file_count(omf) == 1);
+    expect_value(omf, 0, "a", 5);
+    ordered_map_file_done_reading(omf);
+    ordered_map_file_set_compaction(omf, -1.0, 0);
+    // appends keep the old checksum
+    put_value(omf, "b", 6);
+    ordered_map_file_close(omf);
+
+    omf = nullptr;
+    err = ordered_map_file_open(tmp_file_path, &omf);
+    assert(err == 0);
+    assert(ordered_map_file_count(omf) == 2);
+    expect_value(omf, 1, "b", 6);
+    ordered_map_file_done_reading(omf);
+    // compaction moves the file to crc32c
+    ordered_map_file_set_compaction(omf, 0.0, 0);
+    put_value(omf, "c", 7);
+    ordered_map_file_flush(omf);
+    OrderedMapFileStats stats;
+    ordered_map_file_get_stats(omf, &stats);
+    assert(stats.compaction_count == 1);
+    ordered_map_file_set_compaction(omf, -1.0, 0);
+    put_value(omf, "d", 8);
+    ordered_map_file_close(omf);
+
+    char uuid[16];
+    f = fopen(tmp_file_path, "rb");
+    assert(f);
+    assert(fread(uuid, 1, 16, f) == 16);
+    fclose(f);
+    assert(memcmp(uuid, crc32_uuid, 16) != 0);
+
+    omf = nullptr;
+    err = ordered_map_file_open(tmp_file_path, &omf);
+    assert(err == 0);
+    assert(ordered_map_file_count(omf) == 4);
+    expect_value(omf, 0, "a", 5);
+    expect_value(omf, 1, "b", 6);
+    expect_value(omf, 2, "c", 7);
+    expect_value(omf, 3, "d", 8);
+    ordered_map_file_done_reading(omf);
+    ordered_map_file_close(omf);
+    delete_tmp_file();
+}
+
+static void put_compressible_batch(OrderedMapFile *omf, int value) {
+    OrderedMapFileBatch *batch = ordered_map_file_batch_create(omf);
+    for (int i = 0; i < 10; i += 1) {
+        char key[16];
+        sprintf(key, "k%02d", i);
+        ByteBuffer *buf = ordered_map_file_batch_begin_put(batch, key, strlen(key));
+        for (int j = 0; j < 1000; j += 1)
+            buf->append_uint8(value + i);
+        ordered_map_file_batch_end_put(batch);
+    }
+    ordered_map_file_batch_del_bytes(batch, "k09", 3);
+    int err = ordered_map_file_batch_exec(batch);
+    assert(err == 0);
+}
+
+static void expect_long_value(OrderedMapFile *omf, int index, const char *key_str, int value) {
+    ByteBuffer *key;
+    ByteBuffer buf;
+    int err = ordered_map_file_get(omf, index, &key, buf);
+    assert(err == 0);
+    assert(ByteBuffer::compare(*key, key_str) == 0);
+    assert(buf.length() == 1000);
+    assert((uint8_t)buf.at(0) == value && (uint8_t)buf.at(999) == value);
+}
+
+static long tmp_file_size(void) {
+    long file_size;
+    FILE *f = fopen(tmp_file_path, "rb");
+    assert(f);
+    int err = os_file_size(f, &file_size);
+    assert(err == 0);
+    fclose(f);
+    return file_size;
+}
+
+static void test_compression(void) {
+    OrderedMapFile *omf;
+    int err = ordered_map_file_open(tmp_file_path, &omf);
+    assert(err == 0);
+    ordered_map_file_done_reading(omf);
+    ordered_map_file_set_compaction(omf, -1.0, 0);
+    ordered_map_file_set_compression(omf, true);
+    for (int i = 0; i < 20; i += 1)
+        put_compressible_batch(omf, i);
+    put_value(omf, "x", 1);
+    ordered_map_file_flush(omf);
+
+    // the stats count bytes as they are without compression
+    OrderedMapFileStats stats;
+    ordered_map_file_get_stats(omf, &stats);
+    assert(stats.live_key_count == 10);
+    assert(stats.live_bytes == 9 * (8 + 3 + 1000) + (8 + 1 + 256));
+    assert(stats.dead_bytes > 19 * 9 * 1000);
+    ByteBuffer value;
+    err = ordered_map_file_read(omf, "k03", value);
+    assert(err == 0);
+    assert(value.length() == 1000 && (uint8_t)value.at(999) == 19 + 3);
+    ordered_map_file_close(omf);
+    assert(tmp_file_size() < 8 * 1024);
+
+    omf = nullptr;
+    err = ordered_map_file_open(tmp_file_path, &omf);
+    assert(err == 0);
+    assert(ordered_map_file_count(omf) == 10);
+    for (int i = 0; i < 9; i += 1) {
+        char key[16];
+        sprintf(key, "k%02d", i);
+        expect_long_value(omf, i, key, 19 + i);
+    }
+    assert(ordered_map_file_find_key(omf, "k09") == -1);
+    expect_value(omf, 9, "x", 1);
+    ordered_map_file_done_reading(omf);
+
+    // the snapshot is written in compressed blocks, with the keys in the
+    // index
+    ordered_map_file_set_compression(omf, true);
+    ordered_map_file_set_compaction(omf, 0.0, 0);
+    put_value(omf, "y", 2);
+    ordered_map_file_flush(omf);
+    ordered_map_file_get_stats(omf, &stats);
+    assert(stats.compaction_count == 1);
+    assert(stats.dead_bytes < stats.live_bytes);
+    err = ordered_map_file_read(omf, "k05", value);
+    assert(err == 0);
+    assert(value.length() == 1000 && (uint8_t)value.at(0) == 19 + 5);
+
+    // replayed after the index, and written without compression
+    ordered_map_file_set_compaction(omf, -1.0, 0);
+    ordered_map_file_set_compression(omf, false);
+    put_value(omf, "k00", 50);
+    ordered_map_file_close(omf);
+    assert(tmp_file_size() < 4 * 1024);
+
+    omf = nullptr;
+    err = ordered_map_file_open(tmp_file_path, &omf);
+    assert(err == 0);
+    assert(ordered_map_file_count(omf) == 11);
+    expect_value(omf, 0, "k00", 50);
+    for (int i = 1; i < 9; i += 1) {
+        char key[16];
+        sprintf(key, "k%02d", i);
+        expect_long_value(omf, i, key, 19 + i);
+    }
+    expect_value(omf, 9, "x", 1);
+    expect_value(omf, 10, "y", 2);
+    ordered_map_file_done_reading(omf);
+    ordered_map_file_close(omf);
+    delete_tmp_file();
+}
+
 void test_ordered_map_file(void) {
     delete_tmp_file();
     test_open_close();
     test_bogus_file();
     test_simple_data();
     test_many_data();
+    test_durability(OrderedMapFileDurabilityNone);
+    test_durability(OrderedMapFileDurabilityGroup);
+    test_durability(OrderedMapFileDurabilityInterval);
+    test_compaction();
+    test_index_replay();
+    test_read_after_done_reading();
+    test_bad_crc();
+    test_crc32_file();
+    test_compression();
 }
@@ -0,0 +1,310 @@
+// measures how the scheduler scales. synthetic graphs run into a sink that
+// the benchmark reads as fast as it can, in place of a playback device, at
+// each thread count, with and without the compiled graph, and with the
+// critical-path scheduler:
+//     wide: width sources into a mixer
+//     deep: a source and a chain of depth effects
+//     diamond: a source fanned out to width effects, mixed back together
+// every source and effect spends cost multiply-adds on each sample. the
+// pipelines are realtime ones with a block size of one period and buffers
+// of two, since offline buffers are too long for periods to mean anything.
+// per setup it reports frames per second, the time per period spent on
+// anything but running nodes, and how much longer than the mean the worst
+// period took, as json on stdout, one run per line. not part of the unit
+// tests; run it by hand:
+//     ./pipeline_bench [--seconds 10] [--width 16] [--depth 16] [--cost 64] [--period 256]
+
+#include "genesis.hpp"
+#include "mixer_node.hpp"
+#include "os.hpp"
+#include "util.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum GraphShape {
+    GraphShapeWide,
+    GraphShapeDeep,
+    GraphShapeDiamond,
+};
+
+static double run_seconds = 10.0;
+static int graph_width = 16;
+static int graph_depth = 16;
+static int node_cost = 64;
+static int period_frames = 256;
+
+static bool first_result = true;
+
+static float spend(float x) {
+    for (int i = 0; i < node_cost; i += 1)
+        x = x * 0.999f + 0.001f;
+    return x;
+}
+
+static void source_run(struct GenesisNode *node) {
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    for (int frame = 0; frame < frame_count; frame += 1)
+        out_buf[frame] = spend((frame & 0xff) / 256.0f);
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+static void effect_run(struct GenesisNode *node) {
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 1);
+    int frame_count = min(genesis_audio_in_port_fill_count(audio_in_port),
+            genesis_audio_out_port_free_count(audio_out_port));
+    float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    for (int frame = 0; frame < frame_count; frame += 1)
+        out_buf[frame] = spend(in_buf[frame]);
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+static void set_port_format(struct GenesisPortDescriptor *port_descr, int sample_rate) {
+    ok_or_panic(genesis_audio_port_descriptor_set_channel_layout(port_descr,
+        soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono), true, -1));
+    ok_or_panic(genesis_audio_port_descriptor_set_sample_rate(port_descr, sample_rate, true, -1));
+}
+
+struct BenchGraph {
+    struct GenesisPipeline *pipeline;
+    List<GenesisNode *> nodes; // every node with a run callback
+    struct GenesisNode *sink_node;
+    // how many nodes at most can run at the same time
+    int parallelism;
+};
+
+static void create_graph(GenesisContext *context, GraphShape shape, GenesisScheduler scheduler,
+        int thread_count, bool compiled, BenchGraph *graph)
+{
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create_with_scheduler(context, scheduler, &pipeline));
+    ok_or_panic(genesis_pipeline_set_thread_count(pipeline, thread_count));
+    ok_or_panic(genesis_pipeline_set_compiled_graph(pipeline, compiled));
+    ok_or_panic(genesis_pipeline_set_block_size(pipeline, period_frames));
+    genesis_pipeline_set_channel_layout(pipeline, soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono));
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+    // buffers are three quarters of the latency
+    ok_or_panic(genesis_pipeline_set_latency(pipeline, 2.0 * period_frames / sample_rate / 0.75));
+    graph->pipeline = pipeline;
+
+    struct GenesisNodeDescriptor *source_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "bench_source", "Benchmark source."));
+    genesis_node_descriptor_set_run_callback(source_descr, source_run);
+    set_port_format(ok_mem(genesis_node_descriptor_create_port(source_descr, 0,
+                    GenesisPortTypeAudioOut, "audio_out")), sample_rate);
+
+    struct GenesisNodeDescriptor *effect_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 2, "bench_effect", "Benchmark effect."));
+    genesis_node_descriptor_set_run_callback(effect_descr, effect_run);
+    set_port_format(ok_mem(genesis_node_descriptor_create_port(effect_descr, 0,
+                    GenesisPortTypeAudioIn, "audio_in")), sample_rate);
+    set_port_format(ok_mem(genesis_node_descriptor_create_port(effect_descr, 1,
+                    GenesisPortTypeAudioOut, "audio_out")), sample_rate);
+
+    struct GenesisNodeDescriptor *sink_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "bench_sink", "Benchmark sink."));
+    set_port_format(ok_mem(genesis_node_descriptor_create_port(sink_descr, 0,
+                    GenesisPortTypeAudioIn, "audio_in")), sample_rate);
+    graph->sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+
+    struct GenesisNode *last_node = nullptr;
+    switch (shape) {
+    case GraphShapeWide:
+    case GraphShapeDiamond:
+        {
+            struct GenesisNodeDescriptor *mixer_descr;
+            // an output can only have so many readers
+            int width = (shape == GraphShapeDiamond) ? min(graph_width, GENESIS_PORT_MAX_OUTPUTS) : graph_width;
+            ok_or_panic(create_mixer_descriptor(pipeline, width, &mixer_descr));
+            struct GenesisNode *mixer_node = ok_mem(genesis_node_descriptor_create_node(mixer_descr));
+            // the output first, so that the inputs have a layout to match
+            ok_or_panic(genesis_connect_ports(genesis_node_port(mixer_node, 0),
+                        genesis_node_port(graph->sink_node, 0)));
+            struct GenesisNode *fan_out_node = nullptr;
+            if (shape == GraphShapeDiamond) {
+                fan_out_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+                ok_or_panic(graph->nodes.append(fan_out_node));
+            }
+            for (int i = 0; i < width; i += 1) {
+                struct GenesisNode *node;
+                if (fan_out_node) {
+                    node = ok_mem(genesis_node_descriptor_create_node(effect_descr));
+                    ok_or_panic(genesis_connect_audio_nodes(fan_out_node, node));
+                } else {
+                    node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+                }
+                ok_or_panic(graph->nodes.append(node));
+                int audio_out_index = fan_out_node ? 1 : 0;
+                ok_or_panic(genesis_connect_ports(genesis_node_port(node, audio_out_index),
+                            genesis_node_port(mixer_node, i + 1)));
+            }
+            ok_or_panic(graph->nodes.append(mixer_node));
+            graph->parallelism = width;
+            return;
+        }
+    case GraphShapeDeep:
+        last_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+        ok_or_panic(graph->nodes.append(last_node));
+        for (int i = 0; i < graph_depth; i += 1) {
+            struct GenesisNode *node = ok_mem(genesis_node_descriptor_create_node(effect_descr));
+            ok_or_panic(genesis_connect_audio_nodes(last_node, node));
+            ok_or_panic(graph->nodes.append(node));
+            last_node = node;
+        }
+        ok_or_panic(genesis_connect_audio_nodes(last_node, graph->sink_node));
+        graph->parallelism = 1;
+        return;
+    }
+    panic("invalid graph shape");
+}
+
+static const char *shape_name(GraphShape shape) {
+    switch (shape) {
+        case GraphShapeWide: return "wide";
+        case GraphShapeDeep: return "deep";
+        case GraphShapeDiamond: return "diamond";
+    }
+    panic("invalid graph shape");
+}
+
+static const char *scheduler_name(GenesisScheduler scheduler) {
+    switch (scheduler) {
+        case GenesisSchedulerWorkStealing: return "stealing";
+        case GenesisSchedulerSharedQueue: return "shared";
+        case GenesisSchedulerCriticalPath: return "critical";
+    }
+    panic("invalid scheduler");
+}
+
+static void run_graph(GenesisContext *context, GraphShape shape, GenesisScheduler scheduler,
+        int thread_count, bool compiled)
+{
+    BenchGraph graph;
+    create_graph(context, shape, scheduler, thread_count, compiled, &graph);
+    int sample_rate = genesis_pipeline_get_sample_rate(graph.pipeline);
+    long total_frames = run_seconds * sample_rate;
+
+    genesis_pipeline_set_node_stats_enabled(graph.pipeline, true);
+    ok_or_panic(genesis_pipeline_start(graph.pipeline, 0.0));
+    struct GenesisPort *audio_in_port = genesis_node_port(graph.sink_node, 0);
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, 0);
+
+    // a period is done once period_frames more frames have arrived. when
+    // several arrive together the time is shared between them.
+    long frames_read = 0;
+    long frames_since_mark = 0;
+    double max_period_time = 0.0;
+    double start_time = os_get_time();
+    double mark_time = start_time;
+    while (frames_read < total_frames) {
+        int frame_count = min((long)genesis_audio_in_port_fill_count(audio_in_port), total_frames - frames_read);
+        if (frame_count == 0) {
+            if (os_get_time() - start_time > 60.0 + 60.0 * run_seconds)
+                panic("benchmark stalled after %ld frames", frames_read);
+            continue;
+        }
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+        frames_read += frame_count;
+        frames_since_mark += frame_count;
+        if (frames_since_mark >= period_frames) {
+            double now = os_get_time();
+            double period_time = (now - mark_time) * period_frames / frames_since_mark;
+            max_period_time = max(max_period_time, period_time);
+            mark_time = now;
+            frames_since_mark = 0;
+        }
+    }
+    double wall_time = os_get_time() - start_time;
+    genesis_pipeline_stop(graph.pipeline);
+    int actual_thread_count = genesis_pipeline_get_thread_count(graph.pipeline);
+
+    double busy_time = 0.0;
+    for (int i = 0; i < graph.nodes.length(); i += 1) {
+        struct GenesisNodeStats stats;
+        genesis_node_get_stats(graph.nodes.at(i), &stats);
+        busy_time += stats.total_run_time;
+    }
+    genesis_pipeline_destroy(graph.pipeline);
+
+    // the nodes could at best have shared the work out over this many threads
+    int parallelism = min(actual_thread_count, graph.parallelism);
+    double period_count = (double)frames_read / period_frames;
+    double mean_period_time = wall_time / period_count;
+    double overhead_us = max(0.0, wall_time - busy_time / parallelism) / period_count * 1e6;
+    double jitter_us = (max_period_time - mean_period_time) * 1e6;
+    double frames_per_second = frames_read / wall_time;
+
+    printf("%s{\"shape\":\"%s\",\"scheduler\":\"%s\",\"nodes\":%d,\"threads\":%d,\"compiled\":%s,\"cost\":%d,\"period\":%d,"
+            "\"frames_per_second\":%.0f,\"overhead_us_per_period\":%.3f,\"max_jitter_us\":%.3f}",
+            first_result ? "[\n" : ",\n", shape_name(shape), scheduler_name(scheduler),
+            graph.nodes.length(), actual_thread_count,
+            compiled ? "true" : "false", node_cost, period_frames,
+            frames_per_second, overhead_us, jitter_us);
+    first_result = false;
+    fflush(stdout);
+    fprintf(stderr, "%-8s %-8s threads %2d %-8s %12.0f frames/s %10.3f us overhead %10.3f us jitter\n",
+            shape_name(shape), scheduler_name(scheduler), actual_thread_count, compiled ? "compiled" : "",
+            frames_per_second, overhead_us, jitter_us);
+}
+
+static int usage(const char *exe) {
+    fprintf(stderr, "Usage: %s [--seconds 10] [--width 16] [--depth 16] [--cost 64] [--period 256]\n", exe);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i += 1) {
+        const char *arg = argv[i];
+        if (i + 1 >= argc)
+            return usage(argv[0]);
+        const char *value = argv[++i];
+        if (strcmp(arg, "--seconds") == 0) {
+            run_seconds = atof(value);
+        } else if (strcmp(arg, "--width") == 0) {
+            graph_width = atoi(value);
+        } else if (strcmp(arg, "--depth") == 0) {
+            graph_depth = atoi(value);
+        } else if (strcmp(arg, "--cost") == 0) {
+            node_cost = atoi(value);
+        } else if (strcmp(arg, "--period") == 0) {
+            period_frames = atoi(value);
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if (run_seconds <= 0.0 || graph_width < 1 || graph_depth < 1 || node_cost < 0 || period_frames < 1)
+        return usage(argv[0]);
+
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    int max_thread_count = genesis_pipeline_get_thread_count(pipeline);
+    genesis_pipeline_destroy(pipeline);
+
+    static const GraphShape shapes[] = {
+        GraphShapeWide,
+        GraphShapeDeep,
+        GraphShapeDiamond,
+    };
+    for (int shape_i = 0; shape_i < array_length(shapes); shape_i += 1) {
+        for (int thread_count = 1;; thread_count = min(thread_count * 2, max_thread_count)) {
+            run_graph(context, shapes[shape_i], GenesisSchedulerWorkStealing, thread_count, false);
+            run_graph(context, shapes[shape_i], GenesisSchedulerWorkStealing, thread_count, true);
+            run_graph(context, shapes[shape_i], GenesisSchedulerCriticalPath, thread_count, false);
+            if (thread_count == max_thread_count)
+                break;
+        }
+    }
+
+    printf("\n]\n");
+    genesis_context_destroy(context);
+    return 0;
+}
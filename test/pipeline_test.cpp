@@ -0,0 +1,2562 @@
+#include "pipeline_test.hpp"
+#include "genesis.h"
+#include "genesis.hpp"
+#include "util.hpp"
+#include "os.hpp"
+#include "midi_hardware.hpp"
+#include "mixer_node.hpp"
+#include "audio_file.hpp"
+#include "atomics.hpp"
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+// source -> pass -> pass -> ... -> sink, where the test itself plays the
+// part of the audio device and reads from the sink's input port.
+
+static const int pass_node_count = 6;
+static const int frames_to_read = 100000;
+static const char *trace_path = "/tmp/genesis_test_trace.json";
+
+static void source_run(struct GenesisNode *node) {
+    float *counter = (float *)genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        out_buf[frame] = *counter;
+        *counter = fmodf(*counter + 1.0f, 1000.0f);
+    }
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+static void source_seek(struct GenesisNode *node) {
+    float *counter = (float *)genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    *counter = 0.0f;
+}
+
+// not a multiple of GENESIS_SCRATCH_ALIGNMENT, which the pipeline rounds up to
+static const int pass_scratch_frame_count = 250;
+
+static int pass_scratch_size(struct GenesisNode *) {
+    return pass_scratch_frame_count * sizeof(float);
+}
+
+// the frames go through scratch on the way
+static void pass_run(struct GenesisNode *node) {
+    int block_size = *(int *)genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 1);
+    int frame_count = min(genesis_audio_in_port_fill_count(audio_in_port),
+            genesis_audio_out_port_free_count(audio_out_port));
+    if (block_size > 0 && (frame_count == 0 || frame_count % block_size != 0))
+        panic("expected whole blocks, got %d frames", frame_count);
+    float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    float *scratch = (float *)genesis_node_scratch(node);
+    if (!scratch || (uintptr_t)scratch % GENESIS_SCRATCH_ALIGNMENT != 0)
+        panic("bad scratch %p", (void *)scratch);
+    for (int start = 0; start < frame_count; start += pass_scratch_frame_count) {
+        int count = min(pass_scratch_frame_count, frame_count - start);
+        for (int frame = 0; frame < count; frame += 1)
+            scratch[frame] = in_buf[start + frame];
+        for (int frame = 0; frame < count; frame += 1)
+            out_buf[start + frame] = scratch[frame];
+    }
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+static void set_mono(struct GenesisPortDescriptor *port_descr, int sample_rate, bool fixed, int other_port_index) {
+    ok_or_panic(genesis_audio_port_descriptor_set_channel_layout(port_descr,
+        soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono), fixed, other_port_index));
+    ok_or_panic(genesis_audio_port_descriptor_set_sample_rate(port_descr, sample_rate, fixed, other_port_index));
+}
+
+// read frames_to_read frames, expecting the counter to continue from expected
+static void read_sink(struct GenesisPort *audio_in_port, float *expected) {
+    double start_time = os_get_time();
+    int frames_read = 0;
+    while (frames_read < frames_to_read) {
+        if (os_get_time() - start_time > 10.0)
+            panic("pipeline stalled after %d frames", frames_read);
+        int frame_count = min(genesis_audio_in_port_fill_count(audio_in_port), frames_to_read - frames_read);
+        float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+        for (int frame = 0; frame < frame_count; frame += 1) {
+            if (in_buf[frame] != *expected)
+                panic("expected %f got %f", *expected, in_buf[frame]);
+            *expected = fmodf(*expected + 1.0f, 1000.0f);
+        }
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+        frames_read += frame_count;
+    }
+}
+
+static void check_trace_file(void) {
+    FILE *f = fopen(trace_path, "rb");
+    assert(f);
+    static char buf[4096];
+    size_t amt_read = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[amt_read] = 0;
+    assert(strncmp(buf, "{\"traceEvents\":[", 16) == 0);
+    assert(strstr(buf, "\"ph\":\"X\""));
+    assert(strstr(buf, "test_pass.audio_in"));
+    os_delete(trace_path);
+}
+
+struct TestChain {
+    float counter;
+    int block_size;
+    struct GenesisNodeDescriptor *pass_descr;
+    struct GenesisNode *source_node;
+    struct GenesisNode *last_pass_node;
+    struct GenesisNode *sink_node;
+};
+
+// the descriptors keep pointers into chain. pass_run copies each frame after
+// reading it, so it works in place.
+static void create_chain(struct GenesisPipeline *pipeline, struct TestChain *chain, bool in_place) {
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+    chain->counter = 0.0f;
+    chain->block_size = genesis_pipeline_get_block_size(pipeline);
+
+    struct GenesisNodeDescriptor *source_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_source", "Test source."));
+    genesis_node_descriptor_set_userdata(source_descr, &chain->counter);
+    genesis_node_descriptor_set_run_callback(source_descr, source_run);
+    genesis_node_descriptor_set_seek_callback(source_descr, source_seek);
+    set_mono(ok_mem(genesis_node_descriptor_create_port(source_descr, 0, GenesisPortTypeAudioOut, "audio_out")),
+            sample_rate, true, -1);
+
+    struct GenesisNodeDescriptor *pass_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 2, "test_pass", "Test pass-through."));
+    genesis_node_descriptor_set_userdata(pass_descr, &chain->block_size);
+    genesis_node_descriptor_set_run_callback(pass_descr, pass_run);
+    genesis_node_descriptor_set_scratch_callback(pass_descr, pass_scratch_size);
+    set_mono(ok_mem(genesis_node_descriptor_create_port(pass_descr, 0, GenesisPortTypeAudioIn, "audio_in")),
+            sample_rate, false, -1);
+    struct GenesisPortDescriptor *pass_out_descr = ok_mem(genesis_node_descriptor_create_port(
+                pass_descr, 1, GenesisPortTypeAudioOut, "audio_out"));
+    set_mono(pass_out_descr, sample_rate, true, 0);
+    if (in_place)
+        ok_or_panic(genesis_audio_port_descriptor_set_in_place(pass_out_descr, 0));
+    chain->pass_descr = pass_descr;
+
+    struct GenesisNodeDescriptor *sink_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_sink", "Test sink."));
+    struct GenesisPortDescriptor *sink_in_descr = ok_mem(genesis_node_descriptor_create_port(
+                sink_descr, 0, GenesisPortTypeAudioIn, "audio_in"));
+    set_mono(sink_in_descr, sample_rate, false, -1);
+    assert(genesis_audio_port_descriptor_set_in_place(sink_in_descr, 0) == GenesisErrorInvalidPortType);
+
+    chain->source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    struct GenesisNode *prev_node = chain->source_node;
+    for (int i = 0; i < pass_node_count; i += 1) {
+        struct GenesisNode *pass_node = ok_mem(genesis_node_descriptor_create_node(pass_descr));
+        ok_or_panic(genesis_connect_audio_nodes(prev_node, pass_node));
+        prev_node = pass_node;
+    }
+    chain->last_pass_node = prev_node;
+    chain->sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+    ok_or_panic(genesis_connect_audio_nodes(prev_node, chain->sink_node));
+}
+
+// whether the node works on its input's buffer
+static bool is_in_place(struct GenesisNode *node) {
+    return genesis_audio_in_port_read_ptr(genesis_node_port(node, 0)) ==
+        genesis_audio_out_port_write_ptr(genesis_node_port(node, 1));
+}
+
+static void run_pipeline(GenesisContext *context, enum GenesisScheduler scheduler, bool compiled, bool trace,
+        bool offline, int block_size, bool in_place)
+{
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create_with_scheduler(context, scheduler, &pipeline));
+    ok_or_panic(genesis_pipeline_set_compiled_graph(pipeline, compiled));
+    ok_or_panic(genesis_pipeline_set_offline(pipeline, offline));
+    assert(genesis_pipeline_get_offline(pipeline) == offline);
+    assert(genesis_pipeline_set_block_size(pipeline, -1) == GenesisErrorInvalidParam);
+    ok_or_panic(genesis_pipeline_set_block_size(pipeline, block_size));
+    assert(genesis_pipeline_get_block_size(pipeline) == block_size);
+    assert(genesis_pipeline_get_fuse_chains(pipeline));
+    assert(genesis_pipeline_get_flush_denormals(pipeline));
+
+    struct TestChain chain;
+    create_chain(pipeline, &chain, in_place);
+    struct GenesisNodeDescriptor *pass_descr = chain.pass_descr;
+    struct GenesisNode *source_node = chain.source_node;
+    struct GenesisNode *prev_node = chain.last_pass_node;
+    struct GenesisNode *sink_node = chain.sink_node;
+
+    // a span of frames after a tempo change takes the tempo after it
+    struct GenesisTempoChange tempo_changes[] = {{0.0, 60.0}, {1.0, 120.0}};
+    ok_or_panic(genesis_pipeline_set_tempo_map(pipeline, tempo_changes, array_length(tempo_changes)));
+    assert(genesis_pipeline_get_tempo_change_count(pipeline) == 2);
+    assert(genesis_pipeline_get_tempo(pipeline, 1.5) == 120.0);
+    assert(genesis_whole_notes_to_frames(pipeline, 2.0, 48000) == 72000);
+    assert(fabs(genesis_frames_to_whole_notes(pipeline, 72000, 48000) - 2.0) < 0.000001);
+    assert(fabs(genesis_whole_notes_add_frames(pipeline, 0.5, 48000, 48000) - 2.0) < 0.000001);
+
+    // the play head moves on from the clock until its frames run out
+    struct GenesisPlaybackClock clock = {10.0, 0, 24000, 1.0, 48000, 0.5};
+    assert(fabs(genesis_playback_clock_position(pipeline, &clock, 10.0) - 0.5) < 0.000001);
+    assert(fabs(genesis_playback_clock_position(pipeline, &clock, 10.75) - 1.5) < 0.000001);
+    assert(fabs(genesis_playback_clock_position(pipeline, &clock, 20.0) - 2.0) < 0.000001);
+    ok_or_panic(genesis_pipeline_set_tempo_map(pipeline, nullptr, 0));
+    assert(genesis_pipeline_get_tempo(pipeline, 1.5) == 140.0);
+
+    genesis_pipeline_set_node_stats_enabled(pipeline, true);
+    if (trace)
+        ok_or_panic(genesis_pipeline_trace_start(pipeline, trace_path));
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+    assert(genesis_pipeline_trace_stop(pipeline) == GenesisErrorInvalidState);
+    assert(genesis_pipeline_set_offline(pipeline, !offline) == GenesisErrorInvalidState);
+
+    struct GenesisPort *audio_in_port = genesis_node_port(sink_node, 0);
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, 0);
+    float expected = 0.0f;
+    read_sink(audio_in_port, &expected);
+    assert(is_in_place(prev_node) == in_place);
+    assert(genesis_pipeline_set_fuse_chains(pipeline, false) == GenesisErrorInvalidState);
+    assert(genesis_pipeline_set_flush_denormals(pipeline, false) == GenesisErrorInvalidState);
+    assert(genesis_pipeline_set_direct_playback(pipeline, true) == GenesisErrorInvalidState);
+    struct GenesisTempoChange tempo_change = {0.0, 60.0};
+    assert(genesis_pipeline_set_tempo_map(pipeline, &tempo_change, 1) == GenesisErrorInvalidState);
+    assert(!genesis_pipeline_get_direct_playback(pipeline));
+    assert(genesis_pipeline_set_idle_enabled(pipeline, true) == GenesisErrorInvalidState);
+    assert(!genesis_pipeline_get_idle_enabled(pipeline));
+    // with no playback node there is nothing to wake
+    genesis_pipeline_wake(pipeline);
+    // the source and the pass nodes are one fused chain, which the sink is
+    // not part of since the test reads it
+    assert(genesis_audio_in_port_capacity(genesis_node_port(prev_node, 0)) <=
+            GENESIS_FUSED_BUFFER_FRAME_COUNT + block_size);
+    if (offline)
+        assert(genesis_audio_in_port_capacity(audio_in_port) == GENESIS_OFFLINE_BLOCK_FRAME_COUNT);
+
+    // every node but the source has a connected audio in port
+    const int max_fill_count = 8;
+    struct GenesisPortFill fills[max_fill_count];
+    int fill_count = genesis_pipeline_get_port_fills(pipeline, fills, max_fill_count);
+    assert(fill_count > 1);
+    bool sink_listed = false;
+    for (int i = 0; i < min(fill_count, max_fill_count); i += 1) {
+        assert(fills[i].fill_count >= 0 && fills[i].fill_count <= fills[i].capacity);
+        if (fills[i].port == audio_in_port)
+            sink_listed = true;
+    }
+    assert(sink_listed || fill_count > max_fill_count);
+
+    // there is no device, so nothing can underrun
+    struct GenesisPipelineTelemetry telemetry;
+    genesis_pipeline_get_telemetry(pipeline, &telemetry);
+    assert(telemetry.underrun_count == 0);
+    assert(telemetry.callback_count == 0);
+    assert(telemetry.actual_latency > 0.0);
+
+    // with no playback device there is nothing to adapt the latency to
+    double latency = genesis_pipeline_get_latency(pipeline);
+    assert(genesis_pipeline_set_adaptive_latency(pipeline, true, 0.0, 1.0) == GenesisErrorInvalidParam);
+    assert(genesis_pipeline_set_adaptive_latency(pipeline, true, 0.1, 0.01) == GenesisErrorInvalidParam);
+    ok_or_panic(genesis_pipeline_set_adaptive_latency(pipeline, true, 0.001, 1.0));
+    genesis_flush_events(context);
+    assert(genesis_pipeline_get_latency(pipeline) == latency);
+    ok_or_panic(genesis_pipeline_set_adaptive_latency(pipeline, false, 0.001, 1.0));
+
+    // splice another pass node in front of the sink while running. frames
+    // which were already buffered still arrive, in order.
+    struct GenesisGraphEdit *edit;
+    ok_or_panic(genesis_graph_edit_begin(pipeline, &edit));
+    struct GenesisGraphEdit *second_edit;
+    assert(genesis_graph_edit_begin(pipeline, &second_edit) == GenesisErrorInvalidState);
+    struct GenesisNode *spliced_node = ok_mem(genesis_graph_edit_add_node(edit, pass_descr));
+    ok_or_panic(genesis_graph_edit_disconnect(edit, genesis_node_port(prev_node, 1), audio_in_port));
+    assert(genesis_graph_edit_disconnect(edit, genesis_node_port(source_node, 0), audio_in_port) ==
+            GenesisErrorInvalidParam);
+    ok_or_panic(genesis_graph_edit_connect_audio_nodes(edit, prev_node, spliced_node));
+    ok_or_panic(genesis_graph_edit_connect_audio_nodes(edit, spliced_node, sink_node));
+    ok_or_panic(genesis_graph_edit_commit(edit));
+    assert(genesis_pipeline_is_running(pipeline));
+    read_sink(audio_in_port, &expected);
+    assert(is_in_place(spliced_node) == in_place);
+
+    // seeking drops everything that was buffered and starts over
+    ok_or_panic(genesis_pipeline_seek(pipeline, 0.0));
+    expected = 0.0f;
+    read_sink(audio_in_port, &expected);
+
+    // the parked worker threads pick up where they left off
+    genesis_pipeline_stop(pipeline);
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, 0);
+    expected = 0.0f;
+    read_sink(audio_in_port, &expected);
+
+    genesis_pipeline_stop(pipeline);
+    int frames_read = 4 * frames_to_read;
+    ok_or_panic(genesis_pipeline_trace_stop(pipeline));
+    if (trace)
+        check_trace_file();
+
+    struct GenesisNodeStats stats;
+    genesis_node_get_stats(source_node, &stats);
+    assert(stats.run_count > 0);
+    assert(stats.frames_processed >= frames_read);
+    assert(stats.max_run_time <= stats.total_run_time);
+    long histogram_count = 0;
+    for (int i = 0; i < GENESIS_NODE_STATS_HISTOGRAM_SIZE; i += 1)
+        histogram_count += stats.run_time_histogram[i];
+    assert(histogram_count == stats.run_count);
+
+    // the counter continues from 0 to 999, nowhere near denormal
+    assert(stats.denormal_run_count == 0);
+    genesis_node_get_stats(sink_node, &stats);
+    assert(stats.run_count == 0);
+    assert(stats.frames_processed == frames_read);
+
+    genesis_pipeline_reset_stats(pipeline);
+    genesis_node_get_stats(source_node, &stats);
+    assert(stats.run_count == 0);
+    assert(stats.frames_processed == 0);
+
+    genesis_pipeline_destroy(pipeline);
+}
+
+// a realtime and an offline pipeline share the context's threads
+static void run_concurrent_pipelines(GenesisContext *context) {
+    struct GenesisPipeline *realtime_pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &realtime_pipeline));
+    // which may let go of all but one of its threads while the chain is light
+    assert(genesis_pipeline_set_thread_count_range(realtime_pipeline, 2, 1) == GenesisErrorInvalidParam);
+    assert(genesis_pipeline_set_thread_count_range(realtime_pipeline, -1, 0) == GenesisErrorInvalidParam);
+    ok_or_panic(genesis_pipeline_set_thread_count_range(realtime_pipeline, 1, 0));
+    int realtime_thread_count = genesis_pipeline_get_thread_count(realtime_pipeline);
+    assert(genesis_pipeline_get_active_thread_count(realtime_pipeline) == realtime_thread_count);
+    struct TestChain realtime_chain;
+    create_chain(realtime_pipeline, &realtime_chain, false);
+
+    struct GenesisPipeline *offline_pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &offline_pipeline));
+    ok_or_panic(genesis_pipeline_set_offline(offline_pipeline, true));
+    ok_or_panic(genesis_pipeline_set_fuse_chains(offline_pipeline, false));
+    // and on a single thread, so that it gets in the way the least
+    assert(genesis_pipeline_set_thread_count(offline_pipeline, -1) == GenesisErrorInvalidParam);
+    ok_or_panic(genesis_pipeline_set_thread_count(offline_pipeline, 1));
+    assert(genesis_pipeline_get_thread_count(offline_pipeline) == 1);
+    struct TestChain offline_chain;
+    create_chain(offline_pipeline, &offline_chain, true);
+
+    ok_or_panic(genesis_pipeline_start(realtime_pipeline, 0.0));
+    ok_or_panic(genesis_pipeline_start(offline_pipeline, 0.0));
+    assert(genesis_pipeline_set_thread_count(offline_pipeline, 0) == GenesisErrorInvalidState);
+
+    struct GenesisPort *realtime_port = genesis_node_port(realtime_chain.sink_node, 0);
+    struct GenesisPort *offline_port = genesis_node_port(offline_chain.sink_node, 0);
+    assert(genesis_audio_in_port_capacity(genesis_node_port(offline_chain.last_pass_node, 0)) ==
+            GENESIS_OFFLINE_BLOCK_FRAME_COUNT);
+    genesis_audio_in_port_advance_read_ptr(realtime_port, 0);
+    genesis_audio_in_port_advance_read_ptr(offline_port, 0);
+    float realtime_expected = 0.0f;
+    float offline_expected = 0.0f;
+    for (int i = 0; i < 2; i += 1) {
+        read_sink(offline_port, &offline_expected);
+        read_sink(realtime_port, &realtime_expected);
+    }
+
+    // stopping one leaves the other running
+    genesis_pipeline_stop(offline_pipeline);
+    read_sink(realtime_port, &realtime_expected);
+    int active_thread_count = genesis_pipeline_get_active_thread_count(realtime_pipeline);
+    assert(active_thread_count >= 1 && active_thread_count <= realtime_thread_count);
+    assert(genesis_pipeline_set_thread_count_range(realtime_pipeline, 0, 0) == GenesisErrorInvalidState);
+
+    genesis_pipeline_destroy(offline_pipeline);
+    genesis_pipeline_destroy(realtime_pipeline);
+}
+
+// the decisions the scaling policy makes, one window at a time
+static void run_thread_scaling_policy(void) {
+    // an idle pipeline lets go of one worker a window, down to the minimum
+    int active_count = 4;
+    for (int expected = 3; expected >= 1; expected -= 1) {
+        active_count = thread_scaling_target(active_count, 1, 4, 0.0, 0);
+        assert(active_count == expected);
+    }
+    assert(thread_scaling_target(1, 1, 4, 0.0, 0) == 1);
+    assert(thread_scaling_target(2, 2, 4, 0.0, 0) == 2);
+    // still one a window when fewer are needed but some are
+    assert(thread_scaling_target(4, 1, 4, 1.0, 0) == 3);
+    // a light load stays on one
+    assert(thread_scaling_target(1, 1, 4, 0.2, 0) == 1);
+    assert(thread_scaling_target(1, 1, 4, 0.4, 4) == 1);
+    // a mostly busy worker with nodes queued on it gets another
+    assert(thread_scaling_target(1, 1, 4, 0.6, 0) == 1);
+    assert(thread_scaling_target(1, 1, 4, 0.6, 4) == 2);
+    // headroom on what was busy, all at once, up to the pool
+    assert(thread_scaling_target(1, 1, 4, 1.0, 0) == 2);
+    assert(thread_scaling_target(1, 1, 4, 2.5, 0) == 4);
+    assert(thread_scaling_target(4, 1, 4, 3.9, 8) == 4);
+}
+
+// the fan nodes of run_thread_scaling. while heavy they take this long a
+// run, asleep so that the workers do not need the cpus to be busy
+static const int scaling_heavy_microseconds = 2000;
+
+static void scaling_fan_run(struct GenesisNode *node) {
+    atomic_bool *heavy = (atomic_bool *)genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    if (heavy->load())
+        usleep(scaling_heavy_microseconds);
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 1);
+    int frame_count = min(genesis_audio_in_port_fill_count(audio_in_port),
+            genesis_audio_out_port_free_count(audio_out_port));
+    memcpy(genesis_audio_out_port_write_ptr(audio_out_port), genesis_audio_in_port_read_ptr(audio_in_port),
+            frame_count * sizeof(float));
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+// takes what the sinks have, a little at a time when paced as a device
+// would, and then pauses
+static void drain_sinks(struct GenesisNode **sink_nodes, int sink_count, bool paced) {
+    for (int i = 0; i < sink_count; i += 1) {
+        struct GenesisPort *audio_in_port = genesis_node_port(sink_nodes[i], 0);
+        int frame_count = genesis_audio_in_port_fill_count(audio_in_port);
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, paced ? min(frame_count, 64) : frame_count);
+    }
+    usleep(1000);
+}
+
+// a light load eventually lets go of all but the minimum thread, and
+// parallel work that queues up eventually takes some back. how long that
+// takes, and how far it grows, depend on the machine; the exact decisions
+// are run_thread_scaling_policy's to check.
+static void run_thread_scaling(GenesisContext *context) {
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_thread_count_range(pipeline, 1, 4));
+    int thread_count = genesis_pipeline_get_thread_count(pipeline);
+    // one thread has nothing to scale
+    if (thread_count < 2) {
+        genesis_pipeline_destroy(pipeline);
+        return;
+    }
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+
+    float counter = 0.0f;
+    struct GenesisNodeDescriptor *source_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_source", "Test source."));
+    genesis_node_descriptor_set_userdata(source_descr, &counter);
+    genesis_node_descriptor_set_run_callback(source_descr, source_run);
+    set_mono(ok_mem(genesis_node_descriptor_create_port(source_descr, 0, GenesisPortTypeAudioOut, "audio_out")),
+            sample_rate, true, -1);
+
+    atomic_bool heavy;
+    heavy.store(false);
+    struct GenesisNodeDescriptor *fan_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 2, "test_fan", "Test fan node."));
+    genesis_node_descriptor_set_userdata(fan_descr, &heavy);
+    genesis_node_descriptor_set_run_callback(fan_descr, scaling_fan_run);
+    set_mono(ok_mem(genesis_node_descriptor_create_port(fan_descr, 0, GenesisPortTypeAudioIn, "audio_in")),
+            sample_rate, false, -1);
+    set_mono(ok_mem(genesis_node_descriptor_create_port(fan_descr, 1, GenesisPortTypeAudioOut, "audio_out")),
+            sample_rate, true, 0);
+
+    struct GenesisNodeDescriptor *sink_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_sink", "Test sink."));
+    set_mono(ok_mem(genesis_node_descriptor_create_port(sink_descr, 0, GenesisPortTypeAudioIn, "audio_in")),
+            sample_rate, false, -1);
+
+    // twice as many branches as threads, so that heavy ones queue up
+    static const int max_fan_count = 8;
+    int fan_count = 2 * thread_count;
+    struct GenesisNode *sink_nodes[max_fan_count];
+    struct GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    for (int i = 0; i < fan_count; i += 1) {
+        struct GenesisNode *fan_node = ok_mem(genesis_node_descriptor_create_node(fan_descr));
+        sink_nodes[i] = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+        ok_or_panic(genesis_connect_audio_nodes(source_node, fan_node));
+        ok_or_panic(genesis_connect_audio_nodes(fan_node, sink_nodes[i]));
+    }
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+    for (int i = 0; i < fan_count; i += 1)
+        genesis_audio_in_port_advance_read_ptr(genesis_node_port(sink_nodes[i], 0), 0);
+
+    double start_time = os_get_time();
+    while (genesis_pipeline_get_active_thread_count(pipeline) > 1) {
+        if (os_get_time() - start_time > 10.0) {
+            panic("still %d active threads under a light load",
+                    genesis_pipeline_get_active_thread_count(pipeline));
+        }
+        drain_sinks(sink_nodes, fan_count, true);
+    }
+
+    heavy.store(true);
+    start_time = os_get_time();
+    while (genesis_pipeline_get_active_thread_count(pipeline) == 1) {
+        if (os_get_time() - start_time > 10.0)
+            panic("still one active thread with parallel work queued");
+        drain_sinks(sink_nodes, fan_count, false);
+    }
+
+    genesis_pipeline_stop(pipeline);
+    genesis_pipeline_destroy(pipeline);
+}
+
+// reads frames_to_read frames from each port, taking turns, since the
+// producer can only run as far ahead as the slower of the two
+static void read_sinks(struct GenesisPort **ports, float *expected, int port_count) {
+    double start_time = os_get_time();
+    int frames_read[2] = {0, 0};
+    for (;;) {
+        bool done = true;
+        for (int i = 0; i < port_count; i += 1) {
+            if (os_get_time() - start_time > 10.0)
+                panic("fan out stalled after %d frames", frames_read[i]);
+            int frame_count = min(genesis_audio_in_port_fill_count(ports[i]), frames_to_read - frames_read[i]);
+            float *in_buf = genesis_audio_in_port_read_ptr(ports[i]);
+            for (int frame = 0; frame < frame_count; frame += 1) {
+                if (in_buf[frame] != expected[i])
+                    panic("sink %d expected %f got %f", i, expected[i], in_buf[frame]);
+                expected[i] = fmodf(expected[i] + 1.0f, 1000.0f);
+            }
+            genesis_audio_in_port_advance_read_ptr(ports[i], frame_count);
+            frames_read[i] += frame_count;
+            done = done && (frames_read[i] == frames_to_read);
+        }
+        if (done)
+            return;
+    }
+}
+
+// the last pass node feeds two sinks from the same buffer. its frames then
+// cannot stay in the buffer of the node before it.
+static void run_fan_out(GenesisContext *context, bool compiled) {
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_compiled_graph(pipeline, compiled));
+    struct TestChain chain;
+    create_chain(pipeline, &chain, compiled);
+    struct GenesisNode *tap_node = ok_mem(genesis_node_descriptor_create_node(
+                genesis_node_descriptor(chain.sink_node)));
+    ok_or_panic(genesis_connect_audio_nodes(chain.last_pass_node, tap_node));
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+
+    struct GenesisPort *ports[2] = {
+        genesis_node_port(chain.sink_node, 0),
+        genesis_node_port(tap_node, 0),
+    };
+    genesis_audio_in_port_advance_read_ptr(ports[0], 0);
+    genesis_audio_in_port_advance_read_ptr(ports[1], 0);
+    float expected[2] = {0.0f, 0.0f};
+    read_sinks(ports, expected, 2);
+    assert(!is_in_place(chain.last_pass_node));
+
+    // once the tap is gone it no longer holds the producer back
+    struct GenesisGraphEdit *edit;
+    ok_or_panic(genesis_graph_edit_begin(pipeline, &edit));
+    ok_or_panic(genesis_graph_edit_disconnect(edit, genesis_node_port(chain.last_pass_node, 1), ports[1]));
+    ok_or_panic(genesis_graph_edit_commit(edit));
+    read_sink(ports[0], &expected[0]);
+
+    genesis_pipeline_stop(pipeline);
+    genesis_pipeline_destroy(pipeline);
+}
+
+// the silence source alternates between silence_period frames of silence
+// and as many of ones. the quiet pass nodes hand silence on without
+// looking at it.
+static const int silence_period = 16384;
+static const int quiet_pass_node_count = 3;
+
+static void silence_source_run(struct GenesisNode *node) {
+    long *frame_index = (long *)genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int frame_count = min(genesis_audio_out_port_free_count(audio_out_port),
+            (int)(silence_period - *frame_index % silence_period));
+    if ((*frame_index / silence_period) % 2 == 0) {
+        genesis_audio_out_port_write_silence(audio_out_port, frame_count);
+    } else {
+        float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+        for (int frame = 0; frame < frame_count; frame += 1)
+            out_buf[frame] = 1.0f;
+        genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+    }
+    *frame_index += frame_count;
+}
+
+static void quiet_pass_run(struct GenesisNode *node) {
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 1);
+    int frame_count = min(genesis_audio_in_port_fill_count(audio_in_port),
+            genesis_audio_out_port_free_count(audio_out_port));
+    int silent_count = min(genesis_audio_in_port_silent_count(audio_in_port), frame_count);
+    if (silent_count > 0) {
+        genesis_audio_out_port_write_silence(audio_out_port, silent_count);
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, silent_count);
+        return;
+    }
+    float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    for (int frame = 0; frame < frame_count; frame += 1)
+        out_buf[frame] = in_buf[frame];
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+// frames that are flagged as silence have to be zeros. most of the silence
+// makes it through flagged; some of it is lost where a pass node copies
+// across the end of a stretch of ones.
+static void run_silence(GenesisContext *context, int block_size, bool in_place) {
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_block_size(pipeline, block_size));
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+
+    long frame_index = 0;
+    struct GenesisNodeDescriptor *source_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_silence_source", "Test silence source."));
+    genesis_node_descriptor_set_userdata(source_descr, &frame_index);
+    genesis_node_descriptor_set_run_callback(source_descr, silence_source_run);
+    set_mono(ok_mem(genesis_node_descriptor_create_port(source_descr, 0, GenesisPortTypeAudioOut, "audio_out")),
+            sample_rate, true, -1);
+
+    struct GenesisNodeDescriptor *pass_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 2, "test_quiet_pass", "Test silence pass-through."));
+    genesis_node_descriptor_set_run_callback(pass_descr, quiet_pass_run);
+    set_mono(ok_mem(genesis_node_descriptor_create_port(pass_descr, 0, GenesisPortTypeAudioIn, "audio_in")),
+            sample_rate, false, -1);
+    struct GenesisPortDescriptor *pass_out_descr = ok_mem(genesis_node_descriptor_create_port(
+                pass_descr, 1, GenesisPortTypeAudioOut, "audio_out"));
+    set_mono(pass_out_descr, sample_rate, true, 0);
+    if (in_place)
+        ok_or_panic(genesis_audio_port_descriptor_set_in_place(pass_out_descr, 0));
+
+    struct GenesisNodeDescriptor *sink_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_sink", "Test sink."));
+    set_mono(ok_mem(genesis_node_descriptor_create_port(sink_descr, 0, GenesisPortTypeAudioIn, "audio_in")),
+            sample_rate, false, -1);
+
+    struct GenesisNode *prev_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    for (int i = 0; i < quiet_pass_node_count; i += 1) {
+        struct GenesisNode *pass_node = ok_mem(genesis_node_descriptor_create_node(pass_descr));
+        ok_or_panic(genesis_connect_audio_nodes(prev_node, pass_node));
+        prev_node = pass_node;
+    }
+    struct GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+    ok_or_panic(genesis_connect_audio_nodes(prev_node, sink_node));
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+
+    struct GenesisPort *audio_in_port = genesis_node_port(sink_node, 0);
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, 0);
+    int frame_total = 8 * silence_period;
+    int frames_read = 0;
+    int silent_frames_read = 0;
+    double start_time = os_get_time();
+    while (frames_read < frame_total) {
+        if (os_get_time() - start_time > 10.0)
+            panic("pipeline stalled after %d frames", frames_read);
+        int silent_count = genesis_audio_in_port_silent_count(audio_in_port);
+        int frame_count = min(genesis_audio_in_port_fill_count(audio_in_port), frame_total - frames_read);
+        assert(silent_count <= genesis_audio_in_port_fill_count(audio_in_port));
+        float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+        for (int frame = 0; frame < frame_count; frame += 1) {
+            bool silent = ((frames_read + frame) / silence_period) % 2 == 0;
+            if (in_buf[frame] != (silent ? 0.0f : 1.0f))
+                panic("frame %d is %f", frames_read + frame, in_buf[frame]);
+            if (frame < silent_count && !silent)
+                panic("frame %d is flagged as silence", frames_read + frame);
+        }
+        silent_frames_read += min(silent_count, frame_count);
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+        frames_read += frame_count;
+    }
+    assert(silent_frames_read >= frame_total / 4);
+    assert(is_in_place(prev_node) == in_place);
+
+    genesis_pipeline_stop(pipeline);
+    genesis_pipeline_destroy(pipeline);
+}
+
+struct SineSource {
+    int sample_rate;
+    double phase;
+};
+
+static const double sine_hz = 1000.0;
+
+// 0.25 + 0.5 * sin, so that both DC gain and signal gain are checked
+static void sine_source_run(struct GenesisNode *node) {
+    struct SineSource *sine = (struct SineSource *)genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    double step = 2.0 * M_PI * sine_hz / sine->sample_rate;
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        out_buf[frame] = 0.25 + 0.5 * sin(sine->phase);
+        sine->phase = fmod(sine->phase + step, 2.0 * M_PI);
+    }
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+static void run_resample(GenesisContext *context, int in_sample_rate, int out_sample_rate,
+        GenesisResampleQuality quality)
+{
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_offline(pipeline, true));
+
+    struct SineSource sine = {in_sample_rate, 0.0};
+    struct GenesisNodeDescriptor *source_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_sine", "Test sine source."));
+    genesis_node_descriptor_set_userdata(source_descr, &sine);
+    genesis_node_descriptor_set_run_callback(source_descr, sine_source_run);
+    set_mono(ok_mem(genesis_node_descriptor_create_port(source_descr, 0, GenesisPortTypeAudioOut, "audio_out")),
+            in_sample_rate, true, -1);
+
+    struct GenesisNodeDescriptor *sink_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_sink", "Test sink."));
+    set_mono(ok_mem(genesis_node_descriptor_create_port(sink_descr, 0, GenesisPortTypeAudioIn, "audio_in")),
+            out_sample_rate, true, -1);
+
+    struct GenesisNodeDescriptor *resample_descr = ok_mem(genesis_node_descriptor_find(pipeline, "resample"));
+    ok_or_panic(genesis_resample_descriptor_set_quality(resample_descr, quality));
+    struct GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    struct GenesisNode *resample_node = ok_mem(genesis_node_descriptor_create_node(resample_descr));
+    struct GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+    ok_or_panic(genesis_connect_audio_nodes(source_node, resample_node));
+    ok_or_panic(genesis_connect_audio_nodes(resample_node, sink_node));
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+
+    // skip the filter's warm up, then look at a whole number of periods
+    int skip_frames = out_sample_rate / 10;
+    int check_frames = out_sample_rate / 10;
+    float min_value = 1.0f;
+    float max_value = -1.0f;
+    double sum = 0.0;
+    struct GenesisPort *audio_in_port = genesis_node_port(sink_node, 0);
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, 0);
+    int frames_read = 0;
+    double start_time = os_get_time();
+    while (frames_read < skip_frames + check_frames) {
+        if (os_get_time() - start_time > 10.0)
+            panic("resample stalled after %d frames", frames_read);
+        int frame_count = min(genesis_audio_in_port_fill_count(audio_in_port),
+                skip_frames + check_frames - frames_read);
+        float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+        for (int frame = 0; frame < frame_count; frame += 1) {
+            if (frames_read + frame < skip_frames)
+                continue;
+            min_value = min(min_value, in_buf[frame]);
+            max_value = max(max_value, in_buf[frame]);
+            sum += in_buf[frame];
+        }
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+        frames_read += frame_count;
+    }
+    genesis_pipeline_stop(pipeline);
+
+    if (fabs(sum / check_frames - 0.25) > 0.001 || fabsf(max_value - 0.75f) > 0.005f ||
+            fabsf(min_value + 0.25f) > 0.005f)
+    {
+        panic("resample %d -> %d quality %d: mean %f min %f max %f", in_sample_rate, out_sample_rate,
+                (int)quality, sum / check_frames, min_value, max_value);
+    }
+
+    genesis_pipeline_destroy(pipeline);
+}
+
+// the resampler flags its output as silence once its filter has nothing
+// but silence in it, and stays in step meanwhile: away from the edges of
+// each stretch the output is exactly zero or close to one
+static void run_resample_silence(GenesisContext *context) {
+    int in_sample_rate = 44100;
+    int out_sample_rate = 48000;
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_offline(pipeline, true));
+
+    long frame_index = 0;
+    struct GenesisNodeDescriptor *source_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_silence_source", "Test silence source."));
+    genesis_node_descriptor_set_userdata(source_descr, &frame_index);
+    genesis_node_descriptor_set_run_callback(source_descr, silence_source_run);
+    set_mono(ok_mem(genesis_node_descriptor_create_port(source_descr, 0, GenesisPortTypeAudioOut, "audio_out")),
+            in_sample_rate, true, -1);
+
+    struct GenesisNodeDescriptor *sink_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_sink", "Test sink."));
+    set_mono(ok_mem(genesis_node_descriptor_create_port(sink_descr, 0, GenesisPortTypeAudioIn, "audio_in")),
+            out_sample_rate, true, -1);
+
+    struct GenesisNodeDescriptor *resample_descr = ok_mem(genesis_node_descriptor_find(pipeline, "resample"));
+    ok_or_panic(genesis_resample_descriptor_set_quality(resample_descr, GenesisResampleQualityRealtime));
+    struct GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    struct GenesisNode *resample_node = ok_mem(genesis_node_descriptor_create_node(resample_descr));
+    struct GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+    ok_or_panic(genesis_connect_audio_nodes(source_node, resample_node));
+    ok_or_panic(genesis_connect_audio_nodes(resample_node, sink_node));
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+
+    double out_period = silence_period * out_sample_rate / (double)in_sample_rate;
+    int edge_frames = 1024;
+    struct GenesisPort *audio_in_port = genesis_node_port(sink_node, 0);
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, 0);
+    int frame_total = 6 * out_period;
+    int frames_read = 0;
+    int silent_frames_read = 0;
+    double start_time = os_get_time();
+    while (frames_read < frame_total) {
+        if (os_get_time() - start_time > 10.0)
+            panic("resample stalled after %d frames", frames_read);
+        int silent_count = genesis_audio_in_port_silent_count(audio_in_port);
+        // the flags only cover the start of what is read, so read sound a
+        // little at a time to see where the silence starts
+        int frame_count = min(genesis_audio_in_port_fill_count(audio_in_port), frame_total - frames_read);
+        if (silent_count == 0)
+            frame_count = min(frame_count, 256);
+        float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+        for (int frame = 0; frame < frame_count; frame += 1) {
+            double stretch_pos = (frames_read + frame) / out_period;
+            int stretch = (int)stretch_pos;
+            double edge_distance = min(stretch_pos - stretch, stretch + 1 - stretch_pos) * out_period;
+            if (frame < silent_count && in_buf[frame] != 0.0f)
+                panic("frame %d is flagged as silence but is %f", frames_read + frame, in_buf[frame]);
+            if (edge_distance < edge_frames)
+                continue;
+            float expected = (stretch % 2 == 0) ? 0.0f : 1.0f;
+            if (fabsf(in_buf[frame] - expected) > 0.01f)
+                panic("frame %d is %f", frames_read + frame, in_buf[frame]);
+        }
+        silent_frames_read += min(silent_count, frame_count);
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+        frames_read += frame_count;
+    }
+    assert(silent_frames_read >= frame_total / 4);
+
+    genesis_pipeline_stop(pipeline);
+    genesis_pipeline_destroy(pipeline);
+}
+
+struct NoteSource {
+    double pos;
+    double note_on_start;
+    double note_off_start;
+    double max_time_requested;
+};
+
+// one note, on and off at fixed times
+static void note_source_run(struct GenesisNode *node) {
+    struct NoteSource *source = (struct NoteSource *)genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *events_out_port = genesis_node_port(node, 0);
+    int event_count;
+    double time_requested;
+    genesis_events_out_port_free_count(events_out_port, &event_count, &time_requested);
+    assert(event_count >= 2);
+    source->max_time_requested = max(source->max_time_requested, time_requested);
+    GenesisMidiEvent *event = genesis_events_out_port_write_ptr(events_out_port);
+    double end_pos = source->pos + time_requested;
+    int written_count = 0;
+    double starts[2] = {source->note_on_start, source->note_off_start};
+    for (int i = 0; i < 2; i += 1) {
+        if (starts[i] < source->pos || starts[i] >= end_pos)
+            continue;
+        event->event_type = (i == 0) ? GenesisMidiEventTypeNoteOn : GenesisMidiEventTypeNoteOff;
+        event->start = starts[i];
+        event->data.note_data.note = 69;
+        event->data.note_data.velocity = 1.0f;
+        event += 1;
+        written_count += 1;
+    }
+    genesis_events_out_port_advance_write_ptr(events_out_port, written_count, time_requested);
+    source->pos = end_pos;
+}
+
+// the synth starts and releases the note on the frames the events fall on,
+// not on block boundaries
+static void run_synth_events(GenesisContext *context) {
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_offline(pipeline, true));
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+
+    struct NoteSource source;
+    source.pos = 0.0;
+    source.max_time_requested = 0.0;
+    source.note_on_start = genesis_frames_to_whole_notes(pipeline, 1001, sample_rate);
+    source.note_off_start = genesis_frames_to_whole_notes(pipeline, 3003, sample_rate);
+    int note_on_frame = genesis_whole_notes_to_frames(pipeline, source.note_on_start, sample_rate);
+    int note_off_frame = genesis_whole_notes_to_frames(pipeline, source.note_off_start, sample_rate);
+
+    struct GenesisNodeDescriptor *source_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_notes", "Test note source."));
+    genesis_node_descriptor_set_userdata(source_descr, &source);
+    genesis_node_descriptor_set_run_callback(source_descr, note_source_run);
+    ok_mem(genesis_node_descriptor_create_port(source_descr, 0, GenesisPortTypeEventsOut, "events_out"));
+
+    struct GenesisNodeDescriptor *sink_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_sink", "Test sink."));
+    set_mono(ok_mem(genesis_node_descriptor_create_port(sink_descr, 0, GenesisPortTypeAudioIn, "audio_in")),
+            sample_rate, false, -1);
+
+    struct GenesisNodeDescriptor *synth_descr = ok_mem(genesis_node_descriptor_find(pipeline, "synth"));
+    struct GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    struct GenesisNode *synth_node = ok_mem(genesis_node_descriptor_create_node(synth_descr));
+    struct GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+    ok_or_panic(genesis_connect_ports(genesis_node_port(source_node, 0), genesis_node_port(synth_node, 0)));
+    ok_or_panic(genesis_connect_audio_nodes(synth_node, sink_node));
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+
+    struct GenesisPort *audio_in_port = genesis_node_port(sink_node, 0);
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, 0);
+    // the release has died away by then
+    int silent_frame = note_off_frame + sample_rate / 10;
+    int frame_total = silent_frame + 1000;
+    int frames_read = 0;
+    double start_time = os_get_time();
+    while (frames_read < frame_total) {
+        if (os_get_time() - start_time > 10.0)
+            panic("synth stalled after %d frames", frames_read);
+        int frame_count = min(genesis_audio_in_port_fill_count(audio_in_port), frame_total - frames_read);
+        float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+        for (int frame = 0; frame < frame_count; frame += 1) {
+            int frame_index = frames_read + frame;
+            // the note starts at phase 0 and level 0
+            bool sounding = frame_index > note_on_frame && frame_index <= note_off_frame;
+            bool silent = frame_index <= note_on_frame || frame_index >= silent_frame;
+            if ((sounding && in_buf[frame] == 0.0f) || (silent && in_buf[frame] != 0.0f))
+                panic("frame %d is %f", frame_index, in_buf[frame]);
+        }
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+        frames_read += frame_count;
+    }
+    // the synth never asks for events past the frames it has room for
+    int capacity = genesis_audio_in_port_capacity(audio_in_port);
+    assert(source.max_time_requested <= genesis_frames_to_whole_notes(pipeline, capacity + 1, sample_rate));
+
+    genesis_pipeline_stop(pipeline);
+    genesis_pipeline_destroy(pipeline);
+}
+
+struct DenseEventSource {
+    int frame_rate;
+    // the frame the next event is on, and the frame time is accounted to
+    int next_event_frame;
+    int frame_pos;
+    int max_free_event_count;
+};
+
+static const int dense_event_spacing = 4;
+
+// an event every dense_event_spacing frames, as many as there is room for.
+// time is only accounted up to the first event that does not fit.
+static void dense_event_source_run(struct GenesisNode *node) {
+    struct DenseEventSource *source = (struct DenseEventSource *)genesis_node_descriptor_userdata(
+            genesis_node_descriptor(node));
+    struct GenesisPipeline *pipeline = genesis_node_pipeline(node);
+    struct GenesisPort *events_out_port = genesis_node_port(node, 0);
+    int event_count;
+    double time_requested;
+    genesis_events_out_port_free_count(events_out_port, &event_count, &time_requested);
+    source->max_free_event_count = max(source->max_free_event_count, event_count);
+    GenesisMidiEvent *event = genesis_events_out_port_write_ptr(events_out_port);
+    double pos = genesis_frames_to_whole_notes(pipeline, source->frame_pos, source->frame_rate);
+    int end_frame = genesis_whole_notes_to_frames(pipeline, pos + time_requested, source->frame_rate);
+    int written_count = 0;
+    while (source->next_event_frame < end_frame) {
+        if (written_count >= event_count) {
+            end_frame = source->next_event_frame;
+            break;
+        }
+        event->event_type = GenesisMidiEventTypeNoteOn;
+        event->start = genesis_frames_to_whole_notes(pipeline, source->next_event_frame, source->frame_rate);
+        event->data.note_data.note = 69;
+        event->data.note_data.velocity = 1.0f;
+        event += 1;
+        written_count += 1;
+        source->next_event_frame += dense_event_spacing;
+    }
+    double end_pos = genesis_frames_to_whole_notes(pipeline, end_frame, source->frame_rate);
+    genesis_events_out_port_advance_write_ptr(events_out_port, written_count, end_pos - pos);
+    source->frame_pos = end_frame;
+}
+
+// reads frame_total frames' worth of dense events on the test thread,
+// finding events by time as it goes
+static void read_dense_events(struct GenesisPipeline *pipeline, struct GenesisPort *events_in_port,
+        int frame_rate, int frame_total)
+{
+    int frame_pos = 0;
+    double start_time = os_get_time();
+    while (frame_pos < frame_total) {
+        if (os_get_time() - start_time > 10.0)
+            panic("dense events stalled after %d frames", frame_pos);
+        int event_count;
+        int frame_count = genesis_events_in_port_fill_frames(events_in_port, frame_pos,
+                min(4096, frame_total - frame_pos), frame_rate, &event_count);
+        // between events, so that rounding cannot put it on either side
+        int first_event_frame = (frame_pos + dense_event_spacing - 1) / dense_event_spacing * dense_event_spacing;
+        for (int i = 0; i < event_count; i += 1) {
+            int frame = first_event_frame + i * dense_event_spacing + dense_event_spacing / 2;
+            double time = genesis_frames_to_whole_notes(pipeline, frame, frame_rate);
+            if (genesis_events_in_port_find(events_in_port, event_count, time) != i + 1)
+                panic("expected event %d after frame %d", i + 1, frame);
+        }
+        double end_time = genesis_frames_to_whole_notes(pipeline, frame_pos + frame_count, frame_rate);
+        int consumed_count = genesis_events_in_port_find(events_in_port, event_count, end_time);
+        genesis_events_in_port_advance_frames(events_in_port, consumed_count, frame_pos, frame_count, frame_rate);
+        frame_pos += frame_count;
+    }
+}
+
+// an event every few frames overflows the buffer the events port starts
+// with. the next time the pipeline starts the buffer has room for them.
+static void run_dense_events(GenesisContext *context) {
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_offline(pipeline, true));
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+
+    struct DenseEventSource source = {};
+    source.frame_rate = sample_rate;
+    struct GenesisNodeDescriptor *source_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_dense_events", "Test dense event source."));
+    genesis_node_descriptor_set_userdata(source_descr, &source);
+    genesis_node_descriptor_set_run_callback(source_descr, dense_event_source_run);
+    ok_mem(genesis_node_descriptor_create_port(source_descr, 0, GenesisPortTypeEventsOut, "events_out"));
+
+    struct GenesisNodeDescriptor *sink_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_events_sink", "Test events sink."));
+    ok_mem(genesis_node_descriptor_create_port(sink_descr, 0, GenesisPortTypeEventsIn, "events_in"));
+
+    struct GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    struct GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+    ok_or_panic(genesis_connect_ports(genesis_node_port(source_node, 0), genesis_node_port(sink_node, 0)));
+    struct GenesisPort *events_in_port = genesis_node_port(sink_node, 0);
+
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+    read_dense_events(pipeline, events_in_port, sample_rate, sample_rate);
+    genesis_pipeline_stop(pipeline);
+    int first_capacity = source.max_free_event_count;
+
+    source.next_event_frame = 0;
+    source.frame_pos = 0;
+    source.max_free_event_count = 0;
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+    read_dense_events(pipeline, events_in_port, sample_rate, sample_rate);
+    genesis_pipeline_stop(pipeline);
+    if (source.max_free_event_count < 4 * first_capacity)
+        panic("event capacity went from %d to %d", first_capacity, source.max_free_event_count);
+
+    genesis_pipeline_destroy(pipeline);
+}
+
+static void impulse_source_run(struct GenesisNode *node) {
+    long *frame_index = (long *)genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    for (int frame = 0; frame < frame_count; frame += 1)
+        out_buf[frame] = (*frame_index + frame == 0) ? 1.0f : 0.0f;
+    *frame_index += frame_count;
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+// an impulse through a delay of 100.5 frames comes out split between the
+// frames on either side, then again through the feedback
+static void run_delay(GenesisContext *context) {
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_offline(pipeline, true));
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+
+    long frame_index = 0;
+    struct GenesisNodeDescriptor *source_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_impulse", "Test impulse source."));
+    genesis_node_descriptor_set_userdata(source_descr, &frame_index);
+    genesis_node_descriptor_set_run_callback(source_descr, impulse_source_run);
+    set_mono(ok_mem(genesis_node_descriptor_create_port(source_descr, 0, GenesisPortTypeAudioOut, "audio_out")),
+            sample_rate, true, -1);
+
+    struct GenesisNodeDescriptor *sink_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_sink", "Test sink."));
+    set_mono(ok_mem(genesis_node_descriptor_create_port(sink_descr, 0, GenesisPortTypeAudioIn, "audio_in")),
+            sample_rate, false, -1);
+
+    struct GenesisNodeDescriptor *delay_descr = ok_mem(genesis_node_descriptor_find(pipeline, "delay"));
+    assert(genesis_node_descriptor_find_port_index(delay_descr, "audio_out") == 1);
+    assert(genesis_node_descriptor_find_param_index(delay_descr, "wet") == 1);
+    struct GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    struct GenesisNode *delay_node = ok_mem(genesis_node_descriptor_create_node(delay_descr));
+    struct GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+    ok_or_panic(genesis_connect_audio_nodes(source_node, delay_node));
+    ok_or_panic(genesis_connect_audio_nodes(delay_node, sink_node));
+    assert(genesis_delay_node_set_params(source_node, 1.0, 0.5f, 0.5f) == GenesisErrorInvalidParam);
+    assert(genesis_delay_node_set_params(delay_node, 1.0, 1.0f, 0.5f) == GenesisErrorInvalidParam);
+    double delay = genesis_frames_to_whole_notes(pipeline, 201, sample_rate) / 2.0;
+    ok_or_panic(genesis_delay_node_set_max_delay(delay_node, 2.0 * delay));
+    ok_or_panic(genesis_delay_node_set_params(delay_node, delay, 0.5f, 1.0f));
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+    assert(genesis_delay_node_set_max_delay(delay_node, 1.0) == GenesisErrorInvalidState);
+    assert(genesis_delay_node_set_params(delay_node, 3.0 * delay, 0.5f, 1.0f) == GenesisErrorInvalidParam);
+
+    struct GenesisPort *audio_in_port = genesis_node_port(sink_node, 0);
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, 0);
+    int frame_total = 1000;
+    int frames_read = 0;
+    double start_time = os_get_time();
+    while (frames_read < frame_total) {
+        if (os_get_time() - start_time > 10.0)
+            panic("delay stalled after %d frames", frames_read);
+        int frame_count = min(genesis_audio_in_port_fill_count(audio_in_port), frame_total - frames_read);
+        float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+        for (int frame = 0; frame < frame_count; frame += 1) {
+            int i = frames_read + frame;
+            float expected = 0.0f;
+            if (i == 0)
+                expected = 1.0f;
+            else if (i == 100 || i == 101)
+                expected = 0.5f;
+            else if (i == 200 || i == 202)
+                expected = 0.125f;
+            else if (i == 201)
+                expected = 0.25f;
+            else if (i >= 300)
+                break;
+            if (fabsf(in_buf[frame] - expected) > 0.0001f)
+                panic("frame %d is %f, expected %f", i, in_buf[frame], expected);
+        }
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+        frames_read += frame_count;
+    }
+    // a new delay glides in without the pipeline stopping
+    ok_or_panic(genesis_delay_node_set_params(delay_node, 2.0 * delay, 0.5f, 1.0f));
+
+    genesis_pipeline_stop(pipeline);
+    genesis_pipeline_destroy(pipeline);
+}
+
+// a click every 1000 frames, which follows seeks
+static void click_source_run(struct GenesisNode *node) {
+    long *frame_index = (long *)genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    for (int frame = 0; frame < frame_count; frame += 1)
+        out_buf[frame] = ((*frame_index + frame) % 1000 == 0) ? 1.0f : 0.0f;
+    *frame_index += frame_count;
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+static void click_source_seek(struct GenesisNode *node) {
+    long *frame_index = (long *)genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPipeline *pipeline = genesis_node_pipeline(node);
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+    double start_time = genesis_pipeline_get_seek_start_time(pipeline);
+    *frame_index = lround(genesis_whole_notes_to_seconds(pipeline, start_time, sample_rate) * sample_rate);
+}
+
+static void read_frames(struct GenesisPort *audio_in_port, float *out_buf, int frame_total) {
+    int frames_read = 0;
+    double start_time = os_get_time();
+    while (frames_read < frame_total) {
+        if (os_get_time() - start_time > 10.0)
+            panic("pipeline stalled after %d frames", frames_read);
+        int frame_count = min(genesis_audio_in_port_fill_count(audio_in_port), frame_total - frames_read);
+        memcpy(out_buf + frames_read, genesis_audio_in_port_read_ptr(audio_in_port), frame_count * sizeof(float));
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+        frames_read += frame_count;
+    }
+}
+
+// a seek into what was played starts the delay from the checkpoint before
+// it, with the echoes of the clicks before that, and the sink hears what it
+// heard the first time from the checkpoint on
+static void run_checkpoints(GenesisContext *context) {
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_offline(pipeline, true));
+    assert(genesis_pipeline_set_checkpoints(pipeline, -1.0, 64) == GenesisErrorInvalidParam);
+    assert(genesis_pipeline_set_checkpoints(pipeline, 0.1, 0) == GenesisErrorInvalidParam);
+    ok_or_panic(genesis_pipeline_set_checkpoints(pipeline, 0.1, 64));
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+    int interval_frames = lround(0.1 * sample_rate);
+
+    long frame_index = 0;
+    struct GenesisNodeDescriptor *source_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_click", "Test click source."));
+    genesis_node_descriptor_set_userdata(source_descr, &frame_index);
+    genesis_node_descriptor_set_run_callback(source_descr, click_source_run);
+    genesis_node_descriptor_set_seek_callback(source_descr, click_source_seek);
+    set_mono(ok_mem(genesis_node_descriptor_create_port(source_descr, 0, GenesisPortTypeAudioOut, "audio_out")),
+            sample_rate, true, -1);
+
+    struct GenesisNodeDescriptor *sink_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_sink", "Test sink."));
+    set_mono(ok_mem(genesis_node_descriptor_create_port(sink_descr, 0, GenesisPortTypeAudioIn, "audio_in")),
+            sample_rate, false, -1);
+
+    struct GenesisNodeDescriptor *delay_descr = ok_mem(genesis_node_descriptor_find(pipeline, "delay"));
+    struct GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    struct GenesisNode *delay_node = ok_mem(genesis_node_descriptor_create_node(delay_descr));
+    struct GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+    ok_or_panic(genesis_connect_audio_nodes(source_node, delay_node));
+    ok_or_panic(genesis_connect_audio_nodes(delay_node, sink_node));
+    double delay = genesis_frames_to_whole_notes(pipeline, 201, sample_rate) / 2.0;
+    ok_or_panic(genesis_delay_node_set_params(delay_node, delay, 0.9f, 1.0f));
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+    assert(genesis_pipeline_set_checkpoints(pipeline, 0.0, 0) == GenesisErrorInvalidState);
+
+    struct GenesisPort *audio_in_port = genesis_node_port(sink_node, 0);
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, 0);
+    int reference_frame_count = 4 * interval_frames;
+    float *reference = ok_mem(allocate_zero<float>(reference_frame_count));
+    read_frames(audio_in_port, reference, reference_frame_count);
+
+    int seek_frame = 2 * interval_frames + 1234;
+    double seek_time = genesis_frames_to_whole_notes(pipeline, seek_frame, sample_rate);
+    ok_or_panic(genesis_pipeline_seek(pipeline, seek_time));
+    double checkpoint_time = genesis_frames_to_whole_notes(pipeline, 2 * interval_frames, sample_rate);
+    assert(fabs(genesis_pipeline_get_seek_start_time(pipeline) - checkpoint_time) < 0.000001);
+    float *seeked = ok_mem(allocate_zero<float>(interval_frames));
+    read_frames(audio_in_port, seeked, interval_frames);
+    for (int i = 0; i < interval_frames; i += 1) {
+        float expected = reference[2 * interval_frames + i];
+        if (fabsf(seeked[i] - expected) > 0.0001f)
+            panic("frame %d is %f, expected %f", 2 * interval_frames + i, seeked[i], expected);
+    }
+
+    // with nothing to restore, so close to the start it plays from there
+    genesis_pipeline_clear_checkpoints(pipeline);
+    ok_or_panic(genesis_pipeline_seek(pipeline, seek_time));
+    assert(genesis_pipeline_get_seek_start_time(pipeline) == 0.0);
+    read_frames(audio_in_port, seeked, interval_frames);
+    assert(fabsf(seeked[0] - reference[0]) < 0.0001f);
+
+    destroy(seeked, interval_frames);
+    destroy(reference, reference_frame_count);
+    genesis_pipeline_stop(pipeline);
+    genesis_pipeline_destroy(pipeline);
+}
+
+// at ratios of 1 the clicks come through as they went in, late by the
+// node's latency, in either quality
+static void run_time_stretch(GenesisContext *context) {
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_offline(pipeline, true));
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+
+    long frame_index = 0;
+    struct GenesisNodeDescriptor *source_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_click", "Test click source."));
+    genesis_node_descriptor_set_userdata(source_descr, &frame_index);
+    genesis_node_descriptor_set_run_callback(source_descr, click_source_run);
+    genesis_node_descriptor_set_seek_callback(source_descr, click_source_seek);
+    set_mono(ok_mem(genesis_node_descriptor_create_port(source_descr, 0, GenesisPortTypeAudioOut, "audio_out")),
+            sample_rate, true, -1);
+
+    struct GenesisNodeDescriptor *sink_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_sink", "Test sink."));
+    set_mono(ok_mem(genesis_node_descriptor_create_port(sink_descr, 0, GenesisPortTypeAudioIn, "audio_in")),
+            sample_rate, false, -1);
+
+    struct GenesisNodeDescriptor *stretch_descr = ok_mem(genesis_node_descriptor_find(pipeline, "time_stretch"));
+    struct GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    struct GenesisNode *stretch_node = ok_mem(genesis_node_descriptor_create_node(stretch_descr));
+    struct GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+    ok_or_panic(genesis_connect_audio_nodes(source_node, stretch_node));
+    ok_or_panic(genesis_connect_audio_nodes(stretch_node, sink_node));
+    assert(genesis_time_stretch_node_set_params(source_node, 1.0f, 1.0f) == GenesisErrorInvalidParam);
+    assert(genesis_time_stretch_node_set_params(stretch_node, 8.0f, 1.0f) == GenesisErrorInvalidParam);
+    assert(genesis_time_stretch_node_set_quality(source_node, GenesisTimeStretchQualityHigh) ==
+            GenesisErrorInvalidParam);
+
+    static const int frame_total = 6000;
+    float *out = ok_mem(allocate_zero<float>(frame_total));
+    static const GenesisTimeStretchQuality qualities[] = {
+        GenesisTimeStretchQualityDraft,
+        GenesisTimeStretchQualityHigh,
+    };
+    for (int quality_i = 0; quality_i < array_length(qualities); quality_i += 1) {
+        ok_or_panic(genesis_time_stretch_node_set_quality(stretch_node, qualities[quality_i]));
+        int latency = genesis_node_latency(stretch_node);
+        assert(latency > 0);
+        ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+        assert(genesis_time_stretch_node_set_quality(stretch_node, GenesisTimeStretchQualityDraft) ==
+                GenesisErrorInvalidState);
+
+        read_frames(genesis_node_port(sink_node, 0), out, frame_total);
+        for (int i = 0; i < frame_total; i += 1) {
+            float expected = (i >= latency && (i - latency) % 1000 == 0) ? 1.0f : 0.0f;
+            if (fabsf(out[i] - expected) > 0.001f)
+                panic("frame %d is %f, expected %f", i, out[i], expected);
+        }
+        // new ratios glide in without the pipeline stopping
+        ok_or_panic(genesis_time_stretch_node_set_params(stretch_node, 1.5f, 0.75f));
+        genesis_pipeline_stop(pipeline);
+        ok_or_panic(genesis_time_stretch_node_set_params(stretch_node, 1.0f, 1.0f));
+    }
+
+    destroy(out, frame_total);
+    genesis_pipeline_destroy(pipeline);
+}
+
+static float convolution_impulse(int frame) {
+    return 0.5 * cos(frame * 0.05) * exp(-frame / 2000.0) + ((frame == 4000 || frame == 36000) ? 0.5 : 0.0);
+}
+
+// an impulse through a convolution node comes out as the impulse response,
+// late by the node's latency. the response is long enough that the parts
+// convolved on the worker threads are in it, which offline includes the
+// far stage.
+static void run_convolution(GenesisContext *context, bool offline) {
+    static const int latency = 256;
+    static const int impulse_frame_count = 40000;
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_offline(pipeline, offline));
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+
+    long frame_index = 0;
+    struct GenesisNodeDescriptor *source_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_impulse", "Test impulse source."));
+    genesis_node_descriptor_set_userdata(source_descr, &frame_index);
+    genesis_node_descriptor_set_run_callback(source_descr, impulse_source_run);
+    set_mono(ok_mem(genesis_node_descriptor_create_port(source_descr, 0, GenesisPortTypeAudioOut, "audio_out")),
+            sample_rate, true, -1);
+
+    struct GenesisNodeDescriptor *sink_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_sink", "Test sink."));
+    set_mono(ok_mem(genesis_node_descriptor_create_port(sink_descr, 0, GenesisPortTypeAudioIn, "audio_in")),
+            sample_rate, false, -1);
+
+    struct GenesisAudioFile *impulse = ok_mem(genesis_audio_file_create(context, sample_rate));
+    List<float> *samples = &impulse->channels.at(0).samples;
+    ok_or_panic(samples->resize(impulse_frame_count));
+    for (int i = 0; i < impulse_frame_count; i += 1)
+        samples->at(i) = convolution_impulse(i);
+
+    struct GenesisNodeDescriptor *convolution_descr = ok_mem(genesis_node_descriptor_find(pipeline, "convolution"));
+    struct GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    struct GenesisNode *convolution_node = ok_mem(genesis_node_descriptor_create_node(convolution_descr));
+    struct GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+    ok_or_panic(genesis_connect_audio_nodes(source_node, convolution_node));
+    ok_or_panic(genesis_connect_audio_nodes(convolution_node, sink_node));
+    assert(genesis_convolution_node_set_impulse(source_node, impulse) == GenesisErrorInvalidParam);
+    assert(genesis_convolution_node_set_params(source_node, 0.0f, 1.0f) == GenesisErrorInvalidParam);
+    ok_or_panic(genesis_convolution_node_set_impulse(convolution_node, impulse));
+    ok_or_panic(genesis_convolution_node_set_params(convolution_node, 0.0f, 1.0f));
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+    assert(genesis_convolution_node_set_impulse(convolution_node, impulse) == GenesisErrorInvalidState);
+
+    struct GenesisPort *audio_in_port = genesis_node_port(sink_node, 0);
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, 0);
+    int frame_total = latency + impulse_frame_count + 1000;
+    int frames_read = 0;
+    double start_time = os_get_time();
+    while (frames_read < frame_total) {
+        if (os_get_time() - start_time > 10.0)
+            panic("convolution stalled after %d frames", frames_read);
+        int frame_count = min(genesis_audio_in_port_fill_count(audio_in_port), frame_total - frames_read);
+        float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+        for (int frame = 0; frame < frame_count; frame += 1) {
+            int i = frames_read + frame - latency;
+            float expected = (i >= 0 && i < impulse_frame_count) ? convolution_impulse(i) : 0.0f;
+            if (fabsf(in_buf[frame] - expected) > 0.0001f)
+                panic("frame %d is %f, expected %f", i + latency, in_buf[frame], expected);
+        }
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+        frames_read += frame_count;
+    }
+
+    genesis_pipeline_stop(pipeline);
+    genesis_pipeline_destroy(pipeline);
+    genesis_audio_file_destroy(impulse);
+}
+
+// a quarter of the sample rate, half a sample off, so that every sample is
+// at 0.707 while the signal between them peaks at 1
+static void quarter_rate_source_run(struct GenesisNode *node) {
+    long *frame_index = (long *)genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    for (int frame = 0; frame < frame_count; frame += 1)
+        out_buf[frame] = sin(M_PI * 0.5 * (*frame_index + frame) + M_PI * 0.25);
+    *frame_index += frame_count;
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+// the meter passes its input through and measures what it passed since the
+// previous read
+static void run_meter(GenesisContext *context) {
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_offline(pipeline, true));
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+
+    long frame_index = 0;
+    struct GenesisNodeDescriptor *source_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_quarter_rate", "Test quarter rate source."));
+    genesis_node_descriptor_set_userdata(source_descr, &frame_index);
+    genesis_node_descriptor_set_run_callback(source_descr, quarter_rate_source_run);
+    set_mono(ok_mem(genesis_node_descriptor_create_port(source_descr, 0, GenesisPortTypeAudioOut, "audio_out")),
+            sample_rate, true, -1);
+
+    struct GenesisNodeDescriptor *sink_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_sink", "Test sink."));
+    set_mono(ok_mem(genesis_node_descriptor_create_port(sink_descr, 0, GenesisPortTypeAudioIn, "audio_in")),
+            sample_rate, false, -1);
+
+    struct GenesisNodeDescriptor *meter_descr = ok_mem(genesis_node_descriptor_find(pipeline, "meter"));
+    struct GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    struct GenesisNode *meter_node = ok_mem(genesis_node_descriptor_create_node(meter_descr));
+    struct GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+    ok_or_panic(genesis_connect_audio_nodes(source_node, meter_node));
+    ok_or_panic(genesis_connect_audio_nodes(meter_node, sink_node));
+    struct GenesisMeterLevels levels;
+    assert(genesis_meter_node_read_levels(source_node, &levels) == GenesisErrorInvalidParam);
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+
+    struct GenesisPort *audio_in_port = genesis_node_port(sink_node, 0);
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, 0);
+    int frame_total = 20000;
+    int frames_read = 0;
+    double start_time = os_get_time();
+    while (frames_read < frame_total) {
+        if (os_get_time() - start_time > 10.0)
+            panic("meter stalled after %d frames", frames_read);
+        int frame_count = min(genesis_audio_in_port_fill_count(audio_in_port), frame_total - frames_read);
+        float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+        for (int frame = 0; frame < frame_count; frame += 1) {
+            int i = frames_read + frame;
+            float expected = sin(M_PI * 0.5 * i + M_PI * 0.25);
+            if (fabsf(in_buf[frame] - expected) > 0.0001f)
+                panic("frame %d is %f, expected %f", i, in_buf[frame], expected);
+        }
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+        // what came first includes the start of the signal
+        if (frames_read < frame_total / 2 && frames_read + frame_count >= frame_total / 2)
+            ok_or_panic(genesis_meter_node_read_levels(meter_node, &levels));
+        frames_read += frame_count;
+    }
+
+    // the node has run since the levels above, while the sink kept reading
+    ok_or_panic(genesis_meter_node_read_levels(meter_node, &levels));
+    assert(levels.channel_count == 1);
+    assert(levels.frame_count > 0);
+    if (fabsf(levels.peak[0] - (float)M_SQRT1_2) > 0.0001f)
+        panic("peak is %f, expected %f", levels.peak[0], M_SQRT1_2);
+    if (fabsf(levels.rms[0] - (float)M_SQRT1_2) > 0.001f)
+        panic("rms is %f, expected %f", levels.rms[0], M_SQRT1_2);
+    if (fabsf(levels.true_peak[0] - 1.0f) > 0.02f)
+        panic("true peak is %f, expected 1", levels.true_peak[0]);
+
+    genesis_pipeline_stop(pipeline);
+    genesis_pipeline_destroy(pipeline);
+}
+
+static const int automation_ramp_frames = 480;
+
+static void automation_source_run(struct GenesisNode *node) {
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int sample_rate = genesis_audio_port_sample_rate(audio_out_port);
+    int frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    int frame = 0;
+    while (frame < frame_count) {
+        int segment_frame_count = genesis_node_params_next_segment(node, sample_rate, frame_count - frame);
+        float value = genesis_node_param_value(node, 0) + genesis_node_param_value(node, 1);
+        float step = genesis_node_param_step(node, 0) + genesis_node_param_step(node, 1);
+        for (int i = 0; i < segment_frame_count; i += 1)
+            out_buf[frame + i] = value + step * i;
+        genesis_node_params_advance(node, segment_frame_count);
+        frame += segment_frame_count;
+    }
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+// changes queued while the pipeline runs land on the frame they are timed
+// for, one jumping and one ramping
+static void run_param_automation(GenesisContext *context) {
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_offline(pipeline, true));
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+
+    struct GenesisNodeDescriptor *source_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_automation", "Test automated source."));
+    genesis_node_descriptor_set_run_callback(source_descr, automation_source_run);
+    set_mono(ok_mem(genesis_node_descriptor_create_port(source_descr, 0, GenesisPortTypeAudioOut, "audio_out")),
+            sample_rate, true, -1);
+    ok_or_panic(genesis_node_descriptor_add_param(source_descr, "jump", 0.0f, 1.0f, 0.0f, 0.0));
+    ok_or_panic(genesis_node_descriptor_add_param(source_descr, "ramp", 0.0f, 1.0f, 0.0f,
+                automation_ramp_frames / (double)sample_rate));
+    assert(genesis_node_descriptor_add_param(source_descr, "ramp", 0.0f, 1.0f, 0.0f, 0.0) ==
+            GenesisErrorInvalidParam);
+    assert(genesis_node_descriptor_add_param(source_descr, "other", 0.0f, 1.0f, 2.0f, 0.0) ==
+            GenesisErrorInvalidParam);
+    assert(genesis_node_descriptor_param_count(source_descr) == 2);
+    assert(genesis_node_descriptor_find_param_index(source_descr, "ramp") == 1);
+    assert(genesis_node_descriptor_find_param_index(source_descr, "other") == -1);
+
+    struct GenesisNodeDescriptor *sink_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_sink", "Test sink."));
+    set_mono(ok_mem(genesis_node_descriptor_create_port(sink_descr, 0, GenesisPortTypeAudioIn, "audio_in")),
+            sample_rate, false, -1);
+
+    struct GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    struct GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+    assert(genesis_node_descriptor_add_param(source_descr, "other", 0.0f, 1.0f, 0.0f, 0.0) ==
+            GenesisErrorInvalidState);
+    assert(genesis_node_set_param(sink_node, 0, 1.0f, 0.0) == GenesisErrorInvalidParam);
+    assert(genesis_node_set_param(source_node, 2, 1.0f, 0.0) == GenesisErrorInvalidParam);
+    ok_or_panic(genesis_connect_audio_nodes(source_node, sink_node));
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+
+    // past what the source can have written before anything is read
+    struct GenesisPort *audio_in_port = genesis_node_port(sink_node, 0);
+    int jump_frame = genesis_audio_in_port_capacity(audio_in_port) + 1000;
+    int ramp_frame = jump_frame + 2000;
+    ok_or_panic(genesis_node_set_param(source_node, 0, 1.0f,
+                genesis_frames_to_whole_notes(pipeline, jump_frame, sample_rate)));
+    // clamped to the range
+    ok_or_panic(genesis_node_set_param(source_node, 1, 5.0f,
+                genesis_frames_to_whole_notes(pipeline, ramp_frame, sample_rate)));
+
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, 0);
+    int frame_total = ramp_frame + automation_ramp_frames + 1000;
+    int frames_read = 0;
+    double start_time = os_get_time();
+    while (frames_read < frame_total) {
+        if (os_get_time() - start_time > 10.0)
+            panic("automation stalled after %d frames", frames_read);
+        int frame_count = min(genesis_audio_in_port_fill_count(audio_in_port), frame_total - frames_read);
+        float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+        for (int frame = 0; frame < frame_count; frame += 1) {
+            int i = frames_read + frame;
+            float expected = 0.0f;
+            if (i >= ramp_frame + automation_ramp_frames)
+                expected = 2.0f;
+            else if (i >= ramp_frame)
+                expected = 1.0f + (i - ramp_frame) / (float)automation_ramp_frames;
+            else if (i >= jump_frame)
+                expected = 1.0f;
+            if (fabsf(in_buf[frame] - expected) > 0.0001f)
+                panic("frame %d is %f, expected %f", i, in_buf[frame], expected);
+        }
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+        frames_read += frame_count;
+    }
+
+    genesis_pipeline_stop(pipeline);
+    genesis_pipeline_destroy(pipeline);
+}
+
+static void constant_source_run(struct GenesisNode *node) {
+    float value = *(float *)genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int channel_count = genesis_audio_port_channel_layout(audio_out_port)->channel_count;
+    int frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    for (int i = 0; i < frame_count * channel_count; i += 1)
+        out_buf[i] = value;
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+// reads frame_count stereo frames and checks that the last one is
+// left, right
+static void read_stereo_sink(struct GenesisPort *audio_in_port, int frame_count, float left, float right) {
+    int frames_read = 0;
+    double start_time = os_get_time();
+    float last[2] = {0.0f, 0.0f};
+    while (frames_read < frame_count) {
+        if (os_get_time() - start_time > 10.0)
+            panic("mixer stalled after %d frames", frames_read);
+        int count = min(genesis_audio_in_port_fill_count(audio_in_port), frame_count - frames_read);
+        float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+        if (count > 0) {
+            last[0] = in_buf[(count - 1) * 2];
+            last[1] = in_buf[(count - 1) * 2 + 1];
+        }
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, count);
+        frames_read += count;
+    }
+    if (fabsf(last[0] - left) > 0.001f || fabsf(last[1] - right) > 0.001f)
+        panic("mixed %f %f, expected %f %f", last[0], last[1], left, right);
+}
+
+// enough inputs that the mixer tree has three levels
+struct TestLatency {
+    int frame_count;
+    int zeros_left;
+};
+
+// delays its input by frame_count frames, and says so
+static void latency_run(struct GenesisNode *node) {
+    struct TestLatency *latency = (struct TestLatency *)genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 1);
+    int free_count = genesis_audio_out_port_free_count(audio_out_port);
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    int zero_count = min(free_count, latency->zeros_left);
+    for (int frame = 0; frame < zero_count; frame += 1)
+        out_buf[frame] = 0.0f;
+    latency->zeros_left -= zero_count;
+    int frame_count = min(genesis_audio_in_port_fill_count(audio_in_port), free_count - zero_count);
+    float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+    for (int frame = 0; frame < frame_count; frame += 1)
+        out_buf[zero_count + frame] = in_buf[frame];
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, zero_count + frame_count);
+}
+
+static void latency_seek(struct GenesisNode *node) {
+    struct TestLatency *latency = (struct TestLatency *)genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    latency->zeros_left = latency->frame_count;
+}
+
+// both in ports of the sink get the same frames: silence while the
+// latency node fills up, then the counter
+static void read_aligned_sink(struct GenesisNode *sink_node, int frame_total, int latency_frame_count) {
+    struct GenesisPort *delayed_port = genesis_node_port(sink_node, 0);
+    struct GenesisPort *direct_port = genesis_node_port(sink_node, 1);
+    genesis_audio_in_port_advance_read_ptr(delayed_port, 0);
+    genesis_audio_in_port_advance_read_ptr(direct_port, 0);
+    int frames_read = 0;
+    double start_time = os_get_time();
+    while (frames_read < frame_total) {
+        if (os_get_time() - start_time > 10.0)
+            panic("compensated pipeline stalled after %d frames", frames_read);
+        int frame_count = min(min(genesis_audio_in_port_fill_count(delayed_port),
+                    genesis_audio_in_port_fill_count(direct_port)), frame_total - frames_read);
+        float *delayed_buf = genesis_audio_in_port_read_ptr(delayed_port);
+        float *direct_buf = genesis_audio_in_port_read_ptr(direct_port);
+        for (int frame = 0; frame < frame_count; frame += 1) {
+            int i = frames_read + frame - latency_frame_count;
+            float expected = (i >= 0) ? fmodf(i, 1000.0f) : 0.0f;
+            if (delayed_buf[frame] != expected || direct_buf[frame] != expected) {
+                panic("frame %d is %f and %f, expected %f", frames_read + frame,
+                        delayed_buf[frame], direct_buf[frame], expected);
+            }
+        }
+        genesis_audio_in_port_advance_read_ptr(delayed_port, frame_count);
+        genesis_audio_in_port_advance_read_ptr(direct_port, frame_count);
+        frames_read += frame_count;
+    }
+}
+
+// the source feeds the sink directly and through a node with latency, and
+// the direct path is delayed to match
+static void run_latency_compensation(GenesisContext *context) {
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_offline(pipeline, true));
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+
+    float counter = 0.0f;
+    struct GenesisNodeDescriptor *source_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_source", "Test source."));
+    genesis_node_descriptor_set_userdata(source_descr, &counter);
+    genesis_node_descriptor_set_run_callback(source_descr, source_run);
+    genesis_node_descriptor_set_seek_callback(source_descr, source_seek);
+    set_mono(ok_mem(genesis_node_descriptor_create_port(source_descr, 0, GenesisPortTypeAudioOut, "audio_out")),
+            sample_rate, true, -1);
+
+    struct TestLatency latency = {1000, 0};
+    struct GenesisNodeDescriptor *latency_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 2, "test_latency", "Test latency."));
+    genesis_node_descriptor_set_userdata(latency_descr, &latency);
+    genesis_node_descriptor_set_run_callback(latency_descr, latency_run);
+    genesis_node_descriptor_set_seek_callback(latency_descr, latency_seek);
+    genesis_node_descriptor_set_latency(latency_descr, latency.frame_count);
+    set_mono(ok_mem(genesis_node_descriptor_create_port(latency_descr, 0, GenesisPortTypeAudioIn, "audio_in")),
+            sample_rate, false, -1);
+    set_mono(ok_mem(genesis_node_descriptor_create_port(latency_descr, 1, GenesisPortTypeAudioOut, "audio_out")),
+            sample_rate, true, 0);
+
+    struct GenesisNodeDescriptor *sink_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 2, "test_sink", "Test sink."));
+    set_mono(ok_mem(genesis_node_descriptor_create_port(sink_descr, 0, GenesisPortTypeAudioIn, "delayed_in")),
+            sample_rate, false, -1);
+    set_mono(ok_mem(genesis_node_descriptor_create_port(sink_descr, 1, GenesisPortTypeAudioIn, "direct_in")),
+            sample_rate, false, -1);
+
+    struct GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    struct GenesisNode *latency_node = ok_mem(genesis_node_descriptor_create_node(latency_descr));
+    struct GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+    ok_or_panic(genesis_connect_ports(genesis_node_port(source_node, 0), genesis_node_port(latency_node, 0)));
+    ok_or_panic(genesis_connect_ports(genesis_node_port(source_node, 0), genesis_node_port(sink_node, 1)));
+    ok_or_panic(genesis_connect_ports(genesis_node_port(latency_node, 1), genesis_node_port(sink_node, 0)));
+    assert(genesis_node_latency(latency_node) == latency.frame_count);
+    assert(genesis_node_latency(source_node) == 0);
+
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+    double expected_latency = latency.frame_count / (double)sample_rate;
+    assert(fabs(genesis_node_path_latency(sink_node) - expected_latency) < 0.000001);
+    assert(genesis_node_path_latency(latency_node) == 0.0);
+    read_aligned_sink(sink_node, 3 * GENESIS_OFFLINE_BLOCK_FRAME_COUNT, latency.frame_count);
+
+    // a seek starts over with the same delay
+    ok_or_panic(genesis_pipeline_seek(pipeline, 0.0));
+    read_aligned_sink(sink_node, GENESIS_OFFLINE_BLOCK_FRAME_COUNT, latency.frame_count);
+    genesis_pipeline_stop(pipeline);
+
+    // a node's own latency wins over its descriptor's
+    latency.frame_count = 300;
+    genesis_node_set_latency(latency_node, latency.frame_count);
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+    read_aligned_sink(sink_node, GENESIS_OFFLINE_BLOCK_FRAME_COUNT, latency.frame_count);
+    genesis_pipeline_stop(pipeline);
+
+    genesis_pipeline_destroy(pipeline);
+}
+
+static void run_mixer_tree(GenesisContext *context) {
+    static const int input_count = 300;
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_offline(pipeline, true));
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+    struct SoundIoChannelLayout *layout = genesis_pipeline_get_channel_layout(pipeline);
+    assert(layout->channel_count == 2);
+    assert(layout->channels[0] == SoundIoChannelIdFrontLeft);
+
+    struct GenesisNodeDescriptor *sink_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_sink", "Test sink."));
+    struct GenesisPortDescriptor *sink_port = ok_mem(
+            genesis_node_descriptor_create_port(sink_descr, 0, GenesisPortTypeAudioIn, "audio_in"));
+    ok_or_panic(genesis_audio_port_descriptor_set_channel_layout(sink_port, layout, true, -1));
+    ok_or_panic(genesis_audio_port_descriptor_set_sample_rate(sink_port, sample_rate, true, -1));
+    struct GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+
+    MixerTree *tree;
+    ok_or_panic(mixer_tree_create(pipeline, input_count, &tree));
+    // kept across adding the nodes
+    ok_or_panic(mixer_tree_set_input(tree, 0, 2.0f, 0.0f));
+    assert(mixer_tree_set_input(tree, 0, 1.0f, 1.5f) == GenesisErrorInvalidParam);
+    assert(mixer_tree_set_input(tree, input_count, 1.0f, 0.0f) == GenesisErrorInvalidParam);
+
+    float values[input_count];
+    struct GenesisGraphEdit *edit;
+    ok_or_panic(genesis_graph_edit_begin(pipeline, &edit));
+    ok_or_panic(mixer_tree_add_nodes(tree, edit, genesis_node_port(sink_node, 0)));
+    float sum = 0.0f;
+    for (int i = 0; i < input_count; i += 1) {
+        values[i] = (i % 7) * 0.01f;
+        sum += values[i];
+        struct GenesisNodeDescriptor *source_descr = ok_mem(
+                genesis_create_node_descriptor(pipeline, 1, "test_constant", "Test constant source."));
+        genesis_node_descriptor_set_userdata(source_descr, &values[i]);
+        genesis_node_descriptor_set_run_callback(source_descr, constant_source_run);
+        struct GenesisPortDescriptor *source_port = ok_mem(
+                genesis_node_descriptor_create_port(source_descr, 0, GenesisPortTypeAudioOut, "audio_out"));
+        ok_or_panic(genesis_audio_port_descriptor_set_channel_layout(source_port, layout, true, -1));
+        ok_or_panic(genesis_audio_port_descriptor_set_sample_rate(source_port, sample_rate, true, -1));
+        struct GenesisNode *source_node = ok_mem(genesis_graph_edit_add_node(edit, source_descr));
+        ok_or_panic(genesis_graph_edit_connect(edit, genesis_node_port(source_node, 0),
+                    mixer_tree_input_port(tree, i)));
+    }
+    ok_or_panic(genesis_graph_edit_commit(edit));
+    // input 1 panned hard left and input 2 muted
+    ok_or_panic(mixer_tree_set_input(tree, 1, 1.0f, -1.0f));
+    ok_or_panic(mixer_tree_set_input(tree, 2, 0.0f, 0.0f));
+    sum += values[0];
+
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+    struct GenesisPort *audio_in_port = genesis_node_port(sink_node, 0);
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, 0);
+    read_stereo_sink(audio_in_port, sample_rate / 10, sum - values[2], sum - values[1] - values[2]);
+    // a change while running ramps in. it shows once the frames already in
+    // the out buffers of the three levels are read.
+    ok_or_panic(mixer_tree_set_input(tree, 3, 0.5f, 0.5f));
+    read_stereo_sink(audio_in_port, 4 * GENESIS_OFFLINE_BLOCK_FRAME_COUNT, sum - values[2] - 0.75f * values[3],
+            sum - values[1] - values[2] - 0.5f * values[3]);
+
+    genesis_pipeline_stop(pipeline);
+    ok_or_panic(genesis_graph_edit_begin(pipeline, &edit));
+    ok_or_panic(mixer_tree_remove_nodes(tree, edit));
+    ok_or_panic(genesis_graph_edit_commit(edit));
+    mixer_tree_destroy(tree);
+    genesis_pipeline_destroy(pipeline);
+}
+
+// stereo frames. the left channel counts and the right one is its negative.
+static void stereo_counter_run(struct GenesisNode *node) {
+    float *counter = (float *)genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        out_buf[frame * 2] = *counter;
+        out_buf[frame * 2 + 1] = -*counter;
+        *counter = fmodf(*counter + 1.0f, 1000.0f);
+    }
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+// copies stereo frames, checking that each right channel sample is the
+// negative of the left one in whichever layout the ports have
+static void planar_pass_run(struct GenesisNode *node) {
+    int block_size = genesis_pipeline_get_block_size(genesis_node_pipeline(node));
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 1);
+    bool planar = genesis_audio_port_sample_layout(audio_in_port) == GenesisSampleLayoutPlanar;
+    assert(genesis_audio_port_sample_layout(audio_out_port) == genesis_audio_port_sample_layout(audio_in_port));
+    assert(planar == (block_size > 0));
+    int frame_count = min(genesis_audio_in_port_fill_count(audio_in_port),
+            genesis_audio_out_port_free_count(audio_out_port));
+    float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        int left = frame * 2;
+        int right = frame * 2 + 1;
+        if (planar) {
+            int block_start = frame - frame % block_size;
+            left = block_start * 2 + frame % block_size;
+            right = left + block_size;
+        }
+        if (in_buf[right] != -in_buf[left])
+            panic("channels out of place: %f %f", in_buf[left], in_buf[right]);
+        out_buf[left] = in_buf[left];
+        out_buf[right] = in_buf[right];
+    }
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+// source -> planar -> planar -> planar -> sink, with the source and the sink
+// interleaved. the in ports at either end convert the frames and the
+// planar node in the middle works in place. the test reads the sink a few
+// frames at a time, the way an audio device does, so that it is partway
+// into planar blocks.
+static void run_planar(GenesisContext *context, int block_size) {
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_block_size(pipeline, block_size));
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+    const struct SoundIoChannelLayout *stereo = soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdStereo);
+
+    float counter = 0.0f;
+    struct GenesisNodeDescriptor *source_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_stereo_source", "Test stereo source."));
+    genesis_node_descriptor_set_userdata(source_descr, &counter);
+    genesis_node_descriptor_set_run_callback(source_descr, stereo_counter_run);
+    struct GenesisPortDescriptor *source_out_descr = ok_mem(genesis_node_descriptor_create_port(
+                source_descr, 0, GenesisPortTypeAudioOut, "audio_out"));
+    ok_or_panic(genesis_audio_port_descriptor_set_channel_layout(source_out_descr, stereo, true, -1));
+    ok_or_panic(genesis_audio_port_descriptor_set_sample_rate(source_out_descr, sample_rate, true, -1));
+
+    struct GenesisNodeDescriptor *pass_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 2, "test_planar_pass", "Test planar pass-through."));
+    genesis_node_descriptor_set_run_callback(pass_descr, planar_pass_run);
+    struct GenesisPortDescriptor *pass_in_descr = ok_mem(genesis_node_descriptor_create_port(
+                pass_descr, 0, GenesisPortTypeAudioIn, "audio_in"));
+    struct GenesisPortDescriptor *pass_out_descr = ok_mem(genesis_node_descriptor_create_port(
+                pass_descr, 1, GenesisPortTypeAudioOut, "audio_out"));
+    ok_or_panic(genesis_audio_port_descriptor_set_channel_layout(pass_in_descr, stereo, false, -1));
+    ok_or_panic(genesis_audio_port_descriptor_set_sample_rate(pass_in_descr, sample_rate, false, -1));
+    ok_or_panic(genesis_audio_port_descriptor_set_channel_layout(pass_out_descr, stereo, true, 0));
+    ok_or_panic(genesis_audio_port_descriptor_set_sample_rate(pass_out_descr, sample_rate, true, 0));
+    ok_or_panic(genesis_audio_port_descriptor_set_sample_layout(pass_in_descr, GenesisSampleLayoutPlanar));
+    ok_or_panic(genesis_audio_port_descriptor_set_sample_layout(pass_out_descr, GenesisSampleLayoutPlanar));
+    ok_or_panic(genesis_audio_port_descriptor_set_in_place(pass_out_descr, 0));
+
+    struct GenesisNodeDescriptor *sink_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_stereo_sink", "Test stereo sink."));
+    struct GenesisPortDescriptor *sink_in_descr = ok_mem(genesis_node_descriptor_create_port(
+                sink_descr, 0, GenesisPortTypeAudioIn, "audio_in"));
+    ok_or_panic(genesis_audio_port_descriptor_set_channel_layout(sink_in_descr, stereo, false, -1));
+    ok_or_panic(genesis_audio_port_descriptor_set_sample_rate(sink_in_descr, sample_rate, false, -1));
+
+    struct GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    struct GenesisNode *pass_nodes[3];
+    struct GenesisNode *prev_node = source_node;
+    for (int i = 0; i < array_length(pass_nodes); i += 1) {
+        pass_nodes[i] = ok_mem(genesis_node_descriptor_create_node(pass_descr));
+        ok_or_panic(genesis_connect_audio_nodes(prev_node, pass_nodes[i]));
+        prev_node = pass_nodes[i];
+    }
+    struct GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+    ok_or_panic(genesis_connect_audio_nodes(prev_node, sink_node));
+
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+    struct GenesisPort *audio_in_port = genesis_node_port(sink_node, 0);
+    enum GenesisSampleLayout expected_layout = (block_size > 0) ?
+        GenesisSampleLayoutPlanar : GenesisSampleLayoutInterleaved;
+    assert(genesis_audio_port_sample_layout(genesis_node_port(source_node, 0)) == GenesisSampleLayoutInterleaved);
+    assert(genesis_audio_port_sample_layout(genesis_node_port(pass_nodes[1], 1)) == expected_layout);
+    assert(genesis_audio_port_sample_layout(audio_in_port) == GenesisSampleLayoutInterleaved);
+    // the last pass node feeds a reader in the other layout, so it cannot
+    // work in place. the in port of the first one converts its frames, and
+    // only the node may read them.
+    assert(is_in_place(pass_nodes[1]));
+    assert(is_in_place(pass_nodes[2]) == (block_size == 0));
+
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, 0);
+    float expected = 0.0f;
+    int frames_read = 0;
+    bool reopened = false;
+    double start_time = os_get_time();
+    while (frames_read < frames_to_read) {
+        if (os_get_time() - start_time > 10.0)
+            panic("planar pipeline stalled after %d frames", frames_read);
+        // there are no devices, but the pause must not lose any frames
+        if (!reopened && frames_read >= frames_to_read / 2) {
+            ok_or_panic(genesis_pipeline_reopen_devices(pipeline, 0.0));
+            reopened = true;
+        }
+        int frame_count = min(min(genesis_audio_in_port_fill_count(audio_in_port), 37),
+                frames_to_read - frames_read);
+        float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+        for (int frame = 0; frame < frame_count; frame += 1) {
+            if (in_buf[frame * 2] != expected || in_buf[frame * 2 + 1] != -expected)
+                panic("expected %f got %f %f", expected, in_buf[frame * 2], in_buf[frame * 2 + 1]);
+            expected = fmodf(expected + 1.0f, 1000.0f);
+        }
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+        frames_read += frame_count;
+    }
+
+    genesis_pipeline_stop(pipeline);
+    assert(genesis_pipeline_reopen_devices(pipeline, 0.0) == GenesisErrorInvalidState);
+    genesis_pipeline_destroy(pipeline);
+}
+
+// where the sample of channel ch of frame is among the stereo frames of port
+static int stereo_sample_index(struct GenesisPort *port, int frame, int ch) {
+    if (genesis_audio_port_sample_layout(port) == GenesisSampleLayoutInterleaved)
+        return frame * 2 + ch;
+    int block_size = genesis_pipeline_get_block_size(genesis_node_pipeline(genesis_port_node(port)));
+    int block_start = frame - frame % block_size;
+    return block_start * 2 + ch * block_size + frame % block_size;
+}
+
+static double port_sample(struct GenesisPort *port, const void *buf, int index) {
+    switch (genesis_audio_port_sample_precision(port)) {
+        case GenesisSamplePrecisionFloat32:
+            return ((const float *)buf)[index];
+        case GenesisSamplePrecisionFloat64:
+            return ((const double *)buf)[index];
+        case GenesisSamplePrecisionInt16:
+            return ((const int16_t *)buf)[index] / 32767.0;
+    }
+    panic("invalid sample precision");
+}
+
+static void set_port_sample(struct GenesisPort *port, void *buf, int index, double value) {
+    switch (genesis_audio_port_sample_precision(port)) {
+        case GenesisSamplePrecisionFloat32:
+            ((float *)buf)[index] = value;
+            return;
+        case GenesisSamplePrecisionFloat64:
+            ((double *)buf)[index] = value;
+            return;
+        case GenesisSamplePrecisionInt16:
+            ((int16_t *)buf)[index] = lrint(value * 32767.0);
+            return;
+    }
+    panic("invalid sample precision");
+}
+
+// stereo float64 frames. the left channel counts in steps of 1/1024 and the
+// right one is its negative.
+static void double_counter_run(struct GenesisNode *node) {
+    int *counter = (int *)genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    double *out_buf = genesis_audio_out_port_write_ptr_double(audio_out_port);
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        out_buf[frame * 2] = *counter / 1024.0;
+        out_buf[frame * 2 + 1] = -*counter / 1024.0;
+        *counter = (*counter + 1) % 1000;
+    }
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+// copies stereo frames from the precision and layout of its in port to
+// those of its out port, checking that each right channel sample is the
+// negative of the left one
+static void precision_pass_run(struct GenesisNode *node) {
+    struct GenesisPort *audio_in_port = genesis_node_port(node, 0);
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 1);
+    int frame_count = min(genesis_audio_in_port_fill_count(audio_in_port),
+            genesis_audio_out_port_free_count(audio_out_port));
+    const void *in_buf = nullptr;
+    switch (genesis_audio_port_sample_precision(audio_in_port)) {
+        case GenesisSamplePrecisionFloat32: in_buf = genesis_audio_in_port_read_ptr(audio_in_port); break;
+        case GenesisSamplePrecisionFloat64: in_buf = genesis_audio_in_port_read_ptr_double(audio_in_port); break;
+        case GenesisSamplePrecisionInt16: in_buf = genesis_audio_in_port_read_ptr_int16(audio_in_port); break;
+    }
+    void *out_buf = nullptr;
+    switch (genesis_audio_port_sample_precision(audio_out_port)) {
+        case GenesisSamplePrecisionFloat32: out_buf = genesis_audio_out_port_write_ptr(audio_out_port); break;
+        case GenesisSamplePrecisionFloat64: out_buf = genesis_audio_out_port_write_ptr_double(audio_out_port); break;
+        case GenesisSamplePrecisionInt16: out_buf = genesis_audio_out_port_write_ptr_int16(audio_out_port); break;
+    }
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        double left = port_sample(audio_in_port, in_buf, stereo_sample_index(audio_in_port, frame, 0));
+        double right = port_sample(audio_in_port, in_buf, stereo_sample_index(audio_in_port, frame, 1));
+        if (fabs(left + right) > 1.0 / 8192.0)
+            panic("channels out of place: %f %f", left, right);
+        set_port_sample(audio_out_port, out_buf, stereo_sample_index(audio_out_port, frame, 0), left);
+        set_port_sample(audio_out_port, out_buf, stereo_sample_index(audio_out_port, frame, 1), right);
+    }
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+static struct GenesisNodeDescriptor *create_precision_pass_descr(struct GenesisPipeline *pipeline,
+        enum GenesisSamplePrecision in_precision, enum GenesisSampleLayout in_layout,
+        enum GenesisSamplePrecision out_precision, enum GenesisSampleLayout out_layout)
+{
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+    const struct SoundIoChannelLayout *stereo = soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdStereo);
+    struct GenesisNodeDescriptor *pass_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 2, "test_precision_pass", "Test precision pass-through."));
+    genesis_node_descriptor_set_run_callback(pass_descr, precision_pass_run);
+    struct GenesisPortDescriptor *pass_in_descr = ok_mem(genesis_node_descriptor_create_port(
+                pass_descr, 0, GenesisPortTypeAudioIn, "audio_in"));
+    struct GenesisPortDescriptor *pass_out_descr = ok_mem(genesis_node_descriptor_create_port(
+                pass_descr, 1, GenesisPortTypeAudioOut, "audio_out"));
+    ok_or_panic(genesis_audio_port_descriptor_set_channel_layout(pass_in_descr, stereo, false, -1));
+    ok_or_panic(genesis_audio_port_descriptor_set_sample_rate(pass_in_descr, sample_rate, false, -1));
+    ok_or_panic(genesis_audio_port_descriptor_set_channel_layout(pass_out_descr, stereo, true, 0));
+    ok_or_panic(genesis_audio_port_descriptor_set_sample_rate(pass_out_descr, sample_rate, true, 0));
+    ok_or_panic(genesis_audio_port_descriptor_set_sample_precision(pass_in_descr, in_precision));
+    ok_or_panic(genesis_audio_port_descriptor_set_sample_layout(pass_in_descr, in_layout));
+    ok_or_panic(genesis_audio_port_descriptor_set_sample_precision(pass_out_descr, out_precision));
+    ok_or_panic(genesis_audio_port_descriptor_set_sample_layout(pass_out_descr, out_layout));
+    return pass_descr;
+}
+
+// source -> float32 to int16 -> int16 -> sink. the source writes float64
+// and the sink reads float32, so every in port converts the precision, the
+// layout or both of the frames it reads. with a block size the in ports of
+// the two pass nodes are planar.
+static void run_precision(GenesisContext *context, int block_size) {
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_block_size(pipeline, block_size));
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+    const struct SoundIoChannelLayout *stereo = soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdStereo);
+
+    int counter = 0;
+    struct GenesisNodeDescriptor *source_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_double_source", "Test float64 source."));
+    genesis_node_descriptor_set_userdata(source_descr, &counter);
+    genesis_node_descriptor_set_run_callback(source_descr, double_counter_run);
+    struct GenesisPortDescriptor *source_out_descr = ok_mem(genesis_node_descriptor_create_port(
+                source_descr, 0, GenesisPortTypeAudioOut, "audio_out"));
+    ok_or_panic(genesis_audio_port_descriptor_set_channel_layout(source_out_descr, stereo, true, -1));
+    ok_or_panic(genesis_audio_port_descriptor_set_sample_rate(source_out_descr, sample_rate, true, -1));
+    ok_or_panic(genesis_audio_port_descriptor_set_sample_precision(source_out_descr,
+                GenesisSamplePrecisionFloat64));
+
+    struct GenesisNodeDescriptor *quantize_descr = create_precision_pass_descr(pipeline,
+            GenesisSamplePrecisionFloat32, GenesisSampleLayoutPlanar,
+            GenesisSamplePrecisionInt16, GenesisSampleLayoutInterleaved);
+    struct GenesisNodeDescriptor *int16_descr = create_precision_pass_descr(pipeline,
+            GenesisSamplePrecisionInt16, GenesisSampleLayoutPlanar,
+            GenesisSamplePrecisionInt16, GenesisSampleLayoutPlanar);
+
+    struct GenesisNodeDescriptor *sink_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_stereo_sink", "Test stereo sink."));
+    struct GenesisPortDescriptor *sink_in_descr = ok_mem(genesis_node_descriptor_create_port(
+                sink_descr, 0, GenesisPortTypeAudioIn, "audio_in"));
+    ok_or_panic(genesis_audio_port_descriptor_set_channel_layout(sink_in_descr, stereo, false, -1));
+    ok_or_panic(genesis_audio_port_descriptor_set_sample_rate(sink_in_descr, sample_rate, false, -1));
+
+    struct GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    struct GenesisNode *quantize_node = ok_mem(genesis_node_descriptor_create_node(quantize_descr));
+    struct GenesisNode *int16_node = ok_mem(genesis_node_descriptor_create_node(int16_descr));
+    struct GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+    ok_or_panic(genesis_connect_audio_nodes(source_node, quantize_node));
+    ok_or_panic(genesis_connect_audio_nodes(quantize_node, int16_node));
+    ok_or_panic(genesis_connect_audio_nodes(int16_node, sink_node));
+
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+    struct GenesisPort *audio_in_port = genesis_node_port(sink_node, 0);
+    assert(genesis_audio_port_sample_precision(genesis_node_port(source_node, 0)) ==
+            GenesisSamplePrecisionFloat64);
+    assert(genesis_audio_port_sample_precision(genesis_node_port(quantize_node, 0)) ==
+            GenesisSamplePrecisionFloat32);
+    assert(genesis_audio_port_sample_precision(genesis_node_port(int16_node, 1)) ==
+            GenesisSamplePrecisionInt16);
+    assert(genesis_audio_port_sample_precision(audio_in_port) == GenesisSamplePrecisionFloat32);
+    assert(genesis_audio_port_bytes_per_frame(genesis_node_port(int16_node, 1)) == 4);
+    assert(genesis_audio_port_bytes_per_frame(genesis_node_port(source_node, 0)) == 16);
+
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, 0);
+    int expected = 0;
+    int frames_read = 0;
+    double start_time = os_get_time();
+    while (frames_read < frames_to_read) {
+        if (os_get_time() - start_time > 10.0)
+            panic("precision pipeline stalled after %d frames", frames_read);
+        int frame_count = min(min(genesis_audio_in_port_fill_count(audio_in_port), 37),
+                frames_to_read - frames_read);
+        float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+        for (int frame = 0; frame < frame_count; frame += 1) {
+            // int16 is a 15 bit fraction
+            float value = expected / 1024.0f;
+            if (fabsf(in_buf[frame * 2] - value) > 1.0f / 16384.0f ||
+                fabsf(in_buf[frame * 2 + 1] + value) > 1.0f / 16384.0f)
+            {
+                panic("expected %f got %f %f", value, in_buf[frame * 2], in_buf[frame * 2 + 1]);
+            }
+            expected = (expected + 1) % 1000;
+        }
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+        frames_read += frame_count;
+    }
+
+    genesis_pipeline_stop(pipeline);
+    genesis_pipeline_destroy(pipeline);
+}
+
+static const long recorder_frame_total = 200000;
+
+struct RecorderSource {
+    int channel_count;
+    long frame_index;
+};
+
+// counts up to recorder_frame_total, negated in the second channel
+static void recorder_source_run(struct GenesisNode *node) {
+    struct RecorderSource *source = (struct RecorderSource *)genesis_node_descriptor_userdata(
+            genesis_node_descriptor(node));
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int frame_count = min((long)genesis_audio_out_port_free_count(audio_out_port),
+            recorder_frame_total - source->frame_index);
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        float value = source->frame_index + frame;
+        for (int ch = 0; ch < source->channel_count; ch += 1)
+            out_buf[frame * source->channel_count + ch] = (ch == 0) ? value : -value;
+    }
+    source->frame_index += frame_count;
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+static void check_recorded_file(const char *path, int channel_count, int sample_rate) {
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        panic("unable to open %s", path);
+    long file_size;
+    ok_or_panic(os_file_size(file, &file_size));
+    int header_size = 4096;
+    long data_size = recorder_frame_total * channel_count * sizeof(float);
+    if (file_size != header_size + data_size)
+        panic("%s is %ld bytes, expected %ld", path, file_size, header_size + data_size);
+    unsigned char header[4096];
+    ok_or_panic(os_file_read_at(file, 0, (char *)header, header_size));
+    assert(memcmp(header, "RIFF", 4) == 0);
+    assert(memcmp(header + 8, "WAVE", 4) == 0);
+    assert(memcmp(header + 48, "fmt ", 4) == 0);
+    assert(header[56] == 3 && header[58] == channel_count);
+    assert((header[60] | header[61] << 8 | header[62] << 16) == sample_rate);
+    assert(memcmp(header + header_size - 8, "data", 4) == 0);
+    long header_data_size = header[header_size - 4] | header[header_size - 3] << 8 |
+        header[header_size - 2] << 16 | (long)header[header_size - 1] << 24;
+    assert(header_data_size == data_size);
+
+    float *samples = ok_mem(allocate_nonzero<float>(recorder_frame_total * channel_count));
+    ok_or_panic(os_file_read_at(file, header_size, (char *)samples, data_size));
+    for (long frame = 0; frame < recorder_frame_total; frame += 1) {
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            float expected = (ch == 0) ? frame : -(float)frame;
+            float sample = samples[frame * channel_count + ch];
+            if (sample != expected)
+                panic("%s frame %ld channel %d is %f, expected %f", path, frame, ch, sample, expected);
+        }
+    }
+    destroy(samples, recorder_frame_total * channel_count);
+    fclose(file);
+}
+
+// a mono and a stereo track, each through a buffer of a fraction of a
+// second, which the offline pipeline waits for the writer to empty, and a
+// third input which is connected but not recorded
+static void run_disk_recorder(GenesisContext *context, bool direct_io) {
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_offline(pipeline, true));
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+    const char *paths[] = {"/tmp/genesis_test_track_0.wav", "/tmp/genesis_test_track_1.wav"};
+    int channel_counts[] = {1, 2, 1};
+
+    struct GenesisNodeDescriptor *recorder_descr;
+    assert(genesis_disk_recorder_create_node_descriptor(pipeline, 0, &recorder_descr) ==
+            GenesisErrorInvalidParam);
+    ok_or_panic(genesis_disk_recorder_create_node_descriptor(pipeline, 3, &recorder_descr));
+    struct GenesisNode *recorder_node = ok_mem(genesis_node_descriptor_create_node(recorder_descr));
+    for (int i = 0; i < array_length(paths); i += 1)
+        ok_or_panic(genesis_disk_recorder_node_set_track_path(recorder_node, i, paths[i]));
+    assert(genesis_disk_recorder_node_set_track_path(recorder_node, 3, paths[0]) == GenesisErrorInvalidParam);
+    ok_or_panic(genesis_disk_recorder_node_set_buffer_seconds(recorder_node, 0.5));
+    ok_or_panic(genesis_disk_recorder_node_set_direct_io(recorder_node, direct_io));
+
+    struct RecorderSource sources[array_length(channel_counts)];
+    for (int i = 0; i < array_length(channel_counts); i += 1) {
+        sources[i].channel_count = channel_counts[i];
+        sources[i].frame_index = 0;
+        struct GenesisNodeDescriptor *source_descr = ok_mem(
+                genesis_create_node_descriptor(pipeline, 1, "test_recorder_source", "Test recorder source."));
+        genesis_node_descriptor_set_userdata(source_descr, &sources[i]);
+        genesis_node_descriptor_set_run_callback(source_descr, recorder_source_run);
+        struct GenesisPortDescriptor *out_descr = ok_mem(genesis_node_descriptor_create_port(
+                    source_descr, 0, GenesisPortTypeAudioOut, "audio_out"));
+        SoundIoChannelLayoutId layout_id = (channel_counts[i] == 1) ?
+            SoundIoChannelLayoutIdMono : SoundIoChannelLayoutIdStereo;
+        ok_or_panic(genesis_audio_port_descriptor_set_channel_layout(out_descr,
+                    soundio_channel_layout_get_builtin(layout_id), true, -1));
+        ok_or_panic(genesis_audio_port_descriptor_set_sample_rate(out_descr, sample_rate, true, -1));
+        struct GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+        ok_or_panic(genesis_connect_ports(genesis_node_port(source_node, 0), genesis_node_port(recorder_node, i)));
+    }
+
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+    assert(genesis_disk_recorder_node_set_direct_io(recorder_node, false) == GenesisErrorInvalidState);
+    struct GenesisDiskRecorderStats stats;
+    double start_time = os_get_time();
+    for (;;) {
+        ok_or_panic(genesis_disk_recorder_node_get_stats(recorder_node, &stats));
+        if (stats.recorded_frame_count == recorder_frame_total)
+            break;
+        if (os_get_time() - start_time > 10.0)
+            panic("recorder stalled after %ld frames", stats.recorded_frame_count);
+    }
+    genesis_pipeline_stop(pipeline);
+
+    ok_or_panic(genesis_disk_recorder_node_get_stats(recorder_node, &stats));
+    assert(stats.written_frame_count == recorder_frame_total);
+    assert(stats.dropped_frame_count == 0);
+    assert(stats.write_error == 0);
+    assert(stats.peak_buffer_fill > 0.0 && stats.peak_buffer_fill <= 1.0);
+    for (int i = 0; i < array_length(paths); i += 1) {
+        check_recorded_file(paths[i], channel_counts[i], sample_rate);
+        os_delete(paths[i]);
+    }
+
+    genesis_pipeline_destroy(pipeline);
+}
+
+// channel ch of frame i is i + ch / 2
+static void write_ramp_wav(const char *path, int channel_count, int sample_rate, int frame_count) {
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        panic("unable to open %s", path);
+    unsigned data_size = frame_count * channel_count * sizeof(float);
+    ByteBuffer wav;
+    wav.append("RIFF");
+    wav.append_uint32le(36 + data_size);
+    wav.append("WAVEfmt ");
+    wav.append_uint32le(16);
+    // float
+    wav.append_uint16le(3);
+    wav.append_uint16le(channel_count);
+    wav.append_uint32le(sample_rate);
+    wav.append_uint32le(sample_rate * channel_count * sizeof(float));
+    wav.append_uint16le(channel_count * sizeof(float));
+    wav.append_uint16le(32);
+    wav.append("data");
+    wav.append_uint32le(data_size);
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            float sample = frame + ch * 0.5f;
+            wav.append((const char *)&sample, sizeof(float));
+        }
+    }
+    assert(fwrite(wav.raw(), 1, wav.length(), file) == (size_t)wav.length());
+    fclose(file);
+}
+
+// one second of a ramp played at its own pitch for longer than the head
+// it keeps in memory, so that the rest comes from its stream, which the
+// offline pipeline waits for
+static void run_sampler(GenesisContext *context) {
+    static const char *path = "/tmp/genesis_test_sampler_synthetic:48000.wav";
+    static const int sample_frame_count = 48000;
+    write_ramp_wav(path, 2, 48000, sample_frame_count);
+
+    struct GenesisSamplerPool *pool;
+    ok_or_panic(genesis_sampler_pool_create(context, &pool));
+    struct GenesisSamplerZone zones[2] = {
+        {path, 69, 0, 127, 0, 127},
+        {path, 60, 0, 127, 0, 127},
+    };
+    ok_or_panic(genesis_sampler_pool_add_zones(pool, zones, 2));
+    assert(genesis_sampler_pool_resident_bytes(pool) < sample_frame_count * 2 * (long)sizeof(float));
+
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_offline(pipeline, true));
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+    double step = 48000.0 / sample_rate;
+
+    struct NoteSource source;
+    source.pos = 0.0;
+    source.max_time_requested = 0.0;
+    source.note_on_start = genesis_frames_to_whole_notes(pipeline, 1001, sample_rate);
+    source.note_off_start = genesis_frames_to_whole_notes(pipeline, 1001 + sample_rate * 3 / 4, sample_rate);
+    int note_on_frame = genesis_whole_notes_to_frames(pipeline, source.note_on_start, sample_rate);
+    int note_off_frame = genesis_whole_notes_to_frames(pipeline, source.note_off_start, sample_rate);
+
+    struct GenesisNodeDescriptor *source_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_notes", "Test note source."));
+    genesis_node_descriptor_set_userdata(source_descr, &source);
+    genesis_node_descriptor_set_run_callback(source_descr, note_source_run);
+    ok_mem(genesis_node_descriptor_create_port(source_descr, 0, GenesisPortTypeEventsOut, "events_out"));
+
+    struct GenesisNodeDescriptor *sink_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_sink", "Test sink."));
+    set_mono(ok_mem(genesis_node_descriptor_create_port(sink_descr, 0, GenesisPortTypeAudioIn, "audio_in")),
+            sample_rate, false, -1);
+
+    struct GenesisNodeDescriptor *sampler_descr = ok_mem(genesis_node_descriptor_find(pipeline, "sampler"));
+    struct GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    struct GenesisNode *sampler_node = ok_mem(genesis_node_descriptor_create_node(sampler_descr));
+    struct GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+    assert(genesis_sampler_node_set_pool(sink_node, pool) == GenesisErrorInvalidParam);
+    ok_or_panic(genesis_sampler_node_set_pool(sampler_node, pool));
+    ok_or_panic(genesis_connect_ports(genesis_node_port(source_node, 0), genesis_node_port(sampler_node, 0)));
+    ok_or_panic(genesis_connect_audio_nodes(sampler_node, sink_node));
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+    assert(genesis_sampler_node_set_pool(sampler_node, nullptr) == GenesisErrorInvalidState);
+    assert(genesis_sampler_pool_add_zones(pool, zones, 1) == GenesisErrorInvalidState);
+
+    struct GenesisPort *audio_in_port = genesis_node_port(sink_node, 0);
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, 0);
+    // the release has died away by then
+    int silent_frame = note_off_frame + sample_rate / 10 + 256;
+    int frame_total = silent_frame + 1000;
+    int frames_read = 0;
+    double start_time = os_get_time();
+    while (frames_read < frame_total) {
+        if (os_get_time() - start_time > 10.0)
+            panic("sampler stalled after %d frames", frames_read);
+        int frame_count = min(genesis_audio_in_port_fill_count(audio_in_port), frame_total - frames_read);
+        float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+        for (int frame = 0; frame < frame_count; frame += 1) {
+            int frame_index = frames_read + frame;
+            // the filter's window reaches past the start of the sample
+            // for its first frames
+            double expected = (frame_index - note_on_frame) * step;
+            bool sounding = expected >= 16.0 && frame_index < note_off_frame;
+            bool silent = frame_index < note_on_frame || frame_index >= silent_frame;
+            if ((sounding && fabs(in_buf[frame] - expected) > 1e-4 * expected + 0.01) ||
+                (silent && in_buf[frame] != 0.0f))
+            {
+                panic("frame %d is %f, expected %f", frame_index, in_buf[frame], expected);
+            }
+        }
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+        frames_read += frame_count;
+    }
+
+    genesis_pipeline_stop(pipeline);
+    genesis_pipeline_destroy(pipeline);
+    genesis_sampler_pool_destroy(pool);
+    os_delete(path);
+}
+
+static const int network_ramp_length = 1000;
+
+// (i % network_ramp_length + 1) / 1024 for frame i, negated in the second
+// channel, so that no frame is silent
+static void network_source_run(struct GenesisNode *node) {
+    long *frame_index = (long *)genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        float value = ((*frame_index + frame) % network_ramp_length + 1) / 1024.0f;
+        out_buf[frame * 2] = value;
+        out_buf[frame * 2 + 1] = -value;
+    }
+    *frame_index += frame_count;
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+static int32_t read_l24(const unsigned char *bytes) {
+    int32_t value = bytes[0] << 16 | bytes[1] << 8 | bytes[2];
+    return (value & 0x800000) ? value - 0x1000000 : value;
+}
+
+// receives the stream of a network sink on a loopback socket. the packets
+// are in sequence and a packet's time apart, silent until the input first
+// filled up, and from then on the source's frame for each timestamp,
+// except for packets of silence when the pipeline fell behind.
+static void run_network_sink(GenesisContext *context) {
+    static const int packet_frames = 48;
+    static const int audio_packet_total = 500;
+
+    int receiver = socket(AF_INET, SOCK_DGRAM, 0);
+    assert(receiver != -1);
+    struct sockaddr_in receiver_address;
+    memset(&receiver_address, 0, sizeof(receiver_address));
+    receiver_address.sin_family = AF_INET;
+    receiver_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(receiver, (struct sockaddr *)&receiver_address, sizeof(receiver_address)) == 0);
+    socklen_t address_size = sizeof(receiver_address);
+    assert(getsockname(receiver, (struct sockaddr *)&receiver_address, &address_size) == 0);
+    struct timeval timeout = {5, 0};
+    setsockopt(receiver, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    int sample_rate = genesis_pipeline_get_sample_rate(pipeline);
+
+    long frame_index = 0;
+    struct GenesisNodeDescriptor *source_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "test_network_source", "Test network source."));
+    genesis_node_descriptor_set_userdata(source_descr, &frame_index);
+    genesis_node_descriptor_set_run_callback(source_descr, network_source_run);
+    struct GenesisPortDescriptor *out_descr = ok_mem(genesis_node_descriptor_create_port(
+                source_descr, 0, GenesisPortTypeAudioOut, "audio_out"));
+    ok_or_panic(genesis_audio_port_descriptor_set_channel_layout(out_descr,
+                soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdStereo), true, -1));
+    ok_or_panic(genesis_audio_port_descriptor_set_sample_rate(out_descr, sample_rate, true, -1));
+
+    struct GenesisNodeDescriptor *sink_descr = ok_mem(genesis_node_descriptor_find(pipeline, "network-sink"));
+    struct GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    struct GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+    assert(genesis_network_sink_node_set_destination(source_node, "127.0.0.1", 5004) == GenesisErrorInvalidParam);
+    assert(genesis_network_sink_node_set_destination(sink_node, "127.0.0.1", 0) == GenesisErrorInvalidParam);
+    assert(genesis_network_sink_node_set_packet_frames(sink_node, 0) == GenesisErrorInvalidParam);
+    ok_or_panic(genesis_network_sink_node_set_packet_frames(sink_node, packet_frames));
+    ok_or_panic(genesis_network_sink_node_set_destination(sink_node, "127.0.0.1",
+                ntohs(receiver_address.sin_port)));
+    ok_or_panic(genesis_connect_audio_nodes(source_node, sink_node));
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+    assert(genesis_network_sink_node_set_packet_frames(sink_node, 96) == GenesisErrorInvalidState);
+
+    int packet_size = 12 + packet_frames * 2 * 3;
+    unsigned char packet[1500];
+    bool first = true;
+    uint16_t sequence = 0;
+    uint32_t timestamp = 0;
+    uint32_t ssrc = 0;
+    bool started = false;
+    uint32_t start_timestamp = 0;
+    int audio_packet_count = 0;
+    while (audio_packet_count < audio_packet_total) {
+        ssize_t size = recv(receiver, packet, sizeof(packet), 0);
+        if (size == -1)
+            panic("network sink stalled after %d packets", audio_packet_count);
+        assert(size == packet_size);
+        assert(packet[0] == 0x80 && packet[1] == 96);
+        uint16_t packet_sequence = packet[2] << 8 | packet[3];
+        uint32_t packet_timestamp = (uint32_t)packet[4] << 24 | packet[5] << 16 | packet[6] << 8 | packet[7];
+        uint32_t packet_ssrc = (uint32_t)packet[8] << 24 | packet[9] << 16 | packet[10] << 8 | packet[11];
+        if (!first) {
+            assert(packet_sequence == (uint16_t)(sequence + 1));
+            assert(packet_ssrc == ssrc);
+            uint32_t step = packet_timestamp - timestamp;
+            assert(step > 0 && step % packet_frames == 0);
+        }
+        first = false;
+        sequence = packet_sequence;
+        timestamp = packet_timestamp;
+        ssrc = packet_ssrc;
+
+        const unsigned char *payload = packet + 12;
+        bool silent = true;
+        for (int i = 0; i < packet_frames * 2 * 3; i += 1)
+            silent = silent && payload[i] == 0;
+        if (silent)
+            continue;
+        if (!started) {
+            started = true;
+            start_timestamp = packet_timestamp;
+        }
+        for (int frame = 0; frame < packet_frames; frame += 1) {
+            uint32_t source_frame = packet_timestamp - start_timestamp + frame;
+            float value = (source_frame % network_ramp_length + 1) / 1024.0f;
+            for (int ch = 0; ch < 2; ch += 1) {
+                int32_t expected = (int32_t)((ch == 0 ? value : -value) * 8388607.0f);
+                int32_t sample = read_l24(payload + (frame * 2 + ch) * 3);
+                if (sample != expected)
+                    panic("frame %u channel %d is %d, expected %d", source_frame, ch, sample, expected);
+            }
+        }
+        audio_packet_count += 1;
+    }
+    genesis_pipeline_stop(pipeline);
+
+    struct GenesisNetworkSinkStats stats;
+    assert(genesis_network_sink_node_get_stats(source_node, &stats) == GenesisErrorInvalidParam);
+    ok_or_panic(genesis_network_sink_node_get_stats(sink_node, &stats));
+    assert(stats.sent_packet_count >= audio_packet_total);
+    assert(stats.send_error == 0);
+
+    genesis_pipeline_destroy(pipeline);
+    close(receiver);
+}
+
+void test_pipeline(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    assert(genesis_context_set_pipeline_threads(context, GenesisThreadPolicyRealtimeFifo, -1, 0) ==
+            GenesisErrorInvalidParam);
+    ok_or_panic(genesis_context_set_pipeline_threads(context, GenesisThreadPolicyRealtimeFifo, 0, 0));
+
+    run_pipeline(context, GenesisSchedulerWorkStealing, false, true, false, 0, false);
+    run_pipeline(context, GenesisSchedulerSharedQueue, false, false, false, 0, false);
+    run_pipeline(context, GenesisSchedulerWorkStealing, true, false, false, 0, false);
+    run_pipeline(context, GenesisSchedulerSharedQueue, true, true, false, 0, false);
+    run_pipeline(context, GenesisSchedulerWorkStealing, false, false, true, 0, false);
+    run_pipeline(context, GenesisSchedulerSharedQueue, true, false, true, 0, false);
+    run_pipeline(context, GenesisSchedulerWorkStealing, false, false, false, 128, false);
+    run_pipeline(context, GenesisSchedulerWorkStealing, true, false, false, 96, false);
+    run_pipeline(context, GenesisSchedulerWorkStealing, false, false, false, 0, true);
+    run_pipeline(context, GenesisSchedulerSharedQueue, true, false, false, 0, true);
+    run_pipeline(context, GenesisSchedulerWorkStealing, true, false, false, 128, true);
+    run_pipeline(context, GenesisSchedulerCriticalPath, false, false, false, 0, false);
+    run_pipeline(context, GenesisSchedulerCriticalPath, true, true, false, 128, false);
+    run_concurrent_pipelines(context);
+    run_thread_scaling_policy();
+    run_thread_scaling(context);
+    run_fan_out(context, false);
+    run_fan_out(context, true);
+    run_silence(context, 0, false);
+    run_silence(context, 128, true);
+    run_planar(context, 0);
+    run_planar(context, 128);
+    run_precision(context, 0);
+    run_precision(context, 128);
+    run_synth_events(context);
+    run_dense_events(context);
+    run_sampler(context);
+    run_network_sink(context);
+    run_delay(context);
+    run_checkpoints(context);
+    run_time_stretch(context);
+    run_convolution(context, true);
+    run_convolution(context, false);
+    run_meter(context);
+    run_disk_recorder(context, false);
+    run_disk_recorder(context, true);
+    run_param_automation(context);
+    run_latency_compensation(context);
+    run_mixer_tree(context);
+    // same rate, so only channel remapping
+    run_resample(context, 48000, 48000, GenesisResampleQualityRealtime);
+    run_resample(context, 44100, 48000, GenesisResampleQualityRealtime);
+    run_resample(context, 48000, 44100, GenesisResampleQualityRealtime);
+    // large upsample factor, so the phases are interpolated
+    run_resample(context, 44100, 48001, GenesisResampleQualityRealtime);
+    run_resample(context, 44100, 48000, GenesisResampleQualityDraft);
+    run_resample(context, 48000, 44100, GenesisResampleQualityMastering);
+    run_resample_silence(context);
+    // the threads exist now
+    assert(genesis_context_set_pipeline_threads(context, GenesisThreadPolicyNormal, 0, 0) ==
+            GenesisErrorInvalidState);
+
+    genesis_context_destroy(context);
+}
@@ -0,0 +1,8 @@
+#ifndef PIPELINE_TEST_HPP
+#define PIPELINE_TEST_HPP
+
+#undef NDEBUG
+
+void test_pipeline(void);
+
+#endif
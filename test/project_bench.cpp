@@ -0,0 +1,178 @@
+// measures how long commands take to commit and projects take to open. a
+// synthetic project is built through the same calls the editor makes, with
+// --undo more commands that change clip voices on top, then opened again
+// several times. each open is broken down into reading the ordered map
+// file, deserializing the objects and sorting the indexes. there is no
+// command that adds effects, so only the master send is there. results go
+// to stdout as json and a summary to stderr. not part of the unit tests;
+// run it by hand from the build directory:
+//     ./project_bench [--tracks 200] [--clips 50] [--segments 5000] [--undo 1000]
+//             [--opens 5] [--asset ../test/tiny-sine.ogg]
+
+#include "project.hpp"
+#include "os.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *tmp_proj_dir = "/tmp/genesis_project_bench";
+static const char *tmp_proj_path = "/tmp/genesis_project_bench/project.gdaw";
+
+// seconds of each commit of one kind of command
+struct CommitTimes {
+    const char *name;
+    int count;
+    double total;
+    double max;
+};
+
+static void add_commit_time(CommitTimes *times, double seconds) {
+    times->count += 1;
+    times->total += seconds;
+    times->max = max(times->max, seconds);
+}
+
+static void print_commit_times(const CommitTimes *times) {
+    double mean_us = (times->count > 0) ? times->total / times->count * 1e6 : 0.0;
+    printf("    {\"command\":\"%s\",\"count\":%d,\"mean_us\":%.3f,\"max_us\":%.3f},\n",
+            times->name, times->count, mean_us, times->max * 1e6);
+    fprintf(stderr, "%-24s %8d commits %10.3f us mean %10.3f us max\n",
+            times->name, times->count, mean_us, times->max * 1e6);
+}
+
+static int usage(const char *exe) {
+    fprintf(stderr, "Usage: %s [--tracks 200] [--clips 50] [--segments 5000] [--undo 1000]\n"
+            "        [--opens 5] [--asset ../test/tiny-sine.ogg]\n", exe);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    int track_count = 200;
+    int clip_count = 50;
+    int segment_count = 5000;
+    int undo_count = 1000;
+    int open_count = 5;
+    const char *asset_path = "../test/tiny-sine.ogg";
+    for (int i = 1; i < argc; i += 1) {
+        const char *arg = argv[i];
+        if (i + 1 >= argc)
+            return usage(argv[0]);
+        const char *value = argv[++i];
+        if (strcmp(arg, "--tracks") == 0) {
+            track_count = atoi(value);
+        } else if (strcmp(arg, "--clips") == 0) {
+            clip_count = atoi(value);
+        } else if (strcmp(arg, "--segments") == 0) {
+            segment_count = atoi(value);
+        } else if (strcmp(arg, "--undo") == 0) {
+            undo_count = atoi(value);
+        } else if (strcmp(arg, "--opens") == 0) {
+            open_count = atoi(value);
+        } else if (strcmp(arg, "--asset") == 0) {
+            asset_path = value;
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if (track_count < 1 || clip_count < 1 || segment_count < 0 || undo_count < 0 || open_count < 1)
+        return usage(argv[0]);
+
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    ok_or_panic(os_mkdirp(tmp_proj_dir));
+    os_delete(tmp_proj_path);
+
+    User *user = user_create(uint256::random(), os_get_user_name());
+    Project *project;
+    ok_or_panic(project_create(context, tmp_proj_path, uint256::random(), user, &project));
+    // every command stays on the undo stack
+    int command_count = (track_count - 1) + clip_count + segment_count + undo_count;
+    project_set_undo_limits(project, DEFAULT_UNDO_RESIDENT_COUNT, max(DEFAULT_UNDO_MAX_COUNT, command_count));
+
+    CommitTimes track_times = {"add_track", 0, 0.0, 0.0};
+    CommitTimes clip_times = {"add_audio_clip", 0, 0.0, 0.0};
+    CommitTimes segment_times = {"add_audio_clip_segment", 0, 0.0, 0.0};
+    CommitTimes voices_times = {"set_audio_clip_voices", 0, 0.0, 0.0};
+
+    // the project starts with a track
+    for (int i = 1; i < track_count; i += 1) {
+        double start_time = os_get_time();
+        project_insert_track(project, project->track_list.last(), nullptr);
+        add_commit_time(&track_times, os_get_time() - start_time);
+    }
+
+    AudioAsset *audio_asset;
+    ok_or_panic(project_add_audio_asset(project, asset_path, &audio_asset));
+    ByteBuffer copied_asset_path;
+    os_path_join(copied_asset_path, tmp_proj_dir, audio_asset->path);
+    for (int i = 0; i < clip_count; i += 1) {
+        double start_time = os_get_time();
+        project_add_audio_clip(project, audio_asset);
+        add_commit_time(&clip_times, os_get_time() - start_time);
+    }
+
+    for (int i = 0; i < segment_count; i += 1) {
+        AudioClip *audio_clip = project->audio_clip_list.at(i % clip_count);
+        Track *track = project->track_list.at(i % track_count);
+        double pos = (i / track_count) * 0.25;
+        double start_time = os_get_time();
+        project_add_audio_clip_segment(project, audio_clip, track, 0, 100, pos);
+        add_commit_time(&segment_times, os_get_time() - start_time);
+    }
+
+    // undo entries which only change a little, as most edits do
+    for (int i = 0; i < undo_count; i += 1) {
+        AudioClip *audio_clip = project->audio_clip_list.at(i % clip_count);
+        double start_time = os_get_time();
+        project_set_audio_clip_voices(project, audio_clip, 1 + (i / clip_count) % 2, AudioClipVoiceStealOldest);
+        add_commit_time(&voices_times, os_get_time() - start_time);
+    }
+
+    double close_start_time = os_get_time();
+    project_close(project);
+    double close_seconds = os_get_time() - close_start_time;
+    long create_peak_bytes = os_get_peak_memory_bytes();
+
+    printf("{\n  \"tracks\":%d,\"clips\":%d,\"segments\":%d,\"undo\":%d,\n",
+            track_count, clip_count, segment_count, undo_count);
+    printf("  \"commits\":[\n");
+    print_commit_times(&track_times);
+    print_commit_times(&clip_times);
+    print_commit_times(&segment_times);
+    print_commit_times(&voices_times);
+    printf("    {\"command\":\"close\",\"count\":1,\"mean_us\":%.3f,\"max_us\":%.3f}\n  ],\n",
+            close_seconds * 1e6, close_seconds * 1e6);
+
+    // the quickest of the opens is the least disturbed one
+    ProjectOpenStats best = {};
+    double best_total = 0.0;
+    for (int i = 0; i < open_count; i += 1) {
+        double start_time = os_get_time();
+        ok_or_panic(project_open(context, tmp_proj_path, user, &project));
+        double total = os_get_time() - start_time;
+        if (i == 0 || total < best_total) {
+            best = project->open_stats;
+            best_total = total;
+        }
+        project_close(project);
+    }
+    long open_peak_bytes = os_get_peak_memory_bytes();
+
+    printf("  \"open\":{\"total_ms\":%.3f,\"omf_open_ms\":%.3f,\"deserialize_ms\":%.3f,\"index_ms\":%.3f},\n",
+            best_total * 1e3, best.omf_open_seconds * 1e3, best.deserialize_seconds * 1e3,
+            best.index_seconds * 1e3);
+    printf("  \"peak_rss_bytes\":{\"after_create\":%ld,\"after_open\":%ld}\n}\n",
+            create_peak_bytes, open_peak_bytes);
+    fprintf(stderr, "open %.3f ms: omf %.3f ms, deserialize %.3f ms, index %.3f ms\n",
+            best_total * 1e3, best.omf_open_seconds * 1e3, best.deserialize_seconds * 1e3,
+            best.index_seconds * 1e3);
+    fprintf(stderr, "peak rss %.1f MiB after create, %.1f MiB after open\n",
+            create_peak_bytes / 1048576.0, open_peak_bytes / 1048576.0);
+
+    os_delete(copied_asset_path.raw());
+    os_delete(tmp_proj_path);
+    user_destroy(user);
+    genesis_context_destroy(context);
+    return 0;
+}
@@ -0,0 +1,172 @@
+// measures throughput of BoundedQueue against LockedQueue and
+// ThreadSafeQueue, with one item at a time and in batches, for several
+// counts of producers and consumers. each consumer blocks until there is
+// something to take. not part of the unit tests; run it by hand:
+//     ./queue_bench
+
+#include "bounded_queue.hpp"
+#include "locked_queue.hpp"
+#include "thread_safe_queue.hpp"
+#include "genesis.h"
+#include "os.hpp"
+
+#include <stdio.h>
+
+static const int max_thread_count = 8;
+static const int item_count = 400000;
+static const int bounded_capacity = 1024;
+static const int max_batch_size = 64;
+
+enum QueueKind {
+    QueueKindBounded,
+    QueueKindLocked,
+    QueueKindThreadSafe,
+};
+
+static const char *queue_kind_names[] = {
+    "BoundedQueue",
+    "LockedQueue",
+    "ThreadSafeQueue",
+};
+
+struct BenchItem {
+    bool stop;
+};
+
+struct Bench {
+    QueueKind kind;
+    BoundedQueue<BenchItem *> bounded;
+    LockedQueue<BenchItem *> locked;
+    ThreadSafeQueue<BenchItem *> thread_safe;
+    BenchItem *items;
+    BenchItem stop_item;
+    int items_per_producer;
+    int batch_size;
+    atomic_int next_item;
+};
+
+static void push_item(Bench *bench, BenchItem *item) {
+    switch (bench->kind) {
+    case QueueKindBounded:
+        ok_or_panic(bench->bounded.push(item));
+        return;
+    case QueueKindLocked:
+        ok_or_panic(bench->locked.push(item));
+        return;
+    case QueueKindThreadSafe:
+        bench->thread_safe.enqueue(item);
+        return;
+    }
+    panic("invalid queue kind");
+}
+
+// blocks for the first item and takes up to batch_size
+static int shift_items(Bench *bench, BenchItem **items, List<BenchItem *> &list) {
+    switch (bench->kind) {
+    case QueueKindBounded:
+        ok_or_panic(bench->bounded.shift(&items[0]));
+        return 1 + bench->bounded.try_shift_many(items + 1, bench->batch_size - 1);
+    case QueueKindLocked:
+        if (bench->batch_size == 1) {
+            ok_or_panic(bench->locked.shift(&items[0]));
+            return 1;
+        }
+        // LockedQueue has no bounded batch; it hands over all it holds
+        list.clear();
+        ok_or_panic(bench->locked.shift_all(list, -1.0));
+        for (int i = 0; i < list.length(); i += 1)
+            items[i] = list.at(i);
+        return list.length();
+    case QueueKindThreadSafe:
+        return bench->thread_safe.dequeue_many(items, bench->batch_size);
+    }
+    panic("invalid queue kind");
+}
+
+// producers hand out consecutive slices of bench->items
+static void producer_run(void *userdata) {
+    Bench *bench = (Bench *)userdata;
+    int start = bench->next_item.fetch_add(bench->items_per_producer);
+    for (int i = 0; i < bench->items_per_producer; i += 1)
+        push_item(bench, &bench->items[start + i]);
+}
+
+static void consumer_run(void *userdata) {
+    Bench *bench = (Bench *)userdata;
+    BenchItem **batch = ok_mem(allocate_zero<BenchItem *>(item_count + max_thread_count));
+    List<BenchItem *> list;
+    for (;;) {
+        int count = shift_items(bench, batch, list);
+        for (int i = 0; i < count; i += 1) {
+            if (batch[i]->stop) {
+                // give back the rest of the batch so every consumer sees a stop item
+                for (int j = i + 1; j < count; j += 1)
+                    push_item(bench, batch[j]);
+                destroy(batch, item_count + max_thread_count);
+                return;
+            }
+        }
+    }
+}
+
+static double run_throughput(Bench *bench, QueueKind kind, int producer_count, int consumer_count,
+        int batch_size)
+{
+    int items_per_producer = item_count / producer_count;
+    bench->kind = kind;
+    bench->items_per_producer = items_per_producer;
+    bench->batch_size = batch_size;
+    bench->next_item.store(0);
+    ok_or_panic(bench->bounded.init(bounded_capacity));
+    ok_or_panic(bench->thread_safe.resize(item_count + consumer_count + max_thread_count));
+
+    OsThread *consumers[max_thread_count];
+    OsThread *producers[max_thread_count];
+    double start = os_get_time();
+    for (int i = 0; i < consumer_count; i += 1)
+        ok_or_panic(os_thread_create(consumer_run, bench, false, &consumers[i]));
+    for (int i = 0; i < producer_count; i += 1)
+        ok_or_panic(os_thread_create(producer_run, bench, false, &producers[i]));
+    for (int i = 0; i < producer_count; i += 1)
+        os_thread_destroy(producers[i]);
+    for (int i = 0; i < consumer_count; i += 1)
+        push_item(bench, &bench->stop_item);
+    for (int i = 0; i < consumer_count; i += 1)
+        os_thread_destroy(consumers[i]);
+    double elapsed = os_get_time() - start;
+
+    return (items_per_producer * producer_count) / elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    // do all the one-time initialization stuff
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    genesis_context_destroy(context);
+
+    Bench *bench = ok_mem(create_zero<Bench>());
+    ok_or_panic(bench->locked.error());
+    bench->items = ok_mem(allocate_zero<BenchItem>(item_count));
+    bench->stop_item.stop = true;
+
+    fprintf(stderr, "throughput, BoundedQueue holding %d items\n", bounded_capacity);
+    fprintf(stderr, "%16s %10s %10s %6s %14s\n", "queue", "producers", "consumers", "batch", "items/s");
+    static const int thread_counts[] = {1, 2, 4, 8};
+    static const int batch_sizes[] = {1, max_batch_size};
+    for (int p = 0; p < array_length(thread_counts); p += 1) {
+        for (int c = 0; c < array_length(thread_counts); c += 1) {
+            for (int b = 0; b < array_length(batch_sizes); b += 1) {
+                for (int kind = 0; kind < array_length(queue_kind_names); kind += 1) {
+                    double rate = run_throughput(bench, (QueueKind)kind, thread_counts[p],
+                            thread_counts[c], batch_sizes[b]);
+                    fprintf(stderr, "%16s %10d %10d %6d %14.0f\n", queue_kind_names[kind],
+                            thread_counts[p], thread_counts[c], batch_sizes[b], rate);
+                }
+            }
+        }
+    }
+
+    destroy(bench->items, item_count);
+    destroy(bench, 1);
+    return 0;
+}
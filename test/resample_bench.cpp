@@ -0,0 +1,196 @@
+// measures resample node throughput and signal to noise ratio for each
+// quality preset over common sample rate conversions. the input is a stereo
+// sine and the noise is whatever is left of the output after subtracting the
+// best fitting sine of the same frequency. not part of the unit tests; run it
+// by hand:
+//     ./resample_bench
+
+#include "genesis.h"
+#include "os.hpp"
+#include "util.hpp"
+
+#include <stdio.h>
+#include <math.h>
+
+static const int channel_count = 2;
+// seconds of output per run
+static const double run_seconds = 5.0;
+// seconds skipped before the analysis, so the filter has warmed up
+static const double skip_seconds = 0.1;
+
+struct SineOscillator {
+    int sample_rate;
+    double hz;
+    // rotating phasor, cheaper than calling sin for every frame
+    double re;
+    double im;
+    double step_re;
+    double step_im;
+    long frame_index;
+};
+
+static void sine_source_run(struct GenesisNode *node) {
+    SineOscillator *osc = (SineOscillator *)genesis_node_descriptor_userdata(genesis_node_descriptor(node));
+    struct GenesisPort *audio_out_port = genesis_node_port(node, 0);
+    int frame_count = genesis_audio_out_port_free_count(audio_out_port);
+    float *out_buf = genesis_audio_out_port_write_ptr(audio_out_port);
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        float sample = 0.5 * osc->im;
+        for (int ch = 0; ch < channel_count; ch += 1)
+            out_buf[frame * channel_count + ch] = sample;
+        double re = osc->re * osc->step_re - osc->im * osc->step_im;
+        double im = osc->re * osc->step_im + osc->im * osc->step_re;
+        osc->re = re;
+        osc->im = im;
+        osc->frame_index += 1;
+        // keep rounding errors from growing the amplitude
+        if ((osc->frame_index & 0xffff) == 0) {
+            double length = sqrt(osc->re * osc->re + osc->im * osc->im);
+            osc->re /= length;
+            osc->im /= length;
+        }
+    }
+    genesis_audio_out_port_advance_write_ptr(audio_out_port, frame_count);
+}
+
+static void set_stereo(struct GenesisPortDescriptor *port_descr, int sample_rate) {
+    ok_or_panic(genesis_audio_port_descriptor_set_channel_layout(port_descr,
+        soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdStereo), true, -1));
+    ok_or_panic(genesis_audio_port_descriptor_set_sample_rate(port_descr, sample_rate, true, -1));
+}
+
+// least squares fit of a * sin + b * cos to samples, then the power of the
+// fitted sine over the power of what is left
+static double sine_snr_db(const float *samples, int sample_count, double step) {
+    double ss = 0.0, sc = 0.0, cc = 0.0, sy = 0.0, cy = 0.0;
+    for (int i = 0; i < sample_count; i += 1) {
+        double s = sin(i * step);
+        double c = cos(i * step);
+        ss += s * s;
+        sc += s * c;
+        cc += c * c;
+        sy += s * samples[i];
+        cy += c * samples[i];
+    }
+    double det = ss * cc - sc * sc;
+    double a = (sy * cc - cy * sc) / det;
+    double b = (cy * ss - sy * sc) / det;
+
+    double signal = 0.0;
+    double noise = 0.0;
+    for (int i = 0; i < sample_count; i += 1) {
+        double fitted = a * sin(i * step) + b * cos(i * step);
+        double residual = samples[i] - fitted;
+        signal += fitted * fitted;
+        noise += residual * residual;
+    }
+    return 10.0 * log10(signal / max(noise, 1e-30));
+}
+
+// resamples a sine of hz for run_seconds. returns output frames per second
+// of wall time and the snr of the first channel
+static void run_resample(GenesisContext *context, int in_sample_rate, int out_sample_rate,
+        GenesisResampleQuality quality, double hz, double *out_frames_per_sec, double *out_snr_db)
+{
+    struct GenesisPipeline *pipeline;
+    ok_or_panic(genesis_pipeline_create(context, &pipeline));
+    ok_or_panic(genesis_pipeline_set_offline(pipeline, true));
+
+    double step = 2.0 * M_PI * hz / in_sample_rate;
+    SineOscillator osc = {in_sample_rate, hz, 1.0, 0.0, cos(step), sin(step), 0};
+    struct GenesisNodeDescriptor *source_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "bench_sine", "Benchmark sine source."));
+    genesis_node_descriptor_set_userdata(source_descr, &osc);
+    genesis_node_descriptor_set_run_callback(source_descr, sine_source_run);
+    set_stereo(ok_mem(genesis_node_descriptor_create_port(source_descr, 0, GenesisPortTypeAudioOut,
+                    "audio_out")), in_sample_rate);
+
+    struct GenesisNodeDescriptor *sink_descr = ok_mem(
+            genesis_create_node_descriptor(pipeline, 1, "bench_sink", "Benchmark sink."));
+    set_stereo(ok_mem(genesis_node_descriptor_create_port(sink_descr, 0, GenesisPortTypeAudioIn,
+                    "audio_in")), out_sample_rate);
+
+    struct GenesisNodeDescriptor *resample_descr = ok_mem(genesis_node_descriptor_find(pipeline, "resample"));
+    ok_or_panic(genesis_resample_descriptor_set_quality(resample_descr, quality));
+    struct GenesisNode *source_node = ok_mem(genesis_node_descriptor_create_node(source_descr));
+    struct GenesisNode *resample_node = ok_mem(genesis_node_descriptor_create_node(resample_descr));
+    struct GenesisNode *sink_node = ok_mem(genesis_node_descriptor_create_node(sink_descr));
+    ok_or_panic(genesis_connect_audio_nodes(source_node, resample_node));
+    ok_or_panic(genesis_connect_audio_nodes(resample_node, sink_node));
+
+    int skip_frames = skip_seconds * out_sample_rate;
+    int total_frames = run_seconds * out_sample_rate;
+    int analysis_frame_count = total_frames - skip_frames;
+    float *analysis = ok_mem(allocate_zero<float>(analysis_frame_count));
+
+    double start_time = os_get_time();
+    ok_or_panic(genesis_pipeline_start(pipeline, 0.0));
+    struct GenesisPort *audio_in_port = genesis_node_port(sink_node, 0);
+    genesis_audio_in_port_advance_read_ptr(audio_in_port, 0);
+    int frames_read = 0;
+    while (frames_read < total_frames) {
+        int frame_count = min(genesis_audio_in_port_fill_count(audio_in_port), total_frames - frames_read);
+        float *in_buf = genesis_audio_in_port_read_ptr(audio_in_port);
+        for (int frame = 0; frame < frame_count; frame += 1) {
+            int frame_index = frames_read + frame;
+            if (frame_index < skip_frames)
+                continue;
+            analysis[frame_index - skip_frames] = in_buf[frame * channel_count];
+        }
+        genesis_audio_in_port_advance_read_ptr(audio_in_port, frame_count);
+        frames_read += frame_count;
+    }
+    double elapsed = os_get_time() - start_time;
+    genesis_pipeline_stop(pipeline);
+    genesis_pipeline_destroy(pipeline);
+
+    *out_frames_per_sec = total_frames / elapsed;
+    *out_snr_db = sine_snr_db(analysis, analysis_frame_count, 2.0 * M_PI * hz / out_sample_rate);
+    destroy(analysis, analysis_frame_count);
+}
+
+int main(int argc, char *argv[]) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+
+    struct RatePair {
+        int in_sample_rate;
+        int out_sample_rate;
+    };
+    static const RatePair rate_pairs[] = {
+        {44100, 48000},
+        {48000, 44100},
+        {48000, 96000},
+        {96000, 48000},
+        {44100, 96000},
+        {96000, 44100},
+    };
+    static const GenesisResampleQuality qualities[] = {
+        GenesisResampleQualityDraft,
+        GenesisResampleQualityRealtime,
+        GenesisResampleQualityMastering,
+    };
+    static const char *quality_names[] = {"draft", "realtime", "mastering"};
+
+    fprintf(stderr, "stereo, %.0f seconds of output per run\n", run_seconds);
+    fprintf(stderr, "%8s %8s %10s %14s %12s %12s\n",
+            "in", "out", "quality", "frames/s", "snr 1k (dB)", "snr hi (dB)");
+    for (int pair_i = 0; pair_i < array_length(rate_pairs); pair_i += 1) {
+        const RatePair *pair = &rate_pairs[pair_i];
+        // near the top of the band that survives the conversion
+        double high_hz = 0.45 * min(pair->in_sample_rate, pair->out_sample_rate);
+        for (int quality_i = 0; quality_i < array_length(qualities); quality_i += 1) {
+            double frames_per_sec, snr_low, snr_high, unused;
+            run_resample(context, pair->in_sample_rate, pair->out_sample_rate, qualities[quality_i],
+                    1000.0, &frames_per_sec, &snr_low);
+            run_resample(context, pair->in_sample_rate, pair->out_sample_rate, qualities[quality_i],
+                    high_hz, &unused, &snr_high);
+            fprintf(stderr, "%8d %8d %10s %14.0f %12.1f %12.1f\n",
+                    pair->in_sample_rate, pair->out_sample_rate, quality_names[quality_i],
+                    frames_per_sec, snr_low, snr_high);
+        }
+    }
+
+    genesis_context_destroy(context);
+    return 0;
+}
@@ -0,0 +1,132 @@
+// compares RingBuffer and SpscRingBuffer between two threads: streaming
+// throughput, and ping-pong round trips where each side waits for the
+// other's message before it sends the next. both sides spin, so run it on a
+// machine with at least two idle cpus. not part of the unit tests; run it
+// by hand:
+//     ./ring_buffer_bench
+
+#include "ring_buffer.hpp"
+#include "genesis.h"
+#include "os.hpp"
+
+#include <stdio.h>
+
+static const int ring_size = 64 * 1024;
+static const long stream_byte_count = 2L * 1024 * 1024 * 1024;
+static const int round_trip_count = 1000000;
+static const int message_size = 64;
+static const int chunk_sizes[] = {64, 1024, 16384};
+
+// the same calls for both kinds of ring buffer, so the bench is one template.
+// RingBuffer has no wanted count; it always looks at the other offset.
+
+static int free_count(RingBuffer *rb, int) { return ring_buffer_free_count(rb); }
+static int fill_count(RingBuffer *rb, int) { return ring_buffer_fill_count(rb); }
+static char *write_ptr(RingBuffer *rb) { return ring_buffer_write_ptr(rb); }
+static char *read_ptr(RingBuffer *rb) { return ring_buffer_read_ptr(rb); }
+static void advance_write(RingBuffer *rb, int count) { ring_buffer_advance_write_ptr(rb, count); }
+static void advance_read(RingBuffer *rb, int count) { ring_buffer_advance_read_ptr(rb, count); }
+
+static int free_count(SpscRingBuffer *rb, int wanted) { return spsc_ring_buffer_free_count(rb, wanted); }
+static int fill_count(SpscRingBuffer *rb, int wanted) { return spsc_ring_buffer_fill_count(rb, wanted); }
+static char *write_ptr(SpscRingBuffer *rb) { return spsc_ring_buffer_write_ptr(rb); }
+static char *read_ptr(SpscRingBuffer *rb) { return spsc_ring_buffer_read_ptr(rb); }
+static void advance_write(SpscRingBuffer *rb, int count) { spsc_ring_buffer_advance_write_ptr(rb, count); }
+static void advance_read(SpscRingBuffer *rb, int count) { spsc_ring_buffer_advance_read_ptr(rb, count); }
+
+static void init(RingBuffer *rb) { ok_or_panic(ring_buffer_init(rb, ring_size)); }
+static void deinit(RingBuffer *rb) { ring_buffer_deinit(rb); }
+static void init(SpscRingBuffer *rb) { ok_or_panic(spsc_ring_buffer_init(rb, ring_size)); }
+static void deinit(SpscRingBuffer *rb) { spsc_ring_buffer_deinit(rb); }
+
+template<typename Ring>
+struct Bench {
+    Ring *ping;
+    Ring *pong;
+    int chunk_size;
+};
+
+template<typename Ring>
+static void send(Ring *rb, int size) {
+    while (free_count(rb, size) < size)
+        cpu_relax();
+    *write_ptr(rb) = 1;
+    advance_write(rb, size);
+}
+
+template<typename Ring>
+static void receive(Ring *rb, int size) {
+    while (fill_count(rb, size) < size)
+        cpu_relax();
+    // touch the bytes, as a real reader would
+    volatile char c = *read_ptr(rb);
+    (void)c;
+    advance_read(rb, size);
+}
+
+template<typename Ring>
+static void stream_writer_run(void *userdata) {
+    Bench<Ring> *bench = (Bench<Ring> *)userdata;
+    for (long sent = 0; sent < stream_byte_count; sent += bench->chunk_size) {
+        send(bench->ping, bench->chunk_size);
+    }
+}
+
+template<typename Ring>
+static void pong_run(void *userdata) {
+    Bench<Ring> *bench = (Bench<Ring> *)userdata;
+    for (int i = 0; i < round_trip_count; i += 1) {
+        receive(bench->ping, message_size);
+        send(bench->pong, message_size);
+    }
+}
+
+template<typename Ring>
+static void run(const char *name) {
+    Ring *ping = ok_mem(allocate_zero<Ring>(1));
+    Ring *pong = ok_mem(allocate_zero<Ring>(1));
+    init(ping);
+    init(pong);
+    Bench<Ring> bench = {ping, pong, 0};
+    OsThread *thread;
+
+    for (int i = 0; i < array_length(chunk_sizes); i += 1) {
+        bench.chunk_size = chunk_sizes[i];
+        double start = os_get_time();
+        ok_or_panic(os_thread_create(stream_writer_run<Ring>, &bench, false, &thread));
+        for (long received = 0; received < stream_byte_count; received += bench.chunk_size)
+            receive(ping, bench.chunk_size);
+        os_thread_destroy(thread);
+        double seconds = os_get_time() - start;
+        fprintf(stderr, "%16s %12d %14.0f\n", name, bench.chunk_size,
+                stream_byte_count / seconds / (1024.0 * 1024.0));
+    }
+
+    double start = os_get_time();
+    ok_or_panic(os_thread_create(pong_run<Ring>, &bench, false, &thread));
+    for (int i = 0; i < round_trip_count; i += 1) {
+        send(ping, message_size);
+        receive(pong, message_size);
+    }
+    os_thread_destroy(thread);
+    double seconds = os_get_time() - start;
+    fprintf(stderr, "%16s %12s %14.0f\n", name, "round trips", round_trip_count / seconds);
+
+    deinit(ping);
+    deinit(pong);
+    destroy(ping, 1);
+    destroy(pong, 1);
+}
+
+int main(int argc, char *argv[]) {
+    // do all the one-time initialization stuff
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    genesis_context_destroy(context);
+
+    fprintf(stderr, "%16s %12s %14s\n", "ring buffer", "chunk", "MiB/s or /s");
+    run<RingBuffer>("RingBuffer");
+    run<SpscRingBuffer>("SpscRingBuffer");
+
+    return 0;
+}
@@ -52,6 +52,80 @@ static void basic_test(void) {
     assert(ring_buffer_free_count(&rb) == rb.capacity);
 }
 
+// the writer only gets the room that the slowest reader has freed
+static void multi_reader_test(void) {
+    RingBuffer rb;
+    assert_no_err(ring_buffer_init(&rb, 10));
+    assert(ring_buffer_add_reader(&rb) == 1);
+    assert(ring_buffer_add_reader(&rb) == 2);
+
+    int amt = sprintf(ring_buffer_write_ptr(&rb), "hello") + 1;
+    ring_buffer_advance_write_ptr(&rb, amt);
+    for (int i = 0; i < 3; i += 1) {
+        assert(ring_buffer_reader_fill_count(&rb, i) == amt);
+        assert(strcmp(ring_buffer_reader_read_ptr(&rb, i), "hello") == 0);
+    }
+
+    ring_buffer_reader_advance_read_ptr(&rb, 0, amt);
+    ring_buffer_reader_advance_read_ptr(&rb, 2, 2);
+    assert(ring_buffer_reader_fill_count(&rb, 0) == 0);
+    assert(ring_buffer_fill_count(&rb) == amt);
+    assert(ring_buffer_free_count(&rb) == rb.capacity - amt);
+
+    // reader 2 moves into the place of reader 1
+    ring_buffer_remove_reader(&rb, 1);
+    assert(rb.reader_count == 2);
+    assert(ring_buffer_fill_count(&rb) == amt - 2);
+    assert(strcmp(ring_buffer_reader_read_ptr(&rb, 1), "llo") == 0);
+
+    // a new reader starts with what the slowest one still has
+    assert(ring_buffer_add_reader(&rb) == 2);
+    assert(ring_buffer_reader_fill_count(&rb, 2) == amt - 2);
+
+    ring_buffer_clear(&rb);
+    for (int i = 0; i < 3; i += 1)
+        assert(ring_buffer_reader_fill_count(&rb, i) == 0);
+    assert(ring_buffer_free_count(&rb) == rb.capacity);
+
+    while (rb.reader_count < RING_BUFFER_MAX_READERS)
+        ring_buffer_add_reader(&rb);
+    assert(ring_buffer_add_reader(&rb) == -1);
+    ring_buffer_deinit(&rb);
+}
+
+// a reader that follows another only gets what that one has read past
+static void reader_source_test(void) {
+    RingBuffer rb;
+    assert_no_err(ring_buffer_init(&rb, 10));
+    assert(ring_buffer_add_reader(&rb) == 1);
+    ring_buffer_set_reader_source(&rb, 1, 0);
+
+    int amt = sprintf(ring_buffer_write_ptr(&rb), "hello") + 1;
+    ring_buffer_advance_write_ptr(&rb, amt);
+    assert(ring_buffer_reader_fill_count(&rb, 0) == amt);
+    assert(ring_buffer_reader_fill_count(&rb, 1) == 0);
+
+    ring_buffer_reader_advance_read_ptr(&rb, 0, 2);
+    assert(ring_buffer_reader_fill_count(&rb, 1) == 2);
+    assert(ring_buffer_free_count(&rb) == rb.capacity - amt);
+
+    // going back over bytes that are free again
+    char *rewound = ring_buffer_reader_rewind(&rb, 0, 2);
+    assert(rewound == ring_buffer_reader_read_ptr(&rb, 0));
+    assert(strcmp(rewound, "hello") == 0);
+    assert(ring_buffer_reader_fill_count(&rb, 0) == amt);
+    assert(ring_buffer_reader_fill_count(&rb, 1) == 0);
+
+    // a reader that follows the last one is moved along with it
+    assert(ring_buffer_add_reader(&rb) == 2);
+    ring_buffer_set_reader_source(&rb, 1, 2);
+    ring_buffer_remove_reader(&rb, 0);
+    assert(rb.reader_count == 2);
+    assert(rb.reader_sources[0] == -1);
+    assert(rb.reader_sources[1] == 0);
+    ring_buffer_deinit(&rb);
+}
+
 static RingBuffer *rb = nullptr;
 static const int size = 3528;
 static long expected_write_head;
@@ -113,7 +187,56 @@ static void threaded_test(void) {
     assert(fill_count == expected_fill_count);
 }
 
+static SpscRingBuffer *spsc_rb = nullptr;
+static const int spsc_count = 1000000;
+
+// the writer sends consecutive ints in chunks of varying size, so a reader
+// that sees a stale or torn offset finds a gap in the sequence
+static void spsc_writer_thread_run(void *) {
+    int next = 0;
+    while (next < spsc_count) {
+        int wanted = 1 + (next % 61);
+        int free_count = spsc_ring_buffer_free_count(spsc_rb, wanted * sizeof(int));
+        int amount = min((int)(free_count / sizeof(int)), min(wanted, spsc_count - next));
+        int *dest = (int *)spsc_ring_buffer_write_ptr(spsc_rb);
+        for (int i = 0; i < amount; i += 1)
+            dest[i] = next + i;
+        spsc_ring_buffer_advance_write_ptr(spsc_rb, amount * sizeof(int));
+        next += amount;
+    }
+}
+
+static void spsc_threaded_test(void) {
+    spsc_rb = ok_mem(allocate_zero<SpscRingBuffer>(1));
+    assert_no_err(spsc_ring_buffer_init(spsc_rb, 4096));
+    assert((char *)&spsc_rb->read_offset - (char *)&spsc_rb->write_offset >= SPSC_RING_BUFFER_CACHE_LINE);
+
+    OsThread *writer_thread;
+    assert_no_err(os_thread_create(spsc_writer_thread_run, nullptr, false, &writer_thread));
+
+    int expected = 0;
+    while (expected < spsc_count) {
+        int fill_count = spsc_ring_buffer_fill_count(spsc_rb, 37 * sizeof(int));
+        assert(fill_count >= 0);
+        assert(fill_count <= spsc_rb->capacity);
+        int amount = fill_count / sizeof(int);
+        const int *src = (const int *)spsc_ring_buffer_read_ptr(spsc_rb);
+        for (int i = 0; i < amount; i += 1)
+            assert(src[i] == expected + i);
+        spsc_ring_buffer_advance_read_ptr(spsc_rb, amount * sizeof(int));
+        expected += amount;
+    }
+
+    os_thread_destroy(writer_thread);
+    assert(spsc_ring_buffer_fill_count(spsc_rb, 1) == 0);
+    spsc_ring_buffer_deinit(spsc_rb);
+    destroy(spsc_rb, 1);
+}
+
 void test_ring_buffer(void) {
     basic_test();
+    multi_reader_test();
+    reader_source_test();
     threaded_test();
+    spsc_threaded_test();
 }
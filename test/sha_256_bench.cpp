@@ -0,0 +1,110 @@
+// measures sha-256 throughput of each implementation the cpu supports, on
+// one large buffer through Sha256Hasher and on many small files at once
+// through sha256_digest_many, checking every digest against rhash. not part
+// of the unit tests; run it by hand:
+//     ./sha_256_bench
+
+#include "sha_256_hasher.hpp"
+#include "genesis.h"
+#include "os.hpp"
+#include "util.hpp"
+
+#include <stdio.h>
+
+static const char *impl_names[] = {
+    "rhash",
+    "sha-ni",
+    "armv8",
+    "avx2 x8",
+};
+
+static const Sha256Impl impls[] = {
+    Sha256ImplRhash,
+    Sha256ImplShaNi,
+    Sha256ImplArmv8,
+    Sha256ImplAvx2,
+};
+
+static const long large_size = 256L * 1024L * 1024L;
+static const int small_sizes[] = {512, 4096, 65536};
+// bytes hashed per small file measurement
+static const long small_total_size = 128L * 1024L * 1024L;
+
+static double mib_per_sec(long bytes, double seconds) {
+    return (bytes / (1024.0 * 1024.0)) / seconds;
+}
+
+static void bench_large(Sha256Impl impl, char *buf, const ByteBuffer &expected) {
+    Sha256Hasher hasher(impl);
+    ByteBuffer digest;
+    double start = os_get_time();
+    hasher.update(buf, large_size);
+    hasher.get_digest(digest);
+    double end = os_get_time();
+    if (!ByteBuffer::equal(digest, expected))
+        panic("%s gave the wrong digest", impl_names[impl]);
+    fprintf(stderr, "%10s %10s %10.1f\n", impl_names[impl], "large", mib_per_sec(large_size, end - start));
+}
+
+static void bench_small(Sha256Impl impl, int size, const char *const *buffers, const size_t *lens,
+        int count, const ByteBuffer *expected)
+{
+    ByteBuffer *digests = allocate_class<ByteBuffer>(count);
+    double start = os_get_time();
+    sha256_digest_many_with_impl(impl, buffers, lens, count, digests);
+    double end = os_get_time();
+    for (int i = 0; i < count; i += 1) {
+        if (!ByteBuffer::equal(digests[i], expected[i]))
+            panic("%s gave the wrong digest", impl_names[impl]);
+    }
+    destroy(digests, count);
+    fprintf(stderr, "%10s %10d %10.1f\n", impl_names[impl], size, mib_per_sec((long)size * count, end - start));
+}
+
+int main(int argc, char *argv[]) {
+    // do all the one-time initialization stuff
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    genesis_context_destroy(context);
+
+    char *buf = ok_mem(allocate_nonzero<char>(large_size));
+    uint32_t state = 1;
+    for (long i = 0; i < large_size; i += 1) {
+        state = state * 1664525 + 1013904223;
+        buf[i] = state >> 24;
+    }
+
+    fprintf(stderr, "MiB per second\n");
+    fprintf(stderr, "%10s %10s %10s\n", "impl", "size", "speed");
+    ByteBuffer expected;
+    Sha256Hasher rhash_hasher(Sha256ImplRhash);
+    rhash_hasher.update(buf, large_size);
+    rhash_hasher.get_digest(expected);
+    for (int i = 0; i < array_length(impls); i += 1) {
+        if (impls[i] != Sha256ImplAvx2 && sha256_impl_supported(impls[i]))
+            bench_large(impls[i], buf, expected);
+    }
+
+    for (int size_i = 0; size_i < array_length(small_sizes); size_i += 1) {
+        int size = small_sizes[size_i];
+        int count = small_total_size / size;
+        const char **buffers = ok_mem(allocate_nonzero<const char *>(count));
+        size_t *lens = ok_mem(allocate_nonzero<size_t>(count));
+        ByteBuffer *small_expected = allocate_class<ByteBuffer>(count);
+        for (int i = 0; i < count; i += 1) {
+            buffers[i] = buf + (long)i * size;
+            lens[i] = size;
+        }
+        sha256_digest_many_with_impl(Sha256ImplRhash, buffers, lens, count, small_expected);
+        for (int i = 0; i < array_length(impls); i += 1) {
+            if (sha256_impl_supported(impls[i]))
+                bench_small(impls[i], size, buffers, lens, count, small_expected);
+        }
+        destroy(small_expected, count);
+        destroy(lens, count);
+        destroy(buffers, count);
+    }
+
+    destroy(buf, large_size);
+    return 0;
+}
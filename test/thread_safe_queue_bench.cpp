@@ -0,0 +1,167 @@
+// measures ThreadSafeQueue wake-up latency and throughput with and without
+// the spin phase in dequeue(). spinning only pays off with more than one
+// cpu. not part of the unit tests; run it by hand:
+//     ./thread_safe_queue_bench
+
+#include "thread_safe_queue.hpp"
+#include "genesis.h"
+#include "os.hpp"
+
+#include <stdio.h>
+
+static const int max_thread_count = 8;
+static const int throughput_item_count = 400000;
+static const int latency_sample_count = 2000;
+
+struct BenchItem {
+    double enqueue_time;
+    bool stop;
+};
+
+struct Bench {
+    ThreadSafeQueue<BenchItem *> queue;
+    BenchItem *items;
+    BenchItem stop_item;
+    int items_per_producer;
+    int batch_size;
+    atomic_int next_item;
+
+    double latency_sum;
+    double latency_max;
+};
+
+// producers hand out consecutive slices of bench->items
+static void throughput_producer_run(void *userdata) {
+    Bench *bench = (Bench *)userdata;
+    int start = bench->next_item.fetch_add(bench->items_per_producer);
+    for (int i = 0; i < bench->items_per_producer; i += 1)
+        bench->queue.enqueue(&bench->items[start + i]);
+}
+
+static void throughput_consumer_run(void *userdata) {
+    Bench *bench = (Bench *)userdata;
+    BenchItem *batch[64];
+    for (;;) {
+        int count = bench->queue.dequeue_many(batch, bench->batch_size);
+        for (int i = 0; i < count; i += 1) {
+            if (batch[i]->stop) {
+                // give back the rest of the batch so every consumer sees a stop item
+                for (int j = i + 1; j < count; j += 1)
+                    bench->queue.enqueue(batch[j]);
+                return;
+            }
+        }
+    }
+}
+
+static double run_throughput(Bench *bench, int producer_count, int consumer_count,
+        int spin_count, int batch_size)
+{
+    int items_per_producer = throughput_item_count / producer_count;
+    bench->items_per_producer = items_per_producer;
+    bench->batch_size = batch_size;
+    bench->next_item.store(0);
+    ok_or_panic(bench->queue.resize(throughput_item_count + consumer_count + max_thread_count));
+    bench->queue.set_spin_count(spin_count);
+
+    OsThread *consumers[max_thread_count];
+    OsThread *producers[max_thread_count];
+    double start = os_get_time();
+    for (int i = 0; i < consumer_count; i += 1)
+        ok_or_panic(os_thread_create(throughput_consumer_run, bench, false, &consumers[i]));
+    for (int i = 0; i < producer_count; i += 1)
+        ok_or_panic(os_thread_create(throughput_producer_run, bench, false, &producers[i]));
+    for (int i = 0; i < producer_count; i += 1)
+        os_thread_destroy(producers[i]);
+    for (int i = 0; i < consumer_count; i += 1)
+        bench->queue.enqueue(&bench->stop_item);
+    for (int i = 0; i < consumer_count; i += 1)
+        os_thread_destroy(consumers[i]);
+    double elapsed = os_get_time() - start;
+
+    return (items_per_producer * producer_count) / elapsed;
+}
+
+static void latency_consumer_run(void *userdata) {
+    Bench *bench = (Bench *)userdata;
+    for (;;) {
+        BenchItem *item = bench->queue.dequeue();
+        if (item->stop)
+            return;
+        double latency = os_get_time() - item->enqueue_time;
+        bench->latency_sum += latency;
+        if (latency > bench->latency_max)
+            bench->latency_max = latency;
+    }
+}
+
+// a single consumer is fed one item at a time, gap seconds apart, which is
+// what a worker sees between bursts of ready nodes.
+static void run_latency(Bench *bench, double gap, int spin_count, double *out_avg, double *out_max) {
+    ok_or_panic(bench->queue.resize(max_thread_count));
+    bench->queue.set_spin_count(spin_count);
+    bench->latency_sum = 0.0;
+    bench->latency_max = 0.0;
+
+    OsThread *consumer;
+    ok_or_panic(os_thread_create(latency_consumer_run, bench, false, &consumer));
+    for (int i = 0; i < latency_sample_count; i += 1) {
+        double until = os_get_time() + gap;
+        while (os_get_time() < until) {}
+        BenchItem *item = &bench->items[i];
+        item->enqueue_time = os_get_time();
+        bench->queue.enqueue(item);
+    }
+    bench->queue.enqueue(&bench->stop_item);
+    os_thread_destroy(consumer);
+
+    *out_avg = bench->latency_sum / latency_sample_count;
+    *out_max = bench->latency_max;
+}
+
+int main(int argc, char *argv[]) {
+    // do all the one-time initialization stuff
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    genesis_context_destroy(context);
+
+    Bench *bench = ok_mem(create_zero<Bench>());
+    bench->items = ok_mem(allocate_zero<BenchItem>(throughput_item_count));
+    bench->stop_item.stop = true;
+
+    static const int spin_counts[] = {0, thread_safe_queue_default_spin_count};
+    static const int spin_count_count = array_length(spin_counts);
+
+    fprintf(stderr, "wake-up latency, 1 producer 1 consumer\n");
+    fprintf(stderr, "%10s %8s %12s %12s\n", "gap (us)", "spin", "avg (us)", "max (us)");
+    static const double gaps[] = {0.00002, 0.0002, 0.002};
+    for (int gap_i = 0; gap_i < array_length(gaps); gap_i += 1) {
+        for (int spin_i = 0; spin_i < spin_count_count; spin_i += 1) {
+            double avg, max_latency;
+            run_latency(bench, gaps[gap_i], spin_counts[spin_i], &avg, &max_latency);
+            fprintf(stderr, "%10.0f %8d %12.2f %12.2f\n", gaps[gap_i] * 1000000.0, spin_counts[spin_i],
+                    avg * 1000000.0, max_latency * 1000000.0);
+        }
+    }
+
+    fprintf(stderr, "\nthroughput\n");
+    fprintf(stderr, "%10s %10s %8s %6s %14s\n", "producers", "consumers", "spin", "batch", "items/s");
+    static const int thread_counts[] = {1, 2, 4, 8};
+    static const int batch_sizes[] = {1, 64};
+    for (int p = 0; p < array_length(thread_counts); p += 1) {
+        for (int c = 0; c < array_length(thread_counts); c += 1) {
+            for (int spin_i = 0; spin_i < spin_count_count; spin_i += 1) {
+                for (int b = 0; b < array_length(batch_sizes); b += 1) {
+                    double rate = run_throughput(bench, thread_counts[p], thread_counts[c],
+                            spin_counts[spin_i], batch_sizes[b]);
+                    fprintf(stderr, "%10d %10d %8d %6d %14.0f\n", thread_counts[p], thread_counts[c],
+                            spin_counts[spin_i], batch_sizes[b], rate);
+                }
+            }
+        }
+    }
+
+    destroy(bench->items, throughput_item_count);
+    destroy(bench, 1);
+    return 0;
+}
@@ -32,6 +32,12 @@ static void dequeue_one_through_five(void *userdata) {
     }
 }
 
+static void enqueue_ten_through_fourteen(void *userdata) {
+    for (int i = 10; i < 15; i += 1) {
+        queue->enqueue(i);
+    }
+}
+
 void test_thread_safe_queue(void) {
     queue = create<ThreadSafeQueue<int>>();
     assert_no_err(queue->resize(20));
@@ -83,6 +89,41 @@ void test_thread_safe_queue(void) {
     queue->wakeup_all();
     os_thread_destroy(thread1);
 
+    // dequeue_many takes what is there without blocking for more
+    assert_no_err(queue->resize(10));
+    for (int i = 0; i < 3; i += 1) {
+        queue->enqueue(i);
+    }
+    int items[8];
+    test_assert(queue->dequeue_many(items, 8) == 3, "dequeue_many wrong count");
+    for (int i = 0; i < 3; i += 1) {
+        test_assert(items[i] == i, "dequeue_many wrong value");
+    }
+    queue->enqueue(5);
+    queue->enqueue(6);
+    test_assert(queue->dequeue_many(items, 1) == 1, "dequeue_many exceeded max_count");
+    test_assert(items[0] == 5, "dequeue_many wrong value");
+    test_assert(queue->dequeue() == 6, "wrong dequeue value");
+
+    // dequeue_many blocks until a producer shows up, with and without spinning
+    for (int spin_count = 0; spin_count <= 100; spin_count += 100) {
+        assert_no_err(queue->resize(10));
+        queue->set_spin_count(spin_count);
+        test_assert(queue->spin_count() == spin_count, "wrong spin count");
+        assert_no_err(os_thread_create(enqueue_ten_through_fourteen, nullptr, false, &thread1));
+        int total = 0;
+        while (total < 5) {
+            int count = queue->dequeue_many(items, 8);
+            test_assert(count >= 1, "dequeue_many returned no items");
+            for (int i = 0; i < count; i += 1) {
+                test_assert(items[i] == 10 + total + i, "dequeue_many out of order");
+            }
+            total += count;
+        }
+        test_assert(total == 5, "dequeue_many returned too many items");
+        os_thread_destroy(thread1);
+    }
+
     os_mutex_destroy(mutex);
     os_cond_destroy(cond);
 
@@ -8,19 +8,56 @@
 #include "error.h"
 #include "thread_safe_queue_test.hpp"
 #include "sort_key.hpp"
+#include "id_map.hpp"
 #include "locked_queue.hpp"
+#include "bounded_queue.hpp"
 #include "crc32.hpp"
+#include "lz4.hpp"
+#include "flac_frame.hpp"
+#include "sha_256_hasher.hpp"
 #include "ordered_map_file_test.hpp"
+#include "pipeline_test.hpp"
 #include "os.hpp"
 #include "settings_file.hpp"
 #include "project.hpp"
+#include "replication.hpp"
 #include "genesis.h"
 #include "atomic_value.hpp"
 #include "atomic_double.hpp"
+#include "event_timeline.hpp"
+#include "note_store.hpp"
+#include "work_stealing_deque.hpp"
+#include "job_system.hpp"
+#include "logger.hpp"
+#include "parallel.hpp"
+#include "sample_format.hpp"
+#include "dsp_kernels.hpp"
+#include "fft.hpp"
+#include "audio_file.hpp"
+#include "sample_codec.hpp"
+#include "waveform_peaks.hpp"
+#include "render_coordinator.hpp"
+#include "mirrored_memory_pool.hpp"
+#include "ring_buffer.hpp"
+#include "denormals.hpp"
+#include "plugin_bridge.hpp"
+#include "resample.hpp"
+#include "time_stretch.hpp"
+#include "dir_scanner.hpp"
+#include "sample_index.hpp"
+#include "tempo_map.hpp"
 
 #include <stdio.h>
 #include <assert.h>
 #include <math.h>
+#include <unistd.h>
+#include <utime.h>
+#include <time.h>
+#include <poll.h>
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/stat.h>
+#endif
 
 static void debug_print_bb_list(const List<ByteBuffer> &list) {
     fprintf(stderr, "\n");
@@ -58,6 +95,38 @@ static void test_string_make_lower_case(void) {
     assert(String::compare(the_string2, "THIS IS THE BEST SENTENCE IN THE WORLD.") == 0);
 }
 
+static void test_string_case_tables(void) {
+    // latin-1, greek, a CJK ideograph, and the last cased codepoint
+    assert(String::char_to_lower(0xc4) == 0xe4);
+    assert(String::char_to_upper(0xe4) == 0xc4);
+    assert(String::char_to_lower(0x3a9) == 0x3c9);
+    assert(String::char_to_lower(0x4e2d) == 0x4e2d);
+    assert(String::char_to_upper(0x4e2d) == 0x4e2d);
+    assert(String::char_to_upper(0x1e943) == 0x1e921);
+    assert(String::char_to_lower(0x10ffff) == 0x10ffff);
+
+    // mixed runs of ascii and not, longer than one vector
+    String a("Track NAME ");
+    a.append(0xc4);
+    a.append(0x4e2d);
+    a.append('X');
+    String b("track name ");
+    b.append(0xe4);
+    b.append(0x4e2d);
+    b.append('x');
+    assert(String::compare_insensitive(a, b) == 0);
+    assert(String::compare(a, b) == -1);
+    assert(b.index_of_insensitive("NAME") == 6);
+
+    String c = b;
+    c.at(12) = 0x4e2e;
+    assert(String::compare_insensitive(b, c) == -1);
+    c.make_upper_case();
+    assert(c.at(11) == 0xc4);
+    assert(c.at(13) == 'X');
+    assert(String::compare_insensitive(c, "TRACK NAME") == 1);
+}
+
 static void test_list_remove_range(void) {
     List<int> list;
     for (int i = 0; i < 6; i += 1)
@@ -97,6 +166,123 @@ static void test_list_insert_space(void) {
     assert(list.at(27) == 24);
 }
 
+static void test_small_list(void) {
+    SmallList<int, 8> list;
+    for (int i = 0; i < 8; i += 1)
+        ok_or_panic(list.append(i));
+    assert(list.allocated_size() == 0);
+    for (int i = 8; i < 100; i += 1)
+        ok_or_panic(list.append(i));
+    assert(list.allocated_size() > 0);
+    assert(list.length() == 100);
+    for (int i = 0; i < 100; i += 1)
+        assert(list.at(i) == i);
+    ok_or_panic(list.resize(3));
+    assert(list.last() == 2);
+
+    // an id key fits inline, and ByteBuffers still move with their lists
+    ByteBuffer key;
+    key.append_uint32be(1);
+    key.append_uint32be(2);
+    key.append_fill(32, 'x');
+    assert(key.allocated_size() == 0);
+    List<ByteBuffer> keys;
+    for (int i = 0; i < 50; i += 1) {
+        ok_or_panic(keys.add_one());
+        keys.last().format("key %d", i);
+    }
+    for (int i = 0; i < 50; i += 1) {
+        ByteBuffer expected;
+        expected.format("key %d", i);
+        assert(ByteBuffer::equal(keys.at(i), expected));
+    }
+    key.append_fill(100, 'y');
+    assert(key.length() == 140);
+    assert(key.at(139) == 'y');
+    assert(key.raw()[140] == 0);
+}
+
+static void test_mirrored_memory_pool(void) {
+    MirroredMemoryPool pool;
+    ok_or_panic(mirrored_memory_pool_init(&pool));
+    size_t page_size = os_page_size();
+
+    OsMirroredMemory a;
+    ok_or_panic(mirrored_memory_pool_acquire(&pool, &a, page_size + 1));
+    assert(a.capacity == 2 * page_size);
+    // the second mapping mirrors the first
+    a.address[0] = 'x';
+    assert(a.address[a.capacity] == 'x');
+    char *a_address = a.address;
+    mirrored_memory_pool_release(&pool, &a);
+    assert(pool.free_bytes == 2 * page_size);
+
+    // the same number of pages comes back without mapping anything
+    OsMirroredMemory b;
+    ok_or_panic(mirrored_memory_pool_acquire(&pool, &b, 2 * page_size));
+    assert(b.address == a_address);
+    assert(pool.hit_count == 1);
+    assert(pool.free_bytes == 0);
+
+    // other sizes are not handed out
+    OsMirroredMemory c;
+    ok_or_panic(mirrored_memory_pool_acquire(&pool, &c, page_size));
+    assert(c.capacity == page_size);
+    assert(pool.miss_count == 2);
+
+    // past max_free_bytes the oldest free region is unmapped
+    pool.max_free_bytes = 2 * page_size;
+    mirrored_memory_pool_release(&pool, &c);
+    mirrored_memory_pool_release(&pool, &b);
+    assert(pool.free_regions.length() == 1);
+    assert(pool.free_regions.at(0).capacity == 2 * page_size);
+
+    RingBuffer rb;
+    ok_or_panic(ring_buffer_init_pooled(&rb, &pool, 2 * page_size));
+    assert(rb.mem.address == a_address);
+    assert(ring_buffer_fill_count(&rb) == 0);
+    ring_buffer_deinit_pooled(&rb, &pool);
+
+    mirrored_memory_pool_deinit(&pool);
+}
+
+static void test_alloc_debug(void) {
+    assert(!realtime_thread_active());
+    realtime_thread_begin();
+    realtime_thread_begin();
+    realtime_thread_end();
+    realtime_thread_end();
+    assert(!realtime_thread_active());
+
+#ifdef GENESIS_ALLOC_DEBUG
+    AllocDebugStats before;
+    alloc_debug_get_stats(&before);
+    int *big = ok_mem(allocate_zero<int>(100000));
+    AllocDebugStats stats;
+    alloc_debug_get_stats(&stats);
+    assert(stats.allocation_count == before.allocation_count + 1);
+    assert(stats.live_bytes >= before.live_bytes + 400000);
+    assert(stats.peak_bytes >= stats.live_bytes);
+    destroy(big, 0);
+    alloc_debug_get_stats(&stats);
+    assert(stats.live_bytes < stats.peak_bytes);
+
+    OsMutex *mutex = ok_mem(os_mutex_create());
+    realtime_thread_begin();
+    assert(realtime_thread_active());
+    int *small = ok_mem(allocate_nonzero<int>(1));
+    os_mutex_lock(mutex);
+    os_mutex_unlock(mutex);
+    realtime_thread_end();
+    destroy(small, 0);
+    os_mutex_destroy(mutex);
+    alloc_debug_get_stats(&stats);
+    assert(stats.realtime_allocation_count == before.realtime_allocation_count + 1);
+    assert(stats.realtime_lock_count == before.realtime_lock_count + 1);
+    assert(stats.last_realtime_site);
+#endif
+}
+
 static void test_parse_color(void) {
     glm::vec4 color = parse_color("#4D505c");
     assert_floats_close(color[0], 0.30196078431372547);
@@ -162,6 +348,42 @@ static void test_sort_keys_count(void) {
     run_sort_keys_count_test(&some_value, &upper);
 }
 
+static void test_sort_keys_long(void) {
+    // inserting next to the same key over and over grows the keys past
+    // the inline digits
+    SortKey low = SortKey::single(nullptr, nullptr);
+    SortKey high = SortKey::single(&low, nullptr);
+    bool went_long = false;
+    for (int i = 0; i < 300; i += 1) {
+        SortKey mid = SortKey::single(&low, &high);
+        assert(SortKey::compare(low, mid) < 0);
+        assert(SortKey::compare(mid, high) < 0);
+        went_long = went_long || mid.is_long();
+
+        SortKey copy = mid;
+        assert(SortKey::compare(copy, mid) == 0);
+        ByteBuffer buf;
+        mid.serialize(buf);
+        SortKey parsed;
+        int offset = 0;
+        ok_or_panic(parsed.deserialize(buf, &offset));
+        assert(offset == buf.length());
+        assert(SortKey::compare(parsed, mid) == 0);
+
+        high = mid;
+    }
+    assert(went_long);
+
+    List<SortKey> sort_keys;
+    SortKey::rebalance(sort_keys, 1000);
+    assert(sort_keys.length() == 1000);
+    for (int i = 0; i < sort_keys.length(); i += 1) {
+        assert(!sort_keys.at(i).is_long());
+        if (i > 0)
+            assert(SortKey::compare(sort_keys.at(i - 1), sort_keys.at(i)) < 0);
+    }
+}
+
 static void test_locked_queue(void) {
     LockedQueue<int> queue;
 
@@ -192,6 +414,96 @@ static void test_locked_queue(void) {
     }
 }
 
+struct BoundedQueueBench {
+    BoundedQueue<int> queue;
+    int items_per_producer;
+    atomic_int next_item;
+    atomic_long sum;
+};
+
+static void bounded_queue_producer_run(void *userdata) {
+    BoundedQueueBench *bench = (BoundedQueueBench *)userdata;
+    int start = bench->next_item.fetch_add(bench->items_per_producer);
+    for (int i = 0; i < bench->items_per_producer; i += 1)
+        ok_or_panic(bench->queue.push(start + i + 1));
+}
+
+static void bounded_queue_consumer_run(void *userdata) {
+    BoundedQueueBench *bench = (BoundedQueueBench *)userdata;
+    List<int> items;
+    for (;;) {
+        items.clear();
+        int err = bench->queue.shift_all(items, -1.0);
+        if (err == GenesisErrorAborted)
+            return;
+        ok_or_panic(err);
+        for (int i = 0; i < items.length(); i += 1)
+            bench->sum += items.at(i);
+    }
+}
+
+static void test_bounded_queue(void) {
+    BoundedQueue<int> queue;
+    ok_or_panic(queue.init(5));
+    assert(queue.capacity() == 8);
+
+    // wraps around several times
+    for (int round = 0; round < 3; round += 1) {
+        for (int i = 0; i < 8; i += 1)
+            assert(queue.try_push(round * 8 + i));
+        assert(!queue.try_push(-1));
+        assert(queue.length() == 8);
+        for (int i = 0; i < 8; i += 1) {
+            int value;
+            ok_or_panic(queue.shift(&value));
+            assert(value == round * 8 + i);
+        }
+        int value;
+        assert(!queue.try_shift(&value));
+    }
+
+    // times out empty, then takes everything queued
+    List<int> items;
+    ok_or_panic(queue.shift_all(items, 0.01));
+    assert(items.length() == 0);
+    for (int i = 0; i < 6; i += 1)
+        ok_or_panic(queue.push(i));
+    int batch[4];
+    assert(queue.try_shift_many(batch, 4) == 4);
+    assert(batch[0] == 0 && batch[3] == 3);
+    ok_or_panic(queue.shift_all(items, -1.0));
+    assert(items.length() == 2);
+    assert(items.at(0) == 4 && items.at(1) == 5);
+
+    queue.wakeup_all();
+    int value;
+    assert(queue.shift(&value) == GenesisErrorAborted);
+    assert(queue.push(1) == GenesisErrorAborted);
+
+    // producers block on a small queue while consumers drain it
+    static const int producer_count = 4;
+    static const int consumer_count = 3;
+    BoundedQueueBench *bench = ok_mem(create_zero<BoundedQueueBench>());
+    ok_or_panic(bench->queue.init(16));
+    bench->items_per_producer = 5000;
+    OsThread *producers[producer_count];
+    OsThread *consumers[consumer_count];
+    for (int i = 0; i < consumer_count; i += 1)
+        ok_or_panic(os_thread_create(bounded_queue_consumer_run, bench, false, &consumers[i]));
+    for (int i = 0; i < producer_count; i += 1)
+        ok_or_panic(os_thread_create(bounded_queue_producer_run, bench, false, &producers[i]));
+    for (int i = 0; i < producer_count; i += 1)
+        os_thread_destroy(producers[i]);
+    long item_count = producer_count * bench->items_per_producer;
+    while (bench->sum.load() < item_count * (item_count + 1) / 2)
+        cpu_relax();
+    bench->queue.wakeup_all();
+    for (int i = 0; i < consumer_count; i += 1)
+        os_thread_destroy(consumers[i]);
+    assert(bench->sum.load() == item_count * (item_count + 1) / 2);
+    destroy(bench, 1);
+}
+
 static void test_crc32(void) {
     static const unsigned char crc_test_1[] = {125, 129, 239, 175, 71, 13, 235, 208, 227, 34, 211, 180, 156, 52, 192, 149, 243};
     assert(crc32(0, crc_test_1, array_length(crc_test_1)) == 0x799cf6e7);
@@ -224,6 +536,235 @@ static void test_crc32(void) {
     assert(crc32(0, crc_test_10, array_length(crc_test_10)) == 0x479f16e);
 }
 
+static void test_crc32c(void) {
+    static const unsigned char check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    static const Crc32cImpl impls[] = {
+        Crc32cImplSliceBy8,
+        Crc32cImplSse42,
+        Crc32cImplArmv8,
+    };
+    static const int buf_size = 4096;
+    unsigned char buf[buf_size];
+    for (int i = 0; i < buf_size; i += 1)
+        buf[i] = (i * 7919 + (i >> 5)) & 0xff;
+
+    assert(crc32c(0, check, array_length(check)) == 0xe3069283);
+    for (int impl_index = 0; impl_index < array_length(impls); impl_index += 1) {
+        Crc32cImpl impl = impls[impl_index];
+        if (!crc32c_impl_supported(impl))
+            continue;
+        assert(crc32c_with_impl(impl, 0, check, array_length(check)) == 0xe3069283);
+
+        // every implementation gives the same crcs at any alignment and
+        // length, and chains the same way
+        for (int start = 0; start < 16; start += 1) {
+            for (int len = 0; len < 300; len += 1) {
+                uint32_t expected = crc32c_with_impl(Crc32cImplSliceBy8, 0, buf + start, len);
+                assert(crc32c_with_impl(impl, 0, buf + start, len) == expected);
+                uint32_t chained = crc32c_with_impl(impl, 0, buf + start, len / 3);
+                chained = crc32c_with_impl(impl, chained, buf + start + len / 3, len - len / 3);
+                assert(chained == expected);
+            }
+        }
+        assert(crc32c_with_impl(impl, 0, buf, buf_size) ==
+                crc32c_with_impl(Crc32cImplSliceBy8, 0, buf, buf_size));
+    }
+}
+
+static void lz4_round_trip(const uint8_t *src, int size) {
+    int bound = lz4_compress_bound(size);
+    uint8_t *compressed = ok_mem(allocate_nonzero<uint8_t>(bound));
+    uint8_t *decompressed = ok_mem(allocate_nonzero<uint8_t>(size + 1));
+    int compressed_size = lz4_compress(src, size, compressed, bound);
+    assert(compressed_size > 0 && compressed_size <= bound);
+    assert(lz4_decompress(compressed, compressed_size, decompressed, size) == 0);
+    assert(memcmp(src, decompressed, size) == 0);
+    // the size must be the exact one
+    assert(lz4_decompress(compressed, compressed_size, decompressed, size + 1) == GenesisErrorInvalidFormat);
+    if (compressed_size > 1)
+        assert(lz4_decompress(compressed, compressed_size - 1, decompressed, size) == GenesisErrorInvalidFormat);
+    destroy(compressed, bound);
+    destroy(decompressed, size + 1);
+}
+
+static void test_lz4(void) {
+    static const int buf_size = 300000;
+    uint8_t *buf = ok_mem(allocate_nonzero<uint8_t>(buf_size));
+
+    // runs, which compress to overlapping matches, and text-like repeats
+    for (int i = 0; i < buf_size; i += 1)
+        buf[i] = (i % 1000 < 500) ? 'a' : "the quick brown fox "[i % 20];
+    for (int size = 0; size < 40; size += 1)
+        lz4_round_trip(buf, size);
+    lz4_round_trip(buf, buf_size);
+    int bound = lz4_compress_bound(buf_size);
+    uint8_t *compressed = ok_mem(allocate_nonzero<uint8_t>(bound));
+    int compressed_size = lz4_compress(buf, buf_size, compressed, bound);
+    assert(compressed_size < buf_size / 20);
+    assert(lz4_compress(buf, buf_size, compressed, compressed_size - 1) == 0);
+
+    // noise does not compress, and grows by no more than the bound
+    uint32_t state = 1;
+    for (int i = 0; i < buf_size; i += 1) {
+        state = state * 1103515245 + 12345;
+        buf[i] = state >> 24;
+    }
+    lz4_round_trip(buf, buf_size);
+    lz4_round_trip(buf + 1, 70000);
+
+    // a block made by hand: "abc", a match of 9 at offset 3 and then the
+    // last literals
+    static const uint8_t block[] = {0x35, 'a', 'b', 'c', 3, 0, 0x50, 'a', 'b', 'c', 'd', 'e'};
+    uint8_t out[17];
+    assert(lz4_decompress(block, array_length(block), out, 17) == 0);
+    assert(memcmp(out, "abcabcabcabcabcde", 17) == 0);
+    // a match from before the start
+    static const uint8_t bad_offset[] = {0x10, 'a', 4, 0, 0x00};
+    assert(lz4_decompress(bad_offset, array_length(bad_offset), out, 5) == GenesisErrorInvalidFormat);
+
+    destroy(compressed, bound);
+    destroy(buf, buf_size);
+}
+
+static void test_flac_frame(void) {
+    static const uint8_t check[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    assert(flac_crc8(check, array_length(check)) == 0xf4);
+    assert(flac_crc16(check, array_length(check)) == 0xfee8);
+
+    // block size 4096, 44100 Hz, stereo, 16 bits, frame 3, then a made up
+    // body
+    uint8_t frame[32] = {0xff, 0xf8, 0xc9, 0x18, 3};
+    int header_size = 5;
+    frame[header_size] = flac_crc8(frame, header_size);
+    int body_len = 16;
+    for (int i = 0; i < body_len; i += 1)
+        frame[header_size + 1 + i] = i * 37;
+    int size = header_size + 1 + body_len + 2;
+    uint16_t crc = flac_crc16(frame, size - 2);
+    frame[size - 2] = crc >> 8;
+    frame[size - 1] = crc & 0xff;
+
+    List<uint8_t> out;
+    ok_or_panic(flac_frame_renumber(frame, size, 1000, 1000 * 4096, out));
+    // 1000 takes two bytes
+    assert(out.length() == size + 1);
+    const uint8_t *renumbered = out.raw();
+    assert(memcmp(renumbered, frame, 4) == 0);
+    assert(renumbered[4] == 0xcf && renumbered[5] == 0xa8);
+    assert(flac_crc8(renumbered, 6) == renumbered[6]);
+    assert(memcmp(renumbered + 7, frame + header_size + 1, body_len) == 0);
+    assert(flac_crc16(renumbered, out.length()) == 0);
+
+    // back to a small number, from the renumbered frame
+    List<uint8_t> again;
+    ok_or_panic(flac_frame_renumber(renumbered, out.length(), 3, 3 * 4096, again));
+    assert(again.length() == size);
+    assert(memcmp(again.raw(), frame, size) == 0);
+
+    // variable block sizes count samples, which take five bytes here
+    frame[1] = 0xf9;
+    frame[header_size] = flac_crc8(frame, header_size);
+    ok_or_panic(flac_frame_renumber(frame, size, 1000, 1000 * 4096, out));
+    assert(out.length() == size + 4);
+    assert(out.at(4) == 0xf8);
+    assert(flac_crc16(out.raw(), out.length()) == 0);
+
+    frame[header_size] ^= 1;
+    assert(flac_frame_renumber(frame, size, 0, 0, out) == GenesisErrorInvalidFormat);
+    assert(flac_frame_renumber(check, array_length(check), 0, 0, out) == GenesisErrorInvalidFormat);
+
+    uint8_t streaminfo[FLAC_STREAMINFO_SIZE];
+    memset(streaminfo, 0xaa, sizeof(streaminfo));
+    uint8_t md5[16];
+    for (int i = 0; i < 16; i += 1)
+        md5[i] = i;
+    flac_streaminfo_patch(streaminfo, 0x123456789ULL, 0x10203, 0x40506, md5);
+    static const uint8_t expected[18] = {0xaa, 0xaa, 0xaa, 0xaa, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+        0xaa, 0xaa, 0xaa, 0xa1, 0x23, 0x45, 0x67, 0x89};
+    assert(memcmp(streaminfo, expected, sizeof(expected)) == 0);
+    assert(memcmp(streaminfo + 18, md5, 16) == 0);
+}
+
+static void test_sha_256(void) {
+    static const Sha256Impl impls[] = {
+        Sha256ImplRhash,
+        Sha256ImplShaNi,
+        Sha256ImplArmv8,
+    };
+    static const int buf_size = 4096;
+    char buf[buf_size];
+    for (int i = 0; i < buf_size; i += 1)
+        buf[i] = (i * 7919 + (i >> 5)) & 0xff;
+
+    ByteBuffer digest;
+    Sha256Hasher hasher;
+    hasher.update((char *)"abc", 3);
+    hasher.get_digest(digest);
+    assert(digest.to_string() == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+    for (int impl_index = 0; impl_index < array_length(impls); impl_index += 1) {
+        Sha256Impl impl = impls[impl_index];
+        if (!sha256_impl_supported(impl))
+            continue;
+        Sha256Hasher impl_hasher(impl);
+        Sha256Hasher rhash_hasher(Sha256ImplRhash);
+        ByteBuffer expected;
+
+        // every implementation gives the same digests at every padding
+        // length, however the message is split across updates
+        for (int len = 0; len < 300; len += 1) {
+            rhash_hasher.update(buf, len);
+            rhash_hasher.get_digest(expected);
+            rhash_hasher.reset();
+            impl_hasher.update(buf, len);
+            impl_hasher.get_digest(digest);
+            impl_hasher.reset();
+            assert(digest == expected);
+            impl_hasher.update(buf, len / 3);
+            impl_hasher.update(buf + len / 3, len - len / 3);
+            impl_hasher.get_digest(digest);
+            impl_hasher.reset();
+            assert(digest == expected);
+        }
+        rhash_hasher.update(buf, buf_size);
+        rhash_hasher.get_digest(expected);
+        for (int i = 0; i < buf_size; i += 37)
+            impl_hasher.update(buf + i, min(37, buf_size - i));
+        impl_hasher.get_digest(digest);
+        assert(digest == expected);
+    }
+
+    // messages of different lengths side by side, in groups of eight and
+    // a partial one
+    static const int message_count = 21;
+    const char *messages[message_count];
+    size_t lens[message_count];
+    for (int i = 0; i < message_count; i += 1) {
+        messages[i] = buf + i;
+        lens[i] = (i * 193) % 700;
+    }
+    ByteBuffer expected[message_count];
+    sha256_digest_many_with_impl(Sha256ImplRhash, messages, lens, message_count, expected);
+    static const Sha256Impl many_impls[] = {
+        Sha256ImplShaNi,
+        Sha256ImplArmv8,
+        Sha256ImplAvx2,
+    };
+    for (int impl_index = 0; impl_index < array_length(many_impls); impl_index += 1) {
+        Sha256Impl impl = many_impls[impl_index];
+        if (!sha256_impl_supported(impl))
+            continue;
+        ByteBuffer digests[message_count];
+        sha256_digest_many_with_impl(impl, messages, lens, message_count, digests);
+        for (int i = 0; i < message_count; i += 1)
+            assert(digests[i] == expected[i]);
+    }
+    ByteBuffer digests[message_count];
+    sha256_digest_many(messages, lens, message_count, digests);
+    for (int i = 0; i < message_count; i += 1)
+        assert(digests[i] == expected[i]);
+}
+
 static void test_os_get_time(void) {
     double prev_time = os_get_time();
     for (int i = 0; i < 1000; i += 1) {
@@ -233,6 +774,549 @@ static void test_os_get_time(void) {
     }
 }
 
+static void test_os_timestamp(void) {
+    uint64_t prev = os_timestamp();
+    for (int i = 0; i < 1000; i += 1) {
+        uint64_t timestamp = os_timestamp();
+        assert(timestamp >= prev);
+        prev = timestamp;
+    }
+
+    // agrees with the clock
+    double start_time = os_get_time();
+    uint64_t start = os_timestamp();
+    usleep(20000);
+    double seconds = os_timestamp_to_seconds(os_timestamp() - start);
+    double elapsed = os_get_time() - start_time;
+    assert(seconds >= 0.02);
+    assert(fabs(seconds - elapsed) < 0.001);
+}
+
+static bool is_readable(intptr_t fd) {
+    struct pollfd pfd = {(int)fd, POLLIN, 0};
+    return poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN);
+}
+
+// signals stay readable until a reset, however many there were
+static void test_os_poll_event(void) {
+    OsPollEvent *event = ok_mem(os_poll_event_create());
+    intptr_t fd = os_poll_event_handle(event);
+    assert(!is_readable(fd));
+    os_poll_event_signal(event);
+    os_poll_event_signal(event);
+    assert(is_readable(fd));
+    assert(is_readable(fd));
+    os_poll_event_reset(event);
+    assert(!is_readable(fd));
+    os_poll_event_destroy(event);
+
+    // sound backends may signal events of their own at any time, so only a
+    // wakeup is certain
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    genesis_flush_events(context);
+    genesis_wakeup(context);
+    assert(is_readable(genesis_get_event_fd(context)));
+    genesis_context_destroy(context);
+}
+
+#if defined(__linux__)
+static void record_cpu_run(void *arg) {
+    *(int *)arg = sched_getcpu();
+}
+#endif
+
+static void test_os_thread_attributes(void) {
+#if defined(__linux__)
+    int cpu = os_concurrency() - 1;
+    OsThreadAttributes attributes = {};
+    attributes.cpu_mask = (uint64_t)1 << cpu;
+    int ran_on = -1;
+    OsThread *thread;
+    ok_or_panic(os_thread_create_with_attributes(record_cpu_run, &ran_on, &attributes, &thread));
+    os_thread_destroy(thread);
+    assert(ran_on == cpu);
+
+    // falls back to the normal policy without permission
+    attributes.policy = OsThreadPolicyRealtimeRoundRobin;
+    ok_or_panic(os_thread_create_with_attributes(record_cpu_run, &ran_on, &attributes, &thread));
+    os_thread_destroy(thread);
+
+    if (os_concurrency() < 64) {
+        attributes.cpu_mask = (uint64_t)1 << 63;
+        assert(os_thread_create_with_attributes(record_cpu_run, &ran_on, &attributes, &thread) ==
+                GenesisErrorInvalidParam);
+    }
+#endif
+}
+
+static void test_os_cpu_topology(void) {
+    OsCpuTopology topology;
+    ok_or_panic(os_get_cpu_topology(&topology));
+    assert(topology.online_count >= 1);
+    assert(topology.online_count <= topology.cpu_count);
+#if !defined(__MACH__)
+    assert(topology.online_count == os_concurrency());
+#endif
+    assert(topology.core_count >= 1);
+    assert(topology.core_count <= topology.online_count);
+    assert(topology.package_count >= 1);
+    assert(topology.numa_node_count >= 1);
+    assert(topology.performance_class_count >= 1);
+
+    uint64_t class_cpus = 0;
+    for (int performance_class = 0; performance_class < topology.performance_class_count; performance_class += 1) {
+        uint64_t mask = os_cpu_topology_mask(&topology, performance_class);
+        assert(!(mask & class_cpus));
+        class_cpus |= mask;
+    }
+    uint64_t all_cpus = os_cpu_topology_mask(&topology, -1);
+    assert(all_cpus == class_cpus);
+    uint64_t numa_cpus = 0;
+    for (int numa_node = 0; numa_node < topology.numa_node_count; numa_node += 1) {
+        uint64_t mask = os_cpu_topology_numa_mask(&topology, numa_node);
+        assert(!(mask & numa_cpus));
+        numa_cpus |= mask;
+    }
+    assert(all_cpus == numa_cpus);
+    for (int cpu = 0; cpu < topology.cpu_count; cpu += 1) {
+        OsCpuInfo *info = &topology.cpus[cpu];
+        if (!info->online)
+            continue;
+        assert(info->core >= 0 && info->core < topology.core_count);
+        assert(info->l2_group < topology.cpu_count);
+        assert(info->l3_group < topology.cpu_count);
+        if (cpu < 64)
+            assert(all_cpus & ((uint64_t)1 << cpu));
+    }
+    os_cpu_topology_deinit(&topology);
+}
+
+// the effect the unit tests serve when they are started as a plugin host.
+// it doubles its input and adds how many seeks it has seen, and hangs on
+// an input of 1000.
+struct TestGainEffect {
+    int channel_count;
+    int seek_count;
+};
+
+static void *test_gain_create(int channel_count, int sample_rate, int max_frame_count) {
+    TestGainEffect *effect = create_zero<TestGainEffect>();
+    if (effect)
+        effect->channel_count = channel_count;
+    return effect;
+}
+
+static void test_gain_destroy(void *effect) {
+    destroy((TestGainEffect *)effect, 1);
+}
+
+static void test_gain_process(void *userdata, const float *in, float *out, int frame_count) {
+    TestGainEffect *effect = (TestGainEffect *)userdata;
+    for (int i = 0; i < frame_count * effect->channel_count; i += 1) {
+        while (in[i] == 1000.0f) {}
+        out[i] = in[i] * 2.0f + effect->seek_count;
+    }
+}
+
+static void test_gain_seek(void *userdata) {
+    ((TestGainEffect *)userdata)->seek_count += 1;
+}
+
+static const GenesisPluginEffect test_gain_effect = {
+    GENESIS_PLUGIN_VERSION,
+    test_gain_create,
+    test_gain_destroy,
+    test_gain_process,
+    test_gain_seek,
+};
+
+static void test_plugin_bridge(void) {
+    static const int channel_count = 2;
+    static const int max_frame_count = 256;
+    PluginBridge bridge;
+    assert(plugin_bridge_create(&bridge, "/proc/self/exe", nullptr, 0, 48000, max_frame_count,
+                5.0) == GenesisErrorInvalidParam);
+    ok_or_panic(plugin_bridge_create(&bridge, "/proc/self/exe", nullptr, channel_count, 48000,
+            max_frame_count, 5.0));
+
+    float in[channel_count * max_frame_count];
+    float out[channel_count * max_frame_count];
+    for (int round = 0; round < 100; round += 1) {
+        int frame_count = 1 + (round * 37) % max_frame_count;
+        for (int i = 0; i < frame_count * channel_count; i += 1)
+            in[i] = round + i * 0.5f;
+        ok_or_panic(plugin_bridge_process(&bridge, in, out, frame_count, 5.0));
+        for (int i = 0; i < frame_count * channel_count; i += 1)
+            assert(out[i] == in[i] * 2.0f);
+    }
+    // a seek is queued in front of the next block
+    ok_or_panic(plugin_bridge_seek(&bridge));
+    in[0] = 3.0f;
+    ok_or_panic(plugin_bridge_process(&bridge, in, out, 1, 5.0));
+    assert(out[0] == 7.0f);
+
+    // a plugin which hangs is given up on once the time is up
+    in[0] = 1000.0f;
+    double start = os_get_time();
+    assert(plugin_bridge_process(&bridge, in, out, 1, 0.05) == GenesisErrorAborted);
+    assert(os_get_time() - start < 1.0);
+    assert(bridge.failed);
+    in[0] = 1.0f;
+    assert(plugin_bridge_process(&bridge, in, out, 1, 5.0) == GenesisErrorAborted);
+    plugin_bridge_destroy(&bridge);
+
+    // and one which dies is noticed long before the time is up
+    ok_or_panic(plugin_bridge_create(&bridge, "/proc/self/exe", nullptr, channel_count, 48000,
+            max_frame_count, 5.0));
+    os_process_kill(bridge.process);
+    start = os_get_time();
+    assert(plugin_bridge_process(&bridge, in, out, 1, 5.0) == GenesisErrorAborted);
+    assert(os_get_time() - start < 1.0);
+    plugin_bridge_destroy(&bridge);
+
+    // so is one which can't be started
+    assert(plugin_bridge_create(&bridge, "/nonexistent/genesis_plugin_host", nullptr, channel_count,
+                48000, max_frame_count, 5.0) == GenesisErrorAborted);
+}
+
+static void test_os_copy(void) {
+    static const char *src_path = "/tmp/test_genesis_copy_src.bin";
+    static const char *dest_dir = "/tmp";
+    // past one read buffer, and empty
+    static const long sizes[] = {3 * 1024 * 1024 + 17, 0};
+    for (int size_i = 0; size_i < array_length(sizes); size_i += 1) {
+        long size = sizes[size_i];
+        List<char> data;
+        ok_or_panic(data.resize(size));
+        for (long i = 0; i < size; i += 1)
+            data.at(i) = (char)os_random_uint32();
+        FILE *f = fopen(src_path, "wb");
+        assert(f);
+        assert(fwrite(data.raw(), 1, size, f) == (size_t)size);
+        assert(fclose(f) == 0);
+
+        Sha256Hasher expected_hasher;
+        expected_hasher.update(data.raw(), size);
+        ByteBuffer expected_digest;
+        expected_hasher.get_digest(expected_digest);
+        Sha256Hasher file_hasher;
+        ok_or_panic(os_hash_file(src_path, &file_hasher));
+        ByteBuffer file_digest;
+        file_hasher.get_digest(file_digest);
+        assert(ByteBuffer::compare(file_digest, expected_digest) == 0);
+
+        ByteBuffer dest_path;
+        Sha256Hasher copy_hasher;
+        ok_or_panic(os_copy_no_clobber(src_path, dest_dir, "test_genesis_copy_dest", ".bin",
+                    dest_path, &copy_hasher));
+        ByteBuffer copy_digest;
+        copy_hasher.get_digest(copy_digest);
+        assert(ByteBuffer::compare(copy_digest, expected_digest) == 0);
+
+        f = fopen(dest_path.raw(), "rb");
+        assert(f);
+        List<char> copied;
+        ok_or_panic(copied.resize(size + 1));
+        assert(fread(copied.raw(), 1, size + 1, f) == (size_t)size);
+        fclose(f);
+        assert(memcmp(copied.raw(), data.raw(), size) == 0);
+        os_delete(dest_path.raw());
+    }
+    os_delete(src_path);
+}
+
+struct DirScanResult {
+    int entry_count;
+    int batch_count;
+    bool cached;
+    int err;
+};
+
+// waits for the batches of one complete listing
+static DirScanResult wait_for_dir_scan(DirScanner *scanner) {
+    DirScanResult result = {};
+    List<DirScanBatch *> batches;
+    double deadline = os_get_time() + 10.0;
+    for (;;) {
+        ok_or_panic(dir_scanner_poll(scanner, batches));
+        bool last = false;
+        for (int i = 0; i < batches.length(); i += 1) {
+            DirScanBatch *batch = batches.at(i);
+            assert(!last);
+            assert(batch->first == (result.batch_count == 0));
+            result.entry_count += batch->entries.length();
+            result.batch_count += 1;
+            result.cached = batch->cached;
+            result.err = batch->err;
+            last = batch->last;
+            dir_scan_batch_destroy(batch);
+        }
+        batches.clear();
+        if (last)
+            return result;
+        assert(os_get_time() < deadline);
+        usleep(1000);
+    }
+}
+
+static void write_empty_file(const char *dir, int index) {
+    ByteBuffer path;
+    path.format("%s/%05d.wav", dir, index);
+    FILE *f = fopen(path.raw(), "wb");
+    assert(f);
+    fclose(f);
+}
+
+static int compare_dir_entry_sort_keys(OsDirEntry *a, OsDirEntry *b) {
+    return ByteBuffer::compare(a->sort_key, b->sort_key);
+}
+
+static void test_dir_entry_sort_key(void) {
+    static const char *dir = "/tmp/test_genesis_sort_key";
+    static const char *names[] = {"b", "B", "a.wav", "A.wav", "\xc3\x84", "ab"};
+    static const char *sorted[] = {"A.wav", "a.wav", "ab", "B", "b", "\xc3\x84"};
+    ok_or_panic(os_mkdirp(dir));
+    ByteBuffer path;
+    for (int i = 0; i < array_length(names); i += 1) {
+        os_path_join(path, dir, names[i]);
+        FILE *f = fopen(path.raw(), "wb");
+        assert(f);
+        fclose(f);
+    }
+    List<OsDirEntry *> entries;
+    ok_or_panic(os_readdir(dir, entries));
+    assert(entries.length() == array_length(names));
+    entries.sort<compare_dir_entry_sort_keys>();
+    for (int i = 0; i < entries.length(); i += 1) {
+        assert(ByteBuffer::equal(entries.at(i)->name, sorted[i]));
+        os_path_join(path, dir, entries.at(i)->name);
+        os_delete(path.raw());
+        os_dir_entry_unref(entries.at(i));
+    }
+}
+
+static void test_dir_scanner(void) {
+    static const char *dir = "/tmp/test_genesis_dir_scanner";
+    // more than one batch
+    static const int file_count = 300;
+    ok_or_panic(os_mkdirp(dir));
+    List<OsDirEntry *> old_entries;
+    ok_or_panic(os_readdir(dir, old_entries));
+    ByteBuffer path;
+    for (int i = 0; i < old_entries.length(); i += 1) {
+        os_path_join(path, dir, old_entries.at(i)->name);
+        os_delete(path.raw());
+        os_dir_entry_unref(old_entries.at(i));
+    }
+    for (int i = 0; i < file_count; i += 1)
+        write_empty_file(dir, i);
+    // in an earlier second than the listing, so that it can be cached
+    struct utimbuf times = {time(nullptr) - 10, time(nullptr) - 10};
+    assert(utime(dir, &times) == 0);
+
+    DirScanner *scanner;
+    ok_or_panic(dir_scanner_create(&scanner));
+
+    ok_or_panic(dir_scanner_request(scanner, dir));
+    DirScanResult result = wait_for_dir_scan(scanner);
+    assert(!result.err);
+    assert(!result.cached);
+    assert(result.entry_count == file_count);
+    assert(result.batch_count >= 2);
+
+    ok_or_panic(dir_scanner_request(scanner, dir));
+    result = wait_for_dir_scan(scanner);
+    assert(result.cached);
+    assert(result.entry_count == file_count);
+
+    write_empty_file(dir, file_count);
+#if !defined(__linux__)
+    // only linux watches directories
+    ok_or_panic(dir_scanner_request(scanner, dir));
+#endif
+    result = wait_for_dir_scan(scanner);
+    assert(!result.err);
+    assert(!result.cached);
+    assert(result.entry_count == file_count + 1);
+
+    ok_or_panic(dir_scanner_request(scanner, "/tmp/test_genesis_dir_scanner_missing"));
+    result = wait_for_dir_scan(scanner);
+    assert(result.err);
+    assert(result.entry_count == 0);
+
+    dir_scanner_destroy(scanner);
+
+    for (int i = 0; i <= file_count; i += 1) {
+        path.format("%s/%05d.wav", dir, i);
+        os_delete(path.raw());
+    }
+}
+
+// waits for a search for text to find count paths
+static void wait_for_sample_search(SampleIndex *index, const char *text, int count, List<ByteBuffer> &paths) {
+    double deadline = os_get_time() + 10.0;
+    for (;;) {
+        paths.clear();
+        ok_or_panic(sample_index_search(index, text, 100, paths));
+        if (paths.length() == count)
+            return;
+        assert(os_get_time() < deadline);
+        usleep(1000);
+    }
+}
+
+static void write_text_file(const char *path) {
+    FILE *f = fopen(path, "wb");
+    assert(f);
+    fputs("not audio", f);
+    fclose(f);
+}
+
+static void test_sample_index(void) {
+    static const char *index_path = "/tmp/test_genesis_sample_index";
+    static const char *dir = "/tmp/test_genesis_sample_index_dir";
+    static const char *loops_dir = "/tmp/test_genesis_sample_index_dir/Loops";
+    static const char *kick_path = "/tmp/test_genesis_sample_index_dir/Kick 01.txt";
+    static const char *snare_path = "/tmp/test_genesis_sample_index_dir/snare_02.txt";
+    static const char *loop_path = "/tmp/test_genesis_sample_index_dir/Loops/Drum Loop.txt";
+    static const char *hat_path = "/tmp/test_genesis_sample_index_dir/hat.txt";
+    os_delete(index_path);
+    os_delete(hat_path);
+    ok_or_panic(os_mkdirp(loops_dir));
+    write_text_file(kick_path);
+    write_text_file(snare_path);
+    write_text_file(loop_path);
+
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+
+    SampleIndex *index;
+    ok_or_panic(sample_index_open(context, index_path, &index));
+    long generation = sample_index_generation(index);
+    ok_or_panic(sample_index_add_dir(index, dir));
+
+    List<ByteBuffer> paths;
+    wait_for_sample_search(index, "", 3, paths);
+    assert(sample_index_generation(index) != generation);
+    assert(ByteBuffer::equal(paths.at(0), kick_path));
+    assert(ByteBuffer::equal(paths.at(1), loop_path));
+    assert(ByteBuffer::equal(paths.at(2), snare_path));
+
+    wait_for_sample_search(index, "KICK", 1, paths);
+    assert(ByteBuffer::equal(paths.at(0), kick_path));
+    // the directory and the file both match, and it is one path
+    wait_for_sample_search(index, "loop", 1, paths);
+    assert(ByteBuffer::equal(paths.at(0), loop_path));
+    wait_for_sample_search(index, "nothing like it", 0, paths);
+
+    // the paths are searchable once listed, and records come after
+    SampleIndexRecord record;
+    double deadline = os_get_time() + 10.0;
+    while (sample_index_get(index, loop_path, &record) == GenesisErrorKeyNotFound ||
+           sample_index_get(index, kick_path, &record) == GenesisErrorKeyNotFound)
+    {
+        assert(os_get_time() < deadline);
+        usleep(1000);
+    }
+    // not audio, and kept as such so that it is not opened again
+    assert(record.err);
+    assert(record.size == (int64_t)strlen("not audio"));
+
+    paths.clear();
+    ok_or_panic(sample_index_search_prefix(index, loops_dir, 100, paths));
+    assert(paths.length() == 1);
+    assert(ByteBuffer::equal(paths.at(0), loop_path));
+
+    write_text_file(hat_path);
+    os_delete(snare_path);
+#if !defined(__linux__)
+    // only linux watches directories
+    ok_or_panic(sample_index_add_dir(index, dir));
+#endif
+    wait_for_sample_search(index, "hat", 1, paths);
+    wait_for_sample_search(index, "snare", 0, paths);
+    wait_for_sample_search(index, "", 3, paths);
+
+    sample_index_close(index);
+
+    // what was indexed is there straight away when it is opened again
+    ok_or_panic(sample_index_open(context, index_path, &index));
+    paths.clear();
+    ok_or_panic(sample_index_search(index, "", 100, paths));
+    assert(paths.length() == 3);
+    assert(ByteBuffer::equal(paths.at(0), kick_path));
+    assert(ByteBuffer::equal(paths.at(1), loop_path));
+    assert(ByteBuffer::equal(paths.at(2), hat_path));
+    sample_index_close(index);
+
+    genesis_context_destroy(context);
+    os_delete(kick_path);
+    os_delete(loop_path);
+    os_delete(hat_path);
+    os_delete(index_path);
+}
+
+static void test_flat_hash_map(void) {
+    static const int key_count = 10000;
+    List<uint256> keys;
+    for (int i = 0; i < key_count; i += 1)
+        ok_or_panic(keys.append(uint256::random()));
+
+    IdMap<int> map;
+    for (int i = 0; i < key_count; i += 1)
+        map.put(keys.at(i), i);
+    assert(map.size() == key_count);
+    for (int i = 0; i < key_count; i += 1)
+        assert(map.get(keys.at(i)) == i);
+    assert(!map.maybe_get(uint256::random()));
+
+    // remove every other key, then put them back with other values, so that
+    // deleted slots are both skipped and reused
+    for (int i = 0; i < key_count; i += 2)
+        map.remove(keys.at(i));
+    assert(map.size() == key_count / 2);
+    for (int i = 0; i < key_count; i += 1)
+        assert(!map.maybe_get(keys.at(i)) == (i % 2 == 0));
+    for (int i = 0; i < key_count; i += 2)
+        map.put(keys.at(i), -i);
+    map.put(keys.at(1), 100);
+    assert(map.size() == key_count);
+    assert(map.get(keys.at(1)) == 100);
+    assert(map.get(keys.at(2)) == -2);
+
+    int count = 0;
+    auto it = map.entry_iterator();
+    for (;;) {
+        auto *entry = it.next();
+        if (!entry)
+            break;
+        assert(map.maybe_get(entry->key) == entry);
+        count += 1;
+    }
+    assert(count == key_count);
+
+    map.clear();
+    assert(map.size() == 0);
+    assert(!map.maybe_get(keys.at(0)));
+
+    // many removes and puts at the same size wear out the empty slots
+    FlatHashMap<ByteBuffer, int, ByteBuffer::hash> tags;
+    for (int i = 0; i < 20000; i += 1) {
+        ByteBuffer key;
+        key.format("%d", i);
+        tags.put(key, i);
+        if (i >= 10) {
+            ByteBuffer old_key;
+            old_key.format("%d", i - 10);
+            tags.remove(old_key);
+        }
+    }
+    assert(tags.size() == 10);
+    assert(tags.get("19999") == 19999);
+    assert(!tags.maybe_get("19989"));
+}
+
 static void test_uint256(void) {
     {
         uint256 id = uint256::random();
@@ -290,6 +1374,16 @@ static void test_settings_file(void) {
     assert(perspective->dock.tabs.length() == 1);
     assert(String::compare(perspective->dock.tabs.last(), "Fun Tab") == 0);
 
+    // a burst of commits ends up as the last one
+    sf->user_name = "first";
+    ok_or_panic(settings_file_commit(sf));
+    sf->user_name = "second";
+    ok_or_panic(settings_file_commit(sf));
+    ok_or_panic(settings_file_flush(sf));
+    settings_file_close(sf);
+
+    sf = settings_file_open(tmp_file_path);
+    assert(ByteBuffer::compare(sf->user_name.encode(), "second") == 0);
     settings_file_close(sf);
 
     os_delete(tmp_file_path);
@@ -320,6 +1414,22 @@ static void test_list_sort(void) {
     for (int i = 0; i < list.length() - 1; i += 1) {
         assert(list.at(i) <= list.at(i + 1));
     }
+
+    // many duplicates, then already sorted, then reversed
+    list.clear();
+    for (int i = 0; i < 20000; i += 1)
+        ok_or_panic(list.append(os_random_double() * 10));
+    list.sort<compare_ints>();
+    for (int i = 0; i < list.length() - 1; i += 1)
+        assert(list.at(i) <= list.at(i + 1));
+    list.sort<compare_ints>();
+    for (int i = 0; i < list.length() - 1; i += 1)
+        assert(list.at(i) <= list.at(i + 1));
+    for (int i = 0; i < list.length(); i += 1)
+        list.at(i) = list.length() - i;
+    list.sort<compare_ints>();
+    for (int i = 0; i < list.length(); i += 1)
+        assert(list.at(i) == i + 1);
 }
 
 static void test_basic_project_editing(void) {
@@ -383,6 +1493,35 @@ static void test_basic_project_editing(void) {
     project_redo(project);
     assert(project->track_list.length() == 2);
 
+    // edits insert into the sorted list in place, in the same order that
+    // opening the file sorts it
+    Track *first_track = project->track_list.at(0);
+    project_insert_track(project, nullptr, first_track);
+    assert(project->track_list.length() == 3);
+    assert(project->track_list.at(1) == first_track);
+    Track *ordered_tracks[3];
+    uint256 ordered_ids[3];
+    for (int i = 0; i < 3; i += 1) {
+        ordered_tracks[i] = project->track_list.at(i);
+        ordered_ids[i] = ordered_tracks[i]->id;
+    }
+    project_undo(project);
+    assert(project->track_list.length() == 2);
+    assert(project->track_list.at(0) == ordered_tracks[1]);
+    assert(project->track_list.at(1) == ordered_tracks[2]);
+    project_redo(project);
+    assert(project->track_list.length() == 3);
+    assert(project->track_list.at(0)->id == ordered_ids[0]);
+
+    project_close(project);
+    project = nullptr;
+
+    err = project_open(context, tmp_proj_path, user, &project);
+    assert(err == 0);
+    assert(project->track_list.length() == 3);
+    for (int i = 0; i < 3; i += 1)
+        assert(project->track_list.at(i)->id == ordered_ids[i]);
+
     project_close(project);
 
     user_destroy(user);
@@ -390,62 +1529,1656 @@ static void test_basic_project_editing(void) {
     genesis_context_destroy(context);
 }
 
-static void test_string_compare(void) {
-    String a("67 fps");
-    String b("69 fps");
-    assert(String::compare(a, b) == -1);
-    assert(String::compare(b, a) == 1);
-    assert(String::compare_insensitive(a, b) == -1);
-    assert(String::compare_insensitive(b, a) == 1);
+// delivers the messages each way until neither side has anything to say
+static int replication_exchange(ReplicationPeer *a, List<ByteBuffer> &to_a,
+        ReplicationPeer *b, List<ByteBuffer> &to_b, int *out_b_delta_count)
+{
+    int err;
+    while (to_a.length() > 0 || to_b.length() > 0) {
+        List<ByteBuffer> from_a;
+        List<ByteBuffer> from_b;
+        for (int i = 0; i < to_a.length(); i += 1) {
+            if ((err = replication_peer_receive(a, to_a.at(i), from_a)))
+                return err;
+        }
+        for (int i = 0; i < to_b.length(); i += 1) {
+            if (to_b.at(i).at(0) == ReplicationMessageTypeDelta)
+                *out_b_delta_count += 1;
+            if ((err = replication_peer_receive(b, to_b.at(i), from_b)))
+                return err;
+        }
+        to_a.clear();
+        to_b.clear();
+        for (int i = 0; i < from_b.length(); i += 1)
+            ok_or_panic(to_a.append(from_b.at(i)));
+        for (int i = 0; i < from_a.length(); i += 1)
+            ok_or_panic(to_b.append(from_a.at(i)));
+    }
+    return 0;
 }
 
-static void test_audio_file(void) {
-    static const char *tmp_file_path = "/tmp/test_genesis_out.flac";
+static void replication_connect(ReplicationPeer *a, ReplicationPeer *b, int *out_b_delta_count) {
+    List<ByteBuffer> to_a;
+    List<ByteBuffer> to_b;
+    ok_or_panic(to_a.add_one());
+    replication_peer_connect(b, to_a.last());
+    ok_or_panic(to_b.add_one());
+    replication_peer_connect(a, to_b.last());
+    ok_or_panic(replication_exchange(a, to_a, b, to_b, out_b_delta_count));
+}
 
+// sends what a did since the last poll over to b
+static void replication_send(ReplicationPeer *a, ReplicationPeer *b, int *out_b_delta_count) {
+    List<ByteBuffer> to_a;
+    List<ByteBuffer> to_b;
+    ok_or_panic(replication_peer_poll(a, to_b));
+    ok_or_panic(replication_exchange(a, to_a, b, to_b, out_b_delta_count));
+}
+
+static void test_project_replication(void) {
     GenesisContext *context;
     ok_or_panic(genesis_context_create(&context));
+    static const char *path_a = "/tmp/test_genesis_replication_a.gdaw";
+    static const char *path_b = "/tmp/test_genesis_replication_b.gdaw";
+    os_delete(path_a);
+    os_delete(path_b);
 
-    GenesisAudioFile *audio_file;
-    ok_or_panic(genesis_audio_file_load(context, "../test/tiny-sine.ogg", &audio_file));
+    User *user_a = user_create(uint256::random(), "a");
+    User *user_b = user_create(uint256::random(), "b");
 
-    GenesisExportFormat format;
-    format.bit_rate = 320 * 1000;
-    format.codec = genesis_guess_audio_file_codec(context, tmp_file_path, nullptr, nullptr);
-    assert(format.codec);
-    int sample_format_count = genesis_audio_file_codec_sample_format_count(format.codec);
-    assert(sample_format_count > 0);
-    format.sample_format = genesis_audio_file_codec_sample_format_index(format.codec, 0);
-    format.sample_rate = 48000;
-    assert(genesis_audio_file_codec_supports_sample_rate(format.codec, format.sample_rate));
+    Project *a;
+    ok_or_panic(project_create(context, path_a, uint256::random(), user_a, &a));
+    project_close(a);
+    ok_or_panic(os_copy(path_a, path_b, nullptr));
+    ok_or_panic(project_open(context, path_a, user_a, &a));
+    Project *b;
+    ok_or_panic(project_open(context, path_b, user_b, &b));
+    assert(b->user_list.length() == 2);
 
-    genesis_audio_file_export(audio_file, tmp_file_path, -1, &format);
-    genesis_audio_file_destroy(audio_file);
-    genesis_context_destroy(context);
+    ReplicationPeer peer_a;
+    ReplicationPeer peer_b;
+    replication_peer_init(&peer_a, a);
+    replication_peer_init(&peer_b, b);
+    int b_delta_count = 0;
+    replication_connect(&peer_a, &peer_b, &b_delta_count);
 
-    os_delete(tmp_file_path);
-}
+    project_insert_track(a, a->track_list.last(), nullptr);
+    replication_send(&peer_a, &peer_b, &b_delta_count);
+    assert(b->track_list.length() == 2);
+    assert(b->track_list.last()->id == a->track_list.last()->id);
 
-static void test_path_extension(void) {
-    assert(ByteBuffer::compare(os_path_extension("foo"), "") == 0);
-    assert(ByteBuffer::compare(os_path_extension("foo.ogg"), ".ogg") == 0);
-    assert(ByteBuffer::compare(os_path_extension("foo.ogg.flac"), ".flac") == 0);
-}
+    int a_delta_count = 0;
+    project_insert_track(b, b->track_list.last(), nullptr);
+    replication_send(&peer_b, &peer_a, &a_delta_count);
+    assert(a_delta_count == 1);
+    assert(a->track_list.length() == 3);
+    // b's own command does not come back to it
+    b_delta_count = 0;
+    replication_send(&peer_a, &peer_b, &b_delta_count);
+    assert(b_delta_count == 0);
 
-static void test_atomic_value(void) {
-    AtomicValue<int> av;
+    // undo is a's own, of a's track, and goes over like any other command
+    project_undo(a);
+    replication_send(&peer_a, &peer_b, &b_delta_count);
+    assert(b->track_list.length() == 2);
+    assert(b->track_list.last()->id == a->track_list.last()->id);
 
-    int *x = av.write_begin();
-    *x = 900;
-    av.write_end();
-    int *y = av.get_read_ptr();
-    assert(*y == 900);
+    // after a disconnect only the revisions b lacks go over
+    replication_peer_disconnect(&peer_a);
+    replication_peer_disconnect(&peer_b);
+    for (int i = 0; i < 3; i += 1)
+        project_insert_track(a, a->track_list.last(), nullptr);
+    b_delta_count = 0;
+    replication_connect(&peer_a, &peer_b, &b_delta_count);
+    assert(b_delta_count == 1);
+    assert(project_get_next_revision(b) == project_get_next_revision(a));
+    assert(b->track_list.length() == 5);
+    for (int i = 0; i < a->track_list.length(); i += 1)
+        assert(b->track_list.at(i)->id == a->track_list.at(i)->id);
 
-    x = av.write_begin();
-    *x = 1234;
-    av.write_end();
-    y = av.get_read_ptr();
-    assert(*y == 1234);
-}
+    // b saved what it was sent
+    project_close(b);
+    ok_or_panic(project_open(context, path_b, user_b, &b));
+    assert(b->track_list.length() == 5);
+    assert(project_get_next_revision(b) == project_get_next_revision(a));
+    replication_peer_init(&peer_b, b);
+
+    // edits made on both sides while apart are reported, not merged
+    replication_peer_disconnect(&peer_a);
+    project_insert_track(a, a->track_list.last(), nullptr);
+    project_insert_track(b, b->track_list.last(), nullptr);
+    List<ByteBuffer> to_a;
+    List<ByteBuffer> to_b;
+    ok_or_panic(to_a.add_one());
+    replication_peer_connect(&peer_b, to_a.last());
+    ok_or_panic(to_b.add_one());
+    replication_peer_connect(&peer_a, to_b.last());
+    assert(replication_exchange(&peer_a, to_a, &peer_b, to_b, &b_delta_count) == GenesisErrorConflict);
+
+    project_close(a);
+    project_close(b);
+    user_destroy(user_a);
+    user_destroy(user_b);
+    os_delete(path_a);
+    os_delete(path_b);
+    genesis_context_destroy(context);
+}
+
+static void test_project_parallel_open(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    static const char *tmp_proj_path = "/tmp/test_genesis_parallel_open.gdaw";
+    os_delete(tmp_proj_path);
+
+    User *user = user_create(uint256::random(), os_get_user_name());
+    Project *project;
+    ok_or_panic(project_create(context, tmp_proj_path, uint256::random(), user, &project));
+    // enough tracks that they are parsed on several threads
+    static const int track_count = 5000;
+    for (int i = 1; i < track_count; i += 1)
+        project_insert_track(project, project->track_list.last(), nullptr);
+    List<uint256> track_ids;
+    for (int i = 0; i < track_count; i += 1)
+        ok_or_panic(track_ids.append(project->track_list.at(i)->id));
+    project_close(project);
+
+    ok_or_panic(project_open(context, tmp_proj_path, user, &project));
+    assert(project->track_list.length() == track_count);
+    for (int i = 0; i < track_count; i += 1)
+        assert(project->track_list.at(i)->id == track_ids.at(i));
+    assert(project->undo_stack.length() <= DEFAULT_UNDO_MAX_COUNT);
+    for (int i = 0; i < project->command_list.length(); i += 1)
+        assert(project->command_list.at(i)->user->id == user->id);
+
+    project_close(project);
+    user_destroy(user);
+    os_delete(tmp_proj_path);
+    genesis_context_destroy(context);
+}
+
+static void test_track_sort_key_rebalance(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    static const char *tmp_proj_path = "/tmp/test_genesis_rebalance.gdaw";
+    os_delete(tmp_proj_path);
+
+    User *user = user_create(uint256::random(), os_get_user_name());
+    Project *project;
+    ok_or_panic(project_create(context, tmp_proj_path, uint256::random(), user, &project));
+    Track *first = project->track_list.at(0);
+    project_insert_track(project, first, nullptr);
+    Track *last = project->track_list.at(1);
+
+    // always insert right after the first track
+    static const int insert_count = 300;
+    for (int i = 0; i < insert_count; i += 1) {
+        project_insert_track(project, first, project->track_list.at(1));
+        assert(project->track_list.at(0) == first);
+        assert(project->track_list.last() == last);
+        for (int j = 0; j < project->track_list.length(); j += 1)
+            assert(!project->track_list.at(j)->sort_key.is_long());
+    }
+    List<uint256> track_ids;
+    for (int i = 0; i < project->track_list.length(); i += 1)
+        ok_or_panic(track_ids.append(project->track_list.at(i)->id));
+
+    for (int i = 0; i < insert_count; i += 1)
+        project_undo(project);
+    assert(project->track_list.length() == 2);
+    assert(project->track_list.at(0) == first);
+    assert(project->track_list.at(1) == last);
+    for (int i = 0; i < insert_count; i += 1)
+        project_redo(project);
+    project_close(project);
+
+    ok_or_panic(project_open(context, tmp_proj_path, user, &project));
+    assert(project->track_list.length() == track_ids.length());
+    for (int i = 0; i < track_ids.length(); i += 1)
+        assert(project->track_list.at(i)->id == track_ids.at(i));
+
+    project_close(project);
+    user_destroy(user);
+    os_delete(tmp_proj_path);
+    genesis_context_destroy(context);
+}
+
+static void test_undo_history_limits(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    static const char *tmp_proj_path = "/tmp/test_genesis_undo_limits.gdaw";
+    os_delete(tmp_proj_path);
+
+    User *user = user_create(uint256::random(), os_get_user_name());
+    Project *project;
+    ok_or_panic(project_create(context, tmp_proj_path, uint256::random(), user, &project));
+    static const int resident_count = 2;
+    static const int max_count = 8;
+    project_set_undo_limits(project, resident_count, max_count);
+
+    for (int i = 0; i < 20; i += 1)
+        project_insert_track(project, project->track_list.last(), nullptr);
+    assert(project->track_list.length() == 21);
+    assert(project->undo_stack.length() <= max_count);
+    assert(project->undo_stack_index == project->undo_stack.length());
+    assert(project->command_list.length() <= 2 * resident_count + 1);
+
+    // undoing pages the old commands back in
+    int undo_count = project->undo_stack_index;
+    for (int i = 0; i < undo_count; i += 1)
+        project_undo(project);
+    assert(project->track_list.length() == 21 - undo_count);
+    assert(project->command_list.length() <= 2 * resident_count + 1);
+    for (int i = 0; i < undo_count; i += 1)
+        project_redo(project);
+    assert(project->track_list.length() == 21);
+
+    // a new command after some undos drops the redo steps
+    project_undo(project);
+    project_undo(project);
+    project_insert_track(project, project->track_list.last(), nullptr);
+    assert(project->track_list.length() == 20);
+    int undo_length = project->undo_stack.length();
+    assert(project->undo_stack_index == undo_length);
+    project_close(project);
+
+    // the file only keeps the undo stack and the last command
+    ok_or_panic(project_open(context, tmp_proj_path, user, &project));
+    assert(project->track_list.length() == 20);
+    assert(project->undo_stack.length() == undo_length);
+    assert(project->undo_stack_index == undo_length);
+    assert(project->command_list.length() <= undo_length + 1);
+
+    project_set_undo_limits(project, 1, max_count);
+    assert(project->command_list.length() <= 3);
+    for (int i = 0; i < undo_length; i += 1)
+        project_undo(project);
+    assert(project->track_list.length() == 20 - undo_length);
+
+    project_close(project);
+    user_destroy(user);
+    os_delete(tmp_proj_path);
+    genesis_context_destroy(context);
+}
+
+static void on_audio_asset_loaded(Event, void *userdata) {
+    int *loaded_count = (int *)userdata;
+    *loaded_count += 1;
+}
+
+static void test_event_dispatcher_deferred(void) {
+    EventDispatcher events;
+    int immediate_count = 0;
+    int deferred_count = 0;
+    events.attach_handler(EventProjectTracksChanged, on_audio_asset_loaded, &immediate_count);
+    events.attach_deferred_handler(EventProjectTracksChanged, on_audio_asset_loaded, &deferred_count);
+    events.attach_deferred_handler(EventProjectAudioClipSegmentsChanged, on_audio_asset_loaded, &deferred_count);
+
+    events.flush_deferred();
+    assert(deferred_count == 0);
+
+    for (int i = 0; i < 50; i += 1)
+        events.trigger(EventProjectTracksChanged);
+    events.trigger(EventProjectAudioClipSegmentsChanged);
+    assert(immediate_count == 50);
+    assert(deferred_count == 0);
+
+    events.flush_deferred();
+    assert(deferred_count == 1);
+    events.flush_deferred();
+    assert(deferred_count == 1);
+
+    events.trigger(EventProjectAudioClipSegmentsChanged);
+    events.detach_handler(EventProjectAudioClipSegmentsChanged, on_audio_asset_loaded);
+    events.flush_deferred();
+    assert(deferred_count == 1);
+}
+
+static void test_project_async_asset_loading(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    static const char *tmp_proj_dir = "/tmp/test_genesis_assets";
+    static const char *tmp_proj_path = "/tmp/test_genesis_assets/project.gdaw";
+    ok_or_panic(os_mkdirp(tmp_proj_dir));
+    os_delete(tmp_proj_path);
+
+    User *user = user_create(uint256::random(), os_get_user_name());
+    Project *project;
+    ok_or_panic(project_create(context, tmp_proj_path, uint256::random(), user, &project));
+    AudioAsset *audio_asset;
+    ok_or_panic(project_add_audio_asset(project, "../test/tiny-sine.ogg", &audio_asset));
+    ByteBuffer asset_path;
+    os_path_join(asset_path, tmp_proj_dir, audio_asset->path);
+    project_close(project);
+
+    ok_or_panic(project_open(context, tmp_proj_path, user, &project));
+    assert(project->audio_asset_list.length() == 1);
+    audio_asset = project->audio_asset_list.at(0);
+    int loaded_count = 0;
+    project->events.attach_handler(EventProjectAudioAssetLoaded, on_audio_asset_loaded, &loaded_count);
+
+    // waits for the background decode
+    ok_or_panic(project_ensure_audio_asset_loaded(project, audio_asset));
+    assert(project_audio_asset_is_loaded(audio_asset));
+    assert(genesis_audio_file_frame_count(audio_asset->audio_file) > 0);
+
+    int finished, total;
+    project_audio_asset_load_progress(project, &finished, &total);
+    assert(total == 1);
+    assert(loaded_count == 0);
+    project_flush_events(project);
+    project_audio_asset_load_progress(project, &finished, &total);
+    assert(finished == 1);
+    assert(loaded_count == 1);
+
+    project->events.detach_handler(EventProjectAudioAssetLoaded, on_audio_asset_loaded);
+    project_close(project);
+    user_destroy(user);
+    os_delete(asset_path.raw());
+    os_delete(tmp_proj_path);
+    genesis_context_destroy(context);
+}
+
+static void test_audio_asset_cache(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    static const char *tmp_proj_dir = "/tmp/test_genesis_asset_cache";
+    static const char *tmp_proj_path = "/tmp/test_genesis_asset_cache/project.gdaw";
+    ok_or_panic(os_mkdirp(tmp_proj_dir));
+    os_delete(tmp_proj_path);
+    // nothing fits, so whatever may be evicted is
+    genesis_set_audio_asset_cache_bytes(context, 0);
+
+    User *user = user_create(uint256::random(), os_get_user_name());
+    Project *project;
+    ok_or_panic(project_create(context, tmp_proj_path, uint256::random(), user, &project));
+    AudioAsset *audio_asset;
+    ok_or_panic(project_add_audio_asset(project, "../test/tiny-sine.ogg", &audio_asset));
+    ByteBuffer asset_path;
+    os_path_join(asset_path, tmp_proj_dir, audio_asset->path);
+
+    // every load maps this instead of decoding the asset
+    ByteBuffer cache_dir, cache_path;
+    project_decoded_cache_path(project, audio_asset->sha256sum, cache_dir, cache_path);
+    ok_or_panic(os_mkdirp(cache_dir));
+    GenesisAudioFile *decoded = ok_mem(genesis_audio_file_create(context, 44100));
+    ok_or_panic(genesis_audio_file_set_channel_layout(decoded,
+                soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdStereo)));
+    for (int ch = 0; ch < 2; ch += 1) {
+        List<float> *samples = &decoded->channels.at(ch).samples;
+        ok_or_panic(samples->resize(3000));
+        samples->fill(0.25f * ch);
+    }
+    ok_or_panic(genesis_audio_file_write_decoded(decoded, cache_path.raw()));
+    genesis_audio_file_destroy(decoded);
+
+    // the asset being loaded stays until something else trims the cache
+    ok_or_panic(project_ensure_audio_asset_loaded(project, audio_asset));
+    assert(project_audio_asset_is_loaded(audio_asset));
+    assert(genesis_audio_file_frame_count(audio_asset->audio_file) == 3000);
+    AudioAssetCacheStats stats;
+    project_get_audio_asset_cache_stats(project, &stats);
+    assert(!project_audio_asset_is_loaded(audio_asset));
+    assert(stats.budget_bytes == 0);
+    assert(stats.resident_bytes == 0);
+    assert(stats.loaded_count == 0);
+    assert(stats.eviction_count == 1);
+
+    // pinned ones stay, and come back the same from the decoded cache
+    project_pin_audio_asset(project, audio_asset);
+    ok_or_panic(project_ensure_audio_asset_loaded(project, audio_asset));
+    ok_or_panic(project_ensure_audio_asset_loaded(project, audio_asset));
+    assert(genesis_audio_file_frame_count(audio_asset->audio_file) == 3000);
+    project_get_audio_asset_cache_stats(project, &stats);
+    assert(project_audio_asset_is_loaded(audio_asset));
+    assert(stats.loaded_count == 1);
+    assert(stats.resident_bytes == genesis_audio_file_memory_bytes(audio_asset->audio_file));
+    assert(stats.resident_bytes > 0);
+    assert(stats.hit_count == 1);
+    assert(stats.miss_count == 2);
+    project_unpin_audio_asset(project, audio_asset);
+    assert(!project_audio_asset_is_loaded(audio_asset));
+    project_get_audio_asset_cache_stats(project, &stats);
+    assert(stats.eviction_count == 2);
+
+    // so do the ones a clip refers to
+    project_add_audio_clip(project, audio_asset);
+    project_get_audio_asset_cache_stats(project, &stats);
+    assert(project_audio_asset_is_loaded(audio_asset));
+    assert(stats.eviction_count == 2);
+
+    project_close(project);
+    user_destroy(user);
+    os_delete(cache_path.raw());
+    os_delete(asset_path.raw());
+    os_delete(tmp_proj_path);
+    genesis_context_destroy(context);
+}
+
+static void test_asset_store(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    static const char *store_dir = "/tmp/test_genesis_store";
+    static const char *proj_dirs[] = {"/tmp/test_genesis_store_a", "/tmp/test_genesis_store_b"};
+    static const char *proj_paths[] = {
+        "/tmp/test_genesis_store_a/project.gdaw",
+        "/tmp/test_genesis_store_b/project.gdaw",
+    };
+    genesis_set_asset_store_dir(context, store_dir);
+
+    User *user = user_create(uint256::random(), os_get_user_name());
+    Project *projects[2];
+    AudioAsset *audio_assets[2];
+    ByteBuffer asset_paths[2];
+    struct stat asset_stats[2];
+    for (int i = 0; i < 2; i += 1) {
+        ok_or_panic(os_mkdirp(proj_dirs[i]));
+        os_delete(proj_paths[i]);
+        ok_or_panic(project_create(context, proj_paths[i], uint256::random(), user, &projects[i]));
+        ok_or_panic(project_add_audio_asset(projects[i], "../test/tiny-sine.ogg", &audio_assets[i]));
+        os_path_join(asset_paths[i], proj_dirs[i], audio_assets[i]->path);
+        assert(stat(asset_paths[i].raw(), &asset_stats[i]) == 0);
+    }
+    // both projects have the one file in the store
+    ByteBuffer store_path;
+    os_path_join(store_path, store_dir, "files");
+    os_path_join(store_path, store_path, audio_assets[0]->sha256sum.to_string());
+    struct stat store_stat;
+    assert(stat(store_path.raw(), &store_stat) == 0);
+    assert(asset_stats[0].st_ino == store_stat.st_ino);
+    assert(asset_stats[1].st_ino == store_stat.st_ino);
+    AudioAsset *again;
+    assert(project_add_audio_asset(projects[0], "../test/tiny-sine.ogg", &again) == GenesisErrorAlreadyExists);
+    assert(again == audio_assets[0]);
+
+    // and one decoded cache, so only the first load makes the peaks
+    ByteBuffer cache_dirs[2], cache_paths[2];
+    for (int i = 0; i < 2; i += 1)
+        project_decoded_cache_path(projects[i], audio_assets[i]->sha256sum, cache_dirs[i], cache_paths[i]);
+    assert(ByteBuffer::compare(cache_paths[0], cache_paths[1]) == 0);
+    ok_or_panic(os_mkdirp(cache_dirs[0]));
+    GenesisAudioFile *decoded = ok_mem(genesis_audio_file_create(context, 44100));
+    ok_or_panic(genesis_audio_file_set_channel_layout(decoded,
+                soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono)));
+    ok_or_panic(decoded->channels.at(0).samples.resize(3000));
+    decoded->channels.at(0).samples.fill(0.5f);
+    ok_or_panic(genesis_audio_file_write_decoded(decoded, cache_paths[0].raw()));
+    genesis_audio_file_destroy(decoded);
+
+    ok_or_panic(project_ensure_audio_asset_loaded(projects[0], audio_assets[0]));
+    ByteBuffer peaks_path = cache_paths[0];
+    os_path_remove_extension(peaks_path);
+    peaks_path.append(".peaks");
+    WaveformPeaks *cached_peaks;
+    ok_or_panic(waveform_peaks_read(peaks_path.raw(), &cached_peaks));
+    assert(cached_peaks->levels[0].peaks[0].max == 0.5f);
+    waveform_peaks_destroy(cached_peaks);
+    // peaks that could not have come from the samples show that the second
+    // load reads them
+    ok_or_panic(waveform_peaks_create(1, 3000, &cached_peaks));
+    List<float> quiet;
+    ok_or_panic(quiet.resize(3000));
+    quiet.fill(0.25f);
+    const float *quiet_channels[1] = {quiet.raw()};
+    waveform_peaks_add(cached_peaks, quiet_channels, 3000);
+    waveform_peaks_finish(cached_peaks);
+    ok_or_panic(waveform_peaks_write(cached_peaks, peaks_path.raw()));
+    waveform_peaks_destroy(cached_peaks);
+    ok_or_panic(project_ensure_audio_asset_loaded(projects[1], audio_assets[1]));
+    assert(audio_assets[1]->peaks->complete);
+    assert(audio_assets[1]->peaks->levels[0].peaks[0].max == 0.25f);
+
+    for (int i = 0; i < 2; i += 1) {
+        project_close(projects[i]);
+        os_delete(asset_paths[i].raw());
+        os_delete(proj_paths[i]);
+    }
+    os_delete(peaks_path.raw());
+    os_delete(cache_paths[0].raw());
+    os_delete(store_path.raw());
+    user_destroy(user);
+    genesis_context_destroy(context);
+}
+
+static void test_bulk_audio_asset_import(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    static const char *tmp_proj_dir = "/tmp/test_genesis_bulk_import";
+    static const char *tmp_proj_path = "/tmp/test_genesis_bulk_import/project.gdaw";
+    static const char *src_paths[] = {"/tmp/test_genesis_bulk_a.wav", "/tmp/test_genesis_bulk_b.wav"};
+    ok_or_panic(os_mkdirp(tmp_proj_dir));
+    os_delete(tmp_proj_path);
+    for (int i = 0; i < 2; i += 1) {
+        FILE *f = fopen(src_paths[i], "wb");
+        assert(f);
+        fprintf(f, "sample %d", i);
+        fclose(f);
+    }
+
+    User *user = user_create(uint256::random(), os_get_user_name());
+    Project *project;
+    ok_or_panic(project_create(context, tmp_proj_path, uint256::random(), user, &project));
+    // the same file twice is one asset, and a missing file fails on its own
+    List<ByteBuffer> paths;
+    ok_or_panic(paths.append(src_paths[0]));
+    ok_or_panic(paths.append(src_paths[1]));
+    ok_or_panic(paths.append(src_paths[0]));
+    ok_or_panic(paths.append("/tmp/test_genesis_bulk_missing.wav"));
+    List<AudioAsset *> audio_assets;
+    List<int> errors;
+    ok_or_panic(project_add_audio_assets(project, paths, audio_assets, errors));
+    assert(audio_assets.length() == 4);
+    assert(errors.at(0) == 0);
+    assert(errors.at(1) == 0);
+    assert(audio_assets.at(0) != audio_assets.at(1));
+    assert(errors.at(2) == GenesisErrorAlreadyExists);
+    assert(audio_assets.at(2) == audio_assets.at(0));
+    assert(errors.at(3) != 0);
+    assert(audio_assets.at(3) == nullptr);
+    assert(project->audio_asset_list.length() == 2);
+    AudioAsset *again;
+    assert(project_add_audio_asset(project, src_paths[1], &again) == GenesisErrorAlreadyExists);
+    assert(again == audio_assets.at(1));
+
+    ByteBuffer asset_paths[2];
+    for (int i = 0; i < 2; i += 1)
+        os_path_join(asset_paths[i], tmp_proj_dir, audio_assets.at(i)->path);
+    project_close(project);
+    for (int i = 0; i < 2; i += 1) {
+        os_delete(asset_paths[i].raw());
+        os_delete(src_paths[i]);
+    }
+    os_delete(tmp_proj_path);
+    user_destroy(user);
+    genesis_context_destroy(context);
+}
+
+static void test_command_merging(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+    static const char *tmp_proj_dir = "/tmp/test_genesis_merge";
+    static const char *tmp_proj_path = "/tmp/test_genesis_merge/project.gdaw";
+    ok_or_panic(os_mkdirp(tmp_proj_dir));
+    os_delete(tmp_proj_path);
+
+    User *user = user_create(uint256::random(), os_get_user_name());
+    Project *project;
+    ok_or_panic(project_create(context, tmp_proj_path, uint256::random(), user, &project));
+    AudioAsset *audio_asset;
+    ok_or_panic(project_add_audio_asset(project, "../test/tiny-sine.ogg", &audio_asset));
+    ByteBuffer asset_path;
+    os_path_join(asset_path, tmp_proj_dir, audio_asset->path);
+    project_add_audio_clip(project, audio_asset);
+    AudioClip *audio_clip = project->audio_clip_list.at(0);
+    Track *track = project->track_list.at(0);
+    project_add_audio_clip_segment(project, audio_clip, track, 0, 100, 1.0);
+    AudioClipSegment *segment = track->audio_clip_segments.at(0);
+
+    // a drag is one command and one undo step
+    int command_count = project->command_list.length();
+    int undo_count = project->undo_stack.length();
+    for (int i = 0; i < 20; i += 1)
+        project_move_audio_clip_segment(project, segment, 2.0 + i);
+    assert(project->command_list.length() == command_count + 1);
+    assert(project->undo_stack.length() == undo_count + 1);
+    assert(segment->pos == 21.0);
+
+    project_undo(project);
+    assert(segment->pos == 1.0);
+    project_redo(project);
+    assert(segment->pos == 21.0);
+
+    // an undo in between keeps the next move apart
+    project_move_audio_clip_segment(project, segment, 30.0);
+    assert(project->undo_stack.length() == undo_count + 2);
+    project_close(project);
+
+    ok_or_panic(project_open(context, tmp_proj_path, user, &project));
+    track = project->track_list.at(0);
+    segment = track->audio_clip_segments.at(0);
+    assert(segment->pos == 30.0);
+    assert(project->undo_stack.length() == undo_count + 2);
+    project_undo(project);
+    assert(segment->pos == 21.0);
+    project_undo(project);
+    assert(segment->pos == 1.0);
+
+    // clip voices are saved and undone like the rest
+    AudioClip *reopened_clip = project->audio_clip_list.at(0);
+    assert(reopened_clip->polyphony == AUDIO_CLIP_DEFAULT_POLYPHONY);
+    assert(reopened_clip->voice_steal == AudioClipVoiceStealOldest);
+    project_set_audio_clip_voices(project, reopened_clip, 1000, AudioClipVoiceStealQuietest);
+    assert(reopened_clip->polyphony == AUDIO_CLIP_MAX_POLYPHONY);
+    project_close(project);
+
+    ok_or_panic(project_open(context, tmp_proj_path, user, &project));
+    reopened_clip = project->audio_clip_list.at(0);
+    assert(reopened_clip->polyphony == AUDIO_CLIP_MAX_POLYPHONY);
+    assert(reopened_clip->voice_steal == AudioClipVoiceStealQuietest);
+    project_undo(project);
+    assert(reopened_clip->polyphony == AUDIO_CLIP_DEFAULT_POLYPHONY);
+    assert(reopened_clip->voice_steal == AudioClipVoiceStealOldest);
+
+    // and so is the time stretch, which makes the clip's segments longer
+    assert(reopened_clip->stretch == 1.0);
+    segment = project->track_list.at(0)->audio_clip_segments.at(0);
+    long unstretched_duration = audio_clip_segment_duration(segment);
+    project_set_audio_clip_time_stretch(project, reopened_clip, 2.0, 10.0, GenesisTimeStretchQualityHigh);
+    assert(reopened_clip->pitch == TIME_STRETCH_MAX_PITCH);
+    assert(audio_clip_segment_duration(segment) == 2 * unstretched_duration);
+    project_close(project);
+
+    ok_or_panic(project_open(context, tmp_proj_path, user, &project));
+    reopened_clip = project->audio_clip_list.at(0);
+    assert(reopened_clip->stretch == 2.0);
+    assert(reopened_clip->pitch == TIME_STRETCH_MAX_PITCH);
+    assert(reopened_clip->time_stretch_quality == GenesisTimeStretchQualityHigh);
+    project_undo(project);
+    assert(reopened_clip->stretch == 1.0);
+    assert(reopened_clip->pitch == 1.0);
+    assert(reopened_clip->time_stretch_quality == GenesisTimeStretchQualityDraft);
+
+    project_close(project);
+    user_destroy(user);
+    os_delete(asset_path.raw());
+    os_delete(tmp_proj_path);
+    genesis_context_destroy(context);
+}
+
+static void test_string_compare(void) {
+    String a("67 fps");
+    String b("69 fps");
+    assert(String::compare(a, b) == -1);
+    assert(String::compare(b, a) == 1);
+    assert(String::compare_insensitive(a, b) == -1);
+    assert(String::compare_insensitive(b, a) == 1);
+}
+
+static void test_audio_file(void) {
+    static const char *tmp_file_path = "/tmp/test_genesis_out.flac";
+
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+
+    GenesisAudioFile *audio_file;
+    ok_or_panic(genesis_audio_file_load(context, "../test/tiny-sine.ogg", &audio_file));
+
+    GenesisExportFormat format;
+    format.bit_rate = 320 * 1000;
+    format.codec = genesis_guess_audio_file_codec(context, tmp_file_path, nullptr, nullptr);
+    assert(format.codec);
+    int sample_format_count = genesis_audio_file_codec_sample_format_count(format.codec);
+    assert(sample_format_count > 0);
+    format.sample_format = genesis_audio_file_codec_sample_format_index(format.codec, 0);
+    format.sample_rate = 48000;
+    format.dither = GenesisDitherTriangular;
+    assert(genesis_audio_file_codec_supports_sample_rate(format.codec, format.sample_rate));
+
+    genesis_audio_file_export(audio_file, tmp_file_path, -1, &format);
+    genesis_audio_file_destroy(audio_file);
+    genesis_context_destroy(context);
+
+    os_delete(tmp_file_path);
+}
+
+// long enough to be encoded and decoded on several threads, with
+// neighbouring samples far apart so that a misplaced region shows
+static void test_audio_file_parallel_loading(void) {
+    static const char *tmp_file_path = "/tmp/test_genesis_parallel.flac";
+    static const int frame_count = 3 * 1024 * 1024;
+
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+
+    GenesisAudioFile *audio_file = ok_mem(genesis_audio_file_create(context, 48000));
+    List<float> *samples = &audio_file->channels.at(0).samples;
+    ok_or_panic(samples->resize(frame_count));
+    for (int i = 0; i < frame_count; i += 1)
+        samples->at(i) = (((long)i * 7919) % 2001 - 1000) / 1024.0f;
+
+    GenesisExportFormat format;
+    format.bit_rate = 0;
+    format.codec = genesis_guess_audio_file_codec(context, tmp_file_path, nullptr, nullptr);
+    assert(format.codec);
+    assert(genesis_audio_file_codec_supports_sample_format(format.codec, SoundIoFormatS16NE));
+    format.sample_format = SoundIoFormatS16NE;
+    format.sample_rate = 48000;
+    format.dither = GenesisDitherNone;
+    genesis_set_codec_stats_enabled(context, true);
+    ok_or_panic(genesis_audio_file_export(audio_file, tmp_file_path, -1, &format));
+    GenesisCodecStats stats;
+    genesis_get_codec_stats(context, &stats);
+    assert(stats.encode_seconds > 0.0);
+    assert(stats.export_seconds > 0.0);
+    assert(stats.decode_seconds == 0.0);
+    genesis_reset_codec_stats(context);
+
+    GenesisAudioFile *loaded;
+    ok_or_panic(genesis_audio_file_load(context, tmp_file_path, &loaded));
+    genesis_get_codec_stats(context, &stats);
+    assert(stats.decode_seconds > 0.0);
+    assert(stats.import_seconds > 0.0);
+    assert(stats.encode_seconds == 0.0);
+    // the stream leaves out the last frames when they do not fill a packet
+    long loaded_frame_count = genesis_audio_file_frame_count(loaded);
+    assert(loaded_frame_count <= frame_count);
+    assert(loaded_frame_count >= frame_count - 65536);
+    const float *loaded_samples = loaded->channels.at(0).samples.raw();
+    for (long i = 0; i < loaded_frame_count; i += 1)
+        assert(fabsf(loaded_samples[i] - samples->at(i)) < 1.0f / 8192.0f);
+
+    genesis_audio_file_destroy(loaded);
+    genesis_audio_file_destroy(audio_file);
+    genesis_context_destroy(context);
+    os_delete(tmp_file_path);
+}
+
+static void test_audio_file_progressive_loading(void) {
+    static const char *tmp_file_path = "/tmp/test_genesis_progressive.flac";
+    static const int frame_count = 500000;
+
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+
+    GenesisAudioFile *audio_file = ok_mem(genesis_audio_file_create(context, 48000));
+    List<float> *samples = &audio_file->channels.at(0).samples;
+    ok_or_panic(samples->resize(frame_count));
+    for (int i = 0; i < frame_count; i += 1)
+        samples->at(i) = (((long)i * 7919) % 2001 - 1000) / 1024.0f;
+
+    GenesisExportFormat format;
+    format.bit_rate = 0;
+    format.codec = genesis_guess_audio_file_codec(context, tmp_file_path, nullptr, nullptr);
+    assert(format.codec);
+    format.sample_format = SoundIoFormatS16NE;
+    format.sample_rate = 48000;
+    format.dither = GenesisDitherNone;
+    ok_or_panic(genesis_audio_file_export(audio_file, tmp_file_path, -1, &format));
+
+    GenesisAudioFile *loaded;
+    ok_or_panic(genesis_audio_file_open_progressive(context, tmp_file_path, &loaded));
+    assert(!genesis_audio_file_is_streamed(loaded));
+    GenesisAudioFileReader *reader;
+    ok_or_panic(genesis_audio_file_reader_create(loaded, &reader));
+    // reads what there is while the rest decodes
+    long position = 0;
+    for (;;) {
+        bool decoding = genesis_audio_file_is_decoding(loaded);
+        int fill_count = genesis_audio_file_reader_fill_count(reader);
+        assert(position + fill_count <= genesis_audio_file_decoded_frame_count(loaded));
+        const float *read_ptr = genesis_audio_file_reader_read_ptr(reader, 0);
+        for (int i = 0; i < fill_count; i += 1)
+            assert(fabsf(read_ptr[i] - samples->at(position + i)) < 1.0f / 8192.0f);
+        genesis_audio_file_reader_advance_read_ptr(reader, fill_count);
+        position += fill_count;
+        if (!decoding && fill_count == 0)
+            break;
+    }
+    ok_or_panic(genesis_audio_file_wait_decoded(loaded));
+    assert(position == genesis_audio_file_frame_count(loaded));
+    assert(position <= frame_count);
+    assert(position >= frame_count - 65536);
+
+    genesis_audio_file_reader_destroy(reader);
+    genesis_audio_file_destroy(loaded);
+    genesis_audio_file_destroy(audio_file);
+    genesis_context_destroy(context);
+    os_delete(tmp_file_path);
+}
+
+static void test_resample_context(void) {
+    const SoundIoChannelLayout *mono = soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono);
+    const SoundIoChannelLayout *stereo = soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdStereo);
+
+    // mono to stereo at the same rate only copies
+    ResampleContext *resample_context;
+    ok_or_panic(resample_context_create(48000, mono, 48000, stereo,
+                GenesisResampleQualityRealtime, &resample_context));
+    float in[4096];
+    float out[2 * 8192];
+    for (int i = 0; i < 100; i += 1)
+        in[i] = i;
+    int consumed;
+    int written;
+    resample_convert(resample_context, in, 100, out, 60, &consumed, &written);
+    assert(consumed == 60);
+    assert(written == 60);
+    for (int i = 0; i < 60; i += 1) {
+        assert(out[i * 2] == i);
+        assert(out[i * 2 + 1] == i);
+    }
+    resample_context_destroy(resample_context);
+
+    // twice the rate, fed a little at a time
+    ok_or_panic(resample_context_create(24000, mono, 48000, mono,
+                GenesisResampleQualityRealtime, &resample_context));
+    for (int i = 0; i < array_length(in); i += 1)
+        in[i] = 0.5f;
+    int in_frame_count = array_length(in);
+    int in_offset = 0;
+    int out_offset = 0;
+    while (in_offset < in_frame_count) {
+        int in_count = min(100, in_frame_count - in_offset);
+        resample_convert(resample_context, in + in_offset, in_count, out + out_offset, 8192 - out_offset,
+                &consumed, &written);
+        // it keeps what it did not consume for the next call
+        if (consumed == 0)
+            break;
+        in_offset += consumed;
+        out_offset += written;
+    }
+    assert(out_offset >= 2 * in_offset - 2);
+    assert(out_offset <= 2 * in_offset + 2);
+    // past the filter's warm up, dc comes through at unity gain
+    for (int i = 4096; i < out_offset; i += 1)
+        assert(fabsf(out[i] - 0.5f) < 0.01f);
+    resample_context_destroy(resample_context);
+}
+
+// a recording device 300 parts per million fast fills a buffer which a
+// device at the nominal rate empties, both in callbacks of 256 frames. the
+// reader's clock is exact, and the control settles on the drift without
+// the beat of the callbacks in it, holding the buffer near half full.
+static void test_resample_drift_control(void) {
+    const SoundIoChannelLayout *mono = soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdMono);
+    static const int frame_rate = 48000;
+    static const int period = 256;
+    static const int capacity = 4096;
+    static const double drift = 3e-4;
+    ResampleContext *resample_context;
+    ok_or_panic(resample_context_create_adaptive(frame_rate, frame_rate, mono,
+                GenesisResampleQualityDraft, &resample_context));
+    ResampleDriftControl control;
+    resample_drift_control_init(&control, frame_rate, capacity / 2, 0.005);
+
+    float in[period];
+    float out[capacity];
+    for (int i = 0; i < period; i += 1)
+        in[i] = 0.5f;
+    int fill = capacity / 2;
+    int min_fill = capacity;
+    int max_fill = 0;
+    double record_time = 0.0;
+    double play_time = 0.0;
+    while (record_time < 120.0) {
+        if (record_time <= play_time) {
+            int consumed;
+            int written;
+            resample_convert(resample_context, in, period, out, capacity - fill, &consumed, &written);
+            assert(consumed == period);
+            fill += written;
+            resample_context_set_correction(resample_context,
+                    resample_drift_control_update(&control, fill, written, record_time * frame_rate));
+            // past the filter's warm up, dc comes through at unity gain
+            for (int i = 0; record_time > 0.1 && i < written; i += 1)
+                assert(fabsf(out[i] - 0.5f) < 0.01f);
+            record_time += period / (frame_rate * (1.0 + drift));
+        } else {
+            assert(fill >= period);
+            fill -= period;
+            play_time += period / (double)frame_rate;
+        }
+        if (record_time > 60.0) {
+            min_fill = min(min_fill, fill);
+            max_fill = max(max_fill, fill);
+        }
+    }
+    assert(fabs(control.correction - drift) < drift * 0.1);
+    assert(min_fill >= capacity / 2 - 2 * period);
+    assert(max_fill < capacity / 2 + 2 * period);
+    resample_context_destroy(resample_context);
+}
+
+// feeds a mono sine through a time stretch a few hundred frames at a time
+// and returns how many frames came out
+static int stretch_sine(TimeStretch *time_stretch, double frequency, int in_frame_count,
+        float *out, int out_capacity)
+{
+    float in[300];
+    int in_offset = 0;
+    int out_offset = 0;
+    while (out_offset < out_capacity) {
+        int in_count = min((int)array_length(in), in_frame_count - in_offset);
+        for (int i = 0; i < in_count; i += 1)
+            in[i] = sin(2.0 * M_PI * frequency * (in_offset + i) / 48000.0);
+        int consumed;
+        int written;
+        time_stretch_convert(time_stretch, in, in_count, out + out_offset,
+                min(217, out_capacity - out_offset), &consumed, &written);
+        in_offset += consumed;
+        out_offset += written;
+        if (consumed == 0 && written == 0)
+            break;
+    }
+    return out_offset;
+}
+
+// rising zero crossings per second in frames [start, end)
+static double crossing_rate(const float *samples, int start, int end) {
+    int first = -1;
+    int last = -1;
+    int count = 0;
+    for (int i = start + 1; i < end; i += 1) {
+        if (samples[i - 1] < 0.0f && samples[i] >= 0.0f) {
+            if (first < 0)
+                first = i;
+            else
+                count += 1;
+            last = i;
+        }
+    }
+    return count * 48000.0 / (last - first);
+}
+
+static void test_time_stretch(void) {
+    static const int in_frame_count = 24000;
+    static const int out_capacity = 2 * in_frame_count;
+    float *out = ok_mem(allocate_zero<float>(out_capacity));
+    static const GenesisTimeStretchQuality qualities[] = {
+        GenesisTimeStretchQualityDraft,
+        GenesisTimeStretchQualityHigh,
+    };
+    for (int i = 0; i < array_length(qualities); i += 1) {
+        TimeStretch *time_stretch;
+        ok_or_panic(time_stretch_create(48000, 1, qualities[i], &time_stretch));
+
+        // at ratios of 1 the input comes back, lined up with itself
+        int written = stretch_sine(time_stretch, 441.0, in_frame_count, out, out_capacity);
+        assert(written >= in_frame_count - time_stretch_lookahead(time_stretch));
+        assert(written <= in_frame_count);
+        for (int frame = 0; frame < written; frame += 1)
+            assert(fabs(out[frame] - sin(2.0 * M_PI * 441.0 * frame / 48000.0)) < 0.001);
+
+        // twice as long at the same pitch
+        time_stretch_set_ratios(time_stretch, 2.0, 1.0);
+        time_stretch_reset(time_stretch);
+        written = stretch_sine(time_stretch, 441.0, in_frame_count, out, out_capacity);
+        assert(written >= out_capacity - 2 * time_stretch_lookahead(time_stretch));
+        assert(fabs(crossing_rate(out, 4800, written - 4800) - 441.0) < 5.0);
+
+        // as long, an octave up
+        time_stretch_set_ratios(time_stretch, 1.0, 2.0);
+        time_stretch_reset(time_stretch);
+        written = stretch_sine(time_stretch, 441.0, in_frame_count, out, out_capacity);
+        assert(written >= in_frame_count - 2 * time_stretch_lookahead(time_stretch));
+        assert(written <= in_frame_count);
+        assert(fabs(crossing_rate(out, 4800, written - 4800) - 882.0) < 10.0);
+
+        time_stretch_destroy(time_stretch);
+    }
+    destroy(out, out_capacity);
+}
+
+static void test_audio_file_reader(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+
+    GenesisAudioFile *audio_file = ok_mem(genesis_audio_file_create(context, 48000));
+    List<float> *samples = &audio_file->channels.at(0).samples;
+    ok_or_panic(samples->resize(1000));
+    for (int i = 0; i < samples->length(); i += 1)
+        samples->at(i) = i;
+    assert(!genesis_audio_file_is_streamed(audio_file));
+
+    GenesisAudioFileReader *reader;
+    ok_or_panic(genesis_audio_file_reader_create(audio_file, &reader));
+    assert(genesis_audio_file_reader_position(reader) == 0);
+    assert(genesis_audio_file_reader_fill_count(reader) == 1000);
+    genesis_audio_file_reader_advance_read_ptr(reader, 10);
+    assert(genesis_audio_file_reader_read_ptr(reader, 0)[0] == 10.0f);
+    genesis_audio_file_reader_seek(reader, 990);
+    assert(genesis_audio_file_reader_fill_count(reader) == 10);
+    assert(genesis_audio_file_reader_read_ptr(reader, 0)[9] == 999.0f);
+    genesis_audio_file_reader_seek(reader, 2000);
+    assert(genesis_audio_file_reader_fill_count(reader) == 0);
+
+    genesis_audio_file_reader_destroy(reader);
+    genesis_audio_file_destroy(audio_file);
+    genesis_context_destroy(context);
+}
+
+static void on_loudness_file(void *userdata, const char *path, int err, const GenesisLoudness *loudness) {
+    atomic_int *file_count = (atomic_int *)userdata;
+    // none of them are audio
+    assert(err);
+    assert(!loudness);
+    file_count->fetch_add(1);
+}
+
+static void test_loudness(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+
+    // a 1 kHz sine of the same level on both channels of stereo reads as
+    // its level in dBFS
+    static const int sample_rate = 48000;
+    static const int frame_count = sample_rate * 10;
+    GenesisAudioFile *audio_file = ok_mem(genesis_audio_file_create(context, sample_rate));
+    ok_or_panic(genesis_audio_file_set_channel_layout(audio_file,
+                soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdStereo)));
+    for (int ch = 0; ch < 2; ch += 1) {
+        List<float> *samples = &audio_file->channels.at(ch).samples;
+        ok_or_panic(samples->resize(frame_count));
+        for (int i = 0; i < frame_count; i += 1)
+            samples->at(i) = 0.1f * sin(2.0 * M_PI * 1000.0 * i / sample_rate);
+    }
+    GenesisLoudness loudness;
+    ok_or_panic(genesis_audio_file_measure_loudness(audio_file, &loudness));
+    assert(loudness.channel_count == 2);
+    assert(loudness.frame_count == frame_count);
+    assert(fabs(loudness.integrated + 20.0) < 0.1);
+    for (int ch = 0; ch < 2; ch += 1) {
+        assert(fabsf(loudness.sample_peak[ch] - 0.1f) < 0.001f);
+        assert(fabsf(loudness.true_peak[ch] - 0.1f) < 0.002f);
+    }
+
+    // the same frames added in uneven pieces, then silence, which is gated
+    GenesisLoudnessMeter *meter;
+    ok_or_panic(genesis_loudness_meter_create(sample_rate, &audio_file->channel_layout, &meter));
+    const float *channels[2];
+    for (int offset = 0, piece = 1; offset < frame_count; piece = piece * 7 % 4099) {
+        int piece_frame_count = min(piece, frame_count - offset);
+        for (int ch = 0; ch < 2; ch += 1)
+            channels[ch] = audio_file->channels.at(ch).samples.raw() + offset;
+        genesis_loudness_meter_add(meter, channels, piece_frame_count);
+        offset += piece_frame_count;
+    }
+    GenesisLoudness pieces;
+    genesis_loudness_meter_get(meter, &pieces);
+    assert(pieces.integrated == loudness.integrated);
+    assert(pieces.true_peak[0] == loudness.true_peak[0]);
+    List<float> silence;
+    ok_or_panic(silence.resize(frame_count));
+    silence.fill(0.0f);
+    channels[0] = channels[1] = silence.raw();
+    genesis_loudness_meter_add(meter, channels, frame_count);
+    genesis_loudness_meter_get(meter, &pieces);
+    // only the blocks across the end of the sine are left to lower it
+    assert(fabs(pieces.integrated - loudness.integrated) < 0.1);
+    genesis_loudness_meter_destroy(meter);
+
+    assert(fabs(genesis_loudness_normalization_gain(&loudness, -23.0, -1.0) - pow(10.0, -3.0 / 20.0)) < 0.02);
+    // held back by the ceiling
+    assert(fabs(genesis_loudness_normalization_gain(&loudness, 0.0, -1.0) * 0.1 - pow(10.0, -1.0 / 20.0)) < 0.01);
+    genesis_audio_file_destroy(audio_file);
+
+    // a quarter of the sample rate at 45 degrees peaks halfway between
+    // samples which only reach 0.707 of it. the LFE does not count.
+    SoundIoChannelLayout layout;
+    memset(&layout, 0, sizeof(SoundIoChannelLayout));
+    layout.channel_count = 3;
+    layout.channels[0] = SoundIoChannelIdFrontLeft;
+    layout.channels[1] = SoundIoChannelIdFrontRight;
+    layout.channels[2] = SoundIoChannelIdLfe;
+    audio_file = ok_mem(genesis_audio_file_create(context, sample_rate));
+    ok_or_panic(genesis_audio_file_set_channel_layout(audio_file, &layout));
+    for (int ch = 0; ch < 3; ch += 1) {
+        List<float> *samples = &audio_file->channels.at(ch).samples;
+        ok_or_panic(samples->resize(sample_rate));
+        for (int i = 0; i < sample_rate; i += 1)
+            samples->at(i) = (ch == 2) ? 0.5f * sin(M_PI * (i / 2.0 + 0.25)) : 0.0f;
+    }
+    ok_or_panic(genesis_audio_file_measure_loudness(audio_file, &loudness));
+    assert(loudness.integrated == -INFINITY);
+    assert(fabsf(loudness.sample_peak[2] - 0.5f * M_SQRT1_2) < 0.001f);
+    assert(fabsf(loudness.true_peak[2] - 0.5f) < 0.01f);
+    assert(genesis_loudness_normalization_gain(&loudness, -23.0, -1.0) == 1.0f);
+    genesis_audio_file_destroy(audio_file);
+
+    // files which are not audio are each reported with an error
+    static const char *dir = "/tmp/test_genesis_loudness";
+    static const char *sub_dir = "/tmp/test_genesis_loudness/sub";
+    ok_or_panic(os_mkdirp(sub_dir));
+    write_empty_file(dir, 0);
+    write_empty_file(dir, 1);
+    write_empty_file(sub_dir, 0);
+    atomic_int file_count;
+    file_count.store(0);
+    ok_or_panic(genesis_measure_loudness_batch(context, dir, 2, on_loudness_file, &file_count));
+    assert(file_count.load() == 3);
+
+    genesis_context_destroy(context);
+}
+
+static void test_audio_file_sample_storage(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+
+    // float sources stay as they are
+    GenesisAudioFile *audio_file = ok_mem(genesis_audio_file_create(context, 48000));
+    ok_or_panic(audio_file->channels.at(0).samples.resize(10));
+    ok_or_panic(genesis_audio_file_set_sample_storage(audio_file, GenesisSampleStorageCompact));
+    assert(genesis_audio_file_sample_storage(audio_file) == GenesisSampleStorageFloat);
+    genesis_audio_file_destroy(audio_file);
+
+    static const int frame_count = 10000;
+    static const int bits_list[] = {16, 24};
+    static const GenesisSampleStorage storage_list[] = {
+        GenesisSampleStorageCompact,
+        GenesisSampleStorageCompressed,
+    };
+    for (int test_i = 0; test_i < 4; test_i += 1) {
+        int bits = bits_list[test_i % 2];
+        GenesisSampleStorage storage = storage_list[test_i / 2];
+        long max_sample = (1L << (bits - 1)) - 1;
+        // 24 bit samples come from the decoder in the top of 32 bits
+        double scale = (bits == 16) ? 1.0 : 256.0;
+        double half_range = (bits == 16) ? 32767.5 : 2147483647.5;
+        audio_file = ok_mem(genesis_audio_file_create(context, 48000));
+        ok_or_panic(genesis_audio_file_set_channel_layout(audio_file,
+                    soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdStereo)));
+        audio_file->source_bits = bits;
+        // what the decoder makes of integer samples, full scale included
+        for (int ch = 0; ch < 2; ch += 1) {
+            List<float> *samples = &audio_file->channels.at(ch).samples;
+            ok_or_panic(samples->resize(frame_count));
+            // noise on the left and a sine on the right
+            for (int i = 0; i < frame_count; i += 1) {
+                long sample = (ch == 0) ? (i * 7919L) % (2 * max_sample + 2) - max_sample - 1 :
+                    lrint(sin(i * 0.002) * max_sample * 0.9);
+                samples->at(i) = (sample * scale + 0.5) / half_range;
+            }
+            samples->at(0) = -1.0f;
+            samples->at(1) = 1.0f;
+        }
+        float expected[2][frame_count];
+        for (int ch = 0; ch < 2; ch += 1)
+            memcpy(expected[ch], audio_file->channels.at(ch).samples.raw(), sizeof(expected[ch]));
+
+        ok_or_panic(genesis_audio_file_set_sample_storage(audio_file, storage));
+        assert(genesis_audio_file_sample_storage(audio_file) == storage);
+        assert(genesis_audio_file_frame_count(audio_file) == frame_count);
+        assert(audio_file->channels.at(0).samples.capacity() == 0);
+        if (storage == GenesisSampleStorageCompressed) {
+            long block_count = (frame_count + SAMPLE_CODEC_BLOCK_FRAMES - 1) / SAMPLE_CODEC_BLOCK_FRAMES;
+            long sine_bytes = audio_file->compressed_block_offsets[1][block_count];
+            assert(sine_bytes < frame_count * audio_file->integer_sample_bytes / 2);
+        }
+
+        // the reader converts across block boundaries and after seeks
+        GenesisAudioFileReader *reader;
+        ok_or_panic(genesis_audio_file_reader_create(audio_file, &reader));
+        long frame = 0;
+        while (frame < frame_count) {
+            int fill_count = genesis_audio_file_reader_fill_count(reader);
+            assert(fill_count > 0);
+            int amt = min(fill_count, 700);
+            for (int ch = 0; ch < 2; ch += 1) {
+                const float *ptr = genesis_audio_file_reader_read_ptr(reader, ch);
+                for (int i = 0; i < amt; i += 1)
+                    assert(fabsf(ptr[i] - expected[ch][frame + i]) < 1e-6f);
+            }
+            genesis_audio_file_reader_advance_read_ptr(reader, amt);
+            frame += amt;
+        }
+        assert(genesis_audio_file_reader_fill_count(reader) == 0);
+        genesis_audio_file_reader_seek(reader, frame_count - 5);
+        assert(genesis_audio_file_reader_fill_count(reader) == 5);
+        assert(fabsf(genesis_audio_file_reader_read_ptr(reader, 1)[4] - expected[1][frame_count - 1]) < 1e-6f);
+        genesis_audio_file_reader_seek(reader, 0);
+        assert(genesis_audio_file_reader_fill_count(reader) > 0);
+        assert(genesis_audio_file_reader_read_ptr(reader, 0)[0] == -1.0f);
+        genesis_audio_file_reader_destroy(reader);
+
+        ok_or_panic(genesis_audio_file_set_sample_storage(audio_file, GenesisSampleStorageFloat));
+        assert(genesis_audio_file_sample_storage(audio_file) == GenesisSampleStorageFloat);
+        for (int ch = 0; ch < 2; ch += 1) {
+            GenesisAudioFileIterator it = genesis_audio_file_iterator(audio_file, ch, 0);
+            assert(it.end == frame_count);
+            for (int i = 0; i < frame_count; i += 1)
+                assert(fabsf(it.ptr[i] - expected[ch][i]) < 1e-6f);
+        }
+        genesis_audio_file_destroy(audio_file);
+    }
+    genesis_context_destroy(context);
+}
+
+static void test_sample_codec(void) {
+    static const int frame_count = SAMPLE_CODEC_BLOCK_FRAMES;
+    int32_t samples[frame_count];
+    float decoded[frame_count];
+    List<uint8_t> out;
+    ok_or_panic(out.reserve(sample_codec_max_block_bytes(frame_count)));
+    for (int pattern = 0; pattern < 6; pattern += 1) {
+        for (int i = 0; i < frame_count; i += 1) {
+            switch (pattern) {
+            case 0: samples[i] = 0; break;
+            // a residual too large for its rice code
+            case 1: samples[i] = (i == 100) ? 8388607 : (i & 3); break;
+            case 2: samples[i] = i * 1000 - 4000000; break;
+            case 3: samples[i] = (i & 1) ? 8388607 : -8388608; break;
+            case 4: samples[i] = lrint(sin(i * 0.003) * 30000.0); break;
+            default: samples[i] = (int32_t)((i * 2654435761u) >> 8) - 8388608; break;
+            }
+        }
+        static const int lengths[] = {1, 2, 3, 1000, frame_count};
+        for (int length_i = 0; length_i < array_length(lengths); length_i += 1) {
+            int length = lengths[length_i];
+            out.clear();
+            sample_codec_encode(samples, length, out);
+            assert(out.length() <= sample_codec_max_block_bytes(length));
+            sample_codec_decode(out.raw(), out.length(), length, 0.0f, 1.0f, decoded);
+            for (int i = 0; i < length; i += 1)
+                assert(decoded[i] == samples[i]);
+        }
+        if (pattern == 0 || pattern == 2)
+            assert(out.length() < frame_count / 4);
+    }
+}
+
+static void test_audio_file_decoded_cache(void) {
+    static const char *cache_path = "/tmp/test_genesis_decoded.pcm";
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+
+    GenesisAudioFile *audio_file = ok_mem(genesis_audio_file_create(context, 44100));
+    ok_or_panic(genesis_audio_file_set_channel_layout(audio_file,
+                soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdStereo)));
+    for (int ch = 0; ch < 2; ch += 1) {
+        List<float> *samples = &audio_file->channels.at(ch).samples;
+        ok_or_panic(samples->resize(5000));
+        for (int i = 0; i < samples->length(); i += 1)
+            samples->at(i) = ch * 10000 + i;
+    }
+    ok_or_panic(genesis_audio_file_write_decoded(audio_file, cache_path));
+
+    GenesisAudioFile *mapped;
+    ok_or_panic(genesis_audio_file_map_decoded(context, cache_path, &mapped));
+    assert(genesis_audio_file_sample_rate(mapped) == 44100);
+    assert(genesis_audio_file_frame_count(mapped) == 5000);
+    const SoundIoChannelLayout *layout = genesis_audio_file_channel_layout(mapped);
+    assert(layout->channel_count == 2);
+    assert(layout->channels[1] == audio_file->channel_layout.channels[1]);
+    for (int ch = 0; ch < 2; ch += 1) {
+        GenesisAudioFileIterator it = genesis_audio_file_iterator(mapped, ch, 0);
+        assert(it.end == 5000);
+        for (int i = 0; i < 5000; i += 1)
+            assert(it.ptr[i] == ch * 10000 + i);
+    }
+
+    genesis_audio_file_destroy(mapped);
+    genesis_audio_file_destroy(audio_file);
+    os_delete(cache_path);
+    assert(genesis_audio_file_map_decoded(context, cache_path, &mapped) == GenesisErrorFileNotFound);
+    genesis_context_destroy(context);
+}
+
+static void check_peak_span(const float *samples, long start, long end, const WaveformPeak *peak) {
+    float lo = samples[start];
+    float hi = samples[start];
+    for (long i = start; i < end; i += 1) {
+        lo = min(lo, samples[i]);
+        hi = max(hi, samples[i]);
+    }
+    assert(peak->min == lo);
+    assert(peak->max == hi);
+    assert(peak->rms >= 0.0f && peak->rms <= max(fabsf(lo), fabsf(hi)) + 0.0001f);
+}
+
+static void test_waveform_peaks(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+
+    static const long frame_count = 100000;
+    GenesisAudioFile *audio_file = ok_mem(genesis_audio_file_create(context, 44100));
+    ok_or_panic(genesis_audio_file_set_channel_layout(audio_file,
+                soundio_channel_layout_get_builtin(SoundIoChannelLayoutIdStereo)));
+    for (int ch = 0; ch < 2; ch += 1) {
+        List<float> *samples = &audio_file->channels.at(ch).samples;
+        ok_or_panic(samples->resize(frame_count));
+        for (long i = 0; i < frame_count; i += 1)
+            samples->at(i) = sinf(i * 0.001f * (ch + 1)) * (1.0f - (float)i / frame_count);
+    }
+
+    WaveformPeaks *peaks;
+    ok_or_panic(waveform_peaks_create_from_audio_file(audio_file, &peaks));
+    assert(peaks->complete);
+    assert(peaks->frame_count == frame_count);
+    // the top level covers the whole file in one peak
+    const WaveformPeaksLevel *top = &peaks->levels[peaks->level_count - 1];
+    assert(top->count == 1);
+    for (int ch = 0; ch < 2; ch += 1)
+        check_peak_span(audio_file->channels.at(ch).samples.raw(), 0, frame_count, &top->peaks[ch]);
+
+    // built a few frames at a time it comes out the same
+    WaveformPeaks *incremental;
+    ok_or_panic(waveform_peaks_create(2, frame_count, &incremental));
+    const float *channels[2];
+    for (long frame = 0; frame < frame_count; frame += 777) {
+        for (int ch = 0; ch < 2; ch += 1)
+            channels[ch] = audio_file->channels.at(ch).samples.raw() + frame;
+        waveform_peaks_add(incremental, channels, min(777L, frame_count - frame));
+    }
+    waveform_peaks_finish(incremental);
+    for (int level = 0; level < peaks->level_count; level += 1) {
+        assert(incremental->levels[level].count == peaks->levels[level].count);
+        for (long i = 0; i < peaks->levels[level].count * 2; i += 1) {
+            assert(incremental->levels[level].peaks[i].min == peaks->levels[level].peaks[i].min);
+            assert(incremental->levels[level].peaks[i].max == peaks->levels[level].peaks[i].max);
+        }
+    }
+    waveform_peaks_destroy(incremental);
+
+    // and read back from a file the same
+    static const char *peaks_path = "/tmp/test_genesis_waveform.peaks";
+    ok_or_panic(waveform_peaks_write(peaks, peaks_path));
+    WaveformPeaks *read_back;
+    ok_or_panic(waveform_peaks_read(peaks_path, &read_back));
+    os_delete(peaks_path);
+    assert(read_back->complete);
+    assert(read_back->frame_count == frame_count);
+    assert(read_back->level_count == peaks->level_count);
+    for (int level = 0; level < peaks->level_count; level += 1) {
+        assert(read_back->levels[level].count == peaks->levels[level].count);
+        assert(memcmp(read_back->levels[level].peaks, peaks->levels[level].peaks,
+                    peaks->levels[level].count * 2 * sizeof(WaveformPeak)) == 0);
+    }
+    waveform_peaks_destroy(read_back);
+
+    // zoomed out, each pixel comes from whole peaks, so its range holds the
+    // exact span of the peaks it covers
+    WaveformPeak out[64];
+    const float *samples = audio_file->channels.at(1).samples.raw();
+    long pixel_frames = 256 * 8;
+    waveform_peaks_query(peaks, 1, 0, pixel_frames * 40, 40, nullptr, out);
+    for (int pixel = 0; pixel < 40; pixel += 1) {
+        long end = min(frame_count, (pixel + 1) * pixel_frames);
+        check_peak_span(samples, pixel * pixel_frames, end, &out[pixel]);
+    }
+
+    // zoomed in past level 0 it reads the samples
+    waveform_peaks_query(peaks, 1, 1000, 1064, 64, samples, out);
+    for (int pixel = 0; pixel < 64; pixel += 1)
+        check_peak_span(samples, 1000 + pixel, 1001 + pixel, &out[pixel]);
+
+    // past the end is silence
+    waveform_peaks_query(peaks, 0, frame_count * 2, frame_count * 3, 8, nullptr, out);
+    for (int pixel = 0; pixel < 8; pixel += 1)
+        assert(out[pixel].min == 0.0f && out[pixel].max == 0.0f);
+
+    waveform_peaks_destroy(peaks);
+    genesis_audio_file_destroy(audio_file);
+    genesis_context_destroy(context);
+}
+
+static int wait_for_fill_count(GenesisAudioFileReader *reader) {
+    double deadline = os_get_time() + 5.0;
+    for (;;) {
+        int fill_count = genesis_audio_file_reader_fill_count(reader);
+        if (fill_count > 0)
+            return fill_count;
+        assert(os_get_time() < deadline);
+    }
+}
+
+static double read_energy(GenesisAudioFileReader *reader, long end) {
+    double energy = 0.0;
+    while (genesis_audio_file_reader_position(reader) < end) {
+        long frames_left = end - genesis_audio_file_reader_position(reader);
+        int frame_count = min((long)wait_for_fill_count(reader), frames_left);
+        const float *samples = genesis_audio_file_reader_read_ptr(reader, 0);
+        for (int i = 0; i < frame_count; i += 1)
+            energy += samples[i] * samples[i];
+        genesis_audio_file_reader_advance_read_ptr(reader, frame_count);
+    }
+    return energy;
+}
+
+static void test_audio_file_streaming(void) {
+    GenesisContext *context;
+    ok_or_panic(genesis_context_create(&context));
+
+    GenesisAudioFile *resident;
+    ok_or_panic(genesis_audio_file_open(context, "../test/tiny-sine.ogg", &resident));
+    assert(!genesis_audio_file_is_streamed(resident));
+
+    genesis_set_audio_file_resident_bytes(context, 0);
+    GenesisAudioFile *streamed;
+    ok_or_panic(genesis_audio_file_open(context, "../test/tiny-sine.ogg", &streamed));
+    assert(genesis_audio_file_is_streamed(streamed));
+
+    // the streamed length comes from the container, so allow rounding
+    long frame_count = genesis_audio_file_frame_count(resident);
+    long streamed_frame_count = genesis_audio_file_frame_count(streamed);
+    assert(abs(streamed_frame_count - frame_count) <= frame_count / 100 + 1);
+    long end = min(frame_count, streamed_frame_count);
+
+    GenesisAudioFileReader *resident_reader;
+    ok_or_panic(genesis_audio_file_reader_create(resident, &resident_reader));
+    GenesisAudioFileReader *reader;
+    ok_or_panic(genesis_audio_file_reader_create(streamed, &reader));
+
+    double expected = read_energy(resident_reader, end);
+    double energy = read_energy(reader, end);
+    assert(fabs(energy - expected) <= expected * 0.05);
+
+    genesis_audio_file_reader_seek(reader, end / 2);
+    genesis_audio_file_reader_seek(resident_reader, end / 2);
+    expected = read_energy(resident_reader, end);
+    energy = read_energy(reader, end);
+    assert(genesis_audio_file_reader_position(reader) == end);
+    assert(fabs(energy - expected) <= expected * 0.05);
+
+    genesis_audio_file_reader_destroy(reader);
+    genesis_audio_file_reader_destroy(resident_reader);
+    genesis_audio_file_destroy(streamed);
+    genesis_audio_file_destroy(resident);
+    genesis_context_destroy(context);
+}
+
+static void test_render_coordinator_plan(void) {
+    List<RenderRange> ranges;
+    ok_or_panic(render_coordinator_plan(1000, 3, 100, 1, "out.flac", ranges));
+    assert(ranges.length() == 3);
+    long next_frame = 0;
+    for (int i = 0; i < ranges.length(); i += 1) {
+        RenderRange *range = &ranges.at(i);
+        assert(range->start_frame == next_frame);
+        assert(range->frame_count >= 333 && range->frame_count <= 334);
+        next_frame += range->frame_count;
+    }
+    assert(next_frame == 1000);
+    // nothing comes before the first range
+    assert(ranges.at(0).preroll_frames == 0);
+    assert(ranges.at(1).preroll_frames == 100);
+    assert(ByteBuffer::compare(ranges.at(2).out_path, "out.flac.part2") == 0);
+
+    // 44100 Hz output from 48000 Hz clips is back in phase every 147 frames
+    ok_or_panic(render_coordinator_plan(10000, 4, 200, 147, "out.flac", ranges));
+    next_frame = 0;
+    for (int i = 0; i < ranges.length(); i += 1) {
+        RenderRange *range = &ranges.at(i);
+        assert(range->start_frame == next_frame);
+        assert(range->start_frame % 147 == 0);
+        assert((range->start_frame - range->preroll_frames) % 147 == 0);
+        assert(range->frame_count > 0);
+        next_frame += range->frame_count;
+    }
+    assert(next_frame == 10000);
+    assert(ranges.at(1).preroll_frames == 294);
+
+    // no empty ranges
+    ok_or_panic(render_coordinator_plan(2, 8, 100, 1, "out.flac", ranges));
+    assert(ranges.length() == 2);
+    assert(ranges.at(1).preroll_frames == 1);
+    ok_or_panic(render_coordinator_plan(300, 8, 0, 147, "out.flac", ranges));
+    assert(ranges.length() == 2);
+    assert(ranges.at(1).frame_count == 153);
+
+    assert(render_coordinator_plan(0, 4, 0, 1, "out.flac", ranges) == GenesisErrorInvalidParam);
+    assert(render_coordinator_plan(100, 0, 0, 1, "out.flac", ranges) == GenesisErrorInvalidParam);
+}
+
+static void test_path_extension(void) {
+    assert(ByteBuffer::compare(os_path_extension("foo"), "") == 0);
+    assert(ByteBuffer::compare(os_path_extension("foo.ogg"), ".ogg") == 0);
+    assert(ByteBuffer::compare(os_path_extension("foo.ogg.flac"), ".flac") == 0);
+}
+
+static void test_atomic_value(void) {
+    AtomicValue<int> av;
+
+    int *x = av.write_begin();
+    *x = 900;
+    av.write_end();
+    int *y = av.get_read_ptr();
+    assert(*y == 900);
+
+    x = av.write_begin();
+    *x = 1234;
+    av.write_end();
+    y = av.get_read_ptr();
+    assert(*y == 1234);
+}
+
+static int atomic_pointer_destroyed_count = 0;
+
+struct AtomicPointerPayload {
+    List<int> items;
+    ~AtomicPointerPayload() {
+        atomic_pointer_destroyed_count += 1;
+    }
+};
+
+static AtomicPointerPayload *create_atomic_pointer_payload(int item_count) {
+    AtomicPointerPayload *payload = ok_mem(create_zero<AtomicPointerPayload>());
+    for (int i = 0; i < item_count; i += 1)
+        ok_or_panic(payload->items.append(i));
+    return payload;
+}
+
+static void test_atomic_pointer(void) {
+    atomic_pointer_destroyed_count = 0;
+    {
+        AtomicPointer<AtomicPointerPayload> ap;
+        assert(ap.get_read_ptr() == nullptr);
+
+        AtomicPointerPayload *first = create_atomic_pointer_payload(10);
+        ok_or_panic(ap.publish(first));
+        assert(ap.get_read_ptr() == first);
+
+        // the reader still holds first, so it waits
+        AtomicPointerPayload *second = create_atomic_pointer_payload(20);
+        ok_or_panic(ap.publish(second));
+        assert(atomic_pointer_destroyed_count == 0);
+        ap.collect(false);
+        assert(atomic_pointer_destroyed_count == 0);
+
+        // pinning a later value lets it go
+        AtomicPointerPayload *read = ap.get_read_ptr();
+        assert(read == second);
+        assert(read->items.length() == 20);
+        ap.collect(false);
+        assert(atomic_pointer_destroyed_count == 1);
+
+        // values the reader never saw go at the next publish
+        ok_or_panic(ap.publish(create_atomic_pointer_payload(30)));
+        ok_or_panic(ap.publish(create_atomic_pointer_payload(40)));
+        assert(atomic_pointer_destroyed_count == 2);
+        ap.collect(true);
+        assert(atomic_pointer_destroyed_count == 3);
+        assert(ap.get_read_ptr()->items.length() == 40);
+    }
+    assert(atomic_pointer_destroyed_count == 4);
+}
+
+static void test_tempo_map(void) {
+    TempoMap tempo_map;
+    assert(tempo_map.change_count() == 0);
+    assert(tempo_map.whole_notes_per_minute_at(10.0) == TEMPO_MAP_DEFAULT_WHOLE_NOTES_PER_MINUTE);
+    assert(fabs(tempo_map.whole_notes_to_seconds(140.0) - 60.0) < 0.000001);
+    assert(fabs(tempo_map.seconds_to_whole_notes(30.0) - 70.0) < 0.000001);
+
+    // 60 a minute for 4 whole notes, then 120 for 8, then 30
+    GenesisTempoChange changes[] = {
+        {0.0, 60.0},
+        {4.0, 120.0},
+        {12.0, 30.0},
+    };
+    ok_or_panic(tempo_map.set(changes, array_length(changes)));
+    assert(tempo_map.change_count() == 3);
+    assert(tempo_map.change_at(1).whole_note == 4.0);
+    assert(tempo_map.change_at(1).whole_notes_per_minute == 120.0);
+    assert(tempo_map.whole_notes_per_minute_at(3.9) == 60.0);
+    assert(tempo_map.whole_notes_per_minute_at(4.0) == 120.0);
+    assert(tempo_map.whole_notes_per_minute_at(100.0) == 30.0);
+    assert(fabs(tempo_map.whole_notes_to_seconds(2.0) - 2.0) < 0.000001);
+    assert(fabs(tempo_map.whole_notes_to_seconds(8.0) - 6.0) < 0.000001);
+    assert(fabs(tempo_map.whole_notes_to_seconds(13.0) - 10.0) < 0.000001);
+    // before the first change the first tempo goes on
+    assert(fabs(tempo_map.whole_notes_to_seconds(-1.0) + 1.0) < 0.000001);
+    for (double whole_notes = -2.0; whole_notes < 20.0; whole_notes += 0.25) {
+        double seconds = tempo_map.whole_notes_to_seconds(whole_notes);
+        assert(fabs(tempo_map.seconds_to_whole_notes(seconds) - whole_notes) < 0.000001);
+    }
+
+    // out of order, not starting at 0, or a tempo that is not positive
+    GenesisTempoChange unordered[] = {{0.0, 60.0}, {4.0, 120.0}, {4.0, 30.0}};
+    GenesisTempoChange late[] = {{1.0, 60.0}};
+    GenesisTempoChange stopped[] = {{0.0, 60.0}, {4.0, 0.0}};
+    assert(tempo_map.set(unordered, array_length(unordered)) == GenesisErrorInvalidParam);
+    assert(tempo_map.set(late, array_length(late)) == GenesisErrorInvalidParam);
+    assert(tempo_map.set(stopped, array_length(stopped)) == GenesisErrorInvalidParam);
+    assert(tempo_map.change_count() == 3);
+
+    ok_or_panic(tempo_map.set(nullptr, 0));
+    assert(tempo_map.whole_notes_per_minute_at(10.0) == TEMPO_MAP_DEFAULT_WHOLE_NOTES_PER_MINUTE);
+}
+
+static void test_event_timeline(void) {
+    static const int event_count = 200;
+    EventTimelineEvent events[event_count];
+    memset(events, 0, sizeof(events));
+    for (int i = 0; i < event_count; i += 1) {
+        events[i].midi.event_type = GenesisMidiEventTypeSegment;
+        events[i].midi.start = i;
+        events[i].midi.data.segment_data.start = i * 10;
+        events[i].midi.data.segment_data.end = i * 10 + 5;
+        events[i].end = i + 0.5;
+    }
+
+    EventTimeline timeline;
+    ok_or_panic(event_timeline_init(&timeline));
+    ok_or_panic(event_timeline_publish(&timeline, events, event_count));
+    EventTimelineVersion *first = event_timeline_read(&timeline);
+    assert(first->chunk_count == 4);
+    assert(first->chunks[0]->event_count == 50);
+    assert(event_timeline_find_chunk(first, 120.5) == 2);
+    assert(event_timeline_find_chunk(first, 500.0) == 4);
+    assert(event_timeline_find_overlap(first, 120.5) == 2);
+
+    // the same events publish nothing
+    ok_or_panic(event_timeline_publish(&timeline, events, event_count));
+    assert(timeline.current.load() == first);
+
+    // one changed event replaces only its own chunk
+    events[120].midi.data.segment_data.end += 1;
+    ok_or_panic(event_timeline_publish(&timeline, events, event_count));
+    EventTimelineVersion *second = timeline.current.load();
+    assert(second != first);
+    assert(second->chunk_count == 4);
+    assert(second->chunks[0] == first->chunks[0]);
+    assert(second->chunks[1] == first->chunks[1]);
+    assert(second->chunks[2] != first->chunks[2]);
+    assert(second->chunks[3] == first->chunks[3]);
+    assert(second->chunks[2]->events[20].midi.data.segment_data.end == 1206);
+
+    // a long event reaches over the chunks after its own
+    events[10].end = 160.0;
+    ok_or_panic(event_timeline_publish(&timeline, events, event_count));
+    EventTimelineVersion *third = timeline.current.load();
+    assert(event_timeline_find_overlap(third, 120.5) == 0);
+    assert(event_timeline_find_overlap(third, 170.0) == 3);
+
+    // the first version stays until the reader moves on
+    assert(timeline.retired.length() == 1);
+    event_timeline_collect(&timeline, false);
+    assert(timeline.retired.length() == 1);
+    assert(event_timeline_read(&timeline) == third);
+    event_timeline_collect(&timeline, false);
+    assert(timeline.retired.length() == 0);
+
+    event_timeline_deinit(&timeline);
+}
 
 static void test_atomic_double(void) {
     AtomicDouble x;
@@ -459,6 +3192,424 @@ static void test_atomic_double(void) {
     assert(x.load() == 13.0);
 }
 
+static const int steal_item_count = 10000;
+static WorkStealingDeque<int *> steal_deque;
+static atomic_int steal_taken[steal_item_count];
+static atomic_bool steal_done;
+
+static void steal_thread_run(void *userdata) {
+    while (!steal_done || !steal_deque.is_empty()) {
+        int *item = steal_deque.steal();
+        if (item)
+            steal_taken[item - (int *)userdata] += 1;
+    }
+}
+
+static void test_denormals(void) {
+#if defined(GENESIS_DENORMALS_SSE) || defined(GENESIS_DENORMALS_AARCH64)
+    bool old_flush = denormals_get_flush();
+    // its square is denormal
+    volatile float tiny = 1e-20f;
+
+    denormals_set_flush(false);
+    assert(!denormals_get_flush());
+    denormals_clear_flags();
+    assert(!denormals_flagged());
+    volatile float result = tiny * tiny * 1e15f;
+    assert(result != 0.0f);
+    assert(denormals_flagged());
+
+    // flushed results are still flagged, so that they can be counted
+    denormals_set_flush(true);
+    assert(denormals_get_flush());
+    denormals_clear_flags();
+    result = tiny * tiny * 1e15f;
+    assert(result == 0.0f);
+    assert(denormals_flagged());
+
+    denormals_set_flush(old_flush);
+#endif
+}
+
+static void test_note_store(void) {
+    NoteStore *store = create<NoteStore>();
+    note_store_init(store);
+
+    // a long note, then many short ones after it in the same lane
+    NoteStoreNote long_note = {0.0, 8.0, 60, 100};
+    ok_or_panic(note_store_add(store, long_note));
+    for (int i = 0; i < 1000; i += 1) {
+        NoteStoreNote note = {i * 0.25, i * 0.25 + 0.125, 60 + (i % 3), 90};
+        ok_or_panic(note_store_add(store, note));
+    }
+    assert(store->note_count == 1001);
+
+    List<NoteStoreNote> notes;
+    ok_or_panic(note_store_query(store, 100.0, 101.0, 60, 60, notes));
+    // only the note at 100.5 is in pitch 60. the long note ended long ago.
+    assert(notes.length() == 1);
+    assert(notes.at(0).start == 100.5);
+
+    notes.clear();
+    ok_or_panic(note_store_query(store, 7.9, 8.1, 0, 127, notes));
+    // the long note, which started before the window, and the one at 8.0
+    assert(notes.length() == 2);
+    assert(notes.at(0).pitch == 60 && notes.at(0).start == 0.0);
+    assert(notes.at(1).pitch == 62 && notes.at(1).start == 8.0);
+
+    // the latest starting note wins where two sound at once
+    const NoteStoreNote *found = note_store_find(store, 60, 5.3);
+    assert(found && found->start == 5.25);
+    found = note_store_find(store, 60, 5.4);
+    assert(found && found->start == 0.0 && found->end == 8.0);
+    assert(!note_store_find(store, 61, 5.4));
+    assert(!note_store_find(store, 64, 5.3));
+
+    assert(note_store_remove(store, long_note));
+    assert(!note_store_remove(store, long_note));
+    assert(store->note_count == 1000);
+    assert(!note_store_find(store, 60, 5.4));
+
+    notes.clear();
+    ok_or_panic(note_store_query(store, 0.0, 1.0, 60, 60, notes));
+    assert(notes.length() == 2);
+
+    destroy(store, 1);
+}
+
+static void test_work_stealing_deque(void) {
+    WorkStealingDeque<int *> deque;
+    ok_or_panic(deque.resize(4));
+    int items[steal_item_count];
+
+    assert(deque.pop() == nullptr);
+    assert(deque.steal() == nullptr);
+
+    deque.push(&items[0]);
+    deque.push(&items[1]);
+    deque.push(&items[2]);
+    assert(deque.pop() == &items[2]);
+    assert(deque.steal() == &items[0]);
+    assert(deque.pop() == &items[1]);
+    assert(deque.pop() == nullptr);
+
+    // wraparound
+    for (int i = 0; i < 10; i += 1) {
+        deque.push(&items[i]);
+        deque.push(&items[i + 1]);
+        assert(deque.steal() == &items[i]);
+        assert(deque.pop() == &items[i + 1]);
+    }
+    assert(deque.is_empty());
+
+    // every item is taken exactly once while thieves race the owner
+    ok_or_panic(steal_deque.resize(steal_item_count));
+    steal_done = false;
+    OsThread *threads[3];
+    for (int i = 0; i < array_length(threads); i += 1)
+        ok_or_panic(os_thread_create(steal_thread_run, items, false, &threads[i]));
+    for (int i = 0; i < steal_item_count; i += 1) {
+        steal_deque.push(&items[i]);
+        if (i % 3 == 0) {
+            int *item = steal_deque.pop();
+            if (item)
+                steal_taken[item - items] += 1;
+        }
+    }
+    for (;;) {
+        int *item = steal_deque.pop();
+        if (!item)
+            break;
+        steal_taken[item - items] += 1;
+    }
+    steal_done = true;
+    for (int i = 0; i < array_length(threads); i += 1)
+        os_thread_destroy(threads[i]);
+    for (int i = 0; i < steal_item_count; i += 1)
+        assert(steal_taken[i] == 1);
+}
+
+// the order the jobs ran in, by the id each was given
+static atomic_int job_run_order[8];
+static atomic_int job_run_count;
+static atomic_bool job_started;
+static atomic_bool job_blocker_release;
+static atomic_bool job_saw_cancel;
+
+static void job_record_run(Job *, void *userdata) {
+    int id = (int)(intptr_t)userdata;
+    job_run_order[job_run_count.fetch_add(1)] = id;
+}
+
+static void job_blocker_run(Job *job, void *) {
+    job_set_progress(job, 0.5f);
+    job_started = true;
+    while (!job_blocker_release)
+        usleep(1000);
+}
+
+static void job_wait_cancel_run(Job *job, void *) {
+    job_started = true;
+    while (!job_cancelled(job))
+        usleep(1000);
+    job_saw_cancel = true;
+}
+
+// keeps the one thread busy until job_blocker_release
+static Job *submit_job_blocker(JobGroup *group) {
+    job_started = false;
+    job_blocker_release = false;
+    job_run_count = 0;
+    Job *blocker;
+    ok_or_panic(job_submit(group, JobPriorityNormal, job_blocker_run, nullptr, nullptr, 0, &blocker));
+    while (!job_started)
+        usleep(1000);
+    return blocker;
+}
+
+static void test_job_system(void) {
+    OsThreadAttributes attributes = {OsThreadPolicyNormal, 0, 0};
+    JobSystem *job_system;
+    ok_or_panic(job_system_create(&attributes, 1, &job_system));
+    EventDispatcher events;
+    int progress_event_count = 0;
+    events.attach_handler(EventProjectAudioAssetLoadProgress, on_audio_asset_loaded, &progress_event_count);
+    JobGroup *group;
+    ok_or_panic(job_group_create(job_system, &events, EventProjectAudioAssetLoadProgress, &group));
+    int finished_count;
+    int total_count;
+
+    // queued jobs go by priority, then in the order submitted
+    Job *blocker = submit_job_blocker(group);
+    ok_or_panic(job_submit(group, JobPriorityLow, job_record_run, (void *)1, nullptr, 0, nullptr));
+    ok_or_panic(job_submit(group, JobPriorityNormal, job_record_run, (void *)2, nullptr, 0, nullptr));
+    ok_or_panic(job_submit(group, JobPriorityHigh, job_record_run, (void *)3, nullptr, 0, nullptr));
+    ok_or_panic(job_submit(group, JobPriorityNormal, job_record_run, (void *)4, nullptr, 0, nullptr));
+    double progress = job_group_progress(group, &finished_count, &total_count);
+    assert(finished_count == 0 && total_count == 5);
+    assert(progress == 0.5 / 5);
+    assert(!job_finished(blocker));
+    job_blocker_release = true;
+    job_group_wait(group);
+    assert(job_finished(blocker));
+    job_release(blocker);
+    assert(job_run_count == 4);
+    assert(job_run_order[0] == 3 && job_run_order[1] == 2);
+    assert(job_run_order[2] == 4 && job_run_order[3] == 1);
+    progress = job_group_progress(group, &finished_count, &total_count);
+    assert(finished_count == 5 && total_count == 5 && progress == 1.0);
+    job_group_flush_events(group);
+    assert(progress_event_count == 1);
+    job_group_flush_events(group);
+    assert(progress_event_count == 1);
+
+    // a job waits for each of its dependencies, whatever its priority
+    blocker = submit_job_blocker(group);
+    Job *first;
+    Job *second;
+    ok_or_panic(job_submit(group, JobPriorityLow, job_record_run, (void *)1, nullptr, 0, &first));
+    ok_or_panic(job_submit(group, JobPriorityHigh, job_record_run, (void *)2, &first, 1, &second));
+    Job *both[] = {first, second};
+    ok_or_panic(job_submit(group, JobPriorityHigh, job_record_run, (void *)3, both, 2, nullptr));
+    ok_or_panic(job_submit(group, JobPriorityNormal, job_record_run, (void *)4, nullptr, 0, nullptr));
+    job_blocker_release = true;
+    job_group_wait(group);
+    assert(job_run_count == 4);
+    assert(job_run_order[0] == 4 && job_run_order[1] == 1);
+    assert(job_run_order[2] == 2 && job_run_order[3] == 3);
+    job_group_progress(group, &finished_count, &total_count);
+    assert(finished_count == 5 && total_count == 5);
+    job_release(blocker);
+    job_release(first);
+    job_release(second);
+
+    // cancelling a queued job cancels what depends on it, and neither runs
+    blocker = submit_job_blocker(group);
+    ok_or_panic(job_submit(group, JobPriorityNormal, job_record_run, (void *)1, nullptr, 0, &first));
+    ok_or_panic(job_submit(group, JobPriorityHigh, job_record_run, (void *)2, &first, 1, &second));
+    ok_or_panic(job_submit(group, JobPriorityLow, job_record_run, (void *)3, nullptr, 0, nullptr));
+    job_cancel(first);
+    assert(job_finished(first) && job_finished(second));
+    job_blocker_release = true;
+    job_group_wait(group);
+    assert(job_run_count == 1 && job_run_order[0] == 3);
+    // nor does a job submitted after its dependency was cancelled
+    ok_or_panic(job_submit(group, JobPriorityHigh, job_record_run, (void *)4, &first, 1, nullptr));
+    job_group_wait(group);
+    assert(job_run_count == 1);
+    job_release(blocker);
+    job_release(first);
+    job_release(second);
+
+    // a running job sees that it was cancelled, and its dependents never run
+    job_started = false;
+    job_saw_cancel = false;
+    ok_or_panic(job_submit(group, JobPriorityNormal, job_wait_cancel_run, nullptr, nullptr, 0, &first));
+    ok_or_panic(job_submit(group, JobPriorityHigh, job_record_run, (void *)5, &first, 1, nullptr));
+    while (!job_started)
+        usleep(1000);
+    job_group_cancel(group);
+    job_group_wait(group);
+    assert(job_saw_cancel);
+    assert(job_run_count == 1);
+    job_release(first);
+
+    job_group_destroy(group);
+    job_system_destroy(job_system);
+}
+
+// with the logger's mutex, which the sink is called with
+static char log_lines[16][256];
+static int log_line_count;
+static long log_counted_count;
+static long log_dropped_count;
+
+static void capture_log_line(void *, LogLevel, const char *line) {
+    long dropped;
+    if (sscanf(line, "warning: %ld log messages dropped", &dropped) == 1) {
+        log_dropped_count += dropped;
+    } else if (strncmp(line, "count ", 6) == 0) {
+        log_counted_count += 1;
+    } else if (log_line_count < array_length(log_lines)) {
+        snprintf(log_lines[log_line_count], sizeof(log_lines[0]), "%s", line);
+        log_line_count += 1;
+    }
+}
+
+static void log_thread_run(void *userdata) {
+    char name[16];
+    snprintf(name, sizeof(name), "thread %d", (int)(intptr_t)userdata);
+    log_message(LogLevelInfo, "from %s", name);
+    // the argument is copied, not pointed to
+    memset(name, 'x', sizeof(name) - 1);
+}
+
+static void test_logger(void) {
+    log_set_sink(capture_log_line, nullptr);
+    log_flush();
+    log_line_count = 0;
+
+    char text[8] = "abc";
+    size_t size = 12;
+    log_message(LogLevelWarning, "%s %5.2f %ld %zu %x %c %% %*d.", text, 3.14159, -7L, size, 255u, 'q', 4, 9);
+    strcpy(text, "zzz");
+    log_message(LogLevelError, "%p", (void *)nullptr);
+    log_message(LogLevelInfo, "%s", "0123456789012345678901234567890123456789012345678901234567890123456789");
+    log_flush();
+    assert(log_line_count == 3);
+    assert(strcmp(log_lines[0], "warning: abc  3.14 -7 12 ff q %    9.\n") == 0);
+    char pointer[32];
+    snprintf(pointer, sizeof(pointer), "error: %p\n", (void *)nullptr);
+    assert(strcmp(log_lines[1], pointer) == 0);
+    assert(strlen(log_lines[2]) == LOG_TEXT_SIZE - 1 + 1);
+
+    // more threads than there are buffers, each giving its own back
+    log_line_count = 0;
+    for (int i = 0; i < 40; i += 1) {
+        OsThread *thread;
+        ok_or_panic(os_thread_create(log_thread_run, (void *)(intptr_t)i, false, &thread));
+        os_thread_destroy(thread);
+    }
+    log_flush();
+    assert(log_line_count == array_length(log_lines));
+    assert(strcmp(log_lines[0], "from thread 0\n") == 0);
+    assert(strcmp(log_lines[15], "from thread 15\n") == 0);
+
+    // past what the buffer holds, messages are counted instead
+    log_counted_count = 0;
+    log_dropped_count = 0;
+    int count = 5000;
+    for (int i = 0; i < count; i += 1)
+        log_message(LogLevelInfo, "count %d", i);
+    log_flush();
+    assert(log_dropped_count > 0);
+    assert(log_counted_count + log_dropped_count == count);
+
+    log_set_sink(nullptr, nullptr);
+}
+
+static void parallel_square(void *, int *item) {
+    *item = *item * *item;
+}
+
+static long parallel_to_long(void *, const int &item) {
+    return item;
+}
+
+static long parallel_add(long a, long b) {
+    return a + b;
+}
+
+static void fill_random_ints(List<int> &list, int count) {
+    ok_or_panic(list.resize(count));
+    for (int i = 0; i < count; i += 1)
+        list.at(i) = (int)(os_random_uint32() % 10000);
+}
+
+static void assert_ascending(const List<int> &list) {
+    for (int i = 1; i < list.length(); i += 1)
+        assert(list.at(i - 1) <= list.at(i));
+}
+
+static JobSystem *parallel_job_system;
+
+// sorts from a pool thread, which takes chunks itself when no other
+// thread is free
+static void parallel_sort_job_run(Job *, void *userdata) {
+    List<int> *list = (List<int> *)userdata;
+    parallel_sort<int, compare_ints>(parallel_job_system, *list);
+}
+
+static void test_parallel(void) {
+    OsThreadAttributes attributes = {OsThreadPolicyNormal, 0, 0};
+    ok_or_panic(job_system_create(&attributes, 3, &parallel_job_system));
+    assert(parallel_chunk_count(parallel_job_system, PARALLEL_MIN_CHUNK_SIZE) == 1);
+    assert(parallel_chunk_count(nullptr, 1000000) == 1);
+    assert(parallel_chunk_count(parallel_job_system, 1000000) == 16);
+
+    // sizes around the chunk boundaries, with a run left over that has no
+    // pair to merge with
+    int counts[] = {0, 1, 100, PARALLEL_MIN_CHUNK_SIZE * 2, PARALLEL_MIN_CHUNK_SIZE * 5 + 3, 200001};
+    for (int i = 0; i < array_length(counts); i += 1) {
+        List<int> list;
+        fill_random_ints(list, counts[i]);
+        long sum = 0;
+        for (int j = 0; j < list.length(); j += 1)
+            sum += list.at(j);
+        parallel_sort<int, compare_ints>(parallel_job_system, list);
+        assert(list.length() == counts[i]);
+        assert_ascending(list);
+        assert((parallel_reduce<int, long, parallel_to_long, parallel_add>(
+                        parallel_job_system, list, 0, nullptr)) == sum);
+
+        List<long> longs;
+        ok_or_panic((parallel_transform<int, long, parallel_to_long>(parallel_job_system, list, longs, nullptr)));
+        assert(longs.length() == list.length());
+        for (int j = 0; j < list.length(); j += 1)
+            assert(longs.at(j) == list.at(j));
+
+        parallel_for_each<int, parallel_square>(parallel_job_system, list, nullptr);
+        for (int j = 0; j < list.length(); j += 1)
+            assert(list.at(j) == longs.at(j) * longs.at(j));
+    }
+
+    // from jobs of the same job system, more of them than it has threads
+    JobGroup *group;
+    ok_or_panic(job_group_create(parallel_job_system, nullptr, EventFlushEvents, &group));
+    List<int> lists[5];
+    for (int i = 0; i < array_length(lists); i += 1) {
+        fill_random_ints(lists[i], 50000);
+        ok_or_panic(job_submit(group, JobPriorityNormal, parallel_sort_job_run, &lists[i], nullptr, 0, nullptr));
+    }
+    job_group_wait(group);
+    for (int i = 0; i < array_length(lists); i += 1)
+        assert_ascending(lists[i]);
+    job_group_destroy(group);
+
+    job_system_destroy(parallel_job_system);
+    parallel_job_system = nullptr;
+}
+
 static void test_mirrored_memory(void) {
     struct OsMirroredMemory mem;
 
@@ -476,6 +3627,406 @@ static void test_mirrored_memory(void) {
     os_deinit_mirrored_memory(&mem);
 }
 
+static bool is_float_format(SoundIoFormat format) {
+    return format == SoundIoFormatFloat32NE || format == SoundIoFormatFloat32FE ||
+        format == SoundIoFormatFloat64NE || format == SoundIoFormatFloat64FE;
+}
+
+static void test_sample_format(void) {
+    // not a multiple of any vector width, so the scalar tails run too
+    static const int frame_count = 35;
+    static const int channel_count = 2;
+    static const int sample_count = frame_count * channel_count;
+    float src[sample_count];
+    for (int i = 0; i < sample_count; i += 1)
+        src[i] = -1.5f + 3.0f * i / (sample_count - 1);
+    src[1] = -1.0f;
+    src[2] = 0.0f;
+    src[3] = 1.0f;
+
+    char expected[sample_count * 8];
+    char actual[sample_count * 8];
+    float expected_floats[sample_count];
+    float actual_floats[sample_count];
+
+    static const SampleFormatSimd simds[] = {
+        SampleFormatSimdSse2,
+        SampleFormatSimdAvx2,
+        SampleFormatSimdNeon,
+    };
+    for (int i = 0; i < sample_format_info_count(); i += 1) {
+        const SampleFormatInfo *info = sample_format_info_at(i);
+        int bytes = info->bytes_per_sample;
+
+        sample_format_select_simd(SampleFormatSimdNone);
+        info->write_samples(expected, src, sample_count);
+        info->read_samples(expected_floats, expected, sample_count);
+        float tolerance = (bytes == 1) ? 0.01f : (bytes == 2) ? 0.0001f : 0.000001f;
+        for (int j = 0; j < sample_count; j += 1) {
+            float value = is_float_format(info->format) ? src[j] : clamp(-1.0f, src[j], 1.0f);
+            assert(fabsf(expected_floats[j] - value) <= tolerance);
+        }
+
+        // simd versions must match the scalar ones exactly
+        for (int simd_index = 0; simd_index < array_length(simds); simd_index += 1) {
+            if (!sample_format_simd_supported(simds[simd_index]))
+                continue;
+            sample_format_select_simd(simds[simd_index]);
+            info->write_samples(actual, src, sample_count);
+            assert(memcmp(actual, expected, sample_count * bytes) == 0);
+            info->read_samples(actual_floats, expected, sample_count);
+            assert(memcmp(actual_floats, expected_floats, sizeof(expected_floats)) == 0);
+        }
+        sample_format_select_simd(sample_format_best_simd());
+
+        // interleaved areas
+        SoundIoChannelArea areas[channel_count];
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            areas[ch].ptr = actual + ch * bytes;
+            areas[ch].step = channel_count * bytes;
+        }
+        memset(actual, 0, sizeof(actual));
+        sample_format_write_areas(info, areas, channel_count, src, frame_count);
+        assert(memcmp(actual, expected, sample_count * bytes) == 0);
+        sample_format_read_areas(info, areas, channel_count, actual_floats, frame_count);
+        assert(memcmp(actual_floats, expected_floats, sizeof(expected_floats)) == 0);
+
+        // one buffer per channel
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            areas[ch].ptr = actual + ch * frame_count * bytes;
+            areas[ch].step = bytes;
+        }
+        sample_format_write_areas(info, areas, channel_count, src, frame_count);
+        for (int frame = 0; frame < frame_count; frame += 1) {
+            for (int ch = 0; ch < channel_count; ch += 1) {
+                assert(memcmp(areas[ch].ptr + frame * bytes,
+                            expected + (frame * channel_count + ch) * bytes, bytes) == 0);
+            }
+        }
+        memset(actual_floats, 0, sizeof(actual_floats));
+        sample_format_read_areas(info, areas, channel_count, actual_floats, frame_count);
+        assert(memcmp(actual_floats, expected_floats, sizeof(expected_floats)) == 0);
+    }
+}
+
+static void test_dsp_kernels(void) {
+    // odd so that every vector width leaves a scalar tail
+    static const int tap_count = 37;
+    static const int window_stride = 50;
+    static const int frame_count = 21;
+    float filters[2 * tap_count];
+    for (int i = 0; i < 2 * tap_count; i += 1)
+        filters[i] = sinf(i * 0.37f);
+    float windows[GENESIS_MAX_CHANNELS * window_stride];
+    for (int i = 0; i < array_length(windows); i += 1)
+        windows[i] = cosf(i * 0.11f);
+
+    // the specialized channel counts and some that use the generic kernels
+    static const int channel_counts[] = {1, 2, 3, 6, 8, GENESIS_MAX_CHANNELS};
+    for (int i = 0; i < array_length(channel_counts); i += 1) {
+        int channel_count = channel_counts[i];
+        const DspChannelKernels *kernels = dsp_channel_kernels(channel_count);
+
+        float out_frame[GENESIS_MAX_CHANNELS];
+        float out_frame_lerp[GENESIS_MAX_CHANNELS];
+        kernels->fir_frame(channel_count, out_frame, filters, windows, window_stride, tap_count);
+        kernels->fir_frame_lerp(channel_count, out_frame_lerp, filters, 0.25f,
+                windows, window_stride, tap_count);
+        for (int ch = 0; ch < channel_count; ch += 1) {
+            double expected = 0.0;
+            double expected_lerp = 0.0;
+            for (int k = 0; k < tap_count; k += 1) {
+                double sample = windows[ch * window_stride + k];
+                double coefficient = filters[k] + (filters[tap_count + k] - filters[k]) * 0.25;
+                expected += filters[k] * sample;
+                expected_lerp += coefficient * sample;
+            }
+            assert(fabs(out_frame[ch] - expected) < 0.0001);
+            assert(fabs(out_frame_lerp[ch] - expected_lerp) < 0.0001);
+        }
+
+        float planar[GENESIS_MAX_CHANNELS * window_stride];
+        kernels->deinterleave(channel_count, planar, window_stride, windows, frame_count);
+        for (int frame = 0; frame < frame_count; frame += 1) {
+            for (int ch = 0; ch < channel_count; ch += 1)
+                assert(planar[ch * window_stride + frame] == windows[frame * channel_count + ch]);
+        }
+
+        float interleaved[GENESIS_MAX_CHANNELS * frame_count];
+        kernels->interleave(channel_count, interleaved, planar, window_stride, frame_count);
+        for (int j = 0; j < frame_count * channel_count; j += 1)
+            assert(interleaved[j] == windows[j]);
+
+        const float *srcs[GENESIS_MAX_CHANNELS];
+        for (int ch = 0; ch < channel_count; ch += 1)
+            srcs[ch] = planar + ch * window_stride;
+        float mixed[GENESIS_MAX_CHANNELS * frame_count];
+        for (int j = 0; j < frame_count * channel_count; j += 1)
+            mixed[j] = j;
+        kernels->interleave_add(channel_count, mixed, srcs, frame_count);
+        for (int j = 0; j < frame_count * channel_count; j += 1)
+            assert(mixed[j] == j + windows[j]);
+    }
+
+    double expected = 0.0;
+    for (int k = 0; k < tap_count; k += 1)
+        expected += filters[k] * windows[k];
+    assert(fabs(dsp_dot_product(filters, windows, tap_count) - expected) < 0.0001);
+
+    float product[tap_count];
+    dsp_multiply(product, filters, windows, tap_count);
+    for (int i = 0; i < tap_count; i += 1)
+        assert(fabs(product[i] - filters[i] * windows[i]) < 0.0001);
+    dsp_multiply_add(product, filters, windows, tap_count);
+    for (int i = 0; i < tap_count; i += 1)
+        assert(fabs(product[i] - 2.0 * filters[i] * windows[i]) < 0.0001);
+    float power[tap_count];
+    dsp_power_spectrum(power, filters, windows, tap_count);
+    for (int i = 0; i < tap_count; i += 1)
+        assert(fabs(power[i] - (filters[i] * filters[i] + windows[i] * windows[i])) < 0.0001);
+    // a quarter turn takes (re, im) to (-im, re)
+    float rotated_re[tap_count];
+    float rotated_im[tap_count];
+    memcpy(rotated_re, filters, sizeof(rotated_re));
+    memcpy(rotated_im, windows, sizeof(rotated_im));
+    dsp_complex_rotate(rotated_re, rotated_im, 0.0f, 1.0f, tap_count);
+    for (int i = 0; i < tap_count; i += 1) {
+        assert(fabs(rotated_re[i] + windows[i]) < 0.0001);
+        assert(fabs(rotated_im[i] - filters[i]) < 0.0001);
+    }
+
+    // stereo gains ramping in opposite directions
+    float mix[2 * frame_count];
+    for (int i = 0; i < 2 * frame_count; i += 1)
+        mix[i] = 1.0f;
+    float gains[2] = {0.0f, 1.0f};
+    float gain_steps[2] = {0.05f, -0.05f};
+    dsp_mix_add_gain(mix, windows, 2, gains, gain_steps, frame_count);
+    for (int frame = 0; frame < frame_count; frame += 1) {
+        assert(fabs(mix[2 * frame] - (1.0 + windows[2 * frame] * 0.05 * frame)) < 0.0001);
+        assert(fabs(mix[2 * frame + 1] - (1.0 + windows[2 * frame + 1] * (1.0 - 0.05 * frame))) < 0.0001);
+    }
+    assert(fabs(gains[0] - 0.05 * frame_count) < 0.0001);
+    assert(fabs(gains[1] - (1.0 - 0.05 * frame_count)) < 0.0001);
+
+    float line[tap_count];
+    float delay_out[tap_count];
+    dsp_fractional_delay(delay_out, windows, line, filters, filters + 1, 0.25f, tap_count, 0.5f, -0.75f);
+    for (int i = 0; i < tap_count; i += 1) {
+        double delayed = filters[i] + (filters[i + 1] - filters[i]) * 0.25;
+        assert(fabs(delay_out[i] - (windows[i] + 0.5 * delayed)) < 0.0001);
+        assert(fabs(line[i] - (windows[i] - 0.75 * delayed)) < 0.0001);
+    }
+
+    static const int table_bits = 10;
+    static const int table_size = 1 << table_bits;
+    float table[table_size + 1];
+    for (int i = 0; i <= table_size; i += 1)
+        table[i] = sin(2.0 * M_PI * i / table_size);
+    float oscillator[tap_count];
+    for (int i = 0; i < tap_count; i += 1)
+        oscillator[i] = 1.0f;
+    // starts near the end of the table so that it wraps
+    uint32_t start_phase = 0xfff00000u;
+    uint32_t phase = start_phase;
+    uint32_t increment = 0x01234567u;
+    dsp_wavetable_add(oscillator, table, table_bits, &phase, increment, 0.5f, 0.01f, tap_count);
+    assert(phase == start_phase + (uint32_t)tap_count * increment);
+    for (int i = 0; i < tap_count; i += 1) {
+        uint32_t sample_phase = start_phase + (uint32_t)i * increment;
+        double sample = sin(2.0 * M_PI * (sample_phase / 4294967296.0));
+        assert(fabs(oscillator[i] - (1.0 + sample * (0.5 + 0.01 * i))) < 0.0001);
+    }
+}
+
+// the arithmetic of the decoder before it had vector kernels
+static float reference_import_sample(double sample, double min, double max) {
+    double half_range = max / 2.0 - min / 2.0;
+    return (sample - min) / half_range - 1.0;
+}
+
+static void test_dsp_import(void) {
+    // odd so that every vector width leaves a scalar tail
+    static const int frame_count = 37;
+    static const int channel_counts[] = {1, 2, 3, 6, GENESIS_MAX_CHANNELS};
+    static const int sample_count = GENESIS_MAX_CHANNELS * frame_count;
+    uint8_t uint8_src[sample_count];
+    int16_t int16_src[sample_count];
+    int32_t int32_src[sample_count];
+    float float_src[sample_count];
+    double double_src[sample_count];
+    for (int i = 0; i < sample_count; i += 1) {
+        uint32_t bits = (uint32_t)i * 2654435761u;
+        uint8_src[i] = bits >> 24;
+        int16_src[i] = (int16_t)(bits >> 16);
+        int32_src[i] = (int32_t)bits;
+        double_src[i] = sin(i * 0.3);
+        float_src[i] = double_src[i];
+    }
+    int16_src[0] = INT16_MIN;
+    int16_src[1] = INT16_MAX;
+    int32_src[0] = INT32_MIN;
+    int32_src[1] = INT32_MAX;
+
+    float planar[GENESIS_MAX_CHANNELS][frame_count];
+    float *dests[GENESIS_MAX_CHANNELS];
+    for (int ch = 0; ch < GENESIS_MAX_CHANNELS; ch += 1)
+        dests[ch] = planar[ch];
+    for (int i = 0; i < array_length(channel_counts); i += 1) {
+        int channel_count = channel_counts[i];
+        dsp_import_uint8(dests, uint8_src, channel_count, frame_count);
+        for (int frame = 0; frame < frame_count; frame += 1) {
+            for (int ch = 0; ch < channel_count; ch += 1) {
+                float expected = reference_import_sample(uint8_src[frame * channel_count + ch], 0.0, UINT8_MAX);
+                assert(fabsf(planar[ch][frame] - expected) < 0.0000002f);
+            }
+        }
+        dsp_import_int16(dests, int16_src, channel_count, frame_count);
+        for (int frame = 0; frame < frame_count; frame += 1) {
+            for (int ch = 0; ch < channel_count; ch += 1) {
+                float expected = reference_import_sample(int16_src[frame * channel_count + ch],
+                        INT16_MIN, INT16_MAX);
+                assert(fabsf(planar[ch][frame] - expected) < 0.0000002f);
+            }
+        }
+        dsp_import_int32(dests, int32_src, channel_count, frame_count);
+        for (int frame = 0; frame < frame_count; frame += 1) {
+            for (int ch = 0; ch < channel_count; ch += 1) {
+                float expected = reference_import_sample(int32_src[frame * channel_count + ch],
+                        INT32_MIN, INT32_MAX);
+                assert(fabsf(planar[ch][frame] - expected) < 0.0000002f);
+            }
+        }
+        dsp_import_float(dests, float_src, channel_count, frame_count);
+        for (int frame = 0; frame < frame_count; frame += 1) {
+            for (int ch = 0; ch < channel_count; ch += 1)
+                assert(planar[ch][frame] == float_src[frame * channel_count + ch]);
+        }
+        dsp_import_double(dests, double_src, channel_count, frame_count);
+        for (int frame = 0; frame < frame_count; frame += 1) {
+            for (int ch = 0; ch < channel_count; ch += 1)
+                assert(planar[ch][frame] == (float)double_src[frame * channel_count + ch]);
+        }
+    }
+
+    // 24 bit samples in the top of 32 bit ones survive being made compact
+    static const double int32_half_range = ((double)INT32_MAX - (double)INT32_MIN) / 2.0;
+    static const int32_t int24_samples[] = {-8388608, -8388607, -1, 0, 1, 4194305, 8388606, 8388607};
+    int32_t shifted[array_length(int24_samples)];
+    for (int i = 0; i < array_length(int24_samples); i += 1)
+        shifted[i] = int24_samples[i] * 256;
+    dsp_import_int32(dests, shifted, 1, array_length(shifted));
+    for (int i = 0; i < array_length(int24_samples); i += 1)
+        assert(lrint((planar[0][i] * int32_half_range - 0.5) / 256.0) == int24_samples[i]);
+}
+
+static void test_dsp_export(void) {
+    // odd so that every vector width leaves a scalar tail, and past full
+    // scale on both ends so that the samples clip
+    static const int count = 37;
+    float src[count];
+    for (int i = 0; i < count; i += 1)
+        src[i] = sinf(i * 0.7f) * 1.2f;
+    src[0] = 1.0f;
+    src[1] = -1.0f;
+
+    uint8_t uint8_dest[count];
+    int16_t int16_dest[count];
+    int32_t int24_dest[count];
+    int32_t int32_dest[count];
+    double double_dest[count];
+    dsp_export_uint8(uint8_dest, src, count, nullptr);
+    dsp_export_int16(int16_dest, src, count, nullptr);
+    dsp_export_int24(int24_dest, src, count, nullptr);
+    dsp_export_int32(int32_dest, src, count);
+    dsp_export_double(double_dest, src, count);
+    for (int i = 0; i < count; i += 1) {
+        float sample = src[i];
+        assert(uint8_dest[i] == (uint8_t)clamp(0.0f, (sample * 127.5f) + 127.5f, (float)UINT8_MAX));
+        assert(int16_dest[i] == (int16_t)clamp((float)INT16_MIN, sample * 32767.0f, (float)INT16_MAX));
+        assert(int24_dest[i] == (int32_t)clamp(-8388608.0f, sample * 8388607.0f, 8388607.0f) * 256);
+        assert(int32_dest[i] == (int32_t)clamp((double)INT32_MIN, sample * 2147483647.0, (double)INT32_MAX));
+        assert(double_dest[i] == sample);
+    }
+    assert(int16_dest[0] == INT16_MAX);
+    assert(int16_dest[1] == -INT16_MAX);
+
+    // dithered, a level between two steps comes out as the nearest steps
+    // in proportion, where truncating would give the same step every time
+    static const int dither_count = 100003;
+    float *level = ok_mem(allocate_nonzero<float>(dither_count));
+    int16_t *dithered = ok_mem(allocate_nonzero<int16_t>(dither_count));
+    for (int i = 0; i < dither_count; i += 1)
+        level[i] = 10.3f / 32767.0f;
+    DspDither dither;
+    dsp_dither_init(&dither, 1);
+    dsp_export_int16(dithered, level, dither_count, &dither);
+    double sum = 0.0;
+    for (int i = 0; i < dither_count; i += 1) {
+        assert(dithered[i] >= 9 && dithered[i] <= 12);
+        sum += dithered[i];
+    }
+    assert(fabs(sum / dither_count - 10.3) < 0.01);
+    // and the noise goes on from where it left off
+    int16_t again[count];
+    dsp_export_int16(again, level, count, &dither);
+    dsp_dither_init(&dither, 1);
+    dsp_export_int16(int16_dest, level, count, &dither);
+    assert(memcmp(again, int16_dest, sizeof(again)) != 0);
+    destroy(dithered, dither_count);
+    destroy(level, dither_count);
+}
+
+static void test_fft(void) {
+    Fft *fft;
+    assert(fft_create(48, &fft) == GenesisErrorInvalidParam);
+    static const int size = 64;
+    ok_or_panic(fft_create(size, &fft));
+    int bin_count = fft_bin_count(fft);
+    assert(bin_count == size / 2 + 1);
+
+    float signal[size];
+    for (int i = 0; i < size; i += 1)
+        signal[i] = 0.25 + cos(2.0 * M_PI * 3 * i / size) + 0.5 * sin(2.0 * M_PI * 5 * i / size);
+    float re[size / 2 + 1];
+    float im[size / 2 + 1];
+    float work[size];
+    fft_forward(fft, signal, re, im, work);
+    for (int k = 0; k < bin_count; k += 1) {
+        float expected_re = (k == 0) ? 16.0f : (k == 3) ? 32.0f : 0.0f;
+        float expected_im = (k == 5) ? -16.0f : 0.0f;
+        assert(fabsf(re[k] - expected_re) < 0.001f);
+        assert(fabsf(im[k] - expected_im) < 0.001f);
+    }
+    float round_trip[size];
+    fft_inverse(fft, re, im, round_trip, work);
+    for (int i = 0; i < size; i += 1)
+        assert(fabsf(round_trip[i] - signal[i]) < 0.0001f);
+
+    // a product of spectra is a circular convolution
+    float a[size];
+    float b[size];
+    for (int i = 0; i < size; i += 1) {
+        a[i] = sin(i * 0.7) + 0.1 * i / size;
+        b[i] = (i < 8) ? 1.0f / (i + 1) : 0.0f;
+    }
+    float a_re[size / 2 + 1], a_im[size / 2 + 1], b_re[size / 2 + 1], b_im[size / 2 + 1];
+    fft_forward(fft, a, a_re, a_im, work);
+    fft_forward(fft, b, b_re, b_im, work);
+    float acc_re[size / 2 + 1] = {};
+    float acc_im[size / 2 + 1] = {};
+    fft_multiply_add(acc_re, acc_im, a_re, a_im, b_re, b_im, bin_count);
+    float convolved[size];
+    fft_inverse(fft, acc_re, acc_im, convolved, work);
+    for (int i = 0; i < size; i += 1) {
+        double expected = 0.0;
+        for (int j = 0; j < size; j += 1)
+            expected += a[j] * b[(i - j + size) % size];
+        assert(fabs(convolved[i] - expected) < 0.0001);
+    }
+    fft_destroy(fft);
+}
+
 struct Test {
     const char *name;
     void (*fn)(void);
@@ -483,10 +4034,19 @@ struct Test {
 
 static struct Test tests[] = {
     {"mirrored memory", test_mirrored_memory},
+    {"sample format conversion", test_sample_format},
+    {"dsp kernels", test_dsp_kernels},
+    {"dsp import", test_dsp_import},
+    {"dsp export", test_dsp_export},
+    {"fft", test_fft},
     {"ByteBuffer::split", test_bytebuffer_split},
     {"String::make_lower_case", test_string_make_lower_case},
+    {"String case tables", test_string_case_tables},
     {"List::remove_range", test_list_remove_range},
     {"List::insert_space", test_list_insert_space},
+    {"SmallList", test_small_list},
+    {"allocation debug", test_alloc_debug},
+    {"mirrored memory pool", test_mirrored_memory_pool},
     {"parse_color", test_parse_color},
     {"RingBuffer", test_ring_buffer},
     {"euclidean_mod", test_euclidean_mod},
@@ -494,20 +4054,69 @@ static struct Test tests[] = {
     {"greatest_common_denominator", test_gcd},
     {"sort keys basic", test_sort_keys_basic},
     {"sort keys count", test_sort_keys_count},
+    {"sort keys long", test_sort_keys_long},
     {"LockedQueue", test_locked_queue},
+    {"BoundedQueue", test_bounded_queue},
     {"crc32", test_crc32},
+    {"crc32c", test_crc32c},
+    {"lz4", test_lz4},
+    {"flac frame", test_flac_frame},
+    {"sha 256", test_sha_256},
     {"OrderedMapFile", test_ordered_map_file},
     {"os_get_time", test_os_get_time},
+    {"os_timestamp", test_os_timestamp},
+    {"os poll event", test_os_poll_event},
+    {"os thread attributes", test_os_thread_attributes},
+    {"os cpu topology", test_os_cpu_topology},
+    {"os copy", test_os_copy},
+    {"plugin bridge", test_plugin_bridge},
+    {"dir entry sort key", test_dir_entry_sort_key},
+    {"dir scanner", test_dir_scanner},
+    {"sample index", test_sample_index},
     {"uint256", test_uint256},
+    {"FlatHashMap", test_flat_hash_map},
     {"SettingsFile", test_settings_file},
     {"ByteBuffer::to_string", test_byte_buffer_to_string},
     {"List::sort", test_list_sort},
     {"basic project editing", test_basic_project_editing},
+    {"project replication", test_project_replication},
+    {"project open in parallel", test_project_parallel_open},
+    {"undo history limits", test_undo_history_limits},
+    {"track sort key rebalance", test_track_sort_key_rebalance},
+    {"event dispatcher deferred handlers", test_event_dispatcher_deferred},
+    {"audio file loading at project open", test_project_async_asset_loading},
+    {"audio asset cache", test_audio_asset_cache},
+    {"asset store", test_asset_store},
+    {"bulk audio asset import", test_bulk_audio_asset_import},
+    {"command merging", test_command_merging},
     {"String::compare", test_string_compare},
     {"basic audio file loading and saving", test_audio_file},
+    {"audio file reader", test_audio_file_reader},
+    {"loudness", test_loudness},
+    {"audio file sample storage", test_audio_file_sample_storage},
+    {"sample codec", test_sample_codec},
+    {"audio file decoded cache", test_audio_file_decoded_cache},
+    {"waveform peaks", test_waveform_peaks},
+    {"audio file loading by streaming", test_audio_file_streaming},
+    {"parallel audio file loading", test_audio_file_parallel_loading},
+    {"progressive audio file loading", test_audio_file_progressive_loading},
+    {"resample context", test_resample_context},
+    {"resample drift control", test_resample_drift_control},
+    {"time stretch", test_time_stretch},
+    {"render coordinator plan", test_render_coordinator_plan},
     {"os_path_extension", test_path_extension},
     {"AtomicValue", test_atomic_value},
+    {"AtomicPointer", test_atomic_pointer},
     {"AtomicDouble", test_atomic_double},
+    {"tempo map", test_tempo_map},
+    {"event timeline", test_event_timeline},
+    {"note store", test_note_store},
+    {"WorkStealingDeque", test_work_stealing_deque},
+    {"job system", test_job_system},
+    {"logger", test_logger},
+    {"parallel algorithms", test_parallel},
+    {"denormals", test_denormals},
+    {"pipeline", test_pipeline},
     {NULL, NULL},
 };
 
@@ -518,6 +4127,12 @@ static void exec_test(struct Test *test) {
 }
 
 int main(int argc, char *argv[]) {
+    // the plugin bridge test starts this program again as its plugin host
+    if (plugin_bridge_is_host_command(argc, argv)) {
+        ok_or_panic(os_init(nullptr));
+        return plugin_bridge_serve(argc, argv, &test_gain_effect);
+    }
+
     // Do all the one-time initialization stuff.
     GenesisContext *context;
     ok_or_panic(genesis_context_create(&context));